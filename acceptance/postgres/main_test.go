@@ -80,6 +80,21 @@ type Config struct {
 	WaitForStartInterval    time.Duration `env:"WAIT_FOR_START_INTERVAL,default=2s"`
 	PostgresPort            int           `env:"POSTGRES_PORT,default=5432"`
 	ExpectedPostgresVersion string        `env:"EXPECTED_POSTGRES_VERSION,required"`
+
+	BenchmarkName         string        `env:"BENCHMARK_NAME,default=clickbench"`
+	BenchmarkSuiteDir     string        `env:"BENCHMARK_SUITE_DIR,default="`
+	BenchmarkData         []string      `env:"BENCHMARK_DATA,default="`
+	BenchmarkRows         int64         `env:"BENCHMARK_ROWS,default=0"`
+	BenchmarkSettings     []string      `env:"BENCHMARK_SETTINGS,default="`
+	BenchmarkTries        int           `env:"BENCHMARK_TRIES,default=3"`
+	BenchmarkCold         bool          `env:"BENCHMARK_COLD,default=true"`
+	BenchmarkQueryTimeout time.Duration `env:"BENCHMARK_QUERY_TIMEOUT,default=10m"`
+	BenchmarkOutput       string        `env:"BENCHMARK_OUTPUT,default=benchmark.json"`
+
+	PerformanceBaselines       string  `env:"PERFORMANCE_BASELINES,default=../fixtures/performance_baselines.json"`
+	PerformanceUpdateBaselines bool    `env:"PERFORMANCE_UPDATE_BASELINES,default=false"`
+	PerformanceTolerance       float64 `env:"PERFORMANCE_TOLERANCE,default=0.25"`
+	PerformanceTries           int     `env:"PERFORMANCE_TRIES,default=5"`
 }
 
 var config Config
@@ -293,3 +308,50 @@ func Test_PostgresUpgrade(t *testing.T) {
 
 	shared.RunUpgradeTests(t, context.Background(), &c)
 }
+
+func Test_PostgresPerformance(t *testing.T) {
+	shared.RunPerformanceTests(
+		t,
+		context.Background(),
+		&postgresAcceptanceCompose{config: config},
+		shared.PerformanceSuite{
+			Baselines:       config.PerformanceBaselines,
+			UpdateBaselines: config.PerformanceUpdateBaselines,
+			Tolerance:       config.PerformanceTolerance,
+			Tries:           config.PerformanceTries,
+		},
+	)
+}
+
+func Test_PostgresBenchmark(t *testing.T) {
+	if config.BenchmarkSuiteDir == "" {
+		t.Skip("BENCHMARK_SUITE_DIR is not set")
+	}
+
+	data, err := shared.ParseBenchmarkData(config.BenchmarkData)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	output := config.BenchmarkOutput
+	if !filepath.IsAbs(output) && config.ArtifactDir != "" {
+		output = filepath.Join(config.ArtifactDir, output)
+	}
+
+	shared.RunBenchmarks(
+		t,
+		context.Background(),
+		&postgresAcceptanceCompose{config: config},
+		shared.BenchmarkSuite{
+			Name:         config.BenchmarkName,
+			Dir:          config.BenchmarkSuiteDir,
+			Data:         data,
+			Rows:         config.BenchmarkRows,
+			Settings:     config.BenchmarkSettings,
+			Tries:        config.BenchmarkTries,
+			Cold:         config.BenchmarkCold,
+			QueryTimeout: config.BenchmarkQueryTimeout,
+			Output:       output,
+		},
+	)
+}
@@ -0,0 +1,350 @@
+package shared
+
+import (
+	"bufio"
+	"compress/gzip"
+	"context"
+	"encoding/json"
+	"fmt"
+	"io"
+	"net/http"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"testing"
+	"time"
+
+	"github.com/jackc/pgx/v5"
+	"github.com/jackc/pgx/v5/pgxpool"
+)
+
+// A BenchmarkSuite describes a set of queries to time against data loaded
+// into a Hydra-based container, such as ClickBench or the warehouse suite.
+//
+// Dir must contain a create.sql that creates the tables of the suite and a
+// queries.sql with the queries to time, separated by semicolons.
+type BenchmarkSuite struct {
+	Name         string          // name of the suite, prefixes the benchmark names in the results
+	Dir          string          // directory with create.sql and queries.sql
+	Data         []BenchmarkData // files loaded into the tables after create.sql
+	Rows         int64           // maximum number of rows loaded from each file, 0 loads all of them
+	Settings     []string        // name=value settings applied with ALTER SYSTEM before the queries run
+	Tries        int             // number of warm runs of each query
+	Cold         bool            // whether to restart Postgres before the first run of each query
+	QueryTimeout time.Duration   // timeout of a single run of a query
+	Output       string          // path the results are written to as Bencher Metric Format JSON
+}
+
+// BenchmarkData is a file loaded into a table of a [BenchmarkSuite]. Source is
+// a path or an http(s) URL of a .tsv or .csv file, which may be gzipped.
+type BenchmarkData struct {
+	Table  string
+	Source string
+}
+
+// ParseBenchmarkData parses table=source pairs, like
+// hits=https://datasets.clickhouse.com/hits_compatible/hits.tsv.gz, into
+// [BenchmarkData].
+func ParseBenchmarkData(specs []string) ([]BenchmarkData, error) {
+	data := make([]BenchmarkData, 0, len(specs))
+	for _, spec := range specs {
+		table, source, ok := strings.Cut(strings.TrimSpace(spec), "=")
+		if !ok || table == "" || source == "" {
+			return nil, fmt.Errorf("benchmark data must be table=source, got %q", spec)
+		}
+
+		data = append(data, BenchmarkData{Table: table, Source: source})
+	}
+
+	return data, nil
+}
+
+// bencherMetric is a measure of a benchmark in the Bencher Metric Format.
+type bencherMetric struct {
+	Value      float64 `json:"value"`
+	LowerValue float64 `json:"lower_value"`
+	UpperValue float64 `json:"upper_value"`
+}
+
+// RunBenchmarks loads the data of a [BenchmarkSuite] into a fresh container of
+// the [DockerComposeManager], times each of its queries and writes the query
+// times in milliseconds to suite.Output.
+//
+// A cold run restarts Postgres first, so shared buffers and the columnar
+// cache are empty, but the page cache of the host is left as is. The warm
+// runs follow it without a restart.
+func RunBenchmarks(t *testing.T, ctx context.Context, cm DockerComposeManager, suite BenchmarkSuite) {
+	cm.StartCompose(t, ctx, cm.Image(), false)
+	t.Cleanup(func() {
+		cm.TerminateCompose(t, ctx, true)
+	})
+
+	queries, err := readBenchmarkQueries(filepath.Join(suite.Dir, "queries.sql"))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	createSQL, err := os.ReadFile(filepath.Join(suite.Dir, "create.sql"))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	pool := cm.PGPool()
+	if _, err := pool.Exec(ctx, string(createSQL)); err != nil {
+		t.Fatalf("unable to create the tables of %s: %s", suite.Name, err)
+	}
+
+	for _, data := range suite.Data {
+		start := time.Now()
+		rows, err := loadBenchmarkData(ctx, pool, data, suite.Rows)
+		if err != nil {
+			t.Fatalf("unable to load %s into %s: %s", data.Source, data.Table, err)
+		}
+
+		if _, err := pool.Exec(ctx, fmt.Sprintf("ANALYZE %s", pgx.Identifier{data.Table}.Sanitize())); err != nil {
+			t.Fatalf("unable to analyze %s: %s", data.Table, err)
+		}
+
+		t.Logf("Loaded %d rows into %s in %s", rows, data.Table, time.Since(start))
+	}
+
+	for _, setting := range suite.Settings {
+		name, value, ok := strings.Cut(setting, "=")
+		if !ok {
+			t.Fatalf("benchmark setting must be name=value, got %q", setting)
+		}
+
+		sql := fmt.Sprintf("ALTER SYSTEM SET %s = '%s'", pgx.Identifier{strings.TrimSpace(name)}.Sanitize(),
+			strings.ReplaceAll(strings.TrimSpace(value), "'", "''"))
+		if _, err := pool.Exec(ctx, sql); err != nil {
+			t.Fatalf("unable to apply setting %s: %s", setting, err)
+		}
+	}
+
+	// restart once so the settings apply and the first query does not find
+	// the loaded data in shared buffers
+	cm.TerminateCompose(t, ctx, false)
+	cm.StartCompose(t, ctx, cm.Image(), false)
+
+	results := make(map[string]map[string]bencherMetric)
+	var total time.Duration
+
+	for i, query := range queries {
+		name := fmt.Sprintf("%s/Q%d", suite.Name, i)
+		metrics := make(map[string]bencherMetric)
+
+		if suite.Cold && i > 0 {
+			cm.TerminateCompose(t, ctx, false)
+			cm.StartCompose(t, ctx, cm.Image(), false)
+		}
+
+		if suite.Cold {
+			elapsed, err := timeBenchmarkQuery(ctx, cm.PGPool(), query, suite.QueryTimeout)
+			if err != nil {
+				t.Errorf("%s failed: %s", name, err)
+				continue
+			}
+
+			metrics["cold-query-time"] = newBencherMetric([]time.Duration{elapsed})
+		}
+
+		var times []time.Duration
+		for try := 0; try < suite.Tries; try++ {
+			elapsed, err := timeBenchmarkQuery(ctx, cm.PGPool(), query, suite.QueryTimeout)
+			if err != nil {
+				t.Errorf("%s failed: %s", name, err)
+				break
+			}
+
+			times = append(times, elapsed)
+		}
+
+		if len(times) > 0 {
+			metrics["query-time"] = newBencherMetric(times)
+			total += medianDuration(times)
+		}
+
+		t.Logf("%s: %v", name, times)
+		results[name] = metrics
+	}
+
+	results[suite.Name] = map[string]bencherMetric{
+		"query-time": {
+			Value:      milliseconds(total),
+			LowerValue: milliseconds(total),
+			UpperValue: milliseconds(total),
+		},
+	}
+
+	output, err := json.MarshalIndent(results, "", "  ")
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if err := os.WriteFile(suite.Output, output, 0644); err != nil {
+		t.Fatalf("unable to write benchmark results: %s", err)
+	}
+
+	t.Logf("Wrote the results of %s to %s", suite.Name, suite.Output)
+}
+
+// readBenchmarkQueries returns the semicolon separated queries of a file.
+func readBenchmarkQueries(path string) ([]string, error) {
+	content, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+
+	var queries []string
+	for _, query := range strings.Split(string(content), ";") {
+		if query = strings.TrimSpace(query); query != "" {
+			queries = append(queries, query)
+		}
+	}
+
+	return queries, nil
+}
+
+// loadBenchmarkData copies at most maxRows rows of a file into its table and
+// returns how many rows were copied.
+func loadBenchmarkData(ctx context.Context, pool *pgxpool.Pool, data BenchmarkData, maxRows int64) (int64, error) {
+	source, err := openBenchmarkSource(ctx, data.Source)
+	if err != nil {
+		return 0, err
+	}
+	defer source.Close()
+
+	path := data.Source
+	var reader io.Reader = source
+	if strings.HasSuffix(path, ".gz") {
+		gzipReader, err := gzip.NewReader(source)
+		if err != nil {
+			return 0, err
+		}
+		defer gzipReader.Close()
+
+		reader = gzipReader
+		path = strings.TrimSuffix(path, ".gz")
+	}
+
+	var format string
+	switch filepath.Ext(path) {
+	case ".tsv":
+		format = "text"
+	case ".csv":
+		format = "csv"
+	default:
+		return 0, fmt.Errorf("unknown benchmark data format of %s, expected .tsv or .csv", data.Source)
+	}
+
+	if maxRows > 0 {
+		reader = &lineLimitReader{reader: bufio.NewReader(reader), remaining: maxRows}
+	}
+
+	conn, err := pool.Acquire(ctx)
+	if err != nil {
+		return 0, err
+	}
+	defer conn.Release()
+
+	tag, err := conn.Conn().PgConn().CopyFrom(ctx, reader,
+		fmt.Sprintf("COPY %s FROM STDIN WITH (FORMAT %s)", pgx.Identifier{data.Table}.Sanitize(), format))
+	if err != nil {
+		return 0, err
+	}
+
+	return tag.RowsAffected(), nil
+}
+
+// openBenchmarkSource opens a local file or downloads an http(s) URL.
+func openBenchmarkSource(ctx context.Context, source string) (io.ReadCloser, error) {
+	if !strings.HasPrefix(source, "http://") && !strings.HasPrefix(source, "https://") {
+		return os.Open(source)
+	}
+
+	req, err := http.NewRequestWithContext(ctx, http.MethodGet, source, nil)
+	if err != nil {
+		return nil, err
+	}
+
+	resp, err := http.DefaultClient.Do(req)
+	if err != nil {
+		return nil, err
+	}
+
+	if resp.StatusCode != http.StatusOK {
+		resp.Body.Close()
+		return nil, fmt.Errorf("unable to download %s: %s", source, resp.Status)
+	}
+
+	return resp.Body, nil
+}
+
+// lineLimitReader stops reading after a number of lines. Rows of a csv file
+// with quoted newlines span several lines, so those are cut short.
+type lineLimitReader struct {
+	reader    *bufio.Reader
+	remaining int64
+	line      []byte
+}
+
+func (r *lineLimitReader) Read(p []byte) (int, error) {
+	if len(r.line) == 0 {
+		if r.remaining == 0 {
+			return 0, io.EOF
+		}
+
+		line, err := r.reader.ReadBytes('\n')
+		if len(line) == 0 {
+			return 0, err
+		}
+
+		r.line = line
+		r.remaining--
+	}
+
+	n := copy(p, r.line)
+	r.line = r.line[n:]
+
+	return n, nil
+}
+
+// timeBenchmarkQuery runs a query and returns how long it took, including
+// reading all of its result.
+func timeBenchmarkQuery(ctx context.Context, pool *pgxpool.Pool, query string, timeout time.Duration) (time.Duration, error) {
+	if timeout > 0 {
+		var cancel context.CancelFunc
+		ctx, cancel = context.WithTimeout(ctx, timeout)
+		defer cancel()
+	}
+
+	start := time.Now()
+	if _, err := pool.Exec(ctx, query); err != nil {
+		return 0, err
+	}
+
+	return time.Since(start), nil
+}
+
+func newBencherMetric(times []time.Duration) bencherMetric {
+	sorted := append([]time.Duration(nil), times...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+
+	return bencherMetric{
+		Value:      milliseconds(sorted[len(sorted)/2]),
+		LowerValue: milliseconds(sorted[0]),
+		UpperValue: milliseconds(sorted[len(sorted)-1]),
+	}
+}
+
+func medianDuration(times []time.Duration) time.Duration {
+	sorted := append([]time.Duration(nil), times...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+
+	return sorted[len(sorted)/2]
+}
+
+func milliseconds(d time.Duration) float64 {
+	return float64(d) / float64(time.Millisecond)
+}
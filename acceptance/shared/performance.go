@@ -0,0 +1,366 @@
+package shared
+
+import (
+	"context"
+	"encoding/json"
+	"fmt"
+	"math"
+	"os"
+	"sort"
+	"strings"
+	"testing"
+	"time"
+
+	"github.com/jackc/pgx/v5/pgxpool"
+)
+
+// A PerformanceCase checks that a query over the generated performance
+// dataset keeps both the plan and the speedup an optimization of columnar
+// gives it, so accidentally disabling vectorization or qual pushdown fails
+// the acceptance tests instead of only showing up in the benchmarks.
+//
+// The speedup is the median time of the query with the Reference settings,
+// which turn the optimization off, divided by its median time without them.
+// Comparing speedups instead of absolute times keeps the baselines valid on
+// other hardware.
+type PerformanceCase struct {
+	Name             string      // name of the test, also the key of its baseline
+	SQL              string      // query to check
+	Reference        []string    // name=value settings that turn the optimization off
+	Plan             []PlanCheck // checks of the plan the query runs with
+	MinServerVersion int         // lowest server_version_num the case applies to, 0 for all
+}
+
+// A PlanCheck checks the plan of a [PerformanceCase], as returned in JSON by
+// EXPLAIN (ANALYZE, VERBOSE), and returns a description of what it is
+// missing, or "" if the plan passes.
+type PlanCheck func(plan PlanNode) string
+
+// A PlanNode is a node of a plan as returned in JSON by EXPLAIN.
+type PlanNode map[string]any
+
+// Children returns the nodes below the given node.
+func (n PlanNode) Children() []PlanNode {
+	plans, _ := n["Plans"].([]any)
+
+	children := make([]PlanNode, 0, len(plans))
+	for _, plan := range plans {
+		if child, ok := plan.(map[string]any); ok {
+			children = append(children, child)
+		}
+	}
+
+	return children
+}
+
+// Walk calls fn for the node and all nodes below it, until fn returns true.
+func (n PlanNode) Walk(fn func(node PlanNode) bool) bool {
+	if fn(n) {
+		return true
+	}
+
+	for _, child := range n.Children() {
+		if child.Walk(fn) {
+			return true
+		}
+	}
+
+	return false
+}
+
+// PlanHasNode returns a [PlanCheck] that passes if the plan has a node of the
+// given type, like Aggregate, and with a custom scan name, like
+// VectorAggNode, if one is given.
+func PlanHasNode(nodeType, customScanName string) PlanCheck {
+	return func(plan PlanNode) string {
+		found := plan.Walk(func(node PlanNode) bool {
+			return node["Node Type"] == nodeType &&
+				(customScanName == "" || node["Custom Plan Provider"] == customScanName)
+		})
+		if found {
+			return ""
+		}
+
+		if customScanName != "" {
+			return fmt.Sprintf("no %s (%s) node", nodeType, customScanName)
+		}
+
+		return fmt.Sprintf("no %s node", nodeType)
+	}
+}
+
+// PlanHasProperty returns a [PlanCheck] that passes if a node of the plan
+// shows the given property, like Columnar Vectorized Filter.
+func PlanHasProperty(property string) PlanCheck {
+	return func(plan PlanNode) string {
+		found := plan.Walk(func(node PlanNode) bool {
+			_, ok := node[property]
+			return ok
+		})
+		if found {
+			return ""
+		}
+
+		return fmt.Sprintf("no node with %s", property)
+	}
+}
+
+// PlanPropertyAtLeast returns a [PlanCheck] that passes if the numeric
+// property of the plan, like Columnar Chunk Groups Removed by Filter, summed
+// over its nodes is at least min.
+func PlanPropertyAtLeast(property string, min float64) PlanCheck {
+	return func(plan PlanNode) string {
+		var total float64
+		plan.Walk(func(node PlanNode) bool {
+			if value, ok := node[property].(float64); ok {
+				total += value
+			}
+			return false
+		})
+
+		if total >= min {
+			return ""
+		}
+
+		return fmt.Sprintf("%s is %g, expected at least %g", property, total, min)
+	}
+}
+
+// A PerformanceSuite describes how [RunPerformanceTests] runs the
+// [PerformanceCases].
+type PerformanceSuite struct {
+	Baselines       string  // path of the JSON file with the speedup of each case
+	UpdateBaselines bool    // whether to write the measured speedups to Baselines instead of checking them
+	Tolerance       float64 // fraction of its baseline speedup a case may lose before it fails
+	Tries           int     // number of timed runs of each query and setting
+}
+
+// PerformanceSetupSQL generates the dataset the [PerformanceCases] run
+// against: a columnar table of 2M rows, in the default chunk groups of
+// 10000 rows, ordered by id.
+const PerformanceSetupSQL = `
+CREATE TABLE perf_events (
+    id bigint,
+    category int,
+    value int,
+    price float8,
+    ts timestamptz
+) USING columnar;
+
+INSERT INTO perf_events
+SELECT g, g % 16, (g * 7919) % 1000, (g % 10000) / 100.0,
+       '2024-01-01'::timestamptz + g * interval '1 second'
+FROM generate_series(1, 2000000) g;
+
+ANALYZE perf_events;
+`
+
+// PerformanceCases describe the plan and the speedup of the optimizations of
+// columnar that the acceptance tests guard.
+func PerformanceCases() []PerformanceCase {
+	return []PerformanceCase{
+		{
+			Name:             "vectorized aggregate",
+			SQL:              `SELECT count(*), sum(value), min(value), max(value) FROM perf_events`,
+			Reference:        []string{"columnar.enable_vectorization=false"},
+			Plan:             []PlanCheck{PlanHasNode("Custom Scan", "VectorAggNode")},
+			MinServerVersion: 140000,
+		},
+		{
+			Name:             "vectorized hash aggregate",
+			SQL:              `SELECT category, count(*), sum(value) FROM perf_events GROUP BY category`,
+			Reference:        []string{"columnar.enable_vectorization=false"},
+			Plan:             []PlanCheck{PlanHasNode("Custom Scan", "VectorAggNode")},
+			MinServerVersion: 140000,
+		},
+		{
+			Name:      "vectorized filter",
+			SQL:       `SELECT id, price FROM perf_events WHERE value < 10 AND category = 3`,
+			Reference: []string{"columnar.enable_vectorization=false"},
+			Plan: []PlanCheck{
+				PlanHasNode("Custom Scan", "ColumnarScan"),
+				PlanHasProperty("Columnar Vectorized Filter"),
+			},
+		},
+		{
+			Name:      "chunk group filtering",
+			SQL:       `SELECT sum(price) FROM perf_events WHERE id BETWEEN 1000000 AND 1010000`,
+			Reference: []string{"columnar.enable_qual_pushdown=false"},
+			Plan: []PlanCheck{
+				PlanHasProperty("Columnar Chunk Group Filters"),
+				PlanPropertyAtLeast("Columnar Chunk Groups Removed by Filter", 150),
+			},
+		},
+		{
+			Name:      "custom scan projection",
+			SQL:       `SELECT max(ts) FROM perf_events`,
+			Reference: []string{"columnar.enable_custom_scan=false"},
+			Plan:      []PlanCheck{PlanHasNode("Custom Scan", "ColumnarScan")},
+		},
+	}
+}
+
+// RunPerformanceTests loads the performance dataset into a fresh container
+// of the [DockerComposeManager], then checks the plan and the speedup of each
+// [PerformanceCase] against the baselines of the suite, or writes the
+// measured speedups to them if suite.UpdateBaselines is set.
+func RunPerformanceTests(t *testing.T, ctx context.Context, cm DockerComposeManager, suite PerformanceSuite) {
+	cm.StartCompose(t, ctx, cm.Image(), false)
+	t.Cleanup(func() {
+		cm.TerminateCompose(t, ctx, true)
+	})
+
+	baselines := make(map[string]float64)
+	if !suite.UpdateBaselines {
+		content, err := os.ReadFile(suite.Baselines)
+		if err != nil {
+			t.Fatalf("unable to read performance baselines: %s", err)
+		}
+
+		if err := json.Unmarshal(content, &baselines); err != nil {
+			t.Fatalf("unable to parse performance baselines %s: %s", suite.Baselines, err)
+		}
+	}
+
+	pool := cm.PGPool()
+	if _, err := pool.Exec(ctx, PerformanceSetupSQL); err != nil {
+		t.Fatalf("unable to create the performance dataset: %s", err)
+	}
+
+	var serverVersion int
+	if err := pool.QueryRow(ctx, "SELECT current_setting('server_version_num')::int").Scan(&serverVersion); err != nil {
+		t.Fatal(err)
+	}
+
+	measured := make(map[string]float64)
+
+	for _, c := range PerformanceCases() {
+		c := c
+		t.Run(c.Name, func(t *testing.T) {
+			if serverVersion < c.MinServerVersion {
+				t.Skipf("requires server_version_num %d, got %d", c.MinServerVersion, serverVersion)
+			}
+
+			plan, err := explainPerformanceQuery(ctx, pool, c.SQL)
+			if err != nil {
+				t.Fatalf("unable to explain %s: %s", c.SQL, err)
+			}
+
+			for _, check := range c.Plan {
+				if missing := check(plan); missing != "" {
+					t.Errorf("unexpected plan of %s: %s", c.SQL, missing)
+				}
+			}
+
+			optimized, err := timePerformanceQuery(ctx, pool, c.SQL, nil, suite.Tries)
+			if err != nil {
+				t.Fatalf("unable to time %s: %s", c.SQL, err)
+			}
+
+			reference, err := timePerformanceQuery(ctx, pool, c.SQL, c.Reference, suite.Tries)
+			if err != nil {
+				t.Fatalf("unable to time %s with %v: %s", c.SQL, c.Reference, err)
+			}
+
+			speedup := float64(reference) / float64(optimized)
+			measured[c.Name] = math.Round(speedup*100) / 100
+
+			t.Logf("%s: %s, %s with %v, speedup %.2f", c.Name, optimized, reference, c.Reference, speedup)
+
+			if suite.UpdateBaselines {
+				return
+			}
+
+			baseline, ok := baselines[c.Name]
+			if !ok {
+				t.Errorf("no performance baseline for %s in %s", c.Name, suite.Baselines)
+				return
+			}
+
+			if minimum := baseline * (1 - suite.Tolerance); speedup < minimum {
+				t.Errorf("speedup of %s is %.2f, expected at least %.2f (baseline %.2f)",
+					c.Name, speedup, minimum, baseline)
+			}
+		})
+	}
+
+	if suite.UpdateBaselines {
+		output, err := json.MarshalIndent(measured, "", "  ")
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		if err := os.WriteFile(suite.Baselines, append(output, '\n'), 0644); err != nil {
+			t.Fatalf("unable to write performance baselines: %s", err)
+		}
+
+		t.Logf("Wrote the performance baselines to %s", suite.Baselines)
+	}
+}
+
+// explainPerformanceQuery runs a query with EXPLAIN (ANALYZE, VERBOSE) and
+// returns the top node of its plan.
+func explainPerformanceQuery(ctx context.Context, pool *pgxpool.Pool, query string) (PlanNode, error) {
+	var output string
+	if err := pool.QueryRow(ctx, "EXPLAIN (ANALYZE, VERBOSE, FORMAT JSON) "+query).Scan(&output); err != nil {
+		return nil, err
+	}
+
+	var explained []struct {
+		Plan PlanNode `json:"Plan"`
+	}
+	if err := json.Unmarshal([]byte(output), &explained); err != nil {
+		return nil, err
+	}
+
+	if len(explained) == 0 {
+		return nil, fmt.Errorf("no plan in %s", output)
+	}
+
+	return explained[0].Plan, nil
+}
+
+// timePerformanceQuery runs a query tries times on one connection with the
+// given name=value settings and returns its median time. An untimed run
+// first warms up the caches.
+func timePerformanceQuery(ctx context.Context, pool *pgxpool.Pool, query string, settings []string, tries int) (time.Duration, error) {
+	conn, err := pool.Acquire(ctx)
+	if err != nil {
+		return 0, err
+	}
+	defer conn.Release()
+
+	for _, setting := range settings {
+		name, value, ok := strings.Cut(setting, "=")
+		if !ok {
+			return 0, fmt.Errorf("performance setting must be name=value, got %q", setting)
+		}
+
+		if _, err := conn.Exec(ctx, "SELECT set_config($1, $2, false)", name, value); err != nil {
+			return 0, err
+		}
+	}
+	defer conn.Exec(ctx, "RESET ALL") //nolint:errcheck
+
+	if _, err := conn.Exec(ctx, query); err != nil {
+		return 0, err
+	}
+
+	times := make([]time.Duration, 0, tries)
+	for try := 0; try < tries; try++ {
+		start := time.Now()
+		if _, err := conn.Exec(ctx, query); err != nil {
+			return 0, err
+		}
+
+		times = append(times, time.Since(start))
+	}
+
+	if len(times) == 0 {
+		return 0, fmt.Errorf("no timed runs of %s", query)
+	}
+
+	sort.Slice(times, func(i, j int) bool { return times[i] < times[j] })
+
+	return times[len(times)/2], nil
+}
@@ -87,6 +87,11 @@ type Config struct {
 	PostgresVersion      string        `env:"SPILO_POSTGRES_VERSION,default=13"`
 	PostgresPort         int           `env:"POSTGRES_PORT,default=5432"`
 	ReadinessPort        int           `env:"READINESS_PORT,default=8008"`
+
+	PerformanceBaselines       string  `env:"PERFORMANCE_BASELINES,default=../fixtures/performance_baselines.json"`
+	PerformanceUpdateBaselines bool    `env:"PERFORMANCE_UPDATE_BASELINES,default=false"`
+	PerformanceTolerance       float64 `env:"PERFORMANCE_TOLERANCE,default=0.25"`
+	PerformanceTries           int     `env:"PERFORMANCE_TRIES,default=5"`
 }
 
 var config Config
@@ -284,3 +289,17 @@ func Test_SpiloUpgrade(t *testing.T) {
 
 	shared.RunUpgradeTests(t, context.Background(), &c)
 }
+
+func Test_SpiloPerformance(t *testing.T) {
+	shared.RunPerformanceTests(
+		t,
+		context.Background(),
+		&spiloAcceptanceCompose{config: config},
+		shared.PerformanceSuite{
+			Baselines:       config.PerformanceBaselines,
+			UpdateBaselines: config.PerformanceUpdateBaselines,
+			Tolerance:       config.PerformanceTolerance,
+			Tries:           config.PerformanceTries,
+		},
+	)
+}
@@ -19,11 +19,13 @@
 
 #include "miscadmin.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 #include "citus_version.h"
 #include "columnar/columnar.h"
 #include "columnar/columnar_tableam.h"
+#include "columnar/vectorization/columnar_vector_types.h"
 
 /* Default values for option parameters */
 #define DEFAULT_STRIPE_ROW_COUNT 150000
@@ -41,14 +43,70 @@ static void columnar_guc_init(void);
 
 int columnar_compression = DEFAULT_COMPRESSION_TYPE;
 int columnar_stripe_row_limit = DEFAULT_STRIPE_ROW_COUNT;
+int columnar_stripe_size_limit = 0;
+bool columnar_auto_row_limits = false;
+int columnar_auto_chunk_size = 128 * 1024;
+int columnar_auto_stripe_size = 32 * 1024 * 1024;
+int columnar_large_value_threshold = 1024 * 1024;
+int columnar_write_state_memory_limit = 1024 * 1024;
+int columnar_read_state_memory_limit = 0;
+bool columnar_enable_streaming_reads = false;
 int columnar_chunk_group_row_limit = DEFAULT_CHUNK_ROW_COUNT;
 int columnar_compression_level = 3;
+int columnar_auto_compression_min_gain = 10;
+int columnar_compression_workers = 0;
+int columnar_column_compression_threads = 0;
+bool columnar_enable_decompression_thread = false;
+bool columnar_enable_compression_thread = false;
+int columnar_column_decompression_threads = 0;
 bool columnar_enable_parallel_execution = true;
 int columnar_min_parallel_processes = 8;
 bool columnar_enable_vectorization = true;
+bool columnar_enable_vectorized_window = true;
+bool columnar_enable_fused_vector_expressions = true;
+bool columnar_enable_bucketwise_execution = true;
+bool columnar_enable_synchronized_scans = true;
 bool columnar_enable_dml = true;
 bool columnar_enable_page_cache = true;
 int columnar_page_cache_size = 200U;
+int columnar_prefetch_depth = 128;
+bool columnar_enable_late_materialization = true;
+bool columnar_enable_sorted_chunk_search = true;
+bool columnar_enable_chunk_group_delete = true;
+bool columnar_enable_rescan_cache = true;
+bool columnar_enable_transaction_read_cache = true;
+bool columnar_enable_approximate_count_distinct = false;
+bool columnar_enable_metadata_statistics = false;
+int columnar_vector_size = COLUMNAR_VECTOR_COLUMN_SIZE;
+bool columnar_vector_huge_pages = false;
+int columnar_skiplist_cache_size = 16;
+int columnar_shared_cache_size = 0;
+bool columnar_autoprewarm = false;
+int columnar_autoprewarm_interval = 300;
+int columnar_column_cache_admission = COLUMN_CACHE_ADMIT_ALL;
+bool columnar_column_cache_bypass_large_scans = false;
+bool columnar_enable_dictionary_encoding = true;
+bool columnar_enable_run_length_encoding = true;
+bool columnar_enable_bit_packing = true;
+bool columnar_enable_value_offsets = false;
+bool columnar_enable_auto_compaction = false;
+bool columnar_enable_autovacuum_compaction = true;
+bool columnar_enable_vacuum_compaction = false;
+int columnar_auto_compaction_naptime = 60;
+int columnar_auto_compaction_min_stripes = 10;
+int columnar_auto_compaction_stripe_count = 25;
+int columnar_auto_compaction_delta_rows = 10000;
+double columnar_vacuum_deleted_rows_threshold = 0.2;
+bool columnar_online_vacuum = false;
+double columnar_vacuum_cost_delay = -1;
+int columnar_vacuum_cost_limit = -1;
+int columnar_delta_store_row_limit = 1000;
+bool columnar_preserve_compressed_values = false;
+bool columnar_compact_chunk_metadata = false;
+char *columnar_offload_directory = NULL;
+bool columnar_enable_extent_storage = true;
+int columnar_io_uring_queue_depth = 16;
+int columnar_stat_max_relations = 1000;
 
 static const struct config_enum_entry columnar_compression_options[] =
 {
@@ -56,10 +114,19 @@ static const struct config_enum_entry columnar_compression_options[] =
 	{ "pglz", COMPRESSION_PG_LZ, false },
 #if HAVE_CITUS_LIBLZ4
 	{ "lz4", COMPRESSION_LZ4, false },
+	{ "lz4hc", COMPRESSION_LZ4HC, false },
 #endif
 #if HAVE_LIBZSTD
 	{ "zstd", COMPRESSION_ZSTD, false },
 #endif
+	{ "auto", COMPRESSION_AUTO, false },
+	{ NULL, 0, false }
+};
+
+static const struct config_enum_entry columnar_cache_admission_options[] =
+{
+	{ "all", COLUMN_CACHE_ADMIT_ALL, false },
+	{ "second_access", COLUMN_CACHE_ADMIT_SECOND_ACCESS, false },
 	{ NULL, 0, false }
 };
 
@@ -67,8 +134,14 @@ void
 columnar_init(void)
 {
 	columnar_guc_init();
+	ColumnarSharedCacheInit();
+	ColumnarPrewarmInit();
+	ColumnarCompactionInit();
+	ColumnarStatInit();
+	ColumnarSyncScanInit();
 	columnar_tableam_init();
 	columnar_planner_init();
+	ColumnarMetadataStatisticsInit();
 }
 
 
@@ -88,7 +161,7 @@ columnar_guc_init()
 							 NULL);
 
 	DefineCustomIntVariable("columnar.compression_level",
-							"Compression level to be used with zstd.",
+							"Compression level to be used with zstd and lz4hc.",
 							NULL,
 							&columnar_compression_level,
 							3,
@@ -100,6 +173,114 @@ columnar_guc_init()
 							NULL,
 							NULL);
 
+	DefineCustomIntVariable("columnar.auto_compression_min_gain",
+							"Minimum percentage a chunk must shrink by to get "
+							"compressed with the auto compression type.",
+							NULL,
+							&columnar_auto_compression_min_gain,
+							10,
+							0,
+							100,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.compression_workers",
+							"Number of threads zstd uses to compress a column chunk.",
+							"Only chunks larger than zstd's minimum job size are "
+							"split between threads. 0 compresses in the backend "
+							"itself.",
+							&columnar_compression_workers,
+							0,
+							0,
+							COMPRESSION_WORKERS_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.column_compression_threads",
+							"Number of threads that compress the columns of a chunk "
+							"group concurrently.",
+							"Applies to columns compressed with lz4 or zstd without "
+							"a dictionary. 0 compresses one column at a time in the "
+							"backend itself.",
+							&columnar_column_compression_threads,
+							0,
+							0,
+							COMPRESSION_WORKERS_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.column_decompression_threads",
+							"Number of threads that decompress the columns of a chunk "
+							"group concurrently.",
+							"Applies to columns compressed with lz4 or zstd without "
+							"a dictionary, and not while columnar.enable_column_cache "
+							"is on. 0 decompresses one column at a time in the "
+							"backend itself.",
+							&columnar_column_decompression_threads,
+							0,
+							0,
+							COMPRESSION_WORKERS_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_decompression_thread",
+							 gettext_noop("Decompresses the next chunk group of a scan in "
+										  "a helper thread"),
+							 gettext_noop("While a sequential scan reads a chunk group, a "
+										  "thread decompresses the columns of the next "
+										  "one that are compressed with lz4 or zstd "
+										  "without a dictionary. Not used while "
+										  "columnar.enable_column_cache is on."),
+							 &columnar_enable_decompression_thread,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_compression_thread",
+							 gettext_noop("Compresses each chunk group being written in "
+										  "a helper thread"),
+							 gettext_noop("While rows are added to the next chunk group, "
+										  "a thread compresses the columns of the full one "
+										  "that are compressed with lz4 or zstd without a "
+										  "dictionary."),
+							 &columnar_enable_compression_thread,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.preserve_compressed_values",
+							 gettext_noop("Stores values that are already compressed "
+										  "without decompressing them"),
+							 gettext_noop("Values compressed by PostgreSQL, such as the "
+										  "TOASTed values of a heap table being copied, "
+										  "are stored in their compressed form and "
+										  "decompressed when a query uses them."),
+							 &columnar_preserve_compressed_values,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
 	DefineCustomIntVariable("columnar.stripe_row_limit",
 							"Maximum number of tuples per stripe.",
 							NULL,
@@ -113,6 +294,128 @@ columnar_guc_init()
 							NULL,
 							NULL);
 
+	DefineCustomIntVariable("columnar.stripe_size_limit",
+							"Maximum size of the buffers of a stripe before it is "
+							"flushed.",
+							"A stripe is flushed when it reaches either this size "
+							"or stripe_row_limit rows. 0 disables the size limit.",
+							&columnar_stripe_size_limit,
+							0,
+							0,
+							STRIPE_SIZE_LIMIT_MAXIMUM,
+							PGC_USERSET,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.auto_row_limits",
+							 "Sizes the stripes and chunk groups of new tables "
+							 "from their row width.",
+							 "Sets the default auto_row_limits option of new "
+							 "tables, whose writers pick stripe_row_limit and "
+							 "chunk_group_row_limit for each stripe.",
+							 &columnar_auto_row_limits,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.auto_chunk_size",
+							"Target size of a column chunk of tables with "
+							"auto_row_limits.",
+							NULL,
+							&columnar_auto_chunk_size,
+							128 * 1024,
+							1024,
+							MaxAllocSize,
+							PGC_USERSET,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.auto_stripe_size",
+							"Target size of a stripe of tables with "
+							"auto_row_limits.",
+							NULL,
+							&columnar_auto_stripe_size,
+							32 * 1024 * 1024,
+							64 * 1024,
+							MaxAllocSize,
+							PGC_USERSET,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.large_value_threshold",
+							"Size from which variable length values are stored "
+							"out of line.",
+							"Values of at least this size are stored in the large "
+							"value area of their stripe and only read when they are "
+							"used. 0 stores all values inline.",
+							&columnar_large_value_threshold,
+							1024 * 1024,
+							0,
+							MaxAllocSize,
+							PGC_USERSET,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.write_state_memory_limit",
+							gettext_noop("Maximum memory used by the pending writes of "
+										 "all columnar tables in a transaction"),
+							gettext_noop("When the pending writes of the current "
+										 "subtransaction use more, their stripes are "
+										 "flushed early. 0 disables the limit."),
+							&columnar_write_state_memory_limit,
+							1024 * 1024,
+							0,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.read_state_memory_limit",
+							gettext_noop("Maximum memory a sequential scan of a columnar "
+										 "table loads from a stripe at once"),
+							gettext_noop("When the compressed chunks of the columns a "
+										 "scan reads take more, the stripe is loaded a "
+										 "few chunk groups at a time. 0 disables the "
+										 "limit."),
+							&columnar_read_state_memory_limit,
+							0,
+							0,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_streaming_reads",
+							 gettext_noop("Makes sequential scans load the chunks of a "
+										  "stripe one chunk group at a time"),
+							 gettext_noop("The chunks of a chunk group are read when the "
+										  "scan gets to it and freed after it, with the "
+										  "chunks of the next chunk groups prefetched, "
+										  "instead of reading the chunks of the whole "
+										  "stripe before its first row."),
+							 &columnar_enable_streaming_reads,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
 	DefineCustomIntVariable("columnar.chunk_group_row_limit",
 							"Maximum number of rows per chunk.",
 							NULL,
@@ -161,6 +464,56 @@ columnar_guc_init()
 							 NULL, 
 							 NULL);
 
+	DefineCustomBoolVariable("columnar.enable_vectorized_window",
+							 gettext_noop("Enables vectorized execution of window "
+										  "functions over columnar scans"),
+							 NULL,
+							 &columnar_enable_vectorized_window,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_fused_vector_expressions",
+							 gettext_noop("Enables computing nested vectorized bigint "
+										  "and float8 arithmetic in a single pass"),
+							 NULL,
+							 &columnar_enable_fused_vector_expressions,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_bucketwise_execution",
+							 gettext_noop("Enables running joins and aggregates on the "
+										  "bucket_by column of columnar tables "
+										  "bucket by bucket"),
+							 NULL,
+							 &columnar_enable_bucketwise_execution,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_synchronized_scans",
+							 gettext_noop("Enables starting sequential scans of large "
+										  "columnar tables at the stripe other scans "
+										  "of the table are reading"),
+							 NULL,
+							 &columnar_enable_synchronized_scans,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
 	DefineCustomBoolVariable("columnar.enable_dml",
 							gettext_noop("Enables DML"),
 							NULL,
@@ -195,6 +548,550 @@ columnar_guc_init()
 							NULL,
 							NULL,
 							NULL);
+
+	DefineCustomEnumVariable("columnar.column_cache_admission",
+							 gettext_noop("Sets which chunks are added to the column "
+										  "based cache"),
+							 gettext_noop("all caches every chunk that is read, "
+										  "second_access only caches chunks that were "
+										  "read before."),
+							 &columnar_column_cache_admission,
+							 COLUMN_CACHE_ADMIT_ALL,
+							 columnar_cache_admission_options,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.column_cache_bypass_large_scans",
+							 gettext_noop("Prevents large sequential scans from adding "
+										  "chunks to the column based cache"),
+							 gettext_noop("Applies to the scans that use a bulk read "
+										  "buffer ring. They still read cached chunks."),
+							 &columnar_column_cache_bypass_large_scans,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_dictionary_encoding",
+							 gettext_noop("Enables dictionary encoding of variable length "
+										  "columns with few distinct values"),
+							 gettext_noop("Chunks are encoded only if they have at most "
+										  "4096 distinct values and the encoding makes "
+										  "them smaller."),
+							 &columnar_enable_dictionary_encoding,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_run_length_encoding",
+							 gettext_noop("Enables run length encoding of fixed length "
+										  "columns with runs of equal values"),
+							 gettext_noop("Chunks are encoded only if the encoding makes "
+										  "them smaller."),
+							 &columnar_enable_run_length_encoding,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_bit_packing",
+							 gettext_noop("Enables frame of reference and delta bit "
+										  "packing of integer like columns"),
+							 gettext_noop("Chunks are encoded only if the encoding makes "
+										  "them smaller."),
+							 &columnar_enable_bit_packing,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_value_offsets",
+							 gettext_noop("Stores the offsets of the values of variable "
+										  "length columns in their chunks"),
+							 gettext_noop("Readers then find the value of a row without "
+										  "walking the values before it. It applies to "
+										  "chunks that aren't dictionary encoded."),
+							 &columnar_enable_value_offsets,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_late_materialization",
+							 gettext_noop("Enables reading the columns referenced by "
+										  "pushed down quals before the other "
+										  "projected columns"),
+							 gettext_noop("Chunk groups in which no row satisfies the "
+										  "quals, or no join key is in the hash table "
+										  "of the hash join above, are skipped without "
+										  "reading the rest of their columns."),
+							 &columnar_enable_late_materialization,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_sorted_chunk_search",
+							 gettext_noop("Enables binary searching the chunks whose values "
+										  "are sorted for the rows that range quals "
+										  "select"),
+							 gettext_noop("Row by row scans then only read the rows of such "
+										  "a chunk group between the bounds the quals "
+										  "give its sorted column."),
+							 &columnar_enable_sorted_chunk_search,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_chunk_group_delete",
+							 gettext_noop("Enables deleting the chunk groups whose rows "
+										  "all pass the WHERE clause of a DELETE at once"),
+							 gettext_noop("A DELETE of a columnar table without "
+										  "RETURNING, triggers or row-level security "
+										  "marks such chunk groups deleted without "
+										  "reading their rows."),
+							 &columnar_enable_chunk_group_delete,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_rescan_cache",
+							 gettext_noop("Enables keeping the stripes a scan loaded "
+										  "across its rescans"),
+							 gettext_noop("Rescanned scans, like parameterized scans on "
+										  "the inner side of a nested loop, keep the "
+										  "chunk metadata and the chunks of the stripes "
+										  "they load in up to work_mem, and only read "
+										  "the chunks they haven't loaded yet."),
+							 &columnar_enable_rescan_cache,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_transaction_read_cache",
+							 gettext_noop("Enables keeping the row masks a transaction "
+										  "read across its statements"),
+							 gettext_noop("Statements of a transaction that run with "
+										  "the same snapshot reuse the row masks and "
+										  "the deleted row counts of the stripes that "
+										  "earlier ones read, until the transaction "
+										  "writes to the table."),
+							 &columnar_enable_transaction_read_cache,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_approximate_count_distinct",
+							 gettext_noop("Makes vectorized count(DISTINCT) estimate the "
+										  "number of distinct values"),
+							 gettext_noop("The estimate is made with a HyperLogLog sketch, "
+										  "which takes 16kB instead of memory for every "
+										  "distinct value, and is usually within 1% of "
+										  "the exact count."),
+							 &columnar_enable_approximate_count_distinct,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_metadata_statistics",
+							 gettext_noop("Derives planner statistics of columnar tables "
+										  "from their chunk metadata"),
+							 gettext_noop("The null fraction, number of distinct values and "
+										  "histogram of a column are estimated from the "
+										  "chunk statistics written with its stripes when "
+										  "the column was never analyzed, or when the table "
+										  "grew to more than twice its size since."),
+							 &columnar_enable_metadata_statistics,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.vector_size",
+							gettext_noop("Maximum number of rows in the vectors of "
+										 "vectorized execution"),
+							gettext_noop("Smaller vectors fit in CPU caches, larger ones "
+										 "spread the per vector overhead over more rows. "
+										 "A vector never spans chunk groups."),
+							&columnar_vector_size,
+							COLUMNAR_VECTOR_COLUMN_SIZE,
+							COLUMNAR_MIN_VECTOR_COLUMN_SIZE,
+							COLUMNAR_VECTOR_COLUMN_SIZE,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.vector_huge_pages",
+							 gettext_noop("Asks for transparent huge pages for large "
+										  "vector buffers"),
+							 gettext_noop("Buffers of vectorized scans of at least 2MB, "
+										  "as in scans of wide tables, are aligned to huge "
+										  "pages, which saves TLB misses. Has no effect "
+										  "where transparent huge pages aren't supported."),
+							 &columnar_vector_huge_pages,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.prefetch_depth",
+							gettext_noop("Number of blocks to prefetch ahead of columnar "
+										 "stripe reads"),
+							gettext_noop("0 disables prefetching."),
+							&columnar_prefetch_depth,
+							128,
+							0,
+							8192,
+							PGC_USERSET,
+							GUC_UNIT_BLOCKS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.skiplist_cache_size",
+							gettext_noop("Size of the per backend cache of stripe chunk "
+										 "metadata in megabytes"),
+							gettext_noop("0 disables the cache."),
+							&columnar_skiplist_cache_size,
+							16,
+							0,
+							20000,
+							PGC_USERSET,
+							GUC_UNIT_MB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.shared_column_cache_size",
+							gettext_noop("Size of the column based cache shared by all "
+										 "backends in megabytes"),
+							gettext_noop("When set, columnar.enable_column_cache uses "
+										 "this cache instead of a per backend one. "
+										 "Requires columnar in shared_preload_libraries. "
+										 "0 disables the shared cache."),
+							&columnar_shared_cache_size,
+							0,
+							0,
+							1024 * 1024,
+							PGC_POSTMASTER,
+							GUC_UNIT_MB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.autoprewarm",
+							 gettext_noop("Reloads the shared column cache after a "
+										  "restart"),
+							 gettext_noop("The keys of the cached chunks are saved "
+										  "periodically and at shutdown, and loaded "
+										  "back into the cache at server start. "
+										  "Requires columnar.shared_column_cache_size."),
+							 &columnar_autoprewarm,
+							 false,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.autoprewarm_interval",
+							gettext_noop("Time between saves of the keys of the chunks "
+										 "in the shared column cache"),
+							gettext_noop("0 saves them only at shutdown."),
+							&columnar_autoprewarm_interval,
+							300,
+							0,
+							INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_auto_compaction",
+							 gettext_noop("Enables background workers that combine "
+										  "undersized stripes of columnar tables"),
+							 gettext_noop("Requires columnar in shared_preload_libraries."),
+							 &columnar_enable_auto_compaction,
+							 false,
+							 PGC_SIGHUP,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_autovacuum_compaction",
+							 gettext_noop("Lets autovacuum rewrite the undersized and "
+										  "heavily deleted stripes of columnar tables"),
+							 gettext_noop("Autovacuum is triggered by the rows deleted "
+										  "from and inserted into columnar tables. When "
+										  "this is on, it also rewrites the stripes the "
+										  "compaction workers would."),
+							 &columnar_enable_autovacuum_compaction,
+							 true,
+							 PGC_SIGHUP,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_vacuum_compaction",
+							 gettext_noop("Lets VACUUM rewrite the undersized and heavily "
+										  "deleted stripes of columnar tables"),
+							 gettext_noop("Does for VACUUM run by users what "
+										  "columnar.enable_autovacuum_compaction does "
+										  "for autovacuum."),
+							 &columnar_enable_vacuum_compaction,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.auto_compaction_naptime",
+							gettext_noop("Time to sleep between compaction rounds"),
+							NULL,
+							&columnar_auto_compaction_naptime,
+							60,
+							1,
+							86400,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.auto_compaction_min_stripes",
+							gettext_noop("Minimum number of undersized stripes that "
+										 "makes a table a compaction candidate"),
+							gettext_noop("A stripe is undersized when it has less than "
+										 "half of the stripe_row_limit of its table."),
+							&columnar_auto_compaction_min_stripes,
+							10,
+							2,
+							INT_MAX,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.auto_compaction_stripe_count",
+							gettext_noop("Maximum number of stripes combined per table "
+										 "in each compaction round"),
+							NULL,
+							&columnar_auto_compaction_stripe_count,
+							25,
+							1,
+							INT_MAX,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.auto_compaction_delta_rows",
+							gettext_noop("Number of delta store rows at which the "
+										 "compaction worker moves them into stripes"),
+							NULL,
+							&columnar_auto_compaction_delta_rows,
+							10000,
+							1,
+							INT_MAX,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomRealVariable("columnar.vacuum_deleted_rows_threshold",
+							 gettext_noop("Fraction of deleted rows above which a stripe "
+										  "is rewritten by vacuum and compaction"),
+							 gettext_noop("Applies to VACUUM, columnar.vacuum and the "
+										  "compaction workers. 1 disables rewriting "
+										  "stripes because of their deleted rows."),
+							 &columnar_vacuum_deleted_rows_threshold,
+							 0.2,
+							 0.0,
+							 1.0,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomRealVariable("columnar.vacuum_cost_delay",
+							 gettext_noop("Cost based delay of columnar.vacuum and the "
+										  "compaction workers, in milliseconds"),
+							 gettext_noop("-1 uses vacuum_cost_delay, or the autovacuum "
+										  "setting when run by autovacuum."),
+							 &columnar_vacuum_cost_delay,
+							 -1,
+							 -1,
+							 100,
+							 PGC_USERSET,
+							 GUC_UNIT_MS,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.vacuum_cost_limit",
+							gettext_noop("Cost amount after which columnar.vacuum and "
+										 "the compaction workers sleep"),
+							gettext_noop("-1 uses vacuum_cost_limit, or the autovacuum "
+										 "setting when run by autovacuum."),
+							&columnar_vacuum_cost_limit,
+							-1,
+							-1,
+							10000,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.online_vacuum",
+							 gettext_noop("Lets writes go on while columnar.vacuum and "
+										  "the compaction workers combine stripes"),
+							 gettext_noop("Inserts, updates and deletes only wait while "
+										  "the rewritten stripes are swapped for the new "
+										  "ones. Space is not reclaimed until a later "
+										  "vacuum truncates the table."),
+							 &columnar_online_vacuum,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.delta_store_row_limit",
+							gettext_noop("Maximum number of rows a transaction writes "
+										 "to the delta store of a table"),
+							gettext_noop("Only used by tables with the delta_store "
+										 "option. Rows beyond the limit are written "
+										 "to stripes."),
+							&columnar_delta_store_row_limit,
+							1000,
+							0,
+							INT_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.compact_chunk_metadata",
+							 gettext_noop("Stores the chunk metadata of new stripes in "
+										  "one row per stripe"),
+							 gettext_noop("The chunk metadata of stripes written while "
+										  "this is on goes to columnar.stripe_skip_list "
+										  "instead of one columnar.chunk row per column "
+										  "chunk, so it is read with a single lookup."),
+							 &columnar_compact_chunk_metadata,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomStringVariable("columnar.offload_directory",
+							   gettext_noop("Directory columnar.offload_stripes moves "
+											"stripes to"),
+							   gettext_noop("Usually where an object storage bucket is "
+											"mounted. Offloaded stripes are read from "
+											"there, so it must stay set once stripes "
+											"have been moved."),
+							   &columnar_offload_directory,
+							   "",
+							   PGC_SUSET,
+							   0,
+							   NULL,
+							   NULL,
+							   NULL);
+
+	DefineCustomBoolVariable("columnar.enable_extent_storage",
+							 gettext_noop("Keeps the stripe data of new columnar tables in "
+										  "extents read outside of shared buffers"),
+							 gettext_noop("Decided when a table is created, rewritten or "
+										  "upgraded to storage version 3. Data of tables "
+										  "without extents is read through shared buffers."),
+							 &columnar_enable_extent_storage,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.io_uring_queue_depth",
+							gettext_noop("Number of reads of columnar extents a backend "
+										 "keeps in flight on io_uring"),
+							gettext_noop("Only used when columnar is built with liburing. "
+										 "0 reads extents synchronously."),
+							&columnar_io_uring_queue_depth,
+							16,
+							0,
+							1024,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.stat_max_relations",
+							gettext_noop("Maximum number of columnar tables "
+										 "pg_stat_columnar tracks"),
+							gettext_noop("Requires columnar in shared_preload_libraries. "
+										 "0 disables the statistics."),
+							&columnar_stat_max_relations,
+							1000,
+							0,
+							1000000,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
 }
 
 
@@ -0,0 +1,808 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_advisor.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Advice on the options of a columnar table. columnar.column_profile reads
+ * the chunks of a sample of the stripes of a table and returns, per column,
+ * its null fraction, how many distinct values its chunks have, how many of
+ * them are sorted, how many have value ranges that don't overlap those of
+ * the chunk before, and the size of the sampled chunks as they are stored
+ * and compressed with each compression type that is compiled in.
+ *
+ * columnar.advise turns that into recommendations:
+ *
+ *	- the compression of a column, if another compression type stores the
+ *	  sampled chunks in columnar.auto_compression_min_gain percent fewer
+ *	  bytes, or decompresses them at least twice as fast in about as many
+ *	  bytes. Among compression types of about the same size the one that
+ *	  decompresses fastest is picked.
+ *	- a smaller chunk_group_row_limit, if scans already skip chunk groups
+ *	  of the table and a column has chunks with ordered value ranges, so
+ *	  smaller chunk groups skip more rows.
+ *	- a larger chunk_group_row_limit, if scans read all of the table
+ *	  without skipping any chunk group and no column has ordered chunks,
+ *	  so chunk groups only cost metadata and compression ratio.
+ *
+ * Sizes and decompression times are measured on the sample and scaled up
+ * to the whole table by the size of the stripes. The chunk group advice
+ * needs the scan counters of columnar.pg_stat_columnar.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "portability/instr_time.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+#include "utils/typcache.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_compression.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+#define COLUMN_PROFILE_NATTS 11
+#define ADVISE_NATTS 9
+
+/* columns with this fraction of ordered chunk ranges are clustered */
+#define CLUSTERED_RANGE_FRACTION 0.9
+
+/* below this fraction of ordered chunk ranges no column prunes well */
+#define UNCLUSTERED_RANGE_FRACTION 0.5
+
+/* how many times as fast a compression type must decompress to be advised */
+#define DECOMPRESSION_SPEEDUP_FACTOR 2.0
+
+/* compression types measured, in the order of the columns of column_profile */
+static const CompressionType CandidateCompressionTypes[] = {
+	COMPRESSION_NONE,
+	COMPRESSION_PG_LZ,
+	COMPRESSION_LZ4,
+	COMPRESSION_ZSTD
+};
+
+#define CANDIDATE_COUNT lengthof(CandidateCompressionTypes)
+
+/* the sampled chunks of one column */
+typedef struct ColumnProfile
+{
+	/* rows, and rows and nulls of the chunks whose null count is known */
+	uint64 rowCount;
+	uint64 statisticsRowCount;
+	uint64 nullCount;
+	uint64 distinctCount;
+
+	/* chunks whose sortedness is known, and how many of them are sorted */
+	uint64 sortednessKnownCount;
+	uint64 sortedCount;
+
+	/* consecutive chunks, and how many of them have ranges in order */
+	uint64 adjacentRangeCount;
+	uint64 orderedRangeCount;
+
+	/* bytes of the streams as stored, and of the values per compression */
+	uint64 storedBytes;
+	uint64 storedValueBytes[COMPRESSION_COUNT];
+	double storedDecompressMs;
+
+	uint64 candidateBytes[CANDIDATE_COUNT];
+	double candidateDecompressMs[CANDIDATE_COUNT];
+
+	/* compression and level new chunks of the column get */
+	CompressionType compressionType;
+	int compressionLevel;
+} ColumnProfile;
+
+/* the sampled stripes of a table */
+typedef struct RelationProfile
+{
+	uint64 stripeCount;
+	uint64 chunkGroupCount;
+	uint64 dataLength;
+
+	uint64 sampledStripeCount;
+	uint64 sampledDataLength;
+
+	ColumnarOptions options;
+
+	int columnCount;
+	ColumnProfile *columns;
+} RelationProfile;
+
+static Relation OpenAdvisorRelation(Oid relationId);
+static void ProfileRelation(Relation rel, int32 sampleStripes, RelationProfile *profile);
+static void ProfileStripe(Relation rel, StripeMetadata *stripeMetadata,
+						  FmgrInfo **compareFunctions, RelationProfile *profile);
+static void ProfileValueStream(ColumnProfile *column, ColumnChunkSkipNode *chunkSkipNode,
+							   StringInfo valueStream);
+static double TimeDecompression(StringInfo buffer, CompressionType compressionType,
+								uint64 decompressedSize, uint64 dictionaryId,
+								StringInfo outputBuffer);
+static bool RangesInOrder(FmgrInfo *compareFunction, Oid collation,
+						  ColumnChunkSkipNode *previous, ColumnChunkSkipNode *current);
+static CompressionType StoredCompressionType(ColumnProfile *column);
+static double ProfileScale(RelationProfile *profile);
+static void AdviseCompression(RelationProfile *profile, Form_pg_attribute attributeForm,
+							  ColumnProfile *column, Tuplestorestate *tupleStore,
+							  TupleDesc tupleDescriptor);
+static void AdviseChunkGroupRowLimit(Relation rel, RelationProfile *profile,
+									 Tuplestorestate *tupleStore,
+									 TupleDesc tupleDescriptor);
+static Tuplestorestate * BeginAdvisorResult(FunctionCallInfo fcinfo,
+											TupleDesc *tupleDescriptor);
+
+PG_FUNCTION_INFO_V1(columnar_column_profile);
+PG_FUNCTION_INFO_V1(columnar_advise);
+
+
+/*
+ * columnar_column_profile returns what the sampled chunks of each column of
+ * a columnar table tell about its values and how they compress. Sizes are
+ * those of the whole table, scaled up from the sample.
+ */
+Datum
+columnar_column_profile(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int32 sampleStripes = PG_GETARG_INT32(1);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = BeginAdvisorResult(fcinfo, &tupleDescriptor);
+
+	Relation rel = OpenAdvisorRelation(relationId);
+
+	RelationProfile profile = { 0 };
+	ProfileRelation(rel, sampleStripes, &profile);
+	double scale = ProfileScale(&profile);
+
+	TupleDesc relationDescriptor = RelationGetDescr(rel);
+	for (int columnIndex = 0; columnIndex < profile.columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(relationDescriptor, columnIndex);
+		ColumnProfile *column = &profile.columns[columnIndex];
+
+		if (attributeForm->attisdropped || column->rowCount == 0)
+		{
+			continue;
+		}
+
+		Datum values[COLUMN_PROFILE_NATTS] = { 0 };
+		bool nulls[COLUMN_PROFILE_NATTS] = { 0 };
+
+		values[0] = NameGetDatum(&attributeForm->attname);
+
+		uint64 nonNullCount = column->statisticsRowCount - column->nullCount;
+		values[1] = Float4GetDatum((float4) column->nullCount /
+								   Max(column->statisticsRowCount, 1));
+		nulls[1] = column->statisticsRowCount == 0;
+		values[2] = Float4GetDatum((float4) column->distinctCount / Max(nonNullCount, 1));
+		nulls[2] = nonNullCount == 0;
+		values[3] = Float4GetDatum((float4) column->sortedCount /
+								   Max(column->sortednessKnownCount, 1));
+		nulls[3] = column->sortednessKnownCount == 0;
+		values[4] = Float4GetDatum((float4) column->orderedRangeCount /
+								   Max(column->adjacentRangeCount, 1));
+		nulls[4] = column->adjacentRangeCount == 0;
+
+		const char *compressionName = CompressionTypeStr(StoredCompressionType(column));
+		values[5] = CStringGetTextDatum(compressionName ? compressionName : "unknown");
+		values[6] = Int64GetDatum((int64) (column->storedBytes * scale));
+
+		for (int candidate = 0; candidate < CANDIDATE_COUNT; candidate++)
+		{
+			values[7 + candidate] =
+				Int64GetDatum((int64) (column->candidateBytes[candidate] * scale));
+			nulls[7 + candidate] =
+				CompressionTypeStr(CandidateCompressionTypes[candidate]) == NULL;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+	}
+
+	table_close(rel, AccessShareLock);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * columnar_advise returns the options of a columnar table that its profile
+ * suggests to change, with the value to change them to, the estimated size
+ * and decompression time of the column before and after where they are
+ * known, and the reason.
+ */
+Datum
+columnar_advise(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int32 sampleStripes = PG_GETARG_INT32(1);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = BeginAdvisorResult(fcinfo, &tupleDescriptor);
+
+	Relation rel = OpenAdvisorRelation(relationId);
+
+	RelationProfile profile = { 0 };
+	ProfileRelation(rel, sampleStripes, &profile);
+
+	TupleDesc relationDescriptor = RelationGetDescr(rel);
+	for (int columnIndex = 0; columnIndex < profile.columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(relationDescriptor, columnIndex);
+		ColumnProfile *column = &profile.columns[columnIndex];
+
+		if (attributeForm->attisdropped || column->storedBytes == 0)
+		{
+			continue;
+		}
+
+		AdviseCompression(&profile, attributeForm, column, tupleStore, tupleDescriptor);
+	}
+
+	AdviseChunkGroupRowLimit(rel, &profile, tupleStore, tupleDescriptor);
+
+	table_close(rel, AccessShareLock);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * OpenAdvisorRelation opens a columnar table the current user may read.
+ */
+static Relation
+OpenAdvisorRelation(Oid relationId)
+{
+	Relation rel = table_open(relationId, AccessShareLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	AclResult aclresult = pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclresult, OBJECT_TABLE, RelationGetRelationName(rel));
+	}
+
+	return rel;
+}
+
+
+/*
+ * ProfileRelation reads the chunks of up to sampleStripes stripes of the
+ * table, spread evenly over its stripes, into profile.
+ */
+static void
+ProfileRelation(Relation rel, int32 sampleStripes, RelationProfile *profile)
+{
+	if (sampleStripes <= 0)
+	{
+		ereport(ERROR, (errmsg("sample_stripes must be positive")));
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+
+	ReadColumnarOptions(RelationGetRelid(rel), &profile->options);
+
+	profile->columnCount = tupleDescriptor->natts;
+	profile->columns = palloc0(tupleDescriptor->natts * sizeof(ColumnProfile));
+
+	FmgrInfo **compareFunctions = palloc0(tupleDescriptor->natts * sizeof(FmgrInfo *));
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnProfile *column = &profile->columns[columnIndex];
+
+		column->compressionType = profile->options.compressionType;
+		column->compressionLevel = profile->options.compressionLevel;
+
+		if (attributeForm->attisdropped)
+		{
+			continue;
+		}
+
+		TypeCacheEntry *typeEntry = lookup_type_cache(attributeForm->atttypid,
+													  TYPECACHE_CMP_PROC_FINFO);
+		if (OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			compareFunctions[columnIndex] = &typeEntry->cmp_proc_finfo;
+		}
+	}
+
+	ColumnCompressionOption *compressionOption = NULL;
+	foreach_ptr(compressionOption, profile->options.columnCompressionOptions)
+	{
+		if (compressionOption->attnum > tupleDescriptor->natts ||
+			compressionOption->compressionType == COMPRESSION_TYPE_INVALID)
+		{
+			continue;
+		}
+
+		ColumnProfile *column =
+			&profile->columns[AttrNumberGetAttrOffset(compressionOption->attnum)];
+
+		column->compressionType = compressionOption->compressionType;
+		if (compressionOption->compressionLevel != 0)
+		{
+			column->compressionLevel = compressionOption->compressionLevel;
+		}
+	}
+
+	List *readableStripes = NIL;
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 || stripeMetadata->insertedByCurrentXact)
+		{
+			continue;
+		}
+
+		readableStripes = lappend(readableStripes, stripeMetadata);
+		profile->stripeCount++;
+		profile->chunkGroupCount += stripeMetadata->chunkCount;
+		profile->dataLength += stripeMetadata->dataLength;
+	}
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Advisor Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	uint64 sampleCount = Min((uint64) sampleStripes, profile->stripeCount);
+	for (uint64 sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		uint64 stripeIndex = sampleIndex * profile->stripeCount / sampleCount;
+		stripeMetadata = list_nth(readableStripes, stripeIndex);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+		ProfileStripe(rel, stripeMetadata, compareFunctions, profile);
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+
+		profile->sampledStripeCount++;
+		profile->sampledDataLength += stripeMetadata->dataLength;
+	}
+
+	MemoryContextDelete(stripeContext);
+}
+
+
+/*
+ * ProfileStripe adds the chunks of a stripe to the profile of their columns.
+ */
+static void
+ProfileStripe(Relation rel, StripeMetadata *stripeMetadata,
+			  FmgrInfo **compareFunctions, RelationProfile *profile)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+												  tupleDescriptor,
+												  stripeMetadata->chunkCount,
+												  GetTransactionSnapshot());
+
+	/* columns added after the stripe was written have no chunks in it */
+	uint32 columnCount = Min(stripeMetadata->columnCount, skipList->columnCount);
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnProfile *column = &profile->columns[columnIndex];
+
+		if (attributeForm->attisdropped)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *previousSkipNode = NULL;
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			column->rowCount += chunkSkipNode->rowCount;
+
+			if (chunkSkipNode->hasStatistics)
+			{
+				column->statisticsRowCount += chunkSkipNode->rowCount;
+				column->nullCount += chunkSkipNode->nullCount;
+				column->distinctCount += chunkSkipNode->distinctCount;
+			}
+
+			if (chunkSkipNode->sortednessKnown)
+			{
+				column->sortednessKnownCount++;
+				column->sortedCount += chunkSkipNode->valuesSorted ? 1 : 0;
+			}
+
+			if (previousSkipNode != NULL && compareFunctions[columnIndex] != NULL &&
+				previousSkipNode->hasMinMax && chunkSkipNode->hasMinMax)
+			{
+				column->adjacentRangeCount++;
+				if (RangesInOrder(compareFunctions[columnIndex],
+								  attributeForm->attcollation,
+								  previousSkipNode, chunkSkipNode))
+				{
+					column->orderedRangeCount++;
+				}
+			}
+
+			if (chunkSkipNode->hasMinMax)
+			{
+				previousSkipNode = chunkSkipNode;
+			}
+
+			column->storedBytes += chunkSkipNode->existsLength +
+								   chunkSkipNode->valueLength;
+			for (int candidate = 0; candidate < CANDIDATE_COUNT; candidate++)
+			{
+				column->candidateBytes[candidate] += chunkSkipNode->existsLength;
+			}
+
+			if (chunkSkipNode->valueLength == 0)
+			{
+				continue;
+			}
+
+			StringInfo valueStream = makeStringInfo();
+			enlargeStringInfo(valueStream, chunkSkipNode->valueLength);
+			valueStream->len = chunkSkipNode->valueLength;
+			ColumnarStorageRead(rel, stripeMetadata->fileOffset +
+								chunkSkipNode->valueChunkOffset,
+								valueStream->data, valueStream->len);
+
+			ProfileValueStream(column, chunkSkipNode, valueStream);
+		}
+	}
+}
+
+
+/*
+ * ProfileValueStream decompresses the value stream of a chunk, compresses
+ * it with each compression type that is compiled in, and adds the sizes and
+ * the decompression times to the profile of its column.
+ */
+static void
+ProfileValueStream(ColumnProfile *column, ColumnChunkSkipNode *chunkSkipNode,
+				   StringInfo valueStream)
+{
+	StringInfo decompressedBuffer = makeStringInfo();
+	StringInfo compressedBuffer = makeStringInfo();
+	StringInfo outputBuffer = makeStringInfo();
+
+	column->storedValueBytes[chunkSkipNode->valueCompressionType] += valueStream->len;
+	column->storedDecompressMs +=
+		TimeDecompression(valueStream, chunkSkipNode->valueCompressionType,
+						  chunkSkipNode->decompressedValueSize,
+						  chunkSkipNode->compressionDictionaryId, decompressedBuffer);
+
+	for (int candidate = 0; candidate < CANDIDATE_COUNT; candidate++)
+	{
+		CompressionType compressionType = CandidateCompressionTypes[candidate];
+		if (CompressionTypeStr(compressionType) == NULL)
+		{
+			continue;
+		}
+
+		/* like stripes, keep the values as they are if they don't compress */
+		bool compressed = compressionType != COMPRESSION_NONE &&
+						  CompressBuffer(decompressedBuffer, compressedBuffer,
+										 compressionType, column->compressionLevel);
+		StringInfo storedBuffer = compressed ? compressedBuffer : decompressedBuffer;
+
+		column->candidateBytes[candidate] += storedBuffer->len;
+		column->candidateDecompressMs[candidate] +=
+			TimeDecompression(storedBuffer, compressed ? compressionType :
+							  COMPRESSION_NONE, decompressedBuffer->len, 0,
+							  outputBuffer);
+	}
+}
+
+
+/*
+ * TimeDecompression decompresses a buffer into outputBuffer and returns how
+ * many milliseconds it took.
+ */
+static double
+TimeDecompression(StringInfo buffer, CompressionType compressionType,
+				  uint64 decompressedSize, uint64 dictionaryId, StringInfo outputBuffer)
+{
+	instr_time startTime;
+	instr_time endTime;
+
+	INSTR_TIME_SET_CURRENT(startTime);
+	DecompressBufferInto(buffer, compressionType, decompressedSize, dictionaryId,
+						 outputBuffer);
+	INSTR_TIME_SET_CURRENT(endTime);
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+
+	return INSTR_TIME_GET_MILLISEC(endTime);
+}
+
+
+/*
+ * RangesInOrder returns whether the value range of a chunk follows the one of
+ * the chunk before it, upwards or downwards, without overlapping it.
+ */
+static bool
+RangesInOrder(FmgrInfo *compareFunction, Oid collation,
+			  ColumnChunkSkipNode *previous, ColumnChunkSkipNode *current)
+{
+	int32 ascending = DatumGetInt32(FunctionCall2Coll(compareFunction, collation,
+													  previous->maximumValue,
+													  current->minimumValue));
+	if (ascending <= 0)
+	{
+		return true;
+	}
+
+	int32 descending = DatumGetInt32(FunctionCall2Coll(compareFunction, collation,
+													   current->maximumValue,
+													   previous->minimumValue));
+	return descending <= 0;
+}
+
+
+/*
+ * StoredCompressionType returns the compression type most of the sampled
+ * values of a column are stored with.
+ */
+static CompressionType
+StoredCompressionType(ColumnProfile *column)
+{
+	CompressionType storedType = COMPRESSION_NONE;
+	for (int compressionType = 0; compressionType < COMPRESSION_COUNT; compressionType++)
+	{
+		if (column->storedValueBytes[compressionType] >
+			column->storedValueBytes[storedType])
+		{
+			storedType = compressionType;
+		}
+	}
+
+	return storedType;
+}
+
+
+/*
+ * ProfileScale returns the factor that scales the sizes and times measured on
+ * the sampled stripes up to the whole table.
+ */
+static double
+ProfileScale(RelationProfile *profile)
+{
+	if (profile->sampledDataLength == 0)
+	{
+		return 0.0;
+	}
+
+	return (double) profile->dataLength / profile->sampledDataLength;
+}
+
+
+/*
+ * AdviseCompression adds a row that advises another compression type for a
+ * column, if one compresses its sampled chunks considerably better or
+ * decompresses them considerably faster than they are stored now.
+ */
+static void
+AdviseCompression(RelationProfile *profile, Form_pg_attribute attributeForm,
+				  ColumnProfile *column, Tuplestorestate *tupleStore,
+				  TupleDesc tupleDescriptor)
+{
+	int smallest = -1;
+	for (int candidate = 0; candidate < CANDIDATE_COUNT; candidate++)
+	{
+		if (CompressionTypeStr(CandidateCompressionTypes[candidate]) != NULL &&
+			(smallest < 0 ||
+			 column->candidateBytes[candidate] < column->candidateBytes[smallest]))
+		{
+			smallest = candidate;
+		}
+	}
+
+	/* of the compression types about as small as the smallest, the fastest */
+	double closeBytes = column->candidateBytes[smallest] *
+						(100.0 + columnar_auto_compression_min_gain) / 100.0;
+	int chosen = smallest;
+	for (int candidate = 0; candidate < CANDIDATE_COUNT; candidate++)
+	{
+		if (CompressionTypeStr(CandidateCompressionTypes[candidate]) != NULL &&
+			column->candidateBytes[candidate] <= closeBytes &&
+			column->candidateDecompressMs[candidate] <
+			column->candidateDecompressMs[chosen])
+		{
+			chosen = candidate;
+		}
+	}
+
+	CompressionType chosenType = CandidateCompressionTypes[chosen];
+	if (chosenType == column->compressionType ||
+		(chosenType == COMPRESSION_LZ4 && column->compressionType == COMPRESSION_LZ4HC))
+	{
+		return;
+	}
+
+	uint64 storedBytes = column->storedBytes;
+	uint64 chosenBytes = column->candidateBytes[chosen];
+	double storedMs = column->storedDecompressMs;
+	double chosenMs = column->candidateDecompressMs[chosen];
+
+	char *reason = NULL;
+	if (chosenBytes * 100.0 <= storedBytes * (100.0 - columnar_auto_compression_min_gain))
+	{
+		reason = psprintf("%s stores the sampled chunks in %d%% of their size",
+						  CompressionTypeStr(chosenType),
+						  (int) (chosenBytes * 100.0 / storedBytes));
+	}
+	else if (chosenBytes * 100.0 <=
+			 storedBytes * (100.0 + columnar_auto_compression_min_gain) &&
+			 chosenMs * DECOMPRESSION_SPEEDUP_FACTOR <= storedMs)
+	{
+		reason = psprintf("%s decompresses the sampled chunks %.1f times as fast",
+						  CompressionTypeStr(chosenType),
+						  storedMs / Max(chosenMs, 0.001));
+	}
+	else
+	{
+		return;
+	}
+
+	double scale = ProfileScale(profile);
+	const char *currentName = CompressionTypeStr(column->compressionType);
+
+	Datum values[ADVISE_NATTS] = { 0 };
+	bool nulls[ADVISE_NATTS] = { 0 };
+
+	values[0] = NameGetDatum(&attributeForm->attname);
+	values[1] = CStringGetTextDatum("compression");
+	values[2] = CStringGetTextDatum(currentName ? currentName : "unknown");
+	values[3] = CStringGetTextDatum(CompressionTypeStr(chosenType));
+	values[4] = Int64GetDatum((int64) (storedBytes * scale));
+	values[5] = Int64GetDatum((int64) (chosenBytes * scale));
+	values[6] = Float8GetDatum(storedMs * scale);
+	values[7] = Float8GetDatum(chosenMs * scale);
+	values[8] = CStringGetTextDatum(reason);
+
+	tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+}
+
+
+/*
+ * AdviseChunkGroupRowLimit adds a row that advises a smaller or larger
+ * chunk_group_row_limit, if the scans of the table so far and the value
+ * ranges of its chunks suggest one.
+ */
+static void
+AdviseChunkGroupRowLimit(Relation rel, RelationProfile *profile,
+						 Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	uint64 counters[COLUMNAR_STAT_COUNTER_COUNT] = { 0 };
+	if (profile->chunkGroupCount == 0 ||
+		!ColumnarStatRelationCounters(RelationGetRelid(rel), counters))
+	{
+		return;
+	}
+
+	TupleDesc relationDescriptor = RelationGetDescr(rel);
+	const char *clusteredColumn = NULL;
+	double maximumOrderedFraction = 0.0;
+	for (int columnIndex = 0; columnIndex < profile->columnCount; columnIndex++)
+	{
+		ColumnProfile *column = &profile->columns[columnIndex];
+		if (column->adjacentRangeCount == 0)
+		{
+			continue;
+		}
+
+		double orderedFraction = (double) column->orderedRangeCount /
+								 column->adjacentRangeCount;
+		if (orderedFraction > maximumOrderedFraction)
+		{
+			maximumOrderedFraction = orderedFraction;
+			clusteredColumn =
+				NameStr(TupleDescAttr(relationDescriptor, columnIndex)->attname);
+		}
+	}
+
+	uint64 scannedCount = counters[COLUMNAR_STAT_CHUNK_GROUPS_SCANNED];
+	uint64 skippedCount = counters[COLUMNAR_STAT_CHUNK_GROUPS_SKIPPED];
+	uint32 chunkRowCount = profile->options.chunkRowCount;
+	uint32 recommendedRowCount = chunkRowCount;
+	char *reason = NULL;
+
+	if (skippedCount > 0 && maximumOrderedFraction >= CLUSTERED_RANGE_FRACTION)
+	{
+		recommendedRowCount = Max(chunkRowCount / 2, CHUNK_ROW_COUNT_MINIMUM);
+		reason = psprintf("scans skipped %d%% of the chunk groups read and the chunks "
+						  "of column %s have ordered ranges, smaller chunk groups "
+						  "skip more rows",
+						  (int) (skippedCount * 100 / (scannedCount + skippedCount)),
+						  quote_identifier(clusteredColumn));
+	}
+	else if (skippedCount == 0 && scannedCount >= profile->chunkGroupCount &&
+			 maximumOrderedFraction < UNCLUSTERED_RANGE_FRACTION)
+	{
+		recommendedRowCount = Min((uint64) chunkRowCount * 2,
+								  profile->options.stripeRowCount);
+		reason = pstrdup("scans skipped none of the chunk groups and no column has "
+						 "chunks with ordered ranges, larger chunk groups compress "
+						 "better and have less metadata");
+	}
+
+	if (recommendedRowCount == chunkRowCount)
+	{
+		return;
+	}
+
+	Datum values[ADVISE_NATTS] = { 0 };
+	bool nulls[ADVISE_NATTS] = { 0 };
+
+	nulls[0] = true;
+	values[1] = CStringGetTextDatum("chunk_group_row_limit");
+	values[2] = CStringGetTextDatum(psprintf("%u", chunkRowCount));
+	values[3] = CStringGetTextDatum(psprintf("%u", recommendedRowCount));
+	nulls[4] = true;
+	nulls[5] = true;
+	nulls[6] = true;
+	nulls[7] = true;
+	values[8] = CStringGetTextDatum(reason);
+
+	tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+}
+
+
+/*
+ * BeginAdvisorResult checks that the function is called in a context that
+ * takes a set and returns the tuple store and descriptor of its result.
+ */
+static Tuplestorestate *
+BeginAdvisorResult(FunctionCallInfo fcinfo, TupleDesc *tupleDescriptor)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+	if (get_call_result_type(fcinfo, NULL, tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("function returning record called in context "
+							   "that cannot accept type record")));
+	}
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	*tupleDescriptor = CreateTupleDescCopy(*tupleDescriptor);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = *tupleDescriptor;
+
+	return tupleStore;
+}
@@ -0,0 +1,2927 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_arrow.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Export and import of columnar tables in the Arrow IPC streaming format.
+ *
+ * columnar.export_arrow reads the given columns of a table with
+ * ColumnarReadNextVector and returns an Arrow stream as a set of bytea rows:
+ * a schema message, a record batch message for each vector and the end of
+ * stream marker. Concatenated, the rows can be read by any Arrow
+ * implementation, such as pyarrow.ipc.open_stream.
+ *
+ * The vectors of fixed width types already have the layout of Arrow buffers
+ * and are copied as they are. Dates and timestamps only need their epoch
+ * moved to 1970, booleans and NULL flags are packed into bitmaps, and
+ * variable length values are appended to the data buffer of the batch.
+ * Columns of types without an Arrow counterpart, like numeric, are exported
+ * as strings from their output function.
+ *
+ * The metadata of Arrow messages is encoded as flatbuffers. As the stream
+ * only needs a few fixed messages, they are written by the small forward
+ * builder below instead of generated code: every object is appended after
+ * the one that refers to it, and the reference is patched in once the
+ * position of the object is known.
+ *
+ * columnar.import_arrow and columnar.import_arrow_file go the other way:
+ * the column buffers of each record batch are converted into arrays of
+ * datums, a slice of rows at a time, and handed to ColumnarWriteBatch, so
+ * the rows are written into stripes without being formed into tuples or
+ * going through the executor. Fields are matched to columns by name, and
+ * converted directly to the matching types or through the input function of
+ * the column. The metadata of the stream is read by a flatbuffers reader
+ * that checks every offset against the length of the message, as the stream
+ * comes from the user.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "catalog/pg_authid.h"
+#include "catalog/pg_type.h"
+#include "common/int.h"
+#include "executor/tuptable.h"
+#include "funcapi.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/fd.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+#include "utils/uuid.h"
+
+#include "pg_version_compat.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/vectorization/columnar_vector_types.h"
+
+#include "columnar/utils/listutils.h"
+
+/* values of the Arrow flatbuffers schema, see Schema.fbs and Message.fbs */
+#define ARROW_METADATA_VERSION_V4 3
+#define ARROW_METADATA_VERSION_V5 4
+#define ARROW_MESSAGE_HEADER_SCHEMA 1
+#define ARROW_MESSAGE_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_NONE 0
+#define ARROW_TYPE_NULL 1
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_BINARY 4
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_DATE 8
+#define ARROW_TYPE_TIME 9
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_TYPE_FIXED_SIZE_BINARY 15
+#define ARROW_TYPE_LARGE_BINARY 19
+#define ARROW_TYPE_LARGE_UTF8 20
+#define ARROW_PRECISION_SINGLE 1
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_DATE_UNIT_DAY 0
+#define ARROW_DATE_UNIT_MILLISECOND 1
+#define ARROW_TIME_UNIT_SECOND 0
+#define ARROW_TIME_UNIT_MILLISECOND 1
+#define ARROW_TIME_UNIT_MICROSECOND 2
+
+/* marks the start of an encapsulated message, and with a zero length the end */
+#define ARROW_CONTINUATION_MARKER 0xFFFFFFFF
+
+/* buffers of the message bodies are aligned to 8 bytes */
+#define ARROW_BUFFER_ALIGNMENT 8
+
+/* days and microseconds from the Unix epoch to the Postgres epoch */
+#define ARROW_EPOCH_DAYS (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE)
+#define ARROW_EPOCH_USECS ((int64) ARROW_EPOCH_DAYS * USECS_PER_DAY)
+
+#define ARROW_MAX_TABLE_FIELDS 7
+
+/* rows of a record batch converted for each call of ColumnarWriteBatch */
+#define ARROW_IMPORT_SLICE_ROWS 10000
+
+/* how the values of a column are converted to Arrow */
+typedef enum ArrowColumnKind
+{
+	/* values are copied from the vector as they are */
+	ARROW_COLUMN_FIXED,
+	ARROW_COLUMN_BOOL,
+	ARROW_COLUMN_DATE,
+	ARROW_COLUMN_TIMESTAMP,
+	/* varlena values are copied without their header */
+	ARROW_COLUMN_VARLENA,
+	/* varlena values are converted to UTF8 from the server encoding */
+	ARROW_COLUMN_TEXT,
+	/* values are converted to strings by the output function of the type */
+	ARROW_COLUMN_OUTPUT
+} ArrowColumnKind;
+
+typedef struct ArrowColumn
+{
+	AttrNumber attributeNumber;
+	char *name;
+	ArrowColumnKind kind;
+
+	/* Arrow type of the column */
+	uint8 arrowType;
+	int32 bitWidth;
+	bool isSigned;
+	int16 precision;
+	int32 byteWidth;
+	const char *timezone;
+
+	/* length of the values in the vector */
+	int16 valueLength;
+	FmgrInfo outputFunction;
+} ArrowColumn;
+
+/* a field of a flatbuffers table being written */
+typedef struct FlatField
+{
+	/* size of the field in bytes, 0 if it is absent */
+	uint8 size;
+	/* whether the field is the offset of another object */
+	bool isOffset;
+	uint64 value;
+} FlatField;
+
+/* validity and data buffers of a column in a record batch */
+typedef struct ArrowBuffer
+{
+	int64 offset;
+	int64 length;
+} ArrowBuffer;
+
+typedef struct ArrowFieldNode
+{
+	int64 length;
+	int64 nullCount;
+} ArrowFieldNode;
+
+/* how the values of an Arrow field are converted to its column */
+typedef enum ArrowImportConversion
+{
+	ARROW_IMPORT_INVALID,
+	/* fields of type Null only have NULLs */
+	ARROW_IMPORT_NULL,
+	ARROW_IMPORT_INT,
+	ARROW_IMPORT_FLOAT,
+	ARROW_IMPORT_BOOL,
+	/* strings are converted from UTF8 to the server encoding */
+	ARROW_IMPORT_TEXT,
+	ARROW_IMPORT_BYTEA,
+	ARROW_IMPORT_UUID,
+	ARROW_IMPORT_DATE,
+	ARROW_IMPORT_TIME,
+	ARROW_IMPORT_TIMESTAMP,
+	/* values are converted to strings for the input function of the type */
+	ARROW_IMPORT_INPUT
+} ArrowImportConversion;
+
+typedef struct ArrowImportField
+{
+	char *name;
+	AttrNumber attributeNumber;
+	Oid typeId;
+	ArrowImportConversion conversion;
+
+	/* Arrow type of the field */
+	uint8 arrowType;
+	int32 bitWidth;
+	bool isSigned;
+	int32 byteWidth;
+	int16 unit;
+
+	FmgrInfo inputFunction;
+	Oid inputTypeIOParam;
+	int32 typeMod;
+
+	/* buffers of the field in the current record batch */
+	bool hasNulls;
+	const uint8 *validity;
+	const uint8 *values;
+	const uint8 *offsets;
+	int offsetWidth;
+	const uint8 *data;
+	int64 dataLength;
+} ArrowImportField;
+
+/* an Arrow stream being imported, either in memory or in a file */
+typedef struct ArrowStreamReader
+{
+	const char *data;
+	Size length;
+	Size position;
+
+	FILE *file;
+	const char *fileName;
+} ArrowStreamReader;
+
+/* a table of a flatbuffer being read */
+typedef struct FlatTable
+{
+	const char *buf;
+	uint32 length;
+	uint32 position;
+	uint32 vtable;
+	uint16 vtableSize;
+	uint16 tableSize;
+} FlatTable;
+
+PG_FUNCTION_INFO_V1(columnar_export_arrow);
+PG_FUNCTION_INFO_V1(columnar_import_arrow);
+PG_FUNCTION_INFO_V1(columnar_import_arrow_file);
+
+static List * ArrowExportColumns(Relation rel, ArrayType *columnArray);
+static ArrowColumn * BuildArrowColumn(Form_pg_attribute attribute);
+static void CheckArrowExportPrivileges(Relation rel, List *columnList);
+static bytea * ArrowSchemaMessage(List *columnList);
+static bytea * ArrowRecordBatchMessage(List *columnList, Datum *columnValues,
+									   int rowCount);
+static void AppendArrowColumn(StringInfo body, ArrowColumn *column,
+							  VectorColumn *vector, int rowCount,
+							  ArrowFieldNode *fieldNode, ArrowBuffer *buffers);
+static void AppendArrowVarlenaColumn(StringInfo body, ArrowColumn *column,
+									 VectorColumn *vector, int rowCount,
+									 ArrowBuffer *offsetBuffer,
+									 ArrowBuffer *dataBuffer);
+static uint8 * AppendArrowBuffer(StringInfo body, int64 length, ArrowBuffer *buffer);
+static bytea * ArrowMessage(StringInfo metadata, StringInfo body);
+static uint64 ImportArrowStream(Oid relationId, ArrowStreamReader *reader);
+static List * ParseArrowSchema(Relation rel, FlatTable *schemaTable);
+static void SetArrowImportConversion(ArrowImportField *field,
+									 Form_pg_attribute attribute);
+static int64 ParseArrowRecordBatch(FlatTable *recordBatch, const char *body,
+								   int64 bodyLength, List *fieldList);
+static const uint8 * ArrowBodyBuffer(const char *body, int64 bodyLength,
+									 const char *buffers, uint32 bufferIndex,
+									 int64 minimumLength, int64 *length);
+static void ImportArrowColumn(ArrowImportField *field, int64 firstRow,
+							  uint32 rowCount, Datum *values, bool *nulls);
+static int64 ArrowIntValue(ArrowImportField *field, int64 row);
+static Datum ArrowIntDatum(ArrowImportField *field, int64 value);
+static float8 ArrowFloatValue(ArrowImportField *field, int64 row);
+static const char * ArrowBinaryValue(ArrowImportField *field, int64 row, Size *length);
+static const char * ArrowUtf8ToServer(const char *data, Size *length);
+static DateADT ArrowDateValue(ArrowImportField *field, int64 row);
+static int64 ArrowTimeValue(ArrowImportField *field, int64 row);
+static char * ArrowValueString(ArrowImportField *field, int64 row);
+static bool ReadArrowMessage(ArrowStreamReader *reader, const char **metadata,
+							 uint32 *metadataLength);
+static bool ParseArrowMessage(const char *metadata, uint32 metadataLength,
+							  uint8 headerType, FlatTable *header, int64 *bodyLength);
+static const char * ReadArrowBody(ArrowStreamReader *reader, int64 bodyLength);
+static void SkipArrowBody(ArrowStreamReader *reader, int64 bodyLength);
+static const char * ArrowStreamRead(ArrowStreamReader *reader, Size length,
+									bool endAllowed);
+static void FlatStart(StringInfo buf);
+static void FlatPad(StringInfo buf, int alignment);
+static uint32 FlatWriteTable(StringInfo buf, const FlatField *fields, int fieldCount,
+							 uint32 *offsetSlots);
+static uint32 FlatWriteString(StringInfo buf, const char *string);
+static uint32 FlatWriteOffsetVector(StringInfo buf, int count, uint32 *slot);
+static uint32 FlatWriteStructVector(StringInfo buf, const void *data, int count,
+									int structSize);
+static void FlatPatch(StringInfo buf, uint32 slot, uint32 target);
+static void FlatReadRoot(const char *buf, uint32 length, FlatTable *table);
+static void FlatReadTableAt(const char *buf, uint32 length, uint64 position,
+							FlatTable *table);
+static uint32 FlatFieldPosition(FlatTable *table, int fieldIndex, int fieldSize);
+static int64 FlatReadInt(FlatTable *table, int fieldIndex, int fieldSize,
+						 int64 defaultValue);
+static bool FlatReadOffset(FlatTable *table, int fieldIndex, uint64 *target);
+static bool FlatReadChild(FlatTable *table, int fieldIndex, FlatTable *child);
+static uint32 FlatReadVector(FlatTable *table, int fieldIndex, int elementSize,
+							 uint32 *elements);
+static char * FlatReadString(FlatTable *table, int fieldIndex);
+static void FlatReadVectorTable(FlatTable *table, uint32 elements, uint32 index,
+								FlatTable *child);
+static void FlatInvalid(void) pg_attribute_noreturn();
+
+
+/*
+ * columnar_export_arrow returns the rows of the given columns of a columnar
+ * table, or of all its columns if columns is NULL, as the messages of an
+ * Arrow IPC stream. Returns no rows if the relation is NULL.
+ */
+Datum
+columnar_export_arrow(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+#ifdef WORDS_BIGENDIAN
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("Arrow export is not supported on big endian platforms")));
+#endif
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1);
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 1, "message", BYTEAOID, -1, 0);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = resultDescriptor;
+
+	if (PG_ARGISNULL(0))
+	{
+		return (Datum) 0;
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+	ArrayType *columnArray = PG_ARGISNULL(1) ? NULL : PG_GETARG_ARRAYTYPE_P(1);
+
+	Relation rel = table_open(relationId, AccessShareLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (check_enable_rls(relationId, InvalidOid, false) == RLS_ENABLED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot export table %s with row-level security",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	List *columnList = ArrowExportColumns(rel, columnArray);
+	CheckArrowExportPrivileges(rel, columnList);
+
+	MemoryContext scanContext = AllocSetContextCreate(CurrentMemoryContext,
+													  "Columnar Arrow Export Context",
+													  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext batchContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Columnar Arrow Batch Context",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	/* the read projects the columns in attribute order */
+	bool *columnSelected = palloc0(tupleDescriptor->natts * sizeof(bool));
+	ArrowColumn *column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		columnSelected[AttrNumberGetAttrOffset(column->attributeNumber)] = true;
+	}
+
+	List *projectedColumnList = NIL;
+	Bitmapset *projectedColumns = NULL;
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (columnSelected[columnIndex])
+		{
+			projectedColumnList = lappend_int(projectedColumnList, columnIndex + 1);
+			projectedColumns = bms_add_member(projectedColumns, columnIndex);
+		}
+	}
+
+	Datum value = 0;
+	bool isNull = false;
+
+	value = PointerGetDatum(ArrowSchemaMessage(columnList));
+	tuplestore_putvalues(tupleStore, resultDescriptor, &value, &isNull);
+
+	TupleTableSlot *vectorSlot = CreateProjectedVectorTupleTableSlot(tupleDescriptor,
+																	 projectedColumns);
+	VectorTupleTableSlot *vectorTTS = (VectorTupleTableSlot *) vectorSlot;
+
+	oldContext = MemoryContextSwitchTo(scanContext);
+	ColumnarReadState *readState = ColumnarBeginRead(rel, tupleDescriptor,
+													 projectedColumnList, NIL,
+													 scanContext,
+													 GetActiveSnapshot(), false,
+													 NULL);
+	MemoryContextSwitchTo(oldContext);
+
+	int newVectorSize = 0;
+	CleanupVectorSlot(vectorTTS);
+	while (ColumnarReadNextVector(readState, vectorTTS->tts.tts_values,
+								  vectorTTS->rowNumber, vectorTTS->capacity,
+								  &newVectorSize))
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		oldContext = MemoryContextSwitchTo(batchContext);
+		value = PointerGetDatum(ArrowRecordBatchMessage(columnList,
+														vectorTTS->tts.tts_values,
+														newVectorSize));
+		tuplestore_putvalues(tupleStore, resultDescriptor, &value, &isNull);
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(batchContext);
+
+		CleanupVectorSlot(vectorTTS);
+		newVectorSize = 0;
+	}
+
+	ColumnarEndRead(readState);
+	ExecDropSingleTupleTableSlot(vectorSlot);
+	MemoryContextDelete(batchContext);
+	MemoryContextDelete(scanContext);
+
+	/* end of stream marker */
+	bytea *endOfStream = palloc(VARHDRSZ + 2 * sizeof(uint32));
+	uint32 endOfStreamWords[2] = { ARROW_CONTINUATION_MARKER, 0 };
+	SET_VARSIZE(endOfStream, VARHDRSZ + sizeof(endOfStreamWords));
+	memcpy(VARDATA(endOfStream), endOfStreamWords, sizeof(endOfStreamWords));
+
+	value = PointerGetDatum(endOfStream);
+	tuplestore_putvalues(tupleStore, resultDescriptor, &value, &isNull);
+
+	table_close(rel, NoLock);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * ArrowExportColumns returns the columns in the array of column names, in
+ * its order, or all columns of the relation if the array is NULL.
+ */
+static List *
+ArrowExportColumns(Relation rel, ArrayType *columnArray)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	List *columnList = NIL;
+
+	if (columnArray == NULL)
+	{
+		for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+			if (!attribute->attisdropped)
+			{
+				columnList = lappend(columnList, BuildArrowColumn(attribute));
+			}
+		}
+
+		return columnList;
+	}
+
+	Datum *columnNames = NULL;
+	bool *columnNulls = NULL;
+	int columnNameCount = 0;
+	deconstruct_array(columnArray, NAMEOID, NAMEDATALEN, false, TYPALIGN_CHAR,
+					  &columnNames, &columnNulls, &columnNameCount);
+
+	for (int nameIndex = 0; nameIndex < columnNameCount; nameIndex++)
+	{
+		if (columnNulls[nameIndex])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("column names must not be null")));
+		}
+
+		char *columnName = NameStr(*DatumGetName(columnNames[nameIndex]));
+		AttrNumber attributeNumber = get_attnum(RelationGetRelid(rel), columnName);
+		if (attributeNumber <= 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" of relation \"%s\" does not exist",
+								   columnName, RelationGetRelationName(rel))));
+		}
+
+		Form_pg_attribute attribute =
+			TupleDescAttr(tupleDescriptor, AttrNumberGetAttrOffset(attributeNumber));
+		columnList = lappend(columnList, BuildArrowColumn(attribute));
+	}
+
+	if (columnList == NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("no columns to export")));
+	}
+
+	return columnList;
+}
+
+
+/*
+ * BuildArrowColumn returns the Arrow type of a column and how its values
+ * are converted to it.
+ */
+static ArrowColumn *
+BuildArrowColumn(Form_pg_attribute attribute)
+{
+	ArrowColumn *column = palloc0(sizeof(ArrowColumn));
+	column->attributeNumber = attribute->attnum;
+	column->name = pstrdup(NameStr(attribute->attname));
+	column->valueLength = attribute->attlen;
+	column->kind = ARROW_COLUMN_FIXED;
+
+	switch (attribute->atttypid)
+	{
+		case BOOLOID:
+		{
+			column->kind = ARROW_COLUMN_BOOL;
+			column->arrowType = ARROW_TYPE_BOOL;
+			break;
+		}
+
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		{
+			column->arrowType = ARROW_TYPE_INT;
+			column->bitWidth = attribute->attlen * BITS_PER_BYTE;
+			column->isSigned = true;
+			break;
+		}
+
+		case FLOAT4OID:
+		{
+			column->arrowType = ARROW_TYPE_FLOATING_POINT;
+			column->precision = ARROW_PRECISION_SINGLE;
+			break;
+		}
+
+		case FLOAT8OID:
+		{
+			column->arrowType = ARROW_TYPE_FLOATING_POINT;
+			column->precision = ARROW_PRECISION_DOUBLE;
+			break;
+		}
+
+		case DATEOID:
+		{
+			column->kind = ARROW_COLUMN_DATE;
+			column->arrowType = ARROW_TYPE_DATE;
+			break;
+		}
+
+		case TIMEOID:
+		{
+			column->arrowType = ARROW_TYPE_TIME;
+			break;
+		}
+
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		{
+			column->kind = ARROW_COLUMN_TIMESTAMP;
+			column->arrowType = ARROW_TYPE_TIMESTAMP;
+			column->timezone = attribute->atttypid == TIMESTAMPTZOID ? "UTC" : NULL;
+			break;
+		}
+
+		case UUIDOID:
+		{
+			column->arrowType = ARROW_TYPE_FIXED_SIZE_BINARY;
+			column->byteWidth = UUID_LEN;
+			break;
+		}
+
+		case BYTEAOID:
+		{
+			column->kind = ARROW_COLUMN_VARLENA;
+			column->arrowType = ARROW_TYPE_BINARY;
+			break;
+		}
+
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+		{
+			column->kind = GetDatabaseEncoding() == PG_UTF8 ?
+						   ARROW_COLUMN_VARLENA : ARROW_COLUMN_TEXT;
+			column->arrowType = ARROW_TYPE_UTF8;
+			break;
+		}
+
+		default:
+		{
+			Oid outputFunctionId = InvalidOid;
+			bool isVarlena = false;
+			getTypeOutputInfo(attribute->atttypid, &outputFunctionId, &isVarlena);
+			fmgr_info(outputFunctionId, &column->outputFunction);
+
+			column->kind = ARROW_COLUMN_OUTPUT;
+			column->arrowType = ARROW_TYPE_UTF8;
+			break;
+		}
+	}
+
+	return column;
+}
+
+
+/*
+ * CheckArrowExportPrivileges errors out unless the current user may select
+ * the table, or all exported columns of it.
+ */
+static void
+CheckArrowExportPrivileges(Relation rel, List *columnList)
+{
+	Oid relationId = RelationGetRelid(rel);
+
+	if (pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT) == ACLCHECK_OK)
+	{
+		return;
+	}
+
+	ArrowColumn *column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		AclResult aclResult = pg_attribute_aclcheck(relationId, column->attributeNumber,
+													GetUserId(), ACL_SELECT);
+		if (aclResult != ACLCHECK_OK)
+		{
+			aclcheck_error_col(aclResult, OBJECT_TABLE, RelationGetRelationName(rel),
+							   column->name);
+		}
+	}
+}
+
+
+/*
+ * ArrowSchemaMessage returns the schema message of the stream, which has a
+ * nullable field for each column.
+ */
+static bytea *
+ArrowSchemaMessage(List *columnList)
+{
+	StringInfo metadata = makeStringInfo();
+	uint32 slots[ARROW_MAX_TABLE_FIELDS];
+
+	FlatStart(metadata);
+
+	FlatField messageFields[] = {
+		{ sizeof(int16), false, ARROW_METADATA_VERSION_V5 },
+		{ sizeof(uint8), false, ARROW_MESSAGE_HEADER_SCHEMA },
+		{ sizeof(uint32), true, 0 },
+		{ sizeof(int64), false, 0 }
+	};
+	FlatPatch(metadata, 0, FlatWriteTable(metadata, messageFields,
+										  lengthof(messageFields), slots));
+	uint32 headerSlot = slots[2];
+
+	/* endianness defaults to little */
+	FlatField schemaFields[] = {
+		{ 0, false, 0 },
+		{ sizeof(uint32), true, 0 }
+	};
+	FlatPatch(metadata, headerSlot,
+			  FlatWriteTable(metadata, schemaFields, lengthof(schemaFields), slots));
+	uint32 fieldsSlot = slots[1];
+
+	uint32 fieldSlot = 0;
+	FlatPatch(metadata, fieldsSlot,
+			  FlatWriteOffsetVector(metadata, list_length(columnList), &fieldSlot));
+
+	ArrowColumn *column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		FlatField fieldFields[] = {
+			{ sizeof(uint32), true, 0 },
+			{ sizeof(bool), false, true },
+			{ sizeof(uint8), false, column->arrowType },
+			{ sizeof(uint32), true, 0 },
+			{ 0, false, 0 },
+			{ sizeof(uint32), true, 0 }
+		};
+		FlatPatch(metadata, fieldSlot,
+				  FlatWriteTable(metadata, fieldFields, lengthof(fieldFields), slots));
+		fieldSlot += sizeof(uint32);
+
+		uint32 nameSlot = slots[0];
+		uint32 typeSlot = slots[3];
+		uint32 childrenSlot = slots[5];
+		uint32 childSlot = 0;
+
+		FlatPatch(metadata, nameSlot, FlatWriteString(metadata, column->name));
+
+		FlatField typeFields[2] = { 0 };
+		int typeFieldCount = 0;
+
+		switch (column->arrowType)
+		{
+			case ARROW_TYPE_INT:
+			{
+				typeFields[0] = (FlatField) { sizeof(int32), false, column->bitWidth };
+				typeFields[1] = (FlatField) { sizeof(bool), false, column->isSigned };
+				typeFieldCount = 2;
+				break;
+			}
+
+			case ARROW_TYPE_FLOATING_POINT:
+			{
+				typeFields[0] = (FlatField) { sizeof(int16), false, column->precision };
+				typeFieldCount = 1;
+				break;
+			}
+
+			case ARROW_TYPE_DATE:
+			{
+				typeFields[0] = (FlatField) { sizeof(int16), false, ARROW_DATE_UNIT_DAY };
+				typeFieldCount = 1;
+				break;
+			}
+
+			case ARROW_TYPE_TIME:
+			{
+				typeFields[0] = (FlatField) {
+					sizeof(int16), false, ARROW_TIME_UNIT_MICROSECOND
+				};
+				typeFields[1] = (FlatField) { sizeof(int32), false, 64 };
+				typeFieldCount = 2;
+				break;
+			}
+
+			case ARROW_TYPE_TIMESTAMP:
+			{
+				typeFields[0] = (FlatField) {
+					sizeof(int16), false, ARROW_TIME_UNIT_MICROSECOND
+				};
+				if (column->timezone != NULL)
+				{
+					typeFields[1] = (FlatField) { sizeof(uint32), true, 0 };
+				}
+				typeFieldCount = 2;
+				break;
+			}
+
+			case ARROW_TYPE_FIXED_SIZE_BINARY:
+			{
+				typeFields[0] = (FlatField) { sizeof(int32), false, column->byteWidth };
+				typeFieldCount = 1;
+				break;
+			}
+
+			default:
+			{
+				/* Bool, Binary and Utf8 have no fields */
+				break;
+			}
+		}
+
+		FlatPatch(metadata, typeSlot,
+				  FlatWriteTable(metadata, typeFields, typeFieldCount, slots));
+
+		if (column->arrowType == ARROW_TYPE_TIMESTAMP && column->timezone != NULL)
+		{
+			FlatPatch(metadata, slots[1],
+					  FlatWriteString(metadata, column->timezone));
+		}
+
+		/* readers expect the children of every field, even if there are none */
+		FlatPatch(metadata, childrenSlot,
+				  FlatWriteOffsetVector(metadata, 0, &childSlot));
+	}
+
+	return ArrowMessage(metadata, NULL);
+}
+
+
+/*
+ * ArrowRecordBatchMessage returns a record batch message with the rows of
+ * the vectors of the columns.
+ */
+static bytea *
+ArrowRecordBatchMessage(List *columnList, Datum *columnValues, int rowCount)
+{
+	int columnCount = list_length(columnList);
+	ArrowFieldNode *fieldNodes = palloc0(columnCount * sizeof(ArrowFieldNode));
+	ArrowBuffer *buffers = palloc0(3 * columnCount * sizeof(ArrowBuffer));
+	int bufferCount = 0;
+
+	StringInfo body = makeStringInfo();
+
+	ArrowColumn *column = NULL;
+	int columnIndex = 0;
+	foreach_ptr(column, columnList)
+	{
+		VectorColumn *vector = (VectorColumn *) DatumGetPointer(
+			columnValues[AttrNumberGetAttrOffset(column->attributeNumber)]);
+
+		AppendArrowColumn(body, column, vector, rowCount, &fieldNodes[columnIndex],
+						  &buffers[bufferCount]);
+
+		bool hasOffsets = column->kind == ARROW_COLUMN_VARLENA ||
+						  column->kind == ARROW_COLUMN_TEXT ||
+						  column->kind == ARROW_COLUMN_OUTPUT;
+		bufferCount += hasOffsets ? 3 : 2;
+		columnIndex++;
+	}
+
+	StringInfo metadata = makeStringInfo();
+	uint32 slots[ARROW_MAX_TABLE_FIELDS];
+
+	FlatStart(metadata);
+
+	FlatField messageFields[] = {
+		{ sizeof(int16), false, ARROW_METADATA_VERSION_V5 },
+		{ sizeof(uint8), false, ARROW_MESSAGE_HEADER_RECORD_BATCH },
+		{ sizeof(uint32), true, 0 },
+		{ sizeof(int64), false, body->len }
+	};
+	FlatPatch(metadata, 0, FlatWriteTable(metadata, messageFields,
+										  lengthof(messageFields), slots));
+	uint32 headerSlot = slots[2];
+
+	FlatField batchFields[] = {
+		{ sizeof(int64), false, rowCount },
+		{ sizeof(uint32), true, 0 },
+		{ sizeof(uint32), true, 0 }
+	};
+	FlatPatch(metadata, headerSlot,
+			  FlatWriteTable(metadata, batchFields, lengthof(batchFields), slots));
+	uint32 nodesSlot = slots[1];
+	uint32 buffersSlot = slots[2];
+
+	FlatPatch(metadata, nodesSlot,
+			  FlatWriteStructVector(metadata, fieldNodes, columnCount,
+									sizeof(ArrowFieldNode)));
+	FlatPatch(metadata, buffersSlot,
+			  FlatWriteStructVector(metadata, buffers, bufferCount,
+									sizeof(ArrowBuffer)));
+
+	return ArrowMessage(metadata, body);
+}
+
+
+/*
+ * AppendArrowColumn appends the validity and data buffers of a column to the
+ * body of a record batch.
+ */
+static void
+AppendArrowColumn(StringInfo body, ArrowColumn *column, VectorColumn *vector,
+				  int rowCount, ArrowFieldNode *fieldNode, ArrowBuffer *buffers)
+{
+	int64 nullCount = 0;
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		nullCount += vector->isnull[rowIndex];
+	}
+
+	fieldNode->length = rowCount;
+	fieldNode->nullCount = nullCount;
+
+	/* the validity bitmap may be left out if there are no NULLs */
+	if (nullCount == 0)
+	{
+		AppendArrowBuffer(body, 0, &buffers[0]);
+	}
+	else
+	{
+		uint8 *validity = AppendArrowBuffer(body, (rowCount + 7) / 8, &buffers[0]);
+		for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			validity[rowIndex / 8] |= (!vector->isnull[rowIndex]) << (rowIndex % 8);
+		}
+	}
+
+	switch (column->kind)
+	{
+		case ARROW_COLUMN_FIXED:
+		{
+			int64 length = (int64) rowCount * column->valueLength;
+			uint8 *values = AppendArrowBuffer(body, length, &buffers[1]);
+			memcpy(values, vector->value, length);
+			break;
+		}
+
+		case ARROW_COLUMN_BOOL:
+		{
+			uint8 *values = AppendArrowBuffer(body, (rowCount + 7) / 8, &buffers[1]);
+			const bool *vectorValues = (const bool *) vector->value;
+			for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				values[rowIndex / 8] |= (vectorValues[rowIndex] != 0) << (rowIndex % 8);
+			}
+			break;
+		}
+
+		case ARROW_COLUMN_DATE:
+		{
+			int32 *values = (int32 *) AppendArrowBuffer(body, rowCount * sizeof(int32),
+														&buffers[1]);
+			const DateADT *vectorValues = (const DateADT *) vector->value;
+			for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				DateADT date = vectorValues[rowIndex];
+				values[rowIndex] = DATE_NOT_FINITE(date) ? date : date + ARROW_EPOCH_DAYS;
+			}
+			break;
+		}
+
+		case ARROW_COLUMN_TIMESTAMP:
+		{
+			int64 *values = (int64 *) AppendArrowBuffer(body, rowCount * sizeof(int64),
+														&buffers[1]);
+			const Timestamp *vectorValues = (const Timestamp *) vector->value;
+			for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				Timestamp timestamp = vectorValues[rowIndex];
+				values[rowIndex] = TIMESTAMP_NOT_FINITE(timestamp) ?
+								   timestamp : timestamp + ARROW_EPOCH_USECS;
+			}
+			break;
+		}
+
+		case ARROW_COLUMN_VARLENA:
+		case ARROW_COLUMN_TEXT:
+		case ARROW_COLUMN_OUTPUT:
+		{
+			AppendArrowVarlenaColumn(body, column, vector, rowCount, &buffers[1],
+									 &buffers[2]);
+			break;
+		}
+	}
+}
+
+
+/*
+ * AppendArrowVarlenaColumn appends the offsets and data buffers of a binary
+ * or string column to the body of a record batch.
+ */
+static void
+AppendArrowVarlenaColumn(StringInfo body, ArrowColumn *column, VectorColumn *vector,
+						 int rowCount, ArrowBuffer *offsetBuffer,
+						 ArrowBuffer *dataBuffer)
+{
+	/* the data is collected first, as appending it could move the offsets */
+	StringInfo data = makeStringInfo();
+	int32 *offsets = palloc((rowCount + 1) * sizeof(int32));
+
+	offsets[0] = 0;
+
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (!vector->isnull[rowIndex])
+		{
+			Datum value = fetch_att((int8 *) vector->value + vector->columnTypeLen * rowIndex,
+									vector->columnIsVal, vector->columnTypeLen);
+			const char *valueData = NULL;
+			Size valueLength = 0;
+
+			if (column->kind == ARROW_COLUMN_OUTPUT)
+			{
+				valueData = OutputFunctionCall(&column->outputFunction, value);
+				valueLength = strlen(valueData);
+			}
+			else
+			{
+				struct varlena *varlena = pg_detoast_datum_packed(
+					(struct varlena *) DatumGetPointer(value));
+
+				valueData = VARDATA_ANY(varlena);
+				valueLength = VARSIZE_ANY_EXHDR(varlena);
+			}
+
+			/* returns the value itself if it needs no conversion */
+			if (column->kind != ARROW_COLUMN_VARLENA && valueLength > 0)
+			{
+				const char *converted = pg_server_to_any(valueData, valueLength, PG_UTF8);
+				if (converted != valueData)
+				{
+					valueData = converted;
+					valueLength = strlen(converted);
+				}
+			}
+
+			if (valueLength > PG_INT32_MAX - data->len)
+			{
+				ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+								errmsg("values of column \"%s\" are too large for an "
+									   "Arrow record batch", column->name)));
+			}
+
+			appendBinaryStringInfo(data, valueData, valueLength);
+		}
+
+		offsets[rowIndex + 1] = data->len;
+	}
+
+	uint8 *offsetValues = AppendArrowBuffer(body, (rowCount + 1) * sizeof(int32),
+											offsetBuffer);
+	memcpy(offsetValues, offsets, (rowCount + 1) * sizeof(int32));
+
+	uint8 *dataValues = AppendArrowBuffer(body, data->len, dataBuffer);
+	memcpy(dataValues, data->data, data->len);
+}
+
+
+/*
+ * AppendArrowBuffer appends a zeroed buffer of the given length to the body
+ * of a record batch, padded to ARROW_BUFFER_ALIGNMENT, and sets its location
+ * in buffer. The returned pointer is valid until the body is appended to.
+ */
+static uint8 *
+AppendArrowBuffer(StringInfo body, int64 length, ArrowBuffer *buffer)
+{
+	int64 paddedLength = TYPEALIGN(ARROW_BUFFER_ALIGNMENT, length);
+
+	if (paddedLength > MaxAllocSize - 1 - body->len)
+	{
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+						errmsg("Arrow record batch is too large")));
+	}
+
+	buffer->offset = body->len;
+	buffer->length = length;
+
+	enlargeStringInfo(body, paddedLength);
+	uint8 *data = (uint8 *) body->data + body->len;
+	MemSet(data, 0, paddedLength);
+	body->len += paddedLength;
+	body->data[body->len] = '\0';
+
+	return data;
+}
+
+
+/*
+ * ArrowMessage returns an encapsulated message of the stream with the given
+ * flatbuffers metadata and body: the continuation marker, the length of the
+ * metadata padded to 8 bytes, the metadata and the body.
+ */
+static bytea *
+ArrowMessage(StringInfo metadata, StringInfo body)
+{
+	FlatPad(metadata, ARROW_BUFFER_ALIGNMENT);
+
+	int bodyLength = body != NULL ? body->len : 0;
+	uint32 prefix[2] = { ARROW_CONTINUATION_MARKER, metadata->len };
+	Size messageLength = sizeof(prefix) + metadata->len + bodyLength;
+
+	if (messageLength > MaxAllocSize - VARHDRSZ)
+	{
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+						errmsg("Arrow record batch is too large")));
+	}
+
+	bytea *message = palloc(VARHDRSZ + messageLength);
+	SET_VARSIZE(message, VARHDRSZ + messageLength);
+
+	char *position = VARDATA(message);
+	memcpy(position, prefix, sizeof(prefix));
+	position += sizeof(prefix);
+	memcpy(position, metadata->data, metadata->len);
+	position += metadata->len;
+
+	if (bodyLength > 0)
+	{
+		memcpy(position, body->data, bodyLength);
+	}
+
+	return message;
+}
+
+
+/*
+ * columnar_import_arrow writes the rows of an Arrow IPC stream into new
+ * stripes of a columnar table and returns their number.
+ */
+Datum
+columnar_import_arrow(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	bytea *stream = PG_GETARG_BYTEA_PP(1);
+
+	ArrowStreamReader reader = { 0 };
+	reader.data = VARDATA_ANY(stream);
+	reader.length = VARSIZE_ANY_EXHDR(stream);
+
+	PG_RETURN_INT64(ImportArrowStream(relationId, &reader));
+}
+
+
+/*
+ * columnar_import_arrow_file writes the rows of an Arrow IPC stream file on
+ * the server into new stripes of a columnar table and returns their number.
+ * The file is read one message at a time, so it may be larger than a bytea.
+ * Like COPY FROM a file, it needs the privileges of pg_read_server_files.
+ */
+Datum
+columnar_import_arrow_file(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	char *fileName = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	if (!is_member_of_role(GetUserId(), ROLE_PG_READ_SERVER_FILES))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("must be superuser or a member of the "
+							   "pg_read_server_files role to import from a file")));
+	}
+
+	ArrowStreamReader reader = { 0 };
+	reader.fileName = fileName;
+	reader.file = AllocateFile(fileName, PG_BINARY_R);
+	if (reader.file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\" for reading: %m", fileName)));
+	}
+
+	uint64 rowCount = ImportArrowStream(relationId, &reader);
+
+	FreeFile(reader.file);
+
+	PG_RETURN_INT64(rowCount);
+}
+
+
+/*
+ * ImportArrowStream writes the record batches of an Arrow stream into new
+ * stripes of a columnar table, through a write state of its own. The columns
+ * of the batches are converted one at a time into slices of rows that are
+ * passed to ColumnarWriteBatch, so rows are never formed into tuples.
+ */
+static uint64
+ImportArrowStream(Oid relationId, ArrowStreamReader *reader)
+{
+#ifdef WORDS_BIGENDIAN
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("Arrow import is not supported on big endian platforms")));
+#endif
+
+	Relation rel = table_open(relationId, RowExclusiveLock);
+	CheckColumnarImportRelation(rel);
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	int columnCount = tupleDescriptor->natts;
+
+	int64 bodyLength = 0;
+	const char *metadata = NULL;
+	uint32 metadataLength = 0;
+	FlatTable header;
+
+	if (!ReadArrowMessage(reader, &metadata, &metadataLength) ||
+		!ParseArrowMessage(metadata, metadataLength, ARROW_MESSAGE_HEADER_SCHEMA,
+						   &header, &bodyLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("Arrow stream does not start with a schema")));
+	}
+
+	SkipArrowBody(reader, bodyLength);
+	List *fieldList = ParseArrowSchema(rel, &header);
+
+	ColumnarOptions options = { 0 };
+	ReadColumnarOptions(relationId, &options);
+	ColumnarWriteState *writeState = ColumnarBeginWrite(rel->rd_node, options,
+														tupleDescriptor);
+	bool logInserts = ColumnarLogicalChangesLogged(rel, CMD_INSERT);
+
+	MemoryContext batchContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Columnar Arrow Import Batch Context",
+													   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext sliceContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Columnar Arrow Import Slice Context",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	Datum **columnValues = palloc(columnCount * sizeof(Datum *));
+	bool **columnNulls = palloc(columnCount * sizeof(bool *));
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		columnValues[columnIndex] = palloc0(ARROW_IMPORT_SLICE_ROWS * sizeof(Datum));
+		columnNulls[columnIndex] = palloc(ARROW_IMPORT_SLICE_ROWS * sizeof(bool));
+	}
+	uint64 *rowNumbers = palloc(ARROW_IMPORT_SLICE_ROWS * sizeof(uint64));
+
+	uint64 rowCount = 0;
+
+	while (true)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(batchContext);
+
+		if (!ReadArrowMessage(reader, &metadata, &metadataLength))
+		{
+			MemoryContextSwitchTo(oldContext);
+			break;
+		}
+
+		if (!ParseArrowMessage(metadata, metadataLength,
+							   ARROW_MESSAGE_HEADER_RECORD_BATCH, &header,
+							   &bodyLength))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("Arrow stream has a message that is not a "
+								   "record batch"),
+							errdetail("Dictionary encoded columns are not supported.")));
+		}
+
+		const char *body = ReadArrowBody(reader, bodyLength);
+		int64 batchRowCount = ParseArrowRecordBatch(&header, body, bodyLength,
+													fieldList);
+
+		for (int64 sliceStart = 0; sliceStart < batchRowCount;
+			 sliceStart += ARROW_IMPORT_SLICE_ROWS)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			uint32 sliceRowCount = Min(batchRowCount - sliceStart, ARROW_IMPORT_SLICE_ROWS);
+
+			MemoryContextSwitchTo(sliceContext);
+
+			for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				memset(columnNulls[columnIndex], true, sliceRowCount * sizeof(bool));
+			}
+
+			ArrowImportField *field = NULL;
+			foreach_ptr(field, fieldList)
+			{
+				int columnIndex = AttrNumberGetAttrOffset(field->attributeNumber);
+				ImportArrowColumn(field, sliceStart, sliceRowCount,
+								  columnValues[columnIndex], columnNulls[columnIndex]);
+			}
+
+			CheckColumnarImportNotNull(rel, columnNulls, sliceRowCount);
+
+			MemoryContextSwitchTo(ColumnarWritePerTupleContext(writeState));
+			ColumnarWriteBatch(writeState, columnValues, columnNulls, sliceRowCount,
+							   rowNumbers);
+			if (logInserts)
+			{
+				ColumnarLogLogicalMultiInsert(rel, columnValues, columnNulls,
+											  rowNumbers, sliceRowCount);
+			}
+			MemoryContextReset(ColumnarWritePerTupleContext(writeState));
+
+			MemoryContextSwitchTo(batchContext);
+			MemoryContextReset(sliceContext);
+
+			rowCount += sliceRowCount;
+		}
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(batchContext);
+	}
+
+	ColumnarEndWrite(writeState);
+
+	MemoryContextDelete(sliceContext);
+	MemoryContextDelete(batchContext);
+
+	pgstat_count_heap_insert(rel, rowCount);
+	ColumnarStatCount(relationId, COLUMNAR_STAT_ROWS_WRITTEN, rowCount);
+
+	table_close(rel, NoLock);
+
+	return rowCount;
+}
+
+
+/*
+ * CheckColumnarImportRelation errors out unless rows can be written into the
+ * relation by an import, which skips what the executor does for inserts
+ * besides checking NOT NULL. Also used by columnar.load_csv.
+ */
+void
+CheckColumnarImportRelation(Relation rel)
+{
+	Oid relationId = RelationGetRelid(rel);
+	const char *relationName = quote_identifier(RelationGetRelationName(rel));
+
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table", relationName)));
+	}
+
+	AclResult aclResult = pg_class_aclcheck(relationId, GetUserId(), ACL_INSERT);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, OBJECT_TABLE, RelationGetRelationName(rel));
+	}
+
+	if (check_enable_rls(relationId, InvalidOid, false) == RLS_ENABLED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot import into table %s with row-level security",
+							   relationName)));
+	}
+
+	TupleConstr *constraints = RelationGetDescr(rel)->constr;
+	const char *unsupported = NULL;
+
+	if (RelationGetIndexList(rel) != NIL)
+	{
+		unsupported = "indexes";
+	}
+	else if (rel->trigdesc != NULL)
+	{
+		unsupported = "triggers";
+	}
+	else if (constraints != NULL && constraints->num_check > 0)
+	{
+		unsupported = "check constraints";
+	}
+	else if (constraints != NULL && constraints->has_generated_stored)
+	{
+		unsupported = "generated columns";
+	}
+
+	if (unsupported != NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot import into table %s with %s",
+							   relationName, unsupported),
+						errhint("Load the rows with INSERT ... SELECT instead.")));
+	}
+}
+
+
+/*
+ * CheckColumnarImportNotNull errors out if a slice of rows has a NULL in a NOT
+ * NULL column, including the columns that are not in the stream.
+ */
+void
+CheckColumnarImportNotNull(Relation rel, bool **columnNulls, uint32 rowCount)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		if (!attribute->attnotnull || attribute->attisdropped)
+		{
+			continue;
+		}
+
+		if (memchr(columnNulls[columnIndex], true, rowCount) != NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_NOT_NULL_VIOLATION),
+							errmsg("null value in column \"%s\" of relation \"%s\" "
+								   "violates not-null constraint",
+								   NameStr(attribute->attname),
+								   RelationGetRelationName(rel))));
+		}
+	}
+}
+
+
+/*
+ * ParseArrowSchema returns the fields of the Schema table of a stream, each
+ * matched by name to a column of the relation, and how their values are
+ * converted to the type of the column.
+ */
+static List *
+ParseArrowSchema(Relation rel, FlatTable *schemaTable)
+{
+	FlatTable schema = *schemaTable;
+
+	if (FlatReadInt(&schema, 0, sizeof(int16), 0) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("big endian Arrow streams are not supported")));
+	}
+
+	uint32 fieldElements = 0;
+	uint32 fieldCount = FlatReadVector(&schema, 1, sizeof(uint32), &fieldElements);
+	bool *columnImported = palloc0(RelationGetDescr(rel)->natts * sizeof(bool));
+	List *fieldList = NIL;
+
+	for (uint32 fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+	{
+		FlatTable fieldTable;
+		FlatReadVectorTable(&schema, fieldElements, fieldIndex, &fieldTable);
+
+		ArrowImportField *field = palloc0(sizeof(ArrowImportField));
+		field->name = FlatReadString(&fieldTable, 0);
+		field->arrowType = FlatReadInt(&fieldTable, 2, sizeof(uint8), 0);
+
+		if (field->name == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("Arrow stream has a field without a name")));
+		}
+
+		FlatTable dictionary;
+		FlatTable type;
+		uint32 childElements = 0;
+		if (FlatReadChild(&fieldTable, 4, &dictionary) ||
+			FlatReadVector(&fieldTable, 5, sizeof(uint32), &childElements) > 0 ||
+			!FlatReadChild(&fieldTable, 3, &type))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("Arrow field \"%s\" has an unsupported type",
+								   field->name)));
+		}
+
+		switch (field->arrowType)
+		{
+			case ARROW_TYPE_INT:
+			{
+				field->bitWidth = FlatReadInt(&type, 0, sizeof(int32), 0);
+				field->isSigned = FlatReadInt(&type, 1, sizeof(bool), 0);
+				if (field->bitWidth != 8 && field->bitWidth != 16 &&
+					field->bitWidth != 32 && field->bitWidth != 64)
+				{
+					field->arrowType = ARROW_TYPE_NONE;
+				}
+				field->byteWidth = field->bitWidth / BITS_PER_BYTE;
+				break;
+			}
+
+			case ARROW_TYPE_FLOATING_POINT:
+			{
+				int16 precision = FlatReadInt(&type, 0, sizeof(int16), 0);
+				if (precision == ARROW_PRECISION_SINGLE)
+				{
+					field->byteWidth = sizeof(float4);
+				}
+				else if (precision == ARROW_PRECISION_DOUBLE)
+				{
+					field->byteWidth = sizeof(float8);
+				}
+				else
+				{
+					field->arrowType = ARROW_TYPE_NONE;
+				}
+				break;
+			}
+
+			case ARROW_TYPE_DATE:
+			{
+				field->unit = FlatReadInt(&type, 0, sizeof(int16),
+										  ARROW_DATE_UNIT_MILLISECOND);
+				field->byteWidth = field->unit == ARROW_DATE_UNIT_DAY ?
+								   sizeof(int32) : sizeof(int64);
+				break;
+			}
+
+			case ARROW_TYPE_TIME:
+			{
+				field->unit = FlatReadInt(&type, 0, sizeof(int16),
+										  ARROW_TIME_UNIT_MILLISECOND);
+				field->byteWidth = FlatReadInt(&type, 1, sizeof(int32), 32) /
+								   BITS_PER_BYTE;
+				if (field->byteWidth != sizeof(int32) &&
+					field->byteWidth != sizeof(int64))
+				{
+					field->arrowType = ARROW_TYPE_NONE;
+				}
+				break;
+			}
+
+			case ARROW_TYPE_TIMESTAMP:
+			{
+				field->unit = FlatReadInt(&type, 0, sizeof(int16), 0);
+				field->byteWidth = sizeof(int64);
+				break;
+			}
+
+			case ARROW_TYPE_FIXED_SIZE_BINARY:
+			{
+				field->byteWidth = FlatReadInt(&type, 0, sizeof(int32), 0);
+				if (field->byteWidth <= 0)
+				{
+					field->arrowType = ARROW_TYPE_NONE;
+				}
+				break;
+			}
+
+			case ARROW_TYPE_NULL:
+			case ARROW_TYPE_BOOL:
+			case ARROW_TYPE_BINARY:
+			case ARROW_TYPE_UTF8:
+			case ARROW_TYPE_LARGE_BINARY:
+			case ARROW_TYPE_LARGE_UTF8:
+			{
+				break;
+			}
+
+			default:
+			{
+				field->arrowType = ARROW_TYPE_NONE;
+				break;
+			}
+		}
+
+		if (field->arrowType == ARROW_TYPE_NONE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("Arrow field \"%s\" has an unsupported type",
+								   field->name)));
+		}
+
+		AttrNumber attributeNumber = get_attnum(RelationGetRelid(rel), field->name);
+		if (attributeNumber <= 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" of relation \"%s\" does not exist",
+								   field->name, RelationGetRelationName(rel))));
+		}
+
+		int columnIndex = AttrNumberGetAttrOffset(attributeNumber);
+		if (columnImported[columnIndex])
+		{
+			ereport(ERROR, (errcode(ERRCODE_DUPLICATE_COLUMN),
+							errmsg("Arrow stream has more than one field \"%s\"",
+								   field->name)));
+		}
+		columnImported[columnIndex] = true;
+
+		Form_pg_attribute attribute =
+			TupleDescAttr(RelationGetDescr(rel), columnIndex);
+		field->attributeNumber = attributeNumber;
+		SetArrowImportConversion(field, attribute);
+
+		fieldList = lappend(fieldList, field);
+	}
+
+	return fieldList;
+}
+
+
+/*
+ * SetArrowImportConversion sets how the values of a field are converted to
+ * the type of its column. Values are converted directly to the matching
+ * types, and numbers, booleans and strings also through the input function
+ * of any other type.
+ */
+static void
+SetArrowImportConversion(ArrowImportField *field, Form_pg_attribute attribute)
+{
+	Oid typeId = attribute->atttypid;
+	ArrowImportConversion conversion = ARROW_IMPORT_INVALID;
+
+	field->typeId = typeId;
+
+	switch (field->arrowType)
+	{
+		case ARROW_TYPE_NULL:
+		{
+			conversion = ARROW_IMPORT_NULL;
+			break;
+		}
+
+		case ARROW_TYPE_INT:
+		{
+			if (typeId == INT2OID || typeId == INT4OID || typeId == INT8OID)
+			{
+				conversion = ARROW_IMPORT_INT;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_FLOATING_POINT:
+		{
+			if (typeId == FLOAT4OID || typeId == FLOAT8OID)
+			{
+				conversion = ARROW_IMPORT_FLOAT;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_BOOL:
+		{
+			if (typeId == BOOLOID)
+			{
+				conversion = ARROW_IMPORT_BOOL;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_UTF8:
+		case ARROW_TYPE_LARGE_UTF8:
+		{
+			if (typeId == TEXTOID)
+			{
+				conversion = ARROW_IMPORT_TEXT;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_BINARY:
+		case ARROW_TYPE_LARGE_BINARY:
+		{
+			if (typeId == BYTEAOID)
+			{
+				conversion = ARROW_IMPORT_BYTEA;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_FIXED_SIZE_BINARY:
+		{
+			if (typeId == BYTEAOID)
+			{
+				conversion = ARROW_IMPORT_BYTEA;
+			}
+			else if (typeId == UUIDOID && field->byteWidth == UUID_LEN)
+			{
+				conversion = ARROW_IMPORT_UUID;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_DATE:
+		{
+			if (typeId == DATEOID)
+			{
+				conversion = ARROW_IMPORT_DATE;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_TIME:
+		{
+			if (typeId == TIMEOID)
+			{
+				conversion = ARROW_IMPORT_TIME;
+			}
+			break;
+		}
+
+		case ARROW_TYPE_TIMESTAMP:
+		{
+			if (typeId == TIMESTAMPOID || typeId == TIMESTAMPTZOID)
+			{
+				conversion = ARROW_IMPORT_TIMESTAMP;
+			}
+			break;
+		}
+	}
+
+	bool canBeInput = field->arrowType == ARROW_TYPE_INT ||
+					  field->arrowType == ARROW_TYPE_FLOATING_POINT ||
+					  field->arrowType == ARROW_TYPE_BOOL ||
+					  field->arrowType == ARROW_TYPE_UTF8 ||
+					  field->arrowType == ARROW_TYPE_LARGE_UTF8;
+
+	if (conversion == ARROW_IMPORT_INVALID && canBeInput)
+	{
+		Oid inputFunctionId = InvalidOid;
+		getTypeInputInfo(typeId, &inputFunctionId, &field->inputTypeIOParam);
+		fmgr_info(inputFunctionId, &field->inputFunction);
+		field->typeMod = attribute->atttypmod;
+
+		conversion = ARROW_IMPORT_INPUT;
+	}
+
+	if (conversion == ARROW_IMPORT_INVALID)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("cannot import Arrow field \"%s\" into column of type %s",
+							   field->name, format_type_be(typeId))));
+	}
+
+	field->conversion = conversion;
+}
+
+
+/*
+ * ParseArrowRecordBatch sets the buffers of the fields to those of a
+ * RecordBatch table with the given body, and returns its number of rows. The
+ * buffers are checked to lie within the body and to be large enough for the
+ * rows, so the values can be read without further checks, except for the
+ * offsets of variable length values.
+ */
+static int64
+ParseArrowRecordBatch(FlatTable *recordBatch, const char *body, int64 bodyLength,
+					  List *fieldList)
+{
+	FlatTable compression;
+
+	if (FlatReadChild(recordBatch, 3, &compression))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("compressed Arrow record batches are not supported")));
+	}
+
+	int64 rowCount = FlatReadInt(recordBatch, 0, sizeof(int64), 0);
+	uint32 nodeElements = 0;
+	uint32 bufferElements = 0;
+	uint32 nodeCount = FlatReadVector(recordBatch, 1, sizeof(ArrowFieldNode),
+									  &nodeElements);
+	uint32 bufferCount = FlatReadVector(recordBatch, 2, sizeof(ArrowBuffer),
+										&bufferElements);
+
+	/* the structs in the metadata need not be aligned */
+	const char *nodes = recordBatch->buf + nodeElements;
+	const char *buffers = recordBatch->buf + bufferElements;
+
+	if (rowCount < 0 || nodeCount != list_length(fieldList))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid Arrow record batch")));
+	}
+
+	uint32 bufferIndex = 0;
+	ArrowImportField *field = NULL;
+	int fieldIndex = 0;
+	foreach_ptr(field, fieldList)
+	{
+		ArrowFieldNode node;
+		memcpy(&node, nodes + fieldIndex * sizeof(ArrowFieldNode), sizeof(node));
+		fieldIndex++;
+
+		if (node.length != rowCount || node.nullCount < 0 || node.nullCount > rowCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("invalid Arrow record batch")));
+		}
+
+		field->hasNulls = node.nullCount > 0;
+
+		/* arrays of type Null have no buffers */
+		if (field->arrowType == ARROW_TYPE_NULL)
+		{
+			continue;
+		}
+
+		bool hasOffsets = field->arrowType == ARROW_TYPE_BINARY ||
+						  field->arrowType == ARROW_TYPE_UTF8 ||
+						  field->arrowType == ARROW_TYPE_LARGE_BINARY ||
+						  field->arrowType == ARROW_TYPE_LARGE_UTF8;
+		bool largeOffsets = field->arrowType == ARROW_TYPE_LARGE_BINARY ||
+							field->arrowType == ARROW_TYPE_LARGE_UTF8;
+		uint32 fieldBufferCount = hasOffsets ? 3 : 2;
+
+		if (bufferIndex + fieldBufferCount > bufferCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("invalid Arrow record batch")));
+		}
+
+		int64 bitmapLength = (rowCount + 7) / 8;
+		int64 bufferLength = 0;
+		const uint8 *validity = ArrowBodyBuffer(body, bodyLength, buffers, bufferIndex++,
+												field->hasNulls ? bitmapLength : 0,
+												&bufferLength);
+		field->validity = field->hasNulls ? validity : NULL;
+
+		if (hasOffsets)
+		{
+			field->offsetWidth = largeOffsets ? sizeof(int64) : sizeof(int32);
+			field->offsets = ArrowBodyBuffer(body, bodyLength, buffers, bufferIndex++,
+											 (rowCount + 1) * field->offsetWidth,
+											 &bufferLength);
+			field->data = ArrowBodyBuffer(body, bodyLength, buffers, bufferIndex++, 0,
+										  &field->dataLength);
+		}
+		else
+		{
+			int64 valuesLength = field->arrowType == ARROW_TYPE_BOOL ?
+								 bitmapLength : rowCount * field->byteWidth;
+			field->values = ArrowBodyBuffer(body, bodyLength, buffers, bufferIndex++,
+											valuesLength, &bufferLength);
+		}
+	}
+
+	return rowCount;
+}
+
+
+/*
+ * ArrowBodyBuffer returns the buffer of a record batch body at the given
+ * index of its buffers and sets length to its length, after checking that
+ * it lies within the body and has at least minimumLength bytes.
+ */
+static const uint8 *
+ArrowBodyBuffer(const char *body, int64 bodyLength, const char *buffers,
+				uint32 bufferIndex, int64 minimumLength, int64 *length)
+{
+	ArrowBuffer buffer;
+	memcpy(&buffer, buffers + bufferIndex * sizeof(ArrowBuffer), sizeof(buffer));
+
+	if (buffer.offset < 0 || buffer.length < minimumLength ||
+		buffer.offset > bodyLength || buffer.length > bodyLength - buffer.offset)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid Arrow record batch"),
+						errdetail("A buffer does not fit the body of its batch.")));
+	}
+
+	*length = buffer.length;
+	return (const uint8 *) body + buffer.offset;
+}
+
+
+/*
+ * ImportArrowColumn converts rowCount values of a field, starting at the
+ * given row of its record batch, into values and nulls of its column.
+ */
+static void
+ImportArrowColumn(ArrowImportField *field, int64 firstRow, uint32 rowCount,
+				  Datum *values, bool *nulls)
+{
+	if (field->conversion == ARROW_IMPORT_NULL)
+	{
+		return;
+	}
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		int64 row = firstRow + rowIndex;
+		nulls[rowIndex] = field->validity != NULL &&
+						  !(field->validity[row / 8] & (1 << (row % 8)));
+	}
+
+	switch (field->conversion)
+	{
+		case ARROW_IMPORT_INT:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				if (!nulls[rowIndex])
+				{
+					int64 value = ArrowIntValue(field, firstRow + rowIndex);
+					values[rowIndex] = ArrowIntDatum(field, value);
+				}
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_FLOAT:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				float8 value = ArrowFloatValue(field, firstRow + rowIndex);
+				values[rowIndex] = field->typeId == FLOAT4OID ?
+								   Float4GetDatum((float4) value) :
+								   Float8GetDatum(value);
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_BOOL:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				int64 row = firstRow + rowIndex;
+				values[rowIndex] = BoolGetDatum(field->values[row / 8] & (1 << (row % 8)));
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_TEXT:
+		case ARROW_IMPORT_BYTEA:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				if (nulls[rowIndex])
+				{
+					continue;
+				}
+
+				Size length = 0;
+				const char *data = ArrowBinaryValue(field, firstRow + rowIndex, &length);
+
+				if (field->conversion == ARROW_IMPORT_TEXT)
+				{
+					data = ArrowUtf8ToServer(data, &length);
+				}
+
+				if (length > MaxAllocSize - VARHDRSZ)
+				{
+					ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+									errmsg("value of Arrow field \"%s\" is too large",
+										   field->name)));
+				}
+
+				bytea *value = palloc(VARHDRSZ + length);
+				SET_VARSIZE(value, VARHDRSZ + length);
+				memcpy(VARDATA(value), data, length);
+				values[rowIndex] = PointerGetDatum(value);
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_UUID:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				if (!nulls[rowIndex])
+				{
+					pg_uuid_t *value = palloc(sizeof(pg_uuid_t));
+					memcpy(value->data, field->values + (firstRow + rowIndex) * UUID_LEN,
+						   UUID_LEN);
+					values[rowIndex] = UUIDPGetDatum(value);
+				}
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_DATE:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				if (!nulls[rowIndex])
+				{
+					values[rowIndex] = DateADTGetDatum(ArrowDateValue(field,
+																	  firstRow + rowIndex));
+				}
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_TIME:
+		case ARROW_IMPORT_TIMESTAMP:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				if (!nulls[rowIndex])
+				{
+					int64 value = ArrowTimeValue(field, firstRow + rowIndex);
+					values[rowIndex] = field->conversion == ARROW_IMPORT_TIME ?
+									   TimeADTGetDatum(value) :
+									   TimestampGetDatum(value);
+				}
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_INPUT:
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				if (!nulls[rowIndex])
+				{
+					char *string = ArrowValueString(field, firstRow + rowIndex);
+					values[rowIndex] = InputFunctionCall(&field->inputFunction, string,
+														 field->inputTypeIOParam,
+														 field->typeMod);
+				}
+			}
+			break;
+		}
+
+		case ARROW_IMPORT_NULL:
+		case ARROW_IMPORT_INVALID:
+		{
+			break;
+		}
+	}
+}
+
+
+/*
+ * ArrowIntValue returns the value of an Int field at the given row.
+ */
+static int64
+ArrowIntValue(ArrowImportField *field, int64 row)
+{
+	const uint8 *value = field->values + row * field->byteWidth;
+
+	switch (field->bitWidth)
+	{
+		case 8:
+		{
+			return field->isSigned ? (int64) *(const int8 *) value : (int64) *value;
+		}
+
+		case 16:
+		{
+			uint16 bits;
+			memcpy(&bits, value, sizeof(bits));
+			return field->isSigned ? (int64) (int16) bits : (int64) bits;
+		}
+
+		case 32:
+		{
+			uint32 bits;
+			memcpy(&bits, value, sizeof(bits));
+			return field->isSigned ? (int64) (int32) bits : (int64) bits;
+		}
+
+		default:
+		{
+			uint64 bits;
+			memcpy(&bits, value, sizeof(bits));
+			if (!field->isSigned && bits > PG_INT64_MAX)
+			{
+				ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+								errmsg("value " UINT64_FORMAT " of Arrow field \"%s\" "
+									   "is out of range for type bigint",
+									   bits, field->name)));
+			}
+			return (int64) bits;
+		}
+	}
+}
+
+
+/*
+ * ArrowIntDatum returns an integer value as a datum of the type of the
+ * column of the field, after checking that it fits.
+ */
+static Datum
+ArrowIntDatum(ArrowImportField *field, int64 value)
+{
+	if ((field->typeId == INT2OID && (value < PG_INT16_MIN || value > PG_INT16_MAX)) ||
+		(field->typeId == INT4OID && (value < PG_INT32_MIN || value > PG_INT32_MAX)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						errmsg("value " INT64_FORMAT " of Arrow field \"%s\" is out "
+							   "of range for type %s",
+							   value, field->name, format_type_be(field->typeId))));
+	}
+
+	switch (field->typeId)
+	{
+		case INT2OID:
+		{
+			return Int16GetDatum((int16) value);
+		}
+
+		case INT4OID:
+		{
+			return Int32GetDatum((int32) value);
+		}
+
+		default:
+		{
+			return Int64GetDatum(value);
+		}
+	}
+}
+
+
+/*
+ * ArrowFloatValue returns the value of a FloatingPoint field at the given
+ * row.
+ */
+static float8
+ArrowFloatValue(ArrowImportField *field, int64 row)
+{
+	const uint8 *value = field->values + row * field->byteWidth;
+
+	if (field->byteWidth == sizeof(float4))
+	{
+		float4 single;
+		memcpy(&single, value, sizeof(single));
+		return single;
+	}
+
+	float8 value8;
+	memcpy(&value8, value, sizeof(value8));
+	return value8;
+}
+
+
+/*
+ * ArrowBinaryValue returns the bytes of a Binary or Utf8 field at the given
+ * row and sets length to their number, after checking that its offsets lie
+ * within the data buffer.
+ */
+static const char *
+ArrowBinaryValue(ArrowImportField *field, int64 row, Size *length)
+{
+	int64 start = 0;
+	int64 end = 0;
+
+	if (field->arrowType == ARROW_TYPE_FIXED_SIZE_BINARY)
+	{
+		*length = field->byteWidth;
+		return (const char *) field->values + row * field->byteWidth;
+	}
+
+	if (field->offsetWidth == sizeof(int64))
+	{
+		memcpy(&start, field->offsets + row * sizeof(int64), sizeof(int64));
+		memcpy(&end, field->offsets + (row + 1) * sizeof(int64), sizeof(int64));
+	}
+	else
+	{
+		int32 start32;
+		int32 end32;
+		memcpy(&start32, field->offsets + row * sizeof(int32), sizeof(int32));
+		memcpy(&end32, field->offsets + (row + 1) * sizeof(int32), sizeof(int32));
+		start = start32;
+		end = end32;
+	}
+
+	if (start < 0 || end < start || end > field->dataLength)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid Arrow record batch"),
+						errdetail("Offsets of field \"%s\" are out of range.",
+								  field->name)));
+	}
+
+	*length = end - start;
+	return (const char *) field->data + start;
+}
+
+
+/*
+ * ArrowUtf8ToServer converts a UTF8 string of the given length to the server
+ * encoding, after checking that it is valid, and updates length.
+ */
+static const char *
+ArrowUtf8ToServer(const char *data, Size *length)
+{
+	if (*length == 0)
+	{
+		return data;
+	}
+
+	if (*length > PG_INT32_MAX)
+	{
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+						errmsg("Arrow string is too large")));
+	}
+
+	/* returns the string itself if it needs no conversion */
+	const char *converted = pg_any_to_server(data, *length, PG_UTF8);
+	if (converted != data)
+	{
+		*length = strlen(converted);
+	}
+
+	return converted;
+}
+
+
+/*
+ * ArrowDateValue returns the value of a Date field at the given row as a
+ * date.
+ */
+static DateADT
+ArrowDateValue(ArrowImportField *field, int64 row)
+{
+	int64 days = 0;
+
+	if (field->unit == ARROW_DATE_UNIT_DAY)
+	{
+		int32 value;
+		memcpy(&value, field->values + row * sizeof(int32), sizeof(value));
+		days = value;
+	}
+	else
+	{
+		int64 milliseconds;
+		memcpy(&milliseconds, field->values + row * sizeof(int64), sizeof(milliseconds));
+
+		/* round towards minus infinity */
+		days = milliseconds / (SECS_PER_DAY * 1000);
+		if (milliseconds % (SECS_PER_DAY * 1000) < 0)
+		{
+			days--;
+		}
+	}
+
+	days -= ARROW_EPOCH_DAYS;
+	if (!IS_VALID_DATE(days))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+						errmsg("date of Arrow field \"%s\" is out of range",
+							   field->name)));
+	}
+
+	return (DateADT) days;
+}
+
+
+/*
+ * ArrowTimeValue returns the value of a Time or Timestamp field at the given
+ * row in microseconds, since the Postgres epoch for timestamps. Timestamps
+ * are taken as they are, whether they have a timezone or not.
+ */
+static int64
+ArrowTimeValue(ArrowImportField *field, int64 row)
+{
+	int64 value = 0;
+
+	if (field->byteWidth == sizeof(int32))
+	{
+		int32 value32;
+		memcpy(&value32, field->values + row * sizeof(int32), sizeof(value32));
+		value = value32;
+	}
+	else
+	{
+		memcpy(&value, field->values + row * sizeof(int64), sizeof(value));
+	}
+
+	int64 microseconds = 0;
+	bool overflow = false;
+
+	switch (field->unit)
+	{
+		case ARROW_TIME_UNIT_SECOND:
+		{
+			overflow = pg_mul_s64_overflow(value, USECS_PER_SEC, &microseconds);
+			break;
+		}
+
+		case ARROW_TIME_UNIT_MILLISECOND:
+		{
+			overflow = pg_mul_s64_overflow(value, 1000, &microseconds);
+			break;
+		}
+
+		case ARROW_TIME_UNIT_MICROSECOND:
+		{
+			microseconds = value;
+			break;
+		}
+
+		default:
+		{
+			microseconds = value / 1000;
+			break;
+		}
+	}
+
+	if (field->conversion == ARROW_IMPORT_TIME)
+	{
+		if (overflow || microseconds < 0 || microseconds > USECS_PER_DAY)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+							errmsg("time of Arrow field \"%s\" is out of range",
+								   field->name)));
+		}
+
+		return microseconds;
+	}
+
+	if (overflow || pg_sub_s64_overflow(microseconds, ARROW_EPOCH_USECS, &microseconds) ||
+		!IS_VALID_TIMESTAMP(microseconds))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+						errmsg("timestamp of Arrow field \"%s\" is out of range",
+							   field->name)));
+	}
+
+	return microseconds;
+}
+
+
+/*
+ * ArrowValueString returns the value of an Int, FloatingPoint, Bool or Utf8
+ * field at the given row as a string, for the input function of its column.
+ */
+static char *
+ArrowValueString(ArrowImportField *field, int64 row)
+{
+	switch (field->arrowType)
+	{
+		case ARROW_TYPE_INT:
+		{
+			return psprintf(INT64_FORMAT, ArrowIntValue(field, row));
+		}
+
+		case ARROW_TYPE_FLOATING_POINT:
+		{
+			float8 value = ArrowFloatValue(field, row);
+			if (field->byteWidth == sizeof(float4))
+			{
+				return DatumGetCString(DirectFunctionCall1(float4out,
+														   Float4GetDatum((float4) value)));
+			}
+			return DatumGetCString(DirectFunctionCall1(float8out, Float8GetDatum(value)));
+		}
+
+		case ARROW_TYPE_BOOL:
+		{
+			return pstrdup(field->values[row / 8] & (1 << (row % 8)) ? "true" : "false");
+		}
+
+		default:
+		{
+			Size length = 0;
+			const char *data = ArrowBinaryValue(field, row, &length);
+			data = ArrowUtf8ToServer(data, &length);
+			return pnstrdup(data, length);
+		}
+	}
+}
+
+
+/*
+ * ReadArrowMessage reads the metadata of the next encapsulated message of a
+ * stream. Returns false at the end of the stream, which is either the end of
+ * stream marker or the end of its bytes. Streams of Arrow before 0.15, whose
+ * messages have no continuation marker, are read too.
+ */
+static bool
+ReadArrowMessage(ArrowStreamReader *reader, const char **metadata,
+				 uint32 *metadataLength)
+{
+	uint32 word = 0;
+	const char *data = ArrowStreamRead(reader, sizeof(word), true);
+	if (data == NULL)
+	{
+		return false;
+	}
+
+	memcpy(&word, data, sizeof(word));
+	if (word == ARROW_CONTINUATION_MARKER)
+	{
+		data = ArrowStreamRead(reader, sizeof(word), false);
+		memcpy(&word, data, sizeof(word));
+	}
+
+	if (word == 0)
+	{
+		return false;
+	}
+
+	if (word > MaxAllocSize)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid Arrow message length %u", word)));
+	}
+
+	*metadata = ArrowStreamRead(reader, word, false);
+	*metadataLength = word;
+
+	return true;
+}
+
+
+/*
+ * ParseArrowMessage reads the Message table at the root of the metadata of
+ * a message, and sets header to its header and bodyLength to the length of
+ * its body. Returns false if the header is not of the given type.
+ */
+static bool
+ParseArrowMessage(const char *metadata, uint32 metadataLength, uint8 headerType,
+				  FlatTable *header, int64 *bodyLength)
+{
+	FlatTable message;
+	FlatReadRoot(metadata, metadataLength, &message);
+
+	int16 version = FlatReadInt(&message, 0, sizeof(int16), 0);
+	if (version < ARROW_METADATA_VERSION_V4)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("Arrow metadata version %d is not supported",
+							   version + 1)));
+	}
+
+	*bodyLength = FlatReadInt(&message, 3, sizeof(int64), 0);
+	if (*bodyLength < 0 || *bodyLength > MaxAllocHugeSize)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid Arrow message body length " INT64_FORMAT,
+							   *bodyLength)));
+	}
+
+	return FlatReadInt(&message, 1, sizeof(uint8), 0) == headerType &&
+		   FlatReadChild(&message, 2, header);
+}
+
+
+/*
+ * ReadArrowBody returns the body of the current message of a stream.
+ */
+static const char *
+ReadArrowBody(ArrowStreamReader *reader, int64 bodyLength)
+{
+	if (bodyLength == 0)
+	{
+		return "";
+	}
+
+	return ArrowStreamRead(reader, bodyLength, false);
+}
+
+
+/*
+ * SkipArrowBody skips the body of the current message of a stream.
+ */
+static void
+SkipArrowBody(ArrowStreamReader *reader, int64 bodyLength)
+{
+	if (bodyLength > 0)
+	{
+		ArrowStreamRead(reader, bodyLength, false);
+	}
+}
+
+
+/*
+ * ArrowStreamRead returns the next length bytes of a stream. Bytes of a
+ * stream in memory are returned where they are, those of a file are read
+ * into a buffer allocated in the current memory context. Returns NULL if
+ * endAllowed is set and the stream has no more bytes, and errors out if it
+ * ends within the bytes otherwise.
+ */
+static const char *
+ArrowStreamRead(ArrowStreamReader *reader, Size length, bool endAllowed)
+{
+	if (reader->file == NULL)
+	{
+		if (endAllowed && reader->position == reader->length)
+		{
+			return NULL;
+		}
+
+		if (length > reader->length - reader->position)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("unexpected end of Arrow stream")));
+		}
+
+		const char *data = reader->data + reader->position;
+		reader->position += length;
+		return data;
+	}
+
+	char *data = palloc_extended(Max(length, 1), MCXT_ALLOC_HUGE);
+	Size readLength = fread(data, 1, length, reader->file);
+
+	if (ferror(reader->file))
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": %m", reader->fileName)));
+	}
+
+	if (endAllowed && readLength == 0)
+	{
+		pfree(data);
+		return NULL;
+	}
+
+	if (readLength < length)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("unexpected end of Arrow stream in file \"%s\"",
+							   reader->fileName)));
+	}
+
+	return data;
+}
+
+
+/*
+ * FlatStart starts a flatbuffer with the offset of its root table, which is
+ * patched once the root table is written.
+ */
+static void
+FlatStart(StringInfo buf)
+{
+	uint32 rootOffset = 0;
+	appendBinaryStringInfo(buf, (char *) &rootOffset, sizeof(rootOffset));
+}
+
+
+/*
+ * FlatPad appends zeroes until the length of the buffer is a multiple of
+ * alignment.
+ */
+static void
+FlatPad(StringInfo buf, int alignment)
+{
+	while (buf->len % alignment != 0)
+	{
+		appendStringInfoChar(buf, '\0');
+	}
+}
+
+
+/*
+ * FlatWriteTable appends a table with the given fields, preceded by its
+ * vtable, and returns its position. Fields are aligned to their size. The
+ * positions of the offset fields are set in offsetSlots, to be patched with
+ * FlatPatch once the objects they refer to are written.
+ */
+static uint32
+FlatWriteTable(StringInfo buf, const FlatField *fields, int fieldCount,
+			   uint32 *offsetSlots)
+{
+	uint16 fieldOffsets[ARROW_MAX_TABLE_FIELDS] = { 0 };
+	uint16 tableSize = sizeof(int32);
+
+	Assert(fieldCount <= ARROW_MAX_TABLE_FIELDS);
+
+	/* the table starts aligned to 8 bytes, so aligning the offsets suffices */
+	for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+	{
+		if (fields[fieldIndex].size > 0)
+		{
+			tableSize = TYPEALIGN(fields[fieldIndex].size, tableSize);
+			fieldOffsets[fieldIndex] = tableSize;
+			tableSize += fields[fieldIndex].size;
+		}
+	}
+
+	FlatPad(buf, sizeof(uint16));
+	uint32 vtablePosition = buf->len;
+	uint16 vtableSize = sizeof(uint16) * (2 + fieldCount);
+	appendBinaryStringInfo(buf, (char *) &vtableSize, sizeof(vtableSize));
+	appendBinaryStringInfo(buf, (char *) &tableSize, sizeof(tableSize));
+	appendBinaryStringInfo(buf, (char *) fieldOffsets, sizeof(uint16) * fieldCount);
+
+	FlatPad(buf, sizeof(int64));
+	uint32 tablePosition = buf->len;
+	int32 vtableOffset = tablePosition - vtablePosition;
+
+	enlargeStringInfo(buf, tableSize);
+	MemSet(buf->data + tablePosition, 0, tableSize);
+	memcpy(buf->data + tablePosition, &vtableOffset, sizeof(vtableOffset));
+
+	for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+	{
+		const FlatField *field = &fields[fieldIndex];
+		char *fieldData = buf->data + tablePosition + fieldOffsets[fieldIndex];
+
+		if (field->size == 0)
+		{
+			continue;
+		}
+
+		if (field->isOffset)
+		{
+			offsetSlots[fieldIndex] = tablePosition + fieldOffsets[fieldIndex];
+			continue;
+		}
+
+		switch (field->size)
+		{
+			case sizeof(uint8):
+			{
+				uint8 value = field->value;
+				memcpy(fieldData, &value, sizeof(value));
+				break;
+			}
+
+			case sizeof(uint16):
+			{
+				uint16 value = field->value;
+				memcpy(fieldData, &value, sizeof(value));
+				break;
+			}
+
+			case sizeof(uint32):
+			{
+				uint32 value = field->value;
+				memcpy(fieldData, &value, sizeof(value));
+				break;
+			}
+
+			default:
+			{
+				memcpy(fieldData, &field->value, sizeof(uint64));
+				break;
+			}
+		}
+	}
+
+	buf->len += tableSize;
+	buf->data[buf->len] = '\0';
+
+	return tablePosition;
+}
+
+
+/*
+ * FlatWriteString appends a string and returns its position.
+ */
+static uint32
+FlatWriteString(StringInfo buf, const char *string)
+{
+	uint32 length = strlen(string);
+
+	FlatPad(buf, sizeof(uint32));
+	uint32 position = buf->len;
+	appendBinaryStringInfo(buf, (char *) &length, sizeof(length));
+	appendBinaryStringInfo(buf, string, length + 1);
+
+	return position;
+}
+
+
+/*
+ * FlatWriteOffsetVector appends a vector of count offsets and returns its
+ * position. slot is set to the position of the first offset, the others
+ * follow it.
+ */
+static uint32
+FlatWriteOffsetVector(StringInfo buf, int count, uint32 *slot)
+{
+	uint32 length = count;
+	uint32 offset = 0;
+
+	FlatPad(buf, sizeof(uint32));
+	uint32 position = buf->len;
+	appendBinaryStringInfo(buf, (char *) &length, sizeof(length));
+	for (int index = 0; index < count; index++)
+	{
+		appendBinaryStringInfo(buf, (char *) &offset, sizeof(offset));
+	}
+
+	*slot = position + sizeof(uint32);
+
+	return position;
+}
+
+
+/*
+ * FlatWriteStructVector appends a vector of count structs of 8 byte fields
+ * and returns its position. The length is placed so that the structs start
+ * aligned to 8 bytes.
+ */
+static uint32
+FlatWriteStructVector(StringInfo buf, const void *data, int count, int structSize)
+{
+	uint32 length = count;
+	uint32 padding = 0;
+
+	FlatPad(buf, sizeof(uint32));
+	if ((buf->len + sizeof(uint32)) % sizeof(int64) != 0)
+	{
+		appendBinaryStringInfo(buf, (char *) &padding, sizeof(padding));
+	}
+
+	uint32 position = buf->len;
+	appendBinaryStringInfo(buf, (char *) &length, sizeof(length));
+	appendBinaryStringInfo(buf, data, count * structSize);
+
+	return position;
+}
+
+
+/*
+ * FlatPatch sets the offset at slot to refer to the object at target, which
+ * flatbuffers always place after the offset.
+ */
+static void
+FlatPatch(StringInfo buf, uint32 slot, uint32 target)
+{
+	uint32 offset = target - slot;
+
+	Assert(target > slot);
+	memcpy(buf->data + slot, &offset, sizeof(offset));
+}
+
+
+/*
+ * FlatReadRoot reads the root table of a flatbuffer of the given length.
+ */
+static void
+FlatReadRoot(const char *buf, uint32 length, FlatTable *table)
+{
+	if (length < sizeof(uint32))
+	{
+		FlatInvalid();
+	}
+
+	uint32 rootOffset;
+	memcpy(&rootOffset, buf, sizeof(rootOffset));
+	FlatReadTableAt(buf, length, rootOffset, table);
+}
+
+
+/*
+ * FlatReadTableAt reads the table at the given position of a flatbuffer,
+ * after checking that it and its vtable lie within the buffer.
+ */
+static void
+FlatReadTableAt(const char *buf, uint32 length, uint64 position, FlatTable *table)
+{
+	if (position + sizeof(int32) > length)
+	{
+		FlatInvalid();
+	}
+
+	int32 vtableOffset;
+	memcpy(&vtableOffset, buf + position, sizeof(vtableOffset));
+
+	int64 vtable = (int64) position - vtableOffset;
+	if (vtable < 0 || vtable + 2 * sizeof(uint16) > length)
+	{
+		FlatInvalid();
+	}
+
+	uint16 vtableSize;
+	uint16 tableSize;
+	memcpy(&vtableSize, buf + vtable, sizeof(vtableSize));
+	memcpy(&tableSize, buf + vtable + sizeof(uint16), sizeof(tableSize));
+
+	if (vtableSize < 2 * sizeof(uint16) || vtable + vtableSize > length ||
+		tableSize < sizeof(int32) || position + tableSize > length)
+	{
+		FlatInvalid();
+	}
+
+	table->buf = buf;
+	table->length = length;
+	table->position = position;
+	table->vtable = vtable;
+	table->vtableSize = vtableSize;
+	table->tableSize = tableSize;
+}
+
+
+/*
+ * FlatFieldPosition returns the position of a field of the given size in a
+ * table, or 0 if the table does not have it.
+ */
+static uint32
+FlatFieldPosition(FlatTable *table, int fieldIndex, int fieldSize)
+{
+	uint32 slot = (fieldIndex + 2) * sizeof(uint16);
+	if (slot + sizeof(uint16) > table->vtableSize)
+	{
+		return 0;
+	}
+
+	uint16 fieldOffset;
+	memcpy(&fieldOffset, table->buf + table->vtable + slot, sizeof(fieldOffset));
+	if (fieldOffset == 0)
+	{
+		return 0;
+	}
+
+	if (fieldOffset + fieldSize > table->tableSize)
+	{
+		FlatInvalid();
+	}
+
+	return table->position + fieldOffset;
+}
+
+
+/*
+ * FlatReadInt returns the integer field of the given size of a table, or
+ * defaultValue if the table does not have it. Fields of one byte are
+ * unsigned, others signed.
+ */
+static int64
+FlatReadInt(FlatTable *table, int fieldIndex, int fieldSize, int64 defaultValue)
+{
+	uint32 position = FlatFieldPosition(table, fieldIndex, fieldSize);
+	if (position == 0)
+	{
+		return defaultValue;
+	}
+
+	const char *field = table->buf + position;
+
+	switch (fieldSize)
+	{
+		case sizeof(uint8):
+		{
+			return *(const uint8 *) field;
+		}
+
+		case sizeof(int16):
+		{
+			int16 value;
+			memcpy(&value, field, sizeof(value));
+			return value;
+		}
+
+		case sizeof(int32):
+		{
+			int32 value;
+			memcpy(&value, field, sizeof(value));
+			return value;
+		}
+
+		default:
+		{
+			int64 value;
+			memcpy(&value, field, sizeof(value));
+			return value;
+		}
+	}
+}
+
+
+/*
+ * FlatReadOffset sets target to the position of the object the offset field
+ * of a table refers to. Returns false if the table does not have the field.
+ */
+static bool
+FlatReadOffset(FlatTable *table, int fieldIndex, uint64 *target)
+{
+	uint32 position = FlatFieldPosition(table, fieldIndex, sizeof(uint32));
+	if (position == 0)
+	{
+		return false;
+	}
+
+	uint32 offset;
+	memcpy(&offset, table->buf + position, sizeof(offset));
+
+	*target = (uint64) position + offset;
+	if (*target >= table->length)
+	{
+		FlatInvalid();
+	}
+
+	return true;
+}
+
+
+/*
+ * FlatReadChild reads the table the given field of a table refers to.
+ * Returns false if the table does not have the field.
+ */
+static bool
+FlatReadChild(FlatTable *table, int fieldIndex, FlatTable *child)
+{
+	uint64 target = 0;
+	if (!FlatReadOffset(table, fieldIndex, &target))
+	{
+		return false;
+	}
+
+	FlatReadTableAt(table->buf, table->length, target, child);
+	return true;
+}
+
+
+/*
+ * FlatReadVector returns the number of elements of the vector the given
+ * field of a table refers to, after checking that they lie within the
+ * buffer, and sets elements to the position of the first. Returns 0 if the
+ * table does not have the field.
+ */
+static uint32
+FlatReadVector(FlatTable *table, int fieldIndex, int elementSize, uint32 *elements)
+{
+	uint64 target = 0;
+	*elements = 0;
+
+	if (!FlatReadOffset(table, fieldIndex, &target))
+	{
+		return 0;
+	}
+
+	if (target + sizeof(uint32) > table->length)
+	{
+		FlatInvalid();
+	}
+
+	uint32 count;
+	memcpy(&count, table->buf + target, sizeof(count));
+
+	if ((uint64) count * elementSize > table->length - target - sizeof(uint32))
+	{
+		FlatInvalid();
+	}
+
+	*elements = target + sizeof(uint32);
+	return count;
+}
+
+
+/*
+ * FlatReadString returns a copy of the string the given field of a table
+ * refers to, or NULL if the table does not have the field.
+ */
+static char *
+FlatReadString(FlatTable *table, int fieldIndex)
+{
+	uint32 elements = 0;
+	uint64 target = 0;
+
+	if (!FlatReadOffset(table, fieldIndex, &target))
+	{
+		return NULL;
+	}
+
+	uint32 length = FlatReadVector(table, fieldIndex, sizeof(char), &elements);
+	return pnstrdup(table->buf + elements, length);
+}
+
+
+/*
+ * FlatReadVectorTable reads the table at the given index of a vector of
+ * tables whose elements start at the given position.
+ */
+static void
+FlatReadVectorTable(FlatTable *table, uint32 elements, uint32 index, FlatTable *child)
+{
+	uint64 position = elements + (uint64) index * sizeof(uint32);
+
+	uint32 offset;
+	memcpy(&offset, table->buf + position, sizeof(offset));
+
+	FlatReadTableAt(table->buf, table->length, position + offset, child);
+}
+
+
+/*
+ * FlatInvalid errors out on metadata that is not a valid flatbuffer.
+ */
+static void
+FlatInvalid(void)
+{
+	ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg("invalid Arrow stream"),
+					errdetail("The metadata of a message is not a valid flatbuffer.")));
+}
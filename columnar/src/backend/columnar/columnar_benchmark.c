@@ -0,0 +1,756 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_benchmark.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Microbenchmarks of the hot paths of columnar: writing rows and flushing
+ * stripes, reading them row by row and in vectors, the compression codecs,
+ * and the vectorized comparison kernels. They run on synthetic data of a few
+ * shapes and time only the code they benchmark, so regressions show up in
+ * seconds instead of in a full benchmark suite run.
+ *
+ * The functions are not part of the extension. Create them as in
+ * src/test/regress/sql/columnar_test_helpers.sql to use them.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "catalog/pg_language.h"
+#include "catalog/pg_type.h"
+#include "executor/tuptable.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "portability/instr_time.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/regproc.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_compression.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/vectorization/columnar_vector_types.h"
+
+#define BENCHMARK_RESULT_NATTS 7
+
+/* values of distinct rows of BENCHMARK_SHAPE_LOW_CARDINALITY */
+#define BENCHMARK_LOW_CARDINALITY 16
+
+typedef enum BenchmarkShape
+{
+	BENCHMARK_SHAPE_SEQUENTIAL,
+	BENCHMARK_SHAPE_RANDOM,
+	BENCHMARK_SHAPE_LOW_CARDINALITY,
+	BENCHMARK_SHAPE_CONSTANT
+} BenchmarkShape;
+
+typedef struct BenchmarkResult
+{
+	Tuplestorestate *tupleStore;
+	TupleDesc tupleDescriptor;
+} BenchmarkResult;
+
+static BenchmarkShape ParseBenchmarkShape(const char *shapeName);
+static int64 BenchmarkValue(BenchmarkShape shape, uint64 rowIndex);
+static Datum BenchmarkDatum(Form_pg_attribute attributeForm, int64 value);
+static void StoreBenchmarkValue(char *values, Oid typeId, int16 typeLength,
+								uint32 rowIndex, int64 value);
+static Relation OpenBenchmarkRelation(Oid relationId, LOCKMODE lockMode);
+static void BeginBenchmarkResult(FunctionCallInfo fcinfo, BenchmarkResult *result);
+static void AddBenchmarkResult(BenchmarkResult *result, const char *benchmark,
+							   int iterations, int64 rows, int64 bytes,
+							   instr_time elapsed);
+
+PG_FUNCTION_INFO_V1(columnar_benchmark_write);
+PG_FUNCTION_INFO_V1(columnar_benchmark_read);
+PG_FUNCTION_INFO_V1(columnar_benchmark_codec);
+PG_FUNCTION_INFO_V1(columnar_benchmark_kernel);
+
+
+/*
+ * columnar_benchmark_write writes row_count rows of the given shape to a
+ * columnar table and times ColumnarWriteRow, which encodes and compresses
+ * the chunks and flushes the stripes that fill up, apart from the flush of
+ * the last stripe by ColumnarEndWrite. The rows stay in the table unless the
+ * transaction is rolled back.
+ */
+Datum
+columnar_benchmark_write(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int32 rowCount = PG_GETARG_INT32(1);
+	BenchmarkShape shape = ParseBenchmarkShape(text_to_cstring(PG_GETARG_TEXT_P(2)));
+
+	if (rowCount <= 0)
+	{
+		ereport(ERROR, (errmsg("row_count must be positive")));
+	}
+
+	BenchmarkResult result = { 0 };
+	BeginBenchmarkResult(fcinfo, &result);
+
+	Relation rel = OpenBenchmarkRelation(relationId, RowExclusiveLock);
+	if (RelationGetIndexList(rel) != NIL)
+	{
+		ereport(ERROR, (errmsg("table %s has indexes",
+							   quote_identifier(RelationGetRelationName(rel))),
+						errhint("The benchmark doesn't update indexes.")));
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	ColumnarOptions options = { 0 };
+	ReadColumnarOptions(relationId, &options);
+
+	ColumnarWriteState *writeState = ColumnarBeginWrite(rel->rd_node, options,
+														tupleDescriptor);
+
+	Datum *values = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		nulls[columnIndex] = TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped;
+	}
+
+	MemoryContext rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "Columnar Benchmark Row Context",
+													 ALLOCSET_DEFAULT_SIZES);
+	instr_time writeTime;
+	instr_time flushTime;
+	instr_time startTime;
+	instr_time endTime;
+	INSTR_TIME_SET_ZERO(writeTime);
+	INSTR_TIME_SET_ZERO(flushTime);
+
+	for (int32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(rowContext);
+
+		int64 value = BenchmarkValue(shape, rowIndex);
+		for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+			if (!attributeForm->attisdropped)
+			{
+				values[columnIndex] = BenchmarkDatum(attributeForm, value);
+			}
+		}
+
+		INSTR_TIME_SET_CURRENT(startTime);
+		ColumnarWriteRow(writeState, values, nulls);
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(writeTime, endTime, startTime);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(rowContext);
+	}
+
+	INSTR_TIME_SET_CURRENT(startTime);
+	ColumnarEndWrite(writeState);
+	INSTR_TIME_SET_CURRENT(endTime);
+	INSTR_TIME_ACCUM_DIFF(flushTime, endTime, startTime);
+
+	MemoryContextDelete(rowContext);
+
+	AddBenchmarkResult(&result, "write", 1, rowCount, 0, writeTime);
+	AddBenchmarkResult(&result, "flush", 1, 0, 0, flushTime);
+
+	table_close(rel, NoLock);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * columnar_benchmark_read reads all columns of the rows of a columnar table
+ * the given number of times, row by row or in vectors, and times the reads,
+ * which decompress and deserialize the chunks they need.
+ */
+Datum
+columnar_benchmark_read(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	bool vectorized = PG_GETARG_BOOL(1);
+	int32 iterations = PG_GETARG_INT32(2);
+
+	if (iterations <= 0)
+	{
+		ereport(ERROR, (errmsg("iterations must be positive")));
+	}
+
+	BenchmarkResult result = { 0 };
+	BeginBenchmarkResult(fcinfo, &result);
+
+	Relation rel = OpenBenchmarkRelation(relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+
+	List *projectedColumnList = NIL;
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (!TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			projectedColumnList = lappend_int(projectedColumnList, columnIndex + 1);
+		}
+	}
+
+	TupleTableSlot *vectorSlot = NULL;
+	Datum *values = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+	if (vectorized)
+	{
+		vectorSlot = CreateVectorTupleTableSlot(tupleDescriptor);
+	}
+
+	instr_time readTime;
+	INSTR_TIME_SET_ZERO(readTime);
+	int64 rowCount = 0;
+	int64 bytesRead = 0;
+
+	for (int32 iteration = 0; iteration < iterations; iteration++)
+	{
+		MemoryContext scanContext = AllocSetContextCreate(CurrentMemoryContext,
+														  "Columnar Benchmark Scan Context",
+														  ALLOCSET_DEFAULT_SIZES);
+
+		instr_time startTime;
+		instr_time endTime;
+		INSTR_TIME_SET_CURRENT(startTime);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(scanContext);
+		ColumnarReadState *readState = ColumnarBeginRead(rel, tupleDescriptor,
+														 projectedColumnList, NIL,
+														 scanContext,
+														 GetActiveSnapshot(), false,
+														 NULL);
+		MemoryContextSwitchTo(oldContext);
+
+		if (vectorized)
+		{
+			VectorTupleTableSlot *vectorTTS = (VectorTupleTableSlot *) vectorSlot;
+			int newVectorSize = 0;
+
+			while (ColumnarReadNextVector(readState, vectorTTS->tts.tts_values,
+										  vectorTTS->rowNumber, vectorTTS->capacity,
+										  &newVectorSize))
+			{
+				CHECK_FOR_INTERRUPTS();
+				rowCount += newVectorSize;
+			}
+		}
+		else
+		{
+			while (ColumnarReadNextRow(readState, values, nulls, NULL))
+			{
+				CHECK_FOR_INTERRUPTS();
+				rowCount++;
+			}
+		}
+
+		bytesRead += ColumnarReadGetStatistics(readState)->bytesRead;
+		ColumnarEndRead(readState);
+
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(readTime, endTime, startTime);
+
+		MemoryContextDelete(scanContext);
+	}
+
+	AddBenchmarkResult(&result, vectorized ? "read_vector" : "read_row", iterations,
+					   rowCount, bytesRead, readTime);
+
+	if (vectorSlot != NULL)
+	{
+		ExecDropSingleTupleTableSlot(vectorSlot);
+	}
+
+	table_close(rel, NoLock);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * columnar_benchmark_codec compresses and decompresses a buffer of the given
+ * size, filled with 64 bit values of the given shape, the given number of
+ * times with the given compression type and columnar.compression_level.
+ */
+Datum
+columnar_benchmark_codec(PG_FUNCTION_ARGS)
+{
+	char *compressionName = NameStr(*PG_GETARG_NAME(0));
+	BenchmarkShape shape = ParseBenchmarkShape(text_to_cstring(PG_GETARG_TEXT_P(1)));
+	int32 bufferSize = PG_GETARG_INT32(2);
+	int32 iterations = PG_GETARG_INT32(3);
+
+	CompressionType compressionType = ParseCompressionType(compressionName);
+	if (compressionType == COMPRESSION_TYPE_INVALID ||
+		compressionType == COMPRESSION_AUTO)
+	{
+		ereport(ERROR, (errmsg("unknown compression type: %s", compressionName)));
+	}
+
+	if (bufferSize <= 0 || bufferSize > MaxAllocSize / 2)
+	{
+		ereport(ERROR, (errmsg("size must be between 1 and %d", (int) MaxAllocSize / 2)));
+	}
+
+	if (iterations <= 0)
+	{
+		ereport(ERROR, (errmsg("iterations must be positive")));
+	}
+
+	BenchmarkResult result = { 0 };
+	BeginBenchmarkResult(fcinfo, &result);
+
+	StringInfo inputBuffer = makeStringInfo();
+	enlargeStringInfo(inputBuffer, bufferSize);
+	for (uint64 rowIndex = 0; inputBuffer->len < bufferSize; rowIndex++)
+	{
+		int64 value = BenchmarkValue(shape, rowIndex);
+		appendBinaryStringInfo(inputBuffer, (char *) &value,
+							   Min(sizeof(int64), bufferSize - inputBuffer->len));
+	}
+
+	StringInfo compressedBuffer = makeStringInfo();
+	StringInfo outputBuffer = makeStringInfo();
+	bool compressed = false;
+
+	instr_time compressTime;
+	instr_time decompressTime;
+	INSTR_TIME_SET_ZERO(compressTime);
+	INSTR_TIME_SET_ZERO(decompressTime);
+
+	for (int32 iteration = 0; iteration < iterations; iteration++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		instr_time startTime;
+		instr_time endTime;
+		INSTR_TIME_SET_CURRENT(startTime);
+		compressed = CompressBuffer(inputBuffer, compressedBuffer, compressionType,
+									columnar_compression_level);
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(compressTime, endTime, startTime);
+	}
+
+	/* like stripes, keep the data as is if it doesn't compress */
+	StringInfo storedBuffer = compressed ? compressedBuffer : inputBuffer;
+	CompressionType storedType = compressed ? compressionType : COMPRESSION_NONE;
+
+	for (int32 iteration = 0; iteration < iterations; iteration++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		instr_time startTime;
+		instr_time endTime;
+		INSTR_TIME_SET_CURRENT(startTime);
+		DecompressBufferInto(storedBuffer, storedType, inputBuffer->len, 0,
+							 outputBuffer);
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(decompressTime, endTime, startTime);
+	}
+
+	if (storedType != COMPRESSION_NONE &&
+		(outputBuffer->len != inputBuffer->len ||
+		 memcmp(outputBuffer->data, inputBuffer->data, inputBuffer->len) != 0))
+	{
+		ereport(ERROR, (errmsg("decompressed data doesn't match the input")));
+	}
+
+	int64 totalBytes = (int64) inputBuffer->len * iterations;
+	AddBenchmarkResult(&result, "compress", iterations, 0, totalBytes, compressTime);
+	AddBenchmarkResult(&result, "decompress", iterations, 0, totalBytes, decompressTime);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * columnar_benchmark_kernel runs a vectorized comparison operator, such as
+ * vint4gt(int4, int4), over a vector of row_count values of the given shape
+ * and a constant the given number of times. The constant is the middle value
+ * of the sequential shape, so about half the rows of it pass.
+ */
+Datum
+columnar_benchmark_kernel(PG_FUNCTION_ARGS)
+{
+	Oid functionId = PG_GETARG_OID(0);
+	BenchmarkShape shape = ParseBenchmarkShape(text_to_cstring(PG_GETARG_TEXT_P(1)));
+	int32 rowCount = PG_GETARG_INT32(2);
+	int32 iterations = PG_GETARG_INT32(3);
+
+	if (rowCount <= 0 || iterations <= 0)
+	{
+		ereport(ERROR, (errmsg("row_count and iterations must be positive")));
+	}
+
+	Oid *argumentTypes = NULL;
+	int argumentCount = 0;
+	Oid returnType = get_func_signature(functionId, &argumentTypes, &argumentCount);
+
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	if (argumentCount == 2)
+	{
+		get_typlenbyval(argumentTypes[0], &typeLength, &typeByValue);
+	}
+
+	if (returnType != BOOLOID || argumentCount != 2 ||
+		get_func_prolang(functionId) != ClanguageId ||
+		!typeByValue || typeLength <= 0)
+	{
+		ereport(ERROR, (errmsg("%s is not a vectorized comparison operator",
+							   format_procedure(functionId)),
+						errhint("Pass one of the v<type><op> functions of columnar "
+								"with fixed size arguments, like vint4gt.")));
+	}
+
+	BenchmarkResult result = { 0 };
+	BeginBenchmarkResult(fcinfo, &result);
+
+	VectorColumn *vectorColumn = BuildVectorColumn(rowCount, typeLength, true, NULL);
+	for (int32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		StoreBenchmarkValue((char *) vectorColumn->value, argumentTypes[0], typeLength,
+							rowIndex, BenchmarkValue(shape, rowIndex));
+	}
+	vectorColumn->dimension = rowCount;
+
+	/* the constant is a datum of the type of the second argument */
+	int16 constTypeLength = 0;
+	bool constTypeByValue = false;
+	get_typlenbyval(argumentTypes[1], &constTypeLength, &constTypeByValue);
+
+	int64 middleValue = Min(rowCount / 2, PG_INT16_MAX);
+	Datum constValue = 0;
+	if (argumentTypes[1] == FLOAT4OID)
+	{
+		constValue = Float4GetDatum((float4) middleValue);
+	}
+	else if (argumentTypes[1] == FLOAT8OID)
+	{
+		constValue = Float8GetDatum((float8) middleValue);
+	}
+	else if (constTypeLength == sizeof(int16))
+	{
+		constValue = Int16GetDatum((int16) middleValue);
+	}
+	else if (constTypeLength == sizeof(int32))
+	{
+		constValue = Int32GetDatum((int32) middleValue);
+	}
+	else
+	{
+		constValue = Int64GetDatum(middleValue);
+	}
+
+	VectorFnArgument vectorArgument = { VECTOR_FN_ARG_VAR,
+										PointerGetDatum(vectorColumn) };
+	VectorFnArgument constArgument = { VECTOR_FN_ARG_CONSTANT, constValue };
+
+	FmgrInfo functionInfo;
+	fmgr_info(functionId, &functionInfo);
+
+	instr_time kernelTime;
+	INSTR_TIME_SET_ZERO(kernelTime);
+
+	for (int32 iteration = 0; iteration < iterations; iteration++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		instr_time startTime;
+		instr_time endTime;
+		INSTR_TIME_SET_CURRENT(startTime);
+		FunctionCall2(&functionInfo, PointerGetDatum(&vectorArgument),
+					  PointerGetDatum(&constArgument));
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(kernelTime, endTime, startTime);
+	}
+
+	AddBenchmarkResult(&result, get_func_name(functionId), iterations,
+					   (int64) rowCount * iterations,
+					   (int64) rowCount * typeLength * iterations, kernelTime);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * ParseBenchmarkShape returns the data shape of the given name.
+ */
+static BenchmarkShape
+ParseBenchmarkShape(const char *shapeName)
+{
+	if (strcmp(shapeName, "sequential") == 0)
+	{
+		return BENCHMARK_SHAPE_SEQUENTIAL;
+	}
+	else if (strcmp(shapeName, "random") == 0)
+	{
+		return BENCHMARK_SHAPE_RANDOM;
+	}
+	else if (strcmp(shapeName, "low_cardinality") == 0)
+	{
+		return BENCHMARK_SHAPE_LOW_CARDINALITY;
+	}
+	else if (strcmp(shapeName, "constant") == 0)
+	{
+		return BENCHMARK_SHAPE_CONSTANT;
+	}
+
+	ereport(ERROR, (errmsg("unknown data shape: %s", shapeName),
+					errhint("Valid shapes are sequential, random, low_cardinality "
+							"and constant.")));
+}
+
+
+/*
+ * BenchmarkValue returns the value of the given row for a data shape. Random
+ * values are a hash of the row index, so every run uses the same data.
+ */
+static int64
+BenchmarkValue(BenchmarkShape shape, uint64 rowIndex)
+{
+	switch (shape)
+	{
+		case BENCHMARK_SHAPE_SEQUENTIAL:
+		{
+			return (int64) rowIndex;
+		}
+
+		case BENCHMARK_SHAPE_RANDOM:
+		case BENCHMARK_SHAPE_LOW_CARDINALITY:
+		{
+			/* splitmix64 */
+			uint64 value = rowIndex + UINT64CONST(0x9E3779B97F4A7C15);
+			value = (value ^ (value >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+			value = (value ^ (value >> 27)) * UINT64CONST(0x94D049BB133111EB);
+			value = value ^ (value >> 31);
+
+			if (shape == BENCHMARK_SHAPE_LOW_CARDINALITY)
+			{
+				return (int64) (value % BENCHMARK_LOW_CARDINALITY);
+			}
+
+			/* keep values in the range every integer type can hold */
+			return (int64) (value % PG_INT16_MAX);
+		}
+
+		case BENCHMARK_SHAPE_CONSTANT:
+		default:
+		{
+			return 42;
+		}
+	}
+}
+
+
+/*
+ * BenchmarkDatum converts a benchmark value to a datum of the type of the
+ * given column.
+ */
+static Datum
+BenchmarkDatum(Form_pg_attribute attributeForm, int64 value)
+{
+	switch (attributeForm->atttypid)
+	{
+		case BOOLOID:
+		{
+			return BoolGetDatum(value % 2 == 0);
+		}
+
+		case INT2OID:
+		{
+			return Int16GetDatum((int16) (value % PG_INT16_MAX));
+		}
+
+		case INT4OID:
+		case DATEOID:
+		{
+			return Int32GetDatum((int32) value);
+		}
+
+		case INT8OID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		{
+			return Int64GetDatum(value);
+		}
+
+		case FLOAT4OID:
+		{
+			return Float4GetDatum((float4) value / 100);
+		}
+
+		case FLOAT8OID:
+		{
+			return Float8GetDatum((float8) value / 100);
+		}
+
+		case TEXTOID:
+		case VARCHAROID:
+		{
+			return CStringGetTextDatum(psprintf(INT64_FORMAT, value));
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("column %s has a type the benchmark can't generate",
+								   quote_identifier(NameStr(attributeForm->attname))),
+							errhint("Use bool, integer, float, date, timestamp and "
+									"text columns.")));
+		}
+	}
+}
+
+
+/*
+ * StoreBenchmarkValue stores a benchmark value as the row of a vector of a
+ * fixed size type.
+ */
+static void
+StoreBenchmarkValue(char *values, Oid typeId, int16 typeLength, uint32 rowIndex,
+					int64 value)
+{
+	char *target = values + (uint64) rowIndex * typeLength;
+
+	if (typeId == FLOAT4OID)
+	{
+		float4 floatValue = (float4) value;
+		memcpy(target, &floatValue, sizeof(float4));
+	}
+	else if (typeId == FLOAT8OID)
+	{
+		float8 floatValue = (float8) value;
+		memcpy(target, &floatValue, sizeof(float8));
+	}
+	else if (typeLength == sizeof(int16))
+	{
+		int16 intValue = (int16) value;
+		memcpy(target, &intValue, sizeof(int16));
+	}
+	else if (typeLength == sizeof(int32))
+	{
+		int32 intValue = (int32) value;
+		memcpy(target, &intValue, sizeof(int32));
+	}
+	else if (typeLength == sizeof(int64))
+	{
+		memcpy(target, &value, sizeof(int64));
+	}
+	else
+	{
+		*target = (char) value;
+	}
+}
+
+
+/*
+ * OpenBenchmarkRelation opens a columnar table that the current user owns.
+ */
+static Relation
+OpenBenchmarkRelation(Oid relationId, LOCKMODE lockMode)
+{
+	Relation rel = table_open(relationId, lockMode);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE, get_rel_name(relationId));
+	}
+
+	return rel;
+}
+
+
+/*
+ * BeginBenchmarkResult sets up the tuple store that the benchmark functions
+ * return their results in.
+ */
+static void
+BeginBenchmarkResult(FunctionCallInfo fcinfo, BenchmarkResult *result)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("function returning record called in context "
+							   "that cannot accept type record")));
+	}
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	result->tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	result->tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = result->tupleStore;
+	resultInfo->setDesc = result->tupleDescriptor;
+}
+
+
+/*
+ * AddBenchmarkResult adds a row with the time a benchmark took, and the rows
+ * and megabytes per second it processed, to the result of a benchmark
+ * function.
+ */
+static void
+AddBenchmarkResult(BenchmarkResult *result, const char *benchmark, int iterations,
+				   int64 rows, int64 bytes, instr_time elapsed)
+{
+	double elapsedMilliseconds = INSTR_TIME_GET_MILLISEC(elapsed);
+
+	Datum values[BENCHMARK_RESULT_NATTS] = { 0 };
+	bool nulls[BENCHMARK_RESULT_NATTS] = { 0 };
+
+	values[0] = CStringGetTextDatum(benchmark);
+	values[1] = Int32GetDatum(iterations);
+	values[2] = Int64GetDatum(rows);
+	values[3] = Int64GetDatum(bytes);
+	values[4] = Float8GetDatum(elapsedMilliseconds);
+
+	nulls[5] = true;
+	nulls[6] = true;
+	if (elapsedMilliseconds > 0)
+	{
+		double elapsedSeconds = elapsedMilliseconds / 1000.0;
+
+		if (rows > 0)
+		{
+			values[5] = Float8GetDatum(rows / elapsedSeconds);
+			nulls[5] = false;
+		}
+
+		if (bytes > 0)
+		{
+			values[6] = Float8GetDatum((bytes / 1048576.0) / elapsedSeconds);
+			nulls[6] = false;
+		}
+	}
+
+	tuplestore_putvalues(result->tupleStore, result->tupleDescriptor, values, nulls);
+}
@@ -0,0 +1,147 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_bloom.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Per chunk bloom filters of column values. They let us skip chunk groups
+ * for equality predicates on columns whose min/max values cover the whole
+ * domain in every chunk, like random ids.
+ *
+ * A filter is a bytea holding the number of hash functions followed by the
+ * bit array. Values are hashed with the extended hash function of the
+ * column type, and the probed bits are derived from the 64 bit hash by
+ * double hashing.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "utils/typcache.h"
+
+#include "columnar/columnar.h"
+
+/* about 1% false positives with 7 hash functions */
+#define BLOOM_BITS_PER_VALUE 10
+#define BLOOM_HASH_COUNT 7
+
+#define BLOOM_MIN_BITS 64
+#define BLOOM_MAX_BITS (8 * 1024 * 1024)
+
+typedef struct ColumnarBloomFilterData
+{
+	int32 vl_len_;                  /* varlena header (do not touch directly!) */
+	uint32 hashCount;
+	uint8 bits[FLEXIBLE_ARRAY_MEMBER];
+} ColumnarBloomFilterData;
+
+#define BLOOM_FILTER_BIT_COUNT(filter) \
+	((uint64) (VARSIZE(filter) - offsetof(ColumnarBloomFilterData, bits)) * 8)
+
+static inline uint64 BloomFilterBit(uint64 hash, uint32 hashIndex, uint64 bitCount);
+
+
+/*
+ * ColumnarBloomHashFunction returns the extended hash function of the given
+ * type, or NULL if the type doesn't have one.
+ */
+FmgrInfo *
+ColumnarBloomHashFunction(Oid typeId)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(typeId,
+												  TYPECACHE_HASH_EXTENDED_PROC_FINFO);
+
+	if (!OidIsValid(typeEntry->hash_extended_proc))
+	{
+		return NULL;
+	}
+
+	return &typeEntry->hash_extended_proc_finfo;
+}
+
+
+/*
+ * ColumnarBloomHash hashes a value for adding it to, or looking it up in a
+ * bloom filter. Writer and reader must use the same hash function and
+ * collation.
+ */
+uint64
+ColumnarBloomHash(FmgrInfo *hashFunction, Oid collation, Datum value)
+{
+	return DatumGetUInt64(FunctionCall2Coll(hashFunction, collation, value,
+											UInt64GetDatum(0)));
+}
+
+
+/*
+ * ColumnarBloomFilterBuild returns a bloom filter sized for the given number
+ * of hashed values and containing them.
+ */
+bytea *
+ColumnarBloomFilterBuild(uint64 *hashes, uint32 hashCount)
+{
+	uint64 bitCount = (uint64) hashCount * BLOOM_BITS_PER_VALUE;
+	bitCount = Max(bitCount, BLOOM_MIN_BITS);
+	bitCount = Min(bitCount, BLOOM_MAX_BITS);
+	bitCount = TYPEALIGN(8, bitCount);
+
+	Size filterSize = offsetof(ColumnarBloomFilterData, bits) + bitCount / 8;
+	ColumnarBloomFilterData *filter = palloc0(filterSize);
+	SET_VARSIZE(filter, filterSize);
+	filter->hashCount = BLOOM_HASH_COUNT;
+
+	for (uint32 valueIndex = 0; valueIndex < hashCount; valueIndex++)
+	{
+		for (uint32 hashIndex = 0; hashIndex < filter->hashCount; hashIndex++)
+		{
+			uint64 bit = BloomFilterBit(hashes[valueIndex], hashIndex, bitCount);
+			filter->bits[bit / 8] |= (1 << (bit % 8));
+		}
+	}
+
+	return (bytea *) filter;
+}
+
+
+/*
+ * ColumnarBloomFilterMayContain returns false if the value with the given
+ * hash was definitely not added to the bloom filter.
+ */
+bool
+ColumnarBloomFilterMayContain(bytea *bloomFilter, uint64 hash)
+{
+	ColumnarBloomFilterData *filter = (ColumnarBloomFilterData *) bloomFilter;
+	uint64 bitCount = BLOOM_FILTER_BIT_COUNT(filter);
+
+	if (bitCount == 0)
+	{
+		return true;
+	}
+
+	for (uint32 hashIndex = 0; hashIndex < filter->hashCount; hashIndex++)
+	{
+		uint64 bit = BloomFilterBit(hash, hashIndex, bitCount);
+		if ((filter->bits[bit / 8] & (1 << (bit % 8))) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BloomFilterBit returns the bit probed by the given hash function, using
+ * the two halves of the hash as the two base hashes.
+ */
+static inline uint64
+BloomFilterBit(uint64 hash, uint32 hashIndex, uint64 bitCount)
+{
+	uint64 firstHash = (uint32) hash;
+	uint64 secondHash = (uint32) (hash >> 32) | 1;
+
+	return (firstHash + hashIndex * secondHash) % bitCount;
+}
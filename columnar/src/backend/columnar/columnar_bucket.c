@@ -0,0 +1,893 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_bucket.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Hash bucketed stripes. A table with bucket_by (column, bucket count) puts
+ * each row into one of the buckets of the extended hash of that column, and
+ * the rows of each bucket that are written together get a stripe of their
+ * own, whose bucket is recorded in columnar.stripe.
+ *
+ * Scans skip the stripes of buckets that equality predicates on the column
+ * can't match. Hashed aggregates grouped by the column, and hash joins on it
+ * between bucketed tables with the same bucket count, run bucket by bucket:
+ * like partitionwise aggregation, the plan is replaced by an Append of one
+ * copy per bucket, whose scans filter on columnar.bucket_of(column, count).
+ * Each copy only scans the stripes of its bucket and builds a hash table of
+ * its rows only.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_type.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/optimizer.h"
+#include "parser/parse_func.h"
+#include "parser/parsetree.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/typcache.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_customscan.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/utils/listutils.h"
+
+/* seed of the bucket hash, so that buckets don't follow bloom filter bits */
+#define BUCKET_HASH_SEED UINT64CONST(0x5bd1e9955bd1e995)
+
+/*
+ * BucketPartitioning describes how the output rows of a plan are split into
+ * buckets: the rows of a bucket come from scans of the stripes of that
+ * bucket only.
+ */
+typedef struct BucketPartitioning
+{
+	uint32 bucketCount;
+	Oid typeId;
+	Oid collation;
+	Oid eqOperator;
+
+	/* output columns of the plan that hold the bucket_by column */
+	Bitmapset *keyColumns;
+} BucketPartitioning;
+
+typedef struct BucketSplitContext
+{
+	PlannedStmt *stmt;
+	Oid bucketOfFunctionId;
+} BucketSplitContext;
+
+static FmgrInfo * ColumnBucketHashFunction(Relation relation, ColumnarOptions *options,
+										   Oid *typeId, Oid *collation);
+static bool ClauseAllowedBuckets(Node *clause, AttrNumber bucketColumn, Oid typeId,
+								 Oid collation, Oid eqOperator, Oid bucketOfFunctionId,
+								 FmgrInfo *hashFunction, uint32 bucketCount,
+								 Bitmapset **allowedBuckets);
+static bool IsBucketColumn(Node *node, AttrNumber bucketColumn, Oid typeId);
+static Oid ColumnarBucketOfFunctionId(void);
+static Plan * SplitPlanTreeByBucket(Plan *plan, BucketSplitContext *context);
+static bool PlanBucketPartitioning(Plan *plan, BucketSplitContext *context,
+								   BucketPartitioning *partitioning);
+static bool ColumnarScanBucketPartitioning(CustomScan *customScan,
+										   BucketSplitContext *context,
+										   BucketPartitioning *partitioning);
+static bool HashJoinBucketPartitioning(HashJoin *hashJoin, BucketSplitContext *context,
+									   BucketPartitioning *partitioning);
+static bool AggBucketPartitioning(Agg *agg, BucketSplitContext *context,
+								  BucketPartitioning *partitioning);
+static Bitmapset * TargetListKeyColumns(List *targetList, Index varno,
+										Bitmapset *childKeyColumns);
+static bool IsColumnarScan(Plan *plan);
+static Plan * MakeBucketAppend(Plan *plan, uint32 bucketCount,
+							   BucketSplitContext *context);
+static void AddBucketQuals(Plan *plan, uint32 bucket, uint32 bucketCount,
+						   BucketSplitContext *context);
+
+PG_FUNCTION_INFO_V1(bucket_of);
+
+
+/*
+ * ColumnarBucketOfValue returns the bucket of the given value of a bucket_by
+ * column. NULLs go to the first bucket.
+ */
+uint32
+ColumnarBucketOfValue(FmgrInfo *hashFunction, Oid collation, Datum value,
+					  bool isNull, uint32 bucketCount)
+{
+	if (isNull)
+	{
+		return 0;
+	}
+
+	uint64 hash = DatumGetUInt64(FunctionCall2Coll(hashFunction, collation, value,
+												   UInt64GetDatum(BUCKET_HASH_SEED)));
+
+	return (uint32) (hash % bucketCount);
+}
+
+
+/*
+ * bucket_of returns the bucket of a value among the given number of buckets,
+ * the same bucket the rows of a table with bucket_by on a column of its type
+ * are written to.
+ */
+Datum
+bucket_of(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(1))
+	{
+		PG_RETURN_NULL();
+	}
+
+	int32 bucketCount = PG_GETARG_INT32(1);
+	if (bucketCount < 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("bucket count must be positive")));
+	}
+
+	FmgrInfo *hashFunction = (FmgrInfo *) fcinfo->flinfo->fn_extra;
+	if (hashFunction == NULL)
+	{
+		Oid typeId = get_fn_expr_argtype(fcinfo->flinfo, 0);
+
+		hashFunction = ColumnarBloomHashFunction(typeId);
+		if (hashFunction == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+							errmsg("could not identify an extended hash function "
+								   "for type %s", format_type_be(typeId))));
+		}
+
+		fcinfo->flinfo->fn_extra = hashFunction;
+	}
+
+	uint32 bucket = ColumnarBucketOfValue(hashFunction, PG_GET_COLLATION(),
+										  PG_ARGISNULL(0) ? (Datum) 0 :
+										  PG_GETARG_DATUM(0),
+										  PG_ARGISNULL(0), (uint32) bucketCount);
+
+	PG_RETURN_INT32((int32) bucket);
+}
+
+
+/*
+ * ColumnarAllowedBuckets returns true if the given clauses restrict the rows
+ * of a table with bucket_by to some of its buckets, and sets allowedBuckets
+ * to those. Equality with constants and IN lists on the bucket_by column
+ * restrict the buckets, and so do the bucket_of quals of plans that run
+ * bucket by bucket.
+ */
+bool
+ColumnarAllowedBuckets(Relation relation, List *clauseList, Bitmapset **allowedBuckets)
+{
+	ColumnarOptions options = { 0 };
+
+	*allowedBuckets = NULL;
+
+	if (clauseList == NIL || !ReadColumnarOptions(RelationGetRelid(relation), &options) ||
+		!AttributeNumberIsValid(options.bucketColumn))
+	{
+		return false;
+	}
+
+	Oid typeId = InvalidOid;
+	Oid collation = InvalidOid;
+	FmgrInfo *hashFunction = ColumnBucketHashFunction(relation, &options, &typeId,
+													  &collation);
+	if (hashFunction == NULL)
+	{
+		return false;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(typeId, TYPECACHE_EQ_OPR);
+	Oid bucketOfFunctionId = ColumnarBucketOfFunctionId();
+
+	bool restricted = false;
+	Node *clause = NULL;
+	foreach_ptr(clause, clauseList)
+	{
+		Bitmapset *clauseBuckets = NULL;
+		if (!ClauseAllowedBuckets(clause, options.bucketColumn, typeId, collation,
+								  typeEntry->eq_opr, bucketOfFunctionId, hashFunction,
+								  options.bucketCount, &clauseBuckets))
+		{
+			continue;
+		}
+
+		*allowedBuckets = restricted ? bms_int_members(*allowedBuckets, clauseBuckets) :
+						  clauseBuckets;
+		restricted = true;
+	}
+
+	return restricted;
+}
+
+
+/*
+ * ColumnBucketHashFunction returns the hash function of the bucket_by column
+ * of the given table, and its type and collation, or NULL if the column was
+ * dropped.
+ */
+static FmgrInfo *
+ColumnBucketHashFunction(Relation relation, ColumnarOptions *options, Oid *typeId,
+						 Oid *collation)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	if (options->bucketColumn > tupleDescriptor->natts)
+	{
+		return NULL;
+	}
+
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(tupleDescriptor, AttrNumberGetAttrOffset(options->bucketColumn));
+	if (attributeForm->attisdropped)
+	{
+		return NULL;
+	}
+
+	*typeId = attributeForm->atttypid;
+	*collation = attributeForm->attcollation;
+
+	return ColumnarBloomHashFunction(attributeForm->atttypid);
+}
+
+
+/*
+ * ClauseAllowedBuckets returns true if the given clause restricts the rows
+ * to some buckets, and sets allowedBuckets to those.
+ */
+static bool
+ClauseAllowedBuckets(Node *clause, AttrNumber bucketColumn, Oid typeId, Oid collation,
+					 Oid eqOperator, Oid bucketOfFunctionId, FmgrInfo *hashFunction,
+					 uint32 bucketCount, Bitmapset **allowedBuckets)
+{
+	if (IsA(clause, OpExpr) && list_length(((OpExpr *) clause)->args) == 2)
+	{
+		OpExpr *opExpr = (OpExpr *) clause;
+		Node *left = linitial(opExpr->args);
+		Node *right = lsecond(opExpr->args);
+
+		if (IsA(left, Const))
+		{
+			Node *swap = left;
+			left = right;
+			right = swap;
+		}
+
+		if (!IsA(right, Const) || ((Const *) right)->constisnull)
+		{
+			return false;
+		}
+
+		Const *constant = (Const *) right;
+
+		/* column = value */
+		if (opExpr->opno == eqOperator && OidIsValid(eqOperator) &&
+			opExpr->inputcollid == collation && constant->consttype == typeId &&
+			IsBucketColumn(left, bucketColumn, typeId))
+		{
+			uint32 bucket = ColumnarBucketOfValue(hashFunction, collation,
+												  constant->constvalue, false,
+												  bucketCount);
+			*allowedBuckets = bms_make_singleton(bucket);
+			return true;
+		}
+
+		/* columnar.bucket_of(column, bucket count) = bucket */
+		if (opExpr->opno == Int4EqualOperator && IsA(left, FuncExpr) &&
+			OidIsValid(bucketOfFunctionId) &&
+			((FuncExpr *) left)->funcid == bucketOfFunctionId &&
+			((FuncExpr *) left)->inputcollid == collation)
+		{
+			FuncExpr *bucketOf = (FuncExpr *) left;
+			Node *countArgument = lsecond(bucketOf->args);
+
+			if (!IsBucketColumn(linitial(bucketOf->args), bucketColumn, typeId) ||
+				!IsA(countArgument, Const) || ((Const *) countArgument)->constisnull ||
+				DatumGetInt32(((Const *) countArgument)->constvalue) != (int32) bucketCount)
+			{
+				return false;
+			}
+
+			int32 bucket = DatumGetInt32(constant->constvalue);
+			*allowedBuckets = NULL;
+			if (bucket >= 0 && bucket < (int32) bucketCount)
+			{
+				*allowedBuckets = bms_make_singleton(bucket);
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	/* column IN (value, ...) */
+	if (IsA(clause, ScalarArrayOpExpr))
+	{
+		ScalarArrayOpExpr *arrayOpExpr = (ScalarArrayOpExpr *) clause;
+		Node *arrayArgument = lsecond(arrayOpExpr->args);
+
+		if (!arrayOpExpr->useOr || arrayOpExpr->opno != eqOperator ||
+			!OidIsValid(eqOperator) || arrayOpExpr->inputcollid != collation ||
+			!IsBucketColumn(linitial(arrayOpExpr->args), bucketColumn, typeId) ||
+			!IsA(arrayArgument, Const) || ((Const *) arrayArgument)->constisnull ||
+			get_element_type(((Const *) arrayArgument)->consttype) != typeId)
+		{
+			return false;
+		}
+
+		ArrayType *array = DatumGetArrayTypeP(((Const *) arrayArgument)->constvalue);
+		int16 typeLength = 0;
+		bool typeByValue = false;
+		char typeAlign = 0;
+		get_typlenbyvalalign(typeId, &typeLength, &typeByValue, &typeAlign);
+
+		Datum *elements = NULL;
+		bool *elementNulls = NULL;
+		int elementCount = 0;
+		deconstruct_array(array, typeId, typeLength, typeByValue, typeAlign,
+						  &elements, &elementNulls, &elementCount);
+
+		*allowedBuckets = NULL;
+		for (int elementIndex = 0; elementIndex < elementCount; elementIndex++)
+		{
+			if (elementNulls[elementIndex])
+			{
+				continue;
+			}
+
+			uint32 bucket = ColumnarBucketOfValue(hashFunction, collation,
+												  elements[elementIndex], false,
+												  bucketCount);
+			*allowedBuckets = bms_add_member(*allowedBuckets, bucket);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * IsBucketColumn returns whether the given expression is the bucket_by
+ * column of the scanned table.
+ */
+static bool
+IsBucketColumn(Node *node, AttrNumber bucketColumn, Oid typeId)
+{
+	return IsA(node, Var) && ((Var *) node)->varlevelsup == 0 &&
+		   ((Var *) node)->varattno == bucketColumn &&
+		   ((Var *) node)->vartype == typeId;
+}
+
+
+/*
+ * ColumnarBucketOfFunctionId returns the oid of columnar.bucket_of(), or
+ * InvalidOid if the installed version of the extension doesn't have it.
+ */
+static Oid
+ColumnarBucketOfFunctionId(void)
+{
+	Oid argumentTypes[2] = { ANYELEMENTOID, INT4OID };
+
+	return LookupFuncName(list_make2(makeString("columnar"), makeString("bucket_of")),
+						  2, argumentTypes, true);
+}
+
+
+/*
+ * ColumnarSplitPlanByBucket replaces the hashed aggregates and hash joins of
+ * the given plan that only combine rows of the same bucket_by bucket by an
+ * Append of one copy of them per bucket.
+ */
+void
+ColumnarSplitPlanByBucket(PlannedStmt *stmt)
+{
+	BucketSplitContext context = { 0 };
+	context.stmt = stmt;
+	context.bucketOfFunctionId = ColumnarBucketOfFunctionId();
+
+	if (!OidIsValid(context.bucketOfFunctionId))
+	{
+		return;
+	}
+
+	stmt->planTree = SplitPlanTreeByBucket(stmt->planTree, &context);
+
+	ListCell *subplanCell = NULL;
+	foreach(subplanCell, stmt->subplans)
+	{
+		lfirst(subplanCell) = SplitPlanTreeByBucket(lfirst(subplanCell), &context);
+	}
+}
+
+
+/*
+ * SplitPlanTreeByBucket splits the topmost aggregates and hash joins of the
+ * given plan tree that run bucket by bucket. Plans below a Gather aren't
+ * split, their workers share the scans.
+ */
+static Plan *
+SplitPlanTreeByBucket(Plan *plan, BucketSplitContext *context)
+{
+	if (plan == NULL)
+	{
+		return NULL;
+	}
+
+	check_stack_depth();
+
+	if (IsA(plan, Agg) || IsA(plan, HashJoin))
+	{
+		BucketPartitioning partitioning = { 0 };
+		if (PlanBucketPartitioning(plan, context, &partitioning))
+		{
+			return MakeBucketAppend(plan, partitioning.bucketCount, context);
+		}
+	}
+
+	ListCell *planCell = NULL;
+	switch (nodeTag(plan))
+	{
+		case T_Gather:
+		case T_GatherMerge:
+		{
+			return plan;
+		}
+
+		case T_Append:
+		{
+			foreach(planCell, ((Append *) plan)->appendplans)
+			{
+				lfirst(planCell) = SplitPlanTreeByBucket(lfirst(planCell), context);
+			}
+			break;
+		}
+
+		case T_MergeAppend:
+		{
+			foreach(planCell, ((MergeAppend *) plan)->mergeplans)
+			{
+				lfirst(planCell) = SplitPlanTreeByBucket(lfirst(planCell), context);
+			}
+			break;
+		}
+
+		case T_SubqueryScan:
+		{
+			SubqueryScan *subqueryScan = (SubqueryScan *) plan;
+			subqueryScan->subplan = SplitPlanTreeByBucket(subqueryScan->subplan,
+														  context);
+			break;
+		}
+
+		case T_CustomScan:
+		{
+			foreach(planCell, ((CustomScan *) plan)->custom_plans)
+			{
+				lfirst(planCell) = SplitPlanTreeByBucket(lfirst(planCell), context);
+			}
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+
+	plan->lefttree = SplitPlanTreeByBucket(plan->lefttree, context);
+	plan->righttree = SplitPlanTreeByBucket(plan->righttree, context);
+
+	return plan;
+}
+
+
+/*
+ * PlanBucketPartitioning returns true if every row the given plan returns
+ * only depends on rows of one bucket of the columnar tables it scans, and
+ * sets partitioning to the buckets of its output.
+ */
+static bool
+PlanBucketPartitioning(Plan *plan, BucketSplitContext *context,
+					   BucketPartitioning *partitioning)
+{
+	if (plan->initPlan != NIL || contain_subplans((Node *) plan->targetlist) ||
+		contain_subplans((Node *) plan->qual))
+	{
+		return false;
+	}
+
+	switch (nodeTag(plan))
+	{
+		case T_CustomScan:
+		{
+			return ColumnarScanBucketPartitioning((CustomScan *) plan, context,
+												  partitioning);
+		}
+
+		case T_Hash:
+		case T_Material:
+		{
+			BucketPartitioning childPartitioning = { 0 };
+			if (!PlanBucketPartitioning(plan->lefttree, context, &childPartitioning))
+			{
+				return false;
+			}
+
+			*partitioning = childPartitioning;
+			partitioning->keyColumns = TargetListKeyColumns(plan->targetlist, OUTER_VAR,
+															childPartitioning.keyColumns);
+			return true;
+		}
+
+		case T_HashJoin:
+		{
+			return HashJoinBucketPartitioning((HashJoin *) plan, context, partitioning);
+		}
+
+		case T_Agg:
+		{
+			return AggBucketPartitioning((Agg *) plan, context, partitioning);
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * ColumnarScanBucketPartitioning returns true if the given plan is a columnar
+ * scan of a table with bucket_by, whose copies can each scan one bucket.
+ */
+static bool
+ColumnarScanBucketPartitioning(CustomScan *customScan, BucketSplitContext *context,
+							   BucketPartitioning *partitioning)
+{
+	/* sorted reads, row bounds and top-N filters assume they see every row */
+	if (!IsColumnarScan((Plan *) customScan) || customScan->scan.plan.parallel_aware ||
+		customScan->custom_scan_tlist != NIL || customScan->custom_private != NIL ||
+		contain_subplans((Node *) customScan->custom_exprs))
+	{
+		return false;
+	}
+
+	RangeTblEntry *rte = rt_fetch(customScan->scan.scanrelid, context->stmt->rtable);
+	ColumnarOptions options = { 0 };
+	if (rte->rtekind != RTE_RELATION || !ReadColumnarOptions(rte->relid, &options) ||
+		!AttributeNumberIsValid(options.bucketColumn))
+	{
+		return false;
+	}
+
+	/*
+	 * Each copy reads the stripes without a bucket, so only split scans of
+	 * tables that have few of those rows.
+	 */
+	Relation relation = table_open(rte->relid, NoLock);
+	StripeListSummary summary = StripeListSummaryForRelation(relation);
+	Oid typeId = InvalidOid;
+	Oid collation = InvalidOid;
+	FmgrInfo *hashFunction = ColumnBucketHashFunction(relation, &options, &typeId,
+													  &collation);
+	table_close(relation, NoLock);
+
+	if (hashFunction == NULL ||
+		(summary.rowCount - summary.bucketedRowCount) * options.bucketCount >
+		summary.rowCount)
+	{
+		return false;
+	}
+
+	partitioning->bucketCount = options.bucketCount;
+	partitioning->typeId = typeId;
+	partitioning->collation = collation;
+	partitioning->eqOperator = lookup_type_cache(typeId, TYPECACHE_EQ_OPR)->eq_opr;
+	partitioning->keyColumns =
+		TargetListKeyColumns(customScan->scan.plan.targetlist,
+							 customScan->scan.scanrelid,
+							 bms_make_singleton(options.bucketColumn));
+
+	return OidIsValid(partitioning->eqOperator);
+}
+
+
+/*
+ * HashJoinBucketPartitioning returns true if the given hash join joins rows
+ * of the same bucket of both sides on their bucket_by columns, so that each
+ * bucket can be joined on its own.
+ */
+static bool
+HashJoinBucketPartitioning(HashJoin *hashJoin, BucketSplitContext *context,
+						   BucketPartitioning *partitioning)
+{
+	JoinType joinType = hashJoin->join.jointype;
+	if (joinType != JOIN_INNER && joinType != JOIN_LEFT && joinType != JOIN_RIGHT &&
+		joinType != JOIN_FULL && joinType != JOIN_SEMI && joinType != JOIN_ANTI)
+	{
+		return false;
+	}
+
+	if (contain_subplans((Node *) hashJoin->join.joinqual) ||
+		contain_subplans((Node *) hashJoin->hashclauses))
+	{
+		return false;
+	}
+
+	BucketPartitioning outer = { 0 };
+	BucketPartitioning inner = { 0 };
+	if (!PlanBucketPartitioning(outerPlan(hashJoin), context, &outer) ||
+		!PlanBucketPartitioning(innerPlan(hashJoin), context, &inner) ||
+		outer.bucketCount != inner.bucketCount || outer.typeId != inner.typeId ||
+		outer.collation != inner.collation)
+	{
+		return false;
+	}
+
+	bool joinsOnKeys = false;
+	Node *hashClause = NULL;
+	foreach_ptr(hashClause, hashJoin->hashclauses)
+	{
+		if (!IsA(hashClause, OpExpr) || ((OpExpr *) hashClause)->opno != outer.eqOperator ||
+			((OpExpr *) hashClause)->inputcollid != outer.collation ||
+			list_length(((OpExpr *) hashClause)->args) != 2)
+		{
+			continue;
+		}
+
+		Var *left = linitial(((OpExpr *) hashClause)->args);
+		Var *right = lsecond(((OpExpr *) hashClause)->args);
+		if (!IsA(left, Var) || !IsA(right, Var))
+		{
+			continue;
+		}
+
+		if (left->varno == INNER_VAR)
+		{
+			Var *swap = left;
+			left = right;
+			right = swap;
+		}
+
+		if (left->varno == OUTER_VAR && right->varno == INNER_VAR &&
+			bms_is_member(left->varattno, outer.keyColumns) &&
+			bms_is_member(right->varattno, inner.keyColumns))
+		{
+			joinsOnKeys = true;
+			break;
+		}
+	}
+
+	if (!joinsOnKeys)
+	{
+		return false;
+	}
+
+	/* rows that are NULL extended don't keep the key of their side */
+	*partitioning = outer;
+	partitioning->keyColumns = NULL;
+	if (joinType == JOIN_INNER || joinType == JOIN_LEFT || joinType == JOIN_SEMI ||
+		joinType == JOIN_ANTI)
+	{
+		partitioning->keyColumns =
+			TargetListKeyColumns(hashJoin->join.plan.targetlist, OUTER_VAR,
+								 outer.keyColumns);
+	}
+
+	if (joinType == JOIN_INNER || joinType == JOIN_RIGHT)
+	{
+		partitioning->keyColumns =
+			bms_join(partitioning->keyColumns,
+					 TargetListKeyColumns(hashJoin->join.plan.targetlist, INNER_VAR,
+										  inner.keyColumns));
+	}
+
+	return true;
+}
+
+
+/*
+ * AggBucketPartitioning returns true if the given aggregate hashes rows of
+ * one bucket into each of its groups, because it groups by the bucket_by
+ * column.
+ */
+static bool
+AggBucketPartitioning(Agg *agg, BucketSplitContext *context,
+					  BucketPartitioning *partitioning)
+{
+	if (agg->aggstrategy != AGG_HASHED || agg->aggsplit != AGGSPLIT_SIMPLE ||
+		agg->groupingSets != NIL || agg->numCols == 0)
+	{
+		return false;
+	}
+
+	BucketPartitioning childPartitioning = { 0 };
+	if (!PlanBucketPartitioning(outerPlan(agg), context, &childPartitioning))
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < agg->numCols; columnIndex++)
+	{
+		if (bms_is_member(agg->grpColIdx[columnIndex], childPartitioning.keyColumns) &&
+			agg->grpOperators[columnIndex] == childPartitioning.eqOperator &&
+			agg->grpCollations[columnIndex] == childPartitioning.collation)
+		{
+			*partitioning = childPartitioning;
+			partitioning->keyColumns = TargetListKeyColumns(agg->plan.targetlist,
+															OUTER_VAR,
+															childPartitioning.keyColumns);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * TargetListKeyColumns returns the resnos of the entries of the given target
+ * list that are the given key columns of the child with the given varno.
+ */
+static Bitmapset *
+TargetListKeyColumns(List *targetList, Index varno, Bitmapset *childKeyColumns)
+{
+	Bitmapset *keyColumns = NULL;
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, targetList)
+	{
+		Var *var = (Var *) targetEntry->expr;
+		if (IsA(var, Var) && var->varno == varno &&
+			bms_is_member(var->varattno, childKeyColumns))
+		{
+			keyColumns = bms_add_member(keyColumns, targetEntry->resno);
+		}
+	}
+
+	return keyColumns;
+}
+
+
+/*
+ * IsColumnarScan returns whether the given plan is a columnar custom scan.
+ */
+static bool
+IsColumnarScan(Plan *plan)
+{
+	return IsA(plan, CustomScan) &&
+		   ((CustomScan *) plan)->methods == columnar_customscan_methods();
+}
+
+
+/*
+ * MakeBucketAppend returns an Append of one copy of the given plan per
+ * bucket, each scanning the rows of its bucket. The copies keep the
+ * plan_node_id of the original, those only need to be unique below a
+ * Gather, and plans below one aren't split.
+ */
+static Plan *
+MakeBucketAppend(Plan *plan, uint32 bucketCount, BucketSplitContext *context)
+{
+	Append *append = makeNode(Append);
+
+	for (uint32 bucket = 0; bucket < bucketCount; bucket++)
+	{
+		Plan *bucketPlan = copyObject(plan);
+		AddBucketQuals(bucketPlan, bucket, bucketCount, context);
+
+		bucketPlan->plan_rows = clamp_row_est(plan->plan_rows / bucketCount);
+		bucketPlan->startup_cost = plan->startup_cost / bucketCount;
+		bucketPlan->total_cost = plan->total_cost / bucketCount;
+		if (IsA(bucketPlan, Agg))
+		{
+			((Agg *) bucketPlan)->numGroups =
+				Max(((Agg *) bucketPlan)->numGroups / (long) bucketCount, 1);
+		}
+
+		append->appendplans = lappend(append->appendplans, bucketPlan);
+	}
+
+	append->first_partial_plan = bucketCount;
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, plan->targetlist)
+	{
+		TargetEntry *appendEntry =
+			makeTargetEntry((Expr *) makeVarFromTargetEntry(OUTER_VAR, targetEntry),
+							targetEntry->resno, targetEntry->resname,
+							targetEntry->resjunk);
+		appendEntry->ressortgroupref = targetEntry->ressortgroupref;
+
+		append->plan.targetlist = lappend(append->plan.targetlist, appendEntry);
+	}
+
+	append->plan.startup_cost = plan->startup_cost;
+	append->plan.total_cost = plan->total_cost;
+	append->plan.plan_rows = plan->plan_rows;
+	append->plan.plan_width = plan->plan_width;
+	append->plan.parallel_safe = plan->parallel_safe;
+	append->plan.plan_node_id = plan->plan_node_id;
+	append->plan.extParam = bms_copy(plan->extParam);
+	append->plan.allParam = bms_copy(plan->allParam);
+
+	return (Plan *) append;
+}
+
+
+/*
+ * AddBucketQuals makes the columnar scans of the given plan only return the
+ * rows of the given bucket, with a columnar.bucket_of qual, which the reader
+ * also uses to skip the stripes of other buckets.
+ */
+static void
+AddBucketQuals(Plan *plan, uint32 bucket, uint32 bucketCount,
+			   BucketSplitContext *context)
+{
+	if (plan == NULL)
+	{
+		return;
+	}
+
+	if (!IsColumnarScan(plan))
+	{
+		AddBucketQuals(plan->lefttree, bucket, bucketCount, context);
+		AddBucketQuals(plan->righttree, bucket, bucketCount, context);
+		return;
+	}
+
+	CustomScan *customScan = (CustomScan *) plan;
+	RangeTblEntry *rte = rt_fetch(customScan->scan.scanrelid, context->stmt->rtable);
+	ColumnarOptions options = { 0 };
+	if (!ReadColumnarOptions(rte->relid, &options))
+	{
+		elog(ERROR, "could not read options of columnar table %u", rte->relid);
+	}
+
+	Oid typeId = InvalidOid;
+	int32 typeMod = -1;
+	Oid collation = InvalidOid;
+	get_atttypetypmodcoll(rte->relid, options.bucketColumn, &typeId, &typeMod,
+						  &collation);
+
+	Var *bucketColumn = makeVar(customScan->scan.scanrelid, options.bucketColumn,
+								typeId, typeMod, collation, 0);
+	Const *countConst = makeConst(INT4OID, -1, InvalidOid, sizeof(int32),
+								  Int32GetDatum((int32) bucketCount), false, true);
+	FuncExpr *bucketOf = makeFuncExpr(context->bucketOfFunctionId, INT4OID,
+									  list_make2(bucketColumn, countConst),
+									  InvalidOid, collation, COERCE_EXPLICIT_CALL);
+	Const *bucketConst = makeConst(INT4OID, -1, InvalidOid, sizeof(int32),
+								   Int32GetDatum((int32) bucket), false, true);
+	OpExpr *bucketQual = (OpExpr *) make_opclause(Int4EqualOperator, BOOLOID, false,
+												  (Expr *) bucketOf,
+												  (Expr *) bucketConst,
+												  InvalidOid, InvalidOid);
+	set_opfuncid(bucketQual);
+
+	customScan->scan.plan.qual = lappend(customScan->scan.plan.qual, bucketQual);
+
+	/* pushed down clauses, plain and all, see ColumnarScanPath_PlanCustomPath */
+	linitial(customScan->custom_exprs) = lappend(linitial(customScan->custom_exprs),
+												 copyObject(bucketQual));
+	lsecond(customScan->custom_exprs) = lappend(lsecond(customScan->custom_exprs),
+												copyObject(bucketQual));
+}
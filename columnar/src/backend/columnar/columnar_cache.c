@@ -14,10 +14,12 @@
 
 #include "c.h"
 #include "columnar/columnar.h"
+#include "common/hashfn.h"
 #include "fmgr.h"
 #include "funcapi.h"
 #include "lib/ilist.h"
 #include "lib/stringinfo.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
 
@@ -38,26 +40,37 @@ static MemoryContext columnarCacheContext = NULL;
  *
  * An entry for caching a column.
  */
+typedef struct ColumnarCacheKey
+{
+	uint64 relId;
+	uint64 stripeId;
+	uint64 chunkId;
+	uint32 columnId;
+} ColumnarCacheKey;
+
 typedef struct ColumnarCacheEntry ColumnarCacheEntry;
 
 struct ColumnarCacheEntry
 {
+	ColumnarCacheKey key;
 	dlist_node list_node;
-	uint64 relId;
-	uint64 stripeId;
-	uint64 chunkId;
 	uint64 readCount;
 	uint64 length;
 	time_t creationTime;
 	time_t lastAccessTime;
 	void *store;
-	uint32 columnId;
+
+	/* set on every hit, cleared when the clock hand passes the entry */
+	bool referenced;
 };
 
 /*
- * Storage for the ColumnarCacheEntry linked list.
+ * Hash table of all ColumnarCacheEntry, and the ring of the same entries
+ * that the clock hand sweeps over when evicting.
  */
-static dlist_head *head = NULL;
+static HTAB *CacheEntries = NULL;
+static dlist_head CacheRing = DLIST_STATIC_INIT(CacheRing);
+static dlist_node *clockHand = NULL;
 
 /*
  * Storage for total length allocated.
@@ -72,7 +85,8 @@ static uint64 totalAllocationLength = 0;
 static ColumnarCacheStatistics statistics = { 0 };
 
 /*
- * Housekeeping of current chunk in use - so they are not evicted.
+ * Housekeeping of current chunk in use - so they are not evicted. There is
+ * at most one chunk group in use per relation, so this is keyed by relId.
  */
 typedef struct ColumarCacheChunkGroupInUse
 {
@@ -81,7 +95,41 @@ typedef struct ColumarCacheChunkGroupInUse
 	uint64 chunkId;
 } ColumarCacheChunkGroupInUse;
 
-static List * ChunkGroupsInUse = NIL;
+static HTAB *ChunkGroupsInUse = NULL;
+
+/*
+ * Bytes cached per relation, used to enforce the cache_quota option.
+ */
+typedef struct ColumnarCacheRelationUsage
+{
+	uint64 relId;
+	uint64 size;
+} ColumnarCacheRelationUsage;
+
+static HTAB *RelationUsage = NULL;
+
+/*
+ * Admission doorkeeper.
+ *
+ * With columnar.column_cache_admission = 'second_access' a chunk is only
+ * cached the second time it is missed. Missed chunks are remembered in a
+ * small bloom filter which, unlike the cache itself, survives
+ * ColumnarResetCache. It is cleared after DOORKEEPER_BITS / 8 misses, so
+ * old misses age out and the false positive rate stays low.
+ */
+#define DOORKEEPER_BITS (64 * 1024)
+
+static uint64 doorkeeper[DOORKEEPER_BITS / 64];
+static uint32 doorkeeperMisses = 0;
+
+static void InitCacheTables(void);
+static void InitCacheKey(ColumnarCacheKey *key, uint64 relId, uint64 stripeId,
+						 uint64 chunkId, uint32 columnId);
+static void AdvanceClockHand(void);
+static bool ChunkGroupIsInUse(ColumnarCacheKey *key);
+static void RemoveCacheEntry(ColumnarCacheEntry *entry);
+static void AdjustRelationUsage(uint64 relId, int64 delta);
+static bool DoorkeeperTestAndSet(ColumnarCacheKey *key);
 
 /*
  * ColumnarCacheMemoryContext
@@ -101,12 +149,48 @@ ColumnarCacheMemoryContext(void)
 								  0, (uint64) (columnar_page_cache_size * 1024 * 1024 * .1), 
 								  columnar_page_cache_size * 1024 * 1024);
 		memset(&statistics, 0, sizeof(ColumnarCacheStatistics));
-		head = NULL;
+		InitCacheTables();
 	}
 
 	return columnarCacheContext;
 }
 
+/*
+ * InitCacheTables
+ *
+ * Creates the hash tables of the cache in the cache MemoryContext, so
+ * they go away together with the entries when the cache is reset.
+ */
+static void
+InitCacheTables(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ColumnarCacheKey);
+	info.entrysize = sizeof(ColumnarCacheEntry);
+	info.hcxt = columnarCacheContext;
+	CacheEntries = hash_create("columnar cache entries", 1024, &info,
+							   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(ColumarCacheChunkGroupInUse);
+	info.hcxt = columnarCacheContext;
+	ChunkGroupsInUse = hash_create("columnar cache chunk groups in use", 16, &info,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(ColumnarCacheRelationUsage);
+	info.hcxt = columnarCacheContext;
+	RelationUsage = hash_create("columnar cache relation usage", 16, &info,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	dlist_init(&CacheRing);
+	clockHand = NULL;
+}
+
 /*
 * ColumnarResetCache
 *
@@ -120,43 +204,127 @@ ColumnarResetCache(void)
 	{
 		MemoryContextDelete(columnarCacheContext);
 		columnarCacheContext = NULL;
-		ChunkGroupsInUse = NIL;
+		CacheEntries = NULL;
+		ChunkGroupsInUse = NULL;
+		RelationUsage = NULL;
 	}
 
 	totalAllocationLength = 0U;
-	head = NULL;
+	dlist_init(&CacheRing);
+	clockHand = NULL;
+}
+
+/*
+ * InitCacheKey
+ *
+ * Fills in a hash key, zeroing the padding so that the key can be hashed
+ * as a blob.
+ */
+static void
+InitCacheKey(ColumnarCacheKey *key, uint64 relId, uint64 stripeId,
+			 uint64 chunkId, uint32 columnId)
+{
+	memset(key, 0, sizeof(ColumnarCacheKey));
+	key->relId = relId;
+	key->stripeId = stripeId;
+	key->chunkId = chunkId;
+	key->columnId = columnId;
 }
 
 /*
  * ColumnarFindInCache
  *
- * Searches the cache for an entry for a relation ID and a chunk ID.
- * If found, it increments the readCount, and returns the entry.	If
- * none are found, NULL is returned instead.
+ * Searches the cache for an entry for a relation ID and a chunk ID, and
+ * returns the entry.  If none are found, NULL is returned instead.
  */
 static ColumnarCacheEntry *
 ColumnarFindInCache(uint64 relId, uint64 stripeId, uint64 chunkId, uint32 columnId)
 {
-	if (head == NULL)
+	if (CacheEntries == NULL)
 	{
 		return NULL;
 	}
 
-	dlist_iter iter;
-	dlist_foreach(iter, head)
+	ColumnarCacheKey key;
+	InitCacheKey(&key, relId, stripeId, chunkId, columnId);
+
+	return hash_search(CacheEntries, &key, HASH_FIND, NULL);
+}
+
+/*
+ * AdvanceClockHand
+ *
+ * Moves the clock hand to the next entry of the ring, wrapping around at
+ * the end.
+ */
+static void
+AdvanceClockHand(void)
+{
+	if (clockHand == NULL)
+	{
+		return;
+	}
+
+	if (dlist_has_next(&CacheRing, clockHand))
 	{
-		ColumnarCacheEntry *entry = dlist_container(ColumnarCacheEntry, list_node, iter.cur);
+		clockHand = dlist_next_node(&CacheRing, clockHand);
+	}
+	else
+	{
+		clockHand = dlist_head_node(&CacheRing);
+	}
+}
 
-		if (entry->relId == relId && entry->stripeId == stripeId &&
-			entry->chunkId == chunkId && entry->columnId == columnId)
-		{
-			entry->readCount++;
+/*
+ * ChunkGroupIsInUse
+ *
+ * Returns true if the chunk group of the given entry is currently being
+ * read, in which case the entry must not be evicted.
+ */
+static bool
+ChunkGroupIsInUse(ColumnarCacheKey *key)
+{
+	ColumarCacheChunkGroupInUse *chunkGroupInUse =
+		hash_search(ChunkGroupsInUse, &key->relId, HASH_FIND, NULL);
+
+	return chunkGroupInUse != NULL &&
+		   chunkGroupInUse->stripeId == key->stripeId &&
+		   chunkGroupInUse->chunkId == key->chunkId;
+}
+
+/*
+ * RemoveCacheEntry
+ *
+ * Removes an entry from the cache and frees the data stored in it.
+ */
+static void
+RemoveCacheEntry(ColumnarCacheEntry *entry)
+{
+	if (clockHand == &entry->list_node)
+	{
+		AdvanceClockHand();
 
-			return entry;
+		/* this was the only entry */
+		if (clockHand == &entry->list_node)
+		{
+			clockHand = NULL;
 		}
 	}
 
-	return NULL;
+	dlist_delete(&entry->list_node);
+
+	totalAllocationLength -= entry->length;
+	AdjustRelationUsage(entry->key.relId, -((int64) entry->length));
+
+	StringInfo str = entry->store;
+	if (str->data)
+	{
+		pfree(str->data);
+	}
+
+	pfree(str);
+
+	hash_search(CacheEntries, &entry->key, HASH_REMOVE, NULL);
 }
 
 /*
@@ -166,135 +334,76 @@ ColumnarFindInCache(uint64 relId, uint64 stripeId, uint64 chunkId, uint32 column
  * If found, removes the cache entry, and frees memory associated with
  * it. If not found, nothing is done.
  *
- * Returns boolean.
+ * Returns whether an entry was removed.
  */
 static bool
 ColumnarInvalidateCacheEntry(uint64 relId, uint64 stripeId, uint64 chunkId, uint32 columnId)
 {
-	dlist_mutable_iter miter;
+	ColumnarCacheEntry *entry = ColumnarFindInCache(relId, stripeId, chunkId, columnId);
 
-	dlist_foreach_modify(miter, head)
+	if (entry == NULL)
 	{
-		ColumnarCacheEntry *entry = dlist_container(ColumnarCacheEntry, list_node, miter.cur);
-
-		if (entry->relId == relId && entry->stripeId == stripeId &&
-			entry->chunkId == chunkId && entry->columnId == columnId)
-		{
-			dlist_delete(miter.cur);
-
-			totalAllocationLength -= entry->length;
-			statistics.evictions++;
-
-			return true;
-		}
+		return false;
 	}
 
+	RemoveCacheEntry(entry);
+	statistics.evictions++;
+
 	return true;
 }
 
+/*
+ * EvictCache
+ *
+ * Evicts at least size bytes using the CLOCK algorithm: the hand sweeps
+ * over the ring, giving entries that were read since it last passed them
+ * a second chance, and evicting the first one that wasn't.  Entries of
+ * chunk groups in use are skipped.
+ */
 static void
 EvictCache(uint64 size)
 {
-	uint64 lastCount = 0;
-	uint64 nextLowestCount = PG_UINT64_MAX;
+	/* every entry needs at most two visits, to clear its bit and to evict it */
+	uint64 maxSteps = 2 * hash_get_num_entries(CacheEntries);
 
-	while (size > 0)
+	for (uint64 step = 0; step < maxSteps && size > 0 && clockHand != NULL; step++)
 	{
-		dlist_mutable_iter miter;
+		ColumnarCacheEntry *entry = dlist_container(ColumnarCacheEntry, list_node,
+													clockHand);
 
-		dlist_foreach_modify(miter, head)
+		if (entry->referenced)
 		{
-			ColumnarCacheEntry *entry = dlist_container(ColumnarCacheEntry, list_node, miter.cur);
-
-			if (entry->readCount != lastCount && entry->readCount < nextLowestCount)
-			{
-				nextLowestCount = entry->readCount;
-			}
-
-			if (entry->readCount == lastCount)
-			{
-				bool skipCacheEntry = false;
-				ListCell *lc;
-				foreach(lc, ChunkGroupsInUse)
-				{
-					ColumarCacheChunkGroupInUse *chunkGroupInUse =
-						(ColumarCacheChunkGroupInUse *) lfirst(lc);
-
-					if (chunkGroupInUse->relId == entry->relId &&
-						chunkGroupInUse->stripeId == entry->stripeId &&
-						chunkGroupInUse->chunkId == entry->chunkId)
-					{
-						skipCacheEntry = true;
-						break;
-					}
-				}
-
-				if (skipCacheEntry)
-					continue;
-
-				dlist_delete(miter.cur);
-
-				totalAllocationLength -= entry->length;
-				statistics.evictions++;
-
-				StringInfo str = entry->store;
-				if (str->data) {
-					pfree(str->data);
-				}
-
-				pfree(str);
-
-				if (size < entry->length)
-				{
-					pfree(entry);
-					return;
-				}
-				else {
-					size -= entry->length;
-					pfree(entry);
-				}
-			}
+			entry->referenced = false;
+			AdvanceClockHand();
+			continue;
 		}
 
-		lastCount = nextLowestCount;
-		nextLowestCount = PG_UINT64_MAX;
+		if (ChunkGroupIsInUse(&entry->key))
+		{
+			AdvanceClockHand();
+			continue;
+		}
+
+		size = size > entry->length ? size - entry->length : 0;
+
+		ColumnarStatCount((Oid) entry->key.relId, COLUMNAR_STAT_CACHE_EVICTIONS, 1);
+		RemoveCacheEntry(entry);
+		statistics.evictions++;
 	}
 }
 
 void
 ColumnarMarkChunkGroupInUse(uint64 relId, uint64 stripeId, uint32 chunkId)
 {
-	bool found = false;
-	ListCell *lc;
-
-	MemoryContext ctx = MemoryContextSwitchTo(ColumnarCacheMemoryContext());
-
-	foreach(lc, ChunkGroupsInUse)
-	{
-		ColumarCacheChunkGroupInUse *chunkGroupInUse =
-			(ColumarCacheChunkGroupInUse *) lfirst(lc);
-
-		if (chunkGroupInUse->relId == relId)
-		{
-			chunkGroupInUse->stripeId = stripeId;
-			chunkGroupInUse->chunkId = chunkId;
-			found = true;
-		}
-	}
+	/* make sure the cache and its tables exist */
+	ColumnarCacheMemoryContext();
 
-	if (!found)
-	{
-		ColumarCacheChunkGroupInUse *newChunkGroupInUse =
-			palloc0(sizeof(ColumarCacheChunkGroupInUse));
-
-		newChunkGroupInUse->relId = relId;
-		newChunkGroupInUse->stripeId = stripeId;
-		newChunkGroupInUse->chunkId = chunkId;
-
-		ChunkGroupsInUse = lappend(ChunkGroupsInUse, newChunkGroupInUse);
-	}
+	bool found = false;
+	ColumarCacheChunkGroupInUse *chunkGroupInUse =
+		hash_search(ChunkGroupsInUse, &relId, HASH_ENTER, &found);
 
-	MemoryContextSwitchTo(ctx);
+	chunkGroupInUse->stripeId = stripeId;
+	chunkGroupInUse->chunkId = chunkId;
 }
 
 /*
@@ -313,18 +422,14 @@ ColumnarAddCacheEntry(uint64 relId, uint64 stripeId, uint64 chunkId,
 
 	MemoryContext oldContext = MemoryContextSwitchTo(ColumnarCacheMemoryContext());
 
-	if (head == NULL)
-	{
-		head = palloc0(sizeof(dlist_head));
-	}
+	ColumnarCacheKey key;
+	InitCacheKey(&key, relId, stripeId, chunkId, columnId);
 
-	ColumnarCacheEntry *entry = ColumnarFindInCache(relId, stripeId, chunkId, columnId);
 	bool found = false;
+	ColumnarCacheEntry *entry = hash_search(CacheEntries, &key, HASH_ENTER, &found);
 
-	if (entry != NULL)
+	if (found)
 	{
-		found = true;
-
 		/* Free up any existing stored data, everything else will be overwritten. */
 		StringInfo str = entry->store;
 		if (str->data)
@@ -335,22 +440,26 @@ ColumnarAddCacheEntry(uint64 relId, uint64 stripeId, uint64 chunkId,
 		pfree(str);
 
 		totalAllocationLength -= entry->length;
+		AdjustRelationUsage(relId, -((int64) entry->length));
 	}
 	else
 	{
-		entry = palloc0(sizeof(ColumnarCacheEntry));
-
-		entry->relId = relId;
-		entry->stripeId = stripeId;
-		entry->chunkId = chunkId;
-		entry->columnId = columnId;
 		entry->creationTime = entry->lastAccessTime = time(NULL);
 		entry->readCount = 0;
+		entry->referenced = false;
 
-		/* Add the entry into the list if it is not already there. */
-		if (!found)
+		/*
+		 * New entries go right behind the clock hand, so they survive a
+		 * full sweep before they can be evicted.
+		 */
+		if (clockHand == NULL)
 		{
-			dlist_push_tail(head, &(entry->list_node));
+			dlist_push_tail(&CacheRing, &entry->list_node);
+			clockHand = &entry->list_node;
+		}
+		else
+		{
+			dlist_insert_before(clockHand, &entry->list_node);
 		}
 	}
 
@@ -360,6 +469,7 @@ ColumnarAddCacheEntry(uint64 relId, uint64 stripeId, uint64 chunkId,
 	entry->length = size;
 
 	totalAllocationLength += size;
+	AdjustRelationUsage(relId, size);
 
 	if (totalAllocationLength >= statistics.maximumCacheSize)
 	{
@@ -378,6 +488,97 @@ ColumnarAddCacheEntry(uint64 relId, uint64 stripeId, uint64 chunkId,
 	MemoryContextSwitchTo(oldContext);
 }
 
+/*
+ * AdjustRelationUsage
+ *
+ * Adds delta to the number of bytes cached for a relation.
+ */
+static void
+AdjustRelationUsage(uint64 relId, int64 delta)
+{
+	bool found = false;
+	ColumnarCacheRelationUsage *usage =
+		hash_search(RelationUsage, &relId, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		usage->size = 0;
+	}
+
+	usage->size += delta;
+}
+
+/*
+ * DoorkeeperTestAndSet
+ *
+ * Returns whether the key was missed before, and remembers it otherwise.
+ */
+static bool
+DoorkeeperTestAndSet(ColumnarCacheKey *key)
+{
+	uint64 hash = hash_bytes_extended((const unsigned char *) key,
+									  sizeof(ColumnarCacheKey), 0);
+	uint32 firstBit = (uint32) hash % DOORKEEPER_BITS;
+	uint32 secondBit = (uint32) (hash >> 32) % DOORKEEPER_BITS;
+
+	uint64 firstMask = UINT64CONST(1) << (firstBit % 64);
+	uint64 secondMask = UINT64CONST(1) << (secondBit % 64);
+
+	if ((doorkeeper[firstBit / 64] & firstMask) &&
+		(doorkeeper[secondBit / 64] & secondMask))
+	{
+		return true;
+	}
+
+	if (++doorkeeperMisses > DOORKEEPER_BITS / 8)
+	{
+		memset(doorkeeper, 0, sizeof(doorkeeper));
+		doorkeeperMisses = 1;
+	}
+
+	doorkeeper[firstBit / 64] |= firstMask;
+	doorkeeper[secondBit / 64] |= secondMask;
+
+	return false;
+}
+
+/*
+ * ColumnarCacheAdmit
+ *
+ * Decides if a chunk that was missed should be added to the cache, based on
+ * columnar.column_cache_admission and the cache_quota of the relation in
+ * megabytes, where 0 means no quota. Called before the chunk is
+ * decompressed, so rejected chunks are never allocated in the cache.
+ */
+bool
+ColumnarCacheAdmit(uint64 relId, uint64 stripeId, uint64 chunkId,
+				   uint32 columnId, uint64 size, int quota)
+{
+	if (columnar_column_cache_admission == COLUMN_CACHE_ADMIT_SECOND_ACCESS)
+	{
+		ColumnarCacheKey key;
+		InitCacheKey(&key, relId, stripeId, chunkId, columnId);
+
+		if (!DoorkeeperTestAndSet(&key))
+		{
+			return false;
+		}
+	}
+
+	if (quota > 0 && RelationUsage != NULL)
+	{
+		ColumnarCacheRelationUsage *usage =
+			hash_search(RelationUsage, &relId, HASH_FIND, NULL);
+
+		if (usage != NULL && usage->size + size > (uint64) quota * 1024 * 1024)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /*
  * ColumnarRetrieveCache
  *
@@ -403,40 +604,36 @@ ColumnarRetrieveCache(uint64 relId, uint64 stripeId, uint64 chunkId, uint32 colu
 
 	statistics.hits++;
 
+	entry->readCount++;
+	entry->lastAccessTime = time(NULL);
+	entry->referenced = true;
+
 	void *chunkCopy = entry->store;
 
 	return chunkCopy;
 }
 
-/*
- * ColumnarCacheLength
- *
- * Returns how large our cache is, used for accounting.
- */
-static uint64
-ColumnarCacheLength()
+ColumnarCacheStatistics *
+ColumnarGetCacheStatistics(void)
 {
-	uint64 count = 0;
-
-	if (head == NULL)
+	if (ColumnarSharedCacheEnabled())
 	{
-		return 0;
-	}
+		ColumnarSharedCacheStatistics(&statistics);
+		ColumnarSkipListCacheStatistics(&statistics.skipListHits,
+										&statistics.skipListMisses,
+										&statistics.skipListEntries,
+										&statistics.skipListSize);
 
-	dlist_iter iter;
-	dlist_foreach(iter, head)
-	{
-		count++;
+		return &statistics;
 	}
 
-	return count;
-}
-
-ColumnarCacheStatistics *
-ColumnarGetCacheStatistics(void)
-{
 	statistics.endingCacheSize = totalAllocationLength;
-	statistics.entries = ColumnarCacheLength();
+	statistics.entries = CacheEntries ? hash_get_num_entries(CacheEntries) : 0;
+
+	ColumnarSkipListCacheStatistics(&statistics.skipListHits,
+									&statistics.skipListMisses,
+									&statistics.skipListEntries,
+									&statistics.skipListSize);
 
 	return &statistics;
 }
@@ -0,0 +1,581 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_compaction.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Background workers that combine undersized stripes of columnar tables,
+ * so tables loaded with many small inserts don't need manual calls to
+ * columnar.vacuum.
+ *
+ * A launcher started at server start wakes up every
+ * columnar.auto_compaction_naptime seconds and, when
+ * columnar.enable_auto_compaction is set, starts a worker for one database
+ * at a time. The worker looks for columnar tables that have at least
+ * columnar.auto_compaction_min_stripes undersized stripes, or a stripe
+ * whose fraction of deleted rows is above
+ * columnar.vacuum_deleted_rows_threshold, and rewrites up to
+ * columnar.auto_compaction_stripe_count of them per table, using the
+ * same code as columnar.vacuum. Tables that are locked by someone else are
+ * skipped and looked at again in the next round, so writers never wait for
+ * compaction.
+ *
+ * Tables without indexes whose delta store has grown to
+ * columnar.auto_compaction_delta_rows rows get their delta store flushed
+ * into stripes first.
+ *
+ * When columnar.enable_autovacuum_compaction is set, VACUUM run by
+ * autovacuum does the same for the table it is vacuuming, so tables with
+ * many deletes or small inserts are compacted even without the workers.
+ * columnar.enable_vacuum_compaction does the same for VACUUM run by users.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/htup_details.h"
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_database.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "commands/extension.h"
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/utils/listutils.h"
+
+/* seconds before the postmaster restarts a launcher that exited */
+#define COMPACTION_LAUNCHER_RESTART_TIME 10
+
+PGDLLEXPORT void ColumnarCompactionLauncherMain(Datum main_arg);
+PGDLLEXPORT void ColumnarCompactionWorkerMain(Datum main_arg);
+
+static List * CompactionDatabaseList(void);
+static void RunCompactionWorker(Oid databaseId);
+static void CompactRelation(Oid relationId);
+static bool CompactionNeeded(Relation rel, int elevel);
+static void RewriteCompactionCandidates(Oid relationId);
+static void CountCompactionCandidates(Relation rel, uint32 *undersizedStripeCount,
+									  uint32 *deletedStripeCount);
+
+PG_FUNCTION_INFO_V1(columnar_compact_relation);
+
+
+/*
+ * ColumnarCompactionInit registers the compaction launcher. Expected to be
+ * called from _PG_init, and only does something when columnar is loaded via
+ * shared_preload_libraries.
+ */
+void
+ColumnarCompactionInit(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+	{
+		return;
+	}
+
+	BackgroundWorker worker;
+	memset(&worker, 0, sizeof(worker));
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = COMPACTION_LAUNCHER_RESTART_TIME;
+	strlcpy(worker.bgw_library_name, "columnar", BGW_MAXLEN);
+	strlcpy(worker.bgw_function_name, "ColumnarCompactionLauncherMain", BGW_MAXLEN);
+	strlcpy(worker.bgw_name, "columnar compaction launcher", BGW_MAXLEN);
+	strlcpy(worker.bgw_type, "columnar compaction launcher", BGW_MAXLEN);
+
+	RegisterBackgroundWorker(&worker);
+}
+
+
+/*
+ * ColumnarCompactionLauncherMain is the entry point of the launcher. It
+ * isn't connected to any database and only reads pg_database to decide
+ * for which databases to start workers.
+ */
+void
+ColumnarCompactionLauncherMain(Datum main_arg)
+{
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(NULL, NULL, 0);
+
+	MemoryContext launcherContext = AllocSetContextCreate(TopMemoryContext,
+														  "Columnar Compaction Launcher",
+														  ALLOCSET_DEFAULT_SIZES);
+
+	for (;;)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		if (columnar_enable_auto_compaction)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(launcherContext);
+
+			List *databaseList = CompactionDatabaseList();
+
+			Oid databaseId = InvalidOid;
+			foreach_oid(databaseId, databaseList)
+			{
+				RunCompactionWorker(databaseId);
+
+				CHECK_FOR_INTERRUPTS();
+			}
+
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextReset(launcherContext);
+		}
+
+		(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 columnar_auto_compaction_naptime * 1000L,
+						 PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+	}
+}
+
+
+/*
+ * CompactionDatabaseList returns the oids of all databases that accept
+ * connections, allocated in CurrentMemoryContext.
+ */
+static List *
+CompactionDatabaseList(void)
+{
+	List *databaseList = NIL;
+	MemoryContext resultContext = CurrentMemoryContext;
+
+	StartTransactionCommand();
+	(void) GetTransactionSnapshot();
+
+	Relation databaseRelation = table_open(DatabaseRelationId, AccessShareLock);
+	TableScanDesc scan = table_beginscan_catalog(databaseRelation, 0, NULL);
+
+	HeapTuple tuple = NULL;
+	while (HeapTupleIsValid(tuple = heap_getnext(scan, ForwardScanDirection)))
+	{
+		Form_pg_database database = (Form_pg_database) GETSTRUCT(tuple);
+
+		if (!database->datallowconn || database->datistemplate)
+		{
+			continue;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(resultContext);
+		databaseList = lappend_oid(databaseList, database->oid);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	table_endscan(scan);
+	table_close(databaseRelation, AccessShareLock);
+
+	CommitTransactionCommand();
+
+	return databaseList;
+}
+
+
+/*
+ * RunCompactionWorker starts a compaction worker for the given database and
+ * waits for it to finish.
+ */
+static void
+RunCompactionWorker(Oid databaseId)
+{
+	BackgroundWorker worker;
+	memset(&worker, 0, sizeof(worker));
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main_arg = ObjectIdGetDatum(databaseId);
+	worker.bgw_notify_pid = MyProcPid;
+	strlcpy(worker.bgw_library_name, "columnar", BGW_MAXLEN);
+	strlcpy(worker.bgw_function_name, "ColumnarCompactionWorkerMain", BGW_MAXLEN);
+	snprintf(worker.bgw_name, BGW_MAXLEN, "columnar compaction worker for database %u",
+			 databaseId);
+	strlcpy(worker.bgw_type, "columnar compaction worker", BGW_MAXLEN);
+
+	BackgroundWorkerHandle *handle = NULL;
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		ereport(LOG, (errmsg("could not start columnar compaction worker"),
+					  errhint("You might need to increase max_worker_processes.")));
+		return;
+	}
+
+	pid_t pid = 0;
+	if (WaitForBackgroundWorkerStartup(handle, &pid) != BGWH_STARTED)
+	{
+		return;
+	}
+
+	(void) WaitForBackgroundWorkerShutdown(handle);
+}
+
+
+/*
+ * ColumnarCompactionWorkerMain is the entry point of a compaction worker,
+ * which does one round of compaction in the database passed as argument.
+ */
+void
+ColumnarCompactionWorkerMain(Datum main_arg)
+{
+	Oid databaseId = DatumGetObjectId(main_arg);
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnectionByOid(databaseId, InvalidOid, 0);
+
+	MemoryContext relationContext = AllocSetContextCreate(TopMemoryContext,
+														  "Columnar Compaction",
+														  ALLOCSET_DEFAULT_SIZES);
+
+	List *relationList = CompactionRelationList();
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationList)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(relationContext);
+
+		/* an error in one table shouldn't keep the other tables from compaction */
+		PG_TRY();
+		{
+			CompactRelation(relationId);
+		}
+		PG_CATCH();
+		{
+			HOLD_INTERRUPTS();
+			MemoryContextSwitchTo(relationContext);
+			EmitErrorReport();
+			AbortOutOfAnyTransaction();
+			FlushErrorState();
+			RESUME_INTERRUPTS();
+		}
+		PG_END_TRY();
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(relationContext);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	proc_exit(0);
+}
+
+
+/*
+ * CompactionRelationList returns the oids of all columnar tables in the
+ * current database, or NIL if columnar isn't installed in it.
+ */
+List *
+CompactionRelationList(void)
+{
+	List *relationList = NIL;
+	MemoryContext resultContext = CurrentMemoryContext;
+
+	StartTransactionCommand();
+	(void) GetTransactionSnapshot();
+
+	Oid columnarAmId = get_am_oid("columnar", true);
+	if (!OidIsValid(get_extension_oid("columnar", true)) || !OidIsValid(columnarAmId))
+	{
+		CommitTransactionCommand();
+		return NIL;
+	}
+
+	Relation classRelation = table_open(RelationRelationId, AccessShareLock);
+	TableScanDesc scan = table_beginscan_catalog(classRelation, 0, NULL);
+
+	HeapTuple tuple = NULL;
+	while (HeapTupleIsValid(tuple = heap_getnext(scan, ForwardScanDirection)))
+	{
+		Form_pg_class classForm = (Form_pg_class) GETSTRUCT(tuple);
+
+		if (classForm->relkind != RELKIND_RELATION || classForm->relam != columnarAmId)
+		{
+			continue;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(resultContext);
+		relationList = lappend_oid(relationList, classForm->oid);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	table_endscan(scan);
+	table_close(classRelation, AccessShareLock);
+
+	CommitTransactionCommand();
+
+	return relationList;
+}
+
+
+/*
+ * CompactRelation rewrites the undersized and the heavily deleted stripes of
+ * the given table in its own transaction, if it has enough of them and
+ * nobody else holds a conflicting lock on it.
+ */
+static void
+CompactRelation(Oid relationId)
+{
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/* _vacuum_internal takes the same lock, but would wait for it */
+	LOCKMODE lockMode = columnar_online_vacuum ? ShareUpdateExclusiveLock : ExclusiveLock;
+	if (!ConditionalLockRelationOid(relationId, lockMode))
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return;
+	}
+
+	/* the table might have been dropped since we listed it */
+	Relation rel = try_relation_open(relationId, NoLock);
+	if (rel == NULL)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return;
+	}
+
+	bool compactionNeeded = CompactionNeeded(rel, DEBUG1);
+	relation_close(rel, NoLock);
+
+	if (!compactionNeeded)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return;
+	}
+
+	pgstat_report_activity(STATE_RUNNING, "SELECT columnar._vacuum_internal($1, $2)");
+
+	RewriteCompactionCandidates(relationId);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+
+/*
+ * ColumnarVacuumCompact is called by VACUUM run from autovacuum, or by users
+ * with columnar.enable_vacuum_compaction set. The deletes and inserts we
+ * count in pgstat are what make autovacuum pick the table, so this does the
+ * compaction worker's job for it: put the delta store into stripes and
+ * rewrite the undersized and heavily deleted stripes, not only the ones at
+ * the end of the table VACUUM combines. Like the workers, it gives up if
+ * someone holds a conflicting lock.
+ *
+ * The caller must have cleared the PROC_IN_VACUUM flag, as this writes to
+ * the metadata tables.
+ */
+void
+ColumnarVacuumCompact(Relation rel, int elevel)
+{
+	LOCKMODE lockMode = columnar_online_vacuum ? ShareUpdateExclusiveLock : ExclusiveLock;
+	if (!ConditionalLockRelation(rel, lockMode))
+	{
+		ereport(elevel, (errmsg("skipping compaction of \"%s\" --- lock not available",
+								RelationGetRelationName(rel))));
+		return;
+	}
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (CompactionNeeded(rel, elevel))
+	{
+		RewriteCompactionCandidates(RelationGetRelid(rel));
+	}
+
+	PopActiveSnapshot();
+
+	UnlockRelation(rel, lockMode);
+}
+
+
+/*
+ * columnar_compact_relation does what a compaction worker does for the given
+ * table, waiting for its lock instead of skipping it, and returns whether
+ * it rewrote any stripes. The regression tests use it, since they can't
+ * wait for the workers.
+ */
+Datum
+columnar_compact_relation(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	LOCKMODE lockMode = columnar_online_vacuum ? ShareUpdateExclusiveLock : ExclusiveLock;
+	Relation rel = table_open(relationId, lockMode);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	bool compactionNeeded = CompactionNeeded(rel, DEBUG1);
+	table_close(rel, NoLock);
+
+	if (compactionNeeded)
+	{
+		RewriteCompactionCandidates(relationId);
+	}
+
+	PG_RETURN_BOOL(compactionNeeded);
+}
+
+
+/*
+ * CompactionNeeded flushes the delta store of the given table if it has grown
+ * to columnar.auto_compaction_delta_rows rows, and returns whether the table
+ * has enough stripes to rewrite. The caller holds the lock _vacuum_internal
+ * takes.
+ */
+static bool
+CompactionNeeded(Relation rel, int elevel)
+{
+	if (!rel->rd_rel->relhasindex)
+	{
+		uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+		uint64 deltaRowCount = DeltaStoreRowCount(storageId, GetActiveSnapshot());
+		if (deltaRowCount >= (uint64) columnar_auto_compaction_delta_rows)
+		{
+			ereport(elevel, (errmsg("flushing " UINT64_FORMAT " delta store rows "
+									"of \"%s\"", deltaRowCount,
+									RelationGetRelationName(rel))));
+			ColumnarFlushDeltaStore(rel);
+		}
+	}
+
+	uint32 undersizedStripeCount = 0;
+	uint32 deletedStripeCount = 0;
+	CountCompactionCandidates(rel, &undersizedStripeCount, &deletedStripeCount);
+
+	if (undersizedStripeCount < columnar_auto_compaction_min_stripes &&
+		deletedStripeCount == 0)
+	{
+		return false;
+	}
+
+	ereport(elevel, (errmsg("rewriting %u undersized and %u heavily deleted "
+							"stripes of \"%s\"", undersizedStripeCount,
+							deletedStripeCount, RelationGetRelationName(rel))));
+
+	return true;
+}
+
+
+/*
+ * RewriteCompactionCandidates runs columnar._vacuum_internal on the given
+ * table, rewriting up to columnar.auto_compaction_stripe_count stripes.
+ */
+static void
+RewriteCompactionCandidates(Oid relationId)
+{
+	const char *query = "SELECT columnar._vacuum_internal($1, $2)";
+
+	Oid argTypes[] = { REGCLASSOID, INT4OID };
+	Datum argValues[] = {
+		ObjectIdGetDatum(relationId),
+		Int32GetDatum(columnar_auto_compaction_stripe_count)
+	};
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	if (SPI_execute_with_args(query, 2, argTypes, argValues, NULL, false, 1) !=
+		SPI_OK_SELECT)
+	{
+		elog(ERROR, "could not combine stripes of relation %u", relationId);
+	}
+
+	SPI_finish();
+}
+
+
+/*
+ * CountCompactionCandidates counts the stripes of the given table that are
+ * filled less than half of the table's stripe_row_limit, and separately the
+ * ones that aren't but whose fraction of deleted rows is above
+ * columnar.vacuum_deleted_rows_threshold. These are the stripes
+ * columnar.vacuum rewrites. Like columnar.vacuum, we don't count the last
+ * stripe, which might still grow.
+ */
+static void
+CountCompactionCandidates(Relation rel, uint32 *undersizedStripeCount,
+						  uint32 *deletedStripeCount)
+{
+	*undersizedStripeCount = 0;
+	*deletedStripeCount = 0;
+
+	ColumnarOptions options = { 0 };
+	ReadColumnarOptions(RelationGetRelid(rel), &options);
+
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+	if (stripeList == NIL)
+	{
+		return;
+	}
+
+	stripeList = list_truncate(stripeList, list_length(stripeList) - 1);
+
+	StripeMetadata *stripe = NULL;
+	foreach_ptr(stripe, stripeList)
+	{
+		/* columnar.vacuum leaves offloaded stripes alone */
+		if (ColumnarLogicalOffsetIsOffloaded(stripe->fileOffset))
+		{
+			continue;
+		}
+
+		if (stripe->rowCount < options.stripeRowCount / 2)
+		{
+			(*undersizedStripeCount)++;
+			continue;
+		}
+
+		uint32 deletedRows = DeletedRowsForStripe(rel->rd_node, stripe->chunkCount,
+												  stripe->id);
+		if ((double) deletedRows / (double) stripe->rowCount >
+			columnar_vacuum_deleted_rows_threshold)
+		{
+			(*deletedStripeCount)++;
+		}
+	}
+}
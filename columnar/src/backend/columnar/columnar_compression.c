@@ -13,18 +13,29 @@
  */
 #include "postgres.h"
 
+#include <pthread.h>
+#include <signal.h>
+
 #include "citus_version.h"
 #include "common/pg_lzcompress.h"
 #include "lib/stringinfo.h"
+#include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
 
+#include "columnar/columnar.h"
 #include "columnar/columnar_compression.h"
+#include "columnar/columnar_trace.h"
 
 #if HAVE_CITUS_LIBLZ4
 #include <lz4.h>
+#include <lz4hc.h>
 #endif
 
 #if HAVE_LIBZSTD
 #include <zstd.h>
+#include <zdict.h>
 #endif
 
 /*
@@ -48,6 +59,166 @@ typedef struct ColumnarCompressHeader
 									  len) (((ColumnarCompressHeader *) (ptr))->rawsize = \
 												(len))
 
+/* size and number of the slices of a chunk auto compression tries codecs on */
+#define AUTO_COMPRESSION_SAMPLE_SIZE 4096
+#define AUTO_COMPRESSION_SAMPLE_COUNT 4
+
+/*
+ * Compression types auto compression picks from. pglz decompresses much
+ * slower than the others, so it is only used if neither is compiled.
+ */
+static const CompressionType AutoCompressionCandidates[] = {
+#if HAVE_CITUS_LIBLZ4
+	COMPRESSION_LZ4,
+#endif
+#if HAVE_LIBZSTD
+	COMPRESSION_ZSTD,
+#endif
+#if !HAVE_CITUS_LIBLZ4 && !HAVE_LIBZSTD
+	COMPRESSION_PG_LZ,
+#endif
+};
+
+/*
+ * Estimated cost of decompressing a byte, relative to the cost of reading a
+ * byte of compressed data.
+ */
+static const double CompressionDecodeCost[COMPRESSION_COUNT] = {
+	[COMPRESSION_NONE] = 0.0,
+	[COMPRESSION_PG_LZ] = 0.5,
+	[COMPRESSION_LZ4] = 0.05,
+	[COMPRESSION_ZSTD] = 0.15,
+	[COMPRESSION_AUTO] = 0.0,
+	[COMPRESSION_LZ4HC] = 0.05
+};
+
+/* decompressions done by this backend, by the compression type of the chunk */
+static DecompressionStatistics DecompressionStatisticsArray[COMPRESSION_COUNT];
+
+/* jobs of a CompressBuffersConcurrently call, claimed by its threads in turn */
+typedef struct ConcurrentCompressionState
+{
+	CompressionJob *jobs;
+	uint32 jobCount;
+	pg_atomic_uint32 nextJobIndex;
+} ConcurrentCompressionState;
+
+/* argument of a compression thread, thread 0 is the backend itself */
+typedef struct ConcurrentCompressionThread
+{
+	ConcurrentCompressionState *state;
+	int threadIndex;
+} ConcurrentCompressionThread;
+
+/* jobs of a DecompressBuffersConcurrently call, claimed by its threads in turn */
+typedef struct ConcurrentDecompressionState
+{
+	DecompressionJob *jobs;
+	uint32 jobCount;
+	pg_atomic_uint32 nextJobIndex;
+} ConcurrentDecompressionState;
+
+/* argument of a decompression thread, thread 0 is the backend itself */
+typedef struct ConcurrentDecompressionThread
+{
+	ConcurrentDecompressionState *state;
+	int threadIndex;
+} ConcurrentDecompressionThread;
+
+/*
+ * A helper thread that runs the jobs of a StartDecompressionJobs call, at
+ * most one call at a time. It is joined when the memory context it was
+ * created in is reset, so errors can't leave it writing to freed buffers.
+ */
+struct DecompressionThread
+{
+	pthread_t thread;
+	bool running;
+	DecompressionJob *jobs;
+	uint32 jobCount;
+#if HAVE_LIBZSTD
+	ZSTD_DCtx *decompressContext;
+#endif
+	MemoryContextCallback resetCallback;
+};
+
+/*
+ * A helper thread that runs the jobs of a StartCompressionJobs call, at most
+ * one call at a time, joined like a DecompressionThread.
+ */
+struct CompressionThread
+{
+	pthread_t thread;
+	bool running;
+	CompressionJob *jobs;
+	uint32 jobCount;
+#if HAVE_LIBZSTD
+	ZSTD_CCtx *compressContext;
+#endif
+	MemoryContextCallback resetCallback;
+};
+
+static void * ConcurrentCompressionThreadMain(void *arg);
+static void * CompressionThreadMain(void *arg);
+static void RunCompressionJob(CompressionJob *job, void *zstdCompressContext);
+static void JoinCompressionThread(CompressionThread *thread);
+static void CompressionThreadResetCallback(void *arg);
+static int CompressionBound(CompressionType compressionType, int inputSize);
+static void * DecompressionThreadMain(void *arg);
+static void * ConcurrentDecompressionThreadMain(void *arg);
+static void RunDecompressionJob(DecompressionJob *job, void *zstdDecompressContext);
+static void JoinDecompressionThread(DecompressionThread *thread);
+static void DecompressionThreadResetCallback(void *arg);
+
+#if HAVE_LIBZSTD
+
+/* dictionaries kept prepared by a backend, the cache is emptied when full */
+#define COMPRESSION_DICTIONARY_CACHE_SIZE 64
+
+typedef struct CompressionDictionaryEntry
+{
+	uint64 dictionaryId;
+
+	/* created on first use, compressDictionary for compressionLevel */
+	ZSTD_CDict *compressDictionary;
+	int compressionLevel;
+	ZSTD_DDict *decompressDictionary;
+
+	/* raw dictionary, allocated in CompressionDictionaryContext */
+	bytea *dictionary;
+} CompressionDictionaryEntry;
+
+static MemoryContext CompressionDictionaryContext = NULL;
+static HTAB *CompressionDictionaryCache = NULL;
+
+/*
+ * zstd contexts kept by a backend for all zstd compression and decompression,
+ * so their internal buffers are allocated once instead of once per chunk.
+ */
+static ZSTD_CCtx *ZstdCompressContext = NULL;
+static ZSTD_DCtx *ZstdDecompressContext = NULL;
+
+/* zstd contexts of the threads of CompressBuffersConcurrently, by thread */
+static ZSTD_CCtx *ZstdThreadCompressContexts[COMPRESSION_WORKERS_MAX];
+
+/* zstd contexts of the threads of DecompressBuffersConcurrently, by thread */
+static ZSTD_DCtx *ZstdThreadDecompressContexts[COMPRESSION_WORKERS_MAX];
+
+static ZSTD_CCtx * GetZstdCompressContext(void);
+static bool SetZstdCompressionWorkers(ZSTD_CCtx *compressContext, int compressionLevel);
+static ZSTD_DCtx * GetZstdDecompressContext(void);
+static void ZstdDecompressInto(StringInfo buffer, uint64 decompressedSize,
+							   ZSTD_DDict *decompressDictionary,
+							   StringInfo outputBuffer);
+static CompressionDictionaryEntry * LookupCompressionDictionary(uint64 dictionaryId);
+static ZSTD_DDict * PreparedDecompressDictionary(uint64 dictionaryId);
+static void ResetCompressionDictionaryCache(void);
+#endif
+
+static bool BelowMinimumGain(int rawSize, int compressedSize, int minimumGain);
+static void DecompressCodecInto(StringInfo buffer, CompressionType compressionType,
+								uint64 decompressedSize, StringInfo outputBuffer);
+
 
 /*
  * CompressBuffer compresses the given buffer with the given compression type
@@ -88,6 +259,31 @@ CompressBuffer(StringInfo inputBuffer,
 			outputBuffer->len = compressedSize;
 			return true;
 		}
+
+		case COMPRESSION_LZ4HC:
+		{
+			int maximumLength = LZ4_compressBound(inputBuffer->len);
+			int lz4CompressionLevel = Max(LZ4HC_CLEVEL_MIN,
+										  Min(compressionLevel, LZ4HC_CLEVEL_MAX));
+
+			resetStringInfo(outputBuffer);
+			enlargeStringInfo(outputBuffer, maximumLength);
+
+			int compressedSize = LZ4_compress_HC(inputBuffer->data,
+												 outputBuffer->data,
+												 inputBuffer->len, maximumLength,
+												 lz4CompressionLevel);
+			if (compressedSize <= 0)
+			{
+				elog(DEBUG1,
+					 "failure in LZ4_compress_HC, input size=%d, output size=%d",
+					 inputBuffer->len, maximumLength);
+				return false;
+			}
+
+			outputBuffer->len = compressedSize;
+			return true;
+		}
 #endif
 
 #if HAVE_LIBZSTD
@@ -98,11 +294,40 @@ CompressBuffer(StringInfo inputBuffer,
 			resetStringInfo(outputBuffer);
 			enlargeStringInfo(outputBuffer, maximumLength);
 
-			size_t compressedSize = ZSTD_compress(outputBuffer->data,
-												  outputBuffer->maxlen,
-												  inputBuffer->data,
-												  inputBuffer->len,
-												  compressionLevel);
+			ZSTD_CCtx *compressContext = GetZstdCompressContext();
+			size_t compressedSize = 0;
+
+			/*
+			 * zstd's own threads only run library code, never backend code.
+			 * Signals are blocked while zstd may start them, so the threads
+			 * inherit the mask and signals are only delivered to the backend.
+			 */
+			if (columnar_compression_workers > 0 &&
+				SetZstdCompressionWorkers(compressContext, compressionLevel))
+			{
+				sigset_t blockedSignals;
+				sigset_t savedSignals;
+
+				sigfillset(&blockedSignals);
+				pthread_sigmask(SIG_SETMASK, &blockedSignals, &savedSignals);
+
+				compressedSize = ZSTD_compress2(compressContext,
+												outputBuffer->data,
+												outputBuffer->maxlen,
+												inputBuffer->data,
+												inputBuffer->len);
+
+				pthread_sigmask(SIG_SETMASK, &savedSignals, NULL);
+			}
+			else
+			{
+				compressedSize = ZSTD_compressCCtx(compressContext,
+												   outputBuffer->data,
+												   outputBuffer->maxlen,
+												   inputBuffer->data,
+												   inputBuffer->len,
+												   compressionLevel);
+			}
 
 			if (ZSTD_isError(compressedSize))
 			{
@@ -155,93 +380,1320 @@ CompressBuffer(StringInfo inputBuffer,
 
 
 /*
- * DecompressBuffer decompresses the given buffer with the given compression
- * type. This function returns the buffer as-is when no compression is applied.
+ * ConcurrentCompressionSupported returns whether CompressBuffersConcurrently
+ * can compress buffers with the given compression type. pglz keeps its
+ * history in static variables, so only lz4 and zstd can run in threads.
  */
-StringInfo
-DecompressBuffer(StringInfo buffer,
-				 CompressionType compressionType,
-				 uint64 decompressedSize)
+bool
+ConcurrentCompressionSupported(CompressionType compressionType)
 {
 	switch (compressionType)
 	{
-		case COMPRESSION_NONE:
+#if HAVE_CITUS_LIBLZ4
+		case COMPRESSION_LZ4:
+		case COMPRESSION_LZ4HC:
 		{
-			return buffer;
+			return true;
 		}
+#endif
 
-#if HAVE_CITUS_LIBLZ4
-		case COMPRESSION_LZ4:
+#if HAVE_LIBZSTD
+		case COMPRESSION_ZSTD:
 		{
-			StringInfo decompressedBuffer = makeStringInfo();
-			enlargeStringInfo(decompressedBuffer, decompressedSize);
+			return true;
+		}
+#endif
 
-			int lz4DecompressSize = LZ4_decompress_safe(buffer->data,
-														decompressedBuffer->data,
-														buffer->len,
-														decompressedSize);
+		default:
+		{
+			return false;
+		}
+	}
+}
 
-			if (lz4DecompressSize != decompressedSize)
+
+/*
+ * CompressBuffersConcurrently compresses the input buffers of the given jobs
+ * using up to threadCount threads, counting the backend itself, and sets the
+ * compressed field of each job whose outputBuffer got its compressed data.
+ * The compression types of all jobs must pass ConcurrentCompressionSupported.
+ *
+ * All memory is allocated here before the threads start, since the threads
+ * only call library code and never palloc or ereport. Signals are blocked
+ * while the threads are created, so they inherit the mask and signals are
+ * only delivered to the backend.
+ */
+void
+CompressBuffersConcurrently(CompressionJob *jobs, uint32 jobCount, int threadCount)
+{
+	threadCount = Max(1, Min(threadCount, Min(jobCount, COMPRESSION_WORKERS_MAX)));
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		CompressionJob *job = &jobs[jobIndex];
+
+		Assert(ConcurrentCompressionSupported(job->compressionType));
+
+		resetStringInfo(job->outputBuffer);
+		enlargeStringInfo(job->outputBuffer,
+						  CompressionBound(job->compressionType, job->inputBuffer->len));
+		job->compressed = false;
+	}
+
+#if HAVE_LIBZSTD
+	for (int threadIndex = 0; threadIndex < threadCount; threadIndex++)
+	{
+		if (ZstdThreadCompressContexts[threadIndex] == NULL)
+		{
+			ZstdThreadCompressContexts[threadIndex] = ZSTD_createCCtx();
+			if (ZstdThreadCompressContexts[threadIndex] == NULL)
 			{
-				ereport(ERROR, (errmsg("cannot decompress the buffer"),
-								errdetail("Expected %lu bytes, but received %d bytes",
-										  decompressedSize, lz4DecompressSize)));
+				ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+								errmsg("out of memory")));
 			}
+		}
+	}
+#endif
+
+	ConcurrentCompressionState state = { 0 };
+	state.jobs = jobs;
+	state.jobCount = jobCount;
+	pg_atomic_init_u32(&state.nextJobIndex, 0);
+
+	ConcurrentCompressionThread threadArgs[COMPRESSION_WORKERS_MAX];
+	pthread_t threads[COMPRESSION_WORKERS_MAX];
+	int startedThreadCount = 0;
+
+	sigset_t blockedSignals;
+	sigset_t savedSignals;
+	sigfillset(&blockedSignals);
+	pthread_sigmask(SIG_SETMASK, &blockedSignals, &savedSignals);
 
-			decompressedBuffer->len = decompressedSize;
+	for (int threadIndex = 1; threadIndex < threadCount; threadIndex++)
+	{
+		threadArgs[threadIndex].state = &state;
+		threadArgs[threadIndex].threadIndex = threadIndex;
+
+		/* jobs of threads that could not be started are left to the others */
+		if (pthread_create(&threads[startedThreadCount], NULL,
+						   ConcurrentCompressionThreadMain,
+						   &threadArgs[threadIndex]) != 0)
+		{
+			break;
+		}
+
+		startedThreadCount++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &savedSignals, NULL);
+
+	threadArgs[0].state = &state;
+	threadArgs[0].threadIndex = 0;
+	ConcurrentCompressionThreadMain(&threadArgs[0]);
+
+	for (int threadIndex = 0; threadIndex < startedThreadCount; threadIndex++)
+	{
+		pthread_join(threads[threadIndex], NULL);
+	}
+}
+
+
+/*
+ * ConcurrentCompressionThreadMain runs the jobs of a
+ * CompressBuffersConcurrently call until all of them are claimed.
+ */
+static void *
+ConcurrentCompressionThreadMain(void *arg)
+{
+	ConcurrentCompressionThread *thread = (ConcurrentCompressionThread *) arg;
+	ConcurrentCompressionState *state = thread->state;
 
-			return decompressedBuffer;
+	for (;;)
+	{
+		uint32 jobIndex = pg_atomic_fetch_add_u32(&state->nextJobIndex, 1);
+		if (jobIndex >= state->jobCount)
+		{
+			break;
 		}
+
+#if HAVE_LIBZSTD
+		RunCompressionJob(&state->jobs[jobIndex],
+						  ZstdThreadCompressContexts[thread->threadIndex]);
+#else
+		RunCompressionJob(&state->jobs[jobIndex], NULL);
 #endif
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CreateCompressionThread creates the state of a helper thread in the
+ * current memory context. The thread is started by StartCompressionJobs.
+ */
+CompressionThread *
+CreateCompressionThread(void)
+{
+	CompressionThread *thread = palloc0(sizeof(CompressionThread));
 
 #if HAVE_LIBZSTD
-		case COMPRESSION_ZSTD:
-		{
-			StringInfo decompressedBuffer = makeStringInfo();
-			enlargeStringInfo(decompressedBuffer, decompressedSize);
+	thread->compressContext = ZSTD_createCCtx();
+	if (thread->compressContext == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+						errmsg("out of memory")));
+	}
+#endif
+
+	thread->resetCallback.func = CompressionThreadResetCallback;
+	thread->resetCallback.arg = thread;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, &thread->resetCallback);
+
+	return thread;
+}
+
+
+/*
+ * StartCompressionJobs starts compressing the input buffers of the given jobs
+ * in the helper thread, and returns false if the thread could not be started.
+ * The compression types of all jobs must pass ConcurrentCompressionSupported.
+ * The output buffers are enlarged here, and neither the jobs nor their
+ * buffers may be used until FinishCompressionJobs returns.
+ */
+bool
+StartCompressionJobs(CompressionThread *thread, CompressionJob *jobs, uint32 jobCount)
+{
+	Assert(!thread->running);
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		CompressionJob *job = &jobs[jobIndex];
+
+		Assert(ConcurrentCompressionSupported(job->compressionType));
+
+		resetStringInfo(job->outputBuffer);
+		enlargeStringInfo(job->outputBuffer,
+						  CompressionBound(job->compressionType, job->inputBuffer->len));
+		job->compressed = false;
+	}
+
+	thread->jobs = jobs;
+	thread->jobCount = jobCount;
+
+	sigset_t blockedSignals;
+	sigset_t savedSignals;
+	sigfillset(&blockedSignals);
+	pthread_sigmask(SIG_SETMASK, &blockedSignals, &savedSignals);
+
+	thread->running = pthread_create(&thread->thread, NULL, CompressionThreadMain,
+									 thread) == 0;
+
+	pthread_sigmask(SIG_SETMASK, &savedSignals, NULL);
+
+	return thread->running;
+}
+
+
+/*
+ * FinishCompressionJobs waits for the jobs of the last StartCompressionJobs
+ * call. If the thread could not be started, the backend runs them itself.
+ */
+void
+FinishCompressionJobs(CompressionThread *thread)
+{
+	if (thread->running)
+	{
+		JoinCompressionThread(thread);
+		return;
+	}
+
+	CompressionThreadMain(thread);
+	thread->jobCount = 0;
+}
+
 
-			size_t zstdDecompressSize = ZSTD_decompress(decompressedBuffer->data,
-														decompressedSize,
-														buffer->data,
-														buffer->len);
-			if (ZSTD_isError(zstdDecompressSize))
+/*
+ * CompressionThreadMain runs the jobs of a StartCompressionJobs call.
+ */
+static void *
+CompressionThreadMain(void *arg)
+{
+	CompressionThread *thread = (CompressionThread *) arg;
+
+	for (uint32 jobIndex = 0; jobIndex < thread->jobCount; jobIndex++)
+	{
+#if HAVE_LIBZSTD
+		RunCompressionJob(&thread->jobs[jobIndex], thread->compressContext);
+#else
+		RunCompressionJob(&thread->jobs[jobIndex], NULL);
+#endif
+	}
+
+	return NULL;
+}
+
+
+/*
+ * JoinCompressionThread waits for the helper thread to exit.
+ */
+static void
+JoinCompressionThread(CompressionThread *thread)
+{
+	pthread_join(thread->thread, NULL);
+	thread->running = false;
+	thread->jobCount = 0;
+}
+
+
+/*
+ * CompressionThreadResetCallback joins the helper thread before the memory
+ * of its jobs is freed, and frees its zstd context.
+ */
+static void
+CompressionThreadResetCallback(void *arg)
+{
+	CompressionThread *thread = (CompressionThread *) arg;
+
+	if (thread->running)
+	{
+		JoinCompressionThread(thread);
+	}
+
+#if HAVE_LIBZSTD
+	ZSTD_freeCCtx(thread->compressContext);
+	thread->compressContext = NULL;
+#endif
+}
+
+
+/*
+ * RunCompressionJob compresses the input buffer of a job into its already
+ * enlarged output buffer. It is called from compression threads, so it must
+ * not palloc or ereport.
+ */
+static void
+RunCompressionJob(CompressionJob *job, void *zstdCompressContext)
+{
+	StringInfo inputBuffer = job->inputBuffer;
+	StringInfo outputBuffer = job->outputBuffer;
+
+	switch (job->compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case COMPRESSION_LZ4:
+		{
+			int compressedSize = LZ4_compress_default(inputBuffer->data,
+													  outputBuffer->data,
+													  inputBuffer->len,
+													  outputBuffer->maxlen - 1);
+			if (compressedSize > 0)
 			{
-				ereport(ERROR, (errmsg("zstd decompression failed"),
-								(errdetail("%s", ZSTD_getErrorName(
-											   zstdDecompressSize)))));
+				outputBuffer->len = compressedSize;
+				job->compressed = true;
 			}
+			break;
+		}
 
-			if (zstdDecompressSize != decompressedSize)
+		case COMPRESSION_LZ4HC:
+		{
+			int lz4CompressionLevel = Max(LZ4HC_CLEVEL_MIN,
+										  Min(job->compressionLevel, LZ4HC_CLEVEL_MAX));
+			int compressedSize = LZ4_compress_HC(inputBuffer->data,
+												 outputBuffer->data,
+												 inputBuffer->len,
+												 outputBuffer->maxlen - 1,
+												 lz4CompressionLevel);
+			if (compressedSize > 0)
 			{
-				ereport(ERROR, (errmsg("unexpected decompressed size"),
-								errdetail("Expected %ld, received %ld", decompressedSize,
-										  zstdDecompressSize)));
+				outputBuffer->len = compressedSize;
+				job->compressed = true;
 			}
-
-			decompressedBuffer->len = decompressedSize;
-
-			return decompressedBuffer;
+			break;
 		}
 #endif
 
-		case COMPRESSION_PG_LZ:
+#if HAVE_LIBZSTD
+		case COMPRESSION_ZSTD:
 		{
-			uint32 compressedDataSize = VARSIZE(buffer->data) - COLUMNAR_COMPRESS_HDRSZ;
-			uint32 decompressedDataSize = COLUMNAR_COMPRESS_RAWSIZE(buffer->data);
-
-			if (compressedDataSize + COLUMNAR_COMPRESS_HDRSZ != buffer->len)
+			size_t compressedSize =
+				ZSTD_compressCCtx((ZSTD_CCtx *) zstdCompressContext,
+								  outputBuffer->data, outputBuffer->maxlen - 1,
+								  inputBuffer->data, inputBuffer->len,
+								  job->compressionLevel);
+			if (!ZSTD_isError(compressedSize))
 			{
-				ereport(ERROR, (errmsg("cannot decompress the buffer"),
-								errdetail("Expected %u bytes, but received %u bytes",
-										  compressedDataSize, buffer->len)));
+				outputBuffer->len = compressedSize;
+				job->compressed = true;
 			}
+			break;
+		}
+#endif
 
-			char *decompressedData = palloc0(decompressedDataSize);
+		default:
+		{
+			break;
+		}
+	}
+}
 
-			int32 decompressedByteCount = pglz_decompress(COLUMNAR_COMPRESS_RAWDATA(
-															  buffer->data),
+
+/*
+ * CreateDecompressionThread creates the state of a helper thread in the
+ * current memory context. The thread is started by StartDecompressionJobs.
+ */
+DecompressionThread *
+CreateDecompressionThread(void)
+{
+	DecompressionThread *thread = palloc0(sizeof(DecompressionThread));
+
+#if HAVE_LIBZSTD
+	thread->decompressContext = ZSTD_createDCtx();
+	if (thread->decompressContext == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+						errmsg("out of memory")));
+	}
+#endif
+
+	thread->resetCallback.func = DecompressionThreadResetCallback;
+	thread->resetCallback.arg = thread;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, &thread->resetCallback);
+
+	return thread;
+}
+
+
+/*
+ * StartDecompressionJobs starts decompressing the input buffers of the given
+ * jobs in the helper thread, and returns false if the thread could not be
+ * started. The compression types of all jobs must pass
+ * ConcurrentCompressionSupported, and the jobs must not be dictionary
+ * compressed. The output buffers are enlarged here, and neither the jobs nor
+ * their buffers may be used until FinishDecompressionJobs returns.
+ */
+bool
+StartDecompressionJobs(DecompressionThread *thread, DecompressionJob *jobs,
+					   uint32 jobCount)
+{
+	Assert(!thread->running);
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		DecompressionJob *job = &jobs[jobIndex];
+
+		Assert(ConcurrentCompressionSupported(job->compressionType));
+
+		resetStringInfo(job->outputBuffer);
+		enlargeStringInfo(job->outputBuffer, job->decompressedSize);
+		job->decompressed = false;
+		job->elapsedMicroseconds = 0;
+	}
+
+	thread->jobs = jobs;
+	thread->jobCount = jobCount;
+
+	sigset_t blockedSignals;
+	sigset_t savedSignals;
+	sigfillset(&blockedSignals);
+	pthread_sigmask(SIG_SETMASK, &blockedSignals, &savedSignals);
+
+	thread->running = pthread_create(&thread->thread, NULL, DecompressionThreadMain,
+									 thread) == 0;
+
+	pthread_sigmask(SIG_SETMASK, &savedSignals, NULL);
+
+	return thread->running;
+}
+
+
+/*
+ * FinishDecompressionJobs waits for the jobs of the last StartDecompressionJobs
+ * call, and adds the ones that got decompressed to the decompression
+ * statistics of the backend.
+ */
+void
+FinishDecompressionJobs(DecompressionThread *thread)
+{
+	if (!thread->running)
+	{
+		return;
+	}
+
+	JoinDecompressionThread(thread);
+
+	for (uint32 jobIndex = 0; jobIndex < thread->jobCount; jobIndex++)
+	{
+		DecompressionJob *job = &thread->jobs[jobIndex];
+		if (!job->decompressed)
+		{
+			continue;
+		}
+
+		DecompressionStatistics *statistics =
+			&DecompressionStatisticsArray[job->compressionType];
+		statistics->chunkCount++;
+		statistics->compressedBytes += job->inputBuffer->len;
+		statistics->decompressedBytes += job->outputBuffer->len;
+		statistics->elapsedMicroseconds += job->elapsedMicroseconds;
+	}
+}
+
+
+/*
+ * DecompressionThreadMain runs the jobs of a StartDecompressionJobs call.
+ */
+static void *
+DecompressionThreadMain(void *arg)
+{
+	DecompressionThread *thread = (DecompressionThread *) arg;
+
+	for (uint32 jobIndex = 0; jobIndex < thread->jobCount; jobIndex++)
+	{
+#if HAVE_LIBZSTD
+		RunDecompressionJob(&thread->jobs[jobIndex], thread->decompressContext);
+#else
+		RunDecompressionJob(&thread->jobs[jobIndex], NULL);
+#endif
+	}
+
+	return NULL;
+}
+
+
+/*
+ * DecompressBuffersConcurrently decompresses the input buffers of the given
+ * jobs using up to threadCount threads, counting the backend itself, and
+ * adds the ones that got decompressed to the decompression statistics of
+ * the backend. Like for StartDecompressionJobs, the compression types of all
+ * jobs must pass ConcurrentCompressionSupported and the jobs must not be
+ * dictionary compressed, and jobs that fail are left for the backend.
+ *
+ * The output buffers are enlarged here before the threads start, since the
+ * threads only call library code. The backend waits for all of them, so no
+ * thread outlives the call.
+ */
+void
+DecompressBuffersConcurrently(DecompressionJob *jobs, uint32 jobCount, int threadCount)
+{
+	threadCount = Max(1, Min(threadCount, Min(jobCount, COMPRESSION_WORKERS_MAX)));
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		DecompressionJob *job = &jobs[jobIndex];
+
+		Assert(ConcurrentCompressionSupported(job->compressionType));
+
+		resetStringInfo(job->outputBuffer);
+		enlargeStringInfo(job->outputBuffer, job->decompressedSize);
+		job->decompressed = false;
+		job->elapsedMicroseconds = 0;
+	}
+
+#if HAVE_LIBZSTD
+	for (int threadIndex = 0; threadIndex < threadCount; threadIndex++)
+	{
+		if (ZstdThreadDecompressContexts[threadIndex] == NULL)
+		{
+			ZstdThreadDecompressContexts[threadIndex] = ZSTD_createDCtx();
+			if (ZstdThreadDecompressContexts[threadIndex] == NULL)
+			{
+				ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+								errmsg("out of memory")));
+			}
+		}
+	}
+#endif
+
+	ConcurrentDecompressionState state = { 0 };
+	state.jobs = jobs;
+	state.jobCount = jobCount;
+	pg_atomic_init_u32(&state.nextJobIndex, 0);
+
+	ConcurrentDecompressionThread threadArgs[COMPRESSION_WORKERS_MAX];
+	pthread_t threads[COMPRESSION_WORKERS_MAX];
+	int startedThreadCount = 0;
+
+	sigset_t blockedSignals;
+	sigset_t savedSignals;
+	sigfillset(&blockedSignals);
+	pthread_sigmask(SIG_SETMASK, &blockedSignals, &savedSignals);
+
+	for (int threadIndex = 1; threadIndex < threadCount; threadIndex++)
+	{
+		threadArgs[threadIndex].state = &state;
+		threadArgs[threadIndex].threadIndex = threadIndex;
+
+		/* jobs of threads that could not be started are left to the others */
+		if (pthread_create(&threads[startedThreadCount], NULL,
+						   ConcurrentDecompressionThreadMain,
+						   &threadArgs[threadIndex]) != 0)
+		{
+			break;
+		}
+
+		startedThreadCount++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &savedSignals, NULL);
+
+	threadArgs[0].state = &state;
+	threadArgs[0].threadIndex = 0;
+	ConcurrentDecompressionThreadMain(&threadArgs[0]);
+
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_DECOMPRESS);
+	for (int threadIndex = 0; threadIndex < startedThreadCount; threadIndex++)
+	{
+		pthread_join(threads[threadIndex], NULL);
+	}
+	pgstat_report_wait_end();
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		DecompressionJob *job = &jobs[jobIndex];
+		if (!job->decompressed)
+		{
+			continue;
+		}
+
+		DecompressionStatistics *statistics =
+			&DecompressionStatisticsArray[job->compressionType];
+		statistics->chunkCount++;
+		statistics->compressedBytes += job->inputBuffer->len;
+		statistics->decompressedBytes += job->outputBuffer->len;
+		statistics->elapsedMicroseconds += job->elapsedMicroseconds;
+	}
+}
+
+
+/*
+ * ConcurrentDecompressionThreadMain runs the jobs of a
+ * DecompressBuffersConcurrently call until all of them are claimed.
+ */
+static void *
+ConcurrentDecompressionThreadMain(void *arg)
+{
+	ConcurrentDecompressionThread *thread = (ConcurrentDecompressionThread *) arg;
+	ConcurrentDecompressionState *state = thread->state;
+
+	for (;;)
+	{
+		uint32 jobIndex = pg_atomic_fetch_add_u32(&state->nextJobIndex, 1);
+		if (jobIndex >= state->jobCount)
+		{
+			break;
+		}
+
+#if HAVE_LIBZSTD
+		RunDecompressionJob(&state->jobs[jobIndex],
+							ZstdThreadDecompressContexts[thread->threadIndex]);
+#else
+		RunDecompressionJob(&state->jobs[jobIndex], NULL);
+#endif
+	}
+
+	return NULL;
+}
+
+
+/*
+ * RunDecompressionJob decompresses the input buffer of a job into its
+ * already enlarged output buffer, with the given zstd context for zstd
+ * jobs. It is called from helper threads, so it must not palloc or
+ * ereport. Jobs that fail are left for the backend, which reports the error
+ * when it decompresses them again.
+ */
+static void
+RunDecompressionJob(DecompressionJob *job, void *zstdDecompressContext)
+{
+	StringInfo inputBuffer = job->inputBuffer;
+	StringInfo outputBuffer = job->outputBuffer;
+	uint64 decompressedSize = job->decompressedSize;
+
+	instr_time startTime;
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	switch (job->compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case COMPRESSION_LZ4:
+		case COMPRESSION_LZ4HC:
+		{
+			int lz4DecompressSize = LZ4_decompress_safe(inputBuffer->data,
+														outputBuffer->data,
+														inputBuffer->len,
+														decompressedSize);
+			job->decompressed = lz4DecompressSize == decompressedSize;
+			break;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case COMPRESSION_ZSTD:
+		{
+			size_t zstdDecompressSize =
+				ZSTD_decompressDCtx((ZSTD_DCtx *) zstdDecompressContext,
+									outputBuffer->data, decompressedSize,
+									inputBuffer->data, inputBuffer->len);
+			job->decompressed = !ZSTD_isError(zstdDecompressSize) &&
+								zstdDecompressSize == decompressedSize;
+			break;
+		}
+#endif
+
+		default:
+		{
+			break;
+		}
+	}
+
+	if (job->decompressed)
+	{
+		outputBuffer->len = decompressedSize;
+	}
+
+	instr_time elapsedTime;
+	INSTR_TIME_SET_CURRENT(elapsedTime);
+	INSTR_TIME_SUBTRACT(elapsedTime, startTime);
+	job->elapsedMicroseconds = INSTR_TIME_GET_MICROSEC(elapsedTime);
+}
+
+
+/*
+ * JoinDecompressionThread waits for the helper thread to exit.
+ */
+static void
+JoinDecompressionThread(DecompressionThread *thread)
+{
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_DECOMPRESS);
+	pthread_join(thread->thread, NULL);
+	pgstat_report_wait_end();
+
+	thread->running = false;
+}
+
+
+/*
+ * DecompressionThreadResetCallback joins the helper thread before the memory
+ * of its jobs is freed, and frees its zstd context.
+ */
+static void
+DecompressionThreadResetCallback(void *arg)
+{
+	DecompressionThread *thread = (DecompressionThread *) arg;
+
+	if (thread->running)
+	{
+		JoinDecompressionThread(thread);
+	}
+
+#if HAVE_LIBZSTD
+	ZSTD_freeDCtx(thread->decompressContext);
+	thread->decompressContext = NULL;
+#endif
+}
+
+
+/*
+ * CompressionBound returns the largest size compressing inputSize bytes with
+ * the given lz4 or zstd compression type may produce.
+ */
+static int
+CompressionBound(CompressionType compressionType, int inputSize)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case COMPRESSION_LZ4:
+		case COMPRESSION_LZ4HC:
+		{
+			return LZ4_compressBound(inputSize);
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case COMPRESSION_ZSTD:
+		{
+			return ZSTD_compressBound(inputSize);
+		}
+#endif
+
+		default:
+		{
+			return inputSize;
+		}
+	}
+}
+
+
+/*
+ * CompressBufferAuto picks the compression of a chunk for the auto compression
+ * type. It compresses a sample of the buffer with each candidate compression,
+ * and picks the one that makes the chunk cheapest to read, counting the bytes
+ * read plus the estimated cost of decompressing them. If the best candidate
+ * saves less than minimumGain percent of the buffer, the buffer is kept
+ * uncompressed so reads skip decompression altogether.
+ *
+ * Returns the picked compression type, outputBuffer has the compressed data
+ * unless COMPRESSION_NONE is returned.
+ */
+CompressionType
+CompressBufferAuto(StringInfo inputBuffer, StringInfo outputBuffer,
+				   int compressionLevel, int minimumGain)
+{
+	StringInfo sampleBuffer = inputBuffer;
+	if (inputBuffer->len > AUTO_COMPRESSION_SAMPLE_COUNT * AUTO_COMPRESSION_SAMPLE_SIZE)
+	{
+		/* evenly spaced slices represent the chunk better than its prefix */
+		sampleBuffer = makeStringInfo();
+		int sampleDistance = inputBuffer->len / AUTO_COMPRESSION_SAMPLE_COUNT;
+		for (int sampleIndex = 0; sampleIndex < AUTO_COMPRESSION_SAMPLE_COUNT;
+			 sampleIndex++)
+		{
+			appendBinaryStringInfo(sampleBuffer,
+								   inputBuffer->data + sampleIndex * sampleDistance,
+								   AUTO_COMPRESSION_SAMPLE_SIZE);
+		}
+	}
+
+	StringInfo sampleOutputBuffer = makeStringInfo();
+	CompressionType bestCompressionType = COMPRESSION_NONE;
+	double bestCost = sampleBuffer->len;
+	int bestCompressedSize = sampleBuffer->len;
+
+	for (int candidateIndex = 0; candidateIndex < lengthof(AutoCompressionCandidates);
+		 candidateIndex++)
+	{
+		CompressionType compressionType = AutoCompressionCandidates[candidateIndex];
+		if (!CompressBuffer(sampleBuffer, sampleOutputBuffer, compressionType,
+							compressionLevel))
+		{
+			continue;
+		}
+
+		double cost = sampleOutputBuffer->len +
+					  sampleBuffer->len * CompressionDecodeCost[compressionType];
+		if (cost < bestCost)
+		{
+			bestCompressionType = compressionType;
+			bestCost = cost;
+			bestCompressedSize = sampleOutputBuffer->len;
+		}
+	}
+
+	bool worthCompressing = bestCompressionType != COMPRESSION_NONE &&
+							!BelowMinimumGain(sampleBuffer->len, bestCompressedSize,
+											  minimumGain);
+
+	pfree(sampleOutputBuffer->data);
+	pfree(sampleOutputBuffer);
+	if (sampleBuffer != inputBuffer)
+	{
+		pfree(sampleBuffer->data);
+		pfree(sampleBuffer);
+	}
+
+	if (!worthCompressing ||
+		!CompressBuffer(inputBuffer, outputBuffer, bestCompressionType,
+						compressionLevel) ||
+		BelowMinimumGain(inputBuffer->len, outputBuffer->len, minimumGain))
+	{
+		return COMPRESSION_NONE;
+	}
+
+	return bestCompressionType;
+}
+
+
+/*
+ * BelowMinimumGain returns whether compressing rawSize bytes to compressedSize
+ * bytes saves less than minimumGain percent of them.
+ */
+static bool
+BelowMinimumGain(int rawSize, int compressedSize, int minimumGain)
+{
+	return (int64) (rawSize - compressedSize) * 100 < (int64) rawSize * minimumGain;
+}
+
+
+#if HAVE_LIBZSTD
+
+/*
+ * GetZstdCompressContext returns the zstd compression context of the backend,
+ * creating it on first use.
+ */
+static ZSTD_CCtx *
+GetZstdCompressContext(void)
+{
+	if (ZstdCompressContext == NULL)
+	{
+		ZstdCompressContext = ZSTD_createCCtx();
+		if (ZstdCompressContext == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+							errmsg("out of memory")));
+		}
+	}
+
+	return ZstdCompressContext;
+}
+
+
+/*
+ * SetZstdCompressionWorkers sets the compression level and the number of
+ * worker threads of the given context for ZSTD_compress2. zstd compresses
+ * inputs smaller than its minimum job size in the calling thread anyway.
+ * Returns false if zstd is built without multithreading support, in which
+ * case the caller compresses single threaded.
+ */
+static bool
+SetZstdCompressionWorkers(ZSTD_CCtx *compressContext, int compressionLevel)
+{
+	static bool reportedUnsupported = false;
+
+	size_t result = ZSTD_CCtx_setParameter(compressContext, ZSTD_c_nbWorkers,
+										   columnar_compression_workers);
+	if (ZSTD_isError(result))
+	{
+		if (!reportedUnsupported)
+		{
+			ereport(WARNING, (errmsg("zstd is built without multithreading "
+									 "support, columnar.compression_workers "
+									 "is ignored")));
+			reportedUnsupported = true;
+		}
+
+		return false;
+	}
+
+	result = ZSTD_CCtx_setParameter(compressContext, ZSTD_c_compressionLevel,
+									compressionLevel);
+	if (ZSTD_isError(result))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * GetZstdDecompressContext returns the zstd decompression context of the
+ * backend, creating it on first use.
+ */
+static ZSTD_DCtx *
+GetZstdDecompressContext(void)
+{
+	if (ZstdDecompressContext == NULL)
+	{
+		ZstdDecompressContext = ZSTD_createDCtx();
+		if (ZstdDecompressContext == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+							errmsg("out of memory")));
+		}
+	}
+
+	return ZstdDecompressContext;
+}
+
+
+/*
+ * ZstdDecompressInto decompresses the given zstd compressed buffer into
+ * outputBuffer, using decompressDictionary if it is not NULL.
+ */
+static void
+ZstdDecompressInto(StringInfo buffer, uint64 decompressedSize,
+				   ZSTD_DDict *decompressDictionary, StringInfo outputBuffer)
+{
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, decompressedSize);
+
+	size_t zstdDecompressSize = 0;
+	if (decompressDictionary != NULL)
+	{
+		zstdDecompressSize =
+			ZSTD_decompress_usingDDict(GetZstdDecompressContext(),
+									   outputBuffer->data, decompressedSize,
+									   buffer->data, buffer->len,
+									   decompressDictionary);
+	}
+	else
+	{
+		zstdDecompressSize = ZSTD_decompressDCtx(GetZstdDecompressContext(),
+												 outputBuffer->data, decompressedSize,
+												 buffer->data, buffer->len);
+	}
+
+	if (ZSTD_isError(zstdDecompressSize))
+	{
+		ereport(ERROR, (errmsg("zstd decompression failed"),
+						(errdetail("%s", ZSTD_getErrorName(zstdDecompressSize)))));
+	}
+
+	if (zstdDecompressSize != decompressedSize)
+	{
+		ereport(ERROR, (errmsg("unexpected decompressed size"),
+						errdetail("Expected %ld, received %ld", decompressedSize,
+								  zstdDecompressSize)));
+	}
+
+	outputBuffer->len = decompressedSize;
+}
+
+
+/*
+ * LookupCompressionDictionary returns the cache entry of the compression
+ * dictionary with the given id, reading the dictionary on a cache miss.
+ */
+static CompressionDictionaryEntry *
+LookupCompressionDictionary(uint64 dictionaryId)
+{
+	if (CompressionDictionaryCache == NULL)
+	{
+		CompressionDictionaryContext =
+			AllocSetContextCreate(TopMemoryContext,
+								  "Columnar Compression Dictionary Cache",
+								  ALLOCSET_DEFAULT_SIZES);
+
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(CompressionDictionaryEntry);
+		info.hcxt = CompressionDictionaryContext;
+
+		CompressionDictionaryCache =
+			hash_create("columnar compression dictionary cache",
+						COMPRESSION_DICTIONARY_CACHE_SIZE, &info,
+						HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	CompressionDictionaryEntry *entry =
+		hash_search(CompressionDictionaryCache, &dictionaryId, HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		return entry;
+	}
+
+	bytea *dictionary = ReadCompressionDictionary(dictionaryId);
+	if (dictionary == NULL)
+	{
+		ereport(ERROR, (errmsg("compression dictionary " UINT64_FORMAT
+							   " does not exist", dictionaryId)));
+	}
+
+	if (hash_get_num_entries(CompressionDictionaryCache) >=
+		COMPRESSION_DICTIONARY_CACHE_SIZE)
+	{
+		ResetCompressionDictionaryCache();
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(CompressionDictionaryContext);
+	bytea *dictionaryCopy = (bytea *) palloc(VARSIZE(dictionary));
+	memcpy(dictionaryCopy, dictionary, VARSIZE(dictionary));
+	MemoryContextSwitchTo(oldContext);
+
+	pfree(dictionary);
+
+	bool found = false;
+	entry = hash_search(CompressionDictionaryCache, &dictionaryId, HASH_ENTER, &found);
+	entry->compressDictionary = NULL;
+	entry->compressionLevel = 0;
+	entry->decompressDictionary = NULL;
+	entry->dictionary = dictionaryCopy;
+
+	return entry;
+}
+
+
+/*
+ * ResetCompressionDictionaryCache frees all prepared dictionaries of the
+ * cache.
+ */
+static void
+ResetCompressionDictionaryCache(void)
+{
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, CompressionDictionaryCache);
+
+	CompressionDictionaryEntry *entry = NULL;
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		ZSTD_freeCDict(entry->compressDictionary);
+		ZSTD_freeDDict(entry->decompressDictionary);
+		pfree(entry->dictionary);
+
+		hash_search(CompressionDictionaryCache, &entry->dictionaryId, HASH_REMOVE,
+					NULL);
+	}
+}
+
+
+#endif
+
+
+/*
+ * CompressBufferWithDictionary compresses the given buffer with zstd using the
+ * compression dictionary with the given id. Like CompressBuffer it returns
+ * whether compression is done, outputBuffer is only valid if it is.
+ */
+bool
+CompressBufferWithDictionary(StringInfo inputBuffer, StringInfo outputBuffer,
+							 int compressionLevel, uint64 dictionaryId)
+{
+#if HAVE_LIBZSTD
+	CompressionDictionaryEntry *entry = LookupCompressionDictionary(dictionaryId);
+	if (entry->compressDictionary == NULL ||
+		entry->compressionLevel != compressionLevel)
+	{
+		ZSTD_freeCDict(entry->compressDictionary);
+		entry->compressDictionary =
+			ZSTD_createCDict(VARDATA(entry->dictionary),
+							 VARSIZE(entry->dictionary) - VARHDRSZ,
+							 compressionLevel);
+		entry->compressionLevel = compressionLevel;
+
+		if (entry->compressDictionary == NULL)
+		{
+			ereport(WARNING, (errmsg("could not prepare compression dictionary "
+									 UINT64_FORMAT, dictionaryId)));
+			return false;
+		}
+	}
+
+	int maximumLength = ZSTD_compressBound(inputBuffer->len);
+
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, maximumLength);
+
+	size_t compressedSize = ZSTD_compress_usingCDict(GetZstdCompressContext(),
+													 outputBuffer->data,
+													 outputBuffer->maxlen,
+													 inputBuffer->data,
+													 inputBuffer->len,
+													 entry->compressDictionary);
+	if (ZSTD_isError(compressedSize))
+	{
+		ereport(WARNING, (errmsg("zstd compression failed"),
+						  (errdetail("%s", ZSTD_getErrorName(compressedSize)))));
+		return false;
+	}
+
+	outputBuffer->len = compressedSize;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+#if HAVE_LIBZSTD
+
+/*
+ * PreparedDecompressDictionary returns the prepared zstd decompression
+ * dictionary with the given id.
+ */
+static ZSTD_DDict *
+PreparedDecompressDictionary(uint64 dictionaryId)
+{
+	CompressionDictionaryEntry *entry = LookupCompressionDictionary(dictionaryId);
+	if (entry->decompressDictionary == NULL)
+	{
+		entry->decompressDictionary =
+			ZSTD_createDDict(VARDATA(entry->dictionary),
+							 VARSIZE(entry->dictionary) - VARHDRSZ);
+		if (entry->decompressDictionary == NULL)
+		{
+			ereport(ERROR, (errmsg("could not prepare compression dictionary "
+								   UINT64_FORMAT, dictionaryId)));
+		}
+	}
+
+	return entry->decompressDictionary;
+}
+
+
+#endif
+
+
+/*
+ * TrainCompressionDictionary trains a zstd dictionary of at most
+ * dictionarySize bytes from the given samples, which are stored one after
+ * the other in samples. Returns the dictionary as a bytea.
+ */
+bytea *
+TrainCompressionDictionary(StringInfo samples, size_t *sampleSizes,
+						   uint32 sampleCount, uint32 dictionarySize)
+{
+#if HAVE_LIBZSTD
+	bytea *dictionary = (bytea *) palloc(dictionarySize + VARHDRSZ);
+
+	size_t trainedSize = ZDICT_trainFromBuffer(VARDATA(dictionary), dictionarySize,
+											   samples->data, sampleSizes,
+											   sampleCount);
+	if (ZDICT_isError(trainedSize))
+	{
+		ereport(ERROR, (errmsg("could not train compression dictionary"),
+						errdetail("%s", ZDICT_getErrorName(trainedSize)),
+						errhint("Compression dictionaries need more data to "
+								"train on, load more rows first.")));
+	}
+
+	SET_VARSIZE(dictionary, trainedSize + VARHDRSZ);
+
+	return dictionary;
+#else
+	ereport(ERROR, (errmsg("compression dictionaries require zstd support")));
+#endif
+}
+
+
+/*
+ * DecompressBuffer decompresses the given buffer with the given compression
+ * type. This function returns the buffer as-is when no compression is applied.
+ */
+StringInfo
+DecompressBuffer(StringInfo buffer,
+				 CompressionType compressionType,
+				 uint64 decompressedSize)
+{
+	if (compressionType == COMPRESSION_NONE)
+	{
+		return buffer;
+	}
+
+	StringInfo decompressedBuffer = makeStringInfo();
+	DecompressBufferInto(buffer, compressionType, decompressedSize, 0,
+						 decompressedBuffer);
+
+	return decompressedBuffer;
+}
+
+
+/*
+ * DecompressBufferInto decompresses the given buffer into outputBuffer, which
+ * is enlarged as needed. Callers that decompress many chunks can pass the same
+ * outputBuffer every time to avoid allocating a buffer per chunk. dictionaryId
+ * is the zstd dictionary the buffer was compressed with, 0 if none.
+ */
+void
+DecompressBufferInto(StringInfo buffer, CompressionType compressionType,
+					 uint64 decompressedSize, uint64 dictionaryId,
+					 StringInfo outputBuffer)
+{
+	instr_time startTime;
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	COLUMNAR_TRACE_DECOMPRESS_START(compressionType, buffer->len, decompressedSize);
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_DECOMPRESS);
+
+	if (dictionaryId != 0)
+	{
+#if HAVE_LIBZSTD
+		ZstdDecompressInto(buffer, decompressedSize,
+						   PreparedDecompressDictionary(dictionaryId), outputBuffer);
+#else
+		ereport(ERROR, (errmsg("compression dictionaries require zstd support")));
+#endif
+	}
+	else
+	{
+		DecompressCodecInto(buffer, compressionType, decompressedSize, outputBuffer);
+	}
+
+	pgstat_report_wait_end();
+	COLUMNAR_TRACE_DECOMPRESS_DONE(compressionType, buffer->len, decompressedSize);
+
+	instr_time elapsedTime;
+	INSTR_TIME_SET_CURRENT(elapsedTime);
+	INSTR_TIME_SUBTRACT(elapsedTime, startTime);
+
+	DecompressionStatistics *statistics = &DecompressionStatisticsArray[compressionType];
+	statistics->chunkCount++;
+	statistics->compressedBytes += buffer->len;
+	statistics->decompressedBytes += outputBuffer->len;
+	statistics->elapsedMicroseconds += INSTR_TIME_GET_MICROSEC(elapsedTime);
+}
+
+
+/*
+ * ColumnarDecompressionStatistics returns the decompression statistics of
+ * this backend, indexed by compression type.
+ */
+const DecompressionStatistics *
+ColumnarDecompressionStatistics(void)
+{
+	return DecompressionStatisticsArray;
+}
+
+
+/*
+ * DecompressCodecInto decompresses the given buffer, which is compressed
+ * without a dictionary, into outputBuffer.
+ */
+static void
+DecompressCodecInto(StringInfo buffer, CompressionType compressionType,
+					uint64 decompressedSize, StringInfo outputBuffer)
+{
+	switch (compressionType)
+	{
+		case COMPRESSION_NONE:
+		{
+			resetStringInfo(outputBuffer);
+			appendBinaryStringInfo(outputBuffer, buffer->data, buffer->len);
+			break;
+		}
+
+#if HAVE_CITUS_LIBLZ4
+		case COMPRESSION_LZ4:
+		{
+			resetStringInfo(outputBuffer);
+			enlargeStringInfo(outputBuffer, decompressedSize);
+
+			int lz4DecompressSize = LZ4_decompress_safe(buffer->data,
+														outputBuffer->data,
+														buffer->len,
+														decompressedSize);
+
+			if (lz4DecompressSize != decompressedSize)
+			{
+				ereport(ERROR, (errmsg("cannot decompress the buffer"),
+								errdetail("Expected %lu bytes, but received %d bytes",
+										  decompressedSize, lz4DecompressSize)));
+			}
+
+			outputBuffer->len = decompressedSize;
+			break;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case COMPRESSION_ZSTD:
+		{
+			ZstdDecompressInto(buffer, decompressedSize, NULL, outputBuffer);
+			break;
+		}
+#endif
+
+		case COMPRESSION_PG_LZ:
+		{
+			uint32 compressedDataSize = VARSIZE(buffer->data) - COLUMNAR_COMPRESS_HDRSZ;
+			uint32 decompressedDataSize = COLUMNAR_COMPRESS_RAWSIZE(buffer->data);
+
+			if (compressedDataSize + COLUMNAR_COMPRESS_HDRSZ != buffer->len)
+			{
+				ereport(ERROR, (errmsg("cannot decompress the buffer"),
+								errdetail("Expected %u bytes, but received %u bytes",
+										  compressedDataSize, buffer->len)));
+			}
+
+			resetStringInfo(outputBuffer);
+			enlargeStringInfo(outputBuffer, decompressedDataSize);
+
+			int32 decompressedByteCount = pglz_decompress(COLUMNAR_COMPRESS_RAWDATA(
+															  buffer->data),
 														  compressedDataSize,
-														  decompressedData,
+														  outputBuffer->data,
 														  decompressedDataSize, true);
 
 			if (decompressedByteCount < 0)
@@ -250,12 +1702,8 @@ DecompressBuffer(StringInfo buffer,
 								errdetail("compressed data is corrupted")));
 			}
 
-			StringInfo decompressedBuffer = palloc0(sizeof(StringInfoData));
-			decompressedBuffer->data = decompressedData;
-			decompressedBuffer->len = decompressedDataSize;
-			decompressedBuffer->maxlen = decompressedDataSize;
-
-			return decompressedBuffer;
+			outputBuffer->len = decompressedDataSize;
+			break;
 		}
 
 		default:
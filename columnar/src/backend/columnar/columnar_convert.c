@@ -0,0 +1,298 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_convert.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Copying the rows of a heap table into a columnar table, for
+ * columnar.alter_table_set_access_method.
+ *
+ * columnar.copy_heap_rows scans the heap a page at a time and copies the
+ * columns of its rows into slices of values, one array per column, which
+ * are handed to ColumnarWriteBatch. The rows don't go through the executor
+ * or columnar_tuple_insert one at a time, and the target has no indexes
+ * yet, so they are built afterwards by sorting all of its rows.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/detoast.h"
+#include "access/heapam.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "catalog/pg_am.h"
+#include "executor/tuptable.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_tableam.h"
+
+/* rows copied into each slice handed to ColumnarWriteBatch */
+#define HEAP_COPY_SLICE_ROWS 10000
+
+static void CheckHeapCopyRelations(Relation source, Relation target,
+								   AttrNumber *sourceAttributes);
+static Datum CopyHeapValue(Datum value, Form_pg_attribute attributeForm);
+
+PG_FUNCTION_INFO_V1(columnar_copy_heap_rows);
+
+
+/*
+ * columnar_copy_heap_rows copies the rows of a heap table into new stripes
+ * of a columnar table without indexes, triggers or check constraints whose
+ * columns are the columns of the heap table, and returns their number.
+ */
+Datum
+columnar_copy_heap_rows(PG_FUNCTION_ARGS)
+{
+	Oid sourceId = PG_GETARG_OID(0);
+	Oid targetId = PG_GETARG_OID(1);
+
+	Relation source = table_open(sourceId, AccessShareLock);
+	Relation target = table_open(targetId, RowExclusiveLock);
+
+	TupleDesc targetDescriptor = RelationGetDescr(target);
+	int columnCount = targetDescriptor->natts;
+
+	AttrNumber *sourceAttributes = palloc(columnCount * sizeof(AttrNumber));
+	CheckHeapCopyRelations(source, target, sourceAttributes);
+
+	ColumnarOptions options = { 0 };
+	ReadColumnarOptions(targetId, &options);
+	ColumnarWriteState *writeState = ColumnarBeginWrite(target->rd_node, options,
+														targetDescriptor);
+	bool logInserts = ColumnarLogicalChangesLogged(target, CMD_INSERT);
+
+	MemoryContext sliceContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Columnar Heap Copy Slice Context",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	Datum **columnValues = palloc(columnCount * sizeof(Datum *));
+	bool **columnNulls = palloc(columnCount * sizeof(bool *));
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		columnValues[columnIndex] = palloc(HEAP_COPY_SLICE_ROWS * sizeof(Datum));
+		columnNulls[columnIndex] = palloc(HEAP_COPY_SLICE_ROWS * sizeof(bool));
+	}
+	uint64 *rowNumbers = palloc(HEAP_COPY_SLICE_ROWS * sizeof(uint64));
+
+	/* large heaps are read through a ring of buffers, like seqscans */
+	TupleTableSlot *slot = table_slot_create(source, NULL);
+	TableScanDesc scan = table_beginscan(source, GetActiveSnapshot(), 0, NULL);
+
+	uint64 rowCount = 0;
+	uint32 sliceRowCount = 0;
+	bool scanDone = false;
+
+	while (!scanDone)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		scanDone = !table_scan_getnextslot(scan, ForwardScanDirection, slot);
+
+		if (!scanDone)
+		{
+			/*
+			 * Values are copied out of the slot, as the heap page it points
+			 * into is released when the scan moves on to the next one.
+			 */
+			MemoryContext oldContext = MemoryContextSwitchTo(sliceContext);
+
+			slot_getallattrs(slot);
+
+			for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				int sourceIndex = AttrNumberGetAttrOffset(sourceAttributes[columnIndex]);
+				bool isNull = slot->tts_isnull[sourceIndex];
+
+				columnNulls[columnIndex][sliceRowCount] = isNull;
+				columnValues[columnIndex][sliceRowCount] =
+					isNull ? (Datum) 0 :
+					CopyHeapValue(slot->tts_values[sourceIndex],
+								  TupleDescAttr(targetDescriptor, columnIndex));
+			}
+
+			MemoryContextSwitchTo(oldContext);
+
+			sliceRowCount++;
+		}
+
+		if (sliceRowCount == HEAP_COPY_SLICE_ROWS || (scanDone && sliceRowCount > 0))
+		{
+			MemoryContext oldContext =
+				MemoryContextSwitchTo(ColumnarWritePerTupleContext(writeState));
+
+			ColumnarWriteBatch(writeState, columnValues, columnNulls, sliceRowCount,
+							   rowNumbers);
+			if (logInserts)
+			{
+				ColumnarLogLogicalMultiInsert(target, columnValues, columnNulls,
+											  rowNumbers, sliceRowCount);
+			}
+
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextReset(ColumnarWritePerTupleContext(writeState));
+			MemoryContextReset(sliceContext);
+
+			rowCount += sliceRowCount;
+			sliceRowCount = 0;
+		}
+	}
+
+	table_endscan(scan);
+	ExecDropSingleTupleTableSlot(slot);
+
+	ColumnarEndWrite(writeState);
+
+	MemoryContextDelete(sliceContext);
+
+	pgstat_count_heap_insert(target, rowCount);
+	ColumnarStatCount(targetId, COLUMNAR_STAT_ROWS_WRITTEN, rowCount);
+
+	table_close(target, NoLock);
+	table_close(source, NoLock);
+
+	PG_RETURN_INT64(rowCount);
+}
+
+
+/*
+ * CheckHeapCopyRelations errors out unless the rows of source can be copied
+ * into target by columnar.copy_heap_rows, which skips what the executor
+ * does for inserts, and sets sourceAttributes to the attribute number in
+ * source of each column of target.
+ */
+static void
+CheckHeapCopyRelations(Relation source, Relation target, AttrNumber *sourceAttributes)
+{
+	Oid sourceId = RelationGetRelid(source);
+	Oid targetId = RelationGetRelid(target);
+	const char *sourceName = quote_identifier(RelationGetRelationName(source));
+	const char *targetName = quote_identifier(RelationGetRelationName(target));
+
+	if (source->rd_rel->relkind != RELKIND_RELATION ||
+		source->rd_rel->relam != HEAP_TABLE_AM_OID)
+	{
+		ereport(ERROR, (errmsg("table %s is not a heap table", sourceName)));
+	}
+
+	if (!IsColumnarTableAmTable(targetId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table", targetName)));
+	}
+
+	AclResult aclResult = pg_class_aclcheck(sourceId, GetUserId(), ACL_SELECT);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, OBJECT_TABLE, RelationGetRelationName(source));
+	}
+
+	aclResult = pg_class_aclcheck(targetId, GetUserId(), ACL_INSERT);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, OBJECT_TABLE, RelationGetRelationName(target));
+	}
+
+	if (check_enable_rls(sourceId, InvalidOid, false) == RLS_ENABLED ||
+		check_enable_rls(targetId, InvalidOid, false) == RLS_ENABLED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot copy rows of tables with row-level security")));
+	}
+
+	TupleConstr *constraints = RelationGetDescr(target)->constr;
+	if (RelationGetIndexList(target) != NIL || target->trigdesc != NULL ||
+		(constraints != NULL && constraints->num_check > 0))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot copy rows into table %s with indexes, "
+							   "triggers or check constraints", targetName)));
+	}
+
+	/* columns are matched in order, skipping the dropped columns of source */
+	TupleDesc sourceDescriptor = RelationGetDescr(source);
+	TupleDesc targetDescriptor = RelationGetDescr(target);
+	int sourceIndex = 0;
+
+	for (int columnIndex = 0; columnIndex < targetDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute targetForm = TupleDescAttr(targetDescriptor, columnIndex);
+
+		while (sourceIndex < sourceDescriptor->natts &&
+			   TupleDescAttr(sourceDescriptor, sourceIndex)->attisdropped)
+		{
+			sourceIndex++;
+		}
+
+		if (targetForm->attisdropped || sourceIndex == sourceDescriptor->natts ||
+			TupleDescAttr(sourceDescriptor, sourceIndex)->atttypid != targetForm->atttypid ||
+			TupleDescAttr(sourceDescriptor, sourceIndex)->atttypmod != targetForm->atttypmod)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("columns of tables %s and %s don't match",
+								   sourceName, targetName)));
+		}
+
+		sourceAttributes[columnIndex] = AttrOffsetGetAttrNumber(sourceIndex);
+		sourceIndex++;
+	}
+
+	while (sourceIndex < sourceDescriptor->natts &&
+		   TupleDescAttr(sourceDescriptor, sourceIndex)->attisdropped)
+	{
+		sourceIndex++;
+	}
+
+	if (sourceIndex != sourceDescriptor->natts)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("columns of tables %s and %s don't match",
+							   sourceName, targetName)));
+	}
+}
+
+
+/*
+ * CopyHeapValue returns a copy of a value of a heap tuple in the current
+ * memory context. Toasted values are detoasted like columnar_tuple_insert
+ * does, so compressed ones are only fetched if
+ * columnar.preserve_compressed_values is set.
+ */
+static Datum
+CopyHeapValue(Datum value, Form_pg_attribute attributeForm)
+{
+	if (attributeForm->attbyval)
+	{
+		return value;
+	}
+
+	if (attributeForm->attlen == -1 && VARATT_IS_EXTENDED(value))
+	{
+		struct varlena *varlenaValue = (struct varlena *) DatumGetPointer(value);
+
+		if (VARATT_IS_EXTERNAL(varlenaValue))
+		{
+			return PointerGetDatum(columnar_preserve_compressed_values ?
+								   detoast_external_attr(varlenaValue) :
+								   detoast_attr(varlenaValue));
+		}
+
+		if (!columnar_preserve_compressed_values || !VARATT_IS_COMPRESSED(varlenaValue))
+		{
+			return PointerGetDatum(detoast_attr(varlenaValue));
+		}
+	}
+
+	return datumCopy(value, false, attributeForm->attlen);
+}
@@ -0,0 +1,1163 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_csv_load.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Bulk loading of CSV files on the server into columnar tables.
+ *
+ * columnar.load_csv parses a CSV file and writes its rows into new stripes
+ * with ColumnarWriteBatch, a slice of rows at a time, like the Arrow import
+ * does. Parsing the fields and calling the input functions of the columns
+ * dominates loading from CSV, so for large files that's done by parallel
+ * workers: the file is split into ranges of bytes, and each worker parses
+ * the records that start in the ranges it claims and sends their rows back
+ * to the leader through a shared memory queue.
+ *
+ * A worker starts parsing a range at the first line after its nominal
+ * start, as records usually end at a newline. A quoted value with a
+ * newline can make that line fall inside a record, so a range is only used
+ * if its first record starts where the worker of the range before stopped
+ * parsing, which is checked by the leader before it writes any of their
+ * rows.
+ *
+ * Writing stays in the leader: PostgreSQL doesn't allow writes while in
+ * parallel mode, so the file is parsed in rounds of ranges, and the leader
+ * exits parallel mode after each round to write the rows of its ranges, in
+ * the order of the file. The compression of the stripes is spread over
+ * columnar.column_compression_threads threads by the writer.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <sys/stat.h>
+
+#include "access/htup_details.h"
+#include "access/parallel.h"
+#include "access/table.h"
+#include "catalog/pg_authid.h"
+#include "catalog/pg_proc.h"
+#include "executor/tuptable.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "storage/fd.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/columnar_version_compat.h"
+
+#define PARALLEL_CSV_KEY_SHARED UINT64CONST(0xC01A000000000011)
+#define PARALLEL_CSV_KEY_QUEUES UINT64CONST(0xC01A000000000012)
+#define PARALLEL_CSV_KEY_STRINGS UINT64CONST(0xC01A000000000013)
+
+/* same size as the tuple queues of parallel query */
+#define PARALLEL_CSV_QUEUE_SIZE 65536
+
+/* files smaller than a range per worker are parsed by the leader */
+#define CSV_LOAD_MIN_RANGE_SIZE (1024 * 1024)
+#define CSV_LOAD_MAX_RANGE_SIZE (64 * 1024 * 1024)
+
+#define CSV_LOAD_SLICE_ROWS 10000
+#define CSV_LOAD_READ_BUFFER_SIZE 65536
+
+typedef struct CsvLoadOptions
+{
+	char delimiter;
+	char quote;
+	bool header;
+	char *nullString;
+} CsvLoadOptions;
+
+/*
+ * CsvReader reads the records of a CSV file that start before a given
+ * offset, through a buffer of its own.
+ */
+typedef struct CsvReader
+{
+	FILE *file;
+	const char *fileName;
+	CsvLoadOptions *options;
+
+	/* records starting at or after endOffset are left to the next range */
+	int64 endOffset;
+	int64 recordOffset;
+
+	char *buffer;
+	int64 bufferOffset;
+	int bufferLength;
+	int bufferPosition;
+
+	/* fields of the last record, each terminated by a zero byte */
+	StringInfoData fieldData;
+	int *fieldStarts;
+	bool *fieldQuoted;
+	int fieldCount;
+	int maxFieldCount;
+} CsvReader;
+
+/* input functions of the columns of the relation */
+typedef struct CsvLoadColumns
+{
+	TupleDesc tupleDescriptor;
+	FmgrInfo *inputFunctions;
+	Oid *typeIOParams;
+} CsvLoadColumns;
+
+/* slice of rows collected for ColumnarWriteBatch */
+typedef struct CsvLoadSink
+{
+	Relation rel;
+	ColumnarWriteState *writeState;
+	bool logInserts;
+	MemoryContext sliceContext;
+	Datum **columnValues;
+	bool **columnNulls;
+	uint64 *rowNumbers;
+	uint32 sliceRowCount;
+	uint64 rowCount;
+} CsvLoadSink;
+
+typedef struct ParallelCsvRange
+{
+	int64 startOffset;
+	int64 endOffset;
+
+	/* whether startOffset is known to be the start of a record */
+	bool exactStart;
+	bool skipHeader;
+
+	/* set by the worker that parsed the range */
+	int64 firstRecordOffset;
+	int64 stopOffset;
+} ParallelCsvRange;
+
+typedef struct ParallelCsvShared
+{
+	Oid relationId;
+	char delimiter;
+	char quote;
+	uint32 rangeCount;
+	pg_atomic_uint32 nextRange;
+	ParallelCsvRange ranges[FLEXIBLE_ARRAY_MEMBER];
+} ParallelCsvShared;
+
+PGDLLEXPORT void ColumnarParallelCsvLoadWorkerMain(dsm_segment *seg, shm_toc *toc);
+
+static int CsvLoadWorkers(Relation rel, int64 fileSize);
+static int64 LoadCsvRangesInParallel(CsvLoadSink *sink, const char *fileName,
+									 CsvLoadOptions *options, int64 startOffset,
+									 int64 fileSize, int nworkers);
+static void ReceiveRangeRows(ParallelContext *pcxt, shm_mq_handle **queues,
+							 Tuplestorestate **rangeRows, uint32 rangeCount,
+							 TupleDesc tupleDescriptor);
+static void WriteRangeRows(CsvLoadSink *sink, Tuplestorestate *rangeRows);
+static void LoadCsvRangeInLeader(CsvLoadSink *sink, FILE *file, const char *fileName,
+								 CsvLoadOptions *options, int64 startOffset,
+								 int64 fileSize);
+static void ParseRangeIntoQueue(Relation relation, FILE *file, const char *fileName,
+								CsvLoadOptions *options, ParallelCsvRange *range,
+								uint32 rangeIndex, shm_mq_handle *queue);
+static CsvLoadColumns * CsvLoadBeginColumns(TupleDesc tupleDescriptor);
+static void CsvRecordValues(CsvLoadColumns *columns, CsvReader *reader,
+							Datum *values, bool *nulls);
+static void CsvLoadAddRow(CsvLoadSink *sink, Datum *values, bool *nulls);
+static void CsvLoadFlushSlice(CsvLoadSink *sink);
+static void CsvReaderBegin(CsvReader *reader, FILE *file, const char *fileName,
+						   CsvLoadOptions *options, int64 startOffset,
+						   int64 endOffset, bool exactStart);
+static bool CsvReadRecord(CsvReader *reader);
+static void CsvAddField(CsvReader *reader, bool quoted);
+static int CsvReadChar(CsvReader *reader);
+static int CsvPeekChar(CsvReader *reader);
+static void CsvLoadErrorCallback(void *arg);
+
+PG_FUNCTION_INFO_V1(columnar_load_csv);
+
+
+/*
+ * columnar_load_csv writes the rows of a CSV file on the server into new
+ * stripes of a columnar table and returns their number. Large files are
+ * parsed by parallel workers. Like COPY FROM a file, it needs the
+ * privileges of pg_read_server_files.
+ */
+Datum
+columnar_load_csv(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	char *fileName = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	CsvLoadOptions options = { 0 };
+	options.delimiter = PG_GETARG_CHAR(2);
+	options.quote = PG_GETARG_CHAR(3);
+	options.nullString = text_to_cstring(PG_GETARG_TEXT_PP(4));
+	options.header = PG_GETARG_BOOL(5);
+
+	if (!is_member_of_role(GetUserId(), ROLE_PG_READ_SERVER_FILES))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("must be superuser or a member of the "
+							   "pg_read_server_files role to import from a file")));
+	}
+
+	if (options.delimiter == '\0' || options.delimiter == '\n' ||
+		options.delimiter == '\r')
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("CSV delimiter can't be a newline, carriage return "
+							   "or an empty character")));
+	}
+
+	if (options.quote == '\0' || options.quote == options.delimiter)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("CSV quote must be a character other than the "
+							   "delimiter")));
+	}
+
+	FILE *file = AllocateFile(fileName, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\" for reading: %m", fileName)));
+	}
+
+	struct stat fileStat;
+	if (fstat(fileno(file), &fileStat) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat file \"%s\": %m", fileName)));
+	}
+
+	if (S_ISDIR(fileStat.st_mode))
+	{
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("\"%s\" is a directory", fileName)));
+	}
+
+	int64 fileSize = fileStat.st_size;
+
+	Relation rel = table_open(relationId, RowExclusiveLock);
+	CheckColumnarImportRelation(rel);
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	int columnCount = tupleDescriptor->natts;
+
+	ColumnarOptions columnarOptions = { 0 };
+	ReadColumnarOptions(relationId, &columnarOptions);
+
+	CsvLoadSink sink = { 0 };
+	sink.rel = rel;
+	sink.writeState = ColumnarBeginWrite(rel->rd_node, columnarOptions,
+										 tupleDescriptor);
+	sink.logInserts = ColumnarLogicalChangesLogged(rel, CMD_INSERT);
+	sink.sliceContext = AllocSetContextCreate(CurrentMemoryContext,
+											  "Columnar CSV Load Slice Context",
+											  ALLOCSET_DEFAULT_SIZES);
+	sink.columnValues = palloc(columnCount * sizeof(Datum *));
+	sink.columnNulls = palloc(columnCount * sizeof(bool *));
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		sink.columnValues[columnIndex] = palloc0(CSV_LOAD_SLICE_ROWS * sizeof(Datum));
+		sink.columnNulls[columnIndex] = palloc(CSV_LOAD_SLICE_ROWS * sizeof(bool));
+	}
+	sink.rowNumbers = palloc(CSV_LOAD_SLICE_ROWS * sizeof(uint64));
+
+	int64 loadedOffset = 0;
+	int nworkers = CsvLoadWorkers(rel, fileSize);
+
+	if (nworkers > 0)
+	{
+		loadedOffset = LoadCsvRangesInParallel(&sink, fileName, &options, 0, fileSize,
+											   nworkers);
+	}
+
+	/* the rest of the file if no workers could be launched */
+	if (loadedOffset < fileSize)
+	{
+		LoadCsvRangeInLeader(&sink, file, fileName, &options, loadedOffset, fileSize);
+	}
+
+	CsvLoadFlushSlice(&sink);
+	ColumnarEndWrite(sink.writeState);
+
+	MemoryContextDelete(sink.sliceContext);
+	FreeFile(file);
+
+	pgstat_count_heap_insert(rel, sink.rowCount);
+	ColumnarStatCount(relationId, COLUMNAR_STAT_ROWS_WRITTEN, sink.rowCount);
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT64(sink.rowCount);
+}
+
+
+/*
+ * CsvLoadWorkers returns the number of workers to use for parsing a file
+ * of fileSize bytes into rel, 0 if it should be parsed by the leader.
+ */
+static int
+CsvLoadWorkers(Relation rel, int64 fileSize)
+{
+	/* InitializeParallelDSM serializes the active snapshot */
+	if (!columnar_enable_parallel_execution || IsInParallelMode() ||
+		!ActiveSnapshotSet())
+	{
+		return 0;
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	for (int i = 0; i < tupleDescriptor->natts; i++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, i);
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		Oid inputFunctionId = InvalidOid;
+		Oid typeIOParam = InvalidOid;
+		getTypeInputInfo(attribute->atttypid, &inputFunctionId, &typeIOParam);
+
+		if (func_parallel(inputFunctionId) != PROPARALLEL_SAFE)
+		{
+			return 0;
+		}
+	}
+
+	return (int) Min(max_parallel_maintenance_workers,
+					 fileSize / CSV_LOAD_MIN_RANGE_SIZE);
+}
+
+
+/*
+ * LoadCsvRangesInParallel loads the records of the file that start between
+ * startOffset and fileSize, in rounds of a range per worker, and returns
+ * the offset up to which the file was loaded. That is less than fileSize
+ * if no workers could be launched for a round.
+ */
+static int64
+LoadCsvRangesInParallel(CsvLoadSink *sink, const char *fileName,
+						CsvLoadOptions *options, int64 startOffset,
+						int64 fileSize, int nworkers)
+{
+	Size nullStringSize = strlen(options->nullString) + 1;
+	Size stringsSize = strlen(fileName) + 1 + nullStringSize;
+	TupleDesc tupleDescriptor = RelationGetDescr(sink->rel);
+	int64 roundOffset = startOffset;
+
+	while (roundOffset < fileSize)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		int64 rangeSize = Min((fileSize - roundOffset + nworkers - 1) / nworkers,
+							  CSV_LOAD_MAX_RANGE_SIZE);
+		uint32 rangeCount = (uint32) Min(nworkers, (fileSize - roundOffset +
+													rangeSize - 1) / rangeSize);
+
+		EnterParallelMode();
+
+		ParallelContext *pcxt = CreateParallelContext("columnar",
+													  "ColumnarParallelCsvLoadWorkerMain",
+													  nworkers);
+
+		Size sharedSize = add_size(offsetof(ParallelCsvShared, ranges),
+								   mul_size(rangeCount, sizeof(ParallelCsvRange)));
+		shm_toc_estimate_chunk(&pcxt->estimator, sharedSize);
+		shm_toc_estimate_chunk(&pcxt->estimator,
+							   mul_size(PARALLEL_CSV_QUEUE_SIZE, pcxt->nworkers));
+		shm_toc_estimate_chunk(&pcxt->estimator, stringsSize);
+		shm_toc_estimate_keys(&pcxt->estimator, 3);
+
+		InitializeParallelDSM(pcxt);
+
+		/* InitializeParallelDSM sets nworkers to 0 if it couldn't create a segment */
+		if (pcxt->nworkers == 0)
+		{
+			DestroyParallelContext(pcxt);
+			ExitParallelMode();
+			break;
+		}
+
+		ParallelCsvShared *shared = shm_toc_allocate(pcxt->toc, sharedSize);
+		shared->relationId = RelationGetRelid(sink->rel);
+		shared->delimiter = options->delimiter;
+		shared->quote = options->quote;
+		shared->rangeCount = rangeCount;
+		pg_atomic_init_u32(&shared->nextRange, 0);
+
+		for (uint32 i = 0; i < rangeCount; i++)
+		{
+			ParallelCsvRange *range = &shared->ranges[i];
+			range->startOffset = roundOffset + i * rangeSize;
+			range->endOffset = Min(range->startOffset + rangeSize, fileSize);
+			range->exactStart = (i == 0);
+			range->skipHeader = (i == 0 && roundOffset == 0 && options->header);
+			range->firstRecordOffset = -1;
+			range->stopOffset = -1;
+		}
+
+		shm_toc_insert(pcxt->toc, PARALLEL_CSV_KEY_SHARED, shared);
+
+		char *strings = shm_toc_allocate(pcxt->toc, stringsSize);
+		strcpy(strings, fileName);
+		strcpy(strings + strlen(fileName) + 1, options->nullString);
+		shm_toc_insert(pcxt->toc, PARALLEL_CSV_KEY_STRINGS, strings);
+
+		char *queueSpace = shm_toc_allocate(pcxt->toc,
+											mul_size(PARALLEL_CSV_QUEUE_SIZE,
+													 pcxt->nworkers));
+		shm_mq_handle **queues = palloc0(pcxt->nworkers * sizeof(shm_mq_handle *));
+
+		for (int i = 0; i < pcxt->nworkers; i++)
+		{
+			shm_mq *queue = shm_mq_create(queueSpace + i * PARALLEL_CSV_QUEUE_SIZE,
+										  PARALLEL_CSV_QUEUE_SIZE);
+			shm_mq_set_receiver(queue, MyProc);
+			queues[i] = shm_mq_attach(queue, pcxt->seg, NULL);
+		}
+
+		shm_toc_insert(pcxt->toc, PARALLEL_CSV_KEY_QUEUES, queueSpace);
+
+		LaunchParallelWorkers(pcxt);
+
+		if (pcxt->nworkers_launched == 0)
+		{
+			for (int i = 0; i < pcxt->nworkers; i++)
+			{
+				shm_mq_detach(queues[i]);
+			}
+
+			DestroyParallelContext(pcxt);
+			ExitParallelMode();
+			break;
+		}
+
+		for (int i = 0; i < pcxt->nworkers_launched; i++)
+		{
+			shm_mq_set_handle(queues[i], pcxt->worker[i].bgwhandle);
+		}
+
+		Tuplestorestate **rangeRows = palloc0(rangeCount * sizeof(Tuplestorestate *));
+		ReceiveRangeRows(pcxt, queues, rangeRows, rangeCount, tupleDescriptor);
+
+		/* rethrows any error of the workers */
+		WaitForParallelWorkersToFinish(pcxt);
+
+		for (uint32 i = 1; i < rangeCount; i++)
+		{
+			if (shared->ranges[i].firstRecordOffset != shared->ranges[i - 1].stopOffset)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("could not split CSV file \"%s\" at record "
+									   "boundaries", fileName),
+								errdetail("A quoted value around byte offset "
+										  INT64_FORMAT " contains a newline.",
+										  shared->ranges[i].startOffset),
+								errhint("Load the file with columnar.enable_parallel_"
+										"execution set to off.")));
+			}
+		}
+
+		roundOffset = shared->ranges[rangeCount - 1].stopOffset;
+
+		for (int i = 0; i < pcxt->nworkers; i++)
+		{
+			shm_mq_detach(queues[i]);
+		}
+
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+
+		for (uint32 i = 0; i < rangeCount; i++)
+		{
+			if (rangeRows[i] != NULL)
+			{
+				WriteRangeRows(sink, rangeRows[i]);
+				tuplestore_end(rangeRows[i]);
+			}
+		}
+
+		pfree(rangeRows);
+		pfree(queues);
+	}
+
+	return Min(roundOffset, fileSize);
+}
+
+
+/*
+ * ReceiveRangeRows drains the queues of the launched workers until all of
+ * them detached. Every worker sends the index of a range it claimed,
+ * followed by the rows of the records that start in it.
+ */
+static void
+ReceiveRangeRows(ParallelContext *pcxt, shm_mq_handle **queues,
+				 Tuplestorestate **rangeRows, uint32 rangeCount,
+				 TupleDesc tupleDescriptor)
+{
+	int workerCount = pcxt->nworkers_launched;
+	int activeWorkerCount = workerCount;
+	bool *workerDetached = palloc0(workerCount * sizeof(bool));
+	uint32 *workerRange = palloc0(workerCount * sizeof(uint32));
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	/* split work_mem between the tuplestores, they spill to disk past it */
+	int rangeWorkMem = Max(work_mem / (int) rangeCount, 64);
+
+	while (activeWorkerCount > 0)
+	{
+		bool receivedAny = false;
+
+		for (int i = 0; i < workerCount; i++)
+		{
+			if (workerDetached[i])
+			{
+				continue;
+			}
+
+			Size nbytes = 0;
+			void *data = NULL;
+			shm_mq_result result = shm_mq_receive(queues[i], &nbytes, &data, true);
+
+			if (result == SHM_MQ_WOULD_BLOCK)
+			{
+				continue;
+			}
+			else if (result == SHM_MQ_DETACHED)
+			{
+				workerDetached[i] = true;
+				activeWorkerCount--;
+				continue;
+			}
+
+			receivedAny = true;
+
+			/* range indexes are shorter than any minimal tuple */
+			if (nbytes == sizeof(uint32))
+			{
+				uint32 rangeIndex = *(uint32 *) data;
+
+				if (rangeIndex >= rangeCount)
+				{
+					elog(ERROR, "parallel CSV load worker sent invalid range index %u",
+						 rangeIndex);
+				}
+
+				workerRange[i] = rangeIndex;
+				rangeRows[rangeIndex] = tuplestore_begin_heap(false, false,
+															  rangeWorkMem);
+				continue;
+			}
+
+			ExecStoreMinimalTuple((MinimalTuple) data, slot, false);
+			tuplestore_puttupleslot(rangeRows[workerRange[i]], slot);
+		}
+
+		if (!receivedAny && activeWorkerCount > 0)
+		{
+			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, 0,
+							 WAIT_EVENT_MQ_RECEIVE);
+			ResetLatch(MyLatch);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	pfree(workerDetached);
+	pfree(workerRange);
+}
+
+
+/*
+ * WriteRangeRows adds the rows that a worker parsed from a range to the
+ * slices written by the leader.
+ */
+static void
+WriteRangeRows(CsvLoadSink *sink, Tuplestorestate *rangeRows)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(sink->rel);
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+	Datum *values = palloc(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc(tupleDescriptor->natts * sizeof(bool));
+
+	while (tuplestore_gettupleslot(rangeRows, true, false, slot))
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		slot_getallattrs(slot);
+
+		/* the tuple of the slot goes away with the next one */
+		MemoryContext oldContext = MemoryContextSwitchTo(sink->sliceContext);
+
+		for (int i = 0; i < tupleDescriptor->natts; i++)
+		{
+			Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, i);
+
+			nulls[i] = slot->tts_isnull[i];
+			values[i] = nulls[i] ? (Datum) 0 :
+						datumCopy(slot->tts_values[i], attribute->attbyval,
+								  attribute->attlen);
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		CsvLoadAddRow(sink, values, nulls);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	pfree(values);
+	pfree(nulls);
+}
+
+
+/*
+ * LoadCsvRangeInLeader parses the records of the file that start between
+ * startOffset and fileSize in the leader, which startOffset is known to be
+ * the start of a record.
+ */
+static void
+LoadCsvRangeInLeader(CsvLoadSink *sink, FILE *file, const char *fileName,
+					 CsvLoadOptions *options, int64 startOffset, int64 fileSize)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(sink->rel);
+	CsvLoadColumns *columns = CsvLoadBeginColumns(tupleDescriptor);
+	Datum *values = palloc(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc(tupleDescriptor->natts * sizeof(bool));
+
+	CsvReader reader = { 0 };
+	CsvReaderBegin(&reader, file, fileName, options, startOffset, fileSize, true);
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = CsvLoadErrorCallback;
+	errorCallback.arg = &reader;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	if (startOffset == 0 && options->header)
+	{
+		(void) CsvReadRecord(&reader);
+	}
+
+	while (CsvReadRecord(&reader))
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(sink->sliceContext);
+		CsvRecordValues(columns, &reader, values, nulls);
+		MemoryContextSwitchTo(oldContext);
+
+		CsvLoadAddRow(sink, values, nulls);
+	}
+
+	error_context_stack = errorCallback.previous;
+}
+
+
+/*
+ * ColumnarParallelCsvLoadWorkerMain is the entry point of the parallel
+ * workers of columnar.load_csv. It claims ranges until there are none left.
+ */
+void
+ColumnarParallelCsvLoadWorkerMain(dsm_segment *seg, shm_toc *toc)
+{
+	ParallelCsvShared *shared = shm_toc_lookup(toc, PARALLEL_CSV_KEY_SHARED, false);
+	char *queueSpace = shm_toc_lookup(toc, PARALLEL_CSV_KEY_QUEUES, false);
+	char *fileName = shm_toc_lookup(toc, PARALLEL_CSV_KEY_STRINGS, false);
+
+	CsvLoadOptions options = { 0 };
+	options.delimiter = shared->delimiter;
+	options.quote = shared->quote;
+	options.nullString = fileName + strlen(fileName) + 1;
+
+	shm_mq *queue = (shm_mq *) (queueSpace +
+								ParallelWorkerNumber * PARALLEL_CSV_QUEUE_SIZE);
+	shm_mq_set_sender(queue, MyProc);
+	shm_mq_handle *queueHandle = shm_mq_attach(queue, seg, NULL);
+
+	/* the leader holds RowExclusiveLock, which doesn't conflict */
+	Relation relation = table_open(shared->relationId, AccessShareLock);
+
+	FILE *file = AllocateFile(fileName, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\" for reading: %m", fileName)));
+	}
+
+	MemoryContext rangeContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Parallel CSV Load Range Context",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	while (true)
+	{
+		uint32 rangeIndex = pg_atomic_fetch_add_u32(&shared->nextRange, 1);
+		if (rangeIndex >= shared->rangeCount)
+		{
+			break;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(rangeContext);
+
+		ParseRangeIntoQueue(relation, file, fileName, &options,
+							&shared->ranges[rangeIndex], rangeIndex, queueHandle);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(rangeContext);
+	}
+
+	FreeFile(file);
+	table_close(relation, AccessShareLock);
+	shm_mq_detach(queueHandle);
+}
+
+
+/*
+ * ParseRangeIntoQueue sends the range index followed by the rows of the
+ * records that start in the range, and records where the first of them
+ * starts and where parsing stopped.
+ */
+static void
+ParseRangeIntoQueue(Relation relation, FILE *file, const char *fileName,
+					CsvLoadOptions *options, ParallelCsvRange *range,
+					uint32 rangeIndex, shm_mq_handle *queue)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	CsvLoadColumns *columns = CsvLoadBeginColumns(tupleDescriptor);
+	Datum *values = palloc(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc(tupleDescriptor->natts * sizeof(bool));
+
+	shm_mq_result result = shm_mq_send_compat(queue, sizeof(uint32), &rangeIndex,
+											  false, true);
+	if (result != SHM_MQ_SUCCESS)
+	{
+		return;
+	}
+
+	CsvReader reader = { 0 };
+	CsvReaderBegin(&reader, file, fileName, options, range->startOffset,
+				   range->endOffset, range->exactStart);
+	range->firstRecordOffset = reader.recordOffset;
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = CsvLoadErrorCallback;
+	errorCallback.arg = &reader;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	if (range->skipHeader)
+	{
+		(void) CsvReadRecord(&reader);
+	}
+
+	MemoryContext rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "Parallel CSV Load Row Context",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	while (CsvReadRecord(&reader))
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(rowContext);
+
+		CsvRecordValues(columns, &reader, values, nulls);
+		MinimalTuple tuple = heap_form_minimal_tuple(tupleDescriptor, values, nulls);
+
+		result = shm_mq_send_compat(queue, tuple->t_len, tuple, false, false);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(rowContext);
+
+		if (result != SHM_MQ_SUCCESS)
+		{
+			break;
+		}
+	}
+
+	error_context_stack = errorCallback.previous;
+
+	range->stopOffset = reader.recordOffset;
+}
+
+
+/*
+ * CsvLoadBeginColumns looks up the input functions of the columns of a
+ * tuple descriptor.
+ */
+static CsvLoadColumns *
+CsvLoadBeginColumns(TupleDesc tupleDescriptor)
+{
+	CsvLoadColumns *columns = palloc0(sizeof(CsvLoadColumns));
+	columns->tupleDescriptor = tupleDescriptor;
+	columns->inputFunctions = palloc0(tupleDescriptor->natts * sizeof(FmgrInfo));
+	columns->typeIOParams = palloc0(tupleDescriptor->natts * sizeof(Oid));
+
+	for (int i = 0; i < tupleDescriptor->natts; i++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, i);
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		Oid inputFunctionId = InvalidOid;
+		getTypeInputInfo(attribute->atttypid, &inputFunctionId,
+						 &columns->typeIOParams[i]);
+		fmgr_info(inputFunctionId, &columns->inputFunctions[i]);
+	}
+
+	return columns;
+}
+
+
+/*
+ * CsvRecordValues converts the fields of the last record read into the
+ * values of the columns, in the order of the columns, like COPY does.
+ */
+static void
+CsvRecordValues(CsvLoadColumns *columns, CsvReader *reader, Datum *values,
+				bool *nulls)
+{
+	TupleDesc tupleDescriptor = columns->tupleDescriptor;
+	int fieldIndex = 0;
+
+	for (int i = 0; i < tupleDescriptor->natts; i++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, i);
+		if (attribute->attisdropped)
+		{
+			values[i] = (Datum) 0;
+			nulls[i] = true;
+			continue;
+		}
+
+		if (fieldIndex >= reader->fieldCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("missing data for column \"%s\"",
+								   NameStr(attribute->attname))));
+		}
+
+		char *field = reader->fieldData.data + reader->fieldStarts[fieldIndex];
+		bool isNull = !reader->fieldQuoted[fieldIndex] &&
+					  strcmp(field, reader->options->nullString) == 0;
+
+		if (!isNull)
+		{
+			pg_verifymbstr(field, strlen(field), false);
+		}
+
+		values[i] = InputFunctionCall(&columns->inputFunctions[i],
+									  isNull ? NULL : field,
+									  columns->typeIOParams[i],
+									  attribute->atttypmod);
+		nulls[i] = isNull;
+		fieldIndex++;
+	}
+
+	if (fieldIndex < reader->fieldCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("extra data after last expected column")));
+	}
+}
+
+
+/*
+ * CsvLoadAddRow adds a row to the current slice, whose values are in the
+ * slice context, and writes the slice once it is full.
+ */
+static void
+CsvLoadAddRow(CsvLoadSink *sink, Datum *values, bool *nulls)
+{
+	int columnCount = RelationGetDescr(sink->rel)->natts;
+	uint32 rowIndex = sink->sliceRowCount;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		sink->columnValues[columnIndex][rowIndex] = values[columnIndex];
+		sink->columnNulls[columnIndex][rowIndex] = nulls[columnIndex];
+	}
+
+	sink->sliceRowCount++;
+
+	if (sink->sliceRowCount == CSV_LOAD_SLICE_ROWS)
+	{
+		CsvLoadFlushSlice(sink);
+	}
+}
+
+
+/*
+ * CsvLoadFlushSlice writes the rows of the current slice.
+ */
+static void
+CsvLoadFlushSlice(CsvLoadSink *sink)
+{
+	uint32 sliceRowCount = sink->sliceRowCount;
+	if (sliceRowCount == 0)
+	{
+		return;
+	}
+
+	CheckColumnarImportNotNull(sink->rel, sink->columnNulls, sliceRowCount);
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(ColumnarWritePerTupleContext(sink->writeState));
+	ColumnarWriteBatch(sink->writeState, sink->columnValues, sink->columnNulls,
+					   sliceRowCount, sink->rowNumbers);
+	if (sink->logInserts)
+	{
+		ColumnarLogLogicalMultiInsert(sink->rel, sink->columnValues, sink->columnNulls,
+									  sink->rowNumbers, sliceRowCount);
+	}
+	MemoryContextReset(ColumnarWritePerTupleContext(sink->writeState));
+	MemoryContextSwitchTo(oldContext);
+
+	MemoryContextReset(sink->sliceContext);
+
+	sink->rowCount += sliceRowCount;
+	sink->sliceRowCount = 0;
+}
+
+
+/*
+ * CsvReaderBegin positions a reader at the first record of the range of
+ * the file from startOffset to endOffset. Unless startOffset is known to be
+ * the start of a record, that is taken to be the first line starting at or
+ * after it.
+ */
+static void
+CsvReaderBegin(CsvReader *reader, FILE *file, const char *fileName,
+			   CsvLoadOptions *options, int64 startOffset, int64 endOffset,
+			   bool exactStart)
+{
+	reader->file = file;
+	reader->fileName = fileName;
+	reader->options = options;
+	reader->endOffset = endOffset;
+	reader->buffer = palloc(CSV_LOAD_READ_BUFFER_SIZE);
+	reader->bufferOffset = exactStart ? startOffset : startOffset - 1;
+	reader->bufferLength = 0;
+	reader->bufferPosition = 0;
+
+	initStringInfo(&reader->fieldData);
+	reader->maxFieldCount = 16;
+	reader->fieldStarts = palloc(reader->maxFieldCount * sizeof(int));
+	reader->fieldQuoted = palloc(reader->maxFieldCount * sizeof(bool));
+	reader->fieldCount = 0;
+
+	if (fseeko(file, (off_t) reader->bufferOffset, SEEK_SET) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not seek in file \"%s\": %m", fileName)));
+	}
+
+	if (!exactStart)
+	{
+		int c = 0;
+		do {
+			c = CsvReadChar(reader);
+		} while (c != '\n' && c != EOF);
+	}
+
+	reader->recordOffset = reader->bufferOffset + reader->bufferPosition;
+}
+
+
+/*
+ * CsvReadRecord reads the fields of the next record into the reader, and
+ * returns false if there are no more records that start in its range.
+ * Values are quoted with the quote character, which is written twice for a
+ * quote within a quoted value, and records end with a newline outside of a
+ * quoted value.
+ */
+static bool
+CsvReadRecord(CsvReader *reader)
+{
+	char quote = reader->options->quote;
+	char delimiter = reader->options->delimiter;
+
+	reader->recordOffset = reader->bufferOffset + reader->bufferPosition;
+	if (reader->recordOffset >= reader->endOffset)
+	{
+		return false;
+	}
+
+	int c = CsvReadChar(reader);
+	if (c == EOF)
+	{
+		return false;
+	}
+
+	resetStringInfo(&reader->fieldData);
+	reader->fieldCount = 0;
+
+	int fieldStart = 0;
+	bool inQuotes = false;
+	bool fieldQuoted = false;
+
+	while (true)
+	{
+		if (c == EOF)
+		{
+			if (inQuotes)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unterminated CSV quoted field")));
+			}
+
+			break;
+		}
+
+		if (inQuotes)
+		{
+			if (c != quote)
+			{
+				appendStringInfoChar(&reader->fieldData, (char) c);
+			}
+			else if (CsvPeekChar(reader) == quote)
+			{
+				appendStringInfoChar(&reader->fieldData, quote);
+				(void) CsvReadChar(reader);
+			}
+			else
+			{
+				inQuotes = false;
+			}
+		}
+		else if (c == quote)
+		{
+			inQuotes = true;
+			fieldQuoted = true;
+		}
+		else if (c == delimiter)
+		{
+			reader->fieldStarts[reader->fieldCount] = fieldStart;
+			CsvAddField(reader, fieldQuoted);
+			fieldStart = reader->fieldData.len;
+			fieldQuoted = false;
+		}
+		else if (c == '\n')
+		{
+			break;
+		}
+		else if (c == '\r' && CsvPeekChar(reader) == '\n')
+		{
+			(void) CsvReadChar(reader);
+			break;
+		}
+		else
+		{
+			appendStringInfoChar(&reader->fieldData, (char) c);
+		}
+
+		c = CsvReadChar(reader);
+	}
+
+	reader->fieldStarts[reader->fieldCount] = fieldStart;
+	CsvAddField(reader, fieldQuoted);
+
+	return true;
+}
+
+
+/*
+ * CsvAddField ends the field that was appended to the field data of the
+ * reader last, whose start was already recorded.
+ */
+static void
+CsvAddField(CsvReader *reader, bool quoted)
+{
+	appendStringInfoChar(&reader->fieldData, '\0');
+	reader->fieldQuoted[reader->fieldCount] = quoted;
+	reader->fieldCount++;
+
+	if (reader->fieldCount == reader->maxFieldCount)
+	{
+		reader->maxFieldCount *= 2;
+		reader->fieldStarts = repalloc(reader->fieldStarts,
+									   reader->maxFieldCount * sizeof(int));
+		reader->fieldQuoted = repalloc(reader->fieldQuoted,
+									   reader->maxFieldCount * sizeof(bool));
+	}
+}
+
+
+/*
+ * CsvReadChar returns the next byte of the file, or EOF at its end.
+ */
+static int
+CsvReadChar(CsvReader *reader)
+{
+	int c = CsvPeekChar(reader);
+	if (c != EOF)
+	{
+		reader->bufferPosition++;
+	}
+
+	return c;
+}
+
+
+/*
+ * CsvPeekChar returns the next byte of the file without consuming it, or
+ * EOF at its end.
+ */
+static int
+CsvPeekChar(CsvReader *reader)
+{
+	if (reader->bufferPosition == reader->bufferLength)
+	{
+		reader->bufferOffset += reader->bufferLength;
+		reader->bufferPosition = 0;
+		reader->bufferLength = fread(reader->buffer, 1, CSV_LOAD_READ_BUFFER_SIZE,
+									 reader->file);
+
+		if (reader->bufferLength == 0)
+		{
+			if (ferror(reader->file))
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not read from file \"%s\": %m",
+									   reader->fileName)));
+			}
+
+			return EOF;
+		}
+	}
+
+	return (unsigned char) reader->buffer[reader->bufferPosition];
+}
+
+
+/*
+ * CsvLoadErrorCallback adds the record that was being loaded to errors.
+ */
+static void
+CsvLoadErrorCallback(void *arg)
+{
+	CsvReader *reader = (CsvReader *) arg;
+
+	errcontext("columnar.load_csv, file \"%s\", record at byte offset " INT64_FORMAT,
+			   reader->fileName, reader->recordOffset);
+}
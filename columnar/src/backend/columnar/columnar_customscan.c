@@ -20,12 +20,19 @@
 #include <math.h>
 
 #include "access/amapi.h"
+#include "access/parallel.h"
 #include "access/skey.h"
+#include "access/sysattr.h"
 #include "access/xact.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_opfamily.h"
 #include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "commands/explain.h"
+#include "executor/executor.h"
+#include "executor/hashjoin.h"
+#include "lib/binaryheap.h"
 #include "miscadmin.h"
 #include "nodes/extensible.h"
 #include "nodes/makefuncs.h"
@@ -39,18 +46,26 @@
 #include "optimizer/plancat.h"
 #include "optimizer/planner.h"
 #include "optimizer/restrictinfo.h"
+#include "pgstat.h"
 #include "storage/smgr.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/relcache.h"
+#include "utils/rls.h"
 #include "utils/ruleutils.h"
 #include "utils/selfuncs.h"
+#include "utils/snapmgr.h"
+#include "utils/sortsupport.h"
 #include "utils/spccache.h"
+#include "utils/typcache.h"
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
 #include "columnar/columnar_metadata.h"
 #include "columnar/columnar_tableam.h"
+#include "columnar/columnar_version_compat.h"
 #include "columnar/utils/listutils.h"
 
 #include "columnar/vectorization/columnar_vector_execution.h"
@@ -71,6 +86,79 @@ typedef struct ColumnarScanState
 	/* Parallel execution */
 	ParallelColumnarScan parallelColumnarScan;
 
+	/*
+	 * Shared state of a parallel scan, also set when the leader doesn't take
+	 * part in it, and the statistics its workers read from it on shutdown.
+	 */
+	ParallelColumnarScan sharedScanState;
+	ColumnarReadStatistics workerStatistics;
+
+	/*
+	 * Stripes the leader puts in the shared state of a parallel scan, see
+	 * BuildParallelStripeList().
+	 */
+	List *parallelStripeList;
+	bool parallelStripeListPruned;
+	uint64 parallelStripesPruned;
+	uint64 parallelChunkGroupsPruned;
+
+	/* rows a LIMIT above the scan needs at most, or 0 */
+	uint64 rowBound;
+
+	/* chunk groups the aggregate above gets the statistics of, or NULL */
+	ChunkGroupSummary *chunkGroupSummary;
+
+	/* stripes the aggregate above gets the projections of, or NULL */
+	StripeProjectionSummary *projectionSummary;
+
+	/*
+	 * Chunk groups the DELETE above deletes without reading, or NULL, and
+	 * how many of their rows were added to the processed rows of the DELETE.
+	 */
+	ColumnarChunkGroupDelete *chunkGroupDelete;
+	uint64 chunkGroupDeleteRowsCounted;
+
+	/* column the scan returns the rows in the order of, or InvalidAttrNumber */
+	AttrNumber sortKeyColumn;
+
+	/*
+	 * Filter on the join key, built from the hash table of the hash join
+	 * above, see SetupRuntimeFilter().
+	 */
+	struct
+	{
+		HashJoinState *hashJoinState;
+		Var *scanVar;
+		AttrNumber innerAttno;
+		FmgrInfo *hashFunction;
+		MemoryContext context;
+		bool built;
+		bytea *bloomFilter;
+		List *rangeClauses;
+		uint64 rowsRemoved;
+
+		/* the bloom filter for the read to skip chunk groups with */
+		ColumnarJoinKeyFilter joinKeyFilter;
+	} runtimeFilter;
+
+	/*
+	 * First sort keys of the rows that the top-N sort above keeps so far, in
+	 * a heap of indexes into values and nulls with the last row on top, see
+	 * TopNFilterAddRow(). NULL heap if there is no such sort.
+	 */
+	struct
+	{
+		ColumnarTopNBound bound;
+		SortSupportData sortKey;
+		int16 typeLength;
+		bool typeByValue;
+		binaryheap *heap;
+		Datum *values;
+		bool *nulls;
+		MemoryContext context;
+		uint64 rowsRemoved;
+	} topNFilter;
+
 	/* Vectorization */
 	struct
 	{
@@ -81,8 +169,36 @@ typedef struct ColumnarScanState
 		uint32 vectorPendingRowNumber;
 		uint32 vectorRowIndex;
 		List *vectorizedQualList;
-		List *constructedVectorizedQualList;
+		VectorQualPipeline *vectorQualPipeline;
+
+		/*
+		 * Params of the vectorized quals are evaluated when the pipeline is
+		 * built in vectorQualContext, so a rescan that may change the exec
+		 * params builds it again.
+		 */
+		bool vectorizedQualHasExecParams;
+		MemoryContext vectorQualContext;
 		List *attrNeededList;
+
+		/*
+		 * Columns of the rows taken from the vectors one at a time, which
+		 * leaves out the ones only the vectorized quals read.
+		 */
+		List *rowAttrNeededList;
+
+		/*
+		 * Computes the vectors the aggregate above gets from the vectors of
+		 * the reader, see InitVectorizedProjection. projectionAttnos has the
+		 * column of each attribute of the result, or 0 for the ones whose
+		 * vectorized function call is in projectionCalls. NULL
+		 * projectionCalls if the rows are projected one at a time.
+		 */
+		AttrNumber *projectionAttnos;
+		VectorQual **projectionCalls;
+		List *projectionCallExprList;
+
+		/* why the aggregate above runs row by row, or NULL */
+		char *aggregateFallbackReason;
 	} vectorization;
 
 	/* Scan snapshot*/
@@ -92,13 +208,28 @@ typedef struct ColumnarScanState
 
 typedef bool (*PathPredicate)(Path *path);
 
+/* join keys collected from a hash table, see BuildRuntimeFilter() */
+typedef struct RuntimeFilterKeys
+{
+	uint64 *hashes;
+	uint32 hashCount;
+	uint32 hashCapacity;
+
+	FmgrInfo *compareFunction;
+	Datum minimum;
+	Datum maximum;
+} RuntimeFilterKeys;
+
 
 /* functions to cost paths in-place */
 static void CostColumnarPaths(PlannerInfo *root, RelOptInfo *rel, Oid relationId);
 static void CostColumnarIndexPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 								  IndexPath *indexPath);
+static void CostColumnarBitmapHeapPath(PlannerInfo *root, RelOptInfo *rel,
+									   Oid relationId, BitmapHeapPath *bitmapPath);
 static void CostColumnarSeqPath(RelOptInfo *rel, Oid relationId, Path *path);
 static void AdjustColumnarParallelScanCost(Path *path);
+static double ColumnarParallelDivisor(Path *path);
 static void CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 							 CustomPath *cpath, int numberOfColumnsRead,
 							 int nClauses);
@@ -108,13 +239,22 @@ static void AddColumnarScanPaths(PlannerInfo *root, RelOptInfo *rel,
 								 RangeTblEntry *rte);
 static Path * AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel,
 								  RangeTblEntry *rte, Relids required_relids);
+static void AddColumnarSortedScanPath(PlannerInfo *root, RelOptInfo *rel,
+									  RangeTblEntry *rte);
 
 /* helper functions to be used when costing paths or altering them */
 static void RemovePathsByPredicate(RelOptInfo *rel, PathPredicate removePathPredicate);
-static bool IsNotIndexPath(Path *path);
+static bool IsNotIndexScanPath(Path *path);
+static bool IsParallelSeqScanPath(Path *path);
 static Cost ColumnarIndexScanAdditionalCost(PlannerInfo *root, RelOptInfo *rel,
 											Oid relationId, IndexPath *indexPath);
 static int RelationIdGetNumberOfAttributes(Oid relationId);
+static double EstimateColumnarStripeReads(PlannerInfo *root, RelOptInfo *rel,
+										  Oid relationId, CustomPath *cpath);
+static int ColumnarParallelWorkers(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
+								   CustomPath *cpath, int numberOfColumnsRead,
+								   int minimumWorkers);
+static int ColumnarScanColumnsRead(RangeTblEntry *rte);
 static Cost ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId,
 									  int numberOfColumnsRead);
 static uint64 ColumnarTableStripeCount(Oid relationId);
@@ -153,6 +293,9 @@ static TupleTableSlot * CustomExecScan(ColumnarScanState *node,
 static TupleTableSlot * ColumnarScan_ExecCustomScan(CustomScanState *node);
 static void ColumnarScan_EndCustomScan(CustomScanState *node);
 static void ColumnarScan_ReScanCustomScan(CustomScanState *node);
+static void SetVectorQualPipeline(ColumnarScanState *columnarScanState,
+								  TableScanDesc scandesc);
+static void ColumnarScan_ShutdownCustomScan(CustomScanState *node);
 static void ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
 										   ExplainState *es);
 static Size Columnar_EstimateDSMCustomScan(CustomScanState *node,
@@ -166,9 +309,16 @@ static void Columnar_ReinitializeDSMCustomScan(CustomScanState *node,
 static void Columnar_InitializeWorkerCustomScan(CustomScanState *node,
 												shm_toc *toc,
 												void *coordinate);
+static void BuildParallelStripeList(ColumnarScanState *columnarScanState);
+static void InitParallelStripeClaims(ParallelColumnarScan pscan,
+									 ParallelContext *pcxt);
 
 /* helper functions to build strings for EXPLAIN */
 static const char * ColumnarPushdownClausesStr(List *context, List *clauses);
+static void ExplainColumnarReadStatistics(ColumnarScanState *columnarScanState,
+										  ExplainState *es);
+static void ExplainVectorizationFallbacks(ColumnarScanState *columnarScanState,
+										  List *context, ExplainState *es);
 static const char * ColumnarProjectedColumnsStr(List *context,
 												List *projectedColumns);
 #if PG_VERSION_NUM >= 130000
@@ -180,17 +330,57 @@ static List * set_deparse_context_planstate(List *dpcontext, Node *node,
 static List * ColumnarVarNeeded(ColumnarScanState *columnarScanState);
 static Bitmapset * ColumnarAttrNeeded(ScanState *ss, List *customList);
 static bool IsCreateTableAs(const char *query);
+static bool ContainsParams(Node *node, void *notUsed);
+static bool ClausesReferenceSystemColumns(List *clauseList);
+static bool ChunkGroupDeleteSupported(CustomScanState *cscanstate, EState *estate,
+									  List *qualList);
+static void CountChunkGroupDeletes(ColumnarScanState *columnarScanState);
+static void ColumnarExecutorStart(QueryDesc *queryDesc, int eflags);
+static void FlushColumnarWritesForParallelPlan(QueryDesc *queryDesc);
+static bool SetupRuntimeFiltersWalker(PlanState *planState, void *context);
+static bool SetupIndexFetchProjectionsWalker(PlanState *planState, void *context);
+#if PG_VERSION_NUM >= PG_VERSION_14
+static Bitmapset * UpdateFetchAttrNeeded(Relation relation, List *updateColnos);
+#endif
+static Bitmapset * IndexFetchAttrNeeded(ScanState *scanState, List *recheckClauses);
+static void SetupRuntimeFilter(ColumnarScanState *columnarScanState,
+							   HashJoinState *hashJoinState);
+static void BuildRuntimeFilter(ColumnarScanState *columnarScanState);
+static void AddRuntimeFilterKey(ColumnarScanState *columnarScanState,
+								TupleTableSlot *innerSlot, HashJoinTuple hashTuple,
+								RuntimeFilterKeys *keys);
+static List * RuntimeFilterRangeClauses(Var *scanVar, Datum minimum, Datum maximum);
+static List * TopNSortKey(PlannerInfo *root, RelOptInfo *rel, PathKey *pathkey);
+static bool RuntimeFilterMayContain(ColumnarScanState *columnarScanState,
+									TupleTableSlot *slot);
+static void ResetRuntimeFilter(ColumnarScanState *columnarScanState);
+static void InitTopNFilter(ColumnarScanState *columnarScanState, List *topNSortKey,
+						   MemoryContext queryContext);
+static int TopNFilterCompare(Datum a, Datum b, void *arg);
+static void TopNFilterAddRow(ColumnarScanState *columnarScanState, Datum value,
+							 bool isNull);
+static void ResetTopNFilter(ColumnarScanState *columnarScanState);
+static void InitVectorizedProjection(ColumnarScanState *columnarScanState);
+static TupleTableSlot * ProjectVectorSlot(ColumnarScanState *columnarScanState,
+										  VectorTupleTableSlot *vectorSlot);
 
 /* saved hook value in case of unload */
 static set_rel_pathlist_hook_type PreviousSetRelPathlistHook = NULL;
 static get_relation_info_hook_type PreviousGetRelationInfoHook = NULL;
 static planner_hook_type PreviousPlannerHook = NULL;
+static ExecutorStart_hook_type PreviousExecutorStartHook = NULL;
 
 static bool EnableColumnarCustomScan = true;
 static bool EnableColumnarQualPushdown = true;
 static double ColumnarQualPushdownCorrelationThreshold = 0.9;
 static int ColumnarMaxCustomScanPaths = 64;
 static int ColumnarPlannerDebugLevel = DEBUG3;
+static bool EnableColumnarRuntimeFilter = true;
+static bool EnableColumnarTopNFilter = true;
+static bool EnableColumnarSortedScan = true;
+
+/* the top-N filter keeps the sort keys of this many rows at most */
+#define COLUMNAR_TOP_N_FILTER_MAX_ROWS 100000
 
 
 const struct CustomPathMethods ColumnarScanPathMethods = {
@@ -217,7 +407,8 @@ const struct CustomExecMethods ColumnarScanExecuteMethods = {
 	.EstimateDSMCustomScan = Columnar_EstimateDSMCustomScan,
 	.InitializeDSMCustomScan = Columnar_InitializeDSMCustomScan,
 	.ReInitializeDSMCustomScan = Columnar_ReinitializeDSMCustomScan,
-	.InitializeWorkerCustomScan = Columnar_InitializeWorkerCustomScan
+	.InitializeWorkerCustomScan = Columnar_InitializeWorkerCustomScan,
+	.ShutdownCustomScan = ColumnarScan_ShutdownCustomScan
 };
 
 static const struct config_enum_entry debug_level_options[] = {
@@ -242,6 +433,104 @@ columnar_customscan_methods(void)
 }
 
 
+/*
+ * IsColumnarScanPath returns true if the given path is a columnar custom scan
+ * path.
+ */
+bool
+IsColumnarScanPath(Path *path)
+{
+	return IsA(path, CustomPath) &&
+		   ((CustomPath *) path)->methods == &ColumnarScanPathMethods;
+}
+
+
+/*
+ * ColumnarScanChunkGroupSummary returns the summary of the chunk groups that
+ * the given columnar scan left out for the aggregate above it, or NULL if the
+ * plan state isn't such a scan.
+ */
+ChunkGroupSummary *
+ColumnarScanChunkGroupSummary(PlanState *planState)
+{
+	if (!IsA(planState, CustomScanState) ||
+		((CustomScanState *) planState)->methods != &ColumnarScanExecuteMethods)
+	{
+		return NULL;
+	}
+
+	return ((ColumnarScanState *) planState)->chunkGroupSummary;
+}
+
+
+/*
+ * ColumnarScanStripeProjectionSummary returns the groups of the stripe
+ * projections that the given columnar scan answered the aggregate above it
+ * with, or NULL if the plan state isn't such a scan.
+ */
+StripeProjectionSummary *
+ColumnarScanStripeProjectionSummary(PlanState *planState)
+{
+	if (!IsA(planState, CustomScanState) ||
+		((CustomScanState *) planState)->methods != &ColumnarScanExecuteMethods)
+	{
+		return NULL;
+	}
+
+	return ((ColumnarScanState *) planState)->projectionSummary;
+}
+
+
+/*
+ * StripeProjectionsCover returns true if the projections of the given
+ * relation keep the group by, summed and counted columns of the given list,
+ * see StripeProjectionColumns() of the planner hook.
+ */
+static bool
+StripeProjectionsCover(Oid relationId, List *projectionColumns)
+{
+	ColumnarOptions options = { 0 };
+	if (!ReadColumnarOptions(relationId, &options))
+	{
+		return false;
+	}
+
+	Bitmapset *keptColumns = bms_union(options.projectionGroupByColumns,
+									   options.projectionSumColumns);
+	if (bms_is_empty(keptColumns))
+	{
+		return false;
+	}
+
+	int attnum = 0;
+	foreach_int(attnum, (List *) linitial(projectionColumns))
+	{
+		if (!bms_is_member(attnum, options.projectionGroupByColumns))
+		{
+			return false;
+		}
+	}
+
+	foreach_int(attnum, (List *) lsecond(projectionColumns))
+	{
+		if (!bms_is_member(attnum, options.projectionSumColumns))
+		{
+			return false;
+		}
+	}
+
+	foreach_int(attnum, (List *) lthird(projectionColumns))
+	{
+		if (!bms_is_member(attnum, keptColumns))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * columnar_customscan_init installs the hook required to intercept the postgres planner and
  * provide extra paths for columnar tables
@@ -258,6 +547,9 @@ columnar_customscan_init()
 	PreviousPlannerHook = planner_hook;
 	planner_hook = ColumnarPlannerHook;
 
+	PreviousExecutorStartHook = ExecutorStart_hook;
+	ExecutorStart_hook = ColumnarExecutorStart;
+
 	/* register customscan specific GUC's */
 	DefineCustomBoolVariable(
 		"columnar.enable_custom_scan",
@@ -305,6 +597,42 @@ columnar_customscan_init()
 		PGC_USERSET,
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
+	DefineCustomBoolVariable(
+		"columnar.enable_runtime_filter",
+		gettext_noop("Enables filtering the rows of a columnar scan below a hash "
+					 "join with the join keys of the hash table, and skipping "
+					 "the chunk groups outside of their range. This has no "
+					 "effect unless columnar.enable_custom_scan is true."),
+		NULL,
+		&EnableColumnarRuntimeFilter,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+	DefineCustomBoolVariable(
+		"columnar.enable_top_n_filter",
+		gettext_noop("Enables skipping the chunk groups and rows of a columnar "
+					 "scan below a sort with a LIMIT that can't be among the "
+					 "rows the sort keeps. This has no effect unless "
+					 "columnar.enable_custom_scan is true."),
+		NULL,
+		&EnableColumnarTopNFilter,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+	DefineCustomBoolVariable(
+		"columnar.enable_sorted_scan",
+		gettext_noop("Enables columnar scans that return the rows of a table "
+					 "with a sort key in the order of the sort key, by merging "
+					 "its sorted stripes. This has no effect unless "
+					 "columnar.enable_custom_scan is true."),
+		NULL,
+		&EnableColumnarSortedScan,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
 	DefineCustomEnumVariable(
 		"columnar.planner_debug_level",
 		"Message level for columnar planning information.",
@@ -428,8 +756,9 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 	{
 		if (rte->tablesample != NULL)
 		{
-			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("sample scans not supported on columnar tables")));
+			/* sampled relations are only read by the sample scan path */
+			RelationClose(relation);
+			return;
 		}
 
 		/*
@@ -463,9 +792,17 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 			 * In that case, if we don't remove SeqPath's, we might wrongly choose
 			 * SeqPath thinking that its cost would be equal to ColumnarCustomScan.
 			 */
-			RemovePathsByPredicate(rel, IsNotIndexPath);
+			RemovePathsByPredicate(rel, IsNotIndexScanPath);
 			AddColumnarScanPaths(root, rel, rte);
 		}
+		else
+		{
+			/*
+			 * Parallel index and bitmap heap scans are the only partial paths
+			 * that we cost for columnar, see ColumnarGetRelationInfoHook.
+			 */
+			RemovePathsByPredicate(rel, IsParallelSeqScanPath);
+		}
 	}
 	RelationClose(relation);
 }
@@ -482,8 +819,40 @@ ColumnarGetRelationInfoHook(PlannerInfo *root, Oid relationObjectId,
 
 	if (IsColumnarTableAmTable(relationObjectId))
 	{
-		/* disable parallel query */
-		rel->rel_parallel_workers = 0;
+		if (!columnar_enable_parallel_execution)
+		{
+			/* disable parallel query */
+			rel->rel_parallel_workers = 0;
+		}
+		else if (root->parse->jointree == NULL)
+		{
+			/*
+			 * plan_create_index_workers plans parallel index builds with a
+			 * query that has no join tree. Their workers read the table with
+			 * a parallel table scan, and can't see the writes that this
+			 * transaction didn't flush yet, so flush them before the leader
+			 * enters parallel mode.
+			 */
+			Relation relation = RelationIdGetRelation(relationObjectId);
+			Oid relfilenode = relation->rd_node.relNode;
+			RelationClose(relation);
+
+			RowMaskFlushWriteStateForRelfilenode(relfilenode,
+												 GetCurrentSubTransactionId());
+			FlushWriteStateForRelfilenode(relfilenode, GetCurrentSubTransactionId());
+		}
+		else if (rel->indexlist == NIL)
+		{
+			/*
+			 * Our custom scan adds its own partial paths, so we only let
+			 * postgres plan parallel scans when there are indexes to plan
+			 * parallel index and bitmap heap scans with. Workers fetch the rows
+			 * of the TIDs that the index AM hands them, and the leader flushes
+			 * the pending writes before it starts them, see
+			 * FlushColumnarWritesForParallelPlan.
+			 */
+			rel->rel_parallel_workers = 0;
+		}
 
 		/* disable index-only scan */
 		IndexOptInfo *indexOptInfo = NULL;
@@ -529,12 +898,24 @@ RemovePathsByPredicate(RelOptInfo *rel, PathPredicate removePathPredicate)
 
 
 /*
- * IsNotIndexPath returns true if given path is not an IndexPath.
+ * IsNotIndexScanPath returns true if given path is neither an IndexPath nor
+ * a BitmapHeapPath.
+ */
+static bool
+IsNotIndexScanPath(Path *path)
+{
+	return !IsA(path, IndexPath) && !IsA(path, BitmapHeapPath);
+}
+
+
+/*
+ * IsParallelSeqScanPath returns true if given path is a parallel-aware
+ * sequential scan.
  */
 static bool
-IsNotIndexPath(Path *path)
+IsParallelSeqScanPath(Path *path)
 {
-	return !IsA(path, IndexPath);
+	return path->pathtype == T_SeqScan && path->parallel_aware;
 }
 
 
@@ -562,25 +943,26 @@ CreateColumnarSeqScanPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId)
 static void
 CostColumnarPaths(PlannerInfo *root, RelOptInfo *rel, Oid relationId)
 {
+	List *pathList = list_concat_copy(rel->pathlist, rel->partial_pathlist);
+
 	Path *path = NULL;
-	foreach_ptr(path, rel->pathlist)
+	foreach_ptr(path, pathList)
 	{
 		if (IsA(path, IndexPath))
 		{
-			/*
-			 * Since we don't provide implementations for scan_bitmap_next_block
-			 * & scan_bitmap_next_tuple, postgres doesn't generate bitmap index
-			 * scan paths for columnar tables already (see related comments in
-			 * TableAmRoutine). For this reason, we only consider IndexPath's
-			 * here.
-			 */
 			CostColumnarIndexPath(root, rel, relationId, (IndexPath *) path);
 		}
-		else if (path->pathtype == T_SeqScan)
+		else if (IsA(path, BitmapHeapPath))
+		{
+			CostColumnarBitmapHeapPath(root, rel, relationId, (BitmapHeapPath *) path);
+		}
+		else if (path->pathtype == T_SeqScan && !path->parallel_aware)
 		{
 			CostColumnarSeqPath(rel, relationId, path);
 		}
 	}
+
+	list_free(pathList);
 }
 
 
@@ -610,7 +992,10 @@ CostColumnarIndexPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 	 */
 	Cost columnarIndexScanCost = ColumnarIndexScanAdditionalCost(root, rel, relationId,
 																 indexPath);
-	indexPath->path.total_cost += columnarIndexScanCost;
+
+	/* the workers of a parallel index scan share the stripe reads */
+	indexPath->path.total_cost += columnarIndexScanCost /
+								  ColumnarParallelDivisor(&indexPath->path);
 
 	ereport(DEBUG4, (errmsg("columnar table index scan costs re-estimated "
 							"by columnarAM (including indexAM costs): "
@@ -620,6 +1005,49 @@ CostColumnarIndexPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 }
 
 
+/*
+ * CostColumnarBitmapHeapPath re-costs given bitmap heap scan path for
+ * columnar table with relationId. A bitmap heap scan reads the rows in row
+ * number order, so unlike an index scan, it reads each stripe at most once.
+ */
+static void
+CostColumnarBitmapHeapPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
+						   BitmapHeapPath *bitmapPath)
+{
+	if (!enable_bitmapscan)
+	{
+		/* costs are already set to disable_cost, don't adjust them */
+		return;
+	}
+
+	Cost fakeBitmapCost;
+	Selectivity bitmapSelectivity;
+	cost_bitmap_tree_node(bitmapPath->bitmapqual, &fakeBitmapCost, &bitmapSelectivity);
+
+	int numberOfColumnsRead = RelationIdGetNumberOfAttributes(relationId);
+	Cost perStripeCost = ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+
+	Relation relation = RelationIdGetRelation(relationId);
+	uint64 rowCount = ColumnarTableRowCount(relation);
+	RelationClose(relation);
+
+	double estimatedRows = rowCount * bitmapSelectivity;
+	double stripeCount = ColumnarTableStripeCount(relationId);
+	double estimatedStripeReadCount = Max(Min(estimatedRows, stripeCount), 1.0);
+
+	Cost scanCost = perStripeCost * estimatedStripeReadCount /
+					ColumnarParallelDivisor(&bitmapPath->path);
+	bitmapPath->path.total_cost += scanCost;
+
+	ereport(DEBUG4, (errmsg("re-costing bitmap heap scan for columnar table: "
+							"selectivity = %.10f, per stripe cost = %.10f, "
+							"estimated stripe read count = %.10f, "
+							"total additional cost = %.10f",
+							bitmapSelectivity, perStripeCost,
+							estimatedStripeReadCount, scanCost)));
+}
+
+
 /*
  * ColumnarIndexScanAdditionalCost returns additional cost estimated for
  * index scan described by IndexPath for columnar table with relationId.
@@ -830,6 +1258,53 @@ ExprReferencesRelid(Expr *expr, Index relid)
 }
 
 
+/*
+ * IsShreddedKeyClause returns true if the clause compares Var->>'key', for a
+ * jsonb Var of rel, with an expression of other rels using a text btree
+ * operator, or tests it for NULL. Chunks of jsonb columns refute those by the
+ * statistics of their shredded keys. The clause is pushed down even if the
+ * key isn't shredded, the statistics of older chunks are looked up by key.
+ */
+static bool
+IsShreddedKeyClause(RelOptInfo *rel, Node *node)
+{
+	Var *column = NULL;
+	char *key = NULL;
+
+	if (IsA(node, NullTest))
+	{
+		NullTest *nullTest = castNode(NullTest, node);
+		return !nullTest->argisrow &&
+			   ColumnarShreddedKeyExpression((Node *) nullTest->arg, &column, &key) &&
+			   column->varno == rel->relid;
+	}
+
+	if (!IsA(node, OpExpr) || list_length(((OpExpr *) node)->args) != 2)
+	{
+		return false;
+	}
+
+	OpExpr *opExpr = castNode(OpExpr, node);
+	Node *keySide = linitial(opExpr->args);
+	Node *exprSide = lsecond(opExpr->args);
+	if (!ColumnarShreddedKeyExpression(keySide, &column, &key))
+	{
+		keySide = lsecond(opExpr->args);
+		exprSide = linitial(opExpr->args);
+		if (!ColumnarShreddedKeyExpression(keySide, &column, &key))
+		{
+			return false;
+		}
+	}
+
+	return column->varno == rel->relid &&
+		   exprType(exprSide) == TEXTOID &&
+		   !ExprReferencesRelid((Expr *) exprSide, rel->relid) &&
+		   !contain_volatile_functions(exprSide) &&
+		   op_in_opfamily(opExpr->opno, TEXT_BTREE_FAM_OID);
+}
+
+
 /*
  * ExtractPushdownClause extracts an Expr node from given clause for pushing down
  * into the given rel (including join clauses). This test may not be exact in
@@ -839,7 +1314,10 @@ ExprReferencesRelid(Expr *expr, Index relid)
  * would require going through eval_const_expression after parameter binding,
  * and that doesn't seem worth the effort. Here we just look for "Var op Expr"
  * or "Expr op Var", where Var references rel and Expr references other rels
- * (or no rels at all).
+ * (or no rels at all), and for "Var IS [NOT] NULL", which the null states
+ * and null counts of the chunks refute. Comparisons of Var->>'key' of a jsonb
+ * Var with text, and null tests of it, are pushed down for the statistics of
+ * shredded keys, see IsShreddedKeyClause.
  *
  * Moreover, this function also looks into BoolExpr's to recursively extract
  * pushdownable OpExpr's of them:
@@ -959,6 +1437,27 @@ ExtractPushdownClause(PlannerInfo *root, RelOptInfo *rel, Node *node)
 		}
 	}
 
+	if (IsShreddedKeyClause(rel, node))
+	{
+		return (Expr *) node;
+	}
+
+	if (IsA(node, NullTest))
+	{
+		NullTest *nullTest = castNode(NullTest, node);
+		if (nullTest->argisrow || !IsA(nullTest->arg, Var) ||
+			((Var *) nullTest->arg)->varno != rel->relid ||
+			((Var *) nullTest->arg)->varattno <= 0)
+		{
+			ereport(ColumnarPlannerDebugLevel,
+					(errmsg("columnar planner: cannot push down clause: "
+							"null test must be on a column of this rel")));
+			return NULL;
+		}
+
+		return (Expr *) node;
+	}
+
 	if (!IsA(node, OpExpr) || list_length(((OpExpr *) node)->args) != 2)
 	{
 		ereport(ColumnarPlannerDebugLevel,
@@ -1312,6 +1811,11 @@ AddColumnarScanPathsRec(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 
 	Path *columnarScanPath = AddColumnarScanPath(root, rel, rte, paramRelids);
 	add_path(rel, columnarScanPath);
+
+	if (EnableColumnarSortedScan && bms_is_empty(paramRelids))
+	{
+		AddColumnarSortedScanPath(root, rel, rte);
+	}
 	if (columnar_enable_parallel_execution)
 		columnarScanPath->total_cost += columnarScanPath->rows * 0.1;
 
@@ -1351,7 +1855,11 @@ AddColumnarScanPathsRec(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 			Path *parallelColumnarScanPath = 
 				AddColumnarScanPath(root, rel, rte, NULL);
 
-			parallelColumnarScanPath->parallel_workers = columnar_min_parallel_process_running;
+			parallelColumnarScanPath->parallel_workers =
+				ColumnarParallelWorkers(root, rel, rte->relid,
+										(CustomPath *) parallelColumnarScanPath,
+										ColumnarScanColumnsRead(rte),
+										columnar_min_parallel_process_running);
 			parallelColumnarScanPath->parallel_aware = true;
 			AdjustColumnarParallelScanCost(parallelColumnarScanPath);
 
@@ -1432,6 +1940,25 @@ ParameterizationAsString(PlannerInfo *root, Relids paramRelids, StringInfo buf)
 }
 
 
+/*
+ * ContainsParams tests whether the node contains any params. The signature
+ * accepts an extra argument for use with expression_tree_walker.
+ */
+static bool
+ContainsParams(Node *node, void *notUsed)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+	else if (IsA(node, Param))
+	{
+		return true;
+	}
+	return expression_tree_walker(node, ContainsParams, NULL);
+}
+
+
 /*
  * ContainsExecParams tests whether the node contains any exec params. The
  * signature accepts an extra argument for use with expression_tree_walker.
@@ -1536,16 +2063,9 @@ AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 		cpath->custom_private = list_make2(NIL, NIL);
 	}
 
-	int numberOfColumnsRead = bms_num_members(rte->selectedCols);
+	int numberOfColumnsRead = ColumnarScanColumnsRead(rte);
 	int numberOfClausesPushed = list_length(allClauses);
 
-	/* Queries that contain only aggregate with STAR doesn't have any
-	 * selectedCols so we should consider at least one column that needs
-	 * read (for better cost calculation).
-	 */
-	if (numberOfColumnsRead == 0)
-		numberOfColumnsRead = 1;
-
 	CostColumnarScan(root, rel, rte->relid, cpath, numberOfColumnsRead,
 					 numberOfClausesPushed);
 
@@ -1564,38 +2084,148 @@ AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 
 
 /*
- * AdjustColumnarParallelScanCost calculates path cost based on
- * number of parallel workers (based on postgres code).
+ * AddColumnarSortedScanPath adds a path that returns the rows of a columnar
+ * table with a sort key in the order of the sort key, if the query has a use
+ * for the order, see ColumnarBeginMergeRead().
  */
 static void
-AdjustColumnarParallelScanCost(Path *path) 
+AddColumnarSortedScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 {
-	/* Adjust costing for parallelism, if used. */
-	if (path->parallel_workers > 0)
+	ColumnarOptions options = { 0 };
+	if (!ReadColumnarOptions(rte->relid, &options) ||
+		options.sortKeyColumn == InvalidAttrNumber)
 	{
-		double parallel_divisor = path->parallel_workers;
+		return;
+	}
 
-		if (parallel_leader_participation)
-		{
-			double leader_contribution;
+	AttrNumber sortKeyColumn = options.sortKeyColumn;
 
-			leader_contribution = 1.0 - (0.3 * path->parallel_workers);
-			if (leader_contribution > 0)
-				parallel_divisor += leader_contribution;
-		}
+	Relation relation = RelationIdGetRelation(rte->relid);
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(RelationGetDescr(relation), AttrNumberGetAttrOffset(sortKeyColumn));
 
-		/* The CPU cost is divided among all the workers. */
-		path->total_cost /= parallel_divisor;
+	/* the merge needs the chunk skip nodes to tell which stripes are sorted */
+	bool sortednessTracked = !attributeForm->attisdropped &&
+							 ColumnarSortednessTracked(attributeForm);
+	Oid sortKeyType = attributeForm->atttypid;
+	int32 sortKeyTypmod = attributeForm->atttypmod;
+	Oid sortKeyCollation = attributeForm->attcollation;
 
-		path->rows = clamp_row_est(path->rows / parallel_divisor);
+	RelationClose(relation);
+
+	if (!sortednessTracked)
+	{
+		return;
 	}
-}
 
+	TypeCacheEntry *typeEntry = lookup_type_cache(sortKeyType, TYPECACHE_LT_OPR);
+	if (!OidIsValid(typeEntry->lt_opr))
+	{
+		return;
+	}
 
-/*
- * CostColumnarScan calculates the cost of scanning the columnar table. The
+	Var *sortKeyVar = makeVar(rel->relid, sortKeyColumn, sortKeyType, sortKeyTypmod,
+							  sortKeyCollation, 0);
+	List *pathkeys = build_expression_pathkey(root, (Expr *) sortKeyVar, NULL,
+											  typeEntry->lt_opr, rel->relids, false);
+	pathkeys = truncate_useless_pathkeys(root, rel, pathkeys);
+	if (pathkeys == NIL)
+	{
+		return;
+	}
+
+	CustomPath *cpath = (CustomPath *) AddColumnarScanPath(root, rel, rte, NULL);
+	cpath->path.pathkeys = pathkeys;
+
+	/* the third element of custom_private tells the scan to merge the stripes */
+	cpath->custom_private = lappend(cpath->custom_private, makeInteger(sortKeyColumn));
+
+	/* each row is compared with the rows of the other runs of stripes */
+	double stripeCount = ColumnarTableStripeCount(rte->relid);
+	cpath->path.total_cost += cpu_operator_cost * cpath->path.rows *
+							  log2(stripeCount + 1);
+
+	ereport(ColumnarPlannerDebugLevel,
+			(errmsg("columnar planner: adding sorted CustomScan path for %s",
+					rte->eref->aliasname)));
+
+	add_path(rel, (Path *) cpath);
+}
+
+
+/*
+ * ColumnarScanColumnsRead returns the number of columns a columnar scan of
+ * the given range table entry reads.
+ */
+static int
+ColumnarScanColumnsRead(RangeTblEntry *rte)
+{
+	int numberOfColumnsRead = bms_num_members(rte->selectedCols);
+
+	/* Queries that contain only aggregate with STAR doesn't have any
+	 * selectedCols so we should consider at least one column that needs
+	 * read (for better cost calculation).
+	 */
+	if (numberOfColumnsRead == 0)
+		numberOfColumnsRead = 1;
+
+	return numberOfColumnsRead;
+}
+
+
+/*
+ * AdjustColumnarParallelScanCost calculates path cost based on
+ * number of parallel workers (based on postgres code).
+ */
+static void
+AdjustColumnarParallelScanCost(Path *path) 
+{
+	/* Adjust costing for parallelism, if used. */
+	if (path->parallel_workers > 0)
+	{
+		double parallel_divisor = ColumnarParallelDivisor(path);
+
+		/* The CPU cost is divided among all the workers. */
+		path->total_cost /= parallel_divisor;
+
+		path->rows = clamp_row_est(path->rows / parallel_divisor);
+	}
+}
+
+
+/*
+ * ColumnarParallelDivisor returns the share of the work that each process of
+ * given path does, the same way as get_parallel_divisor, or 1 for paths that
+ * aren't parallel.
+ */
+static double
+ColumnarParallelDivisor(Path *path)
+{
+	if (path->parallel_workers <= 0)
+	{
+		return 1.0;
+	}
+
+	double parallel_divisor = path->parallel_workers;
+
+	if (parallel_leader_participation)
+	{
+		double leader_contribution = 1.0 - (0.3 * path->parallel_workers);
+		if (leader_contribution > 0)
+		{
+			parallel_divisor += leader_contribution;
+		}
+	}
+
+	return parallel_divisor;
+}
+
+
+/*
+ * CostColumnarScan calculates the cost of scanning the columnar table. The
  * cost is estimated by using all stripe metadata to estimate based on the
- * columns to read how many pages need to be read.
+ * columns to read how many pages need to be read, scaled by the fraction of
+ * the chunk groups that the pushed down clauses don't refute.
  */
 static void
 CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
@@ -1603,22 +2233,113 @@ CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 {
 	Path *path = &cpath->path;
 
+	double stripesToRead = EstimateColumnarStripeReads(root, rel, relationId, cpath);
+
+	path->rows = rel->tuples;
+	path->startup_cost = 0;
+	path->total_cost = stripesToRead *
+					   ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+}
+
+
+/*
+ * EstimateColumnarStripeReads estimates how many stripes worth of data the
+ * given columnar scan path reads, given the chunk groups that its pushed
+ * down clauses refute. The result is at least 1.
+ */
+static double
+EstimateColumnarStripeReads(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
+							CustomPath *cpath)
+{
+	/*
+	 * Clauses without params can be checked against the min/max values of
+	 * the chunk groups, which tells how much of the table they let us skip.
+	 */
 	List *allClauses = lsecond(cpath->custom_private);
-	Selectivity clauseSel = clauselist_selectivity(
-		root, allClauses, rel->relid, JOIN_INNER, NULL);
+	List *estimatedClauses = NIL;
+	List *remainingClauses = NIL;
+	RestrictInfo *rinfo = NULL;
+	foreach_ptr(rinfo, allClauses)
+	{
+		if (list_member(linitial(cpath->custom_private), rinfo) &&
+			!ContainsParams((Node *) rinfo->clause, NULL))
+		{
+			estimatedClauses = lappend(estimatedClauses, rinfo->clause);
+		}
+		else
+		{
+			remainingClauses = lappend(remainingClauses, rinfo);
+		}
+	}
+
+	Relation relation = RelationIdGetRelation(relationId);
+	double chunkGroupFraction = ColumnarChunkGroupReadFraction(relation,
+															   estimatedClauses);
+	RelationClose(relation);
 
 	/*
 	 * We already filtered out clauses where the overall selectivity would be
 	 * misleading, such as inequalities involving an uncorrelated column. So
-	 * we can apply the selectivity directly to the number of stripes.
+	 * we can apply the selectivity of the other clauses directly to the
+	 * number of stripes.
 	 */
+	Selectivity clauseSel = chunkGroupFraction * clauselist_selectivity(
+		root, remainingClauses, rel->relid, JOIN_INNER, NULL);
+
 	double stripesToRead = clauseSel * ColumnarTableStripeCount(relationId);
-	stripesToRead = Max(stripesToRead, 1.0);
 
-	path->rows = rel->tuples;
-	path->startup_cost = 0;
-	path->total_cost = stripesToRead *
-					   ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+	return Max(stripesToRead, 1.0);
+}
+
+
+/*
+ * ColumnarParallelWorkers returns the number of workers to plan for the
+ * given parallel columnar scan path. Workers take one stripe at a time, so
+ * beyond minimumWorkers, which is already limited by the number of stripes,
+ * we only add workers for the stripes that survive pruning. Like
+ * compute_parallel_worker, we add a worker each time the data to read
+ * triples, up to max_parallel_workers_per_gather.
+ */
+static int
+ColumnarParallelWorkers(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
+						CustomPath *cpath, int numberOfColumnsRead,
+						int minimumWorkers)
+{
+	Relation relation = RelationIdGetRelation(relationId);
+	StripeListSummary stripeListSummary = StripeListSummaryForRelation(relation);
+	RelationClose(relation);
+
+	if (stripeListSummary.stripeCount == 0 || stripeListSummary.maxColumnCount == 0)
+	{
+		return minimumWorkers;
+	}
+
+	double stripesToRead = EstimateColumnarStripeReads(root, rel, relationId, cpath);
+	double columnSelectionRatio =
+		numberOfColumnsRead / (double) stripeListSummary.maxColumnCount;
+	double bytesToRead = stripeListSummary.totalDataLength * columnSelectionRatio *
+						 (stripesToRead / stripeListSummary.stripeCount);
+
+	int parallelWorkers = 1;
+	double threshold = Max((double) min_parallel_table_scan_size, 1.0) * BLCKSZ;
+	while (bytesToRead >= threshold * 3 && parallelWorkers < max_parallel_workers)
+	{
+		parallelWorkers++;
+		threshold *= 3;
+	}
+
+	parallelWorkers = Min(parallelWorkers, max_parallel_workers_per_gather);
+
+	/* the leader takes stripes too */
+	int workUnits = (int) ceil(stripesToRead);
+	if (parallel_leader_participation)
+	{
+		workUnits--;
+	}
+
+	parallelWorkers = Min(parallelWorkers, workUnits);
+
+	return Max(minimumWorkers, parallelWorkers);
 }
 
 
@@ -1631,17 +2352,11 @@ static Cost
 ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId, int numberOfColumnsRead)
 {
 	Relation relation = RelationIdGetRelation(relationId);
-	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+	StripeListSummary stripeListSummary = StripeListSummaryForRelation(relation);
 	RelationClose(relation);
 
-	uint32 maxColumnCount = 0;
-	uint64 totalStripeSize = 0;
-	StripeMetadata *stripeMetadata = NULL;
-	foreach_ptr(stripeMetadata, stripeList)
-	{
-		totalStripeSize += stripeMetadata->dataLength;
-		maxColumnCount = Max(maxColumnCount, stripeMetadata->columnCount);
-	}
+	uint32 maxColumnCount = stripeListSummary.maxColumnCount;
+	uint64 totalStripeSize = stripeListSummary.totalDataLength;
 
 	/*
 	 * When no stripes are in the table we don't have a count in maxColumnCount. To
@@ -1656,7 +2371,7 @@ ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId, int numberOfColumnsRe
 
 	double columnSelectionRatio = numberOfColumnsRead / (double) maxColumnCount;
 	Cost tableScanCost = (double) totalStripeSize / BLCKSZ * columnSelectionRatio;
-	Cost perStripeScanCost = tableScanCost / list_length(stripeList);
+	Cost perStripeScanCost = tableScanCost / stripeListSummary.stripeCount;
 
 	/*
 	 * Finally, multiply the cost of reading a single stripe by seq page read
@@ -1677,14 +2392,13 @@ ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId, int numberOfColumnsRe
 
 /*
  * ColumnarTableStripeCount returns the number of stripes that columnar
- * table with relationId has by using stripe metadata.
+ * table with relationId has by using the cached stripe list summary.
  */
 static uint64
 ColumnarTableStripeCount(Oid relationId)
 {
 	Relation relation = RelationIdGetRelation(relationId);
-	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
-	int stripeCount = list_length(stripeList);
+	uint64 stripeCount = StripeListSummaryForRelation(relation).stripeCount;
 	RelationClose(relation);
 
 	return stripeCount;
@@ -1742,21 +2456,38 @@ ColumnarScanPath_PlanCustomPath(PlannerInfo *root,
 	cscan->scan.plan.targetlist = list_copy(tlist);
 	cscan->scan.scanrelid = best_path->path.parent->relid;
 
+	/* paths in the order of the sort key, see AddColumnarSortedScanPath() */
+	AttrNumber sortKeyColumn = InvalidAttrNumber;
+	if (list_length(best_path->custom_private) > 2)
+	{
+		sortKeyColumn = intVal(lthird(best_path->custom_private));
+
+		Const *sortedRead = makeNode(Const);
+
+		sortedRead->constbyval = true;
+		sortedRead->consttype = CUSTOM_SCAN_SORTED_READ;
+		sortedRead->constvalue = Int16GetDatum(sortKeyColumn);
+		sortedRead->constlen = sizeof(int16);
+
+		cscan->custom_private = lappend(cscan->custom_private, sortedRead);
+	}
+
 	/*
 	 * Vectorized QUAL execution. Split QUAL list into vectorized list 
 	 * stored in third position of custom_exprs list and rest of
-	 * qual list (which can't be vectorized) in scan.plan.qual.
+	 * qual list (which can't be vectorized) in scan.plan.qual. Rows merged
+	 * in the order of the sort key are filtered one at a time.
 	 */
-	if (columnar_enable_vectorization)
+	if (columnar_enable_vectorization && sortKeyColumn == InvalidAttrNumber)
 	{
 		List *candidateQualList = CreateVectorizedExprList(cscan->scan.plan.qual);
-		List *listDifference = list_difference(candidateQualList, cscan->scan.plan.qual);
+		List *listDifference = list_difference_ptr(candidateQualList, cscan->scan.plan.qual);
 
 		cscan->custom_exprs = lappend(cscan->custom_exprs, listDifference);
 
 		if (listDifference != NULL)
-			cscan->scan.plan.qual = list_intersection(cscan->scan.plan.qual,
-													  candidateQualList);
+			cscan->scan.plan.qual = list_intersection_ptr(cscan->scan.plan.qual,
+														  candidateQualList);
 	}
 	else
 	{
@@ -1764,10 +2495,119 @@ ColumnarScanPath_PlanCustomPath(PlannerInfo *root,
 		cscan->custom_exprs = lappend(cscan->custom_exprs, NIL);
 	}
 
+	/*
+	 * A LIMIT directly above a scan of the only relation of the query, with
+	 * no sort in between, stops after limit_tuples rows. Let the reader know,
+	 * so it doesn't load whole stripes for them.
+	 */
+	if (root->limit_tuples > 0 && root->query_pathkeys == NIL &&
+		root->parse->rowMarks == NIL &&
+		bms_membership(root->all_baserels) == BMS_SINGLETON)
+	{
+		Const *rowBound = makeNode(Const);
+
+		rowBound->constbyval = true;
+		rowBound->consttype = CUSTOM_SCAN_ROW_BOUND;
+		rowBound->constvalue = Int32GetDatum((int32) Min(root->limit_tuples,
+														 (double) PG_INT32_MAX));
+		rowBound->constlen = sizeof(int32);
+
+		cscan->custom_private = lappend(cscan->custom_private, rowBound);
+	}
+	else if (EnableColumnarTopNFilter && sortKeyColumn == InvalidAttrNumber &&
+			 root->limit_tuples > 0 &&
+			 root->limit_tuples <= COLUMNAR_TOP_N_FILTER_MAX_ROWS &&
+			 root->query_pathkeys != NIL && root->parse->rowMarks == NIL &&
+			 bms_membership(root->all_baserels) == BMS_SINGLETON)
+	{
+		/*
+		 * With a sort in between, the sort keeps limit_tuples rows, so the
+		 * scan can skip the chunk groups whose rows can't be among them.
+		 */
+		List *topNSortKey = TopNSortKey(root, rel, linitial(root->query_pathkeys));
+		if (topNSortKey != NIL)
+		{
+			Const *topN = makeNode(Const);
+
+			topN->constbyval = false;
+			topN->consttype = CUSTOM_SCAN_TOP_N;
+			topN->constvalue = CStringGetTextDatum(nodeToString(topNSortKey));
+			topN->constlen = -1;
+
+			cscan->custom_private = lappend(cscan->custom_private, topN);
+		}
+	}
+
 	return (Plan *) cscan;
 }
 
 
+/*
+ * TopNSortKey returns the attribute number, sort operator, collation and
+ * nulls first flag of the first sort key of a top-N sort above a scan of the
+ * given relation, followed by the number of rows the sort keeps, or NIL if
+ * the key isn't a column of the relation whose chunk min/max values are in
+ * the order of the sort.
+ */
+static List *
+TopNSortKey(PlannerInfo *root, RelOptInfo *rel, PathKey *pathkey)
+{
+	EquivalenceClass *eclass = pathkey->pk_eclass;
+	if (eclass->ec_has_volatile)
+	{
+		return NIL;
+	}
+
+	ListCell *lc;
+	foreach(lc, eclass->ec_members)
+	{
+		EquivalenceMember *member = lfirst(lc);
+
+		Expr *expr = member->em_expr;
+		while (IsA(expr, RelabelType))
+		{
+			expr = ((RelabelType *) expr)->arg;
+		}
+
+		if (!IsA(expr, Var))
+		{
+			continue;
+		}
+
+		Var *var = (Var *) expr;
+		if (var->varno != rel->relid || var->varlevelsup != 0 || var->varattno <= 0)
+		{
+			continue;
+		}
+
+		/* chunk min/max values follow the default order of the column's type */
+		Oid defaultOpClass = GetDefaultOpClass(var->vartype, BTREE_AM_OID);
+		if (!OidIsValid(defaultOpClass) ||
+			get_opclass_family(defaultOpClass) != pathkey->pk_opfamily ||
+			var->varcollid != eclass->ec_collation)
+		{
+			return NIL;
+		}
+
+		Oid sortOperator = get_opfamily_member(pathkey->pk_opfamily,
+											   member->em_datatype,
+											   member->em_datatype,
+											   pathkey->pk_strategy);
+		if (!OidIsValid(sortOperator))
+		{
+			return NIL;
+		}
+
+		List *topNSortKey = list_make4_int(var->varattno, sortOperator,
+										   eclass->ec_collation,
+										   pathkey->pk_nulls_first);
+		return lappend_int(topNSortKey, (int) root->limit_tuples);
+	}
+
+	return NIL;
+}
+
+
 /*
  * ReparameterizeMutator changes all varnos referencing the topmost parent of
  * child_rel to instead reference child_rel directly.
@@ -1905,7 +2745,19 @@ ColumnarScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int ef
 	 * NULL.
 	 */
 	if (lthird(cscan->custom_exprs) != NIL)
+	{
 		columnarScanState->vectorization.vectorizedQualList =  lthird(cscan->custom_exprs);
+		columnarScanState->vectorization.vectorizedQualHasExecParams =
+			ContainsExecParams((Node *) lthird(cscan->custom_exprs), NULL);
+		columnarScanState->vectorization.vectorQualContext =
+			AllocSetContextCreate(estate->es_query_cxt, "Columnar Vectorized Quals",
+								  ALLOCSET_DEFAULT_SIZES);
+	}
+
+	bool chunkGroupSummary = false;
+	List *chunkGroupSketchColumns = NIL;
+	List *projectionColumns = NIL;
+	List *topNSortKey = NIL;
 
 	ListCell *lc;
 	foreach(lc, cscan->custom_private)
@@ -1916,6 +2768,44 @@ ColumnarScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int ef
 			columnarScanState->vectorization.vectorizationAggregate =
 				privateCustomData->constvalue;
 		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_ROW_BOUND)
+		{
+			columnarScanState->rowBound = DatumGetInt32(privateCustomData->constvalue);
+		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_CHUNK_GROUP_SUMMARY)
+		{
+			chunkGroupSummary = DatumGetBool(privateCustomData->constvalue);
+		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_CHUNK_GROUP_SKETCHES)
+		{
+			chunkGroupSketchColumns =
+				stringToNode(TextDatumGetCString(privateCustomData->constvalue));
+		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_STRIPE_PROJECTION)
+		{
+			projectionColumns =
+				stringToNode(TextDatumGetCString(privateCustomData->constvalue));
+		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_AGGREGATE_FALLBACK)
+		{
+			columnarScanState->vectorization.aggregateFallbackReason =
+				TextDatumGetCString(privateCustomData->constvalue);
+		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_TOP_N)
+		{
+			topNSortKey = stringToNode(TextDatumGetCString(privateCustomData->constvalue));
+		}
+		else if (privateCustomData->consttype == CUSTOM_SCAN_SORTED_READ)
+		{
+			columnarScanState->sortKeyColumn =
+				DatumGetInt16(privateCustomData->constvalue);
+		}
+	}
+
+	/* a vectorized aggregate above doesn't need the rows in any order */
+	if (columnarScanState->vectorization.vectorizationAggregate)
+	{
+		columnarScanState->sortKeyColumn = InvalidAttrNumber;
 	}
 
 	/*
@@ -1943,12 +2833,6 @@ ColumnarScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int ef
 		}
 	}
 
-	if (columnarScanState->vectorization.vectorizationEnabled)
-	{
-		columnarScanState->vectorization.scanVectorSlot =
-			CreateVectorTupleTableSlot(cscanstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
-	}
-
 	columnarScanState->attrNeeded = 
 		ColumnarAttrNeeded(&cscanstate->ss, columnarScanState->vectorization.vectorizedQualList);
 
@@ -1959,6 +2843,133 @@ ColumnarScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int ef
 			lappend_int(columnarScanState->vectorization.attrNeededList, bmsMember);
 	}
 
+	/* the reader only fills the vectors of the columns the scan needs */
+	if (columnarScanState->vectorization.vectorizationEnabled)
+	{
+		columnarScanState->vectorization.scanVectorSlot =
+			CreateProjectedVectorTupleTableSlot(
+				cscanstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor,
+				columnarScanState->attrNeeded);
+	}
+
+	/*
+	 * The reader already evaluated the vectorized quals, so the rows only
+	 * need the columns of the target list and the other quals. The rows an
+	 * UPDATE or DELETE identifies then cost little more than their TIDs. The
+	 * other columns of the scan slot stay NULL.
+	 */
+	columnarScanState->vectorization.rowAttrNeededList =
+		columnarScanState->vectorization.attrNeededList;
+	if (columnarScanState->vectorization.vectorizationEnabled &&
+		!columnarScanState->vectorization.vectorizationAggregate &&
+		columnarScanState->vectorization.vectorizedQualList != NIL)
+	{
+		TupleTableSlot *scanSlot = cscanstate->ss.ss_ScanTupleSlot;
+		Bitmapset *rowAttrNeeded = ColumnarAttrNeeded(&cscanstate->ss, NIL);
+
+		columnarScanState->vectorization.rowAttrNeededList = NIL;
+		for (int attrIndex = 0; attrIndex < scanSlot->tts_tupleDescriptor->natts;
+			 attrIndex++)
+		{
+			if (bms_is_member(attrIndex, rowAttrNeeded))
+			{
+				columnarScanState->vectorization.rowAttrNeededList =
+					lappend_int(columnarScanState->vectorization.rowAttrNeededList,
+								attrIndex);
+			}
+			else
+			{
+				scanSlot->tts_values[attrIndex] = (Datum) 0;
+				scanSlot->tts_isnull[attrIndex] = true;
+			}
+		}
+	}
+
+	/*
+	 * The vectorized aggregate above only needs the statistics of the chunk
+	 * groups whose rows all pass the quals, both the vectorized ones and the
+	 * rest. Volatile quals have to run for each row, and system columns have
+	 * no statistics.
+	 */
+	if (chunkGroupSummary &&
+		columnarScanState->vectorization.vectorizationEnabled &&
+		columnarScanState->vectorization.vectorizationAggregate)
+	{
+		List *summaryQualList =
+			list_concat(list_copy(cscan->scan.plan.qual),
+						columnarScanState->vectorization.vectorizedQualList);
+
+		if (!contain_volatile_functions((Node *) summaryQualList) &&
+			!ClausesReferenceSystemColumns(summaryQualList))
+		{
+			columnarScanState->chunkGroupSummary =
+				CreateChunkGroupSummary(cscanstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor,
+										summaryQualList, chunkGroupSketchColumns);
+		}
+	}
+
+	/*
+	 * Likewise, it only needs the groups of the stripe projections whose rows
+	 * all pass the quals, as long as the table keeps projections of the
+	 * columns it aggregates.
+	 */
+	if (projectionColumns != NIL &&
+		columnarScanState->vectorization.vectorizationEnabled &&
+		columnarScanState->vectorization.vectorizationAggregate)
+	{
+		List *summaryQualList =
+			list_concat(list_copy(cscan->scan.plan.qual),
+						columnarScanState->vectorization.vectorizedQualList);
+		Relation relation = cscanstate->ss.ss_currentRelation;
+
+		if (!contain_volatile_functions((Node *) summaryQualList) &&
+			!ClausesReferenceSystemColumns(summaryQualList) &&
+			StripeProjectionsCover(RelationGetRelid(relation), projectionColumns))
+		{
+			columnarScanState->projectionSummary =
+				CreateStripeProjectionSummary(linitial(projectionColumns),
+											  lsecond(projectionColumns),
+											  lthird(projectionColumns),
+											  summaryQualList,
+											  RelationGetDescr(relation)->natts);
+		}
+	}
+
+	/*
+	 * The rows a plain DELETE of the table reads are all deleted, so the
+	 * chunk groups whose rows all pass the quals are marked deleted without
+	 * reading them.
+	 */
+	if (columnar_enable_chunk_group_delete &&
+		columnarScanState->sortKeyColumn == InvalidAttrNumber)
+	{
+		List *deleteQualList =
+			list_concat(list_copy(cscan->scan.plan.qual),
+						columnarScanState->vectorization.vectorizedQualList);
+
+		if (ChunkGroupDeleteSupported(cscanstate, estate, deleteQualList))
+		{
+			columnarScanState->chunkGroupDelete =
+				CreateChunkGroupDelete(cscanstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor,
+									   deleteQualList);
+		}
+	}
+
+	/* the sort above gets the column of its first key from the scan */
+	if (topNSortKey != NIL &&
+		bms_is_member(linitial_int(topNSortKey) - 1, columnarScanState->attrNeeded))
+	{
+		InitTopNFilter(columnarScanState, topNSortKey, estate->es_query_cxt);
+	}
+
+	if (columnarScanState->vectorization.vectorizationAggregate &&
+		columnarScanState->vectorization.vectorizationEnabled &&
+		cscanstate->ss.ps.ps_ProjInfo != NULL && cscan->scan.plan.qual == NIL &&
+		columnarScanState->topNFilter.heap == NULL)
+	{
+		InitVectorizedProjection(columnarScanState);
+	}
+
 	/*
 	 * If we have pending changes that need to be flushed (row_mask after update/delete)
 	 * or new stripe we need to to them here because sequential columnar scan 
@@ -2037,16 +3048,111 @@ ColumnarAttrNeeded(ScanState *ss, List *customList)
 
 
 /*
- * ExecScanFetch -- check interrupts & fetch next potential tuple
- *
- * This routine is concerned with substituting a test tuple if we are
- * inside an EvalPlanQual recheck.  If we aren't, just execute
- * the access method's next-tuple routine.
+ * ClausesReferenceSystemColumns returns whether the given clauses reference
+ * a system column or a whole row.
  */
-static inline TupleTableSlot *
-ExecScanFetch(ScanState *node,
-			  ExecScanAccessMtd accessMtd,
-			  ExecScanRecheckMtd recheckMtd)
+static bool
+ClausesReferenceSystemColumns(List *clauseList)
+{
+	List *vars = pull_var_clause((Node *) clauseList, PVC_RECURSE_AGGREGATES |
+								 PVC_RECURSE_WINDOWFUNCS | PVC_RECURSE_PLACEHOLDERS);
+
+	Var *var = NULL;
+	foreach_ptr(var, vars)
+	{
+		if (var->varattno <= 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ChunkGroupDeleteSupported returns whether the scan is the only scan of a
+ * DELETE of its table without RETURNING, whose rows all have the quals in
+ * qualList, so that the DELETE deletes every row the scan returns. The rows
+ * of the chunk groups marked deleted at once aren't seen by anything, so the
+ * table can't have triggers, foreign keys, row-level security or logical
+ * decoding of its deletes either.
+ */
+static bool
+ChunkGroupDeleteSupported(CustomScanState *cscanstate, EState *estate, List *qualList)
+{
+	PlannedStmt *plannedStmt = estate->es_plannedstmt;
+	Index scanRelid = ((Scan *) cscanstate->ss.ps.plan)->scanrelid;
+	Relation relation = cscanstate->ss.ss_currentRelation;
+
+	if (plannedStmt == NULL || plannedStmt->commandType != CMD_DELETE ||
+		plannedStmt->hasReturning || list_length(plannedStmt->resultRelations) != 1 ||
+		linitial_int(plannedStmt->resultRelations) != scanRelid ||
+		list_length(estate->es_range_table) != 1 || qualList == NIL)
+	{
+		return false;
+	}
+
+	if (relation->trigdesc != NULL ||
+		check_enable_rls(RelationGetRelid(relation), InvalidOid, true) == RLS_ENABLED ||
+		ColumnarLogicalChangesLogged(relation, CMD_DELETE))
+	{
+		return false;
+	}
+
+	return !contain_volatile_functions((Node *) qualList) &&
+		   !contain_subplans((Node *) qualList) &&
+		   !ClausesReferenceSystemColumns(qualList);
+}
+
+
+/*
+ * CountChunkGroupDeletes adds the rows of the chunk groups marked deleted
+ * since it was last called to the processed rows of the DELETE, and to the
+ * deleted rows of the table, as if the DELETE deleted them one at a time.
+ */
+static void
+CountChunkGroupDeletes(ColumnarScanState *columnarScanState)
+{
+	ColumnarChunkGroupDelete *chunkGroupDelete = columnarScanState->chunkGroupDelete;
+	uint64 newDeletedRowCount = chunkGroupDelete->deletedRowCount -
+								columnarScanState->chunkGroupDeleteRowsCounted;
+
+	if (newDeletedRowCount == 0)
+	{
+		return;
+	}
+
+	EState *estate = columnarScanState->custom_scanstate.ss.ps.state;
+	Relation relation = columnarScanState->custom_scanstate.ss.ss_currentRelation;
+
+	estate->es_processed += newDeletedRowCount;
+
+	/*
+	 * There is no pgstat_count_heap_delete taking a row count, and its
+	 * counters are private to pgstat. Counting the rows one at a time is
+	 * cheap compared to the reads saved by deleting whole chunk groups.
+	 */
+	for (uint64 rowIndex = 0; rowIndex < newDeletedRowCount; rowIndex++)
+	{
+		pgstat_count_heap_delete(relation);
+	}
+
+	columnarScanState->chunkGroupDeleteRowsCounted = chunkGroupDelete->deletedRowCount;
+}
+
+
+/*
+ * ExecScanFetch -- check interrupts & fetch next potential tuple
+ *
+ * This routine is concerned with substituting a test tuple if we are
+ * inside an EvalPlanQual recheck.  If we aren't, just execute
+ * the access method's next-tuple routine.
+ */
+static inline TupleTableSlot *
+ExecScanFetch(ScanState *node,
+			  ExecScanAccessMtd accessMtd,
+			  ExecScanRecheckMtd recheckMtd)
 {
 	EState	   *estate = node->ps.state;
 
@@ -2169,7 +3275,8 @@ CustomExecScan(ColumnarScanState *columnarScanState,
 	 * No qual to check and no projection to do and vectorization is not enabled,
 	 * just skip all the overhead and return the raw scan tuple.
 	 */
-	if (!qual && !projInfo && !columnarScanState->vectorization.vectorizationEnabled)
+	if (!qual && !projInfo && !columnarScanState->vectorization.vectorizationEnabled &&
+		columnarScanState->runtimeFilter.bloomFilter == NULL)
 	{
 		ResetExprContext(econtext);
 		return ExecScanFetch(node, accessMtd, recheckMtd);
@@ -2254,23 +3361,24 @@ CustomExecScan(ColumnarScanState *columnarScanState,
 					return slot;
 			}
 
-			if (columnarScanState->vectorization.vectorizedQualList != NULL)
+			/* the aggregate above gets vectors computed from the vector */
+			if (columnarScanState->vectorization.projectionCalls != NULL &&
+				columnarScanState->runtimeFilter.bloomFilter == NULL)
 			{
+				if (VectorSlotSelectedCount((VectorTupleTableSlot *) slot) == 0)
+					continue;
 
-				if (columnarScanState->vectorization.constructedVectorizedQualList == NULL)
-				{
-					columnarScanState->vectorization.constructedVectorizedQualList =
-						ConstructVectorizedQualList(slot, columnarScanState->vectorization.vectorizedQualList);
-				}
+				return ProjectVectorSlot(columnarScanState,
+										 (VectorTupleTableSlot *) slot);
+			}
 
+			if (columnarScanState->vectorization.vectorizedQualList != NULL)
+			{
+				/* the reader evaluated the vectorized quals and set the selection */
 				VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) slot;
 
-				bool *resultQual = 
-					ExecuteVectorizedQual(slot,
-										columnarScanState->vectorization.constructedVectorizedQualList,
-										AND_EXPR);
-
-				memcpy(vectorSlot->keep, resultQual, COLUMNAR_VECTOR_COLUMN_SIZE);
+				columnarScanState->vectorization.vectorPendingRowNumber =
+					VectorSlotSelectedCount(vectorSlot);
 			}
 			/*
 			 * No qual, no vectorized qual, no projection but we need to return vector
@@ -2294,31 +3402,54 @@ CustomExecScan(ColumnarScanState *columnarScanState,
 			VectorTupleTableSlot *vectorSlot = 
 				(VectorTupleTableSlot *) columnarScanState->vectorization.scanVectorSlot;
 
-			bool rowFound = false;
+			/* all tuples of the selection passed the vectorized quals */
+			if (columnarScanState->vectorization.vectorPendingRowNumber == 0)
+				continue;
 
-			while (columnarScanState->vectorization.vectorPendingRowNumber != 0 &&
-				   rowFound == false)
-			{
-				if (vectorSlot->keep[columnarScanState->vectorization.vectorRowIndex])
-				{
-					slot = columnarScanState->custom_scanstate.ss.ss_ScanTupleSlot;
-					ExecClearTuple(slot);
-					ExtractTupleFromVectorSlot(slot,
-											   vectorSlot,
-											   columnarScanState->vectorization.vectorRowIndex,
-											   columnarScanState->vectorization.attrNeededList);
-					
-					rowNumber = vectorSlot->rowNumber[columnarScanState->vectorization.vectorRowIndex];
-					if (!columnarScanState->vectorization.vectorizationAggregate)
-						slot->tts_tid = row_number_to_tid(rowNumber);
-					rowFound = true;
-				}
-				columnarScanState->vectorization.vectorPendingRowNumber--;
-				columnarScanState->vectorization.vectorRowIndex++;
-			}
+			uint32 vectorRow =
+				VectorSlotSelectedRow(vectorSlot,
+									  columnarScanState->vectorization.vectorRowIndex);
+
+			slot = columnarScanState->custom_scanstate.ss.ss_ScanTupleSlot;
+			ExecClearTuple(slot);
+			ExtractTupleFromVectorSlot(slot,
+									   vectorSlot,
+									   vectorRow,
+									   columnarScanState->vectorization.rowAttrNeededList);
+
+			rowNumber = vectorSlot->rowNumber[vectorRow];
+			if (!columnarScanState->vectorization.vectorizationAggregate)
+				slot->tts_tid = row_number_to_tid(rowNumber);
+
+			columnarScanState->vectorization.vectorPendingRowNumber--;
+			columnarScanState->vectorization.vectorRowIndex++;
+		}
+
+		/* rows without a match in the hash table are joined with nothing */
+		if (columnarScanState->runtimeFilter.bloomFilter != NULL &&
+			!RuntimeFilterMayContain(columnarScanState, slot))
+		{
+			columnarScanState->runtimeFilter.rowsRemoved++;
+			ResetExprContext(econtext);
+			continue;
+		}
+
+		/* rows that sort after the bound can't be kept by the top-N sort above */
+		Datum topNValue = 0;
+		bool topNIsNull = false;
+		if (columnarScanState->topNFilter.heap != NULL)
+		{
+			ColumnarTopNBound *bound = &columnarScanState->topNFilter.bound;
 
-			if (rowFound == false)
+			topNValue = slot_getattr(slot, bound->attno, &topNIsNull);
+			if (bound->valid &&
+				ApplySortComparator(topNValue, topNIsNull, bound->value, bound->isNull,
+									&columnarScanState->topNFilter.sortKey) > 0)
+			{
+				columnarScanState->topNFilter.rowsRemoved++;
+				ResetExprContext(econtext);
 				continue;
+			}
 		}
 
 		/*
@@ -2338,6 +3469,11 @@ CustomExecScan(ColumnarScanState *columnarScanState,
 			/*
 			 * Found a satisfactory scan tuple.
 			 */
+			if (columnarScanState->topNFilter.heap != NULL)
+			{
+				TopNFilterAddRow(columnarScanState, topNValue, topNIsNull);
+			}
+
 			if (projInfo)
 			{
 				/*
@@ -2395,8 +3531,8 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 
 	if (scandesc == NULL)
 	{
-		/* the columnar access method does not use the flags, they are specific to heap */
-		uint32 flags = 0;
+		/* the columnar access method only uses SO_ALLOW_SYNC of the flags */
+		uint32 flags = SO_ALLOW_SYNC;
 
 		/*
 		 * We reach here if the scan is not parallel, or if we're serially
@@ -2410,6 +3546,65 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 											   columnarScanState->parallelColumnarScan,
 											   vectorizationEnabled);
 
+		/*
+		 * The vectorized quals are evaluated by the reader, which only reads
+		 * the columns of a qual for vectors with rows that pass the quals
+		 * before it.
+		 */
+		if (vectorizationEnabled &&
+			columnarScanState->vectorization.vectorizedQualList != NULL)
+		{
+			SetVectorQualPipeline(columnarScanState, scandesc);
+		}
+
+		if (columnarScanState->rowBound != 0)
+		{
+			ColumnarScanSetRowBound((ColumnarScanDesc) scandesc,
+									columnarScanState->rowBound);
+		}
+
+		if (columnarScanState->sortKeyColumn != InvalidAttrNumber)
+		{
+			ColumnarScanSetMergeRead((ColumnarScanDesc) scandesc,
+									 columnarScanState->sortKeyColumn);
+		}
+
+		if (columnarScanState->chunkGroupSummary != NULL)
+		{
+			ColumnarScanSetChunkGroupSummary((ColumnarScanDesc) scandesc,
+											 columnarScanState->chunkGroupSummary);
+		}
+
+		if (columnarScanState->chunkGroupDelete != NULL)
+		{
+			ColumnarScanSetChunkGroupDelete((ColumnarScanDesc) scandesc,
+											columnarScanState->chunkGroupDelete);
+		}
+
+		if (columnarScanState->projectionSummary != NULL)
+		{
+			ColumnarScanSetStripeProjectionSummary((ColumnarScanDesc) scandesc,
+												   columnarScanState->projectionSummary);
+		}
+
+		if (columnarScanState->runtimeFilter.rangeClauses != NIL)
+		{
+			ColumnarScanAddQual((ColumnarScanDesc) scandesc,
+								columnarScanState->runtimeFilter.rangeClauses);
+		}
+
+		if (columnarScanState->runtimeFilter.hashJoinState != NULL)
+		{
+			ColumnarScanSetJoinKeyFilter((ColumnarScanDesc) scandesc,
+										 &columnarScanState->runtimeFilter.joinKeyFilter);
+		}
+
+		if (columnarScanState->topNFilter.heap != NULL)
+		{
+			ColumnarScanSetTopNBound((ColumnarScanDesc) scandesc,
+									 &columnarScanState->topNFilter.bound);
+		}
+
 		node->ss.ss_currentScanDesc = scandesc;
 	}
 
@@ -2423,13 +3618,22 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 		foreach_int(attrIndex, columnarScanState->vectorization.attrNeededList)
 		{
 			VectorColumn *column = (VectorColumn *) vectorSlot->tts.tts_values[attrIndex];
-			memset(column->isnull, true, COLUMNAR_VECTOR_COLUMN_SIZE);
+			memset(column->isnull, true, column->capacity);
 			column->dimension = 0;
+			ResetVectorColumnRuns(column);
 		}
 		vectorSlot->dimension = 0;
+		vectorSlot->hasSelection = false;
+	}
+
+	bool rowFound = table_scan_getnextslot(scandesc, direction, slot);
+
+	if (columnarScanState->chunkGroupDelete != NULL)
+	{
+		CountChunkGroupDeletes(columnarScanState);
 	}
 
-	if (table_scan_getnextslot(scandesc, direction, slot))
+	if (rowFound)
 	{
 		/*
 		* Setup custom scan state for reading tuples directly from stored
@@ -2461,6 +3665,14 @@ ColumnarScanRecheck(ColumnarScanState *node, TupleTableSlot *slot)
 static TupleTableSlot *
 ColumnarScan_ExecCustomScan(CustomScanState *node)
 {
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+
+	if (columnarScanState->runtimeFilter.hashJoinState != NULL &&
+		!columnarScanState->runtimeFilter.built)
+	{
+		BuildRuntimeFilter(columnarScanState);
+	}
+
 	return CustomExecScan((ColumnarScanState *) node,
 						  (ExecScanAccessMtd) ColumnarScanNext,
 						  (ExecScanRecheckMtd) ColumnarScanRecheck);
@@ -2492,6 +3704,23 @@ ColumnarScan_EndCustomScan(CustomScanState *node)
 	}
 	ExecClearTuple(node->ss.ss_ScanTupleSlot);
 
+	/* workers add what they read to the statistics of the leader */
+	if (IsParallelWorker() && columnarScanState->sharedScanState != NULL &&
+		scanDesc != NULL)
+	{
+		const ColumnarReadStatistics *statistics =
+			ColumnarScanGetStatistics((ColumnarScanDesc) scanDesc);
+
+		if (statistics != NULL)
+		{
+			ParallelColumnarScan pscan = columnarScanState->sharedScanState;
+
+			SpinLockAcquire(&pscan->mutex);
+			AddColumnarReadStatistics(&pscan->workerStatistics, statistics);
+			SpinLockRelease(&pscan->mutex);
+		}
+	}
+
 	/*
 	 * close heap scan
 	 */
@@ -2515,6 +3744,33 @@ ColumnarScan_ReScanCustomScan(CustomScanState *node)
 	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
 
 	ResetExprContext(columnarScanState->css_RuntimeContext);
+
+	/* rows left in the vector of the previous scan must not be returned */
+	columnarScanState->vectorization.vectorPendingRowNumber = 0;
+	columnarScanState->vectorization.vectorRowIndex = 0;
+
+	if (columnarScanState->chunkGroupSummary != NULL)
+	{
+		ResetChunkGroupSummary(columnarScanState->chunkGroupSummary);
+	}
+
+	if (columnarScanState->projectionSummary != NULL)
+	{
+		ResetStripeProjectionSummary(columnarScanState->projectionSummary);
+	}
+
+	/* the hash table may be rebuilt for the new scan */
+	if (columnarScanState->runtimeFilter.hashJoinState != NULL)
+	{
+		ResetRuntimeFilter(columnarScanState);
+	}
+
+	/* the sort above starts over too */
+	if (columnarScanState->topNFilter.heap != NULL)
+	{
+		ResetTopNFilter(columnarScanState);
+	}
+
 	List *allClauses = lsecond(cscan->custom_exprs);
 	columnarScanState->qual = (List *) EvalParamsMutator(
 		(Node *) allClauses, columnarScanState->css_RuntimeContext);
@@ -2528,120 +3784,1044 @@ ColumnarScan_ReScanCustomScan(CustomScanState *node)
 		table_rescan(node->ss.ss_currentScanDesc,
 					 scanKeys);
 	}
+
+	/* the vectorized quals compare with the new values of the exec params */
+	if (columnarScanState->vectorization.vectorizedQualHasExecParams &&
+		columnarScanState->vectorization.vectorQualPipeline != NULL)
+	{
+		columnarScanState->vectorization.vectorQualPipeline = NULL;
+		MemoryContextReset(columnarScanState->vectorization.vectorQualContext);
+
+		if (scanDesc != NULL)
+		{
+			SetVectorQualPipeline(columnarScanState, scanDesc);
+		}
+	}
 }
 
 
+/*
+ * SetVectorQualPipeline passes the pipeline of the vectorized quals to the
+ * reader, building it first if needed. Params in the quals are replaced with
+ * their current values, which the pipeline passes as constants.
+ */
 static void
-ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
-							   ExplainState *es)
+SetVectorQualPipeline(ColumnarScanState *columnarScanState, TableScanDesc scandesc)
 {
-	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
-
-	List *context = set_deparse_context_planstate(
-		es->deparse_cxt, (Node *) &node->ss.ps, ancestors);
+	if (columnarScanState->vectorization.vectorQualPipeline == NULL)
+	{
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(columnarScanState->vectorization.vectorQualContext);
 
-	List *projectedColumns = ColumnarVarNeeded(columnarScanState);
-	const char *projectedColumnsStr = ColumnarProjectedColumnsStr(
-		context, projectedColumns);
-	ExplainPropertyText("Columnar Projected Columns",
-						projectedColumnsStr, es);
+		List *vectorizedQualList = (List *) EvalParamsMutator(
+			(Node *) columnarScanState->vectorization.vectorizedQualList,
+			columnarScanState->css_RuntimeContext);
 
-	CustomScan *cscan = castNode(CustomScan, node->ss.ps.plan);
-	List *chunkGroupFilter = lsecond(cscan->custom_exprs);
-	if (chunkGroupFilter != NULL)
-	{
-		const char *pushdownClausesStr = ColumnarPushdownClausesStr(
-			context, chunkGroupFilter);
-		ExplainPropertyText("Columnar Chunk Group Filters",
-							pushdownClausesStr, es);
+		columnarScanState->vectorization.vectorQualPipeline =
+			BuildVectorQualPipeline(columnarScanState->vectorization.scanVectorSlot,
+									vectorizedQualList);
 
-		ColumnarScanDesc columnarScanDesc =
-			(ColumnarScanDesc) node->ss.ss_currentScanDesc;
-		if (columnarScanDesc != NULL)
-		{
-			ExplainPropertyInteger(
-				"Columnar Chunk Groups Removed by Filter",
-				NULL, ColumnarScanChunkGroupsFiltered(columnarScanDesc), es);
-		}
+		MemoryContextSwitchTo(oldContext);
 	}
 
-	if (columnarScanState->vectorization.vectorizationEnabled &&
-		columnarScanState->vectorization.vectorizedQualList != NULL)
+	VectorQualPipeline *pipeline = columnarScanState->vectorization.vectorQualPipeline;
+
+	ColumnarScanSetVectorQual((ColumnarScanDesc) scandesc, pipeline->stageColumnLists,
+							  ExecuteVectorQualStage, pipeline);
+}
+
+
+/*
+ * ColumnarExecutorStart links the columnar scans that are the outer side of a
+ * hash join to the join, after the executor has set up the plan state tree,
+ * so that they can filter their rows with the keys of the hash table.
+ */
+static void
+ColumnarExecutorStart(QueryDesc *queryDesc, int eflags)
+{
+	if (queryDesc->plannedstmt->parallelModeNeeded && !IsInParallelMode() &&
+		(eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
 	{
-		const char *vectorizedWhereClauses = ColumnarPushdownClausesStr(
-					context, columnarScanState->vectorization.vectorizedQualList);
-		ExplainPropertyText("Columnar Vectorized Filter", 
-							vectorizedWhereClauses, es);
+		FlushColumnarWritesForParallelPlan(queryDesc);
 	}
 
-	if (columnar_enable_page_cache)
+	if (PreviousExecutorStartHook != NULL)
 	{
-		ColumnarCacheStatistics *statistics = ColumnarGetCacheStatistics();
+		PreviousExecutorStartHook(queryDesc, eflags);
+	}
+	else
+	{
+		standard_ExecutorStart(queryDesc, eflags);
+	}
 
-		ExplainPropertyUInteger(
-			"Cache Hits",
-			NULL,
-			statistics->hits,
-			es);
+	if (EnableColumnarRuntimeFilter && queryDesc->planstate != NULL &&
+		(eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
+	{
+		SetupRuntimeFiltersWalker(queryDesc->planstate, NULL);
+	}
 
-		ExplainPropertyUInteger(
-			"Cache Misses",
-			NULL,
-			statistics->misses,
-			es);
+	if (queryDesc->planstate != NULL && (eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
+	{
+		SetupIndexFetchProjectionsWalker(queryDesc->planstate, NULL);
+	}
+}
 
-		ExplainPropertyUInteger(
-			"Cache Evictions",
-			NULL,
-			statistics->evictions,
-			es);
 
-		ExplainPropertyUInteger(
-			"Cache Writes",
-			NULL,
-			statistics->writes,
-			es);
+/*
+ * FlushColumnarWritesForParallelPlan flushes the pending writes of this
+ * transaction to the columnar tables that the given parallel plan reads.
+ * Parallel index and bitmap heap scans start their scans only after the
+ * leader entered parallel mode, where it can't flush anymore, and the
+ * workers can't see the writes that aren't flushed. As we flush in the
+ * current command, we then advance the command id of the query snapshot
+ * so that the flushed stripes are visible to the scans, the same way as
+ * FlushWriteStateWithNewSnapshot does.
+ */
+static void
+FlushColumnarWritesForParallelPlan(QueryDesc *queryDesc)
+{
+	bool flushedAny = false;
 
-		ExplainPropertyUInteger(
-			"Cache Maximum Size",
-			NULL,
-			statistics->maximumCacheSize,
-			es);
+	RangeTblEntry *rte = NULL;
+	foreach_ptr(rte, queryDesc->plannedstmt->rtable)
+	{
+		if (rte->rtekind != RTE_RELATION || !IsColumnarTableAmTable(rte->relid))
+		{
+			continue;
+		}
 
-		ExplainPropertyUInteger(
-			"Cache Ending Size", 
-			NULL, 
-			statistics->endingCacheSize,
-			es);
+		Relation relation = RelationIdGetRelation(rte->relid);
+		Oid relfilenode = relation->rd_node.relNode;
+		RelationClose(relation);
 
-		ExplainPropertyUInteger(
-			"Total Cache Entries",
-			NULL,
-			statistics->entries,
-			es
-		);
+		RowMaskFlushWriteStateForRelfilenode(relfilenode, GetCurrentSubTransactionId());
+		FlushWriteStateForRelfilenode(relfilenode, GetCurrentSubTransactionId());
+		flushedAny = true;
 	}
-}
 
+	Snapshot snapshot = queryDesc->snapshot;
+	if (!flushedAny || snapshot == InvalidSnapshot || !IsMVCCSnapshot(snapshot))
+	{
+		return;
+	}
 
-/* Parallel Execution */
+	PushCopiedSnapshot(snapshot);
+	UpdateActiveSnapshotCommandId();
+	Snapshot newSnapshot = RegisterSnapshot(GetActiveSnapshot());
+	PopActiveSnapshot();
 
-static Size 
-Columnar_EstimateDSMCustomScan(CustomScanState *node,
-							   ParallelContext *pcxt)
-{
-	Size nbytes;
+	/* CreateQueryDesc registered the snapshot, FreeQueryDesc unregisters ours */
+	UnregisterSnapshot(snapshot);
+	queryDesc->snapshot = newSnapshot;
+}
 
-	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
 
-	nbytes = offsetof(ParallelColumnarScanData, snapshotData);
+/*
+ * SetupRuntimeFiltersWalker sets up a runtime filter for each hash join in
+ * the given plan state tree whose outer side is a columnar scan.
+ */
+static bool
+SetupRuntimeFiltersWalker(PlanState *planState, void *context)
+{
+	if (planState == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(planState, HashJoinState))
+	{
+		PlanState *outerPlanState = outerPlanState(planState);
+
+		if (IsA(outerPlanState, CustomScanState) &&
+			((CustomScanState *) outerPlanState)->methods == &ColumnarScanExecuteMethods)
+		{
+			SetupRuntimeFilter((ColumnarScanState *) outerPlanState,
+							   (HashJoinState *) planState);
+		}
+	}
+
+	return planstate_tree_walker(planState, SetupRuntimeFiltersWalker, context);
+}
+
+
+/*
+ * SetupIndexFetchProjectionsWalker makes the index, index only and bitmap
+ * heap scans of columnar tables in the given plan state tree decode only the
+ * columns their plan uses. Index only scans take the values from the index,
+ * so their fetches only need to check that the row is still there.
+ */
+static bool
+SetupIndexFetchProjectionsWalker(PlanState *planState, void *context)
+{
+	if (planState == NULL)
+	{
+		return false;
+	}
+
+	ScanState *scanState = (ScanState *) planState;
+	MemoryContext queryContext = planState->state->es_query_cxt;
+
+	if (IsA(planState, IndexScanState) &&
+		scanState->ss_currentRelation->rd_tableam == GetColumnarTableAmRoutine())
+	{
+		IndexScan *indexScan = (IndexScan *) planState->plan;
+		List *recheckClauses = list_concat_copy(indexScan->indexqualorig,
+												indexScan->indexorderbyorig);
+
+		ColumnarSetIndexFetchProjection(scanState->ss_ScanTupleSlot,
+										IndexFetchAttrNeeded(scanState, recheckClauses),
+										queryContext);
+	}
+	else if (IsA(planState, IndexOnlyScanState) &&
+			 scanState->ss_currentRelation->rd_tableam == GetColumnarTableAmRoutine())
+	{
+		IndexOnlyScanState *indexOnlyScanState = (IndexOnlyScanState *) planState;
+
+		ColumnarSetIndexFetchProjection(indexOnlyScanState->ioss_TableSlot, NULL,
+										queryContext);
+	}
+	else if (IsA(planState, BitmapHeapScanState) &&
+			 scanState->ss_currentRelation->rd_tableam == GetColumnarTableAmRoutine())
+	{
+		BitmapHeapScan *bitmapHeapScan = (BitmapHeapScan *) planState->plan;
+
+		ColumnarSetIndexFetchProjection(scanState->ss_ScanTupleSlot,
+										IndexFetchAttrNeeded(scanState,
+															 bitmapHeapScan->bitmapqualorig),
+										queryContext);
+	}
+#if PG_VERSION_NUM >= PG_VERSION_14
+	else if (IsA(planState, ModifyTableState) &&
+			 ((ModifyTableState *) planState)->operation == CMD_UPDATE)
+	{
+		ModifyTableState *modifyTableState = (ModifyTableState *) planState;
+		ModifyTable *modifyTable = (ModifyTable *) planState->plan;
+
+		for (int relIndex = 0; relIndex < modifyTableState->mt_nrels; relIndex++)
+		{
+			ResultRelInfo *resultRelInfo = &modifyTableState->resultRelInfo[relIndex];
+			Relation relation = resultRelInfo->ri_RelationDesc;
+			if (relation->rd_tableam != GetColumnarTableAmRoutine())
+			{
+				continue;
+			}
+
+			List *updateColnos = list_nth(modifyTable->updateColnosLists, relIndex);
+
+			ColumnarSetUpdateFetchProjection(resultRelInfo,
+											 UpdateFetchAttrNeeded(relation,
+																   updateColnos),
+											 queryContext);
+		}
+	}
+#endif
+
+	return planstate_tree_walker(planState, SetupIndexFetchProjectionsWalker, context);
+}
+
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+
+/*
+ * UpdateFetchAttrNeeded returns the 0-indexed attribute numbers of the columns
+ * of the given relation that an UPDATE assigning the columns in updateColnos
+ * copies from the old rows into the new ones. The subplan of the UPDATE
+ * computes the assigned columns, and only reads the columns it needs to
+ * identify the rows and to compute them.
+ */
+static Bitmapset *
+UpdateFetchAttrNeeded(Relation relation, List *updateColnos)
+{
+	int natts = RelationGetDescr(relation)->natts;
+	Bitmapset *attrNeeded = bms_add_range(NULL, 0, natts - 1);
+
+	int attno = 0;
+	foreach_int(attno, updateColnos)
+	{
+		attrNeeded = bms_del_member(attrNeeded, attno - 1);
+	}
+
+	return attrNeeded;
+}
+
+
+#endif
+
+
+/*
+ * IndexFetchAttrNeeded returns the 0-indexed attribute numbers of the columns
+ * that the target list and quals of the given scan use, together with the
+ * given clauses the scan rechecks when the index is lossy.
+ */
+static Bitmapset *
+IndexFetchAttrNeeded(ScanState *scanState, List *recheckClauses)
+{
+	Scan *scan = (Scan *) scanState->ps.plan;
+	int natts = RelationGetDescr(scanState->ss_currentRelation)->natts;
+
+	Bitmapset *varattnos = NULL;
+	pull_varattnos((Node *) scan->plan.targetlist, scan->scanrelid, &varattnos);
+	pull_varattnos((Node *) scan->plan.qual, scan->scanrelid, &varattnos);
+	pull_varattnos((Node *) recheckClauses, scan->scanrelid, &varattnos);
+
+	/* a whole row reference needs all columns */
+	if (bms_is_member(InvalidAttrNumber - FirstLowInvalidHeapAttributeNumber,
+					  varattnos))
+	{
+		return bms_add_range(NULL, 0, natts - 1);
+	}
+
+	Bitmapset *attrNeeded = NULL;
+	int member = -1;
+	while ((member = bms_next_member(varattnos, member)) >= 0)
+	{
+		AttrNumber attno = member + FirstLowInvalidHeapAttributeNumber;
+		if (attno > 0)
+		{
+			attrNeeded = bms_add_member(attrNeeded, attno - 1);
+		}
+	}
+
+	return attrNeeded;
+}
+
+
+/*
+ * SetupRuntimeFilter makes the given columnar scan filter its rows with the
+ * keys of the hash table of the given hash join, once the join has built it.
+ * Only joins that discard the outer rows without a match qualify, and only
+ * for a hash clause that compares a column of the scan with the default
+ * equality operator of a pass-by-value type, whose values we can order and
+ * hash.
+ */
+static void
+SetupRuntimeFilter(ColumnarScanState *columnarScanState, HashJoinState *hashJoinState)
+{
+	JoinType joinType = hashJoinState->js.jointype;
+	if (joinType != JOIN_INNER && joinType != JOIN_SEMI && joinType != JOIN_RIGHT)
+	{
+		return;
+	}
+
+	CustomScan *cscan = (CustomScan *) columnarScanState->custom_scanstate.ss.ps.plan;
+	HashJoin *hashJoin = (HashJoin *) hashJoinState->js.ps.plan;
+
+	/* the hash clauses have the outer side on the left */
+	OpExpr *hashClause = NULL;
+	foreach_ptr(hashClause, hashJoin->hashclauses)
+	{
+		if (!IsA(hashClause, OpExpr) || list_length(hashClause->args) != 2)
+		{
+			continue;
+		}
+
+		Var *outerVar = linitial(hashClause->args);
+		Var *innerVar = lsecond(hashClause->args);
+		if (!IsA(outerVar, Var) || outerVar->varno != OUTER_VAR ||
+			!IsA(innerVar, Var) || innerVar->varno != INNER_VAR ||
+			outerVar->vartype != innerVar->vartype)
+		{
+			continue;
+		}
+
+		/* the outer side references the target list of the scan */
+		if (outerVar->varattno < 1 ||
+			outerVar->varattno > list_length(cscan->scan.plan.targetlist))
+		{
+			continue;
+		}
+
+		TargetEntry *targetEntry = list_nth(cscan->scan.plan.targetlist,
+											outerVar->varattno - 1);
+		Var *scanVar = (Var *) targetEntry->expr;
+		if (!IsA(scanVar, Var) || scanVar->varno != cscan->scan.scanrelid ||
+			scanVar->varattno < 1)
+		{
+			continue;
+		}
+
+		if (!get_typbyval(scanVar->vartype))
+		{
+			continue;
+		}
+
+		TypeCacheEntry *typeEntry = lookup_type_cache(scanVar->vartype,
+													  TYPECACHE_EQ_OPR |
+													  TYPECACHE_CMP_PROC_FINFO);
+		if (typeEntry->eq_opr != hashClause->opno ||
+			!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			continue;
+		}
+
+		FmgrInfo *hashFunction = ColumnarBloomHashFunction(scanVar->vartype);
+		if (hashFunction == NULL)
+		{
+			continue;
+		}
+
+		EState *estate = columnarScanState->custom_scanstate.ss.ps.state;
+
+		columnarScanState->runtimeFilter.hashJoinState = hashJoinState;
+		columnarScanState->runtimeFilter.scanVar = scanVar;
+		columnarScanState->runtimeFilter.innerAttno = innerVar->varattno;
+		columnarScanState->runtimeFilter.hashFunction = hashFunction;
+		columnarScanState->runtimeFilter.joinKeyFilter.attno = scanVar->varattno;
+		columnarScanState->runtimeFilter.joinKeyFilter.collation = scanVar->varcollid;
+		columnarScanState->runtimeFilter.joinKeyFilter.hashFunction = hashFunction;
+		columnarScanState->runtimeFilter.context =
+			AllocSetContextCreate(estate->es_query_cxt, "Columnar Runtime Filter",
+								  ALLOCSET_DEFAULT_SIZES);
+		return;
+	}
+}
+
+
+/*
+ * BuildRuntimeFilter builds the runtime filter of the given scan from the
+ * hash table of the hash join above, once the join has built it. The filter
+ * consists of a bloom filter of the keys that rows have to pass, and of the
+ * range of the keys, which lets the scan skip the stripes and chunk groups
+ * that have no rows in it.
+ *
+ * We can only see all keys if the hash table has a single batch and isn't
+ * shared between parallel workers; the filter stays off otherwise.
+ */
+static void
+BuildRuntimeFilter(ColumnarScanState *columnarScanState)
+{
+	HashJoinState *hashJoinState = columnarScanState->runtimeFilter.hashJoinState;
+	HashJoinTable hashTable = hashJoinState->hj_HashTable;
+
+	/* the join fetches the first outer row before building the hash table */
+	if (hashTable == NULL)
+	{
+		return;
+	}
+
+	columnarScanState->runtimeFilter.built = true;
+
+	if (hashTable->nbatch > 1 || hashTable->parallel_state != NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(columnarScanState->runtimeFilter.context);
+
+	Var *scanVar = columnarScanState->runtimeFilter.scanVar;
+	TypeCacheEntry *typeEntry = lookup_type_cache(scanVar->vartype,
+												  TYPECACHE_CMP_PROC_FINFO);
+
+	RuntimeFilterKeys keys = { 0 };
+	keys.hashCapacity = 1024;
+	keys.hashes = palloc(keys.hashCapacity * sizeof(uint64));
+	keys.compareFunction = &typeEntry->cmp_proc_finfo;
+
+	TupleTableSlot *innerSlot =
+		MakeSingleTupleTableSlot(ExecGetResultType(innerPlanState(hashJoinState)),
+								 &TTSOpsMinimalTuple);
+
+	for (int bucketIndex = 0; bucketIndex < hashTable->nbuckets; bucketIndex++)
+	{
+		HashJoinTuple hashTuple = hashTable->buckets.unshared[bucketIndex];
+		for (; hashTuple != NULL; hashTuple = hashTuple->next.unshared)
+		{
+			AddRuntimeFilterKey(columnarScanState, innerSlot, hashTuple, &keys);
+		}
+	}
+
+	if (hashTable->skewEnabled)
+	{
+		for (int skewIndex = 0; skewIndex < hashTable->nSkewBuckets; skewIndex++)
+		{
+			int bucketNumber = hashTable->skewBucketNums[skewIndex];
+			HashSkewBucket *skewBucket = hashTable->skewBucket[bucketNumber];
+
+			HashJoinTuple hashTuple = skewBucket->tuples;
+			for (; hashTuple != NULL; hashTuple = hashTuple->next.unshared)
+			{
+				AddRuntimeFilterKey(columnarScanState, innerSlot, hashTuple, &keys);
+			}
+		}
+	}
+
+	ExecDropSingleTupleTableSlot(innerSlot);
+
+	columnarScanState->runtimeFilter.bloomFilter =
+		ColumnarBloomFilterBuild(keys.hashes, keys.hashCount);
+	columnarScanState->runtimeFilter.joinKeyFilter.bloomFilter =
+		columnarScanState->runtimeFilter.bloomFilter;
+
+	if (keys.hashCount > 0)
+	{
+		columnarScanState->runtimeFilter.rangeClauses =
+			RuntimeFilterRangeClauses(scanVar, keys.minimum, keys.maximum);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	TableScanDesc scanDesc = columnarScanState->custom_scanstate.ss.ss_currentScanDesc;
+	if (scanDesc != NULL && columnarScanState->runtimeFilter.rangeClauses != NIL)
+	{
+		ColumnarScanAddQual((ColumnarScanDesc) scanDesc,
+							columnarScanState->runtimeFilter.rangeClauses);
+	}
+}
+
+
+/*
+ * AddRuntimeFilterKey adds the join key of the given hash table tuple to the
+ * keys of the runtime filter. Keys that are NULL never match.
+ */
+static void
+AddRuntimeFilterKey(ColumnarScanState *columnarScanState, TupleTableSlot *innerSlot,
+					HashJoinTuple hashTuple, RuntimeFilterKeys *keys)
+{
+	ExecStoreMinimalTuple(HJTUPLE_MINTUPLE(hashTuple), innerSlot, false);
+
+	bool isNull = false;
+	Datum key = slot_getattr(innerSlot, columnarScanState->runtimeFilter.innerAttno,
+							 &isNull);
+	if (isNull)
+	{
+		return;
+	}
+
+	Oid collation = columnarScanState->runtimeFilter.scanVar->varcollid;
+
+	if (keys->hashCount == keys->hashCapacity)
+	{
+		keys->hashCapacity *= 2;
+		keys->hashes = repalloc(keys->hashes, keys->hashCapacity * sizeof(uint64));
+	}
+
+	keys->hashes[keys->hashCount] =
+		ColumnarBloomHash(columnarScanState->runtimeFilter.hashFunction, collation,
+						  key);
+
+	if (keys->hashCount == 0)
+	{
+		keys->minimum = key;
+		keys->maximum = key;
+	}
+	else if (DatumGetInt32(FunctionCall2Coll(keys->compareFunction, collation,
+											 key, keys->minimum)) < 0)
+	{
+		keys->minimum = key;
+	}
+	else if (DatumGetInt32(FunctionCall2Coll(keys->compareFunction, collation,
+											 key, keys->maximum)) > 0)
+	{
+		keys->maximum = key;
+	}
+
+	keys->hashCount++;
+}
+
+
+/*
+ * RuntimeFilterRangeClauses returns the clauses that restrict the given scan
+ * column to the range between the given values, for skipping stripes and
+ * chunk groups.
+ */
+static List *
+RuntimeFilterRangeClauses(Var *scanVar, Datum minimum, Datum maximum)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(scanVar->vartype,
+												  TYPECACHE_BTREE_OPFAMILY);
+	Oid greaterEqualOperator = get_opfamily_member(typeEntry->btree_opf,
+												   scanVar->vartype, scanVar->vartype,
+												   BTGreaterEqualStrategyNumber);
+	Oid lessEqualOperator = get_opfamily_member(typeEntry->btree_opf,
+												scanVar->vartype, scanVar->vartype,
+												BTLessEqualStrategyNumber);
+	if (!OidIsValid(greaterEqualOperator) || !OidIsValid(lessEqualOperator))
+	{
+		return NIL;
+	}
+
+	int16 typeLength = get_typlen(scanVar->vartype);
+	Const *minimumConst = makeConst(scanVar->vartype, scanVar->vartypmod,
+									scanVar->varcollid, typeLength, minimum,
+									false, true);
+	Const *maximumConst = makeConst(scanVar->vartype, scanVar->vartypmod,
+									scanVar->varcollid, typeLength, maximum,
+									false, true);
+
+	Expr *lowerBound = make_opclause(greaterEqualOperator, BOOLOID, false,
+									 (Expr *) copyObject(scanVar),
+									 (Expr *) minimumConst,
+									 InvalidOid, scanVar->varcollid);
+	Expr *upperBound = make_opclause(lessEqualOperator, BOOLOID, false,
+									 (Expr *) copyObject(scanVar),
+									 (Expr *) maximumConst,
+									 InvalidOid, scanVar->varcollid);
+	set_opfuncid((OpExpr *) lowerBound);
+	set_opfuncid((OpExpr *) upperBound);
+
+	return list_make2(lowerBound, upperBound);
+}
+
+
+/*
+ * RuntimeFilterMayContain returns false if the join key of the given scan
+ * tuple is definitely not in the hash table of the hash join above.
+ */
+static bool
+RuntimeFilterMayContain(ColumnarScanState *columnarScanState, TupleTableSlot *slot)
+{
+	Var *scanVar = columnarScanState->runtimeFilter.scanVar;
+
+	bool isNull = false;
+	Datum key = slot_getattr(slot, scanVar->varattno, &isNull);
+	if (isNull)
+	{
+		return false;
+	}
+
+	uint64 hash = ColumnarBloomHash(columnarScanState->runtimeFilter.hashFunction,
+									scanVar->varcollid, key);
+
+	return ColumnarBloomFilterMayContain(columnarScanState->runtimeFilter.bloomFilter,
+										 hash);
+}
+
+
+/*
+ * ResetRuntimeFilter drops the runtime filter of the given scan, so that it
+ * gets rebuilt from the hash table of the next scan. The rescan of the table
+ * drops its range clauses.
+ */
+static void
+ResetRuntimeFilter(ColumnarScanState *columnarScanState)
+{
+	columnarScanState->runtimeFilter.built = false;
+	columnarScanState->runtimeFilter.bloomFilter = NULL;
+	columnarScanState->runtimeFilter.joinKeyFilter.bloomFilter = NULL;
+	columnarScanState->runtimeFilter.rangeClauses = NIL;
+	MemoryContextReset(columnarScanState->runtimeFilter.context);
+}
+
+
+/*
+ * InitTopNFilter sets up the top-N filter of the scan for the sort key found
+ * by TopNSortKey(). The scan keeps the first sort keys of as many rows as the
+ * sort above, and once it returned that many, leaves out the rows and chunk
+ * groups that sort after the last of them.
+ */
+static void
+InitTopNFilter(ColumnarScanState *columnarScanState, List *topNSortKey,
+			   MemoryContext queryContext)
+{
+	TupleDesc tupleDescriptor =
+		columnarScanState->custom_scanstate.ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+	AttrNumber attno = linitial_int(topNSortKey);
+	Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, attno - 1);
+	uint32 rowCount = list_nth_int(topNSortKey, 4);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(queryContext);
+
+	SortSupport sortKey = &columnarScanState->topNFilter.sortKey;
+	memset(sortKey, 0, sizeof(SortSupportData));
+	sortKey->ssup_cxt = queryContext;
+	sortKey->ssup_collation = (Oid) lthird_int(topNSortKey);
+	sortKey->ssup_nulls_first = lfourth_int(topNSortKey);
+	sortKey->ssup_attno = attno;
+	PrepareSortSupportFromOrderingOp((Oid) lsecond_int(topNSortKey), sortKey);
+
+	ColumnarTopNBound *bound = &columnarScanState->topNFilter.bound;
+	bound->attno = attno;
+	bound->rowCount = rowCount;
+	bound->sortKey = sortKey;
+	bound->valid = false;
+	bound->value = (Datum) 0;
+	bound->isNull = false;
+
+	columnarScanState->topNFilter.typeLength = attributeForm->attlen;
+	columnarScanState->topNFilter.typeByValue = attributeForm->attbyval;
+	columnarScanState->topNFilter.values = palloc(rowCount * sizeof(Datum));
+	columnarScanState->topNFilter.nulls = palloc(rowCount * sizeof(bool));
+	columnarScanState->topNFilter.heap = binaryheap_allocate(rowCount, TopNFilterCompare,
+															 columnarScanState);
+	columnarScanState->topNFilter.context =
+		AllocSetContextCreate(queryContext, "Columnar Top-N Filter",
+							  ALLOCSET_DEFAULT_SIZES);
+	columnarScanState->topNFilter.rowsRemoved = 0;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * TopNFilterCompare compares the sort keys at two indexes of the top-N
+ * filter, so that the heap has the one that sorts last on top.
+ */
+static int
+TopNFilterCompare(Datum a, Datum b, void *arg)
+{
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) arg;
+	int indexA = DatumGetInt32(a);
+	int indexB = DatumGetInt32(b);
+
+	return ApplySortComparator(columnarScanState->topNFilter.values[indexA],
+							   columnarScanState->topNFilter.nulls[indexA],
+							   columnarScanState->topNFilter.values[indexB],
+							   columnarScanState->topNFilter.nulls[indexB],
+							   &columnarScanState->topNFilter.sortKey);
+}
+
+
+/*
+ * TopNFilterAddRow adds the first sort key of a row the scan returns to the
+ * top-N filter, in place of the key that sorts last once the filter has as
+ * many keys as the sort keeps, and moves the bound to the new last key.
+ */
+static void
+TopNFilterAddRow(ColumnarScanState *columnarScanState, Datum value, bool isNull)
+{
+	binaryheap *heap = columnarScanState->topNFilter.heap;
+	ColumnarTopNBound *bound = &columnarScanState->topNFilter.bound;
+	bool heapFull = heap->bh_size == bound->rowCount;
+	int index = heap->bh_size;
+
+	if (heapFull)
+	{
+		/* rows that tie with the bound don't move it */
+		if (ApplySortComparator(value, isNull, bound->value, bound->isNull,
+								&columnarScanState->topNFilter.sortKey) >= 0)
+		{
+			return;
+		}
+
+		index = DatumGetInt32(binaryheap_first(heap));
+		if (!columnarScanState->topNFilter.typeByValue &&
+			!columnarScanState->topNFilter.nulls[index])
+		{
+			pfree(DatumGetPointer(columnarScanState->topNFilter.values[index]));
+		}
+	}
+
+	columnarScanState->topNFilter.nulls[index] = isNull;
+	columnarScanState->topNFilter.values[index] = (Datum) 0;
+	if (!isNull)
+	{
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(columnarScanState->topNFilter.context);
+
+		columnarScanState->topNFilter.values[index] =
+			datumCopy(value, columnarScanState->topNFilter.typeByValue,
+					  columnarScanState->topNFilter.typeLength);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	if (heapFull)
+	{
+		binaryheap_replace_first(heap, Int32GetDatum(index));
+	}
+	else
+	{
+		binaryheap_add(heap, Int32GetDatum(index));
+	}
+
+	if (heap->bh_size == bound->rowCount)
+	{
+		int lastIndex = DatumGetInt32(binaryheap_first(heap));
+
+		bound->valid = true;
+		bound->value = columnarScanState->topNFilter.values[lastIndex];
+		bound->isNull = columnarScanState->topNFilter.nulls[lastIndex];
+	}
+}
+
+
+/*
+ * ResetTopNFilter empties the top-N filter, for a scan that starts over.
+ */
+static void
+ResetTopNFilter(ColumnarScanState *columnarScanState)
+{
+	binaryheap_reset(columnarScanState->topNFilter.heap);
+	MemoryContextReset(columnarScanState->topNFilter.context);
+
+	columnarScanState->topNFilter.bound.valid = false;
+	columnarScanState->topNFilter.bound.value = (Datum) 0;
+	columnarScanState->topNFilter.bound.isNull = false;
+}
+
+
+/*
+ * ColumnarScan_ShutdownCustomScan copies the statistics of the workers of a
+ * parallel scan before the shared memory of the scan goes away. The workers
+ * have finished by the time the leader shuts the scan down.
+ */
+static void
+ColumnarScan_ShutdownCustomScan(CustomScanState *node)
+{
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+	ParallelColumnarScan pscan = columnarScanState->sharedScanState;
+
+	if (pscan == NULL || IsParallelWorker())
+	{
+		return;
+	}
+
+	SpinLockAcquire(&pscan->mutex);
+	columnarScanState->workerStatistics = pscan->workerStatistics;
+	SpinLockRelease(&pscan->mutex);
+}
+
+
+static void
+ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
+							   ExplainState *es)
+{
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+
+	List *context = set_deparse_context_planstate(
+		es->deparse_cxt, (Node *) &node->ss.ps, ancestors);
+
+	List *projectedColumns = ColumnarVarNeeded(columnarScanState);
+	const char *projectedColumnsStr = ColumnarProjectedColumnsStr(
+		context, projectedColumns);
+	ExplainPropertyText("Columnar Projected Columns",
+						projectedColumnsStr, es);
+
+	CustomScan *cscan = castNode(CustomScan, node->ss.ps.plan);
+	List *chunkGroupFilter = lsecond(cscan->custom_exprs);
+	if (chunkGroupFilter != NULL)
+	{
+		const char *pushdownClausesStr = ColumnarPushdownClausesStr(
+			context, chunkGroupFilter);
+		ExplainPropertyText("Columnar Chunk Group Filters",
+							pushdownClausesStr, es);
+
+		ColumnarScanDesc columnarScanDesc =
+			(ColumnarScanDesc) node->ss.ss_currentScanDesc;
+		if (columnarScanDesc != NULL)
+		{
+			/* the leader of a parallel scan may have left out whole stripes */
+			ExplainPropertyInteger(
+				"Columnar Chunk Groups Removed by Filter",
+				NULL, ColumnarScanChunkGroupsFiltered(columnarScanDesc) +
+				columnarScanState->parallelChunkGroupsPruned, es);
+		}
+	}
+
+	if (columnarScanState->chunkGroupSummary != NULL &&
+		node->ss.ss_currentScanDesc != NULL)
+	{
+		ExplainPropertyInteger("Columnar Chunk Groups Summarized", NULL,
+							   columnarScanState->chunkGroupSummary->chunkGroupCount,
+							   es);
+	}
+
+	if (columnarScanState->chunkGroupDelete != NULL &&
+		node->ss.ss_currentScanDesc != NULL)
+	{
+		ExplainPropertyInteger("Columnar Chunk Groups Deleted", NULL,
+							   columnarScanState->chunkGroupDelete->chunkGroupCount,
+							   es);
+	}
+
+	if (columnarScanState->projectionSummary != NULL &&
+		node->ss.ss_currentScanDesc != NULL)
+	{
+		ExplainPropertyInteger("Columnar Stripes Answered by Projection", NULL,
+							   columnarScanState->projectionSummary->stripeCount,
+							   es);
+	}
+
+	if (es->analyze && columnarScanState->runtimeFilter.bloomFilter != NULL)
+	{
+		const char *runtimeFilterStr = ColumnarProjectedColumnsStr(
+			context, list_make1(columnarScanState->runtimeFilter.scanVar));
+		ExplainPropertyText("Columnar Runtime Filter", runtimeFilterStr, es);
+		ExplainPropertyInteger("Rows Removed by Runtime Filter", NULL,
+							   columnarScanState->runtimeFilter.rowsRemoved, es);
+		ExplainPropertyInteger(
+			"Columnar Chunk Groups Removed by Runtime Filter", NULL,
+			columnarScanState->runtimeFilter.joinKeyFilter.chunkGroupsFiltered, es);
+	}
+
+	if (columnarScanState->topNFilter.heap != NULL)
+	{
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(node->ss.ss_ScanTupleSlot->tts_tupleDescriptor,
+						  columnarScanState->topNFilter.bound.attno - 1);
+		Var *sortVar = makeVar(cscan->scan.scanrelid, attributeForm->attnum,
+							   attributeForm->atttypid, attributeForm->atttypmod,
+							   attributeForm->attcollation, 0);
+		const char *topNFilterStr = ColumnarProjectedColumnsStr(
+			context, list_make1(sortVar));
+		ExplainPropertyText("Columnar Top-N Filter", topNFilterStr, es);
+
+		if (es->analyze)
+		{
+			ExplainPropertyInteger("Rows Removed by Top-N Filter", NULL,
+								   columnarScanState->topNFilter.rowsRemoved, es);
+		}
+	}
+
+	if (columnarScanState->sortKeyColumn != InvalidAttrNumber)
+	{
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(node->ss.ss_ScanTupleSlot->tts_tupleDescriptor,
+						  AttrNumberGetAttrOffset(columnarScanState->sortKeyColumn));
+		Var *sortVar = makeVar(cscan->scan.scanrelid, attributeForm->attnum,
+							   attributeForm->atttypid, attributeForm->atttypmod,
+							   attributeForm->attcollation, 0);
+		const char *sortKeyStr = ColumnarProjectedColumnsStr(
+			context, list_make1(sortVar));
+		ExplainPropertyText("Columnar Sort Key", sortKeyStr, es);
+	}
+
+	if (columnarScanState->vectorization.vectorizationEnabled &&
+		columnarScanState->vectorization.vectorizedQualList != NULL)
+	{
+		const char *vectorizedWhereClauses = ColumnarPushdownClausesStr(
+					context, columnarScanState->vectorization.vectorizedQualList);
+		ExplainPropertyText("Columnar Vectorized Filter", 
+							vectorizedWhereClauses, es);
+	}
+
+	if (columnarScanState->vectorization.projectionCallExprList != NIL)
+	{
+		const char *projectionStr = ColumnarProjectedColumnsStr(
+			context, columnarScanState->vectorization.projectionCallExprList);
+		ExplainPropertyText("Columnar Vectorized Projection", projectionStr, es);
+	}
+
+	if (es->verbose && columnar_enable_vectorization)
+	{
+		ExplainVectorizationFallbacks(columnarScanState, context, es);
+	}
+
+	if (es->analyze && es->verbose)
+	{
+		ExplainColumnarReadStatistics(columnarScanState, es);
+	}
+
+	if (columnar_enable_page_cache)
+	{
+		ColumnarCacheStatistics *statistics = ColumnarGetCacheStatistics();
+
+		ExplainPropertyUInteger(
+			"Cache Hits",
+			NULL,
+			statistics->hits,
+			es);
+
+		ExplainPropertyUInteger(
+			"Cache Misses",
+			NULL,
+			statistics->misses,
+			es);
+
+		ExplainPropertyUInteger(
+			"Cache Evictions",
+			NULL,
+			statistics->evictions,
+			es);
+
+		ExplainPropertyUInteger(
+			"Cache Writes",
+			NULL,
+			statistics->writes,
+			es);
+
+		ExplainPropertyUInteger(
+			"Cache Maximum Size",
+			NULL,
+			statistics->maximumCacheSize,
+			es);
+
+		ExplainPropertyUInteger(
+			"Cache Ending Size", 
+			NULL, 
+			statistics->endingCacheSize,
+			es);
+
+		ExplainPropertyUInteger(
+			"Total Cache Entries",
+			NULL,
+			statistics->entries,
+			es
+		);
+
+		ExplainPropertyUInteger(
+			"Skip List Cache Hits",
+			NULL,
+			statistics->skipListHits,
+			es);
+
+		ExplainPropertyUInteger(
+			"Skip List Cache Misses",
+			NULL,
+			statistics->skipListMisses,
+			es);
+
+		ExplainPropertyUInteger(
+			"Skip List Cache Entries",
+			NULL,
+			statistics->skipListEntries,
+			es);
+	}
+}
+
+
+/* Parallel Execution */
+
+static Size 
+Columnar_EstimateDSMCustomScan(CustomScanState *node,
+							   ParallelContext *pcxt)
+{
+	Size nbytes;
+
+	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
+
+	BuildParallelStripeList(columnarScanState);
+
+	nbytes = offsetof(ParallelColumnarScanData, snapshotData);
 	nbytes = add_size(nbytes, EstimateSnapshotSpace(columnarScanState->snapshot));
 	nbytes = MAXALIGN(nbytes);
+	nbytes = add_size(nbytes,
+					  mul_size(list_length(columnarScanState->parallelStripeList),
+							   sizeof(StripeMetadata)));
 
 	return nbytes;
 }
 
 
+/*
+ * BuildParallelStripeList looks up the stripes that the participants of a
+ * parallel scan claim, so the workers don't each scan columnar.stripe and
+ * prune the stripes they claim. The scan snapshot doesn't change across
+ * rescans, but clauses with exec params might, so stripes are only pruned
+ * with clauses that don't have any.
+ */
+static void
+BuildParallelStripeList(ColumnarScanState *columnarScanState)
+{
+	CustomScanState *node = (CustomScanState *) columnarScanState;
+	CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+
+	List *pruneClauses = NIL;
+	if (!ContainsExecParams((Node *) lsecond(cscan->custom_exprs), NULL))
+	{
+		pruneClauses = columnarScanState->qual;
+	}
+
+	columnarScanState->parallelStripeList =
+		ColumnarParallelScanStripeList(node->ss.ss_currentRelation,
+									   columnarScanState->snapshot, pruneClauses,
+									   &columnarScanState->parallelStripesPruned,
+									   &columnarScanState->parallelChunkGroupsPruned);
+	columnarScanState->parallelStripeListPruned = pruneClauses != NIL;
+}
+
+
 static void 
 Columnar_InitializeDSMCustomScan(CustomScanState *node,
 								 ParallelContext *pcxt,
@@ -2659,8 +4839,34 @@ Columnar_InitializeDSMCustomScan(CustomScanState *node,
 	/* Initialize parallel scan mutex */
 	SpinLockInit(&pscan->mutex);
 
-	/* Stripe numbers are starting from index 1 */
-	pg_atomic_init_u64(&pscan->nextStripeId, 1);
+	/* The stripe list goes after the snapshot */
+	Size stripeListOffset = offsetof(ParallelColumnarScanData, snapshotData);
+	stripeListOffset = add_size(stripeListOffset,
+								EstimateSnapshotSpace(columnarScanState->snapshot));
+	pscan->stripeListOffset = MAXALIGN(stripeListOffset);
+
+	StripeMetadata *stripeList = ParallelColumnarScanStripes(pscan);
+	StripeMetadata *stripeMetadata = NULL;
+	uint64 stripeIndex = 0;
+	foreach_ptr(stripeMetadata, columnarScanState->parallelStripeList)
+	{
+		stripeList[stripeIndex++] = *stripeMetadata;
+	}
+
+	pscan->stripeCount = stripeIndex;
+	pscan->stripeListPruned = columnarScanState->parallelStripeListPruned;
+	pscan->stripesPruned = columnarScanState->parallelStripesPruned;
+	pscan->chunkGroupsPruned = columnarScanState->parallelChunkGroupsPruned;
+
+	/* Workers add their statistics as they finish, across rescans */
+	memset(&pscan->workerStatistics, 0, sizeof(ColumnarReadStatistics));
+
+	/* The first participant to run out of stripes reads the delta store */
+	pg_atomic_init_u32(&pscan->deltaStoreClaimed, 0);
+
+	InitParallelStripeClaims(pscan, pcxt);
+
+	columnarScanState->sharedScanState = pscan;
 
 	if(parallel_leader_participation)
 		columnarScanState->parallelColumnarScan = pscan;
@@ -2669,6 +4875,24 @@ Columnar_InitializeDSMCustomScan(CustomScanState *node,
 }
 
 
+/*
+ * InitParallelStripeClaims resets what ClaimParallelStripeRange keeps in the
+ * shared scan state, so the participants start over with the first stripe of
+ * the list. The participants split the last stripes once fewer stripes than
+ * participants are left. The stripes the leader pruned count as skipped for
+ * each scan.
+ */
+static void
+InitParallelStripeClaims(ParallelColumnarScan pscan, ParallelContext *pcxt)
+{
+	pscan->nextStripeIndex = 0;
+	pscan->hasSplitStripe = false;
+	pscan->splitStripeNextChunkGroup = 0;
+	pscan->participantCount = pcxt->nworkers + (parallel_leader_participation ? 1 : 0);
+	pscan->workerStatistics.stripesSkipped += pscan->stripesPruned;
+}
+
+
 static void 
 Columnar_ReinitializeDSMCustomScan(CustomScanState *node,
 								   ParallelContext *pcxt,
@@ -2677,8 +4901,8 @@ Columnar_ReinitializeDSMCustomScan(CustomScanState *node,
 	ParallelColumnarScan pscan = (ParallelColumnarScan) coordinate;
 	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
 
-	/* Reset atomic nextStripeId to initial value */
-	pg_atomic_init_u64(&pscan->nextStripeId, 1);
+	pg_atomic_init_u32(&pscan->deltaStoreClaimed, 0);
+	InitParallelStripeClaims(pscan, pcxt);
 
 	if(parallel_leader_participation)
 		columnarScanState->parallelColumnarScan = pscan;
@@ -2695,10 +4919,128 @@ Columnar_InitializeWorkerCustomScan(CustomScanState *node,
 	ColumnarScanState *columnarScanState = (ColumnarScanState *) node;
 	ParallelColumnarScan pscan = (ParallelColumnarScan) coordinate;
 	columnarScanState->parallelColumnarScan = pscan;
+	columnarScanState->sharedScanState = pscan;
 	columnarScanState->snapshot = RestoreSnapshot(pscan->snapshotData);
 }
 
 
+/*
+ * ExplainVectorizationFallbacks shows, for EXPLAIN (VERBOSE), why the quals
+ * of the given scan that are not in its vectorized filter and the aggregate
+ * above it, if any, run row by row.
+ */
+static void
+ExplainVectorizationFallbacks(ColumnarScanState *columnarScanState, List *context,
+							  ExplainState *es)
+{
+	CustomScan *cscan = castNode(CustomScan, columnarScanState->custom_scanstate.ss.ps.plan);
+	List *fallbackList = NIL;
+
+	Node *qual = NULL;
+	foreach_ptr(qual, cscan->scan.plan.qual)
+	{
+		const char *reason = VectorizedQualFallbackReason(qual);
+		if (reason == NULL)
+		{
+			reason = "columnar.enable_vectorization was off when the query was planned";
+		}
+
+		bool useTableNamePrefix = false;
+		bool showImplicitCast = false;
+		const char *qualStr = deparse_expression(qual, context, useTableNamePrefix,
+												 showImplicitCast);
+
+		fallbackList = lappend(fallbackList, psprintf("%s: %s", qualStr, reason));
+	}
+
+	if (fallbackList != NIL)
+	{
+		ExplainPropertyList("Columnar Vectorization Fallbacks", fallbackList, es);
+	}
+
+	if (columnarScanState->vectorization.aggregateFallbackReason != NULL)
+	{
+		ExplainPropertyText("Columnar Aggregate Vectorization Fallback",
+							columnarScanState->vectorization.aggregateFallbackReason,
+							es);
+	}
+}
+
+
+/*
+ * ExplainColumnarReadStatistics shows what the given scan read, including
+ * what its parallel workers read, for EXPLAIN (ANALYZE, VERBOSE).
+ */
+static void
+ExplainColumnarReadStatistics(ColumnarScanState *columnarScanState, ExplainState *es)
+{
+	ColumnarReadStatistics statistics = columnarScanState->workerStatistics;
+
+	ColumnarScanDesc columnarScanDesc =
+		(ColumnarScanDesc) columnarScanState->custom_scanstate.ss.ss_currentScanDesc;
+	if (columnarScanDesc != NULL)
+	{
+		const ColumnarReadStatistics *leaderStatistics =
+			ColumnarScanGetStatistics(columnarScanDesc);
+
+		if (leaderStatistics != NULL)
+		{
+			AddColumnarReadStatistics(&statistics, leaderStatistics);
+		}
+	}
+
+	ExplainPropertyUInteger("Columnar Stripes Read", NULL, statistics.stripesRead, es);
+	ExplainPropertyUInteger("Columnar Stripes Skipped", NULL, statistics.stripesSkipped,
+							es);
+	ExplainPropertyUInteger("Columnar Chunk Groups Read", NULL,
+							statistics.chunkGroupsRead, es);
+	ExplainPropertyUInteger("Columnar Bytes Read", "bytes", statistics.bytesRead, es);
+	ExplainPropertyUInteger("Columnar Peak Memory", "kB",
+							(statistics.peakMemoryBytes + 1023) / 1024, es);
+	ExplainPropertyUInteger("Rows Removed by Row Mask", NULL,
+							statistics.rowsRemovedByRowMask, es);
+	ExplainPropertyUInteger("Rows Removed by Sorted Search", NULL,
+							statistics.rowsRemovedBySortedSearch, es);
+
+	if (columnar_enable_page_cache)
+	{
+		ExplainPropertyUInteger("Columnar Column Cache Hits", NULL,
+								statistics.cacheHits, es);
+		ExplainPropertyUInteger("Columnar Column Cache Misses", NULL,
+								statistics.cacheMisses, es);
+	}
+
+	for (int compressionType = 0; compressionType < COMPRESSION_COUNT; compressionType++)
+	{
+		const DecompressionStatistics *decompression =
+			&statistics.decompression[compressionType];
+		const char *compressionName = CompressionTypeStr(compressionType);
+
+		if (decompression->chunkCount == 0 || compressionName == NULL)
+		{
+			continue;
+		}
+
+		StringInfo label = makeStringInfo();
+		appendStringInfo(label, "Columnar Decompression (%s)", compressionName);
+
+		StringInfo value = makeStringInfo();
+		appendStringInfo(value, "chunks=" UINT64_FORMAT " compressed=" UINT64_FORMAT
+						 " decompressed=" UINT64_FORMAT,
+						 decompression->chunkCount, decompression->compressedBytes,
+						 decompression->decompressedBytes);
+
+		if (es->timing)
+		{
+			appendStringInfo(value, " time=%.3f ms",
+							 decompression->elapsedMicroseconds / 1000.0);
+		}
+
+		ExplainPropertyText(label->data, value->data, es);
+	}
+}
+
+
 /*
  * ColumnarPushdownClausesStr represents the clauses to push down as a string.
  */
@@ -2826,3 +5168,123 @@ set_deparse_context_planstate(List *dpcontext, Node *node, List *ancestors)
 
 
 #endif
+
+
+/*
+ * InitVectorizedProjection sets up computing the vectors the aggregate above
+ * gets from the vectors of the reader, instead of projecting each row, when
+ * the target list is columns and vectorized function calls of them, like a
+ * date_trunc('hour', ts) group key. The values are moved between the vectors
+ * by their bytes, so all of them need to be passed by value.
+ */
+static void
+InitVectorizedProjection(ColumnarScanState *columnarScanState)
+{
+	CustomScan *cscan =
+		castNode(CustomScan, columnarScanState->custom_scanstate.ss.ps.plan);
+	TupleTableSlot *scanVectorSlot = columnarScanState->vectorization.scanVectorSlot;
+	List *targetList = cscan->scan.plan.targetlist;
+	List *callExprList = NIL;
+
+	AttrNumber *attnos = palloc0(sizeof(AttrNumber) * list_length(targetList));
+	VectorQual **calls = palloc0(sizeof(VectorQual *) * list_length(targetList));
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, targetList)
+	{
+		Node *expr = (Node *) targetEntry->expr;
+		int attributeIndex = targetEntry->resno - 1;
+
+		if (!IsVectorizableValueType(exprType(expr)))
+		{
+			return;
+		}
+
+		if (IsA(expr, Var) && ((Var *) expr)->varattno > 0)
+		{
+			attnos[attributeIndex] = ((Var *) expr)->varattno;
+			continue;
+		}
+
+		Node *vectorizedExpr = CreateVectorizedFuncExpr(expr);
+		if (vectorizedExpr == NULL)
+		{
+			return;
+		}
+
+		calls[attributeIndex] = ConstructVectorizedFuncExpr(scanVectorSlot,
+															vectorizedExpr);
+		callExprList = lappend(callExprList, vectorizedExpr);
+	}
+
+	columnarScanState->vectorization.projectionAttnos = attnos;
+	columnarScanState->vectorization.projectionCalls = calls;
+	columnarScanState->vectorization.projectionCallExprList = callExprList;
+}
+
+
+/*
+ * ProjectVectorSlot computes the result vectors from the rows of the vector
+ * the reader returned that passed the quals. When all of them did, columns
+ * keep their runs, and so do the results of the function calls that compute
+ * one value per run.
+ */
+static TupleTableSlot *
+ProjectVectorSlot(ColumnarScanState *columnarScanState, VectorTupleTableSlot *vectorSlot)
+{
+	VectorTupleTableSlot *resultSlot =
+		(VectorTupleTableSlot *) columnarScanState->vectorization.resultVectorSlot;
+	int natts = resultSlot->tts.tts_tupleDescriptor->natts;
+	uint32 rowCount = VectorSlotSelectedCount(vectorSlot);
+
+	ExecClearTuple(&resultSlot->tts);
+	CleanupVectorSlot(resultSlot);
+
+	for (int i = 0; i < natts; i++)
+	{
+		VectorQual *call = columnarScanState->vectorization.projectionCalls[i];
+		AttrNumber attno = columnarScanState->vectorization.projectionAttnos[i];
+		VectorColumn *source = call != NULL ?
+							   ExecuteVectorizedFuncExpr(call) :
+							   (VectorColumn *) vectorSlot->tts.tts_values[attno - 1];
+		VectorColumn *target = (VectorColumn *) resultSlot->tts.tts_values[i];
+		uint16 typeLen = target->columnTypeLen;
+
+		Assert(source->columnTypeLen == typeLen);
+
+		if (!vectorSlot->hasSelection)
+		{
+			memcpy(target->value, source->value, typeLen * rowCount);
+			memcpy(target->isnull, source->isnull, rowCount);
+
+			if (source->hasRuns)
+			{
+				CopyVectorColumnRuns(target, source);
+			}
+		}
+		else
+		{
+			for (uint32 n = 0; n < rowCount; n++)
+			{
+				uint32 row = vectorSlot->selection[n];
+
+				memcpy((int8 *) target->value + typeLen * n,
+					   (int8 *) source->value + typeLen * row, typeLen);
+				target->isnull[n] = source->isnull[row];
+			}
+		}
+
+		target->dimension = rowCount;
+		target->noNulls = source->noNulls;
+	}
+
+	for (uint32 n = 0; n < rowCount; n++)
+	{
+		resultSlot->rowNumber[n] = vectorSlot->rowNumber[VectorSlotSelectedRow(vectorSlot, n)];
+	}
+
+	resultSlot->dimension = rowCount;
+	ExecStoreVirtualTuple(&resultSlot->tts);
+
+	return &resultSlot->tts;
+}
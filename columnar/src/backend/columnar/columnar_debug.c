@@ -33,6 +33,7 @@ static void MemoryContextTotals(MemoryContext context, MemoryContextCounters *co
 
 PG_FUNCTION_INFO_V1(columnar_store_memory_stats);
 PG_FUNCTION_INFO_V1(columnar_storage_info);
+PG_FUNCTION_INFO_V1(columnar_memory_peaks);
 
 
 /*
@@ -147,6 +148,41 @@ columnar_storage_info(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * columnar_memory_peaks returns the most memory a stripe read and a stripe
+ * write of this backend used since the last reset, and resets them if asked
+ * to, so that the peaks of the next query can be measured.
+ */
+Datum
+columnar_memory_peaks(PG_FUNCTION_ARGS)
+{
+#define MEMORY_PEAKS_NATTS 2
+	bool reset = PG_GETARG_BOOL(0);
+	TupleDesc tupdesc;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	Datum values[MEMORY_PEAKS_NATTS] = { 0 };
+	bool nulls[MEMORY_PEAKS_NATTS] = { 0 };
+
+	values[0] = Int64GetDatum(ColumnarReadStatePeakMemory());
+	values[1] = Int64GetDatum(ColumnarWriteStatePeakMemory());
+
+	if (reset)
+	{
+		ColumnarResetReadStatePeakMemory();
+		ColumnarResetWriteStatePeakMemory();
+	}
+
+	HeapTuple tuple = heap_form_tuple(tupdesc, values, nulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+
 /*
  * MemoryContextTotals adds stats of the given memory context and its
  * subtree to the given counters.
@@ -0,0 +1,247 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_delta_store.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Row oriented delta store of columnar tables.
+ *
+ * Writing a stripe costs the same metadata updates however few rows it
+ * holds, so trickles of single row inserts leave behind many tiny stripes.
+ * When the delta_store option of a table is set, the first
+ * columnar.delta_store_row_limit rows of each write are instead kept as
+ * heap tuples in the columnar.delta_store catalog table, under row numbers
+ * reserved like those of stripe rows. Sequential scans return the delta
+ * store rows after the stripe rows, and deletes and updates of such rows
+ * delete them from the catalog table.
+ *
+ * Flushing moves the rows into stripes, either when columnar.flush_delta_store
+ * is called or by the compaction worker once a table has
+ * columnar.auto_compaction_delta_rows delta store rows. Flushed rows get new
+ * row numbers, so tables with indexes never write to the delta store.
+ *
+ * Row numbers are reserved in batches that a backend hands out to the rows
+ * it stores, so concurrent writers don't update the metapage for each row.
+ * The rest of a batch is left unused when the backend moves on to another
+ * table or exits.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "miscadmin.h"
+#include "storage/lmgr.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+
+/* largest number of row numbers reserved at once */
+#define DELTA_ROW_NUMBER_BATCH_MAX 1024
+
+/*
+ * Row numbers the backend reserved for delta store rows of the storage with
+ * id deltaRowNumberStorageId but hasn't used yet, from deltaNextRowNumber
+ * up to deltaEndRowNumber. The next batch doubles in size like the stripe
+ * reservation batches of writers.
+ */
+static uint64 deltaRowNumberStorageId = 0;
+static uint64 deltaNextRowNumber = 0;
+static uint64 deltaEndRowNumber = 0;
+static uint32 deltaNextBatchSize = 1;
+
+static uint64 ReserveDeltaRowNumber(Relation relation, uint64 storageId);
+
+PG_FUNCTION_INFO_V1(flush_delta_store);
+
+
+/*
+ * ColumnarDeltaStoreInsert stores a row of the given relation in the delta
+ * store and returns the row number it got.
+ */
+uint64
+ColumnarDeltaStoreInsert(Relation relation, TupleDesc tupleDescriptor,
+						 Datum *columnValues, bool *columnNulls)
+{
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	uint64 rowNumber = ReserveDeltaRowNumber(relation, storageId);
+
+	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, columnValues, columnNulls);
+
+	bytea *rowData = palloc(VARHDRSZ + heapTuple->t_len);
+	SET_VARSIZE(rowData, VARHDRSZ + heapTuple->t_len);
+	memcpy(VARDATA(rowData), heapTuple->t_data, heapTuple->t_len);
+
+	InsertDeltaStoreRow(storageId, rowNumber, rowData);
+
+	pfree(rowData);
+	heap_freetuple(heapTuple);
+
+	return rowNumber;
+}
+
+
+/*
+ * ReserveDeltaRowNumber returns a row number for a delta store row of the
+ * given relation, from the batch of the backend if it has one left for the
+ * storage. Metapage updates aren't transactional, so the numbers of a batch
+ * stay reserved whether the transactions using them commit or not. Storage
+ * ids aren't reused, so a batch can't outlive its storage.
+ */
+static uint64
+ReserveDeltaRowNumber(Relation relation, uint64 storageId)
+{
+	if (deltaRowNumberStorageId != storageId)
+	{
+		deltaRowNumberStorageId = storageId;
+		deltaNextRowNumber = 0;
+		deltaEndRowNumber = 0;
+		deltaNextBatchSize = 1;
+	}
+
+	if (deltaNextRowNumber == deltaEndRowNumber)
+	{
+		uint32 batchSize = deltaNextBatchSize;
+
+		deltaNextRowNumber = ColumnarStorageReserveRowNumber(relation, batchSize);
+		deltaEndRowNumber = deltaNextRowNumber + batchSize;
+		deltaNextBatchSize = Min(batchSize * 2, DELTA_ROW_NUMBER_BATCH_MAX);
+	}
+
+	return deltaNextRowNumber++;
+}
+
+
+/*
+ * DeformDeltaStoreRow extracts the column values of a delta store row. The
+ * values point into a copy of the row allocated in the current memory
+ * context.
+ */
+void
+DeformDeltaStoreRow(bytea *rowData, TupleDesc tupleDescriptor,
+					Datum *columnValues, bool *columnNulls)
+{
+	uint32 tupleLength = VARSIZE_ANY_EXHDR(rowData);
+
+	/* the tuple header must be aligned, which bytea contents aren't */
+	HeapTupleHeader tupleHeader = palloc(tupleLength);
+	memcpy(tupleHeader, VARDATA_ANY(rowData), tupleLength);
+
+	HeapTupleData heapTuple = { 0 };
+	heapTuple.t_len = tupleLength;
+	heapTuple.t_data = tupleHeader;
+	ItemPointerSetInvalid(&heapTuple.t_self);
+
+	/* rows written before columns were added are filled with their defaults */
+	heap_deform_tuple(&heapTuple, tupleDescriptor, columnValues, columnNulls);
+}
+
+
+/*
+ * ColumnarFlushDeltaStore writes the delta store rows of the given relation
+ * into new stripes, deletes them from the delta store and returns how many
+ * rows were moved. Callers must lock the relation against writes.
+ */
+uint64
+ColumnarFlushDeltaStore(Relation relation)
+{
+	if (!ColumnarDeltaStoreSupported())
+	{
+		return 0;
+	}
+
+	if (relation->rd_rel->relhasindex)
+	{
+		ereport(ERROR, (errmsg("cannot flush the delta store of table %s",
+							   quote_identifier(RelationGetRelationName(relation))),
+						errdetail("Flushed rows get new row numbers, which would "
+								  "invalidate the index entries of the table."),
+						errhint("Use VACUUM FULL to move the rows into stripes.")));
+	}
+
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+
+	ColumnarOptions options = { 0 };
+	ReadColumnarOptions(RelationGetRelid(relation), &options);
+
+	/* rows are read and deleted with the same snapshot, so none is lost */
+	Snapshot snapshot = RegisterSnapshot(GetLatestSnapshot());
+
+	DeltaStoreScanDesc scan = BeginDeltaStoreScan(storageId, snapshot);
+
+	ColumnarWriteState *writeState = ColumnarBeginWrite(relation->rd_node, options,
+														tupleDescriptor);
+
+	MemoryContext rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "Delta Store Flush Row Context",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	Datum *values = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+
+	uint64 rowCount = 0;
+	uint64 rowNumber = 0;
+	bytea *rowData = NULL;
+	while ((rowData = DeltaStoreScanNext(scan, &rowNumber)) != NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(rowContext);
+		DeformDeltaStoreRow(rowData, tupleDescriptor, values, nulls);
+		MemoryContextSwitchTo(oldContext);
+
+		ColumnarWriteRow(writeState, values, nulls);
+
+		pfree(rowData);
+		MemoryContextReset(rowContext);
+		rowCount++;
+	}
+
+	ColumnarEndWrite(writeState);
+	EndDeltaStoreScan(scan);
+
+	DeleteDeltaStoreRows(storageId, snapshot);
+
+	UnregisterSnapshot(snapshot);
+	MemoryContextDelete(rowContext);
+
+	return rowCount;
+}
+
+
+/*
+ * flush_delta_store moves the delta store rows of a columnar table into
+ * stripes and returns the number of rows moved.
+ */
+Datum
+flush_delta_store(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	/* blocks writers, but not readers, of the table while rows are moved */
+	Relation rel = table_open(relationId, ExclusiveLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
+	}
+
+	uint64 rowCount = ColumnarFlushDeltaStore(rel);
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT64(rowCount);
+}
@@ -0,0 +1,890 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_encoding.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Value encodings of column chunks. An encoding rewrites the serialized
+ * values of a chunk before they are handed to the general purpose codec,
+ * and the reader decodes them right after decompression.
+ *
+ * Dictionary encoding is used for variable length columns with few distinct
+ * values in a chunk. The encoded buffer is laid out as
+ *
+ *     DictionaryHeader | entries | codes
+ *
+ * where entries are the distinct values serialized the same way as in an
+ * unencoded chunk, and codes has one uint16 per non-null row which indexes
+ * the entries. Values are compared byte by byte, so this works for any type.
+ *
+ * Run length encoding is used for fixed length columns with long runs of
+ * equal values, e.g. the columns data is ordered by. The encoded buffer is
+ *
+ *     RunLengthHeader | values | run lengths
+ *
+ * where values has one serialized value per run, and run lengths has the
+ * number of consecutive non-null rows of each run as uint32.
+ *
+ * Bit packing is used for 2, 4 and 8 byte integer like columns, e.g. ids and
+ * timestamps. Values are stored either as their offset from the chunk's
+ * minimum value (frame of reference), or, for mostly sorted chunks, as the
+ * offset of their delta to the previous value from the minimum delta. The
+ * offsets are packed with the number of bits the largest one needs:
+ *
+ *     BitPackHeader | packed offsets
+ *
+ * where packed offsets is an array of uint64 words, filled from the least
+ * significant bit, plus one spare word so the unpack loop doesn't need to
+ * check for the end of the array.
+ *
+ * The offsets layout is used for variable length columns when
+ * columnar.enable_value_offsets is on and dictionary encoding didn't apply.
+ * It doesn't make the chunk smaller, but gives the position of every value:
+ *
+ *     OffsetsHeader | offsets | values
+ *
+ * where offsets has valueCount + 1 uint32 offsets of the values relative to
+ * the start of values, the last one being their length, and values is the
+ * unencoded stream of the chunk. Readers find the value of any non-null row
+ * without walking the values before it, and vector kernels can work on the
+ * offsets and values as two contiguous buffers.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "safe_lib.h"
+
+#include "access/tupmacs.h"
+#include "common/hashfn.h"
+#include "port/pg_bitutils.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_encoding.h"
+
+typedef struct DictionaryHeader
+{
+	uint32 entryCount;
+	uint32 entriesLength;
+} DictionaryHeader;
+
+#define DICTIONARY_ENTRIES_OFFSET MAXALIGN(sizeof(DictionaryHeader))
+#define DICTIONARY_CODES_OFFSET(entriesLength) \
+	SHORTALIGN(DICTIONARY_ENTRIES_OFFSET + (entriesLength))
+
+typedef struct RunLengthHeader
+{
+	uint32 runCount;
+	uint32 valueCount;
+} RunLengthHeader;
+
+#define RUN_LENGTH_VALUES_OFFSET MAXALIGN(sizeof(RunLengthHeader))
+#define RUN_LENGTH_LENGTHS_OFFSET(runCount, valueStride) \
+	INTALIGN(RUN_LENGTH_VALUES_OFFSET + (uint64) (runCount) * (valueStride))
+
+/* offsets in a bit packed chunk are deltas to the previous value */
+#define BIT_PACK_DELTA 0x01
+
+typedef struct BitPackHeader
+{
+	uint32 valueCount;
+	uint16 bitWidth;
+	uint16 flags;
+
+	/* first value for delta packed chunks, minimum value otherwise */
+	int64 reference;
+
+	/* minimum delta for delta packed chunks */
+	int64 deltaBase;
+} BitPackHeader;
+
+#define BIT_PACK_WORDS_OFFSET MAXALIGN(sizeof(BitPackHeader))
+#define BIT_PACK_WORD_COUNT(offsetCount, bitWidth) \
+	(((uint64) (offsetCount) * (bitWidth) + 63) / 64 + 1)
+
+typedef struct OffsetsHeader
+{
+	uint32 valueCount;
+	uint32 valuesLength;
+} OffsetsHeader;
+
+#define OFFSETS_OFFSETS_OFFSET MAXALIGN(sizeof(OffsetsHeader))
+#define OFFSETS_VALUES_OFFSET(valueCount) \
+	MAXALIGN(OFFSETS_OFFSETS_OFFSET + ((uint64) (valueCount) + 1) * sizeof(uint32))
+
+typedef struct DictionaryKey
+{
+	const char *data;
+	uint32 length;
+} DictionaryKey;
+
+typedef struct DictionaryEntry
+{
+	DictionaryKey key;
+	uint16 code;
+} DictionaryEntry;
+
+static uint32 DictionaryKeyHash(const void *key, Size keysize);
+static int DictionaryKeyMatch(const void *key1, const void *key2, Size keysize);
+static int64 ReadSerializedInteger(const char *valuePointer, int datumTypeLength);
+static uint32 BitWidth(uint64 maxOffset);
+static void BitPack(const uint64 *offsets, uint32 offsetCount, uint32 bitWidth,
+					uint64 *words);
+static void BitUnpack(const uint64 *words, uint32 offsetCount, uint32 bitWidth,
+					  uint64 *offsets);
+
+
+/*
+ * DictionaryEncodeBuffer dictionary encodes valueCount serialized values of a
+ * variable length type in inputBuffer into outputBuffer. It returns false and
+ * leaves outputBuffer untouched if the chunk has too many distinct values or
+ * the encoding doesn't make it smaller.
+ */
+bool
+DictionaryEncodeBuffer(StringInfo inputBuffer, uint32 valueCount, int datumTypeLength,
+					   char datumTypeAlign, StringInfo outputBuffer)
+{
+	Assert(datumTypeLength == -1);
+
+	if (valueCount == 0)
+	{
+		return false;
+	}
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(DictionaryKey);
+	info.entrysize = sizeof(DictionaryEntry);
+	info.hash = DictionaryKeyHash;
+	info.match = DictionaryKeyMatch;
+	info.hcxt = CurrentMemoryContext;
+
+	HTAB *dictionary = hash_create("columnar dictionary encoding", 256, &info,
+								   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE |
+								   HASH_CONTEXT);
+
+	uint16 *codes = palloc(valueCount * sizeof(uint16));
+	uint32 *entryOffsets = palloc(DICTIONARY_MAX_ENTRIES * sizeof(uint32));
+	uint32 entryCount = 0;
+	uint64 entriesLength = 0;
+	uint32 currentOffset = 0;
+	bool tooManyEntries = false;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		char *valuePointer = inputBuffer->data + currentOffset;
+		uint32 valueLength = att_addlength_pointer(0, datumTypeLength, valuePointer);
+		uint32 nextOffset = att_align_nominal(currentOffset + valueLength,
+											  datumTypeAlign);
+
+		DictionaryKey key = { .data = valuePointer, .length = valueLength };
+
+		bool found = false;
+		DictionaryEntry *entry = hash_search(dictionary, &key, HASH_ENTER, &found);
+		if (!found)
+		{
+			if (entryCount == DICTIONARY_MAX_ENTRIES)
+			{
+				tooManyEntries = true;
+				break;
+			}
+
+			entry->code = entryCount;
+			entryOffsets[entryCount] = currentOffset;
+			entriesLength += nextOffset - currentOffset;
+			entryCount++;
+		}
+
+		codes[valueIndex] = entry->code;
+		currentOffset = nextOffset;
+	}
+
+	hash_destroy(dictionary);
+
+	uint64 codesOffset = DICTIONARY_CODES_OFFSET(entriesLength);
+	uint64 encodedLength = codesOffset + valueCount * sizeof(uint16);
+	if (tooManyEntries || encodedLength >= inputBuffer->len)
+	{
+		pfree(codes);
+		pfree(entryOffsets);
+		return false;
+	}
+
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, encodedLength);
+	memset(outputBuffer->data, 0, encodedLength);
+
+	DictionaryHeader *header = (DictionaryHeader *) outputBuffer->data;
+	header->entryCount = entryCount;
+	header->entriesLength = entriesLength;
+
+	/* entries keep the alignment they had, as both buffers are maxaligned */
+	char *entryPointer = outputBuffer->data + DICTIONARY_ENTRIES_OFFSET;
+	for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		char *valuePointer = inputBuffer->data + entryOffsets[entryIndex];
+		uint32 valueLength = att_addlength_pointer(0, datumTypeLength, valuePointer);
+
+		memcpy_s(entryPointer,
+				 outputBuffer->maxlen - (entryPointer - outputBuffer->data),
+				 valuePointer, valueLength);
+		entryPointer += att_align_nominal(valueLength, datumTypeAlign);
+	}
+
+	memcpy_s(outputBuffer->data + codesOffset, outputBuffer->maxlen - codesOffset,
+			 codes, valueCount * sizeof(uint16));
+	outputBuffer->len = encodedLength;
+
+	pfree(codes);
+	pfree(entryOffsets);
+
+	return true;
+}
+
+
+/*
+ * DictionaryDecodeDatumArray is the dictionary encoding counterpart of
+ * DeserializeDatumArray. Rows with the same value get the same datum, which
+ * points to the dictionary entry in datumBuffer.
+ */
+void
+DictionaryDecodeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
+						   int datumTypeLength, char datumTypeAlign, Datum *datumArray)
+{
+	Datum *entries = NULL;
+	const uint16 *codes = NULL;
+	uint32 codeCount = 0;
+	uint32 entryCount = DictionaryEntryArray(datumBuffer, datumTypeLength,
+											 datumTypeAlign, &entries, &codes,
+											 &codeCount);
+	uint32 codeIndex = 0;
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		if (codeIndex >= codeCount || codes[codeIndex] >= entryCount)
+		{
+			ereport(ERROR, (errmsg("invalid dictionary code in chunk")));
+		}
+
+		datumArray[datumIndex] = entries[codes[codeIndex]];
+		codeIndex++;
+	}
+}
+
+
+/*
+ * DictionaryEntryArray sets entryArray to the distinct values of a dictionary
+ * encoded chunk, pointing into datumBuffer, and codeArray to the index of the
+ * entry of each non-null row, and returns the number of entries. Predicates
+ * on the column can be evaluated once for each entry instead of each row.
+ */
+uint32
+DictionaryEntryArray(StringInfo datumBuffer, int datumTypeLength, char datumTypeAlign,
+					 Datum **entryArray, const uint16 **codeArray, uint32 *codeCount)
+{
+	if (datumBuffer->len < DICTIONARY_ENTRIES_OFFSET)
+	{
+		ereport(ERROR, (errmsg("invalid dictionary encoded chunk: %d bytes",
+							   datumBuffer->len)));
+	}
+
+	DictionaryHeader *header = (DictionaryHeader *) datumBuffer->data;
+	uint64 codesOffset = DICTIONARY_CODES_OFFSET(header->entriesLength);
+	if (codesOffset > datumBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in dictionary: "
+							   UINT64_FORMAT ", %d", codesOffset, datumBuffer->len)));
+	}
+
+	Datum *entries = palloc(Max(header->entryCount, 1) * sizeof(Datum));
+	uint32 entriesEnd = DICTIONARY_ENTRIES_OFFSET + header->entriesLength;
+	uint32 currentOffset = DICTIONARY_ENTRIES_OFFSET;
+
+	for (uint32 entryIndex = 0; entryIndex < header->entryCount; entryIndex++)
+	{
+		char *entryPointer = datumBuffer->data + currentOffset;
+
+		entries[entryIndex] = fetch_att(entryPointer, false, datumTypeLength);
+		currentOffset = att_addlength_pointer(currentOffset, datumTypeLength,
+											  entryPointer);
+		currentOffset = att_align_nominal(currentOffset, datumTypeAlign);
+
+		if (currentOffset > entriesEnd)
+		{
+			ereport(ERROR, (errmsg("insufficient data left in dictionary: %d, %d",
+								   currentOffset, entriesEnd)));
+		}
+	}
+
+	*entryArray = entries;
+	*codeArray = (const uint16 *) (datumBuffer->data + codesOffset);
+	*codeCount = (datumBuffer->len - codesOffset) / sizeof(uint16);
+
+	return header->entryCount;
+}
+
+
+/*
+ * RunLengthEncodeBuffer run length encodes valueCount serialized values of a
+ * fixed length type in inputBuffer into outputBuffer. It returns false and
+ * leaves outputBuffer untouched if the encoding doesn't make it smaller.
+ */
+bool
+RunLengthEncodeBuffer(StringInfo inputBuffer, uint32 valueCount, int datumTypeLength,
+					  char datumTypeAlign, StringInfo outputBuffer)
+{
+	Assert(datumTypeLength > 0);
+
+	uint32 valueStride = att_align_nominal(datumTypeLength, datumTypeAlign);
+	if (valueCount == 0 || (uint64) valueCount * valueStride > inputBuffer->len)
+	{
+		return false;
+	}
+
+	/* serialized values have zeroed padding, so comparing strides is enough */
+	uint32 runCount = 1;
+	for (uint32 valueIndex = 1; valueIndex < valueCount; valueIndex++)
+	{
+		char *valuePointer = inputBuffer->data + (uint64) valueIndex * valueStride;
+		if (memcmp(valuePointer, valuePointer - valueStride, valueStride) != 0)
+		{
+			runCount++;
+		}
+	}
+
+	uint64 lengthsOffset = RUN_LENGTH_LENGTHS_OFFSET(runCount, valueStride);
+	uint64 encodedLength = lengthsOffset + runCount * sizeof(uint32);
+	if (encodedLength >= inputBuffer->len)
+	{
+		return false;
+	}
+
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, encodedLength);
+	memset(outputBuffer->data, 0, encodedLength);
+
+	RunLengthHeader *header = (RunLengthHeader *) outputBuffer->data;
+	header->runCount = runCount;
+	header->valueCount = valueCount;
+
+	char *runValuePointer = outputBuffer->data + RUN_LENGTH_VALUES_OFFSET;
+	uint32 *runLengths = (uint32 *) (outputBuffer->data + lengthsOffset);
+	uint32 runIndex = 0;
+
+	memcpy_s(runValuePointer, valueStride, inputBuffer->data, valueStride);
+	runLengths[0] = 1;
+
+	for (uint32 valueIndex = 1; valueIndex < valueCount; valueIndex++)
+	{
+		char *valuePointer = inputBuffer->data + (uint64) valueIndex * valueStride;
+		if (memcmp(valuePointer, valuePointer - valueStride, valueStride) != 0)
+		{
+			runIndex++;
+			runValuePointer += valueStride;
+			memcpy_s(runValuePointer, valueStride, valuePointer, valueStride);
+		}
+
+		runLengths[runIndex]++;
+	}
+
+	outputBuffer->len = encodedLength;
+
+	return true;
+}
+
+
+/*
+ * RunLengthDecodeDatumArray is the run length encoding counterpart of
+ * DeserializeDatumArray. All rows of a run get the same datum.
+ */
+void
+RunLengthDecodeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
+						  bool datumTypeByValue, int datumTypeLength,
+						  char datumTypeAlign, Datum *datumArray)
+{
+	const char *runValuePointer = NULL;
+	const uint32 *runLengths = NULL;
+	uint32 runCount = RunLengthRunArray(datumBuffer, datumTypeLength, datumTypeAlign,
+										&runValuePointer, &runLengths);
+	uint32 valueStride = att_align_nominal(datumTypeLength, datumTypeAlign);
+	uint32 runIndex = 0;
+	uint32 runRemaining = 0;
+	Datum runValue = 0;
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		while (runRemaining == 0)
+		{
+			if (runIndex >= runCount)
+			{
+				ereport(ERROR, (errmsg("insufficient runs in run length encoded "
+									   "chunk: %u", runCount)));
+			}
+
+			runValue = fetch_att(runValuePointer + (uint64) runIndex * valueStride,
+								 datumTypeByValue, datumTypeLength);
+			runRemaining = runLengths[runIndex];
+			runIndex++;
+		}
+
+		datumArray[datumIndex] = runValue;
+		runRemaining--;
+	}
+}
+
+
+/*
+ * RunLengthRunArray sets runValues to the serialized value of the first run
+ * of a run length encoded chunk, followed by the values of the other runs
+ * att_align_nominal(datumTypeLength, datumTypeAlign) bytes apart, and
+ * runLengthArray to the number of non-null rows of each run, and returns the
+ * number of runs. Predicates on the column can accept or reject whole runs.
+ */
+uint32
+RunLengthRunArray(StringInfo datumBuffer, int datumTypeLength, char datumTypeAlign,
+				  const char **runValues, const uint32 **runLengthArray)
+{
+	if (datumBuffer->len < RUN_LENGTH_VALUES_OFFSET)
+	{
+		ereport(ERROR, (errmsg("invalid run length encoded chunk: %d bytes",
+							   datumBuffer->len)));
+	}
+
+	RunLengthHeader *header = (RunLengthHeader *) datumBuffer->data;
+	uint32 valueStride = att_align_nominal(datumTypeLength, datumTypeAlign);
+	uint64 lengthsOffset = RUN_LENGTH_LENGTHS_OFFSET(header->runCount, valueStride);
+	if (lengthsOffset + header->runCount * sizeof(uint32) > datumBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in run length encoded chunk: "
+							   UINT64_FORMAT ", %d",
+							   lengthsOffset + header->runCount * sizeof(uint32),
+							   datumBuffer->len)));
+	}
+
+	*runValues = datumBuffer->data + RUN_LENGTH_VALUES_OFFSET;
+	*runLengthArray = (const uint32 *) (datumBuffer->data + lengthsOffset);
+
+	return header->runCount;
+}
+
+
+/*
+ * BitPackEncodeBuffer bit packs valueCount serialized values of a 2, 4 or 8
+ * byte integer like type in inputBuffer into outputBuffer. Delta packing is
+ * used if it needs fewer bits than the frame of reference. It returns false
+ * and leaves outputBuffer untouched if packing doesn't make the chunk smaller.
+ */
+bool
+BitPackEncodeBuffer(StringInfo inputBuffer, uint32 valueCount, int datumTypeLength,
+					StringInfo outputBuffer)
+{
+	Assert(datumTypeLength == 2 || datumTypeLength == 4 || datumTypeLength == 8);
+
+	if (valueCount == 0 || (uint64) valueCount * datumTypeLength > inputBuffer->len)
+	{
+		return false;
+	}
+
+	int64 *values = palloc(valueCount * sizeof(int64));
+	int64 minValue = PG_INT64_MAX;
+	int64 maxValue = PG_INT64_MIN;
+	int64 minDelta = PG_INT64_MAX;
+	int64 maxDelta = PG_INT64_MIN;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		int64 value = ReadSerializedInteger(inputBuffer->data +
+											(uint64) valueIndex * datumTypeLength,
+											datumTypeLength);
+		values[valueIndex] = value;
+		minValue = Min(minValue, value);
+		maxValue = Max(maxValue, value);
+
+		if (valueIndex > 0)
+		{
+			/* deltas wrap around the same way as when they are added back */
+			int64 delta = (int64) ((uint64) value - (uint64) values[valueIndex - 1]);
+			minDelta = Min(minDelta, delta);
+			maxDelta = Max(maxDelta, delta);
+		}
+	}
+
+	uint32 frameBitWidth = BitWidth((uint64) maxValue - (uint64) minValue);
+	uint32 deltaBitWidth = valueCount > 1 ?
+						   BitWidth((uint64) maxDelta - (uint64) minDelta) : 0;
+	bool useDelta = valueCount > 1 && deltaBitWidth < frameBitWidth;
+	uint32 bitWidth = useDelta ? deltaBitWidth : frameBitWidth;
+	uint32 offsetCount = useDelta ? valueCount - 1 : valueCount;
+
+	uint64 wordCount = BIT_PACK_WORD_COUNT(offsetCount, bitWidth);
+	uint64 encodedLength = BIT_PACK_WORDS_OFFSET + wordCount * sizeof(uint64);
+	if (encodedLength >= inputBuffer->len)
+	{
+		pfree(values);
+		return false;
+	}
+
+	uint64 *offsets = palloc(Max(offsetCount, 1) * sizeof(uint64));
+	for (uint32 offsetIndex = 0; offsetIndex < offsetCount; offsetIndex++)
+	{
+		if (useDelta)
+		{
+			uint64 delta = (uint64) values[offsetIndex + 1] - (uint64) values[offsetIndex];
+			offsets[offsetIndex] = delta - (uint64) minDelta;
+		}
+		else
+		{
+			offsets[offsetIndex] = (uint64) values[offsetIndex] - (uint64) minValue;
+		}
+	}
+
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, encodedLength);
+	memset(outputBuffer->data, 0, encodedLength);
+
+	BitPackHeader *header = (BitPackHeader *) outputBuffer->data;
+	header->valueCount = valueCount;
+	header->bitWidth = bitWidth;
+	header->flags = useDelta ? BIT_PACK_DELTA : 0;
+	header->reference = useDelta ? values[0] : minValue;
+	header->deltaBase = useDelta ? minDelta : 0;
+
+	BitPack(offsets, offsetCount, bitWidth,
+			(uint64 *) (outputBuffer->data + BIT_PACK_WORDS_OFFSET));
+	outputBuffer->len = encodedLength;
+
+	pfree(values);
+	pfree(offsets);
+
+	return true;
+}
+
+
+/*
+ * BitPackDecodeDatumArray is the bit packing counterpart of
+ * DeserializeDatumArray.
+ */
+void
+BitPackDecodeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
+						int datumTypeLength, Datum *datumArray)
+{
+	if (datumBuffer->len < BIT_PACK_WORDS_OFFSET)
+	{
+		ereport(ERROR, (errmsg("invalid bit packed chunk: %d bytes",
+							   datumBuffer->len)));
+	}
+
+	BitPackHeader *header = (BitPackHeader *) datumBuffer->data;
+	bool useDelta = (header->flags & BIT_PACK_DELTA) != 0;
+	uint32 valueCount = header->valueCount;
+	uint32 offsetCount = (useDelta && valueCount > 0) ? valueCount - 1 : valueCount;
+
+	uint64 wordCount = BIT_PACK_WORD_COUNT(offsetCount, header->bitWidth);
+	if (header->bitWidth > 64 || valueCount > datumCount ||
+		BIT_PACK_WORDS_OFFSET + wordCount * sizeof(uint64) > datumBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in bit packed chunk: "
+							   "%u values of %u bits, %d bytes", valueCount,
+							   header->bitWidth, datumBuffer->len)));
+	}
+
+	uint64 *values = palloc(Max(valueCount, 1) * sizeof(uint64));
+	BitUnpack((const uint64 *) (datumBuffer->data + BIT_PACK_WORDS_OFFSET),
+			  offsetCount, header->bitWidth, useDelta ? values + 1 : values);
+
+	if (useDelta)
+	{
+		uint64 previousValue = (uint64) header->reference;
+		values[0] = previousValue;
+
+		for (uint32 valueIndex = 1; valueIndex < valueCount; valueIndex++)
+		{
+			previousValue += values[valueIndex] + (uint64) header->deltaBase;
+			values[valueIndex] = previousValue;
+		}
+	}
+	else
+	{
+		for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+		{
+			values[valueIndex] += (uint64) header->reference;
+		}
+	}
+
+	/*
+	 * Values come out sign extended, which is also how fetch_att returns
+	 * integers of all supported lengths.
+	 */
+	uint32 valueIndex = 0;
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		if (valueIndex >= valueCount)
+		{
+			ereport(ERROR, (errmsg("insufficient values in bit packed chunk: %u",
+								   valueCount)));
+		}
+
+		datumArray[datumIndex] = (Datum) (int64) values[valueIndex];
+		valueIndex++;
+	}
+
+	pfree(values);
+}
+
+
+/*
+ * OffsetsEncodeBuffer lays out valueCount serialized values of a variable
+ * length type in inputBuffer with their offsets in outputBuffer. Unlike the
+ * other encodings it always applies, since it is asked for to make the
+ * values addressable rather than to make the chunk smaller.
+ */
+void
+OffsetsEncodeBuffer(StringInfo inputBuffer, uint32 valueCount, int datumTypeLength,
+					char datumTypeAlign, StringInfo outputBuffer)
+{
+	Assert(datumTypeLength < 0);
+
+	uint64 valuesOffset = OFFSETS_VALUES_OFFSET(valueCount);
+	uint64 encodedLength = valuesOffset + inputBuffer->len;
+
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, encodedLength);
+	memset(outputBuffer->data, 0, valuesOffset);
+
+	OffsetsHeader *header = (OffsetsHeader *) outputBuffer->data;
+	header->valueCount = valueCount;
+	header->valuesLength = inputBuffer->len;
+
+	uint32 *offsets = (uint32 *) (outputBuffer->data + OFFSETS_OFFSETS_OFFSET);
+	uint32 currentOffset = 0;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		offsets[valueIndex] = currentOffset;
+
+		currentOffset = att_addlength_pointer(currentOffset, datumTypeLength,
+											  inputBuffer->data + currentOffset);
+		currentOffset = att_align_nominal(currentOffset, datumTypeAlign);
+	}
+
+	Assert(currentOffset == inputBuffer->len);
+	offsets[valueCount] = inputBuffer->len;
+
+	/* values keep the alignment they had, as both buffers are maxaligned */
+	if (inputBuffer->len > 0)
+	{
+		memcpy_s(outputBuffer->data + valuesOffset, outputBuffer->maxlen - valuesOffset,
+				 inputBuffer->data, inputBuffer->len);
+	}
+
+	outputBuffer->len = encodedLength;
+}
+
+
+/*
+ * OffsetsValueAt returns the datum of the valueIndex-th non-null value of a
+ * chunk in the offsets layout, which points into datumBuffer. It doesn't
+ * look at any other value, so callers can read single rows of a chunk.
+ */
+Datum
+OffsetsValueAt(StringInfo datumBuffer, uint32 valueIndex, int datumTypeLength)
+{
+	if (datumBuffer->len < OFFSETS_OFFSETS_OFFSET)
+	{
+		ereport(ERROR, (errmsg("invalid offsets encoded chunk: %d bytes",
+							   datumBuffer->len)));
+	}
+
+	OffsetsHeader *header = (OffsetsHeader *) datumBuffer->data;
+	uint64 valuesOffset = OFFSETS_VALUES_OFFSET(header->valueCount);
+	if (valueIndex >= header->valueCount ||
+		valuesOffset + header->valuesLength > datumBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient values in offsets encoded chunk: %u, %u",
+							   valueIndex, header->valueCount)));
+	}
+
+	const uint32 *offsets = (const uint32 *) (datumBuffer->data + OFFSETS_OFFSETS_OFFSET);
+	uint32 valueStart = offsets[valueIndex];
+	uint32 valueEnd = offsets[valueIndex + 1];
+	if (valueStart > valueEnd || valueEnd > header->valuesLength)
+	{
+		ereport(ERROR, (errmsg("invalid value offsets in chunk: %u, %u, %u",
+							   valueStart, valueEnd, header->valuesLength)));
+	}
+
+	char *valuePointer = datumBuffer->data + valuesOffset + valueStart;
+	if (valueStart == valueEnd ||
+		att_addlength_pointer(valueStart, datumTypeLength, valuePointer) > valueEnd)
+	{
+		ereport(ERROR, (errmsg("invalid value length in offsets encoded chunk")));
+	}
+
+	return PointerGetDatum(valuePointer);
+}
+
+
+/*
+ * OffsetsDecodeDatumArray is the offsets layout counterpart of
+ * DeserializeDatumArray. Datums point to the values in datumBuffer, and are
+ * found through their offsets instead of the lengths of the values before.
+ */
+void
+OffsetsDecodeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
+						int datumTypeLength, Datum *datumArray)
+{
+	uint32 valueIndex = 0;
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		datumArray[datumIndex] = OffsetsValueAt(datumBuffer, valueIndex, datumTypeLength);
+		valueIndex++;
+	}
+}
+
+
+/*
+ * ReadSerializedInteger returns the signed integer of given length at
+ * valuePointer.
+ */
+static int64
+ReadSerializedInteger(const char *valuePointer, int datumTypeLength)
+{
+	if (datumTypeLength == 2)
+	{
+		int16 value = 0;
+		memcpy(&value, valuePointer, sizeof(int16));
+		return value;
+	}
+	else if (datumTypeLength == 4)
+	{
+		int32 value = 0;
+		memcpy(&value, valuePointer, sizeof(int32));
+		return value;
+	}
+	else
+	{
+		int64 value = 0;
+		memcpy(&value, valuePointer, sizeof(int64));
+		return value;
+	}
+}
+
+
+/*
+ * BitWidth returns the number of bits needed to store offsets up to
+ * maxOffset.
+ */
+static uint32
+BitWidth(uint64 maxOffset)
+{
+	return maxOffset == 0 ? 0 : pg_leftmost_one_pos64(maxOffset) + 1;
+}
+
+
+/*
+ * BitPack packs offsetCount offsets of bitWidth bits each into words, which
+ * must be zeroed.
+ */
+static void
+BitPack(const uint64 *offsets, uint32 offsetCount, uint32 bitWidth, uint64 *words)
+{
+	if (bitWidth == 0)
+	{
+		return;
+	}
+
+	for (uint32 offsetIndex = 0; offsetIndex < offsetCount; offsetIndex++)
+	{
+		uint64 bitPosition = (uint64) offsetIndex * bitWidth;
+		uint64 wordIndex = bitPosition / 64;
+		uint32 shift = bitPosition % 64;
+
+		words[wordIndex] |= offsets[offsetIndex] << shift;
+
+		/* shifting twice avoids an undefined shift by 64 when shift is 0 */
+		words[wordIndex + 1] |= (offsets[offsetIndex] >> 1) >> (63 - shift);
+	}
+}
+
+
+/*
+ * BitUnpack is the counterpart of BitPack. Iterations of the loop have no
+ * branches and don't depend on each other, so the compiler can vectorize it.
+ */
+static void
+BitUnpack(const uint64 *words, uint32 offsetCount, uint32 bitWidth, uint64 *offsets)
+{
+	if (bitWidth == 0)
+	{
+		memset(offsets, 0, offsetCount * sizeof(uint64));
+		return;
+	}
+
+	uint64 mask = bitWidth == 64 ? PG_UINT64_MAX : (UINT64CONST(1) << bitWidth) - 1;
+
+	for (uint32 offsetIndex = 0; offsetIndex < offsetCount; offsetIndex++)
+	{
+		uint64 bitPosition = (uint64) offsetIndex * bitWidth;
+		uint64 wordIndex = bitPosition / 64;
+		uint32 shift = bitPosition % 64;
+
+		uint64 offset = (words[wordIndex] >> shift) |
+						((words[wordIndex + 1] << 1) << (63 - shift));
+		offsets[offsetIndex] = offset & mask;
+	}
+}
+
+/*
+ * DictionaryKeyHash hashes the bytes of a serialized value.
+ */
+static uint32
+DictionaryKeyHash(const void *key, Size keysize)
+{
+	const DictionaryKey *dictionaryKey = key;
+
+	return DatumGetUInt32(hash_any((const unsigned char *) dictionaryKey->data,
+								   dictionaryKey->length));
+}
+
+
+/*
+ * DictionaryKeyMatch compares the bytes of two serialized values, returning
+ * 0 if they are equal.
+ */
+static int
+DictionaryKeyMatch(const void *key1, const void *key2, Size keysize)
+{
+	const DictionaryKey *left = key1;
+	const DictionaryKey *right = key2;
+
+	if (left->length != right->length)
+	{
+		return 1;
+	}
+
+	return memcmp(left->data, right->data, left->length);
+}
@@ -0,0 +1,324 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_hll.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * HyperLogLog sketches of column values, shared by the per chunk sketches
+ * of the columns in hll_columns, the approx_count_distinct aggregate and
+ * vapprox_count_distinct, so that the sketches of chunk groups can be merged
+ * into the state of the aggregate instead of reading their rows.
+ *
+ * A sketch has 2 ^ COLUMNAR_HLL_PRECISION one byte registers. Values are
+ * hashed by their binary value, so only types whose equality is binary
+ * equality, and text under deterministic collations, are supported. The
+ * sketch of a chunk is a bytea holding the precision and a format byte,
+ * followed by either all registers, or the index and value of the registers
+ * that aren't 0 when that is shorter.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "catalog/pg_type.h"
+#include "common/hashfn.h"
+#include "fmgr.h"
+#include "port/pg_bitutils.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+#include "columnar/columnar.h"
+
+#define HLL_SKETCH_FORMAT_DENSE 0
+#define HLL_SKETCH_FORMAT_SPARSE 1
+
+/* a sparse entry is the register index as 2 bytes and the register value */
+#define HLL_SPARSE_ENTRY_SIZE 3
+
+typedef struct ColumnarHllSketchData
+{
+	int32 vl_len_;                  /* varlena header (do not touch directly!) */
+	uint8 precision;
+	uint8 format;
+	uint8 data[FLEXIBLE_ARRAY_MEMBER];
+} ColumnarHllSketchData;
+
+#define HLL_SKETCH_DATA_SIZE(sketch) \
+	(VARSIZE(sketch) - offsetof(ColumnarHllSketchData, data))
+
+/*
+ * ApproxCountDistinctState is the transition state of approx_count_distinct,
+ * which gets one value at a time.
+ */
+typedef struct ApproxCountDistinctState
+{
+	bool isVarlena;
+	uint8 registers[COLUMNAR_HLL_REGISTERS];
+} ApproxCountDistinctState;
+
+
+/*
+ * ColumnarHllTypeSupported returns whether values of the given type can be
+ * added to sketches, because equal values have equal bytes. Text has to be
+ * compared under a deterministic collation too, which the callers check.
+ */
+bool
+ColumnarHllTypeSupported(Oid typeId)
+{
+	switch (typeId)
+	{
+		case BOOLOID:
+		case CHAROID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		case TEXTOID:
+		case VARCHAROID:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+
+/*
+ * ColumnarHllHash hashes a value for a sketch. By-value types hash their
+ * datum widened to 64 bits with the finalizer of splitmix64, which spreads
+ * the bits of close values over the whole hash, and text hashes its bytes.
+ */
+uint64
+ColumnarHllHash(Datum value, bool isVarlena)
+{
+	if (isVarlena)
+	{
+		text *valueText = DatumGetTextPP(value);
+		return DatumGetUInt64(hash_any_extended((unsigned char *) VARDATA_ANY(valueText),
+												VARSIZE_ANY_EXHDR(valueText), 0));
+	}
+
+	uint64 hash = DatumGetInt64(value);
+
+	hash ^= hash >> 30;
+	hash *= UINT64CONST(0xbf58476d1ce4e5b9);
+	hash ^= hash >> 27;
+	hash *= UINT64CONST(0x94d049bb133111eb);
+	hash ^= hash >> 31;
+
+	return hash;
+}
+
+
+/*
+ * ColumnarHllAddHash adds a hash to the registers of a sketch. The first
+ * bits of the hash pick the register, which keeps the highest rank of the
+ * remaining bits it has seen.
+ */
+void
+ColumnarHllAddHash(uint8 *registers, uint64 hash)
+{
+	uint32 index = hash >> (64 - COLUMNAR_HLL_PRECISION);
+
+	/* the guard bit bounds the rank for hashes whose remaining bits are 0 */
+	uint64 remaining = (hash << COLUMNAR_HLL_PRECISION) |
+					   (UINT64CONST(1) << (COLUMNAR_HLL_PRECISION - 1));
+	uint8 rank = 64 - pg_leftmost_one_pos64(remaining);
+
+	registers[index] = Max(registers[index], rank);
+}
+
+
+/*
+ * ColumnarHllEstimate returns the HyperLogLog estimate of the number of
+ * distinct values added to the registers, or the linear counting estimate
+ * from the empty registers while many are empty, which is the better one
+ * for few distinct values.
+ */
+int64
+ColumnarHllEstimate(const uint8 *registers)
+{
+	double registerCount = COLUMNAR_HLL_REGISTERS;
+	double inverseSum = 0;
+	int emptyRegisters = 0;
+
+	for (int i = 0; i < COLUMNAR_HLL_REGISTERS; i++)
+	{
+		inverseSum += ldexp(1.0, -registers[i]);
+		emptyRegisters += registers[i] == 0;
+	}
+
+	double alpha = 0.7213 / (1.0 + 1.079 / registerCount);
+	double estimate = alpha * registerCount * registerCount / inverseSum;
+
+	if (estimate <= 2.5 * registerCount && emptyRegisters > 0)
+	{
+		estimate = registerCount * log(registerCount / emptyRegisters);
+	}
+
+	return (int64) rint(estimate);
+}
+
+
+/*
+ * ColumnarHllSketchBuild returns the sketch of the given registers, in the
+ * shorter of the dense and sparse formats.
+ */
+bytea *
+ColumnarHllSketchBuild(const uint8 *registers)
+{
+	uint32 usedRegisters = 0;
+	for (int i = 0; i < COLUMNAR_HLL_REGISTERS; i++)
+	{
+		usedRegisters += registers[i] != 0;
+	}
+
+	bool sparse = usedRegisters * HLL_SPARSE_ENTRY_SIZE < COLUMNAR_HLL_REGISTERS;
+	Size dataSize = sparse ? usedRegisters * HLL_SPARSE_ENTRY_SIZE :
+					COLUMNAR_HLL_REGISTERS;
+	Size sketchSize = offsetof(ColumnarHllSketchData, data) + dataSize;
+
+	ColumnarHllSketchData *sketch = palloc(sketchSize);
+	SET_VARSIZE(sketch, sketchSize);
+	sketch->precision = COLUMNAR_HLL_PRECISION;
+
+	if (!sparse)
+	{
+		sketch->format = HLL_SKETCH_FORMAT_DENSE;
+		memcpy(sketch->data, registers, COLUMNAR_HLL_REGISTERS);
+		return (bytea *) sketch;
+	}
+
+	sketch->format = HLL_SKETCH_FORMAT_SPARSE;
+
+	uint8 *entry = sketch->data;
+	for (int i = 0; i < COLUMNAR_HLL_REGISTERS; i++)
+	{
+		if (registers[i] == 0)
+		{
+			continue;
+		}
+
+		entry[0] = (uint8) (i >> 8);
+		entry[1] = (uint8) (i & 0xFF);
+		entry[2] = registers[i];
+		entry += HLL_SPARSE_ENTRY_SIZE;
+	}
+
+	return (bytea *) sketch;
+}
+
+
+/*
+ * ColumnarHllSketchMerge merges a sketch built by ColumnarHllSketchBuild
+ * into the given registers.
+ */
+void
+ColumnarHllSketchMerge(uint8 *registers, bytea *serializedSketch)
+{
+	ColumnarHllSketchData *sketch = (ColumnarHllSketchData *) serializedSketch;
+	Size dataSize = HLL_SKETCH_DATA_SIZE(sketch);
+
+	if (sketch->precision != COLUMNAR_HLL_PRECISION)
+	{
+		elog(ERROR, "unexpected precision %d of columnar distinct value sketch",
+			 sketch->precision);
+	}
+
+	if (sketch->format == HLL_SKETCH_FORMAT_DENSE)
+	{
+		Assert(dataSize == COLUMNAR_HLL_REGISTERS);
+
+		for (int i = 0; i < COLUMNAR_HLL_REGISTERS; i++)
+		{
+			registers[i] = Max(registers[i], sketch->data[i]);
+		}
+
+		return;
+	}
+
+	for (Size offset = 0; offset + HLL_SPARSE_ENTRY_SIZE <= dataSize;
+		 offset += HLL_SPARSE_ENTRY_SIZE)
+	{
+		uint8 *entry = sketch->data + offset;
+		uint32 index = ((uint32) entry[0] << 8) | entry[1];
+
+		registers[index] = Max(registers[index], entry[2]);
+	}
+}
+
+
+/*
+ * approxcountdistinctacc is the transition function of approx_count_distinct,
+ * which adds the hash of a value to a sketch. Vectorized aggregates use
+ * vapprox_count_distinct instead, whose estimates are the same.
+ */
+PG_FUNCTION_INFO_V1(approxcountdistinctacc);
+Datum
+approxcountdistinctacc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggContext;
+	ApproxCountDistinctState *state = NULL;
+
+	if (!AggCheckCallContext(fcinfo, &aggContext))
+	{
+		elog(ERROR, "aggregate function called in non-aggregate context");
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		Oid typeId = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+		if (!ColumnarHllTypeSupported(typeId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("approx_count_distinct does not support type %s",
+								   format_type_be(typeId))));
+		}
+
+		if (get_typlen(typeId) == -1 && OidIsValid(PG_GET_COLLATION()) &&
+			!get_collation_isdeterministic(PG_GET_COLLATION()))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("approx_count_distinct does not support "
+								   "nondeterministic collations")));
+		}
+
+		state = MemoryContextAllocZero(aggContext, sizeof(ApproxCountDistinctState));
+		state->isVarlena = get_typlen(typeId) == -1;
+	}
+	else
+	{
+		state = (ApproxCountDistinctState *) PG_GETARG_POINTER(0);
+	}
+
+	if (!PG_ARGISNULL(1))
+	{
+		ColumnarHllAddHash(state->registers,
+						   ColumnarHllHash(PG_GETARG_DATUM(1), state->isVarlena));
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+
+PG_FUNCTION_INFO_V1(approxcountdistinctfinal);
+Datum
+approxcountdistinctfinal(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	ApproxCountDistinctState *state = (ApproxCountDistinctState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_INT64(ColumnarHllEstimate(state->registers));
+}
@@ -0,0 +1,317 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_large_value.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Out of line storage of large variable length values. Values of at least
+ * columnar.large_value_threshold bytes are compressed one by one into the
+ * large value area at the start of their stripe, and the value stream of
+ * their chunk holds a reference to them instead. Scans that project such a
+ * column then decompress only the references, and a value is only read
+ * from the large value area when it is used.
+ *
+ * A reference is a varlena with the header of an external on disk toast
+ * pointer, so that it has the same size, followed by the raw size of the
+ * value, its stored size and compression, and its offset from the start of
+ * the stripe. Values in value streams are never external otherwise, since
+ * writes detoast them.
+ *
+ * Row reads return references as read only expanded objects, which read
+ * the value when they are flattened, and report its raw size without
+ * reading it, so that functions like octet_length() don't read it either.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/relation.h"
+#include "utils/expandeddatum.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+
+/* the compression type is kept in the top bits of the stored size */
+#define LARGE_VALUE_COMPRESSION_SHIFT 30
+#define LARGE_VALUE_STORED_SIZE_MASK ((1U << LARGE_VALUE_COMPRESSION_SHIFT) - 1)
+
+/* the payload of a reference, it has the size of varatt_external */
+typedef struct ColumnarLargeValuePointer
+{
+	uint32 rawSize;
+	uint32 storedInfo;
+	uint64 offset;
+} ColumnarLargeValuePointer;
+
+StaticAssertDecl(sizeof(ColumnarLargeValuePointer) == sizeof(varatt_external),
+				 "large value references must have the size of toast pointers");
+
+/* a reference returned as an expanded object, which reads the value lazily */
+typedef struct LargeValueExpandedObject
+{
+	ExpandedObjectHeader header;
+	Oid relationId;
+	uint64 stripeFileOffset;
+	ColumnarLargeValuePointer pointer;
+
+	/* the value, once it was read */
+	struct varlena *flatValue;
+} LargeValueExpandedObject;
+
+static Size LargeValueGetFlatSize(ExpandedObjectHeader *eohptr);
+static void LargeValueFlattenInto(ExpandedObjectHeader *eohptr, void *result,
+								  Size allocatedSize);
+static Datum FetchLargeValue(Relation relation, uint64 stripeFileOffset,
+							 ColumnarLargeValuePointer *pointer);
+static ColumnarLargeValuePointer ReadLargeValuePointer(Datum reference);
+static Datum DecompressLargeValue(StringInfo storedValue,
+								  ColumnarLargeValuePointer *pointer);
+
+static const ExpandedObjectMethods LargeValueMethods =
+{
+	LargeValueGetFlatSize,
+	LargeValueFlattenInto
+};
+
+
+/*
+ * ColumnarIsLargeValueReference returns true if the given value of a
+ * variable length column read from a value stream is a reference to the
+ * large value area.
+ */
+bool
+ColumnarIsLargeValueReference(Datum value)
+{
+	return VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(value));
+}
+
+
+/*
+ * ColumnarStoreLargeValue compresses the given value with the given
+ * compression and appends it to largeValueBuffer, which holds the large
+ * value area of the stripe being written. Returns the reference to store in
+ * the value stream instead, allocated in the current memory context.
+ */
+Datum
+ColumnarStoreLargeValue(StringInfo largeValueBuffer, Datum value,
+						CompressionType compressionType, int compressionLevel,
+						StringInfo compressionBuffer)
+{
+	struct varlena *rawValue = (struct varlena *) DatumGetPointer(value);
+	StringInfoData rawValueBuffer = {
+		.data = (char *) rawValue,
+		.len = VARSIZE(rawValue),
+		.maxlen = VARSIZE(rawValue),
+		.cursor = 0
+	};
+	StringInfo storedValue = &rawValueBuffer;
+	CompressionType storedCompressionType = COMPRESSION_NONE;
+
+	Assert(!VARATT_IS_EXTENDED(rawValue));
+
+	if (compressionType == COMPRESSION_AUTO)
+	{
+		storedCompressionType =
+			CompressBufferAuto(&rawValueBuffer, compressionBuffer, compressionLevel,
+							   columnar_auto_compression_min_gain);
+	}
+	else if (CompressBuffer(&rawValueBuffer, compressionBuffer, compressionType,
+							compressionLevel))
+	{
+		/* lz4hc output is decompressed like any other lz4 output */
+		storedCompressionType = compressionType == COMPRESSION_LZ4HC ?
+								COMPRESSION_LZ4 : compressionType;
+	}
+
+	if (storedCompressionType != COMPRESSION_NONE)
+	{
+		storedValue = compressionBuffer;
+	}
+
+	ColumnarLargeValuePointer pointer = {
+		.rawSize = VARSIZE(rawValue),
+		.storedInfo = ((uint32) storedCompressionType << LARGE_VALUE_COMPRESSION_SHIFT) |
+					  (uint32) storedValue->len,
+		.offset = largeValueBuffer->len
+	};
+
+	appendBinaryStringInfo(largeValueBuffer, storedValue->data, storedValue->len);
+
+	struct varlena *reference = palloc(VARHDRSZ_EXTERNAL + sizeof(pointer));
+	SET_VARTAG_EXTERNAL(reference, VARTAG_ONDISK);
+	memcpy(VARDATA_EXTERNAL(reference), &pointer, sizeof(pointer));
+
+	return PointerGetDatum(reference);
+}
+
+
+/*
+ * ColumnarLargeValueFromBuffer returns the value the given reference points
+ * to in the large value area of a stripe that is still being written.
+ */
+Datum
+ColumnarLargeValueFromBuffer(StringInfo largeValueBuffer, Datum reference)
+{
+	ColumnarLargeValuePointer pointer = ReadLargeValuePointer(reference);
+	StringInfoData storedValue = {
+		.data = largeValueBuffer->data + pointer.offset,
+		.len = pointer.storedInfo & LARGE_VALUE_STORED_SIZE_MASK,
+		.maxlen = pointer.storedInfo & LARGE_VALUE_STORED_SIZE_MASK,
+		.cursor = 0
+	};
+
+	return DecompressLargeValue(&storedValue, &pointer);
+}
+
+
+/*
+ * ColumnarFetchLargeValue reads the value the given reference points to from
+ * the large value area of the stripe at stripeFileOffset.
+ */
+Datum
+ColumnarFetchLargeValue(Relation relation, uint64 stripeFileOffset, Datum reference)
+{
+	ColumnarLargeValuePointer pointer = ReadLargeValuePointer(reference);
+
+	return FetchLargeValue(relation, stripeFileOffset, &pointer);
+}
+
+
+/*
+ * ColumnarLazyLargeValue returns a read only expanded object for the given
+ * reference, which reads the value from the stripe at stripeFileOffset only
+ * when it's flattened. The object lives in a context of its own under
+ * parentContext, so it goes away when parentContext is reset.
+ */
+Datum
+ColumnarLazyLargeValue(Relation relation, uint64 stripeFileOffset, Datum reference,
+					   MemoryContext parentContext)
+{
+	MemoryContext objectContext = AllocSetContextCreate(parentContext,
+														"Columnar Large Value",
+														ALLOCSET_SMALL_SIZES);
+	LargeValueExpandedObject *object =
+		MemoryContextAllocZero(objectContext, sizeof(LargeValueExpandedObject));
+
+	EOH_init_header(&object->header, &LargeValueMethods, objectContext);
+	object->relationId = RelationGetRelid(relation);
+	object->stripeFileOffset = stripeFileOffset;
+	object->pointer = ReadLargeValuePointer(reference);
+	object->flatValue = NULL;
+
+	return EOHPGetRODatum(&object->header);
+}
+
+
+/*
+ * LargeValueGetFlatSize returns the size of the value of a lazily read large
+ * value, which is known without reading it.
+ */
+static Size
+LargeValueGetFlatSize(ExpandedObjectHeader *eohptr)
+{
+	LargeValueExpandedObject *object = (LargeValueExpandedObject *) eohptr;
+
+	return object->pointer.rawSize;
+}
+
+
+/*
+ * LargeValueFlattenInto copies the value of a lazily read large value into
+ * result, reading it from the stripe the first time it's needed.
+ */
+static void
+LargeValueFlattenInto(ExpandedObjectHeader *eohptr, void *result, Size allocatedSize)
+{
+	LargeValueExpandedObject *object = (LargeValueExpandedObject *) eohptr;
+
+	Assert(allocatedSize == object->pointer.rawSize);
+
+	if (object->flatValue == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(object->header.eoh_context);
+		Relation relation = relation_open(object->relationId, AccessShareLock);
+
+		Datum value = FetchLargeValue(relation, object->stripeFileOffset,
+									  &object->pointer);
+		object->flatValue = (struct varlena *) DatumGetPointer(value);
+
+		relation_close(relation, AccessShareLock);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	memcpy(result, object->flatValue, allocatedSize);
+}
+
+
+/*
+ * FetchLargeValue reads the value the given pointer points to from the large
+ * value area of the stripe at stripeFileOffset.
+ */
+static Datum
+FetchLargeValue(Relation relation, uint64 stripeFileOffset,
+				ColumnarLargeValuePointer *pointer)
+{
+	uint32 storedSize = pointer->storedInfo & LARGE_VALUE_STORED_SIZE_MASK;
+	StringInfo storedValue = makeStringInfo();
+
+	enlargeStringInfo(storedValue, storedSize);
+	ColumnarStorageRead(relation, stripeFileOffset + pointer->offset,
+						storedValue->data, storedSize);
+	storedValue->len = storedSize;
+
+	return DecompressLargeValue(storedValue, pointer);
+}
+
+
+/*
+ * ReadLargeValuePointer returns the payload of the given reference, which
+ * may not be aligned.
+ */
+static ColumnarLargeValuePointer
+ReadLargeValuePointer(Datum reference)
+{
+	ColumnarLargeValuePointer pointer;
+
+	Assert(ColumnarIsLargeValueReference(reference));
+	memcpy(&pointer, VARDATA_EXTERNAL(DatumGetPointer(reference)), sizeof(pointer));
+
+	return pointer;
+}
+
+
+/*
+ * DecompressLargeValue returns a copy of the value stored in storedValue,
+ * decompressing it if needed, allocated in the current memory context.
+ */
+static Datum
+DecompressLargeValue(StringInfo storedValue, ColumnarLargeValuePointer *pointer)
+{
+	CompressionType compressionType =
+		(CompressionType) (pointer->storedInfo >> LARGE_VALUE_COMPRESSION_SHIFT);
+	struct varlena *value = NULL;
+
+	if (compressionType == COMPRESSION_NONE)
+	{
+		value = palloc(pointer->rawSize);
+		memcpy(value, storedValue->data, pointer->rawSize);
+	}
+	else
+	{
+		StringInfo rawValue = makeStringInfo();
+		DecompressBufferInto(storedValue, compressionType, pointer->rawSize, 0,
+							 rawValue);
+		value = (struct varlena *) rawValue->data;
+	}
+
+	if (VARSIZE(value) != pointer->rawSize)
+	{
+		ereport(ERROR, (errmsg("large value of columnar stripe is corrupted"),
+						errdetail("Expected %u bytes, found %u.",
+								  pointer->rawSize, VARSIZE(value))));
+	}
+
+	return PointerGetDatum(value);
+}
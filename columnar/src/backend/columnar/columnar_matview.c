@@ -0,0 +1,761 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_matview.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Incremental refresh of columnar materialized views that aggregate a
+ * columnar table.
+ *
+ * Rows are appended to columnar tables in stripes with increasing ids. Once
+ * a materialized view is refreshed by columnar.refresh_materialized_view,
+ * columnar.matview_refresh keeps the first stripe id its source table had
+ * not used yet, and the number of live rows of the stripes before it. The
+ * next refresh only aggregates the stripes written since, by running the
+ * query of the view with ColumnarSetStripeFloor, and merges those groups
+ * into the rows the view has: counts and sums are added up, and minimums
+ * and maximums are combined.
+ *
+ * If the stripes before the floor have changed since, because rows were
+ * deleted or updated, stripes were combined by vacuum, or rows were in the
+ * delta store, the view is refreshed in full with REFRESH MATERIALIZED VIEW
+ * instead. The source table is locked against writes while the view is
+ * refreshed, so the stripes and the rows that are counted are those the
+ * view was computed from.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <ctype.h>
+
+#include "access/genam.h"
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "access/xact.h"
+#include "catalog/index.h"
+#include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_inherits.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_rewrite.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/tlist.h"
+#include "parser/parsetree.h"
+#include "rewrite/prs2lock.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/guc.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/snapmgr.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+/* constants for columnar.matview_refresh */
+#define Natts_columnar_matview_refresh 5
+#define Anum_columnar_matview_refresh_matview 1
+#define Anum_columnar_matview_refresh_source 2
+#define Anum_columnar_matview_refresh_next_stripe_id 3
+#define Anum_columnar_matview_refresh_live_rows 4
+#define Anum_columnar_matview_refresh_delta_rows 5
+
+/*
+ * MatviewRefreshState is what a refresh of a materialized view saw of its
+ * source table: the first stripe id it had not used, the live rows of the
+ * stripes before it and the rows in its delta store.
+ */
+typedef struct MatviewRefreshState
+{
+	Oid sourceId;
+	uint64 nextStripeId;
+	uint64 liveRows;
+	uint64 deltaRows;
+} MatviewRefreshState;
+
+/* how an output column of a materialized view is merged */
+typedef enum MatviewColumnMerge
+{
+	MATVIEW_MERGE_GROUP_KEY,
+	MATVIEW_MERGE_SUM,
+	MATVIEW_MERGE_MIN,
+	MATVIEW_MERGE_MAX
+} MatviewColumnMerge;
+
+static Query * MatviewQuery(Relation matview);
+static Oid IncrementalRefreshSource(Query *query, MatviewColumnMerge *columnMerges,
+									int columnCount);
+static bool AggregateMerge(Aggref *aggref, MatviewColumnMerge *columnMerge);
+static MatviewRefreshState SourceRefreshState(Relation source, uint64 nextStripeId);
+static bool ReadMatviewRefreshState(Oid matviewId, MatviewRefreshState *state);
+static void WriteMatviewRefreshState(Oid matviewId, MatviewRefreshState *state);
+static char * MergeQuery(Relation matview, MatviewColumnMerge *columnMerges);
+static void RefreshMatviewIncrementally(Relation matview, Relation source,
+										MatviewColumnMerge *columnMerges,
+										uint64 stripeFloor);
+static void RefreshMatviewFully(Relation matview);
+static Oid ColumnarMatviewRefreshRelationId(void);
+static Oid ColumnarMatviewRefreshIndexRelationId(void);
+
+PG_FUNCTION_INFO_V1(columnar_refresh_materialized_view);
+
+
+/*
+ * columnar_refresh_materialized_view refreshes a columnar materialized view,
+ * only aggregating the rows added to its source table since the last refresh
+ * when it can, and returns whether it did so ("incremental") or refreshed
+ * the view in full ("full").
+ */
+Datum
+columnar_refresh_materialized_view(PG_FUNCTION_ARGS)
+{
+	Oid matviewId = PG_GETARG_OID(0);
+
+	/* like REFRESH MATERIALIZED VIEW without CONCURRENTLY */
+	Relation matview = table_open(matviewId, AccessExclusiveLock);
+
+	if (matview->rd_rel->relkind != RELKIND_MATVIEW)
+	{
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("\"%s\" is not a materialized view",
+							   RelationGetRelationName(matview))));
+	}
+
+	if (!pg_class_ownercheck(matviewId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_MATVIEW,
+					   RelationGetRelationName(matview));
+	}
+
+	if (!IsColumnarTableAmTable(matviewId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("materialized view %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(matview)))));
+	}
+
+	int columnCount = RelationGetDescr(matview)->natts;
+	MatviewColumnMerge *columnMerges = palloc0(columnCount * sizeof(MatviewColumnMerge));
+
+	Query *query = MatviewQuery(matview);
+	Oid sourceId = IncrementalRefreshSource(query, columnMerges, columnCount);
+
+	bool incremental = false;
+	Relation source = NULL;
+
+	if (OidIsValid(sourceId))
+	{
+		/* keep the stripes and rows of the source the way the refresh sees them */
+		source = table_open(sourceId, ShareLock);
+
+		FlushWriteStateForRelfilenode(source->rd_node.relNode,
+									  GetCurrentSubTransactionId());
+		RowMaskFlushWriteStateForRelfilenode(source->rd_node.relNode,
+											 GetCurrentSubTransactionId());
+		CommandCounterIncrement();
+
+		MatviewRefreshState lastState = { 0 };
+		if (RelationIsPopulated(matview) &&
+			ReadMatviewRefreshState(matviewId, &lastState) &&
+			lastState.sourceId == sourceId && lastState.deltaRows == 0)
+		{
+			MatviewRefreshState currentState =
+				SourceRefreshState(source, lastState.nextStripeId);
+
+			incremental = currentState.liveRows == lastState.liveRows &&
+						  currentState.deltaRows == 0;
+		}
+
+		if (incremental)
+		{
+			RefreshMatviewIncrementally(matview, source, columnMerges,
+										lastState.nextStripeId);
+		}
+	}
+
+	if (!incremental)
+	{
+		RefreshMatviewFully(matview);
+	}
+
+	if (source != NULL)
+	{
+		CommandCounterIncrement();
+
+		MatviewRefreshState newState =
+			SourceRefreshState(source, ColumnarStorageGetReservedStripeId(source, false));
+		WriteMatviewRefreshState(matviewId, &newState);
+
+		table_close(source, NoLock);
+	}
+	else
+	{
+		DeleteMatviewRefreshState(matviewId);
+	}
+
+	table_close(matview, NoLock);
+
+	PG_RETURN_TEXT_P(cstring_to_text(incremental ? "incremental" : "full"));
+}
+
+
+/*
+ * MatviewQuery returns a copy of the query of the given materialized view,
+ * from its ON SELECT rule.
+ */
+static Query *
+MatviewQuery(Relation matview)
+{
+	if (matview->rd_rules == NULL || matview->rd_rules->numLocks != 1)
+	{
+		elog(ERROR, "materialized view \"%s\" has not exactly one rule",
+			 RelationGetRelationName(matview));
+	}
+
+	RewriteRule *rule = matview->rd_rules->rules[0];
+	if (rule->event != CMD_SELECT || list_length(rule->actions) != 1)
+	{
+		elog(ERROR, "materialized view \"%s\" has an unexpected rule",
+			 RelationGetRelationName(matview));
+	}
+
+	return copyObject(linitial_node(Query, rule->actions));
+}
+
+
+/*
+ * IncrementalRefreshSource returns the columnar table the given query of a
+ * materialized view aggregates, if the groups of new rows can be merged
+ * into the rows of the view, and sets how each of its columns is merged.
+ * Otherwise it returns InvalidOid.
+ *
+ * The query has to read a single columnar table without inheritance
+ * children, and group by some of its output columns, whose other columns
+ * are count, sum, min or max aggregates. Quals and aggregate filters are
+ * fine, as they only look at one row at a time, but functions that aren't
+ * immutable, DISTINCT aggregates, HAVING, ORDER BY and LIMIT aren't.
+ */
+static Oid
+IncrementalRefreshSource(Query *query, MatviewColumnMerge *columnMerges, int columnCount)
+{
+	if (query->commandType != CMD_SELECT || !query->hasAggs ||
+		query->hasWindowFuncs || query->hasTargetSRFs || query->hasSubLinks ||
+		query->hasDistinctOn || query->hasRecursive || query->hasRowSecurity ||
+		query->cteList != NIL || query->setOperations != NULL ||
+		query->distinctClause != NIL || query->havingQual != NULL ||
+		query->sortClause != NIL || query->groupingSets != NIL ||
+		query->limitCount != NULL || query->limitOffset != NULL ||
+		query->rowMarks != NIL)
+	{
+		return InvalidOid;
+	}
+
+	if (list_length(query->jointree->fromlist) != 1 ||
+		!IsA(linitial(query->jointree->fromlist), RangeTblRef))
+	{
+		return InvalidOid;
+	}
+
+	RangeTblRef *rangeTableRef = linitial(query->jointree->fromlist);
+	RangeTblEntry *rte = rt_fetch(rangeTableRef->rtindex, query->rtable);
+
+	if (rte->rtekind != RTE_RELATION || rte->relkind != RELKIND_RELATION ||
+		rte->tablesample != NULL || !IsColumnarTableAmTable(rte->relid) ||
+		has_subclass(rte->relid))
+	{
+		return InvalidOid;
+	}
+
+	/* rows added later would be seen by different values of these */
+	if (contain_mutable_functions((Node *) query->targetList) ||
+		contain_mutable_functions(query->jointree->quals))
+	{
+		return InvalidOid;
+	}
+
+	/* every group key has to be an output column to merge the groups by */
+	SortGroupClause *groupClause = NULL;
+	foreach_ptr(groupClause, query->groupClause)
+	{
+		TargetEntry *groupEntry = get_sortgroupclause_tle(groupClause,
+														  query->targetList);
+		if (groupEntry->resjunk)
+		{
+			return InvalidOid;
+		}
+	}
+
+	int outputColumn = 0;
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, query->targetList)
+	{
+		if (targetEntry->resjunk)
+		{
+			continue;
+		}
+
+		if (outputColumn == columnCount)
+		{
+			return InvalidOid;
+		}
+
+		if (targetEntry->ressortgroupref != 0 &&
+			get_sortgroupref_clause_noerr(targetEntry->ressortgroupref,
+										  query->groupClause) != NULL)
+		{
+			columnMerges[outputColumn] = MATVIEW_MERGE_GROUP_KEY;
+		}
+		else if (!IsA(targetEntry->expr, Aggref) ||
+				 !AggregateMerge((Aggref *) targetEntry->expr,
+								 &columnMerges[outputColumn]))
+		{
+			return InvalidOid;
+		}
+
+		outputColumn++;
+	}
+
+	if (outputColumn != columnCount)
+	{
+		return InvalidOid;
+	}
+
+	return rte->relid;
+}
+
+
+/*
+ * AggregateMerge sets how the results of the given aggregate for two sets of
+ * rows are merged into its result for both, and returns whether they can be.
+ */
+static bool
+AggregateMerge(Aggref *aggref, MatviewColumnMerge *columnMerge)
+{
+	if (aggref->aggkind != AGGKIND_NORMAL || aggref->aggdistinct != NIL ||
+		aggref->aggorder != NIL || aggref->agglevelsup != 0 ||
+		get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	char *aggregateName = get_func_name(aggref->aggfnoid);
+
+	if (strcmp(aggregateName, "count") == 0 || strcmp(aggregateName, "sum") == 0)
+	{
+		*columnMerge = MATVIEW_MERGE_SUM;
+	}
+	else if (strcmp(aggregateName, "min") == 0)
+	{
+		*columnMerge = MATVIEW_MERGE_MIN;
+	}
+	else if (strcmp(aggregateName, "max") == 0)
+	{
+		*columnMerge = MATVIEW_MERGE_MAX;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * SourceRefreshState returns the given first unused stripe id with the
+ * number of live rows of the stripes of the source table before it, and the
+ * number of rows in its delta store, as of the transaction snapshot.
+ */
+static MatviewRefreshState
+SourceRefreshState(Relation source, uint64 nextStripeId)
+{
+	Snapshot snapshot = GetTransactionSnapshot();
+
+	MatviewRefreshState state = { 0 };
+	state.sourceId = RelationGetRelid(source);
+	state.nextStripeId = nextStripeId;
+	state.deltaRows = DeltaStoreRowCount(ColumnarStorageGetStorageId(source, false),
+										 snapshot);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, StripesForSnapshot(source, snapshot))
+	{
+		if (stripeMetadata->id >= nextStripeId)
+		{
+			continue;
+		}
+
+		state.liveRows += stripeMetadata->rowCount -
+						  StripeDeletedRowCount(source->rd_node, stripeMetadata,
+												snapshot);
+	}
+
+	return state;
+}
+
+
+/*
+ * RefreshMatviewIncrementally replaces the rows of the materialized view
+ * with them merged with the groups of the rows of the stripes of source
+ * from stripeFloor on. The merged rows are all computed before the view is
+ * given new storage and they are written into it, and the indexes of the
+ * view are rebuilt afterwards, like TRUNCATE does.
+ */
+static void
+RefreshMatviewIncrementally(Relation matview, Relation source,
+							MatviewColumnMerge *columnMerges, uint64 stripeFloor)
+{
+	char *mergeQuery = MergeQuery(matview, columnMerges);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	/* only sequential, non-parallel reads of the source skip the old stripes */
+	int gucNestLevel = NewGUCNestLevel();
+	(void) set_config_option("max_parallel_workers_per_gather", "0",
+							 PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+	(void) set_config_option("columnar.enable_parallel_execution", "off",
+							 PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+	(void) set_config_option("enable_indexscan", "off",
+							 PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+	(void) set_config_option("enable_indexonlyscan", "off",
+							 PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+	(void) set_config_option("enable_bitmapscan", "off",
+							 PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+
+	ColumnarSetStripeFloor(RelationGetRelid(source), stripeFloor);
+
+	PG_TRY();
+	{
+		if (SPI_execute(mergeQuery, true, 0) != SPI_OK_SELECT)
+		{
+			elog(ERROR, "could not merge new rows into materialized view \"%s\"",
+				 RelationGetRelationName(matview));
+		}
+	}
+	PG_CATCH();
+	{
+		ColumnarSetStripeFloor(InvalidOid, 0);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	ColumnarSetStripeFloor(InvalidOid, 0);
+	AtEOXact_GUC(true, gucNestLevel);
+
+	RelationSetNewRelfilenode(matview, matview->rd_rel->relpersistence);
+
+	TupleDesc tupleDescriptor = RelationGetDescr(matview);
+	ColumnarOptions options = { 0 };
+	ReadColumnarOptions(RelationGetRelid(matview), &options);
+	ColumnarWriteState *writeState = ColumnarBeginWrite(matview->rd_node, options,
+														tupleDescriptor);
+
+	Datum *values = palloc(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc(tupleDescriptor->natts * sizeof(bool));
+
+	for (uint64 rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		heap_deform_tuple(SPI_tuptable->vals[rowIndex], SPI_tuptable->tupdesc,
+						  values, nulls);
+		ColumnarWriteRow(writeState, values, nulls);
+	}
+
+	ColumnarEndWrite(writeState);
+
+	SPI_finish();
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	ReindexParams reindexParams = { 0 };
+	reindex_relation(RelationGetRelid(matview), REINDEX_REL_PROCESS_TOAST,
+					 &reindexParams);
+#else
+	reindex_relation(RelationGetRelid(matview), REINDEX_REL_PROCESS_TOAST, 0);
+#endif
+}
+
+
+/*
+ * MergeQuery returns a query that merges the rows of the materialized view
+ * with the rows its query returns, grouped by the group keys of the view.
+ * Merged aggregates are cast back to the types of the columns, since sums
+ * of counts are numeric.
+ */
+static char *
+MergeQuery(Relation matview, MatviewColumnMerge *columnMerges)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(matview);
+	char *matviewName =
+		quote_qualified_identifier(get_namespace_name(RelationGetNamespace(matview)),
+								   RelationGetRelationName(matview));
+
+	/* the definition ends with a semicolon */
+	char *definition = TextDatumGetCString(
+		DirectFunctionCall1(pg_get_viewdef, ObjectIdGetDatum(RelationGetRelid(matview))));
+	int definitionLength = strlen(definition);
+	while (definitionLength > 0 &&
+		   (definition[definitionLength - 1] == ';' ||
+			isspace((unsigned char) definition[definitionLength - 1])))
+	{
+		definitionLength--;
+	}
+
+	StringInfoData selectList;
+	initStringInfo(&selectList);
+	StringInfoData groupList;
+	initStringInfo(&groupList);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		const char *columnName = quote_identifier(NameStr(attributeForm->attname));
+		const char *separator = columnIndex == 0 ? "" : ", ";
+
+		switch (columnMerges[columnIndex])
+		{
+			case MATVIEW_MERGE_GROUP_KEY:
+			{
+				appendStringInfo(&selectList, "%s%s", separator, columnName);
+				appendStringInfo(&groupList, "%s%s", groupList.len == 0 ? "" : ", ",
+								 columnName);
+				break;
+			}
+
+			case MATVIEW_MERGE_SUM:
+			case MATVIEW_MERGE_MIN:
+			case MATVIEW_MERGE_MAX:
+			{
+				const char *mergeFunction =
+					columnMerges[columnIndex] == MATVIEW_MERGE_SUM ? "sum" :
+					columnMerges[columnIndex] == MATVIEW_MERGE_MIN ? "min" : "max";
+
+				appendStringInfo(&selectList, "%spg_catalog.%s(%s)::%s", separator,
+								 mergeFunction, columnName,
+								 format_type_with_typemod(attributeForm->atttypid,
+														  attributeForm->atttypmod));
+				break;
+			}
+		}
+	}
+
+	StringInfoData mergeQuery;
+	initStringInfo(&mergeQuery);
+	appendStringInfo(&mergeQuery,
+					 "SELECT %s FROM (SELECT * FROM ONLY %s UNION ALL (%.*s)) AS merged",
+					 selectList.data, matviewName, definitionLength, definition);
+
+	if (groupList.len > 0)
+	{
+		appendStringInfo(&mergeQuery, " GROUP BY %s", groupList.data);
+	}
+
+	return mergeQuery.data;
+}
+
+
+/*
+ * RefreshMatviewFully refreshes the materialized view with REFRESH
+ * MATERIALIZED VIEW.
+ */
+static void
+RefreshMatviewFully(Relation matview)
+{
+	char *matviewName =
+		quote_qualified_identifier(get_namespace_name(RelationGetNamespace(matview)),
+								   RelationGetRelationName(matview));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	StringInfo refreshCommand = makeStringInfo();
+	appendStringInfo(refreshCommand, "REFRESH MATERIALIZED VIEW %s", matviewName);
+
+	if (SPI_execute(refreshCommand->data, false, 0) != SPI_OK_UTILITY)
+	{
+		elog(ERROR, "could not refresh materialized view \"%s\"",
+			 RelationGetRelationName(matview));
+	}
+
+	SPI_finish();
+}
+
+
+/*
+ * ReadMatviewRefreshState sets state to what columnar.matview_refresh keeps
+ * of the last refresh of the given materialized view, and returns whether
+ * it keeps anything.
+ */
+static bool
+ReadMatviewRefreshState(Oid matviewId, MatviewRefreshState *state)
+{
+	Oid matviewRefreshOid = ColumnarMatviewRefreshRelationId();
+	if (!OidIsValid(matviewRefreshOid))
+	{
+		return false;
+	}
+
+	Relation matviewRefresh = table_open(matviewRefreshOid, AccessShareLock);
+	Relation index = index_open(ColumnarMatviewRefreshIndexRelationId(),
+								AccessShareLock);
+
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_matview_refresh_matview,
+				BTEqualStrategyNumber, F_OIDEQ, ObjectIdGetDatum(matviewId));
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(matviewRefresh, index, NULL,
+															1, scanKey);
+
+	bool found = false;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		Datum datumArray[Natts_columnar_matview_refresh];
+		bool isNullArray[Natts_columnar_matview_refresh];
+		heap_deform_tuple(heapTuple, RelationGetDescr(matviewRefresh),
+						  datumArray, isNullArray);
+
+		state->sourceId =
+			DatumGetObjectId(datumArray[Anum_columnar_matview_refresh_source - 1]);
+		state->nextStripeId =
+			DatumGetInt64(datumArray[Anum_columnar_matview_refresh_next_stripe_id - 1]);
+		state->liveRows =
+			DatumGetInt64(datumArray[Anum_columnar_matview_refresh_live_rows - 1]);
+		state->deltaRows =
+			DatumGetInt64(datumArray[Anum_columnar_matview_refresh_delta_rows - 1]);
+		found = true;
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(matviewRefresh, AccessShareLock);
+
+	return found;
+}
+
+
+/*
+ * WriteMatviewRefreshState replaces the row of columnar.matview_refresh of
+ * the given materialized view with the given state.
+ */
+static void
+WriteMatviewRefreshState(Oid matviewId, MatviewRefreshState *state)
+{
+	Oid matviewRefreshOid = ColumnarMatviewRefreshRelationId();
+	if (!OidIsValid(matviewRefreshOid))
+	{
+		/* extension is not updated to a version with incremental refresh yet */
+		return;
+	}
+
+	DeleteMatviewRefreshState(matviewId);
+
+	Relation matviewRefresh = table_open(matviewRefreshOid, RowExclusiveLock);
+
+	bool nulls[Natts_columnar_matview_refresh] = { 0 };
+	Datum values[Natts_columnar_matview_refresh] = {
+		ObjectIdGetDatum(matviewId),
+		ObjectIdGetDatum(state->sourceId),
+		Int64GetDatum(state->nextStripeId),
+		Int64GetDatum(state->liveRows),
+		Int64GetDatum(state->deltaRows)
+	};
+
+	HeapTuple newTuple = heap_form_tuple(RelationGetDescr(matviewRefresh), values, nulls);
+	CatalogTupleInsert(matviewRefresh, newTuple);
+
+	table_close(matviewRefresh, RowExclusiveLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * DeleteMatviewRefreshState removes the row of columnar.matview_refresh of
+ * the given materialized view, if the catalog exists.
+ */
+void
+DeleteMatviewRefreshState(Oid matviewId)
+{
+	Oid matviewRefreshOid = ColumnarMatviewRefreshRelationId();
+	if (!OidIsValid(matviewRefreshOid))
+	{
+		return;
+	}
+
+	Relation matviewRefresh = try_relation_open(matviewRefreshOid, RowExclusiveLock);
+	if (matviewRefresh == NULL)
+	{
+		/* extension has been dropped */
+		return;
+	}
+
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_matview_refresh_matview,
+				BTEqualStrategyNumber, F_OIDEQ, ObjectIdGetDatum(matviewId));
+
+	Relation index = index_open(ColumnarMatviewRefreshIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(matviewRefresh, index, NULL,
+															1, scanKey);
+
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		CatalogTupleDelete(matviewRefresh, &heapTuple->t_self);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	relation_close(matviewRefresh, RowExclusiveLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * ColumnarMatviewRefreshRelationId returns relation id of
+ * columnar.matview_refresh.
+ */
+static Oid
+ColumnarMatviewRefreshRelationId(void)
+{
+	return get_relname_relid("matview_refresh", get_namespace_oid("columnar", true));
+}
+
+
+/*
+ * ColumnarMatviewRefreshIndexRelationId returns relation id of
+ * columnar.matview_refresh_pkey.
+ */
+static Oid
+ColumnarMatviewRefreshIndexRelationId(void)
+{
+	return get_relname_relid("matview_refresh_pkey", get_namespace_oid("columnar", true));
+}
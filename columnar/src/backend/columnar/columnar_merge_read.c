@@ -0,0 +1,672 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_merge_read.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Reading the rows of a columnar table with a sort key in the order of the
+ * sort key, for scans that the planner lets provide that order.
+ *
+ * The rows of each stripe of such a table are sorted when the stripe is
+ * written, so a read in that order merges the stripes. Whether a stripe is
+ * sorted, and its minimum and maximum, are known from the chunk skip nodes
+ * of the sort key column. Sorted stripes are chained by their minimums into
+ * runs of stripes that don't overlap, which are read one stripe after the
+ * other, and the runs are merged. The other rows, of stripes written before
+ * the table got its sort key, of stripes whose sort key has NULLs in chunks
+ * with values, of runs beyond COLUMNAR_MERGE_READ_MAX_RUNS and of the delta
+ * store, are sorted with a tuplesort first, and merged as one more run. The
+ * rows of a table whose stripes don't overlap are read without comparing
+ * any of them.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
+#include "executor/tuptable.h"
+#include "lib/binaryheap.h"
+#include "miscadmin.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/sortsupport.h"
+#include "utils/tuplesort.h"
+#include "utils/typcache.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+/*
+ * Runs of sorted stripes read at the same time at most. Each of them holds
+ * the chunks of its current stripe.
+ */
+#define COLUMNAR_MERGE_READ_MAX_RUNS 16
+
+/* a flushed stripe and the range of its sort key if its rows are sorted */
+typedef struct MergeReadStripe
+{
+	StripeMetadata *stripeMetadata;
+	Datum minimumValue;
+	bool minimumIsNull;
+	Datum maximumValue;
+	bool maximumIsNull;
+} MergeReadStripe;
+
+/* rows merged in the order of the sort key, and the row read from them last */
+typedef struct MergeReadRun
+{
+	/* read of the stripes of the run, NULL for the rows of the tuplesort */
+	ColumnarReadState *readState;
+
+	Datum *columnValues;
+	bool *columnNulls;
+	uint64 rowNumber;
+} MergeReadRun;
+
+struct ColumnarMergeReadState
+{
+	Relation relation;
+	TupleDesc tupleDescriptor;
+	List *projectedColumnList;
+	List *whereClauseList;
+	Snapshot snapshot;
+	MemoryContext scanContext;
+
+	AttrNumber sortKeyColumn;
+	Oid sortOperator;
+	SortSupportData sortKey;
+
+	/* holds the runs of the current read, reset when it starts over */
+	MemoryContext readContext;
+	bool started;
+
+	MergeReadRun *runs;
+	int runCount;
+
+	/* rows of the run without a read state */
+	Tuplesortstate *sortedRows;
+	TupleDesc sortedRowDescriptor;
+	TupleTableSlot *sortedRowSlot;
+
+	/* runs with rows left, the one whose row sorts first on top */
+	binaryheap *runHeap;
+
+	/* run the row returned last came from, -1 if none */
+	int lastRunIndex;
+};
+
+static void BeginMergeRuns(ColumnarMergeReadState *mergeRead);
+static bool StripeSortKeyRange(ColumnarMergeReadState *mergeRead,
+							   MergeReadStripe *mergeStripe);
+static int CompareStripeMinimums(const void *left, const void *right, void *arg);
+static ColumnarReadState * BeginRunRead(ColumnarMergeReadState *mergeRead,
+										List *stripeList, bool readDeltaStore);
+static void SortUnsortedRows(ColumnarMergeReadState *mergeRead,
+							 ColumnarReadState *readState);
+static bool AdvanceRun(ColumnarMergeReadState *mergeRead, int runIndex);
+static int CompareRuns(Datum left, Datum right, void *arg);
+static void EndMergeRuns(ColumnarMergeReadState *mergeRead);
+
+
+/*
+ * ColumnarBeginMergeRead starts a sequential read of the given relation
+ * that returns its rows in the order of its sort key column, the default
+ * order of the type of the column with NULLs last.
+ */
+ColumnarMergeReadState *
+ColumnarBeginMergeRead(Relation relation, TupleDesc tupleDescriptor,
+					   List *projectedColumnList, List *whereClauseList,
+					   MemoryContext scanContext, Snapshot snapshot,
+					   AttrNumber sortKeyColumn)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(scanContext);
+
+	ColumnarMergeReadState *mergeRead = palloc0(sizeof(ColumnarMergeReadState));
+	mergeRead->relation = relation;
+	mergeRead->tupleDescriptor = tupleDescriptor;
+	mergeRead->whereClauseList = copyObject(whereClauseList);
+	mergeRead->snapshot = snapshot;
+	mergeRead->scanContext = scanContext;
+	mergeRead->sortKeyColumn = sortKeyColumn;
+	mergeRead->lastRunIndex = -1;
+
+	/* rows are merged by the sort key, so it is read even if not needed */
+	mergeRead->projectedColumnList = list_copy(projectedColumnList);
+	mergeRead->projectedColumnList =
+		list_append_unique_int(mergeRead->projectedColumnList, sortKeyColumn);
+
+	/* like the writer sorts the rows of the stripes */
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(tupleDescriptor, AttrNumberGetAttrOffset(sortKeyColumn));
+	TypeCacheEntry *typeEntry = lookup_type_cache(attributeForm->atttypid,
+												  TYPECACHE_LT_OPR);
+	mergeRead->sortOperator = typeEntry->lt_opr;
+
+	mergeRead->sortKey.ssup_cxt = scanContext;
+	mergeRead->sortKey.ssup_collation = attributeForm->attcollation;
+	mergeRead->sortKey.ssup_nulls_first = false;
+	mergeRead->sortKey.ssup_attno = sortKeyColumn;
+	PrepareSortSupportFromOrderingOp(mergeRead->sortOperator, &mergeRead->sortKey);
+
+	mergeRead->readContext = AllocSetContextCreate(scanContext,
+												   "Columnar Merge Read Context",
+												   ALLOCSET_DEFAULT_SIZES);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return mergeRead;
+}
+
+
+/*
+ * ColumnarMergeReadNextRow sets the values, nulls and row number of the next
+ * row in the order of the sort key, and returns false if there are no more
+ * rows. The values stay valid until the next row is read.
+ */
+bool
+ColumnarMergeReadNextRow(ColumnarMergeReadState *mergeRead, Datum *columnValues,
+						 bool *columnNulls, uint64 *rowNumber)
+{
+	if (!mergeRead->started)
+	{
+		BeginMergeRuns(mergeRead);
+		mergeRead->started = true;
+	}
+	else if (mergeRead->lastRunIndex >= 0)
+	{
+		/* the row returned last isn't needed anymore */
+		int lastRunIndex = mergeRead->lastRunIndex;
+
+		if (mergeRead->runCount == 1)
+		{
+			if (!AdvanceRun(mergeRead, lastRunIndex))
+			{
+				mergeRead->lastRunIndex = -1;
+			}
+		}
+		else if (AdvanceRun(mergeRead, lastRunIndex))
+		{
+			binaryheap_replace_first(mergeRead->runHeap, Int32GetDatum(lastRunIndex));
+		}
+		else
+		{
+			binaryheap_remove_first(mergeRead->runHeap);
+		}
+	}
+
+	int runIndex = -1;
+	if (mergeRead->runCount == 1)
+	{
+		runIndex = mergeRead->lastRunIndex;
+	}
+	else if (mergeRead->runHeap != NULL && !binaryheap_empty(mergeRead->runHeap))
+	{
+		runIndex = DatumGetInt32(binaryheap_first(mergeRead->runHeap));
+	}
+
+	mergeRead->lastRunIndex = runIndex;
+	if (runIndex < 0)
+	{
+		return false;
+	}
+
+	MergeReadRun *run = &mergeRead->runs[runIndex];
+	int columnCount = mergeRead->tupleDescriptor->natts;
+
+	memcpy(columnValues, run->columnValues, columnCount * sizeof(Datum));
+	memcpy(columnNulls, run->columnNulls, columnCount * sizeof(bool));
+	*rowNumber = run->rowNumber;
+
+	return true;
+}
+
+
+/*
+ * ColumnarMergeRescan makes the next row read start over from the first row,
+ * with the given clauses.
+ */
+void
+ColumnarMergeRescan(ColumnarMergeReadState *mergeRead, List *whereClauseList)
+{
+	EndMergeRuns(mergeRead);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(mergeRead->scanContext);
+	mergeRead->whereClauseList = copyObject(whereClauseList);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarEndMergeRead finishes the given read.
+ */
+void
+ColumnarEndMergeRead(ColumnarMergeReadState *mergeRead)
+{
+	EndMergeRuns(mergeRead);
+	MemoryContextDelete(mergeRead->readContext);
+}
+
+
+/*
+ * BeginMergeRuns splits the stripes of the relation into runs and reads the
+ * first row of each of them.
+ */
+static void
+BeginMergeRuns(ColumnarMergeReadState *mergeRead)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(mergeRead->readContext);
+
+	List *stripeList = StripesForSnapshot(mergeRead->relation, mergeRead->snapshot);
+	MergeReadStripe *sortedStripes =
+		palloc0(Max(list_length(stripeList), 1) * sizeof(MergeReadStripe));
+	int sortedStripeCount = 0;
+	List *unsortedStripeList = NIL;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED ||
+			stripeMetadata->rowCount == 0)
+		{
+			continue;
+		}
+
+		MergeReadStripe *mergeStripe = &sortedStripes[sortedStripeCount];
+		mergeStripe->stripeMetadata = stripeMetadata;
+
+		if (StripeSortKeyRange(mergeRead, mergeStripe))
+		{
+			sortedStripeCount++;
+		}
+		else
+		{
+			unsortedStripeList = lappend(unsortedStripeList, stripeMetadata);
+		}
+	}
+
+	qsort_arg(sortedStripes, sortedStripeCount, sizeof(MergeReadStripe),
+			  CompareStripeMinimums, &mergeRead->sortKey);
+
+	/*
+	 * Each stripe, in the order of their minimums, goes to the first run it
+	 * doesn't overlap with, which uses as few runs as possible.
+	 */
+	List *runStripeLists[COLUMNAR_MERGE_READ_MAX_RUNS];
+	MergeReadStripe *runLastStripes[COLUMNAR_MERGE_READ_MAX_RUNS];
+	int sortedRunCount = 0;
+
+	for (int stripeIndex = 0; stripeIndex < sortedStripeCount; stripeIndex++)
+	{
+		MergeReadStripe *mergeStripe = &sortedStripes[stripeIndex];
+		int runIndex = 0;
+
+		for (; runIndex < sortedRunCount; runIndex++)
+		{
+			MergeReadStripe *lastStripe = runLastStripes[runIndex];
+
+			if (ApplySortComparator(lastStripe->maximumValue, lastStripe->maximumIsNull,
+									mergeStripe->minimumValue, mergeStripe->minimumIsNull,
+									&mergeRead->sortKey) <= 0)
+			{
+				break;
+			}
+		}
+
+		if (runIndex == sortedRunCount)
+		{
+			if (sortedRunCount == COLUMNAR_MERGE_READ_MAX_RUNS)
+			{
+				unsortedStripeList = lappend(unsortedStripeList,
+											 mergeStripe->stripeMetadata);
+				continue;
+			}
+
+			runStripeLists[runIndex] = NIL;
+			sortedRunCount++;
+		}
+
+		runStripeLists[runIndex] = lappend(runStripeLists[runIndex],
+										   mergeStripe->stripeMetadata);
+		runLastStripes[runIndex] = mergeStripe;
+	}
+
+	/* the last run has the rows of the tuplesort, delta store rows included */
+	int columnCount = mergeRead->tupleDescriptor->natts;
+	mergeRead->runs = palloc0((sortedRunCount + 1) * sizeof(MergeReadRun));
+	mergeRead->runCount = 0;
+
+	for (int runIndex = 0; runIndex <= sortedRunCount; runIndex++)
+	{
+		MergeReadRun *run = &mergeRead->runs[mergeRead->runCount];
+		run->columnValues = palloc0(columnCount * sizeof(Datum));
+		run->columnNulls = palloc0(columnCount * sizeof(bool));
+
+		if (runIndex < sortedRunCount)
+		{
+			run->readState = BeginRunRead(mergeRead, runStripeLists[runIndex], false);
+		}
+		else
+		{
+			ColumnarReadState *readState = BeginRunRead(mergeRead, unsortedStripeList,
+														true);
+			SortUnsortedRows(mergeRead, readState);
+			ColumnarEndRead(readState);
+		}
+
+		if (AdvanceRun(mergeRead, mergeRead->runCount))
+		{
+			mergeRead->runCount++;
+		}
+		else if (run->readState != NULL)
+		{
+			ColumnarEndRead(run->readState);
+			run->readState = NULL;
+		}
+	}
+
+	mergeRead->lastRunIndex = -1;
+	if (mergeRead->runCount == 1)
+	{
+		mergeRead->lastRunIndex = 0;
+	}
+	else if (mergeRead->runCount > 1)
+	{
+		mergeRead->runHeap = binaryheap_allocate(mergeRead->runCount, CompareRuns,
+												 mergeRead);
+		for (int runIndex = 0; runIndex < mergeRead->runCount; runIndex++)
+		{
+			binaryheap_add_unordered(mergeRead->runHeap, Int32GetDatum(runIndex));
+		}
+
+		binaryheap_build(mergeRead->runHeap);
+	}
+
+	ereport(DEBUG1, (errmsg("merging %d runs of %d sorted stripes of \"%s\"",
+							mergeRead->runCount, sortedStripeCount,
+							RelationGetRelationName(mergeRead->relation))));
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * StripeSortKeyRange sets the minimum and maximum of the sort key of the
+ * given stripe and returns true if the chunk skip nodes of the sort key
+ * column show that the rows of the stripe are sorted by it. Chunks with
+ * values and NULLs don't tell where their NULLs are, so such stripes don't
+ * count as sorted.
+ */
+static bool
+StripeSortKeyRange(ColumnarMergeReadState *mergeRead, MergeReadStripe *mergeStripe)
+{
+	StripeMetadata *stripeMetadata = mergeStripe->stripeMetadata;
+	TupleDesc tupleDescriptor = mergeRead->tupleDescriptor;
+	uint32 columnIndex = AttrNumberGetAttrOffset(mergeRead->sortKeyColumn);
+
+	/* columns added after the stripe was written have no skip nodes */
+	if (stripeMetadata->columnCount <= columnIndex)
+	{
+		return false;
+	}
+
+	bool *columnMask = palloc0(tupleDescriptor->natts * sizeof(bool));
+	columnMask[columnIndex] = true;
+
+	StripeSkipList *skipList =
+		ReadStripeSkipListColumns(mergeRead->relation->rd_node, stripeMetadata->id,
+								  tupleDescriptor, stripeMetadata->chunkCount,
+								  mergeRead->snapshot, columnMask);
+
+	bool hasValues = false;
+	bool hasNulls = false;
+
+	for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode =
+			&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+		if (chunkSkipNode->rowCount != skipList->chunkGroupRowCounts[chunkIndex])
+		{
+			return false;
+		}
+
+		bool chunkHasValues = chunkSkipNode->hasStatistics ?
+							  chunkSkipNode->nullCount < chunkSkipNode->rowCount :
+							  chunkSkipNode->nullState != CHUNK_NULLS_ALL;
+		bool chunkHasNulls = chunkSkipNode->hasStatistics ?
+							 chunkSkipNode->nullCount > 0 :
+							 chunkSkipNode->nullState != CHUNK_NULLS_NONE;
+
+		if (!chunkHasValues)
+		{
+			hasNulls = true;
+			continue;
+		}
+
+		/* NULLs sort last, so no values can come after them */
+		if (hasNulls || chunkHasNulls || !chunkSkipNode->hasMinMax ||
+			!chunkSkipNode->sortednessKnown || !chunkSkipNode->valuesSorted)
+		{
+			return false;
+		}
+
+		if (!hasValues)
+		{
+			mergeStripe->minimumValue = chunkSkipNode->minimumValue;
+		}
+		else if (ApplySortComparator(mergeStripe->maximumValue, false,
+									 chunkSkipNode->minimumValue, false,
+									 &mergeRead->sortKey) > 0)
+		{
+			return false;
+		}
+
+		mergeStripe->maximumValue = chunkSkipNode->maximumValue;
+		hasValues = true;
+	}
+
+	mergeStripe->minimumIsNull = !hasValues;
+	mergeStripe->maximumIsNull = hasNulls;
+
+	return true;
+}
+
+
+/*
+ * CompareStripeMinimums compares the minimums of the sort key of two
+ * stripes, for qsort_arg.
+ */
+static int
+CompareStripeMinimums(const void *left, const void *right, void *arg)
+{
+	const MergeReadStripe *leftStripe = (const MergeReadStripe *) left;
+	const MergeReadStripe *rightStripe = (const MergeReadStripe *) right;
+
+	return ApplySortComparator(leftStripe->minimumValue, leftStripe->minimumIsNull,
+							   rightStripe->minimumValue, rightStripe->minimumIsNull,
+							   (SortSupport) arg);
+}
+
+
+/*
+ * BeginRunRead starts a read of the given stripes, in the given order, and
+ * of the delta store after them if readDeltaStore is set.
+ */
+static ColumnarReadState *
+BeginRunRead(ColumnarMergeReadState *mergeRead, List *stripeList, bool readDeltaStore)
+{
+	bool randomAccess = false;
+	ColumnarReadState *readState = ColumnarBeginRead(mergeRead->relation,
+													 mergeRead->tupleDescriptor,
+													 mergeRead->projectedColumnList,
+													 mergeRead->whereClauseList,
+													 mergeRead->readContext,
+													 mergeRead->snapshot,
+													 randomAccess, NULL);
+
+	ColumnarSetStripeList(readState, stripeList, readDeltaStore);
+
+	return readState;
+}
+
+
+/*
+ * SortUnsortedRows sorts the rows of the given read by the sort key, with
+ * their row numbers in an extra column after the columns of the relation.
+ */
+static void
+SortUnsortedRows(ColumnarMergeReadState *mergeRead, ColumnarReadState *readState)
+{
+	TupleDesc tupleDescriptor = mergeRead->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+
+	TupleDesc sortedRowDescriptor = CreateTemplateTupleDesc(columnCount + 1);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		TupleDescCopyEntry(sortedRowDescriptor, AttrOffsetGetAttrNumber(columnIndex),
+						   tupleDescriptor, AttrOffsetGetAttrNumber(columnIndex));
+	}
+	TupleDescInitEntry(sortedRowDescriptor, (AttrNumber) columnCount + 1, "row_number",
+					   INT8OID, -1, 0);
+
+	AttrNumber sortColumn = mergeRead->sortKeyColumn;
+	Oid sortCollation = mergeRead->sortKey.ssup_collation;
+	bool nullsFirst = false;
+
+	mergeRead->sortedRowDescriptor = sortedRowDescriptor;
+	mergeRead->sortedRowSlot = MakeSingleTupleTableSlot(sortedRowDescriptor,
+														&TTSOpsMinimalTuple);
+	mergeRead->sortedRows = tuplesort_begin_heap(sortedRowDescriptor, 1, &sortColumn,
+												 &mergeRead->sortOperator,
+												 &sortCollation, &nullsFirst,
+												 work_mem,
+#if PG_VERSION_NUM < PG_VERSION_15
+												 NULL, false);
+#else
+												 NULL, TUPLESORT_NONE);
+#endif
+
+	TupleTableSlot *rowSlot = MakeSingleTupleTableSlot(sortedRowDescriptor,
+													   &TTSOpsVirtual);
+	uint64 rowNumber = 0;
+
+	while (true)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		ExecClearTuple(rowSlot);
+		memset(rowSlot->tts_isnull, true, (columnCount + 1) * sizeof(bool));
+
+		if (!ColumnarReadNextRow(readState, rowSlot->tts_values, rowSlot->tts_isnull,
+								 &rowNumber))
+		{
+			break;
+		}
+
+		rowSlot->tts_values[columnCount] = Int64GetDatum((int64) rowNumber);
+		rowSlot->tts_isnull[columnCount] = false;
+		ExecStoreVirtualTuple(rowSlot);
+
+		tuplesort_puttupleslot(mergeRead->sortedRows, rowSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(rowSlot);
+
+	tuplesort_performsort(mergeRead->sortedRows);
+}
+
+
+/*
+ * AdvanceRun reads the next row of the given run, and returns false if the
+ * run has no more rows.
+ */
+static bool
+AdvanceRun(ColumnarMergeReadState *mergeRead, int runIndex)
+{
+	MergeReadRun *run = &mergeRead->runs[runIndex];
+
+	if (run->readState != NULL)
+	{
+		return ColumnarReadNextRow(run->readState, run->columnValues, run->columnNulls,
+								   &run->rowNumber);
+	}
+
+	TupleTableSlot *sortedRowSlot = mergeRead->sortedRowSlot;
+	if (!tuplesort_gettupleslot(mergeRead->sortedRows, true, false, sortedRowSlot,
+								NULL))
+	{
+		return false;
+	}
+
+	slot_getallattrs(sortedRowSlot);
+
+	int columnCount = mergeRead->tupleDescriptor->natts;
+	memcpy(run->columnValues, sortedRowSlot->tts_values, columnCount * sizeof(Datum));
+	memcpy(run->columnNulls, sortedRowSlot->tts_isnull, columnCount * sizeof(bool));
+	run->rowNumber = (uint64) DatumGetInt64(sortedRowSlot->tts_values[columnCount]);
+
+	return true;
+}
+
+
+/*
+ * CompareRuns compares the sort keys of the rows of two runs, so that the
+ * heap has the run whose row sorts first on top.
+ */
+static int
+CompareRuns(Datum left, Datum right, void *arg)
+{
+	ColumnarMergeReadState *mergeRead = (ColumnarMergeReadState *) arg;
+	MergeReadRun *leftRun = &mergeRead->runs[DatumGetInt32(left)];
+	MergeReadRun *rightRun = &mergeRead->runs[DatumGetInt32(right)];
+	uint32 columnIndex = AttrNumberGetAttrOffset(mergeRead->sortKeyColumn);
+
+	return ApplySortComparator(rightRun->columnValues[columnIndex],
+							   rightRun->columnNulls[columnIndex],
+							   leftRun->columnValues[columnIndex],
+							   leftRun->columnNulls[columnIndex],
+							   &mergeRead->sortKey);
+}
+
+
+/*
+ * EndMergeRuns ends the reads of the runs of the current read, if it
+ * started, so that the next row read starts over.
+ */
+static void
+EndMergeRuns(ColumnarMergeReadState *mergeRead)
+{
+	if (!mergeRead->started)
+	{
+		return;
+	}
+
+	for (int runIndex = 0; runIndex < mergeRead->runCount; runIndex++)
+	{
+		if (mergeRead->runs[runIndex].readState != NULL)
+		{
+			ColumnarEndRead(mergeRead->runs[runIndex].readState);
+		}
+	}
+
+	if (mergeRead->sortedRows != NULL)
+	{
+		tuplesort_end(mergeRead->sortedRows);
+		ExecDropSingleTupleTableSlot(mergeRead->sortedRowSlot);
+	}
+
+	mergeRead->runs = NULL;
+	mergeRead->runCount = 0;
+	mergeRead->sortedRows = NULL;
+	mergeRead->sortedRowDescriptor = NULL;
+	mergeRead->sortedRowSlot = NULL;
+	mergeRead->runHeap = NULL;
+	mergeRead->lastRunIndex = -1;
+	mergeRead->started = false;
+
+	MemoryContextReset(mergeRead->readContext);
+}
@@ -11,6 +11,7 @@
  *   * holds basic stripe information including data size and row counts
  *   * holds basic chunk and chunk group information like data offsets and
  *     min/max values (used for Chunk Group Filtering)
+ *   * holds per stripe min/max values of columns (used for Stripe Filtering)
  *   * useful for fast VACUUM operations (e.g. reporting with VACUUM VERBOSE)
  *   * useful for stats/costing
  *   * maps logical row numbers to stripe IDs
@@ -28,6 +29,7 @@
 #include "columnar/columnar.h"
 #include "columnar/columnar_metadata.h"
 #include "columnar/columnar_storage.h"
+#include "columnar/columnar_trace.h"
 #include "columnar/columnar_version_compat.h"
 #include "columnar/utils/listutils.h"
 
@@ -35,6 +37,7 @@
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/nbtree.h"
+#include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/indexing.h"
 #include "catalog/pg_namespace.h"
@@ -49,11 +52,13 @@
 #include "miscadmin.h"
 #include "nodes/execnodes.h"
 #include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
 #include "port.h"
 #include "storage/fd.h"
 #include "storage/lmgr.h"
 #include "storage/procarray.h"
 #include "storage/smgr.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/memutils.h"
@@ -96,25 +101,62 @@ static List * ReadDataFileStripeList(uint64 storageId, Snapshot snapshot,
 									 ScanDirection scanDirection);
 static StripeMetadata * BuildStripeMetadata(Relation columnarStripes,
 											HeapTuple heapTuple);
+static void ReadChunkGroupRowCountsCached(uint64 storageId, uint64 stripe,
+										 uint32 chunkGroupCount,
+										 uint32 **chunkGroupRowCounts,
+										 uint32 **chunkGroupDeletedRows,
+										 Snapshot snapshot);
 static void ReadChunkGroupRowCounts(uint64 storageId, uint64 stripe,
 									uint32 chunkGroupCount,
 									uint32 **chunkGroupRowCounts,
 									uint32 **chunkGroupDeletedRows,
 									Snapshot snapshot);
+static void SaveCompactStripeSkipList(uint64 storageId, uint64 stripe,
+									  StripeSkipList *chunkList,
+									  TupleDesc tupleDescriptor);
+static StripeSkipList * ReadCompactStripeSkipList(uint64 storageId, uint64 stripe,
+												  TupleDesc tupleDescriptor,
+												  uint32 chunkCount,
+												  Snapshot snapshot,
+												  const bool *columnMask);
+static StripeSkipList * ReadStripeChunkRows(uint64 storageId, uint64 stripe,
+											TupleDesc tupleDescriptor,
+											uint32 chunkCount, Snapshot snapshot,
+											const bool *columnMask);
+static StripeSkipList * CreateEmptyStripeSkipList(uint32 columnCount,
+												  uint32 chunkCount,
+												  const bool *columnMask);
+static void SkipStripeSkipListNode(StringInfo buffer);
 static Oid ColumnarStorageIdSequenceRelationId(void);
 static Oid ColumnarStripeRelationId(void);
 static Oid ColumnarStripePKeyIndexRelationId(void);
 static Oid ColumnarStripeFirstRowNumberIndexRelationId(void);
 static Oid ColumnarOptionsRelationId(void);
 static Oid ColumnarOptionsIndexRegclass(void);
+static Oid ColumnarColumnOptionsRelationId(void);
+static Oid ColumnarColumnOptionsIndexRelationId(void);
+static Oid ColumnarCompressionDictionaryRelationId(void);
+static Oid ColumnarCompressionDictionaryIndexRelationId(void);
+static Oid ColumnarCompressionDictionaryIdIndexRelationId(void);
+static Oid ColumnarCompressionDictionaryIdSequenceRelationId(void);
+static Oid ColumnarDeltaStoreRelationId(void);
+static Oid ColumnarDeltaStoreIndexRelationId(void);
 static Oid ColumnarChunkRelationId(void);
 static Oid ColumnarChunkGroupRelationId(void);
 static Oid ColumnarRowMaskRelationId(void);
 static Oid ColumnarRowMaskSeqId(void);
 static Oid ColumnarChunkIndexRelationId(void);
 static Oid ColumnarChunkGroupIndexRelationId(void);
+static Oid ColumnarStripeAttrRelationId(void);
+static Oid ColumnarStripeAttrIndexRelationId(void);
+static Oid ColumnarStripeSkipListRelationId(void);
+static Oid ColumnarStripeSkipListIndexRelationId(void);
+static Oid ColumnarStripeProjectionRelationId(void);
+static Oid ColumnarStripeProjectionIndexRelationId(void);
 static Oid ColumnarRowMaskIndexRelationId(void);
 static Oid ColumnarRowMaskStripeIndexRelationId(void);
+static void UpdateRowMaskTuple(Relation columnarRowMask, Relation index,
+							   RowMaskWriteStateEntry *rowMaskEntry);
 static Oid ColumnarNamespaceId(void);
 static uint64 GetHighestUsedRowNumber(uint64 storageId);
 static void DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
@@ -127,6 +169,13 @@ static void DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
 												  Oid storageIdIndexId,
 												  uint64 storageId,
 												  uint64 stripeId);
+static void MoveStripeInColumnarMetadataTable(Oid metadataTableId,
+											  AttrNumber storageIdAtrrNumber,
+											  AttrNumber stripeIdAttrNumber,
+											  Oid storageIdIndexId,
+											  uint64 storageId,
+											  uint64 oldStripeId,
+											  uint64 newStripeId);
 static ModifyState * StartModifyRelation(Relation rel);
 static void InsertTupleAndEnforceConstraints(ModifyState *state, Datum *values,
 											 bool *nulls);
@@ -134,7 +183,16 @@ static void DeleteTupleAndEnforceConstraints(ModifyState *state, HeapTuple heapT
 static void FinishModifyRelation(ModifyState *state);
 static bytea * DatumToBytea(Datum value, Form_pg_attribute attrForm);
 static Datum ByteaToDatum(bytea *bytes, Form_pg_attribute attrForm);
+static void SendStripeDatum(StringInfo buffer, Datum value,
+							Form_pg_attribute attributeForm);
+static Datum ReceiveStripeDatum(StringInfo buffer, Form_pg_attribute attributeForm);
 static bool WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite);
+static void WriteColumnarColumnOptions(Oid regclass, ColumnarOptions *options);
+static void DeleteColumnarColumnOptions(Oid regclass);
+static void ReadColumnarColumnOptions(Oid regclass, ColumnarOptions *options);
+static ColumnCompressionOption * FindColumnCompressionOption(List *compressionOptions,
+															 AttrNumber attnum);
+static ArrayType * ShreddedKeyArray(List *shreddedKeys, AttrNumber attnum);
 static StripeMetadata * StripeMetadataLookupRowNumber(Relation relation, uint64 rowNumber,
 													  Snapshot snapshot,
 													  RowNumberLookupMode lookupMode);
@@ -144,12 +202,16 @@ PG_FUNCTION_INFO_V1(columnar_relation_storageid);
 PG_FUNCTION_INFO_V1(create_table_row_mask);
 
 /* constants for columnar.options */
-#define Natts_columnar_options 5
+#define Natts_columnar_options 9
 #define Anum_columnar_options_regclass 1
 #define Anum_columnar_options_chunk_group_row_limit 2
 #define Anum_columnar_options_stripe_row_limit 3
 #define Anum_columnar_options_compression_level 4
 #define Anum_columnar_options_compression 5
+#define Anum_columnar_options_cache_quota 6
+#define Anum_columnar_options_delta_store 7
+#define Anum_columnar_options_stripe_size_limit 8
+#define Anum_columnar_options_auto_row_limits 9
 
 /* ----------------
  *		columnar.options definition.
@@ -163,14 +225,35 @@ typedef struct FormData_columnar_options
 	int32 compressionLevel;
 	NameData compression;
 
+	/*
+	 * cache_quota, delta_store, stripe_size_limit and auto_row_limits are
+	 * added by an ALTER TABLE, so rows
+	 * written before the upgrade don't have them and they must be read with
+	 * heap_getattr.
+	 */
+
 #ifdef CATALOG_VARLEN           /* variable-length fields start here */
 #endif
 } FormData_columnar_options;
 typedef FormData_columnar_options *Form_columnar_options;
 
 
+/* constants for columnar.column_options */
+#define Natts_columnar_column_options 11
+#define Anum_columnar_column_options_regclass 1
+#define Anum_columnar_column_options_attnum 2
+#define Anum_columnar_column_options_bloom_filter 3
+#define Anum_columnar_column_options_compression 4
+#define Anum_columnar_column_options_compression_level 5
+#define Anum_columnar_column_options_sort_key 6
+#define Anum_columnar_column_options_projection_group_by 7
+#define Anum_columnar_column_options_projection_sum 8
+#define Anum_columnar_column_options_hll 9
+#define Anum_columnar_column_options_shredded_keys 10
+#define Anum_columnar_column_options_bucket_count 11
+
 /* constants for columnar.stripe */
-#define Natts_columnar_stripe 9
+#define Natts_columnar_stripe 10
 #define Anum_columnar_stripe_storageid 1
 #define Anum_columnar_stripe_stripe 2
 #define Anum_columnar_stripe_file_offset 3
@@ -180,6 +263,7 @@ typedef FormData_columnar_options *Form_columnar_options;
 #define Anum_columnar_stripe_row_count 7
 #define Anum_columnar_stripe_chunk_count 8
 #define Anum_columnar_stripe_first_row_number 9
+#define Anum_columnar_stripe_bucket 10
 
 /* constants for columnar.chunk_group */
 #define Natts_columnar_chunkgroup 5
@@ -190,7 +274,7 @@ typedef FormData_columnar_options *Form_columnar_options;
 #define Anum_columnar_chunkgroup_deleted_rows 5
 
 /* constants for columnar.chunk */
-#define Natts_columnar_chunk 14
+#define Natts_columnar_chunk 24
 #define Anum_columnar_chunk_storageid 1
 #define Anum_columnar_chunk_stripe 2
 #define Anum_columnar_chunk_attr 3
@@ -205,6 +289,60 @@ typedef FormData_columnar_options *Form_columnar_options;
 #define Anum_columnar_chunk_value_compression_level 12
 #define Anum_columnar_chunk_value_decompressed_size 13
 #define Anum_columnar_chunk_value_count 14
+#define Anum_columnar_chunk_bloom_filter 15
+#define Anum_columnar_chunk_value_encoding_type 16
+#define Anum_columnar_chunk_null_state 17
+#define Anum_columnar_chunk_compression_dictionary_id 18
+#define Anum_columnar_chunk_null_count 19
+#define Anum_columnar_chunk_distinct_count 20
+#define Anum_columnar_chunk_values_sorted 21
+#define Anum_columnar_chunk_hll_sketch 22
+#define Anum_columnar_chunk_large_value_count 23
+#define Anum_columnar_chunk_shredded_key_stats 24
+
+/* constants for columnar.stripe_skip_list */
+#define Natts_columnar_stripe_skip_list 3
+#define Anum_columnar_stripe_skip_list_storageid 1
+#define Anum_columnar_stripe_skip_list_stripe 2
+#define Anum_columnar_stripe_skip_list_skip_list 3
+
+/* format version and chunk flags of the skip lists in columnar.stripe_skip_list */
+#define COMPACT_SKIP_LIST_VERSION 1
+#define COMPACT_CHUNK_HAS_MIN_MAX 0x01
+#define COMPACT_CHUNK_HAS_BLOOM_FILTER 0x02
+#define COMPACT_CHUNK_HAS_STATISTICS 0x04
+#define COMPACT_CHUNK_SORTEDNESS_KNOWN 0x08
+#define COMPACT_CHUNK_VALUES_SORTED 0x10
+#define COMPACT_CHUNK_HAS_HLL_SKETCH 0x20
+#define COMPACT_CHUNK_HAS_LARGE_VALUES 0x40
+#define COMPACT_CHUNK_HAS_SHREDDED_KEYS 0x80
+
+/* constants for columnar.stripe_projection */
+#define Natts_columnar_stripe_projection 3
+#define Anum_columnar_stripe_projection_storageid 1
+#define Anum_columnar_stripe_projection_stripe 2
+#define Anum_columnar_stripe_projection_projection 3
+
+/* constants for columnar.stripe_attr */
+#define Natts_columnar_stripe_attr 5
+#define Anum_columnar_stripe_attr_storageid 1
+#define Anum_columnar_stripe_attr_stripe 2
+#define Anum_columnar_stripe_attr_attr 3
+#define Anum_columnar_stripe_attr_minimum_value 4
+#define Anum_columnar_stripe_attr_maximum_value 5
+
+/* constants for columnar.compression_dictionary */
+#define Natts_columnar_compression_dictionary 4
+#define Anum_columnar_compression_dictionary_storage_id 1
+#define Anum_columnar_compression_dictionary_attr_num 2
+#define Anum_columnar_compression_dictionary_dictionary_id 3
+#define Anum_columnar_compression_dictionary_dictionary 4
+
+/* constants for columnar.delta_store */
+#define Natts_columnar_delta_store 3
+#define Anum_columnar_delta_store_storage_id 1
+#define Anum_columnar_delta_store_row_number 2
+#define Anum_columnar_delta_store_row_data 3
 
 /* constants for columnar.row_mask */
 #define Natts_columnar_row_mask 8
@@ -238,7 +376,11 @@ InitColumnarOptions(Oid regclass)
 		.chunkRowCount = columnar_chunk_group_row_limit,
 		.stripeRowCount = columnar_stripe_row_limit,
 		.compressionType = columnar_compression,
-		.compressionLevel = columnar_compression_level
+		.compressionLevel = columnar_compression_level,
+		.cacheQuota = 0,
+		.deltaStore = false,
+		.stripeSizeLimit = columnar_stripe_size_limit,
+		.autoRowLimits = columnar_auto_row_limits
 	};
 
 	WriteColumnarOptions(regclass, &defaultOptions, false);
@@ -283,6 +425,10 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 		Int32GetDatum(options->stripeRowCount),
 		Int32GetDatum(options->compressionLevel),
 		0, /* to be filled below */
+		Int32GetDatum(options->cacheQuota),
+		BoolGetDatum(options->deltaStore),
+		Int32GetDatum(options->stripeSizeLimit),
+		BoolGetDatum(options->autoRowLimits),
 	};
 
 	NameData compressionName = { 0 };
@@ -294,6 +440,30 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 											 RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(columnarOptions);
 
+	if (options->deltaStore &&
+		tupleDescriptor->natts < Anum_columnar_options_delta_store)
+	{
+		ereport(ERROR, (errmsg("the delta store requires a newer version "
+							   "of the columnar extension"),
+						errhint("Run ALTER EXTENSION columnar UPDATE.")));
+	}
+
+	if (options->stripeSizeLimit != 0 &&
+		tupleDescriptor->natts < Anum_columnar_options_stripe_size_limit)
+	{
+		ereport(ERROR, (errmsg("stripe_size_limit requires a newer version "
+							   "of the columnar extension"),
+						errhint("Run ALTER EXTENSION columnar UPDATE.")));
+	}
+
+	if (options->autoRowLimits &&
+		tupleDescriptor->natts < Anum_columnar_options_auto_row_limits)
+	{
+		ereport(ERROR, (errmsg("auto_row_limits requires a newer version "
+							   "of the columnar extension"),
+						errhint("Run ALTER EXTENSION columnar UPDATE.")));
+	}
+
 	/* find existing item to perform update if exist */
 	ScanKeyData scanKey[1] = { 0 };
 	ScanKeyInit(&scanKey[0], Anum_columnar_options_regclass, BTEqualStrategyNumber,
@@ -316,6 +486,10 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 			update[Anum_columnar_options_stripe_row_limit - 1] = true;
 			update[Anum_columnar_options_compression_level - 1] = true;
 			update[Anum_columnar_options_compression - 1] = true;
+			update[Anum_columnar_options_cache_quota - 1] = true;
+			update[Anum_columnar_options_delta_store - 1] = true;
+			update[Anum_columnar_options_stripe_size_limit - 1] = true;
+			update[Anum_columnar_options_auto_row_limits - 1] = true;
 
 			HeapTuple tuple = heap_modify_tuple(heapTuple, tupleDescriptor,
 												values, nulls, update);
@@ -333,6 +507,7 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 
 	if (written)
 	{
+		WriteColumnarColumnOptions(regclass, options);
 		CommandCounterIncrement();
 	}
 
@@ -344,6 +519,387 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 }
 
 
+/*
+ * WriteColumnarColumnOptions replaces the rows of columnar.column_options for
+ * a given regclass with the per column settings of the given options.
+ */
+static void
+WriteColumnarColumnOptions(Oid regclass, ColumnarOptions *options)
+{
+	Oid columnOptionsOid = ColumnarColumnOptionsRelationId();
+	if (!OidIsValid(columnOptionsOid))
+	{
+		/* extension is not updated to a version with per column options yet */
+		if (!bms_is_empty(options->bloomFilterColumns) ||
+			options->columnCompressionOptions != NIL ||
+			options->sortKeyColumn != InvalidAttrNumber ||
+			!bms_is_empty(options->zorderColumns) ||
+			!bms_is_empty(options->projectionGroupByColumns) ||
+			!bms_is_empty(options->projectionSumColumns) ||
+			!bms_is_empty(options->hllColumns) ||
+			options->shreddedKeys != NIL ||
+			options->bucketColumn != InvalidAttrNumber)
+		{
+			ereport(ERROR, (errmsg("per column options require a newer version "
+								   "of the columnar extension"),
+							errhint("Run ALTER EXTENSION columnar UPDATE.")));
+		}
+
+		return;
+	}
+
+	DeleteColumnarColumnOptions(regclass);
+
+	Relation columnOptions = table_open(columnOptionsOid, RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(columnOptions);
+
+	/* columns with any per column setting get a row */
+	Bitmapset *columns = bms_union(options->bloomFilterColumns,
+								   options->zorderColumns);
+	columns = bms_add_members(columns, options->projectionGroupByColumns);
+	columns = bms_add_members(columns, options->projectionSumColumns);
+	columns = bms_add_members(columns, options->hllColumns);
+	if (options->sortKeyColumn != InvalidAttrNumber)
+	{
+		columns = bms_add_member(columns, options->sortKeyColumn);
+	}
+
+	if (options->bucketColumn != InvalidAttrNumber)
+	{
+		columns = bms_add_member(columns, options->bucketColumn);
+	}
+
+	ColumnCompressionOption *compressionOption = NULL;
+	foreach_ptr(compressionOption, options->columnCompressionOptions)
+	{
+		columns = bms_add_member(columns, compressionOption->attnum);
+	}
+
+	ColumnarShreddedKey *shreddedKey = NULL;
+	foreach_ptr(shreddedKey, options->shreddedKeys)
+	{
+		columns = bms_add_member(columns, shreddedKey->attnum);
+	}
+
+	int attnum = -1;
+	while ((attnum = bms_next_member(columns, attnum)) >= 0)
+	{
+		bool nulls[Natts_columnar_column_options] = { 0 };
+		Datum values[Natts_columnar_column_options] = {
+			ObjectIdGetDatum(regclass),
+			Int16GetDatum(attnum),
+			BoolGetDatum(bms_is_member(attnum, options->bloomFilterColumns)),
+			0,
+			0,
+			BoolGetDatum(attnum == options->sortKeyColumn ||
+						 bms_is_member(attnum, options->zorderColumns)),
+			BoolGetDatum(bms_is_member(attnum, options->projectionGroupByColumns)),
+			BoolGetDatum(bms_is_member(attnum, options->projectionSumColumns)),
+			BoolGetDatum(bms_is_member(attnum, options->hllColumns))
+		};
+
+		NameData compressionName = { 0 };
+		compressionOption =
+			FindColumnCompressionOption(options->columnCompressionOptions, attnum);
+		if (compressionOption != NULL)
+		{
+			namestrcpy(&compressionName,
+					   CompressionTypeStr(compressionOption->compressionType));
+			values[Anum_columnar_column_options_compression - 1] =
+				NameGetDatum(&compressionName);
+		}
+		else
+		{
+			nulls[Anum_columnar_column_options_compression - 1] = true;
+		}
+
+		if (compressionOption != NULL && compressionOption->compressionLevel != 0)
+		{
+			values[Anum_columnar_column_options_compression_level - 1] =
+				Int32GetDatum(compressionOption->compressionLevel);
+		}
+		else
+		{
+			nulls[Anum_columnar_column_options_compression_level - 1] = true;
+		}
+
+		ArrayType *shreddedKeyArray = ShreddedKeyArray(options->shreddedKeys, attnum);
+		if (shreddedKeyArray != NULL)
+		{
+			values[Anum_columnar_column_options_shredded_keys - 1] =
+				PointerGetDatum(shreddedKeyArray);
+		}
+		else
+		{
+			nulls[Anum_columnar_column_options_shredded_keys - 1] = true;
+		}
+
+		if (attnum == options->bucketColumn)
+		{
+			values[Anum_columnar_column_options_bucket_count - 1] =
+				Int32GetDatum(options->bucketCount);
+		}
+		else
+		{
+			nulls[Anum_columnar_column_options_bucket_count - 1] = true;
+		}
+
+		HeapTuple newTuple = heap_form_tuple(tupleDescriptor, values, nulls);
+		CatalogTupleInsert(columnOptions, newTuple);
+	}
+
+	table_close(columnOptions, RowExclusiveLock);
+}
+
+
+/*
+ * DeleteColumnarColumnOptions removes the rows of columnar.column_options for
+ * a given regclass, if the catalog exists.
+ */
+static void
+DeleteColumnarColumnOptions(Oid regclass)
+{
+	Oid columnOptionsOid = ColumnarColumnOptionsRelationId();
+	if (!OidIsValid(columnOptionsOid))
+	{
+		return;
+	}
+
+	Relation columnOptions = try_relation_open(columnOptionsOid, RowExclusiveLock);
+	if (columnOptions == NULL)
+	{
+		/* extension has been dropped */
+		return;
+	}
+
+	ScanKeyData scanKey[1] = { 0 };
+	ScanKeyInit(&scanKey[0], Anum_columnar_column_options_regclass,
+				BTEqualStrategyNumber, F_OIDEQ, ObjectIdGetDatum(regclass));
+
+	Relation index = index_open(ColumnarColumnOptionsIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnOptions, index, NULL,
+															1, scanKey);
+
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		CatalogTupleDelete(columnOptions, &heapTuple->t_self);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	relation_close(columnOptions, RowExclusiveLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * FindColumnCompressionOption returns the compression option of the column
+ * with the given attribute number, or NULL if the column has none.
+ */
+static ColumnCompressionOption *
+FindColumnCompressionOption(List *compressionOptions, AttrNumber attnum)
+{
+	ColumnCompressionOption *compressionOption = NULL;
+	foreach_ptr(compressionOption, compressionOptions)
+	{
+		if (compressionOption->attnum == attnum)
+		{
+			return compressionOption;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ShreddedKeyArray returns the shredded keys of the column with the given
+ * attribute number as a text array, or NULL if the column has none.
+ */
+static ArrayType *
+ShreddedKeyArray(List *shreddedKeys, AttrNumber attnum)
+{
+	Datum *keyDatums = palloc0(Max(list_length(shreddedKeys), 1) * sizeof(Datum));
+	int keyCount = 0;
+
+	ColumnarShreddedKey *shreddedKey = NULL;
+	foreach_ptr(shreddedKey, shreddedKeys)
+	{
+		if (shreddedKey->attnum == attnum)
+		{
+			keyDatums[keyCount++] = CStringGetTextDatum(shreddedKey->key);
+		}
+	}
+
+	if (keyCount == 0)
+	{
+		return NULL;
+	}
+
+	return construct_array(keyDatums, keyCount, TEXTOID, -1, false, 'i');
+}
+
+
+/*
+ * ReadColumnarColumnOptions sets the per column settings of the given options,
+ * i.e. the columns that have bloom filters enabled, the columns that have
+ * their own compression, the sort key or Z-order columns, the columns of
+ * the stripe projection, the columns with chunk sketches, the shredded
+ * keys of jsonb columns and the bucket_by column, from
+ * columnar.column_options.
+ */
+static void
+ReadColumnarColumnOptions(Oid regclass, ColumnarOptions *options)
+{
+	options->bloomFilterColumns = NULL;
+	options->columnCompressionOptions = NIL;
+	options->sortKeyColumn = InvalidAttrNumber;
+	options->zorderColumns = NULL;
+	options->projectionGroupByColumns = NULL;
+	options->projectionSumColumns = NULL;
+	options->hllColumns = NULL;
+	options->shreddedKeys = NIL;
+	options->bucketColumn = InvalidAttrNumber;
+	options->bucketCount = 0;
+
+	Oid columnOptionsOid = ColumnarColumnOptionsRelationId();
+	if (!OidIsValid(columnOptionsOid))
+	{
+		return;
+	}
+
+	Relation columnOptions = try_relation_open(columnOptionsOid, AccessShareLock);
+	if (columnOptions == NULL)
+	{
+		/* extension has been dropped */
+		return;
+	}
+
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_column_options_regclass,
+				BTEqualStrategyNumber, F_OIDEQ, ObjectIdGetDatum(regclass));
+
+	Relation index = index_open(ColumnarColumnOptionsIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnOptions, index, NULL,
+															1, scanKey);
+
+	/* a single sort key column sorts, several are a Z-order */
+	Bitmapset *sortKeyColumns = NULL;
+
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		Datum datumArray[Natts_columnar_column_options];
+		bool isNullArray[Natts_columnar_column_options];
+
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnOptions), datumArray,
+						  isNullArray);
+
+		int16 attnum = DatumGetInt16(datumArray[Anum_columnar_column_options_attnum - 1]);
+
+		if (DatumGetBool(datumArray[Anum_columnar_column_options_bloom_filter - 1]))
+		{
+			options->bloomFilterColumns = bms_add_member(options->bloomFilterColumns,
+														 attnum);
+		}
+
+		if (DatumGetBool(datumArray[Anum_columnar_column_options_sort_key - 1]))
+		{
+			sortKeyColumns = bms_add_member(sortKeyColumns, attnum);
+		}
+
+		if (DatumGetBool(datumArray[Anum_columnar_column_options_projection_group_by - 1]))
+		{
+			options->projectionGroupByColumns =
+				bms_add_member(options->projectionGroupByColumns, attnum);
+		}
+
+		if (DatumGetBool(datumArray[Anum_columnar_column_options_projection_sum - 1]))
+		{
+			options->projectionSumColumns =
+				bms_add_member(options->projectionSumColumns, attnum);
+		}
+
+		if (DatumGetBool(datumArray[Anum_columnar_column_options_hll - 1]))
+		{
+			options->hllColumns = bms_add_member(options->hllColumns, attnum);
+		}
+
+		if (RelationGetDescr(columnOptions)->natts >=
+			Anum_columnar_column_options_shredded_keys &&
+			!isNullArray[Anum_columnar_column_options_shredded_keys - 1])
+		{
+			ArrayType *keyArray = DatumGetArrayTypeP(
+				datumArray[Anum_columnar_column_options_shredded_keys - 1]);
+			Datum *keyDatums = NULL;
+			bool *keyNulls = NULL;
+			int keyCount = 0;
+
+			deconstruct_array(keyArray, TEXTOID, -1, false, 'i',
+							  &keyDatums, &keyNulls, &keyCount);
+
+			for (int keyIndex = 0; keyIndex < keyCount; keyIndex++)
+			{
+				ColumnarShreddedKey *shreddedKey = palloc0(sizeof(ColumnarShreddedKey));
+				shreddedKey->attnum = attnum;
+				shreddedKey->key = TextDatumGetCString(keyDatums[keyIndex]);
+
+				options->shreddedKeys = lappend(options->shreddedKeys, shreddedKey);
+			}
+		}
+
+		if (RelationGetDescr(columnOptions)->natts >=
+			Anum_columnar_column_options_bucket_count &&
+			!isNullArray[Anum_columnar_column_options_bucket_count - 1])
+		{
+			options->bucketColumn = attnum;
+			options->bucketCount = DatumGetInt32(
+				datumArray[Anum_columnar_column_options_bucket_count - 1]);
+		}
+
+		if (!isNullArray[Anum_columnar_column_options_compression - 1])
+		{
+			Name compressionName =
+				DatumGetName(datumArray[Anum_columnar_column_options_compression - 1]);
+
+			ColumnCompressionOption *compressionOption =
+				palloc0(sizeof(ColumnCompressionOption));
+			compressionOption->attnum = attnum;
+			compressionOption->compressionType =
+				ParseCompressionType(NameStr(*compressionName));
+
+			if (!isNullArray[Anum_columnar_column_options_compression_level - 1])
+			{
+				compressionOption->compressionLevel = DatumGetInt32(
+					datumArray[Anum_columnar_column_options_compression_level - 1]);
+			}
+
+			options->columnCompressionOptions =
+				lappend(options->columnCompressionOptions, compressionOption);
+		}
+	}
+
+	if (bms_num_members(sortKeyColumns) > 1)
+	{
+		options->zorderColumns = sortKeyColumns;
+	}
+	else if (!bms_is_empty(sortKeyColumns))
+	{
+		options->sortKeyColumn = bms_next_member(sortKeyColumns, -1);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	relation_close(columnOptions, AccessShareLock);
+}
+
+
 /*
  * DeleteColumnarTableOptions removes the columnar table options for a regclass. When
  * missingOk is false it will throw an error when no table options can be found.
@@ -385,6 +941,8 @@ DeleteColumnarTableOptions(Oid regclass, bool missingOk)
 		CatalogTupleDelete(columnarOptions, &heapTuple->t_self);
 		CommandCounterIncrement();
 
+		DeleteColumnarColumnOptions(regclass);
+
 		result = true;
 	}
 	else if (!missingOk)
@@ -441,6 +999,43 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 		options->stripeRowCount = tupOptions->stripe_row_limit;
 		options->compressionLevel = tupOptions->compressionLevel;
 		options->compressionType = ParseCompressionType(NameStr(tupOptions->compression));
+
+		bool isNull = false;
+		Datum cacheQuota = heap_getattr(heapTuple, Anum_columnar_options_cache_quota,
+										RelationGetDescr(columnarOptions), &isNull);
+		options->cacheQuota = isNull ? 0 : DatumGetInt32(cacheQuota);
+
+		options->deltaStore = false;
+		if (RelationGetDescr(columnarOptions)->natts >= Anum_columnar_options_delta_store)
+		{
+			Datum deltaStore = heap_getattr(heapTuple, Anum_columnar_options_delta_store,
+											RelationGetDescr(columnarOptions), &isNull);
+			options->deltaStore = !isNull && DatumGetBool(deltaStore);
+		}
+
+		options->stripeSizeLimit = 0;
+		if (RelationGetDescr(columnarOptions)->natts >=
+			Anum_columnar_options_stripe_size_limit)
+		{
+			Datum stripeSizeLimit = heap_getattr(heapTuple,
+												 Anum_columnar_options_stripe_size_limit,
+												 RelationGetDescr(columnarOptions),
+												 &isNull);
+			options->stripeSizeLimit = isNull ? 0 : DatumGetInt32(stripeSizeLimit);
+		}
+
+		options->autoRowLimits = false;
+		if (RelationGetDescr(columnarOptions)->natts >=
+			Anum_columnar_options_auto_row_limits)
+		{
+			Datum autoRowLimits = heap_getattr(heapTuple,
+											   Anum_columnar_options_auto_row_limits,
+											   RelationGetDescr(columnarOptions),
+											   &isNull);
+			options->autoRowLimits = !isNull && DatumGetBool(autoRowLimits);
+		}
+
+		ReadColumnarColumnOptions(regclass, options);
 	}
 	else
 	{
@@ -449,6 +1044,20 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 		options->stripeRowCount = columnar_stripe_row_limit;
 		options->chunkRowCount = columnar_chunk_group_row_limit;
 		options->compressionLevel = columnar_compression_level;
+		options->cacheQuota = 0;
+		options->bloomFilterColumns = NULL;
+		options->columnCompressionOptions = NIL;
+		options->sortKeyColumn = InvalidAttrNumber;
+		options->zorderColumns = NULL;
+		options->projectionGroupByColumns = NULL;
+		options->projectionSumColumns = NULL;
+		options->hllColumns = NULL;
+		options->shreddedKeys = NIL;
+		options->bucketColumn = InvalidAttrNumber;
+		options->bucketCount = 0;
+		options->deltaStore = false;
+		options->stripeSizeLimit = columnar_stripe_size_limit;
+		options->autoRowLimits = columnar_auto_row_limits;
 	}
 
 	systable_endscan_ordered(scanDescriptor);
@@ -461,7 +1070,8 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 
 /*
  * SaveStripeSkipList saves chunkList for a given stripe as rows
- * of columnar.chunk.
+ * of columnar.chunk, or as a single row of columnar.stripe_skip_list if
+ * columnar.compact_chunk_metadata is on.
  */
 void
 SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe, StripeSkipList *chunkList,
@@ -472,6 +1082,20 @@ SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe, StripeSkipList *chunk
 	uint32 columnCount = chunkList->columnCount;
 
 	uint64 storageId = LookupStorageId(relfilenode);
+
+	if (columnar_compact_chunk_metadata)
+	{
+		if (!OidIsValid(ColumnarStripeSkipListRelationId()))
+		{
+			ereport(ERROR, (errmsg("compact chunk metadata requires a newer "
+								   "version of the columnar extension"),
+							errhint("Run ALTER EXTENSION columnar UPDATE.")));
+		}
+
+		SaveCompactStripeSkipList(storageId, stripe, chunkList, tupleDescriptor);
+		return;
+	}
+
 	Oid columnarChunkOid = ColumnarChunkRelationId();
 	Relation columnarChunk = table_open(columnarChunkOid, RowExclusiveLock);
 	ModifyState *modifyState = StartModifyRelation(columnarChunk);
@@ -497,10 +1121,27 @@ SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe, StripeSkipList *chunk
 				Int32GetDatum(chunk->valueCompressionType),
 				Int32GetDatum(chunk->valueCompressionLevel),
 				Int64GetDatum(chunk->decompressedValueSize),
-				Int64GetDatum(chunk->rowCount)
+				Int64GetDatum(chunk->rowCount),
+				PointerGetDatum(chunk->bloomFilter),
+				Int32GetDatum(chunk->valueEncodingType),
+				Int32GetDatum(chunk->nullState),
+				Int64GetDatum(chunk->compressionDictionaryId),
+				Int64GetDatum(chunk->nullCount),
+				Int64GetDatum(chunk->distinctCount),
+				BoolGetDatum(chunk->valuesSorted),
+				PointerGetDatum(chunk->hllSketch),
+				Int64GetDatum(chunk->largeValueCount),
+				PointerGetDatum(chunk->shreddedKeyStats)
 			};
 
 			bool nulls[Natts_columnar_chunk] = { false };
+			nulls[Anum_columnar_chunk_bloom_filter - 1] = (chunk->bloomFilter == NULL);
+			nulls[Anum_columnar_chunk_null_count - 1] = !chunk->hasStatistics;
+			nulls[Anum_columnar_chunk_distinct_count - 1] = !chunk->hasStatistics;
+			nulls[Anum_columnar_chunk_values_sorted - 1] = !chunk->sortednessKnown;
+			nulls[Anum_columnar_chunk_hll_sketch - 1] = (chunk->hllSketch == NULL);
+			nulls[Anum_columnar_chunk_shredded_key_stats - 1] =
+				(chunk->shreddedKeyStats == NULL);
 
 			if (chunk->hasMinMax)
 			{
@@ -564,43 +1205,211 @@ SaveChunkGroups(RelFileNode relfilenode, uint64 stripe,
 
 
 /*
- * SaveEmptyRowMask saves the metadata for inserted rows in columnar.mask_row
+ * SaveStripeColumnSummaries saves the stripe level min/max values of each
+ * column as rows of columnar.stripe_attr. Columns without min/max values
+ * don't get a row.
  */
-extern bool 
-SaveEmptyRowMask(uint64 storageId, uint64 stripeId,
-				 uint64 stripeStartRowNumber, List *chunkGroupRowCounts)
+void
+SaveStripeColumnSummaries(RelFileNode relfilenode, uint64 stripe,
+						  ColumnStripeSummary *columnSummaries,
+						  TupleDesc tupleDescriptor)
 {
-	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
-	Oid columnarRowMaskSeq = ColumnarRowMaskSeqId();
-	Relation columnarRowMask = table_open(columnarRowMaskOid, RowExclusiveLock);
-	ModifyState *modifyState = StartModifyRelation(columnarRowMask);
-
-	uint64 chunkIterationStartRowNumber = stripeStartRowNumber;
-	uint64 chunkIterationEndRowNumber = stripeStartRowNumber -  1;
-
-	ListCell *lc = NULL;
-	int chunkId = 0;
+	Oid columnarStripeAttrOid = ColumnarStripeAttrRelationId();
 
-	bool chunkInserted = true;
-
-	foreach(lc, chunkGroupRowCounts)
+	/* columnar.stripe_attr doesn't exist before the extension is updated */
+	if (!OidIsValid(columnarStripeAttrOid))
 	{
-		if (!chunkInserted)
-			break;
+		return;
+	}
 
-		int64 rowCount = lfirst_int(lc);
+	uint64 storageId = LookupStorageId(relfilenode);
+	Relation columnarStripeAttr = table_open(columnarStripeAttrOid, RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(columnarStripeAttr);
 
-		uint16 rowMaskIterations = 
-			(rowCount % COLUMNAR_ROW_MASK_CHUNK_SIZE) ? 
-				(rowCount / COLUMNAR_ROW_MASK_CHUNK_SIZE + 1) :
-				(rowCount / COLUMNAR_ROW_MASK_CHUNK_SIZE);
+	for (uint32 columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		ColumnStripeSummary *columnSummary = &columnSummaries[columnIndex];
 
-		for(uint16 n = 0; n < rowMaskIterations; n++)
+		if (!columnSummary->hasMinMax)
 		{
-			uint16 maskSize;
+			continue;
+		}
 
-			/* Last iteration */
-			if (n == (rowMaskIterations - 1))
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		Datum values[Natts_columnar_stripe_attr] = {
+			UInt64GetDatum(storageId),
+			Int64GetDatum(stripe),
+			Int32GetDatum(columnIndex + 1),
+			PointerGetDatum(DatumToBytea(columnSummary->minimumValue, attributeForm)),
+			PointerGetDatum(DatumToBytea(columnSummary->maximumValue, attributeForm))
+		};
+
+		bool nulls[Natts_columnar_stripe_attr] = { false };
+
+		InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	}
+
+	FinishModifyRelation(modifyState);
+	table_close(columnarStripeAttr, RowExclusiveLock);
+}
+
+
+/*
+ * SaveStripeProjection saves the per group counts and sums of a stripe, as
+ * built by columnar_projection.c, as its row of columnar.stripe_projection.
+ */
+void
+SaveStripeProjection(RelFileNode relfilenode, uint64 stripe, bytea *projection)
+{
+	Oid stripeProjectionOid = ColumnarStripeProjectionRelationId();
+
+	/* columnar.stripe_projection doesn't exist before the extension is updated */
+	if (!OidIsValid(stripeProjectionOid))
+	{
+		return;
+	}
+
+	Datum values[Natts_columnar_stripe_projection] = {
+		UInt64GetDatum(LookupStorageId(relfilenode)),
+		Int64GetDatum(stripe),
+		PointerGetDatum(projection)
+	};
+	bool nulls[Natts_columnar_stripe_projection] = { false };
+
+	Relation stripeProjection = table_open(stripeProjectionOid, RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(stripeProjection);
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	FinishModifyRelation(modifyState);
+	table_close(stripeProjection, RowExclusiveLock);
+}
+
+
+/*
+ * ReadStripeProjection returns a copy of the projection of the given stripe
+ * from columnar.stripe_projection, allocated in the current memory context,
+ * or NULL if the stripe has none.
+ */
+bytea *
+ReadStripeProjection(RelFileNode relfilenode, uint64 stripe, Snapshot snapshot)
+{
+	Oid stripeProjectionOid = ColumnarStripeProjectionRelationId();
+	if (!OidIsValid(stripeProjectionOid))
+	{
+		return NULL;
+	}
+
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_projection_storageid,
+				BTEqualStrategyNumber, F_INT8EQ,
+				UInt64GetDatum(LookupStorageId(relfilenode)));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_projection_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(stripe));
+
+	Relation stripeProjection = table_open(stripeProjectionOid, AccessShareLock);
+	Relation index = index_open(ColumnarStripeProjectionIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(stripeProjection, index,
+															snapshot, 2, scanKey);
+
+	bytea *projection = NULL;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		bool isNull = false;
+		Datum projectionDatum = heap_getattr(heapTuple,
+											 Anum_columnar_stripe_projection_projection,
+											 RelationGetDescr(stripeProjection),
+											 &isNull);
+		projection = DatumGetByteaPCopy(projectionDatum);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(stripeProjection, AccessShareLock);
+
+	return projection;
+}
+
+
+/*
+ * StripeHasDeletedRows returns whether any row of the given stripe is
+ * deleted as of the given snapshot.
+ */
+bool
+StripeHasDeletedRows(RelFileNode relfilenode, StripeMetadata *stripeMetadata,
+					 Snapshot snapshot)
+{
+	return StripeDeletedRowCount(relfilenode, stripeMetadata, snapshot) != 0;
+}
+
+
+/*
+ * StripeDeletedRowCount returns the number of rows of the given stripe that
+ * are deleted as of the given snapshot.
+ */
+uint64
+StripeDeletedRowCount(RelFileNode relfilenode, StripeMetadata *stripeMetadata,
+					  Snapshot snapshot)
+{
+	uint32 *chunkGroupRowCounts = NULL;
+	uint32 *chunkGroupDeletedRows = NULL;
+
+	ReadChunkGroupRowCountsCached(LookupStorageId(relfilenode), stripeMetadata->id,
+								  stripeMetadata->chunkCount, &chunkGroupRowCounts,
+								  &chunkGroupDeletedRows, snapshot);
+
+	uint64 deletedRowCount = 0;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount; chunkIndex++)
+	{
+		deletedRowCount += chunkGroupDeletedRows[chunkIndex];
+	}
+
+	pfree(chunkGroupRowCounts);
+	pfree(chunkGroupDeletedRows);
+
+	return deletedRowCount;
+}
+
+
+/*
+ * SaveEmptyRowMask saves the metadata for inserted rows in columnar.mask_row
+ */
+extern bool 
+SaveEmptyRowMask(uint64 storageId, uint64 stripeId,
+				 uint64 stripeStartRowNumber, List *chunkGroupRowCounts)
+{
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	Oid columnarRowMaskSeq = ColumnarRowMaskSeqId();
+	Relation columnarRowMask = table_open(columnarRowMaskOid, RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(columnarRowMask);
+
+	uint64 chunkIterationStartRowNumber = stripeStartRowNumber;
+	uint64 chunkIterationEndRowNumber = stripeStartRowNumber -  1;
+
+	ListCell *lc = NULL;
+	int chunkId = 0;
+
+	bool chunkInserted = true;
+
+	foreach(lc, chunkGroupRowCounts)
+	{
+		if (!chunkInserted)
+			break;
+
+		int64 rowCount = lfirst_int(lc);
+
+		uint16 rowMaskIterations = 
+			(rowCount % COLUMNAR_ROW_MASK_CHUNK_SIZE) ? 
+				(rowCount / COLUMNAR_ROW_MASK_CHUNK_SIZE + 1) :
+				(rowCount / COLUMNAR_ROW_MASK_CHUNK_SIZE);
+
+		for(uint16 n = 0; n < rowMaskIterations; n++)
+		{
+			uint16 maskSize;
+
+			/* Last iteration */
+			if (n == (rowMaskIterations - 1))
 			{
 				uint16 lastIterationRowSize = rowCount % COLUMNAR_ROW_MASK_CHUNK_SIZE ? 
 						rowCount % COLUMNAR_ROW_MASK_CHUNK_SIZE : COLUMNAR_ROW_MASK_CHUNK_SIZE;
@@ -670,117 +1479,76 @@ SaveEmptyRowMask(uint64 storageId, uint64 stripeId,
 
 
 /*
- * ReadStripeSkipList fetches chunk metadata for a given stripe.
+ * ReadStripeSkipList fetches chunk metadata for a given stripe, from
+ * columnar.stripe_skip_list if it was written compactly and from
+ * columnar.chunk otherwise.
  */
 StripeSkipList *
 ReadStripeSkipList(RelFileNode relfilenode, uint64 stripe, TupleDesc tupleDescriptor,
 				   uint32 chunkCount, Snapshot snapshot)
 {
-	int32 columnIndex = 0;
+	return ReadStripeSkipListColumns(relfilenode, stripe, tupleDescriptor, chunkCount,
+									 snapshot, NULL);
+}
+
+
+/*
+ * ReadStripeSkipListColumns is ReadStripeSkipList for the columns set in
+ * columnMask, so that scans of wide tables only read and keep the chunk
+ * metadata of the columns they project or filter on. The skip nodes of the
+ * other columns are NULL in the returned skip list. A NULL columnMask reads
+ * all columns.
+ */
+StripeSkipList *
+ReadStripeSkipListColumns(RelFileNode relfilenode, uint64 stripe,
+						  TupleDesc tupleDescriptor, uint32 chunkCount,
+						  Snapshot snapshot, const bool *columnMask)
+{
 	int32 chunkGroupIndex = 0;
 	int32 chunkGroupRowOffsetAcc = 0;
-	HeapTuple heapTuple = NULL;
-	uint32 columnCount = tupleDescriptor->natts;
-	ScanKeyData scanKey[2];
+
+	COLUMNAR_TRACE_SKIP_LIST_READ_START(relfilenode.relNode, stripe);
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_SKIP_LIST_READ);
 
 	uint64 storageId = LookupStorageId(relfilenode);
 
-	Oid columnarChunkOid = ColumnarChunkRelationId();
-	Relation columnarChunk = table_open(columnarChunkOid, AccessShareLock);
-	Relation index = index_open(ColumnarChunkIndexRelationId(), AccessShareLock);
+	/*
+	 * Chunk metadata of a stripe doesn't change after it is written, so we
+	 * can use the cached copy if we have one. Deleted rows are always read
+	 * from columnar.chunk_group though.
+	 */
+	StripeSkipList *cachedChunkList =
+		ColumnarSkipListCacheLookup(storageId, stripe, tupleDescriptor, chunkCount,
+									columnMask);
+	if (cachedChunkList != NULL)
+	{
+		uint32 *chunkGroupRowCounts = NULL;
 
-	ScanKeyInit(&scanKey[0], Anum_columnar_chunk_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
-	ScanKeyInit(&scanKey[1], Anum_columnar_chunk_stripe,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripe));
+		ReadChunkGroupRowCountsCached(storageId, stripe, chunkCount,
+									  &chunkGroupRowCounts,
+									  &cachedChunkList->chunkGroupDeletedRows,
+									  snapshot);
+		pfree(chunkGroupRowCounts);
 
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarChunk, index,
-															snapshot, 2, scanKey);
+		pgstat_report_wait_end();
+		COLUMNAR_TRACE_SKIP_LIST_READ_DONE(relfilenode.relNode, stripe);
 
-	StripeSkipList *chunkList = palloc0(sizeof(StripeSkipList));
-	chunkList->chunkCount = chunkCount;
-	chunkList->columnCount = columnCount;
-	chunkList->chunkSkipNodeArray = palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-	{
-		chunkList->chunkSkipNodeArray[columnIndex] =
-			palloc0(chunkCount * sizeof(ColumnChunkSkipNode));
+		return cachedChunkList;
 	}
 
-	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
-																 ForwardScanDirection)))
+	StripeSkipList *chunkList = ReadCompactStripeSkipList(storageId, stripe,
+														  tupleDescriptor, chunkCount,
+														  snapshot, columnMask);
+	if (chunkList == NULL)
 	{
-		Datum datumArray[Natts_columnar_chunk];
-		bool isNullArray[Natts_columnar_chunk];
-
-		heap_deform_tuple(heapTuple, RelationGetDescr(columnarChunk), datumArray,
-						  isNullArray);
-
-		int32 attr = DatumGetInt32(datumArray[Anum_columnar_chunk_attr - 1]);
-		int32 chunkIndex = DatumGetInt32(datumArray[Anum_columnar_chunk_chunk - 1]);
-
-		if (attr <= 0 || attr > columnCount)
-		{
-			ereport(ERROR, (errmsg("invalid columnar chunk entry"),
-							errdetail("Attribute number out of range: %d", attr)));
-		}
-
-		if (chunkIndex < 0 || chunkIndex >= chunkCount)
-		{
-			ereport(ERROR, (errmsg("invalid columnar chunk entry"),
-							errdetail("Chunk number out of range: %d", chunkIndex)));
-		}
-
-		columnIndex = attr - 1;
-
-		ColumnChunkSkipNode *chunk =
-			&chunkList->chunkSkipNodeArray[columnIndex][chunkIndex];
-		chunk->rowCount = DatumGetInt64(datumArray[Anum_columnar_chunk_value_count -
-												   1]);
-		chunk->valueChunkOffset =
-			DatumGetInt64(datumArray[Anum_columnar_chunk_value_stream_offset - 1]);
-		chunk->valueLength =
-			DatumGetInt64(datumArray[Anum_columnar_chunk_value_stream_length - 1]);
-		chunk->existsChunkOffset =
-			DatumGetInt64(datumArray[Anum_columnar_chunk_exists_stream_offset - 1]);
-		chunk->existsLength =
-			DatumGetInt64(datumArray[Anum_columnar_chunk_exists_stream_length - 1]);
-		chunk->valueCompressionType =
-			DatumGetInt32(datumArray[Anum_columnar_chunk_value_compression_type - 1]);
-		chunk->valueCompressionLevel =
-			DatumGetInt32(datumArray[Anum_columnar_chunk_value_compression_level - 1]);
-		chunk->decompressedValueSize =
-			DatumGetInt64(datumArray[Anum_columnar_chunk_value_decompressed_size - 1]);
-
-		if (isNullArray[Anum_columnar_chunk_minimum_value - 1] ||
-			isNullArray[Anum_columnar_chunk_maximum_value - 1])
-		{
-			chunk->hasMinMax = false;
-		}
-		else
-		{
-			bytea *minValue = DatumGetByteaP(
-				datumArray[Anum_columnar_chunk_minimum_value - 1]);
-			bytea *maxValue = DatumGetByteaP(
-				datumArray[Anum_columnar_chunk_maximum_value - 1]);
-
-			chunk->minimumValue =
-				ByteaToDatum(minValue, &tupleDescriptor->attrs[columnIndex]);
-			chunk->maximumValue =
-				ByteaToDatum(maxValue, &tupleDescriptor->attrs[columnIndex]);
-
-			chunk->hasMinMax = true;
-		}
+		chunkList = ReadStripeChunkRows(storageId, stripe, tupleDescriptor, chunkCount,
+										snapshot, columnMask);
 	}
 
-	systable_endscan_ordered(scanDescriptor);
-	index_close(index, AccessShareLock);
-	table_close(columnarChunk, AccessShareLock);
-
-	ReadChunkGroupRowCounts(storageId, stripe, chunkCount,
-							&chunkList->chunkGroupRowCounts,
-							&chunkList->chunkGroupDeletedRows,
-							snapshot);
+	ReadChunkGroupRowCountsCached(storageId, stripe, chunkCount,
+								  &chunkList->chunkGroupRowCounts,
+								  &chunkList->chunkGroupDeletedRows,
+								  snapshot);
 
 	chunkList->chunkGroupRowOffset = palloc0(chunkCount * sizeof(uint32));
 
@@ -790,1518 +1558,3560 @@ ReadStripeSkipList(RelFileNode relfilenode, uint64 stripe, TupleDesc tupleDescri
 		chunkGroupRowOffsetAcc += chunkList->chunkGroupRowCounts[chunkGroupIndex];
 	}
 
+	/*
+	 * Only cache what an MVCC snapshot saw; other snapshots might see the
+	 * chunk metadata of a stripe that is still being written.
+	 */
+	if (snapshot != InvalidSnapshot && IsMVCCSnapshot(snapshot))
+	{
+		ColumnarSkipListCacheInsert(storageId, stripe, chunkList, tupleDescriptor);
+	}
+
+	pgstat_report_wait_end();
+	COLUMNAR_TRACE_SKIP_LIST_READ_DONE(relfilenode.relNode, stripe);
+
 	return chunkList;
 }
 
 
 /*
- * ReadChunkRowMask fetches chunk row mask for columnar relation.
+ * ReadStripeChunkRows builds the skip list of a stripe from its rows of
+ * columnar.chunk. Chunk group row counts and offsets are left to the caller.
+ * With a column mask, only the rows of its columns are scanned, one index
+ * range for each column.
  */
-bytea *
-ReadChunkRowMask(RelFileNode relfilenode, Snapshot snapshot,
-				 MemoryContext cxt,
-				 uint64 stripeFirstRowNumber, int rowCount)
+static StripeSkipList *
+ReadStripeChunkRows(uint64 storageId, uint64 stripe, TupleDesc tupleDescriptor,
+					uint32 chunkCount, Snapshot snapshot, const bool *columnMask)
 {
+	int32 columnIndex = 0;
 	HeapTuple heapTuple = NULL;
+	uint32 columnCount = tupleDescriptor->natts;
 	ScanKeyData scanKey[3];
 
-	uint64 storageId = LookupStorageId(relfilenode);
-
-	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
-	Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
-	Relation index = index_open(ColumnarRowMaskIndexRelationId(), AccessShareLock);
+	Oid columnarChunkOid = ColumnarChunkRelationId();
+	Relation columnarChunk = table_open(columnarChunkOid, AccessShareLock);
+	Relation index = index_open(ColumnarChunkIndexRelationId(), AccessShareLock);
 
-	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
+	/* columns from bloom_filter on were added later */
+	bool hasBloomFilterColumn =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_bloom_filter;
+	bool hasValueEncodingColumn =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_value_encoding_type;
+	bool hasNullStateColumn =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_null_state;
+	bool hasCompressionDictionaryColumn =
+		RelationGetDescr(columnarChunk)->natts >=
+		Anum_columnar_chunk_compression_dictionary_id;
+	bool hasStatisticsColumns =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_values_sorted;
+	bool hasHllSketchColumn =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_hll_sketch;
+	bool hasLargeValueCountColumn =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_large_value_count;
+	bool hasShreddedKeyStatsColumn =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_shredded_key_stats;
 
-	uint16 chunkMaskSize = 
-		(rowCount % COLUMNAR_ROW_MASK_CHUNK_SIZE) ?
-			(rowCount / 8 + 1) :
-			(rowCount / 8);
+	ScanKeyInit(&scanKey[0], Anum_columnar_chunk_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_chunk_stripe,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripe));
 
-	bytea *chunkRowMaskBytea = (bytea *) palloc0(chunkMaskSize + VARHDRSZ);
-	SET_VARSIZE(chunkRowMaskBytea, chunkMaskSize + VARHDRSZ);
+	StripeSkipList *chunkList = CreateEmptyStripeSkipList(columnCount, chunkCount,
+														  columnMask);
 
-	ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storage_id,
-				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
-	ScanKeyInit(&scanKey[1], Anum_columnar_row_mask_start_row_number,
-				BTGreaterEqualStrategyNumber, F_INT8GE, UInt64GetDatum(stripeFirstRowNumber));
-	ScanKeyInit(&scanKey[2], Anum_columnar_row_mask_end_row_number,
-				BTLessEqualStrategyNumber, F_INT8LE, UInt64GetDatum(stripeFirstRowNumber + rowCount - 1));
+	uint32 scanCount = columnMask != NULL ? columnCount : 1;
+	for (uint32 scanIndex = 0; scanIndex < scanCount; scanIndex++)
+	{
+		int scanKeyCount = 2;
 
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarRowMask,
-															index,
-															SnapshotSelf, 3, scanKey);
+		if (columnMask != NULL)
+		{
+			if (!columnMask[scanIndex])
+			{
+				continue;
+			}
 
-	int pos = 0;
-	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
-																 ForwardScanDirection)))
-	{
-		Datum datumArray[Natts_columnar_row_mask];
-		bool isNullArray[Natts_columnar_row_mask];
+			ScanKeyInit(&scanKey[2], Anum_columnar_chunk_attr,
+						BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(scanIndex + 1));
+			scanKeyCount = 3;
+		}
 
-		heap_deform_tuple(heapTuple, RelationGetDescr(columnarRowMask), datumArray, isNullArray);
-		bytea * currentRowMask = DatumGetByteaP(datumArray[Anum_columnar_row_mask_mask - 1]);
+		SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarChunk, index,
+																snapshot, scanKeyCount,
+																scanKey);
 
-		memcpy(VARDATA(chunkRowMaskBytea) + pos,
-			   VARDATA(currentRowMask),
-			   VARSIZE_ANY_EXHDR(currentRowMask));
+		while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																	 ForwardScanDirection)))
+		{
+			Datum datumArray[Natts_columnar_chunk];
+			bool isNullArray[Natts_columnar_chunk];
 
-		pos += VARSIZE_ANY_EXHDR(currentRowMask);
-	}
+			heap_deform_tuple(heapTuple, RelationGetDescr(columnarChunk), datumArray,
+							  isNullArray);
 
-	MemoryContextSwitchTo(oldContext);
+			int32 attr = DatumGetInt32(datumArray[Anum_columnar_chunk_attr - 1]);
+			int32 chunkIndex = DatumGetInt32(datumArray[Anum_columnar_chunk_chunk - 1]);
 
-	systable_endscan_ordered(scanDescriptor);
-	index_close(index, AccessShareLock);
-	table_close(columnarRowMask, AccessShareLock);
+			if (attr <= 0 || attr > columnCount)
+			{
+				ereport(ERROR, (errmsg("invalid columnar chunk entry"),
+								errdetail("Attribute number out of range: %d", attr)));
+			}
 
-	return chunkRowMaskBytea;
-}
+			if (chunkIndex < 0 || chunkIndex >= chunkCount)
+			{
+				ereport(ERROR, (errmsg("invalid columnar chunk entry"),
+								errdetail("Chunk number out of range: %d", chunkIndex)));
+			}
 
+			columnIndex = attr - 1;
 
-bool
-UpdateRowMask(RelFileNode relfilenode, uint64 storageId,
-			  Snapshot snapshot, uint64 rowNumber)
-{
-	bytea *rowMask = NULL;
+			ColumnChunkSkipNode *chunk =
+				&chunkList->chunkSkipNodeArray[columnIndex][chunkIndex];
+			chunk->rowCount = DatumGetInt64(datumArray[Anum_columnar_chunk_value_count -
+													   1]);
+			chunk->valueChunkOffset =
+				DatumGetInt64(datumArray[Anum_columnar_chunk_value_stream_offset - 1]);
+			chunk->valueLength =
+				DatumGetInt64(datumArray[Anum_columnar_chunk_value_stream_length - 1]);
+			chunk->existsChunkOffset =
+				DatumGetInt64(datumArray[Anum_columnar_chunk_exists_stream_offset - 1]);
+			chunk->existsLength =
+				DatumGetInt64(datumArray[Anum_columnar_chunk_exists_stream_length - 1]);
+			chunk->valueCompressionType =
+				DatumGetInt32(datumArray[Anum_columnar_chunk_value_compression_type - 1]);
+			chunk->valueCompressionLevel =
+				DatumGetInt32(datumArray[Anum_columnar_chunk_value_compression_level - 1]);
+			chunk->decompressedValueSize =
+				DatumGetInt64(datumArray[Anum_columnar_chunk_value_decompressed_size - 1]);
+
+			if (isNullArray[Anum_columnar_chunk_minimum_value - 1] ||
+				isNullArray[Anum_columnar_chunk_maximum_value - 1])
+			{
+				chunk->hasMinMax = false;
+			}
+			else
+			{
+				bytea *minValue = DatumGetByteaP(
+					datumArray[Anum_columnar_chunk_minimum_value - 1]);
+				bytea *maxValue = DatumGetByteaP(
+					datumArray[Anum_columnar_chunk_maximum_value - 1]);
 
-	RowMaskWriteStateEntry *rowMaskEntry = 
-		RowMaskFindWriteState(relfilenode.relNode, GetCurrentSubTransactionId(), rowNumber);
+				chunk->minimumValue =
+					ByteaToDatum(minValue, &tupleDescriptor->attrs[columnIndex]);
+				chunk->maximumValue =
+					ByteaToDatum(maxValue, &tupleDescriptor->attrs[columnIndex]);
 
-	if (rowMaskEntry == NULL)
-	{
-		HeapTuple rowMaskHeapTuple;
-		ScanKeyData scanKey[3];
+				chunk->hasMinMax = true;
+			}
 
-		Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
-		Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
-		TupleDesc tupleDescriptor = RelationGetDescr(columnarRowMask);
+			if (hasBloomFilterColumn && !isNullArray[Anum_columnar_chunk_bloom_filter - 1])
+			{
+				chunk->bloomFilter =
+					DatumGetByteaPCopy(datumArray[Anum_columnar_chunk_bloom_filter - 1]);
+			}
 
-		Relation index = index_open(ColumnarRowMaskIndexRelationId(), AccessShareLock);
+			if (hasValueEncodingColumn)
+			{
+				chunk->valueEncodingType =
+					DatumGetInt32(datumArray[Anum_columnar_chunk_value_encoding_type - 1]);
+			}
 
-		ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storage_id,
-					BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
-		ScanKeyInit(&scanKey[1], Anum_columnar_row_mask_start_row_number,
-					BTLessEqualStrategyNumber, F_INT8LE, UInt64GetDatum(rowNumber));
-		ScanKeyInit(&scanKey[2], Anum_columnar_row_mask_end_row_number,
-					BTGreaterEqualStrategyNumber, F_INT8GE, UInt64GetDatum(rowNumber));
-
-		SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarRowMask,
-																index,
-																NULL, 3, scanKey);
-
-		rowMaskHeapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
-
-		if (HeapTupleIsValid(rowMaskHeapTuple))
-		{
-			bool isnull;
+			if (hasNullStateColumn)
+			{
+				chunk->nullState =
+					DatumGetInt32(datumArray[Anum_columnar_chunk_null_state - 1]);
+			}
 
-			Pointer mask = DatumGetPointer(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_mask,
-								tupleDescriptor, &isnull));
-		
-			rowMaskEntry = RowMaskInitWriteState(relfilenode.relNode,
-												 storageId,
-												 GetCurrentSubTransactionId(),
-												 DatumGetByteaP(mask));
-			/* 
-			 * Populate row mask cache with values from heap table
-			 */
-			rowMaskEntry->id = DatumGetUInt64(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_id,
-								tupleDescriptor, &isnull));
+			if (hasCompressionDictionaryColumn)
+			{
+				chunk->compressionDictionaryId = DatumGetInt64(
+					datumArray[Anum_columnar_chunk_compression_dictionary_id - 1]);
+			}
 
-			rowMaskEntry->storageId = DatumGetUInt64(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_storage_id,
-								tupleDescriptor, &isnull));
-			
-			rowMaskEntry->stripeId = DatumGetUInt64(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_stripe_id,
-								tupleDescriptor, &isnull));
-			
-			rowMaskEntry->chunkId = DatumGetInt32(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_chunk_id,
-								tupleDescriptor, &isnull));
+			if (hasStatisticsColumns &&
+				!isNullArray[Anum_columnar_chunk_null_count - 1] &&
+				!isNullArray[Anum_columnar_chunk_distinct_count - 1])
+			{
+				chunk->nullCount =
+					DatumGetInt64(datumArray[Anum_columnar_chunk_null_count - 1]);
+				chunk->distinctCount =
+					DatumGetInt64(datumArray[Anum_columnar_chunk_distinct_count - 1]);
+				chunk->hasStatistics = true;
+			}
 
-			rowMaskEntry->startRowNumber = DatumGetInt64(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_start_row_number,
-								tupleDescriptor, &isnull));
+			if (hasStatisticsColumns && !isNullArray[Anum_columnar_chunk_values_sorted - 1])
+			{
+				chunk->valuesSorted =
+					DatumGetBool(datumArray[Anum_columnar_chunk_values_sorted - 1]);
+				chunk->sortednessKnown = true;
+			}
 
-			rowMaskEntry->deletedRows = DatumGetInt32(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_deleted_rows,
-								tupleDescriptor, &isnull));
+			if (hasHllSketchColumn && !isNullArray[Anum_columnar_chunk_hll_sketch - 1])
+			{
+				chunk->hllSketch =
+					DatumGetByteaPCopy(datumArray[Anum_columnar_chunk_hll_sketch - 1]);
+			}
 
-			rowMaskEntry->endRowNumber = DatumGetInt64(
-					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_end_row_number,
-								tupleDescriptor, &isnull));
+			if (hasLargeValueCountColumn)
+			{
+				chunk->largeValueCount = DatumGetInt64(
+					datumArray[Anum_columnar_chunk_large_value_count - 1]);
+			}
 
-			rowMask = rowMaskEntry->mask;
-		}
-		else
-		{
-			/*
-			* If the heap tuple is invalid, that likely means that we have
-			* encountered a speculative insert.
-			*/
-			systable_endscan_ordered(scanDescriptor);
-			index_close(index, AccessShareLock);
-			table_close(columnarRowMask, AccessShareLock);
-			return false;
+			if (hasShreddedKeyStatsColumn &&
+				!isNullArray[Anum_columnar_chunk_shredded_key_stats - 1])
+			{
+				chunk->shreddedKeyStats = DatumGetByteaPCopy(
+					datumArray[Anum_columnar_chunk_shredded_key_stats - 1]);
+			}
 		}
 
 		systable_endscan_ordered(scanDescriptor);
-		index_close(index, AccessShareLock);
-		table_close(columnarRowMask, AccessShareLock);
-	}
-	else
-	{
-		rowMask = rowMaskEntry->mask;
 	}
 
-	int16 rowByteMask = rowNumber - rowMaskEntry->startRowNumber;
+	index_close(index, AccessShareLock);
+	table_close(columnarChunk, AccessShareLock);
 
-	/* 
-	 * IF we have been blocked by advisory lock for storage, maybe row
-	 * was delete by some other transaction.
-	 */
-	if (VARDATA(rowMask)[rowByteMask / 8] & (1 << (rowByteMask % 8)))
-		return false;
+	return chunkList;
+}
 
-	VARDATA(rowMask)[rowByteMask / 8] |= 1 << (rowByteMask % 8);
 
-	rowMaskEntry->deletedRows++;
+/*
+ * CreateEmptyStripeSkipList allocates a skip list with zeroed nodes for the
+ * given number of columns and chunks, or only for the columns set in
+ * columnMask if it isn't NULL.
+ */
+static StripeSkipList *
+CreateEmptyStripeSkipList(uint32 columnCount, uint32 chunkCount,
+						  const bool *columnMask)
+{
+	StripeSkipList *chunkList = palloc0(sizeof(StripeSkipList));
+	chunkList->chunkCount = chunkCount;
+	chunkList->columnCount = columnCount;
+	chunkList->chunkSkipNodeArray = palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (columnMask != NULL && !columnMask[columnIndex])
+		{
+			continue;
+		}
 
-	CommandCounterIncrement();
+		chunkList->chunkSkipNodeArray[columnIndex] =
+			palloc0(chunkCount * sizeof(ColumnChunkSkipNode));
+	}
 
-	return true;
+	return chunkList;
 }
 
 
-void FlushRowMaskCache(RowMaskWriteStateEntry *rowMaskEntry)
+/*
+ * SaveCompactStripeSkipList stores the chunk metadata of a stripe as a single
+ * row of columnar.stripe_skip_list. Per chunk it holds the same fields as a
+ * columnar.chunk row, with min/max values in their on-disk form.
+ */
+static void
+SaveCompactStripeSkipList(uint64 storageId, uint64 stripe, StripeSkipList *chunkList,
+						  TupleDesc tupleDescriptor)
 {
-	HeapTuple oldHeapTuple = NULL;
-
-	ScanKeyData scanKey;
+	StringInfoData buffer;
+	pq_begintypsend(&buffer);
 
-	Oid columnarChunkGroupMaskOid = ColumnarRowMaskRelationId();
-	Relation columnarChunkGroupMask =
-		table_open(columnarChunkGroupMaskOid, AccessShareLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(columnarChunkGroupMask);
+	pq_sendint32(&buffer, COMPACT_SKIP_LIST_VERSION);
+	pq_sendint32(&buffer, chunkList->columnCount);
+	pq_sendint32(&buffer, chunkList->chunkCount);
 
-	Relation index = index_open(ColumnarRowMaskIndexRelationId(), AccessShareLock);
+	SendStripeSkipListNodes(&buffer, chunkList, chunkList->columnCount, tupleDescriptor);
 
-	ScanKeyInit(&scanKey, Anum_columnar_row_mask_id,
-				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(rowMaskEntry->id));
+	bytea *skipList = pq_endtypsend(&buffer);
 
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarChunkGroupMask,
-															index,
-															NULL, 1, &scanKey);
+	Datum values[Natts_columnar_stripe_skip_list] = {
+		UInt64GetDatum(storageId),
+		Int64GetDatum(stripe),
+		PointerGetDatum(skipList)
+	};
+	bool nulls[Natts_columnar_stripe_skip_list] = { false };
 
-	oldHeapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
+	Relation stripeSkipList = table_open(ColumnarStripeSkipListRelationId(),
+										 RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(stripeSkipList);
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	FinishModifyRelation(modifyState);
+	table_close(stripeSkipList, RowExclusiveLock);
+}
 
-	index_close(index, AccessShareLock);
 
-	if (HeapTupleIsValid(oldHeapTuple))
+/*
+ * ReadCompactStripeSkipList reads the skip list of a stripe from its row of
+ * columnar.stripe_skip_list, or returns NULL if the stripe has none. Columns
+ * added after the stripe was written get empty nodes, like they do when
+ * reading columnar.chunk.
+ */
+static StripeSkipList *
+ReadCompactStripeSkipList(uint64 storageId, uint64 stripe, TupleDesc tupleDescriptor,
+						  uint32 chunkCount, Snapshot snapshot, const bool *columnMask)
+{
+	Oid stripeSkipListOid = ColumnarStripeSkipListRelationId();
+	if (!OidIsValid(stripeSkipListOid))
 	{
-		bool update[Natts_columnar_row_mask] = { 0 };
-		bool nulls[Natts_columnar_row_mask] = { 0 };
-		Datum values[Natts_columnar_row_mask] = { 0 };
-
-		// Update deleted row count
-		update[Anum_columnar_row_mask_deleted_rows - 1] = true;
-		values[Anum_columnar_row_mask_deleted_rows - 1] = PointerGetDatum(rowMaskEntry->deletedRows);
+		return NULL;
+	}
 
-		// Update mask byte array
-		update[Anum_columnar_row_mask_mask - 1] = true;
-		values[Anum_columnar_row_mask_mask - 1] = PointerGetDatum(rowMaskEntry->mask);
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_skip_list_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_skip_list_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(stripe));
 
-		HeapTuple newHeapTuple = heap_modify_tuple(oldHeapTuple, tupleDescriptor,
-												   values, nulls, update);
+	Relation stripeSkipList = table_open(stripeSkipListOid, AccessShareLock);
+	Relation index = index_open(ColumnarStripeSkipListIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(stripeSkipList, index,
+															snapshot, 2, scanKey);
 
-		CatalogTupleUpdate(columnarChunkGroupMask, &oldHeapTuple->t_self, newHeapTuple);
+	StripeSkipList *chunkList = NULL;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		bool isNull = false;
+		Datum skipListDatum = heap_getattr(heapTuple,
+										   Anum_columnar_stripe_skip_list_skip_list,
+										   RelationGetDescr(stripeSkipList), &isNull);
+		bytea *skipList = DatumGetByteaPP(skipListDatum);
+
+		StringInfoData buffer;
+		buffer.data = VARDATA_ANY(skipList);
+		buffer.len = VARSIZE_ANY_EXHDR(skipList);
+		buffer.maxlen = buffer.len;
+		buffer.cursor = 0;
+
+		uint32 version = pq_getmsgint(&buffer, 4);
+		uint32 storedColumnCount = pq_getmsgint(&buffer, 4);
+		uint32 storedChunkCount = pq_getmsgint(&buffer, 4);
+		if (version != COMPACT_SKIP_LIST_VERSION ||
+			storedColumnCount > tupleDescriptor->natts ||
+			storedChunkCount != chunkCount)
+		{
+			ereport(ERROR, (errmsg("invalid columnar skip list entry"),
+							errdetail("Stripe " UINT64_FORMAT " of storage "
+									  UINT64_FORMAT " has version %u, %u columns "
+									  "and %u chunks.", stripe, storageId,
+									  version, storedColumnCount, storedChunkCount)));
+		}
 
-		heap_freetuple(newHeapTuple);
+		chunkList = ReceiveStripeSkipList(&buffer, tupleDescriptor, storedColumnCount,
+										  chunkCount, columnMask);
 	}
 
 	systable_endscan_ordered(scanDescriptor);
-	table_close(columnarChunkGroupMask, AccessShareLock);
+	index_close(index, AccessShareLock);
+	table_close(stripeSkipList, AccessShareLock);
 
-	CommandCounterIncrement();
+	return chunkList;
 }
 
 
 /*
- * FindStripeByRowNumber returns StripeMetadata for the stripe whose
- * firstRowNumber is greater than given rowNumber. If no such stripe
- * exists, then returns NULL.
+ * SendStripeSkipListNodes appends the chunk metadata of the first columnCount
+ * columns of a stripe to a buffer, with min/max values in their on-disk
+ * form, as stored in columnar.stripe_skip_list.
  */
-StripeMetadata *
-FindNextStripeByRowNumber(Relation relation, uint64 rowNumber, Snapshot snapshot)
+void
+SendStripeSkipListNodes(StringInfo buffer, StripeSkipList *chunkList, uint32 columnCount,
+						TupleDesc tupleDescriptor)
 {
-	return StripeMetadataLookupRowNumber(relation, rowNumber, snapshot, FIND_GREATER);
-}
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
 
+		for (uint32 chunkIndex = 0; chunkIndex < chunkList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunk =
+				&chunkList->chunkSkipNodeArray[columnIndex][chunkIndex];
 
-/*
- * FindStripeByRowNumber returns StripeMetadata for the stripe that contains
- * the row with rowNumber. If no such stripe exists, then returns NULL.
- */
-StripeMetadata *
-FindStripeByRowNumber(Relation relation, uint64 rowNumber, Snapshot snapshot)
-{
-	StripeMetadata *stripeMetadata =
-		FindStripeWithMatchingFirstRowNumber(relation, rowNumber, snapshot);
-	if (!stripeMetadata)
-	{
-		return NULL;
-	}
+			int flags = 0;
+			flags |= chunk->hasMinMax ? COMPACT_CHUNK_HAS_MIN_MAX : 0;
+			flags |= (chunk->bloomFilter != NULL) ? COMPACT_CHUNK_HAS_BLOOM_FILTER : 0;
+			flags |= chunk->hasStatistics ? COMPACT_CHUNK_HAS_STATISTICS : 0;
+			flags |= chunk->sortednessKnown ? COMPACT_CHUNK_SORTEDNESS_KNOWN : 0;
+			flags |= chunk->valuesSorted ? COMPACT_CHUNK_VALUES_SORTED : 0;
+			flags |= (chunk->hllSketch != NULL) ? COMPACT_CHUNK_HAS_HLL_SKETCH : 0;
+			flags |= (chunk->largeValueCount > 0) ? COMPACT_CHUNK_HAS_LARGE_VALUES : 0;
+			flags |= (chunk->shreddedKeyStats != NULL) ? COMPACT_CHUNK_HAS_SHREDDED_KEYS : 0;
+			pq_sendbyte(buffer, flags);
+
+			pq_sendint64(buffer, chunk->rowCount);
+			pq_sendint64(buffer, chunk->valueChunkOffset);
+			pq_sendint64(buffer, chunk->valueLength);
+			pq_sendint64(buffer, chunk->existsChunkOffset);
+			pq_sendint64(buffer, chunk->existsLength);
+			pq_sendint64(buffer, chunk->decompressedValueSize);
+			pq_sendint32(buffer, chunk->valueCompressionType);
+			pq_sendint32(buffer, chunk->valueCompressionLevel);
+			pq_sendint32(buffer, chunk->valueEncodingType);
+			pq_sendint32(buffer, chunk->nullState);
+			pq_sendint64(buffer, chunk->compressionDictionaryId);
+
+			if (chunk->hasStatistics)
+			{
+				pq_sendint64(buffer, chunk->nullCount);
+				pq_sendint64(buffer, chunk->distinctCount);
+			}
 
-	if (rowNumber > StripeGetHighestRowNumber(stripeMetadata))
-	{
-		return NULL;
-	}
+			if (chunk->hasMinMax)
+			{
+				SendStripeDatum(buffer, chunk->minimumValue, attributeForm);
+				SendStripeDatum(buffer, chunk->maximumValue, attributeForm);
+			}
 
-	return stripeMetadata;
+			if (chunk->bloomFilter != NULL)
+			{
+				pq_sendint32(buffer, VARSIZE_ANY_EXHDR(chunk->bloomFilter));
+				pq_sendbytes(buffer, VARDATA_ANY(chunk->bloomFilter),
+							 VARSIZE_ANY_EXHDR(chunk->bloomFilter));
+			}
+
+			if (chunk->hllSketch != NULL)
+			{
+				pq_sendint32(buffer, VARSIZE_ANY_EXHDR(chunk->hllSketch));
+				pq_sendbytes(buffer, VARDATA_ANY(chunk->hllSketch),
+							 VARSIZE_ANY_EXHDR(chunk->hllSketch));
+			}
+
+			if (chunk->largeValueCount > 0)
+			{
+				pq_sendint64(buffer, chunk->largeValueCount);
+			}
+
+			if (chunk->shreddedKeyStats != NULL)
+			{
+				pq_sendint32(buffer, VARSIZE_ANY_EXHDR(chunk->shreddedKeyStats));
+				pq_sendbytes(buffer, VARDATA_ANY(chunk->shreddedKeyStats),
+							 VARSIZE_ANY_EXHDR(chunk->shreddedKeyStats));
+			}
+		}
+	}
 }
 
 
 /*
- * FindStripeWithMatchingFirstRowNumber returns a StripeMetadata object for
- * the stripe that has the greatest firstRowNumber among the stripes whose
- * firstRowNumber is smaller than or equal to given rowNumber. If no such
- * stripe exists, then returns NULL.
- *
- * Note that this doesn't mean that found stripe certainly contains the tuple
- * with given rowNumber. This is because, it also needs to be verified if
- * highest row number that found stripe contains is greater than or equal to
- * given rowNumber. For this reason, unless that additional check is done,
- * this function is mostly useful for checking against "possible" constraint
- * violations due to concurrent writes that are not flushed by other backends
- * yet.
+ * ReceiveStripeSkipList reads the chunk metadata of the first columnCount
+ * columns of a stripe, as written by SendStripeSkipListNodes, into a new skip
+ * list for all columns of the tuple descriptor. Columns after the first
+ * columnCount get empty nodes. With a column mask, the nodes of the other
+ * columns are skipped and left NULL.
  */
-StripeMetadata *
-FindStripeWithMatchingFirstRowNumber(Relation relation, uint64 rowNumber,
-									 Snapshot snapshot)
+StripeSkipList *
+ReceiveStripeSkipList(StringInfo buffer, TupleDesc tupleDescriptor, uint32 columnCount,
+					  uint32 chunkCount, const bool *columnMask)
 {
-	return StripeMetadataLookupRowNumber(relation, rowNumber, snapshot,
-										 FIND_LESS_OR_EQUAL);
-}
+	StripeSkipList *chunkList = CreateEmptyStripeSkipList(tupleDescriptor->natts,
+														  chunkCount, columnMask);
 
-/* FindNextStripeForParallelWorker returns next stripe that should be assigned
- * for worker. Approach here is to calculate module of stripe id with total number
- * of workers that are running for execution. 
- */
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
 
-StripeMetadata * 
-FindNextStripeForParallelWorker(Relation relation,
-								Snapshot snapshot,
-								uint64 nextStripeId,
-								uint64 * nextHigherStripeId)
-{
-	StripeMetadata *foundStripeMetadata = NULL;
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			if (chunkList->chunkSkipNodeArray[columnIndex] == NULL)
+			{
+				SkipStripeSkipListNode(buffer);
+				continue;
+			}
 
-	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
-	ScanKeyData scanKey[2];
+			ColumnChunkSkipNode *chunk =
+				&chunkList->chunkSkipNodeArray[columnIndex][chunkIndex];
 
-	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
+			int flags = pq_getmsgbyte(buffer);
+			chunk->rowCount = pq_getmsgint64(buffer);
+			chunk->valueChunkOffset = pq_getmsgint64(buffer);
+			chunk->valueLength = pq_getmsgint64(buffer);
+			chunk->existsChunkOffset = pq_getmsgint64(buffer);
+			chunk->existsLength = pq_getmsgint64(buffer);
+			chunk->decompressedValueSize = pq_getmsgint64(buffer);
+			chunk->valueCompressionType = pq_getmsgint(buffer, 4);
+			chunk->valueCompressionLevel = (int32) pq_getmsgint(buffer, 4);
+			chunk->valueEncodingType = pq_getmsgint(buffer, 4);
+			chunk->nullState = pq_getmsgint(buffer, 4);
+			chunk->compressionDictionaryId = pq_getmsgint64(buffer);
+
+			if (flags & COMPACT_CHUNK_HAS_STATISTICS)
+			{
+				chunk->nullCount = pq_getmsgint64(buffer);
+				chunk->distinctCount = pq_getmsgint64(buffer);
+				chunk->hasStatistics = true;
+			}
 
-	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_stripe,
-				BTGreaterEqualStrategyNumber, F_INT8GE, UInt64GetDatum(nextStripeId));
+			if (flags & COMPACT_CHUNK_HAS_MIN_MAX)
+			{
+				chunk->minimumValue = ReceiveStripeDatum(buffer, attributeForm);
+				chunk->maximumValue = ReceiveStripeDatum(buffer, attributeForm);
+				chunk->hasMinMax = true;
+			}
 
-	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+			if (flags & COMPACT_CHUNK_HAS_BLOOM_FILTER)
+			{
+				int bloomFilterLength = pq_getmsgint(buffer, 4);
+				chunk->bloomFilter = palloc(bloomFilterLength + VARHDRSZ);
+				SET_VARSIZE(chunk->bloomFilter, bloomFilterLength + VARHDRSZ);
+				memcpy(VARDATA(chunk->bloomFilter),
+					   pq_getmsgbytes(buffer, bloomFilterLength),
+					   bloomFilterLength);
+			}
 
-	Relation index = index_open(ColumnarStripePKeyIndexRelationId(),
-								AccessShareLock);
+			if (flags & COMPACT_CHUNK_HAS_HLL_SKETCH)
+			{
+				int hllSketchLength = pq_getmsgint(buffer, 4);
+				chunk->hllSketch = palloc(hllSketchLength + VARHDRSZ);
+				SET_VARSIZE(chunk->hllSketch, hllSketchLength + VARHDRSZ);
+				memcpy(VARDATA(chunk->hllSketch),
+					   pq_getmsgbytes(buffer, hllSketchLength),
+					   hllSketchLength);
+			}
 
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
-															snapshot, 2,
-															scanKey);
+			if (flags & COMPACT_CHUNK_HAS_LARGE_VALUES)
+			{
+				chunk->largeValueCount = pq_getmsgint64(buffer);
+			}
 
-	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
-	if (HeapTupleIsValid(heapTuple))
-	{
-		foundStripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
-		*nextHigherStripeId = foundStripeMetadata->id;
-	}
+			if (flags & COMPACT_CHUNK_HAS_SHREDDED_KEYS)
+			{
+				int shreddedKeyStatsLength = pq_getmsgint(buffer, 4);
+				chunk->shreddedKeyStats = palloc(shreddedKeyStatsLength + VARHDRSZ);
+				SET_VARSIZE(chunk->shreddedKeyStats, shreddedKeyStatsLength + VARHDRSZ);
+				memcpy(VARDATA(chunk->shreddedKeyStats),
+					   pq_getmsgbytes(buffer, shreddedKeyStatsLength),
+					   shreddedKeyStatsLength);
+			}
 
-	systable_endscan_ordered(scanDescriptor);
-	index_close(index, AccessShareLock);
-	table_close(columnarStripes, AccessShareLock);
+			chunk->sortednessKnown = (flags & COMPACT_CHUNK_SORTEDNESS_KNOWN) != 0;
+			chunk->valuesSorted = (flags & COMPACT_CHUNK_VALUES_SORTED) != 0;
+		}
+	}
 
-	return foundStripeMetadata;
+	return chunkList;
 }
 
 
 /*
- * StripeWriteState returns write state of given stripe.
+ * SkipStripeSkipListNode moves the cursor of the buffer past a chunk node
+ * written by SendStripeSkipListNodes, without allocating any of its values.
  */
-StripeWriteStateEnum
-StripeWriteState(StripeMetadata *stripeMetadata)
+static void
+SkipStripeSkipListNode(StringInfo buffer)
 {
-	if (stripeMetadata->aborted)
+	int flags = pq_getmsgbyte(buffer);
+
+	/* row count, offsets, lengths, sizes and the compression dictionary */
+	pq_getmsgbytes(buffer, 7 * sizeof(int64) + 4 * sizeof(int32));
+
+	if (flags & COMPACT_CHUNK_HAS_STATISTICS)
 	{
-		return STRIPE_WRITE_ABORTED;
+		pq_getmsgbytes(buffer, 2 * sizeof(int64));
 	}
-	else if (stripeMetadata->rowCount > 0)
+
+	if (flags & COMPACT_CHUNK_HAS_MIN_MAX)
 	{
-		return STRIPE_WRITE_FLUSHED;
+		pq_getmsgbytes(buffer, pq_getmsgint(buffer, 4));
+		pq_getmsgbytes(buffer, pq_getmsgint(buffer, 4));
 	}
-	else
+
+	if (flags & COMPACT_CHUNK_HAS_BLOOM_FILTER)
 	{
-		return STRIPE_WRITE_IN_PROGRESS;
+		pq_getmsgbytes(buffer, pq_getmsgint(buffer, 4));
 	}
-}
 
+	if (flags & COMPACT_CHUNK_HAS_HLL_SKETCH)
+	{
+		pq_getmsgbytes(buffer, pq_getmsgint(buffer, 4));
+	}
 
-/*
- * StripeGetHighestRowNumber returns rowNumber of the row with highest
- * rowNumber in given stripe.
- */
-uint64
-StripeGetHighestRowNumber(StripeMetadata *stripeMetadata)
-{
-	return stripeMetadata->firstRowNumber + stripeMetadata->rowCount - 1;
+	if (flags & COMPACT_CHUNK_HAS_LARGE_VALUES)
+	{
+		pq_getmsgbytes(buffer, sizeof(int64));
+	}
+
+	if (flags & COMPACT_CHUNK_HAS_SHREDDED_KEYS)
+	{
+		pq_getmsgbytes(buffer, pq_getmsgint(buffer, 4));
+	}
 }
 
 
 /*
- * StripeMetadataLookupRowNumber returns StripeMetadata for the stripe whose
- * firstRowNumber is less than or equal to (FIND_LESS_OR_EQUAL), or is
- * greater than (FIND_GREATER) given rowNumber by doing backward index
- * scan on stripe_first_row_number_idx.
- * If no such stripe exists, then returns NULL.
+ * SendStripeColumnSummaries appends the stripe level min/max values of the
+ * first columnCount columns of a stripe to a buffer, in the same form as the
+ * min/max values of SendStripeSkipListNodes.
  */
-static StripeMetadata *
-StripeMetadataLookupRowNumber(Relation relation, uint64 rowNumber, Snapshot snapshot,
-							  RowNumberLookupMode lookupMode)
+void
+SendStripeColumnSummaries(StringInfo buffer, ColumnStripeSummary *columnSummaries,
+						  uint32 columnCount, TupleDesc tupleDescriptor)
 {
-	Assert(lookupMode == FIND_LESS_OR_EQUAL || lookupMode == FIND_GREATER);
-
-	StripeMetadata *foundStripeMetadata = NULL;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnStripeSummary *columnSummary = &columnSummaries[columnIndex];
 
-	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
-	ScanKeyData scanKey[2];
-	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+		pq_sendbyte(buffer, columnSummary->hasMinMax);
 
-	StrategyNumber strategyNumber = InvalidStrategy;
-	RegProcedure procedure = InvalidOid;
-	if (lookupMode == FIND_LESS_OR_EQUAL)
-	{
-		strategyNumber = BTLessEqualStrategyNumber;
-		procedure = F_INT8LE;
-	}
-	else if (lookupMode == FIND_GREATER)
-	{
-		strategyNumber = BTGreaterStrategyNumber;
-		procedure = F_INT8GT;
+		if (columnSummary->hasMinMax)
+		{
+			SendStripeDatum(buffer, columnSummary->minimumValue, attributeForm);
+			SendStripeDatum(buffer, columnSummary->maximumValue, attributeForm);
+		}
 	}
-	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_first_row_number,
-				strategyNumber, procedure, UInt64GetDatum(rowNumber));
+}
 
 
-	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
-	Relation index = index_open(ColumnarStripeFirstRowNumberIndexRelationId(),
-								AccessShareLock);
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
-															snapshot, 2,
-															scanKey);
+/*
+ * ReceiveStripeColumnSummaries reads the stripe level min/max values of the
+ * first columnCount columns of a stripe, as written by
+ * SendStripeColumnSummaries, into an array with an entry for each attribute
+ * of the tuple descriptor.
+ */
+ColumnStripeSummary *
+ReceiveStripeColumnSummaries(StringInfo buffer, TupleDesc tupleDescriptor,
+							 uint32 columnCount)
+{
+	ColumnStripeSummary *columnSummaries =
+		palloc0(tupleDescriptor->natts * sizeof(ColumnStripeSummary));
 
-	ScanDirection scanDirection = NoMovementScanDirection;
-	if (lookupMode == FIND_LESS_OR_EQUAL)
-	{
-		scanDirection = BackwardScanDirection;
-	}
-	else if (lookupMode == FIND_GREATER)
-	{
-		scanDirection = ForwardScanDirection;
-	}
-	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, scanDirection);
-	if (HeapTupleIsValid(heapTuple))
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
-		foundStripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
-	}
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnStripeSummary *columnSummary = &columnSummaries[columnIndex];
 
-	systable_endscan_ordered(scanDescriptor);
-	index_close(index, AccessShareLock);
-	table_close(columnarStripes, AccessShareLock);
+		if (pq_getmsgbyte(buffer) != 0)
+		{
+			columnSummary->minimumValue = ReceiveStripeDatum(buffer, attributeForm);
+			columnSummary->maximumValue = ReceiveStripeDatum(buffer, attributeForm);
+			columnSummary->hasMinMax = true;
+		}
+	}
 
-	return foundStripeMetadata;
+	return columnSummaries;
 }
 
 
 /*
- * CheckStripeMetadataConsistency first decides if stripe write operation for
- * given stripe is "flushed", "aborted" or "in-progress", then errors out if
- * its metadata entry contradicts with this fact.
- *
- * Checks performed here are just to catch bugs, so it is encouraged to call
- * this function whenever a StripeMetadata object is built from an heap tuple
- * of columnar.stripe. Currently, BuildStripeMetadata is the only function
- * that does this.
+ * SendStripeDatum appends the length and the on-disk form of a min/max value
+ * to a buffer.
  */
 static void
-CheckStripeMetadataConsistency(StripeMetadata *stripeMetadata)
+SendStripeDatum(StringInfo buffer, Datum value, Form_pg_attribute attributeForm)
 {
-	bool stripeLooksInProgress =
-		stripeMetadata->rowCount == 0 && stripeMetadata->chunkCount == 0 &&
-		stripeMetadata->fileOffset == ColumnarInvalidLogicalOffset &&
-		stripeMetadata->dataLength == 0;
-
-	/*
-	 * Even if stripe is flushed, fileOffset and dataLength might be equal
-	 * to 0 for zero column tables, but those two should still be consistent
-	 * with respect to each other.
-	 */
-	bool stripeLooksFlushed =
-		stripeMetadata->rowCount > 0 && stripeMetadata->chunkCount > 0 &&
-		((stripeMetadata->fileOffset != ColumnarInvalidLogicalOffset &&
-		  stripeMetadata->dataLength > 0) ||
-		 (stripeMetadata->fileOffset == ColumnarInvalidLogicalOffset &&
-		  stripeMetadata->dataLength == 0));
-
-	StripeWriteStateEnum stripeWriteState = StripeWriteState(stripeMetadata);
-	if (stripeWriteState == STRIPE_WRITE_FLUSHED && stripeLooksFlushed)
-	{
-		/*
-		 * If stripe was flushed to disk, then we expect stripe to store
-		 * at least one tuple.
-		 */
-		return;
-	}
-	else if (stripeWriteState == STRIPE_WRITE_IN_PROGRESS && stripeLooksInProgress)
-	{
-		/*
-		 * If stripe was not flushed to disk, then values of given four
-		 * fields should match the columns inserted by
-		 * InsertEmptyStripeMetadataRow.
-		 */
-		return;
-	}
-	else if (stripeWriteState == STRIPE_WRITE_ABORTED && (stripeLooksInProgress ||
-														  stripeLooksFlushed))
-	{
-		/*
-		 * Stripe metadata entry for an aborted write can be complete or
-		 * incomplete. We might have aborted the transaction before or after
-		 * inserting into stripe metadata.
-		 */
-		return;
-	}
+	bytea *bytes = DatumToBytea(value, attributeForm);
 
-	ereport(ERROR, (errmsg("unexpected stripe state, stripe metadata "
-						   "entry for stripe with id=" UINT64_FORMAT
-						   " is not consistent", stripeMetadata->id)));
+	pq_sendint32(buffer, VARSIZE(bytes) - VARHDRSZ);
+	pq_sendbytes(buffer, VARDATA(bytes), VARSIZE(bytes) - VARHDRSZ);
 }
 
 
 /*
- * FindStripeWithHighestRowNumber returns StripeMetadata for the stripe that
- * has the row with highest rowNumber by doing backward index scan on
- * stripe_first_row_number_idx. If given relation is empty, then returns NULL.
+ * ReceiveStripeDatum reads a min/max value written by SendStripeDatum. The
+ * length is checked against the type, so a damaged or foreign buffer can't
+ * make fetch_att read past the value.
  */
-StripeMetadata *
-FindStripeWithHighestRowNumber(Relation relation, Snapshot snapshot)
+static Datum
+ReceiveStripeDatum(StringInfo buffer, Form_pg_attribute attributeForm)
 {
-	StripeMetadata *stripeWithHighestRowNumber = NULL;
+	int length = (int) pq_getmsgint(buffer, 4);
+	const char *bytes = pq_getmsgbytes(buffer, length);
 
-	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
-	ScanKeyData scanKey[1];
-	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
-
-	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
-	Relation index = index_open(ColumnarStripeFirstRowNumberIndexRelationId(),
-								AccessShareLock);
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
-															snapshot, 1, scanKey);
+	bool validLength = false;
+	if (attributeForm->attlen > 0)
+	{
+		validLength = length == attributeForm->attlen;
+	}
+	else if (attributeForm->attlen == -1)
+	{
+		validLength = length >= VARHDRSZ_SHORT &&
+					  (VARATT_IS_1B(bytes) ? VARSIZE_1B(bytes) == length :
+					   length >= VARHDRSZ && VARSIZE_4B(bytes) == length) &&
+					  !VARATT_IS_EXTERNAL(bytes);
+	}
+	else
+	{
+		validLength = length > 0 && strnlen(bytes, length) == length - 1;
+	}
 
-	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
-	if (HeapTupleIsValid(heapTuple))
+	if (!validLength)
 	{
-		stripeWithHighestRowNumber = BuildStripeMetadata(columnarStripes, heapTuple);
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid columnar min/max value of %d bytes for "
+							   "column \"%s\"", length,
+							   NameStr(attributeForm->attname))));
 	}
 
-	systable_endscan_ordered(scanDescriptor);
-	index_close(index, AccessShareLock);
-	table_close(columnarStripes, AccessShareLock);
+	/* copied, so the value outlives the buffer, and aligned for fetch_att */
+	char *value = palloc(length);
+	memcpy(value, bytes, length);
 
-	return stripeWithHighestRowNumber;
+	return fetch_att(value, attributeForm->attbyval, attributeForm->attlen);
 }
 
 
 /*
- * ReadChunkGroupRowCounts returns an array of row counts of chunk groups and 
- * deleted rows count for each chunk group for given stripe.
- * Arrays that are updated will be allocated in this function.
+ * ReadStripeColumnSummaries fetches the stripe level min/max values of the
+ * columns of given stripe. Returns an array with an entry for each attribute
+ * of tupleDescriptor, or NULL if columnar.stripe_attr doesn't exist. Columns
+ * that have no summary (e.g. stripes written before columnar.stripe_attr
+ * existed) have hasMinMax set to false.
  */
-static void
-ReadChunkGroupRowCounts(uint64 storageId, uint64 stripe, uint32 chunkGroupCount,
-						uint32 **chunkGroupRowCounts, uint32 **chunkGroupDeletedRows,
-						Snapshot snapshot)
+ColumnStripeSummary *
+ReadStripeColumnSummaries(RelFileNode relfilenode, uint64 stripe,
+						  TupleDesc tupleDescriptor, Snapshot snapshot)
 {
-	Oid columnarChunkGroupOid = ColumnarChunkGroupRelationId();
-	Relation columnarChunkGroup = table_open(columnarChunkGroupOid, AccessShareLock);
-	Relation index = index_open(ColumnarChunkGroupIndexRelationId(), AccessShareLock);
+	Oid columnarStripeAttrOid = ColumnarStripeAttrRelationId();
+	if (!OidIsValid(columnarStripeAttrOid))
+	{
+		return NULL;
+	}
 
+	uint32 columnCount = tupleDescriptor->natts;
+	uint64 storageId = LookupStorageId(relfilenode);
 	ScanKeyData scanKey[2];
-	ScanKeyInit(&scanKey[0], Anum_columnar_chunkgroup_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
-	ScanKeyInit(&scanKey[1], Anum_columnar_chunkgroup_stripe,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripe));
 
-	SysScanDesc scanDescriptor =
-		systable_beginscan_ordered(columnarChunkGroup, index, snapshot, 2, scanKey);
+	Relation columnarStripeAttr = table_open(columnarStripeAttrOid, AccessShareLock);
+	Relation index = index_open(ColumnarStripeAttrIndexRelationId(), AccessShareLock);
 
-	HeapTuple heapTuple = NULL;
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_attr_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_attr_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(stripe));
 
-	*chunkGroupRowCounts = palloc0(chunkGroupCount * sizeof(uint32));
-	*chunkGroupDeletedRows = palloc0(chunkGroupCount * sizeof(uint32));
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripeAttr, index,
+															snapshot, 2, scanKey);
 
-	/*
-	 * Since we have now updates of `chunk_group`, there could be multiple tuples
-	 * retrieved with changed only deleted_row count. We expect that last modified
-	 * version will be retrieved last so it we just update information based on tuple
-	 * chunk group index.
-	 */
+	ColumnStripeSummary *columnSummaries =
+		palloc0(columnCount * sizeof(ColumnStripeSummary));
+
+	HeapTuple heapTuple = NULL;
 	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
 																 ForwardScanDirection)))
 	{
-		if (HeapTupleHeaderIsHotUpdated(heapTuple->t_data))
-			continue;
+		Datum datumArray[Natts_columnar_stripe_attr];
+		bool isNullArray[Natts_columnar_stripe_attr];
 
-		Datum datumArray[Natts_columnar_chunkgroup];
-		bool isNullArray[Natts_columnar_chunkgroup];
-
-		heap_deform_tuple(heapTuple,
-						  RelationGetDescr(columnarChunkGroup),
-						  datumArray, isNullArray);
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnarStripeAttr), datumArray,
+						  isNullArray);
 
-		uint32 tupleChunkGroupIndex =
-			DatumGetUInt32(datumArray[Anum_columnar_chunkgroup_chunk - 1]);
+		int32 attr = DatumGetInt32(datumArray[Anum_columnar_stripe_attr_attr - 1]);
+		if (attr <= 0 || attr > columnCount)
+		{
+			ereport(ERROR, (errmsg("invalid columnar stripe attribute entry"),
+							errdetail("Attribute number out of range: %d", attr)));
+		}
 
-		if (tupleChunkGroupIndex > chunkGroupCount)
+		if (isNullArray[Anum_columnar_stripe_attr_minimum_value - 1] ||
+			isNullArray[Anum_columnar_stripe_attr_maximum_value - 1])
 		{
-			elog(ERROR, "Tuple chunk group higher than chunk group count");
+			continue;
 		}
 
-		(*chunkGroupRowCounts)[tupleChunkGroupIndex] =
-			(uint32) DatumGetUInt64(datumArray[Anum_columnar_chunkgroup_row_count - 1]);
+		uint32 columnIndex = attr - 1;
+		ColumnStripeSummary *columnSummary = &columnSummaries[columnIndex];
 
-		(*chunkGroupDeletedRows)[tupleChunkGroupIndex] =
-			(uint32) DatumGetUInt64(datumArray[Anum_columnar_chunkgroup_deleted_rows - 1]);
+		bytea *minValue = DatumGetByteaP(
+			datumArray[Anum_columnar_stripe_attr_minimum_value - 1]);
+		bytea *maxValue = DatumGetByteaP(
+			datumArray[Anum_columnar_stripe_attr_maximum_value - 1]);
+
+		columnSummary->minimumValue =
+			ByteaToDatum(minValue, &tupleDescriptor->attrs[columnIndex]);
+		columnSummary->maximumValue =
+			ByteaToDatum(maxValue, &tupleDescriptor->attrs[columnIndex]);
+		columnSummary->hasMinMax = true;
 	}
 
 	systable_endscan_ordered(scanDescriptor);
 	index_close(index, AccessShareLock);
-	table_close(columnarChunkGroup, AccessShareLock);
+	table_close(columnarStripeAttr, AccessShareLock);
+
+	return columnSummaries;
 }
 
 
 /*
- * UpdateChunkGroupDeletedRows updates `deleted_rows` column for each chunk group.
+ * ReadStripeRowMasks fetches the row masks of the stripe with given first
+ * row number and row count in a single ordered scan, so that readers don't
+ * scan columnar.row_mask once per chunk group.
  */
-void
-UpdateChunkGroupDeletedRows(uint64 storageId, uint64 stripe, 
-							uint32 chunkGroupId, uint32 deletedRowNumber)
+StripeRowMasks *
+ReadStripeRowMasks(RelFileNode relfilenode, MemoryContext cxt,
+				   uint64 stripeFirstRowNumber, uint64 rowCount)
 {
-
+	HeapTuple heapTuple = NULL;
+	ScanKeyData scanKey[3];
+
+	COLUMNAR_TRACE_ROW_MASK_READ_START(relfilenode.relNode, stripeFirstRowNumber);
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_ROW_MASK_READ);
+
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
+	Relation index = index_open(ColumnarRowMaskIndexRelationId(), AccessShareLock);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
+
+	int maxCount = (rowCount / COLUMNAR_ROW_MASK_CHUNK_SIZE) + 1;
+
+	StripeRowMasks *stripeRowMasks = palloc0(sizeof(StripeRowMasks));
+	stripeRowMasks->startRowNumbers = palloc(maxCount * sizeof(uint64));
+	stripeRowMasks->endRowNumbers = palloc(maxCount * sizeof(uint64));
+	stripeRowMasks->masks = palloc(maxCount * sizeof(bytea *));
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storage_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_row_mask_start_row_number,
+				BTGreaterEqualStrategyNumber, F_INT8GE, UInt64GetDatum(stripeFirstRowNumber));
+	ScanKeyInit(&scanKey[2], Anum_columnar_row_mask_end_row_number,
+				BTLessEqualStrategyNumber, F_INT8LE, UInt64GetDatum(stripeFirstRowNumber + rowCount - 1));
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarRowMask,
+															index,
+															SnapshotSelf, 3, scanKey);
+
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		Datum datumArray[Natts_columnar_row_mask];
+		bool isNullArray[Natts_columnar_row_mask];
+
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnarRowMask), datumArray, isNullArray);
+
+		/* each chunk group has its own row masks, so small ones have more */
+		if (stripeRowMasks->count == maxCount)
+		{
+			maxCount *= 2;
+			stripeRowMasks->startRowNumbers =
+				repalloc(stripeRowMasks->startRowNumbers, maxCount * sizeof(uint64));
+			stripeRowMasks->endRowNumbers =
+				repalloc(stripeRowMasks->endRowNumbers, maxCount * sizeof(uint64));
+			stripeRowMasks->masks =
+				repalloc(stripeRowMasks->masks, maxCount * sizeof(bytea *));
+		}
+
+		int n = stripeRowMasks->count++;
+		stripeRowMasks->startRowNumbers[n] =
+			DatumGetInt64(datumArray[Anum_columnar_row_mask_start_row_number - 1]);
+		stripeRowMasks->endRowNumbers[n] =
+			DatumGetInt64(datumArray[Anum_columnar_row_mask_end_row_number - 1]);
+		stripeRowMasks->masks[n] =
+			DatumGetByteaPCopy(datumArray[Anum_columnar_row_mask_mask - 1]);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarRowMask, AccessShareLock);
+
+	pgstat_report_wait_end();
+	COLUMNAR_TRACE_ROW_MASK_READ_DONE(relfilenode.relNode, stripeFirstRowNumber,
+									  stripeRowMasks->count);
+
+	return stripeRowMasks;
+}
+
+
+/*
+ * StripeChunkRowMask returns the row mask of the chunk group with given first
+ * row number and row count, put together from the row masks of its stripe
+ * that ReadStripeRowMasks fetched.
+ */
+bytea *
+StripeChunkRowMask(StripeRowMasks *stripeRowMasks, MemoryContext cxt,
+				   uint64 chunkFirstRowNumber, int rowCount)
+{
+	uint16 chunkMaskSize = 
+		(rowCount % COLUMNAR_ROW_MASK_CHUNK_SIZE) ?
+			(rowCount / 8 + 1) :
+			(rowCount / 8);
+
+	bytea *chunkRowMaskBytea = (bytea *) MemoryContextAllocZero(cxt, chunkMaskSize +
+																VARHDRSZ);
+	SET_VARSIZE(chunkRowMaskBytea, chunkMaskSize + VARHDRSZ);
+
+	uint64 chunkLastRowNumber = chunkFirstRowNumber + rowCount - 1;
+
+	/* find the first row mask of the chunk group */
+	int low = 0;
+	int high = stripeRowMasks->count;
+	while (low < high)
+	{
+		int mid = low + (high - low) / 2;
+		if (stripeRowMasks->startRowNumbers[mid] < chunkFirstRowNumber)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	int pos = 0;
+	for (int n = low; n < stripeRowMasks->count &&
+		 stripeRowMasks->startRowNumbers[n] <= chunkLastRowNumber; n++)
+	{
+		if (stripeRowMasks->endRowNumbers[n] > chunkLastRowNumber)
+		{
+			continue;
+		}
+
+		bytea *currentRowMask = stripeRowMasks->masks[n];
+
+		memcpy(VARDATA(chunkRowMaskBytea) + pos,
+			   VARDATA(currentRowMask),
+			   VARSIZE_ANY_EXHDR(currentRowMask));
+
+		pos += VARSIZE_ANY_EXHDR(currentRowMask);
+	}
+
+	return chunkRowMaskBytea;
+}
+
+
+/*
+ * StripeRowMasksRowDeleted returns whether the row masks of a stripe that
+ * ReadStripeRowMasks fetched mark the row with given row number deleted.
+ */
+bool
+StripeRowMasksRowDeleted(StripeRowMasks *stripeRowMasks, uint64 rowNumber)
+{
+	/* find the last row mask that starts at or before the row */
+	int low = 0;
+	int high = stripeRowMasks->count;
+	while (low < high)
+	{
+		int mid = low + (high - low) / 2;
+		if (stripeRowMasks->startRowNumbers[mid] <= rowNumber)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	if (low == 0 || stripeRowMasks->endRowNumbers[low - 1] < rowNumber)
+	{
+		return false;
+	}
+
+	bytea *rowMask = stripeRowMasks->masks[low - 1];
+	uint64 maskRow = rowNumber - stripeRowMasks->startRowNumbers[low - 1];
+
+	return (VARDATA(rowMask)[maskRow / 8] & (1 << (maskRow % 8))) != 0;
+}
+
+
+/*
+ * RowMaskWriteStateForRow returns the row mask write state entry of the
+ * columnar.row_mask row that covers the given row number of this
+ * subtransaction, reading the row into a new entry the first time, or NULL
+ * if there is no such row.
+ */
+static RowMaskWriteStateEntry *
+RowMaskWriteStateForRow(RelFileNode relfilenode, uint64 storageId, uint64 rowNumber)
+{
+	RowMaskWriteStateEntry *rowMaskEntry =
+		RowMaskFindWriteState(relfilenode.relNode, GetCurrentSubTransactionId(), rowNumber);
+
+	if (rowMaskEntry == NULL)
+	{
+		HeapTuple rowMaskHeapTuple;
+		ScanKeyData scanKey[3];
+
+		Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+		Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
+		TupleDesc tupleDescriptor = RelationGetDescr(columnarRowMask);
+
+		Relation index = index_open(ColumnarRowMaskIndexRelationId(), AccessShareLock);
+
+		ScanKeyInit(&scanKey[0], Anum_columnar_row_mask_storage_id,
+					BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+		ScanKeyInit(&scanKey[1], Anum_columnar_row_mask_start_row_number,
+					BTLessEqualStrategyNumber, F_INT8LE, UInt64GetDatum(rowNumber));
+		ScanKeyInit(&scanKey[2], Anum_columnar_row_mask_end_row_number,
+					BTGreaterEqualStrategyNumber, F_INT8GE, UInt64GetDatum(rowNumber));
+
+		SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarRowMask,
+																index,
+																NULL, 3, scanKey);
+
+		rowMaskHeapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
+
+		if (HeapTupleIsValid(rowMaskHeapTuple))
+		{
+			bool isnull;
+
+			Pointer mask = DatumGetPointer(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_mask,
+								tupleDescriptor, &isnull));
+		
+			rowMaskEntry = RowMaskInitWriteState(relfilenode.relNode,
+												 storageId,
+												 GetCurrentSubTransactionId(),
+												 DatumGetByteaP(mask));
+			/* 
+			 * Populate row mask cache with values from heap table
+			 */
+			rowMaskEntry->id = DatumGetUInt64(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_id,
+								tupleDescriptor, &isnull));
+
+			rowMaskEntry->storageId = DatumGetUInt64(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_storage_id,
+								tupleDescriptor, &isnull));
+			
+			rowMaskEntry->stripeId = DatumGetUInt64(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_stripe_id,
+								tupleDescriptor, &isnull));
+			
+			rowMaskEntry->chunkId = DatumGetInt32(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_chunk_id,
+								tupleDescriptor, &isnull));
+
+			rowMaskEntry->startRowNumber = DatumGetInt64(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_start_row_number,
+								tupleDescriptor, &isnull));
+
+			rowMaskEntry->deletedRows = DatumGetInt32(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_deleted_rows,
+								tupleDescriptor, &isnull));
+
+			rowMaskEntry->endRowNumber = DatumGetInt64(
+					fastgetattr(rowMaskHeapTuple, Anum_columnar_row_mask_end_row_number,
+								tupleDescriptor, &isnull));
+		}
+		else
+		{
+			/*
+			* If the heap tuple is invalid, that likely means that we have
+			* encountered a speculative insert.
+			*/
+			systable_endscan_ordered(scanDescriptor);
+			index_close(index, AccessShareLock);
+			table_close(columnarRowMask, AccessShareLock);
+			return NULL;
+		}
+
+		systable_endscan_ordered(scanDescriptor);
+		index_close(index, AccessShareLock);
+		table_close(columnarRowMask, AccessShareLock);
+	}
+
+	return rowMaskEntry;
+}
+
+
+bool
+UpdateRowMask(RelFileNode relfilenode, uint64 storageId,
+			  Snapshot snapshot, uint64 rowNumber)
+{
+	TransactionReadCacheInvalidate(storageId);
+
+	RowMaskWriteStateEntry *rowMaskEntry =
+		RowMaskWriteStateForRow(relfilenode, storageId, rowNumber);
+
+	if (rowMaskEntry == NULL)
+	{
+		return false;
+	}
+
+	bytea *rowMask = rowMaskEntry->mask;
+	int16 rowByteMask = rowNumber - rowMaskEntry->startRowNumber;
+
+	/* 
+	 * IF we have been blocked by advisory lock for storage, maybe row
+	 * was delete by some other transaction.
+	 */
+	if (VARDATA(rowMask)[rowByteMask / 8] & (1 << (rowByteMask % 8)))
+		return false;
+
+	VARDATA(rowMask)[rowByteMask / 8] |= 1 << (rowByteMask % 8);
+
+	rowMaskEntry->deletedRows++;
+
+	CommandCounterIncrement();
+
+	return true;
+}
+
+
+/*
+ * UpdateRowMaskRange marks the rows from firstRowNumber on, up to but not
+ * including endRowNumber, deleted like UpdateRowMask does for each of them,
+ * and returns how many of them weren't deleted yet. The rows have to be in
+ * flushed stripes.
+ */
+uint64
+UpdateRowMaskRange(RelFileNode relfilenode, uint64 storageId,
+				   uint64 firstRowNumber, uint64 endRowNumber)
+{
+	uint64 deletedRowCount = 0;
+
+	TransactionReadCacheInvalidate(storageId);
+
+	uint64 rowNumber = firstRowNumber;
+	while (rowNumber < endRowNumber)
+	{
+		RowMaskWriteStateEntry *rowMaskEntry =
+			RowMaskWriteStateForRow(relfilenode, storageId, rowNumber);
+
+		if (rowMaskEntry == NULL)
+		{
+			ereport(ERROR, (errmsg("row mask of row " UINT64_FORMAT " is missing",
+								   rowNumber)));
+		}
+
+		uint64 maskEndRowNumber = Min(endRowNumber,
+									  (uint64) rowMaskEntry->endRowNumber + 1);
+		bytea *rowMask = rowMaskEntry->mask;
+
+		for (; rowNumber < maskEndRowNumber; rowNumber++)
+		{
+			uint64 maskRow = rowNumber - rowMaskEntry->startRowNumber;
+			uint8 rowBit = 1 << (maskRow % 8);
+
+			if ((VARDATA(rowMask)[maskRow / 8] & rowBit) == 0)
+			{
+				VARDATA(rowMask)[maskRow / 8] |= rowBit;
+				rowMaskEntry->deletedRows++;
+				deletedRowCount++;
+			}
+		}
+	}
+
+	CommandCounterIncrement();
+
+	return deletedRowCount;
+}
+
+
+/*
+ * FlushRowMaskWriteStateEntries writes the masks of given row mask write state
+ * entries, ordered by their first row number, to columnar.row_mask, and then
+ * the number of deleted rows of each chunk group they belong to to
+ * columnar.chunk_group, once per chunk group.
+ */
+void
+FlushRowMaskWriteStateEntries(RowMaskWriteStateEntry **rowMaskEntries, int entryCount)
+{
+	if (entryCount == 0)
+	{
+		return;
+	}
+
+	Oid columnarRowMaskOid = ColumnarRowMaskRelationId();
+	Relation columnarRowMask = table_open(columnarRowMaskOid, AccessShareLock);
+	Relation index = index_open(ColumnarRowMaskIndexRelationId(), AccessShareLock);
+
+	for (int entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		UpdateRowMaskTuple(columnarRowMask, index, rowMaskEntries[entryIndex]);
+	}
+
+	index_close(index, AccessShareLock);
+	table_close(columnarRowMask, AccessShareLock);
+
+	CommandCounterIncrement();
+
+	int entryIndex = 0;
+	while (entryIndex < entryCount)
+	{
+		RowMaskWriteStateEntry *chunkGroupEntry = rowMaskEntries[entryIndex];
+		uint32 deletedRows = 0;
+
+		/* chunk groups larger than COLUMNAR_ROW_MASK_CHUNK_SIZE have more masks */
+		while (entryIndex < entryCount &&
+			   rowMaskEntries[entryIndex]->storageId == chunkGroupEntry->storageId &&
+			   rowMaskEntries[entryIndex]->stripeId == chunkGroupEntry->stripeId &&
+			   rowMaskEntries[entryIndex]->chunkId == chunkGroupEntry->chunkId)
+		{
+			deletedRows += rowMaskEntries[entryIndex]->deletedRows;
+			entryIndex++;
+		}
+
+		UpdateChunkGroupDeletedRows(chunkGroupEntry->storageId, chunkGroupEntry->stripeId,
+									chunkGroupEntry->chunkId, deletedRows);
+	}
+}
+
+
+/*
+ * UpdateRowMaskTuple updates the columnar.row_mask row of given write state
+ * entry with its mask and number of deleted rows.
+ */
+static void
+UpdateRowMaskTuple(Relation columnarRowMask, Relation index,
+				   RowMaskWriteStateEntry *rowMaskEntry)
+{
+	HeapTuple oldHeapTuple = NULL;
+
+	ScanKeyData scanKey;
+
+	TupleDesc tupleDescriptor = RelationGetDescr(columnarRowMask);
+
+	ScanKeyInit(&scanKey, Anum_columnar_row_mask_id,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(rowMaskEntry->id));
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarRowMask,
+															index,
+															NULL, 1, &scanKey);
+
+	oldHeapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
+
+	if (HeapTupleIsValid(oldHeapTuple))
+	{
+		bool update[Natts_columnar_row_mask] = { 0 };
+		bool nulls[Natts_columnar_row_mask] = { 0 };
+		Datum values[Natts_columnar_row_mask] = { 0 };
+
+		// Update deleted row count
+		update[Anum_columnar_row_mask_deleted_rows - 1] = true;
+		values[Anum_columnar_row_mask_deleted_rows - 1] = PointerGetDatum(rowMaskEntry->deletedRows);
+
+		// Update mask byte array
+		update[Anum_columnar_row_mask_mask - 1] = true;
+		values[Anum_columnar_row_mask_mask - 1] = PointerGetDatum(rowMaskEntry->mask);
+
+		HeapTuple newHeapTuple = heap_modify_tuple(oldHeapTuple, tupleDescriptor,
+												   values, nulls, update);
+
+		CatalogTupleUpdate(columnarRowMask, &oldHeapTuple->t_self, newHeapTuple);
+
+		heap_freetuple(newHeapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+}
+
+
+/*
+ * FindStripeByRowNumber returns StripeMetadata for the stripe whose
+ * firstRowNumber is greater than given rowNumber. If no such stripe
+ * exists, then returns NULL.
+ */
+StripeMetadata *
+FindNextStripeByRowNumber(Relation relation, uint64 rowNumber, Snapshot snapshot)
+{
+	return StripeMetadataLookupRowNumber(relation, rowNumber, snapshot, FIND_GREATER);
+}
+
+
+/*
+ * FindStripeByRowNumber returns StripeMetadata for the stripe that contains
+ * the row with rowNumber. If no such stripe exists, then returns NULL.
+ */
+StripeMetadata *
+FindStripeByRowNumber(Relation relation, uint64 rowNumber, Snapshot snapshot)
+{
+	StripeMetadata *stripeMetadata =
+		FindStripeWithMatchingFirstRowNumber(relation, rowNumber, snapshot);
+	if (!stripeMetadata)
+	{
+		return NULL;
+	}
+
+	if (rowNumber > StripeGetHighestRowNumber(stripeMetadata))
+	{
+		return NULL;
+	}
+
+	return stripeMetadata;
+}
+
+
+/*
+ * FindStripeWithMatchingFirstRowNumber returns a StripeMetadata object for
+ * the stripe that has the greatest firstRowNumber among the stripes whose
+ * firstRowNumber is smaller than or equal to given rowNumber. If no such
+ * stripe exists, then returns NULL.
+ *
+ * Note that this doesn't mean that found stripe certainly contains the tuple
+ * with given rowNumber. This is because, it also needs to be verified if
+ * highest row number that found stripe contains is greater than or equal to
+ * given rowNumber. For this reason, unless that additional check is done,
+ * this function is mostly useful for checking against "possible" constraint
+ * violations due to concurrent writes that are not flushed by other backends
+ * yet.
+ */
+StripeMetadata *
+FindStripeWithMatchingFirstRowNumber(Relation relation, uint64 rowNumber,
+									 Snapshot snapshot)
+{
+	return StripeMetadataLookupRowNumber(relation, rowNumber, snapshot,
+										 FIND_LESS_OR_EQUAL);
+}
+
+
+/*
+ * FindNextStripeById returns the stripe with the lowest id that is greater
+ * than or equal to stripeId and visible to the given snapshot, or NULL if
+ * there is none.
+ */
+StripeMetadata *
+FindNextStripeById(Relation relation, uint64 stripeId, Snapshot snapshot)
+{
+	StripeMetadata *foundStripeMetadata = NULL;
+
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	ScanKeyData scanKey[2];
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_stripe,
+				BTGreaterEqualStrategyNumber, F_INT8GE, UInt64GetDatum(stripeId));
+
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+	Relation index = index_open(ColumnarStripePKeyIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
+															snapshot, 2,
+															scanKey);
+
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		foundStripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripes, AccessShareLock);
+
+	return foundStripeMetadata;
+}
+
+
+/*
+ * StripeWriteState returns write state of given stripe.
+ */
+StripeWriteStateEnum
+StripeWriteState(StripeMetadata *stripeMetadata)
+{
+	if (stripeMetadata->aborted)
+	{
+		return STRIPE_WRITE_ABORTED;
+	}
+	else if (stripeMetadata->rowCount > 0)
+	{
+		return STRIPE_WRITE_FLUSHED;
+	}
+	else
+	{
+		return STRIPE_WRITE_IN_PROGRESS;
+	}
+}
+
+
+/*
+ * StripeGetHighestRowNumber returns rowNumber of the row with highest
+ * rowNumber in given stripe.
+ */
+uint64
+StripeGetHighestRowNumber(StripeMetadata *stripeMetadata)
+{
+	return stripeMetadata->firstRowNumber + stripeMetadata->rowCount - 1;
+}
+
+
+/*
+ * StripeVisibleToAll returns true if the given stripe is flushed and was
+ * inserted by a transaction that all transactions of oldestXmin and later see
+ * as committed.
+ */
+bool
+StripeVisibleToAll(StripeMetadata *stripeMetadata, TransactionId oldestXmin)
+{
+	if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED ||
+		stripeMetadata->rowCount == 0)
+	{
+		return false;
+	}
+
+	TransactionId insertXid = stripeMetadata->insertXid;
+	if (insertXid == FrozenTransactionId)
+	{
+		return true;
+	}
+
+	return TransactionIdIsNormal(insertXid) &&
+		   TransactionIdPrecedes(insertXid, oldestXmin) &&
+		   TransactionIdDidCommit(insertXid);
+}
+
+
+/*
+ * StripeMetadataLookupRowNumber returns StripeMetadata for the stripe whose
+ * firstRowNumber is less than or equal to (FIND_LESS_OR_EQUAL), or is
+ * greater than (FIND_GREATER) given rowNumber by doing backward index
+ * scan on stripe_first_row_number_idx.
+ * If no such stripe exists, then returns NULL.
+ *
+ * MVCC snapshots first try the row ranges of the stripes that all
+ * transactions see, which answer most lookups of index scans without
+ * scanning columnar.stripe, see columnar_stripe_list_cache.c.
+ */
+static StripeMetadata *
+StripeMetadataLookupRowNumber(Relation relation, uint64 rowNumber, Snapshot snapshot,
+							  RowNumberLookupMode lookupMode)
+{
+	Assert(lookupMode == FIND_LESS_OR_EQUAL || lookupMode == FIND_GREATER);
+
+	StripeMetadata *foundStripeMetadata = NULL;
+
+	if (snapshot != NULL && IsMVCCSnapshot(snapshot))
+	{
+		if (lookupMode == FIND_LESS_OR_EQUAL)
+		{
+			foundStripeMetadata = CachedStripeContainingRowNumber(relation, rowNumber);
+		}
+		else
+		{
+			foundStripeMetadata = CachedStripeFollowingRowNumber(relation, rowNumber);
+		}
+
+		if (foundStripeMetadata != NULL)
+		{
+			return foundStripeMetadata;
+		}
+	}
+
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+
+	StrategyNumber strategyNumber = InvalidStrategy;
+	RegProcedure procedure = InvalidOid;
+	if (lookupMode == FIND_LESS_OR_EQUAL)
+	{
+		strategyNumber = BTLessEqualStrategyNumber;
+		procedure = F_INT8LE;
+	}
+	else if (lookupMode == FIND_GREATER)
+	{
+		strategyNumber = BTGreaterStrategyNumber;
+		procedure = F_INT8GT;
+	}
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_first_row_number,
+				strategyNumber, procedure, UInt64GetDatum(rowNumber));
+
+
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+	Relation index = index_open(ColumnarStripeFirstRowNumberIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
+															snapshot, 2,
+															scanKey);
+
+	ScanDirection scanDirection = NoMovementScanDirection;
+	if (lookupMode == FIND_LESS_OR_EQUAL)
+	{
+		scanDirection = BackwardScanDirection;
+	}
+	else if (lookupMode == FIND_GREATER)
+	{
+		scanDirection = ForwardScanDirection;
+	}
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, scanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		foundStripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripes, AccessShareLock);
+
+	return foundStripeMetadata;
+}
+
+
+/*
+ * CheckStripeMetadataConsistency first decides if stripe write operation for
+ * given stripe is "flushed", "aborted" or "in-progress", then errors out if
+ * its metadata entry contradicts with this fact.
+ *
+ * Checks performed here are just to catch bugs, so it is encouraged to call
+ * this function whenever a StripeMetadata object is built from an heap tuple
+ * of columnar.stripe. Currently, BuildStripeMetadata is the only function
+ * that does this.
+ */
+static void
+CheckStripeMetadataConsistency(StripeMetadata *stripeMetadata)
+{
+	bool stripeLooksInProgress =
+		stripeMetadata->rowCount == 0 && stripeMetadata->chunkCount == 0 &&
+		stripeMetadata->fileOffset == ColumnarInvalidLogicalOffset &&
+		stripeMetadata->dataLength == 0;
+
+	/*
+	 * Even if stripe is flushed, fileOffset and dataLength might be equal
+	 * to 0 for zero column tables, but those two should still be consistent
+	 * with respect to each other.
+	 */
+	bool stripeLooksFlushed =
+		stripeMetadata->rowCount > 0 && stripeMetadata->chunkCount > 0 &&
+		((stripeMetadata->fileOffset != ColumnarInvalidLogicalOffset &&
+		  stripeMetadata->dataLength > 0) ||
+		 (stripeMetadata->fileOffset == ColumnarInvalidLogicalOffset &&
+		  stripeMetadata->dataLength == 0));
+
+	StripeWriteStateEnum stripeWriteState = StripeWriteState(stripeMetadata);
+	if (stripeWriteState == STRIPE_WRITE_FLUSHED && stripeLooksFlushed)
+	{
+		/*
+		 * If stripe was flushed to disk, then we expect stripe to store
+		 * at least one tuple.
+		 */
+		return;
+	}
+	else if (stripeWriteState == STRIPE_WRITE_IN_PROGRESS && stripeLooksInProgress)
+	{
+		/*
+		 * If stripe was not flushed to disk, then values of given four
+		 * fields should match the columns inserted by
+		 * InsertEmptyStripeMetadataRow.
+		 */
+		return;
+	}
+	else if (stripeWriteState == STRIPE_WRITE_ABORTED && (stripeLooksInProgress ||
+														  stripeLooksFlushed))
+	{
+		/*
+		 * Stripe metadata entry for an aborted write can be complete or
+		 * incomplete. We might have aborted the transaction before or after
+		 * inserting into stripe metadata.
+		 */
+		return;
+	}
+
+	ereport(ERROR, (errmsg("unexpected stripe state, stripe metadata "
+						   "entry for stripe with id=" UINT64_FORMAT
+						   " is not consistent", stripeMetadata->id)));
+}
+
+
+/*
+ * FindStripeWithHighestRowNumber returns StripeMetadata for the stripe that
+ * has the row with highest rowNumber by doing backward index scan on
+ * stripe_first_row_number_idx. If given relation is empty, then returns NULL.
+ */
+StripeMetadata *
+FindStripeWithHighestRowNumber(Relation relation, Snapshot snapshot)
+{
+	StripeMetadata *stripeWithHighestRowNumber = NULL;
+
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+	Relation index = index_open(ColumnarStripeFirstRowNumberIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
+															snapshot, 1, scanKey);
+
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		stripeWithHighestRowNumber = BuildStripeMetadata(columnarStripes, heapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripes, AccessShareLock);
+
+	return stripeWithHighestRowNumber;
+}
+
+
+/*
+ * ReadChunkGroupRowCountsCached is ReadChunkGroupRowCounts, but reuses the
+ * counts an earlier statement of the transaction read with the same
+ * snapshot, see TransactionReadCacheLookupRowCounts.
+ */
+static void
+ReadChunkGroupRowCountsCached(uint64 storageId, uint64 stripe, uint32 chunkGroupCount,
+							  uint32 **chunkGroupRowCounts,
+							  uint32 **chunkGroupDeletedRows, Snapshot snapshot)
+{
+	if (TransactionReadCacheLookupRowCounts(storageId, stripe, chunkGroupCount,
+											snapshot, chunkGroupRowCounts,
+											chunkGroupDeletedRows))
+	{
+		return;
+	}
+
+	ReadChunkGroupRowCounts(storageId, stripe, chunkGroupCount, chunkGroupRowCounts,
+							chunkGroupDeletedRows, snapshot);
+
+	TransactionReadCacheStoreRowCounts(storageId, stripe, chunkGroupCount, snapshot,
+									   *chunkGroupRowCounts, *chunkGroupDeletedRows);
+}
+
+
+/*
+ * ReadChunkGroupRowCounts returns an array of row counts of chunk groups and 
+ * deleted rows count for each chunk group for given stripe.
+ * Arrays that are updated will be allocated in this function.
+ */
+static void
+ReadChunkGroupRowCounts(uint64 storageId, uint64 stripe, uint32 chunkGroupCount,
+						uint32 **chunkGroupRowCounts, uint32 **chunkGroupDeletedRows,
+						Snapshot snapshot)
+{
+	Oid columnarChunkGroupOid = ColumnarChunkGroupRelationId();
+	Relation columnarChunkGroup = table_open(columnarChunkGroupOid, AccessShareLock);
+	Relation index = index_open(ColumnarChunkGroupIndexRelationId(), AccessShareLock);
+
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_chunkgroup_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_chunkgroup_stripe,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripe));
+
+	SysScanDesc scanDescriptor =
+		systable_beginscan_ordered(columnarChunkGroup, index, snapshot, 2, scanKey);
+
+	HeapTuple heapTuple = NULL;
+
+	*chunkGroupRowCounts = palloc0(chunkGroupCount * sizeof(uint32));
+	*chunkGroupDeletedRows = palloc0(chunkGroupCount * sizeof(uint32));
+
+	/*
+	 * Since we have now updates of `chunk_group`, there could be multiple tuples
+	 * retrieved with changed only deleted_row count. We expect that last modified
+	 * version will be retrieved last so it we just update information based on tuple
+	 * chunk group index.
+	 */
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		if (HeapTupleHeaderIsHotUpdated(heapTuple->t_data))
+			continue;
+
+		Datum datumArray[Natts_columnar_chunkgroup];
+		bool isNullArray[Natts_columnar_chunkgroup];
+
+		heap_deform_tuple(heapTuple,
+						  RelationGetDescr(columnarChunkGroup),
+						  datumArray, isNullArray);
+
+		uint32 tupleChunkGroupIndex =
+			DatumGetUInt32(datumArray[Anum_columnar_chunkgroup_chunk - 1]);
+
+		if (tupleChunkGroupIndex > chunkGroupCount)
+		{
+			elog(ERROR, "Tuple chunk group higher than chunk group count");
+		}
+
+		(*chunkGroupRowCounts)[tupleChunkGroupIndex] =
+			(uint32) DatumGetUInt64(datumArray[Anum_columnar_chunkgroup_row_count - 1]);
+
+		(*chunkGroupDeletedRows)[tupleChunkGroupIndex] =
+			(uint32) DatumGetUInt64(datumArray[Anum_columnar_chunkgroup_deleted_rows - 1]);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarChunkGroup, AccessShareLock);
+}
+
+
+/*
+ * UpdateChunkGroupDeletedRows updates `deleted_rows` column for each chunk group.
+ */
+void
+UpdateChunkGroupDeletedRows(uint64 storageId, uint64 stripe, 
+							uint32 chunkGroupId, uint32 deletedRowNumber)
+{
+
 	HeapTuple oldHeapTuple = NULL;
 
-	Oid columnarChunkGroupOid = ColumnarChunkGroupRelationId();
-	Relation columnarChunkGroup = table_open(columnarChunkGroupOid, AccessShareLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(columnarChunkGroup);
-	Relation index = index_open(ColumnarChunkGroupIndexRelationId(), AccessShareLock);
+	TransactionReadCacheInvalidate(storageId);
+
+	Oid columnarChunkGroupOid = ColumnarChunkGroupRelationId();
+	Relation columnarChunkGroup = table_open(columnarChunkGroupOid, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(columnarChunkGroup);
+	Relation index = index_open(ColumnarChunkGroupIndexRelationId(), AccessShareLock);
+
+	ScanKeyData scanKey[3];
+	ScanKeyInit(&scanKey[0], Anum_columnar_chunkgroup_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_chunkgroup_stripe,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripe));
+	ScanKeyInit(&scanKey[2], Anum_columnar_chunkgroup_chunk,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(chunkGroupId));
+
+	SysScanDesc scanDescriptor =
+		systable_beginscan_ordered(columnarChunkGroup, index, NULL, 3, scanKey);
+
+	oldHeapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
+
+	index_close(index, AccessShareLock);
+
+	if (HeapTupleIsValid(oldHeapTuple))
+	{
+		bool update[Natts_columnar_chunkgroup] = { 0 };
+		bool nulls[Natts_columnar_chunkgroup] = { 0 };
+		Datum values[Natts_columnar_chunkgroup] = { 0 };
+
+		// Update deleted row count
+		update[Anum_columnar_chunkgroup_deleted_rows - 1] = true;
+		values[Anum_columnar_chunkgroup_deleted_rows - 1] = (deletedRowNumber);
+
+		HeapTuple newHeapTuple = heap_modify_tuple(oldHeapTuple, tupleDescriptor,
+												   values, nulls, update);
+
+		CatalogTupleUpdate(columnarChunkGroup, &oldHeapTuple->t_self, newHeapTuple);
+
+		heap_freetuple(newHeapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	table_close(columnarChunkGroup, AccessShareLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * InsertEmptyStripeMetadataRow adds a row to columnar.stripe for the empty
+ * stripe reservation made for stripeId.
+ */
+static void
+InsertEmptyStripeMetadataRow(uint64 storageId, uint64 stripeId, uint32 columnCount,
+							 uint32 chunkGroupRowCount, uint64 firstRowNumber)
+{
+	bool nulls[Natts_columnar_stripe] = { false };
+
+	Datum values[Natts_columnar_stripe] = { 0 };
+	values[Anum_columnar_stripe_storageid - 1] =
+		UInt64GetDatum(storageId);
+	values[Anum_columnar_stripe_stripe - 1] =
+		UInt64GetDatum(stripeId);
+	values[Anum_columnar_stripe_column_count - 1] =
+		UInt32GetDatum(columnCount);
+	values[Anum_columnar_stripe_chunk_row_count - 1] =
+		UInt32GetDatum(chunkGroupRowCount);
+	values[Anum_columnar_stripe_first_row_number - 1] =
+		UInt64GetDatum(firstRowNumber);
+
+	/* stripe has no rows yet, so initialize rest of the columns accordingly */
+	values[Anum_columnar_stripe_row_count - 1] =
+		UInt64GetDatum(0);
+	values[Anum_columnar_stripe_file_offset - 1] =
+		UInt64GetDatum(ColumnarInvalidLogicalOffset);
+	values[Anum_columnar_stripe_data_length - 1] =
+		UInt64GetDatum(0);
+	values[Anum_columnar_stripe_chunk_count - 1] =
+		UInt32GetDatum(0);
+	values[Anum_columnar_stripe_bucket - 1] =
+		Int32GetDatum(-1);
+
+	Oid columnarStripesOid = ColumnarStripeRelationId();
+	Relation columnarStripes = table_open(columnarStripesOid, RowExclusiveLock);
+
+	ModifyState *modifyState = StartModifyRelation(columnarStripes);
+
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+
+	FinishModifyRelation(modifyState);
+
+	table_close(columnarStripes, RowExclusiveLock);
+}
+
+
+/*
+ * StripesForRelfilenode returns a list of StripeMetadata for stripes
+ * of the given relfilenode.
+ */
+List *
+StripesForRelfilenode(RelFileNode relfilenode, ScanDirection scanDirection)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	return ReadDataFileStripeList(storageId, GetTransactionSnapshot(), scanDirection);
+}
+
+
+/*
+ * StripesForSnapshot returns a list of StripeMetadata for the stripes of the
+ * given relation that are visible to the given snapshot, in row number order.
+ */
+List *
+StripesForSnapshot(Relation relation, Snapshot snapshot)
+{
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+
+	return ReadDataFileStripeList(storageId, snapshot, ForwardScanDirection);
+}
+
+
+/*
+ * StripeVersionsForRelfilenode returns a list of StripeMetadata for every
+ * version of the stripe metadata rows of the given relfilenode that isn't
+ * removed yet, so also for stripes that older snapshots still see after
+ * they were deleted, in row number order.
+ */
+List *
+StripeVersionsForRelfilenode(RelFileNode relfilenode)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	return ReadDataFileStripeList(storageId, SnapshotAny, ForwardScanDirection);
+}
+
+
+/*
+ * DeletedRowsForStripe returns number of deleted rows for stripe
+ * of the given relfilenode.
+ */
+uint32
+DeletedRowsForStripe(RelFileNode relfilenode, uint32 chunkCount, uint64 stripeId)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	uint32 *chunkGroupRowCounts;
+	uint32 *chunkGroupDeletedRows;
+	int i;
+
+	uint32 deletedRows = 0;
+	
+	ReadChunkGroupRowCounts(storageId, stripeId, chunkCount,
+							&chunkGroupRowCounts, &chunkGroupDeletedRows,
+							GetTransactionSnapshot());
+
+	for (i = 0; i < chunkCount; i++)
+	{
+		deletedRows += chunkGroupDeletedRows[i];
+	}
+
+	pfree(chunkGroupRowCounts);
+	pfree(chunkGroupDeletedRows);
+
+	return deletedRows;
+}
+
+
+/*
+ * ChunkGroupRowCountsForStripe reads the row count and the deleted row count
+ * of each chunk group of the given stripe into arrays of chunkCount elements
+ * allocated in the current memory context.
+ */
+void
+ChunkGroupRowCountsForStripe(RelFileNode relfilenode, uint32 chunkCount, uint64 stripeId,
+							 uint32 **chunkGroupRowCounts, uint32 **chunkGroupDeletedRows)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	ReadChunkGroupRowCounts(storageId, stripeId, chunkCount, chunkGroupRowCounts,
+							chunkGroupDeletedRows, GetTransactionSnapshot());
+}
+
+
+/*
+ * GetHighestUsedAddress returns the highest used address for the given
+ * relfilenode across all active and inactive transactions.
+ *
+ * This is used by truncate stage of VACUUM, and VACUUM can be called
+ * for empty tables. So this doesn't throw errors for empty tables and
+ * returns 0.
+ */
+uint64
+GetHighestUsedAddress(RelFileNode relfilenode)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	uint64 highestUsedAddress = 0;
+	uint64 highestUsedId = 0;
+	GetHighestUsedAddressAndId(storageId, &highestUsedAddress, &highestUsedId);
+
+	return highestUsedAddress;
+}
+
+
+/*
+ * GetHighestUsedAddressAndId returns the highest used address and id for
+ * the given relfilenode across all active and inactive transactions.
+ */
+static void
+GetHighestUsedAddressAndId(uint64 storageId,
+						   uint64 *highestUsedAddress,
+						   uint64 *highestUsedId)
+{
+	ListCell *stripeMetadataCell = NULL;
+
+	SnapshotData SnapshotDirty;
+	InitDirtySnapshot(SnapshotDirty);
+
+	List *stripeMetadataList = ReadDataFileStripeList(storageId, &SnapshotDirty,
+													  ForwardScanDirection);
+
+	*highestUsedId = 0;
+
+	/* file starts with metapage */
+	*highestUsedAddress = COLUMNAR_BYTES_PER_PAGE;
+
+	foreach(stripeMetadataCell, stripeMetadataList)
+	{
+		StripeMetadata *stripe = lfirst(stripeMetadataCell);
+		*highestUsedId = Max(*highestUsedId, stripe->id);
+
+		/* offloaded stripes don't use the storage of the table */
+		if (ColumnarLogicalOffsetIsOffloaded(stripe->fileOffset))
+		{
+			continue;
+		}
+
+		uint64 lastByte = stripe->fileOffset + stripe->dataLength - 1;
+		*highestUsedAddress = Max(*highestUsedAddress, lastByte);
+	}
+}
+
+
+/*
+ * ReserveEmptyStripe reserves an empty stripe for given relation
+ * and inserts it into columnar.stripe. It is guaranteed that concurrent
+ * writes won't overwrite the returned stripe.
+ *
+ * If batch is given, the stripe is taken from it. An empty batch is refilled
+ * with a bulk reservation, which doubles in size each time up to
+ * STRIPE_RESERVATION_BATCH_MAX stripes, so long running writes update the
+ * metapage less often while a write of a single stripe reserves just that.
+ */
+EmptyStripeReservation *
+ReserveEmptyStripe(Relation rel, uint64 columnCount, uint64 chunkGroupRowCount,
+				   uint64 stripeRowCount, StripeReservationBatch *batch)
+{
+	EmptyStripeReservation *stripeReservation = palloc0(sizeof(EmptyStripeReservation));
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+
+	if (batch == NULL)
+	{
+		stripeReservation->stripeId = ColumnarStorageReserveStripeId(rel);
+		stripeReservation->stripeFirstRowNumber =
+			ColumnarStorageReserveRowNumber(rel, stripeRowCount);
+	}
+	else
+	{
+		if (batch->remainingStripeCount == 0)
+		{
+			uint32 batchSize = Max(batch->nextBatchSize, 1);
+
+			batch->nextStripeId = ColumnarStorageReserveStripes(rel, batchSize,
+																stripeRowCount,
+																&batch->nextRowNumber);
+			batch->remainingStripeCount = batchSize;
+			batch->nextBatchSize = Min(batchSize * 2, STRIPE_RESERVATION_BATCH_MAX);
+		}
+
+		stripeReservation->stripeId = batch->nextStripeId;
+		stripeReservation->stripeFirstRowNumber = batch->nextRowNumber;
+
+		batch->nextStripeId++;
+		batch->nextRowNumber += stripeRowCount;
+		batch->remainingStripeCount--;
+	}
+
+	/*
+	 * XXX: Instead of inserting a dummy entry to columnar.stripe and
+	 * updating it when flushing the stripe, we could have a hash table
+	 * in shared memory for the bookkeeping of ongoing writes.
+	 */
+	InsertEmptyStripeMetadataRow(storageId, stripeReservation->stripeId,
+								 columnCount, chunkGroupRowCount,
+								 stripeReservation->stripeFirstRowNumber);
+
+	return stripeReservation;
+}
+
+
+/*
+ * ReleaseStripeReservationBatch gives back the stripes of the batch that
+ * weren't used, so that a writer finishing in the middle of a batch doesn't
+ * leave a gap in stripe ids when no other writer reserved stripes since.
+ */
+void
+ReleaseStripeReservationBatch(Relation rel, StripeReservationBatch *batch,
+							  uint64 stripeRowCount)
+{
+	if (batch->remainingStripeCount == 0)
+	{
+		return;
+	}
+
+	uint64 endStripeId = batch->nextStripeId + batch->remainingStripeCount;
+	uint64 endRowNumber = batch->nextRowNumber +
+						  batch->remainingStripeCount * stripeRowCount;
+
+	ColumnarStorageReleaseStripes(rel, batch->nextStripeId, endStripeId,
+								  batch->nextRowNumber, endRowNumber);
+
+	batch->remainingStripeCount = 0;
+}
+
+
+/*
+ * CompleteStripeReservation completes reservation of the stripe with
+ * stripeId for given size and in-place updates related stripe metadata tuple
+ * to complete reservation. bucket is the bucket_by bucket all rows of the
+ * stripe belong to, or -1.
+ */
+StripeMetadata *
+CompleteStripeReservation(Relation rel, uint64 stripeId, uint64 sizeBytes,
+						  uint64 rowCount, uint64 chunkCount, int32 bucket)
+{
+	uint64 resLogicalStart = ColumnarStorageReserveData(rel, sizeBytes);
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+
+	bool update[Natts_columnar_stripe] = { false };
+	update[Anum_columnar_stripe_file_offset - 1] = true;
+	update[Anum_columnar_stripe_data_length - 1] = true;
+	update[Anum_columnar_stripe_row_count - 1] = true;
+	update[Anum_columnar_stripe_chunk_count - 1] = true;
+	update[Anum_columnar_stripe_bucket - 1] = true;
+
+	Datum newValues[Natts_columnar_stripe] = { 0 };
+	newValues[Anum_columnar_stripe_file_offset - 1] = Int64GetDatum(resLogicalStart);
+	newValues[Anum_columnar_stripe_data_length - 1] = Int64GetDatum(sizeBytes);
+	newValues[Anum_columnar_stripe_row_count - 1] = UInt64GetDatum(rowCount);
+	newValues[Anum_columnar_stripe_chunk_count - 1] = Int32GetDatum(chunkCount);
+	newValues[Anum_columnar_stripe_bucket - 1] = Int32GetDatum(bucket);
+
+	ColumnarInvalidateStripeListSummary(rel);
+
+	return UpdateStripeMetadataRow(storageId, stripeId, update, newValues);
+}
+
+
+/*
+ * UpdateStripeMetadataRow updates stripe metadata tuple for the stripe with
+ * stripeId according to given newValues and update arrays.
+ * Note that this function shouldn't be used for the cases where any indexes
+ * of stripe metadata should be updated according to modifications done.
+ */
+static StripeMetadata *
+UpdateStripeMetadataRow(uint64 storageId, uint64 stripeId, bool *update,
+						Datum *newValues)
+{
+	SnapshotData dirtySnapshot;
+	InitDirtySnapshot(dirtySnapshot);
+
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_stripe,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripeId));
+
+	Oid columnarStripesOid = ColumnarStripeRelationId();
+
+	Relation columnarStripes = table_open(columnarStripesOid, AccessShareLock);
+	Relation columnarStripePkeyIndex = index_open(ColumnarStripePKeyIndexRelationId(),
+												  AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes,
+															columnarStripePkeyIndex,
+															&dirtySnapshot, 2, scanKey);
+
+	HeapTuple oldTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (!HeapTupleIsValid(oldTuple))
+	{
+		ereport(ERROR, (errmsg("attempted to modify an unexpected stripe, "
+							   "columnar storage with id=" UINT64_FORMAT
+							   " does not have stripe with id=" UINT64_FORMAT,
+							   storageId, stripeId)));
+	}
+
+	/*
+	 * heap_inplace_update already doesn't allow changing size of the original
+	 * tuple, so we don't allow setting any Datum's to NULL values.
+	 */
+	bool newNulls[Natts_columnar_stripe] = { false };
+	TupleDesc tupleDescriptor = RelationGetDescr(columnarStripes);
+	HeapTuple modifiedTuple = heap_modify_tuple(oldTuple, tupleDescriptor,
+												newValues, newNulls, update);
+
+	heap_inplace_update(columnarStripes, modifiedTuple);
+
+	/*
+	 * Existing tuple now contains modifications, because we used
+	 * heap_inplace_update().
+	 */
+	HeapTuple newTuple = oldTuple;
+
+	/*
+	 * Must not pass modifiedTuple, because BuildStripeMetadata expects a real
+	 * heap tuple with MVCC fields.
+	 */
+	StripeMetadata *modifiedStripeMetadata = BuildStripeMetadata(columnarStripes,
+																 newTuple);
+
+	CommandCounterIncrement();
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(columnarStripePkeyIndex, AccessShareLock);
+	table_close(columnarStripes, AccessShareLock);
+
+	/* return StripeMetadata object built from modified tuple */
+	return modifiedStripeMetadata;
+}
+
+
+/*
+ * ReadDataFileStripeList reads the stripe list for a given storageId
+ * in the given snapshot.
+ */
+static List *
+ReadDataFileStripeList(uint64 storageId, Snapshot snapshot, ScanDirection scanDirection)
+{
+	List *stripeMetadataList = NIL;
+	ScanKeyData scanKey[1];
+	HeapTuple heapTuple;
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+
+	Oid columnarStripesOid = ColumnarStripeRelationId();
+
+	Relation columnarStripes = table_open(columnarStripesOid, AccessShareLock);
+	Relation index = index_open(ColumnarStripeFirstRowNumberIndexRelationId(),
+								AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
+															snapshot, 1,
+															scanKey);
+
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 scanDirection)))
+	{
+		StripeMetadata *stripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
+		stripeMetadataList = lappend(stripeMetadataList, stripeMetadata);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripes, AccessShareLock);
+
+	return stripeMetadataList;
+}
+
+
+/*
+ * BuildStripeMetadata builds a StripeMetadata object from given heap tuple.
+ *
+ * NB: heapTuple must be a proper heap tuple with MVCC fields.
+ */
+static StripeMetadata *
+BuildStripeMetadata(Relation columnarStripes, HeapTuple heapTuple)
+{
+	Assert(RelationGetRelid(columnarStripes) == ColumnarStripeRelationId());
+
+	Datum datumArray[Natts_columnar_stripe];
+	bool isNullArray[Natts_columnar_stripe];
+	heap_deform_tuple(heapTuple, RelationGetDescr(columnarStripes),
+					  datumArray, isNullArray);
+
+	StripeMetadata *stripeMetadata = palloc0(sizeof(StripeMetadata));
+	stripeMetadata->id = DatumGetInt64(datumArray[Anum_columnar_stripe_stripe - 1]);
+	stripeMetadata->fileOffset = DatumGetInt64(
+		datumArray[Anum_columnar_stripe_file_offset - 1]);
+	stripeMetadata->dataLength = DatumGetInt64(
+		datumArray[Anum_columnar_stripe_data_length - 1]);
+	stripeMetadata->columnCount = DatumGetInt32(
+		datumArray[Anum_columnar_stripe_column_count - 1]);
+	stripeMetadata->chunkCount = DatumGetInt32(
+		datumArray[Anum_columnar_stripe_chunk_count - 1]);
+	stripeMetadata->chunkGroupRowCount = DatumGetInt32(
+		datumArray[Anum_columnar_stripe_chunk_row_count - 1]);
+	stripeMetadata->rowCount = DatumGetInt64(
+		datumArray[Anum_columnar_stripe_row_count - 1]);
+	stripeMetadata->firstRowNumber = DatumGetUInt64(
+		datumArray[Anum_columnar_stripe_first_row_number - 1]);
+	stripeMetadata->bucket = -1;
+	if (RelationGetDescr(columnarStripes)->natts >= Anum_columnar_stripe_bucket)
+	{
+		stripeMetadata->bucket = DatumGetInt32(
+			datumArray[Anum_columnar_stripe_bucket - 1]);
+	}
+
+	/*
+	 * If there is unflushed data in a parent transaction, then we would
+	 * have already thrown an error before starting to scan the table.. If
+	 * the data is from an earlier subxact that committed, then it would
+	 * have been flushed already. For this reason, we don't care about
+	 * subtransaction id here.
+	 */
+	TransactionId entryXmin = HeapTupleHeaderGetXmin(heapTuple->t_data);
+	stripeMetadata->aborted = !TransactionIdIsInProgress(entryXmin) &&
+							  TransactionIdDidAbort(entryXmin);
+	stripeMetadata->insertedByCurrentXact =
+		TransactionIdIsCurrentTransactionId(entryXmin);
+	stripeMetadata->insertXid = entryXmin;
+
+	CheckStripeMetadataConsistency(stripeMetadata);
+
+	return stripeMetadata;
+}
+
+
+/*
+ * DeleteMetadataRows removes the rows with given relfilenode from columnar
+ * metadata tables.
+ */
+void
+DeleteMetadataRows(RelFileNode relfilenode)
+{
+	/*
+	 * During a restore for binary upgrade, metadata tables and indexes may or
+	 * may not exist.
+	 */
+	if (IsBinaryUpgrade)
+	{
+		return;
+	}
+
+	DeleteStorageMetadataRows(LookupStorageId(relfilenode));
+}
+
+
+/*
+ * DeleteStorageMetadataRows removes the rows with given storage id from
+ * columnar metadata tables.
+ */
+void
+DeleteStorageMetadataRows(uint64 storageId)
+{
+	ColumnarSkipListCacheInvalidateStorage(storageId);
+	TransactionReadCacheInvalidate(storageId);
+
+	DeleteStorageFromColumnarMetadataTable(ColumnarStripeRelationId(),
+										   Anum_columnar_stripe_storageid,
+										   ColumnarStripePKeyIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarChunkGroupRelationId(),
+										   Anum_columnar_chunkgroup_storageid,
+										   ColumnarChunkGroupIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarChunkRelationId(),
+										   Anum_columnar_chunk_storageid,
+										   ColumnarChunkIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarStripeSkipListRelationId(),
+										   Anum_columnar_stripe_skip_list_storageid,
+										   ColumnarStripeSkipListIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarStripeProjectionRelationId(),
+										   Anum_columnar_stripe_projection_storageid,
+										   ColumnarStripeProjectionIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarRowMaskRelationId(),
+										   Anum_columnar_row_mask_storage_id,
+										   ColumnarRowMaskIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarStripeAttrRelationId(),
+										   Anum_columnar_stripe_attr_storageid,
+										   ColumnarStripeAttrIndexRelationId(),
+										   storageId);
+
+	if (OidIsValid(ColumnarCompressionDictionaryRelationId()))
+	{
+		DeleteStorageFromColumnarMetadataTable(
+			ColumnarCompressionDictionaryRelationId(),
+			Anum_columnar_compression_dictionary_storage_id,
+			ColumnarCompressionDictionaryIndexRelationId(),
+			storageId);
+	}
+
+	if (OidIsValid(ColumnarDeltaStoreRelationId()))
+	{
+		DeleteStorageFromColumnarMetadataTable(ColumnarDeltaStoreRelationId(),
+											   Anum_columnar_delta_store_storage_id,
+											   ColumnarDeltaStoreIndexRelationId(),
+											   storageId);
+	}
+}
+
+
+/*
+ * DeleteMetadataRowsForStripeId removes the rows with given relfilenode and 
+ * stripe id from columnar metadata tables.
+ */
+void
+DeleteMetadataRowsForStripeId(RelFileNode relfilenode, uint64 stripeId)
+{
+	/*
+	 * During a restore for binary upgrade, metadata tables and indexes may or
+	 * may not exist.
+	 */
+	if (IsBinaryUpgrade)
+	{
+		return;
+	}
+
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	ColumnarSkipListCacheInvalidateStripe(storageId, stripeId);
+	TransactionReadCacheInvalidate(storageId);
+
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarStripeRelationId(),
+		Anum_columnar_stripe_storageid,
+		Anum_columnar_stripe_stripe,
+		ColumnarStripePKeyIndexRelationId(),
+		storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarChunkGroupRelationId(),
+		Anum_columnar_chunkgroup_storageid,
+		Anum_columnar_chunkgroup_stripe,
+		ColumnarChunkGroupIndexRelationId(),
+		storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarChunkRelationId(),
+		Anum_columnar_chunk_storageid,
+		Anum_columnar_chunk_stripe,
+		ColumnarChunkIndexRelationId(),
+		storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarStripeSkipListRelationId(),
+		Anum_columnar_stripe_skip_list_storageid,
+		Anum_columnar_stripe_skip_list_stripe,
+		ColumnarStripeSkipListIndexRelationId(),
+		storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarStripeProjectionRelationId(),
+		Anum_columnar_stripe_projection_storageid,
+		Anum_columnar_stripe_projection_stripe,
+		ColumnarStripeProjectionIndexRelationId(),
+		storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarRowMaskRelationId(),
+		Anum_columnar_row_mask_storage_id,
+		Anum_columnar_row_mask_stripe_id,
+		ColumnarRowMaskStripeIndexRelationId(),
+		storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarStripeAttrRelationId(),
+		Anum_columnar_stripe_attr_storageid,
+		Anum_columnar_stripe_attr_stripe,
+		ColumnarStripeAttrIndexRelationId(),
+		storageId, stripeId);
+}
+
+
+/*
+ * ReplaceStripeMetadata swaps the given stripe for a copy of it with the new
+ * stripe id, whose data the caller wrote at fileOffset as described by the
+ * given skip list. The copy keeps the row numbers, chunk groups, row masks,
+ * summaries and projection of the stripe.
+ *
+ * Stripe ids are never reused, so the cached skip lists of other backends
+ * can't go stale, and transactions that still see the old stripe read its
+ * data where it was. Callers must lock the relation against writes.
+ */
+StripeMetadata *
+ReplaceStripeMetadata(Relation rel, StripeMetadata *stripeMetadata, uint64 newStripeId,
+					  uint64 fileOffset, uint64 dataLength, StripeSkipList *skipList,
+					  TupleDesc tupleDescriptor)
+{
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	uint64 oldStripeId = stripeMetadata->id;
+
+	ColumnarSkipListCacheInvalidateStripe(storageId, oldStripeId);
+	TransactionReadCacheInvalidate(storageId);
+
+	/* first_row_number is unique, so the old row has to go first */
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarStripeRelationId(),
+		Anum_columnar_stripe_storageid,
+		Anum_columnar_stripe_stripe,
+		ColumnarStripePKeyIndexRelationId(),
+		storageId, oldStripeId);
+
+	bool nulls[Natts_columnar_stripe] = { false };
+	Datum values[Natts_columnar_stripe] = { 0 };
+	values[Anum_columnar_stripe_storageid - 1] = UInt64GetDatum(storageId);
+	values[Anum_columnar_stripe_stripe - 1] = UInt64GetDatum(newStripeId);
+	values[Anum_columnar_stripe_file_offset - 1] = UInt64GetDatum(fileOffset);
+	values[Anum_columnar_stripe_data_length - 1] = UInt64GetDatum(dataLength);
+	values[Anum_columnar_stripe_column_count - 1] =
+		UInt32GetDatum(stripeMetadata->columnCount);
+	values[Anum_columnar_stripe_chunk_row_count - 1] =
+		UInt32GetDatum(stripeMetadata->chunkGroupRowCount);
+	values[Anum_columnar_stripe_row_count - 1] =
+		UInt64GetDatum(stripeMetadata->rowCount);
+	values[Anum_columnar_stripe_chunk_count - 1] =
+		UInt32GetDatum(stripeMetadata->chunkCount);
+	values[Anum_columnar_stripe_first_row_number - 1] =
+		UInt64GetDatum(stripeMetadata->firstRowNumber);
+	values[Anum_columnar_stripe_bucket - 1] =
+		Int32GetDatum(stripeMetadata->bucket);
+
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(columnarStripes);
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	FinishModifyRelation(modifyState);
+	table_close(columnarStripes, RowExclusiveLock);
+
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarChunkRelationId(),
+		Anum_columnar_chunk_storageid,
+		Anum_columnar_chunk_stripe,
+		ColumnarChunkIndexRelationId(),
+		storageId, oldStripeId);
+	DeleteStripeFromColumnarMetadataTable(
+		ColumnarStripeSkipListRelationId(),
+		Anum_columnar_stripe_skip_list_storageid,
+		Anum_columnar_stripe_skip_list_stripe,
+		ColumnarStripeSkipListIndexRelationId(),
+		storageId, oldStripeId);
+	SaveStripeSkipList(rel->rd_node, newStripeId, skipList, tupleDescriptor);
+
+	MoveStripeInColumnarMetadataTable(
+		ColumnarChunkGroupRelationId(),
+		Anum_columnar_chunkgroup_storageid,
+		Anum_columnar_chunkgroup_stripe,
+		ColumnarChunkGroupIndexRelationId(),
+		storageId, oldStripeId, newStripeId);
+	MoveStripeInColumnarMetadataTable(
+		ColumnarRowMaskRelationId(),
+		Anum_columnar_row_mask_storage_id,
+		Anum_columnar_row_mask_stripe_id,
+		ColumnarRowMaskStripeIndexRelationId(),
+		storageId, oldStripeId, newStripeId);
+	MoveStripeInColumnarMetadataTable(
+		ColumnarStripeAttrRelationId(),
+		Anum_columnar_stripe_attr_storageid,
+		Anum_columnar_stripe_attr_stripe,
+		ColumnarStripeAttrIndexRelationId(),
+		storageId, oldStripeId, newStripeId);
+	MoveStripeInColumnarMetadataTable(
+		ColumnarStripeProjectionRelationId(),
+		Anum_columnar_stripe_projection_storageid,
+		Anum_columnar_stripe_projection_stripe,
+		ColumnarStripeProjectionIndexRelationId(),
+		storageId, oldStripeId, newStripeId);
+
+	ColumnarInvalidateStripeListSummary(rel);
+
+	StripeMetadata *newStripeMetadata = palloc(sizeof(StripeMetadata));
+	*newStripeMetadata = *stripeMetadata;
+	newStripeMetadata->id = newStripeId;
+	newStripeMetadata->fileOffset = fileOffset;
+	newStripeMetadata->dataLength = dataLength;
+	newStripeMetadata->insertedByCurrentXact = true;
+	newStripeMetadata->insertXid = GetCurrentTransactionId();
+
+	return newStripeMetadata;
+}
+
+
+/*
+ * DeleteStorageFromColumnarMetadataTable removes the rows with given
+ * storageId from given columnar metadata table.
+ */
+static void
+DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
+									   AttrNumber storageIdAtrrNumber,
+									   Oid storageIdIndexId, uint64 storageId)
+{
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(storageId));
+
+	Relation metadataTable = try_relation_open(metadataTableId, AccessShareLock);
+	if (metadataTable == NULL)
+	{
+		/* extension has been dropped */
+		return;
+	}
+
+	Relation index = index_open(storageIdIndexId, AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(metadataTable, index, NULL,
+															1, scanKey);
+
+	ModifyState *modifyState = StartModifyRelation(metadataTable);
+
+	HeapTuple heapTuple;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+
+	FinishModifyRelation(modifyState);
+
+	index_close(index, AccessShareLock);
+	table_close(metadataTable, AccessShareLock);
+}
+
+
+/*
+ * DeleteStripeFromColumnarMetadataTable removes the rows in columnar
+ * metadata table that match storageId and stripeId.
+ */
+static void
+DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
+									  AttrNumber storageIdAtrrNumber,
+									  AttrNumber stripeIdAttrNumber,
+									  Oid storageIdIndexId,
+									  uint64 storageId,
+									  uint64 stripeId)
+{
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], stripeIdAttrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(stripeId));
+
+	Relation metadataTable = try_relation_open(metadataTableId, RowShareLock);
+	if (metadataTable == NULL)
+	{
+		/* extension has been dropped */
+		return;
+	}
+
+	Relation index = index_open(storageIdIndexId, RowShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(metadataTable, index, NULL,
+															2, scanKey);
 
-	ScanKeyData scanKey[3];
-	ScanKeyInit(&scanKey[0], Anum_columnar_chunkgroup_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, UInt64GetDatum(storageId));
-	ScanKeyInit(&scanKey[1], Anum_columnar_chunkgroup_stripe,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripe));
-	ScanKeyInit(&scanKey[2], Anum_columnar_chunkgroup_chunk,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(chunkGroupId));
+	ModifyState *modifyState = StartModifyRelation(metadataTable);
 
-	SysScanDesc scanDescriptor =
-		systable_beginscan_ordered(columnarChunkGroup, index, NULL, 3, scanKey);
+	HeapTuple heapTuple;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+	}
 
-	oldHeapTuple = systable_getnext_ordered(scanDescriptor, BackwardScanDirection);
+	systable_endscan_ordered(scanDescriptor);
 
-	index_close(index, AccessShareLock);
+	FinishModifyRelation(modifyState);
 
-	if (HeapTupleIsValid(oldHeapTuple))
+	index_close(index, RowShareLock);
+	table_close(metadataTable, RowShareLock);
+}
+
+
+/*
+ * MoveStripeInColumnarMetadataTable replaces the rows in columnar metadata
+ * table that match storageId and oldStripeId with copies that have
+ * newStripeId instead.
+ */
+static void
+MoveStripeInColumnarMetadataTable(Oid metadataTableId,
+								  AttrNumber storageIdAtrrNumber,
+								  AttrNumber stripeIdAttrNumber,
+								  Oid storageIdIndexId,
+								  uint64 storageId,
+								  uint64 oldStripeId,
+								  uint64 newStripeId)
+{
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], stripeIdAttrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(oldStripeId));
+
+	Relation metadataTable = try_relation_open(metadataTableId, RowExclusiveLock);
+	if (metadataTable == NULL)
 	{
-		bool update[Natts_columnar_chunkgroup] = { 0 };
-		bool nulls[Natts_columnar_chunkgroup] = { 0 };
-		Datum values[Natts_columnar_chunkgroup] = { 0 };
+		/* extension has been dropped */
+		return;
+	}
 
-		// Update deleted row count
-		update[Anum_columnar_chunkgroup_deleted_rows - 1] = true;
-		values[Anum_columnar_chunkgroup_deleted_rows - 1] = (deletedRowNumber);
+	TupleDesc tupleDescriptor = RelationGetDescr(metadataTable);
+	Datum *values = palloc(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc(tupleDescriptor->natts * sizeof(bool));
 
-		HeapTuple newHeapTuple = heap_modify_tuple(oldHeapTuple, tupleDescriptor,
-												   values, nulls, update);
+	Relation index = index_open(storageIdIndexId, RowExclusiveLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(metadataTable, index, NULL,
+															2, scanKey);
 
-		CatalogTupleUpdate(columnarChunkGroup, &oldHeapTuple->t_self, newHeapTuple);
+	ModifyState *modifyState = StartModifyRelation(metadataTable);
 
-		heap_freetuple(newHeapTuple);
+	HeapTuple heapTuple;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		heap_deform_tuple(heapTuple, tupleDescriptor, values, nulls);
+		values[stripeIdAttrNumber - 1] = UInt64GetDatum(newStripeId);
+
+		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+		InsertTupleAndEnforceConstraints(modifyState, values, nulls);
 	}
 
 	systable_endscan_ordered(scanDescriptor);
-	table_close(columnarChunkGroup, AccessShareLock);
 
-	CommandCounterIncrement();
+	FinishModifyRelation(modifyState);
+
+	index_close(index, RowExclusiveLock);
+	table_close(metadataTable, RowExclusiveLock);
+
+	pfree(values);
+	pfree(nulls);
 }
 
 
 /*
- * InsertEmptyStripeMetadataRow adds a row to columnar.stripe for the empty
- * stripe reservation made for stripeId.
+ * StartModifyRelation allocates resources for modifications.
+ */
+static ModifyState *
+StartModifyRelation(Relation rel)
+{
+	EState *estate = create_estate_for_relation(rel);
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
+#else
+	ResultRelInfo *resultRelInfo = estate->es_result_relation_info;
+#endif
+
+	/* ExecSimpleRelationInsert, ... require caller to open indexes */
+	ExecOpenIndices(resultRelInfo, false);
+
+	ModifyState *modifyState = palloc(sizeof(ModifyState));
+	modifyState->rel = rel;
+	modifyState->estate = estate;
+	modifyState->resultRelInfo = resultRelInfo;
+
+	return modifyState;
+}
+
+
+/*
+ * InsertTupleAndEnforceConstraints inserts a tuple into a relation and makes
+ * sure constraints are enforced and indexes are updated.
  */
 static void
-InsertEmptyStripeMetadataRow(uint64 storageId, uint64 stripeId, uint32 columnCount,
-							 uint32 chunkGroupRowCount, uint64 firstRowNumber)
+InsertTupleAndEnforceConstraints(ModifyState *state, Datum *values, bool *nulls)
 {
-	bool nulls[Natts_columnar_stripe] = { false };
+	TupleDesc tupleDescriptor = RelationGetDescr(state->rel);
+	HeapTuple tuple = heap_form_tuple(tupleDescriptor, values, nulls);
 
-	Datum values[Natts_columnar_stripe] = { 0 };
-	values[Anum_columnar_stripe_storageid - 1] =
-		UInt64GetDatum(storageId);
-	values[Anum_columnar_stripe_stripe - 1] =
-		UInt64GetDatum(stripeId);
-	values[Anum_columnar_stripe_column_count - 1] =
-		UInt32GetDatum(columnCount);
-	values[Anum_columnar_stripe_chunk_row_count - 1] =
-		UInt32GetDatum(chunkGroupRowCount);
-	values[Anum_columnar_stripe_first_row_number - 1] =
-		UInt64GetDatum(firstRowNumber);
+	TupleTableSlot *slot = ExecInitExtraTupleSlot(state->estate, tupleDescriptor,
+												  &TTSOpsHeapTuple);
 
-	/* stripe has no rows yet, so initialize rest of the columns accordingly */
-	values[Anum_columnar_stripe_row_count - 1] =
-		UInt64GetDatum(0);
-	values[Anum_columnar_stripe_file_offset - 1] =
-		UInt64GetDatum(ColumnarInvalidLogicalOffset);
-	values[Anum_columnar_stripe_data_length - 1] =
-		UInt64GetDatum(0);
-	values[Anum_columnar_stripe_chunk_count - 1] =
-		UInt32GetDatum(0);
+	ExecStoreHeapTuple(tuple, slot, false);
 
-	Oid columnarStripesOid = ColumnarStripeRelationId();
-	Relation columnarStripes = table_open(columnarStripesOid, RowExclusiveLock);
+	/* use ExecSimpleRelationInsert to enforce constraints */
+	ExecSimpleRelationInsert_compat(state->resultRelInfo, state->estate, slot);
+}
+
+
+/*
+ * DeleteTupleAndEnforceConstraints deletes a tuple from a relation and
+ * makes sure constraints (e.g. FK constraints) are enforced.
+ */
+static void
+DeleteTupleAndEnforceConstraints(ModifyState *state, HeapTuple heapTuple)
+{
+	EState *estate = state->estate;
+	ResultRelInfo *resultRelInfo = state->resultRelInfo;
+
+	ItemPointer tid = &(heapTuple->t_self);
+	simple_heap_delete(state->rel, tid);
+
+	/* execute AFTER ROW DELETE Triggers to enforce constraints */
+#if PG_VERSION_NUM >= PG_VERSION_15
+	ExecARDeleteTriggers(estate, resultRelInfo, tid, NULL, NULL, true);
+#else
+	ExecARDeleteTriggers(estate, resultRelInfo, tid, NULL, NULL);
+#endif
+}
+
+
+/*
+ * FinishModifyRelation cleans up resources after modifications are done.
+ */
+static void
+FinishModifyRelation(ModifyState *state)
+{
+	ExecCloseIndices(state->resultRelInfo);
+
+	AfterTriggerEndQuery(state->estate);
+#if PG_VERSION_NUM >= PG_VERSION_14
+	ExecCloseResultRelations(state->estate);
+	ExecCloseRangeTableRelations(state->estate);
+#else
+	ExecCleanUpTriggerState(state->estate);
+#endif
+	ExecResetTupleTable(state->estate->es_tupleTable, false);
+	FreeExecutorState(state->estate);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * Based on a similar function from
+ * postgres/src/backend/replication/logical/worker.c.
+ *
+ * Executor state preparation for evaluation of constraint expressions,
+ * indexes and triggers.
+ *
+ * This is based on similar code in copy.c
+ */
+EState *
+create_estate_for_relation(Relation rel)
+{
+	EState *estate = CreateExecutorState();
+
+	RangeTblEntry *rte = makeNode(RangeTblEntry);
+	rte->rtekind = RTE_RELATION;
+	rte->relid = RelationGetRelid(rel);
+	rte->relkind = rel->rd_rel->relkind;
+	rte->rellockmode = AccessShareLock;
+	ExecInitRangeTable(estate, list_make1(rte));
+
+#if PG_VERSION_NUM < PG_VERSION_14
+	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
+
+	estate->es_result_relations = resultRelInfo;
+	estate->es_num_result_relations = 1;
+	estate->es_result_relation_info = resultRelInfo;
+#endif
+
+	estate->es_output_cid = GetCurrentCommandId(true);
+
+	/* Prepare to catch AFTER triggers. */
+	AfterTriggerBeginQuery();
+
+	return estate;
+}
+
+
+/*
+ * DatumToBytea serializes a datum into a bytea value.
+ */
+static bytea *
+DatumToBytea(Datum value, Form_pg_attribute attrForm)
+{
+	int datumLength = att_addlength_datum(0, attrForm->attlen, value);
+	bytea *result = palloc0(datumLength + VARHDRSZ);
+
+	SET_VARSIZE(result, datumLength + VARHDRSZ);
+
+	if (attrForm->attlen > 0)
+	{
+		if (attrForm->attbyval)
+		{
+			Datum tmp;
+			store_att_byval(&tmp, value, attrForm->attlen);
+
+			memcpy_s(VARDATA(result), datumLength + VARHDRSZ,
+					 &tmp, attrForm->attlen);
+		}
+		else
+		{
+			memcpy_s(VARDATA(result), datumLength + VARHDRSZ,
+					 DatumGetPointer(value), attrForm->attlen);
+		}
+	}
+	else
+	{
+		memcpy_s(VARDATA(result), datumLength + VARHDRSZ,
+				 DatumGetPointer(value), datumLength);
+	}
 
-	ModifyState *modifyState = StartModifyRelation(columnarStripes);
+	return result;
+}
 
-	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
 
-	FinishModifyRelation(modifyState);
+/*
+ * ByteaToDatum deserializes a value which was previously serialized using
+ * DatumToBytea.
+ */
+static Datum
+ByteaToDatum(bytea *bytes, Form_pg_attribute attrForm)
+{
+	/*
+	 * We copy the data so the result of this function lives even
+	 * after the byteaDatum is freed.
+	 */
+	char *binaryDataCopy = palloc0(VARSIZE_ANY_EXHDR(bytes));
+	memcpy_s(binaryDataCopy, VARSIZE_ANY_EXHDR(bytes),
+			 VARDATA_ANY(bytes), VARSIZE_ANY_EXHDR(bytes));
 
-	table_close(columnarStripes, RowExclusiveLock);
+	return fetch_att(binaryDataCopy, attrForm->attbyval, attrForm->attlen);
 }
 
 
 /*
- * StripesForRelfilenode returns a list of StripeMetadata for stripes
- * of the given relfilenode.
+ * ColumnarStorageIdSequenceRelationId returns relation id of columnar.stripe.
+ * TODO: should we cache this similar to citus?
  */
-List *
-StripesForRelfilenode(RelFileNode relfilenode, ScanDirection scanDirection)
+static Oid
+ColumnarStorageIdSequenceRelationId(void)
 {
-	uint64 storageId = LookupStorageId(relfilenode);
-
-	return ReadDataFileStripeList(storageId, GetTransactionSnapshot(), scanDirection);
+	return get_relname_relid("storageid_seq", ColumnarNamespaceId());
 }
 
 
 /*
- * DeletedRowsForStripe returns number of deleted rows for stripe
- * of the given relfilenode.
+ * ColumnarStripeRelationId returns relation id of columnar.stripe.
+ * TODO: should we cache this similar to citus?
  */
-uint32
-DeletedRowsForStripe(RelFileNode relfilenode, uint32 chunkCount, uint64 stripeId)
+static Oid
+ColumnarStripeRelationId(void)
 {
-	uint64 storageId = LookupStorageId(relfilenode);
-
-	uint32 *chunkGroupRowCounts;
-	uint32 *chunkGroupDeletedRows;
-	int i;
+	return get_relname_relid("stripe", ColumnarNamespaceId());
+}
 
-	uint32 deletedRows = 0;
-	
-	ReadChunkGroupRowCounts(storageId, stripeId, chunkCount,
-							&chunkGroupRowCounts, &chunkGroupDeletedRows,
-							GetTransactionSnapshot());
 
-	for (i = 0; i < chunkCount; i++)
-	{
-		deletedRows += chunkGroupDeletedRows[i];
-	}
+/*
+ * ColumnarStripePKeyIndexRelationId returns relation id of columnar.stripe_pkey.
+ * TODO: should we cache this similar to citus?
+ */
+static Oid
+ColumnarStripePKeyIndexRelationId(void)
+{
+	return get_relname_relid("stripe_pkey", ColumnarNamespaceId());
+}
 
-	pfree(chunkGroupRowCounts);
-	pfree(chunkGroupDeletedRows);
 
-	return deletedRows;
+/*
+ * ColumnarStripeFirstRowNumberIndexRelationId returns relation id of
+ * columnar.stripe_first_row_number_idx.
+ * TODO: should we cache this similar to citus?
+ */
+static Oid
+ColumnarStripeFirstRowNumberIndexRelationId(void)
+{
+	return get_relname_relid("stripe_first_row_number_idx", ColumnarNamespaceId());
 }
 
 
 /*
- * GetHighestUsedAddress returns the highest used address for the given
- * relfilenode across all active and inactive transactions.
- *
- * This is used by truncate stage of VACUUM, and VACUUM can be called
- * for empty tables. So this doesn't throw errors for empty tables and
- * returns 0.
+ * ColumnarOptionsRelationId returns relation id of columnar.options.
  */
-uint64
-GetHighestUsedAddress(RelFileNode relfilenode)
+static Oid
+ColumnarOptionsRelationId(void)
 {
-	uint64 storageId = LookupStorageId(relfilenode);
+	return get_relname_relid("options", ColumnarNamespaceId());
+}
 
-	uint64 highestUsedAddress = 0;
-	uint64 highestUsedId = 0;
-	GetHighestUsedAddressAndId(storageId, &highestUsedAddress, &highestUsedId);
 
-	return highestUsedAddress;
+/*
+ * ColumnarOptionsIndexRegclass returns relation id of columnar.options_pkey.
+ */
+static Oid
+ColumnarOptionsIndexRegclass(void)
+{
+	return get_relname_relid("options_pkey", ColumnarNamespaceId());
 }
 
 
 /*
- * GetHighestUsedAddressAndId returns the highest used address and id for
- * the given relfilenode across all active and inactive transactions.
+ * ColumnarColumnOptionsRelationId returns relation id of
+ * columnar.column_options.
  */
-static void
-GetHighestUsedAddressAndId(uint64 storageId,
-						   uint64 *highestUsedAddress,
-						   uint64 *highestUsedId)
+static Oid
+ColumnarColumnOptionsRelationId(void)
 {
-	ListCell *stripeMetadataCell = NULL;
+	return get_relname_relid("column_options", ColumnarNamespaceId());
+}
 
-	SnapshotData SnapshotDirty;
-	InitDirtySnapshot(SnapshotDirty);
 
-	List *stripeMetadataList = ReadDataFileStripeList(storageId, &SnapshotDirty,
-													  ForwardScanDirection);
+/*
+ * ColumnarColumnOptionsIndexRelationId returns relation id of
+ * columnar.column_options_pkey.
+ */
+static Oid
+ColumnarColumnOptionsIndexRelationId(void)
+{
+	return get_relname_relid("column_options_pkey", ColumnarNamespaceId());
+}
 
-	*highestUsedId = 0;
 
-	/* file starts with metapage */
-	*highestUsedAddress = COLUMNAR_BYTES_PER_PAGE;
+/*
+ * ColumnarChunkValueEncodingSupported returns true if columnar.chunk can
+ * record value encodings, i.e. the extension has been upgraded to a version
+ * which has the value_encoding_type column. Writers must not encode chunks
+ * otherwise, since readers couldn't tell the chunks are encoded.
+ */
+bool
+ColumnarChunkValueEncodingSupported(void)
+{
+	Relation columnarChunk = table_open(ColumnarChunkRelationId(), AccessShareLock);
+	bool supported =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_value_encoding_type;
+	table_close(columnarChunk, AccessShareLock);
 
-	foreach(stripeMetadataCell, stripeMetadataList)
-	{
-		StripeMetadata *stripe = lfirst(stripeMetadataCell);
-		uint64 lastByte = stripe->fileOffset + stripe->dataLength - 1;
-		*highestUsedAddress = Max(*highestUsedAddress, lastByte);
-		*highestUsedId = Max(*highestUsedId, stripe->id);
-	}
+	return supported;
 }
 
 
 /*
- * ReserveEmptyStripe reserves an empty stripe for given relation
- * and inserts it into columnar.stripe. It is guaranteed that concurrent
- * writes won't overwrite the returned stripe.
+ * ColumnarChunkNullStateSupported returns true if columnar.chunk has the
+ * null_state column. Writers must store exists streams for all chunks
+ * otherwise.
  */
-EmptyStripeReservation *
-ReserveEmptyStripe(Relation rel, uint64 columnCount, uint64 chunkGroupRowCount,
-				   uint64 stripeRowCount)
+bool
+ColumnarChunkNullStateSupported(void)
 {
-	EmptyStripeReservation *stripeReservation = palloc0(sizeof(EmptyStripeReservation));
+	Relation columnarChunk = table_open(ColumnarChunkRelationId(), AccessShareLock);
+	bool supported =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_null_state;
+	table_close(columnarChunk, AccessShareLock);
 
-	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	return supported;
+}
 
-	stripeReservation->stripeId = ColumnarStorageReserveStripeId(rel);
-	stripeReservation->stripeFirstRowNumber =
-		ColumnarStorageReserveRowNumber(rel, stripeRowCount);
 
-	/*
-	 * XXX: Instead of inserting a dummy entry to columnar.stripe and
-	 * updating it when flushing the stripe, we could have a hash table
-	 * in shared memory for the bookkeeping of ongoing writes.
-	 */
-	InsertEmptyStripeMetadataRow(storageId, stripeReservation->stripeId,
-								 columnCount, chunkGroupRowCount,
-								 stripeReservation->stripeFirstRowNumber);
+/*
+ * ColumnarChunkLargeValueCountSupported returns true if columnar.chunk has the
+ * large_value_count column. Writers must store all values inline otherwise.
+ */
+bool
+ColumnarChunkLargeValueCountSupported(void)
+{
+	Relation columnarChunk = table_open(ColumnarChunkRelationId(), AccessShareLock);
+	bool supported =
+		RelationGetDescr(columnarChunk)->natts >= Anum_columnar_chunk_large_value_count;
+	table_close(columnarChunk, AccessShareLock);
 
-	return stripeReservation;
+	return supported;
 }
 
 
 /*
- * CompleteStripeReservation completes reservation of the stripe with
- * stripeId for given size and in-place updates related stripe metadata tuple
- * to complete reservation.
+ * ColumnarCompressionDictionarySupported returns true if chunks can reference
+ * compression dictionaries, i.e. columnar.chunk has the
+ * compression_dictionary_id column.
  */
-StripeMetadata *
-CompleteStripeReservation(Relation rel, uint64 stripeId, uint64 sizeBytes,
-						  uint64 rowCount, uint64 chunkCount)
+bool
+ColumnarCompressionDictionarySupported(void)
 {
-	uint64 resLogicalStart = ColumnarStorageReserveData(rel, sizeBytes);
-	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
-
-	bool update[Natts_columnar_stripe] = { false };
-	update[Anum_columnar_stripe_file_offset - 1] = true;
-	update[Anum_columnar_stripe_data_length - 1] = true;
-	update[Anum_columnar_stripe_row_count - 1] = true;
-	update[Anum_columnar_stripe_chunk_count - 1] = true;
-
-	Datum newValues[Natts_columnar_stripe] = { 0 };
-	newValues[Anum_columnar_stripe_file_offset - 1] = Int64GetDatum(resLogicalStart);
-	newValues[Anum_columnar_stripe_data_length - 1] = Int64GetDatum(sizeBytes);
-	newValues[Anum_columnar_stripe_row_count - 1] = UInt64GetDatum(rowCount);
-	newValues[Anum_columnar_stripe_chunk_count - 1] = Int32GetDatum(chunkCount);
+	Relation columnarChunk = table_open(ColumnarChunkRelationId(), AccessShareLock);
+	bool supported =
+		RelationGetDescr(columnarChunk)->natts >=
+		Anum_columnar_chunk_compression_dictionary_id;
+	table_close(columnarChunk, AccessShareLock);
 
-	return UpdateStripeMetadataRow(storageId, stripeId, update, newValues);
+	return supported;
 }
 
 
 /*
- * UpdateStripeMetadataRow updates stripe metadata tuple for the stripe with
- * stripeId according to given newValues and update arrays.
- * Note that this function shouldn't be used for the cases where any indexes
- * of stripe metadata should be updated according to modifications done.
+ * SaveCompressionDictionary stores a new compression dictionary for the
+ * given column of a storage and returns its id. Dictionary ids are unique
+ * across all storages, so chunks only need to record the id.
  */
-static StripeMetadata *
-UpdateStripeMetadataRow(uint64 storageId, uint64 stripeId, bool *update,
-						Datum *newValues)
+uint64
+SaveCompressionDictionary(uint64 storageId, AttrNumber attnum, bytea *dictionary)
 {
-	SnapshotData dirtySnapshot;
-	InitDirtySnapshot(dirtySnapshot);
+	if (!ColumnarCompressionDictionarySupported())
+	{
+		ereport(ERROR, (errmsg("compression dictionaries require a newer version "
+							   "of the columnar extension"),
+						errhint("Run ALTER EXTENSION columnar UPDATE.")));
+	}
 
-	ScanKeyData scanKey[2];
-	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
-	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_stripe,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(stripeId));
+	uint64 dictionaryId =
+		nextval_internal(ColumnarCompressionDictionaryIdSequenceRelationId(), false);
 
-	Oid columnarStripesOid = ColumnarStripeRelationId();
+	bool nulls[Natts_columnar_compression_dictionary] = { 0 };
+	Datum values[Natts_columnar_compression_dictionary] = {
+		UInt64GetDatum(storageId),
+		Int32GetDatum(attnum),
+		UInt64GetDatum(dictionaryId),
+		PointerGetDatum(dictionary)
+	};
 
-	Relation columnarStripes = table_open(columnarStripesOid, AccessShareLock);
-	Relation columnarStripePkeyIndex = index_open(ColumnarStripePKeyIndexRelationId(),
-												  AccessShareLock);
+	Relation compressionDictionary =
+		table_open(ColumnarCompressionDictionaryRelationId(), RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(compressionDictionary);
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	FinishModifyRelation(modifyState);
+	table_close(compressionDictionary, RowExclusiveLock);
 
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes,
-															columnarStripePkeyIndex,
-															&dirtySnapshot, 2, scanKey);
+	CommandCounterIncrement();
 
-	HeapTuple oldTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
-	if (!HeapTupleIsValid(oldTuple))
-	{
-		ereport(ERROR, (errmsg("attempted to modify an unexpected stripe, "
-							   "columnar storage with id=" UINT64_FORMAT
-							   " does not have stripe with id=" UINT64_FORMAT,
-							   storageId, stripeId)));
-	}
+	return dictionaryId;
+}
 
-	/*
-	 * heap_inplace_update already doesn't allow changing size of the original
-	 * tuple, so we don't allow setting any Datum's to NULL values.
-	 */
-	bool newNulls[Natts_columnar_stripe] = { false };
-	TupleDesc tupleDescriptor = RelationGetDescr(columnarStripes);
-	HeapTuple modifiedTuple = heap_modify_tuple(oldTuple, tupleDescriptor,
-												newValues, newNulls, update);
 
-	heap_inplace_update(columnarStripes, modifiedTuple);
+/*
+ * ReadLatestCompressionDictionaryId returns the id of the most recently
+ * trained compression dictionary of the given column of a storage, or 0 if
+ * the column has none.
+ */
+uint64
+ReadLatestCompressionDictionaryId(uint64 storageId, AttrNumber attnum)
+{
+	Oid compressionDictionaryOid = ColumnarCompressionDictionaryRelationId();
+	if (!OidIsValid(compressionDictionaryOid))
+	{
+		return 0;
+	}
 
-	/*
-	 * Existing tuple now contains modifications, because we used
-	 * heap_inplace_update().
-	 */
-	HeapTuple newTuple = oldTuple;
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_compression_dictionary_storage_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_compression_dictionary_attr_num,
+				BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(attnum));
 
-	/*
-	 * Must not pass modifiedTuple, because BuildStripeMetadata expects a real
-	 * heap tuple with MVCC fields.
-	 */
-	StripeMetadata *modifiedStripeMetadata = BuildStripeMetadata(columnarStripes,
-																 newTuple);
+	Relation compressionDictionary = table_open(compressionDictionaryOid,
+												AccessShareLock);
+	Relation index = index_open(ColumnarCompressionDictionaryIndexRelationId(),
+								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(compressionDictionary,
+															index, NULL, 2, scanKey);
 
-	CommandCounterIncrement();
+	/* the index is ordered by dictionary id last, so the latest comes first */
+	uint64 dictionaryId = 0;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor,
+												   BackwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		bool isNull = false;
+		Datum dictionaryIdDatum =
+			heap_getattr(heapTuple, Anum_columnar_compression_dictionary_dictionary_id,
+						 RelationGetDescr(compressionDictionary), &isNull);
+		dictionaryId = DatumGetUInt64(dictionaryIdDatum);
+	}
 
 	systable_endscan_ordered(scanDescriptor);
-	index_close(columnarStripePkeyIndex, AccessShareLock);
-	table_close(columnarStripes, AccessShareLock);
+	index_close(index, AccessShareLock);
+	table_close(compressionDictionary, AccessShareLock);
 
-	/* return StripeMetadata object built from modified tuple */
-	return modifiedStripeMetadata;
+	return dictionaryId;
 }
 
 
 /*
- * ReadDataFileStripeList reads the stripe list for a given storageId
- * in the given snapshot.
+ * ReadCompressionDictionary returns a copy of the compression dictionary
+ * with the given id, or NULL if it doesn't exist.
  */
-static List *
-ReadDataFileStripeList(uint64 storageId, Snapshot snapshot, ScanDirection scanDirection)
+bytea *
+ReadCompressionDictionary(uint64 dictionaryId)
 {
-	List *stripeMetadataList = NIL;
-	ScanKeyData scanKey[1];
-	HeapTuple heapTuple;
-
-	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
-				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+	Oid compressionDictionaryOid = ColumnarCompressionDictionaryRelationId();
+	if (!OidIsValid(compressionDictionaryOid))
+	{
+		return NULL;
+	}
 
-	Oid columnarStripesOid = ColumnarStripeRelationId();
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_compression_dictionary_dictionary_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(dictionaryId));
 
-	Relation columnarStripes = table_open(columnarStripesOid, AccessShareLock);
-	Relation index = index_open(ColumnarStripeFirstRowNumberIndexRelationId(),
+	Relation compressionDictionary = table_open(compressionDictionaryOid,
+												AccessShareLock);
+	Relation index = index_open(ColumnarCompressionDictionaryIdIndexRelationId(),
 								AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(compressionDictionary,
+															index, NULL, 1, scanKey);
 
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
-															snapshot, 1,
-															scanKey);
-
-	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
-																 scanDirection)))
+	bytea *dictionary = NULL;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor,
+												   ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
 	{
-		StripeMetadata *stripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
-		stripeMetadataList = lappend(stripeMetadataList, stripeMetadata);
+		bool isNull = false;
+		Datum dictionaryDatum =
+			heap_getattr(heapTuple, Anum_columnar_compression_dictionary_dictionary,
+						 RelationGetDescr(compressionDictionary), &isNull);
+		dictionary = DatumGetByteaPCopy(dictionaryDatum);
 	}
 
 	systable_endscan_ordered(scanDescriptor);
 	index_close(index, AccessShareLock);
-	table_close(columnarStripes, AccessShareLock);
+	table_close(compressionDictionary, AccessShareLock);
 
-	return stripeMetadataList;
+	return dictionary;
 }
 
 
 /*
- * BuildStripeMetadata builds a StripeMetadata object from given heap tuple.
- *
- * NB: heapTuple must be a proper heap tuple with MVCC fields.
+ * DeltaStoreScanDescData holds the state of a scan over the delta store rows
+ * of a storage.
  */
-static StripeMetadata *
-BuildStripeMetadata(Relation columnarStripes, HeapTuple heapTuple)
+typedef struct DeltaStoreScanDescData
 {
-	Assert(RelationGetRelid(columnarStripes) == ColumnarStripeRelationId());
+	Relation deltaStore;
+	Relation index;
+	SysScanDesc scanDescriptor;
+} DeltaStoreScanDescData;
 
-	Datum datumArray[Natts_columnar_stripe];
-	bool isNullArray[Natts_columnar_stripe];
-	heap_deform_tuple(heapTuple, RelationGetDescr(columnarStripes),
-					  datumArray, isNullArray);
 
-	StripeMetadata *stripeMetadata = palloc0(sizeof(StripeMetadata));
-	stripeMetadata->id = DatumGetInt64(datumArray[Anum_columnar_stripe_stripe - 1]);
-	stripeMetadata->fileOffset = DatumGetInt64(
-		datumArray[Anum_columnar_stripe_file_offset - 1]);
-	stripeMetadata->dataLength = DatumGetInt64(
-		datumArray[Anum_columnar_stripe_data_length - 1]);
-	stripeMetadata->columnCount = DatumGetInt32(
-		datumArray[Anum_columnar_stripe_column_count - 1]);
-	stripeMetadata->chunkCount = DatumGetInt32(
-		datumArray[Anum_columnar_stripe_chunk_count - 1]);
-	stripeMetadata->chunkGroupRowCount = DatumGetInt32(
-		datumArray[Anum_columnar_stripe_chunk_row_count - 1]);
-	stripeMetadata->rowCount = DatumGetInt64(
-		datumArray[Anum_columnar_stripe_row_count - 1]);
-	stripeMetadata->firstRowNumber = DatumGetUInt64(
-		datumArray[Anum_columnar_stripe_first_row_number - 1]);
+/*
+ * ColumnarDeltaStoreSupported returns true if the extension is updated to a
+ * version that has the columnar.delta_store table.
+ */
+bool
+ColumnarDeltaStoreSupported(void)
+{
+	return OidIsValid(ColumnarDeltaStoreRelationId());
+}
 
-	/*
-	 * If there is unflushed data in a parent transaction, then we would
-	 * have already thrown an error before starting to scan the table.. If
-	 * the data is from an earlier subxact that committed, then it would
-	 * have been flushed already. For this reason, we don't care about
-	 * subtransaction id here.
-	 */
-	TransactionId entryXmin = HeapTupleHeaderGetXmin(heapTuple->t_data);
-	stripeMetadata->aborted = !TransactionIdIsInProgress(entryXmin) &&
-							  TransactionIdDidAbort(entryXmin);
-	stripeMetadata->insertedByCurrentXact =
-		TransactionIdIsCurrentTransactionId(entryXmin);
 
-	CheckStripeMetadataConsistency(stripeMetadata);
+/*
+ * InsertDeltaStoreRow stores a serialized row of a storage in the delta
+ * store under the given row number.
+ */
+void
+InsertDeltaStoreRow(uint64 storageId, uint64 rowNumber, bytea *rowData)
+{
+	bool nulls[Natts_columnar_delta_store] = { 0 };
+	Datum values[Natts_columnar_delta_store] = {
+		UInt64GetDatum(storageId),
+		UInt64GetDatum(rowNumber),
+		PointerGetDatum(rowData)
+	};
 
-	return stripeMetadata;
+	Relation deltaStore = table_open(ColumnarDeltaStoreRelationId(), RowExclusiveLock);
+	ModifyState *modifyState = StartModifyRelation(deltaStore);
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+	FinishModifyRelation(modifyState);
+	table_close(deltaStore, RowExclusiveLock);
 }
 
 
 /*
- * DeleteMetadataRows removes the rows with given relfilenode from columnar
- * metadata tables.
+ * BeginDeltaStoreScan starts a scan over the delta store rows of a storage
+ * that are visible to the given snapshot, in row number order. It returns
+ * NULL if the extension doesn't have a delta store yet.
  */
-void
-DeleteMetadataRows(RelFileNode relfilenode)
+DeltaStoreScanDesc
+BeginDeltaStoreScan(uint64 storageId, Snapshot snapshot)
 {
-	/*
-	 * During a restore for binary upgrade, metadata tables and indexes may or
-	 * may not exist.
-	 */
-	if (IsBinaryUpgrade)
+	Oid deltaStoreOid = ColumnarDeltaStoreRelationId();
+	if (!OidIsValid(deltaStoreOid))
 	{
-		return;
+		return NULL;
 	}
 
-	uint64 storageId = LookupStorageId(relfilenode);
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_delta_store_storage_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
 
-	DeleteStorageFromColumnarMetadataTable(ColumnarStripeRelationId(),
-										   Anum_columnar_stripe_storageid,
-										   ColumnarStripePKeyIndexRelationId(),
-										   storageId);
-	DeleteStorageFromColumnarMetadataTable(ColumnarChunkGroupRelationId(),
-										   Anum_columnar_chunkgroup_storageid,
-										   ColumnarChunkGroupIndexRelationId(),
-										   storageId);
-	DeleteStorageFromColumnarMetadataTable(ColumnarChunkRelationId(),
-										   Anum_columnar_chunk_storageid,
-										   ColumnarChunkIndexRelationId(),
-										   storageId);
-	DeleteStorageFromColumnarMetadataTable(ColumnarRowMaskRelationId(),
-										   Anum_columnar_row_mask_storage_id,
-										   ColumnarRowMaskIndexRelationId(),
-										   storageId);
+	DeltaStoreScanDesc scan = palloc0(sizeof(DeltaStoreScanDescData));
+	scan->deltaStore = table_open(deltaStoreOid, AccessShareLock);
+	scan->index = index_open(ColumnarDeltaStoreIndexRelationId(), AccessShareLock);
+	scan->scanDescriptor = systable_beginscan_ordered(scan->deltaStore, scan->index,
+													  snapshot, 1, scanKey);
+
+	return scan;
 }
 
 
 /*
- * DeleteMetadataRowsForStripeId removes the rows with given relfilenode and 
- * stripe id from columnar metadata tables.
+ * DeltaStoreScanNext returns a copy of the next row of a delta store scan
+ * and sets *rowNumber to its row number. Returns NULL when the scan is done.
  */
-void
-DeleteMetadataRowsForStripeId(RelFileNode relfilenode, uint64 stripeId)
+bytea *
+DeltaStoreScanNext(DeltaStoreScanDesc scan, uint64 *rowNumber)
 {
-	/*
-	 * During a restore for binary upgrade, metadata tables and indexes may or
-	 * may not exist.
-	 */
-	if (IsBinaryUpgrade)
+	HeapTuple heapTuple = systable_getnext_ordered(scan->scanDescriptor,
+												   ForwardScanDirection);
+	if (!HeapTupleIsValid(heapTuple))
 	{
-		return;
+		return NULL;
 	}
 
-	uint64 storageId = LookupStorageId(relfilenode);
+	TupleDesc tupleDescriptor = RelationGetDescr(scan->deltaStore);
+	bool isNull = false;
 
-	DeleteStripeFromColumnarMetadataTable(
-		ColumnarStripeRelationId(),
-		Anum_columnar_stripe_storageid,
-		Anum_columnar_stripe_stripe,
-		ColumnarStripePKeyIndexRelationId(),
-		storageId, stripeId);
-	DeleteStripeFromColumnarMetadataTable(
-		ColumnarChunkGroupRelationId(),
-		Anum_columnar_chunkgroup_storageid,
-		Anum_columnar_chunkgroup_stripe,
-		ColumnarChunkGroupIndexRelationId(),
-		storageId, stripeId);
-	DeleteStripeFromColumnarMetadataTable(
-		ColumnarChunkRelationId(),
-		Anum_columnar_chunk_storageid,
-		Anum_columnar_chunk_stripe,
-		ColumnarChunkIndexRelationId(),
-		storageId, stripeId);
-	DeleteStripeFromColumnarMetadataTable(
-		ColumnarRowMaskRelationId(),
-		Anum_columnar_row_mask_storage_id,
-		Anum_columnar_row_mask_stripe_id,
-		ColumnarRowMaskStripeIndexRelationId(),
-		storageId, stripeId);
+	Datum rowNumberDatum = heap_getattr(heapTuple, Anum_columnar_delta_store_row_number,
+										tupleDescriptor, &isNull);
+	*rowNumber = DatumGetUInt64(rowNumberDatum);
+
+	Datum rowDataDatum = heap_getattr(heapTuple, Anum_columnar_delta_store_row_data,
+									  tupleDescriptor, &isNull);
+	return DatumGetByteaPCopy(rowDataDatum);
 }
 
 
 /*
- * DeleteStorageFromColumnarMetadataTable removes the rows with given
- * storageId from given columnar metadata table.
+ * EndDeltaStoreScan ends a scan started by BeginDeltaStoreScan.
  */
-static void
-DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
-									   AttrNumber storageIdAtrrNumber,
-									   Oid storageIdIndexId, uint64 storageId)
+void
+EndDeltaStoreScan(DeltaStoreScanDesc scan)
 {
-	ScanKeyData scanKey[1];
-	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
-				F_INT8EQ, UInt64GetDatum(storageId));
+	systable_endscan_ordered(scan->scanDescriptor);
+	index_close(scan->index, AccessShareLock);
+	table_close(scan->deltaStore, AccessShareLock);
+	pfree(scan);
+}
 
-	Relation metadataTable = try_relation_open(metadataTableId, AccessShareLock);
-	if (metadataTable == NULL)
+
+/*
+ * ReadDeltaStoreRow returns a copy of the delta store row with the given row
+ * number that is visible to the snapshot, or NULL if there is none.
+ */
+bytea *
+ReadDeltaStoreRow(uint64 storageId, uint64 rowNumber, Snapshot snapshot)
+{
+	Oid deltaStoreOid = ColumnarDeltaStoreRelationId();
+	if (!OidIsValid(deltaStoreOid))
 	{
-		/* extension has been dropped */
-		return;
+		return NULL;
 	}
 
-	Relation index = index_open(storageIdIndexId, AccessShareLock);
-
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(metadataTable, index, NULL,
-															1, scanKey);
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_delta_store_storage_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_delta_store_row_number,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(rowNumber));
 
-	ModifyState *modifyState = StartModifyRelation(metadataTable);
+	Relation deltaStore = table_open(deltaStoreOid, AccessShareLock);
+	Relation index = index_open(ColumnarDeltaStoreIndexRelationId(), AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(deltaStore, index,
+															snapshot, 2, scanKey);
 
-	HeapTuple heapTuple;
-	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
-																 ForwardScanDirection)))
+	bytea *rowData = NULL;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
 	{
-		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+		bool isNull = false;
+		Datum rowDataDatum = heap_getattr(heapTuple, Anum_columnar_delta_store_row_data,
+										  RelationGetDescr(deltaStore), &isNull);
+		rowData = DatumGetByteaPCopy(rowDataDatum);
 	}
 
 	systable_endscan_ordered(scanDescriptor);
-
-	FinishModifyRelation(modifyState);
-
 	index_close(index, AccessShareLock);
-	table_close(metadataTable, AccessShareLock);
+	table_close(deltaStore, AccessShareLock);
+
+	return rowData;
 }
 
 
 /*
- * DeleteStripeFromColumnarMetadataTable removes the rows in columnar
- * metadata table that match storageId and stripeId.
+ * DeleteDeltaStoreRow deletes the delta store row with the given row number.
+ * It returns false if the row number doesn't belong to the delta store, and
+ * sets *alreadyDeleted if it does but the row was deleted by an earlier
+ * transaction. Callers hold the storage's advisory lock, so no other
+ * transaction deletes the row concurrently.
  */
-static void
-DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
-									  AttrNumber storageIdAtrrNumber,
-									  AttrNumber stripeIdAttrNumber,
-									  Oid storageIdIndexId,
-									  uint64 storageId,
-									  uint64 stripeId)
+bool
+DeleteDeltaStoreRow(uint64 storageId, uint64 rowNumber, bool *alreadyDeleted)
 {
-	ScanKeyData scanKey[2];
-	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
-				F_INT8EQ, UInt64GetDatum(storageId));
-	ScanKeyInit(&scanKey[1], stripeIdAttrNumber, BTEqualStrategyNumber,
-				F_INT8EQ, UInt64GetDatum(stripeId));
+	*alreadyDeleted = false;
 
-	Relation metadataTable = try_relation_open(metadataTableId, RowShareLock);
-	if (metadataTable == NULL)
+	Oid deltaStoreOid = ColumnarDeltaStoreRelationId();
+	if (!OidIsValid(deltaStoreOid))
 	{
-		/* extension has been dropped */
-		return;
+		return false;
 	}
 
-	Relation index = index_open(storageIdIndexId, RowShareLock);
-	SysScanDesc scanDescriptor = systable_beginscan_ordered(metadataTable, index, NULL,
-															2, scanKey);
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_delta_store_storage_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_delta_store_row_number,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(rowNumber));
 
-	ModifyState *modifyState = StartModifyRelation(metadataTable);
+	Relation deltaStore = table_open(deltaStoreOid, RowExclusiveLock);
+	Relation index = index_open(ColumnarDeltaStoreIndexRelationId(), AccessShareLock);
 
-	HeapTuple heapTuple;
-	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
-																 ForwardScanDirection)))
+	/* a new snapshot sees deletions committed while we waited for the lock */
+	Snapshot snapshot = RegisterSnapshot(GetLatestSnapshot());
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(deltaStore, index,
+															snapshot, 2, scanKey);
+
+	bool found = false;
+	HeapTuple heapTuple = systable_getnext_ordered(scanDescriptor, ForwardScanDirection);
+	if (HeapTupleIsValid(heapTuple))
 	{
+		ModifyState *modifyState = StartModifyRelation(deltaStore);
 		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+		FinishModifyRelation(modifyState);
+		found = true;
 	}
 
 	systable_endscan_ordered(scanDescriptor);
+	UnregisterSnapshot(snapshot);
 
-	FinishModifyRelation(modifyState);
+	if (!found)
+	{
+		/* dead versions of the row tell that it was in the delta store */
+		scanDescriptor = systable_beginscan_ordered(deltaStore, index, SnapshotAny,
+													2, scanKey);
+		found = HeapTupleIsValid(systable_getnext_ordered(scanDescriptor,
+														  ForwardScanDirection));
+		*alreadyDeleted = found;
+		systable_endscan_ordered(scanDescriptor);
+	}
 
-	index_close(index, RowShareLock);
-	table_close(metadataTable, RowShareLock);
+	index_close(index, AccessShareLock);
+	table_close(deltaStore, RowExclusiveLock);
+
+	return found;
 }
 
 
 /*
- * StartModifyRelation allocates resources for modifications.
+ * DeleteDeltaStoreRows deletes the delta store rows of a storage that are
+ * visible to the given snapshot.
  */
-static ModifyState *
-StartModifyRelation(Relation rel)
+void
+DeleteDeltaStoreRows(uint64 storageId, Snapshot snapshot)
 {
-	EState *estate = create_estate_for_relation(rel);
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_delta_store_storage_id,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
 
-#if PG_VERSION_NUM >= PG_VERSION_14
-	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
-	InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
-#else
-	ResultRelInfo *resultRelInfo = estate->es_result_relation_info;
-#endif
+	Relation deltaStore = table_open(ColumnarDeltaStoreRelationId(), RowExclusiveLock);
+	Relation index = index_open(ColumnarDeltaStoreIndexRelationId(), AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(deltaStore, index,
+															snapshot, 1, scanKey);
+
+	ModifyState *modifyState = StartModifyRelation(deltaStore);
+
+	HeapTuple heapTuple;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+	}
 
-	/* ExecSimpleRelationInsert, ... require caller to open indexes */
-	ExecOpenIndices(resultRelInfo, false);
+	systable_endscan_ordered(scanDescriptor);
 
-	ModifyState *modifyState = palloc(sizeof(ModifyState));
-	modifyState->rel = rel;
-	modifyState->estate = estate;
-	modifyState->resultRelInfo = resultRelInfo;
+	FinishModifyRelation(modifyState);
 
-	return modifyState;
+	index_close(index, AccessShareLock);
+	table_close(deltaStore, RowExclusiveLock);
 }
 
 
 /*
- * InsertTupleAndEnforceConstraints inserts a tuple into a relation and makes
- * sure constraints are enforced and indexes are updated.
+ * DeltaStoreRowCount returns the number of delta store rows of a storage that
+ * are visible to the given snapshot.
  */
-static void
-InsertTupleAndEnforceConstraints(ModifyState *state, Datum *values, bool *nulls)
+uint64
+DeltaStoreRowCount(uint64 storageId, Snapshot snapshot)
 {
-	TupleDesc tupleDescriptor = RelationGetDescr(state->rel);
-	HeapTuple tuple = heap_form_tuple(tupleDescriptor, values, nulls);
+	uint64 rowCount = 0;
 
-	TupleTableSlot *slot = ExecInitExtraTupleSlot(state->estate, tupleDescriptor,
-												  &TTSOpsHeapTuple);
+	DeltaStoreScanDesc scan = BeginDeltaStoreScan(storageId, snapshot);
+	if (scan == NULL)
+	{
+		return 0;
+	}
 
-	ExecStoreHeapTuple(tuple, slot, false);
+	while (systable_getnext_ordered(scan->scanDescriptor, ForwardScanDirection) != NULL)
+	{
+		rowCount++;
+	}
 
-	/* use ExecSimpleRelationInsert to enforce constraints */
-	ExecSimpleRelationInsert_compat(state->resultRelInfo, state->estate, slot);
+	EndDeltaStoreScan(scan);
+
+	return rowCount;
 }
 
 
 /*
- * DeleteTupleAndEnforceConstraints deletes a tuple from a relation and
- * makes sure constraints (e.g. FK constraints) are enforced.
+ * ColumnarChunkRelationId returns relation id of columnar.chunk.
+ * TODO: should we cache this similar to citus?
  */
-static void
-DeleteTupleAndEnforceConstraints(ModifyState *state, HeapTuple heapTuple)
+static Oid
+ColumnarChunkRelationId(void)
 {
-	EState *estate = state->estate;
-	ResultRelInfo *resultRelInfo = state->resultRelInfo;
-
-	ItemPointer tid = &(heapTuple->t_self);
-	simple_heap_delete(state->rel, tid);
-
-	/* execute AFTER ROW DELETE Triggers to enforce constraints */
-#if PG_VERSION_NUM >= PG_VERSION_15
-	ExecARDeleteTriggers(estate, resultRelInfo, tid, NULL, NULL, true);
-#else
-	ExecARDeleteTriggers(estate, resultRelInfo, tid, NULL, NULL);
-#endif
+	return get_relname_relid("chunk", ColumnarNamespaceId());
 }
 
 
 /*
- * FinishModifyRelation cleans up resources after modifications are done.
+ * ColumnarChunkGroupRelationId returns relation id of columnar.chunk_group.
+ * TODO: should we cache this similar to citus?
  */
-static void
-FinishModifyRelation(ModifyState *state)
+static Oid
+ColumnarChunkGroupRelationId(void)
 {
-	ExecCloseIndices(state->resultRelInfo);
-
-	AfterTriggerEndQuery(state->estate);
-#if PG_VERSION_NUM >= PG_VERSION_14
-	ExecCloseResultRelations(state->estate);
-	ExecCloseRangeTableRelations(state->estate);
-#else
-	ExecCleanUpTriggerState(state->estate);
-#endif
-	ExecResetTupleTable(state->estate->es_tupleTable, false);
-	FreeExecutorState(state->estate);
-
-	CommandCounterIncrement();
+	return get_relname_relid("chunk_group", ColumnarNamespaceId());
 }
 
 
 /*
- * Based on a similar function from
- * postgres/src/backend/replication/logical/worker.c.
- *
- * Executor state preparation for evaluation of constraint expressions,
- * indexes and triggers.
- *
- * This is based on similar code in copy.c
+ * ColumnarRowMaskRelationId returns relation id of columnar.row_mask.
  */
-EState *
-create_estate_for_relation(Relation rel)
+static Oid
+ColumnarRowMaskRelationId(void)
 {
-	EState *estate = CreateExecutorState();
-
-	RangeTblEntry *rte = makeNode(RangeTblEntry);
-	rte->rtekind = RTE_RELATION;
-	rte->relid = RelationGetRelid(rel);
-	rte->relkind = rel->rd_rel->relkind;
-	rte->rellockmode = AccessShareLock;
-	ExecInitRangeTable(estate, list_make1(rte));
-
-#if PG_VERSION_NUM < PG_VERSION_14
-	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
-	InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
-
-	estate->es_result_relations = resultRelInfo;
-	estate->es_num_result_relations = 1;
-	estate->es_result_relation_info = resultRelInfo;
-#endif
-
-	estate->es_output_cid = GetCurrentCommandId(true);
-
-	/* Prepare to catch AFTER triggers. */
-	AfterTriggerBeginQuery();
-
-	return estate;
+	return get_relname_relid("row_mask", ColumnarNamespaceId());
 }
 
 
 /*
- * DatumToBytea serializes a datum into a bytea value.
+ * ColumnarRowMaskSeqId returns relation id of columnar.row_mask_seq.
  */
-static bytea *
-DatumToBytea(Datum value, Form_pg_attribute attrForm)
+static Oid
+ColumnarRowMaskSeqId(void)
 {
-	int datumLength = att_addlength_datum(0, attrForm->attlen, value);
-	bytea *result = palloc0(datumLength + VARHDRSZ);
-
-	SET_VARSIZE(result, datumLength + VARHDRSZ);
+	return get_relname_relid("row_mask_seq", ColumnarNamespaceId());
+}
 
-	if (attrForm->attlen > 0)
-	{
-		if (attrForm->attbyval)
-		{
-			Datum tmp;
-			store_att_byval(&tmp, value, attrForm->attlen);
 
-			memcpy_s(VARDATA(result), datumLength + VARHDRSZ,
-					 &tmp, attrForm->attlen);
-		}
-		else
-		{
-			memcpy_s(VARDATA(result), datumLength + VARHDRSZ,
-					 DatumGetPointer(value), attrForm->attlen);
-		}
-	}
-	else
-	{
-		memcpy_s(VARDATA(result), datumLength + VARHDRSZ,
-				 DatumGetPointer(value), datumLength);
-	}
 
-	return result;
+/*
+ * ColumnarChunkIndexRelationId returns relation id of columnar.chunk_pkey.
+ * TODO: should we cache this similar to citus?
+ */
+static Oid
+ColumnarChunkIndexRelationId(void)
+{
+	return get_relname_relid("chunk_pkey", ColumnarNamespaceId());
 }
 
 
 /*
- * ByteaToDatum deserializes a value which was previously serialized using
- * DatumToBytea.
+ * ColumnarChunkGroupIndexRelationId returns relation id of columnar.chunk_group_pkey.
+ * TODO: should we cache this similar to citus?
  */
-static Datum
-ByteaToDatum(bytea *bytes, Form_pg_attribute attrForm)
+static Oid
+ColumnarChunkGroupIndexRelationId(void)
 {
-	/*
-	 * We copy the data so the result of this function lives even
-	 * after the byteaDatum is freed.
-	 */
-	char *binaryDataCopy = palloc0(VARSIZE_ANY_EXHDR(bytes));
-	memcpy_s(binaryDataCopy, VARSIZE_ANY_EXHDR(bytes),
-			 VARDATA_ANY(bytes), VARSIZE_ANY_EXHDR(bytes));
-
-	return fetch_att(binaryDataCopy, attrForm->attbyval, attrForm->attlen);
+	return get_relname_relid("chunk_group_pkey", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarStorageIdSequenceRelationId returns relation id of columnar.stripe.
- * TODO: should we cache this similar to citus?
+ * ColumnarCompressionDictionaryRelationId returns relation id of
+ * columnar.compression_dictionary.
  */
 static Oid
-ColumnarStorageIdSequenceRelationId(void)
+ColumnarCompressionDictionaryRelationId(void)
 {
-	return get_relname_relid("storageid_seq", ColumnarNamespaceId());
+	return get_relname_relid("compression_dictionary", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarStripeRelationId returns relation id of columnar.stripe.
- * TODO: should we cache this similar to citus?
+ * ColumnarCompressionDictionaryIndexRelationId returns relation id of
+ * columnar.compression_dictionary_pkey.
  */
 static Oid
-ColumnarStripeRelationId(void)
+ColumnarCompressionDictionaryIndexRelationId(void)
 {
-	return get_relname_relid("stripe", ColumnarNamespaceId());
+	return get_relname_relid("compression_dictionary_pkey", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarStripePKeyIndexRelationId returns relation id of columnar.stripe_pkey.
- * TODO: should we cache this similar to citus?
+ * ColumnarCompressionDictionaryIdIndexRelationId returns relation id of
+ * columnar.compression_dictionary_dictionary_id_key.
  */
 static Oid
-ColumnarStripePKeyIndexRelationId(void)
+ColumnarCompressionDictionaryIdIndexRelationId(void)
 {
-	return get_relname_relid("stripe_pkey", ColumnarNamespaceId());
+	return get_relname_relid("compression_dictionary_dictionary_id_key",
+							 ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarStripeFirstRowNumberIndexRelationId returns relation id of
- * columnar.stripe_first_row_number_idx.
- * TODO: should we cache this similar to citus?
+ * ColumnarCompressionDictionaryIdSequenceRelationId returns relation id of
+ * columnar.compression_dictionary_id_seq.
  */
 static Oid
-ColumnarStripeFirstRowNumberIndexRelationId(void)
+ColumnarCompressionDictionaryIdSequenceRelationId(void)
 {
-	return get_relname_relid("stripe_first_row_number_idx", ColumnarNamespaceId());
+	return get_relname_relid("compression_dictionary_id_seq", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarOptionsRelationId returns relation id of columnar.options.
+ * ColumnarDeltaStoreRelationId returns relation id of columnar.delta_store.
  */
 static Oid
-ColumnarOptionsRelationId(void)
+ColumnarDeltaStoreRelationId(void)
 {
-	return get_relname_relid("options", ColumnarNamespaceId());
+	return get_relname_relid("delta_store", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarOptionsIndexRegclass returns relation id of columnar.options_pkey.
+ * ColumnarDeltaStoreIndexRelationId returns relation id of
+ * columnar.delta_store_pkey.
  */
 static Oid
-ColumnarOptionsIndexRegclass(void)
+ColumnarDeltaStoreIndexRelationId(void)
 {
-	return get_relname_relid("options_pkey", ColumnarNamespaceId());
+	return get_relname_relid("delta_store_pkey", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarChunkRelationId returns relation id of columnar.chunk.
- * TODO: should we cache this similar to citus?
+ * ColumnarStripeAttrRelationId returns relation id of columnar.stripe_attr.
  */
 static Oid
-ColumnarChunkRelationId(void)
+ColumnarStripeAttrRelationId(void)
 {
-	return get_relname_relid("chunk", ColumnarNamespaceId());
+	return get_relname_relid("stripe_attr", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarChunkGroupRelationId returns relation id of columnar.chunk_group.
- * TODO: should we cache this similar to citus?
+ * ColumnarStripeAttrIndexRelationId returns relation id of
+ * columnar.stripe_attr_pkey.
  */
 static Oid
-ColumnarChunkGroupRelationId(void)
+ColumnarStripeAttrIndexRelationId(void)
 {
-	return get_relname_relid("chunk_group", ColumnarNamespaceId());
+	return get_relname_relid("stripe_attr_pkey", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarRowMaskRelationId returns relation id of columnar.row_mask.
+ * ColumnarStripeSkipListRelationId returns relation id of
+ * columnar.stripe_skip_list.
  */
 static Oid
-ColumnarRowMaskRelationId(void)
+ColumnarStripeSkipListRelationId(void)
 {
-	return get_relname_relid("row_mask", ColumnarNamespaceId());
+	return get_relname_relid("stripe_skip_list", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarRowMaskSeqId returns relation id of columnar.row_mask_seq.
+ * ColumnarStripeSkipListIndexRelationId returns relation id of
+ * columnar.stripe_skip_list_pkey.
  */
 static Oid
-ColumnarRowMaskSeqId(void)
+ColumnarStripeSkipListIndexRelationId(void)
 {
-	return get_relname_relid("row_mask_seq", ColumnarNamespaceId());
+	return get_relname_relid("stripe_skip_list_pkey", ColumnarNamespaceId());
 }
 
 
-
 /*
- * ColumnarChunkIndexRelationId returns relation id of columnar.chunk_pkey.
- * TODO: should we cache this similar to citus?
+ * ColumnarStripeProjectionRelationId returns relation id of
+ * columnar.stripe_projection.
  */
 static Oid
-ColumnarChunkIndexRelationId(void)
+ColumnarStripeProjectionRelationId(void)
 {
-	return get_relname_relid("chunk_pkey", ColumnarNamespaceId());
+	return get_relname_relid("stripe_projection", ColumnarNamespaceId());
 }
 
 
 /*
- * ColumnarChunkGroupIndexRelationId returns relation id of columnar.chunk_group_pkey.
- * TODO: should we cache this similar to citus?
+ * ColumnarStripeProjectionIndexRelationId returns relation id of
+ * columnar.stripe_projection_pkey.
  */
 static Oid
-ColumnarChunkGroupIndexRelationId(void)
+ColumnarStripeProjectionIndexRelationId(void)
 {
-	return get_relname_relid("chunk_group_pkey", ColumnarNamespaceId());
+	return get_relname_relid("stripe_projection_pkey", ColumnarNamespaceId());
 }
 
 
@@ -2486,7 +5296,8 @@ ColumnarStorageUpdateIfNeeded(Relation rel, bool isUpgrade)
 	BlockNumber nblocks = smgrnblocks(rel->rd_smgr, MAIN_FORKNUM);
 	if (nblocks < 2)
 	{
-		ColumnarStorageInit(rel->rd_smgr, ColumnarMetadataNewStorageId());
+		ColumnarStorageInit(rel->rd_smgr, ColumnarMetadataNewStorageId(),
+							rel->rd_rel->relpersistence);
 		return;
 	}
 
@@ -2556,5 +5367,71 @@ RewriteStripeMetadataRowWithNewValues(Relation rel, uint64 stripeId,
 	newValues[Anum_columnar_stripe_row_count - 1] = UInt64GetDatum(rowCount);
 	newValues[Anum_columnar_stripe_chunk_count - 1] = Int32GetDatum(chunkCount);
 
+	ColumnarInvalidateStripeListSummary(rel);
+
 	return UpdateStripeMetadataRow(storageId, stripeId, update, newValues);
 }
+
+
+/*
+ * ResetStripeBuckets marks all stripes of the given relation as not bucketed,
+ * for when its bucket_by option changes and the recorded buckets don't match
+ * the option anymore. The stripe rows are updated in place, so the reset
+ * sticks even if the transaction aborts, which only costs pruning.
+ */
+void
+ResetStripeBuckets(Relation rel)
+{
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+
+	SnapshotData dirtySnapshot;
+	InitDirtySnapshot(dirtySnapshot);
+
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_storageid,
+				BTEqualStrategyNumber, F_OIDEQ, Int32GetDatum(storageId));
+
+	Relation columnarStripes = table_open(ColumnarStripeRelationId(), AccessShareLock);
+	if (RelationGetDescr(columnarStripes)->natts < Anum_columnar_stripe_bucket)
+	{
+		table_close(columnarStripes, AccessShareLock);
+		return;
+	}
+
+	Relation index = index_open(ColumnarStripePKeyIndexRelationId(), AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripes, index,
+															&dirtySnapshot, 1,
+															scanKey);
+
+	List *bucketedStripeIds = NIL;
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		StripeMetadata *stripeMetadata = BuildStripeMetadata(columnarStripes, heapTuple);
+		if (stripeMetadata->bucket >= 0)
+		{
+			uint64 *stripeId = palloc(sizeof(uint64));
+			*stripeId = stripeMetadata->id;
+			bucketedStripeIds = lappend(bucketedStripeIds, stripeId);
+		}
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripes, AccessShareLock);
+
+	bool update[Natts_columnar_stripe] = { false };
+	update[Anum_columnar_stripe_bucket - 1] = true;
+
+	Datum newValues[Natts_columnar_stripe] = { 0 };
+	newValues[Anum_columnar_stripe_bucket - 1] = Int32GetDatum(-1);
+
+	uint64 *stripeId = NULL;
+	foreach_ptr(stripeId, bucketedStripeIds)
+	{
+		UpdateStripeMetadataRow(storageId, *stripeId, update, newValues);
+	}
+
+	ColumnarInvalidateStripeListSummary(rel);
+}
@@ -0,0 +1,1139 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_metadata_statistics.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Planner statistics of columnar tables derived from the chunk metadata
+ * written with every stripe. Between ANALYZE runs the planner only knows the
+ * row count of a columnar table, while the skip list of each stripe already
+ * has the value range, null count and distinct estimate of each chunk. When
+ * columnar.enable_metadata_statistics is on, a get_relation_stats_hook hands
+ * the planner a pg_statistic tuple built from them for columns that were
+ * never analyzed, or whose table more than doubled since ANALYZE.
+ *
+ * The per column sums are kept in a backend local cache keyed by relation
+ * id. Writing a stripe queues a relcache invalidation of the table (see
+ * columnar_stripe_list_cache.c), which only marks the entry as out of date:
+ * the next lookup adds the stripes flushed since, and starts over if any
+ * stripe it summarized is gone or an older stripe showed up.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "access/xact.h"
+#include "catalog/pg_statistic.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/fmgroids.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/selfuncs.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/utils/listutils.h"
+
+/* value ranges kept per column, adjacent ranges are merged beyond this */
+#define MAX_RANGES_PER_COLUMN 512
+
+/* like analyze.c, values wider than this are left out of histograms */
+#define HISTOGRAM_WIDTH_THRESHOLD 1024
+
+/* stripes holding this many times pg_class.reltuples make ANALYZE stale */
+#define ANALYZE_STALE_GROWTH_FACTOR 2.0
+
+/*
+ * Chunks whose distinct estimates add up to this fraction of their non-null
+ * rows have (nearly) unique values, which are assumed to be unique across
+ * chunks as well.
+ */
+#define UNIQUE_CHUNK_VALUES_FRACTION 0.9
+
+/*
+ * ColumnMetadataStatistics sums up the chunk metadata of one column over the
+ * stripes summarized so far.
+ */
+typedef struct ColumnMetadataStatistics
+{
+	/* rows of the chunks whose null count is known, and their nulls */
+	uint64 rowCount;
+	uint64 nullCount;
+
+	/* decompressed bytes and values of the chunks that aren't encoded */
+	uint64 valueBytes;
+	uint64 valueBytesCount;
+
+	/* rows and non-null rows of the chunks with a distinct estimate */
+	uint64 distinctChunkRowCount;
+	uint64 distinctChunkValueCount;
+
+	/* sum and maximum of the distinct estimates of the chunks */
+	uint64 distinctSum;
+	uint64 distinctMax;
+
+	/*
+	 * Consecutive chunks in write order, and how many of them have ranges that
+	 * follow each other upwards or downwards without overlapping.
+	 */
+	uint64 adjacentRangeCount;
+	uint64 ascendingRangeCount;
+	uint64 descendingRangeCount;
+
+	/* value range and number of non-null values of the chunks */
+	uint32 rangeCount;
+	Datum *rangeMinimums;
+	Datum *rangeMaximums;
+	uint64 *rangeValueCounts;
+} ColumnMetadataStatistics;
+
+typedef struct MetadataStatisticsCacheEntry
+{
+	Oid relationId;
+
+	/* a new relfilenode has other stripes */
+	RelFileNode relfilenode;
+
+	/* false once stripes were written, the next lookup adds them */
+	bool upToDate;
+
+	/* set while stripes are added, sums left by an error are thrown away */
+	bool summarizing;
+
+	/* flushed stripes summarized and the highest of their ids */
+	uint64 stripeCount;
+	uint64 maxStripeId;
+
+	int columnCount;
+	ColumnMetadataStatistics *columns;
+
+	/* memory of the column statistics and their range values */
+	MemoryContext context;
+} MetadataStatisticsCacheEntry;
+
+/* value of a histogram candidate and the rows it stands for */
+typedef struct HistogramPoint
+{
+	Datum value;
+	double weight;
+} HistogramPoint;
+
+/* comparison of the values of a column */
+typedef struct ColumnComparison
+{
+	FmgrInfo *comparisonFunction;
+	Oid collation;
+} ColumnComparison;
+
+/*
+ * MetadataColumnEstimate is what the planner gets for a column, in the units
+ * of pg_statistic.
+ */
+typedef struct MetadataColumnEstimate
+{
+	float4 nullFraction;
+	int32 width;
+	float4 distinct;
+
+	Oid lessThanOperator;
+	int boundCount;
+	Datum *bounds;
+
+	bool hasCorrelation;
+	float4 correlation;
+} MetadataColumnEstimate;
+
+static HTAB *MetadataStatisticsCacheMap = NULL;
+static get_relation_stats_hook_type PreviousGetRelationStatsHook = NULL;
+
+static bool ColumnarGetRelationStatsHook(PlannerInfo *root, RangeTblEntry *rte,
+										 AttrNumber attnum, VariableStatData *vardata);
+static bool MetadataStatisticsNeeded(Relation relation, AttrNumber attnum);
+static void InitMetadataStatisticsCache(void);
+static void InvalidateMetadataStatisticsCache(Datum argument, Oid relationId);
+static ColumnMetadataStatistics * ColumnMetadataStatisticsForRelation(Relation relation,
+																	  MemoryContext *
+																	  context);
+static bool SummarizeStripes(Relation relation, MetadataStatisticsCacheEntry *entry);
+static void SummarizeStripe(Relation relation, StripeMetadata *stripe,
+							MetadataStatisticsCacheEntry *entry);
+static void AddChunkToColumnStatistics(ColumnMetadataStatistics *column,
+									   ColumnChunkSkipNode *chunk,
+									   Form_pg_attribute attributeForm,
+									   ColumnComparison *comparison,
+									   MemoryContext context);
+static void MergeAdjacentRanges(ColumnMetadataStatistics *column,
+								Form_pg_attribute attributeForm,
+								ColumnComparison *comparison);
+static bool LookupColumnComparison(Form_pg_attribute attributeForm,
+								   ColumnComparison *comparison);
+static int CompareDatums(Datum left, Datum right, ColumnComparison *comparison);
+static int CompareHistogramPoints(const void *left, const void *right, void *argument);
+static void EstimateColumn(ColumnMetadataStatistics *column,
+						   Form_pg_attribute attributeForm,
+						   MetadataColumnEstimate *estimate);
+static void EstimateHistogram(ColumnMetadataStatistics *column,
+							  Form_pg_attribute attributeForm,
+							  MetadataColumnEstimate *estimate);
+static HeapTuple MetadataStatisticsTuple(Relation relation, AttrNumber attnum,
+										 MetadataColumnEstimate *estimate);
+
+
+/*
+ * ColumnarMetadataStatisticsInit installs the hook that gives the planner
+ * statistics derived from chunk metadata.
+ */
+void
+ColumnarMetadataStatisticsInit(void)
+{
+	PreviousGetRelationStatsHook = get_relation_stats_hook;
+	get_relation_stats_hook = ColumnarGetRelationStatsHook;
+}
+
+
+/*
+ * ColumnarGetRelationStatsHook provides the statistics of a column of a
+ * columnar table from its chunk metadata if these are the better ones, and
+ * leaves the lookup in pg_statistic to the planner otherwise.
+ */
+static bool
+ColumnarGetRelationStatsHook(PlannerInfo *root, RangeTblEntry *rte,
+							 AttrNumber attnum, VariableStatData *vardata)
+{
+	if (PreviousGetRelationStatsHook &&
+		PreviousGetRelationStatsHook(root, rte, attnum, vardata))
+	{
+		return true;
+	}
+
+	if (!columnar_enable_metadata_statistics || rte->inh || attnum <= 0 ||
+		!IsColumnarTableAmTable(rte->relid))
+	{
+		return false;
+	}
+
+	Relation relation = RelationIdGetRelation(rte->relid);
+	HeapTuple statsTuple = NULL;
+
+	if (MetadataStatisticsNeeded(relation, attnum))
+	{
+		MemoryContext context = NULL;
+		ColumnMetadataStatistics *columns =
+			ColumnMetadataStatisticsForRelation(relation, &context);
+		ColumnMetadataStatistics *column = &columns[AttrNumberGetAttrOffset(attnum)];
+
+		if (column->rowCount > 0)
+		{
+			MetadataColumnEstimate estimate = { 0 };
+			EstimateColumn(column, TupleDescAttr(RelationGetDescr(relation),
+												 AttrNumberGetAttrOffset(attnum)),
+						   &estimate);
+			statsTuple = MetadataStatisticsTuple(relation, attnum, &estimate);
+		}
+
+		if (context != NULL)
+		{
+			MemoryContextDelete(context);
+		}
+	}
+
+	RelationClose(relation);
+
+	if (!HeapTupleIsValid(statsTuple))
+	{
+		return false;
+	}
+
+	vardata->statsTuple = statsTuple;
+	vardata->freefunc = heap_freetuple;
+
+	/* the same check examine_simple_variable does for pg_statistic tuples */
+	vardata->acl_ok =
+		pg_class_aclcheck(rte->relid, GetUserId(), ACL_SELECT) == ACLCHECK_OK ||
+		pg_attribute_aclcheck(rte->relid, attnum, GetUserId(),
+							  ACL_SELECT) == ACLCHECK_OK;
+
+	return true;
+}
+
+
+/*
+ * MetadataStatisticsNeeded returns whether the column has no ANALYZE
+ * statistics, or the table grew well past the size ANALYZE saw.
+ */
+static bool
+MetadataStatisticsNeeded(Relation relation, AttrNumber attnum)
+{
+	if (attnum > RelationGetNumberOfAttributes(relation) ||
+		TupleDescAttr(RelationGetDescr(relation),
+					  AttrNumberGetAttrOffset(attnum))->attisdropped)
+	{
+		return false;
+	}
+
+	HeapTuple analyzeTuple = SearchSysCache3(STATRELATTINH,
+											 ObjectIdGetDatum(RelationGetRelid(relation)),
+											 Int16GetDatum(attnum),
+											 BoolGetDatum(false));
+	if (!HeapTupleIsValid(analyzeTuple))
+	{
+		return true;
+	}
+
+	ReleaseSysCache(analyzeTuple);
+
+	StripeListSummary summary = StripeListSummaryForRelation(relation);
+	double analyzedRowCount = Max(relation->rd_rel->reltuples, 0);
+
+	return summary.rowCount > ANALYZE_STALE_GROWTH_FACTOR * analyzedRowCount;
+}
+
+
+/*
+ * InitMetadataStatisticsCache creates the hash table of the cache if it
+ * doesn't exist, and registers its invalidation callback the first time.
+ */
+static void
+InitMetadataStatisticsCache(void)
+{
+	static bool invalidationCallbackRegistered = false;
+
+	if (MetadataStatisticsCacheMap != NULL)
+	{
+		return;
+	}
+
+	if (!invalidationCallbackRegistered)
+	{
+		CacheRegisterRelcacheCallback(InvalidateMetadataStatisticsCache, (Datum) 0);
+		invalidationCallbackRegistered = true;
+	}
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(MetadataStatisticsCacheEntry);
+	info.hcxt = CacheMemoryContext;
+
+	MetadataStatisticsCacheMap = hash_create("columnar metadata statistics cache", 64,
+											 &info,
+											 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+
+/*
+ * InvalidateMetadataStatisticsCache marks the entry of the given relation,
+ * or all entries if relationId is InvalidOid, as out of date. The sums stay
+ * so that the next lookup only has to add the new stripes.
+ */
+static void
+InvalidateMetadataStatisticsCache(Datum argument, Oid relationId)
+{
+	if (MetadataStatisticsCacheMap == NULL)
+	{
+		return;
+	}
+
+	if (relationId != InvalidOid)
+	{
+		MetadataStatisticsCacheEntry *entry =
+			hash_search(MetadataStatisticsCacheMap, &relationId, HASH_FIND, NULL);
+		if (entry != NULL)
+		{
+			entry->upToDate = false;
+		}
+
+		return;
+	}
+
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, MetadataStatisticsCacheMap);
+
+	MetadataStatisticsCacheEntry *entry = NULL;
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		entry->upToDate = false;
+	}
+}
+
+
+/*
+ * ColumnMetadataStatisticsForRelation returns the chunk metadata sums of all
+ * columns of the given relation, from the cache when possible.
+ *
+ * Like for the stripe list summary, transactions that use a single snapshot
+ * don't cache what they compute. Their sums live in a new memory context,
+ * which is returned in context for the caller to delete; context is set to
+ * NULL for sums that belong to the cache.
+ */
+static ColumnMetadataStatistics *
+ColumnMetadataStatisticsForRelation(Relation relation, MemoryContext *context)
+{
+	Oid relationId = RelationGetRelid(relation);
+	int columnCount = RelationGetNumberOfAttributes(relation);
+
+	*context = NULL;
+
+	if (IsolationUsesXactSnapshot())
+	{
+		MetadataStatisticsCacheEntry entry = { 0 };
+		entry.context = AllocSetContextCreate(CurrentMemoryContext,
+											  "columnar metadata statistics",
+											  ALLOCSET_DEFAULT_SIZES);
+		entry.columnCount = columnCount;
+		entry.columns = MemoryContextAllocZero(entry.context,
+											   columnCount *
+											   sizeof(ColumnMetadataStatistics));
+		SummarizeStripes(relation, &entry);
+
+		*context = entry.context;
+		return entry.columns;
+	}
+
+	InitMetadataStatisticsCache();
+
+	bool found = false;
+	MetadataStatisticsCacheEntry *entry = hash_search(MetadataStatisticsCacheMap,
+													  &relationId, HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->upToDate = false;
+		entry->summarizing = false;
+		entry->columnCount = 0;
+		entry->columns = NULL;
+		entry->context = NULL;
+	}
+
+	bool startOver = !found || entry->summarizing ||
+					 !RelFileNodeEquals(entry->relfilenode, relation->rd_node) ||
+					 entry->columnCount != columnCount;
+	if (!startOver && entry->upToDate)
+	{
+		return entry->columns;
+	}
+
+	entry->upToDate = false;
+	entry->summarizing = true;
+
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		if (startOver)
+		{
+			if (entry->context != NULL)
+			{
+				MemoryContextDelete(entry->context);
+			}
+
+			entry->relfilenode = relation->rd_node;
+			entry->stripeCount = 0;
+			entry->maxStripeId = 0;
+			entry->columnCount = columnCount;
+			entry->context = AllocSetContextCreate(CacheMemoryContext,
+												   "columnar metadata statistics",
+												   ALLOCSET_DEFAULT_SIZES);
+			entry->columns = MemoryContextAllocZero(entry->context,
+													columnCount *
+													sizeof(ColumnMetadataStatistics));
+		}
+
+		if (SummarizeStripes(relation, entry))
+		{
+			break;
+		}
+
+		startOver = true;
+	}
+
+	entry->summarizing = false;
+	entry->upToDate = true;
+
+	return entry->columns;
+}
+
+
+/*
+ * SummarizeStripes adds the flushed stripes above entry->maxStripeId to the
+ * sums of the entry. It returns false without adding anything if the stripes
+ * up to maxStripeId are no longer the ones the sums were made of, because a
+ * stripe was removed or one with a lower id was flushed later.
+ */
+static bool
+SummarizeStripes(Relation relation, MetadataStatisticsCacheEntry *entry)
+{
+	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+
+	uint64 summarizedStripeCount = 0;
+	StripeMetadata *stripe = NULL;
+	foreach_ptr(stripe, stripeList)
+	{
+		if (entry->stripeCount > 0 && stripe->id <= entry->maxStripeId &&
+			StripeWriteState(stripe) == STRIPE_WRITE_FLUSHED)
+		{
+			summarizedStripeCount++;
+		}
+	}
+
+	if (summarizedStripeCount != entry->stripeCount)
+	{
+		list_free_deep(stripeList);
+		return false;
+	}
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"columnar metadata statistics stripe",
+														ALLOCSET_DEFAULT_SIZES);
+
+	foreach_ptr(stripe, stripeList)
+	{
+		if ((entry->stripeCount > 0 && stripe->id <= entry->maxStripeId) ||
+			StripeWriteState(stripe) != STRIPE_WRITE_FLUSHED)
+		{
+			continue;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+		SummarizeStripe(relation, stripe, entry);
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+
+		entry->stripeCount++;
+		entry->maxStripeId = Max(entry->maxStripeId, stripe->id);
+	}
+
+	MemoryContextDelete(stripeContext);
+	list_free_deep(stripeList);
+
+	return true;
+}
+
+
+/*
+ * SummarizeStripe adds the chunks of the given stripe to the column sums of
+ * the entry.
+ */
+static void
+SummarizeStripe(Relation relation, StripeMetadata *stripe,
+				MetadataStatisticsCacheEntry *entry)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	StripeSkipList *skipList = ReadStripeSkipList(relation->rd_node, stripe->id,
+												  tupleDescriptor, stripe->chunkCount,
+												  GetTransactionSnapshot());
+
+	for (int columnIndex = 0; columnIndex < entry->columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		/* columns added later have no chunks in older stripes */
+		if (attributeForm->attisdropped || columnIndex >= stripe->columnCount)
+		{
+			continue;
+		}
+
+		ColumnComparison comparison = { 0 };
+		bool hasComparison = LookupColumnComparison(attributeForm, &comparison);
+
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			AddChunkToColumnStatistics(&entry->columns[columnIndex],
+									   &skipList->chunkSkipNodeArray[columnIndex][chunkIndex],
+									   attributeForm,
+									   hasComparison ? &comparison : NULL,
+									   entry->context);
+		}
+	}
+}
+
+
+/*
+ * AddChunkToColumnStatistics adds the metadata of a column chunk to the sums
+ * of the column. The range of the chunk is copied into context, and only
+ * kept for types with a comparison function.
+ */
+static void
+AddChunkToColumnStatistics(ColumnMetadataStatistics *column, ColumnChunkSkipNode *chunk,
+						   Form_pg_attribute attributeForm, ColumnComparison *comparison,
+						   MemoryContext context)
+{
+	if (chunk->rowCount == 0)
+	{
+		return;
+	}
+
+	/* older chunks without statistics still tell whether they have nulls */
+	int64 nullCount = -1;
+	if (chunk->hasStatistics)
+	{
+		nullCount = chunk->nullCount;
+	}
+	else if (chunk->nullState == CHUNK_NULLS_NONE)
+	{
+		nullCount = 0;
+	}
+	else if (chunk->nullState == CHUNK_NULLS_ALL)
+	{
+		nullCount = chunk->rowCount;
+	}
+
+	if (nullCount < 0)
+	{
+		return;
+	}
+
+	uint64 valueCount = chunk->rowCount - nullCount;
+
+	column->rowCount += chunk->rowCount;
+	column->nullCount += nullCount;
+
+	if (valueCount > 0 && chunk->valueEncodingType == VALUE_ENCODING_NONE)
+	{
+		column->valueBytes += chunk->decompressedValueSize;
+		column->valueBytesCount += valueCount;
+	}
+
+	if (chunk->hasStatistics)
+	{
+		column->distinctChunkRowCount += chunk->rowCount;
+		column->distinctChunkValueCount += valueCount;
+		column->distinctSum += chunk->distinctCount;
+		column->distinctMax = Max(column->distinctMax, chunk->distinctCount);
+	}
+
+	if (comparison == NULL || !chunk->hasMinMax || valueCount == 0)
+	{
+		return;
+	}
+
+	/*
+	 * The last range stands for the previous chunk, or for a few chunks ending
+	 * with it once ranges were merged.
+	 */
+	if (column->rangeCount > 0)
+	{
+		uint32 lastRange = column->rangeCount - 1;
+
+		column->adjacentRangeCount++;
+		if (CompareDatums(column->rangeMaximums[lastRange], chunk->minimumValue,
+						  comparison) < 0)
+		{
+			column->ascendingRangeCount++;
+		}
+		else if (CompareDatums(chunk->maximumValue, column->rangeMinimums[lastRange],
+							   comparison) < 0)
+		{
+			column->descendingRangeCount++;
+		}
+	}
+
+	/* like analyze.c, wide values are left out of the histogram */
+	if (!attributeForm->attbyval &&
+		(datumGetSize(chunk->minimumValue, false, attributeForm->attlen) >
+		 HISTOGRAM_WIDTH_THRESHOLD ||
+		 datumGetSize(chunk->maximumValue, false, attributeForm->attlen) >
+		 HISTOGRAM_WIDTH_THRESHOLD))
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(context);
+
+	if (column->rangeMinimums == NULL)
+	{
+		column->rangeMinimums = palloc(MAX_RANGES_PER_COLUMN * sizeof(Datum));
+		column->rangeMaximums = palloc(MAX_RANGES_PER_COLUMN * sizeof(Datum));
+		column->rangeValueCounts = palloc(MAX_RANGES_PER_COLUMN * sizeof(uint64));
+	}
+	else if (column->rangeCount == MAX_RANGES_PER_COLUMN)
+	{
+		MergeAdjacentRanges(column, attributeForm, comparison);
+	}
+
+	uint32 rangeIndex = column->rangeCount++;
+	column->rangeMinimums[rangeIndex] = datumCopy(chunk->minimumValue,
+												  attributeForm->attbyval,
+												  attributeForm->attlen);
+	column->rangeMaximums[rangeIndex] = datumCopy(chunk->maximumValue,
+												  attributeForm->attbyval,
+												  attributeForm->attlen);
+	column->rangeValueCounts[rangeIndex] = valueCount;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * MergeAdjacentRanges halves the number of ranges of a column by merging
+ * each pair of ranges that are next to each other in write order. Tables
+ * that are appended to in order lose little precision this way.
+ */
+static void
+MergeAdjacentRanges(ColumnMetadataStatistics *column, Form_pg_attribute attributeForm,
+					ColumnComparison *comparison)
+{
+	uint32 mergedCount = 0;
+
+	for (uint32 rangeIndex = 0; rangeIndex < column->rangeCount; rangeIndex += 2)
+	{
+		Datum minimum = column->rangeMinimums[rangeIndex];
+		Datum maximum = column->rangeMaximums[rangeIndex];
+		uint64 valueCount = column->rangeValueCounts[rangeIndex];
+
+		if (rangeIndex + 1 < column->rangeCount)
+		{
+			Datum nextMinimum = column->rangeMinimums[rangeIndex + 1];
+			Datum nextMaximum = column->rangeMaximums[rangeIndex + 1];
+
+			if (CompareDatums(nextMinimum, minimum, comparison) < 0)
+			{
+				Datum dropped = minimum;
+				minimum = nextMinimum;
+				nextMinimum = dropped;
+			}
+
+			if (CompareDatums(nextMaximum, maximum, comparison) > 0)
+			{
+				Datum dropped = maximum;
+				maximum = nextMaximum;
+				nextMaximum = dropped;
+			}
+
+			if (!attributeForm->attbyval)
+			{
+				pfree(DatumGetPointer(nextMinimum));
+				pfree(DatumGetPointer(nextMaximum));
+			}
+
+			valueCount += column->rangeValueCounts[rangeIndex + 1];
+		}
+
+		column->rangeMinimums[mergedCount] = minimum;
+		column->rangeMaximums[mergedCount] = maximum;
+		column->rangeValueCounts[mergedCount] = valueCount;
+		mergedCount++;
+	}
+
+	column->rangeCount = mergedCount;
+}
+
+
+/*
+ * LookupColumnComparison finds the comparison function of the default btree
+ * operator class of the column type, and returns false if there is none.
+ */
+static bool
+LookupColumnComparison(Form_pg_attribute attributeForm, ColumnComparison *comparison)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(attributeForm->atttypid,
+												  TYPECACHE_LT_OPR |
+												  TYPECACHE_CMP_PROC_FINFO);
+	if (!OidIsValid(typeEntry->lt_opr) || !OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+	{
+		return false;
+	}
+
+	comparison->comparisonFunction = &typeEntry->cmp_proc_finfo;
+	comparison->collation = attributeForm->attcollation;
+
+	return true;
+}
+
+
+/*
+ * CompareDatums compares two values of a column with its btree comparison
+ * function.
+ */
+static int
+CompareDatums(Datum left, Datum right, ColumnComparison *comparison)
+{
+	return DatumGetInt32(FunctionCall2Coll(comparison->comparisonFunction,
+										   comparison->collation, left, right));
+}
+
+
+/*
+ * CompareHistogramPoints is the qsort_arg comparator of histogram points.
+ */
+static int
+CompareHistogramPoints(const void *left, const void *right, void *argument)
+{
+	const HistogramPoint *leftPoint = (const HistogramPoint *) left;
+	const HistogramPoint *rightPoint = (const HistogramPoint *) right;
+
+	return CompareDatums(leftPoint->value, rightPoint->value,
+						 (ColumnComparison *) argument);
+}
+
+
+/*
+ * EstimateColumn turns the chunk metadata sums of a column into the null
+ * fraction, average width, number of distinct values, histogram and
+ * correlation that ANALYZE would have stored.
+ *
+ * A chunk only knows its own number of distinct values. Values that are
+ * (nearly) unique within their chunks are taken to be unique overall. For
+ * the others, the estimate goes from the largest chunk estimate, for chunks
+ * with overlapping ranges that likely share their values, up to the sum of
+ * the chunk estimates, for chunks whose ranges follow each other.
+ */
+static void
+EstimateColumn(ColumnMetadataStatistics *column, Form_pg_attribute attributeForm,
+			   MetadataColumnEstimate *estimate)
+{
+	estimate->nullFraction = 0.0;
+	if (column->rowCount > 0)
+	{
+		estimate->nullFraction = (double) column->nullCount / column->rowCount;
+	}
+
+	if (attributeForm->attlen > 0)
+	{
+		estimate->width = attributeForm->attlen;
+	}
+	else if (column->valueBytesCount > 0)
+	{
+		estimate->width = (int32) rint((double) column->valueBytes /
+									   column->valueBytesCount);
+	}
+	else
+	{
+		estimate->width = get_typavgwidth(attributeForm->atttypid,
+										  attributeForm->atttypmod);
+	}
+
+	double distinct = 0.0;
+	if (column->distinctChunkValueCount > 0 &&
+		column->distinctSum >= UNIQUE_CHUNK_VALUES_FRACTION *
+		column->distinctChunkValueCount)
+	{
+		distinct = column->distinctSum;
+	}
+	else if (column->distinctChunkValueCount > 0)
+	{
+		double followingFraction = 0.0;
+		if (column->adjacentRangeCount > 0)
+		{
+			followingFraction = (double) (column->ascendingRangeCount +
+										  column->descendingRangeCount) /
+								column->adjacentRangeCount;
+		}
+
+		distinct = column->distinctMax +
+				   (column->distinctSum - column->distinctMax) * followingFraction;
+	}
+
+	/* like analyze.c, scale with the table when above a tenth of the rows */
+	estimate->distinct = rint(distinct);
+	if (distinct > 0.1 * column->distinctChunkRowCount)
+	{
+		estimate->distinct = -Min(distinct / column->distinctChunkRowCount, 1.0);
+	}
+
+	/*
+	 * Ranges that follow each other upwards suggest the rows are stored in
+	 * value order, as do ranges going downwards for the reverse order.
+	 */
+	if (column->adjacentRangeCount > 0)
+	{
+		estimate->hasCorrelation = true;
+		estimate->correlation = (double) ((int64) column->ascendingRangeCount -
+										  (int64) column->descendingRangeCount) /
+								column->adjacentRangeCount;
+	}
+
+	EstimateHistogram(column, attributeForm, estimate);
+}
+
+
+/*
+ * EstimateHistogram makes equi-depth histogram bounds from the chunk ranges
+ * of a column. Each range adds its minimum and maximum, each standing for
+ * half of the values of the range.
+ */
+static void
+EstimateHistogram(ColumnMetadataStatistics *column, Form_pg_attribute attributeForm,
+				  MetadataColumnEstimate *estimate)
+{
+	ColumnComparison comparison = { 0 };
+	if (column->rangeCount == 0 || !LookupColumnComparison(attributeForm, &comparison))
+	{
+		return;
+	}
+
+	uint32 pointCount = column->rangeCount * 2;
+	HistogramPoint *points = palloc(pointCount * sizeof(HistogramPoint));
+	double totalWeight = 0.0;
+
+	for (uint32 rangeIndex = 0; rangeIndex < column->rangeCount; rangeIndex++)
+	{
+		double weight = column->rangeValueCounts[rangeIndex] / 2.0;
+
+		points[rangeIndex * 2].value = column->rangeMinimums[rangeIndex];
+		points[rangeIndex * 2].weight = weight;
+		points[rangeIndex * 2 + 1].value = column->rangeMaximums[rangeIndex];
+		points[rangeIndex * 2 + 1].weight = weight;
+		totalWeight += 2 * weight;
+	}
+
+	qsort_arg(points, pointCount, sizeof(HistogramPoint), CompareHistogramPoints,
+			  &comparison);
+
+	int statisticsTarget = attributeForm->attstattarget;
+	if (statisticsTarget < 0)
+	{
+		statisticsTarget = default_statistics_target;
+	}
+
+	int boundCount = Min(pointCount, statisticsTarget + 1);
+	if (boundCount < 2)
+	{
+		pfree(points);
+		return;
+	}
+
+	estimate->bounds = palloc(boundCount * sizeof(Datum));
+	estimate->boundCount = boundCount;
+	estimate->lessThanOperator =
+		lookup_type_cache(attributeForm->atttypid, TYPECACHE_LT_OPR)->lt_opr;
+
+	/*
+	 * Bound i is the point whose middle is closest to where i / (boundCount - 1)
+	 * of the rows are, which keeps all points when there are few enough.
+	 */
+	uint32 pointIndex = 0;
+	double pointMiddle = points[0].weight / 2;
+	for (int boundIndex = 0; boundIndex < boundCount; boundIndex++)
+	{
+		double boundWeight = totalWeight * boundIndex / (boundCount - 1);
+
+		while (pointIndex < pointCount - 1)
+		{
+			double nextMiddle = pointMiddle + points[pointIndex].weight / 2 +
+								points[pointIndex + 1].weight / 2;
+			if (fabs(nextMiddle - boundWeight) > fabs(pointMiddle - boundWeight))
+			{
+				break;
+			}
+
+			pointMiddle = nextMiddle;
+			pointIndex++;
+		}
+
+		if (boundIndex == boundCount - 1)
+		{
+			pointIndex = pointCount - 1;
+		}
+
+		estimate->bounds[boundIndex] = points[pointIndex].value;
+	}
+
+	pfree(points);
+}
+
+
+/*
+ * MetadataStatisticsTuple forms the pg_statistic tuple the planner reads the
+ * estimates of a column from.
+ */
+static HeapTuple
+MetadataStatisticsTuple(Relation relation, AttrNumber attnum,
+						MetadataColumnEstimate *estimate)
+{
+	Form_pg_attribute attributeForm = TupleDescAttr(RelationGetDescr(relation),
+													AttrNumberGetAttrOffset(attnum));
+	Datum values[Natts_pg_statistic] = { 0 };
+	bool nulls[Natts_pg_statistic] = { 0 };
+
+	values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(RelationGetRelid(relation));
+	values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attnum);
+	values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(false);
+	values[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(estimate->nullFraction);
+	values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(estimate->width);
+	values[Anum_pg_statistic_stadistinct - 1] = Float4GetDatum(estimate->distinct);
+
+	for (int slotIndex = 0; slotIndex < STATISTIC_NUM_SLOTS; slotIndex++)
+	{
+		values[Anum_pg_statistic_stakind1 - 1 + slotIndex] = Int16GetDatum(0);
+		values[Anum_pg_statistic_staop1 - 1 + slotIndex] = ObjectIdGetDatum(InvalidOid);
+		values[Anum_pg_statistic_stacoll1 - 1 + slotIndex] = ObjectIdGetDatum(InvalidOid);
+		nulls[Anum_pg_statistic_stanumbers1 - 1 + slotIndex] = true;
+		nulls[Anum_pg_statistic_stavalues1 - 1 + slotIndex] = true;
+	}
+
+	int slotIndex = 0;
+	if (estimate->boundCount > 0)
+	{
+		ArrayType *bounds = construct_array(estimate->bounds, estimate->boundCount,
+											attributeForm->atttypid,
+											attributeForm->attlen,
+											attributeForm->attbyval,
+											attributeForm->attalign);
+
+		values[Anum_pg_statistic_stakind1 - 1 + slotIndex] =
+			Int16GetDatum(STATISTIC_KIND_HISTOGRAM);
+		values[Anum_pg_statistic_staop1 - 1 + slotIndex] =
+			ObjectIdGetDatum(estimate->lessThanOperator);
+		values[Anum_pg_statistic_stacoll1 - 1 + slotIndex] =
+			ObjectIdGetDatum(attributeForm->attcollation);
+		values[Anum_pg_statistic_stavalues1 - 1 + slotIndex] = PointerGetDatum(bounds);
+		nulls[Anum_pg_statistic_stavalues1 - 1 + slotIndex] = false;
+		slotIndex++;
+	}
+
+	if (estimate->hasCorrelation && OidIsValid(estimate->lessThanOperator))
+	{
+		Datum correlation = Float4GetDatum(estimate->correlation);
+		ArrayType *numbers = construct_array(&correlation, 1, FLOAT4OID, sizeof(float4),
+											 FLOAT4PASSBYVAL, TYPALIGN_INT);
+
+		values[Anum_pg_statistic_stakind1 - 1 + slotIndex] =
+			Int16GetDatum(STATISTIC_KIND_CORRELATION);
+		values[Anum_pg_statistic_staop1 - 1 + slotIndex] =
+			ObjectIdGetDatum(estimate->lessThanOperator);
+		values[Anum_pg_statistic_stacoll1 - 1 + slotIndex] =
+			ObjectIdGetDatum(attributeForm->attcollation);
+		values[Anum_pg_statistic_stanumbers1 - 1 + slotIndex] = PointerGetDatum(numbers);
+		nulls[Anum_pg_statistic_stanumbers1 - 1 + slotIndex] = false;
+		slotIndex++;
+	}
+
+	Relation statisticRelation = table_open(StatisticRelationId, AccessShareLock);
+	HeapTuple statsTuple = heap_form_tuple(RelationGetDescr(statisticRelation),
+										   values, nulls);
+	table_close(statisticRelation, AccessShareLock);
+
+	return statsTuple;
+}
+
+
+/* We return 6 columns. */
+#define METADATA_STATISTICS_NATTS 6
+
+/*
+ * columnar_metadata_statistics returns, for each column of a columnar
+ * table, the statistics columnar.enable_metadata_statistics gives the
+ * planner, in the units of pg_stats. They are computed even when the
+ * planner would use the ANALYZE statistics instead.
+ */
+PG_FUNCTION_INFO_V1(columnar_metadata_statistics);
+Datum
+columnar_metadata_statistics(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("function returning record called in context "
+							   "that cannot accept type record")));
+	}
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	Relation relation = RelationIdGetRelation(relationId);
+	if (!RelationIsValid(relation))
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_TABLE),
+						errmsg("relation with OID %u does not exist", relationId)));
+	}
+
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		RelationClose(relation);
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("table %s is not a columnar table",
+							   quote_identifier(get_rel_name(relationId)))));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	MemoryContextSwitchTo(oldContext);
+
+	MemoryContext context = NULL;
+	ColumnMetadataStatistics *columns =
+		ColumnMetadataStatisticsForRelation(relation, &context);
+
+	TupleDesc relationDescriptor = RelationGetDescr(relation);
+	for (int columnIndex = 0; columnIndex < relationDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(relationDescriptor,
+														columnIndex);
+		ColumnMetadataStatistics *column = &columns[columnIndex];
+
+		if (attributeForm->attisdropped || column->rowCount == 0)
+		{
+			continue;
+		}
+
+		MetadataColumnEstimate estimate = { 0 };
+		EstimateColumn(column, attributeForm, &estimate);
+
+		Datum values[METADATA_STATISTICS_NATTS] = { 0 };
+		bool nulls[METADATA_STATISTICS_NATTS] = { 0 };
+
+		values[0] = NameGetDatum(&attributeForm->attname);
+		values[1] = Float4GetDatum(estimate.nullFraction);
+		values[2] = Int32GetDatum(estimate.width);
+		values[3] = Float4GetDatum(estimate.distinct);
+
+		nulls[4] = true;
+		if (estimate.boundCount > 0)
+		{
+			ArrayType *bounds = construct_array(estimate.bounds, estimate.boundCount,
+												attributeForm->atttypid,
+												attributeForm->attlen,
+												attributeForm->attbyval,
+												attributeForm->attalign);
+			values[4] = CStringGetTextDatum(OidOutputFunctionCall(F_ARRAY_OUT,
+																  PointerGetDatum(
+																	  bounds)));
+			nulls[4] = false;
+		}
+
+		values[5] = Float4GetDatum(estimate.correlation);
+		nulls[5] = !estimate.hasCorrelation;
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+	}
+
+	if (context != NULL)
+	{
+		MemoryContextDelete(context);
+	}
+
+	RelationClose(relation);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = tupleDescriptor;
+
+	return (Datum) 0;
+}
@@ -0,0 +1,166 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_offload.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Offloading of cold stripes of columnar tables to cheaper storage, usually
+ * an S3 compatible bucket mounted on the server at columnar.offload_directory.
+ *
+ * The data of an offloaded stripe is appended to a file per table in that
+ * directory, and the stripe gets a new stripe id whose file offset points
+ * into that file, see ColumnarStorageOffload. Its skip list, row masks and
+ * row numbers are kept in the metadata tables, so chunk groups are still
+ * filtered before anything is read, and only the chunks a scan needs are
+ * read from the file. Transactions that still see the old stripe keep
+ * reading its local data, whose space is reused by a later columnar.vacuum.
+ *
+ * columnar.vacuum and the compaction workers leave offloaded stripes alone.
+ * VACUUM FULL brings them back into the table.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/commit_ts.h"
+#include "access/table.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/utils/listutils.h"
+
+static void OffloadStripe(Relation rel, StripeMetadata *stripeMetadata);
+
+PG_FUNCTION_INFO_V1(columnar_offload_stripes);
+
+
+/*
+ * columnar_offload_stripes moves the stripes of a columnar table to
+ * columnar.offload_directory and returns how many it moved. If older_than is
+ * given, only stripes committed at least that long ago are moved.
+ */
+Datum
+columnar_offload_stripes(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		ereport(ERROR, (errmsg("table_name can't be NULL")));
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+
+	if (columnar_offload_directory == NULL || columnar_offload_directory[0] == '\0')
+	{
+		ereport(ERROR, (errmsg("columnar.offload_directory is not set"),
+						errhint("Set it to the directory stripes should be "
+								"moved to.")));
+	}
+
+	bool hasCutoff = !PG_ARGISNULL(1);
+	TimestampTz cutoff = 0;
+	if (hasCutoff)
+	{
+		if (!track_commit_timestamp)
+		{
+			ereport(ERROR, (errmsg("older_than requires track_commit_timestamp"),
+							errhint("Set track_commit_timestamp to on, stripes "
+									"written after that can be offloaded by "
+									"age.")));
+		}
+
+		cutoff = DatumGetTimestampTz(DirectFunctionCall2(timestamptz_mi_interval,
+														 TimestampTzGetDatum(
+															 GetCurrentTimestamp()),
+														 PG_GETARG_DATUM(1)));
+	}
+
+	/* blocks writers, but not readers, of the table while stripes are moved */
+	Relation rel = table_open(relationId, ExclusiveLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
+	}
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Offload Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+	int32 offloadedCount = 0;
+	uint64 offloadedDataLength = 0;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 || stripeMetadata->insertedByCurrentXact ||
+			ColumnarLogicalOffsetIsOffloaded(stripeMetadata->fileOffset) ||
+			(hasCutoff && !StripeWrittenBefore(stripeMetadata, cutoff)))
+		{
+			continue;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+
+		OffloadStripe(rel, stripeMetadata);
+		offloadedDataLength += stripeMetadata->dataLength;
+		offloadedCount++;
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	MemoryContextDelete(stripeContext);
+
+	ereport(DEBUG1, (errmsg("\"%s\": offloaded %d stripes of " UINT64_FORMAT " bytes",
+							RelationGetRelationName(rel), offloadedCount,
+							offloadedDataLength)));
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT32(offloadedCount);
+}
+
+
+/*
+ * OffloadStripe copies the data of the given stripe to the offload file of
+ * the table and replaces the stripe with one that is read from there. The
+ * data is copied as is, so the skip list of the stripe stays valid.
+ */
+static void
+OffloadStripe(Relation rel, StripeMetadata *stripeMetadata)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+												  tupleDescriptor,
+												  stripeMetadata->chunkCount,
+												  GetTransactionSnapshot());
+
+	/* columns added after the stripe was written have no chunks in it */
+	skipList->columnCount = Min(stripeMetadata->columnCount, skipList->columnCount);
+
+	uint64 fileOffset = ColumnarStorageOffload(rel, stripeMetadata->fileOffset,
+											   stripeMetadata->dataLength);
+	uint64 newStripeId = ColumnarStorageReserveStripeId(rel);
+
+	ColumnarVisibilityMapClearStripe(rel, stripeMetadata);
+	ReplaceStripeMetadata(rel, stripeMetadata, newStripeId, fileOffset,
+						  stripeMetadata->dataLength, skipList, tupleDescriptor);
+}
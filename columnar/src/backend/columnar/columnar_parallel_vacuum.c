@@ -0,0 +1,378 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_parallel_vacuum.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Parallel workers that decode the candidate stripes of columnar.vacuum.
+ *
+ * Combining stripes is dominated by decompressing and decoding the
+ * candidate stripes and by filtering out the rows that their row masks mark
+ * as deleted. Workers claim candidate stripes one at a time and send their
+ * live rows back to the leader through a shared memory queue per worker,
+ * and the leader collects the rows of each candidate into its own
+ * tuplestore.
+ *
+ * Re-encoding the rows and swapping the stripe metadata stay in the leader:
+ * PostgreSQL doesn't allow writes while in parallel mode, so the leader
+ * exits parallel mode before writing a batch of candidates, in the same
+ * order as the serial code.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/parallel.h"
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/xact.h"
+#include "executor/tuptable.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_version_compat.h"
+
+#define PARALLEL_VACUUM_KEY_SHARED UINT64CONST(0xC01A000000000001)
+#define PARALLEL_VACUUM_KEY_QUEUES UINT64CONST(0xC01A000000000002)
+
+/* same size as the tuple queues of parallel query */
+#define PARALLEL_VACUUM_QUEUE_SIZE 65536
+
+typedef struct ParallelVacuumStripe
+{
+	StripeMetadata stripeMetadata;
+	uint32 rowLimit;
+} ParallelVacuumStripe;
+
+typedef struct ParallelVacuumShared
+{
+	Oid relationId;
+	uint32 stripeCount;
+	pg_atomic_uint32 nextStripe;
+	ParallelVacuumStripe stripes[FLEXIBLE_ARRAY_MEMBER];
+} ParallelVacuumShared;
+
+PGDLLEXPORT void ColumnarParallelVacuumWorkerMain(dsm_segment *seg, shm_toc *toc);
+
+static void ReadStripeIntoQueue(Relation relation, ParallelVacuumStripe *stripe,
+								uint32 stripeIndex, shm_mq_handle *queue);
+static void ReceiveStripeRows(ParallelContext *pcxt, shm_mq_handle **queues,
+							  Tuplestorestate **stripeRows, uint32 stripeCount,
+							  TupleDesc tupleDescriptor);
+
+
+/*
+ * ColumnarParallelVacuumWorkers returns the number of workers to use for
+ * decoding candidateCount vacuum candidates, 0 if they should be decoded
+ * by the leader.
+ */
+int
+ColumnarParallelVacuumWorkers(int candidateCount)
+{
+	/* InitializeParallelDSM serializes the active snapshot */
+	if (!columnar_enable_parallel_execution || IsInParallelMode() ||
+		!ActiveSnapshotSet() || candidateCount < 2)
+	{
+		return 0;
+	}
+
+	return Min(max_parallel_maintenance_workers, candidateCount);
+}
+
+
+/*
+ * ColumnarParallelReadStripeRows decodes the given stripes in nworkers
+ * parallel workers and returns a tuplestore per stripe with the first
+ * rowLimits[i] live rows of stripes[i]. It returns NULL if no workers
+ * could be launched, and the caller should read the stripes itself.
+ * Also used by VACUUM FULL and CLUSTER to read the old relfilenode.
+ */
+Tuplestorestate **
+ColumnarParallelReadStripeRows(Relation relation, StripeMetadata **stripes,
+							   uint32 *rowLimits, uint32 stripeCount, int nworkers)
+{
+	/* workers can only see the row masks this transaction flushed */
+	RowMaskFlushWriteStateForRelfilenode(relation->rd_node.relNode,
+										 GetCurrentSubTransactionId());
+
+	EnterParallelMode();
+
+	ParallelContext *pcxt = CreateParallelContext("columnar",
+												  "ColumnarParallelVacuumWorkerMain",
+												  nworkers);
+
+	Size sharedSize = add_size(offsetof(ParallelVacuumShared, stripes),
+							   mul_size(stripeCount, sizeof(ParallelVacuumStripe)));
+	shm_toc_estimate_chunk(&pcxt->estimator, sharedSize);
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   mul_size(PARALLEL_VACUUM_QUEUE_SIZE, pcxt->nworkers));
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	/* InitializeParallelDSM sets nworkers to 0 if it couldn't create a segment */
+	if (pcxt->nworkers == 0)
+	{
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return NULL;
+	}
+
+	ParallelVacuumShared *shared = shm_toc_allocate(pcxt->toc, sharedSize);
+	shared->relationId = RelationGetRelid(relation);
+	shared->stripeCount = stripeCount;
+	pg_atomic_init_u32(&shared->nextStripe, 0);
+
+	for (uint32 i = 0; i < stripeCount; i++)
+	{
+		shared->stripes[i].stripeMetadata = *stripes[i];
+		shared->stripes[i].rowLimit = rowLimits[i];
+	}
+
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_SHARED, shared);
+
+	char *queueSpace = shm_toc_allocate(pcxt->toc,
+										mul_size(PARALLEL_VACUUM_QUEUE_SIZE,
+												 pcxt->nworkers));
+	shm_mq_handle **queues = palloc0(pcxt->nworkers * sizeof(shm_mq_handle *));
+
+	for (int i = 0; i < pcxt->nworkers; i++)
+	{
+		shm_mq *queue = shm_mq_create(queueSpace + i * PARALLEL_VACUUM_QUEUE_SIZE,
+									  PARALLEL_VACUUM_QUEUE_SIZE);
+		shm_mq_set_receiver(queue, MyProc);
+		queues[i] = shm_mq_attach(queue, pcxt->seg, NULL);
+	}
+
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_QUEUES, queueSpace);
+
+	LaunchParallelWorkers(pcxt);
+
+	Tuplestorestate **stripeRows = NULL;
+
+	if (pcxt->nworkers_launched > 0)
+	{
+		for (int i = 0; i < pcxt->nworkers_launched; i++)
+		{
+			shm_mq_set_handle(queues[i], pcxt->worker[i].bgwhandle);
+		}
+
+		stripeRows = palloc0(stripeCount * sizeof(Tuplestorestate *));
+		ReceiveStripeRows(pcxt, queues, stripeRows, stripeCount,
+						  RelationGetDescr(relation));
+
+		/* rethrows any error of the workers */
+		WaitForParallelWorkersToFinish(pcxt);
+	}
+
+	for (int i = 0; i < pcxt->nworkers; i++)
+	{
+		shm_mq_detach(queues[i]);
+	}
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+
+	return stripeRows;
+}
+
+
+/*
+ * ReceiveStripeRows drains the queues of the launched workers until all of
+ * them detached. Every worker sends the index of a stripe it claimed,
+ * followed by the rows of that stripe.
+ */
+static void
+ReceiveStripeRows(ParallelContext *pcxt, shm_mq_handle **queues,
+				  Tuplestorestate **stripeRows, uint32 stripeCount,
+				  TupleDesc tupleDescriptor)
+{
+	int workerCount = pcxt->nworkers_launched;
+	int activeWorkerCount = workerCount;
+	bool *workerDetached = palloc0(workerCount * sizeof(bool));
+	uint32 *workerStripe = palloc0(workerCount * sizeof(uint32));
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	/* split work_mem between the tuplestores, they spill to disk past it */
+	int stripeWorkMem = Max(work_mem / (int) stripeCount, 64);
+
+	while (activeWorkerCount > 0)
+	{
+		bool receivedAny = false;
+
+		for (int i = 0; i < workerCount; i++)
+		{
+			if (workerDetached[i])
+			{
+				continue;
+			}
+
+			Size nbytes = 0;
+			void *data = NULL;
+			shm_mq_result result = shm_mq_receive(queues[i], &nbytes, &data, true);
+
+			if (result == SHM_MQ_WOULD_BLOCK)
+			{
+				continue;
+			}
+			else if (result == SHM_MQ_DETACHED)
+			{
+				workerDetached[i] = true;
+				activeWorkerCount--;
+				continue;
+			}
+
+			receivedAny = true;
+
+			/* stripe indexes are shorter than any minimal tuple */
+			if (nbytes == sizeof(uint32))
+			{
+				uint32 stripeIndex = *(uint32 *) data;
+
+				if (stripeIndex >= stripeCount)
+				{
+					elog(ERROR, "parallel vacuum worker sent invalid stripe index %u",
+						 stripeIndex);
+				}
+
+				workerStripe[i] = stripeIndex;
+				stripeRows[stripeIndex] = tuplestore_begin_heap(false, false,
+																stripeWorkMem);
+				continue;
+			}
+
+			ExecStoreMinimalTuple((MinimalTuple) data, slot, false);
+			tuplestore_puttupleslot(stripeRows[workerStripe[i]], slot);
+		}
+
+		if (!receivedAny && activeWorkerCount > 0)
+		{
+			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, 0,
+							 WAIT_EVENT_MQ_RECEIVE);
+			ResetLatch(MyLatch);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	pfree(workerDetached);
+	pfree(workerStripe);
+}
+
+
+/*
+ * ColumnarParallelVacuumWorkerMain is the entry point of the parallel
+ * workers of columnar.vacuum. It claims stripes until there are none left.
+ */
+void
+ColumnarParallelVacuumWorkerMain(dsm_segment *seg, shm_toc *toc)
+{
+	ParallelVacuumShared *shared = shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_SHARED,
+												  false);
+	char *queueSpace = shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_QUEUES, false);
+
+	shm_mq *queue = (shm_mq *) (queueSpace +
+								ParallelWorkerNumber * PARALLEL_VACUUM_QUEUE_SIZE);
+	shm_mq_set_sender(queue, MyProc);
+	shm_mq_handle *queueHandle = shm_mq_attach(queue, seg, NULL);
+
+	/* the leader holds ExclusiveLock, which doesn't conflict within its group */
+	Relation relation = table_open(shared->relationId, AccessShareLock);
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Parallel Vacuum Stripe Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	while (true)
+	{
+		uint32 stripeIndex = pg_atomic_fetch_add_u32(&shared->nextStripe, 1);
+		if (stripeIndex >= shared->stripeCount)
+		{
+			break;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+
+		ReadStripeIntoQueue(relation, &shared->stripes[stripeIndex], stripeIndex,
+							queueHandle);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	table_close(relation, AccessShareLock);
+	shm_mq_detach(queueHandle);
+}
+
+
+/*
+ * ReadStripeIntoQueue sends the stripe index followed by the live rows of
+ * the stripe, read the same way as the serial code of columnar.vacuum does.
+ */
+static void
+ReadStripeIntoQueue(Relation relation, ParallelVacuumStripe *stripe,
+					uint32 stripeIndex, shm_mq_handle *queue)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	List *columnList = NIL;
+
+	for (int i = 0; i < tupleDescriptor->natts; i++)
+	{
+		if (!TupleDescAttr(tupleDescriptor, i)->attisdropped)
+		{
+			columnList = lappend_int(columnList, i + 1);
+		}
+	}
+
+	shm_mq_result result = shm_mq_send_compat(queue, sizeof(uint32), &stripeIndex,
+											  false, true);
+	if (result != SHM_MQ_SUCCESS)
+	{
+		return;
+	}
+
+	ColumnarReadState *readState = ColumnarBeginRead(relation, tupleDescriptor,
+													 columnList, NIL,
+													 CurrentMemoryContext,
+													 SnapshotAny, true, NULL);
+	ColumnarSetStripeReadState(readState, &stripe->stripeMetadata);
+
+	Datum *values = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+	uint64 highestRowNumber = StripeGetHighestRowNumber(&stripe->stripeMetadata);
+	uint64 rowNumber = 0;
+	uint32 rowCount = 0;
+
+	while (rowCount < stripe->rowLimit &&
+		   ColumnarReadNextRow(readState, values, nulls, &rowNumber) &&
+		   rowNumber <= highestRowNumber)
+	{
+		MinimalTuple tuple = heap_form_minimal_tuple(tupleDescriptor, values, nulls);
+
+		result = shm_mq_send_compat(queue, tuple->t_len, tuple, false, false);
+		pfree(tuple);
+
+		if (result != SHM_MQ_SUCCESS)
+		{
+			break;
+		}
+
+		rowCount++;
+	}
+
+	ColumnarEndRead(readState);
+}
@@ -17,10 +17,16 @@
 #include "access/amapi.h"
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_inherits.h"
 #include "catalog/pg_statistic.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
 #include "commands/defrem.h"
+#include "executor/nodeAgg.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
 #include "optimizer/cost.h"
 #include "optimizer/optimizer.h"
 #include "optimizer/pathnode.h"
@@ -28,10 +34,14 @@
 #include "optimizer/plancat.h"
 #include "optimizer/planner.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
 #include "tcop/utility.h"
 #include "parser/parse_oper.h"
 #include "parser/parse_func.h"
+#include "parser/parse_relation.h"
 #include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/selfuncs.h"
 #include "utils/syscache.h"
@@ -39,22 +49,62 @@
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
+#include "columnar/columnar_tableam.h"
 #include "columnar/vectorization/columnar_vector_execution.h"
 #include "columnar/vectorization/nodes/columnar_aggregator_node.h"
+#include "columnar/vectorization/nodes/columnar_window_node.h"
 
 #include "columnar/utils/listutils.h"
 
+/*
+ * Fraction of the CPU cost of an aggregate that remains when it runs as a
+ * vector aggregate over a columnar scan.
+ */
+#define VECTORIZED_AGGREGATE_COST_FACTOR 0.25
+
 static planner_hook_type PreviousPlannerHook = NULL;
+static create_upper_paths_hook_type PreviousCreateUpperPathsHook = NULL;
 
 static PlannedStmt * ColumnarPlannerHook(Query *parse,  const char *query_string,
 										 int cursorOptions, ParamListInfo boundParams);
 
 #if PG_VERSION_NUM >= PG_VERSION_14
 static Plan * PlanTreeMutator(Plan *node, void *context);
+static Plan * VectorizeAggregate(Agg *aggNode, PlanTreeMutatorContext *planTreeContext,
+								 const char **fallbackReason);
+static bool IsColumnarScanPlan(Plan *plan);
+static void ColumnarCreateUpperPathsHook(PlannerInfo *root, UpperRelationKind stage,
+										 RelOptInfo *inputRel, RelOptInfo *outputRel,
+										 void *extra);
+static void CostVectorizedAggregatePaths(PlannerInfo *root, List *pathList);
+static bool VectorizedAggregatePathSupported(PlannerInfo *root, AggPath *aggPath);
+static bool AggregatesVectorizable(Node *node);
+static bool ContainsParams(Node *node, void *context);
+static bool AggregatesColumnarPartitions(Query *parse);
+static List * StripeProjectionColumns(Agg *aggNode);
+static bool VectorizedWindowAggSupported(WindowAgg *windowAgg);
+static bool UnsupportedWindowExpression(Node *node, List **windowFuncs);
+static bool VectorizedWindowFuncSupported(WindowFunc *windowFunc, WindowAgg *windowAgg);
+static bool VectorizedWindowFrameSupported(WindowAgg *windowAgg);
+static Plan * VectorizeWindowAgg(WindowAgg *windowAgg);
+static Node * WindowExpressionMutator(Node *node, List **scanTargetList);
 
 typedef struct PlanTreeMutatorContext
 {
+	/* set while the columnar scan below a vectorized aggregate is mutated */
 	bool vectorizedAggregation;
+
+	/* set if that aggregate can use the statistics of chunk groups */
+	bool chunkGroupSummary;
+
+	/* columns whose chunk group sketches that aggregate merges, or NIL */
+	List *chunkGroupSketchColumns;
+
+	/* columns that aggregate needs from stripe projections, or NIL */
+	List *stripeProjection;
+
+	/* why the aggregate above the scans being mutated isn't vectorized */
+	const char *aggregateFallbackReason;
 } PlanTreeMutatorContext;
 
 
@@ -62,6 +112,105 @@ typedef struct PlanTreeMutatorContext
 	( (newnode) = (nodetype *) palloc(sizeof(nodetype)), \
 	  memcpy((newnode), (node), sizeof(nodetype)) )
 
+/*
+ * VectorizedValueFunction replaces a CASE, COALESCE or NULLIF aggregate
+ * argument, vectorized by CreateVectorizedValueExpr, with a call of vcase,
+ * vcoalesce or vnullif, which compute it from the vectors of their
+ * arguments. The conditions of CASE need to be comparisons of a column with
+ * a constant. vcase gets the vectorized procedure of each comparison before
+ * its operands, and all comparisons need the same collation, which vcase
+ * gets as its own.
+ */
+static Node *
+VectorizedValueFunction(Node *node)
+{
+	if (!IsVectorizableValueExpr(node))
+		return node;
+
+	List *args = NIL;
+	Oid inputCollationId = InvalidOid;
+	const char *functionName = NULL;
+	int functionArgumentCount = 1;
+
+	switch (nodeTag(node))
+	{
+		case T_CaseExpr:
+		{
+			CaseExpr *caseExpr = (CaseExpr *) node;
+
+			ListCell *lc;
+			foreach(lc, caseExpr->args)
+			{
+				CaseWhen *caseWhen = lfirst_node(CaseWhen, lc);
+
+				if (!IsA(caseWhen->expr, OpExpr))
+				{
+					elog(ERROR, "Vectorized aggregate arguments accept only CASE "
+								"conditions comparing a column with a constant.");
+				}
+
+				OpExpr *condition = (OpExpr *) caseWhen->expr;
+
+				if (args != NIL && condition->inputcollid != inputCollationId)
+				{
+					elog(ERROR, "Vectorized aggregate arguments accept only CASE "
+								"conditions of the same collation.");
+				}
+
+				inputCollationId = condition->inputcollid;
+
+				args = lappend(args, makeConst(REGPROCOID, -1, InvalidOid,
+											   sizeof(RegProcedure),
+											   ObjectIdGetDatum(condition->opfuncid),
+											   false, true));
+				args = lappend(args, VectorizedValueFunction(linitial(condition->args)));
+				args = lappend(args, VectorizedValueFunction(lsecond(condition->args)));
+				args = lappend(args, VectorizedValueFunction((Node *) caseWhen->result));
+			}
+
+			args = lappend(args, VectorizedValueFunction((Node *) caseExpr->defresult));
+			functionName = "vcase";
+			break;
+		}
+
+		case T_CoalesceExpr:
+		{
+			ListCell *lc;
+			foreach(lc, ((CoalesceExpr *) node)->args)
+			{
+				args = lappend(args, VectorizedValueFunction(lfirst(lc)));
+			}
+
+			functionName = "vcoalesce";
+			break;
+		}
+
+		case T_NullIfExpr:
+		{
+			NullIfExpr *nullIfExpr = (NullIfExpr *) node;
+
+			args = list_make2(VectorizedValueFunction(linitial(nullIfExpr->args)),
+							  VectorizedValueFunction(lsecond(nullIfExpr->args)));
+			inputCollationId = nullIfExpr->inputcollid;
+			functionName = "vnullif";
+			functionArgumentCount = 2;
+			break;
+		}
+
+		default:
+			elog(ERROR, "Unsupported aggregate argument combination.");
+	}
+
+	Oid argumentTypes[2] = { ANYOID, ANYOID };
+	Oid functionOid = LookupFuncName(list_make1(makeString((char *) functionName)),
+									 functionArgumentCount, argumentTypes, false);
+
+	return (Node *) makeFuncExpr(functionOid, exprType(node), args,
+								 exprCollation(node), inputCollationId,
+								 COERCE_EXPLICIT_CALL);
+}
+
+
 static Node *
 AggRefArgsExpressionMutator(Node *node, void *context)
 {
@@ -70,7 +219,20 @@ AggRefArgsExpressionMutator(Node *node, void *context)
 
 	Node *previousNode = (Node *) context;
 
-	if (IsA(node, OpExpr) || IsA(node, DistinctExpr) || IsA(node, NullIfExpr) )
+	if (IsVectorizableValueExpr(node))
+	{
+		/* only the vectorized quals of scans get params as constants */
+		Node *valueExpr = ContainsParams(node, NULL) ? NULL :
+						  CreateVectorizedValueExpr(node);
+		if (valueExpr == NULL)
+		{
+			elog(ERROR, "Unsupported CASE, COALESCE or NULLIF aggregate argument.");
+		}
+
+		return VectorizedValueFunction(valueExpr);
+	}
+
+	if (IsA(node, OpExpr) || IsA(node, DistinctExpr))
 	{
 		OpExpr *opExprNode = (OpExpr *) node;
 
@@ -83,7 +245,30 @@ AggRefArgsExpressionMutator(Node *node, void *context)
 			return false;
 		}
 
-		if (CheckOpExprArgumentRules(opExprNode->args))
+		/* only arithmetic operators return vectors that aggregates accept */
+		if (opExprNode->opresulttype == BOOLOID)
+		{
+			elog(ERROR, "Vectorized aggregate arguments accept only arithmetic operators.");
+			return false;
+		}
+
+		/* operands are columns, constants or other vectorized operators */
+		ListCell *lcOpExprArgs;
+		int constArgumentCount = 0;
+		foreach(lcOpExprArgs, opExprNode->args)
+		{
+			Node *arg = (Node *) lfirst(lcOpExprArgs);
+
+			if (IsA(arg, Const))
+				constArgumentCount++;
+			else if (!IsA(arg, Var) && !IsA(arg, OpExpr) && !IsVectorizableValueExpr(arg))
+			{
+				elog(ERROR, "Unsupported aggregate argument combination.");
+				return false;
+			}
+		}
+
+		if (constArgumentCount == list_length(opExprNode->args))
 		{
 			elog(ERROR, "Unsupported aggregate argument combination.");
 			return false;
@@ -101,6 +286,9 @@ AggRefArgsExpressionMutator(Node *node, void *context)
 		}
 
 		opExprNode->opfuncid = vectorizedProcedureOid;
+		opExprNode->args = (List *)
+			expression_tree_mutator((Node *) opExprNode->args,
+									AggRefArgsExpressionMutator, (void *) node);
 
 		return (Node *) opExprNode;
 	}
@@ -115,6 +303,177 @@ AggRefArgsExpressionMutator(Node *node, void *context)
 	return expression_tree_mutator(node, AggRefArgsExpressionMutator, (void *) node);
 }
 
+/*
+ * ContainsParams returns whether the expression has a param, for use with
+ * expression_tree_walker.
+ */
+static bool
+ContainsParams(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Param))
+		return true;
+
+	return expression_tree_walker(node, ContainsParams, context);
+}
+
+/*
+ * VectorizedCountDistinct returns the vcount_distinct, or with
+ * columnar.enable_approximate_count_distinct vapprox_count_distinct,
+ * aggregate replacing count(DISTINCT column). The values are hashed by
+ * their binary values, so the column needs a type whose equality is binary
+ * equality, or text under a deterministic collation.
+ */
+static Aggref *
+VectorizedCountDistinct(Aggref *aggRefNode)
+{
+	if (aggRefNode->aggfnoid != F_COUNT_ANY || aggRefNode->aggorder != NIL ||
+		list_length(aggRefNode->args) != 1)
+	{
+		elog(ERROR, "Vectorized aggregate with DISTINCT not supported.");
+	}
+
+	TargetEntry *targetEntry = linitial_node(TargetEntry, aggRefNode->args);
+
+	if (!IsA(targetEntry->expr, Var))
+	{
+		elog(ERROR, "Vectorized Aggregates accepts accepts only valid column argument");
+	}
+
+	switch (exprType((Node *) targetEntry->expr))
+	{
+		case BOOLOID:
+		case CHAROID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			break;
+
+		case TEXTOID:
+		case VARCHAROID:
+		{
+			if (!OidIsValid(aggRefNode->inputcollid) ||
+				!get_collation_isdeterministic(aggRefNode->inputcollid))
+			{
+				elog(ERROR, "Vectorized aggregate with DISTINCT not supported.");
+			}
+			break;
+		}
+
+		default:
+			elog(ERROR, "Vectorized aggregate with DISTINCT not supported.");
+	}
+
+	const char *aggregateName = columnar_enable_approximate_count_distinct ?
+								"vapprox_count_distinct" : "vcount_distinct";
+	Oid argumentType = ANYOID;
+
+	Aggref *newAggRefNode = copyObject(aggRefNode);
+	newAggRefNode->aggfnoid = LookupFuncName(list_make1(makeString((char *) aggregateName)),
+											 1, &argumentType, false);
+	newAggRefNode->aggdistinct = NIL;
+
+	return newAggRefNode;
+}
+
+
+/*
+ * FilteredValue returns CASE WHEN filter THEN value END. A WHEN clause needs
+ * a comparison, so AND becomes nested CASE and OR a WHEN clause for each of
+ * its comparisons.
+ */
+static Expr *
+FilteredValue(Expr *filter, Expr *value)
+{
+	if (is_andclause(filter))
+	{
+		List *filterArgs = ((BoolExpr *) filter)->args;
+
+		Expr *filteredValue = value;
+		for (int i = list_length(filterArgs) - 1; i >= 0; i--)
+		{
+			filteredValue = FilteredValue(list_nth(filterArgs, i), filteredValue);
+		}
+
+		return filteredValue;
+	}
+
+	List *conditionList = is_orclause(filter) ? ((BoolExpr *) filter)->args :
+						  list_make1(filter);
+
+	CaseExpr *caseExpr = makeNode(CaseExpr);
+	caseExpr->casetype = exprType((Node *) value);
+	caseExpr->casecollid = exprCollation((Node *) value);
+	caseExpr->location = -1;
+
+	Expr *condition = NULL;
+	foreach_ptr(condition, conditionList)
+	{
+		if (!IsA(condition, OpExpr))
+		{
+			elog(ERROR, "Vectorized aggregate FILTER accepts only comparisons, "
+						"and AND or OR of them.");
+		}
+
+		CaseWhen *caseWhen = makeNode(CaseWhen);
+		caseWhen->expr = condition;
+		caseWhen->result = value;
+		caseWhen->location = -1;
+
+		caseExpr->args = lappend(caseExpr->args, caseWhen);
+	}
+
+	caseExpr->defresult = (Expr *) makeNullConst(caseExpr->casetype, -1,
+												 caseExpr->casecollid);
+
+	return (Expr *) caseExpr;
+}
+
+
+/*
+ * FilteredAggregate returns a copy of an aggregate with a FILTER clause that
+ * aggregates CASE WHEN filter THEN argument END instead, so vcase masks the
+ * argument with the vectorized comparisons of the filter. The rows the
+ * filter isn't true for are NULL, which the aggregates that have vectorized
+ * versions skip like FILTER does. count(*) counts CASE WHEN filter THEN true
+ * END instead.
+ */
+static Aggref *
+FilteredAggregate(Aggref *aggRefNode)
+{
+	if (aggRefNode->aggdistinct != NIL || aggRefNode->aggorder != NIL ||
+		(!aggRefNode->aggstar && list_length(aggRefNode->args) != 1))
+	{
+		elog(ERROR, "Vectorized aggregate with FILTER not supported");
+	}
+
+	Aggref *newAggRefNode = copyObject(aggRefNode);
+	newAggRefNode->aggfilter = NULL;
+
+	if (aggRefNode->aggstar)
+	{
+		newAggRefNode->aggfnoid = F_COUNT_ANY;
+		newAggRefNode->aggstar = false;
+		newAggRefNode->aggargtypes = list_make1_oid(BOOLOID);
+		newAggRefNode->args =
+			list_make1(makeTargetEntry((Expr *) makeBoolConst(true, false), 1, NULL,
+									   false));
+	}
+
+	TargetEntry *targetEntry = linitial_node(TargetEntry, newAggRefNode->args);
+	targetEntry->expr = FilteredValue(aggRefNode->aggfilter, targetEntry->expr);
+
+	return newAggRefNode;
+}
+
+
 static Node *
 ExpressionMutator(Node *node, void *context)
 {
@@ -124,16 +483,17 @@ ExpressionMutator(Node *node, void *context)
 	if (IsA(node, Aggref))
 	{
 		Aggref *oldAggRefNode = (Aggref *) node;
-		Aggref *newAggRefNode = copyObject(oldAggRefNode);
 
-		if (oldAggRefNode->aggdistinct)
+		if (oldAggRefNode->aggfilter)
 		{
-			elog(ERROR, "Vectorized aggregate with DISTINCT not supported.");
+			oldAggRefNode = FilteredAggregate(oldAggRefNode);
 		}
 
-		if (oldAggRefNode->aggfilter)
+		Aggref *newAggRefNode = copyObject(oldAggRefNode);
+
+		if (oldAggRefNode->aggdistinct)
 		{
-			elog(ERROR, "Vectorized aggregate with FILTER not supported");
+			return (Node *) VectorizedCountDistinct(oldAggRefNode);
 		}
 
 		newAggRefNode->args = (List *)
@@ -154,124 +514,1259 @@ ExpressionMutator(Node *node, void *context)
 }
 
 
-static Plan *
-PlanTreeMutator(Plan *node, void *context)
+/*
+ * VectorizedAggregateStrategyFallbackReason returns why an aggregate can't
+ * run as a vector aggregate node with its strategy, or NULL if it can. Groups
+ * of a hashed aggregate are looked up with the binary values of the grouping
+ * columns, so only fixed width types whose equality is binary equality are
+ * accepted.
+ */
+static const char *
+VectorizedAggregateStrategyFallbackReason(Agg *aggNode)
 {
-	if (node == NULL)
+	if (aggNode->groupingSets != NIL)
+		return "grouping sets are not supported";
+
+	if (aggNode->aggstrategy == AGG_PLAIN)
 		return NULL;
 
-	/* Guard against stack overflow due to overly complex expressions */
-	check_stack_depth();
+	if (aggNode->aggstrategy != AGG_HASHED)
+		return "sorted aggregation is not supported";
 
-	switch (nodeTag(node))
+	for (int i = 0; i < aggNode->numCols; i++)
 	{
-		case T_CustomScan:
+		TargetEntry *targetEntry =
+			get_tle_by_resno(aggNode->plan.lefttree->targetlist, aggNode->grpColIdx[i]);
+
+		if (targetEntry == NULL)
+			return "grouping column is not returned by the scan";
+
+		Oid groupType = exprType((Node *) targetEntry->expr);
+		switch (groupType)
 		{
-			CustomScan *customScan = (CustomScan *) node;
+			case BOOLOID:
+			case CHAROID:
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case OIDOID:
+			case DATEOID:
+			case TIMEOID:
+			case TIMESTAMPOID:
+			case TIMESTAMPTZOID:
+				break;
+
+			default:
+				return psprintf("grouping by type %s is not supported",
+								format_type_be(groupType));
+		}
+	}
 
-			if (customScan->methods == columnar_customscan_methods())
-			{
-				PlanTreeMutatorContext *planTreeContext = (PlanTreeMutatorContext *) context;
+	return NULL;
+}
 
-				Const * vectorizedAggregateExecution = makeNode(Const);
 
-				vectorizedAggregateExecution->constbyval = true;
-				vectorizedAggregateExecution->consttype = CUSTOM_SCAN_VECTORIZED_AGGREGATE;
-				vectorizedAggregateExecution->constvalue =  planTreeContext->vectorizedAggregation;
-				vectorizedAggregateExecution->constlen = sizeof(bool);
+/*
+ * AggregateWithoutSerialFunc returns true if an aggregate of the expression
+ * has a state of type internal but no serialization function.
+ */
+static bool
+AggregateWithoutSerialFunc(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
 
-				customScan->custom_private = lappend(customScan->custom_private, vectorizedAggregateExecution);
-			}
+	if (IsA(node, Aggref))
+	{
+		Aggref *aggRefNode = (Aggref *) node;
 
-			break;
-		}
+		if (aggRefNode->aggtranstype != INTERNALOID)
+			return false;
 
-		case T_Agg:
+		HeapTuple aggTuple = SearchSysCache1(AGGFNOID,
+											 ObjectIdGetDatum(aggRefNode->aggfnoid));
+		if (!HeapTupleIsValid(aggTuple))
 		{
-			Agg *aggNode = (Agg *) node;
-			Agg	*newAgg;
-			CustomScan *vectorizedAggNode;
+			elog(ERROR, "cache lookup failed for aggregate %u", aggRefNode->aggfnoid);
+		}
 
-			if (aggNode->plan.lefttree->type == T_CustomScan)
-			{
-				if (aggNode->aggstrategy == AGG_PLAIN)
-				{
-					vectorizedAggNode = columnar_create_aggregator_node();
+		Form_pg_aggregate aggForm = (Form_pg_aggregate) GETSTRUCT(aggTuple);
+		bool hasSerialFunc = OidIsValid(aggForm->aggserialfn);
+		ReleaseSysCache(aggTuple);
+
+		return !hasSerialFunc;
+	}
+
+	return expression_tree_walker(node, AggregateWithoutSerialFunc, context);
+}
+
+
+/*
+ * VectorizedAggregateSplitSupported returns true if the vector aggregates of
+ * an Agg node can run in its split mode. The states of a partial aggregate
+ * below a Gather are combined by the original aggregates of the Finalize
+ * Aggregate above it, which works as vector aggregates keep the states of the
+ * aggregates they replace, but vector aggregates have no combine functions
+ * of their own, and states of type internal only reach the leader through a
+ * serialization function.
+ */
+static bool
+VectorizedAggregateSplitSupported(Agg *aggNode)
+{
+	if (DO_AGGSPLIT_COMBINE(aggNode->aggsplit))
+		return false;
 
-					FLATCOPY(newAgg, aggNode, Agg);
+	if (!DO_AGGSPLIT_SERIALIZE(aggNode->aggsplit))
+		return true;
 
-					newAgg->plan.targetlist = 
-						(List *) expression_tree_mutator((Node *) newAgg->plan.targetlist, ExpressionMutator, NULL);
+	return !AggregateWithoutSerialFunc((Node *) aggNode->plan.targetlist, NULL) &&
+		   !AggregateWithoutSerialFunc((Node *) aggNode->plan.qual, NULL);
+}
 
 
-					vectorizedAggNode->custom_plans = 
-						lappend(vectorizedAggNode->custom_plans, newAgg);
-					vectorizedAggNode->scan.plan.targetlist = 
-						CustomBuildTargetList(aggNode->plan.targetlist, INDEX_VAR);
-					vectorizedAggNode->custom_scan_tlist = newAgg->plan.targetlist;
+/*
+ * ChunkGroupSummarySupported returns true if the vector aggregates of a plain
+ * Agg node are all count(*), or count, min, max or vapprox_count_distinct of
+ * a column returned by the columnar scan below, and min and max are of
+ * by-value types. The scan can then answer the chunk groups whose rows all
+ * pass its quals from their statistics, see ColumnarSetChunkGroupSummary.
+ * sketchColumns is set to the columns of vapprox_count_distinct, whose chunk
+ * groups are only answered if they have a distinct value sketch.
+ */
+static bool
+ChunkGroupSummarySupported(Agg *aggNode, List **sketchColumns)
+{
+	*sketchColumns = NIL;
 
-					// Parallel agg node
-					Plan *vectorizedAggNodePlan = (Plan *) vectorizedAggNode;
-					vectorizedAggNodePlan->parallel_aware = aggNode->plan.lefttree->parallel_aware;
-					vectorizedAggNodePlan->startup_cost = aggNode->plan.startup_cost;
-					vectorizedAggNodePlan->total_cost = aggNode->plan.total_cost;
-					vectorizedAggNodePlan->plan_rows = aggNode->plan.plan_rows;
-					vectorizedAggNodePlan->plan_width = aggNode->plan.plan_width;
+	if (aggNode->aggstrategy != AGG_PLAIN || aggNode->groupingSets != NIL)
+		return false;
 
+	List *scanTargetList = aggNode->plan.lefttree->targetlist;
+	List *aggNodeList =
+		list_concat(pull_var_clause((Node *) aggNode->plan.targetlist,
+									PVC_INCLUDE_AGGREGATES),
+					pull_var_clause((Node *) aggNode->plan.qual,
+									PVC_INCLUDE_AGGREGATES));
 
-					PlanTreeMutatorContext *planTreeContext = (PlanTreeMutatorContext *) context;
-					planTreeContext->vectorizedAggregation = true;
+	Node *node = NULL;
+	foreach_ptr(node, aggNodeList)
+	{
+		if (!IsA(node, Aggref))
+			return false;
 
-					PlanTreeMutator(node->lefttree, context);
-					PlanTreeMutator(node->righttree, context);
+		Aggref *aggref = (Aggref *) node;
 
-					vectorizedAggNode->scan.plan.lefttree = node->lefttree;
-					vectorizedAggNode->scan.plan.righttree = node->righttree;
+		if (aggref->aggdistinct != NIL || aggref->aggorder != NIL ||
+			aggref->aggfilter != NULL || aggref->aggdirectargs != NIL)
+			return false;
 
-					return (Plan *) vectorizedAggNode;
-				}
+		char *aggregateName = get_func_name(aggref->aggfnoid);
 
-				return node;
-			}
+		if (aggref->aggstar)
+		{
+			if (strcmp(aggregateName, "vcount") != 0)
+				return false;
 
-			break;
+			continue;
 		}
-		default:
+
+		if (list_length(aggref->args) != 1)
+			return false;
+
+		Var *argument = (Var *) ((TargetEntry *) linitial(aggref->args))->expr;
+
+		if (!IsA(argument, Var) || argument->varno != OUTER_VAR ||
+			argument->varattno <= 0 ||
+			argument->varattno > list_length(scanTargetList))
+			return false;
+
+		Var *column = (Var *) ((TargetEntry *) list_nth(scanTargetList,
+														argument->varattno - 1))->expr;
+
+		if (!IsA(column, Var) || column->varattno <= 0)
+			return false;
+
+		if (strcmp(aggregateName, "vcount") == 0)
+			continue;
+
+		if (strcmp(aggregateName, "vapprox_count_distinct") == 0)
 		{
-			
-			break;
+			*sketchColumns = list_append_unique_int(*sketchColumns, column->varattno);
+			continue;
 		}
+
+		/* the state of vmin and vmax is a value of the column */
+		if ((strcmp(aggregateName, "vmin") != 0 && strcmp(aggregateName, "vmax") != 0) ||
+			aggref->aggtranstype != column->vartype ||
+			!get_typbyval(column->vartype))
+			return false;
 	}
 
-	node->lefttree = PlanTreeMutator(node->lefttree, context);
-	node->righttree = PlanTreeMutator(node->righttree, context);
+	return true;
+}
 
-	return node;
+
+/*
+ * ScanColumnOfOuterVar returns the column of the columnar scan below an Agg
+ * node that an OUTER_VAR Var of the Agg refers to, or InvalidAttrNumber if
+ * it isn't a plain column of the scanned relation.
+ */
+static AttrNumber
+ScanColumnOfOuterVar(List *scanTargetList, Node *node)
+{
+	if (!IsA(node, Var))
+		return InvalidAttrNumber;
+
+	Var *var = (Var *) node;
+
+	if (var->varno != OUTER_VAR || var->varattno <= 0 ||
+		var->varattno > list_length(scanTargetList))
+		return InvalidAttrNumber;
+
+	Var *column = (Var *) ((TargetEntry *) list_nth(scanTargetList,
+													var->varattno - 1))->expr;
+
+	if (!IsA(column, Var) || column->varattno <= 0)
+		return InvalidAttrNumber;
+
+	return column->varattno;
 }
-#endif
 
-static PlannedStmt *
-ColumnarPlannerHook(Query *parse,
-					const char *query_string,
-					int cursorOptions,
-					ParamListInfo boundParams)
+
+/*
+ * StripeProjectionColumns returns which columns the vector aggregates of an
+ * Agg node need from the stripe projections of the columnar scan below, as
+ * a list of the group by columns, the summed columns and the counted
+ * columns, or NIL if the aggregates can't be answered from projections. The
+ * node has to be plain or hashed, group only by columns of the scan, and
+ * only aggregate count(*), and count and sum of such columns. The scan
+ * checks the columns against the projections of its table, see
+ * ColumnarSetStripeProjectionSummary.
+ *
+ * The groups of the projections are added to the hash table of a hashed
+ * aggregation once the scan is done, where they can't be spilled, so its
+ * groups have to be expected to fit in hash_mem.
+ */
+static List *
+StripeProjectionColumns(Agg *aggNode)
 {
-	PlannedStmt	*stmt;
-#if PG_VERSION_NUM >= PG_VERSION_14
-	Plan *savedPlanTree;
-	List *savedSubplan;
-	MemoryContext saved_context;
-#endif
+	if ((aggNode->aggstrategy != AGG_PLAIN && aggNode->aggstrategy != AGG_HASHED) ||
+		aggNode->groupingSets != NIL ||
+		aggNode->numCols > PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM)
+		return NIL;
 
-	if (PreviousPlannerHook)
-		stmt = PreviousPlannerHook(parse, query_string, cursorOptions, boundParams);
-	else
-		stmt = standard_planner(parse, query_string, cursorOptions, boundParams);
+	if (aggNode->aggstrategy == AGG_HASHED)
+	{
+		Size hashEntrySize = hash_agg_entry_size(list_length(aggNode->plan.targetlist),
+												 aggNode->plan.lefttree->plan_width,
+												 aggNode->transitionSpace);
+
+		if (aggNode->numGroups * hashEntrySize > get_hash_memory_limit())
+			return NIL;
+	}
+
+	List *scanTargetList = aggNode->plan.lefttree->targetlist;
+	List *groupColumns = NIL;
+	List *sumColumns = NIL;
+	List *countColumns = NIL;
+	Bitmapset *groupTargetEntries = NULL;
+
+	for (int i = 0; i < aggNode->numCols; i++)
+	{
+		AttrNumber targetEntryIndex = aggNode->grpColIdx[i];
+
+		if (targetEntryIndex <= 0 || targetEntryIndex > list_length(scanTargetList))
+			return NIL;
+
+		Var *column = (Var *) ((TargetEntry *) list_nth(scanTargetList,
+														targetEntryIndex - 1))->expr;
+
+		if (!IsA(column, Var) || column->varattno <= 0)
+			return NIL;
+
+		groupColumns = list_append_unique_int(groupColumns, column->varattno);
+		groupTargetEntries = bms_add_member(groupTargetEntries, targetEntryIndex);
+	}
+
+	List *aggNodeList =
+		list_concat(pull_var_clause((Node *) aggNode->plan.targetlist,
+									PVC_INCLUDE_AGGREGATES),
+					pull_var_clause((Node *) aggNode->plan.qual,
+									PVC_INCLUDE_AGGREGATES));
+
+	Node *node = NULL;
+	foreach_ptr(node, aggNodeList)
+	{
+		/* columns outside of aggregates are returned from the group keys */
+		if (IsA(node, Var))
+		{
+			Var *var = (Var *) node;
+
+			if (var->varno != OUTER_VAR ||
+				!bms_is_member(var->varattno, groupTargetEntries))
+				return NIL;
+
+			continue;
+		}
+
+		if (!IsA(node, Aggref))
+			return NIL;
+
+		Aggref *aggref = (Aggref *) node;
+
+		if (aggref->aggdistinct != NIL || aggref->aggorder != NIL ||
+			aggref->aggfilter != NULL || aggref->aggdirectargs != NIL)
+			return NIL;
+
+		char *aggregateName = get_func_name(aggref->aggfnoid);
+
+		if (aggref->aggstar)
+		{
+			if (strcmp(aggregateName, "vcount") != 0)
+				return NIL;
+
+			continue;
+		}
+
+		if (list_length(aggref->args) != 1)
+			return NIL;
+
+		Node *argument = (Node *) ((TargetEntry *) linitial(aggref->args))->expr;
+		AttrNumber attnum = ScanColumnOfOuterVar(scanTargetList, argument);
+
+		if (attnum == InvalidAttrNumber)
+			return NIL;
+
+		if (strcmp(aggregateName, "vcount") == 0)
+		{
+			countColumns = list_append_unique_int(countColumns, attnum);
+			continue;
+		}
+
+		if (strcmp(aggregateName, "vsum") != 0)
+			return NIL;
+
+		/*
+		 * Integer sums are kept in an int8 state, float sums in a state of the
+		 * type of the column.
+		 */
+		Oid columnType = exprType(argument);
+
+		if (columnType == INT2OID || columnType == INT4OID)
+		{
+			if (aggref->aggtranstype != INT8OID)
+				return NIL;
+		}
+		else if (columnType == FLOAT4OID || columnType == FLOAT8OID)
+		{
+			if (aggref->aggtranstype != columnType)
+				return NIL;
+		}
+		else
+			return NIL;
+
+		sumColumns = list_append_unique_int(sumColumns, attnum);
+	}
+
+	return list_make3(groupColumns, sumColumns, countColumns);
+}
+
+
+/*
+ * ColumnarCreateUpperPathsHook credits the aggregate paths that the planner
+ * hook will turn into vector aggregates with their lower CPU cost, so they
+ * compete with other plans for what they will really cost. Plans are only
+ * vectorized once they are complete, hence the estimate: the aggregate has
+ * to be directly over a columnar scan, and its aggregates have to pass the
+ * same mutation the planner hook applies.
+ */
+static void
+ColumnarCreateUpperPathsHook(PlannerInfo *root, UpperRelationKind stage,
+							 RelOptInfo *inputRel, RelOptInfo *outputRel,
+							 void *extra)
+{
+	if (PreviousCreateUpperPathsHook)
+	{
+		PreviousCreateUpperPathsHook(root, stage, inputRel, outputRel, extra);
+	}
+
+	if (!columnar_enable_vectorization || root->parse->commandType != CMD_SELECT)
+	{
+		return;
+	}
+
+	/*
+	 * Partial aggregates are credited before Gather paths are built on them.
+	 * Hashed DISTINCT is an aggregate without aggregates, whose groups the
+	 * vector aggregate finds the same way.
+	 */
+	if (stage != UPPERREL_GROUP_AGG && stage != UPPERREL_PARTIAL_GROUP_AGG &&
+#if PG_VERSION_NUM >= PG_VERSION_15
+		stage != UPPERREL_PARTIAL_DISTINCT &&
+#endif
+		stage != UPPERREL_DISTINCT)
+	{
+		return;
+	}
+
+	CostVectorizedAggregatePaths(root, outputRel->pathlist);
+	CostVectorizedAggregatePaths(root, outputRel->partial_pathlist);
+}
+
+
+/*
+ * CostVectorizedAggregatePaths lowers the cost of the aggregate paths of the
+ * list that can run as vector aggregates. The aggregate's own cost is what
+ * its startup cost adds to the cost of its input, which covers evaluating
+ * the transition functions for every input row.
+ */
+static void
+CostVectorizedAggregatePaths(PlannerInfo *root, List *pathList)
+{
+	Path *path = NULL;
+	foreach_ptr(path, pathList)
+	{
+		if (!IsA(path, AggPath))
+		{
+			continue;
+		}
+
+		AggPath *aggPath = (AggPath *) path;
+		if (!VectorizedAggregatePathSupported(root, aggPath))
+		{
+			continue;
+		}
+
+		Cost aggregateCost = path->startup_cost - aggPath->subpath->total_cost;
+		if (aggregateCost <= 0)
+		{
+			continue;
+		}
+
+		Cost vectorizationCredit = aggregateCost * (1 - VECTORIZED_AGGREGATE_COST_FACTOR);
+		path->startup_cost -= vectorizationCredit;
+		path->total_cost -= vectorizationCredit;
+	}
+}
+
+
+/*
+ * VectorizedAggregatePathSupported returns true if the planner hook is
+ * expected to turn the given aggregate path into a vector aggregate, see
+ * PlanTreeMutator.
+ */
+static bool
+VectorizedAggregatePathSupported(PlannerInfo *root, AggPath *aggPath)
+{
+	if (!IsColumnarScanPath(aggPath->subpath) || DO_AGGSPLIT_COMBINE(aggPath->aggsplit))
+	{
+		return false;
+	}
+
+	if (aggPath->aggstrategy == AGG_HASHED)
+	{
+		SortGroupClause *groupClause = NULL;
+		foreach_ptr(groupClause, aggPath->groupClause)
+		{
+			Node *groupExpr = get_sortgroupclause_expr(groupClause,
+													   root->parse->targetList);
+
+			switch (exprType(groupExpr))
+			{
+				case BOOLOID:
+				case CHAROID:
+				case INT2OID:
+				case INT4OID:
+				case INT8OID:
+				case OIDOID:
+				case DATEOID:
+				case TIMEOID:
+				case TIMESTAMPOID:
+				case TIMESTAMPTZOID:
+					break;
+
+				default:
+					return false;
+			}
+		}
+	}
+	else if (aggPath->aggstrategy != AGG_PLAIN)
+	{
+		return false;
+	}
+
+	Node *aggregateExprs = (Node *) list_make2(aggPath->path.pathtarget->exprs,
+											   aggPath->qual);
+
+	if (DO_AGGSPLIT_SERIALIZE(aggPath->aggsplit) &&
+		AggregateWithoutSerialFunc(aggregateExprs, NULL))
+	{
+		return false;
+	}
+
+	return AggregatesVectorizable(aggregateExprs);
+}
+
+
+/*
+ * AggregatesVectorizable returns true if ExpressionMutator can replace all
+ * aggregates of the given expression with vector aggregates. The mutator
+ * reports what it can't vectorize with errors, which are swallowed here.
+ */
+static bool
+AggregatesVectorizable(Node *node)
+{
+	MemoryContext savedContext = CurrentMemoryContext;
+	bool vectorizable = true;
+
+	PG_TRY();
+	{
+		/* the mutator changes operator expressions in place */
+		expression_tree_mutator(copyObject(node), ExpressionMutator, NULL);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(savedContext);
+		FlushErrorState();
+		vectorizable = false;
+	}
+	PG_END_TRY();
+
+	return vectorizable;
+}
+
+
+/*
+ * AggregatesColumnarPartitions returns true if the given query aggregates
+ * over partitioned tables whose partitions are all columnar.
+ */
+static bool
+AggregatesColumnarPartitions(Query *parse)
+{
+	if (!parse->hasAggs && parse->groupClause == NIL)
+	{
+		return false;
+	}
+
+	bool partitionedTableFound = false;
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, parse->rtable)
+	{
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			rangeTableEntry->relkind != RELKIND_PARTITIONED_TABLE)
+		{
+			continue;
+		}
+
+		List *partitionList = find_all_inheritors(rangeTableEntry->relid,
+												  rangeTableEntry->rellockmode, NULL);
+
+		Oid partitionId = InvalidOid;
+		foreach_oid(partitionId, partitionList)
+		{
+			if (get_rel_relkind(partitionId) == RELKIND_PARTITIONED_TABLE)
+			{
+				continue;
+			}
+
+			if (!IsColumnarTableAmTable(partitionId))
+			{
+				return false;
+			}
+		}
+
+		partitionedTableFound = true;
+	}
+
+	return partitionedTableFound;
+}
+
+
+/*
+ * IsColumnarScanPlan returns true if the given plan is a columnar scan.
+ */
+static bool
+IsColumnarScanPlan(Plan *plan)
+{
+	return plan != NULL && IsA(plan, CustomScan) &&
+		   ((CustomScan *) plan)->methods == columnar_customscan_methods();
+}
+
+
+/*
+ * VectorizeAggregate returns the vector aggregate node replacing the given
+ * aggregate over a columnar scan, with the scan below it mutated, or NULL
+ * with fallbackReason set to why it can't be vectorized. What the
+ * aggregates' mutation can't vectorize is reported with errors, whose
+ * message becomes the reason.
+ */
+static Plan *
+VectorizeAggregate(Agg *aggNode, PlanTreeMutatorContext *planTreeContext,
+				   const char **fallbackReason)
+{
+	Plan *node = (Plan *) aggNode;
+
+	*fallbackReason = VectorizedAggregateStrategyFallbackReason(aggNode);
+	if (*fallbackReason != NULL)
+	{
+		return NULL;
+	}
+
+	if (DO_AGGSPLIT_COMBINE(aggNode->aggsplit))
+	{
+		*fallbackReason = "combining partial aggregates is not supported";
+		return NULL;
+	}
+
+	Agg *newAgg;
+	FLATCOPY(newAgg, aggNode, Agg);
+
+	MemoryContext savedContext = CurrentMemoryContext;
+
+	PG_TRY();
+	{
+		/* the mutator changes operator expressions in place */
+		newAgg->plan.targetlist = (List *)
+			expression_tree_mutator(copyObject((Node *) newAgg->plan.targetlist),
+									ExpressionMutator, NULL);
+		newAgg->plan.qual = (List *)
+			expression_tree_mutator(copyObject((Node *) newAgg->plan.qual),
+									ExpressionMutator, NULL);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(savedContext);
+
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+		ereport(DEBUG1,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+					errmsg("Query can't be vectorized. Falling back to original execution."),
+					errdetail("%s", edata->message)));
+
+		*fallbackReason = edata->message;
+	}
+	PG_END_TRY();
+
+	if (*fallbackReason != NULL)
+	{
+		return NULL;
+	}
+
+	if (!VectorizedAggregateSplitSupported(newAgg))
+	{
+		*fallbackReason = "partial aggregate states of type internal need a "
+						  "serialization function";
+		return NULL;
+	}
+
+	CustomScan *vectorizedAggNode = columnar_create_aggregator_node();
+
+	vectorizedAggNode->custom_plans =
+		lappend(vectorizedAggNode->custom_plans, newAgg);
+	vectorizedAggNode->scan.plan.targetlist =
+		CustomBuildTargetList(aggNode->plan.targetlist, INDEX_VAR);
+	vectorizedAggNode->custom_scan_tlist = newAgg->plan.targetlist;
+
+	// Parallel agg node
+	Plan *vectorizedAggNodePlan = (Plan *) vectorizedAggNode;
+	vectorizedAggNodePlan->parallel_aware = aggNode->plan.lefttree->parallel_aware;
+	vectorizedAggNodePlan->startup_cost = aggNode->plan.startup_cost;
+	vectorizedAggNodePlan->total_cost = aggNode->plan.total_cost;
+	vectorizedAggNodePlan->plan_rows = aggNode->plan.plan_rows;
+	vectorizedAggNodePlan->plan_width = aggNode->plan.plan_width;
+
+	const char *savedFallbackReason = planTreeContext->aggregateFallbackReason;
+	planTreeContext->vectorizedAggregation = true;
+	planTreeContext->chunkGroupSummary =
+		ChunkGroupSummarySupported(newAgg, &planTreeContext->chunkGroupSketchColumns);
+	planTreeContext->stripeProjection = StripeProjectionColumns(newAgg);
+	planTreeContext->aggregateFallbackReason = NULL;
+
+	PlanTreeMutator(node->lefttree, planTreeContext);
+	PlanTreeMutator(node->righttree, planTreeContext);
+
+	planTreeContext->vectorizedAggregation = false;
+	planTreeContext->chunkGroupSummary = false;
+	planTreeContext->chunkGroupSketchColumns = NIL;
+	planTreeContext->stripeProjection = NIL;
+	planTreeContext->aggregateFallbackReason = savedFallbackReason;
+
+	vectorizedAggNode->scan.plan.lefttree = node->lefttree;
+	vectorizedAggNode->scan.plan.righttree = node->righttree;
+
+	return (Plan *) vectorizedAggNode;
+}
+
+
+/*
+ * VectorizedWindowAggSupported returns true if a WindowAgg can run as a
+ * vector window node, see columnar_window_node.c. Its input needs to be a
+ * columnar scan, or a sort of one, and its window functions row_number(),
+ * lag or lead of an input column by a constant offset, or count(*), or
+ * count or sum of an int2, int4, float4 or float8 input column over a ROWS
+ * frame from UNBOUNDED or a constant number of rows PRECEDING to the
+ * CURRENT ROW.
+ */
+static bool
+VectorizedWindowAggSupported(WindowAgg *windowAgg)
+{
+	Plan *input = windowAgg->plan.lefttree;
+
+	if (IsA(input, Sort))
+	{
+		input = input->lefttree;
+	}
+
+	if (!IsColumnarScanPlan(input) || windowAgg->plan.qual != NIL)
+	{
+		return false;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+	if (windowAgg->runCondition != NIL)
+	{
+		return false;
+	}
+#endif
+
+	List *windowFuncs = NIL;
+	if (UnsupportedWindowExpression((Node *) windowAgg->plan.targetlist, &windowFuncs))
+	{
+		return false;
+	}
+
+	WindowFunc *windowFunc = NULL;
+	foreach_ptr(windowFunc, windowFuncs)
+	{
+		if (!VectorizedWindowFuncSupported(windowFunc, windowAgg))
+		{
+			return false;
+		}
+	}
+
+	return windowFuncs != NIL;
+}
+
+
+/*
+ * UnsupportedWindowExpression returns true if the target list of a WindowAgg
+ * has a column of the input that isn't a single column, which the scan tuple
+ * of a vector window node doesn't have. The window functions of the target
+ * list are added to windowFuncs.
+ */
+static bool
+UnsupportedWindowExpression(Node *node, List **windowFuncs)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+
+		return column->varno != OUTER_VAR || column->varattno <= 0;
+	}
+
+	if (IsA(node, WindowFunc))
+	{
+		*windowFuncs = lappend(*windowFuncs, node);
+		return false;
+	}
+
+	return expression_tree_walker(node, UnsupportedWindowExpression, windowFuncs);
+}
+
+
+static bool
+VectorizedWindowFuncSupported(WindowFunc *windowFunc, WindowAgg *windowAgg)
+{
+	if (windowFunc->aggfilter != NULL)
+	{
+		return false;
+	}
+
+	if (windowFunc->args != NIL)
+	{
+		Var *argument = linitial(windowFunc->args);
+
+		if (!IsA(argument, Var) || argument->varno != OUTER_VAR ||
+			argument->varattno <= 0)
+		{
+			return false;
+		}
+	}
+
+	switch (windowFunc->winfnoid)
+	{
+		case F_ROW_NUMBER:
+		{
+			return true;
+		}
+
+		case F_LAG_ANYELEMENT:
+		case F_LAG_ANYELEMENT_INT4:
+		case F_LAG_ANYCOMPATIBLE_INT4_ANYCOMPATIBLE:
+		case F_LEAD_ANYELEMENT:
+		case F_LEAD_ANYELEMENT_INT4:
+		case F_LEAD_ANYCOMPATIBLE_INT4_ANYCOMPATIBLE:
+		{
+			if (list_length(windowFunc->args) > 1)
+			{
+				Const *offset = lsecond(windowFunc->args);
+
+				if (!IsA(offset, Const) || offset->constisnull ||
+					DatumGetInt32(offset->constvalue) < -VECTOR_WINDOW_MAX_OFFSET ||
+					DatumGetInt32(offset->constvalue) > VECTOR_WINDOW_MAX_OFFSET)
+				{
+					return false;
+				}
+			}
+
+			return list_length(windowFunc->args) < 3 ||
+				   IsA(lthird(windowFunc->args), Const);
+		}
+
+		case F_COUNT_:
+		case F_COUNT_ANY:
+		case F_SUM_INT2:
+		case F_SUM_INT4:
+		case F_SUM_FLOAT4:
+		case F_SUM_FLOAT8:
+		{
+			return VectorizedWindowFrameSupported(windowAgg);
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * VectorizedWindowFrameSupported returns true if the frame of a WindowAgg
+ * is a ROWS frame that ends at the current row and starts UNBOUNDED
+ * PRECEDING, at the CURRENT ROW, or up to VECTOR_WINDOW_MAX_OFFSET rows
+ * PRECEDING it.
+ */
+static bool
+VectorizedWindowFrameSupported(WindowAgg *windowAgg)
+{
+	int frameOptions = windowAgg->frameOptions;
+
+	if (!(frameOptions & FRAMEOPTION_ROWS) ||
+		!(frameOptions & FRAMEOPTION_END_CURRENT_ROW) ||
+		(frameOptions & FRAMEOPTION_EXCLUSION))
+	{
+		return false;
+	}
+
+	if (frameOptions & (FRAMEOPTION_START_UNBOUNDED_PRECEDING |
+						FRAMEOPTION_START_CURRENT_ROW))
+	{
+		return true;
+	}
+
+	Const *startOffset = (Const *) windowAgg->startOffset;
+	if (!(frameOptions & FRAMEOPTION_START_OFFSET_PRECEDING) ||
+		startOffset == NULL || !IsA(startOffset, Const) || startOffset->constisnull)
+	{
+		return false;
+	}
+
+	/* negative offsets are an error of the WindowAgg */
+	int64 offset = DatumGetInt64(startOffset->constvalue);
+	return offset >= 0 && offset <= VECTOR_WINDOW_MAX_OFFSET;
+}
+
+
+/*
+ * VectorizeWindowAgg returns the vector window node replacing a WindowAgg
+ * that VectorizedWindowAggSupported accepted. The scan tuple of the node has
+ * the columns of the input, then the results of the window functions, which
+ * the target list of the WindowAgg refers to instead.
+ */
+static Plan *
+VectorizeWindowAgg(WindowAgg *windowAgg)
+{
+	List *scanTargetList = NIL;
+
+	TargetEntry *inputEntry = NULL;
+	foreach_ptr(inputEntry, windowAgg->plan.lefttree->targetlist)
+	{
+		Var *inputColumn = makeVarFromTargetEntry(OUTER_VAR, inputEntry);
+
+		scanTargetList = lappend(scanTargetList,
+								 makeTargetEntry((Expr *) inputColumn,
+												 list_length(scanTargetList) + 1,
+												 NULL, false));
+	}
+
+	List *targetList = (List *)
+		WindowExpressionMutator((Node *) windowAgg->plan.targetlist, &scanTargetList);
+
+	/* the node reads the partitioning and frame of the window from the copy */
+	WindowAgg *windowAggCopy;
+	FLATCOPY(windowAggCopy, windowAgg, WindowAgg);
+	windowAggCopy->plan.lefttree = NULL;
+	windowAggCopy->plan.righttree = NULL;
+	windowAggCopy->plan.targetlist = NIL;
+	windowAggCopy->plan.initPlan = NIL;
+
+	CustomScan *vectorizedWindowNode = columnar_create_window_node();
+	Plan *vectorizedWindowNodePlan = (Plan *) vectorizedWindowNode;
+
+	vectorizedWindowNode->custom_private = list_make1(windowAggCopy);
+	vectorizedWindowNode->custom_scan_tlist = scanTargetList;
+	vectorizedWindowNodePlan->targetlist = targetList;
+	vectorizedWindowNodePlan->lefttree = windowAgg->plan.lefttree;
+	vectorizedWindowNodePlan->startup_cost = windowAgg->plan.startup_cost;
+	vectorizedWindowNodePlan->total_cost = windowAgg->plan.total_cost;
+	vectorizedWindowNodePlan->plan_rows = windowAgg->plan.plan_rows;
+	vectorizedWindowNodePlan->plan_width = windowAgg->plan.plan_width;
+	vectorizedWindowNodePlan->parallel_safe = windowAgg->plan.parallel_safe;
+	vectorizedWindowNodePlan->plan_node_id = windowAgg->plan.plan_node_id;
+	vectorizedWindowNodePlan->initPlan = windowAgg->plan.initPlan;
+	vectorizedWindowNodePlan->extParam = windowAgg->plan.extParam;
+	vectorizedWindowNodePlan->allParam = windowAgg->plan.allParam;
+
+	return vectorizedWindowNodePlan;
+}
+
+
+/*
+ * WindowExpressionMutator returns a copy of a WindowAgg expression that
+ * refers to the scan tuple of the vector window node for the columns of the
+ * input and the window functions, whose target entries are added to
+ * scanTargetList.
+ */
+static Node *
+WindowExpressionMutator(Node *node, List **scanTargetList)
+{
+	if (node == NULL)
+		return NULL;
+
+	if (IsA(node, Var) && ((Var *) node)->varno == OUTER_VAR)
+	{
+		Var *column = (Var *) copyObject(node);
+		column->varno = INDEX_VAR;
+		return (Node *) column;
+	}
+
+	if (IsA(node, WindowFunc))
+	{
+		TargetEntry *scanEntry = NULL;
+		foreach_ptr(scanEntry, *scanTargetList)
+		{
+			if (equal(scanEntry->expr, node))
+			{
+				return (Node *) makeVarFromTargetEntry(INDEX_VAR, scanEntry);
+			}
+		}
+
+		scanEntry = makeTargetEntry((Expr *) copyObject(node),
+									list_length(*scanTargetList) + 1, NULL, false);
+		*scanTargetList = lappend(*scanTargetList, scanEntry);
+
+		return (Node *) makeVarFromTargetEntry(INDEX_VAR, scanEntry);
+	}
+
+	return expression_tree_mutator(node, WindowExpressionMutator, scanTargetList);
+}
+
+
+static Plan *
+PlanTreeMutator(Plan *node, void *context)
+{
+	if (node == NULL)
+		return NULL;
+
+	/* Guard against stack overflow due to overly complex expressions */
+	check_stack_depth();
+
+	switch (nodeTag(node))
+	{
+		case T_CustomScan:
+		{
+			CustomScan *customScan = (CustomScan *) node;
+
+			if (customScan->methods == columnar_customscan_methods())
+			{
+				PlanTreeMutatorContext *planTreeContext = (PlanTreeMutatorContext *) context;
+
+				Const * vectorizedAggregateExecution = makeNode(Const);
+
+				vectorizedAggregateExecution->constbyval = true;
+				vectorizedAggregateExecution->consttype = CUSTOM_SCAN_VECTORIZED_AGGREGATE;
+				vectorizedAggregateExecution->constvalue =  planTreeContext->vectorizedAggregation;
+				vectorizedAggregateExecution->constlen = sizeof(bool);
+
+				customScan->custom_private = lappend(customScan->custom_private, vectorizedAggregateExecution);
+
+				if (planTreeContext->chunkGroupSummary)
+				{
+					Const *chunkGroupSummary = makeNode(Const);
+
+					chunkGroupSummary->constbyval = true;
+					chunkGroupSummary->consttype = CUSTOM_SCAN_CHUNK_GROUP_SUMMARY;
+					chunkGroupSummary->constvalue = BoolGetDatum(true);
+					chunkGroupSummary->constlen = sizeof(bool);
+
+					customScan->custom_private = lappend(customScan->custom_private,
+														 chunkGroupSummary);
+				}
+
+				if (planTreeContext->chunkGroupSummary &&
+					planTreeContext->chunkGroupSketchColumns != NIL)
+				{
+					Const *chunkGroupSketches = makeNode(Const);
+
+					chunkGroupSketches->constbyval = false;
+					chunkGroupSketches->consttype = CUSTOM_SCAN_CHUNK_GROUP_SKETCHES;
+					chunkGroupSketches->constvalue =
+						CStringGetTextDatum(nodeToString(planTreeContext->chunkGroupSketchColumns));
+					chunkGroupSketches->constlen = -1;
+
+					customScan->custom_private = lappend(customScan->custom_private,
+														 chunkGroupSketches);
+				}
+
+				if (planTreeContext->stripeProjection != NIL)
+				{
+					Const *stripeProjection = makeNode(Const);
+
+					stripeProjection->constbyval = false;
+					stripeProjection->consttype = CUSTOM_SCAN_STRIPE_PROJECTION;
+					stripeProjection->constvalue =
+						CStringGetTextDatum(nodeToString(planTreeContext->stripeProjection));
+					stripeProjection->constlen = -1;
+
+					customScan->custom_private = lappend(customScan->custom_private,
+														 stripeProjection);
+				}
+
+				if (!planTreeContext->vectorizedAggregation &&
+					planTreeContext->aggregateFallbackReason != NULL)
+				{
+					Const *aggregateFallback = makeNode(Const);
+
+					aggregateFallback->constbyval = false;
+					aggregateFallback->consttype = CUSTOM_SCAN_AGGREGATE_FALLBACK;
+					aggregateFallback->constvalue =
+						CStringGetTextDatum(planTreeContext->aggregateFallbackReason);
+					aggregateFallback->constlen = -1;
+
+					customScan->custom_private = lappend(customScan->custom_private,
+														 aggregateFallback);
+				}
+			}
+			else
+			{
+				ListCell *lc;
+				foreach(lc, customScan->custom_plans)
+				{
+					lfirst(lc) = PlanTreeMutator(lfirst(lc), context);
+				}
+			}
+
+			break;
+		}
+
+		/*
+		 * Aggregates are vectorized wherever they are in the plan, so the
+		 * children of UNION ALL, of the Append of partitions and of
+		 * subqueries are mutated too.
+		 */
+		case T_Append:
+		{
+			ListCell *lc;
+			foreach(lc, ((Append *) node)->appendplans)
+			{
+				lfirst(lc) = PlanTreeMutator(lfirst(lc), context);
+			}
+
+			break;
+		}
+
+		case T_MergeAppend:
+		{
+			ListCell *lc;
+			foreach(lc, ((MergeAppend *) node)->mergeplans)
+			{
+				lfirst(lc) = PlanTreeMutator(lfirst(lc), context);
+			}
+
+			break;
+		}
+
+		case T_SubqueryScan:
+		{
+			SubqueryScan *subqueryScan = (SubqueryScan *) node;
+			PlanTreeMutatorContext *planTreeContext = (PlanTreeMutatorContext *) context;
+
+			/* why an aggregate above the subquery isn't vectorized doesn't apply in it */
+			const char *savedFallbackReason = planTreeContext->aggregateFallbackReason;
+			planTreeContext->aggregateFallbackReason = NULL;
+
+			subqueryScan->subplan = PlanTreeMutator(subqueryScan->subplan, context);
+
+			planTreeContext->aggregateFallbackReason = savedFallbackReason;
+
+			break;
+		}
+
+		case T_Agg:
+		{
+			Agg *aggNode = (Agg *) node;
+			PlanTreeMutatorContext *planTreeContext = (PlanTreeMutatorContext *) context;
+			const char *fallbackReason = NULL;
+
+			/*
+			 * Only aggregates directly over a columnar scan are vectorized,
+			 * other scans of a join keep returning rows. Aggregates that
+			 * combine the partial aggregates of parallel workers never are,
+			 * so they have no reason to show.
+			 */
+			if (IsColumnarScanPlan(aggNode->plan.lefttree))
+			{
+				Plan *vectorizedAggNode = VectorizeAggregate(aggNode, planTreeContext,
+															 &fallbackReason);
+				if (vectorizedAggNode != NULL)
+				{
+					return vectorizedAggNode;
+				}
+			}
+			else if (DO_AGGSPLIT_COMBINE(aggNode->aggsplit))
+			{
+				fallbackReason = planTreeContext->aggregateFallbackReason;
+			}
+			else if (IsA(aggNode->plan.lefttree, Sort) &&
+					 IsColumnarScanPlan(aggNode->plan.lefttree->lefttree))
+			{
+				fallbackReason = "sorted aggregation is not supported";
+			}
+			else if (IsA(aggNode->plan.lefttree, NestLoop) ||
+					 IsA(aggNode->plan.lefttree, HashJoin) ||
+					 IsA(aggNode->plan.lefttree, MergeJoin))
+			{
+				fallbackReason = "aggregates over a join are not supported";
+			}
+			else
+			{
+				fallbackReason = "aggregate is not directly above a columnar scan";
+			}
+
+			/* the scans below show why, see CUSTOM_SCAN_AGGREGATE_FALLBACK */
+			const char *savedFallbackReason = planTreeContext->aggregateFallbackReason;
+			planTreeContext->aggregateFallbackReason = fallbackReason;
+
+			node->lefttree = PlanTreeMutator(node->lefttree, context);
+			node->righttree = PlanTreeMutator(node->righttree, context);
+
+			planTreeContext->aggregateFallbackReason = savedFallbackReason;
+
+			return node;
+		}
+
+		case T_WindowAgg:
+		{
+			node->lefttree = PlanTreeMutator(node->lefttree, context);
+
+			if (columnar_enable_vectorized_window &&
+				VectorizedWindowAggSupported((WindowAgg *) node))
+			{
+				return VectorizeWindowAgg((WindowAgg *) node);
+			}
+
+			return node;
+		}
+
+		case T_Unique:
+		{
+			PlanTreeMutatorContext *planTreeContext = (PlanTreeMutatorContext *) context;
+
+			/* DISTINCT is only vectorized when it is planned as a hashed aggregate */
+			if (IsA(node->lefttree, Sort) && IsColumnarScanPlan(node->lefttree->lefttree))
+			{
+				const char *savedFallbackReason = planTreeContext->aggregateFallbackReason;
+				planTreeContext->aggregateFallbackReason =
+					"sorted deduplication is not supported";
+
+				node->lefttree = PlanTreeMutator(node->lefttree, context);
+
+				planTreeContext->aggregateFallbackReason = savedFallbackReason;
+
+				return node;
+			}
+
+			break;
+		}
+
+		default:
+		{
+			
+			break;
+		}
+	}
+
+	node->lefttree = PlanTreeMutator(node->lefttree, context);
+	node->righttree = PlanTreeMutator(node->righttree, context);
+
+	return node;
+}
+#endif
+
+static PlannedStmt *
+ColumnarPlannerHook(Query *parse,
+					const char *query_string,
+					int cursorOptions,
+					ParamListInfo boundParams)
+{
+	PlannedStmt	*stmt;
+#if PG_VERSION_NUM >= PG_VERSION_14
+	Plan *savedPlanTree;
+	List *savedSubplan;
+	MemoryContext saved_context;
+	int gucNestLevel = -1;
+
+	/*
+	 * Aggregates are only vectorized directly over a columnar scan, not over
+	 * the Append of the partitions of a table. Partitionwise aggregation
+	 * gives each partition its own (partial) aggregate, which we vectorize,
+	 * and combines their results above the Append.
+	 */
+	if (columnar_enable_vectorization && !enable_partitionwise_aggregate &&
+		parse->commandType == CMD_SELECT && AggregatesColumnarPartitions(parse))
+	{
+		gucNestLevel = NewGUCNestLevel();
+		(void) set_config_option("enable_partitionwise_aggregate", "on",
+								 PGC_USERSET, PGC_S_SESSION,
+								 GUC_ACTION_SAVE, true, 0, false);
+	}
+#endif
+
+	if (PreviousPlannerHook)
+		stmt = PreviousPlannerHook(parse, query_string, cursorOptions, boundParams);
+	else
+		stmt = standard_planner(parse, query_string, cursorOptions, boundParams);
+
+	/* split before vectorizing, so the aggregate of each bucket is vectorized */
+	if (columnar_enable_bucketwise_execution && stmt->commandType == CMD_SELECT)
+	{
+		ColumnarSplitPlanByBucket(stmt);
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	if (gucNestLevel >= 0)
+	{
+		AtEOXact_GUC(true, gucNestLevel);
+	}
 
-#if PG_VERSION_NUM >= PG_VERSION_14
 	if (!columnar_enable_vectorization			/* Vectorization should be enabled */
-		|| stmt->commandType != CMD_SELECT		 /* only SELECTS are supported  */
-		|| list_length(stmt->rtable) != 1)		 /* JOINs are not yet supported */
+		|| stmt->commandType != CMD_SELECT)		 /* only SELECTS are supported  */
 		return stmt;
 
 
@@ -287,13 +1782,21 @@ ColumnarPlannerHook(Query *parse,
 
 		PlanTreeMutatorContext plainTreeContext;
 		plainTreeContext.vectorizedAggregation = 0;
+		plainTreeContext.chunkGroupSummary = false;
+		plainTreeContext.chunkGroupSketchColumns = NIL;
+		plainTreeContext.stripeProjection = NIL;
+		plainTreeContext.aggregateFallbackReason = NULL;
 
 		stmt->planTree = (Plan *) PlanTreeMutator(stmt->planTree, (void *) &plainTreeContext);
 
 		foreach(cell, stmt->subplans)
 		{
 			PlanTreeMutatorContext subPlainTreeContext;
-			plainTreeContext.vectorizedAggregation = 0;
+			subPlainTreeContext.vectorizedAggregation = 0;
+			subPlainTreeContext.chunkGroupSummary = false;
+			subPlainTreeContext.chunkGroupSketchColumns = NIL;
+			subPlainTreeContext.stripeProjection = NIL;
+			subPlainTreeContext.aggregateFallbackReason = NULL;
 			Plan *subplan = (Plan *) PlanTreeMutator(lfirst(cell), (void *) &subPlainTreeContext);
 			subplans = lappend(subplans, subplan);
 		}
@@ -327,6 +1830,9 @@ void columnar_planner_init(void)
 	PreviousPlannerHook = planner_hook;
 	planner_hook = ColumnarPlannerHook;
 #if  PG_VERSION_NUM >= PG_VERSION_14
+	PreviousCreateUpperPathsHook = create_upper_paths_hook;
+	create_upper_paths_hook = ColumnarCreateUpperPathsHook;
 	columnar_register_aggregator_node();
+	columnar_register_window_node();
 #endif
 }
\ No newline at end of file
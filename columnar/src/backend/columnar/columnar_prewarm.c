@@ -0,0 +1,728 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_prewarm.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Loading decompressed column chunks into the shared column cache ahead of
+ * the queries that read them.
+ *
+ * columnar.prewarm decompresses the chunks of the given columns and stripes
+ * of a table into the cache. The per backend cache of columnar_cache.c is
+ * emptied at the end of every scan, so there is nothing to prewarm unless
+ * columnar.shared_column_cache_size is set.
+ *
+ * When columnar.autoprewarm is set as well, a leader started at server start
+ * writes the keys of the cached chunks to columnar_prewarm.chunks in the data
+ * directory every columnar.autoprewarm_interval seconds and at shutdown.
+ * After the next start it runs a worker for each database in the file, one
+ * at a time, that loads the chunks of the file back into the cache. Chunks
+ * of tables that were dropped, rewritten or vacuumed since are skipped, as
+ * their storage or stripe ids don't exist anymore.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_compression.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/utils/listutils.h"
+
+#define AUTOPREWARM_FILE "columnar_prewarm.chunks"
+#define AUTOPREWARM_TEMP_FILE AUTOPREWARM_FILE ".tmp"
+
+PGDLLEXPORT void ColumnarAutoprewarmLeaderMain(Datum main_arg);
+PGDLLEXPORT void ColumnarAutoprewarmWorkerMain(Datum main_arg);
+
+static void CheckPrewarmEnabled(void);
+static bool * PrewarmColumns(Relation rel, ArrayType *columnArray);
+static bool PrewarmStripeSelected(uint64 stripeId, ArrayType *stripeArray);
+static bool PrewarmChunk(Relation rel, uint64 storageId, StripeMetadata *stripeMetadata,
+						 StripeSkipList *skipList, uint32 chunkIndex,
+						 uint32 columnIndex);
+static ColumnarCachedChunk * ReadAutoprewarmFile(int32 *chunkCount);
+static int64 DumpAutoprewarmFile(void);
+static void RunAutoprewarmWorker(Oid databaseId);
+static void AutoprewarmRelation(Oid relationId, ColumnarCachedChunk *chunks,
+								int32 chunkCount);
+static int CompareCachedChunks(const void *left, const void *right);
+
+PG_FUNCTION_INFO_V1(columnar_prewarm);
+PG_FUNCTION_INFO_V1(columnar_autoprewarm_dump);
+
+
+/*
+ * ColumnarPrewarmInit registers the autoprewarm leader. Expected to be called
+ * from _PG_init, and only does something when columnar is loaded via
+ * shared_preload_libraries with both the shared cache and autoprewarm
+ * enabled.
+ */
+void
+ColumnarPrewarmInit(void)
+{
+	if (!process_shared_preload_libraries_in_progress ||
+		!columnar_autoprewarm || columnar_shared_cache_size <= 0)
+	{
+		return;
+	}
+
+	BackgroundWorker worker;
+	memset(&worker, 0, sizeof(worker));
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strlcpy(worker.bgw_library_name, "columnar", BGW_MAXLEN);
+	strlcpy(worker.bgw_function_name, "ColumnarAutoprewarmLeaderMain", BGW_MAXLEN);
+	strlcpy(worker.bgw_name, "columnar autoprewarm leader", BGW_MAXLEN);
+	strlcpy(worker.bgw_type, "columnar autoprewarm leader", BGW_MAXLEN);
+
+	RegisterBackgroundWorker(&worker);
+}
+
+
+/*
+ * columnar_prewarm loads the chunks of the given columns and stripes of a
+ * table into the shared column cache, all of them if the columns or the
+ * stripes are NULL, and returns how many chunks it loaded. Chunks that are
+ * cached already, or that are stored uncompressed and so are never cached,
+ * are not counted.
+ */
+Datum
+columnar_prewarm(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+	ArrayType *columnArray = PG_ARGISNULL(1) ? NULL : PG_GETARG_ARRAYTYPE_P(1);
+	ArrayType *stripeArray = PG_ARGISNULL(2) ? NULL : PG_GETARG_ARRAYTYPE_P(2);
+
+	Relation rel = table_open(relationId, AccessShareLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	AclResult aclresult = pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclresult, OBJECT_TABLE, RelationGetRelationName(rel));
+	}
+
+	bool *columnSelected = PrewarmColumns(rel, columnArray);
+
+	CheckPrewarmEnabled();
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	int64 loadedChunkCount = 0;
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Prewarm Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 || stripeMetadata->aborted ||
+			stripeMetadata->insertedByCurrentXact ||
+			!PrewarmStripeSelected(stripeMetadata->id, stripeArray))
+		{
+			continue;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+
+		StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+													  tupleDescriptor,
+													  stripeMetadata->chunkCount,
+													  GetTransactionSnapshot());
+
+		/* columns added after the stripe was written have no chunks in it */
+		uint32 columnCount = Min(stripeMetadata->columnCount, skipList->columnCount);
+
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (!columnSelected[columnIndex])
+			{
+				continue;
+			}
+
+			for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+			{
+				if (PrewarmChunk(rel, storageId, stripeMetadata, skipList, chunkIndex,
+								 columnIndex))
+				{
+					loadedChunkCount++;
+				}
+			}
+		}
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	MemoryContextDelete(stripeContext);
+	table_close(rel, AccessShareLock);
+
+	PG_RETURN_INT64(loadedChunkCount);
+}
+
+
+/*
+ * columnar_autoprewarm_dump writes the keys of the chunks in the shared
+ * column cache to the autoprewarm file right away and returns how many it
+ * wrote.
+ */
+Datum
+columnar_autoprewarm_dump(PG_FUNCTION_ARGS)
+{
+	CheckPrewarmEnabled();
+
+	PG_RETURN_INT64(DumpAutoprewarmFile());
+}
+
+
+/*
+ * CheckPrewarmEnabled errors out if there is no shared column cache to load
+ * chunks into.
+ */
+static void
+CheckPrewarmEnabled(void)
+{
+	if (!ColumnarSharedCacheEnabled())
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("the shared column cache is not enabled"),
+						errhint("Add columnar to shared_preload_libraries and set "
+								"columnar.shared_column_cache_size. The per backend "
+								"column cache is emptied after each scan.")));
+	}
+}
+
+
+/*
+ * PrewarmColumns returns for each attribute of the table whether the given
+ * column names select it, or whether it isn't dropped if they are NULL.
+ */
+static bool *
+PrewarmColumns(Relation rel, ArrayType *columnArray)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	bool *columnSelected = palloc0(tupleDescriptor->natts * sizeof(bool));
+
+	if (columnArray == NULL)
+	{
+		for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			columnSelected[columnIndex] =
+				!TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped;
+		}
+
+		return columnSelected;
+	}
+
+	Datum *columnNames = NULL;
+	bool *columnNulls = NULL;
+	int columnNameCount = 0;
+	deconstruct_array(columnArray, NAMEOID, NAMEDATALEN, false, TYPALIGN_CHAR,
+					  &columnNames, &columnNulls, &columnNameCount);
+
+	for (int nameIndex = 0; nameIndex < columnNameCount; nameIndex++)
+	{
+		if (columnNulls[nameIndex])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("column names must not be null")));
+		}
+
+		char *columnName = NameStr(*DatumGetName(columnNames[nameIndex]));
+		AttrNumber attributeNumber = get_attnum(RelationGetRelid(rel), columnName);
+		if (attributeNumber <= 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" of relation \"%s\" does not exist",
+								   columnName, RelationGetRelationName(rel))));
+		}
+
+		columnSelected[AttrNumberGetAttrOffset(attributeNumber)] = true;
+	}
+
+	return columnSelected;
+}
+
+
+/*
+ * PrewarmStripeSelected returns true if the given stripe is in the array of
+ * stripe ids, or if there is no array.
+ */
+static bool
+PrewarmStripeSelected(uint64 stripeId, ArrayType *stripeArray)
+{
+	if (stripeArray == NULL)
+	{
+		return true;
+	}
+
+	Datum *stripeIds = NULL;
+	bool *stripeNulls = NULL;
+	int stripeIdCount = 0;
+	deconstruct_array(stripeArray, INT8OID, sizeof(int64), FLOAT8PASSBYVAL,
+					  TYPALIGN_DOUBLE, &stripeIds, &stripeNulls, &stripeIdCount);
+
+	for (int stripeIndex = 0; stripeIndex < stripeIdCount; stripeIndex++)
+	{
+		if (!stripeNulls[stripeIndex] &&
+			DatumGetInt64(stripeIds[stripeIndex]) == (int64) stripeId)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * PrewarmChunk decompresses the given chunk of a column into the shared
+ * cache and returns true, unless it is cached already, is being decompressed
+ * by another backend or is one the reader never caches. The chunk is read
+ * and decompressed the same way DeserializeChunkColumn does on a miss.
+ */
+static bool
+PrewarmChunk(Relation rel, uint64 storageId, StripeMetadata *stripeMetadata,
+			 StripeSkipList *skipList, uint32 chunkIndex, uint32 columnIndex)
+{
+	ColumnChunkSkipNode *chunkSkipNode =
+		&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+	if (chunkSkipNode->valueLength == 0 ||
+		chunkSkipNode->valueCompressionType == COMPRESSION_NONE)
+	{
+		return false;
+	}
+
+	if (!ColumnarSharedCacheClaimMissing(storageId, stripeMetadata->id, chunkIndex,
+										 columnIndex))
+	{
+		return false;
+	}
+
+	StringInfo valueBuffer = makeStringInfo();
+	enlargeStringInfo(valueBuffer, chunkSkipNode->valueLength);
+	valueBuffer->len = chunkSkipNode->valueLength;
+	ColumnarStorageRead(rel, stripeMetadata->fileOffset +
+						chunkSkipNode->valueChunkOffset,
+						valueBuffer->data, valueBuffer->len);
+
+	StringInfo decompressedBuffer = makeStringInfo();
+	DecompressBufferInto(valueBuffer, chunkSkipNode->valueCompressionType,
+						 chunkSkipNode->decompressedValueSize,
+						 chunkSkipNode->compressionDictionaryId, decompressedBuffer);
+
+	ColumnarSharedCacheInsert(storageId, stripeMetadata->id, chunkIndex, columnIndex,
+							  decompressedBuffer);
+
+	pfree(valueBuffer->data);
+	pfree(decompressedBuffer->data);
+
+	return true;
+}
+
+
+/*
+ * ColumnarAutoprewarmLeaderMain is the entry point of the autoprewarm leader.
+ * It loads the chunks of the autoprewarm file into the cache once and then
+ * keeps the file up to date until shutdown.
+ */
+void
+ColumnarAutoprewarmLeaderMain(Datum main_arg)
+{
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, SignalHandlerForShutdownRequest);
+	BackgroundWorkerUnblockSignals();
+
+	int32 chunkCount = 0;
+	ColumnarCachedChunk *chunks = ReadAutoprewarmFile(&chunkCount);
+
+	/* the chunks are sorted by database, so each one is run once */
+	for (int32 chunkIndex = 0; chunkIndex < chunkCount && !ShutdownRequestPending;
+		 chunkIndex++)
+	{
+		if (chunkIndex == 0 ||
+			chunks[chunkIndex].databaseId != chunks[chunkIndex - 1].databaseId)
+		{
+			RunAutoprewarmWorker(chunks[chunkIndex].databaseId);
+		}
+	}
+
+	pfree(chunks);
+
+	while (!ShutdownRequestPending)
+	{
+		long timeout = columnar_autoprewarm_interval * 1000L;
+		int events = WL_LATCH_SET | WL_EXIT_ON_PM_DEATH |
+					 (timeout > 0 ? WL_TIMEOUT : 0);
+
+		int rc = WaitLatch(MyLatch, events, timeout, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		if ((rc & WL_TIMEOUT) && !ShutdownRequestPending)
+		{
+			(void) DumpAutoprewarmFile();
+		}
+	}
+
+	(void) DumpAutoprewarmFile();
+
+	proc_exit(0);
+}
+
+
+/*
+ * ReadAutoprewarmFile returns the chunks of the autoprewarm file, sorted by
+ * database, storage, stripe, chunk and column, and sets chunkCount to their
+ * number. A missing file has no chunks.
+ */
+static ColumnarCachedChunk *
+ReadAutoprewarmFile(int32 *chunkCount)
+{
+	int32 maximumCount = 1024;
+	int32 count = 0;
+	ColumnarCachedChunk *chunks = palloc(maximumCount * sizeof(ColumnarCachedChunk));
+
+	FILE *file = AllocateFile(AUTOPREWARM_FILE, "r");
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+		{
+			ereport(LOG, (errcode_for_file_access(),
+						  errmsg("could not read file \"%s\": %m", AUTOPREWARM_FILE)));
+		}
+
+		*chunkCount = 0;
+		return chunks;
+	}
+
+	ColumnarCachedChunk chunk;
+	while (fscanf(file, "%u " UINT64_FORMAT " " UINT64_FORMAT " " UINT64_FORMAT " %u\n",
+				  &chunk.databaseId, &chunk.storageId, &chunk.stripeId,
+				  &chunk.chunkId, &chunk.columnId) == 5)
+	{
+		if (count == maximumCount)
+		{
+			maximumCount *= 2;
+			chunks = repalloc_huge(chunks, maximumCount * sizeof(ColumnarCachedChunk));
+		}
+
+		chunks[count++] = chunk;
+	}
+
+	FreeFile(file);
+
+	qsort(chunks, count, sizeof(ColumnarCachedChunk), CompareCachedChunks);
+
+	*chunkCount = count;
+	return chunks;
+}
+
+
+/*
+ * DumpAutoprewarmFile replaces the autoprewarm file with the keys of the
+ * chunks that are in the shared cache now and returns how many there are.
+ */
+static int64
+DumpAutoprewarmFile(void)
+{
+	int32 chunkCount = 0;
+	ColumnarCachedChunk *chunks = ColumnarSharedCacheChunks(&chunkCount);
+
+	FILE *file = AllocateFile(AUTOPREWARM_TEMP_FILE, "w");
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m",
+							   AUTOPREWARM_TEMP_FILE)));
+	}
+
+	for (int32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		ColumnarCachedChunk *chunk = &chunks[chunkIndex];
+		fprintf(file, "%u " UINT64_FORMAT " " UINT64_FORMAT " " UINT64_FORMAT " %u\n",
+				chunk->databaseId, chunk->storageId, chunk->stripeId,
+				chunk->chunkId, chunk->columnId);
+	}
+
+	if (ferror(file) || FreeFile(file) != 0)
+	{
+		int savedErrno = errno;
+		unlink(AUTOPREWARM_TEMP_FILE);
+		errno = savedErrno;
+
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not write file \"%s\": %m",
+							   AUTOPREWARM_TEMP_FILE)));
+	}
+
+	(void) durable_rename(AUTOPREWARM_TEMP_FILE, AUTOPREWARM_FILE, ERROR);
+
+	pfree(chunks);
+
+	return chunkCount;
+}
+
+
+/*
+ * RunAutoprewarmWorker starts an autoprewarm worker for the given database
+ * and waits for it to finish.
+ */
+static void
+RunAutoprewarmWorker(Oid databaseId)
+{
+	BackgroundWorker worker;
+	memset(&worker, 0, sizeof(worker));
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main_arg = ObjectIdGetDatum(databaseId);
+	worker.bgw_notify_pid = MyProcPid;
+	strlcpy(worker.bgw_library_name, "columnar", BGW_MAXLEN);
+	strlcpy(worker.bgw_function_name, "ColumnarAutoprewarmWorkerMain", BGW_MAXLEN);
+	snprintf(worker.bgw_name, BGW_MAXLEN, "columnar autoprewarm worker for database %u",
+			 databaseId);
+	strlcpy(worker.bgw_type, "columnar autoprewarm worker", BGW_MAXLEN);
+
+	BackgroundWorkerHandle *handle = NULL;
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		ereport(LOG, (errmsg("could not start columnar autoprewarm worker"),
+					  errhint("You might need to increase max_worker_processes.")));
+		return;
+	}
+
+	pid_t pid = 0;
+	if (WaitForBackgroundWorkerStartup(handle, &pid) != BGWH_STARTED)
+	{
+		return;
+	}
+
+	(void) WaitForBackgroundWorkerShutdown(handle);
+}
+
+
+/*
+ * ColumnarAutoprewarmWorkerMain is the entry point of an autoprewarm worker,
+ * which loads the chunks of the autoprewarm file of the database passed as
+ * argument into the cache.
+ */
+void
+ColumnarAutoprewarmWorkerMain(Datum main_arg)
+{
+	Oid databaseId = DatumGetObjectId(main_arg);
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* the database might have been dropped since the file was written */
+	BackgroundWorkerInitializeConnectionByOid(databaseId, InvalidOid, 0);
+
+	int32 fileChunkCount = 0;
+	ColumnarCachedChunk *fileChunks = ReadAutoprewarmFile(&fileChunkCount);
+
+	/* keep the chunks of this database only */
+	int32 chunkCount = 0;
+	for (int32 chunkIndex = 0; chunkIndex < fileChunkCount; chunkIndex++)
+	{
+		if (fileChunks[chunkIndex].databaseId == databaseId)
+		{
+			fileChunks[chunkCount++] = fileChunks[chunkIndex];
+		}
+	}
+
+	MemoryContext relationContext = AllocSetContextCreate(TopMemoryContext,
+														  "Columnar Autoprewarm",
+														  ALLOCSET_DEFAULT_SIZES);
+
+	List *relationList = chunkCount > 0 ? CompactionRelationList() : NIL;
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationList)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(relationContext);
+
+		/* an error in one table shouldn't keep the other tables from loading */
+		PG_TRY();
+		{
+			AutoprewarmRelation(relationId, fileChunks, chunkCount);
+		}
+		PG_CATCH();
+		{
+			HOLD_INTERRUPTS();
+			MemoryContextSwitchTo(relationContext);
+			EmitErrorReport();
+			AbortOutOfAnyTransaction();
+			FlushErrorState();
+			RESUME_INTERRUPTS();
+		}
+		PG_END_TRY();
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(relationContext);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	proc_exit(0);
+}
+
+
+/*
+ * AutoprewarmRelation loads the given chunks that belong to the storage of
+ * the given table into the cache, in its own transaction.
+ */
+static void
+AutoprewarmRelation(Oid relationId, ColumnarCachedChunk *chunks, int32 chunkCount)
+{
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/* the table might have been dropped since we listed it */
+	Relation rel = try_relation_open(relationId, AccessShareLock);
+	if (rel == NULL)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return;
+	}
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 || stripeMetadata->aborted)
+		{
+			continue;
+		}
+
+		StripeSkipList *skipList = NULL;
+
+		for (int32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnarCachedChunk *chunk = &chunks[chunkIndex];
+			if (chunk->storageId != storageId || chunk->stripeId != stripeMetadata->id)
+			{
+				continue;
+			}
+
+			CHECK_FOR_INTERRUPTS();
+
+			if (skipList == NULL)
+			{
+				skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+											  tupleDescriptor,
+											  stripeMetadata->chunkCount,
+											  GetTransactionSnapshot());
+			}
+
+			uint32 columnCount = Min(stripeMetadata->columnCount, skipList->columnCount);
+			if (chunk->columnId >= columnCount || chunk->chunkId >= skipList->chunkCount ||
+				TupleDescAttr(tupleDescriptor, chunk->columnId)->attisdropped)
+			{
+				continue;
+			}
+
+			(void) PrewarmChunk(rel, storageId, stripeMetadata, skipList,
+								chunk->chunkId, chunk->columnId);
+		}
+	}
+
+	relation_close(rel, AccessShareLock);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+}
+
+
+/*
+ * CompareCachedChunks orders chunks by database, storage, stripe, chunk and
+ * column, for qsort.
+ */
+static int
+CompareCachedChunks(const void *left, const void *right)
+{
+	const ColumnarCachedChunk *leftChunk = left;
+	const ColumnarCachedChunk *rightChunk = right;
+
+	if (leftChunk->databaseId != rightChunk->databaseId)
+	{
+		return leftChunk->databaseId < rightChunk->databaseId ? -1 : 1;
+	}
+
+	if (leftChunk->storageId != rightChunk->storageId)
+	{
+		return leftChunk->storageId < rightChunk->storageId ? -1 : 1;
+	}
+
+	if (leftChunk->stripeId != rightChunk->stripeId)
+	{
+		return leftChunk->stripeId < rightChunk->stripeId ? -1 : 1;
+	}
+
+	if (leftChunk->chunkId != rightChunk->chunkId)
+	{
+		return leftChunk->chunkId < rightChunk->chunkId ? -1 : 1;
+	}
+
+	if (leftChunk->columnId != rightChunk->columnId)
+	{
+		return leftChunk->columnId < rightChunk->columnId ? -1 : 1;
+	}
+
+	return 0;
+}
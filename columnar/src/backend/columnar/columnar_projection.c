@@ -0,0 +1,397 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_projection.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Per stripe aggregate projections. When a table has projection_group_by or
+ * projection_sum columns, each stripe keeps the number of rows of each
+ * group of the values of its projection_group_by columns, and the number of
+ * values and the sum of each projection_sum column in the group. A count or
+ * sum aggregate grouped by some of these columns can then take the groups
+ * of the stripes that have no deleted rows from their projections instead
+ * of reading them, see ColumnarSetStripeProjectionSummary.
+ *
+ * A projection is a bytea holding a format version, the attribute numbers
+ * of the group by and sum columns, and the groups. Group by columns are of
+ * by-value types, so their values are stored as Datums. Stripes with more
+ * than STRIPE_PROJECTION_GROUP_COUNT_MAXIMUM groups get no projection, as
+ * reading them is not much more work than reading the projection.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "common/int.h"
+#include "libpq/pqformat.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+
+#define STRIPE_PROJECTION_VERSION 1
+#define STRIPE_PROJECTION_GROUP_COUNT_MAXIMUM 16384
+
+/*
+ * StripeProjectionBuilder collects the groups of the rows written to a
+ * stripe, see columnar_writer.c.
+ */
+struct StripeProjectionBuilder
+{
+	int keyCount;
+	AttrNumber keyAttnums[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+
+	int sumCount;
+	AttrNumber *sumAttnums;
+	Oid *sumTypeIds;
+
+	MemoryContext context;
+	HTAB *groups;
+
+	/* too many groups, or an overflowing sum, the stripe gets no projection */
+	bool abandoned;
+};
+
+static HTAB * CreateStripeProjectionGroups(StripeProjectionBuilder *builder);
+
+
+/*
+ * StripeProjectionSumTypeSupported returns whether projection_sum columns
+ * can be of the given type, i.e. the types vsum sums in a by-value state.
+ */
+bool
+StripeProjectionSumTypeSupported(Oid typeId)
+{
+	return typeId == INT2OID || typeId == INT4OID ||
+		   typeId == FLOAT4OID || typeId == FLOAT8OID;
+}
+
+
+/*
+ * CreateStripeProjectionBuilder returns a builder of the projections of the
+ * stripes written with the given options, or NULL if the options have no
+ * projection columns. Dropped columns are left out.
+ */
+StripeProjectionBuilder *
+CreateStripeProjectionBuilder(TupleDesc tupleDescriptor, ColumnarOptions *options)
+{
+	if (bms_is_empty(options->projectionGroupByColumns) &&
+		bms_is_empty(options->projectionSumColumns))
+	{
+		return NULL;
+	}
+
+	StripeProjectionBuilder *builder = palloc0(sizeof(StripeProjectionBuilder));
+	builder->sumAttnums = palloc0(bms_num_members(options->projectionSumColumns) *
+								  sizeof(AttrNumber));
+	builder->sumTypeIds = palloc0(bms_num_members(options->projectionSumColumns) *
+								  sizeof(Oid));
+
+	int attnum = -1;
+	while ((attnum = bms_next_member(options->projectionGroupByColumns, attnum)) >= 0)
+	{
+		if (attnum > tupleDescriptor->natts ||
+			builder->keyCount == PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM)
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, attnum - 1);
+		if (attributeForm->attisdropped)
+		{
+			continue;
+		}
+
+		if (!attributeForm->attbyval)
+		{
+			/* alter_columnar_table_set only accepts by-value group by columns */
+			return NULL;
+		}
+
+		builder->keyAttnums[builder->keyCount++] = attnum;
+	}
+
+	attnum = -1;
+	while ((attnum = bms_next_member(options->projectionSumColumns, attnum)) >= 0)
+	{
+		if (attnum > tupleDescriptor->natts)
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, attnum - 1);
+		if (attributeForm->attisdropped)
+		{
+			continue;
+		}
+
+		if (!StripeProjectionSumTypeSupported(attributeForm->atttypid))
+		{
+			return NULL;
+		}
+
+		builder->sumAttnums[builder->sumCount] = attnum;
+		builder->sumTypeIds[builder->sumCount] = attributeForm->atttypid;
+		builder->sumCount++;
+	}
+
+	if (builder->keyCount == 0 && builder->sumCount == 0)
+	{
+		return NULL;
+	}
+
+	builder->context = AllocSetContextCreate(CurrentMemoryContext,
+											 "Columnar Stripe Projection",
+											 ALLOCSET_DEFAULT_SIZES);
+	builder->groups = CreateStripeProjectionGroups(builder);
+
+	return builder;
+}
+
+
+/*
+ * CreateStripeProjectionGroups creates the hash table of the groups of a
+ * stripe projection in the memory context of the builder.
+ */
+static HTAB *
+CreateStripeProjectionGroups(StripeProjectionBuilder *builder)
+{
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = STRIPE_PROJECTION_GROUP_KEY_SIZE;
+	info.entrysize = STRIPE_PROJECTION_GROUP_SIZE(builder->sumCount);
+	info.hcxt = builder->context;
+
+	return hash_create("Columnar Stripe Projection Groups", 256, &info,
+					   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+
+/*
+ * StripeProjectionAddRow adds a row written to the stripe to its group.
+ */
+void
+StripeProjectionAddRow(StripeProjectionBuilder *builder, Datum *columnValues,
+					   bool *columnNulls)
+{
+	if (builder->abandoned)
+	{
+		return;
+	}
+
+	StripeProjectionGroup key;
+	memset(&key, 0, sizeof(key));
+
+	for (int keyIndex = 0; keyIndex < builder->keyCount; keyIndex++)
+	{
+		int columnIndex = builder->keyAttnums[keyIndex] - 1;
+
+		key.keyNulls[keyIndex] = columnNulls[columnIndex];
+		key.keyValues[keyIndex] = columnNulls[columnIndex] ? (Datum) 0 :
+								  columnValues[columnIndex];
+	}
+
+	StripeProjectionGroup *group = hash_search(builder->groups, &key, HASH_FIND, NULL);
+	if (group == NULL)
+	{
+		if (hash_get_num_entries(builder->groups) >= STRIPE_PROJECTION_GROUP_COUNT_MAXIMUM)
+		{
+			builder->abandoned = true;
+			return;
+		}
+
+		group = hash_search(builder->groups, &key, HASH_ENTER, NULL);
+		memset((char *) group + STRIPE_PROJECTION_GROUP_KEY_SIZE, 0,
+			   STRIPE_PROJECTION_GROUP_SIZE(builder->sumCount) -
+			   STRIPE_PROJECTION_GROUP_KEY_SIZE);
+	}
+
+	group->rowCount++;
+
+	for (int sumIndex = 0; sumIndex < builder->sumCount; sumIndex++)
+	{
+		int columnIndex = builder->sumAttnums[sumIndex] - 1;
+		StripeProjectionMeasure *measure = &group->measures[sumIndex];
+
+		if (columnNulls[columnIndex])
+		{
+			continue;
+		}
+
+		Datum value = columnValues[columnIndex];
+		measure->valueCount++;
+
+		switch (builder->sumTypeIds[sumIndex])
+		{
+			case INT2OID:
+			case INT4OID:
+			{
+				int64 intValue = builder->sumTypeIds[sumIndex] == INT2OID ?
+								 DatumGetInt16(value) : DatumGetInt32(value);
+
+				if (pg_add_s64_overflow(measure->intSum, intValue, &measure->intSum))
+				{
+					builder->abandoned = true;
+				}
+
+				break;
+			}
+
+			case FLOAT4OID:
+			{
+				measure->floatSum += DatumGetFloat4(value);
+				break;
+			}
+
+			default:
+			{
+				measure->floatSum += DatumGetFloat8(value);
+				break;
+			}
+		}
+	}
+}
+
+
+/*
+ * StripeProjectionFinish returns the projection of the rows added since the
+ * builder was created or reset, allocated in the current memory context,
+ * or NULL if the stripe gets no projection.
+ */
+bytea *
+StripeProjectionFinish(StripeProjectionBuilder *builder)
+{
+	if (builder->abandoned)
+	{
+		return NULL;
+	}
+
+	StringInfoData buffer;
+	pq_begintypsend(&buffer);
+
+	pq_sendint32(&buffer, STRIPE_PROJECTION_VERSION);
+	pq_sendint32(&buffer, builder->keyCount);
+	pq_sendint32(&buffer, builder->sumCount);
+
+	for (int keyIndex = 0; keyIndex < builder->keyCount; keyIndex++)
+	{
+		pq_sendint16(&buffer, builder->keyAttnums[keyIndex]);
+	}
+
+	for (int sumIndex = 0; sumIndex < builder->sumCount; sumIndex++)
+	{
+		pq_sendint16(&buffer, builder->sumAttnums[sumIndex]);
+	}
+
+	pq_sendint32(&buffer, hash_get_num_entries(builder->groups));
+
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, builder->groups);
+
+	StripeProjectionGroup *group = NULL;
+	while ((group = hash_seq_search(&status)) != NULL)
+	{
+		for (int keyIndex = 0; keyIndex < builder->keyCount; keyIndex++)
+		{
+			pq_sendbyte(&buffer, group->keyNulls[keyIndex]);
+			pq_sendint64(&buffer, (int64) group->keyValues[keyIndex]);
+		}
+
+		pq_sendint64(&buffer, group->rowCount);
+
+		for (int sumIndex = 0; sumIndex < builder->sumCount; sumIndex++)
+		{
+			StripeProjectionMeasure *measure = &group->measures[sumIndex];
+
+			pq_sendint64(&buffer, measure->valueCount);
+			pq_sendint64(&buffer, measure->intSum);
+			pq_sendfloat8(&buffer, measure->floatSum);
+		}
+	}
+
+	return pq_endtypsend(&buffer);
+}
+
+
+/*
+ * ResetStripeProjectionBuilder empties the builder for the next stripe.
+ */
+void
+ResetStripeProjectionBuilder(StripeProjectionBuilder *builder)
+{
+	MemoryContextReset(builder->context);
+	builder->groups = CreateStripeProjectionGroups(builder);
+	builder->abandoned = false;
+}
+
+
+/*
+ * DeserializeStripeProjection returns the groups of the given projection,
+ * allocated in the current memory context.
+ */
+StripeProjection *
+DeserializeStripeProjection(bytea *serialized)
+{
+	StringInfoData buffer;
+	buffer.data = VARDATA_ANY(serialized);
+	buffer.len = VARSIZE_ANY_EXHDR(serialized);
+	buffer.maxlen = buffer.len;
+	buffer.cursor = 0;
+
+	uint32 version = pq_getmsgint(&buffer, 4);
+	uint32 keyCount = pq_getmsgint(&buffer, 4);
+	uint32 sumCount = pq_getmsgint(&buffer, 4);
+	if (version != STRIPE_PROJECTION_VERSION ||
+		keyCount > PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM)
+	{
+		ereport(ERROR, (errmsg("invalid columnar stripe projection"),
+						errdetail("Projection has version %u and %u group by columns.",
+								  version, keyCount)));
+	}
+
+	StripeProjection *projection = palloc0(sizeof(StripeProjection));
+	projection->keyCount = keyCount;
+	projection->sumCount = sumCount;
+	projection->sumAttnums = palloc0(sumCount * sizeof(AttrNumber));
+
+	for (uint32 keyIndex = 0; keyIndex < keyCount; keyIndex++)
+	{
+		projection->keyAttnums[keyIndex] = pq_getmsgint(&buffer, 2);
+	}
+
+	for (uint32 sumIndex = 0; sumIndex < sumCount; sumIndex++)
+	{
+		projection->sumAttnums[sumIndex] = pq_getmsgint(&buffer, 2);
+	}
+
+	projection->groupCount = pq_getmsgint(&buffer, 4);
+	projection->groups = palloc0(projection->groupCount *
+								 sizeof(StripeProjectionGroup *));
+
+	for (uint32 groupIndex = 0; groupIndex < projection->groupCount; groupIndex++)
+	{
+		StripeProjectionGroup *group = palloc0(STRIPE_PROJECTION_GROUP_SIZE(sumCount));
+
+		for (uint32 keyIndex = 0; keyIndex < keyCount; keyIndex++)
+		{
+			group->keyNulls[keyIndex] = pq_getmsgbyte(&buffer);
+			group->keyValues[keyIndex] = (Datum) pq_getmsgint64(&buffer);
+		}
+
+		group->rowCount = pq_getmsgint64(&buffer);
+
+		for (uint32 sumIndex = 0; sumIndex < sumCount; sumIndex++)
+		{
+			StripeProjectionMeasure *measure = &group->measures[sumIndex];
+
+			measure->valueCount = pq_getmsgint64(&buffer);
+			measure->intSum = pq_getmsgint64(&buffer);
+			measure->floatSum = pq_getmsgfloat8(&buffer);
+		}
+
+		projection->groups[groupIndex] = group;
+	}
+
+	return projection;
+}
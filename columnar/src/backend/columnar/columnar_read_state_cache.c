@@ -11,6 +11,14 @@
  * Note: Probably we need to rethink this again and provide more general cache for
  * already read stripes / chunks but on global level.
  *
+ * The transaction read cache keeps the row masks and the chunk group row
+ * counts of the stripes that statements of the transaction read, so that
+ * later statements with the same snapshot, like the statements of a stored
+ * procedure, don't read them again from columnar.row_mask and
+ * columnar.chunk_group. Writes of the transaction to a relation drop what is
+ * kept of it, and snapshots that don't see a write of the transaction don't
+ * use it.
+ *
  *-------------------------------------------------------------------------
  */
 
@@ -22,7 +30,10 @@
 #else
 #include "access/tuptoaster.h"
 #endif
+#include "access/xact.h"
 #include "executor/executor.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
 
 #include "columnar/columnar_tableam.h"
 
@@ -44,6 +55,13 @@ typedef struct SubXidWriteState
 {
 	SubTransactionId subXid;
     ColumnarReadState *readState;
+
+	/* read state of tuple locks, which read with the transaction snapshot */
+	ColumnarReadState *lockReadState;
+
+	/* read state of the old rows of updates, reading updateAttrNeeded */
+	ColumnarReadState *updateReadState;
+	Bitmapset *updateAttrNeeded;
 	struct SubXidWriteState *next;
 } SubXidWriteState;
 
@@ -144,6 +162,61 @@ InitColumnarReadStateCache(Relation relation, SubTransactionId currentSubXid)
 }
 
 
+/*
+ * LockReadStateCache returns where the read state of tuple locks on the given
+ * relation in the current subtransaction is kept, which is NULL until the
+ * first lock creates it.
+ */
+ColumnarReadState **
+LockReadStateCache(Relation relation, SubTransactionId currentSubXid)
+{
+	InitColumnarReadStateCache(relation, currentSubXid);
+
+	ColumnarReadStateMapEntry *hashEntry =
+		hash_search(ColumnarReadStateMap, &relation->rd_node.relNode, HASH_FIND, NULL);
+
+	return &hashEntry->writeStateStack->lockReadState;
+}
+
+
+/*
+ * UpdateReadStateCache returns where the read state that fetches the old rows
+ * of updates of the given relation in the current subtransaction is kept.
+ * The read state only reads the columns in attrNeeded, so a read state kept
+ * for other columns is ended and NULL is returned for the caller to create a
+ * new one.
+ */
+ColumnarReadState **
+UpdateReadStateCache(Relation relation, SubTransactionId currentSubXid,
+					 Bitmapset *attrNeeded)
+{
+	InitColumnarReadStateCache(relation, currentSubXid);
+
+	ColumnarReadStateMapEntry *hashEntry =
+		hash_search(ColumnarReadStateMap, &relation->rd_node.relNode, HASH_FIND, NULL);
+	SubXidWriteState *stackEntry = hashEntry->writeStateStack;
+
+	if (stackEntry->updateReadState != NULL &&
+		!bms_equal(stackEntry->updateAttrNeeded, attrNeeded))
+	{
+		ColumnarEndRead(stackEntry->updateReadState);
+		stackEntry->updateReadState = NULL;
+	}
+
+	if (stackEntry->updateReadState == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(ColumnarReadStateContext);
+
+		bms_free(stackEntry->updateAttrNeeded);
+		stackEntry->updateAttrNeeded = bms_copy(attrNeeded);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return &stackEntry->updateReadState;
+}
+
+
 ColumnarReadState **
 FindReadStateCache(Relation relation, SubTransactionId currentSubXid)
 {
@@ -204,7 +277,21 @@ CleanupReadStateCache(SubTransactionId currentSubXid)
 		SubXidWriteState *stackHead = entry->writeStateStack;
 		if (stackHead->subXid == currentSubXid)
 		{
-			ColumnarEndRead(stackHead->readState);
+			if (stackHead->readState != NULL)
+			{
+				ColumnarEndRead(stackHead->readState);
+			}
+
+			if (stackHead->lockReadState != NULL)
+			{
+				ColumnarEndRead(stackHead->lockReadState);
+			}
+
+			if (stackHead->updateReadState != NULL)
+			{
+				ColumnarEndRead(stackHead->updateReadState);
+			}
+
 			entry->writeStateStack = stackHead->next;
 		}
 	}
@@ -214,4 +301,500 @@ CleanupReadStateCache(SubTransactionId currentSubXid)
 MemoryContext GetColumnarReadStateCache(void)
 {
 	return ColumnarReadStateContext;
-}
\ No newline at end of file
+}
+
+
+/*
+ * TransactionReadCacheRelation is what the transaction read cache keeps of
+ * a relation, by its storage id. The stripes are allocated in their own
+ * context, which writes to the relation delete.
+ */
+typedef struct TransactionReadCacheRelation
+{
+	uint64 storageId;           /* hash key */
+	MemoryContext context;      /* NULL until a stripe is kept */
+	HTAB *rowMaskStripes;       /* TransactionReadCacheStripe by first row number */
+	HTAB *rowCountStripes;      /* TransactionReadCacheStripe by stripe id */
+
+	/* command of the last write of the transaction to the relation */
+	bool written;
+	CommandId writeCommandId;
+} TransactionReadCacheRelation;
+
+typedef struct TransactionReadCacheStripe
+{
+	uint64 stripeKey;           /* hash key */
+	StripeRowMasks *rowMasks;
+	uint32 chunkCount;
+	uint32 *chunkGroupRowCounts;
+	uint32 *chunkGroupDeletedRows;
+} TransactionReadCacheStripe;
+
+/* TransactionReadCacheRelation by storage id, allocated in the context below */
+static HTAB *TransactionReadCacheMap = NULL;
+static MemoryContext TransactionReadCacheContext = NULL;
+
+/* snapshot the kept stripes were read with, curcid aside */
+static bool TransactionReadCacheHasSnapshot = false;
+static TransactionId TransactionReadCacheXmin;
+static TransactionId TransactionReadCacheXmax;
+static uint32 TransactionReadCacheXcnt;
+static TransactionId *TransactionReadCacheXip = NULL;
+static int32 TransactionReadCacheSubxcnt;
+static TransactionId *TransactionReadCacheSubxip = NULL;
+static bool TransactionReadCacheSuboverflowed;
+
+static MemoryContextCallback transactionReadCacheCallback;
+
+static void CleanupTransactionReadCache(void *arg);
+static TransactionReadCacheRelation * TransactionReadCacheFindRelation(uint64 storageId,
+																	   bool create);
+static void TransactionReadCacheDropStripes(TransactionReadCacheRelation *relationEntry);
+static bool TransactionReadCacheSnapshotMatches(Snapshot snapshot);
+static void TransactionReadCacheSetSnapshot(Snapshot snapshot);
+static TransactionReadCacheStripe * TransactionReadCacheLookup(uint64 storageId,
+															   uint64 stripeKey,
+															   bool rowMasks,
+															   Snapshot snapshot);
+static TransactionReadCacheStripe * TransactionReadCacheEnter(uint64 storageId,
+															  uint64 stripeKey,
+															  bool rowMasks,
+															  Snapshot snapshot);
+static StripeRowMasks * CopyStripeRowMasks(StripeRowMasks *stripeRowMasks);
+
+
+static void
+CleanupTransactionReadCache(void *arg)
+{
+	TransactionReadCacheMap = NULL;
+	TransactionReadCacheContext = NULL;
+	TransactionReadCacheHasSnapshot = false;
+	TransactionReadCacheXip = NULL;
+	TransactionReadCacheSubxip = NULL;
+}
+
+
+/*
+ * TransactionReadCacheFindRelation returns the transaction read cache entry
+ * of the relation with given storage id, creating it and the cache if asked
+ * to, or NULL.
+ */
+static TransactionReadCacheRelation *
+TransactionReadCacheFindRelation(uint64 storageId, bool create)
+{
+	if (TransactionReadCacheMap == NULL)
+	{
+		if (!create)
+		{
+			return NULL;
+		}
+
+		TransactionReadCacheContext = AllocSetContextCreate(
+			TopTransactionContext, "Columnar Transaction Read Cache context",
+			ALLOCSET_DEFAULT_SIZES);
+
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(TransactionReadCacheRelation);
+		info.hcxt = TransactionReadCacheContext;
+
+		TransactionReadCacheMap = hash_create("columnar transaction read cache", 16,
+											  &info, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		transactionReadCacheCallback.arg = NULL;
+		transactionReadCacheCallback.func = &CleanupTransactionReadCache;
+		transactionReadCacheCallback.next = NULL;
+		MemoryContextRegisterResetCallback(TransactionReadCacheContext,
+										   &transactionReadCacheCallback);
+	}
+
+	bool found = false;
+	TransactionReadCacheRelation *relationEntry =
+		hash_search(TransactionReadCacheMap, &storageId,
+					create ? HASH_ENTER : HASH_FIND, &found);
+
+	if (create && !found)
+	{
+		relationEntry->context = NULL;
+		relationEntry->rowMaskStripes = NULL;
+		relationEntry->rowCountStripes = NULL;
+		relationEntry->written = false;
+		relationEntry->writeCommandId = InvalidCommandId;
+	}
+
+	return relationEntry;
+}
+
+
+/*
+ * TransactionReadCacheDropStripes drops the stripes kept of a relation, but
+ * remembers its last write.
+ */
+static void
+TransactionReadCacheDropStripes(TransactionReadCacheRelation *relationEntry)
+{
+	if (relationEntry->context != NULL)
+	{
+		MemoryContextDelete(relationEntry->context);
+	}
+
+	relationEntry->context = NULL;
+	relationEntry->rowMaskStripes = NULL;
+	relationEntry->rowCountStripes = NULL;
+}
+
+
+/*
+ * TransactionReadCacheSnapshotMatches returns whether the given snapshot
+ * sees the same transactions as the one the kept stripes were read with.
+ */
+static bool
+TransactionReadCacheSnapshotMatches(Snapshot snapshot)
+{
+	return TransactionReadCacheHasSnapshot &&
+		   snapshot->xmin == TransactionReadCacheXmin &&
+		   snapshot->xmax == TransactionReadCacheXmax &&
+		   snapshot->xcnt == TransactionReadCacheXcnt &&
+		   snapshot->subxcnt == TransactionReadCacheSubxcnt &&
+		   snapshot->suboverflowed == TransactionReadCacheSuboverflowed &&
+		   memcmp(snapshot->xip, TransactionReadCacheXip,
+				  snapshot->xcnt * sizeof(TransactionId)) == 0 &&
+		   memcmp(snapshot->subxip, TransactionReadCacheSubxip,
+				  snapshot->subxcnt * sizeof(TransactionId)) == 0;
+}
+
+
+/*
+ * TransactionReadCacheSetSnapshot drops the stripes kept of all relations
+ * and keeps the given snapshot as the one the next ones are read with.
+ */
+static void
+TransactionReadCacheSetSnapshot(Snapshot snapshot)
+{
+	HASH_SEQ_STATUS status;
+	TransactionReadCacheRelation *relationEntry = NULL;
+
+	hash_seq_init(&status, TransactionReadCacheMap);
+	while ((relationEntry = hash_seq_search(&status)) != NULL)
+	{
+		TransactionReadCacheDropStripes(relationEntry);
+	}
+
+	if (TransactionReadCacheXip != NULL)
+	{
+		pfree(TransactionReadCacheXip);
+	}
+
+	if (TransactionReadCacheSubxip != NULL)
+	{
+		pfree(TransactionReadCacheSubxip);
+	}
+
+	TransactionReadCacheXmin = snapshot->xmin;
+	TransactionReadCacheXmax = snapshot->xmax;
+	TransactionReadCacheXcnt = snapshot->xcnt;
+	TransactionReadCacheSubxcnt = snapshot->subxcnt;
+	TransactionReadCacheSuboverflowed = snapshot->suboverflowed;
+
+	/* the extra element keeps the allocations non-empty */
+	TransactionReadCacheXip =
+		MemoryContextAlloc(TransactionReadCacheContext,
+						   (snapshot->xcnt + 1) * sizeof(TransactionId));
+	memcpy(TransactionReadCacheXip, snapshot->xip,
+		   snapshot->xcnt * sizeof(TransactionId));
+
+	TransactionReadCacheSubxip =
+		MemoryContextAlloc(TransactionReadCacheContext,
+						   (snapshot->subxcnt + 1) * sizeof(TransactionId));
+	memcpy(TransactionReadCacheSubxip, snapshot->subxip,
+		   snapshot->subxcnt * sizeof(TransactionId));
+
+	TransactionReadCacheHasSnapshot = true;
+}
+
+
+/*
+ * TransactionReadCacheLookup returns the kept stripe with given key of the
+ * relation with given storage id if a read with the given snapshot can use
+ * it, or NULL.
+ */
+static TransactionReadCacheStripe *
+TransactionReadCacheLookup(uint64 storageId, uint64 stripeKey, bool rowMasks,
+						   Snapshot snapshot)
+{
+	if (!columnar_enable_transaction_read_cache || snapshot == NULL ||
+		!IsMVCCSnapshot(snapshot) || !TransactionReadCacheSnapshotMatches(snapshot))
+	{
+		return NULL;
+	}
+
+	TransactionReadCacheRelation *relationEntry =
+		TransactionReadCacheFindRelation(storageId, false);
+	if (relationEntry == NULL)
+	{
+		return NULL;
+	}
+
+	/* older snapshots of the transaction, like those of cursors, miss writes */
+	if (relationEntry->written && relationEntry->writeCommandId >= snapshot->curcid)
+	{
+		return NULL;
+	}
+
+	HTAB *stripes = rowMasks ? relationEntry->rowMaskStripes :
+					relationEntry->rowCountStripes;
+	if (stripes == NULL)
+	{
+		return NULL;
+	}
+
+	return hash_search(stripes, &stripeKey, HASH_FIND, NULL);
+}
+
+
+/*
+ * TransactionReadCacheEnter returns a new stripe entry with given key of the
+ * relation with given storage id read with the given snapshot, or NULL if it
+ * can't be kept.
+ */
+static TransactionReadCacheStripe *
+TransactionReadCacheEnter(uint64 storageId, uint64 stripeKey, bool rowMasks,
+						  Snapshot snapshot)
+{
+	if (!columnar_enable_transaction_read_cache || snapshot == NULL ||
+		!IsMVCCSnapshot(snapshot))
+	{
+		return NULL;
+	}
+
+	TransactionReadCacheRelation *relationEntry =
+		TransactionReadCacheFindRelation(storageId, true);
+
+	if (relationEntry->written && relationEntry->writeCommandId >= snapshot->curcid)
+	{
+		return NULL;
+	}
+
+	if (!TransactionReadCacheSnapshotMatches(snapshot))
+	{
+		TransactionReadCacheSetSnapshot(snapshot);
+	}
+
+	if (relationEntry->context == NULL)
+	{
+		relationEntry->context = AllocSetContextCreate(TransactionReadCacheContext,
+													   "Columnar Transaction Read Cache "
+													   "relation context",
+													   ALLOCSET_SMALL_SIZES);
+	}
+
+	HTAB **stripes = rowMasks ? &relationEntry->rowMaskStripes :
+					 &relationEntry->rowCountStripes;
+	if (*stripes == NULL)
+	{
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(TransactionReadCacheStripe);
+		info.hcxt = relationEntry->context;
+
+		*stripes = hash_create("columnar transaction read cache stripes", 64,
+							   &info, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	bool found = false;
+	TransactionReadCacheStripe *stripeEntry =
+		hash_search(*stripes, &stripeKey, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		stripeEntry->rowMasks = NULL;
+		stripeEntry->chunkCount = 0;
+		stripeEntry->chunkGroupRowCounts = NULL;
+		stripeEntry->chunkGroupDeletedRows = NULL;
+	}
+
+	return found ? NULL : stripeEntry;
+}
+
+
+/*
+ * CopyStripeRowMasks returns a copy of the given row masks in the current
+ * memory context.
+ */
+static StripeRowMasks *
+CopyStripeRowMasks(StripeRowMasks *stripeRowMasks)
+{
+	int count = stripeRowMasks->count;
+
+	StripeRowMasks *copy = palloc0(sizeof(StripeRowMasks));
+	copy->count = count;
+	copy->startRowNumbers = palloc((count + 1) * sizeof(uint64));
+	copy->endRowNumbers = palloc((count + 1) * sizeof(uint64));
+	copy->masks = palloc((count + 1) * sizeof(bytea *));
+
+	memcpy(copy->startRowNumbers, stripeRowMasks->startRowNumbers, count * sizeof(uint64));
+	memcpy(copy->endRowNumbers, stripeRowMasks->endRowNumbers, count * sizeof(uint64));
+
+	for (int n = 0; n < count; n++)
+	{
+		bytea *mask = stripeRowMasks->masks[n];
+		copy->masks[n] = palloc(VARSIZE(mask));
+		memcpy(copy->masks[n], mask, VARSIZE(mask));
+	}
+
+	return copy;
+}
+
+
+/*
+ * TransactionReadCacheLookupRowMasks returns a copy in the given memory
+ * context of the kept row masks of the stripe with given first row number,
+ * if a read with the given snapshot can use them, or NULL.
+ */
+StripeRowMasks *
+TransactionReadCacheLookupRowMasks(uint64 storageId, uint64 stripeFirstRowNumber,
+								   Snapshot snapshot, MemoryContext cxt)
+{
+	TransactionReadCacheStripe *stripeEntry =
+		TransactionReadCacheLookup(storageId, stripeFirstRowNumber, true, snapshot);
+	if (stripeEntry == NULL)
+	{
+		return NULL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
+	StripeRowMasks *stripeRowMasks = CopyStripeRowMasks(stripeEntry->rowMasks);
+	MemoryContextSwitchTo(oldContext);
+
+	return stripeRowMasks;
+}
+
+
+/*
+ * TransactionReadCacheStoreRowMasks keeps a copy of the row masks of the
+ * stripe with given first row number read with the given snapshot.
+ */
+void
+TransactionReadCacheStoreRowMasks(uint64 storageId, uint64 stripeFirstRowNumber,
+								  Snapshot snapshot, StripeRowMasks *stripeRowMasks)
+{
+	TransactionReadCacheStripe *stripeEntry =
+		TransactionReadCacheEnter(storageId, stripeFirstRowNumber, true, snapshot);
+	if (stripeEntry == NULL)
+	{
+		return;
+	}
+
+	TransactionReadCacheRelation *relationEntry =
+		TransactionReadCacheFindRelation(storageId, false);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(relationEntry->context);
+	stripeEntry->rowMasks = CopyStripeRowMasks(stripeRowMasks);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * TransactionReadCacheLookupRowCounts sets the row counts and deleted row
+ * counts of the chunk groups of the given stripe to palloc'd copies of the
+ * kept ones and returns true if a read with the given snapshot can use them.
+ */
+bool
+TransactionReadCacheLookupRowCounts(uint64 storageId, uint64 stripe,
+									uint32 chunkGroupCount, Snapshot snapshot,
+									uint32 **chunkGroupRowCounts,
+									uint32 **chunkGroupDeletedRows)
+{
+	TransactionReadCacheStripe *stripeEntry =
+		TransactionReadCacheLookup(storageId, stripe, false, snapshot);
+	if (stripeEntry == NULL || stripeEntry->chunkCount != chunkGroupCount)
+	{
+		return false;
+	}
+
+	Size size = chunkGroupCount * sizeof(uint32);
+
+	*chunkGroupRowCounts = palloc0(size);
+	memcpy(*chunkGroupRowCounts, stripeEntry->chunkGroupRowCounts, size);
+	*chunkGroupDeletedRows = palloc0(size);
+	memcpy(*chunkGroupDeletedRows, stripeEntry->chunkGroupDeletedRows, size);
+
+	return true;
+}
+
+
+/*
+ * TransactionReadCacheStoreRowCounts keeps a copy of the row counts and
+ * deleted row counts of the chunk groups of the given stripe read with the
+ * given snapshot.
+ */
+void
+TransactionReadCacheStoreRowCounts(uint64 storageId, uint64 stripe,
+								   uint32 chunkGroupCount, Snapshot snapshot,
+								   const uint32 *chunkGroupRowCounts,
+								   const uint32 *chunkGroupDeletedRows)
+{
+	TransactionReadCacheStripe *stripeEntry =
+		TransactionReadCacheEnter(storageId, stripe, false, snapshot);
+	if (stripeEntry == NULL)
+	{
+		return;
+	}
+
+	TransactionReadCacheRelation *relationEntry =
+		TransactionReadCacheFindRelation(storageId, false);
+
+	Size size = chunkGroupCount * sizeof(uint32);
+
+	stripeEntry->chunkCount = chunkGroupCount;
+	stripeEntry->chunkGroupRowCounts = MemoryContextAllocZero(relationEntry->context,
+															  size + sizeof(uint32));
+	memcpy(stripeEntry->chunkGroupRowCounts, chunkGroupRowCounts, size);
+	stripeEntry->chunkGroupDeletedRows = MemoryContextAllocZero(relationEntry->context,
+																size + sizeof(uint32));
+	memcpy(stripeEntry->chunkGroupDeletedRows, chunkGroupDeletedRows, size);
+}
+
+
+/*
+ * TransactionReadCacheInvalidate drops what the transaction read cache keeps
+ * of the relation with given storage id, as the transaction writes to it,
+ * and keeps snapshots that don't see the write from using it again.
+ */
+void
+TransactionReadCacheInvalidate(uint64 storageId)
+{
+	TransactionReadCacheRelation *relationEntry =
+		TransactionReadCacheFindRelation(storageId, true);
+
+	TransactionReadCacheDropStripes(relationEntry);
+
+	relationEntry->written = true;
+	relationEntry->writeCommandId = GetCurrentCommandId(false);
+}
+
+
+/*
+ * TransactionReadCacheReset drops the stripes the transaction read cache
+ * keeps of all relations, as when a subtransaction that might have written
+ * to them aborts.
+ */
+void
+TransactionReadCacheReset(void)
+{
+	if (TransactionReadCacheMap == NULL)
+	{
+		return;
+	}
+
+	HASH_SEQ_STATUS status;
+	TransactionReadCacheRelation *relationEntry = NULL;
+
+	hash_seq_init(&status, TransactionReadCacheMap);
+	while ((relationEntry = hash_seq_search(&status)) != NULL)
+	{
+		TransactionReadCacheDropStripes(relationEntry);
+	}
+}
@@ -20,9 +20,15 @@
 #include "safe_lib.h"
 
 #include "access/nbtree.h"
+#include "access/tableam.h"
 #include "access/xact.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_opfamily.h"
+#include "common/hashfn.h"
 #include "commands/defrem.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "storage/bufmgr.h"
 #include "storage/smgr.h"
 #include "columnar/utils/listutils.h"
 #include "nodes/makefuncs.h"
@@ -30,35 +36,128 @@
 #include "optimizer/optimizer.h"
 #include "optimizer/clauses.h"
 #include "optimizer/restrictinfo.h"
+#include "port/pg_bitutils.h"
+#include "port/pg_bswap.h"
+#include "portability/instr_time.h"
 #include "storage/fd.h"
+#include "utils/array.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
 #include "utils/palloc.h"
+#include "utils/pg_locale.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/sortsupport.h"
+#include "utils/typcache.h"
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 #include "columnar/columnar_version_compat.h"
+#include "columnar/vectorization/columnar_vector_types.h"
 
 #define UNEXPECTED_STRIPE_READ_ERR_MSG \
 	"attempted to read an unexpected stripe while reading columnar " \
 	"table %s, stripe with id=" UINT64_FORMAT " is not flushed"
 
+/* the most stripes ColumnarChunkGroupReadFraction checks the chunk groups of */
+#define CHUNK_GROUP_ESTIMATE_MAX_STRIPES 64
+
+/* ChunkRowDeleted returns whether the row mask marks the chunk group row deleted */
+#define ChunkRowDeleted(rowMask, row) \
+	((VARDATA(rowMask)[(row) / 8] & (1 << ((row) % 8))) != 0)
+
+/* number of rows whose deletion bits readers check at once, see ChunkRowMaskWord */
+#define ROW_MASK_WORD_ROWS 64
+
 typedef struct ChunkGroupReadState
 {
 	int64 currentRow;
 	int64 rowCount;
 	int columnCount;
 	List *projectedColumnList;  /* borrowed reference */
+	TupleDesc tupleDescriptor;  /* borrowed reference */
 	ChunkData *chunkGroupData;
 	bytea *rowMask;
 	bool rowMaskCached; /* If rowMask metadata is cached and borrowed */
 	uint32 chunkStripeRowOffset; 
 	uint32 chunkGroupDeletedRows;
+
+	/* row reads don't check the row mask for the rows before this one */
+	int64 liveUntilRow;
+
+	/*
+	 * For vectorized reads of chunk groups with deleted rows, the rows of the
+	 * current vector that aren't deleted, see SelectChunkGroupRows.
+	 */
+	uint32 *selectedRows;
+	uint32 selectedRowsSize;
+
+	/*
+	 * For vectorized reads, the index of the next value of each column in
+	 * chunkGroupData->packedValueArray.
+	 */
+	uint32 *packedValueIndex;
+
+	/*
+	 * Vectorized reads deserialize the chunk of a column when a vector first
+	 * needs it, so the columns that are only read for rows passing the vector
+	 * quals aren't decompressed for chunk groups none of whose rows pass.
+	 * columnDeserialized is NULL for reads that deserialize every chunk when
+	 * the chunk group read begins.
+	 */
+	bool *columnDeserialized;
+	struct StripeReadState *stripeReadState;
+	int chunkIndex;
+	uint64 stripeId;
 } ChunkGroupReadState;
 
+/*
+ * ChunkDecodeBuffers holds the exists and value arrays of the projected
+ * columns that every chunk group of a read is deserialized into, so chunk
+ * groups don't allocate and free their own. They live in the scan context
+ * and are only reallocated for a chunk group with more rows than the ones
+ * read before.
+ */
+typedef struct ChunkDecodeBuffers
+{
+	MemoryContext context;
+	bool *columnMask;
+	uint32 rowCapacity;
+	ChunkData *chunkData;
+} ChunkDecodeBuffers;
+
+/*
+ * StripeRescanCache keeps the skip lists and the loaded chunks of the stripes
+ * a read loads after it was rescanned, so that parameterized scans on the
+ * inner side of a nested loop, which are rescanned for every outer row, only
+ * prune the chunk groups again with the new parameters and read the chunks
+ * they haven't loaded yet. It is emptied when the snapshot of the read or its
+ * command changes, since chunk groups might have rows deleted since, and
+ * takes up to work_mem.
+ */
+typedef struct StripeRescanCache
+{
+	MemoryContext context;      /* NULL until the first rescan */
+	HTAB *stripes;              /* StripeRescanCacheEntry by stripe id */
+	Snapshot snapshot;
+	CommandId commandId;
+} StripeRescanCache;
+
+typedef struct StripeRescanCacheEntry
+{
+	uint64 stripeId;            /* hash key */
+	StripeSkipList *skipList;
+
+	/*
+	 * Loaded chunks of each column by chunk group index, NULL for the ones
+	 * that weren't loaded or didn't fit into the cache.
+	 */
+	ColumnChunkBuffers ***chunkBuffers;
+} StripeRescanCacheEntry;
+
 typedef struct StripeReadState
 {
 	int columnCount;
@@ -68,12 +167,121 @@ typedef struct StripeReadState
 	Relation relation;
 	int chunkGroupIndex;
 	int64 chunkGroupsFiltered;
+	uint64 storageId;               /* only set if the shared cache is used */
+	int cacheQuota;                 /* cache_quota option of the relation */
+	bool cacheAdmissionDisabled;    /* only read from the column cache */
 	MemoryContext stripeReadContext;
 	StripeBuffers *stripeBuffers;   /* allocated in stripeReadContext */
 	List *projectedColumnList;      /* borrowed reference */
 	ChunkGroupReadState *chunkGroupReadState; /* owned */
+	ChunkDecodeBuffers *decodeBuffers; /* borrowed from the read */
+	StripeRescanCache *rescanCache; /* borrowed from the read, or NULL */
+
+	/*
+	 * Streaming reads load the chunks of the projected columns one chunk group
+	 * at a time, when the chunk group is read, see
+	 * columnar.enable_streaming_reads. NULL if the stripe was loaded at once.
+	 */
+	struct StripeStreamState *streamState;
+
+	/*
+	 * Reads with a row bound only load the chunk groups of the stripe up to
+	 * nextChunkGroup, which is the chunk count if the rest of the stripe is
+	 * loaded too.
+	 */
+	uint32 nextChunkGroup;
+
+	/*
+	 * Decompressed values of the current chunk group of each column, reused by
+	 * the next chunk group so each chunk doesn't allocate its own buffer.
+	 * Allocated in stripeReadContext on first use, not used for chunks that
+	 * go to the column cache.
+	 */
+	StringInfo *decompressionBufferArray;
+
+	/*
+	 * Helper thread that decompresses the chunk group after the current one
+	 * while sequential reads read the current one, see
+	 * columnar.enable_decompression_thread. Created on first use. Its jobs
+	 * decompress prefetchJobCount columns, listed in prefetchJobColumns, of
+	 * chunk group prefetchChunkGroupIndex into prefetchBufferArray.
+	 */
+	DecompressionThread *decompressionThread;
+	DecompressionJob *prefetchJobs;
+	uint32 *prefetchJobColumns;
+	uint32 prefetchJobCount;
+	int prefetchChunkGroupIndex;
+	StringInfo *prefetchBufferArray;
+
+	/*
+	 * Columns of chunk group prefetchedChunkGroupIndex whose decompressed
+	 * values were swapped into decompressionBufferArray, or decompressed
+	 * into it by the threads of columnar.column_decompression_threads.
+	 */
+	bool *columnPrefetched;
+	int prefetchedChunkGroupIndex;
+
+	/* the jobs of those threads, allocated on first use */
+	DecompressionJob *columnDecompressionJobs;
+	uint32 *columnDecompressionJobColumns;
+
+	/* statistics of the read the stripe belongs to, borrowed */
+	ColumnarReadStatistics *statistics;
+
+	/*
+	 * Row masks of the whole stripe, fetched when the first chunk group with
+	 * deleted rows is read, so stripes without deleted rows skip the lookup.
+	 */
+	uint64 stripeFirstRowNumber;
+	uint64 stripeRowCount;
+	StripeRowMasks *stripeRowMasks;
+
+	/* snapshot of the read, borrowed */
+	Snapshot snapshot;
+
+	/*
+	 * Values of the current chunk group read from the large value area of
+	 * the stripe at stripeFileOffset, or the expanded objects that read them
+	 * lazily. Created in stripeReadContext on first use.
+	 */
+	uint64 stripeFileOffset;
+	MemoryContext largeValueContext;
+
+	/*
+	 * Pushed down clauses that row reads binary search the sorted chunks of
+	 * their columns for, see NarrowSortedChunkGroup. NIL if there are none.
+	 */
+	List *sortedSearchClauses;
 } StripeReadState;
 
+/*
+ * SortedSearchClause is a pushed down clause that compares a column whose
+ * chunks track sortedness with a constant by the btree order of its type.
+ * The strategy is the one of the column on the left side.
+ */
+typedef struct SortedSearchClause
+{
+	uint32 columnIndex;
+	StrategyNumber strategyNumber;
+	Datum constValue;
+	FmgrInfo comparisonFunction;
+} SortedSearchClause;
+
+/*
+ * ColumnarVectorQual holds the vector quals a vectorized sequential scan
+ * evaluates while it reads, see ColumnarSetVectorQual.
+ */
+typedef struct ColumnarVectorQual
+{
+	/* integer lists of the attribute numbers each stage reads */
+	List *stageColumnLists;
+	ColumnarVectorQualFunc qualFunc;
+	void *qualState;
+
+	/* columns already read into the current vector, by column index */
+	bool *columnRead;
+} ColumnarVectorQual;
+
 struct ColumnarReadState
 {
 	TupleDesc tupleDescriptor;
@@ -106,10 +314,185 @@ struct ColumnarReadState
 
 	/* Parallel exeuction */
 	ParallelColumnarScan parallelColumnarScan;
+
+	/*
+	 * Set if the leader of the parallel scan left out the stripes that
+	 * whereClauseList refutes, see ColumnarParallelScanStripeList.
+	 */
+	bool stripesPrunedByLeader;
+
+	/*
+	 * Set if whereClauseList only allows rows of allowedBuckets of the
+	 * bucket_by option, see StripeBucketRefuted. allowedBucketsValid is
+	 * cleared whenever whereClauseList changes.
+	 */
+	bool allowedBucketsValid;
+	bool bucketsRestricted;
+	Bitmapset *allowedBuckets;
+
+	/*
+	 * Stripes to read in this order instead of all stripes in the order of
+	 * their row numbers, if hasStripeList, see ColumnarSetStripeList.
+	 * stripeListIndex is the index of the next one to read.
+	 */
+	bool hasStripeList;
+	List *stripeList;
+	int stripeListIndex;
+
+	/*
+	 * Set if the read is synchronized with other scans of the table, see
+	 * columnar_sync_scan.c. It starts at the stripe with the first row number
+	 * syncScanStartRowNumber, and syncScanWrapped is set once it went on with
+	 * the first stripe of the table after the last one.
+	 */
+	bool syncScan;
+	uint32 syncScanColumnsHash;
+	uint64 syncScanStartRowNumber;
+	bool syncScanWrapped;
+
+	/*
+	 * Buffer ring used for large sequential scans, NULL if we use the
+	 * default buffer replacement.
+	 */
+	BufferAccessStrategy accessStrategy;
+
+	/*
+	 * Sequential scans return the rows of the delta store after the stripe
+	 * rows. deltaStoreScan is started once the stripes are exhausted, and
+	 * deltaStoreRowContext holds the delta store rows returned last.
+	 */
+	bool readDeltaStore;
+	bool deltaStoreExhausted;
+	DeltaStoreScanDesc deltaStoreScan;
+	MemoryContext deltaStoreRowContext;
+
+	/* vector quals evaluated by ColumnarReadNextVector, or NULL */
+	ColumnarVectorQual *vectorQual;
+
+	/*
+	 * Number of rows the scan is expected to need, or 0 if it reads all of
+	 * them, see ColumnarSetRowBound. The current stripe is loaded from
+	 * stripeFirstChunkGroup, up to the chunk groups holding stripeRowTarget
+	 * rows.
+	 */
+	uint64 rowBound;
+	uint32 stripeFirstChunkGroup;
+	uint64 stripeRowTarget;
+
+	/*
+	 * Chunk groups of the current stripe from stripeEndChunkGroup on are left
+	 * to other participants of a parallel scan, PG_UINT32_MAX if none are.
+	 */
+	uint32 stripeEndChunkGroup;
+
+	/* statistics of the chunk groups left out of the read, or NULL */
+	ChunkGroupSummary *chunkGroupSummary;
+
+	/* chunk groups the read marks deleted instead of reading, or NULL */
+	ColumnarChunkGroupDelete *chunkGroupDelete;
+
+	/* groups of the stripes left out of the read, or NULL */
+	StripeProjectionSummary *projectionSummary;
+
+	/* bound of the top-N sort above the read, or NULL */
+	ColumnarTopNBound *topNBound;
+
+	/* keys of the hash join above the read, or NULL */
+	ColumnarJoinKeyFilter *joinKeyFilter;
+
+	/* what the read did so far, see ColumnarReadGetStatistics */
+	ColumnarReadStatistics statistics;
+
+	/* arrays the chunk groups of the read are deserialized into */
+	ChunkDecodeBuffers decodeBuffers;
+
+	/* stripes loaded since the read was rescanned */
+	StripeRescanCache rescanCache;
+
+	/*
+	 * Sorted row numbers whose rows ColumnarReadNextRowNumber returns, see
+	 * ColumnarReadSetRowNumbers. Borrowed from the caller.
+	 */
+	const uint64 *rowNumbers;
+	uint32 rowNumberCount;
+	uint32 nextRowNumberIndex;
+
+	/*
+	 * Rows that ColumnarReadNextBatchedRow and ColumnarReadChunkGroupNextRow
+	 * decoded a vector at a time into batchSlot, a vector slot of the
+	 * projected columns, and return one by one. batchRowIndex is the index of
+	 * the next of the batchRowCount rows to return. batchRows is set while a
+	 * sequential read batches its rows, see RowBatchAllowed.
+	 */
+	TupleTableSlot *batchSlot;
+	uint32 batchRowCount;
+	uint32 batchRowIndex;
+	bool batchRows;
 };
 
+/*
+ * StripeReadRange is a contiguous logical range of the relation that will be
+ * read while loading a stripe.
+ */
+typedef struct StripeReadRange
+{
+	uint64 offset;
+	uint64 length;
+} StripeReadRange;
+
+/*
+ * StripePrefetchState keeps prefetch requests for up to columnar.prefetch_depth
+ * blocks in flight ahead of the synchronous reads done by LoadColumnBuffers.
+ * Ranges are kept in the same order as LoadColumnBuffers reads them, which is
+ * also the order they are laid out on disk.
+ */
+typedef struct StripePrefetchState
+{
+	Relation relation;
+	StripeReadRange *ranges;
+	int rangeCount;
+
+	/* first range that is not completely prefetched yet */
+	int nextRange;
+	uint64 nextRangePrefetched;
+
+	uint64 bytesPrefetched;
+	uint64 bytesConsumed;
+	uint64 windowSize;
+} StripePrefetchState;
+
+/*
+ * StripeStreamState keeps what a streaming stripe read needs to load the
+ * chunks of a chunk group when it is read. Chunk groups are indexed by their
+ * position among the selected chunk groups, like in StripeBuffers.
+ */
+typedef struct StripeStreamState
+{
+	Relation relation;
+	TupleDesc tupleDescriptor;
+	uint64 stripeOffset;
+	bool *projectedColumnMask;
+	StripeSkipList *selectedChunkSkipList;
+
+	/* prefetches the chunks in the order chunk groups load them, or NULL */
+	StripePrefetchState *prefetchState;
+	BufferAccessStrategy accessStrategy;
+	ColumnarReadStatistics *statistics;
+
+	bool *chunkGroupLoaded;
+} StripeStreamState;
+
+/* most memory a stripe read of this backend used, see UpdateReadPeakMemory */
+static uint64 ReadStatePeakMemory = 0;
+
+/* reads of this relation skip its stripes below the floor, see ColumnarSetStripeFloor */
+static Oid StripeFloorRelationId = InvalidOid;
+static uint64 StripeFloor = 0;
+
 /* static function declarations */
 static MemoryContext CreateStripeReadMemoryContext(void);
+static uint64 ReadStateMemoryLimit(void);
+static void UpdateReadPeakMemory(ColumnarReadState *readState);
 static bool ColumnarReadIsCurrentStripe(ColumnarReadState *readState,
 										uint64 rowNumber);
 static StripeMetadata * ColumnarReadGetCurrentStripe(ColumnarReadState *readState);
@@ -124,22 +507,83 @@ static bool ReadChunkGroupRowByRowOffset(ChunkGroupReadState *chunkGroupReadStat
 										 bool *columnNulls);
 static bool StripeReadInProgress(ColumnarReadState *readState);
 static bool HasUnreadStripe(ColumnarReadState *readState);
+static bytea * NextDeltaStoreRowData(ColumnarReadState *readState, uint64 *rowNumber);
+static MemoryContext DeltaStoreRowContext(ColumnarReadState *readState);
+static bool ReadNextDeltaStoreRow(ColumnarReadState *readState, Datum *columnValues,
+								  bool *columnNulls, uint64 *rowNumber);
+static bool RowBatchAllowed(ColumnarReadState *readState);
+static bool RowBatchColumnsSupported(ColumnarReadState *readState);
+static bool FillRowBatch(ColumnarReadState *readState, bool chunkGroupOnly);
+static void ReadRowBatchNextRow(ColumnarReadState *readState, Datum *columnValues,
+								bool *columnNulls, uint64 *rowNumber);
+static bool ReadNextDeltaStoreVector(ColumnarReadState *readState, Datum *columnValues,
+									 uint64 *rowNumber, int maxVectorSize,
+									 int *newVectorSize);
+static bool DeltaStoreVectorPassesQual(ColumnarVectorQual *vectorQual,
+									   uint32 vectorSize);
+static bool ReadDeltaStoreRowByRowNumber(ColumnarReadState *readState,
+										 uint64 rowNumber, Datum *columnValues,
+										 bool *columnNulls);
+static void EndDeltaStoreRead(ColumnarReadState *readState);
 static StripeReadState * BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel,
 										 TupleDesc tupleDesc, List *projectedColumnList,
 										 List *whereClauseList, List *whereClauseVars,
 										 MemoryContext stripeReadContext,
-										 Snapshot snapshot);
+										 Snapshot snapshot,
+										 BufferAccessStrategy accessStrategy,
+										 uint32 firstChunkGroup, uint32 endChunkGroup,
+										 uint64 rowTarget, uint64 memoryLimit,
+										 ChunkGroupSummary *chunkGroupSummary,
+										 ColumnarChunkGroupDelete *chunkGroupDelete,
+										 ColumnarTopNBound *topNBound,
+										 ColumnarJoinKeyFilter *joinKeyFilter,
+										 ColumnarReadStatistics *statistics,
+										 ChunkDecodeBuffers *decodeBuffers,
+										 StripeRescanCache *rescanCache);
 static void AdvanceStripeRead(ColumnarReadState *readState);
+static void SkipStripesNotToRead(ColumnarReadState *readState);
+static StripeMetadata * FindNextStripeToRead(ColumnarReadState *readState,
+											 StripeMetadata *lastStripeMetadata);
+static StripeMetadata * FindNextSerialStripe(ColumnarReadState *readState,
+											 uint64 lastReadRowNumber);
+static StripeMetadata * ClaimParallelStripeRange(ColumnarReadState *readState);
+static StripeMetadata * ClaimParallelStripeById(ColumnarReadState *readState);
+static bool StripeAnsweredByProjection(ColumnarReadState *readState,
+									   StripeMetadata *stripeMetadata);
+static bool AddStripeProjectionToSummary(StripeProjectionSummary *summary,
+										 StripeProjection *projection);
+static bool StripeBucketRefuted(ColumnarReadState *readState,
+								StripeMetadata *stripeMetadata);
+static bool StripeRefutedBySummary(ColumnarReadState *readState,
+								   StripeMetadata *stripeMetadata);
+static bool StripeSummaryRefutesClauses(Relation relation, TupleDesc tupleDescriptor,
+										StripeMetadata *stripeMetadata,
+										List *whereClauseList, List *whereClauseVars,
+										Snapshot snapshot);
 static bool SnapshotMightSeeUnflushedStripes(Snapshot snapshot);
 static bool ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
 							  bool *columnNulls,
 							  uint64 stripeFirstRowNumber,
 							  Snapshot snapshot, uint64 stripeId);
+static void StartChunkGroupPrefetch(StripeReadState *stripeReadState);
+static List * SortedSearchClauses(List *whereClauseList, TupleDesc tupleDescriptor,
+								  List *projectedColumnList);
+static void NarrowSortedChunkGroup(StripeReadState *stripeReadState);
+static uint32 SortedChunkSearch(ChunkData *chunkData, Form_pg_attribute attributeForm,
+								SortedSearchClause *searchClause, uint32 rowCount,
+								bool includeEqual);
+static bytea * StripeReadChunkRowMask(StripeReadState *stripeReadState,
+									  uint64 chunkFirstRowNumber, int rowCount);
+static void ConsumeChunkGroupPrefetch(StripeReadState *stripeReadState);
+static void DecompressChunkGroupConcurrently(StripeBuffers *stripeBuffers,
+											 uint64 chunkIndex, bool *columnMask,
+											 StripeReadState *state);
 static ChunkGroupReadState * BeginChunkGroupRead(StripeBuffers *stripeBuffers, int
 												 chunkIndex,
 												 TupleDesc tupleDesc,
 												 List *projectedColumnList,
-												 MemoryContext cxt, StripeReadState *state, uint64 stripeId);
+												 MemoryContext cxt, StripeReadState *state, uint64 stripeId,
+												 bool vectorRead);
 static void EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState);
 static bool ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState,
 								  Datum *columnValues,
@@ -152,14 +596,148 @@ static StripeBuffers * LoadFilteredStripeBuffers(Relation relation,
 												 List *whereClauseList,
 												 List *whereClauseVars,
 												 int64 *chunkGroupsFiltered,
-												 Snapshot snapshot);
+												 Snapshot snapshot,
+												 BufferAccessStrategy accessStrategy,
+												 uint32 firstChunkGroup,
+												 uint32 endChunkGroup,
+												 uint64 rowTarget,
+												 uint64 memoryLimit,
+												 uint32 *nextChunkGroup,
+												 ChunkGroupSummary *chunkGroupSummary,
+												 ColumnarChunkGroupDelete *chunkGroupDelete,
+												 ColumnarTopNBound *topNBound,
+												 ColumnarJoinKeyFilter *joinKeyFilter,
+												 ColumnarReadStatistics *statistics,
+												 StripeRescanCache *rescanCache,
+												 StripeStreamState **streamState);
+static void LoadStreamedChunkGroup(StripeReadState *stripeReadState,
+								   uint32 chunkIndex);
+static void FreeStreamedChunkGroup(StripeBuffers *stripeBuffers,
+								   StripeStreamState *streamState,
+								   uint32 chunkIndex);
+static void BeginRescanCache(ColumnarReadState *readState);
+static StripeRescanCache * ReadRescanCache(ColumnarReadState *readState);
+static StripeRescanCacheEntry * RescanCacheEntry(StripeRescanCache *rescanCache,
+												 Relation relation,
+												 StripeMetadata *stripeMetadata,
+												 TupleDesc tupleDescriptor,
+												 Snapshot snapshot,
+												 const bool *skipListColumnMask);
+static ColumnBuffers * LoadCachedColumnBuffers(Relation relation,
+											   StripeRescanCache *rescanCache,
+											   StripeRescanCacheEntry *cacheEntry,
+											   bool *selectedChunkMask,
+											   uint64 stripeOffset,
+											   Form_pg_attribute attributeForm,
+											   BufferAccessStrategy accessStrategy,
+											   ColumnarReadStatistics *statistics);
+static uint32 LimitSelectedChunkGroups(StripeSkipList *stripeSkipList,
+									   bool *selectedChunkMask,
+									   bool *projectedColumnMask,
+									   uint32 firstChunkGroup, uint32 endChunkGroup,
+									   uint64 rowTarget, uint64 memoryLimit);
+static StripePrefetchState * BeginStripePrefetch(Relation relation,
+												 StripeMetadata *stripeMetadata,
+												 StripeSkipList *selectedChunkSkipList,
+												 bool *projectedColumnMask,
+												 bool chunkGroupOrder);
+static void AddStripePrefetchRange(StripeReadRange *ranges, int *rangeCount,
+								   uint64 offset, uint64 length);
+static void AdvanceStripePrefetch(StripePrefetchState *prefetchState,
+								  uint64 bytesConsumed);
 static ColumnBuffers * LoadColumnBuffers(Relation relation,
 										 ColumnChunkSkipNode *chunkSkipNodeArray,
 										 uint32 chunkCount, uint64 stripeOffset,
-										 Form_pg_attribute attributeForm);
+										 Form_pg_attribute attributeForm,
+										 StripePrefetchState *prefetchState,
+										 BufferAccessStrategy accessStrategy,
+										 ColumnarReadStatistics *statistics);
+static void LoadColumnBuffersAsync(Relation relation,
+								   ColumnChunkSkipNode *chunkSkipNodeArray,
+								   uint32 chunkCount, uint64 stripeOffset,
+								   ColumnChunkBuffers **chunkBuffersArray,
+								   StripePrefetchState *prefetchState,
+								   BufferAccessStrategy accessStrategy,
+								   ColumnarReadStatistics *statistics);
 static bool * SelectedChunkMask(StripeSkipList *stripeSkipList,
 								List *whereClauseList, List *whereClauseVars,
 								int64 *chunkGroupsFiltered);
+static bool ChunkValuesAllNull(ColumnChunkSkipNode *chunkSkipNode);
+static bool ChunkValuesNoneNull(ColumnChunkSkipNode *chunkSkipNode);
+static uint32 SummarizeCoveredChunkGroups(StripeSkipList *stripeSkipList,
+										  bool *selectedChunkMask,
+										  uint32 firstChunkGroup, uint32 endChunkGroup,
+										  List *projectedColumnList,
+										  ChunkGroupSummary *summary);
+static bool ChunkGroupSummarizable(ChunkGroupSummary *summary,
+								   StripeSkipList *stripeSkipList, uint32 chunkIndex,
+								   List *projectedColumnList);
+static bool ChunkGroupCoveredByQuals(StripeSkipList *stripeSkipList, uint32 chunkIndex,
+									 List *qualList, List *qualVars,
+									 List *constraintList);
+static uint32 DeleteCoveredChunkGroups(Relation relation, StripeMetadata *stripeMetadata,
+									   StripeSkipList *stripeSkipList,
+									   bool *selectedChunkMask,
+									   uint32 firstChunkGroup, uint32 endChunkGroup,
+									   ColumnarChunkGroupDelete *chunkGroupDelete);
+static bool ChunkSkipNodeValueCount(ColumnChunkSkipNode *chunkSkipNode,
+									uint64 *valueCount);
+static void AddChunkGroupToSummary(ChunkGroupSummary *summary,
+								   StripeSkipList *stripeSkipList, uint32 chunkIndex,
+								   List *projectedColumnList);
+static void FilterChunksByBloomFilters(StripeSkipList *stripeSkipList,
+									   List *whereClauseList, bool *selectedChunkMask,
+									   int64 *chunkGroupsFiltered);
+static void FilterChunksByTopNBound(StripeSkipList *stripeSkipList,
+									ColumnarTopNBound *bound, bool *selectedChunkMask,
+									int64 *chunkGroupsFiltered);
+static void FilterChunksByShreddedKeys(StripeSkipList *stripeSkipList,
+									   List *whereClauseList, bool *selectedChunkMask,
+									   int64 *chunkGroupsFiltered);
+static bool ShreddedKeyClause(Node *clause, Var **column, char **key,
+							  StrategyNumber *strategy, text **constant);
+static bool BloomFilterClauseHashes(Node *clause, Var **column, uint64 **hashes,
+									uint32 *hashCount);
+static void FilterChunksByQualColumns(Relation relation,
+									  StripeMetadata *stripeMetadata,
+									  StripeSkipList *stripeSkipList,
+									  TupleDesc tupleDescriptor,
+									  bool *projectedColumnMask,
+									  List *whereClauseList, List *whereClauseVars,
+									  bool *selectedChunkMask,
+									  int64 *chunkGroupsFiltered,
+									  BufferAccessStrategy accessStrategy,
+									  ColumnarReadStatistics *statistics);
+static void FilterChunksByJoinKeys(Relation relation, StripeMetadata *stripeMetadata,
+								   StripeSkipList *stripeSkipList,
+								   TupleDesc tupleDescriptor,
+								   bool *projectedColumnMask,
+								   ColumnarJoinKeyFilter *joinKeyFilter,
+								   bool *selectedChunkMask,
+								   BufferAccessStrategy accessStrategy,
+								   ColumnarReadStatistics *statistics);
+static void LoadChunkColumnValues(Relation relation, StripeMetadata *stripeMetadata,
+								  StripeSkipList *stripeSkipList,
+								  Form_pg_attribute attributeForm, uint32 chunkIndex,
+								  StringInfo decompressionBuffer,
+								  BufferAccessStrategy accessStrategy,
+								  ColumnarReadStatistics *statistics,
+								  bool *existsArray, Datum *valueArray);
+static StringInfo LoadChunkColumnValueBuffer(Relation relation,
+											 StripeMetadata *stripeMetadata,
+											 StripeSkipList *stripeSkipList,
+											 Form_pg_attribute attributeForm,
+											 uint32 chunkIndex,
+											 StringInfo decompressionBuffer,
+											 BufferAccessStrategy accessStrategy,
+											 ColumnarReadStatistics *statistics,
+											 bool *existsArray);
+static bool EncodedChunkRowsPassQual(StringInfo valueBuffer,
+									 ValueEncodingType valueEncodingType,
+									 bool *existsArray, uint32 rowCount,
+									 Form_pg_attribute attributeForm,
+									 ExprState *qualState, ExprContext *econtext,
+									 bool *rowPassesArray);
 static Node * BuildBaseConstraint(Var *variable);
 static List * GetClauseVars(List *clauses, int natts);
 static OpExpr * MakeOpExpression(Var *variable, int16 strategyNumber);
@@ -170,30 +748,61 @@ static StripeSkipList * SelectedChunkSkipList(StripeSkipList *stripeSkipList,
 											  bool *selectedChunkMask);
 static uint32 StripeSkipListRowCount(StripeSkipList *stripeSkipList);
 static bool * ProjectedColumnMask(uint32 columnCount, List *projectedColumnList);
+static bool * SkipListColumnMask(uint32 columnCount, const bool *projectedColumnMask,
+								 List *whereClauseVars, ColumnarTopNBound *topNBound,
+								 ColumnarJoinKeyFilter *joinKeyFilter);
+static bool SkipListHasColumns(StripeSkipList *stripeSkipList, const bool *columnMask);
+static ChunkData * AcquireChunkDecodeBuffers(ChunkDecodeBuffers *decodeBuffers,
+											 uint32 columnCount,
+											 List *projectedColumnList, uint32 rowCount);
+static StringInfo DecompressChunkValueBuffer(ColumnChunkBuffers *chunkBuffers,
+											 StringInfo outputBuffer,
+											 ColumnarReadStatistics *statistics);
+static void DeserializeExistsArray(ColumnChunkBuffers *chunkBuffers, bool *existsArray,
+								   uint32 rowCount);
 static void DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
 								 uint32 boolArrayLength);
-static void DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray,
-								  uint32 datumCount, bool datumTypeByValue,
-								  int datumTypeLength, char datumTypeAlign,
-								  Datum *datumArray);
+static void DeserializeDatumArray(StringInfo datumBuffer,
+								  ValueEncodingType valueEncodingType,
+								  bool *existsArray, uint32 datumCount,
+								  bool datumTypeByValue, int datumTypeLength,
+								  char datumTypeAlign, Datum *datumArray);
+static void DeserializeByRefArray(char *data, uint32 datumStride, bool *existsArray,
+								  uint32 datumCount, Datum *datumArray);
+static void InsufficientDatumBufferError(uint64 offset, int bufferLength)
+pg_attribute_noreturn();
+static bool ChunkValuesCanStayPacked(ValueEncodingType valueEncodingType,
+									 Form_pg_attribute attributeForm);
+static uint32 CheckPackedDatumArray(StringInfo datumBuffer, bool *existsArray,
+									uint32 datumCount, int datumStride);
 static ChunkData * DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
 										uint32 rowCount, TupleDesc tupleDescriptor,
-										List *projectedColumnList, StripeReadState *state, uint64 stripeId);
+										List *projectedColumnList, StripeReadState *state, uint64 stripeId,
+										bool vectorRead);
+static void DeserializeChunkColumn(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+								   uint32 rowCount, TupleDesc tupleDescriptor,
+								   uint32 columnIndex, bool columnProjected,
+								   ChunkData *chunkData, StripeReadState *state,
+								   uint64 stripeId, bool vectorRead);
+static void ReadChunkLargeValues(StripeReadState *state, Form_pg_attribute attributeForm,
+								 bool *existsArray, uint32 rowCount, Datum *valueArray,
+								 bool vectorRead);
 static Datum ColumnDefaultValue(TupleConstr *tupleConstraints,
 								Form_pg_attribute attributeForm);
 
 /* Vectorization */
 static bool ReadStripeNextVector(StripeReadState *stripeReadState, Datum *columnValues,
-								 bool *columnNulls, int *newVectorSize,
+								 int maxVectorSize, int *newVectorSize,
 								 uint64 stripeId,
 								 Snapshot snapshot,
 								 uint64 *rowNumber,
-								 uint64 stripeFirstRowNumber);
+								 uint64 stripeFirstRowNumber,
+								 ColumnarVectorQual *vectorQual);
 static bool ReadChunkGroupNextVector(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
-									 bool *columnNulls, TupleDesc tupleDesc, 
-									 int32 *columnValueOffset, int *chunkReadRows,
+									 int maxVectorSize, int *chunkReadRows,
 									 uint64 *rowNumber,
-									 uint64 stripeFirstRowNumber);
+									 uint64 chunkFirstRowNumber,
+									 ColumnarVectorQual *vectorQual);
 
 /*
  * ColumnarBeginRead initializes a columnar read operation. This function returns a
@@ -220,11 +829,13 @@ ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 	readState->projectedColumnList = projectedColumnList;
 	readState->whereClauseList = whereClauseList;
 	readState->whereClauseVars = GetClauseVars(whereClauseList, tupleDescriptor->natts);
+	readState->allowedBucketsValid = false;
 	readState->chunkGroupsFiltered = 0;
 	readState->tupleDescriptor = tupleDescriptor;
 	readState->stripeReadContext = stripeReadContext;
 	readState->stripeReadState = NULL;
 	readState->scanContext = scanContext;
+	readState->decodeBuffers.context = scanContext;
 
 	/*
 	 * Note that ColumnarReadFlushPendingWrites might update those two by
@@ -235,6 +846,39 @@ ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 
 	/* Parallel execution */
 	readState->parallelColumnarScan = parallelColumnarScan;
+	readState->stripesPrunedByLeader = parallelColumnarScan != NULL &&
+									   parallelColumnarScan->stripeListPruned;
+
+	/*
+	 * Similar to initscan() in heapam.c, use a bulk-read buffer ring for
+	 * sequential scans of relations larger than a quarter of shared_buffers,
+	 * so a big analytic scan doesn't push everything else out of the cache.
+	 */
+	readState->accessStrategy = NULL;
+	if (!randomAccess && RelationGetNumberOfBlocks(relation) > NBuffers / 4)
+	{
+		readState->accessStrategy = GetAccessStrategy(BAS_BULKREAD);
+	}
+
+	/* random access readers look rows up in the delta store on demand */
+	readState->readDeltaStore = !randomAccess;
+	readState->deltaStoreExhausted = false;
+	readState->deltaStoreScan = NULL;
+	readState->deltaStoreRowContext = NULL;
+	readState->vectorQual = NULL;
+	readState->rowBound = 0;
+	readState->stripeFirstChunkGroup = 0;
+	readState->stripeEndChunkGroup = PG_UINT32_MAX;
+	readState->stripeRowTarget = 0;
+	readState->chunkGroupSummary = NULL;
+	readState->chunkGroupDelete = NULL;
+	readState->projectionSummary = NULL;
+	readState->topNBound = NULL;
+	readState->joinKeyFilter = NULL;
+	readState->hasStripeList = false;
+	readState->stripeList = NIL;
+	readState->stripeListIndex = 0;
+	readState->syncScan = false;
 
 	if (!randomAccess)
 	{
@@ -317,6 +961,136 @@ CreateStripeReadMemoryContext()
 }
 
 
+/*
+ * ReadStateMemoryLimit returns columnar.read_state_memory_limit in bytes.
+ */
+static uint64
+ReadStateMemoryLimit(void)
+{
+	return (uint64) columnar_read_state_memory_limit * 1024;
+}
+
+
+/*
+ * UpdateReadPeakMemory records the memory of the current stripe read in the
+ * peak of the read and in the peak of all reads of the backend. Called before
+ * stripeReadContext is reset, which is when it holds the most, as memory
+ * freed within a stripe read stays allocated to the context.
+ */
+static void
+UpdateReadPeakMemory(ColumnarReadState *readState)
+{
+	uint64 allocated = MemoryContextMemAllocated(readState->stripeReadContext, true);
+
+	readState->statistics.peakMemoryBytes =
+		Max(readState->statistics.peakMemoryBytes, allocated);
+	ReadStatePeakMemory = Max(ReadStatePeakMemory, allocated);
+}
+
+
+/*
+ * ColumnarReadStatePeakMemory returns the most memory a stripe read of this
+ * backend used since the last ColumnarResetReadStatePeakMemory.
+ */
+uint64
+ColumnarReadStatePeakMemory(void)
+{
+	return ReadStatePeakMemory;
+}
+
+
+/*
+ * ColumnarResetReadStatePeakMemory resets what ColumnarReadStatePeakMemory
+ * returns.
+ */
+void
+ColumnarResetReadStatePeakMemory(void)
+{
+	ReadStatePeakMemory = 0;
+}
+
+
+/*
+ * ColumnarSetStripeFloor makes the reads of the given relation skip its
+ * stripes with smaller ids than the given one, so they only read the rows
+ * of stripes written since, until it is called with InvalidOid. Reads of
+ * the delta store and reads by row number aren't affected.
+ */
+void
+ColumnarSetStripeFloor(Oid relationId, uint64 stripeId)
+{
+	StripeFloorRelationId = relationId;
+	StripeFloor = stripeId;
+}
+
+
+/*
+ * ColumnarSetStripeList makes a sequential read only read the given flushed
+ * stripes, in the order of the list, and only read the rows of the delta
+ * store after them if readDeltaStore is set. It must be called before the
+ * first row is read.
+ */
+void
+ColumnarSetStripeList(ColumnarReadState *readState, List *stripeList,
+					  bool readDeltaStore)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	ColumnarResetRead(readState);
+
+	readState->hasStripeList = true;
+	readState->stripeList = list_copy(stripeList);
+	readState->stripeListIndex = 0;
+	readState->readDeltaStore = readState->readDeltaStore && readDeltaStore;
+
+	/* set currentStripeMetadata for the first stripe of the list */
+	AdvanceStripeRead(readState);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarSetSyncScan synchronizes a sequential read of a large table with
+ * the other reads of the same columns of it, see columnar_sync_scan.c. Like
+ * heap, only tables larger than a quarter of shared_buffers are read this
+ * way, since for smaller ones the rows are likely to be cached anyway and
+ * the order they come in is kept. Has to be called before the first row is
+ * read.
+ */
+void
+ColumnarSetSyncScan(ColumnarReadState *readState)
+{
+	if (!columnar_enable_synchronized_scans || !synchronize_seqscans ||
+		!ColumnarSyncScanEnabled() ||
+		readState->parallelColumnarScan != NULL || readState->hasStripeList ||
+		readState->accessStrategy == NULL ||
+		RelationUsesLocalBuffers(readState->relation))
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	ColumnarResetRead(readState);
+
+	uint32 columnsHash = 0;
+	ListCell *lc;
+	foreach(lc, readState->projectedColumnList)
+	{
+		columnsHash = hash_combine(columnsHash, hash_uint32(lfirst_int(lc)));
+	}
+
+	readState->syncScan = true;
+	readState->syncScanColumnsHash = columnsHash;
+
+	/* set currentStripeMetadata for the stripe the other reads are at */
+	AdvanceStripeRead(readState);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 /*
  * ColumnarReadNextRow tries to read a row from the columnar table. On success, it sets
  * column values, column nulls and rowNumber (if passed to be non-NULL), and returns true.
@@ -332,7 +1106,8 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 		{
 			if (!HasUnreadStripe(readState))
 			{
-				return false;
+				return ReadNextDeltaStoreRow(readState, columnValues, columnNulls,
+											 rowNumber);
 			}
 
 			readState->stripeReadState = BeginStripeRead(readState->currentStripeMetadata,
@@ -342,7 +1117,19 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 														 readState->whereClauseList,
 														 readState->whereClauseVars,
 														 readState->stripeReadContext,
-														 readState->snapshot);
+														 readState->snapshot,
+														 readState->accessStrategy,
+														 readState->stripeFirstChunkGroup,
+														 readState->stripeEndChunkGroup,
+														 readState->stripeRowTarget,
+														 ReadStateMemoryLimit(),
+														 readState->chunkGroupSummary,
+														 readState->chunkGroupDelete,
+														 readState->topNBound,
+														 readState->joinKeyFilter,
+														 &readState->statistics,
+														 &readState->decodeBuffers,
+														 ReadRescanCache(readState));
 		}
 
 		if (!ReadStripeNextRow(readState->stripeReadState, columnValues, columnNulls,
@@ -361,6 +1148,7 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 						 readState->stripeReadState->chunkGroupReadState->currentRow  - 1;
 		}
 
+		readState->statistics.rowsRead++;
 		return true;
 	}
 
@@ -369,46 +1157,232 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 
 
 /*
- * ColumnarReadRowByRowNumberOrError is a wrapper around
- * ColumnarReadRowByRowNumber that throws an error if tuple
- * with rowNumber does not exist.
+ * ColumnarReadNextBatchedRow reads the next row like ColumnarReadNextRow, but
+ * decodes the rows a vector at a time with ColumnarReadNextVector and returns
+ * them from the vector, so that each column of a chunk group is copied out in
+ * one pass instead of one row at a time. Sequential scans that aren't done
+ * by the custom scan, index builds and table rewrites read their rows this
+ * way. Reads that RowBatchAllowed rules out read row by row instead.
  */
-void
-ColumnarReadRowByRowNumberOrError(ColumnarReadState *readState,
-								  uint64 rowNumber, Datum *columnValues,
-								  bool *columnNulls)
+bool
+ColumnarReadNextBatchedRow(ColumnarReadState *readState, Datum *columnValues,
+						   bool *columnNulls, uint64 *rowNumber)
 {
-	if (!ColumnarReadRowByRowNumber(readState, rowNumber,
-									columnValues, columnNulls))
+	while (readState->batchRowIndex >= readState->batchRowCount)
 	{
-		ereport(ERROR, (errmsg("cannot read from columnar table %s, tuple with "
-							   "row number " UINT64_FORMAT " does not exist",
-							   RelationGetRelationName(readState->relation),
-							   rowNumber)));
+		/*
+		 * Chunk groups are begun differently for vector and row reads, so the
+		 * way of reading only changes between stripes.
+		 */
+		if (!StripeReadInProgress(readState))
+		{
+			readState->batchRows = RowBatchAllowed(readState);
+		}
+
+		if (!readState->batchRows)
+		{
+			return ColumnarReadNextRow(readState, columnValues, columnNulls, rowNumber);
+		}
+
+		if (!FillRowBatch(readState, false))
+		{
+			return false;
+		}
 	}
+
+	ReadRowBatchNextRow(readState, columnValues, columnNulls, rowNumber);
+	return true;
 }
 
 
 /*
- * ColumnarReadRowByRowNumber reads row with rowNumber from given relation
- * into columnValues and columnNulls, and returns true. If no such row
- * exists, then returns false.
+ * RowBatchAllowed returns whether the sequential read may batch its rows.
+ * Vector quals drop the rows that fail them from vectors, and the clauses of
+ * the read may narrow chunk groups to the rows of a sorted range, which only
+ * the row reads do. Reads with a row bound are expected to stop early, before
+ * a vector would be used up.
  */
-bool
-ColumnarReadRowByRowNumber(ColumnarReadState *readState,
-						   uint64 rowNumber, Datum *columnValues,
-						   bool *columnNulls)
+static bool
+RowBatchAllowed(ColumnarReadState *readState)
 {
-	if (!ColumnarReadIsCurrentStripe(readState, rowNumber))
+	return readState->vectorQual == NULL &&
+		   readState->whereClauseList == NIL &&
+		   readState->rowBound == 0 &&
+		   RowBatchColumnsSupported(readState);
+}
+
+
+/*
+ * RowBatchColumnsSupported returns whether vectors can hold the values of all
+ * projected columns. Vectors store values of types up to 8 bytes long as they
+ * are passed by value, which types of other such lengths aren't.
+ */
+static bool
+RowBatchColumnsSupported(ColumnarReadState *readState)
+{
+	int attno;
+	foreach_int(attno, readState->projectedColumnList)
 	{
-		Relation columnarRelation = readState->relation;
-		Snapshot snapshot = readState->snapshot;
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(readState->tupleDescriptor, attno - 1);
+
+		if (attributeForm->attlen > 0 && attributeForm->attlen <= 8 &&
+			!attributeForm->attbyval)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * FillRowBatch decodes the next rows of the read into the batch, creating the
+ * batch slot on first use. With chunkGroupOnly, only the rest of the chunk
+ * group set by ColumnarReadSetChunkGroup is read. Returns false if there are
+ * no more rows.
+ */
+static bool
+FillRowBatch(ColumnarReadState *readState, bool chunkGroupOnly)
+{
+	if (readState->batchSlot == NULL)
+	{
+		Bitmapset *projectedColumns = NULL;
+
+		int attno;
+		foreach_int(attno, readState->projectedColumnList)
+		{
+			projectedColumns = bms_add_member(projectedColumns, attno - 1);
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+		readState->batchSlot =
+			CreateProjectedVectorTupleTableSlot(readState->tupleDescriptor,
+												projectedColumns);
+		MemoryContextSwitchTo(oldContext);
+
+		bms_free(projectedColumns);
+	}
+
+	VectorTupleTableSlot *batchSlot = (VectorTupleTableSlot *) readState->batchSlot;
+	int newVectorSize = 0;
+
+	CleanupVectorSlot(batchSlot);
+	readState->batchRowCount = 0;
+	readState->batchRowIndex = 0;
+
+	if (chunkGroupOnly)
+	{
+		StripeReadState *stripeReadState = readState->stripeReadState;
+		if (stripeReadState == NULL ||
+			!ReadStripeNextVector(stripeReadState, batchSlot->tts.tts_values,
+								  batchSlot->capacity, &newVectorSize,
+								  readState->currentStripeMetadata->id,
+								  readState->snapshot, batchSlot->rowNumber,
+								  readState->currentStripeMetadata->firstRowNumber,
+								  NULL))
+		{
+			return false;
+		}
+	}
+	else if (!ColumnarReadNextVector(readState, batchSlot->tts.tts_values,
+									 batchSlot->rowNumber, batchSlot->capacity,
+									 &newVectorSize))
+	{
+		return false;
+	}
+
+	batchSlot->dimension = newVectorSize;
+	readState->batchRowCount = newVectorSize;
+
+	return true;
+}
+
+
+/*
+ * ReadRowBatchNextRow sets columnValues and columnNulls to the next row of
+ * the batch, and rowNumber to its row number if it's not NULL. Values that
+ * aren't passed by value point into the vectors, or into the chunk group or
+ * delta store rows they were read from, and stay valid until the batch is
+ * filled again.
+ */
+static void
+ReadRowBatchNextRow(ColumnarReadState *readState, Datum *columnValues,
+					bool *columnNulls, uint64 *rowNumber)
+{
+	VectorTupleTableSlot *batchSlot = (VectorTupleTableSlot *) readState->batchSlot;
+	uint32 rowIndex = readState->batchRowIndex++;
+
+	memset(columnNulls, true, sizeof(bool) * readState->tupleDescriptor->natts);
+
+	int attno;
+	foreach_int(attno, readState->projectedColumnList)
+	{
+		/* attno is 1-indexed; columnValues is 0-indexed */
+		const uint32 columnIndex = attno - 1;
+
+		VectorColumn *column = (VectorColumn *) batchSlot->tts.tts_values[columnIndex];
+		if (column == NULL || column->isnull[rowIndex])
+		{
+			continue;
+		}
+
+		columnValues[columnIndex] =
+			fetch_att((int8 *) column->value + column->columnTypeLen * rowIndex,
+					  column->columnIsVal, column->columnTypeLen);
+		columnNulls[columnIndex] = false;
+	}
+
+	if (rowNumber)
+	{
+		*rowNumber = batchSlot->rowNumber[rowIndex];
+	}
+}
+
+
+/*
+ * ColumnarReadRowByRowNumberOrError is a wrapper around
+ * ColumnarReadRowByRowNumber that throws an error if tuple
+ * with rowNumber does not exist.
+ */
+void
+ColumnarReadRowByRowNumberOrError(ColumnarReadState *readState,
+								  uint64 rowNumber, Datum *columnValues,
+								  bool *columnNulls)
+{
+	if (!ColumnarReadRowByRowNumber(readState, rowNumber,
+									columnValues, columnNulls))
+	{
+		ereport(ERROR, (errmsg("cannot read from columnar table %s, tuple with "
+							   "row number " UINT64_FORMAT " does not exist",
+							   RelationGetRelationName(readState->relation),
+							   rowNumber)));
+	}
+}
+
+
+/*
+ * ColumnarReadRowByRowNumber reads row with rowNumber from given relation
+ * into columnValues and columnNulls, and returns true. If no such row
+ * exists, then returns false.
+ */
+bool
+ColumnarReadRowByRowNumber(ColumnarReadState *readState,
+						   uint64 rowNumber, Datum *columnValues,
+						   bool *columnNulls)
+{
+	if (!ColumnarReadIsCurrentStripe(readState, rowNumber))
+	{
+		Relation columnarRelation = readState->relation;
+		Snapshot snapshot = readState->snapshot;
 		StripeMetadata *stripeMetadata = FindStripeByRowNumber(columnarRelation,
 															   rowNumber, snapshot);
 		if (stripeMetadata == NULL)
 		{
-			/* no such row exists */
-			return false;
+			/* rows that are not in a stripe may still be in the delta store */
+			return ReadDeltaStoreRowByRowNumber(readState, rowNumber, columnValues,
+												columnNulls);
 		}
 
 		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
@@ -437,7 +1411,12 @@ ColumnarReadRowByRowNumber(ColumnarReadState *readState,
 													 whereClauseList,
 													 whereClauseVars,
 													 stripeReadContext,
-													 snapshot);
+													 snapshot,
+													 readState->accessStrategy,
+													 0, PG_UINT32_MAX, 0, 0, NULL, NULL, NULL,
+													 &readState->statistics,
+													 &readState->decodeBuffers,
+													 ReadRescanCache(readState));
 
 		readState->currentStripeMetadata = stripeMetadata;
 	}
@@ -445,6 +1424,80 @@ ColumnarReadRowByRowNumber(ColumnarReadState *readState,
 	return ReadStripeRowByRowNumber(readState, rowNumber, columnValues, columnNulls);
 }
 
+/*
+ * ColumnarReadSetRowNumbers makes ColumnarReadNextRowNumber return the rows
+ * with the given row numbers, which must be sorted, as the tids of bitmap
+ * heap scans are. The array must stay valid until those rows are read.
+ */
+void
+ColumnarReadSetRowNumbers(ColumnarReadState *readState, const uint64 *rowNumbers,
+						  uint32 rowNumberCount)
+{
+	readState->rowNumbers = rowNumbers;
+	readState->rowNumberCount = rowNumberCount;
+	readState->nextRowNumberIndex = 0;
+}
+
+
+/*
+ * ColumnarReadNextRowNumber reads the next row of those given to
+ * ColumnarReadSetRowNumbers that exists and is visible to the snapshot of the
+ * read, sets rowNumber to its row number and returns true. Returns false once
+ * the row numbers are exhausted.
+ *
+ * Unlike a loop of ColumnarReadRowByRowNumber calls after looking up the
+ * stripe of each row, we look up a stripe only when the rows move past the
+ * current one, and as the rows are sorted, each chunk group is decoded once
+ * for all the rows requested from it.
+ */
+bool
+ColumnarReadNextRowNumber(ColumnarReadState *readState, Datum *columnValues,
+						  bool *columnNulls, uint64 *rowNumber)
+{
+	while (readState->nextRowNumberIndex < readState->rowNumberCount)
+	{
+		uint64 nextRowNumber = readState->rowNumbers[readState->nextRowNumberIndex++];
+
+		if (!ColumnarReadIsCurrentStripe(readState, nextRowNumber))
+		{
+			StripeMetadata *stripeMetadata =
+				FindStripeWithMatchingFirstRowNumber(readState->relation, nextRowNumber,
+													 readState->snapshot);
+			StripeWriteStateEnum stripeWriteState =
+				stripeMetadata ? StripeWriteState(stripeMetadata) : STRIPE_WRITE_FLUSHED;
+
+			if (stripeWriteState == STRIPE_WRITE_IN_PROGRESS &&
+				stripeMetadata->insertedByCurrentXact &&
+				!readState->snapshotRegisteredByUs)
+			{
+				/* the index has our rows that aren't flushed yet */
+				ColumnarReadFlushPendingWrites(readState);
+			}
+			else if (stripeWriteState != STRIPE_WRITE_FLUSHED)
+			{
+				/* rows of stripes other transactions are writing aren't visible */
+				pfree(stripeMetadata);
+				continue;
+			}
+
+			if (stripeMetadata)
+			{
+				pfree(stripeMetadata);
+			}
+		}
+
+		if (ColumnarReadRowByRowNumber(readState, nextRowNumber, columnValues,
+									   columnNulls))
+		{
+			*rowNumber = nextRowNumber;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * ColumnarSetStripeReadState 
  */
@@ -491,7 +1544,12 @@ ColumnarSetStripeReadState(ColumnarReadState *readState,
 													 whereClauseList,
 													 whereClauseVars,
 													 stripeReadContext,
-													 snapshot);
+													 snapshot,
+													 readState->accessStrategy,
+													 0, PG_UINT32_MAX, 0, 0, NULL, NULL, NULL,
+													 &readState->statistics,
+													 &readState->decodeBuffers,
+													 ReadRescanCache(readState));
 
 		readState->currentStripeMetadata = stripeMetadata;
 	}
@@ -499,6 +1557,106 @@ ColumnarSetStripeReadState(ColumnarReadState *readState,
 	return true;
 }
 
+
+/*
+ * ColumnarReadSetChunkGroup sets the read up to return the rows of only the
+ * given chunk group of the given stripe, see ColumnarReadChunkGroupNextRow.
+ * The chunk group is expected to have rows that are not deleted.
+ */
+void
+ColumnarReadSetChunkGroup(ColumnarReadState *readState, StripeMetadata *stripeMetadata,
+						  uint32 chunkGroupIndex)
+{
+	ColumnarResetRead(readState);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+	StripeMetadata *currentStripeMetadata = palloc(sizeof(StripeMetadata));
+	*currentStripeMetadata = *stripeMetadata;
+	MemoryContextSwitchTo(oldContext);
+
+	List *whereClauseList = NIL;
+	List *whereClauseVars = NIL;
+	uint64 rowTarget = 0;
+	readState->stripeReadState = BeginStripeRead(currentStripeMetadata,
+												 readState->relation,
+												 readState->tupleDescriptor,
+												 readState->projectedColumnList,
+												 whereClauseList,
+												 whereClauseVars,
+												 readState->stripeReadContext,
+												 readState->snapshot,
+												 readState->accessStrategy,
+												 chunkGroupIndex, chunkGroupIndex + 1,
+												 rowTarget, 0, NULL, NULL, NULL,
+												 &readState->statistics,
+												 &readState->decodeBuffers,
+												 ReadRescanCache(readState));
+
+	readState->currentStripeMetadata = currentStripeMetadata;
+	readState->batchRows = RowBatchColumnsSupported(readState);
+}
+
+
+/*
+ * ColumnarReadChunkGroupNextRow reads the next row of the chunk group set by
+ * ColumnarReadSetChunkGroup, and returns false once its rows are exhausted.
+ * The rows are decoded a vector at a time, see ColumnarReadNextBatchedRow.
+ */
+bool
+ColumnarReadChunkGroupNextRow(ColumnarReadState *readState, Datum *columnValues,
+							  bool *columnNulls, uint64 *rowNumber)
+{
+	StripeReadState *stripeReadState = readState->stripeReadState;
+	if (stripeReadState == NULL || stripeReadState->chunkGroupIndex != 0)
+	{
+		return false;
+	}
+
+	if (readState->batchRows)
+	{
+		while (readState->batchRowIndex >= readState->batchRowCount)
+		{
+			if (!FillRowBatch(readState, true))
+			{
+				return false;
+			}
+		}
+
+		ReadRowBatchNextRow(readState, columnValues, columnNulls, rowNumber);
+		return true;
+	}
+
+	if (!ReadStripeNextRow(stripeReadState, columnValues, columnNulls,
+						   readState->currentStripeMetadata->firstRowNumber,
+						   readState->snapshot, readState->currentStripeMetadata->id) ||
+		stripeReadState->chunkGroupIndex != 0)
+	{
+		return false;
+	}
+
+	if (rowNumber)
+	{
+		*rowNumber = readState->currentStripeMetadata->firstRowNumber +
+					 stripeReadState->chunkGroupReadState->chunkStripeRowOffset +
+					 stripeReadState->chunkGroupReadState->currentRow - 1;
+	}
+
+	return true;
+}
+
+
+/*
+ * ColumnarReadDeltaStoreNextRow reads the next row of the delta store of the
+ * relation, leaving out the stripes. Only sequential reads can read the delta
+ * store this way.
+ */
+bool
+ColumnarReadDeltaStoreNextRow(ColumnarReadState *readState, Datum *columnValues,
+							  bool *columnNulls, uint64 *rowNumber)
+{
+	return ReadNextDeltaStoreRow(readState, columnValues, columnNulls, rowNumber);
+}
+
 /*
  * ColumnarReadIsCurrentStripe returns true if stripe being read contains
  * row with given rowNumber.
@@ -570,7 +1728,8 @@ ReadStripeRowByRowNumber(ColumnarReadState *readState,
 			stripeReadState->projectedColumnList,
 			stripeReadState->stripeReadContext,
 			stripeReadState,
-			readState->currentStripeMetadata->id
+			readState->currentStripeMetadata->id,
+			false
 			);
 
 		uint64 chunkFirstRowNumber = 
@@ -591,11 +1750,8 @@ ReadStripeRowByRowNumber(ColumnarReadState *readState,
 			else if (stripeReadState->chunkGroupReadState->chunkGroupDeletedRows > 0)
 			{
 				stripeReadState->chunkGroupReadState->rowMask =
-					ReadChunkRowMask(stripeReadState->relation->rd_node,
-										readState->snapshot,
-										stripeReadState->stripeReadContext,
-										chunkFirstRowNumber,
-										stripeReadState->chunkGroupReadState->rowCount);
+					StripeReadChunkRowMask(stripeReadState, chunkFirstRowNumber,
+										   stripeReadState->chunkGroupReadState->rowCount);
 				stripeReadState->chunkGroupReadState->rowMaskCached = false;
 			}
 		}
@@ -679,13 +1835,25 @@ ColumnarRescan(ColumnarReadState *readState, List *scanQual)
 	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
 
 	ColumnarResetRead(readState);
+	EndDeltaStoreRead(readState);
+	BeginRescanCache(readState);
+
+	/*
+	 * Update the clauses before choosing the first stripe, since the stripes
+	 * to skip depend on them.
+	 */
+	readState->whereClauseList = copyObject(scanQual);
+	readState->whereClauseVars = GetClauseVars(readState->whereClauseList,
+											   readState->tupleDescriptor->natts);
+	readState->allowedBucketsValid = false;
+	readState->stripesPrunedByLeader = readState->parallelColumnarScan != NULL &&
+									   readState->parallelColumnarScan->stripeListPruned;
 
 	/* set currentStripeMetadata for the first stripe to read */
 	AdvanceStripeRead(readState);
 
 	readState->chunkGroupsFiltered = 0;
 
-	readState->whereClauseList = copyObject(scanQual);
 	MemoryContextSwitchTo(oldContext);
 }
 
@@ -696,6 +1864,17 @@ ColumnarRescan(ColumnarReadState *readState, List *scanQual)
 void
 ColumnarEndRead(ColumnarReadState *readState)
 {
+	if (StripeReadInProgress(readState))
+	{
+		readState->statistics.chunkGroupsSkipped +=
+			readState->stripeReadState->chunkGroupsFiltered;
+	}
+
+	UpdateReadPeakMemory(readState);
+
+	ColumnarStatCountRead(RelationGetRelid(readState->relation),
+						  &readState->statistics);
+
 	if (readState->snapshotRegisteredByUs)
 	{
 		/*
@@ -706,11 +1885,39 @@ ColumnarEndRead(ColumnarReadState *readState)
 	}
 
 	MemoryContextDelete(readState->stripeReadContext);
+
+	if (readState->rescanCache.context != NULL)
+	{
+		MemoryContextDelete(readState->rescanCache.context);
+	}
+
+	FreeChunkData(readState->decodeBuffers.chunkData);
+	if (readState->decodeBuffers.columnMask != NULL)
+	{
+		pfree(readState->decodeBuffers.columnMask);
+	}
+
+	EndDeltaStoreRead(readState);
+	if (readState->deltaStoreRowContext)
+	{
+		MemoryContextDelete(readState->deltaStoreRowContext);
+	}
+
+	if (readState->accessStrategy)
+	{
+		FreeAccessStrategy(readState->accessStrategy);
+	}
+
 	if (readState->currentStripeMetadata)
 	{
 		pfree(readState->currentStripeMetadata);
 	}
 
+	if (readState->batchSlot)
+	{
+		ExecDropSingleTupleTableSlot(readState->batchSlot);
+	}
+
 	if (readState) {
 		pfree(readState);
 	}
@@ -724,11 +1931,15 @@ ColumnarEndRead(ColumnarReadState *readState)
 void
 ColumnarResetRead(ColumnarReadState *readState)
 {
+	readState->batchRowCount = 0;
+	readState->batchRowIndex = 0;
+
 	if (StripeReadInProgress(readState))
 	{
 		pfree(readState->currentStripeMetadata);
 		readState->currentStripeMetadata = NULL;
 
+		UpdateReadPeakMemory(readState);
 		readState->stripeReadState = NULL;
 		MemoryContextReset(readState->stripeReadContext);
 	}
@@ -736,1452 +1947,7061 @@ ColumnarResetRead(ColumnarReadState *readState)
 
 
 /*
- * BeginStripeRead allocates state for reading a stripe.
+ * NextDeltaStoreRowData returns the next delta store row of a sequential
+ * scan and sets *rowNumber to its row number, starting the delta store scan
+ * on the first call. Returns NULL when there are no more delta store rows.
  */
-static StripeReadState *
-BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDesc,
-				List *projectedColumnList, List *whereClauseList, List *whereClauseVars,
-				MemoryContext stripeReadContext, Snapshot snapshot)
+static bytea *
+NextDeltaStoreRowData(ColumnarReadState *readState, uint64 *rowNumber)
 {
-	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadContext);
+	if (!readState->readDeltaStore || readState->deltaStoreExhausted)
+	{
+		return NULL;
+	}
 
-	StripeReadState *stripeReadState = palloc0(sizeof(StripeReadState));
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
 
-	stripeReadState->relation = rel;
-	stripeReadState->tupleDescriptor = tupleDesc;
-	stripeReadState->columnCount = tupleDesc->natts;
-	stripeReadState->chunkGroupReadState = NULL;
-	stripeReadState->projectedColumnList = projectedColumnList;
-	stripeReadState->stripeReadContext = stripeReadContext;
+	if (readState->deltaStoreScan == NULL)
+	{
+		/* in parallel scans, only the first participant to claim it reads it */
+		ParallelColumnarScan parallelColumnarScan = readState->parallelColumnarScan;
+		if (parallelColumnarScan != NULL &&
+			pg_atomic_exchange_u32(&parallelColumnarScan->deltaStoreClaimed, 1) != 0)
+		{
+			readState->deltaStoreExhausted = true;
+			MemoryContextSwitchTo(oldContext);
+			return NULL;
+		}
 
-	stripeReadState->stripeBuffers = LoadFilteredStripeBuffers(rel,
-															   stripeMetadata,
-															   tupleDesc,
-															   projectedColumnList,
-															   whereClauseList,
-															   whereClauseVars,
-															   &stripeReadState->
-															   chunkGroupsFiltered,
-															   snapshot);
+		/*
+		 * Table rewrites scan with SnapshotAny, which would bring deleted
+		 * delta store rows back, so they read the rows visible to us instead.
+		 */
+		Snapshot snapshot = readState->snapshot;
+		if (!IsMVCCSnapshot(snapshot))
+		{
+			snapshot = SnapshotSelf;
+		}
 
-	stripeReadState->rowCount = stripeReadState->stripeBuffers->rowCount;
+		uint64 storageId = ColumnarStorageGetStorageId(readState->relation, false);
+		readState->deltaStoreScan = BeginDeltaStoreScan(storageId, snapshot);
+		if (readState->deltaStoreScan == NULL)
+		{
+			readState->deltaStoreExhausted = true;
+			MemoryContextSwitchTo(oldContext);
+			return NULL;
+		}
+	}
 
-	MemoryContextSwitchTo(oldContext);
+	bytea *rowData = DeltaStoreScanNext(readState->deltaStoreScan, rowNumber);
+	if (rowData == NULL)
+	{
+		EndDeltaStoreRead(readState);
+		readState->deltaStoreExhausted = true;
+	}
 
+	MemoryContextSwitchTo(oldContext);
 
-	return stripeReadState;
+	return rowData;
 }
 
 
 /*
- * AdvanceStripeRead updates chunkGroupsFiltered and sets
- * currentStripeMetadata for next stripe read.
+ * DeltaStoreRowContext returns the memory context for the delta store rows
+ * returned by the read state, after resetting it. The rows returned before
+ * are freed.
  */
-static void
-AdvanceStripeRead(ColumnarReadState *readState)
+static MemoryContext
+DeltaStoreRowContext(ColumnarReadState *readState)
 {
-	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
-
-	if (readState->parallelColumnarScan == 0)
+	if (readState->deltaStoreRowContext == NULL)
 	{
-		/* if not read any stripes yet, start from the first one .. */
-		uint64 lastReadRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
-		if (StripeReadInProgress(readState))
-		{
-			/* .. otherwise, continue with the next stripe */
-			lastReadRowNumber = StripeGetHighestRowNumber(readState->currentStripeMetadata);
-
-			readState->chunkGroupsFiltered +=
-				readState->stripeReadState->chunkGroupsFiltered;
-		}
-
-		readState->currentStripeMetadata = FindNextStripeByRowNumber(readState->relation,
-																	lastReadRowNumber,
-																	readState->snapshot);
+		readState->deltaStoreRowContext =
+			AllocSetContextCreate(readState->scanContext, "Delta Store Row Context",
+								  ALLOCSET_DEFAULT_SIZES);
 	}
 	else
 	{
-		if (StripeReadInProgress(readState))
-		{
-			readState->chunkGroupsFiltered +=
-				readState->stripeReadState->chunkGroupsFiltered;
-		}
-
-		SpinLockAcquire(&readState->parallelColumnarScan->mutex);
-
-		/* Fetch atomic next stripe id to be read by this scan. */
-		uint64 nextStripeId = 
-			pg_atomic_fetch_add_u64(&readState->parallelColumnarScan->nextStripeId, 1);
-
-		uint64 nextHigherStripeId = nextStripeId;
-
-		readState->currentStripeMetadata = FindNextStripeForParallelWorker(readState->relation,
-																		   readState->snapshot,
-																		   nextStripeId,
-																		   &nextHigherStripeId);
-
-		/* 
-		 * There exists higher stripe id than this one so adjust and 
-		 * add +1 for next workers.
-		 */
-		if (nextHigherStripeId != nextStripeId)
-		{
-			pg_atomic_write_u64(&readState->parallelColumnarScan->nextStripeId,
-								nextHigherStripeId + 1);
-		}
-
-		SpinLockRelease(&readState->parallelColumnarScan->mutex);
-	}
-
-	if (readState->currentStripeMetadata &&
-		StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED &&
-		!SnapshotMightSeeUnflushedStripes(readState->snapshot))
-	{
-		/*
-		 * To be on the safe side, error out if we don't expect to encounter
-		 * with an un-flushed stripe. Otherwise, we will skip such stripes
-		 * until finding a flushed one.
-		 */
-		ereport(ERROR, (errmsg(UNEXPECTED_STRIPE_READ_ERR_MSG,
-							   RelationGetRelationName(readState->relation),
-							   readState->currentStripeMetadata->id)));
-	}
-
-	while (readState->currentStripeMetadata &&
-		   StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED)
-	{
-		readState->currentStripeMetadata =
-			FindNextStripeByRowNumber(readState->relation,
-									  readState->currentStripeMetadata->firstRowNumber,
-									  readState->snapshot);
+		MemoryContextReset(readState->deltaStoreRowContext);
 	}
 
-	readState->stripeReadState = NULL;
-	MemoryContextReset(readState->stripeReadContext);
-
-	MemoryContextSwitchTo(oldContext);
+	return readState->deltaStoreRowContext;
 }
 
 
 /*
- * SnapshotMightSeeUnflushedStripes returns true if given snapshot is
- * expected to see un-flushed stripes either because of other backends'
- * pending writes or aborted transactions.
+ * ReadNextDeltaStoreRow reads the next delta store row of a sequential scan
+ * into columnValues and columnNulls. Returns false if there is none.
  */
 static bool
-SnapshotMightSeeUnflushedStripes(Snapshot snapshot)
+ReadNextDeltaStoreRow(ColumnarReadState *readState, Datum *columnValues,
+					  bool *columnNulls, uint64 *rowNumber)
 {
-	if (snapshot == InvalidSnapshot)
+	uint64 deltaRowNumber = 0;
+	bytea *rowData = NextDeltaStoreRowData(readState, &deltaRowNumber);
+	if (rowData == NULL)
 	{
 		return false;
 	}
 
-	switch (snapshot->snapshot_type)
-	{
-		case SNAPSHOT_ANY:
-		case SNAPSHOT_DIRTY:
-		case SNAPSHOT_NON_VACUUMABLE:
-		{
-			return true;
-		}
+	MemoryContext oldContext = MemoryContextSwitchTo(DeltaStoreRowContext(readState));
+	DeformDeltaStoreRow(rowData, RelationGetDescr(readState->relation),
+						columnValues, columnNulls);
+	MemoryContextSwitchTo(oldContext);
 
-		default:
-			return false;
+	pfree(rowData);
+
+	if (rowNumber)
+	{
+		*rowNumber = deltaRowNumber;
 	}
+
+	return true;
 }
 
 
 /*
- * ReadStripeNextRow: If more rows can be read from the current stripe, fill
- * in non-NULL columnValues and return true. Otherwise, return false.
- *
- * On entry, all entries in columnNulls should be true; this function only
- * sets non-NULL entries.
- *
+ * ReadNextDeltaStoreVector fills the projected columns of the vectors in
+ * columnValues with the next delta store rows of a sequential scan. Vectors
+ * with no row that passes the vector quals are dropped. Returns false if
+ * there are no more delta store rows.
  */
 static bool
-ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
-				  bool *columnNulls,
-				  uint64 stripeFirstRowNumber,
-				  Snapshot snapshot, uint64 stripeId)
+ReadNextDeltaStoreVector(ColumnarReadState *readState, Datum *columnValues,
+						 uint64 *rowNumber, int maxVectorSize, int *newVectorSize)
 {
-	if (stripeReadState->currentRow >= stripeReadState->rowCount)
-	{
-		Assert(stripeReadState->currentRow == stripeReadState->rowCount);
-		return false;
-	}
+	TupleDesc tupleDescriptor = RelationGetDescr(readState->relation);
+	ColumnarVectorQual *vectorQual = readState->vectorQual;
 
 	while (true)
 	{
-		if (stripeReadState->chunkGroupReadState == NULL)
+		MemoryContext rowContext = DeltaStoreRowContext(readState);
+
+		Datum *rowValues = MemoryContextAlloc(rowContext,
+											  tupleDescriptor->natts * sizeof(Datum));
+		bool *rowNulls = MemoryContextAlloc(rowContext,
+											tupleDescriptor->natts * sizeof(bool));
+
+		while (*newVectorSize < maxVectorSize)
 		{
-			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
-				stripeReadState->stripeBuffers,
-				stripeReadState->
-				chunkGroupIndex,
-				stripeReadState->
-				tupleDescriptor,
-				stripeReadState->
-				projectedColumnList,
-				stripeReadState->
-				stripeReadContext,
-				stripeReadState,
-				stripeId
-				);
-			
-			if (columnar_enable_dml &&
-				stripeReadState->chunkGroupReadState->chunkGroupDeletedRows != 0)
+			uint64 deltaRowNumber = 0;
+			bytea *rowData = NextDeltaStoreRowData(readState, &deltaRowNumber);
+			if (rowData == NULL)
 			{
-				uint64 chunkFirstRowNumber = 
-					stripeFirstRowNumber + 
-					stripeReadState->chunkGroupReadState->chunkStripeRowOffset;
-
-				stripeReadState->chunkGroupReadState->rowMask = 
-					ReadChunkRowMask(stripeReadState->relation->rd_node,
-									 snapshot,
-									 stripeReadState->stripeReadContext,
-									 chunkFirstRowNumber,
-									 stripeReadState->chunkGroupReadState->rowCount);
-				stripeReadState->chunkGroupReadState->rowMaskCached = false;
+				break;
 			}
-			else
+
+			/* varlena values of the vector point into the row, so it must stay */
+			MemoryContext oldContext = MemoryContextSwitchTo(rowContext);
+			DeformDeltaStoreRow(rowData, tupleDescriptor, rowValues, rowNulls);
+			MemoryContextSwitchTo(oldContext);
+
+			pfree(rowData);
+
+			int attno;
+			foreach_int(attno, readState->projectedColumnList)
 			{
-				stripeReadState->chunkGroupReadState->rowMask = NULL;
+				/* attno is 1-indexed; rowValues is 0-indexed */
+				const uint32 columnIndex = attno - 1;
+
+				VectorColumn *vectorColumn = (VectorColumn *) columnValues[columnIndex];
+
+				if (!rowNulls[columnIndex])
+				{
+					int8 *writeColumnRowPosition =
+						(int8 *) vectorColumn->value +
+						vectorColumn->columnTypeLen * vectorColumn->dimension;
+
+					if (vectorColumn->columnTypeLen <= 8)
+					{
+						store_att_byval(writeColumnRowPosition, rowValues[columnIndex],
+										vectorColumn->columnTypeLen);
+					}
+					else
+					{
+						memcpy(writeColumnRowPosition,
+							   DatumGetPointer(rowValues[columnIndex]),
+							   vectorColumn->columnTypeLen);
+					}
+
+					vectorColumn->isnull[vectorColumn->dimension] = false;
+				}
+
+				vectorColumn->dimension++;
 			}
+
+			rowNumber[*newVectorSize] = deltaRowNumber;
+			(*newVectorSize)++;
 		}
 
-		int32 deletedColumnsNumber = 0;
-		if (!ReadChunkGroupNextRow(stripeReadState->chunkGroupReadState, columnValues,
-								   columnNulls, &deletedColumnsNumber))
+		if (*newVectorSize == 0)
 		{
-			/* if this chunk group is exhausted, fetch the next one and loop */
+			return false;
+		}
 
-			stripeReadState->currentRow += deletedColumnsNumber;
+		if (vectorQual == NULL || DeltaStoreVectorPassesQual(vectorQual,
+															 *newVectorSize))
+		{
+			return true;
+		}
 
-			bool isStripeExhausted = stripeReadState->currentRow >= stripeReadState->rowCount;
+		int attno;
+		foreach_int(attno, readState->projectedColumnList)
+		{
+			ClearVectorColumn((VectorColumn *) columnValues[attno - 1]);
+		}
 
-			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
-			stripeReadState->chunkGroupReadState = NULL;
+		*newVectorSize = 0;
+	}
+}
 
-			if (isStripeExhausted)
-				return false;
 
-			stripeReadState->chunkGroupIndex++;
-				
-			continue;
-		}
+/*
+ * DeltaStoreVectorPassesQual evaluates all stages of the vector quals on a
+ * vector of delta store rows, and returns false if no row passes them.
+ */
+static bool
+DeltaStoreVectorPassesQual(ColumnarVectorQual *vectorQual, uint32 vectorSize)
+{
+	int stageCount = list_length(vectorQual->stageColumnLists);
 
-		stripeReadState->currentRow += 1 + deletedColumnsNumber;
-		return true;
+	for (int stage = 0; stage < stageCount; stage++)
+	{
+		if (vectorQual->qualFunc(vectorQual->qualState, stage, vectorSize) == 0)
+		{
+			return false;
+		}
 	}
 
-	Assert(stripeReadState->currentRow == stripeReadState->rowCount);
-	return false;
+	return true;
 }
 
 
 /*
- * BeginChunkGroupRead allocates state for reading a chunk.
+ * ReadDeltaStoreRowByRowNumber reads the delta store row with rowNumber into
+ * columnValues and columnNulls, and returns true. If the delta store has no
+ * such row, then returns false.
  */
-static ChunkGroupReadState *
-BeginChunkGroupRead(StripeBuffers *stripeBuffers, int chunkIndex, TupleDesc tupleDesc,
-					List *projectedColumnList, MemoryContext cxt, StripeReadState *state, uint64 stripeId)
+static bool
+ReadDeltaStoreRowByRowNumber(ColumnarReadState *readState, uint64 rowNumber,
+							 Datum *columnValues, bool *columnNulls)
 {
-	uint32 chunkGroupRowCount =
-		stripeBuffers->selectedChunkGroupRowCounts[chunkIndex];
-	uint32 chunkGroupRowOffset =
-		stripeBuffers->selectedChunkGroupRowOffset[chunkIndex];
-	uint32 chunkGroupDeletedRows =
-		stripeBuffers->selectedChunkGroupDeletedRows[chunkIndex];
-
-	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
-	ChunkGroupReadState *chunkGroupReadState = palloc0(sizeof(ChunkGroupReadState));
-
-	chunkGroupReadState->currentRow = 0;
-	chunkGroupReadState->rowCount = chunkGroupRowCount;
-	chunkGroupReadState->chunkStripeRowOffset = chunkGroupRowOffset;
-	chunkGroupReadState->chunkGroupDeletedRows = chunkGroupDeletedRows;
-	chunkGroupReadState->columnCount = tupleDesc->natts;
-	chunkGroupReadState->projectedColumnList = projectedColumnList;
+	uint64 storageId = ColumnarStorageGetStorageId(readState->relation, false);
+	bytea *rowData = ReadDeltaStoreRow(storageId, rowNumber, readState->snapshot);
+	if (rowData == NULL)
+	{
+		/* no such row exists */
+		return false;
+	}
 
-	chunkGroupReadState->chunkGroupData = DeserializeChunkData(stripeBuffers, chunkIndex,
-															   chunkGroupRowCount,
-															   tupleDesc,
-															   projectedColumnList, state, stripeId);
+	MemoryContext oldContext = MemoryContextSwitchTo(DeltaStoreRowContext(readState));
+	DeformDeltaStoreRow(rowData, RelationGetDescr(readState->relation),
+						columnValues, columnNulls);
 	MemoryContextSwitchTo(oldContext);
 
-	return chunkGroupReadState;
+	pfree(rowData);
+
+	return true;
 }
 
 
 /*
- * EndChunkRead finishes a chunk read.
+ * EndDeltaStoreRead ends the delta store scan of the read state, if any, so
+ * that the next sequential read starts it again.
  */
 static void
-EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState)
+EndDeltaStoreRead(ColumnarReadState *readState)
 {
-	FreeChunkBufferValueArray(chunkGroupReadState->chunkGroupData);
-	FreeChunkData(chunkGroupReadState->chunkGroupData);
-	if (chunkGroupReadState->rowMask != NULL && !chunkGroupReadState->rowMaskCached)
-		pfree(chunkGroupReadState->rowMask);
-	chunkGroupReadState->rowMask = NULL;
-	pfree(chunkGroupReadState);
+	if (readState->deltaStoreScan != NULL)
+	{
+		EndDeltaStoreScan(readState->deltaStoreScan);
+		readState->deltaStoreScan = NULL;
+	}
+
+	readState->deltaStoreExhausted = false;
 }
 
 
 /*
- * ReadChunkGroupNextRow: if more rows can be read from the current chunk
- * group, fill in non-NULL columnValues and return true. Otherwise, return
- * false.
- *
- * On entry, all entries in columnNulls should be true; this function only
- * sets non-NULL entries.
+ * BeginStripeRead allocates state for reading a stripe. Only the chunk groups
+ * from firstChunkGroup up to before endChunkGroup are loaded, and if rowTarget
+ * or memoryLimit isn't 0, only up to the chunk groups that hold rowTarget rows
+ * or about memoryLimit bytes of compressed data.
  */
-static bool
-ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
-					  bool *columnNulls, int32 *deletedColumnsNumber)
+static StripeReadState *
+BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDesc,
+				List *projectedColumnList, List *whereClauseList, List *whereClauseVars,
+				MemoryContext stripeReadContext, Snapshot snapshot,
+				BufferAccessStrategy accessStrategy, uint32 firstChunkGroup,
+				uint32 endChunkGroup, uint64 rowTarget, uint64 memoryLimit,
+				ChunkGroupSummary *chunkGroupSummary,
+				ColumnarChunkGroupDelete *chunkGroupDelete,
+				ColumnarTopNBound *topNBound,
+				ColumnarJoinKeyFilter *joinKeyFilter,
+				ColumnarReadStatistics *statistics,
+				ChunkDecodeBuffers *decodeBuffers,
+				StripeRescanCache *rescanCache)
 {
+	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadContext);
+
+	StripeReadState *stripeReadState = palloc0(sizeof(StripeReadState));
+
+	stripeReadState->relation = rel;
+	stripeReadState->tupleDescriptor = tupleDesc;
+	stripeReadState->columnCount = tupleDesc->natts;
+	stripeReadState->chunkGroupReadState = NULL;
+	stripeReadState->projectedColumnList = projectedColumnList;
+	stripeReadState->stripeReadContext = stripeReadContext;
+	stripeReadState->decompressionBufferArray =
+		palloc0(tupleDesc->natts * sizeof(StringInfo));
+	stripeReadState->statistics = statistics;
+	stripeReadState->decodeBuffers = decodeBuffers;
+	stripeReadState->rescanCache = rescanCache;
+	stripeReadState->stripeFirstRowNumber = stripeMetadata->firstRowNumber;
+	stripeReadState->stripeRowCount = stripeMetadata->rowCount;
+	stripeReadState->snapshot = snapshot;
+	stripeReadState->stripeFileOffset = stripeMetadata->fileOffset;
+	stripeReadState->largeValueContext = NULL;
+
+	if (columnar_enable_sorted_chunk_search)
+	{
+		stripeReadState->sortedSearchClauses = SortedSearchClauses(whereClauseList,
+																   tupleDesc,
+																   projectedColumnList);
+	}
+
 	/*
-	 * Initialize to all-NULL. Only non-NULL projected attributes will be set.
+	 * Reads continuing with the rest of a stripe, or with the part of it that
+	 * a parallel scan gave to this participant, don't read another stripe.
 	 */
-	memset(columnNulls, true, sizeof(bool) * chunkGroupReadState->columnCount);
+	if (firstChunkGroup == 0)
+	{
+		statistics->stripesRead++;
+	}
 
-	while (chunkGroupReadState->currentRow < chunkGroupReadState->rowCount)
+	if (columnar_enable_page_cache)
 	{
-		if (chunkGroupReadState->rowMask != NULL)
+		if (ColumnarSharedCacheEnabled())
 		{
-			int8 checkColumnMask = 1 << (chunkGroupReadState->currentRow % 8);
-			int8 checkLookupMask = VARDATA(chunkGroupReadState->rowMask)[chunkGroupReadState->currentRow / 8 ];
-
-			if (checkLookupMask & checkColumnMask)
-			{
-				chunkGroupReadState->currentRow++;
-				*deletedColumnsNumber += 1;
-				continue;
-			}
+			stripeReadState->storageId = ColumnarStorageGetStorageId(rel, false);
 		}
 
-		int attno;
-		foreach_int(attno, chunkGroupReadState->projectedColumnList)
+		ColumnarOptions options = { 0 };
+		if (ReadColumnarOptions(rel->rd_id, &options))
 		{
-			const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
-			const int rowIndex = chunkGroupReadState->currentRow;
-
-			/* attno is 1-indexed; existsArray is 0-indexed */
-			const uint32 columnIndex = attno - 1;
-
-			if (chunkGroupData->existsArray[columnIndex][rowIndex])
-			{
-				columnValues[columnIndex] = chunkGroupData->valueArray[columnIndex][rowIndex];
-				columnNulls[columnIndex] = false;
-			}
+			stripeReadState->cacheQuota = options.cacheQuota;
 		}
 
-		chunkGroupReadState->currentRow++;
-		return true;
+		stripeReadState->cacheAdmissionDisabled =
+			columnar_column_cache_bypass_large_scans && accessStrategy != NULL;
 	}
 
-	return false;
+	stripeReadState->stripeBuffers = LoadFilteredStripeBuffers(rel,
+															   stripeMetadata,
+															   tupleDesc,
+															   projectedColumnList,
+															   whereClauseList,
+															   whereClauseVars,
+															   &stripeReadState->
+															   chunkGroupsFiltered,
+															   snapshot,
+															   accessStrategy,
+															   firstChunkGroup,
+															   endChunkGroup,
+															   rowTarget,
+															   memoryLimit,
+															   &stripeReadState->
+															   nextChunkGroup,
+															   chunkGroupSummary,
+															   chunkGroupDelete,
+															   topNBound,
+															   joinKeyFilter,
+															   statistics,
+															   rescanCache,
+															   &stripeReadState->
+															   streamState);
 
-}
+	stripeReadState->rowCount = stripeReadState->stripeBuffers->rowCount;
 
+	MemoryContextSwitchTo(oldContext);
 
-/*
- * ColumnarReadChunkGroupsFiltered
- *
- * Return the number of chunk groups filtered during this read operation.
- */
-int64
-ColumnarReadChunkGroupsFiltered(ColumnarReadState *state)
-{
-	return state->chunkGroupsFiltered;
+
+	return stripeReadState;
 }
 
 
 /*
- * CreateEmptyChunkDataArray creates data buffers to keep deserialized exist and
- * value arrays for requested columns in columnMask.
+ * AdvanceStripeRead updates chunkGroupsFiltered and sets
+ * currentStripeMetadata for next stripe read. Stripes whose column
+ * summaries refute the pushed down clauses are skipped. If a read with a row
+ * bound didn't load all chunk groups of the current stripe, the next read
+ * continues with the rest of the stripe instead.
  */
-ChunkData *
-CreateEmptyChunkData(uint32 columnCount, bool *columnMask, uint32 chunkGroupRowCount)
+static void
+AdvanceStripeRead(ColumnarReadState *readState)
 {
-	uint32 columnIndex = 0;
-
-	ChunkData *chunkData = palloc0(sizeof(ChunkData));
-	chunkData->existsArray = palloc0(columnCount * sizeof(bool *));
-	chunkData->valueArray = palloc0(columnCount * sizeof(Datum *));
-	chunkData->valueBufferArray = palloc0(columnCount * sizeof(StringInfo));
-	chunkData->columnCount = columnCount;
-	chunkData->rowCount = chunkGroupRowCount;
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
 
-	/* allocate chunk memory for deserialized data */
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	/* if not read any stripes yet, start from the first one .. */
+	StripeMetadata *lastStripeMetadata = NULL;
+	if (StripeReadInProgress(readState))
 	{
-		if (columnMask[columnIndex])
+		/* .. otherwise, continue with the next stripe */
+		lastStripeMetadata = readState->currentStripeMetadata;
+
+		readState->chunkGroupsFiltered +=
+			readState->stripeReadState->chunkGroupsFiltered;
+		readState->statistics.chunkGroupsSkipped +=
+			readState->stripeReadState->chunkGroupsFiltered;
+
+		/*
+		 * The row bound didn't cover the rows that the scan needed, so load
+		 * the next chunk groups of the stripe, twice as many rows each time.
+		 */
+		uint32 nextChunkGroup = readState->stripeReadState->nextChunkGroup;
+		if (nextChunkGroup < lastStripeMetadata->chunkCount &&
+			nextChunkGroup < readState->stripeEndChunkGroup)
 		{
-			chunkData->existsArray[columnIndex] = palloc0(chunkGroupRowCount *
-														  sizeof(bool));
-			chunkData->valueArray[columnIndex] = palloc0(chunkGroupRowCount *
-														 sizeof(Datum));
-			chunkData->valueBufferArray[columnIndex] = NULL;
+			readState->stripeFirstChunkGroup = nextChunkGroup;
+			readState->stripeRowTarget *= 2;
+
+			UpdateReadPeakMemory(readState);
+			readState->stripeReadState = NULL;
+			MemoryContextReset(readState->stripeReadContext);
+
+			MemoryContextSwitchTo(oldContext);
+			return;
 		}
 	}
 
-	return chunkData;
-}
+	readState->stripeFirstChunkGroup = 0;
+	readState->stripeEndChunkGroup = PG_UINT32_MAX;
+	readState->stripeRowTarget = readState->rowBound;
 
+	readState->currentStripeMetadata = FindNextStripeToRead(readState,
+															lastStripeMetadata);
 
-/*
- * FreeChunkData deallocates data buffers to keep deserialized exist and
- * value arrays for requested columns in columnMask.
- * ColumnChunkData->serializedValueBuffer lives in memory read/write context
- * so it is deallocated automatically when the context is deleted.
- */
-void
-FreeChunkData(ChunkData *chunkData)
-{
-	uint32 columnIndex = 0;
+	SkipStripesNotToRead(readState);
 
-	if (chunkData == NULL)
+	if (readState->syncScan && readState->currentStripeMetadata != NULL)
 	{
-		return;
+		ColumnarSyncScanReportLocation(readState->relation,
+									   readState->syncScanColumnsHash,
+									   readState->currentStripeMetadata->firstRowNumber);
 	}
 
-	for (columnIndex = 0; columnIndex < chunkData->columnCount; columnIndex++)
-	{
-		if (chunkData->existsArray[columnIndex] != NULL)
-		{
-			pfree(chunkData->existsArray[columnIndex]);
-		}
-
-		if (chunkData->valueArray[columnIndex] != NULL)
-		{
-			pfree(chunkData->valueArray[columnIndex]);
-		}
-	}
+	UpdateReadPeakMemory(readState);
+	readState->stripeReadState = NULL;
+	MemoryContextReset(readState->stripeReadContext);
 
-	pfree(chunkData->existsArray);
-	pfree(chunkData->valueArray);
-	pfree(chunkData);
+	MemoryContextSwitchTo(oldContext);
 }
 
 
-/* FreeChunkValueArrayBuffer relase valueBufferArray memory. */
-void FreeChunkBufferValueArray(ChunkData *chunkData)
+/*
+ * SkipStripesNotToRead moves currentStripeMetadata past the stripes that
+ * aren't flushed, the stripes below the stripe floor, the stripes whose
+ * summaries refute the pushed down clauses, and the stripes whose
+ * projection answers the aggregate above the scan.
+ */
+static void
+SkipStripesNotToRead(ColumnarReadState *readState)
 {
-	uint32 columnIndex = 0;
-
-	if (chunkData == NULL)
+	while (true)
 	{
-		return;
-	}
+		if (readState->currentStripeMetadata &&
+			StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED &&
+			!SnapshotMightSeeUnflushedStripes(readState->snapshot))
+		{
+			/*
+			 * To be on the safe side, error out if we don't expect to encounter
+			 * with an un-flushed stripe. Otherwise, we will skip such stripes
+			 * until finding a flushed one.
+			 */
+			ereport(ERROR, (errmsg(UNEXPECTED_STRIPE_READ_ERR_MSG,
+								   RelationGetRelationName(readState->relation),
+								   readState->currentStripeMetadata->id)));
+		}
 
-	for (columnIndex = 0; columnIndex < chunkData->columnCount; columnIndex++)
-	{
-		if (chunkData->valueBufferArray[columnIndex] != NULL && !MemoryContextContains(ColumnarCacheMemoryContext(), chunkData->valueBufferArray[columnIndex]))
+		while (readState->currentStripeMetadata &&
+			   StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED)
 		{
-			pfree(chunkData->valueBufferArray[columnIndex]->data);
-			pfree(chunkData->valueBufferArray[columnIndex]);
+			readState->currentStripeMetadata =
+				FindNextSerialStripe(readState,
+									 readState->currentStripeMetadata->firstRowNumber);
 		}
-	}
-}
 
+		if (readState->currentStripeMetadata == NULL)
+		{
+			break;
+		}
 
-/* ColumnarTableRowCount returns the exact row count of a table using skiplists */
-uint64
-ColumnarTableRowCount(Relation relation)
-{
-	ListCell *stripeMetadataCell = NULL;
-	uint64 totalRowCount = 0;
-	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+		if (OidIsValid(StripeFloorRelationId) &&
+			RelationGetRelid(readState->relation) == StripeFloorRelationId &&
+			readState->currentStripeMetadata->id < StripeFloor)
+		{
+			/* the caller only wants the stripes written since the floor */
+		}
+		else if (StripeRefutedBySummary(readState, readState->currentStripeMetadata))
+		{
+			/* none of the chunk groups of this stripe, or of our part of it, can match */
+			uint32 chunkCount = readState->currentStripeMetadata->chunkCount;
+			uint32 refutedChunkGroups = Min(chunkCount, readState->stripeEndChunkGroup) -
+										readState->stripeFirstChunkGroup;
+			readState->chunkGroupsFiltered += refutedChunkGroups;
+			readState->statistics.chunkGroupsSkipped += refutedChunkGroups;
+			if (readState->stripeFirstChunkGroup == 0)
+			{
+				readState->statistics.stripesSkipped++;
+			}
+		}
+		else if (!StripeAnsweredByProjection(readState,
+											 readState->currentStripeMetadata))
+		{
+			break;
+		}
 
-	foreach(stripeMetadataCell, stripeList)
-	{
-		StripeMetadata *stripeMetadata = (StripeMetadata *) lfirst(stripeMetadataCell);
-		totalRowCount += stripeMetadata->rowCount;
-	}
+		readState->stripeFirstChunkGroup = 0;
+		readState->stripeEndChunkGroup = PG_UINT32_MAX;
 
-	return totalRowCount;
+		readState->currentStripeMetadata =
+			FindNextStripeToRead(readState, readState->currentStripeMetadata);
+	}
 }
 
 
 /*
- * LoadFilteredStripeBuffers reads serialized stripe data from the given file.
- * The function skips over chunks whose rows are refuted by restriction qualifiers,
- * and only loads columns that are projected in the query.
+ * StripeAnsweredByProjection returns whether the groups of the projection of
+ * the given stripe were added to the projection summary of the read, so the
+ * stripe doesn't need to be read. Only whole stripes without deleted rows
+ * are answered, and only by non-parallel reads.
  */
-static StripeBuffers *
-LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
-						  TupleDesc tupleDescriptor, List *projectedColumnList,
-						  List *whereClauseList, List *whereClauseVars,
-						  int64 *chunkGroupsFiltered, Snapshot snapshot)
+static bool
+StripeAnsweredByProjection(ColumnarReadState *readState, StripeMetadata *stripeMetadata)
 {
-	uint32 columnIndex = 0;
-	uint32 columnCount = tupleDescriptor->natts;
-
-	bool *projectedColumnMask = ProjectedColumnMask(columnCount, projectedColumnList);
-
-	StripeSkipList *stripeSkipList = ReadStripeSkipList(relation->rd_node,
-														stripeMetadata->id,
-														tupleDescriptor,
-														stripeMetadata->chunkCount,
-														snapshot);
-
-	bool *selectedChunkMask = SelectedChunkMask(stripeSkipList, whereClauseList,
-												whereClauseVars, chunkGroupsFiltered);
-
-	StripeSkipList *selectedChunkSkipList =
-		SelectedChunkSkipList(stripeSkipList, projectedColumnMask,
-							  selectedChunkMask);
-
-	/* load column data for projected columns */
-	ColumnBuffers **columnBuffersArray = palloc0(columnCount * sizeof(ColumnBuffers *));
-
-	for (columnIndex = 0; columnIndex < stripeMetadata->columnCount; columnIndex++)
+	if (readState->projectionSummary == NULL ||
+		readState->parallelColumnarScan != NULL ||
+		readState->stripeFirstChunkGroup != 0)
 	{
-		if (projectedColumnMask[columnIndex])
-		{
-			ColumnChunkSkipNode *chunkSkipNode =
-				selectedChunkSkipList->chunkSkipNodeArray[columnIndex];
-			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
-			uint32 chunkCount = selectedChunkSkipList->chunkCount;
+		return false;
+	}
 
-			ColumnBuffers *columnBuffers = LoadColumnBuffers(relation, chunkSkipNode,
-															 chunkCount,
-															 stripeMetadata->fileOffset,
-															 attributeForm);
+	/* stripeReadContext is reset by AdvanceStripeRead once we are done */
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->stripeReadContext);
 
-			columnBuffersArray[columnIndex] = columnBuffers;
-		}
+	bool stripeAnswered = false;
+	bytea *serializedProjection = ReadStripeProjection(readState->relation->rd_node,
+													   stripeMetadata->id,
+													   readState->snapshot);
+	if (serializedProjection != NULL &&
+		!StripeHasDeletedRows(readState->relation->rd_node, stripeMetadata,
+							  readState->snapshot))
+	{
+		StripeProjection *projection = DeserializeStripeProjection(serializedProjection);
+		stripeAnswered = AddStripeProjectionToSummary(readState->projectionSummary,
+													  projection);
 	}
 
-	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
-	stripeBuffers->columnCount = columnCount;
-	stripeBuffers->rowCount = StripeSkipListRowCount(selectedChunkSkipList);
-	stripeBuffers->columnBuffersArray = columnBuffersArray;
-	stripeBuffers->selectedChunkGroupRowCounts =
-		selectedChunkSkipList->chunkGroupRowCounts;
-	stripeBuffers->selectedChunkGroupRowOffset =
-		selectedChunkSkipList->chunkGroupRowOffset;
-	stripeBuffers->selectedChunkGroupDeletedRows =
-		selectedChunkSkipList->chunkGroupDeletedRows;
-	
+	MemoryContextSwitchTo(oldContext);
 
-	return stripeBuffers;
+	return stripeAnswered;
 }
 
 
 /*
- * LoadColumnBuffers reads serialized column data from the given file. These
- * column data are laid out as sequential chunks in the file; and chunk positions
- * and lengths are retrieved from the column chunk skip node array.
+ * AddStripeProjectionToSummary adds the groups of a stripe projection that
+ * pass the quals of the summary to it, and returns true, if the projection
+ * has the columns the summary needs and tells which groups pass the quals.
+ * A group passes if its values of the columns the quals reference imply
+ * the quals, and is left out if they refute them. If neither can be proven,
+ * none of the groups are added. Counts of group by columns are the number of
+ * rows of the groups where they aren't NULL.
  */
-static ColumnBuffers *
-LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
-				  uint32 chunkCount, uint64 stripeOffset,
-				  Form_pg_attribute attributeForm)
+static bool
+AddStripeProjectionToSummary(StripeProjectionSummary *summary,
+							 StripeProjection *projection)
 {
-	uint32 chunkIndex = 0;
-	ColumnChunkBuffers **chunkBuffersArray =
-		palloc0(chunkCount * sizeof(ColumnChunkBuffers *));
-
-	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
-	{
-		chunkBuffersArray[chunkIndex] = palloc0(sizeof(ColumnChunkBuffers));
-	}
-
-	/*
-	 * We first read the "exists" chunks. We don't read "values" array here,
-	 * because "exists" chunks are stored sequentially on disk, and we want to
-	 * minimize disk seeks.
-	 */
-	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	int groupKeyIndexes[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+	for (int groupIndex = 0; groupIndex < summary->groupCount; groupIndex++)
 	{
-		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
-		uint64 existsOffset = stripeOffset + chunkSkipNode->existsChunkOffset;
-		StringInfo rawExistsBuffer = makeStringInfo();
-
-		enlargeStringInfo(rawExistsBuffer, chunkSkipNode->existsLength);
-		rawExistsBuffer->len = chunkSkipNode->existsLength;
-		ColumnarStorageRead(relation, existsOffset, rawExistsBuffer->data,
-							chunkSkipNode->existsLength);
+		groupKeyIndexes[groupIndex] = -1;
+		for (int keyIndex = 0; keyIndex < projection->keyCount; keyIndex++)
+		{
+			if (projection->keyAttnums[keyIndex] == summary->groupAttnums[groupIndex])
+			{
+				groupKeyIndexes[groupIndex] = keyIndex;
+			}
+		}
 
-		chunkBuffersArray[chunkIndex]->existsBuffer = rawExistsBuffer;
+		if (groupKeyIndexes[groupIndex] < 0)
+		{
+			return false;
+		}
 	}
 
-	/* then read "values" chunks, which are also stored sequentially on disk */
-	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	/* sums come from sum columns, counts of group by columns from the row counts */
+	int *measureSumIndexes = palloc(summary->measureCount * sizeof(int));
+	int *measureKeyIndexes = palloc(summary->measureCount * sizeof(int));
+	for (int measureIndex = 0; measureIndex < summary->measureCount; measureIndex++)
 	{
-		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
-		CompressionType compressionType = chunkSkipNode->valueCompressionType;
-		uint64 valueOffset = stripeOffset + chunkSkipNode->valueChunkOffset;
-		StringInfo rawValueBuffer = makeStringInfo();
+		AttrNumber attnum = summary->measureAttnums[measureIndex];
 
-		enlargeStringInfo(rawValueBuffer, chunkSkipNode->valueLength);
-		rawValueBuffer->len = chunkSkipNode->valueLength;
-		ColumnarStorageRead(relation, valueOffset, rawValueBuffer->data,
-							chunkSkipNode->valueLength);
+		measureSumIndexes[measureIndex] = -1;
+		measureKeyIndexes[measureIndex] = -1;
+		for (int sumIndex = 0; sumIndex < projection->sumCount; sumIndex++)
+		{
+			if (projection->sumAttnums[sumIndex] == attnum)
+			{
+				measureSumIndexes[measureIndex] = sumIndex;
+			}
+		}
 
-		chunkBuffersArray[chunkIndex]->valueBuffer = rawValueBuffer;
-		chunkBuffersArray[chunkIndex]->valueCompressionType = compressionType;
-		chunkBuffersArray[chunkIndex]->decompressedValueSize =
-			chunkSkipNode->decompressedValueSize;
+		for (int keyIndex = 0; keyIndex < projection->keyCount; keyIndex++)
+		{
+			if (projection->keyAttnums[keyIndex] == attnum)
+			{
+				measureKeyIndexes[measureIndex] = keyIndex;
+			}
+		}
+
+		if (measureSumIndexes[measureIndex] < 0 &&
+			(measureKeyIndexes[measureIndex] < 0 ||
+			 bms_is_member(attnum, summary->sumColumns)))
+		{
+			return false;
+		}
 	}
 
-	ColumnBuffers *columnBuffers = palloc0(sizeof(ColumnBuffers));
-	columnBuffers->chunkBuffersArray = chunkBuffersArray;
+	/* a value of each column the quals reference, or IS NULL if there is none */
+	List *valueConstraints = NIL;
+	List *nullConstraints = NIL;
+	int *qualKeyIndexes = palloc(list_length(summary->qualVars) * sizeof(int));
+	int qualVarIndex = 0;
 
-	return columnBuffers;
-}
+	Var *column = NULL;
+	foreach_ptr(column, summary->qualVars)
+	{
+		qualKeyIndexes[qualVarIndex] = -1;
+		for (int keyIndex = 0; keyIndex < projection->keyCount; keyIndex++)
+		{
+			if (projection->keyAttnums[keyIndex] == column->varattno)
+			{
+				qualKeyIndexes[qualVarIndex] = keyIndex;
+			}
+		}
 
+		if (qualKeyIndexes[qualVarIndex] < 0 ||
+			GetFunctionInfoOrNull(column->vartype, BTREE_AM_OID, BTORDER_PROC) == NULL)
+		{
+			return false;
+		}
 
-/*
- * SelectedChunkMask walks over each column's chunks and checks if a chunk can
- * be filtered without reading its data. The filtering happens when all rows in
- * the chunk can be refuted by the given qualifier conditions.
- */
-static bool *
-SelectedChunkMask(StripeSkipList *stripeSkipList, List *whereClauseList,
-				  List *whereClauseVars, int64 *chunkGroupsFiltered)
-{
-	ListCell *columnCell = NULL;
-	uint32 chunkIndex = 0;
+		NullTest *nullTest = makeNode(NullTest);
+		nullTest->arg = (Expr *) column;
+		nullTest->nulltesttype = IS_NULL;
+		nullTest->argisrow = false;
+		nullTest->location = -1;
 
-	bool *selectedChunkMask = palloc0(stripeSkipList->chunkCount * sizeof(bool));
-	memset(selectedChunkMask, true, stripeSkipList->chunkCount * sizeof(bool));
+		valueConstraints = lappend(valueConstraints,
+								   MakeOpExpression(column, BTEqualStrategyNumber));
+		nullConstraints = lappend(nullConstraints, nullTest);
+		qualVarIndex++;
+	}
 
-	foreach(columnCell, whereClauseVars)
+	bool *groupPasses = palloc(Max(projection->groupCount, 1) * sizeof(bool));
+	for (uint32 groupIndex = 0; groupIndex < projection->groupCount; groupIndex++)
 	{
-		Var *column = lfirst(columnCell);
-		uint32 columnIndex = column->varattno - 1;
+		StripeProjectionGroup *group = projection->groups[groupIndex];
 
-		/* if this column's data type doesn't have a comparator, skip it */
-		FmgrInfo *comparisonFunction = GetFunctionInfoOrNull(column->vartype,
-															 BTREE_AM_OID,
-															 BTORDER_PROC);
-		if (comparisonFunction == NULL)
+		groupPasses[groupIndex] = true;
+		if (summary->qualList == NIL)
 		{
 			continue;
 		}
 
-		Node *baseConstraint = BuildBaseConstraint(column);
-		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		List *constraintList = NIL;
+		for (qualVarIndex = 0; qualVarIndex < list_length(summary->qualVars);
+			 qualVarIndex++)
 		{
-			ColumnChunkSkipNode *chunkSkipNodeArray =
-				stripeSkipList->chunkSkipNodeArray[columnIndex];
-			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
-
-			/*
-			 * A column chunk with comparable data type can miss min/max values
-			 * if all values in the chunk are NULL.
-			 */
-			if (!chunkSkipNode->hasMinMax)
+			int keyIndex = qualKeyIndexes[qualVarIndex];
+			if (group->keyNulls[keyIndex])
 			{
+				constraintList = lappend(constraintList,
+										 list_nth(nullConstraints, qualVarIndex));
 				continue;
 			}
 
-			UpdateConstraint(baseConstraint, chunkSkipNode->minimumValue,
-							 chunkSkipNode->maximumValue);
+			OpExpr *constraint = list_nth(valueConstraints, qualVarIndex);
+			Const *value = (Const *) get_rightop((Expr *) constraint);
+			value->constvalue = group->keyValues[keyIndex];
+			value->constisnull = false;
+			value->constbyval = true;
 
-			List *constraintList = list_make1(baseConstraint);
-			bool predicateRefuted =
-				predicate_refuted_by(constraintList, whereClauseList, false);
-			if (predicateRefuted && selectedChunkMask[chunkIndex])
+			constraintList = lappend(constraintList, constraint);
+		}
+
+		if (predicate_implied_by(summary->qualList, constraintList, false))
+		{
+			continue;
+		}
+
+		/* rows whose quals are NULL don't pass them either */
+		if (!predicate_refuted_by(summary->qualList, constraintList, true))
+		{
+			return false;
+		}
+
+		groupPasses[groupIndex] = false;
+	}
+
+	for (uint32 groupIndex = 0; groupIndex < projection->groupCount; groupIndex++)
+	{
+		StripeProjectionGroup *group = projection->groups[groupIndex];
+		if (!groupPasses[groupIndex])
+		{
+			continue;
+		}
+
+		StripeProjectionGroup key;
+		memset(&key, 0, sizeof(key));
+
+		for (int groupColumn = 0; groupColumn < summary->groupCount; groupColumn++)
+		{
+			int keyIndex = groupKeyIndexes[groupColumn];
+
+			key.keyNulls[groupColumn] = group->keyNulls[keyIndex];
+			key.keyValues[groupColumn] = group->keyValues[keyIndex];
+		}
+
+		bool found = false;
+		StripeProjectionGroup *summaryGroup = hash_search(summary->groups, &key,
+														  HASH_ENTER, &found);
+		if (!found)
+		{
+			memset((char *) summaryGroup + STRIPE_PROJECTION_GROUP_KEY_SIZE, 0,
+				   STRIPE_PROJECTION_GROUP_SIZE(summary->measureCount) -
+				   STRIPE_PROJECTION_GROUP_KEY_SIZE);
+		}
+
+		summaryGroup->rowCount += group->rowCount;
+
+		for (int measureIndex = 0; measureIndex < summary->measureCount; measureIndex++)
+		{
+			StripeProjectionMeasure *summaryMeasure = &summaryGroup->measures[measureIndex];
+			int sumIndex = measureSumIndexes[measureIndex];
+
+			if (sumIndex >= 0)
 			{
-				selectedChunkMask[chunkIndex] = false;
-				*chunkGroupsFiltered += 1;
+				StripeProjectionMeasure *measure = &group->measures[sumIndex];
+
+				summaryMeasure->valueCount += measure->valueCount;
+				summaryMeasure->intSum += measure->intSum;
+				summaryMeasure->floatSum += measure->floatSum;
+			}
+			else if (!group->keyNulls[measureKeyIndexes[measureIndex]])
+			{
+				summaryMeasure->valueCount += group->rowCount;
 			}
 		}
 	}
 
-	return selectedChunkMask;
+	summary->stripeCount++;
+
+	return true;
 }
 
 
 /*
- * GetFunctionInfoOrNull first resolves the operator for the given data type,
- * access method, and support procedure. The function then uses the resolved
- * operator's identifier to fill in a function manager object, and returns
- * this object. This function is based on a similar function from CitusDB's code.
+ * FindNextStripeToRead returns the stripe that should be read after
+ * lastStripeMetadata, or the first stripe to read if lastStripeMetadata is
+ * NULL. For parallel scans, the next range of chunk groups is claimed from
+ * the shared scan state instead, see ClaimParallelStripeRange, and reads
+ * with a stripe list take the next stripe of the list. Returns NULL if there
+ * are no more stripes.
  */
-FmgrInfo *
-GetFunctionInfoOrNull(Oid typeId, Oid accessMethodId, int16 procedureId)
+static StripeMetadata *
+FindNextStripeToRead(ColumnarReadState *readState, StripeMetadata *lastStripeMetadata)
 {
-	FmgrInfo *functionInfo = NULL;
-
-	/* get default operator class from pg_opclass for datum type */
-	Oid operatorClassId = GetDefaultOpClass(typeId, accessMethodId);
-	if (operatorClassId == InvalidOid)
+	if (readState->hasStripeList)
 	{
-		return NULL;
-	}
+		/* a read that starts over starts with the first stripe of the list */
+		if (lastStripeMetadata == NULL)
+		{
+			readState->stripeListIndex = 0;
+		}
 
-	Oid operatorFamilyId = get_opclass_family(operatorClassId);
-	if (operatorFamilyId == InvalidOid)
-	{
-		return NULL;
-	}
+		if (readState->stripeListIndex >= list_length(readState->stripeList))
+		{
+			return NULL;
+		}
 
-	Oid operatorId = get_opfamily_proc(operatorFamilyId, typeId, typeId, procedureId);
+		/* the read frees the stripes it is done with */
+		StripeMetadata *nextStripeMetadata = palloc(sizeof(StripeMetadata));
+		*nextStripeMetadata = *(StripeMetadata *) list_nth(readState->stripeList,
+														   readState->stripeListIndex++);
 
-	/* No operator for typeId, search for operator class type*/
-	if (operatorId == InvalidOid)
-	{
-		Oid opcintype = get_opclass_input_type(operatorClassId);
-		operatorId = get_opfamily_proc(operatorFamilyId, opcintype, opcintype, procedureId);
+		return nextStripeMetadata;
 	}
 
-	if (operatorId != InvalidOid)
+	if (readState->parallelColumnarScan == 0)
 	{
-		functionInfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo));
+		uint64 lastReadRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
+		if (lastStripeMetadata != NULL)
+		{
+			lastReadRowNumber = StripeGetHighestRowNumber(lastStripeMetadata);
+		}
+		else if (readState->syncScan)
+		{
+			/* start at the stripe the other reads of the table are at */
+			readState->syncScanWrapped = false;
+			readState->syncScanStartRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
+
+			uint64 syncRowNumber =
+				ColumnarSyncScanGetLocation(readState->relation,
+											readState->syncScanColumnsHash);
+			if (syncRowNumber != COLUMNAR_INVALID_ROW_NUMBER)
+			{
+				StripeMetadata *startStripeMetadata =
+					FindNextStripeByRowNumber(readState->relation, syncRowNumber - 1,
+											  readState->snapshot);
+				if (startStripeMetadata != NULL)
+				{
+					readState->syncScanStartRowNumber =
+						startStripeMetadata->firstRowNumber;
+					return startStripeMetadata;
+				}
+			}
+		}
 
-		/* fill in the FmgrInfo struct using the operatorId */
-		fmgr_info(operatorId, functionInfo);
+		return FindNextSerialStripe(readState, lastReadRowNumber);
 	}
 
-	return functionInfo;
+	return ClaimParallelStripeRange(readState);
 }
 
 
 /*
- * BuildBaseConstraint builds and returns a base constraint. This constraint
- * implements an expression in the form of (var <= max && var >= min), where
- * min and max values represent a chunk's min and max values. These chunk
- * values are filled in after the constraint is built. This function is based
- * on a similar function from CitusDB's shard pruning logic.
+ * FindNextSerialStripe returns the stripe after the given row number for a
+ * read that isn't parallel. A synchronized read goes on with the first
+ * stripe of the table after the last one, and ends before the stripe it
+ * started at.
  */
-static Node *
-BuildBaseConstraint(Var *variable)
+static StripeMetadata *
+FindNextSerialStripe(ColumnarReadState *readState, uint64 lastReadRowNumber)
 {
-	OpExpr *lessThanExpr = MakeOpExpression(variable, BTLessEqualStrategyNumber);
-	OpExpr *greaterThanExpr = MakeOpExpression(variable, BTGreaterEqualStrategyNumber);
+	StripeMetadata *stripeMetadata =
+		FindNextStripeByRowNumber(readState->relation, lastReadRowNumber,
+								  readState->snapshot);
 
-	Node *baseConstraint = make_and_qual((Node *) lessThanExpr, (Node *) greaterThanExpr);
+	if (!readState->syncScan)
+	{
+		return stripeMetadata;
+	}
 
-	return baseConstraint;
+	if (stripeMetadata == NULL && !readState->syncScanWrapped)
+	{
+		readState->syncScanWrapped = true;
+		stripeMetadata = FindNextStripeByRowNumber(readState->relation,
+												   COLUMNAR_INVALID_ROW_NUMBER,
+												   readState->snapshot);
+	}
+
+	if (readState->syncScanWrapped && stripeMetadata != NULL &&
+		stripeMetadata->firstRowNumber >= readState->syncScanStartRowNumber)
+	{
+		pfree(stripeMetadata);
+		stripeMetadata = NULL;
+	}
+
+	return stripeMetadata;
 }
 
 
 /*
- * GetClauseVars extracts the Vars from the given clauses for the purpose of
- * building constraints that can be refuted by predicate_refuted_by(). It also
- * deduplicates and sorts them.
+ * ClaimParallelStripeRange claims the next chunk groups to read for a
+ * participant of a parallel scan from the stripe list that the leader put in
+ * the shared scan state, and sets stripeFirstChunkGroup and
+ * stripeEndChunkGroup to them. Returns the stripe they belong to, or NULL if
+ * all stripes are claimed.
+ *
+ * While there are more unclaimed stripes than participants, the rest of the
+ * stripe being split or a whole new stripe is claimed. Towards the end of the
+ * scan, the last stripes are split: each claim takes an equal share of the
+ * chunk groups of the stripe that are left for the participants, but at least
+ * one, so the participants finish at about the same time even when the last
+ * stripes are large.
  */
-static List *
-GetClauseVars(List *whereClauseList, int natts)
+static StripeMetadata *
+ClaimParallelStripeRange(ColumnarReadState *readState)
 {
-	/*
-	 * We don't recurse into or include aggregates, window functions, or
-	 * PHVs. We don't expect any PHVs during execution; and Vars found inside
-	 * an aggregate or window function aren't going to be useful in forming
-	 * constraints that can be refuted.
-	 */
-	int flags = 0;
-	List *vars = pull_var_clause((Node *) whereClauseList, flags);
-	Var **deduplicate = palloc0(sizeof(Var *) * natts);
+	ParallelColumnarScan parallelColumnarScan = readState->parallelColumnarScan;
 
-	ListCell *lc;
-	foreach(lc, vars)
+	if (parallelColumnarScan->stripeListOffset == 0)
 	{
-		Node *node = lfirst(lc);
-		Assert(IsA(node, Var));
+		return ClaimParallelStripeById(readState);
+	}
 
-		Var *var = (Var *) node;
-		int idx = var->varattno - 1;
+	SpinLockAcquire(&parallelColumnarScan->mutex);
 
-		if (deduplicate[idx] != NULL)
+	if (!parallelColumnarScan->hasSplitStripe ||
+		parallelColumnarScan->splitStripeNextChunkGroup >=
+		parallelColumnarScan->splitStripe.chunkCount)
+	{
+		if (parallelColumnarScan->nextStripeIndex >= parallelColumnarScan->stripeCount)
 		{
-			/* if they have the same varattno, the rest should be identical */
-			Assert(equal(var, deduplicate[idx]));
+			parallelColumnarScan->hasSplitStripe = false;
+			SpinLockRelease(&parallelColumnarScan->mutex);
+			return NULL;
 		}
 
-		deduplicate[idx] = var;
-	}
+		StripeMetadata *stripeList = ParallelColumnarScanStripes(parallelColumnarScan);
 
-	List *whereClauseVars = NIL;
-	for (int i = 0; i < natts; i++)
-	{
-		Var *var = deduplicate[i];
-		if (var != NULL)
-		{
-			whereClauseVars = lappend(whereClauseVars, var);
-		}
+		parallelColumnarScan->splitStripe =
+			stripeList[parallelColumnarScan->nextStripeIndex++];
+		parallelColumnarScan->splitStripeNextChunkGroup = 0;
+		parallelColumnarScan->hasSplitStripe = true;
 	}
 
-	pfree(deduplicate);
+	StripeMetadata claimedStripe = parallelColumnarScan->splitStripe;
 
-	return whereClauseVars;
-}
+	uint32 firstChunkGroup = parallelColumnarScan->splitStripeNextChunkGroup;
+	uint32 chunkGroupsLeft = claimedStripe.chunkCount - firstChunkGroup;
+	uint32 claimedChunkGroups = chunkGroupsLeft;
 
+	uint64 unclaimedStripeCount = parallelColumnarScan->stripeCount -
+								  parallelColumnarScan->nextStripeIndex;
+	if (unclaimedStripeCount < parallelColumnarScan->participantCount)
+	{
+		uint32 participantCount = Max(parallelColumnarScan->participantCount, 1);
+		claimedChunkGroups = Max((chunkGroupsLeft + participantCount - 1) /
+								 participantCount, 1);
+	}
 
-/*
- * MakeOpExpression builds an operator expression node. This operator expression
- * implements the operator clause as defined by the variable and the strategy
- * number. The function is copied from CitusDB's shard pruning logic.
- */
-static OpExpr *
-MakeOpExpression(Var *variable, int16 strategyNumber)
-{
-	Oid typeId = variable->vartype;
-	Oid typeModId = variable->vartypmod;
-	Oid collationId = variable->varcollid;
+	parallelColumnarScan->splitStripeNextChunkGroup = firstChunkGroup +
+													  claimedChunkGroups;
 
-	Oid accessMethodId = BTREE_AM_OID;
+	SpinLockRelease(&parallelColumnarScan->mutex);
 
-	/* Load the operator from system catalogs */
-	Oid operatorId = GetOperatorByType(typeId, accessMethodId, strategyNumber);
+	readState->stripeFirstChunkGroup = firstChunkGroup;
+	readState->stripeEndChunkGroup = firstChunkGroup + claimedChunkGroups;
 
-	/* No operator for typeId, search for operator class type */
-	if (operatorId == InvalidOid)
+	/* a stripe without chunk groups is claimed as a whole */
+	if (claimedStripe.chunkCount == 0)
 	{
-		Oid operatorClassId = GetDefaultOpClass(typeId, accessMethodId);
-		Oid opcintype = get_opclass_input_type(operatorClassId);
-		operatorId = GetOperatorByType(opcintype, accessMethodId, strategyNumber);
+		readState->stripeEndChunkGroup = PG_UINT32_MAX;
 	}
 
-	Const *constantValue = makeNullConst(typeId, typeModId, collationId);
-
-	/* Now make the expression with the given variable and a null constant */
-	OpExpr *expression = (OpExpr *) make_opclause(operatorId,
-												  InvalidOid, /* no result type yet */
-												  false, /* no return set */
-												  (Expr *) variable,
-												  (Expr *) constantValue,
-												  InvalidOid, collationId);
-
-	/* Set implementing function id and result type */
-	expression->opfuncid = get_opcode(operatorId);
-	expression->opresulttype = get_func_rettype(expression->opfuncid);
+	StripeMetadata *stripeMetadata = palloc(sizeof(StripeMetadata));
+	*stripeMetadata = claimedStripe;
 
-	return expression;
+	return stripeMetadata;
 }
 
 
 /*
- * GetOperatorByType returns operator Oid for the given type, access method,
- * and strategy number. Note that this function incorrectly errors out when
- * the given type doesn't have its own operator but can use another compatible
- * type's default operator. The function is copied from CitusDB's shard pruning
- * logic.
+ * ClaimParallelStripeById claims the next whole stripe for a participant of
+ * a parallel table scan, which doesn't have a stripe list. Participants look
+ * up the first stripe from nextStripeId on and move nextStripeId past it; if
+ * another participant moved it first, they look again. Returns NULL if all
+ * stripes are claimed.
  */
-static Oid
-GetOperatorByType(Oid typeId, Oid accessMethodId, int16 strategyNumber)
+static StripeMetadata *
+ClaimParallelStripeById(ColumnarReadState *readState)
 {
-	/* Get default operator class from pg_opclass */
-	Oid operatorClassId = GetDefaultOpClass(typeId, accessMethodId);
+	ParallelColumnarScan parallelColumnarScan = readState->parallelColumnarScan;
 
-	Oid operatorFamily = get_opclass_family(operatorClassId);
+	while (true)
+	{
+		uint64 nextStripeId = pg_atomic_read_u64(&parallelColumnarScan->nextStripeId);
 
-	Oid operatorId = get_opfamily_member(operatorFamily, typeId, typeId, strategyNumber);
+		StripeMetadata *stripeMetadata = FindNextStripeById(readState->relation,
+															nextStripeId,
+															readState->snapshot);
+		if (stripeMetadata == NULL)
+		{
+			return NULL;
+		}
 
-	return operatorId;
+		if (!pg_atomic_compare_exchange_u64(&parallelColumnarScan->nextStripeId,
+											&nextStripeId, stripeMetadata->id + 1))
+		{
+			pfree(stripeMetadata);
+			continue;
+		}
+
+		/*
+		 * As in ColumnarParallelScanStripeList, stripes that aren't flushed
+		 * yet are skipped if the snapshot might see them.
+		 */
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED &&
+			SnapshotMightSeeUnflushedStripes(readState->snapshot))
+		{
+			pfree(stripeMetadata);
+			continue;
+		}
+
+		readState->stripeFirstChunkGroup = 0;
+		readState->stripeEndChunkGroup = PG_UINT32_MAX;
+
+		return stripeMetadata;
+	}
 }
 
 
 /*
- * UpdateConstraint updates the base constraint with the given min/max values.
- * The function is copied from CitusDB's shard pruning logic.
+ * StripeRefutedBySummary returns true if the stripe level min/max values of
+ * the columns referenced in the pushed down clauses, or the bucket of the
+ * stripe, prove that no row of the given stripe can satisfy the clauses.
+ * This lets us skip the stripe without reading its chunk level metadata.
  */
-static void
-UpdateConstraint(Node *baseConstraint, Datum minValue, Datum maxValue)
+static bool
+StripeRefutedBySummary(ColumnarReadState *readState, StripeMetadata *stripeMetadata)
 {
-	BoolExpr *andExpr = (BoolExpr *) baseConstraint;
-	Node *lessThanExpr = (Node *) linitial(andExpr->args);
-	Node *greaterThanExpr = (Node *) lsecond(andExpr->args);
+	if (readState->whereClauseList == NIL || readState->whereClauseVars == NIL)
+	{
+		return false;
+	}
 
-	Node *minNode = get_rightop((Expr *) greaterThanExpr);
-	Node *maxNode = get_rightop((Expr *) lessThanExpr);
+	/* the leader of a parallel scan left out the stripes the clauses refute */
+	if (readState->stripesPrunedByLeader)
+	{
+		return false;
+	}
 
-	Assert(IsA(minNode, Const));
-	Assert(IsA(maxNode, Const));
+	if (StripeBucketRefuted(readState, stripeMetadata))
+	{
+		return true;
+	}
 
-	Const *minConstant = (Const *) minNode;
-	Const *maxConstant = (Const *) maxNode;
+	/* stripeReadContext is reset by AdvanceStripeRead once we are done */
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->stripeReadContext);
 
-	minConstant->constvalue = minValue;
-	maxConstant->constvalue = maxValue;
+	bool stripeRefuted = StripeSummaryRefutesClauses(readState->relation,
+													 readState->tupleDescriptor,
+													 stripeMetadata,
+													 readState->whereClauseList,
+													 readState->whereClauseVars,
+													 readState->snapshot);
 
-	minConstant->constisnull = false;
-	maxConstant->constisnull = false;
+	MemoryContextSwitchTo(oldContext);
 
-	minConstant->constbyval = true;
-	maxConstant->constbyval = true;
+	return stripeRefuted;
 }
 
 
 /*
- * SelectedChunkSkipList constructs a new StripeSkipList in which the
- * non-selected chunks are removed from the given stripeSkipList.
+ * StripeBucketRefuted returns true if the given stripe holds a bucket of the
+ * bucket_by option that the pushed down clauses rule out. The buckets they
+ * allow are looked up once for each set of clauses.
  */
-static StripeSkipList *
-SelectedChunkSkipList(StripeSkipList *stripeSkipList, bool *projectedColumnMask,
-					  bool *selectedChunkMask)
+static bool
+StripeBucketRefuted(ColumnarReadState *readState, StripeMetadata *stripeMetadata)
 {
-	uint32 selectedChunkCount = 0;
-	uint32 chunkIndex = 0;
-	uint32 columnIndex = 0;
-	uint32 columnCount = stripeSkipList->columnCount;
-	uint32 selectedChunkIndex = 0;
-
-	for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	if (stripeMetadata->bucket < 0)
 	{
-		if (selectedChunkMask[chunkIndex])
-		{
-			selectedChunkCount++;
-		}
+		return false;
 	}
 
-	ColumnChunkSkipNode **selectedChunkSkipNodeArray =
-		palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+	if (!readState->allowedBucketsValid)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
 
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		bms_free(readState->allowedBuckets);
+		readState->allowedBuckets = NULL;
+		readState->bucketsRestricted =
+			ColumnarAllowedBuckets(readState->relation, readState->whereClauseList,
+								   &readState->allowedBuckets);
+		readState->allowedBucketsValid = true;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return readState->bucketsRestricted &&
+		   !bms_is_member(stripeMetadata->bucket, readState->allowedBuckets);
+}
+
+/*
+ * StripeSummaryRefutesClauses returns true if the stripe column summaries of
+ * the given stripe refute the given clauses. Allocates in the current memory
+ * context.
+ */
+static bool
+StripeSummaryRefutesClauses(Relation relation, TupleDesc tupleDescriptor,
+							StripeMetadata *stripeMetadata,
+							List *whereClauseList, List *whereClauseVars,
+							Snapshot snapshot)
+{
+	ColumnStripeSummary *columnSummaries =
+		ReadStripeColumnSummaries(relation->rd_node, stripeMetadata->id,
+								  tupleDescriptor, snapshot);
+	if (columnSummaries == NULL)
 	{
-		bool firstColumn = columnIndex == 0;
-		selectedChunkIndex = 0;
+		return false;
+	}
 
-		/* first column's chunk skip node is always read */
-		if (!projectedColumnMask[columnIndex] && !firstColumn)
+	Var *column = NULL;
+	foreach_ptr(column, whereClauseVars)
+	{
+		uint32 columnIndex = column->varattno - 1;
+		ColumnStripeSummary *columnSummary = &columnSummaries[columnIndex];
+
+		/*
+		 * Columns that are NULL for the whole stripe, that don't have a
+		 * comparator or that were added after this stripe was written don't
+		 * have a summary.
+		 */
+		if (!columnSummary->hasMinMax)
 		{
-			selectedChunkSkipNodeArray[columnIndex] = NULL;
 			continue;
 		}
 
-		Assert(stripeSkipList->chunkSkipNodeArray[columnIndex] != NULL);
-
-		selectedChunkSkipNodeArray[columnIndex] = palloc0(selectedChunkCount *
-														  sizeof(ColumnChunkSkipNode));
+		Node *baseConstraint = BuildBaseConstraint(column);
+		UpdateConstraint(baseConstraint, columnSummary->minimumValue,
+						 columnSummary->maximumValue);
 
-		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		List *constraintList = list_make1(baseConstraint);
+		if (predicate_refuted_by(constraintList, whereClauseList, false))
 		{
-			if (selectedChunkMask[chunkIndex])
-			{
-				selectedChunkSkipNodeArray[columnIndex][selectedChunkIndex] =
-					stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
-				selectedChunkIndex++;
-			}
+			return true;
 		}
 	}
 
-	selectedChunkIndex = 0;
-	uint32 *chunkGroupRowCounts = palloc0(selectedChunkCount * sizeof(uint32));
-	uint32 *chunkGroupRowOffset = palloc0(selectedChunkCount * sizeof(uint32));
-	uint32 *chunkGroupDeletedRows = palloc(selectedChunkCount * sizeof(uint32));
+	return false;
+}
 
-	for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+
+/*
+ * StripeChunksImplyClauses returns true if the chunk skip nodes of the given
+ * stripe show that all of its rows satisfy the given clauses, that is every
+ * chunk has minimum and maximum values that imply them, and no NULLs in the
+ * columns they refer to. Allocates in the current memory context.
+ */
+bool
+StripeChunksImplyClauses(Relation relation, StripeMetadata *stripeMetadata,
+						 List *clauseList, Snapshot snapshot)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	List *clauseVars = GetClauseVars(clauseList, tupleDescriptor->natts);
+	if (clauseVars == NIL)
 	{
-		if (selectedChunkMask[chunkIndex])
+		return false;
+	}
+
+	bool *columnMask = palloc0(tupleDescriptor->natts * sizeof(bool));
+	Var *column = NULL;
+	foreach_ptr(column, clauseVars)
+	{
+		columnMask[column->varattno - 1] = true;
+	}
+
+	StripeSkipList *skipList =
+		ReadStripeSkipListColumns(relation->rd_node, stripeMetadata->id,
+								  tupleDescriptor, stripeMetadata->chunkCount,
+								  snapshot, columnMask);
+
+	for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+	{
+		List *constraintList = NIL;
+
+		foreach_ptr(column, clauseVars)
 		{
-			chunkGroupRowCounts[selectedChunkIndex] =
-				stripeSkipList->chunkGroupRowCounts[chunkIndex];
-			chunkGroupRowOffset[selectedChunkIndex] =
-				stripeSkipList->chunkGroupRowOffset[chunkIndex];
-			chunkGroupDeletedRows[selectedChunkIndex] =
-				stripeSkipList->chunkGroupDeletedRows[chunkIndex];
-			selectedChunkIndex++;
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[column->varattno - 1][chunkIndex];
+
+			/* a NULL satisfies neither the clauses nor their negation */
+			if (!chunkSkipNode->hasMinMax ||
+				chunkSkipNode->nullState != CHUNK_NULLS_NONE)
+			{
+				return false;
+			}
+
+			Node *baseConstraint = BuildBaseConstraint(column);
+			UpdateConstraint(baseConstraint, chunkSkipNode->minimumValue,
+							 chunkSkipNode->maximumValue);
+			constraintList = lappend(constraintList, baseConstraint);
 		}
-	}
 
-	StripeSkipList *selectedChunkSkipList = palloc0(sizeof(StripeSkipList));
-	selectedChunkSkipList->chunkSkipNodeArray = selectedChunkSkipNodeArray;
-	selectedChunkSkipList->chunkCount = selectedChunkCount;
-	selectedChunkSkipList->columnCount = stripeSkipList->columnCount;
-	selectedChunkSkipList->chunkGroupRowCounts = chunkGroupRowCounts;
-	selectedChunkSkipList->chunkGroupRowOffset = chunkGroupRowOffset;
-	selectedChunkSkipList->chunkGroupDeletedRows = chunkGroupDeletedRows;
+		if (!predicate_implied_by(clauseList, constraintList, false))
+		{
+			return false;
+		}
+	}
 
-	return selectedChunkSkipList;
+	return true;
 }
 
 
 /*
- * StripeSkipListRowCount counts the number of rows in the given stripeSkipList.
- * To do this, the function finds the first column, and sums up row counts across
- * all chunks for that column.
+ * ColumnarParallelScanStripeList returns the stripes that the participants of
+ * a parallel scan with the given clauses claim, in the order they claim them,
+ * so they don't each look up and prune the stripes they claim. Stripes whose
+ * column summaries or bucket refute the clauses are left out, and added to
+ * *stripesPruned and their chunk groups to *chunkGroupsPruned.
  */
-static uint32
-StripeSkipListRowCount(StripeSkipList *stripeSkipList)
+List *
+ColumnarParallelScanStripeList(Relation relation, Snapshot snapshot,
+							   List *whereClauseList, uint64 *stripesPruned,
+							   uint64 *chunkGroupsPruned)
 {
-	uint32 stripeSkipListRowCount = 0;
-	uint32 chunkIndex = 0;
-	uint32 *chunkGroupRowCounts = stripeSkipList->chunkGroupRowCounts;
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	List *whereClauseVars = GetClauseVars(whereClauseList, tupleDescriptor->natts);
+	List *stripeList = StripesForSnapshot(relation, snapshot);
+	List *claimedStripeList = NIL;
 
-	for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	*stripesPruned = 0;
+	*chunkGroupsPruned = 0;
+
+	Bitmapset *allowedBuckets = NULL;
+	bool bucketsRestricted = ColumnarAllowedBuckets(relation, whereClauseList,
+													&allowedBuckets);
+
+	MemoryContext summaryContext = AllocSetContextCreate(CurrentMemoryContext,
+														 "Columnar Parallel Scan Pruning",
+														 ALLOCSET_DEFAULT_SIZES);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
 	{
-		uint32 chunkGroupRowCount = chunkGroupRowCounts[chunkIndex];
-		stripeSkipListRowCount += chunkGroupRowCount;
+		/*
+		 * The read errors out on stripes that aren't flushed unless the
+		 * snapshot might see them, when they are skipped.
+		 */
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+		{
+			if (!SnapshotMightSeeUnflushedStripes(snapshot))
+			{
+				claimedStripeList = lappend(claimedStripeList, stripeMetadata);
+			}
+
+			continue;
+		}
+
+		if (bucketsRestricted && stripeMetadata->bucket >= 0 &&
+			!bms_is_member(stripeMetadata->bucket, allowedBuckets))
+		{
+			(*stripesPruned)++;
+			*chunkGroupsPruned += stripeMetadata->chunkCount;
+			continue;
+		}
+
+		if (whereClauseList != NIL && whereClauseVars != NIL)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(summaryContext);
+
+			bool stripeRefuted = StripeSummaryRefutesClauses(relation, tupleDescriptor,
+															 stripeMetadata,
+															 whereClauseList,
+															 whereClauseVars,
+															 snapshot);
+
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextReset(summaryContext);
+
+			if (stripeRefuted)
+			{
+				(*stripesPruned)++;
+				*chunkGroupsPruned += stripeMetadata->chunkCount;
+				continue;
+			}
+		}
+
+		claimedStripeList = lappend(claimedStripeList, stripeMetadata);
 	}
 
-	return stripeSkipListRowCount;
+	MemoryContextDelete(summaryContext);
+
+	return claimedStripeList;
 }
 
 
 /*
- * ProjectedColumnMask returns a boolean array in which the projected columns
- * from the projected column list are marked as true.
+ * SnapshotMightSeeUnflushedStripes returns true if given snapshot is
+ * expected to see un-flushed stripes either because of other backends'
+ * pending writes or aborted transactions.
  */
-static bool *
-ProjectedColumnMask(uint32 columnCount, List *projectedColumnList)
+static bool
+SnapshotMightSeeUnflushedStripes(Snapshot snapshot)
 {
-	bool *projectedColumnMask = palloc0(columnCount * sizeof(bool));
-	int attno;
-
-	foreach_int(attno, projectedColumnList)
+	if (snapshot == InvalidSnapshot)
 	{
-		/* attno is 1-indexed; projectedColumnMask is 0-indexed */
-		int columnIndex = attno - 1;
-		projectedColumnMask[columnIndex] = true;
+		return false;
 	}
 
-	return projectedColumnMask;
+	switch (snapshot->snapshot_type)
+	{
+		case SNAPSHOT_ANY:
+		case SNAPSHOT_DIRTY:
+		case SNAPSHOT_NON_VACUUMABLE:
+		{
+			return true;
+		}
+
+		default:
+			return false;
+	}
 }
 
 
 /*
- * DeserializeBoolArray reads an array of bits from the given buffer and stores
- * it in provided bool array.
+ * ReadStripeNextRow: If more rows can be read from the current stripe, fill
+ * in non-NULL columnValues and return true. Otherwise, return false.
+ *
+ * On entry, all entries in columnNulls should be true; this function only
+ * sets non-NULL entries.
+ *
  */
-static void
-DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
-					 uint32 boolArrayLength)
+static bool
+ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
+				  bool *columnNulls,
+				  uint64 stripeFirstRowNumber,
+				  Snapshot snapshot, uint64 stripeId)
 {
-	uint32 boolArrayIndex = 0;
-
-	uint32 maximumBoolCount = boolArrayBuffer->len * 8;
-	if (boolArrayLength > maximumBoolCount)
+	if (stripeReadState->currentRow >= stripeReadState->rowCount)
 	{
-		ereport(ERROR, (errmsg("insufficient data for reading boolean array")));
+		Assert(stripeReadState->currentRow == stripeReadState->rowCount);
+		return false;
 	}
 
-	for (boolArrayIndex = 0; boolArrayIndex < boolArrayLength; boolArrayIndex++)
+	while (true)
 	{
-		uint32 byteIndex = boolArrayIndex / 8;
-		uint32 bitIndex = boolArrayIndex % 8;
-		uint8 bitmask = (1 << bitIndex);
-
-		uint8 shiftedBit = (boolArrayBuffer->data[byteIndex] & bitmask);
-		if (shiftedBit == 0)
+		if (stripeReadState->chunkGroupReadState == NULL)
 		{
-			boolArray[boolArrayIndex] = false;
+			ConsumeChunkGroupPrefetch(stripeReadState);
+
+			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
+				stripeReadState->stripeBuffers,
+				stripeReadState->
+				chunkGroupIndex,
+				stripeReadState->
+				tupleDescriptor,
+				stripeReadState->
+				projectedColumnList,
+				stripeReadState->
+				stripeReadContext,
+				stripeReadState,
+				stripeId,
+				false
+				);
+
+			StartChunkGroupPrefetch(stripeReadState);
+			
+			if (columnar_enable_dml &&
+				stripeReadState->chunkGroupReadState->chunkGroupDeletedRows != 0)
+			{
+				uint64 chunkFirstRowNumber = 
+					stripeFirstRowNumber + 
+					stripeReadState->chunkGroupReadState->chunkStripeRowOffset;
+
+				stripeReadState->chunkGroupReadState->rowMask = 
+					StripeReadChunkRowMask(stripeReadState, chunkFirstRowNumber,
+										   stripeReadState->chunkGroupReadState->rowCount);
+				stripeReadState->chunkGroupReadState->rowMaskCached = false;
+			}
+			else
+			{
+				stripeReadState->chunkGroupReadState->rowMask = NULL;
+			}
+
+			if (stripeReadState->sortedSearchClauses != NIL)
+			{
+				NarrowSortedChunkGroup(stripeReadState);
+			}
 		}
-		else
+
+		int32 deletedColumnsNumber = 0;
+		if (!ReadChunkGroupNextRow(stripeReadState->chunkGroupReadState, columnValues,
+								   columnNulls, &deletedColumnsNumber))
 		{
-			boolArray[boolArrayIndex] = true;
+			/* if this chunk group is exhausted, fetch the next one and loop */
+
+			stripeReadState->currentRow += deletedColumnsNumber;
+
+			bool isStripeExhausted = stripeReadState->currentRow >= stripeReadState->rowCount;
+
+			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
+			stripeReadState->chunkGroupReadState = NULL;
+
+			if (isStripeExhausted)
+				return false;
+
+			stripeReadState->chunkGroupIndex++;
+				
+			continue;
 		}
+
+		stripeReadState->currentRow += 1 + deletedColumnsNumber;
+		return true;
 	}
+
+	Assert(stripeReadState->currentRow == stripeReadState->rowCount);
+	return false;
 }
 
 
 /*
- * DeserializeDatumArray reads an array of datums from the given buffer and stores
- * them in provided datumArray. If a value is marked as false in the exists array,
- * the function assumes that the datum isn't in the buffer, and simply skips it.
+ * SortedSearchClauses returns the pushed down clauses that compare a
+ * projected column whose chunks track sortedness with a constant of its
+ * type, by an operator of the btree operator family of the type.
  */
-static void
-DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
-					  bool datumTypeByValue, int datumTypeLength,
-					  char datumTypeAlign, Datum *datumArray)
+static List *
+SortedSearchClauses(List *whereClauseList, TupleDesc tupleDescriptor,
+					List *projectedColumnList)
 {
-	uint32 datumIndex = 0;
-	uint32 currentDatumDataOffset = 0;
+	List *searchClauseList = NIL;
 
-	for (datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
 	{
-		if (!existsArray[datumIndex])
+		if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
 		{
 			continue;
 		}
 
-		char *currentDatumDataPointer = datumBuffer->data + currentDatumDataOffset;
+		OpExpr *opExpr = (OpExpr *) clause;
+		Node *columnOperand = linitial(opExpr->args);
+		Node *constOperand = lsecond(opExpr->args);
+		bool commuted = false;
 
-		datumArray[datumIndex] = fetch_att(currentDatumDataPointer, datumTypeByValue,
-										   datumTypeLength);
+		if (IsA(columnOperand, Const))
+		{
+			Node *swap = columnOperand;
+			columnOperand = constOperand;
+			constOperand = swap;
+			commuted = true;
+		}
+
+		if (!IsA(columnOperand, Var) || !IsA(constOperand, Const) ||
+			((Const *) constOperand)->constisnull)
+		{
+			continue;
+		}
+
+		Var *column = (Var *) columnOperand;
+		if (column->varattno <= 0 || column->varattno > tupleDescriptor->natts ||
+			!list_member_int(projectedColumnList, column->varattno))
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+														column->varattno - 1);
+		if (!ColumnarSortednessTracked(attributeForm) ||
+			((Const *) constOperand)->consttype != attributeForm->atttypid)
+		{
+			continue;
+		}
+
+		/* chunks are sorted by the btree order of the type, see InlineCompare */
+		TypeCacheEntry *typeEntry =
+			lookup_type_cache(attributeForm->atttypid,
+							  TYPECACHE_BTREE_OPFAMILY | TYPECACHE_CMP_PROC_FINFO);
+		if (!OidIsValid(typeEntry->btree_opf) ||
+			!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			continue;
+		}
+
+		int strategyNumber = get_op_opfamily_strategy(opExpr->opno,
+													  typeEntry->btree_opf);
+		if (strategyNumber == InvalidStrategy)
+		{
+			continue;
+		}
+
+		if (commuted)
+		{
+			strategyNumber = BTMaxStrategyNumber + 1 - strategyNumber;
+		}
+
+		SortedSearchClause *searchClause = palloc0(sizeof(SortedSearchClause));
+		searchClause->columnIndex = column->varattno - 1;
+		searchClause->strategyNumber = strategyNumber;
+		searchClause->constValue = ((Const *) constOperand)->constvalue;
+		fmgr_info_copy(&searchClause->comparisonFunction, &typeEntry->cmp_proc_finfo,
+					   CurrentMemoryContext);
+
+		searchClauseList = lappend(searchClauseList, searchClause);
+	}
+
+	return searchClauseList;
+}
+
+
+/*
+ * NarrowSortedChunkGroup narrows the rows that the current chunk group read
+ * goes over to the ones the sorted search clauses of the stripe can select.
+ * For a clause on a column whose chunk has no NULLs and is sorted, the rows
+ * whose values the clause selects are contiguous, so their bounds are binary
+ * searched and the rows outside them are left out without evaluating the
+ * quals on them. The scan still evaluates the quals on the rows it reads.
+ */
+static void
+NarrowSortedChunkGroup(StripeReadState *stripeReadState)
+{
+	ChunkGroupReadState *chunkGroupReadState = stripeReadState->chunkGroupReadState;
+	ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
+	ColumnChunkSkipNode **chunkSkipNodeArray =
+		stripeReadState->stripeBuffers->selectedChunkSkipNodeArray;
+	uint32 rowCount = chunkGroupReadState->rowCount;
+	uint32 startRow = 0;
+	uint32 endRow = rowCount;
+
+	SortedSearchClause *searchClause = NULL;
+	foreach_ptr(searchClause, stripeReadState->sortedSearchClauses)
+	{
+		uint32 columnIndex = searchClause->columnIndex;
+		if (chunkSkipNodeArray == NULL || chunkSkipNodeArray[columnIndex] == NULL)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&chunkSkipNodeArray[columnIndex][stripeReadState->chunkGroupIndex];
+		bool chunkHasNulls = chunkSkipNode->hasStatistics ?
+							 chunkSkipNode->nullCount > 0 :
+							 chunkSkipNode->nullState != CHUNK_NULLS_NONE;
+
+		if (!chunkSkipNode->sortednessKnown || !chunkSkipNode->valuesSorted ||
+			chunkHasNulls || chunkSkipNode->rowCount != rowCount ||
+			(chunkGroupData->packedValueArray[columnIndex] == NULL &&
+			 chunkGroupData->valueArray[columnIndex] == NULL))
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(stripeReadState->tupleDescriptor, columnIndex);
+
+		switch (searchClause->strategyNumber)
+		{
+			case BTLessStrategyNumber:
+			{
+				endRow = Min(endRow, SortedChunkSearch(chunkGroupData, attributeForm,
+													   searchClause, rowCount, true));
+				break;
+			}
+
+			case BTLessEqualStrategyNumber:
+			{
+				endRow = Min(endRow, SortedChunkSearch(chunkGroupData, attributeForm,
+													   searchClause, rowCount, false));
+				break;
+			}
+
+			case BTEqualStrategyNumber:
+			{
+				startRow = Max(startRow, SortedChunkSearch(chunkGroupData, attributeForm,
+														   searchClause, rowCount, true));
+				endRow = Min(endRow, SortedChunkSearch(chunkGroupData, attributeForm,
+													   searchClause, rowCount, false));
+				break;
+			}
+
+			case BTGreaterEqualStrategyNumber:
+			{
+				startRow = Max(startRow, SortedChunkSearch(chunkGroupData, attributeForm,
+														   searchClause, rowCount, true));
+				break;
+			}
+
+			case BTGreaterStrategyNumber:
+			{
+				startRow = Max(startRow, SortedChunkSearch(chunkGroupData, attributeForm,
+														   searchClause, rowCount, false));
+				break;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+	endRow = Max(startRow, endRow);
+
+	uint32 rowsLeftOut = rowCount - (endRow - startRow);
+	if (rowsLeftOut == 0)
+	{
+		return;
+	}
+
+	/* row numbers of the rows read still follow from their position */
+	chunkGroupReadState->currentRow = startRow;
+	chunkGroupReadState->rowCount = endRow;
+
+	stripeReadState->currentRow += rowsLeftOut;
+	stripeReadState->statistics->rowsRemovedBySortedSearch += rowsLeftOut;
+}
+
+
+/*
+ * SortedChunkSearch returns the first of the rows of a sorted chunk without
+ * NULLs whose value is above the constant of the given clause, or if
+ * includeEqual, not below it, or rowCount if there is none.
+ */
+static uint32
+SortedChunkSearch(ChunkData *chunkData, Form_pg_attribute attributeForm,
+				  SortedSearchClause *searchClause, uint32 rowCount, bool includeEqual)
+{
+	uint32 columnIndex = searchClause->columnIndex;
+	const char *packedValues = chunkData->packedValueArray[columnIndex];
+	uint32 lowRow = 0;
+	uint32 highRow = rowCount;
+
+	while (lowRow < highRow)
+	{
+		uint32 middleRow = lowRow + (highRow - lowRow) / 2;
+		Datum value = packedValues != NULL ?
+					  fetch_att(packedValues + attributeForm->attlen * middleRow,
+								attributeForm->attbyval, attributeForm->attlen) :
+					  chunkData->valueArray[columnIndex][middleRow];
+
+		int32 comparison =
+			DatumGetInt32(FunctionCall2Coll(&searchClause->comparisonFunction,
+											InvalidOid, value,
+											searchClause->constValue));
+
+		if (comparison > 0 || (includeEqual && comparison == 0))
+		{
+			highRow = middleRow;
+		}
+		else
+		{
+			lowRow = middleRow + 1;
+		}
+	}
+
+	return lowRow;
+}
+
+
+/*
+ * StripeReadChunkRowMask returns the row mask of the chunk group of the
+ * stripe being read with given first row number and row count. The row masks
+ * of the whole stripe are fetched in one scan on first use, instead of one
+ * scan per chunk group, unless an earlier statement of the transaction read
+ * them with the same snapshot.
+ */
+static bytea *
+StripeReadChunkRowMask(StripeReadState *stripeReadState, uint64 chunkFirstRowNumber,
+					   int rowCount)
+{
+	if (stripeReadState->stripeRowMasks == NULL)
+	{
+		RelFileNode relfilenode = stripeReadState->relation->rd_node;
+		uint64 storageId = LookupStorageId(relfilenode);
+
+		stripeReadState->stripeRowMasks =
+			TransactionReadCacheLookupRowMasks(storageId,
+											   stripeReadState->stripeFirstRowNumber,
+											   stripeReadState->snapshot,
+											   stripeReadState->stripeReadContext);
+
+		if (stripeReadState->stripeRowMasks == NULL)
+		{
+			stripeReadState->stripeRowMasks =
+				ReadStripeRowMasks(relfilenode, stripeReadState->stripeReadContext,
+								   stripeReadState->stripeFirstRowNumber,
+								   stripeReadState->stripeRowCount);
+
+			TransactionReadCacheStoreRowMasks(storageId,
+											  stripeReadState->stripeFirstRowNumber,
+											  stripeReadState->snapshot,
+											  stripeReadState->stripeRowMasks);
+		}
+	}
+
+	return StripeChunkRowMask(stripeReadState->stripeRowMasks,
+							  stripeReadState->stripeReadContext,
+							  chunkFirstRowNumber, rowCount);
+}
+
+
+/*
+ * StartChunkGroupPrefetch starts decompressing the value streams of the chunk
+ * group after the current one in the helper thread of the stripe read, if
+ * columnar.enable_decompression_thread is set. Only streams compressed with
+ * lz4 or zstd without a dictionary are decompressed by the thread, and none
+ * are while the column cache is enabled, as it keeps its own copies.
+ */
+static void
+StartChunkGroupPrefetch(StripeReadState *stripeReadState)
+{
+	StripeBuffers *stripeBuffers = stripeReadState->stripeBuffers;
+	int chunkIndex = stripeReadState->chunkGroupIndex + 1;
+
+	if (!columnar_enable_decompression_thread || columnar_enable_page_cache ||
+		chunkIndex >= stripeBuffers->selectedChunkGroupCount)
+	{
+		return;
+	}
+
+	/* streaming reads need the chunks of the next chunk group to be loaded */
+	LoadStreamedChunkGroup(stripeReadState, chunkIndex);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadState->stripeReadContext);
+
+	if (stripeReadState->decompressionThread == NULL)
+	{
+		int columnCount = stripeReadState->columnCount;
+
+		stripeReadState->decompressionThread = CreateDecompressionThread();
+		stripeReadState->prefetchJobs = palloc0(columnCount * sizeof(DecompressionJob));
+		stripeReadState->prefetchJobColumns = palloc0(columnCount * sizeof(uint32));
+		stripeReadState->prefetchBufferArray = palloc0(columnCount * sizeof(StringInfo));
+		stripeReadState->columnPrefetched = palloc0(columnCount * sizeof(bool));
+	}
+
+	uint32 jobCount = 0;
+
+	for (uint32 columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		if (columnBuffers == NULL)
+		{
+			continue;
+		}
+
+		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
+		if (chunkBuffers->compressionDictionaryId != 0 ||
+			!ConcurrentCompressionSupported(chunkBuffers->valueCompressionType))
+		{
+			continue;
+		}
+
+		if (stripeReadState->prefetchBufferArray[columnIndex] == NULL)
+		{
+			stripeReadState->prefetchBufferArray[columnIndex] = makeStringInfo();
+		}
+
+		DecompressionJob *job = &stripeReadState->prefetchJobs[jobCount];
+		job->inputBuffer = chunkBuffers->valueBuffer;
+		job->outputBuffer = stripeReadState->prefetchBufferArray[columnIndex];
+		job->compressionType = chunkBuffers->valueCompressionType;
+		job->decompressedSize = chunkBuffers->decompressedValueSize;
+
+		stripeReadState->prefetchJobColumns[jobCount] = columnIndex;
+		jobCount++;
+	}
+
+	if (jobCount > 0 &&
+		StartDecompressionJobs(stripeReadState->decompressionThread,
+							   stripeReadState->prefetchJobs, jobCount))
+	{
+		stripeReadState->prefetchJobCount = jobCount;
+		stripeReadState->prefetchChunkGroupIndex = chunkIndex;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ConsumeChunkGroupPrefetch waits for the helper thread of the stripe read.
+ * If it decompressed the chunk group about to be read, its buffers are
+ * swapped into decompressionBufferArray for DeserializeChunkColumn to use,
+ * and the buffers of the previous chunk group are decompressed into next.
+ */
+static void
+ConsumeChunkGroupPrefetch(StripeReadState *stripeReadState)
+{
+	if (stripeReadState->decompressionThread == NULL)
+	{
+		return;
+	}
+
+	FinishDecompressionJobs(stripeReadState->decompressionThread);
+
+	memset(stripeReadState->columnPrefetched, false,
+		   stripeReadState->columnCount * sizeof(bool));
+	stripeReadState->prefetchedChunkGroupIndex = stripeReadState->chunkGroupIndex;
+
+	for (uint32 jobIndex = 0; jobIndex < stripeReadState->prefetchJobCount; jobIndex++)
+	{
+		DecompressionJob *job = &stripeReadState->prefetchJobs[jobIndex];
+		uint32 columnIndex = stripeReadState->prefetchJobColumns[jobIndex];
+
+		if (!job->decompressed ||
+			stripeReadState->prefetchChunkGroupIndex != stripeReadState->chunkGroupIndex)
+		{
+			continue;
+		}
+
+		StringInfo previousBuffer = stripeReadState->decompressionBufferArray[columnIndex];
+		stripeReadState->decompressionBufferArray[columnIndex] = job->outputBuffer;
+		stripeReadState->prefetchBufferArray[columnIndex] = previousBuffer;
+		stripeReadState->columnPrefetched[columnIndex] = true;
+
+		DecompressionStatistics *decompression =
+			&stripeReadState->statistics->decompression[job->compressionType];
+		decompression->chunkCount++;
+		decompression->compressedBytes += job->inputBuffer->len;
+		decompression->decompressedBytes += job->outputBuffer->len;
+		decompression->elapsedMicroseconds += job->elapsedMicroseconds;
+	}
+
+	stripeReadState->prefetchJobCount = 0;
+}
+
+
+/*
+ * BeginChunkGroupRead allocates state for reading a chunk. For vectorized
+ * reads, the chunks of the columns are deserialized as vectors need them,
+ * and fixed length values are left packed as they are stored.
+ */
+static ChunkGroupReadState *
+BeginChunkGroupRead(StripeBuffers *stripeBuffers, int chunkIndex, TupleDesc tupleDesc,
+					List *projectedColumnList, MemoryContext cxt, StripeReadState *state, uint64 stripeId,
+					bool vectorRead)
+{
+	uint32 chunkGroupRowCount =
+		stripeBuffers->selectedChunkGroupRowCounts[chunkIndex];
+	uint32 chunkGroupRowOffset =
+		stripeBuffers->selectedChunkGroupRowOffset[chunkIndex];
+	uint32 chunkGroupDeletedRows =
+		stripeBuffers->selectedChunkGroupDeletedRows[chunkIndex];
+
+	MemoryContext oldContext = MemoryContextSwitchTo(cxt);
+	ChunkGroupReadState *chunkGroupReadState = palloc0(sizeof(ChunkGroupReadState));
+
+	chunkGroupReadState->currentRow = 0;
+	chunkGroupReadState->rowCount = chunkGroupRowCount;
+	chunkGroupReadState->chunkStripeRowOffset = chunkGroupRowOffset;
+	chunkGroupReadState->chunkGroupDeletedRows = chunkGroupDeletedRows;
+	chunkGroupReadState->columnCount = tupleDesc->natts;
+	chunkGroupReadState->projectedColumnList = projectedColumnList;
+	chunkGroupReadState->tupleDescriptor = tupleDesc;
+
+	state->statistics->chunkGroupsRead++;
+	state->statistics->rowsRemovedByRowMask += chunkGroupDeletedRows;
+
+	LoadStreamedChunkGroup(state, chunkIndex);
+
+	chunkGroupReadState->chunkGroupData = DeserializeChunkData(stripeBuffers, chunkIndex,
+															   chunkGroupRowCount,
+															   tupleDesc,
+															   projectedColumnList, state, stripeId,
+															   vectorRead);
+
+	if (vectorRead)
+	{
+		chunkGroupReadState->packedValueIndex = palloc0(tupleDesc->natts * sizeof(uint32));
+		chunkGroupReadState->columnDeserialized = palloc0(tupleDesc->natts * sizeof(bool));
+		chunkGroupReadState->stripeReadState = state;
+		chunkGroupReadState->chunkIndex = chunkIndex;
+		chunkGroupReadState->stripeId = stripeId;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return chunkGroupReadState;
+}
+
+
+/*
+ * EndChunkRead finishes a chunk read.
+ */
+static void
+EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState)
+{
+	/* the chunk data belongs to the decode buffers of the read */
+	FreeChunkBufferValueArray(chunkGroupReadState->chunkGroupData);
+	if (chunkGroupReadState->rowMask != NULL && !chunkGroupReadState->rowMaskCached)
+		pfree(chunkGroupReadState->rowMask);
+	chunkGroupReadState->rowMask = NULL;
+	if (chunkGroupReadState->packedValueIndex != NULL)
+		pfree(chunkGroupReadState->packedValueIndex);
+	if (chunkGroupReadState->columnDeserialized != NULL)
+		pfree(chunkGroupReadState->columnDeserialized);
+	if (chunkGroupReadState->selectedRows != NULL)
+		pfree(chunkGroupReadState->selectedRows);
+	pfree(chunkGroupReadState);
+}
+
+
+/*
+ * ReadChunkGroupNextRow: if more rows can be read from the current chunk
+ * group, fill in non-NULL columnValues and return true. Otherwise, return
+ * false.
+ *
+ * On entry, all entries in columnNulls should be true; this function only
+ * sets non-NULL entries.
+ */
+static bool
+ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
+					  bool *columnNulls, int32 *deletedColumnsNumber)
+{
+	/*
+	 * Initialize to all-NULL. Only non-NULL projected attributes will be set.
+	 */
+	memset(columnNulls, true, sizeof(bool) * chunkGroupReadState->columnCount);
+
+	while (chunkGroupReadState->currentRow < chunkGroupReadState->rowCount)
+	{
+		if (chunkGroupReadState->rowMask != NULL &&
+			chunkGroupReadState->currentRow >= chunkGroupReadState->liveUntilRow &&
+			chunkGroupReadState->currentRow % ROW_MASK_WORD_ROWS == 0 &&
+			chunkGroupReadState->currentRow + ROW_MASK_WORD_ROWS <=
+			chunkGroupReadState->rowCount)
+		{
+			uint64 deletedWord = ChunkRowMaskWord(chunkGroupReadState->rowMask,
+												  chunkGroupReadState->currentRow);
+
+			if (deletedWord == ~UINT64CONST(0))
+			{
+				chunkGroupReadState->currentRow += ROW_MASK_WORD_ROWS;
+				*deletedColumnsNumber += ROW_MASK_WORD_ROWS;
+				continue;
+			}
+			else if (deletedWord == 0)
+			{
+				chunkGroupReadState->liveUntilRow =
+					chunkGroupReadState->currentRow + ROW_MASK_WORD_ROWS;
+			}
+		}
+
+		if (chunkGroupReadState->rowMask != NULL &&
+			chunkGroupReadState->currentRow >= chunkGroupReadState->liveUntilRow)
+		{
+			int8 checkColumnMask = 1 << (chunkGroupReadState->currentRow % 8);
+			int8 checkLookupMask = VARDATA(chunkGroupReadState->rowMask)[chunkGroupReadState->currentRow / 8 ];
+
+			if (checkLookupMask & checkColumnMask)
+			{
+				chunkGroupReadState->currentRow++;
+				*deletedColumnsNumber += 1;
+				continue;
+			}
+		}
+
+		int attno;
+		foreach_int(attno, chunkGroupReadState->projectedColumnList)
+		{
+			const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
+			const int rowIndex = chunkGroupReadState->currentRow;
+
+			/* attno is 1-indexed; existsArray is 0-indexed */
+			const uint32 columnIndex = attno - 1;
+
+			const char *packedValues = chunkGroupData->packedValueArray[columnIndex];
+
+			if (packedValues != NULL)
+			{
+				/* packed for row reads only when no row is NULL */
+				Form_pg_attribute attributeForm =
+					TupleDescAttr(chunkGroupReadState->tupleDescriptor, columnIndex);
+
+				columnValues[columnIndex] =
+					fetch_att(packedValues + attributeForm->attlen * rowIndex,
+							  attributeForm->attbyval, attributeForm->attlen);
+				columnNulls[columnIndex] = false;
+			}
+			else if (chunkGroupData->existsArray[columnIndex][rowIndex])
+			{
+				columnValues[columnIndex] = chunkGroupData->valueArray[columnIndex][rowIndex];
+				columnNulls[columnIndex] = false;
+			}
+		}
+
+		chunkGroupReadState->currentRow++;
+		return true;
+	}
+
+	return false;
+
+}
+
+
+/*
+ * ColumnarSetVectorQual makes the vectorized reads of the scan evaluate vector
+ * quals while they fill vectors. Each element of stageColumnLists is the
+ * integer list of the attribute numbers that a stage of the quals reads, and
+ * qualFunc(qualState, stage, vectorSize) evaluates that stage once its
+ * columns are filled, returning the number of rows that passed the stages so
+ * far. The columns of later stages are only read for vectors with such rows.
+ * A NULL qualFunc removes the vector quals.
+ */
+void
+ColumnarSetVectorQual(ColumnarReadState *readState, List *stageColumnLists,
+					  ColumnarVectorQualFunc qualFunc, void *qualState)
+{
+	/* the quals set before are freed with the scan context */
+	readState->vectorQual = NULL;
+
+	if (qualFunc == NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	ColumnarVectorQual *vectorQual = palloc0(sizeof(ColumnarVectorQual));
+
+	List *stageColumnList = NIL;
+	foreach_ptr(stageColumnList, stageColumnLists)
+	{
+		/* only projected columns have stripe buffers to read */
+		List *stageProjectedColumnList = NIL;
+
+		int attno;
+		foreach_int(attno, stageColumnList)
+		{
+			if (list_member_int(readState->projectedColumnList, attno))
+			{
+				stageProjectedColumnList = lappend_int(stageProjectedColumnList, attno);
+			}
+		}
+
+		vectorQual->stageColumnLists = lappend(vectorQual->stageColumnLists,
+											   stageProjectedColumnList);
+	}
+
+	vectorQual->qualFunc = qualFunc;
+	vectorQual->qualState = qualState;
+	vectorQual->columnRead = palloc0(readState->tupleDescriptor->natts * sizeof(bool));
+
+	readState->vectorQual = vectorQual;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarSetRowBound tells a sequential read that it is expected to return
+ * at most rowBound rows, for instance because of a LIMIT. Stripes are then
+ * loaded a few chunk groups at a time, starting with the chunk groups that
+ * hold rowBound rows, instead of all at once. A rowBound of 0 loads whole
+ * stripes.
+ */
+void
+ColumnarSetRowBound(ColumnarReadState *readState, uint64 rowBound)
+{
+	readState->rowBound = rowBound;
+
+	/* the first stripe to read is chosen when the read begins */
+	if (!StripeReadInProgress(readState))
+	{
+		readState->stripeRowTarget = rowBound;
+	}
+}
+
+
+/*
+ * ColumnarSetTopNBound makes a sequential read leave out the chunk groups
+ * whose rows all sort after the given bound, see ColumnarTopNBound. The bound
+ * gets tighter as the scan returns rows, so unless the read has a row bound,
+ * stripes are loaded in parts as if it had one of the size of the sort, and
+ * each part is filtered with the bound at the time it is loaded.
+ */
+void
+ColumnarSetTopNBound(ColumnarReadState *readState, ColumnarTopNBound *bound)
+{
+	readState->topNBound = bound;
+
+	if (readState->rowBound == 0)
+	{
+		ColumnarSetRowBound(readState, bound->rowCount);
+	}
+}
+
+
+/*
+ * ColumnarSetJoinKeyFilter makes a sequential read leave out the chunk groups
+ * none of whose join keys are in the given filter, see ColumnarJoinKeyFilter.
+ * Stripes loaded before the filter has its keys are read as they are.
+ */
+void
+ColumnarSetJoinKeyFilter(ColumnarReadState *readState, ColumnarJoinKeyFilter *filter)
+{
+	readState->joinKeyFilter = filter;
+}
+
+
+/*
+ * CreateChunkGroupSummary returns an empty chunk group summary for the
+ * columns of the given tuple descriptor, for chunk groups whose rows must all
+ * pass qualList. The attribute numbers in sketchColumns also get distinct
+ * value sketches.
+ */
+ChunkGroupSummary *
+CreateChunkGroupSummary(TupleDesc tupleDescriptor, List *qualList, List *sketchColumns)
+{
+	uint32 columnCount = tupleDescriptor->natts;
+
+	ChunkGroupSummary *summary = palloc0(sizeof(ChunkGroupSummary));
+	summary->qualList = qualList;
+	summary->qualVars = GetClauseVars(qualList, columnCount);
+	summary->columnCount = columnCount;
+	summary->valueCount = palloc0(columnCount * sizeof(uint64));
+	summary->minMaxValues = palloc0(columnCount * sizeof(Datum *));
+	summary->minMaxValueCount = palloc0(columnCount * sizeof(uint32));
+	summary->minMaxCapacity = palloc0(columnCount * sizeof(uint32));
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		/* skip list values of other types are freed with their stripe */
+		if (!attributeForm->attisdropped && attributeForm->attbyval)
+		{
+			summary->minMaxCapacity[columnIndex] = 16;
+			summary->minMaxValues[columnIndex] = palloc(16 * sizeof(Datum));
+		}
+	}
+
+	summary->sketchRegisters = palloc0(columnCount * sizeof(uint8 *));
+
+	int attno = 0;
+	foreach_int(attno, sketchColumns)
+	{
+		summary->sketchColumns = bms_add_member(summary->sketchColumns, attno);
+		summary->sketchRegisters[attno - 1] = palloc0(COLUMNAR_HLL_REGISTERS);
+	}
+
+	return summary;
+}
+
+
+/*
+ * ResetChunkGroupSummary empties the given chunk group summary, for a scan
+ * that starts over.
+ */
+void
+ResetChunkGroupSummary(ChunkGroupSummary *summary)
+{
+	summary->chunkGroupCount = 0;
+	summary->rowCount = 0;
+
+	memset(summary->valueCount, 0, summary->columnCount * sizeof(uint64));
+	memset(summary->minMaxValueCount, 0, summary->columnCount * sizeof(uint32));
+
+	int attno = -1;
+	while ((attno = bms_next_member(summary->sketchColumns, attno)) >= 0)
+	{
+		memset(summary->sketchRegisters[attno - 1], 0, COLUMNAR_HLL_REGISTERS);
+	}
+}
+
+
+/*
+ * ColumnarSetChunkGroupSummary makes a sequential read leave out the chunk
+ * groups whose rows all pass the quals of the summary, and have no deleted
+ * rows, and add their statistics to the summary instead. The caller must be
+ * an aggregate that only needs the number of rows of the projected columns
+ * with a value, and their min/max values.
+ */
+void
+ColumnarSetChunkGroupSummary(ColumnarReadState *readState, ChunkGroupSummary *summary)
+{
+	readState->chunkGroupSummary = summary;
+}
+
+
+/*
+ * CreateChunkGroupDelete returns a delete of the chunk groups whose rows all
+ * pass qualList, for the columns of the given tuple descriptor.
+ */
+ColumnarChunkGroupDelete *
+CreateChunkGroupDelete(TupleDesc tupleDescriptor, List *qualList)
+{
+	ColumnarChunkGroupDelete *chunkGroupDelete = palloc0(sizeof(ColumnarChunkGroupDelete));
+	chunkGroupDelete->qualList = qualList;
+	chunkGroupDelete->qualVars = GetClauseVars(qualList, tupleDescriptor->natts);
+
+	return chunkGroupDelete;
+}
+
+
+/*
+ * ColumnarSetChunkGroupDelete makes a sequential read mark the rows of the
+ * chunk groups whose rows all pass the quals of the delete deleted, and leave
+ * them out of the read. The caller must be a DELETE with these quals that
+ * deletes each row it reads, and nothing else has to see the deleted rows.
+ */
+void
+ColumnarSetChunkGroupDelete(ColumnarReadState *readState,
+							ColumnarChunkGroupDelete *chunkGroupDelete)
+{
+	readState->chunkGroupDelete = chunkGroupDelete;
+}
+
+
+/*
+ * CreateStripeProjectionSummary returns an empty projection summary whose
+ * groups are merged by the given group by columns, with the counts of the
+ * given count columns and the counts and sums of the given sum columns, for
+ * rows that must pass qualList. The columns are lists of attribute numbers.
+ */
+StripeProjectionSummary *
+CreateStripeProjectionSummary(List *groupColumns, List *sumColumns, List *countColumns,
+							  List *qualList, int natts)
+{
+	StripeProjectionSummary *summary = palloc0(sizeof(StripeProjectionSummary));
+	summary->qualList = qualList;
+	summary->qualVars = GetClauseVars(qualList, natts);
+
+	Assert(list_length(groupColumns) <= PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM);
+
+	int attnum = 0;
+	foreach_int(attnum, groupColumns)
+	{
+		summary->groupAttnums[summary->groupCount++] = attnum;
+	}
+
+	Bitmapset *measureColumns = NULL;
+	foreach_int(attnum, sumColumns)
+	{
+		summary->sumColumns = bms_add_member(summary->sumColumns, attnum);
+		measureColumns = bms_add_member(measureColumns, attnum);
+	}
+
+	foreach_int(attnum, countColumns)
+	{
+		measureColumns = bms_add_member(measureColumns, attnum);
+	}
+
+	summary->measureAttnums = palloc0(Max(bms_num_members(measureColumns), 1) *
+									  sizeof(AttrNumber));
+
+	attnum = -1;
+	while ((attnum = bms_next_member(measureColumns, attnum)) >= 0)
+	{
+		summary->measureAttnums[summary->measureCount++] = attnum;
+	}
+
+	summary->context = AllocSetContextCreate(CurrentMemoryContext,
+											 "Columnar Stripe Projection Summary",
+											 ALLOCSET_DEFAULT_SIZES);
+	ResetStripeProjectionSummary(summary);
+
+	return summary;
+}
+
+
+/*
+ * ResetStripeProjectionSummary empties the given projection summary, for a
+ * scan that starts over.
+ */
+void
+ResetStripeProjectionSummary(StripeProjectionSummary *summary)
+{
+	MemoryContextReset(summary->context);
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = STRIPE_PROJECTION_GROUP_KEY_SIZE;
+	info.entrysize = STRIPE_PROJECTION_GROUP_SIZE(summary->measureCount);
+	info.hcxt = summary->context;
+
+	summary->groups = hash_create("Columnar Stripe Projection Summary Groups", 256,
+								  &info, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	summary->stripeCount = 0;
+}
+
+
+/*
+ * ColumnarSetStripeProjectionSummary makes a sequential read leave out the
+ * stripes whose projection has the groups of the summary, and add them to
+ * the summary instead. The caller must be an aggregate that only needs the
+ * number of rows of each group, and the counts and sums of the summary's
+ * columns. The read may have already picked its first stripe, which is
+ * checked again.
+ */
+void
+ColumnarSetStripeProjectionSummary(ColumnarReadState *readState,
+								   StripeProjectionSummary *summary)
+{
+	readState->projectionSummary = summary;
+
+	if (summary != NULL && HasUnreadStripe(readState) &&
+		!StripeReadInProgress(readState))
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+		SkipStripesNotToRead(readState);
+		MemoryContextReset(readState->stripeReadContext);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+}
+
+
+/*
+ * ColumnarAddScanQual adds the given clauses to the clauses that the read
+ * skips stripes and chunk groups with. The read keeps reading the chunk groups
+ * it already selected in the current stripe, so the clauses only take effect
+ * from the next stripe on. The caller must still filter the rows it gets.
+ */
+void
+ColumnarAddScanQual(ColumnarReadState *readState, List *clauseList)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	readState->whereClauseList = list_concat(list_copy(readState->whereClauseList),
+											 copyObject(clauseList));
+	readState->whereClauseVars = GetClauseVars(readState->whereClauseList,
+											   readState->tupleDescriptor->natts);
+	readState->allowedBucketsValid = false;
+
+	/* the leader didn't know about these */
+	readState->stripesPrunedByLeader = false;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarChunkGroupReadFraction estimates which fraction of the rows of the
+ * given relation a scan with the given clauses reads, by finding the chunk
+ * groups that the clauses refute with their skip list statistics. On tables
+ * with many stripes, only CHUNK_GROUP_ESTIMATE_MAX_STRIPES stripes spread
+ * over the table are checked, to keep planning cheap.
+ */
+double
+ColumnarChunkGroupReadFraction(Relation relation, List *whereClauseList)
+{
+	if (whereClauseList == NIL)
+	{
+		return 1.0;
+	}
+
+	MemoryContext estimateContext = AllocSetContextCreate(CurrentMemoryContext,
+														  "Columnar Chunk Group Estimate",
+														  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(estimateContext);
+
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	List *whereClauseVars = GetClauseVars(whereClauseList, tupleDescriptor->natts);
+	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+
+	/* only the chunk metadata of the columns of the clauses is needed */
+	bool *skipListColumnMask =
+		SkipListColumnMask(tupleDescriptor->natts,
+						   ProjectedColumnMask(tupleDescriptor->natts, NIL),
+						   whereClauseVars, NULL, NULL);
+
+	int stripeCount = list_length(stripeList);
+	int stripeStep = (stripeCount + CHUNK_GROUP_ESTIMATE_MAX_STRIPES - 1) /
+					 CHUNK_GROUP_ESTIMATE_MAX_STRIPES;
+
+	uint64 totalRowCount = 0;
+	uint64 selectedRowCount = 0;
+	for (int stripeIndex = 0; stripeIndex < stripeCount; stripeIndex += stripeStep)
+	{
+		StripeMetadata *stripeMetadata = list_nth(stripeList, stripeIndex);
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED ||
+			stripeMetadata->chunkCount == 0)
+		{
+			continue;
+		}
+
+		StripeSkipList *stripeSkipList =
+			ReadStripeSkipListColumns(relation->rd_node, stripeMetadata->id,
+									  tupleDescriptor, stripeMetadata->chunkCount,
+									  GetTransactionSnapshot(), skipListColumnMask);
+
+		int64 chunkGroupsFiltered = 0;
+		bool *selectedChunkMask = SelectedChunkMask(stripeSkipList, whereClauseList,
+													whereClauseVars,
+													&chunkGroupsFiltered);
+
+		for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			uint32 chunkGroupRowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+
+			totalRowCount += chunkGroupRowCount;
+			if (selectedChunkMask[chunkIndex])
+			{
+				selectedRowCount += chunkGroupRowCount;
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(estimateContext);
+
+	if (totalRowCount == 0)
+	{
+		return 1.0;
+	}
+
+	return selectedRowCount / (double) totalRowCount;
+}
+
+
+/*
+ * ColumnarReadChunkGroupsFiltered
+ *
+ * Return the number of chunk groups filtered during this read operation.
+ */
+int64
+ColumnarReadChunkGroupsFiltered(ColumnarReadState *state)
+{
+	return state->chunkGroupsFiltered;
+}
+
+
+/*
+ * ColumnarReadGetStatistics returns what the given read did so far, across
+ * rescans.
+ */
+const ColumnarReadStatistics *
+ColumnarReadGetStatistics(ColumnarReadState *state)
+{
+	return &state->statistics;
+}
+
+
+/*
+ * AddColumnarReadStatistics adds the given read statistics to total.
+ */
+void
+AddColumnarReadStatistics(ColumnarReadStatistics *total,
+						  const ColumnarReadStatistics *statistics)
+{
+	total->stripesRead += statistics->stripesRead;
+	total->stripesSkipped += statistics->stripesSkipped;
+	total->chunkGroupsRead += statistics->chunkGroupsRead;
+	total->chunkGroupsSkipped += statistics->chunkGroupsSkipped;
+	total->bytesRead += statistics->bytesRead;
+	total->rowsRemovedByRowMask += statistics->rowsRemovedByRowMask;
+	total->rowsRemovedBySortedSearch += statistics->rowsRemovedBySortedSearch;
+	total->cacheHits += statistics->cacheHits;
+	total->cacheMisses += statistics->cacheMisses;
+	total->rowsRead += statistics->rowsRead;
+	total->vectorRowsRead += statistics->vectorRowsRead;
+	total->peakMemoryBytes = Max(total->peakMemoryBytes, statistics->peakMemoryBytes);
+
+	for (int compressionType = 0; compressionType < COMPRESSION_COUNT; compressionType++)
+	{
+		DecompressionStatistics *totalDecompression = &total->decompression[compressionType];
+		const DecompressionStatistics *decompression =
+			&statistics->decompression[compressionType];
+
+		totalDecompression->chunkCount += decompression->chunkCount;
+		totalDecompression->compressedBytes += decompression->compressedBytes;
+		totalDecompression->decompressedBytes += decompression->decompressedBytes;
+		totalDecompression->elapsedMicroseconds += decompression->elapsedMicroseconds;
+	}
+}
+
+
+/*
+ * CreateEmptyChunkDataArray creates data buffers to keep deserialized exist and
+ * value arrays for requested columns in columnMask.
+ */
+ChunkData *
+CreateEmptyChunkData(uint32 columnCount, bool *columnMask, uint32 chunkGroupRowCount)
+{
+	uint32 columnIndex = 0;
+
+	ChunkData *chunkData = palloc0(sizeof(ChunkData));
+	chunkData->existsArray = palloc0(columnCount * sizeof(bool *));
+	chunkData->valueArray = palloc0(columnCount * sizeof(Datum *));
+	chunkData->valueBufferArray = palloc0(columnCount * sizeof(StringInfo));
+	chunkData->valueEncodingArray = palloc0(columnCount * sizeof(ValueEncodingType));
+	chunkData->nullStateArray = palloc0(columnCount * sizeof(ChunkNullState));
+	chunkData->packedValueArray = palloc0(columnCount * sizeof(char *));
+	chunkData->columnCount = columnCount;
+	chunkData->rowCount = chunkGroupRowCount;
+
+	/* allocate chunk memory for deserialized data */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (columnMask[columnIndex])
+		{
+			chunkData->existsArray[columnIndex] = palloc0(chunkGroupRowCount *
+														  sizeof(bool));
+			chunkData->valueArray[columnIndex] = palloc0(chunkGroupRowCount *
+														 sizeof(Datum));
+			chunkData->valueBufferArray[columnIndex] = NULL;
+		}
+	}
+
+	return chunkData;
+}
+
+
+/*
+ * FreeChunkData deallocates data buffers to keep deserialized exist and
+ * value arrays for requested columns in columnMask.
+ * ColumnChunkData->serializedValueBuffer lives in memory read/write context
+ * so it is deallocated automatically when the context is deleted.
+ */
+void
+FreeChunkData(ChunkData *chunkData)
+{
+	uint32 columnIndex = 0;
+
+	if (chunkData == NULL)
+	{
+		return;
+	}
+
+	for (columnIndex = 0; columnIndex < chunkData->columnCount; columnIndex++)
+	{
+		if (chunkData->existsArray[columnIndex] != NULL)
+		{
+			pfree(chunkData->existsArray[columnIndex]);
+		}
+
+		if (chunkData->valueArray[columnIndex] != NULL)
+		{
+			pfree(chunkData->valueArray[columnIndex]);
+		}
+	}
+
+	pfree(chunkData->existsArray);
+	pfree(chunkData->valueArray);
+	pfree(chunkData->valueEncodingArray);
+	pfree(chunkData->nullStateArray);
+	pfree(chunkData->packedValueArray);
+	pfree(chunkData);
+}
+
+
+/* FreeChunkValueArrayBuffer relase valueBufferArray memory. */
+void FreeChunkBufferValueArray(ChunkData *chunkData)
+{
+	uint32 columnIndex = 0;
+
+	if (chunkData == NULL)
+	{
+		return;
+	}
+
+	for (columnIndex = 0; columnIndex < chunkData->columnCount; columnIndex++)
+	{
+		if (chunkData->valueBufferArray[columnIndex] != NULL && !MemoryContextContains(ColumnarCacheMemoryContext(), chunkData->valueBufferArray[columnIndex]))
+		{
+			pfree(chunkData->valueBufferArray[columnIndex]->data);
+			pfree(chunkData->valueBufferArray[columnIndex]);
+		}
+	}
+}
+
+
+/*
+ * ColumnarTableRowCount returns the row count of a table, deleted rows
+ * included, from its cached stripe list summary.
+ */
+uint64
+ColumnarTableRowCount(Relation relation)
+{
+	return StripeListSummaryForRelation(relation).rowCount;
+}
+
+
+/*
+ * LoadFilteredStripeBuffers reads serialized stripe data from the given file.
+ * The function skips over chunks whose rows are refuted by restriction qualifiers,
+ * and only loads columns that are projected in the query. With a chunk group
+ * summary, chunks that it can answer from their statistics are skipped too,
+ * and with a join key filter, chunks none of whose keys the join matches.
+ * With a rescan cache, the skip list and the chunks loaded by earlier scans
+ * of the same stripe are taken from it. Streaming reads only set up the
+ * buffers of the chunk groups here and return the state to load them with in
+ * streamState, which is NULL otherwise.
+ */
+static StripeBuffers *
+LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
+						  TupleDesc tupleDescriptor, List *projectedColumnList,
+						  List *whereClauseList, List *whereClauseVars,
+						  int64 *chunkGroupsFiltered, Snapshot snapshot,
+						  BufferAccessStrategy accessStrategy,
+						  uint32 firstChunkGroup, uint32 endChunkGroup, uint64 rowTarget,
+						  uint64 memoryLimit, uint32 *nextChunkGroup,
+						  ChunkGroupSummary *chunkGroupSummary,
+						  ColumnarChunkGroupDelete *chunkGroupDelete,
+						  ColumnarTopNBound *topNBound,
+						  ColumnarJoinKeyFilter *joinKeyFilter,
+						  ColumnarReadStatistics *statistics,
+						  StripeRescanCache *rescanCache,
+						  StripeStreamState **streamState)
+{
+	uint32 columnIndex = 0;
+	uint32 columnCount = tupleDescriptor->natts;
+
+	bool *projectedColumnMask = ProjectedColumnMask(columnCount, projectedColumnList);
+	bool *skipListColumnMask = SkipListColumnMask(columnCount, projectedColumnMask,
+												  whereClauseVars, topNBound,
+												  joinKeyFilter);
+
+	StripeRescanCacheEntry *cacheEntry = RescanCacheEntry(rescanCache, relation,
+														  stripeMetadata,
+														  tupleDescriptor, snapshot,
+														  skipListColumnMask);
+	StripeSkipList *stripeSkipList = NULL;
+	if (cacheEntry != NULL)
+	{
+		stripeSkipList = cacheEntry->skipList;
+	}
+	else
+	{
+		stripeSkipList = ReadStripeSkipListColumns(relation->rd_node, stripeMetadata->id,
+												   tupleDescriptor,
+												   stripeMetadata->chunkCount, snapshot,
+												   skipListColumnMask);
+	}
+
+	/*
+	 * The filters also count the chunk groups outside the range being loaded,
+	 * so the filtered chunk groups are counted below instead.
+	 */
+	int64 chunkGroupsRemoved = 0;
+	bool *selectedChunkMask = SelectedChunkMask(stripeSkipList, whereClauseList,
+												whereClauseVars, &chunkGroupsRemoved);
+
+	if (topNBound != NULL)
+	{
+		FilterChunksByTopNBound(stripeSkipList, topNBound, selectedChunkMask,
+								&chunkGroupsRemoved);
+	}
+
+	*nextChunkGroup = LimitSelectedChunkGroups(stripeSkipList, selectedChunkMask,
+											   projectedColumnMask,
+											   firstChunkGroup, endChunkGroup,
+											   rowTarget, memoryLimit);
+
+	/* summarized before late materialization, which would read their columns */
+	uint32 chunkGroupsSummarized = 0;
+	if (chunkGroupSummary != NULL)
+	{
+		chunkGroupsSummarized = SummarizeCoveredChunkGroups(stripeSkipList,
+															selectedChunkMask,
+															firstChunkGroup,
+															*nextChunkGroup,
+															projectedColumnList,
+															chunkGroupSummary);
+	}
+
+	/* deleted chunk groups aren't read, but weren't filtered either */
+	if (chunkGroupDelete != NULL)
+	{
+		chunkGroupsSummarized += DeleteCoveredChunkGroups(relation, stripeMetadata,
+														  stripeSkipList,
+														  selectedChunkMask,
+														  firstChunkGroup,
+														  *nextChunkGroup,
+														  chunkGroupDelete);
+	}
+
+	if (columnar_enable_late_materialization)
+	{
+		FilterChunksByQualColumns(relation, stripeMetadata, stripeSkipList,
+								  tupleDescriptor, projectedColumnMask,
+								  whereClauseList, whereClauseVars,
+								  selectedChunkMask, &chunkGroupsRemoved,
+								  accessStrategy, statistics);
+	}
+
+	/* the join drops these rows, counted by the filter of the join instead */
+	if (columnar_enable_late_materialization && joinKeyFilter != NULL &&
+		joinKeyFilter->bloomFilter != NULL)
+	{
+		FilterChunksByJoinKeys(relation, stripeMetadata, stripeSkipList,
+							   tupleDescriptor, projectedColumnMask, joinKeyFilter,
+							   selectedChunkMask, accessStrategy, statistics);
+	}
+
+	for (uint32 chunkIndex = firstChunkGroup; chunkIndex < *nextChunkGroup; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex])
+		{
+			*chunkGroupsFiltered += 1;
+		}
+	}
+
+	/* summarized chunk groups aren't read, but weren't filtered either */
+	*chunkGroupsFiltered -= chunkGroupsSummarized;
+
+	StripeSkipList *selectedChunkSkipList =
+		SelectedChunkSkipList(stripeSkipList, projectedColumnMask,
+							  selectedChunkMask);
+
+	/* cached reads only read the chunks that aren't cached, so don't prefetch */
+	bool streamChunkGroups = columnar_enable_streaming_reads && cacheEntry == NULL;
+	StripePrefetchState *prefetchState = NULL;
+	if (cacheEntry == NULL)
+	{
+		prefetchState = BeginStripePrefetch(relation, stripeMetadata,
+											selectedChunkSkipList, projectedColumnMask,
+											streamChunkGroups);
+	}
+
+	*streamState = NULL;
+	if (streamChunkGroups)
+	{
+		StripeStreamState *stripeStreamState = palloc0(sizeof(StripeStreamState));
+		stripeStreamState->relation = relation;
+		stripeStreamState->tupleDescriptor = tupleDescriptor;
+		stripeStreamState->stripeOffset = stripeMetadata->fileOffset;
+		stripeStreamState->projectedColumnMask = projectedColumnMask;
+		stripeStreamState->selectedChunkSkipList = selectedChunkSkipList;
+		stripeStreamState->prefetchState = prefetchState;
+		stripeStreamState->accessStrategy = accessStrategy;
+		stripeStreamState->statistics = statistics;
+		stripeStreamState->chunkGroupLoaded =
+			palloc0(Max(selectedChunkSkipList->chunkCount, 1) * sizeof(bool));
+
+		*streamState = stripeStreamState;
+	}
+
+	/* load column data for projected columns */
+	ColumnBuffers **columnBuffersArray = palloc0(columnCount * sizeof(ColumnBuffers *));
+
+	for (columnIndex = 0; columnIndex < stripeMetadata->columnCount; columnIndex++)
+	{
+		if (projectedColumnMask[columnIndex])
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				selectedChunkSkipList->chunkSkipNodeArray[columnIndex];
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+			uint32 chunkCount = selectedChunkSkipList->chunkCount;
+
+			ColumnBuffers *columnBuffers = NULL;
+			if (streamChunkGroups)
+			{
+				/* the chunks are loaded by LoadStreamedChunkGroup */
+				columnBuffers = palloc0(sizeof(ColumnBuffers));
+				columnBuffers->chunkBuffersArray =
+					palloc0(Max(chunkCount, 1) * sizeof(ColumnChunkBuffers *));
+			}
+			else if (cacheEntry != NULL)
+			{
+				columnBuffers = LoadCachedColumnBuffers(relation, rescanCache,
+														cacheEntry, selectedChunkMask,
+														stripeMetadata->fileOffset,
+														attributeForm, accessStrategy,
+														statistics);
+			}
+			else
+			{
+				columnBuffers = LoadColumnBuffers(relation, chunkSkipNode, chunkCount,
+												  stripeMetadata->fileOffset,
+												  attributeForm, prefetchState,
+												  accessStrategy, statistics);
+			}
+
+			columnBuffersArray[columnIndex] = columnBuffers;
+		}
+	}
+
+	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
+	stripeBuffers->columnCount = columnCount;
+	stripeBuffers->rowCount = StripeSkipListRowCount(selectedChunkSkipList);
+	stripeBuffers->columnBuffersArray = columnBuffersArray;
+	stripeBuffers->selectedChunkGroupRowCounts =
+		selectedChunkSkipList->chunkGroupRowCounts;
+	stripeBuffers->selectedChunkGroupRowOffset =
+		selectedChunkSkipList->chunkGroupRowOffset;
+	stripeBuffers->selectedChunkGroupDeletedRows =
+		selectedChunkSkipList->chunkGroupDeletedRows;
+	stripeBuffers->selectedChunkGroupCount = selectedChunkSkipList->chunkCount;
+	stripeBuffers->selectedChunkSkipNodeArray = selectedChunkSkipList->chunkSkipNodeArray;
+
+	/* the column cache is keyed by the index of the chunk group in the stripe */
+	stripeBuffers->selectedChunkGroupIndex =
+		palloc0(Max(selectedChunkSkipList->chunkCount, 1) * sizeof(uint32));
+
+	uint32 selectedChunkIndex = 0;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (selectedChunkMask[chunkIndex])
+		{
+			stripeBuffers->selectedChunkGroupIndex[selectedChunkIndex++] = chunkIndex;
+		}
+	}
+
+	return stripeBuffers;
+}
+
+
+/*
+ * BeginRescanCache makes the read keep the stripes it loads in its rescan
+ * cache from its first rescan on, and empties the cache if the snapshot of
+ * the read or its command changed since the stripes were cached.
+ */
+static void
+BeginRescanCache(ColumnarReadState *readState)
+{
+	StripeRescanCache *rescanCache = &readState->rescanCache;
+	Snapshot snapshot = readState->snapshot;
+	bool cacheUsable = columnar_enable_rescan_cache && snapshot != NULL &&
+					   IsMVCCSnapshot(snapshot);
+
+	if (rescanCache->context != NULL &&
+		(!cacheUsable || rescanCache->snapshot != snapshot ||
+		 rescanCache->commandId != snapshot->curcid))
+	{
+		MemoryContextDelete(rescanCache->context);
+		rescanCache->context = NULL;
+		rescanCache->stripes = NULL;
+	}
+
+	if (!cacheUsable || rescanCache->context != NULL)
+	{
+		return;
+	}
+
+	rescanCache->context = AllocSetContextCreate(readState->scanContext,
+												 "Columnar Rescan Cache",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(StripeRescanCacheEntry);
+	info.hcxt = rescanCache->context;
+
+	rescanCache->stripes = hash_create("columnar rescan cache", 64, &info,
+									   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	rescanCache->snapshot = snapshot;
+	rescanCache->commandId = snapshot->curcid;
+}
+
+
+/*
+ * ReadRescanCache returns the rescan cache of the read, or NULL if the read
+ * wasn't rescanned or its snapshot changed since.
+ */
+static StripeRescanCache *
+ReadRescanCache(ColumnarReadState *readState)
+{
+	StripeRescanCache *rescanCache = &readState->rescanCache;
+
+	if (rescanCache->context == NULL ||
+		rescanCache->snapshot != readState->snapshot ||
+		rescanCache->commandId != readState->snapshot->curcid)
+	{
+		return NULL;
+	}
+
+	return rescanCache;
+}
+
+
+/*
+ * RescanCacheEntry returns the entry of the given stripe in the rescan cache,
+ * reading the skip nodes of the columns in skipListColumnMask into the cache
+ * if it isn't there yet. Returns NULL without a rescan cache, if the cache is
+ * full and doesn't have the stripe, or if the entry lacks some of the columns,
+ * e.g. of quals added since it was read.
+ */
+static StripeRescanCacheEntry *
+RescanCacheEntry(StripeRescanCache *rescanCache, Relation relation,
+				 StripeMetadata *stripeMetadata, TupleDesc tupleDescriptor,
+				 Snapshot snapshot, const bool *skipListColumnMask)
+{
+	if (rescanCache == NULL)
+	{
+		return NULL;
+	}
+
+	StripeRescanCacheEntry *cacheEntry = hash_search(rescanCache->stripes,
+													 &stripeMetadata->id,
+													 HASH_FIND, NULL);
+	if (cacheEntry != NULL)
+	{
+		return SkipListHasColumns(cacheEntry->skipList, skipListColumnMask) ?
+			   cacheEntry : NULL;
+	}
+
+	if (MemoryContextMemAllocated(rescanCache->context, true) >=
+		(Size) work_mem * 1024L)
+	{
+		return NULL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(rescanCache->context);
+
+	StripeSkipList *skipList = ReadStripeSkipListColumns(relation->rd_node,
+														 stripeMetadata->id,
+														 tupleDescriptor,
+														 stripeMetadata->chunkCount,
+														 snapshot, skipListColumnMask);
+	ColumnChunkBuffers ***chunkBuffers =
+		palloc0(tupleDescriptor->natts * sizeof(ColumnChunkBuffers **));
+
+	MemoryContextSwitchTo(oldContext);
+
+	cacheEntry = hash_search(rescanCache->stripes, &stripeMetadata->id, HASH_ENTER,
+							 NULL);
+	cacheEntry->skipList = skipList;
+	cacheEntry->chunkBuffers = chunkBuffers;
+
+	return cacheEntry;
+}
+
+
+/*
+ * LoadCachedColumnBuffers returns the buffers of the selected chunks of a
+ * column, like LoadColumnBuffers does for the selected chunk skip list, but
+ * takes the chunks loaded before from the entry of the stripe in the rescan
+ * cache and only reads the others. The chunks it reads are added to the entry
+ * while the cache has room for them.
+ */
+static ColumnBuffers *
+LoadCachedColumnBuffers(Relation relation, StripeRescanCache *rescanCache,
+						StripeRescanCacheEntry *cacheEntry, bool *selectedChunkMask,
+						uint64 stripeOffset, Form_pg_attribute attributeForm,
+						BufferAccessStrategy accessStrategy,
+						ColumnarReadStatistics *statistics)
+{
+	uint32 columnIndex = attributeForm->attnum - 1;
+	uint32 chunkCount = cacheEntry->skipList->chunkCount;
+	ColumnChunkSkipNode *chunkSkipNodeArray =
+		cacheEntry->skipList->chunkSkipNodeArray[columnIndex];
+
+	if (cacheEntry->chunkBuffers[columnIndex] == NULL)
+	{
+		cacheEntry->chunkBuffers[columnIndex] =
+			MemoryContextAllocZero(rescanCache->context,
+								   Max(chunkCount, 1) * sizeof(ColumnChunkBuffers *));
+	}
+
+	ColumnChunkBuffers **cachedChunkBuffers = cacheEntry->chunkBuffers[columnIndex];
+
+	ColumnChunkSkipNode *missingSkipNodeArray =
+		palloc(Max(chunkCount, 1) * sizeof(ColumnChunkSkipNode));
+	uint32 selectedChunkCount = 0;
+	uint32 missingChunkCount = 0;
+
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex])
+		{
+			continue;
+		}
+
+		selectedChunkCount++;
+
+		if (cachedChunkBuffers[chunkIndex] == NULL)
+		{
+			missingSkipNodeArray[missingChunkCount++] = chunkSkipNodeArray[chunkIndex];
+		}
+	}
+
+	ColumnBuffers *missingBuffers = NULL;
+	bool cacheMissingChunks =
+		MemoryContextMemAllocated(rescanCache->context, true) < (Size) work_mem * 1024L;
+
+	if (missingChunkCount > 0)
+	{
+		MemoryContext oldContext = CurrentMemoryContext;
+		if (cacheMissingChunks)
+		{
+			MemoryContextSwitchTo(rescanCache->context);
+		}
+
+		missingBuffers = LoadColumnBuffers(relation, missingSkipNodeArray,
+										   missingChunkCount, stripeOffset,
+										   attributeForm, NULL, accessStrategy,
+										   statistics);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	ColumnBuffers *columnBuffers = palloc0(sizeof(ColumnBuffers));
+	columnBuffers->chunkBuffersArray =
+		palloc0(Max(selectedChunkCount, 1) * sizeof(ColumnChunkBuffers *));
+
+	uint32 selectedChunkIndex = 0;
+	uint32 missingChunkIndex = 0;
+
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex])
+		{
+			continue;
+		}
+
+		ColumnChunkBuffers *chunkBuffers = cachedChunkBuffers[chunkIndex];
+		if (chunkBuffers == NULL)
+		{
+			chunkBuffers = missingBuffers->chunkBuffersArray[missingChunkIndex++];
+
+			if (cacheMissingChunks)
+			{
+				cachedChunkBuffers[chunkIndex] = chunkBuffers;
+			}
+		}
+
+		columnBuffers->chunkBuffersArray[selectedChunkIndex++] = chunkBuffers;
+	}
+
+	pfree(missingSkipNodeArray);
+
+	return columnBuffers;
+}
+
+
+/*
+ * LoadStreamedChunkGroup loads the chunks of the projected columns of the
+ * given chunk group of a streaming stripe read, if they aren't loaded yet.
+ * The chunks of the other loaded chunk groups are freed, except for the ones
+ * of the chunk group being read and of the one the decompression thread is
+ * working on, so a streaming read holds about two chunk groups at a time.
+ */
+static void
+LoadStreamedChunkGroup(StripeReadState *stripeReadState, uint32 chunkIndex)
+{
+	StripeStreamState *streamState = stripeReadState->streamState;
+	if (streamState == NULL || streamState->chunkGroupLoaded[chunkIndex])
+	{
+		return;
+	}
+
+	StripeBuffers *stripeBuffers = stripeReadState->stripeBuffers;
+
+	for (uint32 loadedIndex = 0; loadedIndex < stripeBuffers->selectedChunkGroupCount;
+		 loadedIndex++)
+	{
+		bool decompressing = stripeReadState->prefetchJobCount > 0 &&
+							 stripeReadState->prefetchChunkGroupIndex == loadedIndex;
+
+		if (streamState->chunkGroupLoaded[loadedIndex] &&
+			loadedIndex != stripeReadState->chunkGroupIndex && !decompressing)
+		{
+			FreeStreamedChunkGroup(stripeBuffers, streamState, loadedIndex);
+		}
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadState->stripeReadContext);
+
+	for (uint32 columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		if (columnBuffers == NULL)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&streamState->selectedChunkSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(streamState->tupleDescriptor, columnIndex);
+
+		ColumnBuffers *chunkGroupBuffers = LoadColumnBuffers(streamState->relation,
+															 chunkSkipNode, 1,
+															 streamState->stripeOffset,
+															 attributeForm,
+															 streamState->prefetchState,
+															 streamState->accessStrategy,
+															 streamState->statistics);
+
+		columnBuffers->chunkBuffersArray[chunkIndex] =
+			chunkGroupBuffers->chunkBuffersArray[0];
+
+		pfree(chunkGroupBuffers->chunkBuffersArray);
+		pfree(chunkGroupBuffers);
+	}
+
+	streamState->chunkGroupLoaded[chunkIndex] = true;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * FreeStreamedChunkGroup frees the chunks of the given chunk group of a
+ * streaming stripe read, including the uncompressed values that
+ * DeserializeChunkData leaves to the stream.
+ */
+static void
+FreeStreamedChunkGroup(StripeBuffers *stripeBuffers, StripeStreamState *streamState,
+					   uint32 chunkIndex)
+{
+	for (uint32 columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		if (columnBuffers == NULL || columnBuffers->chunkBuffersArray[chunkIndex] == NULL)
+		{
+			continue;
+		}
+
+		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
+
+		pfree(chunkBuffers->existsBuffer->data);
+		pfree(chunkBuffers->existsBuffer);
+		pfree(chunkBuffers->valueBuffer->data);
+		pfree(chunkBuffers->valueBuffer);
+		pfree(chunkBuffers);
+
+		columnBuffers->chunkBuffersArray[chunkIndex] = NULL;
+	}
+
+	streamState->chunkGroupLoaded[chunkIndex] = false;
+}
+
+
+/*
+ * LimitSelectedChunkGroups unselects the chunk groups of the stripe before
+ * firstChunkGroup and from endChunkGroup on, and if rowTarget isn't 0, the
+ * chunk groups after the selected ones that hold rowTarget rows that aren't
+ * deleted. If memoryLimit isn't 0, it also unselects the chunk groups after
+ * the selected ones whose projected columns take memoryLimit bytes, but keeps
+ * at least one. Returns the index of the first chunk group after the range
+ * that is left to load.
+ */
+static uint32
+LimitSelectedChunkGroups(StripeSkipList *stripeSkipList, bool *selectedChunkMask,
+						 bool *projectedColumnMask,
+						 uint32 firstChunkGroup, uint32 endChunkGroup,
+						 uint64 rowTarget, uint64 memoryLimit)
+{
+	uint32 chunkCount = stripeSkipList->chunkCount;
+	endChunkGroup = Min(endChunkGroup, chunkCount);
+	uint64 selectedRowCount = 0;
+	uint64 selectedBytes = 0;
+
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		if (chunkIndex < firstChunkGroup || chunkIndex >= endChunkGroup)
+		{
+			selectedChunkMask[chunkIndex] = false;
+			continue;
+		}
+
+		if (!selectedChunkMask[chunkIndex])
+		{
+			continue;
+		}
+
+		if (rowTarget != 0)
+		{
+			selectedRowCount += stripeSkipList->chunkGroupRowCounts[chunkIndex] -
+								stripeSkipList->chunkGroupDeletedRows[chunkIndex];
+
+			if (selectedRowCount >= rowTarget)
+			{
+				endChunkGroup = chunkIndex + 1;
+			}
+		}
+
+		if (memoryLimit != 0)
+		{
+			for (uint32 columnIndex = 0; columnIndex < stripeSkipList->columnCount;
+				 columnIndex++)
+			{
+				if (projectedColumnMask[columnIndex])
+				{
+					ColumnChunkSkipNode *chunkSkipNode =
+						&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+					selectedBytes += chunkSkipNode->existsLength +
+									 chunkSkipNode->valueLength;
+				}
+			}
+
+			if (selectedBytes >= memoryLimit)
+			{
+				endChunkGroup = chunkIndex + 1;
+			}
+		}
+	}
+
+	return endChunkGroup;
+}
+
+
+/*
+ * BeginStripePrefetch collects the logical ranges that LoadColumnBuffers is
+ * going to read for the selected chunks of the projected columns, and issues
+ * prefetch requests for the first columnar.prefetch_depth blocks of them.
+ * With chunkGroupOrder, the ranges are in the order streaming reads load
+ * them, one chunk group after another. Returns NULL if prefetching is
+ * disabled or there is nothing to read.
+ */
+static StripePrefetchState *
+BeginStripePrefetch(Relation relation, StripeMetadata *stripeMetadata,
+					StripeSkipList *selectedChunkSkipList, bool *projectedColumnMask,
+					bool chunkGroupOrder)
+{
+	if (columnar_prefetch_depth <= 0)
+	{
+		return NULL;
+	}
+
+	uint32 chunkCount = selectedChunkSkipList->chunkCount;
+	int maxRangeCount = stripeMetadata->columnCount * chunkCount * 2;
+	if (maxRangeCount == 0)
+	{
+		return NULL;
+	}
+
+	StripeReadRange *ranges = palloc(maxRangeCount * sizeof(StripeReadRange));
+	int rangeCount = 0;
+
+	if (chunkGroupOrder)
+	{
+		/* same order as LoadStreamedChunkGroup: every column of a chunk group */
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			for (uint32 columnIndex = 0; columnIndex < stripeMetadata->columnCount;
+				 columnIndex++)
+			{
+				if (!projectedColumnMask[columnIndex])
+				{
+					continue;
+				}
+
+				ColumnChunkSkipNode *chunkSkipNode =
+					&selectedChunkSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+				AddStripePrefetchRange(ranges, &rangeCount,
+									   stripeMetadata->fileOffset +
+									   chunkSkipNode->existsChunkOffset,
+									   chunkSkipNode->existsLength);
+				AddStripePrefetchRange(ranges, &rangeCount,
+									   stripeMetadata->fileOffset +
+									   chunkSkipNode->valueChunkOffset,
+									   chunkSkipNode->valueLength);
+			}
+		}
+	}
+	else
+	{
+		for (uint32 columnIndex = 0; columnIndex < stripeMetadata->columnCount; columnIndex++)
+		{
+			if (!projectedColumnMask[columnIndex])
+			{
+				continue;
+			}
+
+			ColumnChunkSkipNode *chunkSkipNodeArray =
+				selectedChunkSkipList->chunkSkipNodeArray[columnIndex];
+
+			/* same order as LoadColumnBuffers: all "exists" streams, then "values" */
+			for (int pass = 0; pass < 2; pass++)
+			{
+				for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+				{
+					ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+					uint64 offset = stripeMetadata->fileOffset +
+									(pass == 0 ? chunkSkipNode->existsChunkOffset :
+									 chunkSkipNode->valueChunkOffset);
+					uint64 length = (pass == 0) ? chunkSkipNode->existsLength :
+									chunkSkipNode->valueLength;
+
+					AddStripePrefetchRange(ranges, &rangeCount, offset, length);
+				}
+			}
+		}
+	}
+
+	if (rangeCount == 0)
+	{
+		pfree(ranges);
+		return NULL;
+	}
+
+	StripePrefetchState *prefetchState = palloc0(sizeof(StripePrefetchState));
+	prefetchState->relation = relation;
+	prefetchState->ranges = ranges;
+	prefetchState->rangeCount = rangeCount;
+	prefetchState->windowSize = (uint64) columnar_prefetch_depth *
+								COLUMNAR_BYTES_PER_PAGE;
+
+	AdvanceStripePrefetch(prefetchState, 0);
+
+	return prefetchState;
+}
+
+
+/*
+ * AddStripePrefetchRange adds a range to the ranges of a stripe prefetch,
+ * merging it with the previous range if they are adjacent on disk.
+ */
+static void
+AddStripePrefetchRange(StripeReadRange *ranges, int *rangeCount, uint64 offset,
+					   uint64 length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	if (*rangeCount > 0 &&
+		ranges[*rangeCount - 1].offset + ranges[*rangeCount - 1].length == offset)
+	{
+		ranges[*rangeCount - 1].length += length;
+		return;
+	}
+
+	ranges[*rangeCount].offset = offset;
+	ranges[*rangeCount].length = length;
+	(*rangeCount)++;
+}
+
+
+/*
+ * AdvanceStripePrefetch records that bytesConsumed more bytes were read by
+ * LoadColumnBuffers, and issues prefetch requests for the following ranges
+ * until the prefetch window is full again.
+ */
+static void
+AdvanceStripePrefetch(StripePrefetchState *prefetchState, uint64 bytesConsumed)
+{
+	if (prefetchState == NULL)
+	{
+		return;
+	}
+
+	prefetchState->bytesConsumed += bytesConsumed;
+
+	while (prefetchState->nextRange < prefetchState->rangeCount)
+	{
+		uint64 bytesInFlight = 0;
+		if (prefetchState->bytesPrefetched > prefetchState->bytesConsumed)
+		{
+			bytesInFlight = prefetchState->bytesPrefetched -
+							prefetchState->bytesConsumed;
+		}
+
+		if (bytesInFlight >= prefetchState->windowSize)
+		{
+			break;
+		}
+
+		StripeReadRange *range = &prefetchState->ranges[prefetchState->nextRange];
+		uint64 remaining = range->length - prefetchState->nextRangePrefetched;
+		uint64 amount = Min(remaining, prefetchState->windowSize - bytesInFlight);
+
+		ColumnarStoragePrefetch(prefetchState->relation,
+								range->offset + prefetchState->nextRangePrefetched,
+								amount);
+
+		prefetchState->bytesPrefetched += amount;
+		prefetchState->nextRangePrefetched += amount;
+
+		if (prefetchState->nextRangePrefetched == range->length)
+		{
+			prefetchState->nextRange++;
+			prefetchState->nextRangePrefetched = 0;
+		}
+	}
+}
+
+
+/*
+ * LoadColumnBuffers reads serialized column data from the given file. These
+ * column data are laid out as sequential chunks in the file; and chunk positions
+ * and lengths are retrieved from the column chunk skip node array. If
+ * prefetchState is given, it is advanced after each read so that the upcoming
+ * blocks are already being fetched while we copy the current ones. Blocks are
+ * read through accessStrategy, which may be NULL.
+ */
+static ColumnBuffers *
+LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
+				  uint32 chunkCount, uint64 stripeOffset,
+				  Form_pg_attribute attributeForm,
+				  StripePrefetchState *prefetchState,
+				  BufferAccessStrategy accessStrategy,
+				  ColumnarReadStatistics *statistics)
+{
+	uint32 chunkIndex = 0;
+	ColumnChunkBuffers **chunkBuffersArray =
+		palloc0(chunkCount * sizeof(ColumnChunkBuffers *));
+
+	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		chunkBuffersArray[chunkIndex] = palloc0(sizeof(ColumnChunkBuffers));
+	}
+
+	if (ColumnarStorageReadsAsync(relation))
+	{
+		LoadColumnBuffersAsync(relation, chunkSkipNodeArray, chunkCount, stripeOffset,
+							   chunkBuffersArray, prefetchState, accessStrategy,
+							   statistics);
+
+		ColumnBuffers *columnBuffers = palloc0(sizeof(ColumnBuffers));
+		columnBuffers->chunkBuffersArray = chunkBuffersArray;
+
+		return columnBuffers;
+	}
+
+	/*
+	 * We first read the "exists" chunks. We don't read "values" array here,
+	 * because "exists" chunks are stored sequentially on disk, and we want to
+	 * minimize disk seeks.
+	 */
+	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		uint64 existsOffset = stripeOffset + chunkSkipNode->existsChunkOffset;
+		StringInfo rawExistsBuffer = makeStringInfo();
+
+		enlargeStringInfo(rawExistsBuffer, chunkSkipNode->existsLength);
+		rawExistsBuffer->len = chunkSkipNode->existsLength;
+		ColumnarStorageReadExtended(relation, existsOffset, rawExistsBuffer->data,
+									chunkSkipNode->existsLength, accessStrategy);
+		AdvanceStripePrefetch(prefetchState, chunkSkipNode->existsLength);
+		statistics->bytesRead += chunkSkipNode->existsLength;
+
+		chunkBuffersArray[chunkIndex]->existsBuffer = rawExistsBuffer;
+	}
+
+	/* then read "values" chunks, which are also stored sequentially on disk */
+	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		CompressionType compressionType = chunkSkipNode->valueCompressionType;
+		uint64 valueOffset = stripeOffset + chunkSkipNode->valueChunkOffset;
+		StringInfo rawValueBuffer = makeStringInfo();
+
+		enlargeStringInfo(rawValueBuffer, chunkSkipNode->valueLength);
+		rawValueBuffer->len = chunkSkipNode->valueLength;
+		ColumnarStorageReadExtended(relation, valueOffset, rawValueBuffer->data,
+									chunkSkipNode->valueLength, accessStrategy);
+		AdvanceStripePrefetch(prefetchState, chunkSkipNode->valueLength);
+		statistics->bytesRead += chunkSkipNode->valueLength;
+
+		chunkBuffersArray[chunkIndex]->valueBuffer = rawValueBuffer;
+		chunkBuffersArray[chunkIndex]->valueCompressionType = compressionType;
+		chunkBuffersArray[chunkIndex]->valueEncodingType =
+			chunkSkipNode->valueEncodingType;
+		chunkBuffersArray[chunkIndex]->nullState = chunkSkipNode->nullState;
+		chunkBuffersArray[chunkIndex]->compressionDictionaryId =
+			chunkSkipNode->compressionDictionaryId;
+		chunkBuffersArray[chunkIndex]->decompressedValueSize =
+			chunkSkipNode->decompressedValueSize;
+		chunkBuffersArray[chunkIndex]->largeValueCount = chunkSkipNode->largeValueCount;
+	}
+
+	ColumnBuffers *columnBuffers = palloc0(sizeof(ColumnBuffers));
+	columnBuffers->chunkBuffersArray = chunkBuffersArray;
+
+	return columnBuffers;
+}
+
+
+/*
+ * LoadColumnBuffersAsync fills the given chunk buffers like LoadColumnBuffers,
+ * but queues the reads of all "exists" and "values" chunks at once, so that
+ * they complete in whatever order the storage finishes them.
+ */
+static void
+LoadColumnBuffersAsync(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
+					   uint32 chunkCount, uint64 stripeOffset,
+					   ColumnChunkBuffers **chunkBuffersArray,
+					   StripePrefetchState *prefetchState,
+					   BufferAccessStrategy accessStrategy,
+					   ColumnarReadStatistics *statistics)
+{
+	ColumnarStorageRange *ranges = palloc(2 * chunkCount * sizeof(ColumnarStorageRange));
+	uint64 bytesRead = 0;
+
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		ColumnChunkBuffers *chunkBuffers = chunkBuffersArray[chunkIndex];
+
+		StringInfo rawExistsBuffer = makeStringInfo();
+		enlargeStringInfo(rawExistsBuffer, chunkSkipNode->existsLength);
+		rawExistsBuffer->len = chunkSkipNode->existsLength;
+
+		StringInfo rawValueBuffer = makeStringInfo();
+		enlargeStringInfo(rawValueBuffer, chunkSkipNode->valueLength);
+		rawValueBuffer->len = chunkSkipNode->valueLength;
+
+		/* "exists" chunks first, in the order they are stored, like above */
+		ranges[chunkIndex].logicalOffset = stripeOffset + chunkSkipNode->existsChunkOffset;
+		ranges[chunkIndex].data = rawExistsBuffer->data;
+		ranges[chunkIndex].amount = chunkSkipNode->existsLength;
+
+		ColumnarStorageRange *valueRange = &ranges[chunkCount + chunkIndex];
+		valueRange->logicalOffset = stripeOffset + chunkSkipNode->valueChunkOffset;
+		valueRange->data = rawValueBuffer->data;
+		valueRange->amount = chunkSkipNode->valueLength;
+
+		bytesRead += chunkSkipNode->existsLength + chunkSkipNode->valueLength;
+
+		chunkBuffers->existsBuffer = rawExistsBuffer;
+		chunkBuffers->valueBuffer = rawValueBuffer;
+		chunkBuffers->valueCompressionType = chunkSkipNode->valueCompressionType;
+		chunkBuffers->valueEncodingType = chunkSkipNode->valueEncodingType;
+		chunkBuffers->nullState = chunkSkipNode->nullState;
+		chunkBuffers->compressionDictionaryId = chunkSkipNode->compressionDictionaryId;
+		chunkBuffers->decompressedValueSize = chunkSkipNode->decompressedValueSize;
+		chunkBuffers->largeValueCount = chunkSkipNode->largeValueCount;
+	}
+
+	ColumnarStorageReadRanges(relation, ranges, 2 * chunkCount, accessStrategy);
+
+	AdvanceStripePrefetch(prefetchState, bytesRead);
+	statistics->bytesRead += bytesRead;
+
+	pfree(ranges);
+}
+
+
+/*
+ * SelectedChunkMask walks over each column's chunks and checks if a chunk can
+ * be filtered without reading its data. The filtering happens when all rows in
+ * the chunk can be refuted by the given qualifier conditions.
+ */
+static bool *
+SelectedChunkMask(StripeSkipList *stripeSkipList, List *whereClauseList,
+				  List *whereClauseVars, int64 *chunkGroupsFiltered)
+{
+	ListCell *columnCell = NULL;
+	uint32 chunkIndex = 0;
+
+	bool *selectedChunkMask = palloc0(stripeSkipList->chunkCount * sizeof(bool));
+	memset(selectedChunkMask, true, stripeSkipList->chunkCount * sizeof(bool));
+
+	foreach(columnCell, whereClauseVars)
+	{
+		Var *column = lfirst(columnCell);
+		uint32 columnIndex = column->varattno - 1;
+
+		/* if this column's data type doesn't have a comparator, skip min/max */
+		FmgrInfo *comparisonFunction = GetFunctionInfoOrNull(column->vartype,
+															 BTREE_AM_OID,
+															 BTORDER_PROC);
+		Node *baseConstraint = NULL;
+		if (comparisonFunction != NULL)
+		{
+			baseConstraint = BuildBaseConstraint(column);
+		}
+
+		/* whether the clauses rule out a null column, decided on first use */
+		int nullRefuted = -1;
+
+		/* holds for the rows of chunks without NULLs, refuting IS NULL tests */
+		NullTest *notNullConstraint = makeNode(NullTest);
+		notNullConstraint->arg = (Expr *) column;
+		notNullConstraint->nulltesttype = IS_NOT_NULL;
+		notNullConstraint->argisrow = false;
+		notNullConstraint->location = -1;
+
+		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNodeArray =
+				stripeSkipList->chunkSkipNodeArray[columnIndex];
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+
+			/* chunks without values can't match clauses that are strict for the column */
+			if (ChunkValuesAllNull(chunkSkipNode))
+			{
+				if (nullRefuted == -1)
+				{
+					NullTest *nullTest = makeNode(NullTest);
+					nullTest->arg = (Expr *) column;
+					nullTest->nulltesttype = IS_NULL;
+					nullTest->argisrow = false;
+					nullTest->location = -1;
+
+					nullRefuted = predicate_refuted_by(list_make1(nullTest),
+													   whereClauseList, false);
+				}
+
+				if (nullRefuted && selectedChunkMask[chunkIndex])
+				{
+					selectedChunkMask[chunkIndex] = false;
+					*chunkGroupsFiltered += 1;
+				}
+
+				continue;
+			}
+
+			List *constraintList = NIL;
+			if (ChunkValuesNoneNull(chunkSkipNode))
+			{
+				constraintList = lappend(constraintList, notNullConstraint);
+			}
+
+			/*
+			 * A column chunk with comparable data type can miss min/max values
+			 * if all values in the chunk are NULL.
+			 */
+			if (baseConstraint != NULL && chunkSkipNode->hasMinMax)
+			{
+				UpdateConstraint(baseConstraint, chunkSkipNode->minimumValue,
+								 chunkSkipNode->maximumValue);
+
+				constraintList = lappend(constraintList, baseConstraint);
+			}
+
+			if (constraintList == NIL)
+			{
+				continue;
+			}
+
+			bool predicateRefuted =
+				predicate_refuted_by(constraintList, whereClauseList, false);
+			if (predicateRefuted && selectedChunkMask[chunkIndex])
+			{
+				selectedChunkMask[chunkIndex] = false;
+				*chunkGroupsFiltered += 1;
+			}
+		}
+	}
+
+	FilterChunksByBloomFilters(stripeSkipList, whereClauseList, selectedChunkMask,
+							   chunkGroupsFiltered);
+
+	FilterChunksByShreddedKeys(stripeSkipList, whereClauseList, selectedChunkMask,
+							   chunkGroupsFiltered);
+
+	return selectedChunkMask;
+}
+
+
+/*
+ * ChunkValuesAllNull returns whether all values of the given column chunk are
+ * NULL, as recorded by its null state or its null count.
+ */
+static bool
+ChunkValuesAllNull(ColumnChunkSkipNode *chunkSkipNode)
+{
+	if (chunkSkipNode->rowCount == 0)
+	{
+		return false;
+	}
+
+	return chunkSkipNode->nullState == CHUNK_NULLS_ALL ||
+		   (chunkSkipNode->hasStatistics &&
+			chunkSkipNode->nullCount == chunkSkipNode->rowCount);
+}
+
+
+/*
+ * ChunkValuesNoneNull returns whether none of the values of the given column
+ * chunk are NULL, as recorded by its null state or its null count.
+ */
+static bool
+ChunkValuesNoneNull(ColumnChunkSkipNode *chunkSkipNode)
+{
+	if (chunkSkipNode->rowCount == 0)
+	{
+		return false;
+	}
+
+	return chunkSkipNode->nullState == CHUNK_NULLS_NONE ||
+		   (chunkSkipNode->hasStatistics && chunkSkipNode->nullCount == 0);
+}
+
+
+/*
+ * SummarizeCoveredChunkGroups unselects the selected chunk groups between
+ * firstChunkGroup and endChunkGroup that the summary can answer from their
+ * skip list statistics, adds the statistics to the summary and returns how
+ * many chunk groups it unselected. Such chunk groups have no deleted rows,
+ * their projected columns are summarizable and their rows all pass the quals
+ * of the summary.
+ */
+static uint32
+SummarizeCoveredChunkGroups(StripeSkipList *stripeSkipList, bool *selectedChunkMask,
+							uint32 firstChunkGroup, uint32 endChunkGroup,
+							List *projectedColumnList, ChunkGroupSummary *summary)
+{
+	List *constraintList = NIL;
+
+	Var *column = NULL;
+	foreach_ptr(column, summary->qualVars)
+	{
+		/* without a comparator, nothing is known about the values of the column */
+		if (GetFunctionInfoOrNull(column->vartype, BTREE_AM_OID,
+								  BTORDER_PROC) == NULL)
+		{
+			return 0;
+		}
+
+		constraintList = lappend(constraintList, BuildBaseConstraint(column));
+	}
+
+	uint32 chunkGroupsSummarized = 0;
+
+	for (uint32 chunkIndex = firstChunkGroup; chunkIndex < endChunkGroup; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex] ||
+			stripeSkipList->chunkGroupDeletedRows[chunkIndex] != 0 ||
+			!ChunkGroupSummarizable(summary, stripeSkipList, chunkIndex,
+									projectedColumnList) ||
+			!ChunkGroupCoveredByQuals(stripeSkipList, chunkIndex, summary->qualList,
+									  summary->qualVars, constraintList))
+		{
+			continue;
+		}
+
+		AddChunkGroupToSummary(summary, stripeSkipList, chunkIndex,
+							   projectedColumnList);
+
+		selectedChunkMask[chunkIndex] = false;
+		chunkGroupsSummarized++;
+	}
+
+	return chunkGroupsSummarized;
+}
+
+
+/*
+ * ChunkGroupSummarizable returns whether the skip nodes of the projected
+ * columns of the chunk group tell how many of its rows have a value, and
+ * their min/max values if there are any, and have a sketch if the summary
+ * merges their sketches. Columns added after the stripe was written have no
+ * skip nodes with the rows of the chunk group.
+ */
+static bool
+ChunkGroupSummarizable(ChunkGroupSummary *summary, StripeSkipList *stripeSkipList,
+					   uint32 chunkIndex, List *projectedColumnList)
+{
+	int attno = 0;
+	foreach_int(attno, projectedColumnList)
+	{
+		uint32 columnIndex = attno - 1;
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		uint64 valueCount = 0;
+
+		if (chunkSkipNode->rowCount != stripeSkipList->chunkGroupRowCounts[chunkIndex] ||
+			!ChunkSkipNodeValueCount(chunkSkipNode, &valueCount) ||
+			(valueCount > 0 && !chunkSkipNode->hasMinMax) ||
+			(chunkSkipNode->hllSketch == NULL &&
+			 bms_is_member(attno, summary->sketchColumns)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ChunkGroupCoveredByQuals returns whether all rows of the chunk group pass
+ * qualList, because the ranges of the min/max values of the columns in
+ * qualVars it references imply them. The constraints only hold for rows with
+ * values, so these columns can't have NULLs in the chunk group.
+ */
+static bool
+ChunkGroupCoveredByQuals(StripeSkipList *stripeSkipList, uint32 chunkIndex,
+						 List *qualList, List *qualVars, List *constraintList)
+{
+	if (qualList == NIL)
+	{
+		return true;
+	}
+
+	ListCell *columnCell = NULL;
+	ListCell *constraintCell = NULL;
+	forboth(columnCell, qualVars, constraintCell, constraintList)
+	{
+		Var *column = lfirst(columnCell);
+		uint32 columnIndex = column->varattno - 1;
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		uint64 valueCount = 0;
+
+		if (!chunkSkipNode->hasMinMax ||
+			!ChunkSkipNodeValueCount(chunkSkipNode, &valueCount) ||
+			valueCount != stripeSkipList->chunkGroupRowCounts[chunkIndex])
+		{
+			return false;
+		}
+
+		UpdateConstraint(lfirst(constraintCell), chunkSkipNode->minimumValue,
+						 chunkSkipNode->maximumValue);
+	}
+
+	return predicate_implied_by(qualList, constraintList, false);
+}
+
+
+/*
+ * DeleteCoveredChunkGroups marks the rows of the selected chunk groups
+ * between firstChunkGroup and endChunkGroup whose rows all pass the quals of
+ * the delete deleted, a row mask at a time, unselects them and returns how
+ * many chunk groups it unselected. The rows of the other chunk groups are
+ * read, and deleted one at a time by the executor.
+ */
+static uint32
+DeleteCoveredChunkGroups(Relation relation, StripeMetadata *stripeMetadata,
+						 StripeSkipList *stripeSkipList, bool *selectedChunkMask,
+						 uint32 firstChunkGroup, uint32 endChunkGroup,
+						 ColumnarChunkGroupDelete *chunkGroupDelete)
+{
+	List *constraintList = NIL;
+
+	Var *column = NULL;
+	foreach_ptr(column, chunkGroupDelete->qualVars)
+	{
+		/* without a comparator, nothing is known about the values of the column */
+		if (GetFunctionInfoOrNull(column->vartype, BTREE_AM_OID,
+								  BTORDER_PROC) == NULL)
+		{
+			return 0;
+		}
+
+		constraintList = lappend(constraintList, BuildBaseConstraint(column));
+	}
+
+	uint64 storageId = 0;
+	uint32 chunkGroupsDeleted = 0;
+
+	for (uint32 chunkIndex = firstChunkGroup; chunkIndex < endChunkGroup; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex] ||
+			!ChunkGroupCoveredByQuals(stripeSkipList, chunkIndex,
+									  chunkGroupDelete->qualList,
+									  chunkGroupDelete->qualVars, constraintList))
+		{
+			continue;
+		}
+
+		if (chunkGroupsDeleted == 0)
+		{
+			storageId = ColumnarStorageGetStorageId(relation, false);
+			ColumnarLockStorageForRowChange(storageId);
+		}
+
+		uint64 firstRowNumber = stripeMetadata->firstRowNumber +
+								stripeSkipList->chunkGroupRowOffset[chunkIndex];
+		uint64 endRowNumber = firstRowNumber +
+							  stripeSkipList->chunkGroupRowCounts[chunkIndex];
+
+		ColumnarVisibilityMapClearRows(relation, firstRowNumber, endRowNumber);
+		chunkGroupDelete->deletedRowCount +=
+			UpdateRowMaskRange(relation->rd_node, storageId, firstRowNumber,
+							   endRowNumber);
+
+		selectedChunkMask[chunkIndex] = false;
+		chunkGroupsDeleted++;
+	}
+
+	chunkGroupDelete->chunkGroupCount += chunkGroupsDeleted;
+
+	return chunkGroupsDeleted;
+}
+
+
+/*
+ * ChunkSkipNodeValueCount sets valueCount to the number of rows of the given
+ * column chunk that aren't NULL, and returns false if the skip node doesn't
+ * record it.
+ */
+static bool
+ChunkSkipNodeValueCount(ColumnChunkSkipNode *chunkSkipNode, uint64 *valueCount)
+{
+	if (chunkSkipNode->nullState == CHUNK_NULLS_NONE)
+	{
+		*valueCount = chunkSkipNode->rowCount;
+	}
+	else if (chunkSkipNode->nullState == CHUNK_NULLS_ALL)
+	{
+		*valueCount = 0;
+	}
+	else if (chunkSkipNode->hasStatistics)
+	{
+		*valueCount = chunkSkipNode->rowCount - chunkSkipNode->nullCount;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * AddChunkGroupToSummary adds the row count of the chunk group to the
+ * summary, and the value count, min/max values and sketches of its projected
+ * columns.
+ */
+static void
+AddChunkGroupToSummary(ChunkGroupSummary *summary, StripeSkipList *stripeSkipList,
+					   uint32 chunkIndex, List *projectedColumnList)
+{
+	summary->chunkGroupCount++;
+	summary->rowCount += stripeSkipList->chunkGroupRowCounts[chunkIndex];
+
+	int attno = 0;
+	foreach_int(attno, projectedColumnList)
+	{
+		uint32 columnIndex = attno - 1;
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		uint64 valueCount = 0;
+
+		ChunkSkipNodeValueCount(chunkSkipNode, &valueCount);
+		summary->valueCount[columnIndex] += valueCount;
+
+		if (summary->sketchRegisters[columnIndex] != NULL)
+		{
+			ColumnarHllSketchMerge(summary->sketchRegisters[columnIndex],
+								   chunkSkipNode->hllSketch);
+		}
+
+		if (valueCount == 0 || summary->minMaxValues[columnIndex] == NULL)
+		{
+			continue;
+		}
+
+		uint32 minMaxValueCount = summary->minMaxValueCount[columnIndex];
+		if (minMaxValueCount + 2 > summary->minMaxCapacity[columnIndex])
+		{
+			summary->minMaxCapacity[columnIndex] *= 2;
+			summary->minMaxValues[columnIndex] =
+				repalloc(summary->minMaxValues[columnIndex],
+						 summary->minMaxCapacity[columnIndex] * sizeof(Datum));
+		}
+
+		summary->minMaxValues[columnIndex][minMaxValueCount] =
+			chunkSkipNode->minimumValue;
+		summary->minMaxValues[columnIndex][minMaxValueCount + 1] =
+			chunkSkipNode->maximumValue;
+		summary->minMaxValueCount[columnIndex] = minMaxValueCount + 2;
+	}
+}
+
+
+/*
+ * FilterChunksByBloomFilters unselects the chunk groups whose bloom filters
+ * show that they contain none of the values an equality or IN clause is
+ * looking for. Clauses are implicitly ANDed, so one such clause is enough.
+ */
+static void
+FilterChunksByBloomFilters(StripeSkipList *stripeSkipList, List *whereClauseList,
+						   bool *selectedChunkMask, int64 *chunkGroupsFiltered)
+{
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		Var *column = NULL;
+		uint64 *hashes = NULL;
+		uint32 hashCount = 0;
+
+		if (!BloomFilterClauseHashes(clause, &column, &hashes, &hashCount))
+		{
+			continue;
+		}
+
+		uint32 columnIndex = column->varattno - 1;
+		if (columnIndex >= stripeSkipList->columnCount)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNodeArray =
+			stripeSkipList->chunkSkipNodeArray[columnIndex];
+
+		for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			bytea *bloomFilter = chunkSkipNodeArray[chunkIndex].bloomFilter;
+			if (bloomFilter == NULL || !selectedChunkMask[chunkIndex])
+			{
+				continue;
+			}
+
+			bool mayContain = false;
+			for (uint32 hashIndex = 0; hashIndex < hashCount && !mayContain; hashIndex++)
+			{
+				mayContain = ColumnarBloomFilterMayContain(bloomFilter, hashes[hashIndex]);
+			}
+
+			if (!mayContain)
+			{
+				selectedChunkMask[chunkIndex] = false;
+				*chunkGroupsFiltered += 1;
+			}
+		}
+	}
+}
+
+
+/*
+ * FilterChunksByShreddedKeys unselects the chunk groups whose statistics of a
+ * shredded key of a jsonb column show that none of their rows has a ->>
+ * value for the key that passes a comparison with a constant, or that isn't
+ * NULL. Like with bloom filters, one such clause is enough.
+ */
+static void
+FilterChunksByShreddedKeys(StripeSkipList *stripeSkipList, List *whereClauseList,
+						   bool *selectedChunkMask, int64 *chunkGroupsFiltered)
+{
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		Var *column = NULL;
+		char *key = NULL;
+		StrategyNumber strategy = InvalidStrategy;
+		text *constant = NULL;
+
+		if (!ShreddedKeyClause(clause, &column, &key, &strategy, &constant))
+		{
+			continue;
+		}
+
+		uint32 columnIndex = column->varattno - 1;
+		if (columnIndex >= stripeSkipList->columnCount)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNodeArray =
+			stripeSkipList->chunkSkipNodeArray[columnIndex];
+
+		for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			bytea *shreddedKeyStats = chunkSkipNodeArray[chunkIndex].shreddedKeyStats;
+			if (shreddedKeyStats == NULL || !selectedChunkMask[chunkIndex])
+			{
+				continue;
+			}
+
+			uint64 presentCount = 0;
+			text *minimumValue = NULL;
+			text *maximumValue = NULL;
+			if (!ColumnarShreddedKeyLookup(shreddedKeyStats, key, &presentCount,
+										   &minimumValue, &maximumValue))
+			{
+				continue;
+			}
+
+			bool refuted = (presentCount == 0);
+			if (!refuted && constant != NULL && minimumValue != NULL)
+			{
+				switch (strategy)
+				{
+					case BTLessStrategyNumber:
+					{
+						refuted = ColumnarShreddedKeyValueCompare(minimumValue,
+																  constant) >= 0;
+						break;
+					}
+
+					case BTLessEqualStrategyNumber:
+					{
+						refuted = ColumnarShreddedKeyValueCompare(minimumValue,
+																  constant) > 0;
+						break;
+					}
+
+					case BTEqualStrategyNumber:
+					{
+						refuted = ColumnarShreddedKeyValueCompare(constant,
+																  minimumValue) < 0 ||
+								  ColumnarShreddedKeyValueCompare(constant,
+																  maximumValue) > 0;
+						break;
+					}
+
+					case BTGreaterEqualStrategyNumber:
+					{
+						refuted = ColumnarShreddedKeyValueCompare(maximumValue,
+																  constant) < 0;
+						break;
+					}
+
+					case BTGreaterStrategyNumber:
+					{
+						refuted = ColumnarShreddedKeyValueCompare(maximumValue,
+																  constant) <= 0;
+						break;
+					}
+
+					default:
+					{
+						break;
+					}
+				}
+			}
+
+			if (refuted)
+			{
+				selectedChunkMask[chunkIndex] = false;
+				*chunkGroupsFiltered += 1;
+			}
+		}
+	}
+}
+
+
+/*
+ * ShreddedKeyClause checks if the clause is "column->>'key' IS NOT NULL" or
+ * compares column->>'key' with a text constant using a text btree operator,
+ * so it can be checked against the statistics of shredded keys. The bounds
+ * are in byte order, so ranges need the "C" collation, and equality one
+ * that is deterministic. If so, it sets the column, the key, the strategy of
+ * the operator with the key on the left and the constant, NULL for the null
+ * test, and returns true.
+ */
+static bool
+ShreddedKeyClause(Node *clause, Var **column, char **key, StrategyNumber *strategy,
+				  text **constant)
+{
+	if (IsA(clause, NullTest))
+	{
+		NullTest *nullTest = (NullTest *) clause;
+		if (nullTest->nulltesttype != IS_NOT_NULL || nullTest->argisrow ||
+			!ColumnarShreddedKeyExpression((Node *) nullTest->arg, column, key))
+		{
+			return false;
+		}
+
+		*strategy = InvalidStrategy;
+		*constant = NULL;
+		return true;
+	}
+
+	if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
+	{
+		return false;
+	}
+
+	OpExpr *opExpr = (OpExpr *) clause;
+	Node *keyOperand = linitial(opExpr->args);
+	Node *constOperand = lsecond(opExpr->args);
+	bool commuted = false;
+
+	if (IsA(keyOperand, Const))
+	{
+		Node *swap = keyOperand;
+		keyOperand = constOperand;
+		constOperand = swap;
+		commuted = true;
+	}
+
+	if (!IsA(constOperand, Const) || ((Const *) constOperand)->constisnull ||
+		((Const *) constOperand)->consttype != TEXTOID ||
+		!ColumnarShreddedKeyExpression(keyOperand, column, key))
+	{
+		return false;
+	}
+
+	int operatorStrategy = get_op_opfamily_strategy(opExpr->opno, TEXT_BTREE_FAM_OID);
+	if (operatorStrategy == InvalidStrategy)
+	{
+		return false;
+	}
+
+	if (operatorStrategy == BTEqualStrategyNumber)
+	{
+		if (OidIsValid(opExpr->inputcollid) &&
+			!get_collation_isdeterministic(opExpr->inputcollid))
+		{
+			return false;
+		}
+	}
+	else if (!lc_collate_is_c(opExpr->inputcollid))
+	{
+		return false;
+	}
+
+	if (commuted)
+	{
+		operatorStrategy = BTMaxStrategyNumber + 1 - operatorStrategy;
+	}
+
+	*strategy = operatorStrategy;
+	*constant = DatumGetTextPP(((Const *) constOperand)->constvalue);
+	return true;
+}
+
+
+/*
+ * FilterChunksByTopNBound unselects the chunk groups none of whose rows sort
+ * before the bound of the top-N sort above the read, or together with it, by
+ * the min/max values and nulls of the column of its first sort key. Rows that
+ * tie with the bound are kept, for sorts WITH TIES and the later sort keys.
+ */
+static void
+FilterChunksByTopNBound(StripeSkipList *stripeSkipList, ColumnarTopNBound *bound,
+						bool *selectedChunkMask, int64 *chunkGroupsFiltered)
+{
+	uint32 columnIndex = bound->attno - 1;
+	if (!bound->valid || columnIndex >= stripeSkipList->columnCount)
+	{
+		return;
+	}
+
+	SortSupport sortKey = bound->sortKey;
+
+	/* the sort key decides whether NULLs come before the bound */
+	bool nullsKept = ApplySortComparator((Datum) 0, true, bound->value, bound->isNull,
+										 sortKey) <= 0;
+
+	ColumnChunkSkipNode *chunkSkipNodeArray =
+		stripeSkipList->chunkSkipNodeArray[columnIndex];
+
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		if (!selectedChunkMask[chunkIndex] || chunkSkipNode->rowCount == 0)
+		{
+			continue;
+		}
+
+		if (!ChunkValuesNoneNull(chunkSkipNode) && nullsKept)
+		{
+			continue;
+		}
+
+		if (!ChunkValuesAllNull(chunkSkipNode))
+		{
+			if (!chunkSkipNode->hasMinMax)
+			{
+				continue;
+			}
+
+			/* either the minimum or the maximum comes first in the sort */
+			if (ApplySortComparator(chunkSkipNode->minimumValue, false,
+									bound->value, bound->isNull, sortKey) <= 0 ||
+				ApplySortComparator(chunkSkipNode->maximumValue, false,
+									bound->value, bound->isNull, sortKey) <= 0)
+			{
+				continue;
+			}
+		}
+
+		selectedChunkMask[chunkIndex] = false;
+		*chunkGroupsFiltered += 1;
+	}
+}
+
+
+/*
+ * BloomFilterClauseHashes checks if the clause is "column = constant" or
+ * "column = ANY(constant array)" using the equality operator of the column
+ * type, so it can be checked against bloom filters. If so, it sets column
+ * and the bloom filter hashes of the constants, and returns true.
+ */
+static bool
+BloomFilterClauseHashes(Node *clause, Var **column, uint64 **hashes, uint32 *hashCount)
+{
+	Oid opno = InvalidOid;
+	Oid inputCollation = InvalidOid;
+	Node *leftOperand = NULL;
+	Node *rightOperand = NULL;
+	bool isArray = false;
+
+	if (IsA(clause, OpExpr) && list_length(((OpExpr *) clause)->args) == 2)
+	{
+		OpExpr *opExpr = (OpExpr *) clause;
+		opno = opExpr->opno;
+		inputCollation = opExpr->inputcollid;
+		leftOperand = linitial(opExpr->args);
+		rightOperand = lsecond(opExpr->args);
+
+		/* equality is commutative for the type's own operator */
+		if (IsA(rightOperand, Var))
+		{
+			Node *swap = leftOperand;
+			leftOperand = rightOperand;
+			rightOperand = swap;
+		}
+	}
+	else if (IsA(clause, ScalarArrayOpExpr) && ((ScalarArrayOpExpr *) clause)->useOr)
+	{
+		ScalarArrayOpExpr *arrayOpExpr = (ScalarArrayOpExpr *) clause;
+		opno = arrayOpExpr->opno;
+		inputCollation = arrayOpExpr->inputcollid;
+		leftOperand = linitial(arrayOpExpr->args);
+		rightOperand = lsecond(arrayOpExpr->args);
+		isArray = true;
+	}
+	else
+	{
+		return false;
+	}
+
+	if (!IsA(leftOperand, Var) || !IsA(rightOperand, Const) ||
+		((Const *) rightOperand)->constisnull)
+	{
+		return false;
+	}
+
+	Var *var = (Var *) leftOperand;
+	Const *constant = (Const *) rightOperand;
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(var->vartype, TYPECACHE_EQ_OPR);
+	if (var->varattno <= 0 || opno != typeEntry->eq_opr ||
+		inputCollation != var->varcollid)
+	{
+		return false;
+	}
+
+	FmgrInfo *hashFunction = ColumnarBloomHashFunction(var->vartype);
+	if (hashFunction == NULL)
+	{
+		return false;
+	}
+
+	if (!isArray)
+	{
+		if (constant->consttype != var->vartype)
+		{
+			return false;
+		}
+
+		*hashes = palloc(sizeof(uint64));
+		(*hashes)[0] = ColumnarBloomHash(hashFunction, var->varcollid,
+										 constant->constvalue);
+		*hashCount = 1;
+		*column = var;
+
+		return true;
+	}
+
+	ArrayType *array = DatumGetArrayTypeP(constant->constvalue);
+	if (ARR_ELEMTYPE(array) != var->vartype)
+	{
+		return false;
+	}
+
+	int16 elementLength = 0;
+	bool elementByValue = false;
+	char elementAlign = 0;
+	get_typlenbyvalalign(var->vartype, &elementLength, &elementByValue, &elementAlign);
+
+	Datum *elements = NULL;
+	bool *elementNulls = NULL;
+	int elementCount = 0;
+	deconstruct_array(array, var->vartype, elementLength, elementByValue, elementAlign,
+					  &elements, &elementNulls, &elementCount);
+
+	*hashes = palloc0(Max(elementCount, 1) * sizeof(uint64));
+	*hashCount = 0;
+	for (int elementIndex = 0; elementIndex < elementCount; elementIndex++)
+	{
+		/* NULL elements never compare equal, so nothing to look for */
+		if (elementNulls[elementIndex])
+		{
+			continue;
+		}
+
+		(*hashes)[(*hashCount)++] = ColumnarBloomHash(hashFunction, var->varcollid,
+													  elements[elementIndex]);
+	}
+	*column = var;
+
+	return true;
+}
+
+
+/*
+ * FilterChunksByQualColumns extends the min/max based chunk group filtering
+ * of SelectedChunkMask by reading the actual values of the columns referenced
+ * in the pushed down clauses, and unselecting the chunk groups that have no
+ * row satisfying all the clauses. This way, the remaining projected columns
+ * are only read for the chunk groups that might produce a row.
+ *
+ * Pushed down clauses are implied by the scan quals (see
+ * ExtractPushdownClause), hence a chunk group in which no row passes them
+ * wouldn't produce a row anyway. We stop evaluating a chunk group at the
+ * first matching row, so non-selective quals only cost a few evaluations.
+ *
+ * Clauses on a single column whose chunk is dictionary or run length encoded
+ * are evaluated on the distinct values or runs of the chunk without decoding
+ * it, and the other qual columns are only read for the chunk groups with rows
+ * that pass them.
+ */
+static void
+FilterChunksByQualColumns(Relation relation, StripeMetadata *stripeMetadata,
+						  StripeSkipList *stripeSkipList, TupleDesc tupleDescriptor,
+						  bool *projectedColumnMask, List *whereClauseList,
+						  List *whereClauseVars, bool *selectedChunkMask,
+						  int64 *chunkGroupsFiltered,
+						  BufferAccessStrategy accessStrategy,
+						  ColumnarReadStatistics *statistics)
+{
+	if (whereClauseList == NIL || whereClauseVars == NIL)
+	{
+		return;
+	}
+
+	uint32 columnCount = tupleDescriptor->natts;
+	bool *qualColumnMask = palloc0(columnCount * sizeof(bool));
+
+	Var *column = NULL;
+	foreach_ptr(column, whereClauseVars)
+	{
+		uint32 columnIndex = column->varattno - 1;
+
+		/* columns added after this stripe was written are not stored in it */
+		if (columnIndex >= stripeMetadata->columnCount)
+		{
+			pfree(qualColumnMask);
+			return;
+		}
+
+		qualColumnMask[columnIndex] = true;
+	}
+
+	/*
+	 * If the quals reference all the projected columns, there is nothing to
+	 * save by reading the quals' columns first.
+	 */
+	bool hasOtherProjectedColumns = false;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (projectedColumnMask[columnIndex] && !qualColumnMask[columnIndex])
+		{
+			hasOtherProjectedColumns = true;
+			break;
+		}
+	}
+
+	pfree(qualColumnMask);
+
+	if (!hasOtherProjectedColumns)
+	{
+		return;
+	}
+
+	MemoryContext filterContext =
+		AllocSetContextCreate(CurrentMemoryContext,
+							  "Columnar Late Materialization Context",
+							  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext chunkContext =
+		AllocSetContextCreate(filterContext,
+							  "Columnar Late Materialization Chunk Context",
+							  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(filterContext);
+
+	/*
+	 * Clauses on a single column are evaluated apart from the others, so that
+	 * for dictionary and run length encoded chunks they are evaluated once
+	 * per distinct value or run, see EncodedChunkRowsPassQual().
+	 */
+	List **columnClauseLists = palloc0(columnCount * sizeof(List *));
+	List *otherClauseList = NIL;
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		List *clauseVars = GetClauseVars(list_make1(clause), columnCount);
+		if (list_length(clauseVars) == 1 && !contain_volatile_functions(clause))
+		{
+			uint32 columnIndex = ((Var *) linitial(clauseVars))->varattno - 1;
+			columnClauseLists[columnIndex] = lappend(columnClauseLists[columnIndex],
+													 clause);
+		}
+		else
+		{
+			otherClauseList = lappend(otherClauseList, clause);
+		}
+	}
+
+	ExprState **columnQualStates = palloc0(columnCount * sizeof(ExprState *));
+	foreach_ptr(column, whereClauseVars)
+	{
+		uint32 columnIndex = column->varattno - 1;
+		columnQualStates[columnIndex] = ExecInitQual(columnClauseLists[columnIndex],
+													 NULL);
+	}
+
+	ExprState *otherQualState = ExecInitQual(otherClauseList, NULL);
+	bool *otherClauseColumnMask = palloc0(columnCount * sizeof(bool));
+	foreach_ptr(column, GetClauseVars(otherClauseList, columnCount))
+	{
+		otherClauseColumnMask[column->varattno - 1] = true;
+	}
+
+	ExprContext *econtext = CreateStandaloneExprContext();
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor, &TTSOpsVirtual);
+	econtext->ecxt_scantuple = slot;
+
+	bool **existsArrays = palloc0(columnCount * sizeof(bool *));
+	Datum **valueArrays = palloc0(columnCount * sizeof(Datum *));
+	bool *columnEvaluatedEncoded = palloc0(columnCount * sizeof(bool));
+
+	/* values of each column are decompressed into the same buffer for every chunk */
+	StringInfo *decompressionBuffers = palloc0(columnCount * sizeof(StringInfo));
+	foreach_ptr(column, whereClauseVars)
+	{
+		decompressionBuffers[column->varattno - 1] = makeStringInfo();
+	}
+
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex])
+		{
+			continue;
+		}
+
+		uint32 rowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+
+		MemoryContextSwitchTo(chunkContext);
+
+		/* rows that may pass the clauses evaluated on encoded values so far */
+		bool *rowPassesArray = palloc(rowCount * sizeof(bool));
+		memset(rowPassesArray, true, rowCount * sizeof(bool));
+		bool chunkHasMatch = true;
+
+		/* encoded columns first, as they may reject the chunk group on their own */
+		foreach_ptr(column, whereClauseVars)
+		{
+			uint32 columnIndex = column->varattno - 1;
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+															columnIndex);
+			ColumnChunkSkipNode *chunkSkipNode =
+				&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+			ValueEncodingType valueEncodingType = chunkSkipNode->valueEncodingType;
+
+			/* encoded values of chunks with large values would be references */
+			columnEvaluatedEncoded[columnIndex] =
+				columnClauseLists[columnIndex] != NIL &&
+				chunkSkipNode->largeValueCount == 0 &&
+				(valueEncodingType == VALUE_ENCODING_DICTIONARY ||
+				 valueEncodingType == VALUE_ENCODING_RUN_LENGTH);
+			if (!columnEvaluatedEncoded[columnIndex])
+			{
+				continue;
+			}
+
+			existsArrays[columnIndex] = palloc0(rowCount * sizeof(bool));
+			StringInfo valueBuffer =
+				LoadChunkColumnValueBuffer(relation, stripeMetadata, stripeSkipList,
+										   attributeForm, chunkIndex,
+										   decompressionBuffers[columnIndex],
+										   accessStrategy, statistics,
+										   existsArrays[columnIndex]);
+
+			chunkHasMatch = EncodedChunkRowsPassQual(valueBuffer, valueEncodingType,
+													 existsArrays[columnIndex], rowCount,
+													 attributeForm,
+													 columnQualStates[columnIndex],
+													 econtext, rowPassesArray);
+
+			if (!chunkHasMatch)
+			{
+				break;
+			}
+
+			/* the values are needed for the other clauses too */
+			if (otherClauseColumnMask[columnIndex])
+			{
+				valueArrays[columnIndex] = palloc0(rowCount * sizeof(Datum));
+				DeserializeDatumArray(valueBuffer, valueEncodingType,
+									  existsArrays[columnIndex], rowCount,
+									  attributeForm->attbyval, attributeForm->attlen,
+									  attributeForm->attalign, valueArrays[columnIndex]);
+			}
+		}
+
+		if (chunkHasMatch)
+		{
+			foreach_ptr(column, whereClauseVars)
+			{
+				uint32 columnIndex = column->varattno - 1;
+				if (columnEvaluatedEncoded[columnIndex])
+				{
+					continue;
+				}
+
+				Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+																columnIndex);
+
+				existsArrays[columnIndex] = palloc0(rowCount * sizeof(bool));
+				valueArrays[columnIndex] = palloc0(rowCount * sizeof(Datum));
+
+				LoadChunkColumnValues(relation, stripeMetadata, stripeSkipList,
+									  attributeForm, chunkIndex,
+									  decompressionBuffers[columnIndex],
+									  accessStrategy, statistics,
+									  existsArrays[columnIndex], valueArrays[columnIndex]);
+			}
+		}
+
+		MemoryContextSwitchTo(filterContext);
+
+		bool rowMatches = false;
+		for (uint32 rowIndex = 0; chunkHasMatch && rowIndex < rowCount && !rowMatches;
+			 rowIndex++)
+		{
+			if (!rowPassesArray[rowIndex])
+			{
+				continue;
+			}
+
+			ExecClearTuple(slot);
+			memset(slot->tts_isnull, true, columnCount * sizeof(bool));
+
+			foreach_ptr(column, whereClauseVars)
+			{
+				uint32 columnIndex = column->varattno - 1;
+				if (valueArrays[columnIndex] != NULL)
+				{
+					slot->tts_values[columnIndex] = valueArrays[columnIndex][rowIndex];
+					slot->tts_isnull[columnIndex] = !existsArrays[columnIndex][rowIndex];
+				}
+			}
+
+			ExecStoreVirtualTuple(slot);
+
+			rowMatches = ExecQual(otherQualState, econtext);
+			foreach_ptr(column, whereClauseVars)
+			{
+				uint32 columnIndex = column->varattno - 1;
+				if (!rowMatches)
+				{
+					break;
+				}
+
+				if (!columnEvaluatedEncoded[columnIndex])
+				{
+					rowMatches = ExecQual(columnQualStates[columnIndex], econtext);
+				}
+			}
+
+			ResetExprContext(econtext);
+		}
+
+		if (!rowMatches)
+		{
+			selectedChunkMask[chunkIndex] = false;
+			*chunkGroupsFiltered += 1;
+		}
+
+		ExecClearTuple(slot);
+		memset(existsArrays, 0, columnCount * sizeof(bool *));
+		memset(valueArrays, 0, columnCount * sizeof(Datum *));
+		MemoryContextReset(chunkContext);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExprContext(econtext, true);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(filterContext);
+}
+
+
+/*
+ * EncodedChunkRowsPassQual evaluates the given qual on a single column once
+ * for each distinct value of a dictionary encoded chunk of the column, or for
+ * each run of a run length encoded one, and once for NULL if the chunk has
+ * NULLs, instead of for each row. It unsets the entries of rowPassesArray for
+ * the rows whose value fails the qual, and returns whether any row passes.
+ */
+static bool
+EncodedChunkRowsPassQual(StringInfo valueBuffer, ValueEncodingType valueEncodingType,
+						 bool *existsArray, uint32 rowCount,
+						 Form_pg_attribute attributeForm, ExprState *qualState,
+						 ExprContext *econtext, bool *rowPassesArray)
+{
+	TupleTableSlot *slot = econtext->ecxt_scantuple;
+	uint32 columnIndex = attributeForm->attnum - 1;
+	bool *valuePassesArray = NULL;
+	bool nullPasses = false;
+	bool nullEvaluated = false;
+	bool anyRowPasses = false;
+
+	ExecClearTuple(slot);
+	memset(slot->tts_isnull, true, slot->tts_tupleDescriptor->natts * sizeof(bool));
+	ExecStoreVirtualTuple(slot);
+
+	if (valueEncodingType == VALUE_ENCODING_DICTIONARY)
+	{
+		Datum *entries = NULL;
+		const uint16 *codes = NULL;
+		uint32 codeCount = 0;
+		uint32 entryCount = DictionaryEntryArray(valueBuffer, attributeForm->attlen,
+												 attributeForm->attalign, &entries,
+												 &codes, &codeCount);
+
+		valuePassesArray = palloc(Max(entryCount, 1) * sizeof(bool));
+		for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+		{
+			slot->tts_values[columnIndex] = entries[entryIndex];
+			slot->tts_isnull[columnIndex] = false;
+			valuePassesArray[entryIndex] = ExecQual(qualState, econtext);
+			ResetExprContext(econtext);
+		}
+
+		uint32 codeIndex = 0;
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			bool rowPasses = false;
+			if (existsArray[rowIndex])
+			{
+				if (codeIndex >= codeCount || codes[codeIndex] >= entryCount)
+				{
+					ereport(ERROR, (errmsg("invalid dictionary code in chunk")));
+				}
+
+				rowPasses = valuePassesArray[codes[codeIndex]];
+				codeIndex++;
+			}
+			else
+			{
+				if (!nullEvaluated)
+				{
+					slot->tts_isnull[columnIndex] = true;
+					nullPasses = ExecQual(qualState, econtext);
+					ResetExprContext(econtext);
+					nullEvaluated = true;
+				}
+
+				rowPasses = nullPasses;
+			}
+
+			rowPassesArray[rowIndex] = rowPassesArray[rowIndex] && rowPasses;
+			anyRowPasses = anyRowPasses || rowPassesArray[rowIndex];
+		}
+	}
+	else
+	{
+		Assert(valueEncodingType == VALUE_ENCODING_RUN_LENGTH);
+
+		const char *runValues = NULL;
+		const uint32 *runLengths = NULL;
+		uint32 runCount = RunLengthRunArray(valueBuffer, attributeForm->attlen,
+											attributeForm->attalign, &runValues,
+											&runLengths);
+		uint32 valueStride = att_align_nominal(attributeForm->attlen,
+											   attributeForm->attalign);
+		uint32 runIndex = 0;
+		uint32 runRemaining = 0;
+		bool runPasses = false;
+
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			bool rowPasses = false;
+			if (existsArray[rowIndex])
+			{
+				while (runRemaining == 0)
+				{
+					if (runIndex >= runCount)
+					{
+						ereport(ERROR, (errmsg("insufficient runs in run length "
+											   "encoded chunk: %u", runCount)));
+					}
+
+					slot->tts_values[columnIndex] =
+						fetch_att(runValues + (uint64) runIndex * valueStride,
+								  attributeForm->attbyval, attributeForm->attlen);
+					slot->tts_isnull[columnIndex] = false;
+					runPasses = ExecQual(qualState, econtext);
+					ResetExprContext(econtext);
+
+					runRemaining = runLengths[runIndex];
+					runIndex++;
+				}
+
+				rowPasses = runPasses;
+				runRemaining--;
+			}
+			else
+			{
+				if (!nullEvaluated)
+				{
+					slot->tts_isnull[columnIndex] = true;
+					nullPasses = ExecQual(qualState, econtext);
+					ResetExprContext(econtext);
+					nullEvaluated = true;
+				}
+
+				rowPasses = nullPasses;
+			}
+
+			rowPassesArray[rowIndex] = rowPassesArray[rowIndex] && rowPasses;
+			anyRowPasses = anyRowPasses || rowPassesArray[rowIndex];
+		}
+	}
+
+	ExecClearTuple(slot);
+
+	return anyRowPasses;
+}
+
+
+/*
+ * FilterChunksByJoinKeys unselects the chunk groups none of whose join keys
+ * may be in the bloom filter of the hash join above the read. Like with
+ * FilterChunksByQualColumns, the join key column is read first, so the other
+ * projected columns are only read for the chunk groups with rows that the
+ * join might keep.
+ */
+static void
+FilterChunksByJoinKeys(Relation relation, StripeMetadata *stripeMetadata,
+					   StripeSkipList *stripeSkipList, TupleDesc tupleDescriptor,
+					   bool *projectedColumnMask, ColumnarJoinKeyFilter *joinKeyFilter,
+					   bool *selectedChunkMask, BufferAccessStrategy accessStrategy,
+					   ColumnarReadStatistics *statistics)
+{
+	uint32 keyColumnIndex = joinKeyFilter->attno - 1;
+
+	/* columns added after this stripe was written are NULL in all its rows */
+	if (keyColumnIndex >= stripeMetadata->columnCount)
+	{
+		return;
+	}
+
+	/* nothing to save if the join key is the only column read */
+	bool hasOtherProjectedColumns = false;
+	for (uint32 columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (projectedColumnMask[columnIndex] && columnIndex != keyColumnIndex)
+		{
+			hasOtherProjectedColumns = true;
+			break;
+		}
+	}
+
+	if (!hasOtherProjectedColumns)
+	{
+		return;
+	}
+
+	MemoryContext filterContext =
+		AllocSetContextCreate(CurrentMemoryContext,
+							  "Columnar Join Key Filter Context",
+							  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext chunkContext =
+		AllocSetContextCreate(filterContext,
+							  "Columnar Join Key Filter Chunk Context",
+							  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(filterContext);
+
+	Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, keyColumnIndex);
+	StringInfo decompressionBuffer = makeStringInfo();
+
+	MemoryContextSwitchTo(chunkContext);
+
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (!selectedChunkMask[chunkIndex])
+		{
+			continue;
+		}
+
+		uint32 rowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+		bool *existsArray = palloc0(rowCount * sizeof(bool));
+		Datum *valueArray = palloc0(rowCount * sizeof(Datum));
+
+		LoadChunkColumnValues(relation, stripeMetadata, stripeSkipList, attributeForm,
+							  chunkIndex, decompressionBuffer, accessStrategy,
+							  statistics, existsArray, valueArray);
+
+		/* NULL keys never match */
+		bool chunkHasMatch = false;
+		for (uint32 rowIndex = 0; rowIndex < rowCount && !chunkHasMatch; rowIndex++)
+		{
+			if (!existsArray[rowIndex])
+			{
+				continue;
+			}
+
+			uint64 hash = ColumnarBloomHash(joinKeyFilter->hashFunction,
+											joinKeyFilter->collation,
+											valueArray[rowIndex]);
+			chunkHasMatch = ColumnarBloomFilterMayContain(joinKeyFilter->bloomFilter,
+														   hash);
+		}
+
+		if (!chunkHasMatch)
+		{
+			selectedChunkMask[chunkIndex] = false;
+			joinKeyFilter->chunkGroupsFiltered++;
+		}
+
+		MemoryContextReset(chunkContext);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(filterContext);
+}
+
+
+/*
+ * LoadChunkColumnValues reads and decodes the values of a column in a chunk
+ * group of the stripe into the given arrays, which have room for the rows of
+ * the chunk group. The values are decompressed into decompressionBuffer,
+ * which the by-reference values point into.
+ */
+static void
+LoadChunkColumnValues(Relation relation, StripeMetadata *stripeMetadata,
+					  StripeSkipList *stripeSkipList, Form_pg_attribute attributeForm,
+					  uint32 chunkIndex, StringInfo decompressionBuffer,
+					  BufferAccessStrategy accessStrategy,
+					  ColumnarReadStatistics *statistics,
+					  bool *existsArray, Datum *valueArray)
+{
+	uint32 columnIndex = attributeForm->attnum - 1;
+	uint32 rowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+	ColumnChunkSkipNode *chunkSkipNode =
+		&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+	StringInfo valueBuffer = LoadChunkColumnValueBuffer(relation, stripeMetadata,
+														stripeSkipList, attributeForm,
+														chunkIndex, decompressionBuffer,
+														accessStrategy, statistics,
+														existsArray);
+
+	DeserializeDatumArray(valueBuffer, chunkSkipNode->valueEncodingType, existsArray,
+						  rowCount, attributeForm->attbyval, attributeForm->attlen,
+						  attributeForm->attalign, valueArray);
+
+	/* quals are evaluated on the values, so large values are read right away */
+	if (chunkSkipNode->largeValueCount > 0)
+	{
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			if (existsArray[rowIndex] &&
+				ColumnarIsLargeValueReference(valueArray[rowIndex]))
+			{
+				valueArray[rowIndex] =
+					ColumnarFetchLargeValue(relation, stripeMetadata->fileOffset,
+											valueArray[rowIndex]);
+			}
+		}
+	}
+}
+
+
+/*
+ * LoadChunkColumnValueBuffer reads the exists array of a column in a chunk
+ * group of the stripe into existsArray and returns its values decompressed,
+ * but still encoded, into decompressionBuffer.
+ */
+static StringInfo
+LoadChunkColumnValueBuffer(Relation relation, StripeMetadata *stripeMetadata,
+						   StripeSkipList *stripeSkipList,
+						   Form_pg_attribute attributeForm, uint32 chunkIndex,
+						   StringInfo decompressionBuffer,
+						   BufferAccessStrategy accessStrategy,
+						   ColumnarReadStatistics *statistics, bool *existsArray)
+{
+	uint32 columnIndex = attributeForm->attnum - 1;
+	uint32 rowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+	ColumnChunkSkipNode *chunkSkipNode =
+		&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+	ColumnBuffers *columnBuffers = LoadColumnBuffers(relation, chunkSkipNode, 1,
+													 stripeMetadata->fileOffset,
+													 attributeForm, NULL,
+													 accessStrategy, statistics);
+	ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[0];
+
+	StringInfo valueBuffer = DecompressChunkValueBuffer(chunkBuffers,
+														decompressionBuffer,
+														statistics);
+
+	DeserializeExistsArray(chunkBuffers, existsArray, rowCount);
+
+	return valueBuffer;
+}
+
+
+/*
+ * GetFunctionInfoOrNull first resolves the operator for the given data type,
+ * access method, and support procedure. The function then uses the resolved
+ * operator's identifier to fill in a function manager object, and returns
+ * this object. This function is based on a similar function from CitusDB's code.
+ */
+FmgrInfo *
+GetFunctionInfoOrNull(Oid typeId, Oid accessMethodId, int16 procedureId)
+{
+	FmgrInfo *functionInfo = NULL;
+
+	/* get default operator class from pg_opclass for datum type */
+	Oid operatorClassId = GetDefaultOpClass(typeId, accessMethodId);
+	if (operatorClassId == InvalidOid)
+	{
+		return NULL;
+	}
+
+	Oid operatorFamilyId = get_opclass_family(operatorClassId);
+	if (operatorFamilyId == InvalidOid)
+	{
+		return NULL;
+	}
+
+	Oid operatorId = get_opfamily_proc(operatorFamilyId, typeId, typeId, procedureId);
+
+	/* No operator for typeId, search for operator class type*/
+	if (operatorId == InvalidOid)
+	{
+		Oid opcintype = get_opclass_input_type(operatorClassId);
+		operatorId = get_opfamily_proc(operatorFamilyId, opcintype, opcintype, procedureId);
+	}
+
+	if (operatorId != InvalidOid)
+	{
+		functionInfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo));
+
+		/* fill in the FmgrInfo struct using the operatorId */
+		fmgr_info(operatorId, functionInfo);
+	}
+
+	return functionInfo;
+}
+
+
+/*
+ * BuildBaseConstraint builds and returns a base constraint. This constraint
+ * implements an expression in the form of (var <= max && var >= min), where
+ * min and max values represent a chunk's min and max values. These chunk
+ * values are filled in after the constraint is built. This function is based
+ * on a similar function from CitusDB's shard pruning logic.
+ */
+static Node *
+BuildBaseConstraint(Var *variable)
+{
+	OpExpr *lessThanExpr = MakeOpExpression(variable, BTLessEqualStrategyNumber);
+	OpExpr *greaterThanExpr = MakeOpExpression(variable, BTGreaterEqualStrategyNumber);
+
+	Node *baseConstraint = make_and_qual((Node *) lessThanExpr, (Node *) greaterThanExpr);
+
+	return baseConstraint;
+}
+
+
+/*
+ * GetClauseVars extracts the Vars from the given clauses for the purpose of
+ * building constraints that can be refuted by predicate_refuted_by(). It also
+ * deduplicates and sorts them.
+ */
+static List *
+GetClauseVars(List *whereClauseList, int natts)
+{
+	/*
+	 * We don't recurse into or include aggregates, window functions, or
+	 * PHVs. We don't expect any PHVs during execution; and Vars found inside
+	 * an aggregate or window function aren't going to be useful in forming
+	 * constraints that can be refuted.
+	 */
+	int flags = 0;
+	List *vars = pull_var_clause((Node *) whereClauseList, flags);
+	Var **deduplicate = palloc0(sizeof(Var *) * natts);
+
+	ListCell *lc;
+	foreach(lc, vars)
+	{
+		Node *node = lfirst(lc);
+		Assert(IsA(node, Var));
+
+		Var *var = (Var *) node;
+		int idx = var->varattno - 1;
+
+		if (deduplicate[idx] != NULL)
+		{
+			/* if they have the same varattno, the rest should be identical */
+			Assert(equal(var, deduplicate[idx]));
+		}
+
+		deduplicate[idx] = var;
+	}
+
+	List *whereClauseVars = NIL;
+	for (int i = 0; i < natts; i++)
+	{
+		Var *var = deduplicate[i];
+		if (var != NULL)
+		{
+			whereClauseVars = lappend(whereClauseVars, var);
+		}
+	}
+
+	pfree(deduplicate);
+
+	return whereClauseVars;
+}
+
+
+/*
+ * MakeOpExpression builds an operator expression node. This operator expression
+ * implements the operator clause as defined by the variable and the strategy
+ * number. The function is copied from CitusDB's shard pruning logic.
+ */
+static OpExpr *
+MakeOpExpression(Var *variable, int16 strategyNumber)
+{
+	Oid typeId = variable->vartype;
+	Oid typeModId = variable->vartypmod;
+	Oid collationId = variable->varcollid;
+
+	Oid accessMethodId = BTREE_AM_OID;
+
+	/* Load the operator from system catalogs */
+	Oid operatorId = GetOperatorByType(typeId, accessMethodId, strategyNumber);
+
+	/* No operator for typeId, search for operator class type */
+	if (operatorId == InvalidOid)
+	{
+		Oid operatorClassId = GetDefaultOpClass(typeId, accessMethodId);
+		Oid opcintype = get_opclass_input_type(operatorClassId);
+		operatorId = GetOperatorByType(opcintype, accessMethodId, strategyNumber);
+	}
+
+	Const *constantValue = makeNullConst(typeId, typeModId, collationId);
+
+	/* Now make the expression with the given variable and a null constant */
+	OpExpr *expression = (OpExpr *) make_opclause(operatorId,
+												  InvalidOid, /* no result type yet */
+												  false, /* no return set */
+												  (Expr *) variable,
+												  (Expr *) constantValue,
+												  InvalidOid, collationId);
+
+	/* Set implementing function id and result type */
+	expression->opfuncid = get_opcode(operatorId);
+	expression->opresulttype = get_func_rettype(expression->opfuncid);
+
+	return expression;
+}
+
+
+/*
+ * GetOperatorByType returns operator Oid for the given type, access method,
+ * and strategy number. Note that this function incorrectly errors out when
+ * the given type doesn't have its own operator but can use another compatible
+ * type's default operator. The function is copied from CitusDB's shard pruning
+ * logic.
+ */
+static Oid
+GetOperatorByType(Oid typeId, Oid accessMethodId, int16 strategyNumber)
+{
+	/* Get default operator class from pg_opclass */
+	Oid operatorClassId = GetDefaultOpClass(typeId, accessMethodId);
+
+	Oid operatorFamily = get_opclass_family(operatorClassId);
+
+	Oid operatorId = get_opfamily_member(operatorFamily, typeId, typeId, strategyNumber);
+
+	return operatorId;
+}
+
+
+/*
+ * UpdateConstraint updates the base constraint with the given min/max values.
+ * The function is copied from CitusDB's shard pruning logic.
+ */
+static void
+UpdateConstraint(Node *baseConstraint, Datum minValue, Datum maxValue)
+{
+	BoolExpr *andExpr = (BoolExpr *) baseConstraint;
+	Node *lessThanExpr = (Node *) linitial(andExpr->args);
+	Node *greaterThanExpr = (Node *) lsecond(andExpr->args);
+
+	Node *minNode = get_rightop((Expr *) greaterThanExpr);
+	Node *maxNode = get_rightop((Expr *) lessThanExpr);
+
+	Assert(IsA(minNode, Const));
+	Assert(IsA(maxNode, Const));
+
+	Const *minConstant = (Const *) minNode;
+	Const *maxConstant = (Const *) maxNode;
+
+	minConstant->constvalue = minValue;
+	maxConstant->constvalue = maxValue;
+
+	minConstant->constisnull = false;
+	maxConstant->constisnull = false;
+
+	minConstant->constbyval = true;
+	maxConstant->constbyval = true;
+}
+
+
+/*
+ * SelectedChunkSkipList constructs a new StripeSkipList in which the
+ * non-selected chunks are removed from the given stripeSkipList.
+ */
+static StripeSkipList *
+SelectedChunkSkipList(StripeSkipList *stripeSkipList, bool *projectedColumnMask,
+					  bool *selectedChunkMask)
+{
+	uint32 selectedChunkCount = 0;
+	uint32 chunkIndex = 0;
+	uint32 columnIndex = 0;
+	uint32 columnCount = stripeSkipList->columnCount;
+	uint32 selectedChunkIndex = 0;
+
+	for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (selectedChunkMask[chunkIndex])
+		{
+			selectedChunkCount++;
+		}
+	}
+
+	ColumnChunkSkipNode **selectedChunkSkipNodeArray =
+		palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		bool firstColumn = columnIndex == 0;
+		selectedChunkIndex = 0;
+
+		/* first column's chunk skip node is always read */
+		if (!projectedColumnMask[columnIndex] && !firstColumn)
+		{
+			selectedChunkSkipNodeArray[columnIndex] = NULL;
+			continue;
+		}
+
+		Assert(stripeSkipList->chunkSkipNodeArray[columnIndex] != NULL);
+
+		selectedChunkSkipNodeArray[columnIndex] = palloc0(selectedChunkCount *
+														  sizeof(ColumnChunkSkipNode));
+
+		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			if (selectedChunkMask[chunkIndex])
+			{
+				selectedChunkSkipNodeArray[columnIndex][selectedChunkIndex] =
+					stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+				selectedChunkIndex++;
+			}
+		}
+	}
+
+	selectedChunkIndex = 0;
+	uint32 *chunkGroupRowCounts = palloc0(selectedChunkCount * sizeof(uint32));
+	uint32 *chunkGroupRowOffset = palloc0(selectedChunkCount * sizeof(uint32));
+	uint32 *chunkGroupDeletedRows = palloc(selectedChunkCount * sizeof(uint32));
+
+	for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (selectedChunkMask[chunkIndex])
+		{
+			chunkGroupRowCounts[selectedChunkIndex] =
+				stripeSkipList->chunkGroupRowCounts[chunkIndex];
+			chunkGroupRowOffset[selectedChunkIndex] =
+				stripeSkipList->chunkGroupRowOffset[chunkIndex];
+			chunkGroupDeletedRows[selectedChunkIndex] =
+				stripeSkipList->chunkGroupDeletedRows[chunkIndex];
+			selectedChunkIndex++;
+		}
+	}
+
+	StripeSkipList *selectedChunkSkipList = palloc0(sizeof(StripeSkipList));
+	selectedChunkSkipList->chunkSkipNodeArray = selectedChunkSkipNodeArray;
+	selectedChunkSkipList->chunkCount = selectedChunkCount;
+	selectedChunkSkipList->columnCount = stripeSkipList->columnCount;
+	selectedChunkSkipList->chunkGroupRowCounts = chunkGroupRowCounts;
+	selectedChunkSkipList->chunkGroupRowOffset = chunkGroupRowOffset;
+	selectedChunkSkipList->chunkGroupDeletedRows = chunkGroupDeletedRows;
+
+	return selectedChunkSkipList;
+}
+
+
+/*
+ * StripeSkipListRowCount counts the number of rows in the given stripeSkipList.
+ * To do this, the function finds the first column, and sums up row counts across
+ * all chunks for that column.
+ */
+static uint32
+StripeSkipListRowCount(StripeSkipList *stripeSkipList)
+{
+	uint32 stripeSkipListRowCount = 0;
+	uint32 chunkIndex = 0;
+	uint32 *chunkGroupRowCounts = stripeSkipList->chunkGroupRowCounts;
+
+	for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		uint32 chunkGroupRowCount = chunkGroupRowCounts[chunkIndex];
+		stripeSkipListRowCount += chunkGroupRowCount;
+	}
+
+	return stripeSkipListRowCount;
+}
+
+
+/*
+ * ProjectedColumnMask returns a boolean array in which the projected columns
+ * from the projected column list are marked as true.
+ */
+static bool *
+ProjectedColumnMask(uint32 columnCount, List *projectedColumnList)
+{
+	bool *projectedColumnMask = palloc0(columnCount * sizeof(bool));
+	int attno;
+
+	foreach_int(attno, projectedColumnList)
+	{
+		/* attno is 1-indexed; projectedColumnMask is 0-indexed */
+		int columnIndex = attno - 1;
+		projectedColumnMask[columnIndex] = true;
+	}
+
+	return projectedColumnMask;
+}
+
+
+/*
+ * SkipListColumnMask returns the columns whose skip nodes a stripe read
+ * needs: the projected ones, those of the quals, of the top-N bound and of
+ * the join key filter, and the first column, whose chunks give the row
+ * counts of the selected chunk groups, see SelectedChunkSkipList. Scans of
+ * wide tables then don't read the chunk metadata of every column.
+ */
+static bool *
+SkipListColumnMask(uint32 columnCount, const bool *projectedColumnMask,
+				   List *whereClauseVars, ColumnarTopNBound *topNBound,
+				   ColumnarJoinKeyFilter *joinKeyFilter)
+{
+	bool *columnMask = palloc0(Max(columnCount, 1) * sizeof(bool));
+
+	memcpy(columnMask, projectedColumnMask, columnCount * sizeof(bool));
+	columnMask[0] = true;
+
+	ListCell *varCell = NULL;
+	foreach(varCell, whereClauseVars)
+	{
+		Var *var = lfirst(varCell);
+		if (var->varattno > 0 && var->varattno <= columnCount)
+		{
+			columnMask[var->varattno - 1] = true;
+		}
+	}
+
+	if (topNBound != NULL && topNBound->attno > 0 && topNBound->attno <= columnCount)
+	{
+		columnMask[topNBound->attno - 1] = true;
+	}
+
+	if (joinKeyFilter != NULL && joinKeyFilter->attno > 0 &&
+		joinKeyFilter->attno <= columnCount)
+	{
+		columnMask[joinKeyFilter->attno - 1] = true;
+	}
+
+	return columnMask;
+}
+
+
+/*
+ * SkipListHasColumns returns whether the skip list has the skip nodes of all
+ * columns set in columnMask.
+ */
+static bool
+SkipListHasColumns(StripeSkipList *stripeSkipList, const bool *columnMask)
+{
+	for (uint32 columnIndex = 0; columnIndex < stripeSkipList->columnCount; columnIndex++)
+	{
+		if (columnMask[columnIndex] &&
+			stripeSkipList->chunkSkipNodeArray[columnIndex] == NULL)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * DecompressChunkValueBuffer returns the decompressed value stream of a column
+ * chunk, using the compression dictionary of the chunk if it has one. The
+ * values are decompressed into outputBuffer, or into a new buffer if it is
+ * NULL. Uncompressed value streams are returned as-is. The decompression is
+ * added to the given read statistics.
+ */
+static StringInfo
+DecompressChunkValueBuffer(ColumnChunkBuffers *chunkBuffers, StringInfo outputBuffer,
+						   ColumnarReadStatistics *statistics)
+{
+	if (chunkBuffers->valueCompressionType == COMPRESSION_NONE &&
+		chunkBuffers->compressionDictionaryId == 0)
+	{
+		return chunkBuffers->valueBuffer;
+	}
+
+	if (outputBuffer == NULL)
+	{
+		outputBuffer = makeStringInfo();
+	}
+
+	instr_time startTime;
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	DecompressBufferInto(chunkBuffers->valueBuffer, chunkBuffers->valueCompressionType,
+						 chunkBuffers->decompressedValueSize,
+						 chunkBuffers->compressionDictionaryId, outputBuffer);
+
+	instr_time elapsedTime;
+	INSTR_TIME_SET_CURRENT(elapsedTime);
+	INSTR_TIME_SUBTRACT(elapsedTime, startTime);
+
+	DecompressionStatistics *decompression =
+		&statistics->decompression[chunkBuffers->valueCompressionType];
+	decompression->chunkCount++;
+	decompression->compressedBytes += chunkBuffers->valueBuffer->len;
+	decompression->decompressedBytes += outputBuffer->len;
+	decompression->elapsedMicroseconds += INSTR_TIME_GET_MICROSEC(elapsedTime);
+
+	return outputBuffer;
+}
+
+
+/*
+ * ColumnarDeserializeChunkBuffers decompresses and deserializes a column chunk
+ * that is in memory, like the full chunks of a stripe that a writer hasn't
+ * flushed yet. Values of by reference types point into a buffer allocated in
+ * the current memory context.
+ */
+void
+ColumnarDeserializeChunkBuffers(ColumnChunkBuffers *chunkBuffers, uint32 rowCount,
+								Form_pg_attribute attributeForm, bool *existsArray,
+								Datum *datumArray)
+{
+	DeserializeExistsArray(chunkBuffers, existsArray, rowCount);
+
+	StringInfo valueBuffer = chunkBuffers->valueBuffer;
+	if (chunkBuffers->valueCompressionType != COMPRESSION_NONE ||
+		chunkBuffers->compressionDictionaryId != 0)
+	{
+		valueBuffer = makeStringInfo();
+		DecompressBufferInto(chunkBuffers->valueBuffer,
+							 chunkBuffers->valueCompressionType,
+							 chunkBuffers->decompressedValueSize,
+							 chunkBuffers->compressionDictionaryId, valueBuffer);
+	}
+
+	DeserializeDatumArray(valueBuffer, chunkBuffers->valueEncodingType, existsArray,
+						  rowCount, attributeForm->attbyval, attributeForm->attlen,
+						  attributeForm->attalign, datumArray);
+}
+
+
+/*
+ * ColumnarDeserializeDatumArray deserializes values that are serialized
+ * without any encoding or compression, like the ones of the chunk a writer is
+ * filling.
+ */
+void
+ColumnarDeserializeDatumArray(StringInfo datumBuffer, bool *existsArray,
+							  uint32 datumCount, Form_pg_attribute attributeForm,
+							  Datum *datumArray)
+{
+	DeserializeDatumArray(datumBuffer, VALUE_ENCODING_NONE, existsArray, datumCount,
+						  attributeForm->attbyval, attributeForm->attlen,
+						  attributeForm->attalign, datumArray);
+}
+
+
+/*
+ * DeserializeExistsArray sets the exists array of a column chunk, either from
+ * its null state or from its exists stream.
+ */
+static void
+DeserializeExistsArray(ColumnChunkBuffers *chunkBuffers, bool *existsArray,
+					   uint32 rowCount)
+{
+	if (chunkBuffers->nullState == CHUNK_NULLS_NONE)
+	{
+		memset(existsArray, true, rowCount * sizeof(bool));
+	}
+	else if (chunkBuffers->nullState == CHUNK_NULLS_ALL)
+	{
+		memset(existsArray, false, rowCount * sizeof(bool));
+	}
+	else
+	{
+		DeserializeBoolArray(chunkBuffers->existsBuffer, existsArray, rowCount);
+	}
+}
+
+
+/*
+ * DeserializeBoolArray reads an array of bits from the given buffer and stores
+ * it in provided bool array. Full bytes are expanded to 8 bools at a time
+ * using a lookup table.
+ */
+static void
+DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
+					 uint32 boolArrayLength)
+{
+	static bool boolExpansionTable[256][8];
+	static bool boolExpansionTableBuilt = false;
+
+	uint32 maximumBoolCount = boolArrayBuffer->len * 8;
+	if (boolArrayLength > maximumBoolCount)
+	{
+		ereport(ERROR, (errmsg("insufficient data for reading boolean array")));
+	}
+
+	if (!boolExpansionTableBuilt)
+	{
+		for (uint32 byteValue = 0; byteValue < 256; byteValue++)
+		{
+			for (uint32 bitIndex = 0; bitIndex < 8; bitIndex++)
+			{
+				boolExpansionTable[byteValue][bitIndex] =
+					(byteValue & (1 << bitIndex)) != 0;
+			}
+		}
+
+		boolExpansionTableBuilt = true;
+	}
+
+	const uint8 *bytes = (const uint8 *) boolArrayBuffer->data;
+	uint32 fullByteCount = boolArrayLength / 8;
+
+	for (uint32 byteIndex = 0; byteIndex < fullByteCount; byteIndex++)
+	{
+		memcpy(boolArray + byteIndex * 8, boolExpansionTable[bytes[byteIndex]], 8);
+	}
+
+	for (uint32 boolArrayIndex = fullByteCount * 8; boolArrayIndex < boolArrayLength;
+		 boolArrayIndex++)
+	{
+		uint32 byteIndex = boolArrayIndex / 8;
+		uint32 bitIndex = boolArrayIndex % 8;
+
+		boolArray[boolArrayIndex] = (bytes[byteIndex] & (1 << bitIndex)) != 0;
+	}
+}
+
+
+/*
+ * InsufficientDatumBufferError errors out for a value that ends at offset
+ * of a datum buffer of bufferLength bytes.
+ */
+static void
+InsufficientDatumBufferError(uint64 offset, int bufferLength)
+{
+	ereport(ERROR, (errmsg("insufficient data left in datum buffer: " UINT64_FORMAT
+						   ", %d", offset, bufferLength)));
+}
+
+
+/*
+ * Loops that deserialize the values of one fixed length passed by value,
+ * named DeserializeByValArray<LENGTH>, for values serialized back to back.
+ * Each value is read with a memcpy of a constant length, which compiles to
+ * a single load, instead of going through fetch_att. Chunks without NULL
+ * rows take a loop without branches.
+ */
+#define BUILD_DESERIALIZE_BYVAL_ARRAY(LENGTH, CTYPE, GETDATUM)					\
+	static void																	\
+	DeserializeByValArray##LENGTH(const char *data, bool *existsArray,		\
+								  uint32 datumCount, bool allExist,				\
+								  Datum *datumArray)							\
+	{																			\
+		CTYPE value;															\
+																				\
+		if (allExist)															\
+		{																		\
+			for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)	\
+			{																	\
+				memcpy(&value, data + datumIndex * LENGTH, LENGTH);				\
+				datumArray[datumIndex] = GETDATUM(value);						\
+			}																	\
+			return;																\
+		}																		\
+																				\
+		uint32 valueIndex = 0;													\
+		for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)		\
+		{																		\
+			if (!existsArray[datumIndex])										\
+			{																	\
+				continue;														\
+			}																	\
+																				\
+			memcpy(&value, data + valueIndex * LENGTH, LENGTH);					\
+			datumArray[datumIndex] = GETDATUM(value);							\
+			valueIndex++;														\
+		}																		\
+	}
+
+BUILD_DESERIALIZE_BYVAL_ARRAY(1, char, CharGetDatum)
+BUILD_DESERIALIZE_BYVAL_ARRAY(2, int16, Int16GetDatum)
+BUILD_DESERIALIZE_BYVAL_ARRAY(4, int32, Int32GetDatum)
+#if SIZEOF_DATUM == 8
+BUILD_DESERIALIZE_BYVAL_ARRAY(8, int64, Int64GetDatum)
+#endif
+
+/*
+ * Loops that deserialize varlena values aligned to ALIGNVAL bytes, named
+ * DeserializeVarlenaArray<NAME>, with the alignment known at compile time
+ * instead of looked up by att_align_nominal for each value.
+ */
+#define BUILD_DESERIALIZE_VARLENA_ARRAY(NAME, ALIGNVAL)							\
+	static void																	\
+	DeserializeVarlenaArray##NAME(StringInfo datumBuffer, bool *existsArray,	\
+								  uint32 datumCount, Datum *datumArray)			\
+	{																			\
+		uint64 offset = 0;														\
+																				\
+		for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)		\
+		{																		\
+			if (!existsArray[datumIndex])										\
+			{																	\
+				continue;														\
+			}																	\
+																				\
+			if (offset >= (uint64) datumBuffer->len)							\
+			{																	\
+				InsufficientDatumBufferError(offset, datumBuffer->len);		\
+			}																	\
+																				\
+			char *value = datumBuffer->data + offset;							\
+			datumArray[datumIndex] = PointerGetDatum(value);					\
+			offset = TYPEALIGN(ALIGNVAL, offset + VARSIZE_ANY(value));			\
+		}																		\
+																				\
+		if (offset > (uint64) datumBuffer->len)									\
+		{																		\
+			InsufficientDatumBufferError(offset, datumBuffer->len);			\
+		}																		\
+	}
+
+BUILD_DESERIALIZE_VARLENA_ARRAY(Char, 1)
+BUILD_DESERIALIZE_VARLENA_ARRAY(Short, ALIGNOF_SHORT)
+BUILD_DESERIALIZE_VARLENA_ARRAY(Int, ALIGNOF_INT)
+BUILD_DESERIALIZE_VARLENA_ARRAY(Double, ALIGNOF_DOUBLE)
+
+
+/*
+ * DeserializeByRefArray points the datums of fixed length values passed by
+ * reference at values serialized datumStride bytes apart.
+ */
+static void
+DeserializeByRefArray(char *data, uint32 datumStride, bool *existsArray,
+					  uint32 datumCount, Datum *datumArray)
+{
+	char *currentDatumDataPointer = data;
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		datumArray[datumIndex] = PointerGetDatum(currentDatumDataPointer);
+		currentDatumDataPointer += datumStride;
+	}
+}
+
+
+/*
+ * DeserializeDatumArray reads an array of datums from the given buffer and stores
+ * them in provided datumArray. If a value is marked as false in the exists array,
+ * the function assumes that the datum isn't in the buffer, and simply skips it.
+ *
+ * Datums of by-reference types point directly into datumBuffer, so for
+ * uncompressed chunks they reference the buffer that was read from disk
+ * without any further copying. Encoded buffers are decoded by the functions
+ * in columnar_encoding.c.
+ */
+static void
+DeserializeDatumArray(StringInfo datumBuffer, ValueEncodingType valueEncodingType,
+					  bool *existsArray, uint32 datumCount,
+					  bool datumTypeByValue, int datumTypeLength,
+					  char datumTypeAlign, Datum *datumArray)
+{
+	uint32 datumIndex = 0;
+	uint32 currentDatumDataOffset = 0;
+
+	if (valueEncodingType == VALUE_ENCODING_DICTIONARY)
+	{
+		DictionaryDecodeDatumArray(datumBuffer, existsArray, datumCount,
+								   datumTypeLength, datumTypeAlign, datumArray);
+		return;
+	}
+	else if (valueEncodingType == VALUE_ENCODING_RUN_LENGTH)
+	{
+		RunLengthDecodeDatumArray(datumBuffer, existsArray, datumCount,
+								  datumTypeByValue, datumTypeLength, datumTypeAlign,
+								  datumArray);
+		return;
+	}
+	else if (valueEncodingType == VALUE_ENCODING_BIT_PACKED)
+	{
+		BitPackDecodeDatumArray(datumBuffer, existsArray, datumCount,
+								datumTypeLength, datumArray);
+		return;
+	}
+	else if (valueEncodingType == VALUE_ENCODING_OFFSETS)
+	{
+		OffsetsDecodeDatumArray(datumBuffer, existsArray, datumCount,
+								datumTypeLength, datumArray);
+		return;
+	}
+
+	if (datumTypeLength > 0)
+	{
+		/*
+		 * Fixed-length values are serialized with a constant stride (see
+		 * SerializeSingleDatum), so we can check the buffer length once and
+		 * skip computing the length and alignment of each value.
+		 */
+		uint32 datumStride = att_align_nominal(datumTypeLength, datumTypeAlign);
+
+		uint32 existsCount = CheckPackedDatumArray(datumBuffer, existsArray, datumCount,
+												   datumStride);
+		bool allExist = existsCount == datumCount;
+
+		if (!datumTypeByValue)
+		{
+			DeserializeByRefArray(datumBuffer->data, datumStride, existsArray,
+								  datumCount, datumArray);
+			return;
+		}
+
+		if (datumStride == datumTypeLength)
+		{
+			switch (datumTypeLength)
+			{
+				case 1:
+				{
+					DeserializeByValArray1(datumBuffer->data, existsArray, datumCount,
+										   allExist, datumArray);
+					return;
+				}
+
+				case 2:
+				{
+					DeserializeByValArray2(datumBuffer->data, existsArray, datumCount,
+										   allExist, datumArray);
+					return;
+				}
+
+				case 4:
+				{
+					DeserializeByValArray4(datumBuffer->data, existsArray, datumCount,
+										   allExist, datumArray);
+					return;
+				}
+
+#if SIZEOF_DATUM == 8
+				case 8:
+				{
+					DeserializeByValArray8(datumBuffer->data, existsArray, datumCount,
+										   allExist, datumArray);
+					return;
+				}
+#endif
+
+				default:
+				{
+					break;
+				}
+			}
+		}
+
+		/* values passed by value that are padded to their alignment */
+		char *currentDatumDataPointer = datumBuffer->data;
+		for (datumIndex = 0; datumIndex < datumCount; datumIndex++)
+		{
+			if (!existsArray[datumIndex])
+			{
+				continue;
+			}
+
+			datumArray[datumIndex] = fetch_att(currentDatumDataPointer, datumTypeByValue,
+											   datumTypeLength);
+			currentDatumDataPointer += datumStride;
+		}
+
+		return;
+	}
+
+	if (datumTypeLength == -1)
+	{
+		switch (datumTypeAlign)
+		{
+			case TYPALIGN_CHAR:
+			{
+				DeserializeVarlenaArrayChar(datumBuffer, existsArray, datumCount,
+											datumArray);
+				return;
+			}
+
+			case TYPALIGN_SHORT:
+			{
+				DeserializeVarlenaArrayShort(datumBuffer, existsArray, datumCount,
+											 datumArray);
+				return;
+			}
+
+			case TYPALIGN_INT:
+			{
+				DeserializeVarlenaArrayInt(datumBuffer, existsArray, datumCount,
+										   datumArray);
+				return;
+			}
+
+			case TYPALIGN_DOUBLE:
+			{
+				DeserializeVarlenaArrayDouble(datumBuffer, existsArray, datumCount,
+											  datumArray);
+				return;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+	/* cstrings */
+	for (datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		char *currentDatumDataPointer = datumBuffer->data + currentDatumDataOffset;
+
+		datumArray[datumIndex] = fetch_att(currentDatumDataPointer, datumTypeByValue,
+										   datumTypeLength);
 		currentDatumDataOffset = att_addlength_datum(currentDatumDataOffset,
 													 datumTypeLength,
 													 currentDatumDataPointer);
 		currentDatumDataOffset = att_align_nominal(currentDatumDataOffset,
 												   datumTypeAlign);
 
-		if (currentDatumDataOffset > datumBuffer->len)
+		if (currentDatumDataOffset > datumBuffer->len)
+		{
+			ereport(ERROR, (errmsg("insufficient data left in datum buffer: %d, %d", currentDatumDataOffset, datumBuffer->len)));
+		}
+	}
+}
+
+
+/*
+ * ChunkValuesCanStayPacked returns whether the stored values of a column
+ * chunk are laid out the way vectors keep them: plain encoded values of a
+ * fixed length, back to back without padding. Values of by-reference types
+ * longer than a Datum are copied into vectors as they are, so they qualify.
+ */
+static bool
+ChunkValuesCanStayPacked(ValueEncodingType valueEncodingType,
+						 Form_pg_attribute attributeForm)
+{
+	if (valueEncodingType != VALUE_ENCODING_NONE || attributeForm->attlen <= 0)
+	{
+		return false;
+	}
+
+	if (att_align_nominal(attributeForm->attlen, attributeForm->attalign) !=
+		attributeForm->attlen)
+	{
+		return false;
+	}
+
+	return attributeForm->attbyval || attributeForm->attlen > sizeof(Datum);
+}
+
+
+/*
+ * CheckPackedDatumArray errors out if the buffer is too short to hold a
+ * value of datumStride bytes for every row marked true in existsArray, and
+ * otherwise returns the number of those rows.
+ */
+static uint32
+CheckPackedDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCount,
+					  int datumStride)
+{
+	uint32 existsCount = 0;
+
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		existsCount += existsArray[datumIndex] ? 1 : 0;
+	}
+
+	if ((uint64) existsCount * datumStride > (uint64) datumBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in datum buffer: "
+							   UINT64_FORMAT ", %d",
+							   (uint64) existsCount * datumStride,
+							   datumBuffer->len)));
+	}
+
+	return existsCount;
+}
+
+
+/*
+ * AcquireChunkDecodeBuffers returns the chunk data of the decode buffers,
+ * emptied for a chunk group of rowCount rows. The columns to deserialize are
+ * found from the projected columns on first use.
+ */
+static ChunkData *
+AcquireChunkDecodeBuffers(ChunkDecodeBuffers *decodeBuffers, uint32 columnCount,
+						  List *projectedColumnList, uint32 rowCount)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(decodeBuffers->context);
+
+	if (decodeBuffers->columnMask == NULL)
+	{
+		decodeBuffers->columnMask = ProjectedColumnMask(columnCount, projectedColumnList);
+	}
+
+	ChunkData *chunkData = decodeBuffers->chunkData;
+
+	if (chunkData == NULL || rowCount > decodeBuffers->rowCapacity)
+	{
+		FreeChunkData(chunkData);
+
+		chunkData = CreateEmptyChunkData(columnCount, decodeBuffers->columnMask, rowCount);
+		decodeBuffers->chunkData = chunkData;
+		decodeBuffers->rowCapacity = rowCount;
+	}
+	else
+	{
+		/* the value buffers of the previous chunk group were freed with it */
+		memset(chunkData->valueBufferArray, 0, columnCount * sizeof(StringInfo));
+		memset(chunkData->valueEncodingArray, 0, columnCount * sizeof(ValueEncodingType));
+		memset(chunkData->nullStateArray, 0, columnCount * sizeof(ChunkNullState));
+		memset(chunkData->packedValueArray, 0, columnCount * sizeof(char *));
+
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (decodeBuffers->columnMask[columnIndex])
+			{
+				memset(chunkData->existsArray[columnIndex], 0, rowCount * sizeof(bool));
+				memset(chunkData->valueArray[columnIndex], 0, rowCount * sizeof(Datum));
+			}
+		}
+
+		chunkData->rowCount = rowCount;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return chunkData;
+}
+
+
+/*
+ * DeserializeChunkGroupData deserializes requested data chunk for all columns and
+ * stores in chunkDataArray. It uncompresses serialized data if necessary. The
+ * function also deallocates data buffers used for previous chunk, and compressed
+ * data buffers for the current chunk which will not be needed again. If a column
+ * data is not present serialized buffer, then default value (or null) is used
+ * to fill value array. For vectorized reads, only the arrays are allocated and
+ * the columns are deserialized by ReadColumnNextVector.
+ */
+static ChunkData *
+DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+					 uint32 rowCount, TupleDesc tupleDescriptor,
+					 List *projectedColumnList, StripeReadState *state, uint64 stripeId,
+					 bool vectorRead)
+{
+	int columnIndex = 0;
+	ChunkDecodeBuffers *decodeBuffers = state->decodeBuffers;
+	ChunkData *chunkData = AcquireChunkDecodeBuffers(decodeBuffers, tupleDescriptor->natts,
+													 projectedColumnList, rowCount);
+	bool *columnMask = decodeBuffers->columnMask;
+
+	/* large values of the previous chunk group aren't needed anymore */
+	if (state->largeValueContext != NULL)
+	{
+		MemoryContextReset(state->largeValueContext);
+	}
+
+	if (columnar_column_decompression_threads > 1 && !columnar_enable_page_cache)
+	{
+		DecompressChunkGroupConcurrently(stripeBuffers, chunkIndex, columnMask, state);
+	}
+
+	/* vectorized reads deserialize each column when a vector first reads it */
+	if (vectorRead)
+	{
+		return chunkData;
+	}
+
+	for (columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
+	{
+		DeserializeChunkColumn(stripeBuffers, chunkIndex, rowCount, tupleDescriptor,
+							   columnIndex, columnMask[columnIndex], chunkData, state,
+							   stripeId, false);
+	}
+
+	return chunkData;
+}
+
+
+/*
+ * DecompressChunkGroupConcurrently decompresses the value streams of the
+ * projected columns of a chunk group with columnar.column_decompression_threads
+ * threads, into the decompression buffers of the columns, which
+ * DeserializeChunkColumn then uses like the ones of the helper thread. Only
+ * streams compressed with lz4 or zstd without a dictionary are handled, and
+ * nothing is done unless there are at least two of them.
+ */
+static void
+DecompressChunkGroupConcurrently(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+								 bool *columnMask, StripeReadState *state)
+{
+	int columnCount = state->columnCount;
+
+	if (state->columnDecompressionJobs == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(state->stripeReadContext);
+
+		if (state->columnPrefetched == NULL)
+		{
+			state->columnPrefetched = palloc0(columnCount * sizeof(bool));
+		}
+
+		state->columnDecompressionJobs = palloc0(columnCount * sizeof(DecompressionJob));
+		state->columnDecompressionJobColumns = palloc0(columnCount * sizeof(uint32));
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	/* columns the helper thread decompressed for this chunk group are kept */
+	if (state->prefetchedChunkGroupIndex != chunkIndex)
+	{
+		memset(state->columnPrefetched, false, columnCount * sizeof(bool));
+		state->prefetchedChunkGroupIndex = chunkIndex;
+	}
+
+	uint32 jobCount = 0;
+
+	for (uint32 columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		if (columnBuffers == NULL || !columnMask[columnIndex] ||
+			state->columnPrefetched[columnIndex])
+		{
+			continue;
+		}
+
+		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
+		if (chunkBuffers->compressionDictionaryId != 0 ||
+			!ConcurrentCompressionSupported(chunkBuffers->valueCompressionType))
+		{
+			continue;
+		}
+
+		if (state->decompressionBufferArray[columnIndex] == NULL)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(state->stripeReadContext);
+			state->decompressionBufferArray[columnIndex] = makeStringInfo();
+			MemoryContextSwitchTo(oldContext);
+		}
+
+		DecompressionJob *job = &state->columnDecompressionJobs[jobCount];
+		job->inputBuffer = chunkBuffers->valueBuffer;
+		job->outputBuffer = state->decompressionBufferArray[columnIndex];
+		job->compressionType = chunkBuffers->valueCompressionType;
+		job->decompressedSize = chunkBuffers->decompressedValueSize;
+
+		state->columnDecompressionJobColumns[jobCount] = columnIndex;
+		jobCount++;
+	}
+
+	if (jobCount < 2)
+	{
+		return;
+	}
+
+	DecompressBuffersConcurrently(state->columnDecompressionJobs, jobCount,
+								  columnar_column_decompression_threads);
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		DecompressionJob *job = &state->columnDecompressionJobs[jobIndex];
+		if (!job->decompressed)
+		{
+			continue;
+		}
+
+		state->columnPrefetched[state->columnDecompressionJobColumns[jobIndex]] = true;
+
+		DecompressionStatistics *decompression =
+			&state->statistics->decompression[job->compressionType];
+		decompression->chunkCount++;
+		decompression->compressedBytes += job->inputBuffer->len;
+		decompression->decompressedBytes += job->outputBuffer->len;
+		decompression->elapsedMicroseconds += job->elapsedMicroseconds;
+	}
+}
+
+
+/*
+ * DeserializeChunkColumn deserializes the chunk of a column into chunkData,
+ * decompressing it if necessary. Fixed length values are left packed as they
+ * are stored for vectorized reads, and for row reads of chunks without NULL
+ * rows.
+ */
+static void
+DeserializeChunkColumn(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+					   uint32 rowCount, TupleDesc tupleDescriptor,
+					   uint32 columnIndex, bool columnProjected,
+					   ChunkData *chunkData, StripeReadState *state,
+					   uint64 stripeId, bool vectorRead)
+{
+	Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+	ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+	bool columnAdded = false;
+
+	if (columnBuffers == NULL && columnProjected)
+	{
+		columnAdded = true;
+	}
+
+	if (columnBuffers != NULL)
+	{
+		ColumnChunkBuffers *chunkBuffers =
+			columnBuffers->chunkBuffersArray[chunkIndex];
+		bool shouldCache = columnar_enable_page_cache == true && chunkBuffers->valueCompressionType != COMPRESSION_NONE;
+		bool useSharedCache = shouldCache && ColumnarSharedCacheEnabled();
+		uint64 stripeChunkIndex = stripeBuffers->selectedChunkGroupIndex[chunkIndex];
+
+		/* the shared cache returns copies, so there is nothing to pin */
+		if (useSharedCache)
+		{
+			shouldCache = false;
+		}
+
+		/* already decompressed by the helper thread of the stripe read */
+		StringInfo prefetchedBuffer = NULL;
+		if (state->columnPrefetched != NULL && state->columnPrefetched[columnIndex] &&
+			state->prefetchedChunkGroupIndex == chunkIndex)
+		{
+			prefetchedBuffer = state->decompressionBufferArray[columnIndex];
+			state->columnPrefetched[columnIndex] = false;
+			shouldCache = false;
+			useSharedCache = false;
+		}
+
+		if (shouldCache)
+		{
+			ColumnarMarkChunkGroupInUse(state->relation->rd_id, stripeId, stripeChunkIndex);
+		}
+
+		/* decompress and deserialize current chunk's data */
+		StringInfo valueBuffer = prefetchedBuffer;
+		StringInfo decompressionBuffer = NULL;
+		
+		if (shouldCache)
+		{
+			valueBuffer = ColumnarRetrieveCache(state->relation->rd_id, stripeId, stripeChunkIndex, columnIndex);
+		}
+		else if (useSharedCache)
+		{
+			valueBuffer = ColumnarSharedCacheLookup(state->storageId, stripeId,
+													stripeChunkIndex, columnIndex);
+		}
+
+		if (shouldCache || useSharedCache)
+		{
+			if (valueBuffer != NULL)
+			{
+				state->statistics->cacheHits++;
+			}
+			else
+			{
+				state->statistics->cacheMisses++;
+			}
+		}
+
+		/*
+		 * Decide if a missed chunk should be cached before it is
+		 * decompressed into the cache memory context. Quotas are only
+		 * tracked by the backend local cache.
+		 */
+		if (valueBuffer == NULL && (shouldCache || useSharedCache) &&
+			(state->cacheAdmissionDisabled ||
+			 !ColumnarCacheAdmit(state->relation->rd_id, stripeId, stripeChunkIndex,
+								 columnIndex, chunkBuffers->decompressedValueSize,
+								 useSharedCache ? 0 : state->cacheQuota)))
+		{
+			/* let the backends waiting for this chunk decompress it themselves */
+			if (useSharedCache)
+			{
+				ColumnarSharedCacheReleaseClaim();
+			}
+
+			shouldCache = false;
+			useSharedCache = false;
+		}
+
+		if (valueBuffer == NULL)
+		{
+			MemoryContext oldMemoryContext;
+			if (shouldCache)
+			{
+				oldMemoryContext = MemoryContextSwitchTo(ColumnarCacheMemoryContext());
+			}
+
+			/* the column cache keeps its entries, so they need their own buffer */
+			if (!shouldCache)
+			{
+				if (state->decompressionBufferArray[columnIndex] == NULL)
+				{
+					state->decompressionBufferArray[columnIndex] = makeStringInfo();
+				}
+
+				decompressionBuffer = state->decompressionBufferArray[columnIndex];
+			}
+
+			valueBuffer = DecompressChunkValueBuffer(chunkBuffers, decompressionBuffer,
+													 state->statistics);
+
+			if (shouldCache)
+			{
+				ColumnarAddCacheEntry(state->relation->rd_id, stripeId, stripeChunkIndex, columnIndex, valueBuffer);
+				MemoryContextSwitchTo(oldMemoryContext);
+			}
+			else if (useSharedCache)
+			{
+				ColumnarSharedCacheInsert(state->storageId, stripeId, stripeChunkIndex,
+										  columnIndex, valueBuffer);
+			}
+		}
+
+		DeserializeExistsArray(chunkBuffers, chunkData->existsArray[columnIndex],
+							   rowCount);
+
+		/*
+		 * Vectors get the values copied straight from the value buffer. Row
+		 * reads fetch them from it too when no row is NULL, so that the value
+		 * of a row is at its index, which saves widening narrow values into
+		 * Datums only to read them back.
+		 */
+		bool leavePacked = false;
+		if (ChunkValuesCanStayPacked(chunkBuffers->valueEncodingType, attributeForm))
+		{
+			uint32 valueCount =
+				CheckPackedDatumArray(valueBuffer, chunkData->existsArray[columnIndex],
+									  rowCount, attributeForm->attlen);
+			leavePacked = vectorRead || valueCount == rowCount;
+		}
+
+		if (leavePacked)
+		{
+			chunkData->packedValueArray[columnIndex] = valueBuffer->data;
+		}
+		else
+		{
+			DeserializeDatumArray(valueBuffer, chunkBuffers->valueEncodingType,
+								  chunkData->existsArray[columnIndex],
+								  rowCount, attributeForm->attbyval,
+								  attributeForm->attlen, attributeForm->attalign,
+								  chunkData->valueArray[columnIndex]);
+		}
+
+		if (!leavePacked && chunkBuffers->largeValueCount > 0)
 		{
-			ereport(ERROR, (errmsg("insufficient data left in datum buffer: %d, %d", currentDatumDataOffset, datumBuffer->len)));
+			ReadChunkLargeValues(state, attributeForm,
+								 chunkData->existsArray[columnIndex], rowCount,
+								 chunkData->valueArray[columnIndex], vectorRead);
+		}
+
+		/*
+		 * store current chunk's data buffer to be freed at next chunk read,
+		 * the reused decompression buffer is owned by the stripe read state
+		 * and uncompressed values of cached chunks by the rescan cache, or
+		 * of streamed chunks by the stream
+		 */
+		bool valueBufferOwned = valueBuffer == decompressionBuffer ||
+								(state->streamState != NULL &&
+								 valueBuffer == chunkBuffers->valueBuffer) ||
+								(state->rescanCache != NULL &&
+								 MemoryContextContains(state->rescanCache->context,
+													   valueBuffer));
+		chunkData->valueBufferArray[columnIndex] =
+			valueBufferOwned ? NULL : valueBuffer;
+		chunkData->valueEncodingArray[columnIndex] = chunkBuffers->valueEncodingType;
+		chunkData->nullStateArray[columnIndex] = chunkBuffers->nullState;
+	}
+	else if (columnAdded)
+	{
+		/*
+		 * This is a column that was added after creation of this stripe.
+		 * So we use either the default value or NULL.
+		 */
+		if (attributeForm->atthasdef)
+		{
+			int rowIndex = 0;
+
+			Datum defaultValue = ColumnDefaultValue(tupleDescriptor->constr,
+													attributeForm);
+
+			for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				chunkData->existsArray[columnIndex][rowIndex] = true;
+				chunkData->valueArray[columnIndex][rowIndex] = defaultValue;
+			}
+
+			chunkData->nullStateArray[columnIndex] = CHUNK_NULLS_NONE;
+		}
+		else
+		{
+			memset(chunkData->existsArray[columnIndex], false,
+				   rowCount * sizeof(bool));
+			chunkData->nullStateArray[columnIndex] = CHUNK_NULLS_ALL;
+		}
+	}
+}
+
+
+/*
+ * ReadChunkLargeValues replaces the references to the large value area in
+ * the values of a chunk column with the values. Vectorized reads get the
+ * values right away, and row reads expanded objects that read a value when
+ * it's used, so rows whose value isn't used don't read it. Both live in the
+ * large value context of the stripe read until the next chunk group.
+ *
+ * Expanded objects of array and composite types are expected to be of their
+ * types, so those are also read right away.
+ */
+static void
+ReadChunkLargeValues(StripeReadState *state, Form_pg_attribute attributeForm,
+					 bool *existsArray, uint32 rowCount, Datum *valueArray,
+					 bool vectorRead)
+{
+	if (state->largeValueContext == NULL)
+	{
+		state->largeValueContext = AllocSetContextCreate(state->stripeReadContext,
+														 "Columnar Large Values",
+														 ALLOCSET_DEFAULT_SIZES);
+	}
+
+	bool readLazily = !vectorRead &&
+					  !type_is_array_domain(attributeForm->atttypid) &&
+					  !type_is_rowtype(attributeForm->atttypid);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(state->largeValueContext);
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (!existsArray[rowIndex] || !ColumnarIsLargeValueReference(valueArray[rowIndex]))
+		{
+			continue;
+		}
+
+		if (readLazily)
+		{
+			valueArray[rowIndex] = ColumnarLazyLargeValue(state->relation,
+														  state->stripeFileOffset,
+														  valueArray[rowIndex],
+														  state->largeValueContext);
+		}
+		else
+		{
+			valueArray[rowIndex] = ColumnarFetchLargeValue(state->relation,
+														   state->stripeFileOffset,
+														   valueArray[rowIndex]);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnDefaultValue returns default value for given column. Only const values
+ * are supported. The function errors on any other default value expressions.
+ */
+static Datum
+ColumnDefaultValue(TupleConstr *tupleConstraints, Form_pg_attribute attributeForm)
+{
+	Node *defaultValueNode = NULL;
+	int defValIndex = 0;
+
+	for (defValIndex = 0; defValIndex < tupleConstraints->num_defval; defValIndex++)
+	{
+		AttrDefault attrDefault = tupleConstraints->defval[defValIndex];
+		if (attrDefault.adnum == attributeForm->attnum)
+		{
+			defaultValueNode = stringToNode(attrDefault.adbin);
+			break;
+		}
+	}
+
+	Assert(defaultValueNode != NULL);
+
+	/* try reducing the default value node to a const node */
+	defaultValueNode = eval_const_expressions(NULL, defaultValueNode);
+	if (IsA(defaultValueNode, Const))
+	{
+		Const *constNode = (Const *) defaultValueNode;
+		return constNode->constvalue;
+	}
+	else
+	{
+		const char *columnName = NameStr(attributeForm->attname);
+		ereport(ERROR, (errmsg("unsupported default value for column \"%s\"", columnName),
+						errhint("Expression is either mutable or "
+								"does not evaluate to constant value")));
+	}
+}
+
+/* Vectorization */
+
+static inline uint64 ChunkRowMaskWord(bytea *rowMask, uint32 row);
+static uint32 SelectChunkGroupRows(bytea *rowMask, uint32 startRow, uint32 rowCount,
+								   uint32 maxSelectedRows, uint32 *selectedRows,
+								   uint32 *endRow);
+static void ReadColumnNextVector(ChunkGroupReadState *chunkGroupReadState,
+								 uint32 columnIndex, VectorColumn *vectorColumn,
+								 uint32 endRow, const uint32 *selectedRows,
+								 uint32 selectedRowCount);
+static void DiscardChunkGroupVector(ChunkGroupReadState *chunkGroupReadState,
+									Datum *columnValues, const bool *columnRead,
+									uint32 endRow);
+static uint32 ChunkValueCount(const bool *existsArray, uint32 startRow, uint32 endRow);
+static bool ChunkRangeHasNulls(const ChunkData *chunkGroupData, uint32 columnIndex,
+							   uint32 startRow, uint32 endRow);
+static void ReadPackedColumnNextVector(ChunkGroupReadState *chunkGroupReadState,
+									   uint32 columnIndex, VectorColumn *vectorColumn,
+									   uint32 endRow, const uint32 *selectedRows,
+									   uint32 selectedRowCount);
+static void ReadDatumColumnNextVector(ChunkGroupReadState *chunkGroupReadState,
+									  uint32 columnIndex, VectorColumn *vectorColumn,
+									  uint32 endRow, const uint32 *selectedRows,
+									  uint32 selectedRowCount);
+
+/*
+ * ColumnarReadNextVector fills the projected columns of the vectors in
+ * columnValues with up to maxVectorSize next rows of a sequential scan, and
+ * rowNumber with their row numbers. A vector holds rows of a single chunk
+ * group, or of the delta store. With vector quals, only vectors with rows
+ * that pass them are returned. Returns false if there are no more rows.
+ */
+bool
+ColumnarReadNextVector(ColumnarReadState *readState, Datum *columnValues,
+					   uint64 *rowNumber, int maxVectorSize, int *newVectorSize)
+{
+	while (true)
+	{
+		if (!StripeReadInProgress(readState))
+		{
+			if (!HasUnreadStripe(readState))
+			{
+				return ReadNextDeltaStoreVector(readState, columnValues, rowNumber,
+												maxVectorSize, newVectorSize);
+			}
+
+			readState->stripeReadState = BeginStripeRead(readState->currentStripeMetadata,
+														 readState->relation,
+														 readState->tupleDescriptor,
+														 readState->projectedColumnList,
+														 readState->whereClauseList,
+														 readState->whereClauseVars,
+														 readState->stripeReadContext,
+														 readState->snapshot,
+														 readState->accessStrategy,
+														 readState->stripeFirstChunkGroup,
+														 readState->stripeEndChunkGroup,
+														 readState->stripeRowTarget,
+														 ReadStateMemoryLimit(),
+														 readState->chunkGroupSummary,
+														 readState->chunkGroupDelete,
+														 readState->topNBound,
+														 readState->joinKeyFilter,
+														 &readState->statistics,
+														 &readState->decodeBuffers,
+														 ReadRescanCache(readState));
+		}
+
+		if (!ReadStripeNextVector(readState->stripeReadState, columnValues,
+								  maxVectorSize, newVectorSize,
+								  readState->currentStripeMetadata->id,
+								  readState->snapshot,
+								  rowNumber,
+								  readState->currentStripeMetadata->firstRowNumber,
+								  readState->vectorQual))
+		{
+			AdvanceStripeRead(readState);
+			continue;
+		}
+
+		readState->statistics.vectorRowsRead += *newVectorSize;
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * ReadStripeNextVector reads the next rows of the current chunk group of the
+ * stripe into the vectors. Chunk groups whose remaining rows are all deleted,
+ * or fail the vector quals, are skipped. Returns false if the stripe has no
+ * more rows.
+ */
+static bool
+ReadStripeNextVector(StripeReadState *stripeReadState, Datum *columnValues,
+					 int maxVectorSize, int *newVectorSize,
+					 uint64 stripeId,
+					 Snapshot snapshot,
+					 uint64 *rowNumber,
+					 uint64 stripeFirstRowNumber,
+					 ColumnarVectorQual *vectorQual)
+{
+	while (*newVectorSize == 0)
+	{
+		if (stripeReadState->chunkGroupReadState == NULL)
+		{
+			if (stripeReadState->currentRow >= stripeReadState->rowCount)
+			{
+				Assert(stripeReadState->currentRow == stripeReadState->rowCount);
+				return false;
+			}
+
+			ConsumeChunkGroupPrefetch(stripeReadState);
+
+			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
+				stripeReadState->stripeBuffers,
+				stripeReadState->
+				chunkGroupIndex,
+				stripeReadState->
+				tupleDescriptor,
+				stripeReadState->
+				projectedColumnList,
+				stripeReadState->
+				stripeReadContext,
+				stripeReadState,
+				stripeId,
+				true);
+
+			StartChunkGroupPrefetch(stripeReadState);
+
+			if (columnar_enable_dml &&
+				stripeReadState->chunkGroupReadState->chunkGroupDeletedRows != 0)
+			{
+				uint64 chunkFirstRowNumber =
+					stripeFirstRowNumber +
+					stripeReadState->chunkGroupReadState->chunkStripeRowOffset;
+
+				stripeReadState->chunkGroupReadState->rowMask =
+					StripeReadChunkRowMask(stripeReadState, chunkFirstRowNumber,
+										   stripeReadState->chunkGroupReadState->rowCount);
+			}
+			else
+			{
+				stripeReadState->chunkGroupReadState->rowMask = NULL;
+			}
+		}
+
+		uint64 chunkFirstRowNumber = stripeFirstRowNumber +
+			stripeReadState->chunkGroupReadState->chunkStripeRowOffset;
+
+		if (!ReadChunkGroupNextVector(stripeReadState->chunkGroupReadState,
+									  columnValues,
+									  maxVectorSize,
+									  newVectorSize,
+									  rowNumber,
+									  chunkFirstRowNumber,
+									  vectorQual))
+		{
+			/* if this chunk group is exhausted, fetch the next one and loop */
+			stripeReadState->currentRow += stripeReadState->chunkGroupReadState->rowCount;
+
+			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
+			stripeReadState->chunkGroupReadState = NULL;
+			stripeReadState->chunkGroupIndex++;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ReadChunkGroupNextVector appends the next rows of the chunk group that
+ * aren't deleted to the vectors, until the vectors have maxVectorSize rows.
+ * A chunk group larger than a vector is read by several calls. The rows of
+ * the vector are found first, then each column is filled in one pass.
+ *
+ * With vector quals, the columns of each stage of the quals are filled and
+ * the stage evaluated before the next stage is read. Once no row passes, the
+ * rows are dropped without reading the remaining columns, and *chunkReadRows
+ * is left 0. Returns false if the chunk group has no more rows.
+ */
+static bool
+ReadChunkGroupNextVector(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
+						 int maxVectorSize, int *chunkReadRows,
+						 uint64 *rowNumber,
+						 uint64 chunkFirstRowNumber,
+						 ColumnarVectorQual *vectorQual)
+{
+	if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
+	{
+		Assert(chunkGroupReadState->currentRow == chunkGroupReadState->rowCount);
+		return false;
+	}
+
+	bytea *rowMask = chunkGroupReadState->rowMask;
+	uint32 startRow = chunkGroupReadState->currentRow;
+	uint32 endRow = startRow;
+	int vectorRowCount = *chunkReadRows;
+
+	/* rows of the vector that aren't deleted, NULL if no row in it is */
+	const uint32 *selectedRows = NULL;
+	uint32 selectedRowCount = 0;
+
+	if (rowMask == NULL)
+	{
+		endRow = Min(chunkGroupReadState->rowCount,
+					 startRow + (maxVectorSize - vectorRowCount));
+
+		for (uint32 row = startRow; row < endRow; row++)
+		{
+			rowNumber[vectorRowCount++] = chunkFirstRowNumber + row;
+		}
+	}
+	else
+	{
+		uint32 maxSelectedRows = maxVectorSize - vectorRowCount;
+
+		if (chunkGroupReadState->selectedRowsSize < maxSelectedRows)
+		{
+			if (chunkGroupReadState->selectedRows != NULL)
+			{
+				pfree(chunkGroupReadState->selectedRows);
+			}
+
+			chunkGroupReadState->selectedRows =
+				MemoryContextAlloc(chunkGroupReadState->stripeReadState->stripeReadContext,
+								   maxSelectedRows * sizeof(uint32));
+			chunkGroupReadState->selectedRowsSize = maxSelectedRows;
+		}
+
+		selectedRowCount = SelectChunkGroupRows(rowMask, startRow,
+												chunkGroupReadState->rowCount,
+												maxSelectedRows,
+												chunkGroupReadState->selectedRows,
+												&endRow);
+
+		for (uint32 i = 0; i < selectedRowCount; i++)
+		{
+			rowNumber[vectorRowCount++] =
+				chunkFirstRowNumber + chunkGroupReadState->selectedRows[i];
+		}
+
+		/* without deleted rows between startRow and endRow, copy them in bulk */
+		if (selectedRowCount != endRow - startRow)
+		{
+			selectedRows = chunkGroupReadState->selectedRows;
 		}
 	}
+
+	int attno;
+
+	if (vectorQual != NULL)
+	{
+		bool *columnRead = vectorQual->columnRead;
+		int stage = 0;
+
+		memset(columnRead, false, chunkGroupReadState->columnCount * sizeof(bool));
+
+		List *stageColumnList = NIL;
+		foreach_ptr(stageColumnList, vectorQual->stageColumnLists)
+		{
+			foreach_int(attno, stageColumnList)
+			{
+				const uint32 columnIndex = attno - 1;
+
+				if (!columnRead[columnIndex])
+				{
+					ReadColumnNextVector(chunkGroupReadState, columnIndex,
+										 (VectorColumn *) columnValues[columnIndex],
+										 endRow, selectedRows, selectedRowCount);
+					columnRead[columnIndex] = true;
+				}
+			}
+
+			if (vectorQual->qualFunc(vectorQual->qualState, stage, vectorRowCount) == 0)
+			{
+				DiscardChunkGroupVector(chunkGroupReadState, columnValues, columnRead,
+										endRow);
+
+				*chunkReadRows = 0;
+				chunkGroupReadState->currentRow = endRow;
+
+				return true;
+			}
+
+			stage++;
+		}
+	}
+
+	foreach_int(attno, chunkGroupReadState->projectedColumnList)
+	{
+		/* attno is 1-indexed; existsArray is 0-indexed */
+		const uint32 columnIndex = attno - 1;
+
+		if (vectorQual != NULL && vectorQual->columnRead[columnIndex])
+		{
+			continue;
+		}
+
+		ReadColumnNextVector(chunkGroupReadState, columnIndex,
+							 (VectorColumn *) columnValues[columnIndex],
+							 endRow, selectedRows, selectedRowCount);
+	}
+
+	*chunkReadRows = vectorRowCount;
+	chunkGroupReadState->currentRow = endRow;
+
+	return true;
 }
 
 
 /*
- * DeserializeChunkGroupData deserializes requested data chunk for all columns and
- * stores in chunkDataArray. It uncompresses serialized data if necessary. The
- * function also deallocates data buffers used for previous chunk, and compressed
- * data buffers for the current chunk which will not be needed again. If a column
- * data is not present serialized buffer, then default value (or null) is used
- * to fill value array.
+ * ChunkRowMaskWord returns the deletion bits of the ROW_MASK_WORD_ROWS chunk
+ * group rows from given row on, which is a multiple of ROW_MASK_WORD_ROWS,
+ * with the bit of that row as the lowest one.
  */
-static ChunkData *
-DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
-					 uint32 rowCount, TupleDesc tupleDescriptor,
-					 List *projectedColumnList, StripeReadState *state, uint64 stripeId)
+static inline uint64
+ChunkRowMaskWord(bytea *rowMask, uint32 row)
 {
-	int columnIndex = 0;
-	bool *columnMask = ProjectedColumnMask(tupleDescriptor->natts, projectedColumnList);
+	uint64 deletedWord;
 
+	memcpy(&deletedWord, VARDATA(rowMask) + row / 8, sizeof(uint64));
 
-	ChunkData *chunkData = CreateEmptyChunkData(tupleDescriptor->natts, columnMask,
-												rowCount);
+#ifdef WORDS_BIGENDIAN
+	deletedWord = pg_bswap64(deletedWord);
+#endif
 
-	for (columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
-	{
-		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
-		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
-		bool columnAdded = false;
+	return deletedWord;
+}
 
-		if (columnBuffers == NULL && columnMask[columnIndex])
-		{
-			columnAdded = true;
-		}
 
+/*
+ * SelectChunkGroupRows fills selectedRows with up to maxSelectedRows rows of
+ * the chunk group from startRow on that the row mask doesn't mark deleted,
+ * and sets *endRow to the row after the last one it consumed. The mask is
+ * checked a word at a time, so that runs of deleted rows are skipped and runs
+ * of live rows are selected without testing each bit.
+ */
+static uint32
+SelectChunkGroupRows(bytea *rowMask, uint32 startRow, uint32 rowCount,
+					 uint32 maxSelectedRows, uint32 *selectedRows, uint32 *endRow)
+{
+	uint32 selectedRowCount = 0;
+	uint32 row = startRow;
 
-		if (columnBuffers != NULL)
+	while (row < rowCount && selectedRowCount < maxSelectedRows)
+	{
+		/* rows before the first word boundary and after the last one */
+		if (row % ROW_MASK_WORD_ROWS != 0 || row + ROW_MASK_WORD_ROWS > rowCount)
 		{
-			ColumnChunkBuffers *chunkBuffers =
-				columnBuffers->chunkBuffersArray[chunkIndex];
-			bool shouldCache = columnar_enable_page_cache == true && chunkBuffers->valueCompressionType != COMPRESSION_NONE;
-
-			if (shouldCache)
+			if (!ChunkRowDeleted(rowMask, row))
 			{
-				ColumnarMarkChunkGroupInUse(state->relation->rd_id, stripeId, chunkIndex);
+				selectedRows[selectedRowCount++] = row;
 			}
 
-			/* decompress and deserialize current chunk's data */
-			StringInfo valueBuffer = NULL;
-			
-			if (shouldCache)
-			{
-				valueBuffer = ColumnarRetrieveCache(state->relation->rd_id, stripeId, chunkIndex, columnIndex);
-			}
+			row++;
+			continue;
+		}
 
-			if (valueBuffer == NULL)
-			{
-				MemoryContext oldMemoryContext;
-				if (shouldCache)
-				{
-					oldMemoryContext = MemoryContextSwitchTo(ColumnarCacheMemoryContext());
-				}
+		uint64 deletedWord = ChunkRowMaskWord(rowMask, row);
 
-				valueBuffer = DecompressBuffer(chunkBuffers->valueBuffer,
-								 chunkBuffers->valueCompressionType,
-								 chunkBuffers->decompressedValueSize);
+		if (deletedWord == ~UINT64CONST(0))
+		{
+			row += ROW_MASK_WORD_ROWS;
+			continue;
+		}
 
-				if (shouldCache)
-				{
-					ColumnarAddCacheEntry(state->relation->rd_id, stripeId, chunkIndex, columnIndex, valueBuffer);
-					MemoryContextSwitchTo(oldMemoryContext);
-				}
+		if (deletedWord == 0 &&
+			selectedRowCount + ROW_MASK_WORD_ROWS <= maxSelectedRows)
+		{
+			for (uint32 bit = 0; bit < ROW_MASK_WORD_ROWS; bit++)
+			{
+				selectedRows[selectedRowCount++] = row + bit;
 			}
 
-			DeserializeBoolArray(chunkBuffers->existsBuffer,
-								 chunkData->existsArray[columnIndex],
-								 rowCount);
-			DeserializeDatumArray(valueBuffer, chunkData->existsArray[columnIndex],
-								  rowCount, attributeForm->attbyval,
-								  attributeForm->attlen, attributeForm->attalign,
-								  chunkData->valueArray[columnIndex]);
-
-			/* store current chunk's data buffer to be freed at next chunk read */
-			chunkData->valueBufferArray[columnIndex] = valueBuffer;
+			row += ROW_MASK_WORD_ROWS;
+			continue;
 		}
-		else if (columnAdded)
-		{
-			/*
-			 * This is a column that was added after creation of this stripe.
-			 * So we use either the default value or NULL.
-			 */
-			if (attributeForm->atthasdef)
-			{
-				int rowIndex = 0;
 
-				Datum defaultValue = ColumnDefaultValue(tupleDescriptor->constr,
-														attributeForm);
+		uint64 liveWord = ~deletedWord;
+		while (liveWord != 0 && selectedRowCount < maxSelectedRows)
+		{
+			selectedRows[selectedRowCount++] = row + pg_rightmost_one_pos64(liveWord);
+			liveWord &= liveWord - 1;
+		}
 
-				for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
-				{
-					chunkData->existsArray[columnIndex][rowIndex] = true;
-					chunkData->valueArray[columnIndex][rowIndex] = defaultValue;
-				}
-			}
-			else
-			{
-				memset(chunkData->existsArray[columnIndex], false,
-					   rowCount * sizeof(bool));
-			}
+		if (liveWord != 0)
+		{
+			/* the vector is full, the next one starts at the next live row */
+			row += pg_rightmost_one_pos64(liveWord);
+			break;
 		}
+
+		row += ROW_MASK_WORD_ROWS;
 	}
 
-	return chunkData;
+	*endRow = row;
+
+	return selectedRowCount;
 }
 
 
 /*
- * ColumnDefaultValue returns default value for given column. Only const values
- * are supported. The function errors on any other default value expressions.
+ * ReadColumnNextVector appends the rows of the chunk group up to endRow that
+ * aren't deleted to the vector of a column, deserializing the chunk of the
+ * column first if no vector read it yet. selectedRows lists the rows that
+ * aren't deleted, or is NULL if none between the current row and endRow is.
  */
-static Datum
-ColumnDefaultValue(TupleConstr *tupleConstraints, Form_pg_attribute attributeForm)
+static void
+ReadColumnNextVector(ChunkGroupReadState *chunkGroupReadState,
+					 uint32 columnIndex, VectorColumn *vectorColumn,
+					 uint32 endRow, const uint32 *selectedRows,
+					 uint32 selectedRowCount)
 {
-	Node *defaultValueNode = NULL;
-	int defValIndex = 0;
+	ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
 
-	for (defValIndex = 0; defValIndex < tupleConstraints->num_defval; defValIndex++)
+	if (!chunkGroupReadState->columnDeserialized[columnIndex])
 	{
-		AttrDefault attrDefault = tupleConstraints->defval[defValIndex];
-		if (attrDefault.adnum == attributeForm->attnum)
+		StripeReadState *stripeReadState = chunkGroupReadState->stripeReadState;
+		StripeBuffers *stripeBuffers = stripeReadState->stripeBuffers;
+
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(stripeReadState->stripeReadContext);
+
+		if (columnIndex < stripeBuffers->columnCount)
 		{
-			defaultValueNode = stringToNode(attrDefault.adbin);
-			break;
+			DeserializeChunkColumn(stripeBuffers, chunkGroupReadState->chunkIndex,
+								   chunkGroupReadState->rowCount,
+								   stripeReadState->tupleDescriptor, columnIndex, true,
+								   chunkGroupData, stripeReadState,
+								   chunkGroupReadState->stripeId, true);
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		/* earlier vectors of the chunk group didn't need the column */
+		if (chunkGroupData->packedValueArray[columnIndex] != NULL)
+		{
+			chunkGroupReadState->packedValueIndex[columnIndex] =
+				ChunkValueCount(chunkGroupData->existsArray[columnIndex], 0,
+								chunkGroupReadState->currentRow);
 		}
+
+		chunkGroupReadState->columnDeserialized[columnIndex] = true;
 	}
 
-	Assert(defaultValueNode != NULL);
+	/* the vector has no NULL rows as long as none of its ranges had any */
+	bool noNulls = (vectorColumn->dimension == 0 || vectorColumn->noNulls) &&
+				   !ChunkRangeHasNulls(chunkGroupData, columnIndex,
+									   chunkGroupReadState->currentRow, endRow);
 
-	/* try reducing the default value node to a const node */
-	defaultValueNode = eval_const_expressions(NULL, defaultValueNode);
-	if (IsA(defaultValueNode, Const))
+	if (chunkGroupData->packedValueArray[columnIndex] != NULL)
 	{
-		Const *constNode = (Const *) defaultValueNode;
-		return constNode->constvalue;
+		ReadPackedColumnNextVector(chunkGroupReadState, columnIndex, vectorColumn,
+								   endRow, selectedRows, selectedRowCount);
 	}
 	else
 	{
-		const char *columnName = NameStr(attributeForm->attname);
-		ereport(ERROR, (errmsg("unsupported default value for column \"%s\"", columnName),
-						errhint("Expression is either mutable or "
-								"does not evaluate to constant value")));
+		ReadDatumColumnNextVector(chunkGroupReadState, columnIndex, vectorColumn,
+								  endRow, selectedRows, selectedRowCount);
 	}
+
+	vectorColumn->noNulls = noNulls;
 }
 
-/* Vectorization */
 
-#include "columnar/vectorization/columnar_vector_types.h"
+/*
+ * ChunkRangeHasNulls returns whether a row of the chunk of a column between
+ * startRow and endRow is NULL. Chunks whose skip node says they have no NULL
+ * rows don't need their exists array looked at.
+ */
+static bool
+ChunkRangeHasNulls(const ChunkData *chunkGroupData, uint32 columnIndex,
+				   uint32 startRow, uint32 endRow)
+{
+	if (chunkGroupData->nullStateArray[columnIndex] == CHUNK_NULLS_NONE)
+	{
+		return false;
+	}
 
-bool
-ColumnarReadNextVector(ColumnarReadState *readState,  Datum *columnValues,
-					   bool *columnNulls, uint64 *rowNumber, int *newVectorSize)
+	return memchr(chunkGroupData->existsArray[columnIndex] + startRow, false,
+				  endRow - startRow) != NULL;
+}
+
+
+/*
+ * DiscardChunkGroupVector drops the rows of the chunk group up to endRow,
+ * none of which passed the vector quals. The vectors of the columns already
+ * read are emptied again, and the packed values of the other deserialized
+ * columns are skipped.
+ */
+static void
+DiscardChunkGroupVector(ChunkGroupReadState *chunkGroupReadState,
+						Datum *columnValues, const bool *columnRead,
+						uint32 endRow)
 {
-	while (true)
+	const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
+
+	int attno;
+	foreach_int(attno, chunkGroupReadState->projectedColumnList)
 	{
-		if (!StripeReadInProgress(readState))
-		{
-			if (!HasUnreadStripe(readState))
-			{
-				return false;
-			}
+		const uint32 columnIndex = attno - 1;
 
-			readState->stripeReadState = BeginStripeRead(readState->currentStripeMetadata,
-														 readState->relation,
-														 readState->tupleDescriptor,
-														 readState->projectedColumnList,
-														 readState->whereClauseList,
-														 readState->whereClauseVars,
-														 readState->stripeReadContext,
-														 readState->snapshot);
+		if (columnRead[columnIndex])
+		{
+			ClearVectorColumn((VectorColumn *) columnValues[columnIndex]);
 		}
-
-		if (!ReadStripeNextVector(readState->stripeReadState, columnValues, columnNulls, 
-								  newVectorSize,
-								  readState->currentStripeMetadata->id,
-								  readState->snapshot,
-								  rowNumber,
-								  readState->currentStripeMetadata->firstRowNumber))
+		else if (chunkGroupReadState->columnDeserialized[columnIndex] &&
+				 chunkGroupData->packedValueArray[columnIndex] != NULL)
 		{
-			AdvanceStripeRead(readState);
-			
-			// We have collected rows from last stripe, break loop
-			if (*newVectorSize)
-				return true;
-			
-			continue;
+			chunkGroupReadState->packedValueIndex[columnIndex] +=
+				ChunkValueCount(chunkGroupData->existsArray[columnIndex],
+								chunkGroupReadState->currentRow, endRow);
 		}
-
-		return true;
 	}
-
-	return false;
 }
 
 
-static bool
-ReadStripeNextVector(StripeReadState *stripeReadState, Datum *columnValues,
-					 bool *columnNulls, int *newVectorSize,
-					 uint64 stripeId,
-					 Snapshot snapshot,
-					 uint64 *rowNumber,
-					 uint64 stripeFirstRowNumber)
+/*
+ * ChunkValueCount returns the number of rows between startRow and endRow that
+ * have a value, which deleted rows also keep in the value buffer.
+ */
+static uint32
+ChunkValueCount(const bool *existsArray, uint32 startRow, uint32 endRow)
 {
-	if (stripeReadState->currentRow >= stripeReadState->rowCount)
+	uint32 valueCount = 0;
+
+	for (uint32 row = startRow; row < endRow; row++)
 	{
-		Assert(stripeReadState->currentRow == stripeReadState->rowCount);
-		return false;
+		valueCount += existsArray[row];
 	}
 
-	int32 *columnValueOffset = palloc(sizeof(int32) * stripeReadState->tupleDescriptor->natts);
-	memset(columnValueOffset, 0, sizeof(int32) * stripeReadState->tupleDescriptor->natts);
+	return valueCount;
+}
+
 
-	while (true)
+/*
+ * ReadPackedColumnNextVector appends the rows of the chunk group up to endRow
+ * that aren't deleted to the vector of a column whose values stayed packed.
+ * Without deleted or NULL rows in the range, the values are copied with a
+ * single memcpy, and without NULL rows, the values of the selected rows are
+ * found by their offset in the range.
+ */
+static void
+ReadPackedColumnNextVector(ChunkGroupReadState *chunkGroupReadState,
+						   uint32 columnIndex, VectorColumn *vectorColumn,
+						   uint32 endRow, const uint32 *selectedRows,
+						   uint32 selectedRowCount)
+{
+	const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
+	const bool *existsArray = chunkGroupData->existsArray[columnIndex];
+	const char *packedValues = chunkGroupData->packedValueArray[columnIndex];
+	const uint16 typeLen = vectorColumn->columnTypeLen;
+	const uint32 startRow = chunkGroupReadState->currentRow;
+	const uint32 rowCount = endRow - startRow;
+	uint32 valueIndex = chunkGroupReadState->packedValueIndex[columnIndex];
+	bool hasNulls = ChunkRangeHasNulls(chunkGroupData, columnIndex, startRow, endRow);
+
+	if (selectedRows == NULL && !hasNulls)
 	{
-		uint64 chunkFirstRowNumber = 0;
+		memcpy((int8 *) vectorColumn->value + typeLen * vectorColumn->dimension,
+			   packedValues + typeLen * valueIndex,
+			   typeLen * rowCount);
+		memset(vectorColumn->isnull + vectorColumn->dimension, false, rowCount);
 
-		if (stripeReadState->chunkGroupReadState == NULL)
+		vectorColumn->dimension += rowCount;
+		valueIndex += rowCount;
+	}
+	else if (!hasNulls)
+	{
+		/* deleted rows still have their value in the buffer */
+		for (uint32 i = 0; i < selectedRowCount; i++)
 		{
-			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
-				stripeReadState->stripeBuffers,
-				stripeReadState->
-				chunkGroupIndex,
-				stripeReadState->
-				tupleDescriptor,
-				stripeReadState->
-				projectedColumnList,
-				stripeReadState->
-				stripeReadContext,
-				stripeReadState,
-				stripeId);
+			memcpy((int8 *) vectorColumn->value + typeLen * vectorColumn->dimension,
+				   packedValues + typeLen * (valueIndex + selectedRows[i] - startRow),
+				   typeLen);
+			vectorColumn->isnull[vectorColumn->dimension] = false;
+			vectorColumn->dimension++;
+		}
 
-			chunkFirstRowNumber = stripeFirstRowNumber +
-								  stripeReadState->chunkGroupReadState->chunkStripeRowOffset;
+		valueIndex += rowCount;
+	}
+	else
+	{
+		uint32 selectedIndex = 0;
 
-			if (columnar_enable_dml &&
-				stripeReadState->chunkGroupReadState->chunkGroupDeletedRows != 0)
-			{
-				stripeReadState->chunkGroupReadState->rowMask =
-					ReadChunkRowMask(stripeReadState->relation->rd_node,
-									 snapshot,
-									 stripeReadState->stripeReadContext,
-									 chunkFirstRowNumber,
-									 stripeReadState->chunkGroupReadState->rowCount);
+		for (uint32 row = startRow; row < endRow; row++)
+		{
+			bool exists = existsArray[row];
 
-			}
-			else
+			if (selectedRows == NULL ||
+				(selectedIndex < selectedRowCount && selectedRows[selectedIndex] == row))
 			{
-				stripeReadState->chunkGroupReadState->rowMask = NULL;
-			}
-		}
-		else
-		{
-			chunkFirstRowNumber = stripeFirstRowNumber +
-						stripeReadState->chunkGroupReadState->chunkStripeRowOffset;
-		}
+				if (exists)
+				{
+					memcpy((int8 *) vectorColumn->value + typeLen * vectorColumn->dimension,
+						   packedValues + typeLen * valueIndex,
+						   typeLen);
+					vectorColumn->isnull[vectorColumn->dimension] = false;
+				}
 
-		if (!ReadChunkGroupNextVector(stripeReadState->chunkGroupReadState,
-									  columnValues, columnNulls, 
-									  stripeReadState->tupleDescriptor,
-									  columnValueOffset, 
-									  newVectorSize,
-									  rowNumber,
-									  chunkFirstRowNumber))
-		{
-			/* if this chunk group is exhausted, fetch the next one and loop */
-			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
-			stripeReadState->chunkGroupReadState = NULL;
-			stripeReadState->chunkGroupIndex++;
+				vectorColumn->dimension++;
+				selectedIndex++;
+			}
 
-			if (*newVectorSize == 0)
-				continue;
+			/* deleted rows still have their value in the buffer */
+			valueIndex += exists;
 		}
-
-		stripeReadState->currentRow += stripeReadState->chunkGroupReadState->rowCount;
-
-		return true;
 	}
 
-	return false;
+	chunkGroupReadState->packedValueIndex[columnIndex] = valueIndex;
 }
 
 
-static bool
-ReadChunkGroupNextVector(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
-						 bool *columnNulls, TupleDesc tupleDesc, 
-						 int32 *columnValueOffset, int *chunkReadRows,
-						 uint64 *rowNumber,
-						 uint64 stripeFirstRowNumber)
+/*
+ * ReadDatumColumnNextVector appends the rows of the chunk group up to endRow
+ * that aren't deleted to the vector of a column deserialized into a Datum
+ * array.
+ */
+static void
+ReadDatumColumnNextVector(ChunkGroupReadState *chunkGroupReadState,
+						  uint32 columnIndex, VectorColumn *vectorColumn,
+						  uint32 endRow, const uint32 *selectedRows,
+						  uint32 selectedRowCount)
 {
-	if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
+	const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
+	const bool *existsArray = chunkGroupData->existsArray[columnIndex];
+	const Datum *valueArray = chunkGroupData->valueArray[columnIndex];
+	uint32 startRow = chunkGroupReadState->currentRow;
+
+	/* values of dictionary and run length encoded chunks come in runs */
+	if (vectorColumn->dimension == 0)
 	{
-		Assert(chunkGroupReadState->currentRow == chunkGroupReadState->rowCount);
-		return false;
-	}
+		ValueEncodingType valueEncodingType =
+			chunkGroupData->valueEncodingArray[columnIndex];
 
-	/*
-	 * Initialize to all-NULL. Only non-NULL projected attributes will be set.
-	 */
-	memset(columnNulls, true, sizeof(bool) * chunkGroupReadState->columnCount);
+		vectorColumn->hasRuns = valueEncodingType == VALUE_ENCODING_DICTIONARY ||
+								valueEncodingType == VALUE_ENCODING_RUN_LENGTH;
+	}
 
-	int i;
-	int rowNumberIndex = 0;
+	uint32 vectorRowCount = selectedRows != NULL ? selectedRowCount : endRow - startRow;
 
-	for (i = 0; i < chunkGroupReadState->rowCount; i ++)
+	for (uint32 i = 0; i < vectorRowCount; i++)
 	{
-		if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
-			return false;
-		
-		if (*chunkReadRows >= COLUMNAR_VECTOR_COLUMN_SIZE)
-			break;
+		uint32 row = selectedRows != NULL ? selectedRows[i] : startRow + i;
 
-		if (chunkGroupReadState->rowMask != NULL)
+		if (existsArray[row])
 		{
-			int8 checkColumnMask = 1 << (chunkGroupReadState->currentRow % 8);
-			int8 checkLookupMask = VARDATA(chunkGroupReadState->rowMask)[chunkGroupReadState->currentRow / 8];
+			int8 *writeColumnRowPosition =
+				(int8 *) vectorColumn->value +
+				vectorColumn->columnTypeLen * vectorColumn->dimension;
 
-			if (checkLookupMask & checkColumnMask)
+			/* 
+			 * For data types which have len less or equal 8 we can
+			 * use `store_att_byval` function.
+			 */
+			if (vectorColumn->columnTypeLen <= 8)
 			{
-				chunkGroupReadState->currentRow++;
-				continue;
+				store_att_byval(writeColumnRowPosition, valueArray[row],
+								vectorColumn->columnTypeLen);
 			}
-		}
-
-		int attno;
-		foreach_int(attno, chunkGroupReadState->projectedColumnList)
-		{
-			const ChunkData *chunkGroupData = chunkGroupReadState->chunkGroupData;
-			const int rowIndex = chunkGroupReadState->currentRow;
-
-			/* attno is 1-indexed; existsArray is 0-indexed */
-			const uint32 columnIndex = attno - 1;
-
-			VectorColumn* vectorColumn = (VectorColumn*) columnValues[columnIndex];
-
-			if (chunkGroupData->existsArray[columnIndex][rowIndex])
+			else
 			{
-				int8 *writeColumnRowPosition = 
-					(int8 *) vectorColumn->value + columnValueOffset[columnIndex];
-
-
-				/* 
-				 * For data types which have len less or equal 8 we can
-				 * use `store_att_byval` function.
-				 */
-				if (vectorColumn->columnTypeLen <= 8)
-				{
-					store_att_byval(writeColumnRowPosition,
-									chunkGroupData->valueArray[columnIndex][rowIndex],
-									vectorColumn->columnTypeLen);
-				}
-				else
-				{
-					memcpy(writeColumnRowPosition,
-						   (int8 *)(chunkGroupData->valueArray[columnIndex][rowIndex]),
-						   vectorColumn->columnTypeLen);
-				}
-
-				vectorColumn->isnull[vectorColumn->dimension] = false;
+				memcpy(writeColumnRowPosition, (int8 *) valueArray[row],
+					   vectorColumn->columnTypeLen);
 			}
 
-			vectorColumn->dimension++;
-			columnValueOffset[columnIndex] += vectorColumn->columnTypeLen;
+			vectorColumn->isnull[vectorColumn->dimension] = false;
 		}
 
-		(*chunkReadRows)++;
-		chunkGroupReadState->currentRow++;
-		rowNumber[rowNumberIndex++] = stripeFirstRowNumber + chunkGroupReadState->currentRow - 1;
-	}
+		if (vectorColumn->hasRuns)
+		{
+			ExtendVectorColumnRuns(vectorColumn);
+		}
 
-	return true;
-}
\ No newline at end of file
+		vectorColumn->dimension++;
+	}
+}
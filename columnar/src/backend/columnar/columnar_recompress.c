@@ -0,0 +1,596 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_recompress.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Recompression of the stripes of columnar tables with another compression
+ * type and level, e.g. to move data that was loaded with lz4 for write
+ * throughput to zstd once it is rarely read.
+ *
+ * Only value streams are decompressed and compressed again. Exists streams,
+ * encodings, statistics and bloom filters of the chunks are kept as they
+ * are, and so are the row numbers of the stripe, so indexes, row masks and
+ * the visibility map stay valid. The recompressed stripe gets a new stripe
+ * id and its data is written to a new place, so transactions that still see
+ * the old stripe keep reading its data.
+ *
+ * columnar.recompress can be limited to stripes written some time ago. The
+ * age of a stripe is the commit time of the transaction that wrote it, which
+ * needs track_commit_timestamp. Stripes whose commit time isn't known
+ * anymore count as old.
+ *
+ * Columns dropped with ALTER TABLE DROP COLUMN keep their chunks in the
+ * stripes written before. Stripes rewritten here store them as chunks whose
+ * values are all NULL, which take no space, and
+ * columnar.reclaim_dropped_columns rewrites just the stripes that have such
+ * chunks, copying the streams of the other columns as they are.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/commit_ts.h"
+#include "access/table.h"
+#include "access/transam.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/utils/listutils.h"
+
+static bool StripeNeedsRecompression(StripeSkipList *skipList, uint32 columnCount,
+									 CompressionType compressionType,
+									 int compressionLevel);
+static bool StripeHasDroppedColumnData(StripeSkipList *skipList, uint32 columnCount,
+									   TupleDesc tupleDescriptor);
+static bool RewriteStripe(Relation rel, StripeMetadata *stripeMetadata,
+						  CompressionType compressionType, int compressionLevel,
+						  uint64 *newDataLength);
+static uint64 StripeLargeValueAreaLength(StripeSkipList *skipList, uint32 columnCount);
+static void ClearChunkSkipNode(ColumnChunkSkipNode *chunkSkipNode);
+static StringInfo ReadStripeStream(Relation rel, uint64 logicalOffset, uint64 length);
+
+PG_FUNCTION_INFO_V1(columnar_recompress);
+PG_FUNCTION_INFO_V1(columnar_reclaim_dropped_columns);
+
+
+/*
+ * columnar_recompress compresses the value streams of the stripes of a
+ * columnar table again with the given compression type and level, and
+ * returns how many stripes it rewrote. If older_than is given, only stripes
+ * committed at least that long ago are rewritten. Stripes that already use
+ * the given compression are left alone.
+ */
+Datum
+columnar_recompress(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+	{
+		ereport(ERROR, (errmsg("table_name and compression can't be NULL")));
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+
+	Name compressionName = PG_GETARG_NAME(1);
+	CompressionType compressionType = ParseCompressionType(NameStr(*compressionName));
+	if (compressionType == COMPRESSION_TYPE_INVALID)
+	{
+		ereport(ERROR, (errmsg("unknown compression type for columnar table: %s",
+							   quote_identifier(NameStr(*compressionName)))));
+	}
+
+	int compressionLevel = columnar_compression_level;
+	if (!PG_ARGISNULL(2))
+	{
+		compressionLevel = PG_GETARG_INT32(2);
+		if (compressionLevel < COMPRESSION_LEVEL_MIN ||
+			compressionLevel > COMPRESSION_LEVEL_MAX ||
+			compressionLevel == 0)
+		{
+			ereport(ERROR, (errmsg("compression level out of range"),
+							errhint("compression level must be between %d and %d, "
+									"except 0",
+									COMPRESSION_LEVEL_MIN,
+									COMPRESSION_LEVEL_MAX)));
+		}
+	}
+
+	bool hasCutoff = !PG_ARGISNULL(3);
+	TimestampTz cutoff = 0;
+	if (hasCutoff)
+	{
+		if (!track_commit_timestamp)
+		{
+			ereport(ERROR, (errmsg("older_than requires track_commit_timestamp"),
+							errhint("Set track_commit_timestamp to on, stripes "
+									"written after that can be recompressed by "
+									"age.")));
+		}
+
+		cutoff = DatumGetTimestampTz(DirectFunctionCall2(timestamptz_mi_interval,
+														 TimestampTzGetDatum(
+															 GetCurrentTimestamp()),
+														 PG_GETARG_DATUM(3)));
+	}
+
+	/* blocks writers, but not readers, of the table while stripes are rewritten */
+	Relation rel = table_open(relationId, ExclusiveLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
+	}
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Recompress Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+	int32 recompressedCount = 0;
+	uint64 oldDataLength = 0;
+	uint64 newDataLength = 0;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 || stripeMetadata->insertedByCurrentXact ||
+			(hasCutoff && !StripeWrittenBefore(stripeMetadata, cutoff)))
+		{
+			continue;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+
+		uint64 dataLength = 0;
+		if (RewriteStripe(rel, stripeMetadata, compressionType, compressionLevel,
+						  &dataLength))
+		{
+			oldDataLength += stripeMetadata->dataLength;
+			newDataLength += dataLength;
+			recompressedCount++;
+		}
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	MemoryContextDelete(stripeContext);
+
+	ereport(DEBUG1, (errmsg("\"%s\": recompressed %d stripes from " UINT64_FORMAT
+							" to " UINT64_FORMAT " bytes",
+							RelationGetRelationName(rel), recompressedCount,
+							oldDataLength, newDataLength)));
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT32(recompressedCount);
+}
+
+
+/*
+ * columnar_reclaim_dropped_columns rewrites the stripes of a columnar table
+ * that still have chunks of dropped columns without them, and returns how
+ * many stripes it rewrote. The streams of the other columns are copied
+ * without decompressing them.
+ */
+Datum
+columnar_reclaim_dropped_columns(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		ereport(ERROR, (errmsg("table_name can't be NULL")));
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+
+	/* blocks writers, but not readers, of the table while stripes are rewritten */
+	Relation rel = table_open(relationId, ExclusiveLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
+	}
+
+	if (!ColumnarChunkNullStateSupported())
+	{
+		ereport(ERROR, (errmsg("reclaiming dropped columns requires the latest "
+							   "version of columnar"),
+						errhint("Run ALTER EXTENSION columnar UPDATE.")));
+	}
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Reclaim Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+	int32 rewrittenCount = 0;
+	uint64 oldDataLength = 0;
+	uint64 newDataLength = 0;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 || stripeMetadata->insertedByCurrentXact)
+		{
+			continue;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+
+		uint64 dataLength = 0;
+		if (RewriteStripe(rel, stripeMetadata, COMPRESSION_TYPE_INVALID, 0,
+						  &dataLength))
+		{
+			oldDataLength += stripeMetadata->dataLength;
+			newDataLength += dataLength;
+			rewrittenCount++;
+		}
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	MemoryContextDelete(stripeContext);
+
+	ereport(DEBUG1, (errmsg("\"%s\": reclaimed dropped columns of %d stripes, from "
+							UINT64_FORMAT " to " UINT64_FORMAT " bytes",
+							RelationGetRelationName(rel), rewrittenCount,
+							oldDataLength, newDataLength)));
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT32(rewrittenCount);
+}
+
+
+/*
+ * StripeWrittenBefore returns whether the transaction that wrote the given
+ * stripe committed before cutoff, or too long ago for its commit time to be
+ * known.
+ */
+bool
+StripeWrittenBefore(StripeMetadata *stripeMetadata, TimestampTz cutoff)
+{
+	TimestampTz commitTime = 0;
+	if (!TransactionIdIsNormal(stripeMetadata->insertXid) ||
+		!TransactionIdGetCommitTsData(stripeMetadata->insertXid, &commitTime, NULL))
+	{
+		return true;
+	}
+
+	return commitTime <= cutoff;
+}
+
+
+/*
+ * StripeNeedsRecompression returns whether any value stream of the given skip
+ * list is compressed otherwise than with the given compression type and level.
+ * The auto compression type stores a different type per chunk, so for it only
+ * the level is compared.
+ */
+static bool
+StripeNeedsRecompression(StripeSkipList *skipList, uint32 columnCount,
+						 CompressionType compressionType, int compressionLevel)
+{
+	/* lz4hc output is stored like any other lz4 output */
+	CompressionType storedType = compressionType == COMPRESSION_LZ4HC ?
+								 COMPRESSION_LZ4 : compressionType;
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			if (chunkSkipNode->valueLength == 0)
+			{
+				continue;
+			}
+
+			if (chunkSkipNode->compressionDictionaryId != 0 ||
+				chunkSkipNode->valueCompressionLevel != compressionLevel ||
+				(compressionType != COMPRESSION_AUTO &&
+				 chunkSkipNode->valueCompressionType != storedType))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * StripeHasDroppedColumnData returns whether any chunk of a dropped column in
+ * the given skip list has data.
+ */
+static bool
+StripeHasDroppedColumnData(StripeSkipList *skipList, uint32 columnCount,
+						   TupleDesc tupleDescriptor)
+{
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (!TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			continue;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			if (chunkSkipNode->existsLength > 0 || chunkSkipNode->valueLength > 0 ||
+				chunkSkipNode->nullState != CHUNK_NULLS_ALL)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RewriteStripe writes a copy of the given stripe whose value streams are
+ * compressed with the given compression type and level, and replaces the
+ * stripe with it. With COMPRESSION_TYPE_INVALID the value streams are copied
+ * as they are. Chunks of dropped columns become chunks whose values are all
+ * NULL, which take no space, once columnar.chunk can record that.
+ *
+ * It returns false if there was nothing to change, and otherwise sets
+ * newDataLength to the data length of the copy. The layout of the copy is the
+ * same as FlushStripe writes.
+ */
+static bool
+RewriteStripe(Relation rel, StripeMetadata *stripeMetadata,
+			  CompressionType compressionType, int compressionLevel,
+			  uint64 *newDataLength)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+												  tupleDescriptor,
+												  stripeMetadata->chunkCount,
+												  GetTransactionSnapshot());
+
+	/* columns added after the stripe was written have no chunks in it */
+	uint32 columnCount = Min(stripeMetadata->columnCount, skipList->columnCount);
+	skipList->columnCount = columnCount;
+
+	bool recompress = compressionType != COMPRESSION_TYPE_INVALID &&
+					  StripeNeedsRecompression(skipList, columnCount, compressionType,
+											   compressionLevel);
+	bool reclaimDroppedColumns = ColumnarChunkNullStateSupported() &&
+								 StripeHasDroppedColumnData(skipList, columnCount,
+															tupleDescriptor);
+	if (!recompress && !reclaimDroppedColumns)
+	{
+		return false;
+	}
+
+	uint32 chunkCount = skipList->chunkCount;
+	StringInfo *existsStreams = palloc0(columnCount * chunkCount * sizeof(StringInfo));
+	StringInfo *valueStreams = palloc0(columnCount * chunkCount * sizeof(StringInfo));
+
+	/* large values are referenced by their offset, so their area is kept as is */
+	uint64 largeValueAreaLength = StripeLargeValueAreaLength(skipList, columnCount);
+	StringInfo largeValueArea = ReadStripeStream(rel, stripeMetadata->fileOffset,
+												 largeValueAreaLength);
+	uint64 dataLength = largeValueAreaLength;
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNodes = skipList->chunkSkipNodeArray[columnIndex];
+		bool columnDropped = reclaimDroppedColumns &&
+							 TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped;
+
+		if (columnDropped)
+		{
+			for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+			{
+				ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodes[chunkIndex];
+				ClearChunkSkipNode(chunkSkipNode);
+
+				existsStreams[columnIndex * chunkCount + chunkIndex] = makeStringInfo();
+				valueStreams[columnIndex * chunkCount + chunkIndex] = makeStringInfo();
+
+				chunkSkipNode->existsChunkOffset = dataLength;
+				chunkSkipNode->valueChunkOffset = dataLength;
+			}
+
+			continue;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodes[chunkIndex];
+
+			existsStreams[columnIndex * chunkCount + chunkIndex] =
+				ReadStripeStream(rel, stripeMetadata->fileOffset +
+								 chunkSkipNode->existsChunkOffset,
+								 chunkSkipNode->existsLength);
+
+			chunkSkipNode->existsChunkOffset = dataLength;
+			dataLength += chunkSkipNode->existsLength;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodes[chunkIndex];
+			StringInfo valueStream =
+				ReadStripeStream(rel, stripeMetadata->fileOffset +
+								 chunkSkipNode->valueChunkOffset,
+								 chunkSkipNode->valueLength);
+
+			if (recompress && valueStream->len > 0)
+			{
+				StringInfo decompressionBuffer = makeStringInfo();
+				DecompressBufferInto(valueStream, chunkSkipNode->valueCompressionType,
+									 chunkSkipNode->decompressedValueSize,
+									 chunkSkipNode->compressionDictionaryId,
+									 decompressionBuffer);
+
+				StringInfo compressionBuffer = makeStringInfo();
+				CompressionType actualCompressionType = COMPRESSION_NONE;
+				if (compressionType == COMPRESSION_AUTO)
+				{
+					actualCompressionType =
+						CompressBufferAuto(decompressionBuffer, compressionBuffer,
+										   compressionLevel,
+										   columnar_auto_compression_min_gain);
+				}
+				else if (CompressBuffer(decompressionBuffer, compressionBuffer,
+										compressionType, compressionLevel))
+				{
+					actualCompressionType = compressionType == COMPRESSION_LZ4HC ?
+											COMPRESSION_LZ4 : compressionType;
+				}
+
+				valueStream = actualCompressionType == COMPRESSION_NONE ?
+							  decompressionBuffer : compressionBuffer;
+
+				chunkSkipNode->valueCompressionType = actualCompressionType;
+				chunkSkipNode->valueCompressionLevel = compressionLevel;
+				chunkSkipNode->compressionDictionaryId = 0;
+				chunkSkipNode->decompressedValueSize = decompressionBuffer->len;
+			}
+
+			valueStreams[columnIndex * chunkCount + chunkIndex] = valueStream;
+
+			chunkSkipNode->valueChunkOffset = dataLength;
+			chunkSkipNode->valueLength = valueStream->len;
+			dataLength += valueStream->len;
+		}
+	}
+
+	/* a stripe must keep some data, see StripeWriteState */
+	if (dataLength == 0)
+	{
+		return false;
+	}
+
+	uint64 newStripeId = ColumnarStorageReserveStripeId(rel);
+	uint64 fileOffset = ColumnarStorageReserveData(rel, dataLength);
+
+	ColumnarStorageWrite(rel, fileOffset, largeValueArea->data, largeValueArea->len);
+
+	uint64 currentFileOffset = fileOffset + largeValueArea->len;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			StringInfo existsStream = existsStreams[columnIndex * chunkCount + chunkIndex];
+			ColumnarStorageWrite(rel, currentFileOffset, existsStream->data,
+								 existsStream->len);
+			currentFileOffset += existsStream->len;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			StringInfo valueStream = valueStreams[columnIndex * chunkCount + chunkIndex];
+			ColumnarStorageWrite(rel, currentFileOffset, valueStream->data,
+								 valueStream->len);
+			currentFileOffset += valueStream->len;
+		}
+	}
+
+	ColumnarVisibilityMapClearStripe(rel, stripeMetadata);
+	ReplaceStripeMetadata(rel, stripeMetadata, newStripeId, fileOffset, dataLength,
+						  skipList, tupleDescriptor);
+
+	*newDataLength = dataLength;
+	return true;
+}
+
+
+/*
+ * StripeLargeValueAreaLength returns the length of the large value area at the
+ * start of the stripe of the given skip list, which ends where the first
+ * chunk stream begins, or 0 if no chunk has large values.
+ */
+static uint64
+StripeLargeValueAreaLength(StripeSkipList *skipList, uint32 columnCount)
+{
+	bool hasLargeValues = false;
+	uint64 firstStreamOffset = PG_UINT64_MAX;
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			hasLargeValues |= chunkSkipNode->largeValueCount > 0;
+			firstStreamOffset = Min(firstStreamOffset, chunkSkipNode->existsChunkOffset);
+			firstStreamOffset = Min(firstStreamOffset, chunkSkipNode->valueChunkOffset);
+		}
+	}
+
+	return hasLargeValues ? firstStreamOffset : 0;
+}
+
+
+/*
+ * ClearChunkSkipNode turns the given skip node into the one of a chunk whose
+ * values are all NULL and that has no streams.
+ */
+static void
+ClearChunkSkipNode(ColumnChunkSkipNode *chunkSkipNode)
+{
+	uint64 rowCount = chunkSkipNode->rowCount;
+
+	memset(chunkSkipNode, 0, sizeof(ColumnChunkSkipNode));
+	chunkSkipNode->rowCount = rowCount;
+	chunkSkipNode->valueCompressionType = COMPRESSION_NONE;
+	chunkSkipNode->valueEncodingType = VALUE_ENCODING_NONE;
+	chunkSkipNode->nullState = CHUNK_NULLS_ALL;
+}
+
+
+/*
+ * ReadStripeStream reads length bytes of stripe data at the given logical
+ * offset into a new buffer.
+ */
+static StringInfo
+ReadStripeStream(Relation rel, uint64 logicalOffset, uint64 length)
+{
+	StringInfo stream = makeStringInfo();
+	enlargeStringInfo(stream, length);
+	stream->len = length;
+
+	if (length > 0)
+	{
+		ColumnarStorageRead(rel, logicalOffset, stream->data, length);
+	}
+
+	return stream;
+}
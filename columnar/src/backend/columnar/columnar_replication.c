@@ -0,0 +1,480 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_replication.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Logical decoding of changes to columnar tables.
+ *
+ * Logical decoding only understands the WAL records of heap tables, and the
+ * WAL columnar writes for its stripes and metadata can't be turned back into
+ * rows. So while a columnar table is published, every insert, update and
+ * delete of its rows is logged a second time, as the heap record heap_insert,
+ * heap_multi_insert, heap_update or heap_delete would log for it with
+ * wal_level=logical. Decoding turns these records into changes of the table
+ * like it does for heap tables.
+ *
+ * Heap redo must not apply these records to the columnar storage, so each of
+ * them registers the columnar metapage with a full page image instead of a
+ * heap page. Redo restores the image, which holds the metapage as it already
+ * is, and skips the rest of the record like it does for any block restored
+ * from an image.
+ *
+ * Rows are logged when they are written rather than when their stripe is
+ * flushed, so that the changes of a transaction are decoded in the order it
+ * made them, whichever of its subtransactions made them. Batches of rows,
+ * from COPY or from columnar.import_arrow, are logged in multi insert
+ * records of up to COLUMNAR_LOGICAL_BATCH_ROWS rows each.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/heapam_xlog.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "access/xloginsert.h"
+#include "catalog/pg_publication.h"
+#include "nodes/nodes.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/columnar_version_compat.h"
+
+/*
+ * Rows and bytes of row data a multi insert record holds at most. The number
+ * of rows of a record is stored in 16 bits, and heap_multi_insert writes
+ * records of about this size too.
+ */
+#define COLUMNAR_LOGICAL_BATCH_ROWS 1000
+#define COLUMNAR_LOGICAL_BATCH_BYTES (1024 * 1024)
+
+static bool ColumnarPublishesAction(Relation rel, CmdType operation);
+static HeapTuple FormLogicalTuple(Relation rel, Datum *values, bool *nulls);
+static HeapTuple FormReplicaIdentityTuple(Relation rel, Datum *values, bool *nulls,
+										  bool *fullTuple);
+static void AppendLogicalTuple(StringInfo buffer, HeapTuple tuple);
+static void AppendMultiInsertTuple(StringInfo buffer, HeapTuple tuple);
+static void LogLogicalMultiInsertBatch(Relation rel, StringInfo tupleData,
+									   OffsetNumber *offsets, int rowCount);
+
+
+/*
+ * ColumnarLogicalChangesLogged returns whether changes of the given kind,
+ * CMD_INSERT, CMD_UPDATE or CMD_DELETE, to the relation need to be logged
+ * for logical decoding. That is the case when wal_level is logical and a
+ * publication publishes them.
+ */
+bool
+ColumnarLogicalChangesLogged(Relation rel, CmdType operation)
+{
+	if (!RelationIsLogicallyLogged(rel))
+	{
+		return false;
+	}
+
+	return ColumnarPublishesAction(rel, operation);
+}
+
+
+/*
+ * ColumnarCheckLogicalReplication throws an error if inserts into the
+ * relation are published. This should be called before writing rows into a
+ * columnar table in a way that can't log them for logical decoding, such as
+ * importing a stripe as it is.
+ */
+void
+ColumnarCheckLogicalReplication(Relation rel)
+{
+	if (ColumnarPublishesAction(rel, CMD_INSERT))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg(
+							"cannot insert into columnar table that is a part of a publication")));
+	}
+}
+
+
+/*
+ * ColumnarLogLogicalInsert logs the insert of a row, written with the given
+ * tid, for logical decoding.
+ */
+void
+ColumnarLogLogicalInsert(Relation rel, ItemPointer tid, Datum *values, bool *nulls)
+{
+	HeapTuple tuple = FormLogicalTuple(rel, values, nulls);
+
+	xl_heap_insert xlrec = { 0 };
+	xlrec.offnum = ItemPointerGetOffsetNumber(tid);
+	xlrec.flags = XLH_INSERT_CONTAINS_NEW_TUPLE;
+
+	StringInfoData tupleData;
+	initStringInfo(&tupleData);
+	AppendLogicalTuple(&tupleData, tuple);
+
+	(void) GetCurrentTransactionId();
+
+	ColumnarStorageLogChange(rel, RM_HEAP_ID, XLOG_HEAP_INSERT,
+							 (char *) &xlrec, SizeOfHeapInsert,
+							 tupleData.data, tupleData.len);
+
+	pfree(tupleData.data);
+	heap_freetuple(tuple);
+}
+
+
+/*
+ * ColumnarLogLogicalMultiInsert logs the insert of a batch of rows, given as
+ * arrays of values and nulls per column like ColumnarWriteBatch takes them
+ * and written with the given row numbers, for logical decoding.
+ */
+void
+ColumnarLogLogicalMultiInsert(Relation rel, Datum **columnValues, bool **columnNulls,
+							  uint64 *rowNumbers, int rowCount)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	int natts = tupleDescriptor->natts;
+
+	Datum *values = palloc(natts * sizeof(Datum));
+	bool *nulls = palloc(natts * sizeof(bool));
+	OffsetNumber *offsets = palloc(COLUMNAR_LOGICAL_BATCH_ROWS * sizeof(OffsetNumber));
+
+	StringInfoData tupleData;
+	initStringInfo(&tupleData);
+
+	(void) GetCurrentTransactionId();
+
+	int batchRowCount = 0;
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		for (int columnIndex = 0; columnIndex < natts; columnIndex++)
+		{
+			values[columnIndex] = columnValues[columnIndex][rowIndex];
+			nulls[columnIndex] = columnNulls[columnIndex][rowIndex];
+		}
+
+		HeapTuple tuple = FormLogicalTuple(rel, values, nulls);
+		AppendMultiInsertTuple(&tupleData, tuple);
+		heap_freetuple(tuple);
+
+		ItemPointerData tid = row_number_to_tid(rowNumbers[rowIndex]);
+		offsets[batchRowCount++] = ItemPointerGetOffsetNumber(&tid);
+
+		if (batchRowCount == COLUMNAR_LOGICAL_BATCH_ROWS ||
+			tupleData.len >= COLUMNAR_LOGICAL_BATCH_BYTES)
+		{
+			LogLogicalMultiInsertBatch(rel, &tupleData, offsets, batchRowCount);
+
+			resetStringInfo(&tupleData);
+			batchRowCount = 0;
+		}
+	}
+
+	if (batchRowCount > 0)
+	{
+		LogLogicalMultiInsertBatch(rel, &tupleData, offsets, batchRowCount);
+	}
+
+	pfree(tupleData.data);
+	pfree(offsets);
+	pfree(nulls);
+	pfree(values);
+}
+
+
+/*
+ * ColumnarLogLogicalDelete logs the delete of the row with the given tid and
+ * values for logical decoding. Like heap_delete, only the replica identity
+ * of the row is logged.
+ */
+void
+ColumnarLogLogicalDelete(Relation rel, ItemPointer tid, Datum *oldValues,
+						 bool *oldNulls)
+{
+	bool fullTuple = false;
+	HeapTuple oldKey = FormReplicaIdentityTuple(rel, oldValues, oldNulls, &fullTuple);
+
+	xl_heap_delete xlrec = { 0 };
+	xlrec.xmax = GetCurrentTransactionId();
+	xlrec.offnum = ItemPointerGetOffsetNumber(tid);
+
+	if (oldKey != NULL)
+	{
+		xlrec.flags = fullTuple ? XLH_DELETE_CONTAINS_OLD_TUPLE :
+					  XLH_DELETE_CONTAINS_OLD_KEY;
+	}
+
+	StringInfoData mainData;
+	initStringInfo(&mainData);
+	appendBinaryStringInfo(&mainData, (char *) &xlrec, SizeOfHeapDelete);
+
+	if (oldKey != NULL)
+	{
+		AppendLogicalTuple(&mainData, oldKey);
+		heap_freetuple(oldKey);
+	}
+
+	ColumnarStorageLogChange(rel, RM_HEAP_ID, XLOG_HEAP_DELETE,
+							 mainData.data, mainData.len, NULL, 0);
+
+	pfree(mainData.data);
+}
+
+
+/*
+ * ColumnarLogLogicalUpdate logs the update of the row with oldTid and the
+ * given old values into the row with newTid and the given new values, for
+ * logical decoding. Like heap_update, the replica identity of the old row
+ * and all of the new row are logged.
+ */
+void
+ColumnarLogLogicalUpdate(Relation rel, ItemPointer oldTid, Datum *oldValues,
+						 bool *oldNulls, ItemPointer newTid, Datum *newValues,
+						 bool *newNulls)
+{
+	bool fullTuple = false;
+	HeapTuple oldKey = FormReplicaIdentityTuple(rel, oldValues, oldNulls, &fullTuple);
+	HeapTuple newTuple = FormLogicalTuple(rel, newValues, newNulls);
+
+	xl_heap_update xlrec = { 0 };
+	xlrec.old_xmax = GetCurrentTransactionId();
+	xlrec.old_offnum = ItemPointerGetOffsetNumber(oldTid);
+	xlrec.new_xmax = InvalidTransactionId;
+	xlrec.new_offnum = ItemPointerGetOffsetNumber(newTid);
+	xlrec.flags = XLH_UPDATE_CONTAINS_NEW_TUPLE;
+
+	if (oldKey != NULL)
+	{
+		xlrec.flags |= fullTuple ? XLH_UPDATE_CONTAINS_OLD_TUPLE :
+					   XLH_UPDATE_CONTAINS_OLD_KEY;
+	}
+
+	StringInfoData mainData;
+	initStringInfo(&mainData);
+	appendBinaryStringInfo(&mainData, (char *) &xlrec, SizeOfHeapUpdate);
+
+	if (oldKey != NULL)
+	{
+		AppendLogicalTuple(&mainData, oldKey);
+		heap_freetuple(oldKey);
+	}
+
+	StringInfoData tupleData;
+	initStringInfo(&tupleData);
+	AppendLogicalTuple(&tupleData, newTuple);
+
+	ColumnarStorageLogChange(rel, RM_HEAP_ID, XLOG_HEAP_UPDATE,
+							 mainData.data, mainData.len,
+							 tupleData.data, tupleData.len);
+
+	pfree(tupleData.data);
+	pfree(mainData.data);
+	heap_freetuple(newTuple);
+}
+
+
+/*
+ * ColumnarPublishesAction returns whether a publication publishes changes
+ * of the given kind to the relation.
+ */
+static bool
+ColumnarPublishesAction(Relation rel, CmdType operation)
+{
+	if (!is_publishable_relation(rel))
+	{
+		return false;
+	}
+
+	PublicationActions *pubactions = NULL;
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+	PublicationDesc pubdesc;
+
+	RelationBuildPublicationDesc(rel, &pubdesc);
+	pubactions = &pubdesc.pubactions;
+#else
+	if (rel->rd_pubactions == NULL)
+	{
+		GetRelationPublicationActions(rel);
+		Assert(rel->rd_pubactions != NULL);
+	}
+
+	pubactions = rel->rd_pubactions;
+#endif
+
+	switch (operation)
+	{
+		case CMD_INSERT:
+		{
+			return pubactions->pubinsert;
+		}
+
+		case CMD_UPDATE:
+		{
+			return pubactions->pubupdate;
+		}
+
+		case CMD_DELETE:
+		{
+			return pubactions->pubdelete;
+		}
+
+		default:
+		{
+			elog(ERROR, "unexpected operation %d for logical decoding", (int) operation);
+		}
+	}
+}
+
+
+/*
+ * FormLogicalTuple forms the heap tuple logical decoding receives for a row
+ * of the relation. Dropped columns are logged as nulls, like heap tuples
+ * have them.
+ */
+static HeapTuple
+FormLogicalTuple(Relation rel, Datum *values, bool *nulls)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	bool *tupleNulls = palloc(tupleDescriptor->natts * sizeof(bool));
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		tupleNulls[columnIndex] = nulls[columnIndex] ||
+								  TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped;
+	}
+
+	HeapTuple tuple = heap_form_tuple(tupleDescriptor, values, tupleNulls);
+
+	pfree(tupleNulls);
+
+	return tuple;
+}
+
+
+/*
+ * FormReplicaIdentityTuple forms the tuple with the replica identity of a
+ * row, the way ExtractReplicaIdentity does for heap tables. That is all of
+ * the row for REPLICA IDENTITY FULL, in which case fullTuple is set, and the
+ * columns of the identity index with all others null otherwise. Returns
+ * NULL if the relation has no replica identity.
+ */
+static HeapTuple
+FormReplicaIdentityTuple(Relation rel, Datum *values, bool *nulls, bool *fullTuple)
+{
+	char replident = rel->rd_rel->relreplident;
+
+	*fullTuple = false;
+
+	if (replident == REPLICA_IDENTITY_NOTHING)
+	{
+		return NULL;
+	}
+
+	if (replident == REPLICA_IDENTITY_FULL)
+	{
+		*fullTuple = true;
+		return FormLogicalTuple(rel, values, nulls);
+	}
+
+	Bitmapset *identityColumns =
+		RelationGetIndexAttrBitmap(rel, INDEX_ATTR_BITMAP_IDENTITY_KEY);
+	if (bms_is_empty(identityColumns))
+	{
+		return NULL;
+	}
+
+	int natts = RelationGetDescr(rel)->natts;
+	bool *keyNulls = palloc(natts * sizeof(bool));
+
+	for (int columnIndex = 0; columnIndex < natts; columnIndex++)
+	{
+		AttrNumber attnum = AttrOffsetGetAttrNumber(columnIndex);
+
+		keyNulls[columnIndex] =
+			nulls[columnIndex] ||
+			!bms_is_member(attnum - FirstLowInvalidHeapAttributeNumber,
+						   identityColumns);
+	}
+
+	HeapTuple keyTuple = FormLogicalTuple(rel, values, keyNulls);
+
+	pfree(keyNulls);
+	bms_free(identityColumns);
+
+	return keyTuple;
+}
+
+
+/*
+ * AppendLogicalTuple appends a tuple to the buffer in the form heap records
+ * carry tuples in, the header fields of xl_heap_header followed by the data
+ * of the tuple after its header.
+ */
+static void
+AppendLogicalTuple(StringInfo buffer, HeapTuple tuple)
+{
+	xl_heap_header xlhdr;
+	xlhdr.t_infomask2 = tuple->t_data->t_infomask2;
+	xlhdr.t_infomask = tuple->t_data->t_infomask;
+	xlhdr.t_hoff = tuple->t_data->t_hoff;
+
+	appendBinaryStringInfo(buffer, (char *) &xlhdr, SizeOfHeapHeader);
+	appendBinaryStringInfo(buffer, (char *) tuple->t_data + SizeofHeapTupleHeader,
+						   tuple->t_len - SizeofHeapTupleHeader);
+}
+
+
+/*
+ * AppendMultiInsertTuple appends a tuple to the buffer in the form multi
+ * insert records carry tuples in, aligned and preceded by the length of its
+ * data in an xl_multi_insert_tuple.
+ */
+static void
+AppendMultiInsertTuple(StringInfo buffer, HeapTuple tuple)
+{
+	while (buffer->len != SHORTALIGN(buffer->len))
+	{
+		appendStringInfoCharMacro(buffer, '\0');
+	}
+
+	xl_multi_insert_tuple tuphdr;
+	tuphdr.datalen = tuple->t_len - SizeofHeapTupleHeader;
+	tuphdr.t_infomask2 = tuple->t_data->t_infomask2;
+	tuphdr.t_infomask = tuple->t_data->t_infomask;
+	tuphdr.t_hoff = tuple->t_data->t_hoff;
+
+	appendBinaryStringInfo(buffer, (char *) &tuphdr, SizeOfMultiInsertTuple);
+	appendBinaryStringInfo(buffer, (char *) tuple->t_data + SizeofHeapTupleHeader,
+						   tuphdr.datalen);
+}
+
+
+/*
+ * LogLogicalMultiInsertBatch logs a multi insert record for rows whose
+ * tuples AppendMultiInsertTuple appended to tupleData.
+ */
+static void
+LogLogicalMultiInsertBatch(Relation rel, StringInfo tupleData, OffsetNumber *offsets,
+						   int rowCount)
+{
+	StringInfoData mainData;
+	initStringInfo(&mainData);
+
+	xl_heap_multi_insert xlrec = { 0 };
+	xlrec.flags = XLH_INSERT_CONTAINS_NEW_TUPLE | XLH_INSERT_LAST_IN_MULTI;
+	xlrec.ntuples = rowCount;
+
+	appendBinaryStringInfo(&mainData, (char *) &xlrec, SizeOfHeapMultiInsert);
+	appendBinaryStringInfo(&mainData, (char *) offsets, rowCount * sizeof(OffsetNumber));
+
+	ColumnarStorageLogChange(rel, RM_HEAP2_ID, XLOG_HEAP2_MULTI_INSERT,
+							 mainData.data, mainData.len,
+							 tupleData->data, tupleData->len);
+
+	pfree(mainData.data);
+}
@@ -0,0 +1,267 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_retention.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Dropping the rows of a columnar table that match a predicate a stripe at
+ * a time, for retention jobs that delete the oldest rows of a table.
+ *
+ * columnar.drop_stripes looks at the chunk minimums and maximums of each
+ * stripe, and detaches the stripes whose rows all match the predicate by
+ * deleting their metadata rows, without writing a row mask bit for each of
+ * their rows. The rows of the other stripes that match are deleted with
+ * DELETE. The storage of a detached stripe is kept for the snapshots that
+ * still see its metadata, and is recorded as free by the next vacuum once
+ * those are pruned, see RecordFreeRanges.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "access/xact.h"
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "nodes/pathnodes.h"
+#include "optimizer/optimizer.h"
+#include "parser/analyze.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+static List * DropStripesClauses(Relation rel, const char *predicate);
+static bool StripesCanBeDetached(Relation rel, List *clauseList);
+static uint64 DetachMatchingStripes(Relation rel, List *clauseList,
+									uint32 *detachedStripeCount);
+
+PG_FUNCTION_INFO_V1(columnar_drop_stripes);
+
+
+/*
+ * columnar_drop_stripes removes the rows of a columnar table that match the
+ * given predicate, and returns their number. Stripes whose rows all match
+ * are detached, and the rest of the matching rows are deleted.
+ */
+Datum
+columnar_drop_stripes(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	char *predicate = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	/* blocks writers, but not readers, of the table while stripes are detached */
+	Relation rel = table_open(relationId, ExclusiveLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
+	}
+
+	List *clauseList = DropStripesClauses(rel, predicate);
+
+	/* the stripe metadata has to show the rows this transaction wrote */
+	FlushWriteStateForRelfilenode(rel->rd_node.relNode, GetCurrentSubTransactionId());
+	RowMaskFlushWriteStateForRelfilenode(rel->rd_node.relNode,
+										 GetCurrentSubTransactionId());
+	CommandCounterIncrement();
+
+	uint64 droppedRowCount = 0;
+	uint32 detachedStripeCount = 0;
+
+	if (StripesCanBeDetached(rel, clauseList))
+	{
+		droppedRowCount = DetachMatchingStripes(rel, clauseList, &detachedStripeCount);
+	}
+
+	/* the stripes that only partly match, and the delta store */
+	char *tableName =
+		quote_qualified_identifier(get_namespace_name(RelationGetNamespace(rel)),
+								   RelationGetRelationName(rel));
+	StringInfo deleteCommand = makeStringInfo();
+	appendStringInfo(deleteCommand, "DELETE FROM ONLY %s WHERE %s", tableName, predicate);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		elog(ERROR, "SPI_connect failed");
+	}
+
+	if (SPI_execute(deleteCommand->data, false, 0) != SPI_OK_DELETE)
+	{
+		elog(ERROR, "could not delete rows of table \"%s\"",
+			 RelationGetRelationName(rel));
+	}
+
+	uint64 deletedRowCount = SPI_processed;
+
+	SPI_finish();
+
+	ereport(DEBUG1, (errmsg("\"%s\": detached %u stripes of " UINT64_FORMAT
+							" rows, deleted " UINT64_FORMAT " rows",
+							RelationGetRelationName(rel), detachedStripeCount,
+							droppedRowCount, deletedRowCount)));
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT64(droppedRowCount + deletedRowCount);
+}
+
+
+/*
+ * DropStripesClauses returns the given predicate over the columns of rel as
+ * an implicitly ANDed list of clauses, with stable functions such as now()
+ * evaluated once, the way a DELETE with the predicate sees them.
+ */
+static List *
+DropStripesClauses(Relation rel, const char *predicate)
+{
+	char *tableName =
+		quote_qualified_identifier(get_namespace_name(RelationGetNamespace(rel)),
+								   RelationGetRelationName(rel));
+	StringInfo queryString = makeStringInfo();
+	appendStringInfo(queryString, "SELECT FROM ONLY %s WHERE %s", tableName, predicate);
+
+	List *parseTreeList = pg_parse_query(queryString->data);
+	if (list_length(parseTreeList) != 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+						errmsg("predicate must be a single boolean expression")));
+	}
+
+	Query *query = parse_analyze_fixedparams_compat(linitial_node(RawStmt, parseTreeList),
+													queryString->data, NULL, 0, NULL);
+
+	if (query->commandType != CMD_SELECT || list_length(query->rtable) != 1 ||
+		query->setOperations != NULL || query->cteList != NIL ||
+		query->hasAggs || query->hasWindowFuncs || query->hasTargetSRFs ||
+		query->hasSubLinks || query->groupClause != NIL ||
+		query->havingQual != NULL || query->sortClause != NIL ||
+		query->distinctClause != NIL || query->limitCount != NULL ||
+		query->limitOffset != NULL || query->rowMarks != NIL ||
+		query->jointree->quals == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+						errmsg("predicate must be a single boolean expression")));
+	}
+
+	Node *quals = query->jointree->quals;
+	if (contain_volatile_functions(quals))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("predicate can't call volatile functions")));
+	}
+
+	/* like the planner does when it estimates selectivities */
+	PlannerInfo *root = makeNode(PlannerInfo);
+	root->glob = makeNode(PlannerGlobal);
+	quals = estimate_expression_value(root, quals);
+
+	Expr *qualExpr = canonicalize_qual((Expr *) quals, false);
+
+	return make_ands_implicit(qualExpr);
+}
+
+
+/*
+ * StripesCanBeDetached returns whether rows of rel matching the given
+ * clauses can be dropped with their stripes, without DELETE. That can't be
+ * done if something other than the rows of the table has to see each
+ * deleted row, like triggers, foreign keys, row-level security or logical
+ * decoding, or if the clauses refer to system columns.
+ */
+static bool
+StripesCanBeDetached(Relation rel, List *clauseList)
+{
+	if (rel->trigdesc != NULL ||
+		check_enable_rls(RelationGetRelid(rel), InvalidOid, true) == RLS_ENABLED ||
+		ColumnarLogicalChangesLogged(rel, CMD_DELETE))
+	{
+		return false;
+	}
+
+	Var *column = NULL;
+	foreach_ptr(column, pull_var_clause((Node *) clauseList, 0))
+	{
+		if (column->varattno <= 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * DetachMatchingStripes deletes the metadata of the flushed stripes of rel
+ * whose rows all match the given clauses, sets detachedStripeCount to their
+ * number and returns the number of their rows that weren't deleted.
+ */
+static uint64
+DetachMatchingStripes(Relation rel, List *clauseList, uint32 *detachedStripeCount)
+{
+	Snapshot snapshot = GetTransactionSnapshot();
+	uint64 detachedRowCount = 0;
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Drop Stripes Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, StripesForSnapshot(rel, snapshot))
+	{
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED ||
+			stripeMetadata->rowCount == 0)
+		{
+			continue;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContext oldContext = MemoryContextSwitchTo(stripeContext);
+
+		bool stripeMatches = StripeChunksImplyClauses(rel, stripeMetadata, clauseList,
+													  snapshot);
+		if (stripeMatches)
+		{
+			detachedRowCount += stripeMetadata->rowCount -
+								StripeDeletedRowCount(rel->rd_node, stripeMetadata,
+													  snapshot);
+
+			ColumnarVisibilityMapClearStripe(rel, stripeMetadata);
+			DeleteMetadataRowsForStripeId(rel->rd_node, stripeMetadata->id);
+			(*detachedStripeCount)++;
+		}
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	MemoryContextDelete(stripeContext);
+
+	if (*detachedStripeCount > 0)
+	{
+		ColumnarInvalidateStripeListSummary(rel);
+		CommandCounterIncrement();
+	}
+
+	return detachedRowCount;
+}
@@ -0,0 +1,871 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_shared_cache.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Shared memory cache of decompressed column chunks, used by all backends
+ * and parallel workers instead of the per backend cache in columnar_cache.c
+ * when columnar.shared_column_cache_size is set and columnar is loaded via
+ * shared_preload_libraries.
+ *
+ * Cached data lives in a DSA area created in place in the main shared memory
+ * segment, so its size is fixed at server start. Entries are found through a
+ * hash table of slots in shared memory and evicted with the CLOCK algorithm.
+ * Readers copy the cached data out while holding a reference on the slot,
+ * which keeps the slot from being evicted without having to hold the lock
+ * during the copy.
+ *
+ * Since neither storage ids nor stripe ids are ever reused, cached chunks
+ * never go stale and are never explicitly invalidated.
+ *
+ * A backend that misses a chunk claims it while it decompresses the chunk.
+ * Backends, including parallel workers, that miss a claimed chunk wait for
+ * it to be published instead of decompressing a popular chunk many times
+ * over. Backends only wait while they don't hold a claim themselves, and
+ * claims are released when the chunk is inserted or the transaction aborts.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "safe_lib.h"
+
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#endif
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "storage/condition_variable.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_version_compat.h"
+
+/* assume decompressed chunks of at least this size when sizing the slots */
+#define SHARED_CACHE_BYTES_PER_SLOT (16 * 1024)
+
+/* CLOCK usage count is capped at this value */
+#define SHARED_CACHE_MAX_USAGE_COUNT 5
+
+#define INVALID_SLOT_INDEX (-1)
+
+/* number of chunks that can be claimed for decompression at the same time */
+#define SHARED_CACHE_CLAIM_COUNT 128
+
+typedef struct SharedCacheKey
+{
+	Oid databaseId;
+	uint32 columnId;
+	uint64 storageId;
+	uint64 stripeId;
+	uint64 chunkId;
+} SharedCacheKey;
+
+typedef struct SharedCacheSlot
+{
+	SharedCacheKey key;
+	dsa_pointer data;
+	uint64 length;
+	bool used;
+
+	/* next slot in the bucket chain, or in the free list if not used */
+	int32 next;
+
+	/* number of backends copying data out of this slot */
+	pg_atomic_uint32 refCount;
+	pg_atomic_uint32 usageCount;
+} SharedCacheSlot;
+
+/* a chunk that a backend is decompressing to insert into the cache */
+typedef struct SharedCacheClaim
+{
+	SharedCacheKey key;
+	bool used;
+
+	/* broadcast when the claim is released */
+	ConditionVariable released;
+} SharedCacheClaim;
+
+typedef struct SharedCacheControl
+{
+	/* protects everything below except atomics */
+	LWLock *lock;
+	int dsaTrancheId;
+
+	uint64 maximumSize;
+	uint64 totalSize;
+
+	int32 slotCount;
+	int32 bucketCount;
+	int32 freeList;
+	int32 clockHand;
+
+	pg_atomic_uint64 hits;
+	pg_atomic_uint64 misses;
+	pg_atomic_uint64 evictions;
+	pg_atomic_uint64 writes;
+
+	/* offsets from the start of this struct */
+	Size bucketsOffset;
+	Size slotsOffset;
+	Size areaOffset;
+
+	SharedCacheClaim claims[SHARED_CACHE_CLAIM_COUNT];
+} SharedCacheControl;
+
+static SharedCacheControl *SharedCache = NULL;
+static dsa_area *SharedCacheArea = NULL;
+
+/* claim held by this backend, at most one at a time */
+static int32 OwnedClaimIndex = INVALID_SLOT_INDEX;
+static bool ClaimCallbacksRegistered = false;
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+static shmem_request_hook_type PreviousShmemRequestHook = NULL;
+#endif
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
+static void ColumnarSharedCacheShmemRequest(void);
+static void ColumnarSharedCacheShmemStartup(void);
+static Size SharedCacheAreaSize(void);
+static int32 SharedCacheSlotCount(void);
+static Size SharedCacheShmemSize(void);
+static int32 * SharedCacheBuckets(void);
+static SharedCacheSlot * SharedCacheSlots(void);
+static dsa_area * GetSharedCacheArea(void);
+static void InitSharedCacheKey(SharedCacheKey *key, uint64 storageId, uint64 stripeId,
+							   uint64 chunkId, uint32 columnId);
+static int32 SharedCacheBucket(SharedCacheKey *key);
+static SharedCacheSlot * FindSharedCacheSlot(SharedCacheKey *key);
+static StringInfo CopySharedCacheSlot(dsa_area *area, SharedCacheSlot *slot);
+static void InsertSharedCacheSlot(SharedCacheKey *key, StringInfo data);
+static bool EvictSharedCacheSlot(void);
+static SharedCacheClaim * FindSharedCacheClaim(SharedCacheKey *key);
+static void ClaimSharedCacheChunk(SharedCacheKey *key);
+static void RegisterClaimCallbacks(void);
+static void SharedCacheXactCallback(XactEvent event, void *arg);
+static void SharedCacheSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
+									   SubTransactionId parentSubid, void *arg);
+static void SharedCacheShmemExit(int code, Datum arg);
+
+
+/*
+ * ColumnarSharedCacheInit installs the hooks that set up the shared cache.
+ * Expected to be called from _PG_init.
+ */
+void
+ColumnarSharedCacheInit(void)
+{
+	if (!process_shared_preload_libraries_in_progress ||
+		columnar_shared_cache_size == 0)
+	{
+		return;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+	PreviousShmemRequestHook = shmem_request_hook;
+	shmem_request_hook = ColumnarSharedCacheShmemRequest;
+#else
+	ColumnarSharedCacheShmemRequest();
+#endif
+
+	PreviousShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = ColumnarSharedCacheShmemStartup;
+}
+
+
+/*
+ * ColumnarSharedCacheShmemRequest requests the shared memory and the lock
+ * used by the shared cache.
+ */
+static void
+ColumnarSharedCacheShmemRequest(void)
+{
+#if PG_VERSION_NUM >= PG_VERSION_15
+	if (PreviousShmemRequestHook)
+	{
+		PreviousShmemRequestHook();
+	}
+#endif
+
+	RequestAddinShmemSpace(SharedCacheShmemSize());
+	RequestNamedLWLockTranche("columnar_shared_cache", 1);
+}
+
+
+/*
+ * ColumnarSharedCacheShmemStartup initializes the shared cache in shared
+ * memory.
+ */
+static void
+ColumnarSharedCacheShmemStartup(void)
+{
+	if (PreviousShmemStartupHook)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	bool found = false;
+	SharedCache = ShmemInitStruct("columnar shared cache", SharedCacheShmemSize(),
+								  &found);
+
+	if (!found)
+	{
+		int32 slotCount = SharedCacheSlotCount();
+
+		SharedCache->lock = &(GetNamedLWLockTranche("columnar_shared_cache"))->lock;
+		SharedCache->dsaTrancheId = LWLockNewTrancheId();
+		SharedCache->maximumSize = SharedCacheAreaSize();
+		SharedCache->totalSize = 0;
+		SharedCache->slotCount = slotCount;
+		SharedCache->bucketCount = slotCount;
+		SharedCache->clockHand = 0;
+
+		pg_atomic_init_u64(&SharedCache->hits, 0);
+		pg_atomic_init_u64(&SharedCache->misses, 0);
+		pg_atomic_init_u64(&SharedCache->evictions, 0);
+		pg_atomic_init_u64(&SharedCache->writes, 0);
+
+		SharedCache->bucketsOffset = MAXALIGN(sizeof(SharedCacheControl));
+		SharedCache->slotsOffset = SharedCache->bucketsOffset +
+								   MAXALIGN(slotCount * sizeof(int32));
+		SharedCache->areaOffset = SharedCache->slotsOffset +
+								  MAXALIGN(slotCount * sizeof(SharedCacheSlot));
+
+		int32 *buckets = SharedCacheBuckets();
+		SharedCacheSlot *slots = SharedCacheSlots();
+
+		for (int32 slotIndex = 0; slotIndex < slotCount; slotIndex++)
+		{
+			buckets[slotIndex] = INVALID_SLOT_INDEX;
+
+			slots[slotIndex].used = false;
+			slots[slotIndex].data = InvalidDsaPointer;
+			slots[slotIndex].next = slotIndex + 1 < slotCount ? slotIndex + 1 :
+									INVALID_SLOT_INDEX;
+			pg_atomic_init_u32(&slots[slotIndex].refCount, 0);
+			pg_atomic_init_u32(&slots[slotIndex].usageCount, 0);
+		}
+
+		SharedCache->freeList = 0;
+
+		for (int claimIndex = 0; claimIndex < SHARED_CACHE_CLAIM_COUNT; claimIndex++)
+		{
+			SharedCache->claims[claimIndex].used = false;
+			ConditionVariableInit(&SharedCache->claims[claimIndex].released);
+		}
+
+		/* similar to StatsShmemInit(), create the area and only keep it pinned */
+		char *areaPlace = (char *) SharedCache + SharedCache->areaOffset;
+		dsa_area *area = dsa_create_in_place(areaPlace, SharedCacheAreaSize(),
+											 SharedCache->dsaTrancheId, NULL);
+		dsa_pin(area);
+		dsa_set_size_limit(area, SharedCacheAreaSize());
+		dsa_detach(area);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * SharedCacheAreaSize returns the size of the DSA area holding cached data.
+ */
+static Size
+SharedCacheAreaSize(void)
+{
+	Size areaSize = (Size) columnar_shared_cache_size * 1024 * 1024;
+	return Max(areaSize, dsa_minimum_size());
+}
+
+
+/*
+ * SharedCacheSlotCount returns the number of cache slots.
+ */
+static int32
+SharedCacheSlotCount(void)
+{
+	return Max(SharedCacheAreaSize() / SHARED_CACHE_BYTES_PER_SLOT, 64);
+}
+
+
+/*
+ * SharedCacheShmemSize returns the size of the shared memory needed by the
+ * shared cache.
+ */
+static Size
+SharedCacheShmemSize(void)
+{
+	int32 slotCount = SharedCacheSlotCount();
+
+	Size size = MAXALIGN(sizeof(SharedCacheControl));
+	size = add_size(size, MAXALIGN(mul_size(slotCount, sizeof(int32))));
+	size = add_size(size, MAXALIGN(mul_size(slotCount, sizeof(SharedCacheSlot))));
+	size = add_size(size, SharedCacheAreaSize());
+
+	return size;
+}
+
+
+static int32 *
+SharedCacheBuckets(void)
+{
+	return (int32 *) ((char *) SharedCache + SharedCache->bucketsOffset);
+}
+
+
+static SharedCacheSlot *
+SharedCacheSlots(void)
+{
+	return (SharedCacheSlot *) ((char *) SharedCache + SharedCache->slotsOffset);
+}
+
+
+/*
+ * ColumnarSharedCacheEnabled returns true if the shared cache was set up at
+ * server start.
+ */
+bool
+ColumnarSharedCacheEnabled(void)
+{
+	return SharedCache != NULL;
+}
+
+
+/*
+ * GetSharedCacheArea attaches to the DSA area of the shared cache if this
+ * backend didn't do so yet.
+ */
+static dsa_area *
+GetSharedCacheArea(void)
+{
+	if (SharedCacheArea == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+		LWLockRegisterTranche(SharedCache->dsaTrancheId, "columnar_shared_cache_dsa");
+
+		char *areaPlace = (char *) SharedCache + SharedCache->areaOffset;
+		SharedCacheArea = dsa_attach_in_place(areaPlace, NULL);
+		dsa_pin_mapping(SharedCacheArea);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return SharedCacheArea;
+}
+
+
+static void
+InitSharedCacheKey(SharedCacheKey *key, uint64 storageId, uint64 stripeId,
+				   uint64 chunkId, uint32 columnId)
+{
+	memset(key, 0, sizeof(SharedCacheKey));
+	key->databaseId = MyDatabaseId;
+	key->columnId = columnId;
+	key->storageId = storageId;
+	key->stripeId = stripeId;
+	key->chunkId = chunkId;
+}
+
+
+static int32
+SharedCacheBucket(SharedCacheKey *key)
+{
+	return tag_hash(key, sizeof(SharedCacheKey)) % SharedCache->bucketCount;
+}
+
+
+/*
+ * FindSharedCacheSlot returns the slot caching given key, or NULL if the key
+ * isn't cached. Caller should hold the lock.
+ */
+static SharedCacheSlot *
+FindSharedCacheSlot(SharedCacheKey *key)
+{
+	SharedCacheSlot *slots = SharedCacheSlots();
+
+	int32 slotIndex = SharedCacheBuckets()[SharedCacheBucket(key)];
+	while (slotIndex != INVALID_SLOT_INDEX)
+	{
+		SharedCacheSlot *slot = &slots[slotIndex];
+		if (memcmp(&slot->key, key, sizeof(SharedCacheKey)) == 0)
+		{
+			return slot;
+		}
+
+		slotIndex = slot->next;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ColumnarSharedCacheLookup returns a copy of the cached decompressed chunk
+ * allocated in CurrentMemoryContext, or NULL if the chunk is not cached. If
+ * another backend is decompressing the chunk, it waits for that backend to
+ * insert it. On a miss, the chunk is claimed by this backend until it calls
+ * ColumnarSharedCacheInsert or ColumnarSharedCacheReleaseClaim.
+ */
+StringInfo
+ColumnarSharedCacheLookup(uint64 storageId, uint64 stripeId, uint64 chunkId,
+						  uint32 columnId)
+{
+	SharedCacheKey key;
+	InitSharedCacheKey(&key, storageId, stripeId, chunkId, columnId);
+
+	dsa_area *area = GetSharedCacheArea();
+
+	/* never wait while holding a claim, others might be waiting for it */
+	ColumnarSharedCacheReleaseClaim();
+
+	while (true)
+	{
+		LWLockAcquire(SharedCache->lock, LW_SHARED);
+
+		SharedCacheSlot *slot = FindSharedCacheSlot(&key);
+		if (slot != NULL)
+		{
+			return CopySharedCacheSlot(area, slot);
+		}
+
+		SharedCacheClaim *claim = FindSharedCacheClaim(&key);
+		if (claim == NULL)
+		{
+			LWLockRelease(SharedCache->lock);
+			break;
+		}
+
+		/* prepared while the claim can't be released, so no wakeup is lost */
+		ConditionVariablePrepareToSleep(&claim->released);
+		LWLockRelease(SharedCache->lock);
+
+		ConditionVariableSleep(&claim->released, PG_WAIT_EXTENSION);
+		ConditionVariableCancelSleep();
+	}
+
+	LWLockAcquire(SharedCache->lock, LW_EXCLUSIVE);
+
+	/* leave chunks that got cached or claimed meanwhile to the other backend */
+	if (FindSharedCacheSlot(&key) == NULL && FindSharedCacheClaim(&key) == NULL)
+	{
+		ClaimSharedCacheChunk(&key);
+	}
+
+	LWLockRelease(SharedCache->lock);
+
+	pg_atomic_fetch_add_u64(&SharedCache->misses, 1);
+
+	return NULL;
+}
+
+
+/*
+ * ColumnarSharedCacheClaimMissing returns true if the given chunk is neither
+ * cached nor being decompressed by another backend, claiming it for this
+ * backend like a miss of ColumnarSharedCacheLookup does. Unlike a lookup it
+ * never waits, copies or counts a hit or a miss, so prewarming a chunk that
+ * is cached already is cheap.
+ */
+bool
+ColumnarSharedCacheClaimMissing(uint64 storageId, uint64 stripeId, uint64 chunkId,
+								uint32 columnId)
+{
+	SharedCacheKey key;
+	InitSharedCacheKey(&key, storageId, stripeId, chunkId, columnId);
+
+	ColumnarSharedCacheReleaseClaim();
+
+	LWLockAcquire(SharedCache->lock, LW_EXCLUSIVE);
+
+	bool missing = FindSharedCacheSlot(&key) == NULL &&
+				   FindSharedCacheClaim(&key) == NULL;
+	if (missing)
+	{
+		ClaimSharedCacheChunk(&key);
+	}
+
+	LWLockRelease(SharedCache->lock);
+
+	return missing;
+}
+
+
+/*
+ * ColumnarSharedCacheChunks returns the keys of the chunks in the cache, of
+ * all databases, allocated in CurrentMemoryContext, and sets chunkCount to
+ * their number.
+ */
+ColumnarCachedChunk *
+ColumnarSharedCacheChunks(int32 *chunkCount)
+{
+	ColumnarCachedChunk *chunks = palloc(SharedCache->slotCount *
+										 sizeof(ColumnarCachedChunk));
+	int32 count = 0;
+
+	LWLockAcquire(SharedCache->lock, LW_SHARED);
+
+	SharedCacheSlot *slots = SharedCacheSlots();
+	for (int32 slotIndex = 0; slotIndex < SharedCache->slotCount; slotIndex++)
+	{
+		SharedCacheSlot *slot = &slots[slotIndex];
+		if (!slot->used)
+		{
+			continue;
+		}
+
+		ColumnarCachedChunk *chunk = &chunks[count++];
+		chunk->databaseId = slot->key.databaseId;
+		chunk->storageId = slot->key.storageId;
+		chunk->stripeId = slot->key.stripeId;
+		chunk->chunkId = slot->key.chunkId;
+		chunk->columnId = slot->key.columnId;
+	}
+
+	LWLockRelease(SharedCache->lock);
+
+	*chunkCount = count;
+	return chunks;
+}
+
+
+/*
+ * CopySharedCacheSlot returns a copy of the data of the given slot allocated
+ * in CurrentMemoryContext. Caller should hold the lock, which is released.
+ */
+static StringInfo
+CopySharedCacheSlot(dsa_area *area, SharedCacheSlot *slot)
+{
+	/* allocate before taking a reference, so an error can't leak it */
+	StringInfo copy = makeStringInfo();
+	enlargeStringInfo(copy, slot->length);
+
+	pg_atomic_fetch_add_u32(&slot->refCount, 1);
+	if (pg_atomic_read_u32(&slot->usageCount) < SHARED_CACHE_MAX_USAGE_COUNT)
+	{
+		pg_atomic_fetch_add_u32(&slot->usageCount, 1);
+	}
+
+	dsa_pointer data = slot->data;
+	uint64 length = slot->length;
+
+	LWLockRelease(SharedCache->lock);
+
+	memcpy_s(copy->data, copy->maxlen, dsa_get_address(area, data), length);
+	copy->len = length;
+	copy->data[length] = '\0';
+
+	pg_atomic_fetch_sub_u32(&slot->refCount, 1);
+	pg_atomic_fetch_add_u64(&SharedCache->hits, 1);
+
+	return copy;
+}
+
+
+/*
+ * ColumnarSharedCacheInsert adds a copy of given decompressed chunk to the
+ * cache unless it is already cached, evicting other chunks if needed. If no
+ * space can be made, the chunk is not cached. Either way, the claim of this
+ * backend is released, waking up the backends waiting for the chunk.
+ */
+void
+ColumnarSharedCacheInsert(uint64 storageId, uint64 stripeId, uint64 chunkId,
+						  uint32 columnId, StringInfo data)
+{
+	SharedCacheKey key;
+	InitSharedCacheKey(&key, storageId, stripeId, chunkId, columnId);
+
+	InsertSharedCacheSlot(&key, data);
+
+	ColumnarSharedCacheReleaseClaim();
+}
+
+
+/*
+ * InsertSharedCacheSlot does the work of ColumnarSharedCacheInsert.
+ */
+static void
+InsertSharedCacheSlot(SharedCacheKey *keyPointer, StringInfo data)
+{
+	SharedCacheKey key = *keyPointer;
+	dsa_area *area = GetSharedCacheArea();
+	uint64 length = data->len;
+
+	/* don't let a single chunk take over the cache */
+	if (length > SharedCache->maximumSize / 4)
+	{
+		return;
+	}
+
+	LWLockAcquire(SharedCache->lock, LW_EXCLUSIVE);
+
+	/* another backend might have cached it while we were decompressing */
+	if (FindSharedCacheSlot(&key) != NULL)
+	{
+		LWLockRelease(SharedCache->lock);
+		return;
+	}
+
+	while (SharedCache->freeList == INVALID_SLOT_INDEX ||
+		   SharedCache->totalSize + length > SharedCache->maximumSize)
+	{
+		if (!EvictSharedCacheSlot())
+		{
+			LWLockRelease(SharedCache->lock);
+			return;
+		}
+	}
+
+	dsa_pointer dataPointer = dsa_allocate_extended(area, length, DSA_ALLOC_NO_OOM);
+	while (!DsaPointerIsValid(dataPointer))
+	{
+		/* the area might be fragmented, make space until the allocation fits */
+		if (!EvictSharedCacheSlot())
+		{
+			LWLockRelease(SharedCache->lock);
+			return;
+		}
+
+		dataPointer = dsa_allocate_extended(area, length, DSA_ALLOC_NO_OOM);
+	}
+
+	memcpy_s(dsa_get_address(area, dataPointer), length, data->data, length);
+
+	int32 slotIndex = SharedCache->freeList;
+	SharedCacheSlot *slot = &SharedCacheSlots()[slotIndex];
+	SharedCache->freeList = slot->next;
+
+	int32 bucket = SharedCacheBucket(&key);
+	int32 *buckets = SharedCacheBuckets();
+
+	slot->key = key;
+	slot->data = dataPointer;
+	slot->length = length;
+	slot->used = true;
+	slot->next = buckets[bucket];
+	pg_atomic_write_u32(&slot->refCount, 0);
+	pg_atomic_write_u32(&slot->usageCount, 1);
+	buckets[bucket] = slotIndex;
+
+	SharedCache->totalSize += length;
+
+	LWLockRelease(SharedCache->lock);
+
+	pg_atomic_fetch_add_u64(&SharedCache->writes, 1);
+}
+
+
+/*
+ * EvictSharedCacheSlot evicts one slot using the CLOCK algorithm, skipping
+ * the slots that backends are copying from. Returns false if nothing could
+ * be evicted. Caller should hold the lock in exclusive mode.
+ */
+static bool
+EvictSharedCacheSlot(void)
+{
+	SharedCacheSlot *slots = SharedCacheSlots();
+	int32 *buckets = SharedCacheBuckets();
+	int64 maxSteps = (int64) SharedCache->slotCount * (SHARED_CACHE_MAX_USAGE_COUNT + 1);
+
+	for (int64 step = 0; step < maxSteps; step++)
+	{
+		int32 slotIndex = SharedCache->clockHand;
+		SharedCache->clockHand = (SharedCache->clockHand + 1) % SharedCache->slotCount;
+
+		SharedCacheSlot *slot = &slots[slotIndex];
+		if (!slot->used || pg_atomic_read_u32(&slot->refCount) > 0)
+		{
+			continue;
+		}
+
+		if (pg_atomic_read_u32(&slot->usageCount) > 0)
+		{
+			pg_atomic_fetch_sub_u32(&slot->usageCount, 1);
+			continue;
+		}
+
+		/* unlink the slot from its bucket chain */
+		int32 *link = &buckets[SharedCacheBucket(&slot->key)];
+		while (*link != slotIndex)
+		{
+			Assert(*link != INVALID_SLOT_INDEX);
+			link = &slots[*link].next;
+		}
+		*link = slot->next;
+
+		dsa_free(GetSharedCacheArea(), slot->data);
+		SharedCache->totalSize -= slot->length;
+
+		slot->used = false;
+		slot->data = InvalidDsaPointer;
+		slot->length = 0;
+		slot->next = SharedCache->freeList;
+		SharedCache->freeList = slotIndex;
+
+		pg_atomic_fetch_add_u64(&SharedCache->evictions, 1);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * FindSharedCacheClaim returns the claim of the given key, or NULL if the key
+ * isn't claimed. Caller should hold the lock.
+ */
+static SharedCacheClaim *
+FindSharedCacheClaim(SharedCacheKey *key)
+{
+	for (int claimIndex = 0; claimIndex < SHARED_CACHE_CLAIM_COUNT; claimIndex++)
+	{
+		SharedCacheClaim *claim = &SharedCache->claims[claimIndex];
+		if (claim->used && memcmp(&claim->key, key, sizeof(SharedCacheKey)) == 0)
+		{
+			return claim;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ClaimSharedCacheChunk claims the given key for this backend. If all claims
+ * are in use, the chunk is left unclaimed and others decompress it as well.
+ * Caller should hold the lock in exclusive mode.
+ */
+static void
+ClaimSharedCacheChunk(SharedCacheKey *key)
+{
+	Assert(OwnedClaimIndex == INVALID_SLOT_INDEX);
+
+	if (!ClaimCallbacksRegistered)
+	{
+		RegisterClaimCallbacks();
+	}
+
+	for (int claimIndex = 0; claimIndex < SHARED_CACHE_CLAIM_COUNT; claimIndex++)
+	{
+		SharedCacheClaim *claim = &SharedCache->claims[claimIndex];
+		if (!claim->used)
+		{
+			claim->key = *key;
+			claim->used = true;
+			OwnedClaimIndex = claimIndex;
+			return;
+		}
+	}
+}
+
+
+/*
+ * ColumnarSharedCacheReleaseClaim releases the claim this backend holds, if
+ * any, and wakes up the backends waiting for the claimed chunk. Readers call
+ * it if they decide not to insert a chunk they missed.
+ */
+void
+ColumnarSharedCacheReleaseClaim(void)
+{
+	if (OwnedClaimIndex == INVALID_SLOT_INDEX)
+	{
+		return;
+	}
+
+	SharedCacheClaim *claim = &SharedCache->claims[OwnedClaimIndex];
+
+	LWLockAcquire(SharedCache->lock, LW_EXCLUSIVE);
+	claim->used = false;
+	LWLockRelease(SharedCache->lock);
+
+	OwnedClaimIndex = INVALID_SLOT_INDEX;
+
+	ConditionVariableBroadcast(&claim->released);
+}
+
+
+/*
+ * RegisterClaimCallbacks makes sure the claim of this backend is released if
+ * an error or exit interrupts the decompression of the claimed chunk. Called
+ * in backends, since the postmaster doesn't pass exit callbacks on.
+ */
+static void
+RegisterClaimCallbacks(void)
+{
+	RegisterXactCallback(SharedCacheXactCallback, NULL);
+	RegisterSubXactCallback(SharedCacheSubXactCallback, NULL);
+	before_shmem_exit(SharedCacheShmemExit, 0);
+
+	ClaimCallbacksRegistered = true;
+}
+
+
+static void
+SharedCacheXactCallback(XactEvent event, void *arg)
+{
+	if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT)
+	{
+		ColumnarSharedCacheReleaseClaim();
+	}
+}
+
+
+static void
+SharedCacheSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
+						   SubTransactionId parentSubid, void *arg)
+{
+	if (event == SUBXACT_EVENT_ABORT_SUB)
+	{
+		ColumnarSharedCacheReleaseClaim();
+	}
+}
+
+
+static void
+SharedCacheShmemExit(int code, Datum arg)
+{
+	ColumnarSharedCacheReleaseClaim();
+}
+
+
+/*
+ * ColumnarSharedCacheStatistics fills in the server wide statistics of the
+ * shared cache.
+ */
+void
+ColumnarSharedCacheStatistics(ColumnarCacheStatistics *statistics)
+{
+	statistics->hits = pg_atomic_read_u64(&SharedCache->hits);
+	statistics->misses = pg_atomic_read_u64(&SharedCache->misses);
+	statistics->evictions = pg_atomic_read_u64(&SharedCache->evictions);
+	statistics->writes = pg_atomic_read_u64(&SharedCache->writes);
+
+	LWLockAcquire(SharedCache->lock, LW_SHARED);
+	statistics->endingCacheSize = SharedCache->totalSize;
+	statistics->maximumCacheSize = SharedCache->maximumSize;
+
+	uint64 entries = 0;
+	SharedCacheSlot *slots = SharedCacheSlots();
+	for (int32 slotIndex = 0; slotIndex < SharedCache->slotCount; slotIndex++)
+	{
+		if (slots[slotIndex].used)
+		{
+			entries++;
+		}
+	}
+	statistics->entries = entries;
+	LWLockRelease(SharedCache->lock);
+}
@@ -0,0 +1,397 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_shredded_keys.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Per chunk statistics of the top level keys of jsonb columns listed in the
+ * shredded_keys option. For each key, a chunk keeps the number of rows whose
+ * ->> value for the key isn't NULL, and the smallest and largest of those
+ * values in byte order, which is the order of the "C" collation. Scans use
+ * them to skip chunk groups for quals like payload->>'country' = 'US'
+ * without decompressing and parsing the documents.
+ *
+ * Equality under a deterministic collation is byte equality, so byte order
+ * bounds refute equality under any of them, but ranges only under "C".
+ * Values longer than SHREDDED_KEY_VALUE_LIMIT drop the bounds of their key
+ * for the chunk, so that a chunk never keeps large copies of values.
+ *
+ * Statistics are serialized as, for each key, its length and bytes, the
+ * present count and, if the bounds are known, the lengths and bytes of the
+ * minimum and the maximum.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "libpq/pqformat.h"
+#include "nodes/primnodes.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/fmgroids.h"
+#include "utils/jsonb.h"
+#include "utils/memutils.h"
+#include "utils/numeric.h"
+
+#include "columnar/columnar.h"
+#include "columnar/utils/listutils.h"
+
+/* values longer than this many bytes aren't kept as bounds */
+#define SHREDDED_KEY_VALUE_LIMIT 256
+
+static text * ShreddedKeyValue(Jsonb *jsonb, const char *key);
+static void SendShreddedKeyValue(StringInfo buffer, text *value);
+static text * ReceiveShreddedKeyValue(StringInfo buffer);
+
+
+/*
+ * ColumnarShreddedKeyStatisticsList returns new statistics for each of the
+ * given shredded keys of the column with the given attribute number, or NIL
+ * if the column has none.
+ */
+List *
+ColumnarShreddedKeyStatisticsList(List *shreddedKeys, AttrNumber attnum)
+{
+	List *keyStatisticsList = NIL;
+
+	ColumnarShreddedKey *shreddedKey = NULL;
+	foreach_ptr(shreddedKey, shreddedKeys)
+	{
+		if (shreddedKey->attnum != attnum)
+		{
+			continue;
+		}
+
+		ShreddedKeyStatistics *keyStatistics = palloc0(sizeof(ShreddedKeyStatistics));
+		keyStatistics->key = pstrdup(shreddedKey->key);
+		keyStatistics->boundsKnown = true;
+
+		keyStatisticsList = lappend(keyStatisticsList, keyStatistics);
+	}
+
+	return keyStatisticsList;
+}
+
+
+/*
+ * ColumnarShreddedKeysAdd adds the values of the shredded keys in the given
+ * jsonb value to their statistics. Copies of new bounds are allocated in
+ * statisticsContext.
+ */
+void
+ColumnarShreddedKeysAdd(List *keyStatisticsList, Datum jsonbValue,
+						MemoryContext statisticsContext)
+{
+	Jsonb *jsonb = DatumGetJsonbP(jsonbValue);
+
+	/* ->> of a key is NULL for arrays and scalars */
+	if (!JB_ROOT_IS_OBJECT(jsonb))
+	{
+		return;
+	}
+
+	ShreddedKeyStatistics *keyStatistics = NULL;
+	foreach_ptr(keyStatistics, keyStatisticsList)
+	{
+		text *value = ShreddedKeyValue(jsonb, keyStatistics->key);
+		if (value == NULL)
+		{
+			continue;
+		}
+
+		keyStatistics->presentCount++;
+
+		if (!keyStatistics->boundsKnown)
+		{
+			pfree(value);
+			continue;
+		}
+
+		if (VARSIZE_ANY_EXHDR(value) > SHREDDED_KEY_VALUE_LIMIT)
+		{
+			keyStatistics->boundsKnown = false;
+			pfree(value);
+			continue;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(statisticsContext);
+
+		if (keyStatistics->minimumValue == NULL ||
+			ColumnarShreddedKeyValueCompare(value, keyStatistics->minimumValue) < 0)
+		{
+			if (keyStatistics->minimumValue != NULL)
+			{
+				pfree(keyStatistics->minimumValue);
+			}
+
+			keyStatistics->minimumValue = (text *) datumCopy(PointerGetDatum(value),
+															 false, -1);
+		}
+
+		if (keyStatistics->maximumValue == NULL ||
+			ColumnarShreddedKeyValueCompare(value, keyStatistics->maximumValue) > 0)
+		{
+			if (keyStatistics->maximumValue != NULL)
+			{
+				pfree(keyStatistics->maximumValue);
+			}
+
+			keyStatistics->maximumValue = (text *) datumCopy(PointerGetDatum(value),
+															 false, -1);
+		}
+
+		MemoryContextSwitchTo(oldContext);
+		pfree(value);
+	}
+
+	if ((Pointer) jsonb != DatumGetPointer(jsonbValue))
+	{
+		pfree(jsonb);
+	}
+}
+
+
+/*
+ * ColumnarShreddedKeysBuild serializes the given statistics of the chunk
+ * that was written and resets them for the next chunk.
+ */
+bytea *
+ColumnarShreddedKeysBuild(List *keyStatisticsList)
+{
+	StringInfoData buffer;
+	pq_begintypsend(&buffer);
+
+	ShreddedKeyStatistics *keyStatistics = NULL;
+	foreach_ptr(keyStatistics, keyStatisticsList)
+	{
+		bool boundsKnown = keyStatistics->boundsKnown && keyStatistics->presentCount > 0;
+
+		pq_sendint32(&buffer, strlen(keyStatistics->key));
+		pq_sendbytes(&buffer, keyStatistics->key, strlen(keyStatistics->key));
+		pq_sendint64(&buffer, keyStatistics->presentCount);
+		pq_sendbyte(&buffer, boundsKnown);
+
+		if (boundsKnown)
+		{
+			SendShreddedKeyValue(&buffer, keyStatistics->minimumValue);
+			SendShreddedKeyValue(&buffer, keyStatistics->maximumValue);
+		}
+
+		if (keyStatistics->minimumValue != NULL)
+		{
+			pfree(keyStatistics->minimumValue);
+			pfree(keyStatistics->maximumValue);
+		}
+
+		keyStatistics->presentCount = 0;
+		keyStatistics->boundsKnown = true;
+		keyStatistics->minimumValue = NULL;
+		keyStatistics->maximumValue = NULL;
+	}
+
+	return pq_endtypsend(&buffer);
+}
+
+
+/*
+ * ColumnarShreddedKeyLookup finds the statistics of the given key in the
+ * serialized statistics of a chunk. It sets the present count, and the
+ * bounds or NULL if they aren't known, and returns true, or returns false
+ * if the key wasn't shredded when the chunk was written.
+ */
+bool
+ColumnarShreddedKeyLookup(bytea *shreddedKeyStats, const char *key,
+						  uint64 *presentCount, text **minimumValue,
+						  text **maximumValue)
+{
+	StringInfoData buffer = {
+		.data = VARDATA_ANY(shreddedKeyStats),
+		.len = VARSIZE_ANY_EXHDR(shreddedKeyStats),
+		.maxlen = VARSIZE_ANY_EXHDR(shreddedKeyStats),
+		.cursor = 0
+	};
+	int keyLength = strlen(key);
+
+	while (buffer.cursor < buffer.len)
+	{
+		int statisticsKeyLength = pq_getmsgint(&buffer, 4);
+		const char *statisticsKey = pq_getmsgbytes(&buffer, statisticsKeyLength);
+		uint64 statisticsPresentCount = pq_getmsgint64(&buffer);
+		bool boundsKnown = pq_getmsgbyte(&buffer);
+
+		text *statisticsMinimum = NULL;
+		text *statisticsMaximum = NULL;
+		if (boundsKnown)
+		{
+			statisticsMinimum = ReceiveShreddedKeyValue(&buffer);
+			statisticsMaximum = ReceiveShreddedKeyValue(&buffer);
+		}
+
+		if (statisticsKeyLength == keyLength &&
+			memcmp(statisticsKey, key, keyLength) == 0)
+		{
+			*presentCount = statisticsPresentCount;
+			*minimumValue = statisticsMinimum;
+			*maximumValue = statisticsMaximum;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ColumnarShreddedKeyExpression checks if the given expression is
+ * column->>'key', or jsonb_object_field_text(column, 'key'), for a jsonb
+ * column and a constant key, possibly with another collation. If so, it sets
+ * the column and the key, and returns true.
+ */
+bool
+ColumnarShreddedKeyExpression(Node *node, Var **column, char **key)
+{
+	List *args = NIL;
+
+	/* COLLATE clauses become relabelings of the same type */
+	while (IsA(node, RelabelType))
+	{
+		node = (Node *) ((RelabelType *) node)->arg;
+	}
+
+	if (IsA(node, OpExpr) && ((OpExpr *) node)->opfuncid == F_JSONB_OBJECT_FIELD_TEXT)
+	{
+		args = ((OpExpr *) node)->args;
+	}
+	else if (IsA(node, FuncExpr) &&
+			 ((FuncExpr *) node)->funcid == F_JSONB_OBJECT_FIELD_TEXT)
+	{
+		args = ((FuncExpr *) node)->args;
+	}
+	else
+	{
+		return false;
+	}
+
+	if (list_length(args) != 2)
+	{
+		return false;
+	}
+
+	Node *columnArg = linitial(args);
+	Node *keyArg = lsecond(args);
+
+	if (!IsA(columnArg, Var) || ((Var *) columnArg)->varattno <= 0 ||
+		((Var *) columnArg)->vartype != JSONBOID ||
+		!IsA(keyArg, Const) || ((Const *) keyArg)->constisnull)
+	{
+		return false;
+	}
+
+	*column = (Var *) columnArg;
+	*key = TextDatumGetCString(((Const *) keyArg)->constvalue);
+	return true;
+}
+
+
+/*
+ * ColumnarShreddedKeyValueCompare compares two values of shredded keys in
+ * byte order, like texts under the "C" collation.
+ */
+int
+ColumnarShreddedKeyValueCompare(text *left, text *right)
+{
+	int leftLength = VARSIZE_ANY_EXHDR(left);
+	int rightLength = VARSIZE_ANY_EXHDR(right);
+
+	int result = memcmp(VARDATA_ANY(left), VARDATA_ANY(right),
+						Min(leftLength, rightLength));
+	if (result == 0)
+	{
+		result = (leftLength > rightLength) - (leftLength < rightLength);
+	}
+
+	return result;
+}
+
+
+/*
+ * ShreddedKeyValue returns the value of the given key in the given jsonb
+ * object as the ->> operator does, or NULL if the key is missing or null.
+ */
+static text *
+ShreddedKeyValue(Jsonb *jsonb, const char *key)
+{
+	JsonbValue valueBuffer;
+	JsonbValue *value = getKeyJsonValueFromContainer(&jsonb->root, key, strlen(key),
+													 &valueBuffer);
+	if (value == NULL)
+	{
+		return NULL;
+	}
+
+	switch (value->type)
+	{
+		case jbvNull:
+		{
+			return NULL;
+		}
+
+		case jbvString:
+		{
+			return cstring_to_text_with_len(value->val.string.val,
+											value->val.string.len);
+		}
+
+		case jbvBool:
+		{
+			return cstring_to_text(value->val.boolean ? "true" : "false");
+		}
+
+		case jbvNumeric:
+		{
+			Datum numericString = DirectFunctionCall1(numeric_out,
+													  NumericGetDatum(value->val.numeric));
+			return cstring_to_text(DatumGetCString(numericString));
+		}
+
+		case jbvBinary:
+		{
+			StringInfo jsonString = makeStringInfo();
+			JsonbToCString(jsonString, value->val.binary.data, value->val.binary.len);
+			return cstring_to_text_with_len(jsonString->data, jsonString->len);
+		}
+
+		default:
+		{
+			elog(ERROR, "unrecognized jsonb value type: %d", value->type);
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * SendShreddedKeyValue appends the length and bytes of a value to a buffer.
+ */
+static void
+SendShreddedKeyValue(StringInfo buffer, text *value)
+{
+	pq_sendint32(buffer, VARSIZE_ANY_EXHDR(value));
+	pq_sendbytes(buffer, VARDATA_ANY(value), VARSIZE_ANY_EXHDR(value));
+}
+
+
+/*
+ * ReceiveShreddedKeyValue reads a value appended by SendShreddedKeyValue.
+ */
+static text *
+ReceiveShreddedKeyValue(StringInfo buffer)
+{
+	int valueLength = pq_getmsgint(buffer, 4);
+	const char *valueData = pq_getmsgbytes(buffer, valueLength);
+
+	return cstring_to_text_with_len(valueData, valueLength);
+}
@@ -0,0 +1,427 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_skiplist_cache.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Backend local cache of decoded StripeSkipList metadata, so repeated scans
+ * of the same stripes don't rebuild the skip list from columnar.chunk every
+ * time.
+ *
+ * Entries are keyed by storage id and stripe id. Chunk metadata of a stripe
+ * never changes once the stripe is flushed, and neither storage ids nor
+ * stripe ids are ever reused, so entries can't go stale; invalidation only
+ * releases memory for stripes and relations that are removed. Deleted row
+ * counts of chunk groups do change, so they are not cached and are always
+ * read from columnar.chunk_group by the caller.
+ *
+ * Scans read the skip nodes of the columns they need only, so an entry can
+ * hold some of the columns of its stripe. Entries gain the columns of later
+ * reads of the stripe, and serve the reads whose columns they all hold.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "safe_lib.h"
+
+#include "lib/ilist.h"
+#include "utils/datum.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+
+typedef struct SkipListCacheKey
+{
+	uint64 storageId;
+	uint64 stripeId;
+} SkipListCacheKey;
+
+typedef struct SkipListCacheEntry
+{
+	SkipListCacheKey key;
+
+	/* position in SkipListCacheLru, most recently used entry is at the head */
+	dlist_node lruNode;
+
+	/* owns everything skipList points to */
+	MemoryContext entryContext;
+	StripeSkipList *skipList;
+	uint64 size;
+} SkipListCacheEntry;
+
+/* memory context for the hash table and all cache entries */
+static MemoryContext SkipListCacheContext = NULL;
+
+static HTAB *SkipListCacheMap = NULL;
+static dlist_head SkipListCacheLru = DLIST_STATIC_INIT(SkipListCacheLru);
+static uint64 SkipListCacheTotalSize = 0;
+
+static uint64 SkipListCacheHits = 0;
+static uint64 SkipListCacheMisses = 0;
+
+static void InitSkipListCache(void);
+static StripeSkipList * CopyStripeSkipList(StripeSkipList *skipList,
+										   TupleDesc tupleDescriptor,
+										   const bool *columnMask, uint64 *size);
+static void RemoveSkipListCacheEntry(SkipListCacheEntry *entry);
+static uint64 SkipListCacheMaxSize(void);
+
+
+/*
+ * InitSkipListCache creates the hash table of the cache if it doesn't exist.
+ */
+static void
+InitSkipListCache(void)
+{
+	if (SkipListCacheMap != NULL)
+	{
+		return;
+	}
+
+	SkipListCacheContext = AllocSetContextCreate(TopMemoryContext,
+												 "Columnar Skip List Cache",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SkipListCacheKey);
+	info.entrysize = sizeof(SkipListCacheEntry);
+	info.hcxt = SkipListCacheContext;
+
+	SkipListCacheMap = hash_create("columnar skip list cache", 256, &info,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	dlist_init(&SkipListCacheLru);
+	SkipListCacheTotalSize = 0;
+}
+
+
+/*
+ * SkipListCacheMaxSize returns the size limit of the cache in bytes.
+ */
+static uint64
+SkipListCacheMaxSize(void)
+{
+	return (uint64) columnar_skiplist_cache_size * 1024 * 1024;
+}
+
+
+/*
+ * ColumnarSkipListCacheLookup returns a copy of the cached skip list of given
+ * stripe allocated in CurrentMemoryContext, or NULL if the stripe is not
+ * cached. Only the columns set in columnMask are copied, and the entry must
+ * hold all of them; a NULL columnMask asks for all columns.
+ * chunkGroupDeletedRows of the returned skip list is not set.
+ */
+StripeSkipList *
+ColumnarSkipListCacheLookup(uint64 storageId, uint64 stripeId,
+							TupleDesc tupleDescriptor, uint32 chunkCount,
+							const bool *columnMask)
+{
+	if (columnar_skiplist_cache_size == 0 || SkipListCacheMap == NULL)
+	{
+		return NULL;
+	}
+
+	SkipListCacheKey key = { .storageId = storageId, .stripeId = stripeId };
+	SkipListCacheEntry *entry = hash_search(SkipListCacheMap, &key, HASH_FIND, NULL);
+
+	/*
+	 * We might have cached the skip list before a column was added to the
+	 * table, in that case just rebuild it.
+	 */
+	if (entry == NULL ||
+		entry->skipList->columnCount != tupleDescriptor->natts ||
+		entry->skipList->chunkCount != chunkCount)
+	{
+		SkipListCacheMisses++;
+		return NULL;
+	}
+
+	for (uint32 columnIndex = 0; columnIndex < entry->skipList->columnCount; columnIndex++)
+	{
+		if ((columnMask == NULL || columnMask[columnIndex]) &&
+			entry->skipList->chunkSkipNodeArray[columnIndex] == NULL)
+		{
+			SkipListCacheMisses++;
+			return NULL;
+		}
+	}
+
+	SkipListCacheHits++;
+
+	dlist_move_head(&SkipListCacheLru, &entry->lruNode);
+
+	uint64 size = 0;
+	return CopyStripeSkipList(entry->skipList, tupleDescriptor, columnMask, &size);
+}
+
+
+/*
+ * ColumnarSkipListCacheInsert adds a copy of given skip list to the cache,
+ * evicting least recently used entries if the cache gets too large. The
+ * columns of the cached skip list of the stripe that the given one doesn't
+ * have are kept.
+ */
+void
+ColumnarSkipListCacheInsert(uint64 storageId, uint64 stripeId,
+							StripeSkipList *skipList, TupleDesc tupleDescriptor)
+{
+	if (columnar_skiplist_cache_size == 0)
+	{
+		return;
+	}
+
+	InitSkipListCache();
+
+	SkipListCacheKey key = { .storageId = storageId, .stripeId = stripeId };
+
+	bool found = false;
+	SkipListCacheEntry *entry = hash_search(SkipListCacheMap, &key, HASH_FIND, &found);
+
+	/* the columns cached before, unless the tuple descriptor changed since */
+	ColumnChunkSkipNode **cachedNodeArray = NULL;
+	if (found && entry->skipList->columnCount == skipList->columnCount &&
+		entry->skipList->chunkCount == skipList->chunkCount)
+	{
+		cachedNodeArray = entry->skipList->chunkSkipNodeArray;
+	}
+
+	MemoryContext entryContext = AllocSetContextCreate(SkipListCacheContext,
+													   "Columnar Skip List Cache Entry",
+													   ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	/* copied from a skip list with the nodes of both, which owns none of them */
+	StripeSkipList mergedSkipList = *skipList;
+	mergedSkipList.chunkSkipNodeArray =
+		palloc(skipList->columnCount * sizeof(ColumnChunkSkipNode *));
+	for (uint32 columnIndex = 0; columnIndex < skipList->columnCount; columnIndex++)
+	{
+		ColumnChunkSkipNode *nodeArray = skipList->chunkSkipNodeArray[columnIndex];
+		if (nodeArray == NULL && cachedNodeArray != NULL)
+		{
+			nodeArray = cachedNodeArray[columnIndex];
+		}
+
+		mergedSkipList.chunkSkipNodeArray[columnIndex] = nodeArray;
+	}
+
+	uint64 size = 0;
+	StripeSkipList *skipListCopy = CopyStripeSkipList(&mergedSkipList, tupleDescriptor,
+													  NULL, &size);
+	pfree(mergedSkipList.chunkSkipNodeArray);
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* replaced, also if the tuple descriptor changed */
+	if (found)
+	{
+		RemoveSkipListCacheEntry(entry);
+	}
+
+	entry = hash_search(SkipListCacheMap, &key, HASH_ENTER, &found);
+	entry->entryContext = entryContext;
+	entry->skipList = skipListCopy;
+	entry->size = size + ALLOCSET_SMALL_INITSIZE;
+	dlist_push_head(&SkipListCacheLru, &entry->lruNode);
+
+	SkipListCacheTotalSize += entry->size;
+
+	/* never evict the entry we just added */
+	while (SkipListCacheTotalSize > SkipListCacheMaxSize() &&
+		   dlist_tail_node(&SkipListCacheLru) != &entry->lruNode)
+	{
+		SkipListCacheEntry *victim =
+			dlist_tail_element(SkipListCacheEntry, lruNode, &SkipListCacheLru);
+		RemoveSkipListCacheEntry(victim);
+	}
+}
+
+
+/*
+ * ColumnarSkipListCacheInvalidateStripe removes the cache entry of given
+ * stripe, if any.
+ */
+void
+ColumnarSkipListCacheInvalidateStripe(uint64 storageId, uint64 stripeId)
+{
+	if (SkipListCacheMap == NULL)
+	{
+		return;
+	}
+
+	SkipListCacheKey key = { .storageId = storageId, .stripeId = stripeId };
+	SkipListCacheEntry *entry = hash_search(SkipListCacheMap, &key, HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		RemoveSkipListCacheEntry(entry);
+	}
+}
+
+
+/*
+ * ColumnarSkipListCacheInvalidateStorage removes the cache entries of all
+ * stripes of given storage.
+ */
+void
+ColumnarSkipListCacheInvalidateStorage(uint64 storageId)
+{
+	if (SkipListCacheMap == NULL)
+	{
+		return;
+	}
+
+	dlist_mutable_iter iter;
+	dlist_foreach_modify(iter, &SkipListCacheLru)
+	{
+		SkipListCacheEntry *entry =
+			dlist_container(SkipListCacheEntry, lruNode, iter.cur);
+
+		if (entry->key.storageId == storageId)
+		{
+			RemoveSkipListCacheEntry(entry);
+		}
+	}
+}
+
+
+/*
+ * ColumnarSkipListCacheStatistics sets hit/miss counters and the current
+ * state of the cache.
+ */
+void
+ColumnarSkipListCacheStatistics(uint64 *hits, uint64 *misses, uint64 *entries,
+								uint64 *size)
+{
+	*hits = SkipListCacheHits;
+	*misses = SkipListCacheMisses;
+	*entries = SkipListCacheMap ? hash_get_num_entries(SkipListCacheMap) : 0;
+	*size = SkipListCacheTotalSize;
+}
+
+
+/*
+ * RemoveSkipListCacheEntry removes given entry from the cache and frees its
+ * memory.
+ */
+static void
+RemoveSkipListCacheEntry(SkipListCacheEntry *entry)
+{
+	dlist_delete(&entry->lruNode);
+	SkipListCacheTotalSize -= entry->size;
+	MemoryContextDelete(entry->entryContext);
+
+	hash_search(SkipListCacheMap, &entry->key, HASH_REMOVE, NULL);
+}
+
+
+/*
+ * CopyStripeSkipList returns a deep copy of given skip list, excluding
+ * chunkGroupDeletedRows, in CurrentMemoryContext and sets size to the
+ * approximate number of bytes allocated for it. With a column mask, the
+ * nodes of the other columns are left NULL in the copy.
+ */
+static StripeSkipList *
+CopyStripeSkipList(StripeSkipList *skipList, TupleDesc tupleDescriptor,
+				   const bool *columnMask, uint64 *size)
+{
+	uint32 columnCount = skipList->columnCount;
+	uint32 chunkCount = skipList->chunkCount;
+
+	StripeSkipList *copy = palloc0(sizeof(StripeSkipList));
+	copy->columnCount = columnCount;
+	copy->chunkCount = chunkCount;
+
+	copy->chunkGroupRowCounts = palloc(chunkCount * sizeof(uint32));
+	memcpy_s(copy->chunkGroupRowCounts, chunkCount * sizeof(uint32),
+			 skipList->chunkGroupRowCounts, chunkCount * sizeof(uint32));
+
+	copy->chunkGroupRowOffset = palloc(chunkCount * sizeof(uint32));
+	memcpy_s(copy->chunkGroupRowOffset, chunkCount * sizeof(uint32),
+			 skipList->chunkGroupRowOffset, chunkCount * sizeof(uint32));
+
+	*size = sizeof(StripeSkipList) + 2 * chunkCount * sizeof(uint32);
+
+	copy->chunkSkipNodeArray = palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+	*size += columnCount * sizeof(ColumnChunkSkipNode *);
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (skipList->chunkSkipNodeArray[columnIndex] == NULL ||
+			(columnMask != NULL && !columnMask[columnIndex]))
+		{
+			continue;
+		}
+
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		uint64 nodeArraySize = chunkCount * sizeof(ColumnChunkSkipNode);
+
+		ColumnChunkSkipNode *nodeArray = palloc(nodeArraySize);
+		memcpy_s(nodeArray, nodeArraySize,
+				 skipList->chunkSkipNodeArray[columnIndex], nodeArraySize);
+		*size += nodeArraySize;
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *node = &nodeArray[chunkIndex];
+			if (node->bloomFilter != NULL)
+			{
+				Size bloomFilterSize = VARSIZE(node->bloomFilter);
+				bytea *bloomFilter = palloc(bloomFilterSize);
+				memcpy_s(bloomFilter, bloomFilterSize, node->bloomFilter,
+						 bloomFilterSize);
+				node->bloomFilter = bloomFilter;
+
+				*size += bloomFilterSize;
+			}
+
+			if (node->hllSketch != NULL)
+			{
+				Size hllSketchSize = VARSIZE(node->hllSketch);
+				bytea *hllSketch = palloc(hllSketchSize);
+				memcpy_s(hllSketch, hllSketchSize, node->hllSketch, hllSketchSize);
+				node->hllSketch = hllSketch;
+
+				*size += hllSketchSize;
+			}
+
+			if (node->shreddedKeyStats != NULL)
+			{
+				Size shreddedKeyStatsSize = VARSIZE(node->shreddedKeyStats);
+				bytea *shreddedKeyStats = palloc(shreddedKeyStatsSize);
+				memcpy_s(shreddedKeyStats, shreddedKeyStatsSize, node->shreddedKeyStats,
+						 shreddedKeyStatsSize);
+				node->shreddedKeyStats = shreddedKeyStats;
+
+				*size += shreddedKeyStatsSize;
+			}
+		}
+
+		if (!attributeForm->attbyval)
+		{
+			for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+			{
+				ColumnChunkSkipNode *node = &nodeArray[chunkIndex];
+				if (!node->hasMinMax)
+				{
+					continue;
+				}
+
+				node->minimumValue = datumCopy(node->minimumValue, false,
+											   attributeForm->attlen);
+				node->maximumValue = datumCopy(node->maximumValue, false,
+											   attributeForm->attlen);
+
+				*size += datumGetSize(node->minimumValue, false, attributeForm->attlen);
+				*size += datumGetSize(node->maximumValue, false, attributeForm->attlen);
+			}
+		}
+
+		copy->chunkSkipNodeArray[columnIndex] = nodeArray;
+	}
+
+	return copy;
+}
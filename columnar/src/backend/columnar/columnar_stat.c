@@ -0,0 +1,553 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_stat.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Cumulative per table statistics of columnar reads and writes, shown in the
+ * columnar.pg_stat_columnar view.
+ *
+ * The counters live in a hash table in shared memory, sized by
+ * columnar.stat_max_relations, so they are the same for all backends and
+ * survive the backends that counted them, but not a server restart. Tables
+ * that don't fit into the hash table are not tracked until entries are freed
+ * by dropping tables or by columnar.stat_reset.
+ *
+ * Like the cumulative statistics of postgres, backends count into a local
+ * hash table and add their counts to the shared one when the transaction
+ * ends, so scans don't touch shared memory for every stripe or chunk.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+#define STAT_RELATIONS_NATTS (COLUMNAR_STAT_COUNTER_COUNT + 1)
+
+typedef struct ColumnarStatKey
+{
+	Oid databaseId;
+	Oid relationId;
+} ColumnarStatKey;
+
+typedef struct ColumnarStatEntry
+{
+	ColumnarStatKey key;
+
+	/* protects counters, the hash table lock protects the rest */
+	slock_t mutex;
+	uint64 counters[COLUMNAR_STAT_COUNTER_COUNT];
+} ColumnarStatEntry;
+
+typedef struct PendingStatEntry
+{
+	Oid relationId;
+	uint64 counters[COLUMNAR_STAT_COUNTER_COUNT];
+} PendingStatEntry;
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+static shmem_request_hook_type PreviousShmemRequestHook = NULL;
+#endif
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
+/* lock of SharedStats, in shared memory */
+static LWLock *SharedStatsLock = NULL;
+static HTAB *SharedStats = NULL;
+
+/* counts of this backend not yet added to SharedStats */
+static HTAB *PendingStats = NULL;
+
+/* tables dropped by the current transaction */
+static List *PendingDrops = NIL;
+
+static void ColumnarStatShmemRequest(void);
+static void ColumnarStatShmemStartup(void);
+static PendingStatEntry * GetPendingStatEntry(Oid relationId);
+static void FlushPendingStats(void);
+static void RemoveSharedStats(Oid relationId);
+static void ColumnarStatXactCallback(XactEvent event, void *arg);
+
+PG_FUNCTION_INFO_V1(columnar_stat_relations);
+PG_FUNCTION_INFO_V1(columnar_stat_reset);
+
+
+/*
+ * ColumnarStatInit installs the hooks that set up the statistics hash table.
+ * Expected to be called from _PG_init.
+ */
+void
+ColumnarStatInit(void)
+{
+	if (!process_shared_preload_libraries_in_progress ||
+		columnar_stat_max_relations == 0)
+	{
+		return;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+	PreviousShmemRequestHook = shmem_request_hook;
+	shmem_request_hook = ColumnarStatShmemRequest;
+#else
+	ColumnarStatShmemRequest();
+#endif
+
+	PreviousShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = ColumnarStatShmemStartup;
+
+	RegisterXactCallback(ColumnarStatXactCallback, NULL);
+}
+
+
+/*
+ * ColumnarStatShmemRequest requests the shared memory and the lock used by
+ * the statistics hash table.
+ */
+static void
+ColumnarStatShmemRequest(void)
+{
+#if PG_VERSION_NUM >= PG_VERSION_15
+	if (PreviousShmemRequestHook)
+	{
+		PreviousShmemRequestHook();
+	}
+#endif
+
+	RequestAddinShmemSpace(hash_estimate_size(columnar_stat_max_relations,
+											  sizeof(ColumnarStatEntry)));
+	RequestNamedLWLockTranche("columnar_stat", 1);
+}
+
+
+/*
+ * ColumnarStatShmemStartup creates or attaches to the statistics hash table.
+ */
+static void
+ColumnarStatShmemStartup(void)
+{
+	if (PreviousShmemStartupHook)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SharedStatsLock = &(GetNamedLWLockTranche("columnar_stat"))->lock;
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ColumnarStatKey);
+	info.entrysize = sizeof(ColumnarStatEntry);
+
+	SharedStats = ShmemInitHash("columnar stat hash", columnar_stat_max_relations,
+								columnar_stat_max_relations, &info,
+								HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * ColumnarStatCount adds amount to the given counter of a columnar table.
+ */
+void
+ColumnarStatCount(Oid relationId, ColumnarStatCounter counter, uint64 amount)
+{
+	if (SharedStats == NULL || amount == 0)
+	{
+		return;
+	}
+
+	PendingStatEntry *entry = GetPendingStatEntry(relationId);
+	entry->counters[counter] += amount;
+}
+
+
+/*
+ * ColumnarStatCountRead adds what a read of a columnar table did to its
+ * counters.
+ */
+void
+ColumnarStatCountRead(Oid relationId, const ColumnarReadStatistics *statistics)
+{
+	if (SharedStats == NULL)
+	{
+		return;
+	}
+
+	uint64 bytesDecompressed = 0;
+	for (int compressionType = 0; compressionType < COMPRESSION_COUNT; compressionType++)
+	{
+		bytesDecompressed += statistics->decompression[compressionType].decompressedBytes;
+	}
+
+	PendingStatEntry *entry = GetPendingStatEntry(relationId);
+	entry->counters[COLUMNAR_STAT_STRIPES_SCANNED] += statistics->stripesRead;
+	entry->counters[COLUMNAR_STAT_STRIPES_SKIPPED] += statistics->stripesSkipped;
+	entry->counters[COLUMNAR_STAT_CHUNK_GROUPS_SCANNED] += statistics->chunkGroupsRead;
+	entry->counters[COLUMNAR_STAT_CHUNK_GROUPS_SKIPPED] +=
+		statistics->chunkGroupsSkipped;
+	entry->counters[COLUMNAR_STAT_BYTES_READ] += statistics->bytesRead;
+	entry->counters[COLUMNAR_STAT_BYTES_DECOMPRESSED] += bytesDecompressed;
+	entry->counters[COLUMNAR_STAT_VECTORIZED_ROWS] += statistics->vectorRowsRead;
+	entry->counters[COLUMNAR_STAT_ROW_PATH_ROWS] += statistics->rowsRead;
+	entry->counters[COLUMNAR_STAT_CACHE_HITS] += statistics->cacheHits;
+	entry->counters[COLUMNAR_STAT_CACHE_MISSES] += statistics->cacheMisses;
+}
+
+
+/*
+ * ColumnarStatRelationCounters copies the counters of a columnar table,
+ * including the counts of this backend that are not yet flushed, into
+ * counters and returns whether the table has any.
+ */
+bool
+ColumnarStatRelationCounters(Oid relationId, uint64 *counters)
+{
+	if (SharedStats == NULL)
+	{
+		return false;
+	}
+
+	FlushPendingStats();
+
+	ColumnarStatKey key = { 0 };
+	key.databaseId = MyDatabaseId;
+	key.relationId = relationId;
+
+	LWLockAcquire(SharedStatsLock, LW_SHARED);
+
+	ColumnarStatEntry *entry = hash_search(SharedStats, &key, HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		SpinLockAcquire(&entry->mutex);
+		memcpy(counters, entry->counters, sizeof(entry->counters));
+		SpinLockRelease(&entry->mutex);
+	}
+
+	LWLockRelease(SharedStatsLock);
+
+	return entry != NULL;
+}
+
+
+/*
+ * ColumnarStatDropRelation forgets the statistics of a columnar table when
+ * the transaction that drops it commits.
+ */
+void
+ColumnarStatDropRelation(Oid relationId)
+{
+	if (SharedStats == NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	PendingDrops = lappend_oid(PendingDrops, relationId);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * GetPendingStatEntry returns the local counters of the given table, creating
+ * them if needed.
+ */
+static PendingStatEntry *
+GetPendingStatEntry(Oid relationId)
+{
+	if (PendingStats == NULL)
+	{
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(Oid);
+		info.entrysize = sizeof(PendingStatEntry);
+		info.hcxt = TopMemoryContext;
+
+		PendingStats = hash_create("columnar pending stats", 16, &info,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	bool found = false;
+	PendingStatEntry *entry = hash_search(PendingStats, &relationId, HASH_ENTER,
+										  &found);
+	if (!found)
+	{
+		memset(entry->counters, 0, sizeof(entry->counters));
+	}
+
+	return entry;
+}
+
+
+/*
+ * FlushPendingStats adds the local counters to the shared ones. Tables that
+ * are new to the shared hash table are left out when it is full.
+ */
+static void
+FlushPendingStats(void)
+{
+	if (PendingStats == NULL || hash_get_num_entries(PendingStats) == 0)
+	{
+		return;
+	}
+
+	HASH_SEQ_STATUS status;
+	PendingStatEntry *pendingEntry = NULL;
+
+	hash_seq_init(&status, PendingStats);
+	while ((pendingEntry = hash_seq_search(&status)) != NULL)
+	{
+		ColumnarStatKey key = { 0 };
+		key.databaseId = MyDatabaseId;
+		key.relationId = pendingEntry->relationId;
+
+		LWLockAcquire(SharedStatsLock, LW_SHARED);
+
+		ColumnarStatEntry *entry = hash_search(SharedStats, &key, HASH_FIND, NULL);
+		if (entry == NULL)
+		{
+			LWLockRelease(SharedStatsLock);
+			LWLockAcquire(SharedStatsLock, LW_EXCLUSIVE);
+
+			/* another backend might have added it while we didn't hold the lock */
+			entry = hash_search(SharedStats, &key, HASH_FIND, NULL);
+			if (entry == NULL &&
+				hash_get_num_entries(SharedStats) < columnar_stat_max_relations)
+			{
+				entry = hash_search(SharedStats, &key, HASH_ENTER, NULL);
+				SpinLockInit(&entry->mutex);
+				memset(entry->counters, 0, sizeof(entry->counters));
+			}
+		}
+
+		if (entry != NULL)
+		{
+			SpinLockAcquire(&entry->mutex);
+			for (int counter = 0; counter < COLUMNAR_STAT_COUNTER_COUNT; counter++)
+			{
+				entry->counters[counter] += pendingEntry->counters[counter];
+			}
+			SpinLockRelease(&entry->mutex);
+		}
+
+		LWLockRelease(SharedStatsLock);
+
+		hash_search(PendingStats, &pendingEntry->relationId, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * RemoveSharedStats removes the counters of the given table of the current
+ * database, or of all its tables if relationId is invalid.
+ */
+static void
+RemoveSharedStats(Oid relationId)
+{
+	LWLockAcquire(SharedStatsLock, LW_EXCLUSIVE);
+
+	if (OidIsValid(relationId))
+	{
+		ColumnarStatKey key = { 0 };
+		key.databaseId = MyDatabaseId;
+		key.relationId = relationId;
+
+		hash_search(SharedStats, &key, HASH_REMOVE, NULL);
+	}
+	else
+	{
+		HASH_SEQ_STATUS status;
+		ColumnarStatEntry *entry = NULL;
+
+		hash_seq_init(&status, SharedStats);
+		while ((entry = hash_seq_search(&status)) != NULL)
+		{
+			if (entry->key.databaseId == MyDatabaseId)
+			{
+				hash_search(SharedStats, &entry->key, HASH_REMOVE, NULL);
+			}
+		}
+	}
+
+	LWLockRelease(SharedStatsLock);
+}
+
+
+/*
+ * ColumnarStatXactCallback adds the counts of the transaction to the shared
+ * counters, whether it commits or not, and forgets the tables it dropped if
+ * it commits.
+ */
+static void
+ColumnarStatXactCallback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+		case XACT_EVENT_PREPARE:
+		{
+			break;
+		}
+
+		default:
+		{
+			return;
+		}
+	}
+
+	if (SharedStats == NULL)
+	{
+		return;
+	}
+
+	FlushPendingStats();
+
+	if (event == XACT_EVENT_COMMIT)
+	{
+		Oid relationId = InvalidOid;
+		foreach_oid(relationId, PendingDrops)
+		{
+			RemoveSharedStats(relationId);
+		}
+	}
+
+	list_free(PendingDrops);
+	PendingDrops = NIL;
+}
+
+
+/*
+ * columnar_stat_relations returns the counters of the columnar tables of the
+ * current database, including the counts of this backend that are not yet
+ * flushed.
+ */
+Datum
+columnar_stat_relations(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("function returning record called in context "
+							   "that cannot accept type record")));
+	}
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	if (SharedStats == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("columnar statistics are not enabled"),
+						errhint("Add columnar to shared_preload_libraries and set "
+								"columnar.stat_max_relations above 0.")));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	MemoryContextSwitchTo(oldContext);
+
+	/* so that the counts of the current transaction show up */
+	FlushPendingStats();
+
+	LWLockAcquire(SharedStatsLock, LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	ColumnarStatEntry *entry = NULL;
+
+	hash_seq_init(&status, SharedStats);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		uint64 counters[COLUMNAR_STAT_COUNTER_COUNT];
+
+		SpinLockAcquire(&entry->mutex);
+		memcpy(counters, entry->counters, sizeof(counters));
+		SpinLockRelease(&entry->mutex);
+
+		Datum values[STAT_RELATIONS_NATTS] = { 0 };
+		bool nulls[STAT_RELATIONS_NATTS] = { 0 };
+
+		values[0] = ObjectIdGetDatum(entry->key.relationId);
+		for (int counter = 0; counter < COLUMNAR_STAT_COUNTER_COUNT; counter++)
+		{
+			values[counter + 1] = Int64GetDatum(counters[counter]);
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+	}
+
+	LWLockRelease(SharedStatsLock);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = tupleDescriptor;
+
+	return (Datum) 0;
+}
+
+
+/*
+ * columnar_stat_reset resets the counters of the given table, or of all
+ * tables of the current database if it is NULL.
+ */
+Datum
+columnar_stat_reset(PG_FUNCTION_ARGS)
+{
+	if (SharedStats == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	Oid relationId = PG_ARGISNULL(0) ? InvalidOid : PG_GETARG_OID(0);
+
+	/* counts not flushed yet would otherwise show up again */
+	if (PendingStats != NULL)
+	{
+		if (OidIsValid(relationId))
+		{
+			hash_search(PendingStats, &relationId, HASH_REMOVE, NULL);
+		}
+		else
+		{
+			hash_destroy(PendingStats);
+			PendingStats = NULL;
+		}
+	}
+
+	RemoveSharedStats(relationId);
+
+	PG_RETURN_VOID();
+}
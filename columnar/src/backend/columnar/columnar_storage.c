@@ -26,10 +26,49 @@
  *
  * Reservation is done with a relation extension lock, and designed for
  * concurrency, so the callers only need an ordinary lock on the
- * relation. Initializing the metapage or truncating the relation require that
+ * relation. A reservation that extends the relation while other writers
+ * wait for the lock extends it further for them, and the delta store and
+ * writers reserve row numbers and stripe ids in batches, so concurrent
+ * writers seldom queue on the metapage. Initializing the metapage or truncating the relation require that
  * the caller holds an AccessExclusiveLock. (XXX: New reservations of data are
  * aligned onto a new page for no particular reason. Reconsider?).
  *
+ * The metapage also keeps a list of free ranges below the reserved offset,
+ * which columnar.vacuum records once the stripes it removed can no longer
+ * be read by anyone. New reservations are placed into the smallest free
+ * range they fit in before the reserved offset is advanced.
+ *
+ * Stripes can be offloaded to a file per table in columnar.offload_directory,
+ * typically an object storage bucket mounted on the server, see
+ * ColumnarStorageOffload. Reads of their logical offsets are served from
+ * that file, and only the ranges asked for are read.
+ *
+ * Reads and writes take part in the cost based vacuum delay when it is
+ * active, so VACUUM, autovacuum and columnar.vacuum (see
+ * ColumnarStorageBeginCostDelay) sleep between blocks like they do on heap
+ * tables.
+ *
+ * As of storage version 3, the blocks from the first extent block in the
+ * metapage on are extents: they keep the same page format, but are written
+ * and read outside of shared buffers, with one large I/O for up to
+ * COLUMNAR_EXTENT_BLOCKS blocks into a private buffer. Writes still emit a
+ * full page image of every page, and the files written are synced before
+ * the transaction commits, which is what the buffer manager would otherwise
+ * guarantee. Standbys read extents through shared buffers, where redo of
+ * these images puts them. Reservations of at least an extent start on an
+ * extent boundary.
+ *
+ * Stripes are written with ColumnarStorageWriteBuffers, which fills their
+ * pages without WAL and then logs full page images of the whole range in
+ * batches, instead of one generic WAL record for each write to a page. When
+ * the relation doesn't need WAL, such as when it was created in the same
+ * transaction under wal_level = minimal, nothing is logged and the pending
+ * sync of the relation flushes it at commit.
+ *
+ * When built with liburing, ColumnarStorageReadRanges queues the reads of
+ * many ranges in the extents, such as the chunks of a column, on an
+ * io_uring at once, and copies out their pages as they complete.
+ *
  *-------------------------------------------------------------------------
  */
 
@@ -38,15 +77,38 @@
 
 #include "safe_lib.h"
 
+#include "citus_version.h"
+#include "pg_version_constants.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
 #include "access/generic_xlog.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "access/xloginsert.h"
+#if PG_VERSION_NUM >= PG_VERSION_15
+#include "access/xlogrecovery.h"
+#endif
 #include "catalog/storage.h"
+#include "catalog/storage_xlog.h"
+#include "commands/vacuum.h"
+#include "common/controldata_utils.h"
+#include "common/relpath.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/bufmgr.h"
+#include "storage/fd.h"
 #include "storage/lmgr.h"
+#include "storage/proc.h"
 #include "storage/smgr.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_storage.h"
+#include "columnar/columnar_trace.h"
 #include "columnar/columnar_version_compat.h"
 
 /*
@@ -85,9 +147,37 @@ typedef struct ColumnarMetapage
 	 * XXX: Not used yet; reserved field for later support for UNLOGGED.
 	 */
 	bool unloggedReset;
+
+	/*
+	 * Unused ranges below reservedOffset, see ColumnarStorageSetFreeRanges.
+	 * Metapages written before these fields were added read them as zero,
+	 * which is an empty list.
+	 */
+	uint32 freeRangeCount;
+	ColumnarFreeRange freeRanges[COLUMNAR_MAX_FREE_RANGES];
+
+	/*
+	 * First block of the extents, which are written and read outside of
+	 * shared buffers. 0, which metapages written before this field was added
+	 * read it as, means the table has no extents.
+	 */
+	uint64 firstExtentBlock;
 } ColumnarMetapage;
 
 
+/*
+ * Kept in rd_amcache of the relation, so the metapage is read once per
+ * relcache entry to find where the extents start.
+ */
+typedef struct ColumnarStorageCache
+{
+	RelFileNode node;
+	BlockNumber firstExtentBlock;   /* InvalidBlockNumber if no extents */
+	bool buffersFlushed;            /* see PrepareExtentIO */
+	LocalTransactionId flushedTransaction;
+} ColumnarStorageCache;
+
+
 /* represents a "physical" block+offset address */
 typedef struct PhysicalAddr
 {
@@ -98,6 +188,14 @@ typedef struct PhysicalAddr
 
 #define COLUMNAR_METAPAGE_BLOCKNO 0
 #define COLUMNAR_EMPTY_BLOCKNO 1
+
+/*
+ * Storage id that an unlogged relation reset after a crash reads as until a
+ * transaction that can write gives it a new one, see ResetUnloggedMetapage.
+ * Storage ids start at 10000000000, so it has no metadata rows.
+ */
+#define COLUMNAR_RESET_STORAGE_ID ((uint64) 0)
+
 #define COLUMNAR_INVALID_STRIPE_ID 0
 #define COLUMNAR_FIRST_STRIPE_ID 1
 
@@ -106,6 +204,68 @@ typedef struct PhysicalAddr
 								  "version or run \"ALTER EXTENSION citus UPDATE\"."
 
 
+/* offload file last read from, kept open for the next read */
+static File offloadReadFile = -1;
+static char offloadReadFilePath[MAXPGPATH];
+
+/* size of the pieces ColumnarStorageOffload copies stripes in */
+#define OFFLOAD_COPY_SIZE (BLCKSZ * 128)
+
+/* most blocks a reservation extends the relation by for waiting writers */
+#define RESERVATION_EXTRA_BLOCKS_MAX (COLUMNAR_EXTENT_BLOCKS * 4)
+
+/*
+ * Last extent page written, so that the next write of the same stripe,
+ * which continues on that page, doesn't have to read it back.
+ */
+static PGAlignedBlock extentTailPage;
+static RelFileNode extentTailNode;
+static BlockNumber extentTailBlock = InvalidBlockNumber;
+
+/* relfilenodes with extents written in this transaction, to be synced */
+static List *pendingExtentSyncs = NIL;
+
+/* set once a checkpoint is known to have completed after recovery */
+static bool checkpointedAfterRecovery = false;
+
+#ifdef HAVE_LIBURING
+
+/*
+ * A read of consecutive blocks of one segment file, for the part of a range
+ * of ColumnarStorageReadRanges that is in these blocks.
+ */
+typedef struct ExtentReadRequest
+{
+	ColumnarStorageRange *range;
+	uint32 rangeOffset;         /* first byte of the range read here */
+	uint32 amount;              /* bytes of the range read here */
+	BlockNumber blockno;
+	BlockNumber blockCount;
+	int fd;
+	char *pages;
+} ExtentReadRequest;
+
+/* segment file opened by ReadExtentRangesAsync */
+typedef struct ExtentSegmentFile
+{
+	BlockNumber segmentNumber;
+	int fd;
+} ExtentSegmentFile;
+
+/* io_uring of the backend, set up on first use */
+static struct io_uring extentRing;
+static int extentRingDepth = 0;
+static bool extentRingUnavailable = false;
+
+#endif
+
+/* vacuum cost settings replaced by ColumnarStorageBeginCostDelay */
+static bool costDelayReplaced = false;
+static bool savedVacuumCostActive = false;
+static double savedVacuumCostDelay = 0;
+static int savedVacuumCostLimit = 0;
+
+
 /* only for testing purposes */
 PG_FUNCTION_INFO_V1(test_columnar_storage_write_new_page);
 
@@ -138,25 +298,64 @@ PhysicalToLogical(PhysicalAddr addr)
 static void ColumnarOverwriteMetapage(Relation relation,
 									  ColumnarMetapage columnarMetapage);
 static ColumnarMetapage ColumnarMetapageRead(Relation rel, bool force);
+static ColumnarMetapage ResetUnloggedMetapage(Relation rel, ColumnarMetapage metapage);
+static void LockMetapage(Relation rel);
+static void InitStorageFork(SMgrRelation srel, ForkNumber forkNumber, uint64 storageId,
+							char persistence);
 static void ReadFromBlock(Relation rel, BlockNumber blockno, uint32 offset,
-						  char *buf, uint32 len, bool force);
+						  char *buf, uint32 len, bool force,
+						  BufferAccessStrategy strategy);
 static void WriteToBlock(Relation rel, BlockNumber blockno, uint32 offset,
-						 char *buf, uint32 len, bool clear);
+						 char *buf, uint32 len, bool clear, bool logged);
+static void CheckWriteOffset(Relation rel, uint64 logicalOffset);
+static void WriteToBlocks(Relation rel, uint64 logicalOffset, char *data,
+						  uint32 amount, bool logged, BlockNumber *firstBlock,
+						  BlockNumber *endBlock);
 static uint64 AlignReservation(uint64 prevReservation);
+static bool ReserveFreeRange(ColumnarMetapage *metapage, uint64 amount,
+							 uint64 *logicalOffset);
 static bool ColumnarMetapageIsCurrent(ColumnarMetapage *metapage);
 static bool ColumnarMetapageIsOlder(ColumnarMetapage *metapage);
 static bool ColumnarMetapageIsNewer(ColumnarMetapage *metapage);
 static void ColumnarMetapageCheckVersion(Relation rel, ColumnarMetapage *metapage);
+static void OffloadFilePath(Relation rel, char *path);
+static void ReadOffloadedData(Relation rel, uint64 logicalOffset, char *data,
+							  uint32 amount);
+static ColumnarStorageCache * GetStorageCache(Relation rel);
+static BlockNumber FirstExtentBlock(Relation rel);
+static void PrepareExtentIO(Relation rel, bool write);
+static bool CheckpointedAfterRecovery(void);
+static void ExtentFileIO(Relation rel, BlockNumber blockno, BlockNumber blockCount,
+						 char *buffer, bool write);
+static void ReadFromExtents(Relation rel, uint64 logicalOffset, char *data,
+							uint32 amount);
+static uint32 CopyFromExtentPages(Relation rel, char *pages, BlockNumber blockCount,
+								  uint64 logicalOffset, char *data, uint32 amount);
+static void WriteToExtents(Relation rel, uint64 logicalOffset, char *data,
+						   uint32 amount);
+static void ReadExtentPage(Relation rel, BlockNumber blockno, Page page);
+static void RegisterExtentSync(Relation rel);
+#ifdef HAVE_LIBURING
+static bool SetUpExtentRing(void);
+static void ReadExtentRangesAsync(Relation rel, ColumnarStorageRange **ranges,
+								  uint32 rangeCount);
+static uint32 PrepareExtentReadRequests(Relation rel, ColumnarStorageRange **ranges,
+										uint32 rangeCount, List **segmentFiles,
+										ExtentReadRequest **requests);
+static void CompleteExtentReadRequest(Relation rel, ExtentReadRequest *request,
+									  int result);
+#endif
 
 
 /*
  * ColumnarStorageInit - initialize a new metapage in an empty relation
- * with the given storageId.
+ * with the given storageId and persistence. Unlogged relations also get an
+ * init fork with the same pages.
  *
  * Caller must hold AccessExclusiveLock on the relation.
  */
 void
-ColumnarStorageInit(SMgrRelation srel, uint64 storageId)
+ColumnarStorageInit(SMgrRelation srel, uint64 storageId, char persistence)
 {
 	BlockNumber nblocks = smgrnblocks(srel, MAIN_FORKNUM);
 
@@ -167,6 +366,34 @@ ColumnarStorageInit(SMgrRelation srel, uint64 storageId)
 			 nblocks);
 	}
 
+	InitStorageFork(srel, MAIN_FORKNUM, storageId, persistence);
+
+	/* after a crash, the main fork of an unlogged relation is reset to this */
+	if (persistence == RELPERSISTENCE_UNLOGGED)
+	{
+		/* tables truncated in the transaction that created them have one */
+		if (!smgrexists(srel, INIT_FORKNUM))
+		{
+			smgrcreate(srel, INIT_FORKNUM, false);
+			log_smgrcreate(&srel->smgr_rnode.node, INIT_FORKNUM);
+		}
+
+		InitStorageFork(srel, INIT_FORKNUM, storageId, persistence);
+	}
+}
+
+
+/*
+ * InitStorageFork writes the metapage and the empty page to the given fork
+ * of the relation, over the pages the init fork already has. The metapage of
+ * an init fork has unloggedReset set.
+ */
+static void
+InitStorageFork(SMgrRelation srel, ForkNumber forkNumber, uint64 storageId,
+				char persistence)
+{
+	BlockNumber nblocks = smgrnblocks(srel, forkNumber);
+
 	/* create two pages */
 	PGAlignedBlock block;
 	Page page = block.data;
@@ -182,30 +409,56 @@ ColumnarStorageInit(SMgrRelation srel, uint64 storageId)
 	metapage.reservedStripeId = COLUMNAR_FIRST_STRIPE_ID;
 	metapage.reservedRowNumber = COLUMNAR_FIRST_ROW_NUMBER;
 	metapage.reservedOffset = ColumnarFirstLogicalOffset;
-	metapage.unloggedReset = false;
+	metapage.unloggedReset = forkNumber == INIT_FORKNUM;
+
+	/*
+	 * Temporary tables live in local buffers, keep them there. Extents are
+	 * only synced for permanent tables, so unlogged tables, whose files a
+	 * shutdown checkpoint must sync, stay in shared buffers too.
+	 */
+	if (columnar_enable_extent_storage && persistence == RELPERSISTENCE_PERMANENT)
+	{
+		metapage.firstExtentBlock =
+			LogicalToPhysical(ColumnarFirstLogicalOffset).blockno;
+	}
+
 	memcpy_s(page + phdr->pd_lower, phdr->pd_upper - phdr->pd_lower,
 			 (char *) &metapage, sizeof(ColumnarMetapage));
 	phdr->pd_lower += sizeof(ColumnarMetapage);
 
-	log_newpage(&srel->smgr_rnode.node, MAIN_FORKNUM,
+	log_newpage(&srel->smgr_rnode.node, forkNumber,
 				COLUMNAR_METAPAGE_BLOCKNO, page, true);
 	PageSetChecksumInplace(page, COLUMNAR_METAPAGE_BLOCKNO);
-	smgrextend(srel, MAIN_FORKNUM, COLUMNAR_METAPAGE_BLOCKNO, page, true);
+	if (nblocks > COLUMNAR_METAPAGE_BLOCKNO)
+	{
+		smgrwrite(srel, forkNumber, COLUMNAR_METAPAGE_BLOCKNO, page, true);
+	}
+	else
+	{
+		smgrextend(srel, forkNumber, COLUMNAR_METAPAGE_BLOCKNO, page, true);
+	}
 
 	/* write empty page */
 	PageInit(page, BLCKSZ, 0);
 
-	log_newpage(&srel->smgr_rnode.node, MAIN_FORKNUM,
+	log_newpage(&srel->smgr_rnode.node, forkNumber,
 				COLUMNAR_EMPTY_BLOCKNO, page, true);
 	PageSetChecksumInplace(page, COLUMNAR_EMPTY_BLOCKNO);
-	smgrextend(srel, MAIN_FORKNUM, COLUMNAR_EMPTY_BLOCKNO, page, true);
+	if (nblocks > COLUMNAR_EMPTY_BLOCKNO)
+	{
+		smgrwrite(srel, forkNumber, COLUMNAR_EMPTY_BLOCKNO, page, true);
+	}
+	else
+	{
+		smgrextend(srel, forkNumber, COLUMNAR_EMPTY_BLOCKNO, page, true);
+	}
 
 	/*
 	 * An immediate sync is required even if we xlog'd the page, because the
 	 * write did not go through shared_buffers and therefore a concurrent
 	 * checkpoint may have moved the redo pointer past our xlog record.
 	 */
-	smgrimmedsync(srel, MAIN_FORKNUM);
+	smgrimmedsync(srel, forkNumber);
 }
 
 
@@ -222,7 +475,7 @@ void
 ColumnarStorageUpdateCurrent(Relation rel, bool upgrade, uint64 reservedStripeId,
 							 uint64 reservedRowNumber, uint64 reservedOffset)
 {
-	LockRelationForExtension(rel, ExclusiveLock);
+	LockMetapage(rel);
 
 	ColumnarMetapage metapage = ColumnarMetapageRead(rel, true);
 
@@ -250,6 +503,20 @@ ColumnarStorageUpdateCurrent(Relation rel, bool upgrade, uint64 reservedStripeId
 	metapage.reservedRowNumber = reservedRowNumber;
 	metapage.reservedOffset = reservedOffset;
 
+	/*
+	 * Pages keep their format in version 3, so existing data stays where it
+	 * is and is read through shared buffers, while new data goes to extents
+	 * after it. Any buffers of the blocks that become extents are written
+	 * out, so that none are newer than the file.
+	 */
+	if (upgrade && metapage.firstExtentBlock == 0 && columnar_enable_extent_storage &&
+		rel->rd_rel->relpersistence == RELPERSISTENCE_PERMANENT)
+	{
+		metapage.firstExtentBlock =
+			LogicalToPhysical(AlignReservation(reservedOffset)).blockno;
+		FlushRelationBuffers(rel);
+	}
+
 	ColumnarOverwriteMetapage(rel, metapage);
 
 	UnlockRelationForExtension(rel, ExclusiveLock);
@@ -379,7 +646,7 @@ ColumnarStorageIsCurrent(Relation rel)
 uint64
 ColumnarStorageReserveRowNumber(Relation rel, uint64 nrows)
 {
-	LockRelationForExtension(rel, ExclusiveLock);
+	LockMetapage(rel);
 
 	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
 
@@ -403,7 +670,7 @@ ColumnarStorageReserveRowNumber(Relation rel, uint64 nrows)
 uint64
 ColumnarStorageReserveStripeId(Relation rel)
 {
-	LockRelationForExtension(rel, ExclusiveLock);
+	LockMetapage(rel);
 
 	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
 
@@ -418,6 +685,61 @@ ColumnarStorageReserveStripeId(Relation rel)
 }
 
 
+/*
+ * ColumnarStorageReserveStripes reserves stripeCount consecutive stripe ids
+ * and stripeRowCount row numbers for each of them with a single metapage
+ * update. Returns the first stripe id and sets firstRowNumber to the first
+ * row number of the reservation.
+ */
+uint64
+ColumnarStorageReserveStripes(Relation rel, uint64 stripeCount, uint64 stripeRowCount,
+							  uint64 *firstRowNumber)
+{
+	LockMetapage(rel);
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+
+	uint64 firstStripeId = metapage.reservedStripeId;
+	metapage.reservedStripeId += stripeCount;
+
+	*firstRowNumber = metapage.reservedRowNumber;
+	metapage.reservedRowNumber += stripeCount * stripeRowCount;
+
+	ColumnarOverwriteMetapage(rel, metapage);
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+
+	return firstStripeId;
+}
+
+
+/*
+ * ColumnarStorageReleaseStripes gives back the unused end of a reservation
+ * made by ColumnarStorageReserveStripes. Ids and row numbers can only be
+ * given back if nobody reserved any after them, otherwise they are left
+ * unused.
+ */
+void
+ColumnarStorageReleaseStripes(Relation rel, uint64 firstStripeId, uint64 endStripeId,
+							  uint64 firstRowNumber, uint64 endRowNumber)
+{
+	LockMetapage(rel);
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+
+	if (metapage.reservedStripeId == endStripeId &&
+		metapage.reservedRowNumber == endRowNumber)
+	{
+		metapage.reservedStripeId = firstStripeId;
+		metapage.reservedRowNumber = firstRowNumber;
+
+		ColumnarOverwriteMetapage(rel, metapage);
+	}
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+}
+
+
 /*
  * ColumnarStorageReserveData - reserve logical data offsets for writing.
  */
@@ -429,11 +751,35 @@ ColumnarStorageReserveData(Relation rel, uint64 amount)
 		return ColumnarInvalidLogicalOffset;
 	}
 
-	LockRelationForExtension(rel, ExclusiveLock);
+	LockMetapage(rel);
 
 	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
 
+	/* free ranges are below reservedOffset, so they need no new pages */
+	uint64 freeReservation = ColumnarInvalidLogicalOffset;
+	if (ReserveFreeRange(&metapage, amount, &freeReservation))
+	{
+		ColumnarOverwriteMetapage(rel, metapage);
+		UnlockRelationForExtension(rel, ExclusiveLock);
+
+		return freeReservation;
+	}
+
+	BlockNumber firstExtentBlock = FirstExtentBlock(rel);
+
 	uint64 alignedReservation = AlignReservation(metapage.reservedOffset);
+	PhysicalAddr initial = LogicalToPhysical(alignedReservation);
+
+	/* large reservations in the extents start on an extent boundary */
+	if (amount >= COLUMNAR_EXTENT_BLOCKS * COLUMNAR_BYTES_PER_PAGE &&
+		initial.blockno >= firstExtentBlock &&
+		initial.blockno % COLUMNAR_EXTENT_BLOCKS != 0)
+	{
+		initial.blockno += COLUMNAR_EXTENT_BLOCKS -
+						   initial.blockno % COLUMNAR_EXTENT_BLOCKS;
+		alignedReservation = PhysicalToLogical(initial);
+	}
+
 	uint64 nextReservation = alignedReservation + amount;
 	metapage.reservedOffset = nextReservation;
 
@@ -450,12 +796,36 @@ ColumnarStorageReserveData(Relation rel, uint64 amount)
 	}
 
 	BlockNumber nblocks = smgrnblocks(rel->rd_smgr, MAIN_FORKNUM);
+	BlockNumber endBlock = final.blockno + 1;
+
+	/*
+	 * Like heap inserts, extend by as many blocks again for each writer
+	 * waiting for the lock, so their reservations likely find them there.
+	 */
+	if (nblocks < endBlock)
+	{
+		uint64 lockWaiters = RelationExtensionLockWaiterCount(rel);
+		uint64 extraBlocks = Min(lockWaiters * (endBlock - nblocks),
+								 RESERVATION_EXTRA_BLOCKS_MAX);
+
+		endBlock += extraBlocks;
+	}
 
-	while (nblocks <= final.blockno)
+	while (nblocks < endBlock)
 	{
-		Buffer newBuffer = ReadBuffer(rel, P_NEW);
-		Assert(BufferGetBlockNumber(newBuffer) == nblocks);
-		ReleaseBuffer(newBuffer);
+		if (nblocks >= firstExtentBlock)
+		{
+			/* extents never get a buffer, so extend the file directly */
+			PGAlignedBlock zeroBlock = { 0 };
+			smgrextend(rel->rd_smgr, MAIN_FORKNUM, nblocks, zeroBlock.data, false);
+		}
+		else
+		{
+			Buffer newBuffer = ReadBuffer(rel, P_NEW);
+			Assert(BufferGetBlockNumber(newBuffer) == nblocks);
+			ReleaseBuffer(newBuffer);
+		}
+
 		nblocks++;
 	}
 
@@ -465,12 +835,72 @@ ColumnarStorageReserveData(Relation rel, uint64 amount)
 }
 
 
+/*
+ * ColumnarStorageSetFreeRanges replaces the free ranges of the metapage
+ * with the given ranges, largest first, so that ColumnarStorageReserveData
+ * places new data into them. Ranges are aligned the same way as reservations
+ * and those shorter than a page, or beyond the reserved offset, are left out.
+ * Only COLUMNAR_MAX_FREE_RANGES ranges are kept.
+ *
+ * Nothing may read or write the given ranges anymore, and no reservation may
+ * be in progress that isn't recorded in the stripe metadata yet, so callers
+ * hold ExclusiveLock on the relation.
+ */
+void
+ColumnarStorageSetFreeRanges(Relation rel, ColumnarFreeRange *freeRanges,
+							 uint32 freeRangeCount)
+{
+	LockMetapage(rel);
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+
+	metapage.freeRangeCount = 0;
+	for (uint32 rangeIndex = 0;
+		 rangeIndex < freeRangeCount &&
+		 metapage.freeRangeCount < COLUMNAR_MAX_FREE_RANGES;
+		 rangeIndex++)
+	{
+		uint64 rangeStart = AlignReservation(freeRanges[rangeIndex].logicalOffset);
+		uint64 rangeEnd = Min(freeRanges[rangeIndex].logicalOffset +
+							  freeRanges[rangeIndex].length,
+							  metapage.reservedOffset);
+
+		if (rangeEnd <= rangeStart || rangeEnd - rangeStart < COLUMNAR_BYTES_PER_PAGE)
+		{
+			continue;
+		}
+
+		ColumnarFreeRange *freeRange = &metapage.freeRanges[metapage.freeRangeCount++];
+		freeRange->logicalOffset = rangeStart;
+		freeRange->length = rangeEnd - rangeStart;
+	}
+
+	ColumnarOverwriteMetapage(rel, metapage);
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+}
+
+
 /*
  * ColumnarStorageRead - map the logical offset to a block and offset, then
  * read the buffer from multiple blocks if necessary.
  */
 void
 ColumnarStorageRead(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
+{
+	ColumnarStorageReadExtended(rel, logicalOffset, data, amount, NULL);
+}
+
+
+/*
+ * ColumnarStorageReadExtended - same as ColumnarStorageRead, but reads the
+ * blocks using the given buffer access strategy. Large sequential scans pass
+ * a BAS_BULKREAD ring here so that they don't evict the rest of
+ * shared_buffers.
+ */
+void
+ColumnarStorageReadExtended(Relation rel, uint64 logicalOffset, char *data,
+							uint32 amount, BufferAccessStrategy strategy)
 {
 	/* if there's no work to do, succeed even with invalid offset */
 	if (amount == 0)
@@ -486,120 +916,593 @@ ColumnarStorageRead(Relation rel, uint64 logicalOffset, char *data, uint32 amoun
 			 rel->rd_id, logicalOffset);
 	}
 
+	COLUMNAR_TRACE_STORAGE_READ_START(rel->rd_id, logicalOffset, amount);
+
+	if (ColumnarLogicalOffsetIsOffloaded(logicalOffset))
+	{
+		ReadOffloadedData(rel, logicalOffset, data, amount);
+		COLUMNAR_TRACE_STORAGE_READ_DONE(rel->rd_id, logicalOffset, amount);
+		return;
+	}
+
+	BlockNumber firstExtentBlock = FirstExtentBlock(rel);
 	uint64 read = 0;
 
 	while (read < amount)
 	{
 		PhysicalAddr addr = LogicalToPhysical(logicalOffset + read);
 
+		/* the rest of the range is in the extents */
+		if (addr.blockno >= firstExtentBlock)
+		{
+			ReadFromExtents(rel, logicalOffset + read, data + read, amount - read);
+			break;
+		}
+
+		/* reported per block, as waits for the buffer clear it */
+		pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_STORAGE_READ);
+
 		uint32 to_read = Min(amount - read, BLCKSZ - addr.offset);
 		ReadFromBlock(rel, addr.blockno, addr.offset, data + read, to_read,
-					  false);
+					  false, strategy);
+
+		pgstat_report_wait_end();
 
 		read += to_read;
+
+		/* ReadBuffer charged the cost of the block */
+		if (VacuumCostActive)
+		{
+			vacuum_delay_point();
+		}
 	}
+
+	COLUMNAR_TRACE_STORAGE_READ_DONE(rel->rd_id, logicalOffset, amount);
 }
 
 
 /*
- * ColumnarStorageWrite - map the logical offset to a block and offset, then
- * write the buffer across multiple blocks if necessary.
+ * ColumnarStorageReadsAsync - whether ColumnarStorageReadRanges reads the
+ * ranges of the relation that are in its extents asynchronously, rather
+ * than one range after the other.
+ */
+bool
+ColumnarStorageReadsAsync(Relation rel)
+{
+#ifdef HAVE_LIBURING
+	return columnar_io_uring_queue_depth > 0 && !extentRingUnavailable &&
+		   FirstExtentBlock(rel) != InvalidBlockNumber;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * ColumnarStorageReadRanges - read each of the given ranges into its data,
+ * like ColumnarStorageReadExtended would. When ColumnarStorageReadsAsync,
+ * the reads of the ranges in the extents are all queued on an io_uring, up
+ * to columnar.io_uring_queue_depth at a time, and their pages are copied out
+ * in the order they complete. The other ranges are read first, one after
+ * the other.
  */
 void
-ColumnarStorageWrite(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
+ColumnarStorageReadRanges(Relation rel, ColumnarStorageRange *ranges,
+						  uint32 rangeCount, BufferAccessStrategy strategy)
 {
-	/* if there's no work to do, succeed even with invalid offset */
-	if (amount == 0)
+#ifdef HAVE_LIBURING
+	if (ColumnarStorageReadsAsync(rel) && SetUpExtentRing())
 	{
+		BlockNumber firstExtentBlock = FirstExtentBlock(rel);
+		ColumnarStorageRange **extentRanges =
+			palloc(rangeCount * sizeof(ColumnarStorageRange *));
+		uint32 extentRangeCount = 0;
+
+		for (uint32 rangeIndex = 0; rangeIndex < rangeCount; rangeIndex++)
+		{
+			ColumnarStorageRange *range = &ranges[rangeIndex];
+
+			if (range->amount > 0 && ColumnarLogicalOffsetIsValid(range->logicalOffset) &&
+				!ColumnarLogicalOffsetIsOffloaded(range->logicalOffset) &&
+				LogicalToPhysical(range->logicalOffset).blockno >= firstExtentBlock)
+			{
+				extentRanges[extentRangeCount++] = range;
+			}
+			else
+			{
+				ColumnarStorageReadExtended(rel, range->logicalOffset, range->data,
+											range->amount, strategy);
+			}
+		}
+
+		if (extentRangeCount > 0)
+		{
+			ReadExtentRangesAsync(rel, extentRanges, extentRangeCount);
+		}
+
+		pfree(extentRanges);
 		return;
 	}
+#endif
 
-	if (!ColumnarLogicalOffsetIsValid(logicalOffset))
+	for (uint32 rangeIndex = 0; rangeIndex < rangeCount; rangeIndex++)
 	{
-		elog(ERROR,
-			 "attempted columnar write on relation %d to invalid logical offset: "
-			 UINT64_FORMAT,
-			 rel->rd_id, logicalOffset);
+		ColumnarStorageReadExtended(rel, ranges[rangeIndex].logicalOffset,
+									ranges[rangeIndex].data,
+									ranges[rangeIndex].amount, strategy);
 	}
+}
 
-	uint64 written = 0;
 
-	while (written < amount)
+/*
+ * ColumnarStoragePrefetch - issue asynchronous read requests for all blocks
+ * that back the given logical range, so that a later ColumnarStorageRead of
+ * the same range doesn't have to wait for the I/O. Returns the number of
+ * blocks for which a prefetch was requested.
+ *
+ * This is only a hint to the kernel (see PrefetchBuffer), so it is a no-op
+ * on platforms without USE_PREFETCH.
+ */
+uint32
+ColumnarStoragePrefetch(Relation rel, uint64 logicalOffset, uint64 amount)
+{
+	uint32 prefetched = 0;
+
+#ifdef USE_PREFETCH
+	if (amount == 0 || !ColumnarLogicalOffsetIsValid(logicalOffset) ||
+		ColumnarLogicalOffsetIsOffloaded(logicalOffset))
 	{
-		PhysicalAddr addr = LogicalToPhysical(logicalOffset + written);
+		return 0;
+	}
 
-		uint64 to_write = Min(amount - written, BLCKSZ - addr.offset);
-		WriteToBlock(rel, addr.blockno, addr.offset, data + written, to_write,
-					 false);
+	PhysicalAddr first = LogicalToPhysical(logicalOffset);
+	PhysicalAddr last = LogicalToPhysical(logicalOffset + amount - 1);
+	BlockNumber firstExtentBlock = FirstExtentBlock(rel);
 
-		written += to_write;
+	for (BlockNumber blockno = first.blockno; blockno <= last.blockno; blockno++)
+	{
+		if (blockno >= firstExtentBlock)
+		{
+			smgrprefetch(rel->rd_smgr, MAIN_FORKNUM, blockno);
+		}
+		else
+		{
+			PrefetchBuffer(rel, MAIN_FORKNUM, blockno);
+		}
+
+		prefetched++;
 	}
+#endif
+
+	return prefetched;
 }
 
 
 /*
- * ColumnarStorageTruncate - truncate the columnar storage such that
- * newDataReservation will be the first unused logical offset available. Free
- * pages at the end of the relation.
- *
- * Caller must hold AccessExclusiveLock on the relation.
- *
- * Returns true if pages were truncated; false otherwise.
+ * ColumnarStorageWrite - map the logical offset to a block and offset, then
+ * write the buffer across multiple blocks if necessary.
  */
-bool
-ColumnarStorageTruncate(Relation rel, uint64 newDataReservation)
+void
+ColumnarStorageWrite(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
 {
-	if (!ColumnarLogicalOffsetIsValid(newDataReservation))
+	/* if there's no work to do, succeed even with invalid offset */
+	if (amount == 0)
 	{
-		elog(ERROR,
-			 "attempted to truncate relation %d to invalid logical offset: " UINT64_FORMAT,
-			 rel->rd_id, newDataReservation);
+		return;
 	}
 
-	if (unlikely(rel->rd_smgr == NULL))
+	CheckWriteOffset(rel, logicalOffset);
+
+	COLUMNAR_TRACE_STORAGE_WRITE_START(rel->rd_id, logicalOffset, amount);
+
+	BlockNumber firstBlock = InvalidBlockNumber;
+	BlockNumber endBlock = InvalidBlockNumber;
+	WriteToBlocks(rel, logicalOffset, data, amount, true, &firstBlock, &endBlock);
+
+	COLUMNAR_TRACE_STORAGE_WRITE_DONE(rel->rd_id, logicalOffset, amount);
+}
+
+
+/*
+ * ColumnarStorageWriteBuffers - write the given buffers one after the other
+ * from the logical offset on, like that many ColumnarStorageWrite calls. The
+ * range must be reserved by the caller and not be read by anyone else until
+ * its transaction commits, as a stripe being flushed is.
+ *
+ * The pages are filled without WAL, and full page images of all of them are
+ * logged at the end by log_newpage_range, which puts many pages in a record.
+ * A page the buffers share is thus logged once rather than once per buffer.
+ * If the transaction fails before that, the range is never referenced.
+ */
+void
+ColumnarStorageWriteBuffers(Relation rel, uint64 logicalOffset, StringInfo *buffers,
+							uint32 bufferCount)
+{
+	uint64 amount = 0;
+	for (uint32 bufferIndex = 0; bufferIndex < bufferCount; bufferIndex++)
 	{
-		smgrsetowner(&(rel->rd_smgr), smgropen(rel->rd_node, rel->rd_backend));
+		amount += buffers[bufferIndex]->len;
 	}
 
-	BlockNumber old_rel_pages = smgrnblocks(rel->rd_smgr, MAIN_FORKNUM);
-	if (old_rel_pages == 0)
+	if (amount == 0)
 	{
-		/* nothing to do */
-		return false;
+		return;
 	}
 
-	LockRelationForExtension(rel, ExclusiveLock);
+	CheckWriteOffset(rel, logicalOffset);
 
-	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+	COLUMNAR_TRACE_STORAGE_WRITE_START(rel->rd_id, logicalOffset, amount);
 
-	if (metapage.reservedOffset < newDataReservation)
+	BlockNumber firstBlock = InvalidBlockNumber;
+	BlockNumber endBlock = InvalidBlockNumber;
+	uint64 currentOffset = logicalOffset;
+
+	for (uint32 bufferIndex = 0; bufferIndex < bufferCount; bufferIndex++)
 	{
-		elog(ERROR,
-			 "attempted to truncate relation %d to offset " UINT64_FORMAT \
-			 " which is higher than existing offset " UINT64_FORMAT,
-			 rel->rd_id, newDataReservation, metapage.reservedOffset);
+		StringInfo buffer = buffers[bufferIndex];
+		if (buffer->len == 0)
+		{
+			continue;
+		}
+
+		WriteToBlocks(rel, currentOffset, buffer->data, buffer->len, false,
+					  &firstBlock, &endBlock);
+		currentOffset += buffer->len;
 	}
 
-	if (metapage.reservedOffset == newDataReservation)
+	if (firstBlock != InvalidBlockNumber && RelationNeedsWAL(rel))
 	{
-		/* nothing to do */
-		UnlockRelationForExtension(rel, ExclusiveLock);
-		return false;
+		pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_STORAGE_WRITE);
+		log_newpage_range(rel, MAIN_FORKNUM, firstBlock, endBlock, true);
+		pgstat_report_wait_end();
 	}
 
-	metapage.reservedOffset = newDataReservation;
-
-	/* write new reservation */
-	ColumnarOverwriteMetapage(rel, metapage);
-
-	UnlockRelationForExtension(rel, ExclusiveLock);
+	COLUMNAR_TRACE_STORAGE_WRITE_DONE(rel->rd_id, logicalOffset, amount);
+}
 
-	PhysicalAddr final = LogicalToPhysical(newDataReservation - 1);
-	BlockNumber new_rel_pages = final.blockno + 1;
-	Assert(new_rel_pages <= old_rel_pages);
 
-	/*
-	 * Truncate the storage. Note that RelationTruncate() takes care of
+/*
+ * CheckWriteOffset - error out if data can't be written to the logical
+ * offset.
+ */
+static void
+CheckWriteOffset(Relation rel, uint64 logicalOffset)
+{
+	if (!ColumnarLogicalOffsetIsValid(logicalOffset))
+	{
+		elog(ERROR,
+			 "attempted columnar write on relation %d to invalid logical offset: "
+			 UINT64_FORMAT,
+			 rel->rd_id, logicalOffset);
+	}
+
+	/* offloaded stripes are never written again, only replaced */
+	if (ColumnarLogicalOffsetIsOffloaded(logicalOffset))
+	{
+		elog(ERROR,
+			 "attempted columnar write on relation %d to offloaded logical offset: "
+			 UINT64_FORMAT,
+			 rel->rd_id, logicalOffset);
+	}
+}
+
+
+/*
+ * WriteToBlocks - write data to the blocks from the logical offset on, and
+ * to the extents for the part of it that is there. Pages in shared buffers
+ * written without WAL extend the range [firstBlock, endBlock), which the
+ * caller logs.
+ */
+static void
+WriteToBlocks(Relation rel, uint64 logicalOffset, char *data, uint32 amount,
+			  bool logged, BlockNumber *firstBlock, BlockNumber *endBlock)
+{
+	BlockNumber firstExtentBlock = FirstExtentBlock(rel);
+	uint64 written = 0;
+
+	while (written < amount)
+	{
+		PhysicalAddr addr = LogicalToPhysical(logicalOffset + written);
+
+		/* the rest of the range is in the extents */
+		if (addr.blockno >= firstExtentBlock)
+		{
+			WriteToExtents(rel, logicalOffset + written, data + written,
+						   amount - written);
+			break;
+		}
+
+		pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_STORAGE_WRITE);
+
+		uint64 to_write = Min(amount - written, BLCKSZ - addr.offset);
+		WriteToBlock(rel, addr.blockno, addr.offset, data + written, to_write,
+					 false, logged);
+
+		pgstat_report_wait_end();
+
+		if (!logged)
+		{
+			if (*firstBlock == InvalidBlockNumber || addr.blockno < *firstBlock)
+			{
+				*firstBlock = addr.blockno;
+			}
+
+			if (*endBlock == InvalidBlockNumber || addr.blockno >= *endBlock)
+			{
+				*endBlock = addr.blockno + 1;
+			}
+		}
+
+		written += to_write;
+
+		if (VacuumCostActive)
+		{
+			vacuum_delay_point();
+		}
+	}
+}
+
+
+/*
+ * ColumnarStorageLogChange - emit a WAL record of the given resource manager
+ * that changes nothing. The record registers the metapage with a full page
+ * image, so redo only restores the metapage as it is and skips the rest of
+ * the record. This lets columnar log records for other readers of the WAL,
+ * namely heap records for logical decoding, that must not touch its storage
+ * when replayed. The image is written for every record, but as the page is
+ * registered as a standard one it only holds the page header and the
+ * metapage itself, about 1.1kB. blockData is the data of the registered
+ * block, and may be NULL.
+ */
+void
+ColumnarStorageLogChange(Relation rel, RmgrId rmid, uint8 info, char *mainData,
+						 uint32 mainLength, char *blockData, uint32 blockLength)
+{
+	Buffer buffer = ReadBuffer(rel, COLUMNAR_METAPAGE_BLOCKNO);
+	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+
+	START_CRIT_SECTION();
+
+	MarkBufferDirty(buffer);
+
+	XLogBeginInsert();
+	XLogRegisterData(mainData, mainLength);
+	XLogRegisterBuffer(0, buffer,
+					   REGBUF_FORCE_IMAGE | REGBUF_KEEP_DATA | REGBUF_STANDARD);
+	if (blockLength > 0)
+	{
+		XLogRegisterBufData(0, blockData, blockLength);
+	}
+
+	/* logical decoding may filter the changes by their origin */
+	XLogSetRecordFlags(XLOG_INCLUDE_ORIGIN);
+
+	XLogRecPtr recptr = XLogInsert(rmid, info);
+	PageSetLSN(BufferGetPage(buffer), recptr);
+
+	END_CRIT_SECTION();
+
+	UnlockReleaseBuffer(buffer);
+}
+
+
+/*
+ * ColumnarStorageOffload - append the given range of the storage to the
+ * table's file in columnar.offload_directory and return the logical offset
+ * it is read from there. The file is synced before returning, so the caller
+ * can point the stripe metadata at it. What was appended by aborted
+ * transactions is not reused.
+ */
+uint64
+ColumnarStorageOffload(Relation rel, uint64 logicalOffset, uint64 amount)
+{
+	char path[MAXPGPATH];
+	OffloadFilePath(rel, path);
+
+	if (MakePGDirectory(columnar_offload_directory) < 0 && errno != EEXIST)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create directory \"%s\": %m",
+							   columnar_offload_directory)));
+	}
+
+	File file = PathNameOpenFile(path, O_RDWR | O_CREAT | PG_BINARY);
+	if (file < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", path)));
+	}
+
+	off_t fileOffset = FileSize(file);
+	if (fileOffset < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not determine size of file \"%s\": %m", path)));
+	}
+
+	char *buffer = palloc(OFFLOAD_COPY_SIZE);
+	uint64 copied = 0;
+
+	while (copied < amount)
+	{
+		uint32 to_copy = Min(amount - copied, OFFLOAD_COPY_SIZE);
+		ColumnarStorageRead(rel, logicalOffset + copied, buffer, to_copy);
+
+		errno = 0;
+		if (FileWrite(file, buffer, to_copy, fileOffset + copied,
+					  WAIT_EVENT_DATA_FILE_WRITE) != (int) to_copy)
+		{
+			/* if write didn't set errno, assume problem is no disk space */
+			if (errno == 0)
+			{
+				errno = ENOSPC;
+			}
+
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not write to file \"%s\": %m", path)));
+		}
+
+		copied += to_copy;
+	}
+
+	if (FileSync(file, WAIT_EVENT_DATA_FILE_SYNC) != 0)
+	{
+		ereport(data_sync_elevel(ERROR),
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m", path)));
+	}
+
+	FileClose(file);
+	pfree(buffer);
+
+	return COLUMNAR_OFFLOADED_OFFSET_FLAG | (uint64) fileOffset;
+}
+
+
+/*
+ * ColumnarStorageBeginCostDelay - make the reads and writes done until
+ * ColumnarStorageEndCostDelay sleep for costDelay milliseconds each time
+ * costLimit has been used up, the way vacuum_cost_delay and vacuum_cost_limit
+ * throttle VACUUM. A negative value keeps the current setting, which under
+ * autovacuum is the autovacuum one. A delay of 0 turns throttling off.
+ */
+void
+ColumnarStorageBeginCostDelay(double costDelay, int costLimit)
+{
+	if (!costDelayReplaced)
+	{
+		savedVacuumCostActive = VacuumCostActive;
+		savedVacuumCostDelay = VacuumCostDelay;
+		savedVacuumCostLimit = VacuumCostLimit;
+		costDelayReplaced = true;
+	}
+
+	if (costDelay >= 0)
+	{
+		VacuumCostDelay = costDelay;
+	}
+
+	if (costLimit > 0)
+	{
+		VacuumCostLimit = costLimit;
+	}
+
+	if (!VacuumCostActive)
+	{
+		VacuumCostBalance = 0;
+	}
+
+	VacuumCostActive = (VacuumCostDelay > 0);
+}
+
+
+/*
+ * ColumnarStorageEndCostDelay - restore the vacuum cost settings replaced by
+ * ColumnarStorageBeginCostDelay, if they were.
+ */
+void
+ColumnarStorageEndCostDelay(void)
+{
+	if (!costDelayReplaced)
+	{
+		return;
+	}
+
+	VacuumCostActive = savedVacuumCostActive;
+	VacuumCostDelay = savedVacuumCostDelay;
+	VacuumCostLimit = savedVacuumCostLimit;
+
+	if (!VacuumCostActive)
+	{
+		VacuumCostBalance = 0;
+	}
+
+	costDelayReplaced = false;
+}
+
+
+/*
+ * ColumnarStorageTruncate - truncate the columnar storage such that
+ * newDataReservation will be the first unused logical offset available. Free
+ * pages at the end of the relation.
+ *
+ * Caller must hold AccessExclusiveLock on the relation.
+ *
+ * Returns true if pages were truncated; false otherwise.
+ */
+bool
+ColumnarStorageTruncate(Relation rel, uint64 newDataReservation)
+{
+	if (!ColumnarLogicalOffsetIsValid(newDataReservation))
+	{
+		elog(ERROR,
+			 "attempted to truncate relation %d to invalid logical offset: " UINT64_FORMAT,
+			 rel->rd_id, newDataReservation);
+	}
+
+	if (unlikely(rel->rd_smgr == NULL))
+	{
+		smgrsetowner(&(rel->rd_smgr), smgropen(rel->rd_node, rel->rd_backend));
+	}
+
+	BlockNumber old_rel_pages = smgrnblocks(rel->rd_smgr, MAIN_FORKNUM);
+	if (old_rel_pages == 0)
+	{
+		/* nothing to do */
+		return false;
+	}
+
+	LockMetapage(rel);
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+
+	if (metapage.reservedOffset < newDataReservation)
+	{
+		elog(ERROR,
+			 "attempted to truncate relation %d to offset " UINT64_FORMAT \
+			 " which is higher than existing offset " UINT64_FORMAT,
+			 rel->rd_id, newDataReservation, metapage.reservedOffset);
+	}
+
+	if (metapage.reservedOffset == newDataReservation)
+	{
+		/* nothing to do */
+		UnlockRelationForExtension(rel, ExclusiveLock);
+		return false;
+	}
+
+	metapage.reservedOffset = newDataReservation;
+
+	/* the last extent page written may be truncated away */
+	extentTailBlock = InvalidBlockNumber;
+
+	/* free ranges must not reach into the truncated pages */
+	uint32 keptRangeCount = 0;
+	for (uint32 rangeIndex = 0; rangeIndex < metapage.freeRangeCount; rangeIndex++)
+	{
+		ColumnarFreeRange freeRange = metapage.freeRanges[rangeIndex];
+		if (freeRange.logicalOffset >= newDataReservation)
+		{
+			continue;
+		}
+
+		freeRange.length = Min(freeRange.length,
+							   newDataReservation - freeRange.logicalOffset);
+		metapage.freeRanges[keptRangeCount++] = freeRange;
+	}
+	metapage.freeRangeCount = keptRangeCount;
+
+	/* write new reservation */
+	ColumnarOverwriteMetapage(rel, metapage);
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+
+	PhysicalAddr final = LogicalToPhysical(newDataReservation - 1);
+	BlockNumber new_rel_pages = final.blockno + 1;
+	Assert(new_rel_pages <= old_rel_pages);
+
+	/*
+	 * Truncate the storage. Note that RelationTruncate() takes care of
 	 * Write Ahead Logging.
 	 */
 	if (new_rel_pages < old_rel_pages)
@@ -622,7 +1525,7 @@ ColumnarOverwriteMetapage(Relation relation, ColumnarMetapage columnarMetapage)
 	/* clear metapage because we are overwriting */
 	bool clear = true;
 	WriteToBlock(relation, COLUMNAR_METAPAGE_BLOCKNO, SizeOfPageHeaderData,
-				 (char *) &columnarMetapage, sizeof(ColumnarMetapage), clear);
+				 (char *) &columnarMetapage, sizeof(ColumnarMetapage), clear, true);
 }
 
 
@@ -668,27 +1571,108 @@ ColumnarMetapageRead(Relation rel, bool force)
 	bool forceReadBlock = true;
 	ColumnarMetapage metapage;
 	ReadFromBlock(rel, COLUMNAR_METAPAGE_BLOCKNO, SizeOfPageHeaderData,
-				  (char *) &metapage, sizeof(ColumnarMetapage), forceReadBlock);
+				  (char *) &metapage, sizeof(ColumnarMetapage), forceReadBlock,
+				  NULL);
 
 	if (!force)
 	{
 		ColumnarMetapageCheckVersion(rel, &metapage);
 	}
 
+	if (unlikely(metapage.unloggedReset))
+	{
+		metapage = ResetUnloggedMetapage(rel, metapage);
+	}
+
+	return metapage;
+}
+
+
+/*
+ * ResetUnloggedMetapage handles the metapage of an unlogged relation whose
+ * main fork was reset to its init fork after a crash. The stripes and other
+ * metadata rows of its storage id refer to data that is gone, so the storage
+ * gets a new storage id, the reset flag is cleared, and the old rows are
+ * deleted. Transactions that can't write do this on the next metapage read
+ * of a transaction that can, and until then see the storage as empty.
+ *
+ * Must not be called under the relation extension lock, see LockMetapage.
+ */
+static ColumnarMetapage
+ResetUnloggedMetapage(Relation rel, ColumnarMetapage metapage)
+{
+	BlockNumber nblocks = smgrnblocks(rel->rd_smgr, MAIN_FORKNUM);
+	if (rel->rd_rel->relpersistence != RELPERSISTENCE_UNLOGGED ||
+		nblocks != COLUMNAR_EMPTY_BLOCKNO + 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("unexpected reset flag in the columnar metapage of "
+							   "relation \"%s\"", RelationGetRelationName(rel))));
+	}
+
+	if (XactReadOnly || IsInParallelMode())
+	{
+		metapage.storageId = COLUMNAR_RESET_STORAGE_ID;
+		return metapage;
+	}
+
+	uint64 oldStorageId = metapage.storageId;
+	uint64 newStorageId = ColumnarMetadataNewStorageId();
+
+	/* another backend may have reset the storage since we read the metapage */
+	LockRelationForExtension(rel, ExclusiveLock);
+
+	ReadFromBlock(rel, COLUMNAR_METAPAGE_BLOCKNO, SizeOfPageHeaderData,
+				  (char *) &metapage, sizeof(ColumnarMetapage), true, NULL);
+
+	bool resetByUs = metapage.unloggedReset;
+	if (resetByUs)
+	{
+		metapage.storageId = newStorageId;
+		metapage.unloggedReset = false;
+		ColumnarOverwriteMetapage(rel, metapage);
+	}
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+
+	/* if we abort, the rows stay behind, but nothing reads them anymore */
+	if (resetByUs)
+	{
+		DeleteStorageMetadataRows(oldStorageId);
+	}
+
 	return metapage;
 }
 
 
+/*
+ * LockMetapage takes the relation extension lock that the metapage is
+ * updated under. A pending reset of an unlogged relation is handled first,
+ * as it takes other locks, which can't be taken while holding that one.
+ */
+static void
+LockMetapage(Relation rel)
+{
+	if (rel->rd_rel->relpersistence == RELPERSISTENCE_UNLOGGED)
+	{
+		(void) ColumnarMetapageRead(rel, true);
+	}
+
+	LockRelationForExtension(rel, ExclusiveLock);
+}
+
+
 /*
  * ReadFromBlock - read bytes from a page at the given offset. If 'force' is
  * true, don't check pd_lower; useful when reading a metapage of unknown
- * version.
+ * version. 'strategy' may be NULL to use the default buffer replacement.
  */
 static void
 ReadFromBlock(Relation rel, BlockNumber blockno, uint32 offset, char *buf,
-			  uint32 len, bool force)
+			  uint32 len, bool force, BufferAccessStrategy strategy)
 {
-	Buffer buffer = ReadBuffer(rel, blockno);
+	Buffer buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blockno, RBM_NORMAL,
+									   strategy);
 	LockBuffer(buffer, BUFFER_LOCK_SHARE);
 	Page page = BufferGetPage(buffer);
 	PageHeader phdr = (PageHeader) page;
@@ -707,21 +1691,23 @@ ReadFromBlock(Relation rel, BlockNumber blockno, uint32 offset, char *buf,
 
 /*
  * WriteToBlock - append data to a block, initializing if necessary, and emit
- * WAL. If 'clear' is true, always clear the data on the page and reinitialize
- * it first, and offset must be SizeOfPageHeaderData. Otherwise, offset must
- * be equal to pd_lower and pd_lower will be set to the end of the written
- * data.
+ * WAL if 'logged' is true. If 'clear' is true, always clear the data on the
+ * page and reinitialize it first, and offset must be SizeOfPageHeaderData.
+ * Otherwise, offset must be equal to pd_lower and pd_lower will be set to the
+ * end of the written data.
  */
 static void
 WriteToBlock(Relation rel, BlockNumber blockno, uint32 offset, char *buf,
-			 uint32 len, bool clear)
+			 uint32 len, bool clear, bool logged)
 {
 	Buffer buffer = ReadBuffer(rel, blockno);
-	GenericXLogState *state = GenericXLogStart(rel);
+	GenericXLogState *state = logged ? GenericXLogStart(rel) : NULL;
 
 	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
 
-	Page page = GenericXLogRegisterBuffer(state, buffer, GENERIC_XLOG_FULL_IMAGE);
+	Page page = logged ?
+				GenericXLogRegisterBuffer(state, buffer, GENERIC_XLOG_FULL_IMAGE) :
+				BufferGetPage(buffer);
 
 	PageHeader phdr = (PageHeader) page;
 	if (PageIsNew(page) || clear)
@@ -758,7 +1744,14 @@ WriteToBlock(Relation rel, BlockNumber blockno, uint32 offset, char *buf,
 	memcpy_s(page + phdr->pd_lower, phdr->pd_upper - phdr->pd_lower, buf, len);
 	phdr->pd_lower += len;
 
-	GenericXLogFinish(state);
+	if (logged)
+	{
+		GenericXLogFinish(state);
+	}
+	else
+	{
+		MarkBufferDirty(buffer);
+	}
 
 	UnlockReleaseBuffer(buffer);
 }
@@ -790,6 +1783,52 @@ AlignReservation(uint64 prevReservation)
 }
 
 
+/*
+ * ReserveFreeRange reserves amount bytes from the smallest free range of the
+ * metapage they fit in, and returns false if none is large enough. What is
+ * left of the range after the reservation stays free from the next page on.
+ */
+static bool
+ReserveFreeRange(ColumnarMetapage *metapage, uint64 amount, uint64 *logicalOffset)
+{
+	int bestRangeIndex = -1;
+	for (uint32 rangeIndex = 0; rangeIndex < metapage->freeRangeCount; rangeIndex++)
+	{
+		uint64 rangeLength = metapage->freeRanges[rangeIndex].length;
+		if (rangeLength >= amount &&
+			(bestRangeIndex < 0 ||
+			 rangeLength < metapage->freeRanges[bestRangeIndex].length))
+		{
+			bestRangeIndex = rangeIndex;
+		}
+	}
+
+	if (bestRangeIndex < 0)
+	{
+		return false;
+	}
+
+	ColumnarFreeRange *freeRange = &metapage->freeRanges[bestRangeIndex];
+	uint64 rangeEnd = freeRange->logicalOffset + freeRange->length;
+	uint64 nextReservation = AlignReservation(freeRange->logicalOffset + amount);
+
+	*logicalOffset = freeRange->logicalOffset;
+
+	if (nextReservation < rangeEnd)
+	{
+		freeRange->logicalOffset = nextReservation;
+		freeRange->length = rangeEnd - nextReservation;
+	}
+	else
+	{
+		metapage->freeRanges[bestRangeIndex] =
+			metapage->freeRanges[--metapage->freeRangeCount];
+	}
+
+	return true;
+}
+
+
 /*
  * ColumnarMetapageIsCurrent - is the metapage at the latest version?
  */
@@ -879,3 +1918,847 @@ test_columnar_storage_write_new_page(PG_FUNCTION_ARGS)
 
 	PG_RETURN_VOID();
 }
+
+
+/*
+ * OffloadFilePath - the path of the file in columnar.offload_directory that
+ * keeps the offloaded stripes of the given table.
+ */
+static void
+OffloadFilePath(Relation rel, char *path)
+{
+	if (columnar_offload_directory == NULL || columnar_offload_directory[0] == '\0')
+	{
+		ereport(ERROR, (errmsg("columnar.offload_directory is not set"),
+						errdetail("Stripes of \"%s\" are offloaded to it.",
+								  RelationGetRelationName(rel))));
+	}
+
+	snprintf(path, MAXPGPATH, "%s/" UINT64_FORMAT, columnar_offload_directory,
+			 ColumnarStorageGetStorageId(rel, false));
+}
+
+
+/*
+ * ReadOffloadedData - read bytes of an offloaded stripe from the offload
+ * file of the given table.
+ */
+static void
+ReadOffloadedData(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
+{
+	char path[MAXPGPATH];
+	OffloadFilePath(rel, path);
+
+	if (offloadReadFile < 0 || strcmp(path, offloadReadFilePath) != 0)
+	{
+		if (offloadReadFile >= 0)
+		{
+			FileClose(offloadReadFile);
+			offloadReadFile = -1;
+		}
+
+		File file = PathNameOpenFile(path, O_RDONLY | PG_BINARY);
+		if (file < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\": %m", path)));
+		}
+
+		offloadReadFile = file;
+		strlcpy(offloadReadFilePath, path, MAXPGPATH);
+	}
+
+	off_t fileOffset = (off_t) (logicalOffset & ~COLUMNAR_OFFLOADED_OFFSET_FLAG);
+	int bytesRead = FileRead(offloadReadFile, data, amount, fileOffset,
+							 WAIT_EVENT_DATA_FILE_READ);
+	if (bytesRead < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": %m", path)));
+	}
+	else if (bytesRead != (int) amount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("could not read file \"%s\": read only %d of %u bytes",
+							   path, bytesRead, amount)));
+	}
+}
+
+
+/*
+ * GetStorageCache returns the storage state cached for the relation, reading
+ * the first extent block from the metapage the first time. Metapages of
+ * other versions are read as having no extents, and not cached, since the
+ * relation is only read to be upgraded then.
+ */
+static ColumnarStorageCache *
+GetStorageCache(Relation rel)
+{
+	ColumnarStorageCache *cache = (ColumnarStorageCache *) rel->rd_amcache;
+
+	if (unlikely(rel->rd_smgr == NULL))
+	{
+		smgrsetowner(&(rel->rd_smgr), smgropen(rel->rd_node, rel->rd_backend));
+	}
+
+	if (cache != NULL && RelFileNodeEquals(cache->node, rel->rd_node))
+	{
+		return cache;
+	}
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, true);
+	if (!ColumnarMetapageIsCurrent(&metapage))
+	{
+		return NULL;
+	}
+
+	if (cache == NULL)
+	{
+		cache = MemoryContextAlloc(CacheMemoryContext, sizeof(ColumnarStorageCache));
+		rel->rd_amcache = cache;
+	}
+
+	cache->node = rel->rd_node;
+	cache->firstExtentBlock = metapage.firstExtentBlock == 0 ? InvalidBlockNumber :
+							  (BlockNumber) metapage.firstExtentBlock;
+	cache->buffersFlushed = false;
+	cache->flushedTransaction = InvalidLocalTransactionId;
+
+	return cache;
+}
+
+
+/*
+ * FirstExtentBlock returns the first block of the relation that is written
+ * and read outside of shared buffers, or InvalidBlockNumber when there is
+ * none. During recovery, extents are read through shared buffers, because
+ * that is where redo restores their pages.
+ */
+static BlockNumber
+FirstExtentBlock(Relation rel)
+{
+	ColumnarStorageCache *cache = GetStorageCache(rel);
+
+	if (cache == NULL || RecoveryInProgress())
+	{
+		return InvalidBlockNumber;
+	}
+
+	return cache->firstExtentBlock;
+}
+
+
+/*
+ * PrepareExtentIO writes out the buffers of the relation that may be newer
+ * than its file before extents are accessed directly. Extents otherwise
+ * never get a buffer on a primary, but redo dirtied theirs until the first
+ * checkpoint after a promotion, and with wal_level = minimal, committing a
+ * relation created in the transaction may log its pages from shared buffers
+ * (see smgrDoPendingSyncs). The buffers left behind are clean, and never read
+ * again, so they do no harm.
+ */
+static void
+PrepareExtentIO(Relation rel, bool write)
+{
+	ColumnarStorageCache *cache = GetStorageCache(rel);
+	Assert(cache != NULL);
+
+	if (!cache->buffersFlushed)
+	{
+		if (!CheckpointedAfterRecovery())
+		{
+			FlushRelationBuffers(rel);
+		}
+
+		cache->buffersFlushed = true;
+	}
+
+	/* only writes can be overwritten by these buffers later */
+	if (write && !XLogIsNeeded() && cache->flushedTransaction != MyProc->lxid)
+	{
+		FlushRelationBuffers(rel);
+		cache->flushedTransaction = MyProc->lxid;
+	}
+}
+
+
+/*
+ * CheckpointedAfterRecovery returns whether a checkpoint has completed
+ * since WAL was last replayed, which wrote out all buffers redo dirtied.
+ * That is the case right away after crash recovery, and a while after a
+ * promotion.
+ */
+static bool
+CheckpointedAfterRecovery(void)
+{
+	if (checkpointedAfterRecovery)
+	{
+		return true;
+	}
+
+	bool crcOk = false;
+	ControlFileData *controlFile = get_controlfile(DataDir, &crcOk);
+
+	if (crcOk && controlFile->checkPointCopy.redo >= GetXLogReplayRecPtr(NULL))
+	{
+		checkpointedAfterRecovery = true;
+	}
+
+	pfree(controlFile);
+
+	return checkpointedAfterRecovery;
+}
+
+
+/*
+ * ExtentFileIO reads or writes the given blocks of the main fork of the
+ * relation with one I/O per segment file. The blocks must exist.
+ */
+static void
+ExtentFileIO(Relation rel, BlockNumber blockno, BlockNumber blockCount,
+			 char *buffer, bool write)
+{
+	char *relationPath = relpathbackend(rel->rd_node, rel->rd_backend, MAIN_FORKNUM);
+
+	while (blockCount > 0)
+	{
+		BlockNumber segmentNumber = blockno / ((BlockNumber) RELSEG_SIZE);
+		BlockNumber segmentBlock = blockno % ((BlockNumber) RELSEG_SIZE);
+		BlockNumber segmentBlockCount = Min(blockCount, RELSEG_SIZE - segmentBlock);
+
+		char *path = segmentNumber == 0 ? pstrdup(relationPath) :
+					 psprintf("%s.%u", relationPath, segmentNumber);
+
+		File file = PathNameOpenFile(path, (write ? O_RDWR : O_RDONLY) | PG_BINARY);
+		if (file < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\": %m", path)));
+		}
+
+		int length = segmentBlockCount * BLCKSZ;
+		off_t fileOffset = (off_t) segmentBlock * BLCKSZ;
+
+		if (write)
+		{
+			int bytesWritten = FileWrite(file, buffer, length, fileOffset,
+										 WAIT_EVENT_COLUMNAR_STORAGE_WRITE);
+			if (bytesWritten != length)
+			{
+				/* if write didn't set errno, assume problem is no disk space */
+				if (bytesWritten >= 0)
+				{
+					errno = ENOSPC;
+				}
+
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not write blocks %u..%u in file \"%s\": %m",
+									   segmentBlock, segmentBlock + segmentBlockCount - 1,
+									   path)));
+			}
+		}
+		else
+		{
+			int bytesRead = FileRead(file, buffer, length, fileOffset,
+									 WAIT_EVENT_COLUMNAR_STORAGE_READ);
+			if (bytesRead < 0)
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not read blocks %u..%u in file \"%s\": %m",
+									   segmentBlock, segmentBlock + segmentBlockCount - 1,
+									   path)));
+			}
+			else if (bytesRead != length)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("could not read blocks %u..%u in file \"%s\": "
+									   "read only %d of %d bytes",
+									   segmentBlock, segmentBlock + segmentBlockCount - 1,
+									   path, bytesRead, length)));
+			}
+		}
+
+		FileClose(file);
+		pfree(path);
+
+		blockno += segmentBlockCount;
+		blockCount -= segmentBlockCount;
+		buffer += length;
+	}
+
+	pfree(relationPath);
+}
+
+
+/*
+ * ReadFromExtents reads the given range, which is all in the extents, up to
+ * COLUMNAR_EXTENT_BLOCKS blocks at a time, and copies out the data of the
+ * pages after checking them like ReadBuffer and ReadFromBlock would.
+ */
+static void
+ReadFromExtents(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
+{
+	PrepareExtentIO(rel, false);
+
+	PhysicalAddr first = LogicalToPhysical(logicalOffset);
+	PhysicalAddr last = LogicalToPhysical(logicalOffset + amount - 1);
+	BlockNumber blockCount = Min(last.blockno - first.blockno + 1,
+								 COLUMNAR_EXTENT_BLOCKS);
+	char *pages = palloc(blockCount * BLCKSZ);
+	uint32 read = 0;
+
+	for (BlockNumber blockno = first.blockno; blockno <= last.blockno;
+		 blockno += blockCount)
+	{
+		blockCount = Min(last.blockno - blockno + 1, COLUMNAR_EXTENT_BLOCKS);
+		ExtentFileIO(rel, blockno, blockCount, pages, false);
+
+		read += CopyFromExtentPages(rel, pages, blockCount, logicalOffset + read,
+									data + read, amount - read);
+
+		/* charged like buffers that weren't in shared buffers */
+		if (VacuumCostActive)
+		{
+			VacuumCostBalance += VacuumCostPageMiss * blockCount;
+			vacuum_delay_point();
+		}
+	}
+
+	pfree(pages);
+}
+
+
+/*
+ * CopyFromExtentPages copies data starting at logicalOffset out of the given
+ * pages read from the extents, the first of which holds logicalOffset, after
+ * checking them like ReadBuffer and ReadFromBlock would. Copies at most
+ * amount bytes, and returns how many were copied.
+ */
+static uint32
+CopyFromExtentPages(Relation rel, char *pages, BlockNumber blockCount,
+					uint64 logicalOffset, char *data, uint32 amount)
+{
+	BlockNumber firstBlock PG_USED_FOR_ASSERTS_ONLY =
+		LogicalToPhysical(logicalOffset).blockno;
+	uint32 read = 0;
+
+	for (BlockNumber pageIndex = 0; pageIndex < blockCount && read < amount;
+		 pageIndex++)
+	{
+		Page page = pages + pageIndex * BLCKSZ;
+		PhysicalAddr addr = LogicalToPhysical(logicalOffset + read);
+		Assert(addr.blockno == firstBlock + pageIndex);
+
+		if (!PageIsVerifiedExtended(page, addr.blockno,
+									PIV_LOG_WARNING | PIV_REPORT_STAT))
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("invalid page in block %u of relation %s",
+								   addr.blockno, RelationGetRelationName(rel))));
+		}
+
+		uint32 to_read = Min(amount - read, BLCKSZ - addr.offset);
+		if (((PageHeader) page)->pd_lower < addr.offset + to_read)
+		{
+			elog(ERROR,
+				 "attempt to read columnar data of length %d from offset %d of block %d of relation %d",
+				 to_read, addr.offset, addr.blockno, rel->rd_id);
+		}
+
+		memcpy_s(data + read, amount - read, page + addr.offset, to_read);
+		read += to_read;
+	}
+
+	return read;
+}
+
+
+/*
+ * WriteToExtents writes the given range, which is all in the extents. The
+ * pages are put together in a private buffer the way WriteToBlock would,
+ * continuing a page that was partly written before, and written up to
+ * COLUMNAR_EXTENT_BLOCKS blocks at a time after their full page images are
+ * logged. A checkpoint may complete between logging a page and writing it,
+ * so the file is synced before commit, see ColumnarStorageSyncExtents.
+ */
+static void
+WriteToExtents(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
+{
+	PrepareExtentIO(rel, true);
+
+	PhysicalAddr first = LogicalToPhysical(logicalOffset);
+	PhysicalAddr last = LogicalToPhysical(logicalOffset + amount - 1);
+	BlockNumber blockCount = Min(last.blockno - first.blockno + 1,
+								 COLUMNAR_EXTENT_BLOCKS);
+	char *pages = palloc(blockCount * BLCKSZ);
+	uint64 written = 0;
+
+	RegisterExtentSync(rel);
+
+	for (BlockNumber blockno = first.blockno; blockno <= last.blockno;
+		 blockno += blockCount)
+	{
+		blockCount = Min(last.blockno - blockno + 1, COLUMNAR_EXTENT_BLOCKS);
+
+		for (BlockNumber pageIndex = 0; pageIndex < blockCount; pageIndex++)
+		{
+			Page page = pages + pageIndex * BLCKSZ;
+			PhysicalAddr addr = LogicalToPhysical(logicalOffset + written);
+			Assert(addr.blockno == blockno + pageIndex);
+
+			if (addr.offset == SizeOfPageHeaderData)
+			{
+				PageInit(page, BLCKSZ, 0);
+			}
+			else
+			{
+				ReadExtentPage(rel, addr.blockno, page);
+			}
+
+			PageHeader phdr = (PageHeader) page;
+			uint32 to_write = Min(amount - written, BLCKSZ - addr.offset);
+
+			if (phdr->pd_lower < addr.offset || phdr->pd_upper - addr.offset < to_write)
+			{
+				elog(ERROR,
+					 "attempt to write columnar data of length %d to offset %d of block %d of relation %d",
+					 to_write, addr.offset, addr.blockno, rel->rd_id);
+			}
+
+			/* as in WriteToBlock, this overwrites a rolled back write */
+			phdr->pd_lower = addr.offset;
+
+			memcpy_s(page + phdr->pd_lower, phdr->pd_upper - phdr->pd_lower,
+					 data + written, to_write);
+			phdr->pd_lower += to_write;
+			written += to_write;
+
+			if (RelationNeedsWAL(rel))
+			{
+				log_newpage(&rel->rd_node, MAIN_FORKNUM, addr.blockno, page, true);
+			}
+
+			PageSetChecksumInplace(page, addr.blockno);
+		}
+
+		ExtentFileIO(rel, blockno, blockCount, pages, true);
+
+		/* the next write of the stripe continues on the last page */
+		memcpy_s(extentTailPage.data, BLCKSZ, pages + (blockCount - 1) * BLCKSZ,
+				 BLCKSZ);
+		extentTailNode = rel->rd_node;
+		extentTailBlock = blockno + blockCount - 1;
+
+		if (VacuumCostActive)
+		{
+			VacuumCostBalance += VacuumCostPageDirty * blockCount;
+			vacuum_delay_point();
+		}
+	}
+
+	pfree(pages);
+}
+
+
+/*
+ * ReadExtentPage reads a page of the extents into the given page, from the
+ * copy of the last page written when that is the one.
+ */
+static void
+ReadExtentPage(Relation rel, BlockNumber blockno, Page page)
+{
+	if (extentTailBlock == blockno && RelFileNodeEquals(extentTailNode, rel->rd_node))
+	{
+		memcpy_s(page, BLCKSZ, extentTailPage.data, BLCKSZ);
+		return;
+	}
+
+	ExtentFileIO(rel, blockno, 1, page, false);
+
+	if (!PageIsVerifiedExtended(page, blockno, PIV_LOG_WARNING | PIV_REPORT_STAT))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("invalid page in block %u of relation %s",
+							   blockno, RelationGetRelationName(rel))));
+	}
+
+	/* a block added by ColumnarStorageReserveData and not written yet */
+	if (PageIsNew(page))
+	{
+		PageInit(page, BLCKSZ, 0);
+	}
+}
+
+
+/*
+ * RegisterExtentSync remembers that extents of the relation were written in
+ * this transaction. Only permanent relations are synced, as the others
+ * don't survive a crash anyway.
+ */
+static void
+RegisterExtentSync(Relation rel)
+{
+	if (rel->rd_rel->relpersistence != RELPERSISTENCE_PERMANENT)
+	{
+		return;
+	}
+
+	ListCell *nodeCell = NULL;
+	foreach(nodeCell, pendingExtentSyncs)
+	{
+		if (RelFileNodeEquals(*(RelFileNode *) lfirst(nodeCell), rel->rd_node))
+		{
+			return;
+		}
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	RelFileNode *node = palloc(sizeof(RelFileNode));
+	*node = rel->rd_node;
+	pendingExtentSyncs = lappend(pendingExtentSyncs, node);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarStorageSyncExtents syncs the files of the relations whose extents
+ * were written in this transaction, like the buffer manager would have done
+ * at the next checkpoint. Called before commit, after the last stripes of
+ * the transaction are flushed. Files of relations dropped in an aborted
+ * subtransaction are gone, and skipped.
+ */
+void
+ColumnarStorageSyncExtents(void)
+{
+	ListCell *nodeCell = NULL;
+	foreach(nodeCell, pendingExtentSyncs)
+	{
+		SMgrRelation srel = smgropen(*(RelFileNode *) lfirst(nodeCell),
+									 InvalidBackendId);
+
+		if (smgrexists(srel, MAIN_FORKNUM))
+		{
+			smgrimmedsync(srel, MAIN_FORKNUM);
+		}
+	}
+
+	pendingExtentSyncs = NIL;
+}
+
+
+/*
+ * ColumnarStorageForgetExtents forgets the extents written by a transaction
+ * that aborted, whose list went away with its memory.
+ */
+void
+ColumnarStorageForgetExtents(void)
+{
+	pendingExtentSyncs = NIL;
+}
+
+
+#ifdef HAVE_LIBURING
+
+/*
+ * SetUpExtentRing sets up the io_uring of the backend with
+ * columnar.io_uring_queue_depth entries, and returns whether it is usable.
+ * Kernels without io_uring, or where it is disabled, make the reads fall
+ * back to synchronous ones for the rest of the session.
+ */
+static bool
+SetUpExtentRing(void)
+{
+	if (extentRingDepth == columnar_io_uring_queue_depth)
+	{
+		return true;
+	}
+
+	if (extentRingDepth > 0)
+	{
+		io_uring_queue_exit(&extentRing);
+		extentRingDepth = 0;
+	}
+
+	int result = io_uring_queue_init(columnar_io_uring_queue_depth, &extentRing, 0);
+	if (result < 0)
+	{
+		ereport(DEBUG1, (errmsg("could not set up io_uring for columnar reads: %s",
+								strerror(-result))));
+		extentRingUnavailable = true;
+		return false;
+	}
+
+	extentRingDepth = columnar_io_uring_queue_depth;
+	return true;
+}
+
+
+/*
+ * ReadExtentRangesAsync reads the given ranges, which are all in the
+ * extents, through the io_uring of the backend.
+ *
+ * The kernel writes into the pages of a request until it completes, so no
+ * error may leave this function while requests are in flight. Errors of
+ * completed requests are thrown after waiting for the rest, and if io_uring
+ * itself fails with requests in flight, the backend exits instead.
+ */
+static void
+ReadExtentRangesAsync(Relation rel, ColumnarStorageRange **ranges, uint32 rangeCount)
+{
+	PrepareExtentIO(rel, false);
+
+	List *segmentFiles = NIL;
+	ExtentReadRequest *requests = NULL;
+	uint32 requestCount = PrepareExtentReadRequests(rel, ranges, rangeCount,
+													&segmentFiles, &requests);
+	volatile uint32 prepared = 0;
+	volatile uint32 submitted = 0;
+	volatile uint32 completed = 0;
+
+	PG_TRY();
+	{
+		while (completed < requestCount)
+		{
+			while (prepared < requestCount &&
+				   prepared - completed < (uint32) extentRingDepth)
+			{
+				struct io_uring_sqe *sqe = io_uring_get_sqe(&extentRing);
+				if (sqe == NULL)
+				{
+					break;
+				}
+
+				ExtentReadRequest *request = &requests[prepared++];
+				off_t fileOffset =
+					(off_t) (request->blockno % ((BlockNumber) RELSEG_SIZE)) * BLCKSZ;
+
+				request->pages = palloc(request->blockCount * BLCKSZ);
+				io_uring_prep_read(sqe, request->fd, request->pages,
+								   request->blockCount * BLCKSZ, fileOffset);
+				io_uring_sqe_set_data(sqe, request);
+			}
+
+			pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_STORAGE_READ);
+			int result = io_uring_submit_and_wait(&extentRing, 1);
+			pgstat_report_wait_end();
+
+			if (result >= 0)
+			{
+				submitted += result;
+			}
+			else if (result != -EINTR && result != -EAGAIN && result != -EBUSY)
+			{
+				ereport(FATAL, (errmsg("could not submit columnar reads to io_uring: %s",
+									   strerror(-result))));
+			}
+
+			/* completions come in any order */
+			struct io_uring_cqe *cqe = NULL;
+			while (io_uring_peek_cqe(&extentRing, &cqe) == 0)
+			{
+				ExtentReadRequest *request = io_uring_cqe_get_data(cqe);
+				int readResult = cqe->res;
+
+				io_uring_cqe_seen(&extentRing, cqe);
+				completed++;
+
+				CompleteExtentReadRequest(rel, request, readResult);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		/* wait for the requests still in flight before their pages go away */
+		while (completed < submitted)
+		{
+			struct io_uring_cqe *cqe = NULL;
+			int result = io_uring_wait_cqe(&extentRing, &cqe);
+
+			if (result == -EINTR)
+			{
+				continue;
+			}
+			else if (result < 0)
+			{
+				ereport(FATAL, (errmsg("could not wait for columnar reads on io_uring: %s",
+									   strerror(-result))));
+			}
+
+			io_uring_cqe_seen(&extentRing, cqe);
+			completed++;
+		}
+
+		/* requests that were never submitted would be by the next reads */
+		if (io_uring_sq_ready(&extentRing) > 0)
+		{
+			io_uring_queue_exit(&extentRing);
+			extentRingDepth = 0;
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	ListCell *segmentCell = NULL;
+	foreach(segmentCell, segmentFiles)
+	{
+		ExtentSegmentFile *segmentFile = lfirst(segmentCell);
+		CloseTransientFile(segmentFile->fd);
+	}
+
+	list_free_deep(segmentFiles);
+
+	/* charged like buffers that weren't in shared buffers */
+	if (VacuumCostActive)
+	{
+		for (uint32 requestIndex = 0; requestIndex < requestCount; requestIndex++)
+		{
+			VacuumCostBalance += VacuumCostPageMiss * requests[requestIndex].blockCount;
+		}
+
+		vacuum_delay_point();
+	}
+
+	pfree(requests);
+}
+
+
+/*
+ * PrepareExtentReadRequests splits the given ranges into reads of up to
+ * COLUMNAR_EXTENT_BLOCKS blocks of one segment file, opening the segment
+ * files the ranges are in. Returns the number of requests.
+ */
+static uint32
+PrepareExtentReadRequests(Relation rel, ColumnarStorageRange **ranges,
+						  uint32 rangeCount, List **segmentFiles,
+						  ExtentReadRequest **requests)
+{
+	char *relationPath = relpathbackend(rel->rd_node, rel->rd_backend, MAIN_FORKNUM);
+	uint32 requestCapacity = rangeCount;
+	uint32 requestCount = 0;
+
+	*requests = palloc(requestCapacity * sizeof(ExtentReadRequest));
+
+	for (uint32 rangeIndex = 0; rangeIndex < rangeCount; rangeIndex++)
+	{
+		ColumnarStorageRange *range = ranges[rangeIndex];
+		uint64 rangeEnd = range->logicalOffset + range->amount;
+		BlockNumber lastBlock = LogicalToPhysical(rangeEnd - 1).blockno;
+		uint64 logicalOffset = range->logicalOffset;
+
+		while (logicalOffset < rangeEnd)
+		{
+			BlockNumber blockno = LogicalToPhysical(logicalOffset).blockno;
+			BlockNumber segmentNumber = blockno / ((BlockNumber) RELSEG_SIZE);
+			BlockNumber segmentBlocksLeft = RELSEG_SIZE - blockno % ((BlockNumber) RELSEG_SIZE);
+			BlockNumber blockCount = Min(Min(lastBlock - blockno + 1, segmentBlocksLeft),
+										 COLUMNAR_EXTENT_BLOCKS);
+
+			PhysicalAddr nextAddr = { blockno + blockCount, SizeOfPageHeaderData };
+			uint64 requestEnd = Min(rangeEnd, PhysicalToLogical(nextAddr));
+
+			ExtentSegmentFile *segmentFile = NULL;
+			ListCell *segmentCell = NULL;
+			foreach(segmentCell, *segmentFiles)
+			{
+				ExtentSegmentFile *openFile = lfirst(segmentCell);
+				if (openFile->segmentNumber == segmentNumber)
+				{
+					segmentFile = openFile;
+					break;
+				}
+			}
+
+			if (segmentFile == NULL)
+			{
+				char *path = segmentNumber == 0 ? pstrdup(relationPath) :
+							 psprintf("%s.%u", relationPath, segmentNumber);
+
+				int fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+				if (fd < 0)
+				{
+					ereport(ERROR, (errcode_for_file_access(),
+									errmsg("could not open file \"%s\": %m", path)));
+				}
+
+				segmentFile = palloc(sizeof(ExtentSegmentFile));
+				segmentFile->segmentNumber = segmentNumber;
+				segmentFile->fd = fd;
+				*segmentFiles = lappend(*segmentFiles, segmentFile);
+				pfree(path);
+			}
+
+			if (requestCount == requestCapacity)
+			{
+				requestCapacity *= 2;
+				*requests = repalloc(*requests, requestCapacity * sizeof(ExtentReadRequest));
+			}
+
+			ExtentReadRequest *request = &(*requests)[requestCount++];
+			request->range = range;
+			request->rangeOffset = logicalOffset - range->logicalOffset;
+			request->amount = requestEnd - logicalOffset;
+			request->blockno = blockno;
+			request->blockCount = blockCount;
+			request->fd = segmentFile->fd;
+			request->pages = NULL;
+
+			logicalOffset = requestEnd;
+		}
+	}
+
+	pfree(relationPath);
+
+	return requestCount;
+}
+
+
+/*
+ * CompleteExtentReadRequest copies the data of a completed read into its
+ * range. result is that of the read, the number of bytes read or -errno.
+ * A short read is finished synchronously.
+ */
+static void
+CompleteExtentReadRequest(Relation rel, ExtentReadRequest *request, int result)
+{
+	int length = request->blockCount * BLCKSZ;
+	off_t fileOffset = (off_t) (request->blockno % ((BlockNumber) RELSEG_SIZE)) * BLCKSZ;
+
+	while (result >= 0 && result < length)
+	{
+		int bytesRead = pg_pread(request->fd, request->pages + result, length - result,
+								 fileOffset + result);
+		if (bytesRead <= 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("could not read blocks %u..%u of relation %s: "
+								   "read only %d of %d bytes",
+								   request->blockno,
+								   request->blockno + request->blockCount - 1,
+								   RelationGetRelationName(rel), result, length)));
+		}
+
+		result += bytesRead;
+	}
+
+	if (result < 0)
+	{
+		errno = -result;
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read blocks %u..%u of relation %s: %m",
+							   request->blockno, request->blockno + request->blockCount - 1,
+							   RelationGetRelationName(rel))));
+	}
+
+	ColumnarStorageRange *range = request->range;
+	CopyFromExtentPages(rel, request->pages, request->blockCount,
+						range->logicalOffset + request->rangeOffset,
+						range->data + request->rangeOffset, request->amount);
+
+	pfree(request->pages);
+	request->pages = NULL;
+}
+
+#endif
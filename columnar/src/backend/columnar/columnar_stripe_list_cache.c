@@ -0,0 +1,427 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_stripe_list_cache.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Backend local cache of the stripe count, data length, column count and
+ * row count of columnar tables, which the planner needs for every path it
+ * costs. Computing them takes a full scan of the stripes of the table in
+ * columnar.stripe, which dominates planning time on tables with many
+ * stripes.
+ *
+ * Entries are keyed by relation id and dropped by a relcache invalidation
+ * callback. Writing, moving or removing a stripe calls
+ * ColumnarInvalidateStripeListSummary, which queues a relcache invalidation
+ * of the table; like catalog changes, the invalidation reaches other
+ * backends when the transaction that wrote the stripe commits.
+ *
+ * Entries also keep the row number ranges of the stripes of the table that
+ * all transactions see, sorted by first row number, so index scans can find
+ * the stripe of a row number with a binary search rather than a scan of
+ * columnar.stripe per fetched tuple. They are built lazily, from a fresh
+ * snapshot so stripes that were removed before the build are left out
+ * whatever the isolation level. Only flushed stripes whose inserting
+ * transaction precedes the xmin horizon are kept: every snapshot sees
+ * them, and row numbers of stripes never overlap, so a cached stripe that
+ * holds a row number is what a scan of columnar.stripe would find. Lookups
+ * the ranges can't answer, as for rows of recent stripes, fall back to
+ * that scan.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "storage/procarray.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+typedef struct StripeListCacheEntry
+{
+	Oid relationId;
+
+	/* a new relfilenode has other stripes */
+	RelFileNode relfilenode;
+
+	bool summaryValid;
+	StripeListSummary summary;
+
+	/* stripes all transactions see by first row number, in CacheMemoryContext */
+	bool rowRangesValid;
+	uint32 rowRangeCount;
+	StripeMetadata *rowRanges;
+} StripeListCacheEntry;
+
+static HTAB *StripeListCacheMap = NULL;
+
+/* counts invalidations, so builds can tell whether one raced with them */
+static uint64 StripeListCacheInvalidations = 0;
+
+static void InitStripeListCache(void);
+static void InvalidateStripeListCache(Datum argument, Oid relationId);
+static StripeListCacheEntry * StripeListCacheEntryForRelation(Relation relation,
+															  bool create);
+static StripeListSummary ComputeStripeListSummary(Relation relation);
+static StripeListCacheEntry * StripeRowRangesForRelation(Relation relation);
+static int64 StripeRowRangeIndex(StripeListCacheEntry *entry, uint64 rowNumber);
+static StripeMetadata * CopyStripeMetadata(StripeMetadata *stripeMetadata);
+
+
+/*
+ * InitStripeListCache creates the hash table of the cache if it doesn't
+ * exist, and registers its invalidation callback the first time.
+ */
+static void
+InitStripeListCache(void)
+{
+	static bool invalidationCallbackRegistered = false;
+
+	if (StripeListCacheMap != NULL)
+	{
+		return;
+	}
+
+	if (!invalidationCallbackRegistered)
+	{
+		CacheRegisterRelcacheCallback(InvalidateStripeListCache, (Datum) 0);
+		invalidationCallbackRegistered = true;
+	}
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(StripeListCacheEntry);
+	info.hcxt = CacheMemoryContext;
+
+	StripeListCacheMap = hash_create("columnar stripe list cache", 64, &info,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+
+/*
+ * InvalidateStripeListCache drops the entry of the given relation, or all
+ * entries if relationId is InvalidOid.
+ */
+static void
+InvalidateStripeListCache(Datum argument, Oid relationId)
+{
+	StripeListCacheInvalidations++;
+
+	if (StripeListCacheMap == NULL)
+	{
+		return;
+	}
+
+	if (relationId == InvalidOid)
+	{
+		HASH_SEQ_STATUS status;
+		hash_seq_init(&status, StripeListCacheMap);
+
+		StripeListCacheEntry *entry = NULL;
+		while ((entry = hash_seq_search(&status)) != NULL)
+		{
+			if (entry->rowRanges != NULL)
+			{
+				pfree(entry->rowRanges);
+			}
+		}
+
+		hash_destroy(StripeListCacheMap);
+		StripeListCacheMap = NULL;
+		return;
+	}
+
+	StripeListCacheEntry *entry = hash_search(StripeListCacheMap, &relationId,
+											  HASH_FIND, NULL);
+	if (entry != NULL && entry->rowRanges != NULL)
+	{
+		pfree(entry->rowRanges);
+	}
+
+	hash_search(StripeListCacheMap, &relationId, HASH_REMOVE, NULL);
+}
+
+
+/*
+ * StripeListCacheEntryForRelation returns the cache entry of the given
+ * relation, or NULL if there is none and create is false. Entries of an
+ * older relfilenode are emptied.
+ */
+static StripeListCacheEntry *
+StripeListCacheEntryForRelation(Relation relation, bool create)
+{
+	Oid relationId = RelationGetRelid(relation);
+
+	InitStripeListCache();
+
+	bool found = false;
+	StripeListCacheEntry *entry = hash_search(StripeListCacheMap, &relationId,
+											  create ? HASH_ENTER : HASH_FIND,
+											  &found);
+	if (!found)
+	{
+		if (entry != NULL)
+		{
+			entry->relfilenode = relation->rd_node;
+			entry->summaryValid = false;
+			entry->rowRangesValid = false;
+			entry->rowRangeCount = 0;
+			entry->rowRanges = NULL;
+		}
+
+		return entry;
+	}
+
+	if (!RelFileNodeEquals(entry->relfilenode, relation->rd_node))
+	{
+		entry->relfilenode = relation->rd_node;
+		entry->summaryValid = false;
+		entry->rowRangesValid = false;
+		entry->rowRangeCount = 0;
+		if (entry->rowRanges != NULL)
+		{
+			pfree(entry->rowRanges);
+			entry->rowRanges = NULL;
+		}
+	}
+
+	return entry;
+}
+
+
+/*
+ * StripeListSummaryForRelation returns the summary of the stripes of the
+ * given relation, from the cache when possible.
+ *
+ * Transactions that use a single snapshot don't cache what they compute, as
+ * their snapshot may predate stripes whose invalidation was already
+ * processed.
+ */
+StripeListSummary
+StripeListSummaryForRelation(Relation relation)
+{
+	StripeListCacheEntry *entry = StripeListCacheEntryForRelation(relation, false);
+	if (entry != NULL && entry->summaryValid)
+	{
+		return entry->summary;
+	}
+
+	StripeListSummary summary = ComputeStripeListSummary(relation);
+
+	if (!IsolationUsesXactSnapshot())
+	{
+		entry = StripeListCacheEntryForRelation(relation, true);
+		entry->summary = summary;
+		entry->summaryValid = true;
+	}
+
+	return summary;
+}
+
+
+/*
+ * CachedStripeContainingRowNumber returns a copy of the stripe that holds the
+ * given row number if it is one of the stripes all transactions see, or NULL
+ * if the caller needs to look it up in columnar.stripe.
+ */
+StripeMetadata *
+CachedStripeContainingRowNumber(Relation relation, uint64 rowNumber)
+{
+	StripeListCacheEntry *entry = StripeRowRangesForRelation(relation);
+
+	int64 rangeIndex = StripeRowRangeIndex(entry, rowNumber);
+	if (rangeIndex < 0 ||
+		rowNumber > StripeGetHighestRowNumber(&entry->rowRanges[rangeIndex]))
+	{
+		return NULL;
+	}
+
+	return CopyStripeMetadata(&entry->rowRanges[rangeIndex]);
+}
+
+
+/*
+ * CachedStripeFollowingRowNumber returns a copy of the stripe with the lowest
+ * first row number greater than the given row number, or NULL if the caller
+ * needs to look it up in columnar.stripe. That is only known when the row
+ * number is in a cached stripe whose last row number is followed by the
+ * first one of the next cached stripe, since stripes the cache doesn't have
+ * may lie in any gap.
+ */
+StripeMetadata *
+CachedStripeFollowingRowNumber(Relation relation, uint64 rowNumber)
+{
+	StripeListCacheEntry *entry = StripeRowRangesForRelation(relation);
+
+	int64 rangeIndex = StripeRowRangeIndex(entry, rowNumber);
+	if (rangeIndex < 0 || rangeIndex + 1 >= entry->rowRangeCount)
+	{
+		return NULL;
+	}
+
+	StripeMetadata *stripeMetadata = &entry->rowRanges[rangeIndex];
+	StripeMetadata *nextStripeMetadata = &entry->rowRanges[rangeIndex + 1];
+	if (rowNumber > StripeGetHighestRowNumber(stripeMetadata) ||
+		StripeGetHighestRowNumber(stripeMetadata) + 1 !=
+		nextStripeMetadata->firstRowNumber)
+	{
+		return NULL;
+	}
+
+	return CopyStripeMetadata(nextStripeMetadata);
+}
+
+
+/*
+ * ColumnarInvalidateStripeListSummary makes all backends recompute the
+ * stripe list summary of the given relation once the current transaction
+ * commits, and this backend at its next command.
+ */
+void
+ColumnarInvalidateStripeListSummary(Relation relation)
+{
+	CacheInvalidateRelcache(relation);
+}
+
+
+/*
+ * ComputeStripeListSummary reads the stripes of the given relation and
+ * summarizes them.
+ */
+static StripeListSummary
+ComputeStripeListSummary(Relation relation)
+{
+	StripeListSummary summary = { 0 };
+
+	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		summary.stripeCount++;
+		summary.totalDataLength += stripeMetadata->dataLength;
+		summary.rowCount += stripeMetadata->rowCount;
+		summary.maxColumnCount = Max(summary.maxColumnCount,
+									 stripeMetadata->columnCount);
+
+		if (stripeMetadata->bucket >= 0)
+		{
+			summary.bucketedRowCount += stripeMetadata->rowCount;
+		}
+	}
+
+	list_free_deep(stripeList);
+
+	return summary;
+}
+
+
+/*
+ * StripeRowRangesForRelation returns the cache entry of the given relation
+ * with its row ranges built, or with none if an invalidation came in while
+ * building them.
+ */
+static StripeListCacheEntry *
+StripeRowRangesForRelation(Relation relation)
+{
+	StripeListCacheEntry *entry = StripeListCacheEntryForRelation(relation, true);
+	if (entry->rowRangesValid)
+	{
+		return entry;
+	}
+
+	uint64 invalidations = StripeListCacheInvalidations;
+	TransactionId oldestXmin =
+		GetOldestNonRemovableTransactionId_compat(relation, PROCARRAY_FLAGS_VACUUM);
+
+	Snapshot snapshot = RegisterSnapshot(GetLatestSnapshot());
+	List *stripeList = StripesForSnapshot(relation, snapshot);
+	UnregisterSnapshot(snapshot);
+
+	StripeMetadata *rowRanges =
+		MemoryContextAlloc(CacheMemoryContext,
+						   Max(list_length(stripeList), 1) * sizeof(StripeMetadata));
+	uint32 rowRangeCount = 0;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (StripeVisibleToAll(stripeMetadata, oldestXmin))
+		{
+			rowRanges[rowRangeCount++] = *stripeMetadata;
+		}
+	}
+
+	list_free_deep(stripeList);
+
+	/*
+	 * Reading the stripes may have processed invalidations, which may have
+	 * removed the entry or be about stripes our snapshot predates. Leave the
+	 * ranges empty for now then, so lookups fall back to columnar.stripe.
+	 */
+	entry = StripeListCacheEntryForRelation(relation, true);
+	if (invalidations != StripeListCacheInvalidations)
+	{
+		pfree(rowRanges);
+		return entry;
+	}
+
+	entry->rowRanges = rowRanges;
+	entry->rowRangeCount = rowRangeCount;
+	entry->rowRangesValid = true;
+
+	return entry;
+}
+
+
+/*
+ * StripeRowRangeIndex returns the index of the cached stripe with the
+ * greatest first row number that is less than or equal to the given row
+ * number, or -1 if there is none.
+ */
+static int64
+StripeRowRangeIndex(StripeListCacheEntry *entry, uint64 rowNumber)
+{
+	int64 low = 0;
+	int64 high = (int64) entry->rowRangeCount - 1;
+	int64 foundIndex = -1;
+
+	while (low <= high)
+	{
+		int64 middle = low + (high - low) / 2;
+		if (entry->rowRanges[middle].firstRowNumber <= rowNumber)
+		{
+			foundIndex = middle;
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+
+	return foundIndex;
+}
+
+
+/*
+ * CopyStripeMetadata returns a copy of the given cached stripe in the current
+ * memory context, which callers may free or keep past an invalidation.
+ */
+static StripeMetadata *
+CopyStripeMetadata(StripeMetadata *stripeMetadata)
+{
+	StripeMetadata *copy = palloc(sizeof(StripeMetadata));
+	*copy = *stripeMetadata;
+
+	return copy;
+}
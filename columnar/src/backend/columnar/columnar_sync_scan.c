@@ -0,0 +1,270 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_sync_scan.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Synchronized sequential scans of columnar tables, like the ones of heap
+ * tables in access/common/syncscan.c, but at stripe granularity.
+ *
+ * Serial scans of a large table report the first row number of each stripe
+ * they start reading to a small table of locations in shared memory, keyed
+ * by the table and the columns the scan reads. A scan of the same columns
+ * that starts while another one is in progress starts at the stripe that
+ * scan reported, reads to the end of the table, then wraps around to the
+ * stripes before it. The scans then read the same stripes at about the same
+ * time, so the chunks the first one loads and decompresses into the shared
+ * column cache are still there when the others get to them, and backends
+ * that miss a chunk another one is decompressing wait for it instead of
+ * decompressing it again, see columnar_shared_cache.c.
+ *
+ * As with heap, the table only remembers the most recently reported scans,
+ * and a location that is stale only costs the scan that uses it a start
+ * somewhere else in the table.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/rel.h"
+#include "utils/timestamp.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/columnar_version_compat.h"
+
+/* like SYNC_SCAN_NELEM of heap, scans of more tables at once evict each other */
+#define SYNC_SCAN_LOCATION_COUNT 32
+
+typedef struct SyncScanKey
+{
+	RelFileNode relfilenode;
+	uint32 columnsHash;
+} SyncScanKey;
+
+typedef struct SyncScanLocation
+{
+	SyncScanKey key;
+
+	/* first row number of the stripe the scan reported last, 0 if unused */
+	uint64 rowNumber;
+	TimestampTz reportTime;
+} SyncScanLocation;
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+static shmem_request_hook_type PreviousShmemRequestHook = NULL;
+#endif
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
+/* lock of SyncScanLocations, in shared memory */
+static LWLock *SyncScanLock = NULL;
+static SyncScanLocation *SyncScanLocations = NULL;
+
+static void ColumnarSyncScanShmemRequest(void);
+static void ColumnarSyncScanShmemStartup(void);
+static void InitSyncScanKey(SyncScanKey *key, Relation relation, uint32 columnsHash);
+static SyncScanLocation * FindSyncScanLocation(SyncScanKey *key);
+
+
+/*
+ * ColumnarSyncScanInit installs the hooks that set up the table of scan
+ * locations. Expected to be called from _PG_init.
+ */
+void
+ColumnarSyncScanInit(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+	{
+		return;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+	PreviousShmemRequestHook = shmem_request_hook;
+	shmem_request_hook = ColumnarSyncScanShmemRequest;
+#else
+	ColumnarSyncScanShmemRequest();
+#endif
+
+	PreviousShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = ColumnarSyncScanShmemStartup;
+}
+
+
+/*
+ * ColumnarSyncScanShmemRequest requests the shared memory and the lock used
+ * by the table of scan locations.
+ */
+static void
+ColumnarSyncScanShmemRequest(void)
+{
+#if PG_VERSION_NUM >= PG_VERSION_15
+	if (PreviousShmemRequestHook)
+	{
+		PreviousShmemRequestHook();
+	}
+#endif
+
+	RequestAddinShmemSpace(sizeof(SyncScanLocation) * SYNC_SCAN_LOCATION_COUNT);
+	RequestNamedLWLockTranche("columnar_sync_scan", 1);
+}
+
+
+/*
+ * ColumnarSyncScanShmemStartup creates or attaches to the table of scan
+ * locations.
+ */
+static void
+ColumnarSyncScanShmemStartup(void)
+{
+	if (PreviousShmemStartupHook)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SyncScanLock = &(GetNamedLWLockTranche("columnar_sync_scan"))->lock;
+
+	bool found = false;
+	SyncScanLocations = ShmemInitStruct("columnar sync scan locations",
+										sizeof(SyncScanLocation) *
+										SYNC_SCAN_LOCATION_COUNT,
+										&found);
+	if (!found)
+	{
+		memset(SyncScanLocations, 0,
+			   sizeof(SyncScanLocation) * SYNC_SCAN_LOCATION_COUNT);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * ColumnarSyncScanEnabled returns whether scans can be synchronized, which
+ * needs columnar to be loaded via shared_preload_libraries.
+ */
+bool
+ColumnarSyncScanEnabled(void)
+{
+	return SyncScanLocations != NULL;
+}
+
+
+static void
+InitSyncScanKey(SyncScanKey *key, Relation relation, uint32 columnsHash)
+{
+	/* zero the padding, since keys are compared with memcmp */
+	memset(key, 0, sizeof(SyncScanKey));
+	key->relfilenode = relation->rd_node;
+	key->columnsHash = columnsHash;
+}
+
+
+/*
+ * FindSyncScanLocation returns the location of the scans with the given key,
+ * or NULL if there is none. The caller holds SyncScanLock.
+ */
+static SyncScanLocation *
+FindSyncScanLocation(SyncScanKey *key)
+{
+	for (int i = 0; i < SYNC_SCAN_LOCATION_COUNT; i++)
+	{
+		SyncScanLocation *location = &SyncScanLocations[i];
+
+		if (location->rowNumber != COLUMNAR_INVALID_ROW_NUMBER &&
+			memcmp(&location->key, key, sizeof(SyncScanKey)) == 0)
+		{
+			return location;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ColumnarSyncScanGetLocation returns the first row number of the stripe a
+ * scan of the given columns of the relation last reported, or
+ * COLUMNAR_INVALID_ROW_NUMBER if no such scan did.
+ */
+uint64
+ColumnarSyncScanGetLocation(Relation relation, uint32 columnsHash)
+{
+	SyncScanKey key;
+	uint64 rowNumber = COLUMNAR_INVALID_ROW_NUMBER;
+
+	if (SyncScanLocations == NULL)
+	{
+		return rowNumber;
+	}
+
+	InitSyncScanKey(&key, relation, columnsHash);
+
+	LWLockAcquire(SyncScanLock, LW_SHARED);
+
+	SyncScanLocation *location = FindSyncScanLocation(&key);
+	if (location != NULL)
+	{
+		rowNumber = location->rowNumber;
+	}
+
+	LWLockRelease(SyncScanLock);
+
+	return rowNumber;
+}
+
+
+/*
+ * ColumnarSyncScanReportLocation records that a scan of the given columns of
+ * the relation starts reading the stripe with the given first row number.
+ * Scans of other tables whose locations were reported least recently are
+ * forgotten to make room.
+ */
+void
+ColumnarSyncScanReportLocation(Relation relation, uint32 columnsHash,
+							   uint64 rowNumber)
+{
+	SyncScanKey key;
+
+	if (SyncScanLocations == NULL)
+	{
+		return;
+	}
+
+	InitSyncScanKey(&key, relation, columnsHash);
+
+	LWLockAcquire(SyncScanLock, LW_EXCLUSIVE);
+
+	SyncScanLocation *location = FindSyncScanLocation(&key);
+	if (location == NULL)
+	{
+		/* take an unused location, or the one reported least recently */
+		location = &SyncScanLocations[0];
+		for (int i = 1; i < SYNC_SCAN_LOCATION_COUNT; i++)
+		{
+			if (location->rowNumber == COLUMNAR_INVALID_ROW_NUMBER)
+			{
+				break;
+			}
+
+			if (SyncScanLocations[i].rowNumber == COLUMNAR_INVALID_ROW_NUMBER ||
+				SyncScanLocations[i].reportTime < location->reportTime)
+			{
+				location = &SyncScanLocations[i];
+			}
+		}
+
+		location->key = key;
+	}
+
+	location->rowNumber = rowNumber;
+	location->reportTime = GetCurrentTimestamp();
+
+	LWLockRelease(SyncScanLock);
+}
@@ -28,6 +28,7 @@
 #include "catalog/pg_am.h"
 #include "catalog/pg_publication.h"
 #include "catalog/pg_trigger.h"
+#include "catalog/pg_type.h"
 #include "catalog/pg_extension.h"
 #include "catalog/storage.h"
 #include "catalog/storage_xlog.h"
@@ -39,8 +40,10 @@
 #include "funcapi.h"
 #include "nodes/makefuncs.h"
 #include "nodes/pg_list.h"
+#include "nodes/tidbitmap.h"
 #include "optimizer/plancat.h"
 #include "pgstat.h"
+#include "postmaster/autovacuum.h"
 #include "safe_lib.h"
 #include "storage/bufmgr.h"
 #include "storage/bufpage.h"
@@ -51,14 +54,18 @@
 #include "storage/procarray.h"
 #include "storage/smgr.h"
 #include "tcop/utility.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/memutils.h"
 #include "utils/pg_rusage.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
+#include "utils/sampling.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
+#include "utils/tuplestore.h"
+#include "utils/typcache.h"
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
 #include "columnar/columnar_metadata.h"
@@ -78,6 +85,82 @@
 #define VACUUM_TRUNCATE_LOCK_WAIT_INTERVAL 50       /* ms */
 #define VACUUM_TRUNCATE_LOCK_TIMEOUT 4500               /* ms */
 
+/*
+ * Number of rows ANALYZE samples per chunk group it decodes. Decoding fewer
+ * chunk groups makes the sample less random, as rows of a chunk group were
+ * usually written together.
+ */
+#define ANALYZE_SAMPLE_ROWS_PER_CHUNK_GROUP 100
+
+/*
+ * Parallel table scans, which parallel index builds read the table with,
+ * keep the shared state of the columnar reader after the descriptor of
+ * postgres, followed by the snapshot that postgres serializes.
+ */
+#define COLUMNAR_PARALLEL_SCAN_OFFSET MAXALIGN(sizeof(ParallelTableScanDescData))
+#define ParallelTableScanColumnarScan(pscan) \
+	((ParallelColumnarScan) ((char *) (pscan) + COLUMNAR_PARALLEL_SCAN_OFFSET))
+
+/*
+ * Stripes per parallel worker that columnar.vacuum and VACUUM FULL decode
+ * before the leader writes them.
+ */
+#define VACUUM_PARALLEL_BATCH_FACTOR 4
+
+/*
+ * ColumnarSampleState is the state of the sampling of a columnar table by
+ * ANALYZE or TABLESAMPLE, which sample blocks. Both sample the chunk groups
+ * of the table instead, followed by its delta store as one last chunk group.
+ * ANALYZE spreads them evenly over the blocks of the table, see
+ * columnar_scan_analyze_next_block(), and TABLESAMPLE samples them as if they
+ * were blocks, see columnar_scan_sample_next_block().
+ */
+typedef struct ColumnarSampleState
+{
+	/* flushed stripes of the table, and the index of their first chunk group */
+	StripeMetadata **stripes;
+	uint64 *stripeFirstChunkGroup;
+	int stripeCount;
+
+	/* chunk groups of the stripes, and the delta store */
+	uint64 chunkGroupCount;
+	BlockNumber blockCount;
+
+	/* probability that a chunk group of a sampled block is decoded by ANALYZE */
+	double decodeFraction;
+
+	/*
+	 * Next chunk group of the block sampled by ANALYZE, and the first of the
+	 * next block. TABLESAMPLE methods that don't choose blocks themselves
+	 * read the chunk groups from nextChunkGroup in order.
+	 */
+	uint64 nextChunkGroup;
+	uint64 endChunkGroup;
+
+	/* the chunk group being decoded, and how many rows it has and returned */
+	bool chunkGroupReadInProgress;
+	bool deltaStoreReadInProgress;
+	uint32 chunkGroupRowCount;
+	uint32 chunkGroupRowsRead;
+
+	/* row counts of the chunk groups of the stripe that was looked up last */
+	int countedStripeIndex;
+	uint32 *chunkGroupRowCounts;
+	uint32 *chunkGroupDeletedRows;
+
+	/*
+	 * TABLESAMPLE methods choose the rows to return by their item pointer.
+	 * sampleBlock is the block of the item pointers of the rows just read,
+	 * sampleMaxOffset the last offset in it that the chunk group being read
+	 * can have, and sampledOffset the next offset the method chose, which is
+	 * InvalidOffsetNumber once it chose all of them.
+	 */
+	uint64 chunkGroupLastRowNumber;
+	BlockNumber sampleBlock;
+	OffsetNumber sampleMaxOffset;
+	OffsetNumber sampledOffset;
+} ColumnarSampleState;
+
 /*
  * ColumnarScanDescData is the scan state passed between beginscan(),
  * getnextslot(), rescan(), and endscan() calls.
@@ -100,6 +183,52 @@ typedef struct ColumnarScanDescData
 
 	/* Vectorization */
 	bool returnVectorizedTuple;
+
+	/* vector quals to pass to cs_readState, see ColumnarScanSetVectorQual() */
+	List *vectorQualStageColumnLists;
+	ColumnarVectorQualFunc vectorQualFunc;
+	void *vectorQualState;
+
+	/* row bound to pass to cs_readState, see ColumnarScanSetRowBound() */
+	uint64 rowBound;
+
+	/* summary to pass to cs_readState, see ColumnarScanSetChunkGroupSummary() */
+	ChunkGroupSummary *chunkGroupSummary;
+
+	/* delete to pass to cs_readState, see ColumnarScanSetChunkGroupDelete() */
+	ColumnarChunkGroupDelete *chunkGroupDelete;
+
+	/* summary to pass to cs_readState, see ColumnarScanSetStripeProjectionSummary() */
+	StripeProjectionSummary *projectionSummary;
+
+	/* bound to pass to cs_readState, see ColumnarScanSetTopNBound() */
+	ColumnarTopNBound *topNBound;
+
+	/* filter to pass to cs_readState, see ColumnarScanSetJoinKeyFilter() */
+	ColumnarJoinKeyFilter *joinKeyFilter;
+
+	/* quals to add to scanQual until the next rescan, see ColumnarScanAddQual() */
+	List *addedQual;
+
+	/* sampling state of ANALYZE and TABLESAMPLE, see ColumnarSampleState */
+	ColumnarSampleState *sampleState;
+
+	/*
+	 * Scans in the order of the sort key read the rows with mergeReadState
+	 * instead of cs_readState, see ColumnarScanSetMergeRead().
+	 */
+	AttrNumber mergeSortKeyColumn;
+	ColumnarMergeReadState *mergeReadState;
+
+	/*
+	 * Bitmap heap scans read the rows of each block of the bitmap, in row
+	 * number order, with bitmapReadState, see columnar_scan_bitmap_next_block().
+	 * bitmapRowNumbers has room for the rows of one block.
+	 */
+	ColumnarReadState *bitmapReadState;
+	uint64 *bitmapRowNumbers;
+	uint32 bitmapRowCount;
+	bool bitmapRowsPending;
 } ColumnarScanDescData;
 
 
@@ -121,6 +250,37 @@ typedef struct IndexFetchColumnarData
 	MemoryContext scanContext;
 } IndexFetchColumnarData;
 
+/*
+ * IndexFetchProjection records the columns the executor needs from the rows
+ * that an index or bitmap heap scan fetches into the given slot, see
+ * ColumnarSetIndexFetchProjection.
+ */
+typedef struct IndexFetchProjection
+{
+	TupleTableSlot *slot;
+	Bitmapset *attrNeeded;
+	MemoryContextCallback resetCallback;
+} IndexFetchProjection;
+
+/* projections of the running queries, each allocated in its query context */
+static List *IndexFetchProjectionList = NIL;
+
+/*
+ * UpdateFetchProjection records the columns an UPDATE needs from the old rows
+ * it fetches to form the new rows of the given result relation, see
+ * ColumnarSetUpdateFetchProjection. The executor creates the slot of the old
+ * rows only once it updates the first row, so we match the result relation.
+ */
+typedef struct UpdateFetchProjection
+{
+	ResultRelInfo *resultRelInfo;
+	Bitmapset *attrNeeded;
+	MemoryContextCallback resetCallback;
+} UpdateFetchProjection;
+
+/* like IndexFetchProjectionList */
+static List *UpdateFetchProjectionList = NIL;
+
 /* available to other extensions using find_rendezvous_variable() */
 static ColumnarTableSetOptions_hook_type ColumnarTableSetOptions_hook = NULL;
 
@@ -148,14 +308,42 @@ static bool ConditionalLockRelationWithTimeout(Relation rel, LOCKMODE lockMode,
 											   int timeout, int retryInterval,
 											   bool acquire);
 static List * NeededColumnsList(TupleDesc tupdesc, Bitmapset *attr_needed);
+static bool ColumnarMergeGetNextSlot(ColumnarScanDesc scan, TupleTableSlot *slot);
+static void IndexFetchProjectionReset(void *arg);
+static bool IndexFetchProjectionForSlot(TupleTableSlot *slot, Bitmapset **attrNeeded);
+static void UpdateFetchProjectionReset(void *arg);
+static bool UpdateFetchProjectionForSlot(TupleTableSlot *slot, Bitmapset **attrNeeded);
+static double CopyStripesInParallel(Relation rel, List *stripeList,
+									ColumnarWriteState *writeState,
+									int parallelWorkers);
+static double CopyStripeRows(Relation rel, StripeMetadata *stripeMetadata,
+							 ColumnarWriteState *writeState);
+static double WriteTuplestoreRows(Tuplestorestate *rows, TupleDesc tupleDesc,
+								  ColumnarWriteState *writeState);
 static void LogRelationStats(Relation rel, int elevel);
 static void TruncateColumnar(Relation rel, int elevel);
 static bool TruncateAndCombineColumnarStripes(Relation rel, int elevel);
+static void ClearVacuumStatusFlags(void);
+static Datum CombineColumnarTableStripes(PG_FUNCTION_ARGS);
 static HeapTuple ColumnarSlotCopyHeapTuple(TupleTableSlot *slot);
-static void ColumnarCheckLogicalReplication(Relation rel);
+static void ColumnarMultiInsertCheckConstraints(Relation relation, TupleTableSlot **slots,
+												int ntuples);
+static void ColumnarKeepRowNumbersIfIndexed(Relation relation,
+										  ColumnarWriteState *writeState);
+static ColumnarReadState * ColumnarLockReadState(Relation relation);
+static void ColumnarReadRowForChange(Relation relation, uint64 rowNumber,
+									 Datum **values, bool **nulls);
 static Datum * detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull);
 static uint64 tid_to_row_number(ItemPointerData tid);
 static void ErrorIfInvalidRowNumber(uint64 rowNumber);
+static ColumnarShreddedKey * ParseShreddedKeyOption(Relation rel, char *optionString);
+static void ResetRelationBuckets(Relation rel);
+static ColumnCompressionOption * ParseColumnCompressionOption(Relation rel,
+															  char *optionString);
+static uint32 CollectCompressionDictionarySamples(Relation rel, AttrNumber attnum,
+												  uint64 maximumSampleBytes,
+												  StringInfo samples,
+												  size_t **sampleSizes);
 static void ColumnarReportTotalVirtualBlocks(Relation relation, Snapshot snapshot,
 											 int progressArrIndex);
 static BlockNumber ColumnarGetNumberOfVirtualBlocks(Relation relation, Snapshot snapshot);
@@ -174,6 +362,20 @@ static void ColumnarReadMissingRowsIntoIndex(TableScanDesc scan, Relation indexR
 											 ValidateIndexState *state);
 static ItemPointerData TupleSortSkipSmallerItemPointers(Tuplesortstate *tupleSort,
 														ItemPointer targetItemPointer);
+static ColumnarSampleState * BeginColumnarSample(ColumnarScanDesc scan);
+static double ColumnarAnalyzeDecodeFraction(Relation relation, uint64 chunkGroupCount,
+											BlockNumber blockCount);
+static uint64 ColumnarAnalyzeBlockFirstChunkGroup(ColumnarSampleState *sample,
+												  BlockNumber blockno);
+static void ColumnarSampleBeginChunkGroup(ColumnarScanDesc scan, uint64 chunkGroup);
+static bool ColumnarSampleNextRow(ColumnarScanDesc scan, TupleTableSlot *slot,
+								  uint64 *rowNumber);
+static void ColumnarSampleEndTupleBlock(ColumnarSampleState *sample,
+										SampleScanState *scanstate);
+static int ColumnarSampleStripeIndex(ColumnarSampleState *sample,
+									  uint64 chunkGroup);
+static bool ColumnarAnalyzeNextChunkGroup(ColumnarScanDesc scan,
+										  double *liverows, double *deadrows);
 
 
 /* Custom tuple slot ops used for columnar. Initialized in columnar_tableam_init(). */
@@ -202,10 +404,16 @@ columnar_beginscan(Relation relation, Snapshot snapshot,
 	/* attr_needed represents 0-indexed attribute numbers */
 	Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
 
+	ParallelColumnarScan parallelColumnarScan = NULL;
+	if (parallel_scan != NULL)
+	{
+		parallelColumnarScan = ParallelTableScanColumnarScan(parallel_scan);
+	}
+
 	TableScanDesc scandesc = columnar_beginscan_extended(relation, snapshot, nkeys, key,
 														 parallel_scan,
 														 flags, attr_needed, NULL,
-														 NULL,
+														 parallelColumnarScan,
 														 false);
 
 	bms_free(attr_needed);
@@ -318,6 +526,18 @@ columnar_endscan(TableScanDesc sscan)
 		scan->cs_readState = NULL;
 	}
 
+	if (scan->mergeReadState != NULL)
+	{
+		ColumnarEndMergeRead(scan->mergeReadState);
+		scan->mergeReadState = NULL;
+	}
+
+	if (scan->bitmapReadState != NULL)
+	{
+		ColumnarEndRead(scan->bitmapReadState);
+		scan->bitmapReadState = NULL;
+	}
+
 	if (scan->cs_base.rs_flags & SO_TEMP_SNAPSHOT)
 	{
 		UnregisterSnapshot(scan->cs_base.rs_snapshot);
@@ -342,10 +562,24 @@ columnar_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
 	/* XXX: hack to pass in new quals that aren't actually scan keys */
 	List *scanQual = (List *) key;
 
+	/* quals added during the previous scan don't apply to the new one */
+	scan->addedQual = NIL;
+
 	if (scan->cs_readState != NULL)
 	{
 		ColumnarRescan(scan->cs_readState, scanQual);
 	}
+
+	if (scan->mergeReadState != NULL)
+	{
+		ColumnarMergeRescan(scan->mergeReadState, scanQual);
+	}
+
+	if (scan->sampleState != NULL)
+	{
+		scan->sampleState->nextChunkGroup = 0;
+		scan->sampleState->chunkGroupReadInProgress = false;
+	}
 }
 
 
@@ -354,6 +588,11 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 {
 	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
 
+	if (scan->mergeSortKeyColumn != InvalidAttrNumber)
+	{
+		return ColumnarMergeGetNextSlot(scan, slot);
+	}
+
 	/*
 	 * if this is the first row, initialize read state.
 	 */
@@ -366,6 +605,53 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 									 scan->scanContext, scan->cs_base.rs_snapshot,
 									 randomAccess,
 									 scan->parallelColumnarScan);
+
+		if (scan->vectorQualFunc != NULL)
+		{
+			ColumnarSetVectorQual(scan->cs_readState, scan->vectorQualStageColumnLists,
+								  scan->vectorQualFunc, scan->vectorQualState);
+		}
+
+		if (scan->rowBound != 0)
+		{
+			ColumnarSetRowBound(scan->cs_readState, scan->rowBound);
+		}
+
+		if (scan->chunkGroupSummary != NULL)
+		{
+			ColumnarSetChunkGroupSummary(scan->cs_readState, scan->chunkGroupSummary);
+		}
+
+		if (scan->chunkGroupDelete != NULL)
+		{
+			ColumnarSetChunkGroupDelete(scan->cs_readState, scan->chunkGroupDelete);
+		}
+
+		if (scan->projectionSummary != NULL)
+		{
+			ColumnarSetStripeProjectionSummary(scan->cs_readState,
+											   scan->projectionSummary);
+		}
+
+		if (scan->topNBound != NULL)
+		{
+			ColumnarSetTopNBound(scan->cs_readState, scan->topNBound);
+		}
+
+		if (scan->joinKeyFilter != NULL)
+		{
+			ColumnarSetJoinKeyFilter(scan->cs_readState, scan->joinKeyFilter);
+		}
+
+		if (scan->addedQual != NIL)
+		{
+			ColumnarAddScanQual(scan->cs_readState, scan->addedQual);
+		}
+
+		if (scan->cs_base.rs_flags & SO_ALLOW_SYNC)
+		{
+			ColumnarSetSyncScan(scan->cs_readState);
+		}
 	}
 
 	ExecClearTuple(slot);
@@ -376,10 +662,13 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 
 		int newVectorSize = 0;
 
+		/* vector quals evaluated by the read set the selection */
+		vectorTTS->hasSelection = false;
+
 		bool nextRowFound = ColumnarReadNextVector(scan->cs_readState,
 												   vectorTTS->tts.tts_values,
-												   vectorTTS->tts.tts_isnull,
 												   vectorTTS->rowNumber,
+												   vectorTTS->capacity,
 												   &newVectorSize);
 
 		if (!nextRowFound)
@@ -387,15 +676,14 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 
 		vectorTTS->dimension = newVectorSize;
 
-		memset(vectorTTS->keep, true, newVectorSize);
-
 		ExecStoreVirtualTuple(slot);
 	}
 	else
 	{
 		uint64 rowNumber;
-		bool nextRowFound = ColumnarReadNextRow(scan->cs_readState, slot->tts_values,
-												slot->tts_isnull, &rowNumber);
+		bool nextRowFound = ColumnarReadNextBatchedRow(scan->cs_readState,
+													   slot->tts_values,
+													   slot->tts_isnull, &rowNumber);
 
 		if (!nextRowFound)
 		{
@@ -410,6 +698,42 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 }
 
 
+/*
+ * ColumnarMergeGetNextSlot stores the next row of a scan in the order of the
+ * sort key in the given slot, see ColumnarScanSetMergeRead().
+ */
+static bool
+ColumnarMergeGetNextSlot(ColumnarScanDesc scan, TupleTableSlot *slot)
+{
+	if (scan->mergeReadState == NULL)
+	{
+		TupleDesc tupdesc = slot->tts_tupleDescriptor;
+		MemoryContext oldContext = MemoryContextSwitchTo(scan->scanContext);
+		List *neededColumnList = NeededColumnsList(tupdesc, scan->attr_needed);
+		MemoryContextSwitchTo(oldContext);
+
+		scan->mergeReadState =
+			ColumnarBeginMergeRead(scan->cs_base.rs_rd, tupdesc, neededColumnList,
+								   scan->scanQual, scan->scanContext,
+								   scan->cs_base.rs_snapshot, scan->mergeSortKeyColumn);
+	}
+
+	ExecClearTuple(slot);
+
+	uint64 rowNumber;
+	if (!ColumnarMergeReadNextRow(scan->mergeReadState, slot->tts_values,
+								  slot->tts_isnull, &rowNumber))
+	{
+		return false;
+	}
+
+	ExecStoreVirtualTuple(slot);
+	slot->tts_tid = row_number_to_tid(rowNumber);
+
+	return true;
+}
+
+
 /*
  * row_number_to_tid maps given rowNumber to ItemPointerData.
  */
@@ -464,24 +788,47 @@ ErrorIfInvalidRowNumber(uint64 rowNumber)
 }
 
 
+/*
+ * columnar_parallelscan_estimate returns the size of the shared state of a
+ * parallel table scan. Parallel queries read columnar tables with the
+ * columnar custom scan instead, so these are only used by parallel index
+ * builds.
+ */
 static Size
 columnar_parallelscan_estimate(Relation rel)
 {
-	elog(ERROR, "columnar_parallelscan_estimate not implemented");
+	return add_size(COLUMNAR_PARALLEL_SCAN_OFFSET,
+					MAXALIGN(offsetof(ParallelColumnarScanData, snapshotData)));
 }
 
 
 static Size
 columnar_parallelscan_initialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	elog(ERROR, "columnar_parallelscan_initialize not implemented");
+	ParallelColumnarScan parallelColumnarScan = ParallelTableScanColumnarScan(pscan);
+
+	pscan->phs_relid = RelationGetRelid(rel);
+	pscan->phs_syncscan = false;
+
+	memset(parallelColumnarScan, 0, offsetof(ParallelColumnarScanData, snapshotData));
+	SpinLockInit(&parallelColumnarScan->mutex);
+
+	/* without a stripe list, the participants claim stripes by id */
+	parallelColumnarScan->stripeListOffset = 0;
+	pg_atomic_init_u64(&parallelColumnarScan->nextStripeId, 1);
+	pg_atomic_init_u32(&parallelColumnarScan->deltaStoreClaimed, 0);
+
+	return columnar_parallelscan_estimate(rel);
 }
 
 
 static void
 columnar_parallelscan_reinitialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	elog(ERROR, "columnar_parallelscan_reinitialize not implemented");
+	ParallelColumnarScan parallelColumnarScan = ParallelTableScanColumnarScan(pscan);
+
+	pg_atomic_write_u64(&parallelColumnarScan->nextStripeId, 1);
+	pg_atomic_write_u32(&parallelColumnarScan->deltaStoreClaimed, 0);
 }
 
 
@@ -537,6 +884,123 @@ columnar_index_fetch_end(IndexFetchTableData *sscan)
 }
 
 
+/*
+ * ColumnarSetIndexFetchProjection tells the index fetches of columnar tables
+ * that fill the given slot to read only the columns in attrNeeded (0-indexed).
+ * The projection is forgotten once queryContext is reset, which must not
+ * outlive the slot.
+ */
+void
+ColumnarSetIndexFetchProjection(TupleTableSlot *slot, Bitmapset *attrNeeded,
+								MemoryContext queryContext)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(queryContext);
+
+	IndexFetchProjection *projection = palloc0(sizeof(IndexFetchProjection));
+	projection->slot = slot;
+	projection->attrNeeded = bms_copy(attrNeeded);
+	projection->resetCallback.func = IndexFetchProjectionReset;
+	projection->resetCallback.arg = projection;
+	MemoryContextRegisterResetCallback(queryContext, &projection->resetCallback);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+	IndexFetchProjectionList = lappend(IndexFetchProjectionList, projection);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * IndexFetchProjectionReset forgets the given projection when the context of
+ * its query goes away, including when the query errors out.
+ */
+static void
+IndexFetchProjectionReset(void *arg)
+{
+	IndexFetchProjectionList = list_delete_ptr(IndexFetchProjectionList, arg);
+}
+
+
+/*
+ * IndexFetchProjectionForSlot sets attrNeeded to the columns needed by the
+ * scan that fills the given slot and returns true, or returns false if no
+ * projection was set for it, as for the fetches of constraint checks.
+ */
+static bool
+IndexFetchProjectionForSlot(TupleTableSlot *slot, Bitmapset **attrNeeded)
+{
+	IndexFetchProjection *projection = NULL;
+	foreach_ptr(projection, IndexFetchProjectionList)
+	{
+		if (projection->slot == slot)
+		{
+			*attrNeeded = bms_copy(projection->attrNeeded);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ColumnarSetUpdateFetchProjection tells the fetches of the old rows of the
+ * given result relation of an UPDATE to read only the columns in attrNeeded
+ * (0-indexed), which are the columns the new rows take from the old ones.
+ * The projection is forgotten once queryContext is reset.
+ */
+void
+ColumnarSetUpdateFetchProjection(ResultRelInfo *resultRelInfo, Bitmapset *attrNeeded,
+								 MemoryContext queryContext)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(queryContext);
+
+	UpdateFetchProjection *projection = palloc0(sizeof(UpdateFetchProjection));
+	projection->resultRelInfo = resultRelInfo;
+	projection->attrNeeded = bms_copy(attrNeeded);
+	projection->resetCallback.func = UpdateFetchProjectionReset;
+	projection->resetCallback.arg = projection;
+	MemoryContextRegisterResetCallback(queryContext, &projection->resetCallback);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+	UpdateFetchProjectionList = lappend(UpdateFetchProjectionList, projection);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+static void
+UpdateFetchProjectionReset(void *arg)
+{
+	UpdateFetchProjectionList = list_delete_ptr(UpdateFetchProjectionList, arg);
+}
+
+
+/*
+ * UpdateFetchProjectionForSlot sets attrNeeded to the columns an UPDATE needs
+ * from the old rows it fetches into the given slot and returns true, or
+ * returns false if the slot isn't the old row slot of such an UPDATE. Other
+ * fetches, like those of RETURNING and of triggers, need all columns.
+ */
+static bool
+UpdateFetchProjectionForSlot(TupleTableSlot *slot, Bitmapset **attrNeeded)
+{
+#if PG_VERSION_NUM >= PG_VERSION_14
+	UpdateFetchProjection *projection = NULL;
+	foreach_ptr(projection, UpdateFetchProjectionList)
+	{
+		if (projection->resultRelInfo->ri_oldTupleSlot == slot)
+		{
+			*attrNeeded = bms_copy(projection->attrNeeded);
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
+
 static bool
 columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 						   ItemPointer tid,
@@ -567,9 +1031,13 @@ columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 	/* initialize read state for the first row */
 	if (scan->cs_readState == NULL)
 	{
-		/* we need all columns */
-		int natts = columnarRelation->rd_att->natts;
-		Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
+		/* without a projection for the slot, we need all columns */
+		Bitmapset *attr_needed = NULL;
+		if (!IndexFetchProjectionForSlot(slot, &attr_needed))
+		{
+			int natts = columnarRelation->rd_att->natts;
+			attr_needed = bms_add_range(NULL, 0, natts - 1);
+		}
 
 		/* no quals for index scan */
 		List *scanQual = NIL;
@@ -698,16 +1166,30 @@ columnar_fetch_row_version(Relation relation,
 						   TupleTableSlot *slot)
 {
 	uint64 rowNumber = tid_to_row_number(*tid);
-	ColumnarReadState **readState =
-		FindReadStateCache(relation, GetCurrentSubTransactionId());
+	ColumnarReadState **readState = NULL;
 
-	if (readState == NULL)
+	/* an UPDATE doesn't need the old values of the columns it assigns */
+	Bitmapset *attr_needed = NULL;
+	if (UpdateFetchProjectionForSlot(slot, &attr_needed))
+	{
+		readState = UpdateReadStateCache(relation, GetCurrentSubTransactionId(),
+										 attr_needed);
+	}
+	else
 	{
-		readState = InitColumnarReadStateCache(relation, GetCurrentSubTransactionId());
+		readState = FindReadStateCache(relation, GetCurrentSubTransactionId());
+		if (readState == NULL || *readState == NULL)
+		{
+			readState = InitColumnarReadStateCache(relation,
+												   GetCurrentSubTransactionId());
+		}
 
 		int natts = relation->rd_att->natts;
-		Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
+		attr_needed = bms_add_range(NULL, 0, natts - 1);
+	}
 
+	if (*readState == NULL)
+	{
 		List *scanQual = NIL;
 
 		bool randomAccess = false;
@@ -756,7 +1238,14 @@ columnar_tuple_satisfies_snapshot(Relation rel, TupleTableSlot *slot,
 {
 	uint64 rowNumber = tid_to_row_number(slot->tts_tid);
 	StripeMetadata *stripeMetadata = FindStripeByRowNumber(rel, rowNumber, snapshot);
-	return stripeMetadata != NULL;
+	if (stripeMetadata != NULL)
+	{
+		return true;
+	}
+
+	/* rows that are not in a stripe may still be in the delta store */
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	return ReadDeltaStoreRow(storageId, rowNumber, snapshot) != NULL;
 }
 
 
@@ -841,7 +1330,7 @@ columnar_tuple_insert(Relation relation, TupleTableSlot *slot, CommandId cid,
 	MemoryContext oldContext = MemoryContextSwitchTo(ColumnarWritePerTupleContext(
 														 writeState));
 
-	ColumnarCheckLogicalReplication(relation);
+	ColumnarKeepRowNumbersIfIndexed(relation, writeState);
 
 	slot_getallattrs(slot);
 
@@ -851,10 +1340,19 @@ columnar_tuple_insert(Relation relation, TupleTableSlot *slot, CommandId cid,
 	uint64 writtenRowNumber = ColumnarWriteRow(writeState, values, slot->tts_isnull);
 	slot->tts_tid = row_number_to_tid(writtenRowNumber);
 
+	if (!(options & TABLE_INSERT_NO_LOGICAL) &&
+		ColumnarLogicalChangesLogged(relation, CMD_INSERT))
+	{
+		ColumnarLogLogicalInsert(relation, &slot->tts_tid, values, slot->tts_isnull);
+	}
+
 	MemoryContextSwitchTo(oldContext);
 	MemoryContextReset(ColumnarWritePerTupleContext(writeState));
 
+	ColumnarEnforceWriteStateMemoryLimit(GetCurrentSubTransactionId());
+
 	pgstat_count_heap_insert(relation, 1);
+	ColumnarStatCount(RelationGetRelid(relation), COLUMNAR_STAT_ROWS_WRITTEN, 1);
 }
 
 
@@ -877,24 +1375,23 @@ columnar_tuple_insert_speculative(Relation relation, TupleTableSlot *slot,
 	MemoryContext oldContext = MemoryContextSwitchTo(ColumnarWritePerTupleContext(
 														 writeState));
 
-	ColumnarCheckLogicalReplication(relation);
+	ColumnarKeepRowNumbersIfIndexed(relation, writeState);
 
 	slot_getallattrs(slot);
 
 	Datum *values = detoast_values(slot->tts_tupleDescriptor,
 								   slot->tts_values, slot->tts_isnull);
 
-	uint64 storageId = LookupStorageId(relation->rd_node);
-
 	uint64 writtenRowNumber = ColumnarWriteRow(writeState, values, slot->tts_isnull);
-	UpdateRowMask(relation->rd_node, storageId,  NULL, writtenRowNumber);
-
 	slot->tts_tid = row_number_to_tid(writtenRowNumber);
 
 	MemoryContextSwitchTo(oldContext);
 	MemoryContextReset(ColumnarWritePerTupleContext(writeState));
 
+	ColumnarEnforceWriteStateMemoryLimit(GetCurrentSubTransactionId());
+
 	pgstat_count_heap_insert(relation, 1);
+	ColumnarStatCount(RelationGetRelid(relation), COLUMNAR_STAT_ROWS_WRITTEN, 1);
 }
 
 
@@ -904,11 +1401,36 @@ columnar_tuple_complete_speculative(Relation relation, TupleTableSlot *slot,
 {
 	uint64 rowNumber = tid_to_row_number(slot->tts_tid);
 
-	uint64 storageId = LookupStorageId(relation->rd_node);
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	ColumnarLockStorageForRowChange(storageId);
 
-	/* Set lock for relation until transaction ends */
-	DirectFunctionCall1(pg_advisory_xact_lock_int8,
-						Int64GetDatum((int64) storageId));
+	if (!succeeded)
+	{
+		/*
+		 * A concurrent insert of a conflicting row won, so the row we wrote
+		 * must not become visible. Rows can only be masked once their stripe
+		 * is flushed, but this is rare enough to not matter.
+		 */
+		FlushWriteStateForRelfilenode(relation->rd_node.relNode,
+									  GetCurrentSubTransactionId());
+		UpdateRowMask(relation->rd_node, storageId, NULL, rowNumber);
+
+		/* count deletion, as we counted the insertion too */
+		pgstat_count_heap_delete(relation);
+	}
+	else if (ColumnarLogicalChangesLogged(relation, CMD_INSERT))
+	{
+		/*
+		 * The row is only logged for logical decoding once it is known to
+		 * stay, which saves logging the speculative insert and its
+		 * confirmation like heap does.
+		 */
+		slot_getallattrs(slot);
+
+		Datum *values = detoast_values(slot->tts_tupleDescriptor,
+									   slot->tts_values, slot->tts_isnull);
+		ColumnarLogLogicalInsert(relation, &slot->tts_tid, values, slot->tts_isnull);
+	}
 
 	columnar_enable_page_cache = previousCacheEnabledState;
 }
@@ -923,11 +1445,26 @@ columnar_multi_insert(Relation relation, TupleTableSlot **slots, int ntuples,
 																 slots[0]->tts_tableOid,
 															   GetCurrentSubTransactionId());
 
-	ColumnarCheckLogicalReplication(relation);
+	ColumnarKeepRowNumbersIfIndexed(relation, writeState);
+
+	if (relation->rd_att->constr)
+	{
+		ColumnarMultiInsertCheckConstraints(relation, slots, ntuples);
+	}
 
 	MemoryContext oldContext = MemoryContextSwitchTo(ColumnarWritePerTupleContext(
 														 writeState));
 
+	/* transpose the batch into one array of values and nulls per column */
+	int natts = RelationGetDescr(relation)->natts;
+	Datum **columnValues = palloc(natts * sizeof(Datum *));
+	bool **columnNulls = palloc(natts * sizeof(bool *));
+	for (int columnIndex = 0; columnIndex < natts; columnIndex++)
+	{
+		columnValues[columnIndex] = palloc(ntuples * sizeof(Datum));
+		columnNulls[columnIndex] = palloc(ntuples * sizeof(bool));
+	}
+
 	for (int i = 0; i < ntuples; i++)
 	{
 		TupleTableSlot *tupleSlot = slots[i];
@@ -937,61 +1474,159 @@ columnar_multi_insert(Relation relation, TupleTableSlot **slots, int ntuples,
 		Datum *values = detoast_values(tupleSlot->tts_tupleDescriptor,
 									   tupleSlot->tts_values, tupleSlot->tts_isnull);
 
-		uint64 writtenRowNumber = ColumnarWriteRow(writeState, values,
-												   tupleSlot->tts_isnull);
-
-		EState *estate = create_estate_for_relation(relation);
-
-#if PG_VERSION_NUM >= PG_VERSION_14
-		ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
-		InitResultRelInfo(resultRelInfo, relation, 1, NULL, 0);
-#else
-		ResultRelInfo *resultRelInfo = estate->es_result_relation_info;
-#endif
-
-		ExecOpenIndices(resultRelInfo, false);
-
-		if (relation->rd_att->constr)
-			ExecConstraints(resultRelInfo, tupleSlot, estate);
-
-		ExecCloseIndices(resultRelInfo);
+		for (int columnIndex = 0; columnIndex < natts; columnIndex++)
+		{
+			columnValues[columnIndex][i] = values[columnIndex];
+			columnNulls[columnIndex][i] = tupleSlot->tts_isnull[columnIndex];
+		}
+	}
 
-		AfterTriggerEndQuery(estate);
-#if PG_VERSION_NUM >= PG_VERSION_14
-		ExecCloseResultRelations(estate);
-		ExecCloseRangeTableRelations(estate);
-#else
-		ExecCleanUpTriggerState(estate);
-#endif
-		ExecResetTupleTable(estate->es_tupleTable, false);
-		FreeExecutorState(estate);
+	uint64 *rowNumbers = palloc(ntuples * sizeof(uint64));
+	ColumnarWriteBatch(writeState, columnValues, columnNulls, ntuples, rowNumbers);
 
-		tupleSlot->tts_tid = row_number_to_tid(writtenRowNumber);
+	for (int i = 0; i < ntuples; i++)
+	{
+		slots[i]->tts_tid = row_number_to_tid(rowNumbers[i]);
+	}
 
-		MemoryContextReset(ColumnarWritePerTupleContext(writeState));
+	if (!(options & TABLE_INSERT_NO_LOGICAL) &&
+		ColumnarLogicalChangesLogged(relation, CMD_INSERT))
+	{
+		ColumnarLogLogicalMultiInsert(relation, columnValues, columnNulls, rowNumbers,
+									  ntuples);
 	}
 
 	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(ColumnarWritePerTupleContext(writeState));
+
+	ColumnarEnforceWriteStateMemoryLimit(GetCurrentSubTransactionId());
 
 	pgstat_count_heap_insert(relation, ntuples);
+	ColumnarStatCount(RelationGetRelid(relation), COLUMNAR_STAT_ROWS_WRITTEN, ntuples);
 }
 
 
-static TM_Result
-columnar_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
-					  Snapshot snapshot, Snapshot crosscheck, bool wait,
-					  TM_FailureData *tmfd, bool changingPart)
+/*
+ * ColumnarMultiInsertCheckConstraints checks the constraints of the relation
+ * for all tuples of a multi insert batch before any of them is written. The
+ * executor state is set up once for the batch instead of once per tuple.
+ */
+static void
+ColumnarMultiInsertCheckConstraints(Relation relation, TupleTableSlot **slots,
+									int ntuples)
 {
-	uint64 rowNumber = tid_to_row_number(*tid);
-
-	uint64 storageId = LookupStorageId(relation->rd_node);
+	EState *estate = create_estate_for_relation(relation);
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, relation, 1, NULL, 0);
+#else
+	ResultRelInfo *resultRelInfo = estate->es_result_relation_info;
+#endif
+
+	for (int i = 0; i < ntuples; i++)
+	{
+		ExecConstraints(resultRelInfo, slots[i], estate);
+		ResetPerTupleExprContext(estate);
+	}
+
+	AfterTriggerEndQuery(estate);
+#if PG_VERSION_NUM >= PG_VERSION_14
+	ExecCloseResultRelations(estate);
+	ExecCloseRangeTableRelations(estate);
+#else
+	ExecCleanUpTriggerState(estate);
+#endif
+	ExecResetTupleTable(estate->es_tupleTable, false);
+	FreeExecutorState(estate);
+}
+
+
+/*
+ * ColumnarKeepRowNumbersIfIndexed stops the write state from sorting stripes
+ * and from using the delta store for a relation with indexes. Index entries
+ * point to the row numbers handed out at insert time, which sorting a stripe
+ * or flushing the delta store would change.
+ */
+static void
+ColumnarKeepRowNumbersIfIndexed(Relation relation, ColumnarWriteState *writeState)
+{
+	if (relation->rd_rel->relhasindex)
+	{
+		ColumnarDisableStripeSort(writeState);
+		ColumnarDisableDeltaStore(writeState);
+	}
+}
+
+
+/*
+ * ColumnarLockStorageForRowChange takes the advisory lock on given storage id
+ * that deletes and updates of the table hold until the transaction ends.
+ * DELETE and UPDATE call us for each row, so we skip the lock manager once the
+ * current subtransaction holds the lock, as locks taken by subtransactions are
+ * released when they abort.
+ */
+void
+ColumnarLockStorageForRowChange(uint64 storageId)
+{
+	static LocalTransactionId lockedLocalXid = InvalidLocalTransactionId;
+	static SubTransactionId lockedSubXid = InvalidSubTransactionId;
+	static uint64 lockedStorageId = 0;
+
+	if (lockedLocalXid == MyProc->lxid &&
+		lockedSubXid == GetCurrentSubTransactionId() &&
+		lockedStorageId == storageId)
+	{
+		return;
+	}
 
 	/* Set lock for relation until transaction ends */
 	DirectFunctionCall1(pg_advisory_xact_lock_int8,
 						Int64GetDatum((int64) storageId));
 
-	if (!UpdateRowMask(relation->rd_node, storageId,  snapshot, rowNumber))
-		return TM_Deleted;
+	lockedLocalXid = MyProc->lxid;
+	lockedSubXid = GetCurrentSubTransactionId();
+	lockedStorageId = storageId;
+}
+
+
+static TM_Result
+columnar_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
+					  Snapshot snapshot, Snapshot crosscheck, bool wait,
+					  TM_FailureData *tmfd, bool changingPart)
+{
+	uint64 rowNumber = tid_to_row_number(*tid);
+
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	ColumnarLockStorageForRowChange(storageId);
+
+	/* the old row is logged for logical decoding, so read it while it's there */
+	bool logDelete = ColumnarLogicalChangesLogged(relation, CMD_DELETE);
+	Datum *oldValues = NULL;
+	bool *oldNulls = NULL;
+	if (logDelete)
+	{
+		ColumnarReadRowForChange(relation, rowNumber, &oldValues, &oldNulls);
+	}
+
+	bool alreadyDeleted = false;
+	if (DeleteDeltaStoreRow(storageId, rowNumber, &alreadyDeleted))
+	{
+		if (alreadyDeleted)
+			return TM_Deleted;
+	}
+	else
+	{
+		ColumnarVisibilityMapClearRow(relation, rowNumber);
+
+		if (!UpdateRowMask(relation->rd_node, storageId,  snapshot, rowNumber))
+			return TM_Deleted;
+	}
+
+	if (logDelete)
+	{
+		ColumnarLogLogicalDelete(relation, tid, oldValues, oldNulls);
+	}
 
 	pgstat_count_heap_delete(relation);
 
@@ -1007,16 +1642,41 @@ columnar_tuple_update(Relation relation, ItemPointer otid, TupleTableSlot *slot,
 {
 	uint64 rowNumber = tid_to_row_number(*otid);
 
-	uint64 storageId = LookupStorageId(relation->rd_node);
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	ColumnarLockStorageForRowChange(storageId);
 
-	/* Set lock for relation until transaction ends */
-	DirectFunctionCall1(pg_advisory_xact_lock_int8,
-						Int64GetDatum((int64) storageId));
+	bool logUpdate = ColumnarLogicalChangesLogged(relation, CMD_UPDATE);
+	Datum *oldValues = NULL;
+	bool *oldNulls = NULL;
+	if (logUpdate)
+	{
+		ColumnarReadRowForChange(relation, rowNumber, &oldValues, &oldNulls);
+	}
+
+	bool alreadyDeleted = false;
+	if (DeleteDeltaStoreRow(storageId, rowNumber, &alreadyDeleted))
+	{
+		if (alreadyDeleted)
+			return TM_Deleted;
+	}
+	else
+	{
+		ColumnarVisibilityMapClearRow(relation, rowNumber);
+
+		if (!UpdateRowMask(relation->rd_node, storageId, snapshot, rowNumber))
+			return TM_Deleted;
+	}
 
-	if (!UpdateRowMask(relation->rd_node, storageId, snapshot, rowNumber))
-		return TM_Deleted;
+	/* the new row is logged as part of the update, not as an insert */
+	columnar_tuple_insert(relation, slot, cid, TABLE_INSERT_NO_LOGICAL, NULL);
 
-	columnar_tuple_insert(relation, slot, cid, 0, NULL);
+	if (logUpdate)
+	{
+		Datum *newValues = detoast_values(slot->tts_tupleDescriptor,
+										  slot->tts_values, slot->tts_isnull);
+		ColumnarLogLogicalUpdate(relation, otid, oldValues, oldNulls, &slot->tts_tid,
+								 newValues, slot->tts_isnull);
+	}
 
 	*update_indexes = true;
 
@@ -1033,24 +1693,13 @@ columnar_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
 					TM_FailureData *tmfd)
 {
 	uint64 rowNumber = tid_to_row_number(*tid);
-	ColumnarReadState *readState = NULL;
-
-	int natts = relation->rd_att->natts;
-	Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
-
-	List *scanQual = NIL;
 
-	bool randomAccess = true;
-
-	readState = init_columnar_read_state(relation,
-										slot->tts_tupleDescriptor,
-										attr_needed, scanQual,
-										CurrentMemoryContext, // to be checked
-										GetTransactionSnapshot(), randomAccess,
-										NULL);
+	ColumnarReadState *readState = ColumnarLockReadState(relation);
 
+	MemoryContext oldContext = MemoryContextSwitchTo(GetColumnarReadStateCache());
 	ColumnarReadRowByRowNumber(readState, rowNumber,
 							   slot->tts_values, slot->tts_isnull);
+	MemoryContextSwitchTo(oldContext);
 
 	slot->tts_tableOid = RelationGetRelid(relation);
 	slot->tts_tid = *tid;
@@ -1064,6 +1713,64 @@ columnar_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
 }
 
 
+/*
+ * ColumnarLockReadState returns the read state that columnar_tuple_lock and
+ * the changes that log old rows for logical decoding read single rows
+ * through.
+ *
+ * INSERT ... ON CONFLICT DO UPDATE locks every conflicting row, so keep the
+ * read state for the rest of the transaction rather than decoding the chunk
+ * group of each row in a new one. GetTransactionSnapshot always returns the
+ * same snapshot struct, whose contents it updates as needed, so the read
+ * state sees the same rows as a new one would.
+ */
+static ColumnarReadState *
+ColumnarLockReadState(Relation relation)
+{
+	ColumnarReadState **readState =
+		LockReadStateCache(relation, GetCurrentSubTransactionId());
+	if (*readState == NULL)
+	{
+		int natts = relation->rd_att->natts;
+		Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
+
+		List *scanQual = NIL;
+
+		bool randomAccess = true;
+
+		*readState = init_columnar_read_state(relation,
+											  RelationGetDescr(relation),
+											  attr_needed, scanQual,
+											  GetColumnarReadStateCache(),
+											  GetTransactionSnapshot(), randomAccess,
+											  NULL);
+	}
+
+	return *readState;
+}
+
+
+/*
+ * ColumnarReadRowForChange reads the values of a row that is about to be
+ * deleted or updated, to log them for logical decoding.
+ */
+static void
+ColumnarReadRowForChange(Relation relation, uint64 rowNumber, Datum **values,
+						 bool **nulls)
+{
+	int natts = RelationGetDescr(relation)->natts;
+
+	*values = palloc0(natts * sizeof(Datum));
+	*nulls = palloc0(natts * sizeof(bool));
+
+	ColumnarReadState *readState = ColumnarLockReadState(relation);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(GetColumnarReadStateCache());
+	ColumnarReadRowByRowNumberOrError(readState, rowNumber, *values, *nulls);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 static void
 columnar_finish_bulk_insert(Relation relation, int options)
 {
@@ -1080,12 +1787,6 @@ columnar_relation_set_new_filenode(Relation rel,
 								   TransactionId *freezeXid,
 								   MultiXactId *minmulti)
 {
-	if (persistence == RELPERSISTENCE_UNLOGGED)
-	{
-		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg("unlogged columnar tables are not supported")));
-	}
-
 	/*
 	 * If existing and new relfilenode are different, that means the existing
 	 * storage was dropped and we also need to clean up the metadata and
@@ -1107,7 +1808,7 @@ columnar_relation_set_new_filenode(Relation rel,
 	SMgrRelation srel = RelationCreateStorage(*newrnode, persistence);
 #endif
 
-	ColumnarStorageInit(srel, ColumnarMetadataNewStorageId());
+	ColumnarStorageInit(srel, ColumnarMetadataNewStorageId(), persistence);
 	InitColumnarOptions(rel->rd_id);
 
 	smgrclose(srel);
@@ -1125,6 +1826,7 @@ columnar_relation_nontransactional_truncate(Relation rel)
 
 	/* Delete old relfilenode metadata */
 	DeleteMetadataRows(relfilenode);
+	ColumnarInvalidateStripeListSummary(rel);
 
 	/*
 	 * No need to set new relfilenode, since the table was created in this
@@ -1142,7 +1844,7 @@ columnar_relation_nontransactional_truncate(Relation rel)
 		smgrsetowner(&(rel->rd_smgr), smgropen(rel->rd_node, rel->rd_backend));
 	}
 
-	ColumnarStorageInit(rel->rd_smgr, storageId);
+	ColumnarStorageInit(rel->rd_smgr, storageId, rel->rd_rel->relpersistence);
 }
 
 
@@ -1218,11 +1920,32 @@ columnar_relation_copy_for_cluster(Relation OldHeap, Relation NewHeap,
 
 	*num_tuples = 0;
 
-	/* we don't need to know rowNumber here */
-	while (ColumnarReadNextRow(readState, values, nulls, NULL))
+	List *stripeList = StripesForSnapshot(OldHeap, snapshot);
+	int parallelWorkers = ColumnarParallelVacuumWorkers(list_length(stripeList));
+
+	if (parallelWorkers > 0)
 	{
-		ColumnarWriteRow(writeState, values, nulls);
-		(*num_tuples)++;
+		/*
+		 * Parallel workers decode the stripes, which leaves only the delta
+		 * store for readState.
+		 */
+		*num_tuples = CopyStripesInParallel(OldHeap, stripeList, writeState,
+											parallelWorkers);
+
+		while (ColumnarReadDeltaStoreNextRow(readState, values, nulls, NULL))
+		{
+			ColumnarWriteRow(writeState, values, nulls);
+			(*num_tuples)++;
+		}
+	}
+	else
+	{
+		/* we don't need to know rowNumber here */
+		while (ColumnarReadNextBatchedRow(readState, values, nulls, NULL))
+		{
+			ColumnarWriteRow(writeState, values, nulls);
+			(*num_tuples)++;
+		}
 	}
 
 	*tups_vacuumed = 0;
@@ -1232,6 +1955,129 @@ columnar_relation_copy_for_cluster(Relation OldHeap, Relation NewHeap,
 }
 
 
+/*
+ * CopyStripesInParallel writes the rows of the given stripes to writeState in
+ * stripe order, decoding them in parallel workers a batch at a time. Batches
+ * that get no workers are read here. Returns the number of rows written.
+ */
+static double
+CopyStripesInParallel(Relation rel, List *stripeList, ColumnarWriteState *writeState,
+					  int parallelWorkers)
+{
+	TupleDesc tupleDesc = RelationGetDescr(rel);
+	int stripeCount = list_length(stripeList);
+	int batchSize = parallelWorkers * VACUUM_PARALLEL_BATCH_FACTOR;
+	StripeMetadata **stripes = palloc(batchSize * sizeof(StripeMetadata *));
+	uint32 *rowLimits = palloc(batchSize * sizeof(uint32));
+	double rowCount = 0;
+
+	for (int batchStart = 0; batchStart < stripeCount; batchStart += batchSize)
+	{
+		int batchEnd = Min(batchStart + batchSize, stripeCount);
+
+		for (int i = batchStart; i < batchEnd; i++)
+		{
+			stripes[i - batchStart] = list_nth(stripeList, i);
+			rowLimits[i - batchStart] = PG_UINT32_MAX;
+		}
+
+		Tuplestorestate **batchRows =
+			ColumnarParallelReadStripeRows(rel, stripes, rowLimits,
+										   batchEnd - batchStart,
+										   Min(parallelWorkers, batchEnd - batchStart));
+
+		for (int i = batchStart; i < batchEnd; i++)
+		{
+			if (batchRows != NULL && batchRows[i - batchStart] != NULL)
+			{
+				rowCount += WriteTuplestoreRows(batchRows[i - batchStart], tupleDesc,
+												writeState);
+				tuplestore_end(batchRows[i - batchStart]);
+			}
+			else
+			{
+				rowCount += CopyStripeRows(rel, stripes[i - batchStart], writeState);
+			}
+		}
+
+		if (batchRows != NULL)
+		{
+			pfree(batchRows);
+		}
+	}
+
+	pfree(stripes);
+	pfree(rowLimits);
+
+	return rowCount;
+}
+
+
+/*
+ * CopyStripeRows writes the live rows of a single stripe to writeState.
+ * Returns the number of rows written.
+ */
+static double
+CopyStripeRows(Relation rel, StripeMetadata *stripeMetadata,
+			   ColumnarWriteState *writeState)
+{
+	TupleDesc tupleDesc = RelationGetDescr(rel);
+	Bitmapset *attr_needed = bms_add_range(NULL, 0, tupleDesc->natts - 1);
+	MemoryContext scanContext = CreateColumnarScanMemoryContext();
+	MemoryContext oldContext = MemoryContextSwitchTo(scanContext);
+
+	ColumnarReadState *readState = init_columnar_read_state(rel, tupleDesc,
+															attr_needed, NIL,
+															scanContext, SnapshotAny,
+															true, NULL);
+	ColumnarSetStripeReadState(readState, stripeMetadata);
+
+	Datum *values = palloc0(tupleDesc->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
+	uint64 highestRowNumber = StripeGetHighestRowNumber(stripeMetadata);
+	uint64 rowNumber = 0;
+	double rowCount = 0;
+
+	while (ColumnarReadNextRow(readState, values, nulls, &rowNumber) &&
+		   rowNumber <= highestRowNumber)
+	{
+		ColumnarWriteRow(writeState, values, nulls);
+		rowCount++;
+	}
+
+	ColumnarEndRead(readState);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(scanContext);
+
+	return rowCount;
+}
+
+
+/*
+ * WriteTuplestoreRows writes the rows that a parallel worker decoded to
+ * writeState. Returns the number of rows written.
+ */
+static double
+WriteTuplestoreRows(Tuplestorestate *rows, TupleDesc tupleDesc,
+					ColumnarWriteState *writeState)
+{
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDesc, &TTSOpsMinimalTuple);
+	double rowCount = 0;
+
+	while (tuplestore_gettupleslot(rows, true, false, slot))
+	{
+		slot_getallattrs(slot);
+		ColumnarWriteRow(writeState, slot->tts_values, slot->tts_isnull);
+		rowCount++;
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+
+	return rowCount;
+}
+
+
 /*
  * NeededColumnsList returns a list of AttrNumber's for the columns that
  * are not dropped and specified by attr_needed.
@@ -1305,6 +2151,12 @@ TruncateAndCombineColumnarStripes(Relation rel, int elevel)
 	{
 		StripeMetadata * stripeMetadata = lfirst(lc);
 
+		/* offloaded stripes stay where they are */
+		if (ColumnarLogicalOffsetIsOffloaded(stripeMetadata->fileOffset))
+		{
+			break;
+		}
+
 		lastStripeDeletedRows = DeletedRowsForStripe(rel->rd_node,
 													 stripeMetadata->chunkCount,
 													 stripeMetadata->id);
@@ -1335,13 +2187,14 @@ TruncateAndCombineColumnarStripes(Relation rel, int elevel)
 	 */
 	else if (startingStripeListPosition == 1)
 	{
-		/* Maybe we should vacuum only one stripe if count of
-		 * deleted rows is higher than 20 percent.
+		/* Maybe we should vacuum only one stripe if the fraction of its
+		 * deleted rows is above columnar.vacuum_deleted_rows_threshold.
 		 */
-		float percentageOfDeleteRows =
-			(float)lastStripeDeletedRows / (float)(totalRowNumberCount + lastStripeDeletedRows);
+		double percentageOfDeleteRows =
+			(double)lastStripeDeletedRows / (double)(totalRowNumberCount + lastStripeDeletedRows);
 
-		bool shouldVacuumOnlyStripe = percentageOfDeleteRows > 0.2f;
+		bool shouldVacuumOnlyStripe =
+			percentageOfDeleteRows > columnar_vacuum_deleted_rows_threshold;
 
 		if (!shouldVacuumOnlyStripe)
 		{
@@ -1349,26 +2202,7 @@ TruncateAndCombineColumnarStripes(Relation rel, int elevel)
 		}
 	}
 
-	/*
-	 * We need to clear current proces (VACUUUM) status flag here. Why?
-	 * Current process has flag `PROC_IN_VACUUM` which is problematic because
-	 * we write here into metadata heap tables. If concurrent process
-	 * read page in which we inserted metadata tuples these tuples will be considered
-	 * DEAD and will be removed (in problematic scenarion).
-	 * Concurrent process, when assigning RecentXmin will scan all active processes in
-	 * system but will NOT consider this process because of
-	 * `PROC_IN_VACUUM` flag set. It looks that invalidating status flag here doesn't affect
-	 * further execution.
-	 */
-
-	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
-#if PG_VERSION_NUM >= PG_VERSION_14
-	MyProc->statusFlags = 0;
-	ProcGlobal->statusFlags[MyProc->pgxactoff] = MyProc->statusFlags;
-#else
-	MyPgXact->vacuumFlags = 0;
-#endif
-	LWLockRelease(ProcArrayLock);
+	ClearVacuumStatusFlags();
 
 	/* We need to re-assing RecentXmin here */
 	PushActiveSnapshot(GetTransactionSnapshot());
@@ -1400,7 +2234,7 @@ TruncateAndCombineColumnarStripes(Relation rel, int elevel)
 	bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
 
 	/* we don't need to know rowNumber here */
-	while (ColumnarReadNextRow(readState, values, nulls, NULL))
+	while (ColumnarReadNextBatchedRow(readState, values, nulls, NULL))
 	{
 		ColumnarWriteRow(writeState, values, nulls);
 	}
@@ -1418,7 +2252,11 @@ TruncateAndCombineColumnarStripes(Relation rel, int elevel)
 		newDataReservation = mtd->fileOffset;
 	}
 
-	ColumnarStorageTruncate(rel, newDataReservation);
+	/* the data of offloaded stripes isn't at the end of the storage */
+	if (!ColumnarLogicalOffsetIsOffloaded(newDataReservation))
+	{
+		ColumnarStorageTruncate(rel, newDataReservation);
+	}
 
 	ColumnarEndWrite(writeState);
 	ColumnarEndRead(readState);
@@ -1426,9 +2264,12 @@ TruncateAndCombineColumnarStripes(Relation rel, int elevel)
 	for (int i = 0; i < startingStripeListPosition; i++)
 	{
 		StripeMetadata *metadata = list_nth(stripeMetadataList, i);
+		ColumnarVisibilityMapClearStripe(rel, metadata);
 		DeleteMetadataRowsForStripeId(rel->rd_node, metadata->id);
 	}
 
+	ColumnarInvalidateStripeListSummary(rel);
+
 	PopActiveSnapshot();
 
 	return true;
@@ -1454,6 +2295,31 @@ ColumnarTableTupleCount(Relation relation)
 	return tupleCount;
 }
 
+/*
+ * ClearVacuumStatusFlags clears the status flags of the current (VACUUM)
+ * process. Why? Current process has flag `PROC_IN_VACUUM` which is
+ * problematic because we write into metadata heap tables. If concurrent
+ * process read page in which we inserted metadata tuples these tuples will
+ * be considered DEAD and will be removed (in problematic scenarion).
+ * Concurrent process, when assigning RecentXmin will scan all active
+ * processes in system but will NOT consider this process because of
+ * `PROC_IN_VACUUM` flag set. It looks that invalidating status flag here
+ * doesn't affect further execution.
+ */
+static void
+ClearVacuumStatusFlags(void)
+{
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+#if PG_VERSION_NUM >= PG_VERSION_14
+	MyProc->statusFlags = 0;
+	ProcGlobal->statusFlags[MyProc->pgxactoff] = MyProc->statusFlags;
+#else
+	MyPgXact->vacuumFlags = 0;
+#endif
+	LWLockRelease(ProcArrayLock);
+}
+
+
 /*
  * columnar_vacuum_rel implements VACUUM without FULL option.
  */
@@ -1479,6 +2345,22 @@ columnar_vacuum_rel(Relation rel, VacuumParams *params,
 
 	LogRelationStats(rel, elevel);
 
+	/*
+	 * Autovacuum picks columnar tables by the deletes and inserts counted in
+	 * pgstat, but truncating only combines the stripes at the end. Rewrite
+	 * the heavily deleted and undersized stripes elsewhere in the table too,
+	 * as the compaction workers would. VACUUM run by users only does so when
+	 * asked to, as it used to leave those stripes to columnar.vacuum.
+	 */
+	bool compactionEnabled = IsAutoVacuumWorkerProcess() ?
+							 columnar_enable_autovacuum_compaction :
+							 columnar_enable_vacuum_compaction;
+	if (compactionEnabled)
+	{
+		ClearVacuumStatusFlags();
+		ColumnarVacuumCompact(rel, elevel);
+	}
+
 	/*
 	 * We don't have updates, deletes, or concurrent updates, so all we
 	 * care for now is truncating the unused space at the end of storage.
@@ -1524,6 +2406,12 @@ columnar_vacuum_rel(Relation rel, VacuumParams *params,
 
 	Assert(TransactionIdPrecedesOrEquals(freezeLimit, oldestXmin));
 
+	/* only index only scans use the visibility map */
+	if (nindexes > 0)
+	{
+		ColumnarVisibilityMapUpdate(rel, oldestXmin, elevel);
+	}
+
 	/*
 	 * Columnar storage doesn't hold any transaction IDs, so we can always
 	 * just advance to the most aggressive value.
@@ -1807,43 +2695,369 @@ ConditionalLockRelationWithTimeout(Relation rel, LOCKMODE lockMode, int timeout,
 }
 
 
+/*
+ * columnar_scan_analyze_next_block sets the scan up to return the rows of the
+ * chunk groups of the given block. Rows of columnar tables are not confined to
+ * blocks, so chunk group g is given to block floor(g * blocks / chunk groups)
+ * instead, which gives each chunk group the same probability to be sampled.
+ */
 static bool
 columnar_scan_analyze_next_block(TableScanDesc scan, BlockNumber blockno,
 								 BufferAccessStrategy bstrategy)
 {
-	/*
-	 * Our access method is not pages based, i.e. tuples are not confined
-	 * to pages boundaries. So not much to do here. We return true anyway
-	 * so acquire_sample_rows() in analyze.c would call our
-	 * columnar_scan_analyze_next_tuple() callback.
-	 */
-	return true;
+	ColumnarScanDesc columnarScan = (ColumnarScanDesc) scan;
+
+	if (columnarScan->sampleState == NULL)
+	{
+		ColumnarSampleState *sample = BeginColumnarSample(columnarScan);
+
+		sample->blockCount = Max(RelationGetNumberOfBlocks(scan->rs_rd), 1);
+		sample->decodeFraction = ColumnarAnalyzeDecodeFraction(scan->rs_rd,
+															   sample->chunkGroupCount,
+															   sample->blockCount);
+		columnarScan->sampleState = sample;
+	}
+
+	ColumnarSampleState *sample = columnarScan->sampleState;
+	sample->nextChunkGroup = ColumnarAnalyzeBlockFirstChunkGroup(sample, blockno);
+	sample->endChunkGroup = ColumnarAnalyzeBlockFirstChunkGroup(sample, blockno + 1);
+	sample->chunkGroupReadInProgress = false;
+
+	return sample->nextChunkGroup < sample->endChunkGroup;
 }
 
 
+/*
+ * columnar_scan_analyze_next_tuple returns the next row of the chunk groups of
+ * the current block that are decoded. Each chunk group is decoded with the same
+ * probability, chosen so that about as many chunk groups as the sample needs
+ * are decoded. Live and dead rows of the other chunk groups are counted from
+ * their metadata, and so are the dead rows of the decoded ones.
+ */
 static bool
 columnar_scan_analyze_next_tuple(TableScanDesc scan, TransactionId OldestXmin,
 								 double *liverows, double *deadrows,
 								 TupleTableSlot *slot)
 {
-	/*
-	 * Currently we don't do anything smart to reduce number of rows returned
-	 * for ANALYZE. The TableAM API's ANALYZE functions are designed for page
-	 * based access methods where it chooses random pages, and then reads
-	 * tuples from those pages.
-	 *
-	 * We could do something like that here by choosing sample stripes or chunks,
-	 * but getting that correct might need quite some work. Since columnar_fdw's
-	 * ANALYZE scanned all rows, as a starter we do the same here and scan all
-	 * rows.
-	 */
-	if (columnar_getnextslot(scan, ForwardScanDirection, slot))
+	ColumnarScanDesc columnarScan = (ColumnarScanDesc) scan;
+	ColumnarSampleState *sample = columnarScan->sampleState;
+
+	while (true)
+	{
+		if (sample->chunkGroupReadInProgress)
+		{
+			uint64 rowNumber = 0;
+			if (ColumnarSampleNextRow(columnarScan, slot, &rowNumber))
+			{
+				sample->chunkGroupRowsRead++;
+				(*liverows)++;
+				return true;
+			}
+
+			/* rows of the chunk group that the read skipped are deleted */
+			if (!sample->deltaStoreReadInProgress)
+			{
+				*deadrows += sample->chunkGroupRowCount - sample->chunkGroupRowsRead;
+			}
+
+			sample->chunkGroupReadInProgress = false;
+		}
+
+		if (!ColumnarAnalyzeNextChunkGroup(columnarScan, liverows, deadrows))
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * ColumnarAnalyzeNextChunkGroup moves to the next chunk group of the current
+ * block, and either starts decoding it or counts its rows from its metadata.
+ * Returns false if the block has no more chunk groups.
+ */
+static bool
+ColumnarAnalyzeNextChunkGroup(ColumnarScanDesc scan, double *liverows, double *deadrows)
+{
+	ColumnarSampleState *sample = scan->sampleState;
+	Relation relation = scan->cs_base.rs_rd;
+
+	if (sample->nextChunkGroup >= sample->endChunkGroup)
+	{
+		return false;
+	}
+
+	uint64 chunkGroup = sample->nextChunkGroup++;
+	bool decode = sample->decodeFraction >= 1.0 ||
+				  anl_random_fract() < sample->decodeFraction;
+
+	/* the last chunk group is the delta store */
+	if (chunkGroup == sample->chunkGroupCount - 1)
+	{
+		if (decode)
+		{
+			ColumnarSampleBeginChunkGroup(scan, chunkGroup);
+		}
+		else
+		{
+			uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+			*liverows += DeltaStoreRowCount(storageId, GetTransactionSnapshot());
+		}
+
+		return true;
+	}
+
+	int stripeIndex = ColumnarSampleStripeIndex(sample, chunkGroup);
+	StripeMetadata *stripeMetadata = sample->stripes[stripeIndex];
+	uint32 chunkGroupIndex = chunkGroup - sample->stripeFirstChunkGroup[stripeIndex];
+
+	if (sample->countedStripeIndex != stripeIndex)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(scan->scanContext);
+
+		if (sample->chunkGroupRowCounts != NULL)
+		{
+			pfree(sample->chunkGroupRowCounts);
+			pfree(sample->chunkGroupDeletedRows);
+		}
+
+		ChunkGroupRowCountsForStripe(relation->rd_node, stripeMetadata->chunkCount,
+									 stripeMetadata->id, &sample->chunkGroupRowCounts,
+									 &sample->chunkGroupDeletedRows);
+		sample->countedStripeIndex = stripeIndex;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	uint32 rowCount = sample->chunkGroupRowCounts[chunkGroupIndex];
+	uint32 deletedRows = sample->chunkGroupDeletedRows[chunkGroupIndex];
+
+	if (!decode || deletedRows >= rowCount)
 	{
-		(*liverows)++;
+		*liverows += rowCount - Min(deletedRows, rowCount);
+		*deadrows += Min(deletedRows, rowCount);
 		return true;
 	}
 
-	return false;
+	ColumnarSampleBeginChunkGroup(scan, chunkGroup);
+	sample->chunkGroupRowCount = rowCount;
+	sample->chunkGroupRowsRead = 0;
+
+	return true;
+}
+
+
+/*
+ * BeginColumnarSample creates the sampling state of the given scan from the
+ * flushed stripes of its relation, and the read state of the scan if it
+ * doesn't have one yet.
+ */
+static ColumnarSampleState *
+BeginColumnarSample(ColumnarScanDesc scan)
+{
+	Relation relation = scan->cs_base.rs_rd;
+
+	/* the read state flushes our pending writes, so create it first */
+	if (scan->cs_readState == NULL)
+	{
+		bool randomAccess = false;
+		scan->cs_readState =
+			init_columnar_read_state(relation, RelationGetDescr(relation),
+									 scan->attr_needed, NIL, scan->scanContext,
+									 scan->cs_base.rs_snapshot, randomAccess, NULL);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(scan->scanContext);
+
+	ColumnarSampleState *sample = palloc0(sizeof(ColumnarSampleState));
+
+	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+	sample->stripes = palloc0(Max(list_length(stripeList), 1) * sizeof(StripeMetadata *));
+	sample->stripeFirstChunkGroup = palloc0(Max(list_length(stripeList), 1) *
+											sizeof(uint64));
+
+	uint64 chunkGroupCount = 0;
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED ||
+			stripeMetadata->chunkCount == 0)
+		{
+			continue;
+		}
+
+		sample->stripes[sample->stripeCount] = stripeMetadata;
+		sample->stripeFirstChunkGroup[sample->stripeCount] = chunkGroupCount;
+		sample->stripeCount++;
+
+		chunkGroupCount += stripeMetadata->chunkCount;
+	}
+
+	/* one more for the delta store */
+	sample->chunkGroupCount = chunkGroupCount + 1;
+	sample->countedStripeIndex = -1;
+	sample->sampleBlock = InvalidBlockNumber;
+	sample->sampledOffset = InvalidOffsetNumber;
+
+	MemoryContextSwitchTo(oldContext);
+
+	return sample;
+}
+
+
+/*
+ * ColumnarAnalyzeDecodeFraction returns the fraction of the chunk groups of
+ * the sampled blocks to decode, so that ANALYZE decodes about one chunk group
+ * per ANALYZE_SAMPLE_ROWS_PER_CHUNK_GROUP rows it samples.
+ *
+ * ANALYZE doesn't tell the table access method how many rows it samples, so
+ * we compute it like std_typanalyze() does, from the largest statistics target
+ * of the columns.
+ */
+static double
+ColumnarAnalyzeDecodeFraction(Relation relation, uint64 chunkGroupCount,
+							  BlockNumber blockCount)
+{
+	TupleDesc tupleDesc = RelationGetDescr(relation);
+	int statisticsTarget = 0;
+
+	for (int attrIndex = 0; attrIndex < tupleDesc->natts; attrIndex++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(tupleDesc, attrIndex);
+		if (attr->attisdropped)
+		{
+			continue;
+		}
+
+		int attributeTarget = attr->attstattarget;
+		if (attributeTarget < 0)
+		{
+			attributeTarget = default_statistics_target;
+		}
+
+		statisticsTarget = Max(statisticsTarget, attributeTarget);
+	}
+
+	double targetRows = 300.0 * Max(statisticsTarget, 1);
+	double sampledBlocks = Min(targetRows, (double) blockCount);
+	double sampledChunkGroups = sampledBlocks * chunkGroupCount / blockCount;
+	double targetChunkGroups = Max(targetRows / ANALYZE_SAMPLE_ROWS_PER_CHUNK_GROUP,
+								   1.0);
+
+	return Min(targetChunkGroups / sampledChunkGroups, 1.0);
+}
+
+
+/*
+ * ColumnarAnalyzeBlockFirstChunkGroup returns the first chunk group given to
+ * the given block, or the first chunk group of the next block with chunk
+ * groups if the block has none.
+ */
+static uint64
+ColumnarAnalyzeBlockFirstChunkGroup(ColumnarSampleState *sample, BlockNumber blockno)
+{
+	if (blockno >= sample->blockCount)
+	{
+		return sample->chunkGroupCount;
+	}
+
+	/* the smallest g with floor(g * blocks / chunk groups) >= blockno */
+	double chunkGroup = ceil((double) blockno * sample->chunkGroupCount /
+							 sample->blockCount);
+
+	return Min((uint64) chunkGroup, sample->chunkGroupCount);
+}
+
+
+/*
+ * ColumnarSampleBeginChunkGroup starts reading the rows of the given chunk
+ * group, or of the delta store if it is the last one.
+ */
+static void
+ColumnarSampleBeginChunkGroup(ColumnarScanDesc scan, uint64 chunkGroup)
+{
+	ColumnarSampleState *sample = scan->sampleState;
+
+	sample->chunkGroupReadInProgress = true;
+	sample->sampleBlock = InvalidBlockNumber;
+	sample->sampledOffset = InvalidOffsetNumber;
+
+	if (chunkGroup == sample->chunkGroupCount - 1)
+	{
+		sample->deltaStoreReadInProgress = true;
+		sample->chunkGroupLastRowNumber = PG_UINT64_MAX;
+		return;
+	}
+
+	int stripeIndex = ColumnarSampleStripeIndex(sample, chunkGroup);
+	StripeMetadata *stripeMetadata = sample->stripes[stripeIndex];
+	uint32 chunkGroupIndex = chunkGroup - sample->stripeFirstChunkGroup[stripeIndex];
+
+	uint64 chunkGroupFirstRow = (uint64) chunkGroupIndex *
+								stripeMetadata->chunkGroupRowCount;
+	uint64 chunkGroupRowCount = Min(stripeMetadata->chunkGroupRowCount,
+									stripeMetadata->rowCount - chunkGroupFirstRow);
+
+	ColumnarReadSetChunkGroup(scan->cs_readState, stripeMetadata, chunkGroupIndex);
+
+	sample->deltaStoreReadInProgress = false;
+	sample->chunkGroupLastRowNumber = stripeMetadata->firstRowNumber +
+									  chunkGroupFirstRow + chunkGroupRowCount - 1;
+}
+
+
+/*
+ * ColumnarSampleNextRow stores the next row of the chunk group being read in
+ * the given slot. Returns false if the chunk group has no more rows.
+ */
+static bool
+ColumnarSampleNextRow(ColumnarScanDesc scan, TupleTableSlot *slot, uint64 *rowNumber)
+{
+	ColumnarSampleState *sample = scan->sampleState;
+
+	ExecClearTuple(slot);
+
+	bool rowFound = sample->deltaStoreReadInProgress ?
+					ColumnarReadDeltaStoreNextRow(scan->cs_readState, slot->tts_values,
+												  slot->tts_isnull, rowNumber) :
+					ColumnarReadChunkGroupNextRow(scan->cs_readState, slot->tts_values,
+												  slot->tts_isnull, rowNumber);
+	if (!rowFound)
+	{
+		return false;
+	}
+
+	ExecStoreVirtualTuple(slot);
+	slot->tts_tid = row_number_to_tid(*rowNumber);
+
+	return true;
+}
+
+
+/*
+ * ColumnarSampleStripeIndex returns the index of the stripe that has the
+ * given chunk group, which is not the delta store.
+ */
+static int
+ColumnarSampleStripeIndex(ColumnarSampleState *sample, uint64 chunkGroup)
+{
+	int low = 0;
+	int high = sample->stripeCount - 1;
+
+	while (low < high)
+	{
+		int middle = low + (high - low + 1) / 2;
+		if (sample->stripeFirstChunkGroup[middle] <= chunkGroup)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+
+	return low;
 }
 
 
@@ -1869,50 +3083,52 @@ columnar_index_build_range_scan(Relation columnarRelation,
 		ereport(ERROR, (errmsg("BRIN indexes on columnar tables are not supported")));
 	}
 
-	if (scan)
-	{
-		/*
-		 * Parallel scans on columnar tables are already discardad by
-		 * ColumnarGetRelationInfoHook but be on the safe side.
-		 */
-		elog(ERROR, "parallel scans on columnar are not supported");
-	}
-
-	/*
-	 * In a normal index build, we use SnapshotAny to retrieve all tuples. In
-	 * a concurrent build or during bootstrap, we take a regular MVCC snapshot
-	 * and index whatever's live according to that.
-	 */
-	TransactionId OldestXmin = InvalidTransactionId;
-	if (!IsBootstrapProcessingMode() && !indexInfo->ii_Concurrent)
-	{
-		/* ignore lazy VACUUM's */
-		OldestXmin = GetOldestNonRemovableTransactionId_compat(columnarRelation,
-															   PROCARRAY_FLAGS_VACUUM);
-	}
-
 	Snapshot snapshot = { 0 };
 	bool snapshotRegisteredByUs = false;
 
-	/*
-	 * For serial index build, we begin our own scan. We may also need to
-	 * register a snapshot whose lifetime is under our direct control.
-	 */
-	if (!TransactionIdIsValid(OldestXmin))
+	if (scan != NULL)
 	{
-		snapshot = RegisterSnapshot(GetTransactionSnapshot());
-		snapshotRegisteredByUs = true;
+		/*
+		 * Parallel index build. The scan was begun with the snapshot of the
+		 * parallel scan, and this participant reads the stripes it claims.
+		 */
+		snapshot = scan->rs_snapshot;
 	}
 	else
 	{
-		snapshot = SnapshotAny;
-	}
+		/*
+		 * In a normal index build, we use SnapshotAny to retrieve all tuples.
+		 * In a concurrent build or during bootstrap, we take a regular MVCC
+		 * snapshot and index whatever's live according to that.
+		 */
+		TransactionId OldestXmin = InvalidTransactionId;
+		if (!IsBootstrapProcessingMode() && !indexInfo->ii_Concurrent)
+		{
+			/* ignore lazy VACUUM's */
+			OldestXmin = GetOldestNonRemovableTransactionId_compat(columnarRelation,
+																   PROCARRAY_FLAGS_VACUUM);
+		}
 
-	int nkeys = 0;
-	ScanKeyData *scanKey = NULL;
-	bool allowAccessStrategy = true;
-	scan = table_beginscan_strat(columnarRelation, snapshot, nkeys, scanKey,
-								 allowAccessStrategy, allow_sync);
+		/*
+		 * For serial index build, we begin our own scan. We may also need to
+		 * register a snapshot whose lifetime is under our direct control.
+		 */
+		if (!TransactionIdIsValid(OldestXmin))
+		{
+			snapshot = RegisterSnapshot(GetTransactionSnapshot());
+			snapshotRegisteredByUs = true;
+		}
+		else
+		{
+			snapshot = SnapshotAny;
+		}
+
+		int nkeys = 0;
+		ScanKeyData *scanKey = NULL;
+		bool allowAccessStrategy = true;
+		scan = table_beginscan_strat(columnarRelation, snapshot, nkeys, scanKey,
+									 allowAccessStrategy, allow_sync);
+	}
 
 	if (progress)
 	{
@@ -2059,6 +3275,8 @@ ColumnarReadRowsIntoIndex(TableScanDesc scan, Relation indexRelation,
 			 * columnar_getnextslot guarantees that returned tuple will
 			 * always have a greater ItemPointer than the ones we fetched
 			 * before, so we directly use BlockNumber to report our progress.
+			 * Participants of a parallel build claim stripes in id order,
+			 * which is also row number order.
 			 */
 			Assert(lastReportedBlockNumber == InvalidBlockNumber ||
 				   currentBlockNumber >= lastReportedBlockNumber);
@@ -2332,77 +3550,314 @@ columnar_estimate_rel_size(Relation rel, int32 *attr_widths,
 }
 
 
+/*
+ * columnar_scan_bitmap_next_block prepares to return the rows of the given
+ * block of a bitmap heap scan. Our blocks are ranges of row numbers, see
+ * row_number_to_tid, and as the bitmap gives the blocks in order, we hand the
+ * sorted row numbers of each block to ColumnarReadNextRowNumber, which looks
+ * up a stripe only when the rows leave the current one. For parallel
+ * bitmap heap scans, the executor hands out the blocks of a shared bitmap to
+ * the workers, so each of them reads a disjoint set of row number ranges.
+ */
 static bool
-columnar_scan_sample_next_block(TableScanDesc scan, SampleScanState *scanstate)
+columnar_scan_bitmap_next_block(TableScanDesc sscan, TBMIterateResult *tbmres)
 {
-	elog(ERROR, "columnar_scan_sample_next_block not implemented");
-}
-
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
 
-static bool
-columnar_scan_sample_next_tuple(TableScanDesc scan, SampleScanState *scanstate,
-								TupleTableSlot *slot)
-{
-	elog(ERROR, "columnar_scan_sample_next_tuple not implemented");
-}
+	if (scan->bitmapRowNumbers == NULL)
+	{
+		scan->bitmapRowNumbers = MemoryContextAlloc(scan->scanContext,
+													VALID_ITEMPOINTER_OFFSETS *
+													sizeof(uint64));
+	}
 
+	/*
+	 * The offsets of exact blocks are sorted. For lossy blocks, we try all
+	 * offsets of the block and leave it to the executor to recheck the quals.
+	 */
+	bool lossy = tbmres->ntuples < 0;
+	int tupleCount = lossy ? (int) VALID_ITEMPOINTER_OFFSETS : tbmres->ntuples;
 
-static void
-ColumnarXactCallback(XactEvent event, void *arg)
-{
-	switch (event)
+	scan->bitmapRowCount = 0;
+	for (int tupleIndex = 0; tupleIndex < tupleCount; tupleIndex++)
 	{
-		case XACT_EVENT_COMMIT:
-		case XACT_EVENT_PARALLEL_COMMIT:
-		case XACT_EVENT_PREPARE:
-		{
-			/* nothing to do */
-			break;
-		}
+		OffsetNumber offset = lossy ? tupleIndex + FirstOffsetNumber :
+							  tbmres->offsets[tupleIndex];
 
-		case XACT_EVENT_ABORT:
-		case XACT_EVENT_PARALLEL_ABORT:
+		uint64 rowNumber = (uint64) tbmres->blockno * VALID_ITEMPOINTER_OFFSETS +
+						   offset - FirstOffsetNumber;
+		if (rowNumber == COLUMNAR_INVALID_ROW_NUMBER ||
+			rowNumber > COLUMNAR_MAX_ROW_NUMBER)
 		{
-			DiscardWriteStateForAllRels(GetCurrentSubTransactionId(), 0);
-			CleanupReadStateCache(GetCurrentSubTransactionId());
-			break;
+			continue;
 		}
 
-		case XACT_EVENT_PRE_COMMIT:
-		case XACT_EVENT_PARALLEL_PRE_COMMIT:
-		case XACT_EVENT_PRE_PREPARE:
-		{
-			FlushWriteStateForAllRels(GetCurrentSubTransactionId(), 0);
-			CleanupReadStateCache(GetCurrentSubTransactionId());
-			break;
-		}
+		scan->bitmapRowNumbers[scan->bitmapRowCount++] = rowNumber;
 	}
+
+	scan->bitmapRowsPending = true;
+
+	return scan->bitmapRowCount > 0;
 }
 
 
-static void
-ColumnarSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
-						SubTransactionId parentSubid, void *arg)
+/*
+ * columnar_scan_bitmap_next_tuple returns the next visible row of the block
+ * that columnar_scan_bitmap_next_block moved to. The read state is kept for
+ * the whole scan, so a chunk group that holds rows of consecutive blocks is
+ * decoded once.
+ */
+static bool
+columnar_scan_bitmap_next_tuple(TableScanDesc sscan, TBMIterateResult *tbmres,
+								TupleTableSlot *slot)
 {
-	switch (event)
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+	Relation relation = sscan->rs_rd;
+
+	if (scan->bitmapReadState == NULL)
 	{
-		case SUBXACT_EVENT_START_SUB:
-		case SUBXACT_EVENT_COMMIT_SUB:
+		/* without a projection for the slot, we need all columns */
+		Bitmapset *attr_needed = NULL;
+		if (!IndexFetchProjectionForSlot(slot, &attr_needed))
 		{
-			/* nothing to do */
-			break;
+			attr_needed = bms_add_range(NULL, 0, relation->rd_att->natts - 1);
 		}
 
-		case SUBXACT_EVENT_ABORT_SUB:
-		{
-			DiscardWriteStateForAllRels(mySubid, parentSubid);
-			CleanupReadStateCache(mySubid);
-			break;
-		}
+		/* the executor rechecks the quals of lossy blocks */
+		List *scanQual = NIL;
 
-		case SUBXACT_EVENT_PRE_COMMIT_SUB:
-		{
-			FlushWriteStateForAllRels(mySubid, parentSubid);
+		bool randomAccess = true;
+		scan->bitmapReadState = init_columnar_read_state(relation,
+														 slot->tts_tupleDescriptor,
+														 attr_needed, scanQual,
+														 scan->scanContext,
+														 sscan->rs_snapshot,
+														 randomAccess, NULL);
+	}
+
+	if (scan->bitmapRowsPending)
+	{
+		ColumnarReadSetRowNumbers(scan->bitmapReadState, scan->bitmapRowNumbers,
+								  scan->bitmapRowCount);
+		scan->bitmapRowsPending = false;
+	}
+
+	CHECK_FOR_INTERRUPTS();
+
+	ExecClearTuple(slot);
+
+	uint64 rowNumber = 0;
+	if (!ColumnarReadNextRowNumber(scan->bitmapReadState, slot->tts_values,
+								   slot->tts_isnull, &rowNumber))
+	{
+		return false;
+	}
+
+	slot->tts_tableOid = RelationGetRelid(relation);
+	slot->tts_tid = row_number_to_tid(rowNumber);
+	ExecStoreVirtualTuple(slot);
+
+	pgstat_count_heap_fetch(relation);
+
+	return true;
+}
+
+
+/*
+ * columnar_scan_sample_next_block moves to the next chunk group to sample. The
+ * chunk groups of the table, and its delta store as the last one, are given
+ * to the sampling method as blocks, so methods that choose the blocks, like
+ * SYSTEM, skip the I/O for the chunk groups they don't choose. The others,
+ * like BERNOULLI, read all chunk groups.
+ */
+static bool
+columnar_scan_sample_next_block(TableScanDesc scan, SampleScanState *scanstate)
+{
+	ColumnarScanDesc columnarScan = (ColumnarScanDesc) scan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+
+	if (columnarScan->sampleState == NULL)
+	{
+		columnarScan->sampleState = BeginColumnarSample(columnarScan);
+	}
+
+	ColumnarSampleState *sample = columnarScan->sampleState;
+	ColumnarSampleEndTupleBlock(sample, scanstate);
+
+	uint64 chunkGroup = 0;
+	if (tsm->NextSampleBlock)
+	{
+		BlockNumber nextBlock = tsm->NextSampleBlock(scanstate,
+													 (BlockNumber) sample->chunkGroupCount);
+		if (!BlockNumberIsValid(nextBlock))
+		{
+			sample->chunkGroupReadInProgress = false;
+			return false;
+		}
+
+		chunkGroup = nextBlock;
+	}
+	else
+	{
+		if (sample->nextChunkGroup >= sample->chunkGroupCount)
+		{
+			sample->nextChunkGroup = 0;
+			sample->chunkGroupReadInProgress = false;
+			return false;
+		}
+
+		chunkGroup = sample->nextChunkGroup++;
+	}
+
+	ColumnarSampleBeginChunkGroup(columnarScan, chunkGroup);
+
+	return true;
+}
+
+
+/*
+ * columnar_scan_sample_next_tuple returns the next row of the current chunk
+ * group that the sampling method chooses. Methods choose rows by the offsets
+ * of their item pointers within the block of the item pointers, so for each
+ * such block we walk the offsets the method returns along with the rows.
+ */
+static bool
+columnar_scan_sample_next_tuple(TableScanDesc scan, SampleScanState *scanstate,
+								TupleTableSlot *slot)
+{
+	ColumnarScanDesc columnarScan = (ColumnarScanDesc) scan;
+	ColumnarSampleState *sample = columnarScan->sampleState;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+
+	while (sample->chunkGroupReadInProgress)
+	{
+		uint64 rowNumber = 0;
+		if (!ColumnarSampleNextRow(columnarScan, slot, &rowNumber))
+		{
+			ColumnarSampleEndTupleBlock(sample, scanstate);
+			sample->chunkGroupReadInProgress = false;
+			break;
+		}
+
+		BlockNumber rowBlock = ItemPointerGetBlockNumber(&slot->tts_tid);
+		OffsetNumber rowOffset = ItemPointerGetOffsetNumber(&slot->tts_tid);
+
+		if (rowBlock != sample->sampleBlock)
+		{
+			ColumnarSampleEndTupleBlock(sample, scanstate);
+
+			/* the chunk group may end before the block does */
+			sample->sampleMaxOffset = VALID_ITEMPOINTER_OFFSETS;
+			if (sample->chunkGroupLastRowNumber / VALID_ITEMPOINTER_OFFSETS == rowBlock)
+			{
+				sample->sampleMaxOffset =
+					sample->chunkGroupLastRowNumber % VALID_ITEMPOINTER_OFFSETS +
+					FirstOffsetNumber;
+			}
+
+			sample->sampleBlock = rowBlock;
+			sample->sampledOffset = tsm->NextSampleTuple(scanstate, rowBlock,
+														 sample->sampleMaxOffset);
+		}
+
+		while (OffsetNumberIsValid(sample->sampledOffset) &&
+			   sample->sampledOffset < rowOffset)
+		{
+			sample->sampledOffset = tsm->NextSampleTuple(scanstate, rowBlock,
+														 sample->sampleMaxOffset);
+		}
+
+		if (sample->sampledOffset == rowOffset)
+		{
+			pgstat_count_heap_getnext(scan->rs_rd);
+			return true;
+		}
+	}
+
+	ExecClearTuple(slot);
+	return false;
+}
+
+
+/*
+ * ColumnarSampleEndTupleBlock asks the sampling method for the rest of the
+ * offsets it chooses in the current block of item pointers, since methods
+ * only start over with the next block once they returned all of them.
+ */
+static void
+ColumnarSampleEndTupleBlock(ColumnarSampleState *sample, SampleScanState *scanstate)
+{
+	TsmRoutine *tsm = scanstate->tsmroutine;
+
+	while (OffsetNumberIsValid(sample->sampledOffset))
+	{
+		sample->sampledOffset = tsm->NextSampleTuple(scanstate, sample->sampleBlock,
+													 sample->sampleMaxOffset);
+	}
+
+	sample->sampleBlock = InvalidBlockNumber;
+}
+
+
+static void
+ColumnarXactCallback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_PREPARE:
+		{
+			/* nothing to do */
+			break;
+		}
+
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+		{
+			DiscardWriteStateForAllRels(GetCurrentSubTransactionId(), 0);
+			CleanupReadStateCache(GetCurrentSubTransactionId());
+			ColumnarStorageForgetExtents();
+			break;
+		}
+
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PARALLEL_PRE_COMMIT:
+		case XACT_EVENT_PRE_PREPARE:
+		{
+			FlushWriteStateForAllRels(GetCurrentSubTransactionId(), 0);
+			CleanupReadStateCache(GetCurrentSubTransactionId());
+			ColumnarStorageSyncExtents();
+			break;
+		}
+	}
+}
+
+
+static void
+ColumnarSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
+						SubTransactionId parentSubid, void *arg)
+{
+	switch (event)
+	{
+		case SUBXACT_EVENT_START_SUB:
+		case SUBXACT_EVENT_COMMIT_SUB:
+		{
+			/* nothing to do */
+			break;
+		}
+
+		case SUBXACT_EVENT_ABORT_SUB:
+		{
+			DiscardWriteStateForAllRels(mySubid, parentSubid);
+			CleanupReadStateCache(mySubid);
+			TransactionReadCacheReset();
+			break;
+		}
+
+		case SUBXACT_EVENT_PRE_COMMIT_SUB:
+		{
+			FlushWriteStateForAllRels(mySubid, parentSubid);
 			CleanupReadStateCache(mySubid);
 			break;
 		}
@@ -2437,129 +3892,320 @@ columnar_tableam_init()
 
 
 /*
- * Get the number of chunks filtered out during the given scan.
+ * ColumnarScanSetVectorQual makes the vectorized reads of the given scan
+ * evaluate vector quals while they fill vectors, see ColumnarSetVectorQual().
  */
-int64
-ColumnarScanChunkGroupsFiltered(ColumnarScanDesc columnarScanDesc)
+void
+ColumnarScanSetVectorQual(ColumnarScanDesc columnarScanDesc, List *stageColumnLists,
+						  ColumnarVectorQualFunc qualFunc, void *qualState)
 {
-	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+	MemoryContext oldContext = MemoryContextSwitchTo(columnarScanDesc->scanContext);
+
+	columnarScanDesc->vectorQualStageColumnLists = copyObject(stageColumnLists);
+	columnarScanDesc->vectorQualFunc = qualFunc;
+	columnarScanDesc->vectorQualState = qualState;
+
+	MemoryContextSwitchTo(oldContext);
 
 	/* readState is initialized lazily */
-	if (readState != NULL)
-	{
-		return ColumnarReadChunkGroupsFiltered(readState);
-	}
-	else
+	if (columnarScanDesc->cs_readState != NULL)
 	{
-		return 0;
+		ColumnarSetVectorQual(columnarScanDesc->cs_readState, stageColumnLists,
+							  qualFunc, qualState);
 	}
 }
 
 
 /*
- * Implementation of TupleTableSlotOps.copy_heap_tuple for TTSOpsColumnar.
+ * ColumnarScanSetRowBound tells the given scan how many rows it is expected
+ * to return at most, see ColumnarSetRowBound().
  */
-static HeapTuple
-ColumnarSlotCopyHeapTuple(TupleTableSlot *slot)
+void
+ColumnarScanSetRowBound(ColumnarScanDesc columnarScanDesc, uint64 rowBound)
 {
-	Assert(!TTS_EMPTY(slot));
+	columnarScanDesc->rowBound = rowBound;
 
-	HeapTuple tuple = heap_form_tuple(slot->tts_tupleDescriptor,
-									  slot->tts_values,
-									  slot->tts_isnull);
-
-	/* slot->tts_tid is filled in columnar_getnextslot */
-	tuple->t_self = slot->tts_tid;
-
-	return tuple;
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
+	{
+		ColumnarSetRowBound(columnarScanDesc->cs_readState, rowBound);
+	}
 }
 
 
 /*
- * ColumnarTableDropHook
- *
- * Clean-up resources for columnar tables.
+ * ColumnarScanSetChunkGroupSummary makes the given scan answer chunk groups
+ * from their statistics where it can, see ColumnarSetChunkGroupSummary().
  */
-static void
-ColumnarTableDropHook(Oid relid)
+void
+ColumnarScanSetChunkGroupSummary(ColumnarScanDesc columnarScanDesc,
+								 ChunkGroupSummary *summary)
 {
-	/*
-	 * Lock relation to prevent it from being dropped and to avoid
-	 * race conditions in the next if block.
-	 */
-	LockRelationOid(relid, AccessShareLock);
+	columnarScanDesc->chunkGroupSummary = summary;
 
-	if (IsColumnarTableAmTable(relid))
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
 	{
-		/*
-		 * Drop metadata. No need to drop storage here since for
-		 * tableam tables storage is managed by postgres.
-		 */
-		Relation rel = table_open(relid, AccessExclusiveLock);
-		RelFileNode relfilenode = rel->rd_node;
+		ColumnarSetChunkGroupSummary(columnarScanDesc->cs_readState, summary);
+	}
+}
 
-		DeleteMetadataRows(relfilenode);
-		DeleteColumnarTableOptions(rel->rd_id, true);
 
-		MarkRelfilenodeDropped(relfilenode.relNode, GetCurrentSubTransactionId());
+/*
+ * ColumnarScanSetChunkGroupDelete makes the given scan mark the chunk groups
+ * covered by the quals of the delete deleted instead of reading them, see
+ * ColumnarSetChunkGroupDelete().
+ */
+void
+ColumnarScanSetChunkGroupDelete(ColumnarScanDesc columnarScanDesc,
+								ColumnarChunkGroupDelete *chunkGroupDelete)
+{
+	columnarScanDesc->chunkGroupDelete = chunkGroupDelete;
 
-		/* keep the lock since we did physical changes to the relation */
-		table_close(rel, NoLock);
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
+	{
+		ColumnarSetChunkGroupDelete(columnarScanDesc->cs_readState, chunkGroupDelete);
 	}
 }
 
 
 /*
- * Reject AFTER ... FOR EACH ROW triggers on columnar tables.
+ * ColumnarScanSetMergeRead makes the given scan return the rows in the order
+ * of the given sort key column, see ColumnarBeginMergeRead(). It has to be
+ * called before the first row is read.
  */
-static void
-ColumnarTriggerCreateHook(Oid tgid)
+void
+ColumnarScanSetMergeRead(ColumnarScanDesc columnarScanDesc, AttrNumber sortKeyColumn)
 {
-	/*
-	 * Fetch the pg_trigger tuple by the Oid of the trigger
-	 */
-	ScanKeyData skey[1];
-	Relation tgrel = table_open(TriggerRelationId, AccessShareLock);
+	Assert(columnarScanDesc->cs_readState == NULL);
 
-	ScanKeyInit(&skey[0],
-				Anum_pg_trigger_oid,
-				BTEqualStrategyNumber, F_OIDEQ,
-				ObjectIdGetDatum(tgid));
+	columnarScanDesc->mergeSortKeyColumn = sortKeyColumn;
+}
 
-	SysScanDesc tgscan = systable_beginscan(tgrel, TriggerOidIndexId, true,
-											SnapshotSelf, 1, skey);
 
-	HeapTuple tgtup = systable_getnext(tgscan);
+/*
+ * ColumnarScanSetStripeProjectionSummary makes the given scan answer stripes
+ * from their projections where it can, see ColumnarSetStripeProjectionSummary().
+ */
+void
+ColumnarScanSetStripeProjectionSummary(ColumnarScanDesc columnarScanDesc,
+									   StripeProjectionSummary *summary)
+{
+	columnarScanDesc->projectionSummary = summary;
 
-	if (!HeapTupleIsValid(tgtup))
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
 	{
-		table_close(tgrel, AccessShareLock);
-		return;
+		ColumnarSetStripeProjectionSummary(columnarScanDesc->cs_readState, summary);
 	}
+}
 
-	Form_pg_trigger tgrec = (Form_pg_trigger) GETSTRUCT(tgtup);
-
-	Oid tgrelid = tgrec->tgrelid;
-	int16 tgtype = tgrec->tgtype;
 
-	systable_endscan(tgscan);
-	table_close(tgrel, AccessShareLock);
+/*
+ * ColumnarScanSetTopNBound makes the given scan skip the chunk groups that
+ * can't hold rows of the top-N sort above it, see ColumnarSetTopNBound().
+ */
+void
+ColumnarScanSetTopNBound(ColumnarScanDesc columnarScanDesc, ColumnarTopNBound *bound)
+{
+	columnarScanDesc->topNBound = bound;
 
-	if (TRIGGER_FOR_ROW(tgtype) && TRIGGER_FOR_AFTER(tgtype) &&
-		IsColumnarTableAmTable(tgrelid))
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
 	{
-		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg(
-							"Foreign keys and AFTER ROW triggers are not supported for columnar tables"),
-						errhint("Consider an AFTER STATEMENT trigger instead.")));
+		ColumnarSetTopNBound(columnarScanDesc->cs_readState, bound);
 	}
 }
 
 
 /*
- * Capture create/drop events and dispatch to the proper action.
+ * ColumnarScanSetJoinKeyFilter makes the given scan skip the chunk groups
+ * none of whose join keys the hash join above it matches, see
+ * ColumnarSetJoinKeyFilter().
  */
-static void
+void
+ColumnarScanSetJoinKeyFilter(ColumnarScanDesc columnarScanDesc,
+							 ColumnarJoinKeyFilter *filter)
+{
+	columnarScanDesc->joinKeyFilter = filter;
+
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
+	{
+		ColumnarSetJoinKeyFilter(columnarScanDesc->cs_readState, filter);
+	}
+}
+
+
+/*
+ * ColumnarScanAddQual adds the given clauses to the quals that the scan skips
+ * stripes and chunk groups with, until the next rescan. See
+ * ColumnarAddScanQual().
+ */
+void
+ColumnarScanAddQual(ColumnarScanDesc columnarScanDesc, List *clauseList)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(columnarScanDesc->scanContext);
+
+	columnarScanDesc->addedQual = list_concat(columnarScanDesc->addedQual,
+											  copyObject(clauseList));
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* readState is initialized lazily */
+	if (columnarScanDesc->cs_readState != NULL)
+	{
+		ColumnarAddScanQual(columnarScanDesc->cs_readState, clauseList);
+	}
+}
+
+
+/*
+ * Get the number of chunks filtered out during the given scan.
+ */
+int64
+ColumnarScanChunkGroupsFiltered(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadChunkGroupsFiltered(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * ColumnarScanGetStatistics returns what the given scan read so far, or NULL
+ * if it hasn't read anything yet.
+ */
+const ColumnarReadStatistics *
+ColumnarScanGetStatistics(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState == NULL)
+	{
+		return NULL;
+	}
+
+	return ColumnarReadGetStatistics(readState);
+}
+
+
+/*
+ * Implementation of TupleTableSlotOps.copy_heap_tuple for TTSOpsColumnar.
+ */
+static HeapTuple
+ColumnarSlotCopyHeapTuple(TupleTableSlot *slot)
+{
+	Assert(!TTS_EMPTY(slot));
+
+	HeapTuple tuple = heap_form_tuple(slot->tts_tupleDescriptor,
+									  slot->tts_values,
+									  slot->tts_isnull);
+
+	/* slot->tts_tid is filled in columnar_getnextslot */
+	tuple->t_self = slot->tts_tid;
+
+	return tuple;
+}
+
+
+/*
+ * ColumnarTableDropHook
+ *
+ * Clean-up resources for columnar tables.
+ */
+static void
+ColumnarTableDropHook(Oid relid)
+{
+	/*
+	 * Lock relation to prevent it from being dropped and to avoid
+	 * race conditions in the next if block.
+	 */
+	LockRelationOid(relid, AccessShareLock);
+
+	if (IsColumnarTableAmTable(relid))
+	{
+		/*
+		 * Drop metadata. No need to drop storage here since for
+		 * tableam tables storage is managed by postgres.
+		 */
+		Relation rel = table_open(relid, AccessExclusiveLock);
+		RelFileNode relfilenode = rel->rd_node;
+
+		DeleteMetadataRows(relfilenode);
+		DeleteColumnarTableOptions(rel->rd_id, true);
+		DeleteMatviewRefreshState(rel->rd_id);
+
+		MarkRelfilenodeDropped(relfilenode.relNode, GetCurrentSubTransactionId());
+		ColumnarStatDropRelation(relid);
+
+		/* keep the lock since we did physical changes to the relation */
+		table_close(rel, NoLock);
+	}
+}
+
+
+/*
+ * Reject AFTER ... FOR EACH ROW triggers on columnar tables.
+ */
+static void
+ColumnarTriggerCreateHook(Oid tgid)
+{
+	/*
+	 * Fetch the pg_trigger tuple by the Oid of the trigger
+	 */
+	ScanKeyData skey[1];
+	Relation tgrel = table_open(TriggerRelationId, AccessShareLock);
+
+	ScanKeyInit(&skey[0],
+				Anum_pg_trigger_oid,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(tgid));
+
+	SysScanDesc tgscan = systable_beginscan(tgrel, TriggerOidIndexId, true,
+											SnapshotSelf, 1, skey);
+
+	HeapTuple tgtup = systable_getnext(tgscan);
+
+	if (!HeapTupleIsValid(tgtup))
+	{
+		table_close(tgrel, AccessShareLock);
+		return;
+	}
+
+	Form_pg_trigger tgrec = (Form_pg_trigger) GETSTRUCT(tgtup);
+
+	Oid tgrelid = tgrec->tgrelid;
+	int16 tgtype = tgrec->tgtype;
+
+	systable_endscan(tgscan);
+	table_close(tgrel, AccessShareLock);
+
+	if (TRIGGER_FOR_ROW(tgtype) && TRIGGER_FOR_AFTER(tgtype) &&
+		IsColumnarTableAmTable(tgrelid))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg(
+							"Foreign keys and AFTER ROW triggers are not supported for columnar tables"),
+						errhint("Consider an AFTER STATEMENT trigger instead.")));
+	}
+}
+
+
+/*
+ * Capture create/drop events and dispatch to the proper action.
+ */
+static void
 ColumnarTableAMObjectAccessHook(ObjectAccessType access, Oid classId, Oid objectId,
 								int subId, void *arg)
 {
@@ -2724,8 +4370,8 @@ static const TableAmRoutine columnar_am_methods = {
 
 	.relation_estimate_size = columnar_estimate_rel_size,
 
-	.scan_bitmap_next_block = NULL,
-	.scan_bitmap_next_tuple = NULL,
+	.scan_bitmap_next_block = columnar_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = columnar_scan_bitmap_next_tuple,
 	.scan_sample_next_block = columnar_scan_sample_next_block,
 	.scan_sample_next_tuple = columnar_scan_sample_next_tuple
 };
@@ -2749,9 +4395,10 @@ columnar_handler(PG_FUNCTION_ARGS)
 /*
  * detoast_values
  *
- * Detoast and decompress all values. If there's no work to do, return
- * original pointer; otherwise return a newly-allocated values array. Should
- * be called in per-tuple context.
+ * Detoast and decompress all values. Compressed values are only fetched, not
+ * decompressed, if columnar.preserve_compressed_values is set. If there's no
+ * work to do, return original pointer; otherwise return a newly-allocated
+ * values array. Should be called in per-tuple context.
  */
 static Datum *
 detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
@@ -2766,6 +4413,14 @@ detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
 		if (!isnull[i] && tupleDesc->attrs[i].attlen == -1 &&
 			VARATT_IS_EXTENDED(values[i]))
 		{
+			struct varlena *value = (struct varlena *) DatumGetPointer(values[i]);
+
+			/* compressed inline values are valid datums, so they can be kept */
+			if (columnar_preserve_compressed_values && VARATT_IS_COMPRESSED(value))
+			{
+				continue;
+			}
+
 			/* make a copy */
 			if (values == orig_values)
 			{
@@ -2774,9 +4429,21 @@ detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
 						 orig_values, sizeof(Datum) * natts);
 			}
 
-			/* will be freed when per-tuple context is reset */
-			struct varlena *new_value = (struct varlena *) DatumGetPointer(values[i]);
-			new_value = detoast_attr(new_value);
+			/*
+			 * Will be freed when per-tuple context is reset. Fetching an
+			 * external value without decompressing it leaves it compressed
+			 * inline if it was stored compressed.
+			 */
+			struct varlena *new_value = NULL;
+			if (columnar_preserve_compressed_values && VARATT_IS_EXTERNAL(value))
+			{
+				new_value = detoast_external_attr(value);
+			}
+			else
+			{
+				new_value = detoast_attr(value);
+			}
+
 			values[i] = PointerGetDatum(new_value);
 		}
 	}
@@ -2785,49 +4452,6 @@ detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
 }
 
 
-/*
- * ColumnarCheckLogicalReplication throws an error if the relation is
- * part of any publication. This should be called before any write to
- * a columnar table, because columnar changes are not replicated with
- * logical replication (similar to a row table without a replica
- * identity).
- */
-static void
-ColumnarCheckLogicalReplication(Relation rel)
-{
-	bool pubActionInsert = false;
-
-	if (!is_publishable_relation(rel))
-	{
-		return;
-	}
-
-#if PG_VERSION_NUM >= PG_VERSION_15
-	{
-		PublicationDesc pubdesc;
-
-		RelationBuildPublicationDesc(rel, &pubdesc);
-		pubActionInsert = pubdesc.pubactions.pubinsert;
-	}
-#else
-	if (rel->rd_pubactions == NULL)
-	{
-		GetRelationPublicationActions(rel);
-		Assert(rel->rd_pubactions != NULL);
-	}
-
-	pubActionInsert = rel->rd_pubactions->pubinsert;
-#endif
-
-	if (pubActionInsert)
-	{
-		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg(
-							"cannot insert into columnar table that is a part of a publication")));
-	}
-}
-
-
 /*
  * alter_columnar_table_set is a UDF exposed in postgres to change settings on a columnar
  * table. Calling this function on a non-columnar table gives an error.
@@ -2837,7 +4461,22 @@ ColumnarCheckLogicalReplication(Relation rel)
  *        table_name regclass,
  *        chunk_group_row_limit int DEFAULT NULL,
  *        stripe_row_limit int DEFAULT NULL,
- *        compression name DEFAULT null)
+ *        compression name DEFAULT null,
+ *        compression_level int DEFAULT NULL,
+ *        cache_quota int DEFAULT NULL,
+ *        bloom_filter_columns name[] DEFAULT NULL,
+ *        column_compression text[] DEFAULT NULL,
+ *        sort_key name DEFAULT NULL,
+ *        delta_store bool DEFAULT NULL,
+ *        stripe_size_limit int DEFAULT NULL,
+ *        zorder_columns name[] DEFAULT NULL,
+ *        projection_group_by name[] DEFAULT NULL,
+ *        projection_sum name[] DEFAULT NULL,
+ *        hll_columns name[] DEFAULT NULL,
+ *        shredded_keys text[] DEFAULT NULL,
+ *        auto_row_limits bool DEFAULT NULL,
+ *        bucket_by name DEFAULT NULL,
+ *        bucket_count int DEFAULT NULL)
  *
  * All arguments except the table name are optional. The UDF is supposed to be called
  * like:
@@ -2847,6 +4486,42 @@ ColumnarCheckLogicalReplication(Relation rel)
  * same. Multiple settings can be changed at the same time by providing multiple
  * arguments. Calling the argument with the NULL value will be interperted as not having
  * provided the argument.
+ *
+ * column_compression overrides the compression of single columns, each element
+ * has the form 'column=compression' or 'column=compression:level'. Columns
+ * without a level use the compression level of the table.
+ *
+ * sort_key names a column the rows of each stripe are sorted by before the
+ * stripe is written. zorder_columns instead orders them by the Z-order of
+ * several columns, so that the chunk groups are narrow in all of them.
+ * Setting one of them resets the other.
+ *
+ * delta_store makes small writes go to the row oriented delta store, see
+ * columnar_delta_store.c.
+ *
+ * stripe_size_limit flushes a stripe once its buffers use that many bytes,
+ * even if it has fewer than stripe_row_limit rows. 0 disables the limit.
+ *
+ * projection_group_by and projection_sum make each stripe keep row counts and
+ * sums grouped by the given columns, see columnar_projection.c.
+ *
+ * hll_columns makes each chunk keep a HyperLogLog sketch of the distinct
+ * values of the given columns, which approx_count_distinct merges for the
+ * chunk groups its quals fully cover, see columnar_hll.c.
+ *
+ * shredded_keys makes each chunk of a jsonb column keep statistics of the
+ * ->> values of some of its top level keys, each element has the form
+ * 'column=key'. Scans skip chunk groups by them for quals on those values,
+ * see columnar_shredded_keys.c.
+ *
+ * auto_row_limits makes the writer pick chunk_group_row_limit and
+ * stripe_row_limit for each stripe from the row width of the previous one,
+ * see columnar_writer.c.
+ *
+ * bucket_by and bucket_count make the writer put the rows of each stripe it
+ * flushes into bucket_count buckets by the hash of the given column, each in
+ * a stripe of its own. Joins and aggregates on the column then run bucket by
+ * bucket, see columnar_bucket.c.
  */
 PG_FUNCTION_INFO_V1(alter_columnar_table_set);
 Datum
@@ -2927,10 +4602,12 @@ alter_columnar_table_set(PG_FUNCTION_ARGS)
 	{
 		options.compressionLevel = PG_GETARG_INT32(4);
 		if (options.compressionLevel < COMPRESSION_LEVEL_MIN ||
-			options.compressionLevel > COMPRESSION_LEVEL_MAX)
+			options.compressionLevel > COMPRESSION_LEVEL_MAX ||
+			options.compressionLevel == 0)
 		{
 			ereport(ERROR, (errmsg("compression level out of range"),
-							errhint("compression level must be between %d and %d",
+							errhint("compression level must be between %d and %d, "
+									"except 0",
 									COMPRESSION_LEVEL_MIN,
 									COMPRESSION_LEVEL_MAX)));
 		}
@@ -2939,54 +4616,524 @@ alter_columnar_table_set(PG_FUNCTION_ARGS)
 								options.compressionLevel)));
 	}
 
-	if (ColumnarTableSetOptions_hook != NULL)
+	/* cache_quota => not null */
+	if (PG_NARGS() > 5 && !PG_ARGISNULL(5))
 	{
-		ColumnarTableSetOptions_hook(relationId, options);
+		options.cacheQuota = PG_GETARG_INT32(5);
+		if (options.cacheQuota < 0 ||
+			options.cacheQuota > CACHE_QUOTA_MAXIMUM)
+		{
+			ereport(ERROR, (errmsg("cache quota out of range"),
+							errhint("cache quota must be between 0 and %d megabytes",
+									CACHE_QUOTA_MAXIMUM)));
+		}
+
+		ereport(DEBUG1, (errmsg("updating cache quota to %d", options.cacheQuota)));
 	}
 
-	SetColumnarOptions(relationId, &options);
+	/* bloom_filter_columns => not null */
+	if (PG_NARGS() > 6 && !PG_ARGISNULL(6))
+	{
+		ArrayType *columnNameArray = PG_GETARG_ARRAYTYPE_P(6);
+		Datum *columnNames = NULL;
+		bool *columnNameNulls = NULL;
+		int columnNameCount = 0;
 
-	table_close(rel, NoLock);
+		deconstruct_array(columnNameArray, NAMEOID, NAMEDATALEN, false,
+						  'c', &columnNames, &columnNameNulls,
+						  &columnNameCount);
 
-	PG_RETURN_VOID();
-}
+		options.bloomFilterColumns = NULL;
+		for (int columnIndex = 0; columnIndex < columnNameCount; columnIndex++)
+		{
+			if (columnNameNulls[columnIndex])
+			{
+				continue;
+			}
 
+			char *columnName = NameStr(*DatumGetName(columnNames[columnIndex]));
+			AttrNumber attnum = get_attnum(relationId, columnName);
+			if (attnum == InvalidAttrNumber || attnum < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+								errmsg("column \"%s\" of relation \"%s\" does not "
+									   "exist", columnName,
+									   RelationGetRelationName(rel))));
+			}
 
-/*
- * alter_columnar_table_reset is a UDF exposed in postgres to reset the settings on a
- * columnar table. Calling this function on a non-columnar table gives an error.
- *
- * sql syntax:
- *   pg_catalog.alter_columnar_table_re
- *   teset(
- *        table_name regclass,
- *        chunk_group_row_limit bool DEFAULT FALSE,
- *        stripe_row_limit bool DEFAULT FALSE,
- *        compression bool DEFAULT FALSE)
- *
- * All arguments except the table name are optional. The UDF is supposed to be called
- * like:
- *   SELECT alter_columnar_table_set('table', compression => true);
- *
- * All options set to true will be reset to the default system value.
- */
-PG_FUNCTION_INFO_V1(alter_columnar_table_reset);
-Datum
-alter_columnar_table_reset(PG_FUNCTION_ARGS)
-{
-	Oid relationId = PG_GETARG_OID(0);
+			if (ColumnarBloomHashFunction(get_atttype(relationId, attnum)) == NULL)
+			{
+				ereport(ERROR, (errmsg("column \"%s\" has a type that cannot be "
+									   "hashed for a bloom filter", columnName)));
+			}
 
-	Relation rel = table_open(relationId, AccessExclusiveLock); /* ALTER TABLE LOCK */
-	if (!IsColumnarTableAmTable(relationId))
-	{
-		ereport(ERROR, (errmsg("table %s is not a columnar table",
-							   quote_identifier(RelationGetRelationName(rel)))));
+			options.bloomFilterColumns = bms_add_member(options.bloomFilterColumns,
+														attnum);
+		}
+
+		ereport(DEBUG1, (errmsg("updating bloom filter columns")));
 	}
 
-	if (!pg_class_ownercheck(relationId, GetUserId()))
+	/* column_compression => not null */
+	if (PG_NARGS() > 7 && !PG_ARGISNULL(7))
 	{
-		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
-					   get_rel_name(relationId));
+		ArrayType *optionArray = PG_GETARG_ARRAYTYPE_P(7);
+		Datum *optionDatums = NULL;
+		bool *optionNulls = NULL;
+		int optionCount = 0;
+
+		deconstruct_array(optionArray, TEXTOID, -1, false, 'i',
+						  &optionDatums, &optionNulls, &optionCount);
+
+		options.columnCompressionOptions = NIL;
+		for (int optionIndex = 0; optionIndex < optionCount; optionIndex++)
+		{
+			if (optionNulls[optionIndex])
+			{
+				continue;
+			}
+
+			char *optionString = TextDatumGetCString(optionDatums[optionIndex]);
+			ColumnCompressionOption *compressionOption =
+				ParseColumnCompressionOption(rel, optionString);
+
+			/* a later setting of the same column wins */
+			bool replaced = false;
+			ColumnCompressionOption *existingOption = NULL;
+			foreach_ptr(existingOption, options.columnCompressionOptions)
+			{
+				if (existingOption->attnum == compressionOption->attnum)
+				{
+					*existingOption = *compressionOption;
+					replaced = true;
+					break;
+				}
+			}
+
+			if (!replaced)
+			{
+				options.columnCompressionOptions =
+					lappend(options.columnCompressionOptions, compressionOption);
+			}
+		}
+
+		ereport(DEBUG1, (errmsg("updating column compression")));
+	}
+
+	/* sort_key => not null */
+	if (PG_NARGS() > 8 && !PG_ARGISNULL(8))
+	{
+		char *columnName = NameStr(*PG_GETARG_NAME(8));
+		AttrNumber attnum = get_attnum(relationId, columnName);
+		if (attnum == InvalidAttrNumber || attnum < 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" of relation \"%s\" does not "
+								   "exist", columnName,
+								   RelationGetRelationName(rel))));
+		}
+
+		TypeCacheEntry *typeEntry = lookup_type_cache(get_atttype(relationId, attnum),
+													  TYPECACHE_LT_OPR);
+		if (!OidIsValid(typeEntry->lt_opr))
+		{
+			ereport(ERROR, (errmsg("column \"%s\" has a type that cannot be "
+								   "sorted", columnName)));
+		}
+
+		options.sortKeyColumn = attnum;
+		options.zorderColumns = NULL;
+
+		ereport(DEBUG1, (errmsg("updating sort key to %s", columnName)));
+	}
+
+	/* delta_store => not null */
+	if (PG_NARGS() > 9 && !PG_ARGISNULL(9))
+	{
+		options.deltaStore = PG_GETARG_BOOL(9);
+		ereport(DEBUG1, (errmsg("updating delta store to %s",
+								options.deltaStore ? "true" : "false")));
+	}
+
+	/* stripe_size_limit => not null */
+	if (PG_NARGS() > 10 && !PG_ARGISNULL(10))
+	{
+		options.stripeSizeLimit = PG_GETARG_INT32(10);
+		if (options.stripeSizeLimit < 0 ||
+			options.stripeSizeLimit > STRIPE_SIZE_LIMIT_MAXIMUM)
+		{
+			ereport(ERROR, (errmsg("stripe size limit out of range"),
+							errhint("stripe size limit must be between 0 and %d bytes",
+									STRIPE_SIZE_LIMIT_MAXIMUM)));
+		}
+		ereport(DEBUG1, (errmsg("updating stripe size limit to %d",
+								options.stripeSizeLimit)));
+	}
+
+	/* zorder_columns => not null */
+	if (PG_NARGS() > 11 && !PG_ARGISNULL(11))
+	{
+		ArrayType *columnNameArray = PG_GETARG_ARRAYTYPE_P(11);
+		Datum *columnNames = NULL;
+		bool *columnNameNulls = NULL;
+		int columnNameCount = 0;
+
+		deconstruct_array(columnNameArray, NAMEOID, NAMEDATALEN, false,
+						  'c', &columnNames, &columnNameNulls,
+						  &columnNameCount);
+
+		Bitmapset *zorderColumns = NULL;
+		for (int columnIndex = 0; columnIndex < columnNameCount; columnIndex++)
+		{
+			if (columnNameNulls[columnIndex])
+			{
+				continue;
+			}
+
+			char *columnName = NameStr(*DatumGetName(columnNames[columnIndex]));
+			AttrNumber attnum = get_attnum(relationId, columnName);
+			if (attnum == InvalidAttrNumber || attnum < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+								errmsg("column \"%s\" of relation \"%s\" does not "
+									   "exist", columnName,
+									   RelationGetRelationName(rel))));
+			}
+
+			TypeCacheEntry *typeEntry =
+				lookup_type_cache(get_atttype(relationId, attnum), TYPECACHE_LT_OPR);
+			if (!OidIsValid(typeEntry->lt_opr))
+			{
+				ereport(ERROR, (errmsg("column \"%s\" has a type that cannot be "
+									   "sorted", columnName)));
+			}
+
+			zorderColumns = bms_add_member(zorderColumns, attnum);
+		}
+
+		int zorderColumnCount = bms_num_members(zorderColumns);
+		if (zorderColumnCount < 2 || zorderColumnCount > ZORDER_COLUMN_COUNT_MAXIMUM)
+		{
+			ereport(ERROR, (errmsg("zorder_columns must name between 2 and %d "
+								   "columns", ZORDER_COLUMN_COUNT_MAXIMUM),
+							errhint("Use sort_key to sort by a single column.")));
+		}
+
+		options.zorderColumns = zorderColumns;
+		options.sortKeyColumn = InvalidAttrNumber;
+
+		ereport(DEBUG1, (errmsg("updating zorder columns")));
+	}
+
+	/* projection_group_by => not null */
+	if (PG_NARGS() > 12 && !PG_ARGISNULL(12))
+	{
+		ArrayType *columnNameArray = PG_GETARG_ARRAYTYPE_P(12);
+		Datum *columnNames = NULL;
+		bool *columnNameNulls = NULL;
+		int columnNameCount = 0;
+
+		deconstruct_array(columnNameArray, NAMEOID, NAMEDATALEN, false,
+						  'c', &columnNames, &columnNameNulls,
+						  &columnNameCount);
+
+		Bitmapset *groupByColumns = NULL;
+		for (int columnIndex = 0; columnIndex < columnNameCount; columnIndex++)
+		{
+			if (columnNameNulls[columnIndex])
+			{
+				continue;
+			}
+
+			char *columnName = NameStr(*DatumGetName(columnNames[columnIndex]));
+			AttrNumber attnum = get_attnum(relationId, columnName);
+			if (attnum == InvalidAttrNumber || attnum < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+								errmsg("column \"%s\" of relation \"%s\" does not "
+									   "exist", columnName,
+									   RelationGetRelationName(rel))));
+			}
+
+			if (!get_typbyval(get_atttype(relationId, attnum)))
+			{
+				ereport(ERROR, (errmsg("column \"%s\" cannot be a projection "
+									   "group by column", columnName),
+								errdetail("Only columns of a type passed by value "
+										  "can be grouped by.")));
+			}
+
+			groupByColumns = bms_add_member(groupByColumns, attnum);
+		}
+
+		if (bms_num_members(groupByColumns) > PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM)
+		{
+			ereport(ERROR, (errmsg("projection_group_by can name at most %d "
+								   "columns",
+								   PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM)));
+		}
+
+		options.projectionGroupByColumns = groupByColumns;
+
+		ereport(DEBUG1, (errmsg("updating projection group by columns")));
+	}
+
+	/* projection_sum => not null */
+	if (PG_NARGS() > 13 && !PG_ARGISNULL(13))
+	{
+		ArrayType *columnNameArray = PG_GETARG_ARRAYTYPE_P(13);
+		Datum *columnNames = NULL;
+		bool *columnNameNulls = NULL;
+		int columnNameCount = 0;
+
+		deconstruct_array(columnNameArray, NAMEOID, NAMEDATALEN, false,
+						  'c', &columnNames, &columnNameNulls,
+						  &columnNameCount);
+
+		Bitmapset *sumColumns = NULL;
+		for (int columnIndex = 0; columnIndex < columnNameCount; columnIndex++)
+		{
+			if (columnNameNulls[columnIndex])
+			{
+				continue;
+			}
+
+			char *columnName = NameStr(*DatumGetName(columnNames[columnIndex]));
+			AttrNumber attnum = get_attnum(relationId, columnName);
+			if (attnum == InvalidAttrNumber || attnum < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+								errmsg("column \"%s\" of relation \"%s\" does not "
+									   "exist", columnName,
+									   RelationGetRelationName(rel))));
+			}
+
+			if (!StripeProjectionSumTypeSupported(get_atttype(relationId, attnum)))
+			{
+				ereport(ERROR, (errmsg("column \"%s\" cannot be a projection sum "
+									   "column", columnName),
+								errhint("Sums are kept for smallint, integer, real "
+										"and double precision columns.")));
+			}
+
+			sumColumns = bms_add_member(sumColumns, attnum);
+		}
+
+		options.projectionSumColumns = sumColumns;
+
+		ereport(DEBUG1, (errmsg("updating projection sum columns")));
+	}
+
+	/* hll_columns => not null */
+	if (PG_NARGS() > 14 && !PG_ARGISNULL(14))
+	{
+		ArrayType *columnNameArray = PG_GETARG_ARRAYTYPE_P(14);
+		Datum *columnNames = NULL;
+		bool *columnNameNulls = NULL;
+		int columnNameCount = 0;
+
+		deconstruct_array(columnNameArray, NAMEOID, NAMEDATALEN, false,
+						  'c', &columnNames, &columnNameNulls,
+						  &columnNameCount);
+
+		Bitmapset *hllColumns = NULL;
+		for (int columnIndex = 0; columnIndex < columnNameCount; columnIndex++)
+		{
+			if (columnNameNulls[columnIndex])
+			{
+				continue;
+			}
+
+			char *columnName = NameStr(*DatumGetName(columnNames[columnIndex]));
+			AttrNumber attnum = get_attnum(relationId, columnName);
+			if (attnum == InvalidAttrNumber || attnum < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+								errmsg("column \"%s\" of relation \"%s\" does not "
+									   "exist", columnName,
+									   RelationGetRelationName(rel))));
+			}
+
+			Form_pg_attribute attributeForm =
+				TupleDescAttr(RelationGetDescr(rel), attnum - 1);
+			if (!ColumnarHllTypeSupported(attributeForm->atttypid) ||
+				(OidIsValid(attributeForm->attcollation) &&
+				 !get_collation_isdeterministic(attributeForm->attcollation)))
+			{
+				ereport(ERROR, (errmsg("column \"%s\" cannot be a hll column",
+									   columnName),
+								errhint("Sketches are kept for integer, boolean, "
+										"date, time and timestamp columns, and "
+										"text under deterministic collations.")));
+			}
+
+			hllColumns = bms_add_member(hllColumns, attnum);
+		}
+
+		options.hllColumns = hllColumns;
+
+		ereport(DEBUG1, (errmsg("updating hll columns")));
+	}
+
+	/* shredded_keys => not null */
+	if (PG_NARGS() > 15 && !PG_ARGISNULL(15))
+	{
+		ArrayType *keyArray = PG_GETARG_ARRAYTYPE_P(15);
+		Datum *keyDatums = NULL;
+		bool *keyNulls = NULL;
+		int keyCount = 0;
+
+		deconstruct_array(keyArray, TEXTOID, -1, false, 'i',
+						  &keyDatums, &keyNulls, &keyCount);
+
+		options.shreddedKeys = NIL;
+		for (int keyIndex = 0; keyIndex < keyCount; keyIndex++)
+		{
+			if (keyNulls[keyIndex])
+			{
+				continue;
+			}
+
+			char *keyString = TextDatumGetCString(keyDatums[keyIndex]);
+			ColumnarShreddedKey *shreddedKey = ParseShreddedKeyOption(rel, keyString);
+
+			bool duplicate = false;
+			ColumnarShreddedKey *existingKey = NULL;
+			foreach_ptr(existingKey, options.shreddedKeys)
+			{
+				if (existingKey->attnum == shreddedKey->attnum &&
+					strcmp(existingKey->key, shreddedKey->key) == 0)
+				{
+					duplicate = true;
+					break;
+				}
+			}
+
+			if (!duplicate)
+			{
+				options.shreddedKeys = lappend(options.shreddedKeys, shreddedKey);
+			}
+		}
+
+		ereport(DEBUG1, (errmsg("updating shredded keys")));
+	}
+
+	/* auto_row_limits => not null */
+	if (PG_NARGS() > 16 && !PG_ARGISNULL(16))
+	{
+		options.autoRowLimits = PG_GETARG_BOOL(16);
+		ereport(DEBUG1, (errmsg("updating auto row limits to %s",
+								options.autoRowLimits ? "true" : "false")));
+	}
+
+	/* bucket_by, bucket_count => not null */
+	if ((PG_NARGS() > 17 && !PG_ARGISNULL(17)) ||
+		(PG_NARGS() > 18 && !PG_ARGISNULL(18)))
+	{
+		AttrNumber bucketColumn = options.bucketColumn;
+		uint32 bucketCount = options.bucketCount;
+
+		if (PG_NARGS() > 17 && !PG_ARGISNULL(17))
+		{
+			char *columnName = NameStr(*PG_GETARG_NAME(17));
+			bucketColumn = get_attnum(relationId, columnName);
+			if (bucketColumn == InvalidAttrNumber || bucketColumn < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+								errmsg("column \"%s\" of relation \"%s\" does not "
+									   "exist", columnName,
+									   RelationGetRelationName(rel))));
+			}
+
+			if (ColumnarBloomHashFunction(get_atttype(relationId, bucketColumn)) == NULL)
+			{
+				ereport(ERROR, (errmsg("column \"%s\" has a type that cannot be "
+									   "hashed into buckets", columnName)));
+			}
+		}
+
+		if (PG_NARGS() > 18 && !PG_ARGISNULL(18))
+		{
+			int32 newBucketCount = PG_GETARG_INT32(18);
+			if (newBucketCount < BUCKET_COUNT_MINIMUM ||
+				newBucketCount > BUCKET_COUNT_MAXIMUM)
+			{
+				ereport(ERROR, (errmsg("bucket count out of range"),
+								errhint("bucket count must be between %d and %d",
+										BUCKET_COUNT_MINIMUM, BUCKET_COUNT_MAXIMUM)));
+			}
+
+			bucketCount = newBucketCount;
+		}
+
+		if (bucketColumn == InvalidAttrNumber)
+		{
+			ereport(ERROR, (errmsg("bucket_count requires bucket_by")));
+		}
+
+		if (bucketCount == 0)
+		{
+			ereport(ERROR, (errmsg("bucket_by requires bucket_count")));
+		}
+
+		if (bucketColumn != options.bucketColumn || bucketCount != options.bucketCount)
+		{
+			ResetRelationBuckets(rel);
+		}
+
+		options.bucketColumn = bucketColumn;
+		options.bucketCount = bucketCount;
+		ereport(DEBUG1, (errmsg("updating bucket_by to %u buckets", bucketCount)));
+	}
+
+	if (ColumnarTableSetOptions_hook != NULL)
+	{
+		ColumnarTableSetOptions_hook(relationId, options);
+	}
+
+	SetColumnarOptions(relationId, &options);
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * alter_columnar_table_reset is a UDF exposed in postgres to reset the settings on a
+ * columnar table. Calling this function on a non-columnar table gives an error.
+ *
+ * sql syntax:
+ *   pg_catalog.alter_columnar_table_re
+ *   teset(
+ *        table_name regclass,
+ *        chunk_group_row_limit bool DEFAULT FALSE,
+ *        stripe_row_limit bool DEFAULT FALSE,
+ *        compression bool DEFAULT FALSE)
+ *
+ * All arguments except the table name are optional. The UDF is supposed to be called
+ * like:
+ *   SELECT alter_columnar_table_set('table', compression => true);
+ *
+ * All options set to true will be reset to the default system value.
+ */
+PG_FUNCTION_INFO_V1(alter_columnar_table_reset);
+Datum
+alter_columnar_table_reset(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	Relation rel = table_open(relationId, AccessExclusiveLock); /* ALTER TABLE LOCK */
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
 	}
 
 	ColumnarOptions options = { 0 };
@@ -3012,32 +5159,418 @@ alter_columnar_table_reset(PG_FUNCTION_ARGS)
 						options.stripeRowCount)));
 	}
 
-	/* compression => true */
-	if (!PG_ARGISNULL(3) && PG_GETARG_BOOL(3))
+	/* compression => true */
+	if (!PG_ARGISNULL(3) && PG_GETARG_BOOL(3))
+	{
+		options.compressionType = columnar_compression;
+		ereport(DEBUG1, (errmsg("resetting compression to %s",
+								CompressionTypeStr(options.compressionType))));
+	}
+
+	/* compression_level => true */
+	if (!PG_ARGISNULL(4) && PG_GETARG_BOOL(4))
+	{
+		options.compressionLevel = columnar_compression_level;
+		ereport(DEBUG1, (errmsg("reseting compression level to %d",
+								columnar_compression_level)));
+	}
+
+	/* cache_quota => true */
+	if (PG_NARGS() > 5 && !PG_ARGISNULL(5) && PG_GETARG_BOOL(5))
+	{
+		options.cacheQuota = 0;
+		ereport(DEBUG1, (errmsg("resetting cache quota to 0")));
+	}
+
+	/* bloom_filter_columns => true */
+	if (PG_NARGS() > 6 && !PG_ARGISNULL(6) && PG_GETARG_BOOL(6))
+	{
+		options.bloomFilterColumns = NULL;
+		ereport(DEBUG1, (errmsg("resetting bloom filter columns")));
+	}
+
+	/* column_compression => true */
+	if (PG_NARGS() > 7 && !PG_ARGISNULL(7) && PG_GETARG_BOOL(7))
+	{
+		options.columnCompressionOptions = NIL;
+		ereport(DEBUG1, (errmsg("resetting column compression")));
+	}
+
+	/* sort_key => true */
+	if (PG_NARGS() > 8 && !PG_ARGISNULL(8) && PG_GETARG_BOOL(8))
+	{
+		options.sortKeyColumn = InvalidAttrNumber;
+		ereport(DEBUG1, (errmsg("resetting sort key")));
+	}
+
+	/* delta_store => true */
+	if (PG_NARGS() > 9 && !PG_ARGISNULL(9) && PG_GETARG_BOOL(9))
+	{
+		options.deltaStore = false;
+		ereport(DEBUG1, (errmsg("resetting delta store")));
+	}
+
+	/* stripe_size_limit => true */
+	if (PG_NARGS() > 10 && !PG_ARGISNULL(10) && PG_GETARG_BOOL(10))
+	{
+		options.stripeSizeLimit = columnar_stripe_size_limit;
+		ereport(DEBUG1, (errmsg("resetting stripe size limit to %d",
+								options.stripeSizeLimit)));
+	}
+
+	/* zorder_columns => true */
+	if (PG_NARGS() > 11 && !PG_ARGISNULL(11) && PG_GETARG_BOOL(11))
+	{
+		options.zorderColumns = NULL;
+		ereport(DEBUG1, (errmsg("resetting zorder columns")));
+	}
+
+	/* projection_group_by => true */
+	if (PG_NARGS() > 12 && !PG_ARGISNULL(12) && PG_GETARG_BOOL(12))
+	{
+		options.projectionGroupByColumns = NULL;
+		ereport(DEBUG1, (errmsg("resetting projection group by columns")));
+	}
+
+	/* projection_sum => true */
+	if (PG_NARGS() > 13 && !PG_ARGISNULL(13) && PG_GETARG_BOOL(13))
+	{
+		options.projectionSumColumns = NULL;
+		ereport(DEBUG1, (errmsg("resetting projection sum columns")));
+	}
+
+	/* hll_columns => true */
+	if (PG_NARGS() > 14 && !PG_ARGISNULL(14) && PG_GETARG_BOOL(14))
+	{
+		options.hllColumns = NULL;
+		ereport(DEBUG1, (errmsg("resetting hll columns")));
+	}
+
+	/* shredded_keys => true */
+	if (PG_NARGS() > 15 && !PG_ARGISNULL(15) && PG_GETARG_BOOL(15))
+	{
+		options.shreddedKeys = NIL;
+		ereport(DEBUG1, (errmsg("resetting shredded keys")));
+	}
+
+	/* auto_row_limits => true */
+	if (PG_NARGS() > 16 && !PG_ARGISNULL(16) && PG_GETARG_BOOL(16))
+	{
+		options.autoRowLimits = columnar_auto_row_limits;
+		ereport(DEBUG1, (errmsg("resetting auto row limits to %s",
+								options.autoRowLimits ? "true" : "false")));
+	}
+
+	/* bucket_by => true */
+	if (PG_NARGS() > 17 && !PG_ARGISNULL(17) && PG_GETARG_BOOL(17))
+	{
+		if (options.bucketColumn != InvalidAttrNumber)
+		{
+			ResetRelationBuckets(rel);
+		}
+
+		options.bucketColumn = InvalidAttrNumber;
+		options.bucketCount = 0;
+		ereport(DEBUG1, (errmsg("resetting bucket_by")));
+	}
+
+	if (ColumnarTableSetOptions_hook != NULL)
+	{
+		ColumnarTableSetOptions_hook(relationId, options);
+	}
+
+	SetColumnarOptions(relationId, &options);
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ResetRelationBuckets makes the stripes of the given relation and the rows
+ * this backend has yet to flush to it forget their bucket, when its bucket_by
+ * option changes. Only stripes written with the current option are pruned by
+ * bucket.
+ */
+static void
+ResetRelationBuckets(Relation rel)
+{
+	ColumnarDisableWriteStateBuckets(rel->rd_node.relNode);
+	ResetStripeBuckets(rel);
+	TransactionReadCacheInvalidate(ColumnarStorageGetStorageId(rel, false));
+}
+
+/*
+ * ParseColumnCompressionOption parses a column_compression element of
+ * alter_columnar_table_set, which is 'column=compression' optionally followed
+ * by ':level', for a column of the given relation.
+ */
+static ColumnCompressionOption *
+ParseColumnCompressionOption(Relation rel, char *optionString)
+{
+	/* column names may contain '=', compression names never do */
+	char *compressionString = strrchr(optionString, '=');
+	if (compressionString == NULL || compressionString == optionString)
+	{
+		ereport(ERROR, (errmsg("invalid column compression \"%s\"", optionString),
+						errhint("column compression must be given as "
+								"column=compression or column=compression:level")));
+	}
+
+	char *columnName = pnstrdup(optionString, compressionString - optionString);
+	compressionString = pstrdup(compressionString + 1);
+
+	char *levelString = strchr(compressionString, ':');
+	if (levelString != NULL)
+	{
+		*levelString = '\0';
+		levelString++;
+	}
+
+	AttrNumber attnum = get_attnum(RelationGetRelid(rel), columnName);
+	if (attnum == InvalidAttrNumber || attnum < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not "
+							   "exist", columnName,
+							   RelationGetRelationName(rel))));
+	}
+
+	ColumnCompressionOption *compressionOption = palloc0(sizeof(ColumnCompressionOption));
+	compressionOption->attnum = attnum;
+	compressionOption->compressionType = ParseCompressionType(compressionString);
+	if (compressionOption->compressionType == COMPRESSION_TYPE_INVALID)
+	{
+		ereport(ERROR, (errmsg("unknown compression type for columnar table: %s",
+							   quote_identifier(compressionString))));
+	}
+
+	if (levelString != NULL)
+	{
+		char *levelEnd = NULL;
+		errno = 0;
+		long compressionLevel = strtol(levelString, &levelEnd, 10);
+		if (errno != 0 || levelEnd == levelString || *levelEnd != '\0' ||
+			compressionLevel < COMPRESSION_LEVEL_MIN ||
+			compressionLevel > COMPRESSION_LEVEL_MAX || compressionLevel == 0)
+		{
+			ereport(ERROR, (errmsg("compression level out of range"),
+							errhint("compression level must be between %d and %d, "
+									"except 0",
+									COMPRESSION_LEVEL_MIN,
+									COMPRESSION_LEVEL_MAX)));
+		}
+
+		compressionOption->compressionLevel = (int) compressionLevel;
+	}
+
+	return compressionOption;
+}
+
+
+/*
+ * ParseShreddedKeyOption parses a shredded_keys element of
+ * alter_columnar_table_set, which is 'column=key', for a jsonb column of the
+ * given relation. Keys may contain '=', column names may not.
+ */
+static ColumnarShreddedKey *
+ParseShreddedKeyOption(Relation rel, char *optionString)
+{
+	char *keyString = strchr(optionString, '=');
+	if (keyString == NULL || keyString == optionString || keyString[1] == '\0')
+	{
+		ereport(ERROR, (errmsg("invalid shredded key \"%s\"", optionString),
+						errhint("shredded keys must be given as column=key")));
+	}
+
+	char *columnName = pnstrdup(optionString, keyString - optionString);
+
+	AttrNumber attnum = get_attnum(RelationGetRelid(rel), columnName);
+	if (attnum == InvalidAttrNumber || attnum < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not "
+							   "exist", columnName,
+							   RelationGetRelationName(rel))));
+	}
+
+	if (get_atttype(RelationGetRelid(rel), attnum) != JSONBOID)
+	{
+		ereport(ERROR, (errmsg("column \"%s\" cannot have shredded keys",
+							   columnName),
+						errhint("Keys are shredded from jsonb columns.")));
+	}
+
+	ColumnarShreddedKey *shreddedKey = palloc0(sizeof(ColumnarShreddedKey));
+	shreddedKey->attnum = attnum;
+	shreddedKey->key = pstrdup(keyString + 1);
+
+	return shreddedKey;
+}
+
+
+/*
+ * train_compression_dictionary is a UDF that trains a zstd dictionary for a
+ * column of a columnar table from the data the column already has. Chunks of
+ * the column written with zstd afterwards are compressed with the dictionary,
+ * which keeps compression ratios of small chunks close to those of large
+ * ones. Returns the id of the new dictionary.
+ *
+ * sql syntax:
+ *   columnar.train_compression_dictionary(
+ *        table_name regclass,
+ *        column_name name,
+ *        dictionary_size int DEFAULT 65536)
+ */
+PG_FUNCTION_INFO_V1(train_compression_dictionary);
+Datum
+train_compression_dictionary(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	Name columnName = PG_GETARG_NAME(1);
+	int32 dictionarySize = PG_GETARG_INT32(2);
+
+	/* conflicts with itself, so dictionaries of a table are trained one by one */
+	Relation rel = table_open(relationId, ShareUpdateExclusiveLock);
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(relationId));
+	}
+
+	AttrNumber attnum = get_attnum(relationId, NameStr(*columnName));
+	if (attnum == InvalidAttrNumber || attnum < 0)
 	{
-		options.compressionType = columnar_compression;
-		ereport(DEBUG1, (errmsg("resetting compression to %s",
-								CompressionTypeStr(options.compressionType))));
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not "
+							   "exist", NameStr(*columnName),
+							   RelationGetRelationName(rel))));
 	}
 
-	/* compression_level => true */
-	if (!PG_ARGISNULL(4) && PG_GETARG_BOOL(4))
+	if (dictionarySize < COMPRESSION_DICTIONARY_SIZE_MIN ||
+		dictionarySize > COMPRESSION_DICTIONARY_SIZE_MAX)
 	{
-		options.compressionLevel = columnar_compression_level;
-		ereport(DEBUG1, (errmsg("reseting compression level to %d",
-								columnar_compression_level)));
+		ereport(ERROR, (errmsg("dictionary size out of range"),
+						errhint("dictionary size must be between %d and %d",
+								COMPRESSION_DICTIONARY_SIZE_MIN,
+								COMPRESSION_DICTIONARY_SIZE_MAX)));
 	}
 
-	if (ColumnarTableSetOptions_hook != NULL)
+	if (!ColumnarCompressionDictionarySupported())
 	{
-		ColumnarTableSetOptions_hook(relationId, options);
+		ereport(ERROR, (errmsg("compression dictionaries require a newer version "
+							   "of the columnar extension"),
+						errhint("Run ALTER EXTENSION columnar UPDATE.")));
 	}
 
-	SetColumnarOptions(relationId, &options);
+	/* zstd recommends training on about a hundred times the dictionary size */
+	StringInfo samples = makeStringInfo();
+	size_t *sampleSizes = NULL;
+	uint32 sampleCount =
+		CollectCompressionDictionarySamples(rel, attnum, (uint64) dictionarySize * 100,
+											samples, &sampleSizes);
+
+	bytea *dictionary = TrainCompressionDictionary(samples, sampleSizes, sampleCount,
+												   dictionarySize);
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	uint64 dictionaryId = SaveCompressionDictionary(storageId, attnum, dictionary);
 
 	table_close(rel, NoLock);
 
-	PG_RETURN_VOID();
+	PG_RETURN_INT64(dictionaryId);
+}
+
+
+/*
+ * CollectCompressionDictionarySamples appends the decompressed value streams
+ * of the chunks of the given column to samples, split into pieces of
+ * COMPRESSION_DICTIONARY_SAMPLE_SIZE bytes, until about maximumSampleBytes
+ * are collected. sampleSizes is set to the size of each piece, and the number
+ * of pieces is returned.
+ */
+static uint32
+CollectCompressionDictionarySamples(Relation rel, AttrNumber attnum,
+									uint64 maximumSampleBytes, StringInfo samples,
+									size_t **sampleSizes)
+{
+	uint32 sampleCount = 0;
+	uint32 sampleCapacity = 64;
+	*sampleSizes = palloc(sampleCapacity * sizeof(size_t));
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	List *stripeList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+	StringInfo valueBuffer = makeStringInfo();
+	StringInfo decompressedBuffer = makeStringInfo();
+
+	StripeMetadata *stripe = NULL;
+	foreach_ptr(stripe, stripeList)
+	{
+		if (samples->len >= maximumSampleBytes)
+		{
+			break;
+		}
+
+		if (StripeWriteState(stripe) != STRIPE_WRITE_FLUSHED ||
+			attnum > stripe->columnCount)
+		{
+			continue;
+		}
+
+		StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripe->id,
+													  tupleDescriptor,
+													  stripe->chunkCount,
+													  GetTransactionSnapshot());
+
+		for (uint32 chunkIndex = 0;
+			 chunkIndex < skipList->chunkCount && samples->len < maximumSampleBytes;
+			 chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[AttrNumberGetAttrOffset(attnum)][chunkIndex];
+			if (chunkSkipNode->valueLength == 0)
+			{
+				continue;
+			}
+
+			resetStringInfo(valueBuffer);
+			enlargeStringInfo(valueBuffer, chunkSkipNode->valueLength);
+			valueBuffer->len = chunkSkipNode->valueLength;
+			ColumnarStorageRead(rel, stripe->fileOffset + chunkSkipNode->valueChunkOffset,
+								valueBuffer->data, chunkSkipNode->valueLength);
+
+			DecompressBufferInto(valueBuffer, chunkSkipNode->valueCompressionType,
+								 chunkSkipNode->decompressedValueSize,
+								 chunkSkipNode->compressionDictionaryId,
+								 decompressedBuffer);
+
+			for (int sampleOffset = 0; sampleOffset < decompressedBuffer->len;
+				 sampleOffset += COMPRESSION_DICTIONARY_SAMPLE_SIZE)
+			{
+				int sampleSize = Min(COMPRESSION_DICTIONARY_SAMPLE_SIZE,
+									 decompressedBuffer->len - sampleOffset);
+
+				if (sampleCount == sampleCapacity)
+				{
+					sampleCapacity *= 2;
+					*sampleSizes = repalloc(*sampleSizes, sampleCapacity * sizeof(size_t));
+				}
+
+				appendBinaryStringInfo(samples, decompressedBuffer->data + sampleOffset,
+									   sampleSize);
+				(*sampleSizes)[sampleCount++] = sampleSize;
+			}
+		}
+	}
+
+	return sampleCount;
 }
 
 
@@ -3106,95 +5639,565 @@ downgrade_columnar_storage(PG_FUNCTION_ARGS)
 							   quote_identifier(RelationGetRelationName(rel)))));
 	}
 
-	ColumnarStorageUpdateIfNeeded(rel, false);
-
-	table_close(rel, AccessExclusiveLock);
-	PG_RETURN_VOID();
+	ColumnarStorageUpdateIfNeeded(rel, false);
+
+	table_close(rel, AccessExclusiveLock);
+	PG_RETURN_VOID();
+}
+
+typedef struct StripeHole
+{
+	uint64 fileOffset;
+	uint64 dataLength;
+} StripeHole;
+
+/*
+ * HolesForRelation returns a list of holes in the Relation id in the current
+ * MemoryContext.
+ */
+static List *HolesForRelation(Relation rel)
+{
+	List *holes = NIL;
+
+	/* Get current columnar options */
+	ColumnarOptions columnarOptions = { 0 };
+	ReadColumnarOptions(rel->rd_id, &columnarOptions);
+
+	ListCell *lc = NULL;
+
+	List *stripeMetadataList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
+	uint64 lastMinimalOffset = ColumnarFirstLogicalOffset;
+
+	foreach(lc, stripeMetadataList)
+	{
+		StripeMetadata * stripeMetadata = lfirst(lc);
+
+		if (ColumnarLogicalOffsetIsOffloaded(stripeMetadata->fileOffset))
+		{
+			continue;
+		}
+
+		/* Arbitrary check to see if the offset will be large enough, 10000 bytes is what was chosen. */
+		if (stripeMetadata->fileOffset == lastMinimalOffset || stripeMetadata->fileOffset - lastMinimalOffset < 10000) {
+			lastMinimalOffset = stripeMetadata->fileOffset + stripeMetadata->dataLength;
+			continue;
+		} else {
+			StripeHole * hole = palloc(sizeof(StripeHole));
+			hole->fileOffset = lastMinimalOffset;
+			hole->dataLength = stripeMetadata->fileOffset + stripeMetadata->dataLength - lastMinimalOffset;
+			lastMinimalOffset = stripeMetadata->fileOffset + stripeMetadata->dataLength;
+
+			holes = lappend(holes, hole);
+		}
+	}
+
+	return holes;
+}
+
+/*
+ * CompareFreeRangesByOffset orders free ranges by their logical offset.
+ */
+static int
+CompareFreeRangesByOffset(const void *left, const void *right)
+{
+	const ColumnarFreeRange *leftRange = left;
+	const ColumnarFreeRange *rightRange = right;
+
+	if (leftRange->logicalOffset != rightRange->logicalOffset)
+	{
+		return leftRange->logicalOffset < rightRange->logicalOffset ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * CompareFreeRangesByLength orders free ranges from the largest to the
+ * smallest.
+ */
+static int
+CompareFreeRangesByLength(const void *left, const void *right)
+{
+	const ColumnarFreeRange *leftRange = left;
+	const ColumnarFreeRange *rightRange = right;
+
+	if (leftRange->length != rightRange->length)
+	{
+		return leftRange->length > rightRange->length ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * RecordFreeRanges records the ranges of the storage of the given table that
+ * no stripe refers to as free, so that later writes fill them instead of
+ * growing the file. Stripes that are deleted but still seen by some snapshot
+ * keep their data until their metadata rows are pruned.
+ *
+ * The caller holds ExclusiveLock, so there are no writes whose data isn't in
+ * the stripe metadata yet.
+ */
+static void
+RecordFreeRanges(Relation rel)
+{
+	List *stripeList = StripeVersionsForRelfilenode(rel->rd_node);
+	int stripeCount = list_length(stripeList);
+
+	ColumnarFreeRange *usedRanges = palloc(sizeof(ColumnarFreeRange) * (stripeCount + 1));
+	int usedRangeCount = 0;
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (stripeMetadata->dataLength == 0 ||
+			ColumnarLogicalOffsetIsOffloaded(stripeMetadata->fileOffset))
+		{
+			continue;
+		}
+
+		usedRanges[usedRangeCount].logicalOffset = stripeMetadata->fileOffset;
+		usedRanges[usedRangeCount].length = stripeMetadata->dataLength;
+		usedRangeCount++;
+	}
+
+	qsort(usedRanges, usedRangeCount, sizeof(ColumnarFreeRange),
+		  CompareFreeRangesByOffset);
+
+	/* the space left after the last stripe is for truncation to take back */
+	ColumnarFreeRange *freeRanges = palloc(sizeof(ColumnarFreeRange) * (stripeCount + 1));
+	uint32 freeRangeCount = 0;
+	uint64 usedEnd = ColumnarFirstLogicalOffset;
+
+	for (int rangeIndex = 0; rangeIndex < usedRangeCount; rangeIndex++)
+	{
+		ColumnarFreeRange *usedRange = &usedRanges[rangeIndex];
+		if (usedRange->logicalOffset > usedEnd)
+		{
+			freeRanges[freeRangeCount].logicalOffset = usedEnd;
+			freeRanges[freeRangeCount].length = usedRange->logicalOffset - usedEnd;
+			freeRangeCount++;
+		}
+
+		usedEnd = Max(usedEnd, usedRange->logicalOffset + usedRange->length);
+	}
+
+	qsort(freeRanges, freeRangeCount, sizeof(ColumnarFreeRange),
+		  CompareFreeRangesByLength);
+
+	ColumnarStorageSetFreeRanges(rel, freeRanges, freeRangeCount);
+
+	pfree(usedRanges);
+	pfree(freeRanges);
+}
+
+
+/*
+ * This is a check whether we need to bail out of a vacuum, it is set by the
+ * signal handler, and checked by the vacuum UDF process.
+ */
+static bool need_to_bail = false;
+static int last_signal = 0;
+static struct sigaction abt_action;
+static struct sigaction int_action;
+static struct sigaction trm_action;
+static struct sigaction kil_action;
+
+/*
+ * vacuum_signal_handler - catch any signals sent during the UDF vacuum, and
+ * attempt to clean up as much as we can and bail as cleanly as possible.
+ */
+static void vacuum_signal_handler(int signal)
+{
+	elog(DEBUG3, "Received signal %d during a vacuum request", signal);
+
+	/* Set up the ability to bail from the vacuum, with needed information. */
+	need_to_bail = true;
+	last_signal = signal;
+}
+
+/*
+ * vacuum_columnar_table
+ */
+typedef struct StripeVacuumCandidate
+{
+	uint64 stripeId;
+	int32 stripeMetadataIndex;
+	uint32 candidateTotalSize;
+	uint32 activeRows;
+	StripeMetadata *stripeMetadata;
+
+	/*
+	 * Full chunk groups without deleted rows that are copied instead of
+	 * decoded, NULL if the candidate has none.
+	 */
+	bool *copiedChunkGroups;
+
+	/*
+	 * Online vacuums record where the rows of the candidate went as runs of
+	 * consecutive row numbers, see SwapOnlineVacuumCandidates.
+	 */
+	List *rowRuns;
+} StripeVacuumCandidate;
+
+typedef struct VacuumRowRun
+{
+	uint64 oldRowNumber;
+	uint64 newRowNumber;
+	uint32 rowCount;
+} VacuumRowRun;
+
+
+/*
+ * AddVacuumRowRun records that rowCount rows of a candidate starting at
+ * oldRowNumber were written starting at newRowNumber, extending the last
+ * run of the candidate if they continue it.
+ */
+static void
+AddVacuumRowRun(StripeVacuumCandidate *vacuumCandidate, uint64 oldRowNumber,
+				uint64 newRowNumber, uint32 rowCount)
+{
+	if (vacuumCandidate->rowRuns != NIL)
+	{
+		VacuumRowRun *lastRun = llast(vacuumCandidate->rowRuns);
+		if (lastRun->oldRowNumber + lastRun->rowCount == oldRowNumber &&
+			lastRun->newRowNumber + lastRun->rowCount == newRowNumber)
+		{
+			lastRun->rowCount += rowCount;
+			return;
+		}
+	}
+
+	/* runs outlive the memory context each candidate is rewritten in */
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(GetMemoryChunkContext(vacuumCandidate));
+
+	VacuumRowRun *rowRun = palloc(sizeof(VacuumRowRun));
+	rowRun->oldRowNumber = oldRowNumber;
+	rowRun->newRowNumber = newRowNumber;
+	rowRun->rowCount = rowCount;
+
+	vacuumCandidate->rowRuns = lappend(vacuumCandidate->rowRuns, rowRun);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+/*
+ * ReadVacuumCandidateBatch decodes the candidates from batchStart up to
+ * batchEnd in parallel workers, see ColumnarParallelReadStripeRows.
+ * Candidates with chunk groups to copy are left to the leader, and get no
+ * tuplestore.
+ */
+static Tuplestorestate **
+ReadVacuumCandidateBatch(Relation rel, List *vacuumCandidateList, int batchStart,
+						 int batchEnd, int parallelWorkers)
+{
+	uint32 batchSize = batchEnd - batchStart;
+	StripeMetadata **stripes = palloc(batchSize * sizeof(StripeMetadata *));
+	uint32 *rowLimits = palloc(batchSize * sizeof(uint32));
+	uint32 *batchOffsets = palloc(batchSize * sizeof(uint32));
+	uint32 stripeCount = 0;
+
+	for (int i = batchStart; i < batchEnd; i++)
+	{
+		StripeVacuumCandidate *vacuumCandidate = list_nth(vacuumCandidateList, i);
+		if (vacuumCandidate->copiedChunkGroups != NULL)
+		{
+			continue;
+		}
+
+		stripes[stripeCount] = vacuumCandidate->stripeMetadata;
+		rowLimits[stripeCount] = vacuumCandidate->activeRows;
+		batchOffsets[stripeCount] = i - batchStart;
+		stripeCount++;
+	}
+
+	Tuplestorestate **batchRows = NULL;
+	Tuplestorestate **stripeRows = NULL;
+	if (stripeCount > 0)
+	{
+		stripeRows = ColumnarParallelReadStripeRows(rel, stripes, rowLimits, stripeCount,
+													Min(parallelWorkers,
+														(int) stripeCount));
+	}
+
+	if (stripeRows != NULL)
+	{
+		batchRows = palloc0(batchSize * sizeof(Tuplestorestate *));
+		for (uint32 stripeIndex = 0; stripeIndex < stripeCount; stripeIndex++)
+		{
+			batchRows[batchOffsets[stripeIndex]] = stripeRows[stripeIndex];
+		}
+
+		pfree(stripeRows);
+	}
+
+	pfree(stripes);
+	pfree(rowLimits);
+	pfree(batchOffsets);
+
+	return batchRows;
+}
+
+
+/*
+ * CopiedChunkGroupsForCandidate returns which chunk groups of a vacuum
+ * candidate can be copied as they are, which are the full ones without
+ * deleted rows, or NULL if there are none. Stripes of tables with a sort
+ * key or Z-order columns are always decoded so that the new stripes are
+ * sorted, and so are those of tables with projections, so that the new
+ * stripes get one.
+ */
+static bool *
+CopiedChunkGroupsForCandidate(Relation rel, ColumnarOptions *columnarOptions,
+							  StripeMetadata *stripeMetadata,
+							  uint32 *chunkGroupRowCounts,
+							  uint32 *chunkGroupDeletedRows)
+{
+	if (columnarOptions->sortKeyColumn != InvalidAttrNumber ||
+		!bms_is_empty(columnarOptions->zorderColumns) ||
+		!bms_is_empty(columnarOptions->projectionGroupByColumns) ||
+		!bms_is_empty(columnarOptions->projectionSumColumns) ||
+		stripeMetadata->columnCount != RelationGetDescr(rel)->natts ||
+		stripeMetadata->chunkGroupRowCount != columnarOptions->chunkRowCount)
+	{
+		return NULL;
+	}
+
+	bool *copiedChunkGroups = palloc0(stripeMetadata->chunkCount * sizeof(bool));
+	bool anyCopied = false;
+
+	for (uint32 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount; chunkIndex++)
+	{
+		copiedChunkGroups[chunkIndex] =
+			chunkGroupRowCounts[chunkIndex] == columnarOptions->chunkRowCount &&
+			chunkGroupDeletedRows[chunkIndex] == 0;
+		anyCopied |= copiedChunkGroups[chunkIndex];
+	}
+
+	if (!anyCopied)
+	{
+		pfree(copiedChunkGroups);
+		return NULL;
+	}
+
+	return copiedChunkGroups;
 }
 
-typedef struct StripeHole
-{
-	uint64 fileOffset;
-	uint64 dataLength;
-} StripeHole;
 
 /*
- * HolesForRelation returns a list of holes in the Relation id in the current
- * MemoryContext.
+ * WriteVacuumCandidateChunkGroups moves the rows of a candidate chunk group
+ * by chunk group. Chunk groups to copy are appended first without being
+ * decoded, see ColumnarWriteChunkGroup, and then the live rows of the other
+ * chunk groups are decoded and written again. Chunk groups are only copied
+ * while the new stripe ends at a chunk boundary, the others have their rows
+ * written too.
+ *
+ * Only rows of the candidate are read, and the rows snapshot sees. If
+ * recordRowRuns is set, the row numbers the rows move to are recorded.
  */
-static List *HolesForRelation(Relation rel)
+static void
+WriteVacuumCandidateChunkGroups(Relation rel, StripeVacuumCandidate *vacuumCandidate,
+								ColumnarWriteState *writeState,
+								Bitmapset *attr_needed, MemoryContext scanContext,
+								Snapshot snapshot, bool recordRowRuns)
 {
-	List *holes = NIL;
+	TupleDesc tupleDesc = RelationGetDescr(rel);
+	StripeMetadata *stripeMetadata = vacuumCandidate->stripeMetadata;
+	StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+												  tupleDesc, stripeMetadata->chunkCount,
+												  GetTransactionSnapshot());
+	bool *copiedChunkGroups = palloc0(stripeMetadata->chunkCount * sizeof(bool));
 
-	/* Get current columnar options */
-	ColumnarOptions columnarOptions = { 0 };
-	ReadColumnarOptions(rel->rd_id, &columnarOptions);
+	for (uint32 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount; chunkIndex++)
+	{
+		uint64 newRowNumber = 0;
 
-	ListCell *lc = NULL;
+		if (vacuumCandidate->copiedChunkGroups != NULL &&
+			vacuumCandidate->copiedChunkGroups[chunkIndex] &&
+			ColumnarWriteChunkGroup(writeState, stripeMetadata, skipList, chunkIndex,
+									&newRowNumber))
+		{
+			copiedChunkGroups[chunkIndex] = true;
 
-	List *stripeMetadataList = StripesForRelfilenode(rel->rd_node, ForwardScanDirection);
-	uint64 lastMinimalOffset = ColumnarFirstLogicalOffset;
+			if (recordRowRuns)
+			{
+				AddVacuumRowRun(vacuumCandidate, stripeMetadata->firstRowNumber +
+								skipList->chunkGroupRowOffset[chunkIndex],
+								newRowNumber, skipList->chunkGroupRowCounts[chunkIndex]);
+			}
+		}
+	}
 
-	foreach(lc, stripeMetadataList)
-	{
-		StripeMetadata * stripeMetadata = lfirst(lc);
+	ColumnarReadState *readState = NULL;
+	Datum *values = palloc0(tupleDesc->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
 
-		/* Arbitrary check to see if the offset will be large enough, 10000 bytes is what was chosen. */
-		if (stripeMetadata->fileOffset == lastMinimalOffset || stripeMetadata->fileOffset - lastMinimalOffset < 10000) {
-			lastMinimalOffset = stripeMetadata->fileOffset + stripeMetadata->dataLength;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount; chunkIndex++)
+	{
+		if (copiedChunkGroups[chunkIndex] ||
+			skipList->chunkGroupDeletedRows[chunkIndex] ==
+			skipList->chunkGroupRowCounts[chunkIndex])
+		{
 			continue;
-		} else {
-			StripeHole * hole = palloc(sizeof(StripeHole));
-			hole->fileOffset = lastMinimalOffset;
-			hole->dataLength = stripeMetadata->fileOffset + stripeMetadata->dataLength - lastMinimalOffset;
-			lastMinimalOffset = stripeMetadata->fileOffset + stripeMetadata->dataLength;
+		}
 
-			holes = lappend(holes, hole);
+		if (readState == NULL)
+		{
+			readState = init_columnar_read_state(rel, tupleDesc, attr_needed, NIL,
+												 scanContext, snapshot, true, NULL);
+		}
+
+		uint64 oldRowNumber = 0;
+		ColumnarReadSetChunkGroup(readState, stripeMetadata, chunkIndex);
+		while (ColumnarReadChunkGroupNextRow(readState, values, nulls, &oldRowNumber))
+		{
+			uint64 newRowNumber = ColumnarWriteRow(writeState, values, nulls);
+
+			if (recordRowRuns)
+			{
+				AddVacuumRowRun(vacuumCandidate, oldRowNumber, newRowNumber, 1);
+			}
 		}
 	}
 
-	return holes;
+	if (readState != NULL)
+	{
+		ColumnarEndRead(readState);
+	}
+
+	pfree(copiedChunkGroups);
+	pfree(values);
+	pfree(nulls);
 }
 
-/*
- * This is a check whether we need to bail out of a vacuum, it is set by the
- * signal handler, and checked by the vacuum UDF process.
- */
-static bool need_to_bail = false;
-static int last_signal = 0;
-static struct sigaction abt_action;
-static struct sigaction int_action;
-static struct sigaction trm_action;
-static struct sigaction kil_action;
 
 /*
- * vacuum_signal_handler - catch any signals sent during the UDF vacuum, and
- * attempt to clean up as much as we can and bail as cleanly as possible.
+ * SwapOnlineVacuumCandidates removes the candidates an online vacuum has
+ * rewritten, so that their new stripes take their place once the
+ * transaction commits. The rows of the candidates were read without
+ * blocking writers, so rows deleted since then are still in the new stripes.
+ * ExclusiveLock lets in-progress deletes and updates finish and keeps new
+ * ones out, and the deletions they made are carried over to the new rows
+ * before the candidates are removed. Inserts only ever add new stripes, so
+ * they need nothing else.
+ *
+ * The lock is held until the vacuum is done, and expected to be taken while
+ * holding ShareUpdateExclusiveLock, so the candidates were not rewritten by
+ * someone else meanwhile.
  */
-static void vacuum_signal_handler(int signal)
+static void
+SwapOnlineVacuumCandidates(Relation rel, List *vacuumCandidateList)
 {
-	elog(DEBUG3, "Received signal %d during a vacuum request", signal);
+	if (vacuumCandidateList == NIL)
+	{
+		return;
+	}
 
-	/* Set up the ability to bail from the vacuum, with needed information. */
-	need_to_bail = true;
-	last_signal = signal;
+	LockRelation(rel, ExclusiveLock);
+
+	/* see the row masks of the flushed new stripes */
+	CommandCounterIncrement();
+	InvalidateCatalogSnapshot();
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	uint64 movedDeletions = 0;
+
+	StripeVacuumCandidate *vacuumCandidate = NULL;
+	foreach_ptr(vacuumCandidate, vacuumCandidateList)
+	{
+		StripeMetadata *stripeMetadata = vacuumCandidate->stripeMetadata;
+		StripeRowMasks *stripeRowMasks = ReadStripeRowMasks(rel->rd_node,
+															CurrentMemoryContext,
+															stripeMetadata->firstRowNumber,
+															stripeMetadata->rowCount);
+
+		VacuumRowRun *rowRun = NULL;
+		foreach_ptr(rowRun, vacuumCandidate->rowRuns)
+		{
+			for (uint32 rowIndex = 0; rowIndex < rowRun->rowCount; rowIndex++)
+			{
+				if (StripeRowMasksRowDeleted(stripeRowMasks,
+											 rowRun->oldRowNumber + rowIndex) &&
+					UpdateRowMask(rel->rd_node, storageId, GetTransactionSnapshot(),
+								  rowRun->newRowNumber + rowIndex))
+				{
+					movedDeletions++;
+				}
+			}
+		}
+
+		ColumnarVisibilityMapClearStripe(rel, stripeMetadata);
+		DeleteMetadataRowsForStripeId(rel->rd_node, stripeMetadata->id);
+		ColumnarInvalidateStripeListSummary(rel);
+	}
+
+	ereport(DEBUG1, (errmsg("\"%s\": swapped %d stripes, carried over " UINT64_FORMAT
+							" concurrent deletions", RelationGetRelationName(rel),
+							list_length(vacuumCandidateList), movedDeletions)));
 }
 
 /*
- * vacuum_columnar_table
+ * vacuum_columnar_table implements columnar._vacuum_internal. The optional
+ * cost_delay and cost_limit arguments throttle its reads and writes like
+ * vacuum_cost_delay and vacuum_cost_limit do for VACUUM, falling back to
+ * columnar.vacuum_cost_delay and columnar.vacuum_cost_limit when NULL.
  */
-typedef struct StripeVacuumCandidate
-{
-	uint64 stripeId;
-	int32 stripeMetadataIndex;
-	uint32 candidateTotalSize;
-	uint32 activeRows;
-	StripeMetadata *stripeMetadata;
-} StripeVacuumCandidate;
-
 PG_FUNCTION_INFO_V1(vacuum_columnar_table);
 Datum
 vacuum_columnar_table(PG_FUNCTION_ARGS)
+{
+	double costDelay = columnar_vacuum_cost_delay;
+	int costLimit = columnar_vacuum_cost_limit;
+
+	if (PG_NARGS() > 2 && !PG_ARGISNULL(2))
+	{
+		costDelay = PG_GETARG_FLOAT4(2);
+		if (costDelay < 0 || costDelay > 100)
+		{
+			ereport(ERROR, (errmsg("cost delay out of range"),
+							errhint("cost delay must be between 0 and 100 "
+									"milliseconds")));
+		}
+	}
+
+	if (PG_NARGS() > 3 && !PG_ARGISNULL(3))
+	{
+		costLimit = PG_GETARG_INT32(3);
+		if (costLimit < 1 || costLimit > 10000)
+		{
+			ereport(ERROR, (errmsg("cost limit out of range"),
+							errhint("cost limit must be between 1 and 10000")));
+		}
+	}
+
+	Datum result = 0;
+
+	ColumnarStorageBeginCostDelay(costDelay, costLimit);
+
+	PG_TRY();
+	{
+		result = CombineColumnarTableStripes(fcinfo);
+	}
+	PG_FINALLY();
+	{
+		ColumnarStorageEndCostDelay();
+	}
+	PG_END_TRY();
+
+	return result;
+}
+
+
+/*
+ * CombineColumnarTableStripes rewrites the undersized and heavily deleted
+ * stripes of the table for vacuum_columnar_table, and moves stripes into the
+ * space they leave behind.
+ */
+static Datum
+CombineColumnarTableStripes(PG_FUNCTION_ARGS)
 {
 	Oid relid = PG_GETARG_OID(0);
 	Relation rel = RelationIdGetRelation(relid);
@@ -3205,6 +6208,14 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 	bool completelyDone = false;
 	struct sigaction action;
 
+	/*
+	 * Online vacuums let writers in until they swap the stripes they have
+	 * rewritten, see SwapOnlineVacuumCandidates.
+	 */
+	bool online = columnar_online_vacuum;
+	LOCKMODE lockMode = online ? ShareUpdateExclusiveLock : ExclusiveLock;
+	List *rewrittenCandidateList = NIL;
+
 	/*
 	 * Set up signal handlers for any incoming signals during the vacuum,
 	 * killing during a write could cause corruption.  Give us time to
@@ -3239,7 +6250,16 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 		PG_RETURN_VOID();
 	}
 
-	LockRelation(rel, ExclusiveLock);
+	LockRelation(rel, lockMode);
+
+	/*
+	 * Stripes may be moved into any hole below, so the free ranges are
+	 * recorded again once they are in place.
+	 */
+	if (!online)
+	{
+		ColumnarStorageSetFreeRanges(rel, NULL, 0);
+	}
 
 	/* Get current columnar options */
 	ColumnarOptions columnarOptions = { 0 };
@@ -3282,21 +6302,38 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 		}
 
 		StripeMetadata * stripeMetadata = lfirst(lc);
-		uint32 stripeDeletedRows = DeletedRowsForStripe(rel->rd_node,
-												 		stripeMetadata->chunkCount,
-														stripeMetadata->id);
 
-		float percentageOfDeleteRows =
-			(float)stripeDeletedRows / (float)(stripeMetadata->rowCount);
+		/* offloaded stripes are cold, leave them where they are */
+		if (ColumnarLogicalOffsetIsOffloaded(stripeMetadata->fileOffset))
+		{
+			continue;
+		}
+
+		uint32 *chunkGroupRowCounts = NULL;
+		uint32 *chunkGroupDeletedRows = NULL;
+		ChunkGroupRowCountsForStripe(rel->rd_node, stripeMetadata->chunkCount,
+									 stripeMetadata->id, &chunkGroupRowCounts,
+									 &chunkGroupDeletedRows);
+
+		uint32 stripeDeletedRows = 0;
+		for (uint32 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount; chunkIndex++)
+		{
+			stripeDeletedRows += chunkGroupDeletedRows[chunkIndex];
+		}
+
+		double percentageOfDeleteRows =
+			(double)stripeDeletedRows / (double)(stripeMetadata->rowCount);
 
 		/*
-		 * If inspected stripe has less than 0.5 percent of maximum strip row size
-		 * or percentage of deleted rows is less than 20% we will skip this stripe
-		 * for vacuum.
+		 * Stripes that are at least half of the maximum stripe row count and
+		 * whose fraction of deleted rows isn't above
+		 * columnar.vacuum_deleted_rows_threshold are skipped for vacuum.
 		*/
 		if ((stripeMetadata->rowCount > columnarOptions.stripeRowCount * 0.5) &&
-			percentageOfDeleteRows <= 0.2f)
+			percentageOfDeleteRows <= columnar_vacuum_deleted_rows_threshold)
 		{
+			pfree(chunkGroupRowCounts);
+			pfree(chunkGroupDeletedRows);
 			continue;
 		}
 
@@ -3305,6 +6342,13 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 		vacuumCandidate->candidateTotalSize = stripeMetadata->rowCount - stripeDeletedRows;
 		vacuumCandidate->stripeMetadata = stripeMetadata;
 		vacuumCandidate->activeRows = stripeMetadata->rowCount - stripeDeletedRows;
+		vacuumCandidate->copiedChunkGroups =
+			CopiedChunkGroupsForCandidate(rel, &columnarOptions, stripeMetadata,
+										  chunkGroupRowCounts, chunkGroupDeletedRows);
+		vacuumCandidate->rowRuns = NIL;
+
+		pfree(chunkGroupRowCounts);
+		pfree(chunkGroupDeletedRows);
 
 		vacuumCandidatesStripeList = lappend(vacuumCandidatesStripeList, vacuumCandidate);
 	}
@@ -3316,8 +6360,16 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 	/* No quals for table rewrite */
 	List *scanQual = NIL;
 
-	/* Use SnapshotAny when re-writing table as heapAM does. */
+	/*
+	 * Use SnapshotAny when re-writing table as heapAM does. Online vacuums
+	 * read the rows committed by now instead, as deletes may still be in
+	 * progress, and those that commit later are carried over by the swap.
+	 */
 	Snapshot snapshot = SnapshotAny;
+	if (online)
+	{
+		snapshot = RegisterSnapshot(GetLatestSnapshot());
+	}
 
 	MemoryContext scanContext = CreateColumnarScanMemoryContext();
 	bool randomAccess = true;
@@ -3326,6 +6378,24 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 											columnarOptions,
 											tupleDesc);
 
+	/* the swap needs to know the row numbers rows are written to */
+	if (online)
+	{
+		ColumnarDisableStripeSort(writeState);
+	}
+
+	/*
+	 * Decoding the candidates can be done by parallel workers, a batch of
+	 * candidates at a time. Their rows are still written here, in candidate
+	 * order, since writes aren't allowed in parallel mode.
+	 */
+	int candidateCount = list_length(vacuumCandidatesStripeList);
+	int parallelWorkers = online ? 0 : ColumnarParallelVacuumWorkers(candidateCount);
+	Tuplestorestate **batchRows = NULL;
+	int batchStart = 0;
+	int batchEnd = 0;
+	int candidateIndex = 0;
+
 	/*
 	 * Combine the vacuum candidates into their own stripes appended to the rel, this
 	 * should clear out any space from partial stripes to make space to move stripes into.
@@ -3334,36 +6404,89 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 	{
 		StripeVacuumCandidate *vacuumCandidate = lfirst(lc);
 
+		if (parallelWorkers > 0 && candidateIndex == batchEnd)
+		{
+			batchStart = candidateIndex;
+			batchEnd = Min(candidateIndex + parallelWorkers * VACUUM_PARALLEL_BATCH_FACTOR,
+						   candidateCount);
+
+			/* don't decode candidates beyond the requested number of stripes */
+			if (stripeCount)
+			{
+				batchEnd = Min(batchEnd, candidateIndex + (int) (stripeCount - progress));
+			}
+
+			batchRows = ReadVacuumCandidateBatch(rel, vacuumCandidatesStripeList,
+												 batchStart, batchEnd,
+												 parallelWorkers);
+		}
+
 		MemoryContext combineContext = AllocSetContextCreate(CurrentMemoryContext,
 						"Stripe Combine Context", ALLOCSET_DEFAULT_SIZES);
 		MemoryContext previousContext = MemoryContextSwitchTo(combineContext);
 
-		ColumnarReadState *readState = init_columnar_read_state(rel, tupleDesc,
-															attr_needed, scanQual,
-															scanContext, snapshot,
-															randomAccess,
-															NULL);
+		Tuplestorestate *candidateRows = NULL;
+		if (batchRows != NULL && candidateIndex < batchEnd)
+		{
+			candidateRows = batchRows[candidateIndex - batchStart];
+		}
+
+		if (candidateRows != NULL)
+		{
+			WriteTuplestoreRows(candidateRows, tupleDesc, writeState);
+			tuplestore_end(candidateRows);
+			batchRows[candidateIndex - batchStart] = NULL;
+		}
+		else if (vacuumCandidate->copiedChunkGroups != NULL || online)
+		{
+			WriteVacuumCandidateChunkGroups(rel, vacuumCandidate, writeState,
+											attr_needed, scanContext, snapshot,
+											online);
+		}
+		else
+		{
+			ColumnarReadState *readState = init_columnar_read_state(rel, tupleDesc,
+																attr_needed, scanQual,
+																scanContext, snapshot,
+																randomAccess,
+																NULL);
 
 
-		ColumnarSetStripeReadState(readState,
-								vacuumCandidate->stripeMetadata);
+			ColumnarSetStripeReadState(readState,
+									vacuumCandidate->stripeMetadata);
 
-		Datum *values = palloc0(tupleDesc->natts * sizeof(Datum));
-		bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
+			Datum *values = palloc0(tupleDesc->natts * sizeof(Datum));
+			bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
 
-		int32 rowCount = 0;
+			int32 rowCount = 0;
 
-		while (rowCount < vacuumCandidate->activeRows && ColumnarReadNextRow(readState, values, nulls, NULL))
-		{
-			ColumnarWriteRow(writeState, values, nulls);
-			rowCount++;
+			while (rowCount < vacuumCandidate->activeRows && ColumnarReadNextRow(readState, values, nulls, NULL))
+			{
+				ColumnarWriteRow(writeState, values, nulls);
+				rowCount++;
+			}
+
+			ColumnarEndRead(readState);
+
+			pfree(values);
+			pfree(nulls);
 		}
 
-		DeleteMetadataRowsForStripeId(rel->rd_node, vacuumCandidate->stripeMetadata->id);
-		ColumnarEndRead(readState);
+		if (online)
+		{
+			MemoryContextSwitchTo(previousContext);
+			rewrittenCandidateList = lappend(rewrittenCandidateList, vacuumCandidate);
+			MemoryContextSwitchTo(combineContext);
+		}
+		else
+		{
+			ColumnarVisibilityMapClearStripe(rel, vacuumCandidate->stripeMetadata);
+			DeleteMetadataRowsForStripeId(rel->rd_node,
+										  vacuumCandidate->stripeMetadata->id);
+			ColumnarInvalidateStripeListSummary(rel);
+		}
 
-		pfree(values);
-		pfree(nulls);
+		candidateIndex++;
 
 		progress++;
 
@@ -3371,7 +6494,14 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 		if (need_to_bail)
 		{
 			ColumnarEndWrite(writeState);
-			UnlockRelation(rel, ExclusiveLock);
+			if (online)
+			{
+				/* candidates written so far must not stay next to their copies */
+				SwapOnlineVacuumCandidates(rel, rewrittenCandidateList);
+				UnregisterSnapshot(snapshot);
+				UnlockRelation(rel, ExclusiveLock);
+			}
+			UnlockRelation(rel, lockMode);
 			relation_close(rel, NoLock);
 
 			need_to_bail = 0;
@@ -3416,8 +6546,33 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 
 	elog(DEBUG3, "Combined %d stripes", progress);
 
+	/*
+	 * Online vacuums leave moving stripes into holes and truncating the table
+	 * to a later vacuum, as both would block writers.
+	 */
+	if (online)
+	{
+		SwapOnlineVacuumCandidates(rel, rewrittenCandidateList);
+		UnregisterSnapshot(snapshot);
+
+		relation_close(rel, NoLock);
+		UnlockRelation(rel, ExclusiveLock);
+		UnlockRelation(rel, lockMode);
+
+		MemoryContextSwitchTo(oldcontext);
+
+		/* Reset the signal handlers back to their original state. */
+		sigaction(SIGINT, &int_action, NULL);
+		sigaction(SIGTERM, &trm_action, NULL);
+		sigaction(SIGABRT, &abt_action, NULL);
+		sigaction(SIGKILL, &kil_action, NULL);
+
+		PG_RETURN_UINT32(progress);
+	}
+
 	if (completelyDone)
 	{
+		RecordFreeRanges(rel);
 		relation_close(rel, NoLock);
 		TruncateColumnar(rel, DEBUG3);
 		UnlockRelation(rel, ExclusiveLock);
@@ -3506,7 +6661,8 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 				}
 
 				/* Find one that will fit, and move it. */
-				if (hole->fileOffset && stripe->dataLength < hole->dataLength && stripe->fileOffset > hole->fileOffset)
+				if (hole->fileOffset && stripe->dataLength < hole->dataLength && stripe->fileOffset > hole->fileOffset &&
+					!ColumnarLogicalOffsetIsOffloaded(stripe->fileOffset))
 				{
 					/* Read a copy of the old row. */
 					char * data = palloc(stripe->dataLength);
@@ -3546,6 +6702,7 @@ vacuum_columnar_table(PG_FUNCTION_ARGS)
 
 	elog(DEBUG3, "Ending reorganization");
 
+	RecordFreeRanges(rel);
 	relation_close(rel, NoLock);
 
 	TruncateColumnar(rel, DEBUG3);
@@ -3673,3 +6830,90 @@ columnar_stats(PG_FUNCTION_ARGS)
 		SRF_RETURN_DONE(funcctx);
 	}
 }
+
+
+/* compression types decompression statistics are returned for */
+static const CompressionType DecompressionStatisticsTypes[] = {
+	COMPRESSION_PG_LZ,
+	COMPRESSION_LZ4,
+	COMPRESSION_ZSTD
+};
+
+/* We return 6 columns. */
+#define DECOMPRESSION_STATS_NATTS 6
+
+/*
+ * columnar_decompression_stats returns the number of chunks each compression
+ * type decompressed in this backend, the bytes read and produced, the time
+ * spent, and the resulting throughput in megabytes of decompressed data per
+ * second. Compression types that are not compiled in are skipped.
+ */
+PG_FUNCTION_INFO_V1(columnar_decompression_stats);
+Datum
+columnar_decompression_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	TupleDesc tupdesc;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		funcctx = SRF_FIRSTCALL_INIT();
+
+		MemoryContext oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("function returning record called in context "
+								   "that cannot accept type record")));
+		}
+
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+		funcctx->max_calls = lengthof(DecompressionStatisticsTypes);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+
+	const DecompressionStatistics *statisticsArray = ColumnarDecompressionStatistics();
+
+	while (funcctx->call_cntr < funcctx->max_calls)
+	{
+		CompressionType compressionType =
+			DecompressionStatisticsTypes[funcctx->call_cntr];
+		const char *compressionName = CompressionTypeStr(compressionType);
+		if (compressionName == NULL)
+		{
+			funcctx->call_cntr++;
+			continue;
+		}
+
+		const DecompressionStatistics *statistics = &statisticsArray[compressionType];
+
+		Datum values[DECOMPRESSION_STATS_NATTS] = { 0 };
+		bool nulls[DECOMPRESSION_STATS_NATTS] = { 0 };
+
+		values[0] = CStringGetTextDatum(compressionName);
+		values[1] = Int64GetDatum(statistics->chunkCount);
+		values[2] = Int64GetDatum(statistics->compressedBytes);
+		values[3] = Int64GetDatum(statistics->decompressedBytes);
+		values[4] = Float8GetDatum(statistics->elapsedMicroseconds / 1000.0);
+
+		if (statistics->elapsedMicroseconds > 0)
+		{
+			values[5] = Float8GetDatum((statistics->decompressedBytes / 1048576.0) /
+									   (statistics->elapsedMicroseconds / 1000000.0));
+		}
+		else
+		{
+			nulls[5] = true;
+		}
+
+		HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
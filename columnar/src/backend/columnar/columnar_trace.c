@@ -0,0 +1,139 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_trace.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Names of the wait events of columnar, see columnar_trace.h.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_authid.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/proc.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+#include "pg_version_compat.h"
+
+#include "columnar/columnar_trace.h"
+
+#define WAIT_EVENTS_NATTS 2
+
+PG_FUNCTION_INFO_V1(columnar_wait_events);
+
+
+/*
+ * ColumnarWaitEventName returns the name of the given columnar wait event, or
+ * NULL if it is not one.
+ */
+const char *
+ColumnarWaitEventName(uint32 waitEventInfo)
+{
+	switch ((ColumnarWaitEvent) waitEventInfo)
+	{
+		case WAIT_EVENT_COLUMNAR_STORAGE_READ:
+		{
+			return "ColumnarStorageRead";
+		}
+
+		case WAIT_EVENT_COLUMNAR_STORAGE_WRITE:
+		{
+			return "ColumnarStorageWrite";
+		}
+
+		case WAIT_EVENT_COLUMNAR_DECOMPRESS:
+		{
+			return "ColumnarDecompress";
+		}
+
+		case WAIT_EVENT_COLUMNAR_SKIP_LIST_READ:
+		{
+			return "ColumnarSkipListRead";
+		}
+
+		case WAIT_EVENT_COLUMNAR_ROW_MASK_READ:
+		{
+			return "ColumnarRowMaskRead";
+		}
+
+		case WAIT_EVENT_COLUMNAR_STRIPE_FLUSH:
+		{
+			return "ColumnarStripeFlush";
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * columnar_wait_events returns the backends that are in a columnar wait event
+ * and the name of it, which pg_stat_activity can only show as Extension.
+ * Like there, the wait events of the backends of other roles are only shown
+ * to members of pg_read_all_stats.
+ */
+Datum
+columnar_wait_events(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc tupleDescriptor = NULL;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("function returning record called in context "
+							   "that cannot accept type record")));
+	}
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	MemoryContextSwitchTo(oldContext);
+
+	bool readAllStats = has_privs_of_role(GetUserId(), ROLE_PG_READ_ALL_STATS);
+
+	for (uint32 procIndex = 0; procIndex < ProcGlobal->allProcCount; procIndex++)
+	{
+		PGPROC *proc = &ProcGlobal->allProcs[procIndex];
+
+		/* read once, the backend may move on meanwhile */
+		uint32 waitEventInfo = UINT32_ACCESS_ONCE(proc->wait_event_info);
+		const char *waitEventName = ColumnarWaitEventName(waitEventInfo);
+		int pid = proc->pid;
+
+		if (waitEventName == NULL || pid == 0 ||
+			(!readAllStats && !has_privs_of_role(GetUserId(), proc->roleId)))
+		{
+			continue;
+		}
+
+		Datum values[WAIT_EVENTS_NATTS] = { 0 };
+		bool nulls[WAIT_EVENTS_NATTS] = { 0 };
+
+		values[0] = Int32GetDatum(pid);
+		values[1] = CStringGetTextDatum(waitEventName);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+	}
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = tupleDescriptor;
+
+	return (Datum) 0;
+}
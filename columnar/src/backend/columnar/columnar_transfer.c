@@ -0,0 +1,839 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_transfer.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Copying columnar tables between clusters stripe by stripe, in the form
+ * the stripes have on disk.
+ *
+ * columnar.export_stripes returns a bytea for each stripe of a table. It
+ * holds the chunk metadata of the stripe, its stripe level min/max values,
+ * the compression dictionaries its chunks use and the exists and value
+ * streams of its chunks exactly as ColumnarStorageRead returns them.
+ * columnar.import_stripe writes such a bytea into a new stripe of a table
+ * with the same columns. Neither side decompresses or compresses anything,
+ * so copying a table is limited by the network instead of the CPU.
+ *
+ * As the formats of COPY can't be extended, the stripes travel as bytea
+ * values that COPY can carry, e.g. in its binary format into a staging table
+ * of the target cluster, from which they are imported.
+ *
+ * A stripe only carries the values of its rows, so the rows that are
+ * deleted from it and the rows in the delta store would be lost. Export
+ * refuses tables that have either, and columnar.vacuum or
+ * columnar.flush_delta_store get them into stripes of their own first.
+ * The streams are written as they are, so the exporting and the importing
+ * server need to have the same byte order and alignment.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/utils/listutils.h"
+
+/* "HCST", followed by the version of the format */
+#define STRIPE_TRANSFER_MAGIC 0x48435354
+#define STRIPE_TRANSFER_VERSION 1
+
+/* written in native byte order, to refuse stripes of the other byte order */
+#define STRIPE_TRANSFER_BYTE_ORDER 0x01020304
+
+/* room left in a bytea for the metadata that precedes the streams */
+#define STRIPE_TRANSFER_MAX_DATA_LENGTH (MaxAllocSize / 2)
+
+static bytea * ExportStripe(Relation rel, StripeMetadata *stripeMetadata,
+							Snapshot snapshot);
+static void SendStripeColumns(StringInfo buffer, TupleDesc tupleDescriptor,
+							  uint32 columnCount);
+static void CheckStripeColumns(StringInfo buffer, Relation rel, uint32 columnCount);
+static void CheckStripeImportRelation(Relation rel);
+static void CheckStripeLayout(StripeSkipList *skipList, uint32 columnCount,
+							  uint64 rowCount, uint64 dataLength);
+static void CheckStripeNotNull(Relation rel, StripeSkipList *skipList,
+							   uint32 columnCount, const char *data);
+static bool ChunkHasNulls(ColumnChunkSkipNode *chunkSkipNode, const char *data);
+static void ImportStripeDictionaries(StringInfo buffer, Relation rel,
+									 StripeSkipList *skipList, uint32 columnCount);
+static void InvalidStripe(const char *detail) pg_attribute_noreturn();
+
+PG_FUNCTION_INFO_V1(columnar_export_stripes);
+PG_FUNCTION_INFO_V1(columnar_import_stripe);
+
+
+/*
+ * columnar_export_stripes returns a bytea for each stripe of a columnar
+ * table that is visible to the active snapshot, in row number order, which
+ * columnar.import_stripe writes into a table with the same columns.
+ */
+Datum
+columnar_export_stripes(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+	if (resultInfo == NULL || !IsA(resultInfo, ReturnSetInfo) ||
+		!(resultInfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("set-valued function called in context that cannot "
+							   "accept a set")));
+	}
+
+	MemoryContext perQueryContext = resultInfo->econtext->ecxt_per_query_memory;
+	MemoryContext oldContext = MemoryContextSwitchTo(perQueryContext);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1);
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 1, "stripe", BYTEAOID, -1, 0);
+	MemoryContextSwitchTo(oldContext);
+
+	resultInfo->returnMode = SFRM_Materialize;
+	resultInfo->setResult = tupleStore;
+	resultInfo->setDesc = resultDescriptor;
+
+	if (PG_ARGISNULL(0))
+	{
+		return (Datum) 0;
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+
+	Relation rel = table_open(relationId, AccessShareLock);
+	const char *relationName = quote_identifier(RelationGetRelationName(rel));
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table", relationName)));
+	}
+
+	AclResult aclResult = pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, OBJECT_TABLE, RelationGetRelationName(rel));
+	}
+
+	if (check_enable_rls(relationId, InvalidOid, false) == RLS_ENABLED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot export table %s with row-level security",
+							   relationName)));
+	}
+
+	/* rows this transaction wrote or deleted are seen by the export too */
+	Snapshot snapshot = GetActiveSnapshot();
+	bool snapshotRegisteredByUs = false;
+	RowMaskFlushWriteStateForRelfilenode(rel->rd_node.relNode,
+										 GetCurrentSubTransactionId());
+	FlushWriteStateWithNewSnapshot(rel->rd_node.relNode, &snapshot,
+								   &snapshotRegisteredByUs);
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	if (DeltaStoreRowCount(storageId, snapshot) > 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("cannot export the stripes of table %s while it has "
+							   "rows in its delta store", relationName),
+						errhint("Run columnar.flush_delta_store first.")));
+	}
+
+	MemoryContext stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+														"Columnar Stripe Export Context",
+														ALLOCSET_DEFAULT_SIZES);
+
+	List *stripeList = StripesForSnapshot(rel, snapshot);
+
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+		{
+			continue;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		oldContext = MemoryContextSwitchTo(stripeContext);
+
+		Datum value = PointerGetDatum(ExportStripe(rel, stripeMetadata, snapshot));
+		bool isNull = false;
+		tuplestore_putvalues(tupleStore, resultDescriptor, &value, &isNull);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(stripeContext);
+	}
+
+	MemoryContextDelete(stripeContext);
+
+	if (snapshotRegisteredByUs)
+	{
+		UnregisterSnapshot(snapshot);
+	}
+
+	table_close(rel, NoLock);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * columnar_import_stripe writes a stripe exported by columnar.export_stripes
+ * into a new stripe of a columnar table and returns its number of rows. The
+ * stripe gets new row numbers, and the compression dictionaries it uses are
+ * added to the table.
+ *
+ * The streams of the stripe are not decoded here, but by every later read
+ * of the table, so only superusers may import them.
+ */
+Datum
+columnar_import_stripe(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	bytea *stripe = PG_GETARG_BYTEA_PP(1);
+
+	if (!superuser())
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("must be superuser to import columnar stripes")));
+	}
+
+	StringInfoData buffer;
+	buffer.data = VARDATA_ANY(stripe);
+	buffer.len = VARSIZE_ANY_EXHDR(stripe);
+	buffer.maxlen = buffer.len;
+	buffer.cursor = 0;
+
+	if (buffer.len < (int) (3 * sizeof(uint32)) ||
+		pq_getmsgint(&buffer, 4) != STRIPE_TRANSFER_MAGIC)
+	{
+		InvalidStripe("The value was not returned by columnar.export_stripes.");
+	}
+
+	uint32 version = pq_getmsgint(&buffer, 4);
+	if (version != STRIPE_TRANSFER_VERSION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("unsupported columnar stripe format version %u", version)));
+	}
+
+	uint32 byteOrder = 0;
+	pq_copymsgbytes(&buffer, (char *) &byteOrder, sizeof(byteOrder));
+	uint8 maximumAlignment = pq_getmsgbyte(&buffer);
+	if (byteOrder != STRIPE_TRANSFER_BYTE_ORDER || maximumAlignment != MAXIMUM_ALIGNOF)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot import a stripe exported on a platform with "
+							   "another byte order or alignment")));
+	}
+
+	uint32 columnCount = pq_getmsgint(&buffer, 4);
+	uint32 chunkCount = pq_getmsgint(&buffer, 4);
+	uint32 chunkGroupRowCount = pq_getmsgint(&buffer, 4);
+	uint64 rowCount = pq_getmsgint64(&buffer);
+	uint64 dataLength = pq_getmsgint64(&buffer);
+
+	Relation rel = table_open(relationId, RowExclusiveLock);
+	CheckStripeImportRelation(rel);
+
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	if (columnCount == 0 || columnCount > tupleDescriptor->natts)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("stripe has %u columns, table %s has %d", columnCount,
+							   quote_identifier(RelationGetRelationName(rel)),
+							   tupleDescriptor->natts)));
+	}
+
+	CheckStripeColumns(&buffer, rel, columnCount);
+
+	if (chunkCount == 0 || chunkGroupRowCount == 0 || rowCount == 0 ||
+		dataLength == 0 || dataLength > STRIPE_TRANSFER_MAX_DATA_LENGTH ||
+		chunkCount > (uint32) (buffer.len - buffer.cursor) / sizeof(uint32))
+	{
+		InvalidStripe("The stripe header is out of range.");
+	}
+
+	List *chunkGroupRowCounts = NIL;
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		chunkGroupRowCounts = lappend_int(chunkGroupRowCounts,
+										  (int) pq_getmsgint(&buffer, 4));
+	}
+
+	StripeSkipList *skipList = ReceiveStripeSkipList(&buffer, tupleDescriptor,
+													 columnCount, chunkCount, NULL);
+	skipList->columnCount = columnCount;
+
+	ColumnStripeSummary *columnSummaries = NULL;
+	if (pq_getmsgbyte(&buffer) != 0)
+	{
+		columnSummaries = ReceiveStripeColumnSummaries(&buffer, tupleDescriptor,
+													   columnCount);
+	}
+
+	ImportStripeDictionaries(&buffer, rel, skipList, columnCount);
+
+	if ((uint64) (buffer.len - buffer.cursor) != dataLength)
+	{
+		InvalidStripe("The length of the stripe data doesn't match its header.");
+	}
+
+	const char *data = pq_getmsgbytes(&buffer, dataLength);
+
+	int chunkIndex = 0;
+	uint64 chunkGroupRowTotal = 0;
+	int chunkGroupRows = 0;
+	foreach_int(chunkGroupRows, chunkGroupRowCounts)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &skipList->chunkSkipNodeArray[0][chunkIndex];
+		if (chunkGroupRows <= 0 || (uint32) chunkGroupRows > chunkGroupRowCount ||
+			chunkSkipNode->rowCount != (uint64) chunkGroupRows)
+		{
+			InvalidStripe("The row counts of the chunk groups don't match their "
+						  "chunks.");
+		}
+
+		chunkGroupRowTotal += chunkGroupRows;
+		chunkIndex++;
+	}
+
+	if (chunkGroupRowTotal != rowCount)
+	{
+		InvalidStripe("The row counts of the chunk groups don't add up to the "
+					  "row count of the stripe.");
+	}
+
+	CheckStripeLayout(skipList, columnCount, rowCount, dataLength);
+	CheckStripeNotNull(rel, skipList, columnCount, data);
+
+	EmptyStripeReservation *reservation = ReserveEmptyStripe(rel, columnCount,
+															 chunkGroupRowCount,
+															 rowCount, NULL);
+	StripeMetadata *stripeMetadata =
+		CompleteStripeReservation(rel, reservation->stripeId, dataLength, rowCount,
+								  chunkCount, -1);
+
+	ColumnarStorageWrite(rel, stripeMetadata->fileOffset, (char *) data, dataLength);
+
+	SaveChunkGroups(rel->rd_node, stripeMetadata->id, chunkGroupRowCounts);
+	SaveStripeSkipList(rel->rd_node, stripeMetadata->id, skipList, tupleDescriptor);
+	if (columnSummaries != NULL)
+	{
+		SaveStripeColumnSummaries(rel->rd_node, stripeMetadata->id, columnSummaries,
+								  tupleDescriptor);
+	}
+	SaveEmptyRowMask(LookupStorageId(rel->rd_node), stripeMetadata->id,
+					 stripeMetadata->firstRowNumber, chunkGroupRowCounts);
+
+	pgstat_count_heap_insert(rel, rowCount);
+	ColumnarStatCount(relationId, COLUMNAR_STAT_ROWS_WRITTEN, rowCount);
+	ColumnarStatCount(relationId, COLUMNAR_STAT_STRIPES_FLUSHED, 1);
+
+	table_close(rel, NoLock);
+
+	PG_RETURN_INT64(rowCount);
+}
+
+
+/*
+ * ExportStripe returns the bytea columnar.export_stripes returns for the
+ * given stripe.
+ */
+static bytea *
+ExportStripe(Relation rel, StripeMetadata *stripeMetadata, Snapshot snapshot)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+	StripeSkipList *skipList = ReadStripeSkipList(rel->rd_node, stripeMetadata->id,
+												  tupleDescriptor,
+												  stripeMetadata->chunkCount,
+												  snapshot);
+
+	for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+	{
+		if (skipList->chunkGroupDeletedRows[chunkIndex] > 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot export stripe " UINT64_FORMAT " of table "
+								   "%s with deleted rows", stripeMetadata->id,
+								   quote_identifier(RelationGetRelationName(rel))),
+							errhint("Run columnar.vacuum first.")));
+		}
+	}
+
+	if (stripeMetadata->dataLength > STRIPE_TRANSFER_MAX_DATA_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+						errmsg("stripe " UINT64_FORMAT " of table %s is too large "
+							   "to export", stripeMetadata->id,
+							   quote_identifier(RelationGetRelationName(rel))),
+						errhint("Rewrite the table with a lower "
+								"columnar.stripe_row_limit.")));
+	}
+
+	/* columns added after the stripe was written have no chunks in it */
+	uint32 columnCount = Min(stripeMetadata->columnCount, skipList->columnCount);
+
+	StringInfoData buffer;
+	pq_begintypsend(&buffer);
+
+	pq_sendint32(&buffer, STRIPE_TRANSFER_MAGIC);
+	pq_sendint32(&buffer, STRIPE_TRANSFER_VERSION);
+
+	uint32 byteOrder = STRIPE_TRANSFER_BYTE_ORDER;
+	pq_sendbytes(&buffer, (char *) &byteOrder, sizeof(byteOrder));
+	pq_sendbyte(&buffer, MAXIMUM_ALIGNOF);
+
+	pq_sendint32(&buffer, columnCount);
+	pq_sendint32(&buffer, skipList->chunkCount);
+	pq_sendint32(&buffer, stripeMetadata->chunkGroupRowCount);
+	pq_sendint64(&buffer, stripeMetadata->rowCount);
+	pq_sendint64(&buffer, stripeMetadata->dataLength);
+
+	SendStripeColumns(&buffer, tupleDescriptor, columnCount);
+
+	for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+	{
+		pq_sendint32(&buffer, skipList->chunkGroupRowCounts[chunkIndex]);
+	}
+
+	SendStripeSkipListNodes(&buffer, skipList, columnCount, tupleDescriptor);
+
+	ColumnStripeSummary *columnSummaries =
+		ReadStripeColumnSummaries(rel->rd_node, stripeMetadata->id, tupleDescriptor,
+								  snapshot);
+	pq_sendbyte(&buffer, columnSummaries != NULL);
+	if (columnSummaries != NULL)
+	{
+		SendStripeColumnSummaries(&buffer, columnSummaries, columnCount,
+								  tupleDescriptor);
+	}
+
+	/* the dictionaries the chunks of each column use, each once */
+	List *dictionaryIdList = NIL;
+	List *dictionaryColumnList = NIL;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		uint64 lastDictionaryId = 0;
+
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			uint64 dictionaryId =
+				skipList->chunkSkipNodeArray[columnIndex][chunkIndex].compressionDictionaryId;
+			if (dictionaryId == 0 || dictionaryId == lastDictionaryId)
+			{
+				continue;
+			}
+
+			bool seen = false;
+			ListCell *idCell = NULL;
+			ListCell *columnCell = NULL;
+			forboth(idCell, dictionaryIdList, columnCell, dictionaryColumnList)
+			{
+				uint64 *seenId = lfirst(idCell);
+				if (*seenId == dictionaryId && lfirst_int(columnCell) == columnIndex)
+				{
+					seen = true;
+					break;
+				}
+			}
+
+			if (!seen)
+			{
+				uint64 *newId = palloc(sizeof(uint64));
+				*newId = dictionaryId;
+				dictionaryIdList = lappend(dictionaryIdList, newId);
+				dictionaryColumnList = lappend_int(dictionaryColumnList, columnIndex);
+			}
+
+			lastDictionaryId = dictionaryId;
+		}
+	}
+
+	pq_sendint32(&buffer, list_length(dictionaryIdList));
+
+	ListCell *idCell = NULL;
+	ListCell *columnCell = NULL;
+	forboth(idCell, dictionaryIdList, columnCell, dictionaryColumnList)
+	{
+		uint64 dictionaryId = *(uint64 *) lfirst(idCell);
+		bytea *dictionary = ReadCompressionDictionary(dictionaryId);
+		if (dictionary == NULL)
+		{
+			ereport(ERROR, (errmsg("compression dictionary " UINT64_FORMAT
+								   " of stripe " UINT64_FORMAT " not found",
+								   dictionaryId, stripeMetadata->id)));
+		}
+
+		pq_sendint32(&buffer, lfirst_int(columnCell));
+		pq_sendint64(&buffer, dictionaryId);
+		pq_sendint32(&buffer, VARSIZE_ANY_EXHDR(dictionary));
+		pq_sendbytes(&buffer, VARDATA_ANY(dictionary), VARSIZE_ANY_EXHDR(dictionary));
+	}
+
+	/* the exists and value streams of all chunks, as they are stored */
+	enlargeStringInfo(&buffer, stripeMetadata->dataLength);
+	ColumnarStorageRead(rel, stripeMetadata->fileOffset, buffer.data + buffer.len,
+						stripeMetadata->dataLength);
+	buffer.len += stripeMetadata->dataLength;
+	buffer.data[buffer.len] = '\0';
+
+	return pq_endtypsend(&buffer);
+}
+
+
+/*
+ * SendStripeColumns appends what the streams of the first columnCount
+ * columns depend on to a buffer: whether a column is dropped, the storage
+ * of its type and, for columns that are not dropped, the type and collation.
+ */
+static void
+SendStripeColumns(StringInfo buffer, TupleDesc tupleDescriptor, uint32 columnCount)
+{
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		pq_sendbyte(buffer, attributeForm->attisdropped);
+		pq_sendint16(buffer, attributeForm->attlen);
+		pq_sendbyte(buffer, attributeForm->attbyval);
+		pq_sendbyte(buffer, attributeForm->attalign);
+
+		if (!attributeForm->attisdropped)
+		{
+			char *collationName = OidIsValid(attributeForm->attcollation) ?
+								  get_collation_name(attributeForm->attcollation) :
+								  NULL;
+
+			pq_sendstring(buffer, format_type_with_typemod(attributeForm->atttypid,
+														   attributeForm->atttypmod));
+			pq_sendstring(buffer, collationName != NULL ? collationName : "");
+		}
+	}
+}
+
+
+/*
+ * CheckStripeColumns reads the columns written by SendStripeColumns and
+ * errors out unless they match the columns of the relation, as the chunks of
+ * the stripe are read as values of those columns.
+ */
+static void
+CheckStripeColumns(StringInfo buffer, Relation rel, uint32 columnCount)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		bool dropped = pq_getmsgbyte(buffer) != 0;
+		int16 typeLength = (int16) pq_getmsgint(buffer, 2);
+		bool typeByValue = pq_getmsgbyte(buffer) != 0;
+		char typeAlign = pq_getmsgbyte(buffer);
+
+		const char *typeName = NULL;
+		const char *collationName = NULL;
+		if (!dropped)
+		{
+			typeName = pq_getmsgstring(buffer);
+			collationName = pq_getmsgstring(buffer);
+		}
+
+		if (dropped != attributeForm->attisdropped)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("columns of the stripe don't match the columns "
+								   "of table %s",
+								   quote_identifier(RelationGetRelationName(rel))),
+							errdetail("Column %u is dropped in only one of them, "
+									  "columns are matched by position.",
+									  columnIndex + 1)));
+		}
+
+		if (!dropped)
+		{
+			char *columnTypeName = format_type_with_typemod(attributeForm->atttypid,
+															attributeForm->atttypmod);
+			char *columnCollationName = OidIsValid(attributeForm->attcollation) ?
+										get_collation_name(attributeForm->attcollation) :
+										NULL;
+
+			if (strcmp(typeName, columnTypeName) != 0 ||
+				strcmp(collationName,
+					   columnCollationName != NULL ? columnCollationName : "") != 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+								errmsg("column \"%s\" of table %s has type %s, the "
+									   "stripe has %s", NameStr(attributeForm->attname),
+									   quote_identifier(RelationGetRelationName(rel)),
+									   columnTypeName, typeName),
+								errdetail("Columns must have the same type and "
+										  "collation.")));
+			}
+		}
+
+		/* dropped columns keep the storage of their type */
+		if (typeLength != attributeForm->attlen ||
+			typeByValue != attributeForm->attbyval ||
+			typeAlign != attributeForm->attalign)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("column %u of the stripe is stored differently "
+								   "than column %u of table %s", columnIndex + 1,
+								   columnIndex + 1,
+								   quote_identifier(RelationGetRelationName(rel)))));
+		}
+	}
+}
+
+
+/*
+ * CheckStripeImportRelation errors out unless stripes can be written into
+ * the relation as they are, which skips what the executor does for inserts.
+ */
+static void
+CheckStripeImportRelation(Relation rel)
+{
+	Oid relationId = RelationGetRelid(rel);
+	const char *relationName = quote_identifier(RelationGetRelationName(rel));
+
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table", relationName)));
+	}
+
+	TupleConstr *constraints = RelationGetDescr(rel)->constr;
+	const char *unsupported = NULL;
+
+	if (RelationGetIndexList(rel) != NIL)
+	{
+		unsupported = "indexes";
+	}
+	else if (rel->trigdesc != NULL)
+	{
+		unsupported = "triggers";
+	}
+	else if (constraints != NULL && constraints->num_check > 0)
+	{
+		unsupported = "check constraints";
+	}
+	else if (check_enable_rls(relationId, InvalidOid, false) == RLS_ENABLED)
+	{
+		unsupported = "row-level security";
+	}
+
+	if (unsupported != NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot import stripes into table %s with %s",
+							   relationName, unsupported),
+						errhint("Import into a table without them and load the rows "
+								"with INSERT ... SELECT.")));
+	}
+
+	ColumnarCheckLogicalReplication(rel);
+}
+
+
+/*
+ * CheckStripeLayout errors out if a stream of a chunk lies outside of the
+ * data of the stripe, or a chunk has another number of rows than the chunks
+ * of the first column.
+ */
+static void
+CheckStripeLayout(StripeSkipList *skipList, uint32 columnCount, uint64 rowCount,
+				  uint64 dataLength)
+{
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			if (chunkSkipNode->rowCount !=
+				skipList->chunkSkipNodeArray[0][chunkIndex].rowCount ||
+				chunkSkipNode->existsChunkOffset > dataLength ||
+				chunkSkipNode->existsLength > dataLength -
+				chunkSkipNode->existsChunkOffset ||
+				chunkSkipNode->valueChunkOffset > dataLength ||
+				chunkSkipNode->valueLength > dataLength -
+				chunkSkipNode->valueChunkOffset)
+			{
+				InvalidStripe("A chunk lies outside of the stripe data.");
+			}
+		}
+	}
+}
+
+
+/*
+ * CheckStripeNotNull errors out if the stripe has NULLs in a NOT NULL column
+ * of the relation, as found from the null state of the chunks or else their
+ * exists streams. Columns added after the stripe was written are read with
+ * their default value, which ALTER TABLE checked.
+ */
+static void
+CheckStripeNotNull(Relation rel, StripeSkipList *skipList, uint32 columnCount,
+				   const char *data)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(rel);
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		if (!attributeForm->attnotnull || attributeForm->attisdropped)
+		{
+			continue;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			if (ChunkHasNulls(&skipList->chunkSkipNodeArray[columnIndex][chunkIndex],
+							  data))
+			{
+				ereport(ERROR, (errcode(ERRCODE_NOT_NULL_VIOLATION),
+								errmsg("null value in column \"%s\" of relation \"%s\" "
+									   "violates not-null constraint",
+									   NameStr(attributeForm->attname),
+									   RelationGetRelationName(rel)),
+								errdetail("The stripe has NULL values in the column.")));
+			}
+		}
+	}
+}
+
+
+/*
+ * ChunkHasNulls returns whether a chunk has a NULL value, from its null state
+ * or else from the bits of its exists stream within the stripe data.
+ */
+static bool
+ChunkHasNulls(ColumnChunkSkipNode *chunkSkipNode, const char *data)
+{
+	if (chunkSkipNode->rowCount == 0 || chunkSkipNode->nullState == CHUNK_NULLS_NONE)
+	{
+		return false;
+	}
+	else if (chunkSkipNode->nullState == CHUNK_NULLS_ALL)
+	{
+		return true;
+	}
+
+	const uint8 *exists = (const uint8 *) data + chunkSkipNode->existsChunkOffset;
+	uint64 byteCount = (chunkSkipNode->rowCount + 7) / 8;
+	if (chunkSkipNode->existsLength < byteCount)
+	{
+		InvalidStripe("The exists stream of a chunk is too short.");
+	}
+
+	for (uint64 rowIndex = 0; rowIndex < chunkSkipNode->rowCount; rowIndex++)
+	{
+		if ((exists[rowIndex / 8] & (1 << (rowIndex % 8))) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ImportStripeDictionaries adds the compression dictionaries that come with
+ * a stripe to the relation, and makes the chunks of the stripe refer to
+ * them by their new ids.
+ */
+static void
+ImportStripeDictionaries(StringInfo buffer, Relation rel, StripeSkipList *skipList,
+						 uint32 columnCount)
+{
+	uint32 dictionaryCount = pq_getmsgint(buffer, 4);
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+
+	uint64 *oldDictionaryIds = palloc0(dictionaryCount * sizeof(uint64));
+	uint64 *newDictionaryIds = palloc0(dictionaryCount * sizeof(uint64));
+	uint32 *dictionaryColumns = palloc0(dictionaryCount * sizeof(uint32));
+
+	for (uint32 dictionaryIndex = 0; dictionaryIndex < dictionaryCount;
+		 dictionaryIndex++)
+	{
+		uint32 columnIndex = pq_getmsgint(buffer, 4);
+		uint64 dictionaryId = pq_getmsgint64(buffer);
+		int length = (int) pq_getmsgint(buffer, 4);
+		const char *bytes = pq_getmsgbytes(buffer, length);
+
+		if (columnIndex >= columnCount || dictionaryId == 0)
+		{
+			InvalidStripe("A compression dictionary belongs to no column.");
+		}
+
+		bytea *dictionary = palloc(length + VARHDRSZ);
+		SET_VARSIZE(dictionary, length + VARHDRSZ);
+		memcpy(VARDATA(dictionary), bytes, length);
+
+		oldDictionaryIds[dictionaryIndex] = dictionaryId;
+		dictionaryColumns[dictionaryIndex] = columnIndex;
+		newDictionaryIds[dictionaryIndex] =
+			SaveCompressionDictionary(storageId, columnIndex + 1, dictionary);
+	}
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		for (uint32 chunkIndex = 0; chunkIndex < skipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+			if (chunkSkipNode->compressionDictionaryId == 0)
+			{
+				continue;
+			}
+
+			uint32 dictionaryIndex = 0;
+			while (dictionaryIndex < dictionaryCount &&
+				   (oldDictionaryIds[dictionaryIndex] !=
+					chunkSkipNode->compressionDictionaryId ||
+					dictionaryColumns[dictionaryIndex] != columnIndex))
+			{
+				dictionaryIndex++;
+			}
+
+			if (dictionaryIndex == dictionaryCount)
+			{
+				InvalidStripe("A chunk uses a compression dictionary that doesn't "
+							  "come with the stripe.");
+			}
+
+			chunkSkipNode->compressionDictionaryId = newDictionaryIds[dictionaryIndex];
+		}
+	}
+}
+
+
+/*
+ * InvalidStripe errors out on a value that can't be imported as a stripe.
+ */
+static void
+InvalidStripe(const char *detail)
+{
+	ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg("invalid columnar stripe"),
+					errdetail_internal("%s", detail)));
+}
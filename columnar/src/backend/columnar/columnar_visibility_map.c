@@ -0,0 +1,295 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_visibility_map.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Visibility map of columnar tables, which lets index only scans return the
+ * values of index tuples without fetching their rows.
+ *
+ * Row numbers map to item pointers with VALID_ITEMPOINTER_OFFSETS rows per
+ * block, and index only scans look up the block of each item pointer in the
+ * visibility map fork of the table, the same way as for heap tables. VACUUM
+ * marks a block all visible once every row number of the block belongs to a
+ * single stripe that all transactions can see, and the chunk groups holding
+ * those rows have no deleted rows. Row numbers of a stripe are never handed
+ * out again, so inserts never clear bits. Deletes and updates clear the bit
+ * of the block of their row before they change its row mask, and stripes
+ * that vacuum rewrites get their bits cleared before they are removed.
+ *
+ * DELETE and UPDATE hold an advisory lock on the storage of the table until
+ * their transaction ends. VACUUM only sets bits if it gets that lock without
+ * waiting, so it can't miss a deletion that isn't committed yet, and writers
+ * that come later wait for it and then clear the bits they need to.
+ *
+ * The map uses the page layout of visibilitymap.c, whose macros are private,
+ * but bits are set and cleared with generic WAL records as columnar doesn't
+ * have heap pages to log them with.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/generic_xlog.h"
+#include "access/visibilitymap.h"
+#include "storage/bufmgr.h"
+#include "utils/builtins.h"
+#include "utils/rel.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
+#include "columnar/columnar_tableam.h"
+#include "columnar/utils/listutils.h"
+
+/* same as in visibilitymap.c */
+#define MAPSIZE (BLCKSZ - MAXALIGN(SizeOfPageHeaderData))
+#define HEAPBLOCKS_PER_BYTE (BITS_PER_BYTE / BITS_PER_HEAPBLOCK)
+#define HEAPBLOCKS_PER_PAGE (MAPSIZE * HEAPBLOCKS_PER_BYTE)
+#define HEAPBLK_TO_MAPBLOCK(x) ((x) / HEAPBLOCKS_PER_PAGE)
+#define HEAPBLK_TO_MAPBYTE(x) (((x) % HEAPBLOCKS_PER_PAGE) / HEAPBLOCKS_PER_BYTE)
+#define HEAPBLK_TO_OFFSET(x) (((x) % HEAPBLOCKS_PER_BYTE) * BITS_PER_HEAPBLOCK)
+
+static uint64 SetRowRangeAllVisible(Relation relation, uint64 firstRowNumber,
+									uint64 endRowNumber);
+static void ClearRowRangeAllVisible(Relation relation, uint64 firstRowNumber,
+									uint64 endRowNumber);
+static Page RegisterMapBuffer(GenericXLogState *state, Buffer vmBuffer);
+
+
+/*
+ * ColumnarVisibilityMapUpdate marks the blocks of the given table whose rows
+ * all transactions of oldestXmin and later see as all visible. It does
+ * nothing if a delete or update of the table is in progress.
+ */
+void
+ColumnarVisibilityMapUpdate(Relation relation, TransactionId oldestXmin, int elevel)
+{
+	uint64 storageId = ColumnarStorageGetStorageId(relation, false);
+	if (!DatumGetBool(DirectFunctionCall1(pg_try_advisory_xact_lock_int8,
+										  Int64GetDatum((int64) storageId))))
+	{
+		ereport(elevel,
+				(errmsg("\"%s\": skipping visibility map due to concurrent deletes",
+						RelationGetRelationName(relation))));
+		return;
+	}
+
+	uint64 allVisibleBlocks = 0;
+
+	List *stripeList = StripesForRelfilenode(relation->rd_node, ForwardScanDirection);
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeList)
+	{
+		if (!StripeVisibleToAll(stripeMetadata, oldestXmin))
+		{
+			continue;
+		}
+
+		uint32 *chunkGroupRowCounts = NULL;
+		uint32 *chunkGroupDeletedRows = NULL;
+		ChunkGroupRowCountsForStripe(relation->rd_node, stripeMetadata->chunkCount,
+									 stripeMetadata->id, &chunkGroupRowCounts,
+									 &chunkGroupDeletedRows);
+
+		/* blocks within runs of chunk groups without deleted rows qualify */
+		uint64 chunkGroupFirstRowNumber = stripeMetadata->firstRowNumber;
+		uint64 runFirstRowNumber = chunkGroupFirstRowNumber;
+		for (uint32 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount; chunkIndex++)
+		{
+			uint64 chunkGroupEndRowNumber =
+				chunkGroupFirstRowNumber + chunkGroupRowCounts[chunkIndex];
+
+			if (chunkGroupDeletedRows[chunkIndex] > 0)
+			{
+				allVisibleBlocks += SetRowRangeAllVisible(relation, runFirstRowNumber,
+														  chunkGroupFirstRowNumber);
+				runFirstRowNumber = chunkGroupEndRowNumber;
+			}
+
+			chunkGroupFirstRowNumber = chunkGroupEndRowNumber;
+		}
+
+		allVisibleBlocks += SetRowRangeAllVisible(relation, runFirstRowNumber,
+												  chunkGroupFirstRowNumber);
+
+		pfree(chunkGroupRowCounts);
+		pfree(chunkGroupDeletedRows);
+	}
+
+	ereport(elevel,
+			(errmsg("\"%s\": marked " UINT64_FORMAT " blocks all visible",
+					RelationGetRelationName(relation), allVisibleBlocks)));
+}
+
+
+/*
+ * ColumnarVisibilityMapClearRow clears the bit of the block of the given row
+ * number, so index only scans fetch its rows again.
+ */
+void
+ColumnarVisibilityMapClearRow(Relation relation, uint64 rowNumber)
+{
+	ClearRowRangeAllVisible(relation, rowNumber, rowNumber + 1);
+}
+
+
+/*
+ * ColumnarVisibilityMapClearRows clears the bits of the blocks of the rows
+ * from firstRowNumber on, up to but not including endRowNumber.
+ */
+void
+ColumnarVisibilityMapClearRows(Relation relation, uint64 firstRowNumber,
+							   uint64 endRowNumber)
+{
+	ClearRowRangeAllVisible(relation, firstRowNumber, endRowNumber);
+}
+
+
+/*
+ * ColumnarVisibilityMapClearStripe clears the bits of the blocks of the given
+ * stripe before its rows are removed.
+ */
+void
+ColumnarVisibilityMapClearStripe(Relation relation, StripeMetadata *stripeMetadata)
+{
+	ClearRowRangeAllVisible(relation, stripeMetadata->firstRowNumber,
+							stripeMetadata->firstRowNumber + stripeMetadata->rowCount);
+}
+
+
+/*
+ * SetRowRangeAllVisible sets the bits of the blocks whose valid row numbers
+ * are all in [firstRowNumber, endRowNumber), and returns how many it set.
+ */
+static uint64
+SetRowRangeAllVisible(Relation relation, uint64 firstRowNumber, uint64 endRowNumber)
+{
+	/* row number 0 is invalid, so block 0 starts at the first row number */
+	BlockNumber firstBlock = 0;
+	if (firstRowNumber > COLUMNAR_FIRST_ROW_NUMBER)
+	{
+		firstBlock = (firstRowNumber + VALID_ITEMPOINTER_OFFSETS - 1) /
+					 VALID_ITEMPOINTER_OFFSETS;
+	}
+	BlockNumber endBlock = endRowNumber / VALID_ITEMPOINTER_OFFSETS;
+
+	uint64 setBlocks = 0;
+	Buffer vmBuffer = InvalidBuffer;
+	GenericXLogState *state = NULL;
+	Page page = NULL;
+
+	for (BlockNumber block = firstBlock; block < endBlock; block++)
+	{
+		if (state == NULL || HEAPBLK_TO_MAPBLOCK(block) != BufferGetBlockNumber(vmBuffer))
+		{
+			if (state != NULL)
+			{
+				GenericXLogFinish(state);
+				LockBuffer(vmBuffer, BUFFER_LOCK_UNLOCK);
+			}
+
+			/* extends the visibility map fork as needed */
+			visibilitymap_pin(relation, block, &vmBuffer);
+			LockBuffer(vmBuffer, BUFFER_LOCK_EXCLUSIVE);
+
+			state = GenericXLogStart(relation);
+			page = RegisterMapBuffer(state, vmBuffer);
+		}
+
+		uint8 *map = (uint8 *) PageGetContents(page);
+		uint8 flag = VISIBILITYMAP_ALL_VISIBLE << HEAPBLK_TO_OFFSET(block);
+		if ((map[HEAPBLK_TO_MAPBYTE(block)] & flag) == 0)
+		{
+			map[HEAPBLK_TO_MAPBYTE(block)] |= flag;
+			setBlocks++;
+		}
+	}
+
+	if (state != NULL)
+	{
+		GenericXLogFinish(state);
+		UnlockReleaseBuffer(vmBuffer);
+	}
+
+	return setBlocks;
+}
+
+
+/*
+ * ClearRowRangeAllVisible clears the bits of the blocks that hold any of the
+ * row numbers in [firstRowNumber, endRowNumber). Map pages that have none of
+ * those bits set are left alone, so deletes of tables that vacuum never
+ * marked only read the map.
+ */
+static void
+ClearRowRangeAllVisible(Relation relation, uint64 firstRowNumber, uint64 endRowNumber)
+{
+	if (endRowNumber <= firstRowNumber)
+	{
+		return;
+	}
+
+	BlockNumber firstBlock = firstRowNumber / VALID_ITEMPOINTER_OFFSETS;
+	BlockNumber lastBlock = (endRowNumber - 1) / VALID_ITEMPOINTER_OFFSETS;
+
+	Buffer vmBuffer = InvalidBuffer;
+	BlockNumber block = firstBlock;
+	while (block <= lastBlock)
+	{
+		BlockNumber mapBlock = HEAPBLK_TO_MAPBLOCK(block);
+		BlockNumber mapEndBlock = Min((BlockNumber) ((mapBlock + 1) * HEAPBLOCKS_PER_PAGE),
+									  lastBlock + 1);
+
+		/* no map page yet means no bits are set */
+		bool anySet = false;
+		for (BlockNumber mapped = block; mapped < mapEndBlock && !anySet; mapped++)
+		{
+			anySet = visibilitymap_get_status(relation, mapped, &vmBuffer) != 0;
+		}
+
+		if (anySet)
+		{
+			LockBuffer(vmBuffer, BUFFER_LOCK_EXCLUSIVE);
+
+			GenericXLogState *state = GenericXLogStart(relation);
+			Page page = RegisterMapBuffer(state, vmBuffer);
+			uint8 *map = (uint8 *) PageGetContents(page);
+
+			for (BlockNumber mapped = block; mapped < mapEndBlock; mapped++)
+			{
+				map[HEAPBLK_TO_MAPBYTE(mapped)] &=
+					~(VISIBILITYMAP_VALID_BITS << HEAPBLK_TO_OFFSET(mapped));
+			}
+
+			GenericXLogFinish(state);
+			LockBuffer(vmBuffer, BUFFER_LOCK_UNLOCK);
+		}
+
+		block = mapEndBlock;
+	}
+
+	if (BufferIsValid(vmBuffer))
+	{
+		ReleaseBuffer(vmBuffer);
+	}
+}
+
+
+/*
+ * RegisterMapBuffer registers the given locked map page with the generic WAL
+ * record. visibilitymap.c initializes new map pages without logging them,
+ * so their first record needs a full image to be replayed.
+ */
+static Page
+RegisterMapBuffer(GenericXLogState *state, Buffer vmBuffer)
+{
+	int flags = 0;
+	if (PageGetLSN(BufferGetPage(vmBuffer)) == InvalidXLogRecPtr)
+	{
+		flags = GENERIC_XLOG_FULL_IMAGE;
+	}
+
+	return GenericXLogRegisterBuffer(state, vmBuffer, flags);
+}
@@ -18,37 +18,159 @@
 
 #include "safe_lib.h"
 
+#include "access/detoast.h"
 #include "access/heapam.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
+#include "common/hashfn.h"
+#include "lib/hyperloglog.h"
 #include "miscadmin.h"
 #include "storage/fd.h"
 #include "storage/smgr.h"
+#include "utils/float.h"
 #include "utils/guc.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/relfilenodemap.h"
+#include "utils/sortsupport.h"
+#include "utils/typcache.h"
 
 #include "columnar/columnar.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_version_compat.h"
+#include "columnar/utils/listutils.h"
+
+/*
+ * StripeSortBuffer holds the rows of a stripe of a table with a sort key
+ * until the stripe is flushed. Values of row i are at values[i * columnCount].
+ */
+typedef struct StripeSortBuffer
+{
+	uint32 rowCount;
+	uint32 rowCapacity;
+	Datum *values;
+	bool *nulls;
+} StripeSortBuffer;
+
+/*
+ * ZOrderSortState is the qsort_arg argument for ordering the rows of a sort
+ * buffer in Z-order. The rows are first sorted by each Z-order column in
+ * turn to give their values a rank, ranks[i * zorderColumnCount + j] being
+ * the rank of row i in the j-th column, and then ordered by the interleaved
+ * bits of their ranks.
+ */
+typedef struct ZOrderSortState
+{
+	StripeSortBuffer *sortBuffer;
+	uint32 columnCount;
+
+	/* column that is ranked now */
+	int columnIndex;
+	SortSupport sortSupport;
+
+	uint32 *ranks;
+	int zorderColumnCount;
+} ZOrderSortState;
+
+/*
+ * InlineComparisonKind tells how values of a column are compared when
+ * maintaining chunk statistics. By-value types whose btree order is plain
+ * integer or float order are compared inline, other types call their btree
+ * comparison function.
+ */
+typedef enum InlineComparisonKind
+{
+	INLINE_COMPARISON_NONE = 0,
+	INLINE_COMPARISON_INT16,
+	INLINE_COMPARISON_INT32,
+	INLINE_COMPARISON_INT64,
+	INLINE_COMPARISON_FLOAT4,
+	INLINE_COMPARISON_FLOAT8
+} InlineComparisonKind;
+
+/* register width of the distinct value sketches, 1024 registers */
+#define DISTINCT_SKETCH_REGISTER_WIDTH 10
+
+/* size of the large value area that flushes the stripe, far from MaxAllocSize */
+#define LARGE_VALUE_AREA_LIMIT (MaxAllocSize / 4)
+
+/*
+ * Limits of auto_row_limits. Chunk groups get at most ten times the default
+ * row count, since the writer holds a chunk group of each column unencoded.
+ * Scans of fewer chunk groups than AUTO_ROW_LIMITS_MIN_CHUNK_GROUPS don't
+ * change the chunk group size.
+ */
+#define AUTO_CHUNK_ROW_COUNT_MAXIMUM 100000
+#define AUTO_ROW_LIMITS_MIN_CHUNK_GROUPS 100
+
+/*
+ * ChunkValueTracker follows the values of a column in the current chunk for
+ * the statistics min/max don't give. Sortedness is only tracked for columns
+ * compared inline.
+ */
+typedef struct ChunkValueTracker
+{
+	bool valuesSorted;
+	bool hasLastValue;
+	Datum lastValue;
+	hyperLogLogState distinctSketch;
+} ChunkValueTracker;
 
 struct ColumnarWriteState
 {
 	TupleDesc tupleDescriptor;
 	FmgrInfo **comparisonFunctionArray;
+	InlineComparisonKind *comparisonKindArray;
+	ChunkValueTracker *chunkValueTrackers;
 	RelFileNode relfilenode;
 
+	/* relation of relfilenode, looked up when the first stripe starts */
+	Oid relationId;
+
 	MemoryContext stripeWriteContext;
 	MemoryContext perTupleContext;
+
 	StripeBuffers *stripeBuffers;
 	StripeSkipList *stripeSkipList;
 	EmptyStripeReservation *emptyStripeReservation;
+	StripeReservationBatch stripeReservationBatch;
 	ColumnarOptions options;
 	ChunkData *chunkData;
 
 	List *chunkGroupRowCounts;
 
+	/*
+	 * Hash functions of the columns that get bloom filters, NULL for other
+	 * columns, and the hashes of the values of the current chunk. The hash
+	 * arrays outlive the stripe, so they are not in stripeWriteContext.
+	 */
+	FmgrInfo **bloomHashFunctionArray;
+	uint64 **bloomHashArray;
+	uint32 *bloomHashCount;
+	uint32 *bloomHashCapacity;
+
+	/*
+	 * Distinct value sketch registers of the current chunk of the columns in
+	 * hll_columns, NULL for other columns.
+	 */
+	uint8 **hllRegisterArray;
+
+	/*
+	 * List of ShreddedKeyStatistics of the current chunk of each jsonb column
+	 * with shredded keys, NIL for other columns. Their bounds are allocated
+	 * in stripeWriteContext, and freed each time a chunk is serialized.
+	 */
+	List **shreddedKeyStatisticsArray;
+
+	/* compression of each column, the table's unless the column overrides it */
+	CompressionType *compressionTypeArray;
+	int *compressionLevelArray;
+
+	/* latest zstd dictionary of each zstd compressed column, 0 if none */
+	uint64 *compressionDictionaryIdArray;
+
 	/*
 	 * compressionBuffer buffer is used as temporary storage during
 	 * data value compression operation. It is kept here to minimize
@@ -56,25 +178,156 @@ struct ColumnarWriteState
 	 * deallocated when memory context is reset.
 	 */
 	StringInfo compressionBuffer;
+
+	/* encodings chunks may use, encodingBuffer is like compressionBuffer */
+	bool dictionaryEncodingEnabled;
+	bool runLengthEncodingEnabled;
+	bool bitPackingEnabled;
+	bool valueOffsetsEnabled;
+	StringInfo encodingBuffer;
+
+	/* set if chunks without a mix of nulls may omit their exists stream */
+	bool nullStateEnabled;
+
+	/*
+	 * Variable length values of at least largeValueThreshold bytes go to the
+	 * large value area of the stripe, which is collected in largeValueBuffer,
+	 * see columnar_large_value.c. 0 if they are all stored inline.
+	 * largeValueBuffer lives in stripeWriteContext.
+	 */
+	int largeValueThreshold;
+	StringInfo largeValueBuffer;
+
+	/*
+	 * If sortKeyIndex is not -1, the rows of a stripe are collected in
+	 * sortBuffer and written ordered by that column when the stripe is
+	 * flushed. sortBuffer lives in stripeWriteContext.
+	 */
+	int sortKeyIndex;
+	SortSupportData sortSupport;
+	StripeSortBuffer *sortBuffer;
+
+	/*
+	 * If zorderColumnCount is not 0, the rows are instead written in the
+	 * Z-order of these columns, and sortKeyIndex is the first of them.
+	 */
+	int zorderColumnCount;
+	int *zorderColumnIndexes;
+	SortSupportData *zorderSortSupport;
+
+	/*
+	 * If bucketKeyIndex is not -1, the rows of a stripe are also collected in
+	 * sortBuffer, and written as one stripe per bucket_by bucket of that
+	 * column when the stripe is flushed. stripeBucket is the bucket of the
+	 * current stripe, which is recorded in its metadata only while
+	 * recordBuckets is set.
+	 */
+	int bucketKeyIndex;
+	FmgrInfo *bucketHashFunction;
+	Oid bucketCollation;
+	bool recordBuckets;
+	int32 stripeBucket;
+
+	/*
+	 * If deltaStoreEnabled is set, rows go to the delta store instead of a
+	 * stripe until deltaStoreRowCount reaches columnar.delta_store_row_limit.
+	 */
+	bool deltaStoreEnabled;
+	uint64 deltaStoreRowCount;
+
+	/* groups of the rows of the current stripe, NULL if it gets no projection */
+	StripeProjectionBuilder *projectionBuilder;
+
+	/*
+	 * If options.autoRowLimits is set, the row limits of each stripe are
+	 * picked from autoRowWidth, the average bytes a row of the previous
+	 * stripe took in its chunks before compression, or the estimated width
+	 * of the columns for the first stripe. liveColumnCount is the number of
+	 * columns that aren't dropped.
+	 */
+	double autoRowWidth;
+	uint32 liveColumnCount;
+
+	/*
+	 * If compressionThread is not NULL, the compression jobs of a chunk run
+	 * in a helper thread while the rows of the next chunk are added.
+	 * pendingJobs are the jobs of chunk pendingChunkIndex, which are
+	 * finished when the next chunk is serialized or the stripe is flushed.
+	 * All of them live in stripeWriteContext.
+	 */
+	CompressionThread *compressionThread;
+	CompressionJob *pendingJobs;
+	uint32 *pendingJobColumnIndexes;
+	uint32 pendingJobCount;
+	uint32 pendingChunkIndex;
 };
 
+/* most memory a write state of this backend held, see UpdateWritePeakMemory */
+static uint64 WriteStatePeakMemory = 0;
+
 static StripeBuffers * CreateEmptyStripeBuffers(uint32 stripeMaxRowCount,
 												uint32 chunkRowCount,
 												uint32 columnCount);
 static StripeSkipList * CreateEmptyStripeSkipList(uint32 stripeMaxRowCount,
 												  uint32 chunkRowCount,
 												  uint32 columnCount);
+static void CreateStripeWriteBuffers(ColumnarWriteState *writeState);
+static void ReserveStripeWriteBuffers(ColumnarWriteState *writeState);
+static void AutoSizeStripe(ColumnarWriteState *writeState);
+static double AutoChunkPruningFactor(ColumnarWriteState *writeState);
+static uint32 AutoRowLimit(double rowCount, uint32 minimum, uint32 maximum,
+						   uint32 multiple);
+static uint64 AppendRowToStripe(ColumnarWriteState *writeState, Datum *columnValues,
+								bool *columnNulls);
+static void AddRowToSortBuffer(ColumnarWriteState *writeState, Datum *columnValues,
+							   bool *columnNulls);
+static void WriteSortBufferRows(ColumnarWriteState *writeState);
+static void WriteBucketStripes(ColumnarWriteState *writeState, uint32 *rowOrder);
+static inline bool StripeRowsCollected(ColumnarWriteState *writeState);
+static bool DeltaStoreTakesRows(ColumnarWriteState *writeState, uint32 rowCount);
+static bool StripeSizeLimitReached(ColumnarWriteState *writeState);
+static void UpdateWritePeakMemory(ColumnarWriteState *writeState);
+static StringInfo ReadChunkStream(Relation relation, uint64 logicalOffset,
+								  uint64 length);
+static int CompareSortBufferRows(const void *left, const void *right, void *arg);
+static Oid SortableColumnOperator(TupleDesc tupleDescriptor, AttrNumber attnum);
+static void PrepareColumnSortSupport(SortSupport sortSupport,
+									 TupleDesc tupleDescriptor, AttrNumber attnum,
+									 Oid sortOperator);
+static void SortBufferRowsInZOrder(ColumnarWriteState *writeState, uint32 *rowOrder);
+static int CompareSortBufferColumn(const void *left, const void *right, void *arg);
+static int CompareZOrderRanks(const void *left, const void *right, void *arg);
+static Relation OpenWriteStateRelation(ColumnarWriteState *writeState);
 static void FlushStripe(ColumnarWriteState *writeState);
 static StringInfo SerializeBoolArray(bool *boolArray, uint32 boolArrayLength);
 static void SerializeSingleDatum(StringInfo datumBuffer, Datum datum,
 								 bool datumTypeByValue, int datumTypeLength,
 								 char datumTypeAlign);
+static void SerializeColumnValue(ColumnarWriteState *writeState, uint32 columnIndex,
+								 ColumnChunkSkipNode *chunkSkipNode, Datum value);
+static Datum FlattenColumnValue(Form_pg_attribute attributeForm, Datum value);
 static void SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex,
 							   uint32 rowCount);
+static void StoreCompressionJobs(ColumnarWriteState *writeState, uint32 chunkIndex,
+								 CompressionJob *jobs, uint32 *jobColumnIndexes,
+								 uint32 jobCount);
+static void FinishPendingCompression(ColumnarWriteState *writeState);
+static InlineComparisonKind GetInlineComparisonKind(Form_pg_attribute attributeForm);
+static inline int InlineCompare(InlineComparisonKind comparisonKind, Datum left,
+								Datum right);
+static void UpdateChunkStatistics(ColumnarWriteState *writeState, uint32 columnIndex,
+								  ColumnChunkSkipNode *chunkSkipNode, Datum columnValue);
+static void FinishChunkStatistics(ColumnarWriteState *writeState, uint32 columnIndex,
+								  ColumnChunkSkipNode *chunkSkipNode,
+								  uint32 existsCount);
+static uint32 DistinctSketchHash(Datum columnValue, Form_pg_attribute attributeForm);
 static void UpdateChunkSkipNodeMinMax(ColumnChunkSkipNode *chunkSkipNode,
 									  Datum columnValue, bool columnTypeByValue,
 									  int columnTypeLength, Oid columnCollation,
 									  FmgrInfo *comparisonFunction);
+static ColumnStripeSummary * BuildStripeColumnSummaries(ColumnarWriteState *writeState);
+static void AddBloomFilterHash(ColumnarWriteState *writeState, uint32 columnIndex,
+							   Datum columnValue);
 static Datum DatumCopy(Datum datum, bool datumTypeByValue, int datumTypeLength);
 static StringInfo CopyStringInfo(StringInfo sourceString);
 
@@ -91,6 +344,10 @@ ColumnarBeginWrite(RelFileNode relfilenode,
 	/* get comparison function pointers for each of the columns */
 	uint32 columnCount = tupleDescriptor->natts;
 	FmgrInfo **comparisonFunctionArray = palloc0(columnCount * sizeof(FmgrInfo *));
+	InlineComparisonKind *comparisonKindArray =
+		palloc0(columnCount * sizeof(InlineComparisonKind));
+	ChunkValueTracker *chunkValueTrackers =
+		palloc0(columnCount * sizeof(ChunkValueTracker));
 	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
 		FmgrInfo *comparisonFunction = NULL;
@@ -106,6 +363,203 @@ ColumnarBeginWrite(RelFileNode relfilenode,
 		}
 
 		comparisonFunctionArray[columnIndex] = comparisonFunction;
+		if (comparisonFunction != NULL)
+		{
+			comparisonKindArray[columnIndex] = GetInlineComparisonKind(attributeForm);
+		}
+
+		chunkValueTrackers[columnIndex].valuesSorted = true;
+		initHyperLogLog(&chunkValueTrackers[columnIndex].distinctSketch,
+						DISTINCT_SKETCH_REGISTER_WIDTH);
+	}
+
+	/* get hash functions of the columns that get bloom filters */
+	FmgrInfo **bloomHashFunctionArray = palloc0(columnCount * sizeof(FmgrInfo *));
+	uint64 **bloomHashArray = palloc0(columnCount * sizeof(uint64 *));
+	uint32 *bloomHashCount = palloc0(columnCount * sizeof(uint32));
+	uint32 *bloomHashCapacity = palloc0(columnCount * sizeof(uint32));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		FormData_pg_attribute *attributeForm = TupleDescAttr(tupleDescriptor,
+															 columnIndex);
+
+		if (attributeForm->attisdropped ||
+			!bms_is_member(attributeForm->attnum, options.bloomFilterColumns))
+		{
+			continue;
+		}
+
+		bloomHashFunctionArray[columnIndex] =
+			ColumnarBloomHashFunction(attributeForm->atttypid);
+		if (bloomHashFunctionArray[columnIndex] != NULL)
+		{
+			bloomHashCapacity[columnIndex] = Min(options.chunkRowCount, 1024);
+			bloomHashArray[columnIndex] =
+				palloc(bloomHashCapacity[columnIndex] * sizeof(uint64));
+		}
+	}
+
+	/*
+	 * Columns in hll_columns get a sketch per chunk, unless a type change or
+	 * collation made their values unfit for it since the option was set.
+	 */
+	uint8 **hllRegisterArray = palloc0(columnCount * sizeof(uint8 *));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		FormData_pg_attribute *attributeForm = TupleDescAttr(tupleDescriptor,
+															 columnIndex);
+
+		if (attributeForm->attisdropped ||
+			!bms_is_member(attributeForm->attnum, options.hllColumns) ||
+			!ColumnarHllTypeSupported(attributeForm->atttypid))
+		{
+			continue;
+		}
+
+		if (OidIsValid(attributeForm->attcollation) &&
+			!get_collation_isdeterministic(attributeForm->attcollation))
+		{
+			continue;
+		}
+
+		hllRegisterArray[columnIndex] = palloc0(COLUMNAR_HLL_REGISTERS);
+	}
+
+	/* jsonb columns with shredded keys get statistics of the keys per chunk */
+	List **shreddedKeyStatisticsArray = palloc0(columnCount * sizeof(List *));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		FormData_pg_attribute *attributeForm = TupleDescAttr(tupleDescriptor,
+															 columnIndex);
+
+		if (attributeForm->attisdropped || attributeForm->atttypid != JSONBOID)
+		{
+			continue;
+		}
+
+		shreddedKeyStatisticsArray[columnIndex] =
+			ColumnarShreddedKeyStatisticsList(options.shreddedKeys,
+											  attributeForm->attnum);
+	}
+
+	/* resolve the compression of each column */
+	CompressionType *compressionTypeArray = palloc(columnCount * sizeof(CompressionType));
+	int *compressionLevelArray = palloc(columnCount * sizeof(int));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		compressionTypeArray[columnIndex] = options.compressionType;
+		compressionLevelArray[columnIndex] = options.compressionLevel;
+	}
+
+	ColumnCompressionOption *compressionOption = NULL;
+	foreach_ptr(compressionOption, options.columnCompressionOptions)
+	{
+		if (compressionOption->attnum > columnCount ||
+			compressionOption->compressionType == COMPRESSION_TYPE_INVALID)
+		{
+			continue;
+		}
+
+		int columnIndex = AttrNumberGetAttrOffset(compressionOption->attnum);
+
+		compressionTypeArray[columnIndex] = compressionOption->compressionType;
+		if (compressionOption->compressionLevel != 0)
+		{
+			compressionLevelArray[columnIndex] = compressionOption->compressionLevel;
+		}
+	}
+
+	/* zstd compressed columns use their latest trained dictionary, if any */
+	uint64 *compressionDictionaryIdArray = palloc0(columnCount * sizeof(uint64));
+	if (ColumnarCompressionDictionarySupported())
+	{
+		uint64 storageId = 0;
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (compressionTypeArray[columnIndex] != COMPRESSION_ZSTD)
+			{
+				continue;
+			}
+
+			if (storageId == 0)
+			{
+				storageId = LookupStorageId(relfilenode);
+			}
+
+			compressionDictionaryIdArray[columnIndex] =
+				ReadLatestCompressionDictionaryId(storageId,
+												  AttrOffsetGetAttrNumber(columnIndex));
+		}
+	}
+
+	/* the sort key is ignored if it was dropped or its type can't be sorted */
+	int sortKeyIndex = -1;
+	Oid sortKeyOperator = SortableColumnOperator(tupleDescriptor,
+												 options.sortKeyColumn);
+	if (OidIsValid(sortKeyOperator))
+	{
+		sortKeyIndex = AttrNumberGetAttrOffset(options.sortKeyColumn);
+	}
+
+	/* so are Z-order columns, a single one left is used as the sort key */
+	int zorderColumnCount = 0;
+	int *zorderColumnIndexes = NULL;
+	SortSupportData *zorderSortSupport = NULL;
+	if (sortKeyIndex < 0 && !bms_is_empty(options.zorderColumns))
+	{
+		int zorderColumnCapacity = bms_num_members(options.zorderColumns);
+		zorderColumnIndexes = palloc0(zorderColumnCapacity * sizeof(int));
+		zorderSortSupport = palloc0(zorderColumnCapacity * sizeof(SortSupportData));
+
+		int attnum = -1;
+		while ((attnum = bms_next_member(options.zorderColumns, attnum)) >= 0)
+		{
+			Oid sortOperator = SortableColumnOperator(tupleDescriptor, attnum);
+			if (!OidIsValid(sortOperator))
+			{
+				continue;
+			}
+
+			PrepareColumnSortSupport(&zorderSortSupport[zorderColumnCount],
+									 tupleDescriptor, attnum, sortOperator);
+			zorderColumnIndexes[zorderColumnCount] = AttrNumberGetAttrOffset(attnum);
+			zorderColumnCount++;
+		}
+
+		if (zorderColumnCount > 0)
+		{
+			sortKeyIndex = zorderColumnIndexes[0];
+		}
+
+		if (zorderColumnCount == 1)
+		{
+			sortKeyOperator =
+				SortableColumnOperator(tupleDescriptor,
+									   AttrOffsetGetAttrNumber(sortKeyIndex));
+			zorderColumnCount = 0;
+		}
+	}
+
+	/* the bucket_by column is ignored if it was dropped or can't be hashed */
+	int bucketKeyIndex = -1;
+	FmgrInfo *bucketHashFunction = NULL;
+	Oid bucketCollation = InvalidOid;
+	if (AttributeNumberIsValid(options.bucketColumn) &&
+		options.bucketColumn <= tupleDescriptor->natts)
+	{
+		Form_pg_attribute bucketAttribute =
+			TupleDescAttr(tupleDescriptor,
+						  AttrNumberGetAttrOffset(options.bucketColumn));
+		if (!bucketAttribute->attisdropped)
+		{
+			bucketHashFunction = ColumnarBloomHashFunction(bucketAttribute->atttypid);
+			bucketCollation = bucketAttribute->attcollation;
+		}
+
+		if (bucketHashFunction != NULL)
+		{
+			bucketKeyIndex = AttrNumberGetAttrOffset(options.bucketColumn);
+		}
 	}
 
 	/*
@@ -123,17 +577,86 @@ ColumnarBeginWrite(RelFileNode relfilenode,
 	ChunkData *chunkData = CreateEmptyChunkData(columnCount, columnMaskArray,
 												options.chunkRowCount);
 
+	/* old catalogs can't record encodings, so chunks must stay unencoded */
+	bool valueEncodingSupported = ColumnarChunkValueEncodingSupported();
+
 	ColumnarWriteState *writeState = palloc0(sizeof(ColumnarWriteState));
 	writeState->relfilenode = relfilenode;
+	writeState->relationId = InvalidOid;
 	writeState->options = options;
+	writeState->options.bloomFilterColumns = bms_copy(options.bloomFilterColumns);
+	writeState->options.hllColumns = bms_copy(options.hllColumns);
+	writeState->options.shreddedKeys = NIL;
+	writeState->options.columnCompressionOptions = NIL;
+	writeState->compressionTypeArray = compressionTypeArray;
+	writeState->compressionLevelArray = compressionLevelArray;
+	writeState->compressionDictionaryIdArray = compressionDictionaryIdArray;
+	writeState->bloomHashFunctionArray = bloomHashFunctionArray;
+	writeState->bloomHashArray = bloomHashArray;
+	writeState->bloomHashCount = bloomHashCount;
+	writeState->bloomHashCapacity = bloomHashCapacity;
+	writeState->hllRegisterArray = hllRegisterArray;
+	writeState->shreddedKeyStatisticsArray = shreddedKeyStatisticsArray;
 	writeState->tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
 	writeState->comparisonFunctionArray = comparisonFunctionArray;
+	writeState->comparisonKindArray = comparisonKindArray;
+	writeState->chunkValueTrackers = chunkValueTrackers;
 	writeState->stripeBuffers = NULL;
 	writeState->stripeSkipList = NULL;
 	writeState->emptyStripeReservation = NULL;
 	writeState->stripeWriteContext = stripeWriteContext;
 	writeState->chunkData = chunkData;
 	writeState->compressionBuffer = NULL;
+	writeState->dictionaryEncodingEnabled = columnar_enable_dictionary_encoding &&
+											valueEncodingSupported;
+	writeState->runLengthEncodingEnabled = columnar_enable_run_length_encoding &&
+										   valueEncodingSupported;
+	writeState->bitPackingEnabled = columnar_enable_bit_packing &&
+									valueEncodingSupported;
+	writeState->valueOffsetsEnabled = columnar_enable_value_offsets &&
+									  valueEncodingSupported;
+	writeState->encodingBuffer = NULL;
+	writeState->nullStateEnabled = ColumnarChunkNullStateSupported();
+	writeState->largeValueThreshold = ColumnarChunkLargeValueCountSupported() ?
+									  columnar_large_value_threshold : 0;
+	writeState->largeValueBuffer = NULL;
+	writeState->sortKeyIndex = sortKeyIndex;
+	writeState->sortBuffer = NULL;
+	if (OidIsValid(sortKeyOperator))
+	{
+		PrepareColumnSortSupport(&writeState->sortSupport, tupleDescriptor,
+								 AttrOffsetGetAttrNumber(sortKeyIndex),
+								 sortKeyOperator);
+	}
+	writeState->zorderColumnCount = zorderColumnCount;
+	writeState->zorderColumnIndexes = zorderColumnIndexes;
+	writeState->zorderSortSupport = zorderSortSupport;
+	writeState->bucketKeyIndex = bucketKeyIndex;
+	writeState->bucketHashFunction = bucketHashFunction;
+	writeState->bucketCollation = bucketCollation;
+	writeState->recordBuckets = true;
+	writeState->stripeBucket = -1;
+	writeState->deltaStoreEnabled = false;
+	writeState->deltaStoreRowCount = 0;
+	writeState->projectionBuilder = CreateStripeProjectionBuilder(tupleDescriptor,
+																  &options);
+	writeState->autoRowWidth = 0;
+	writeState->liveColumnCount = 0;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		if (attributeForm->attisdropped)
+		{
+			continue;
+		}
+
+		writeState->autoRowWidth += attributeForm->attlen > 0 ?
+									att_align_nominal(attributeForm->attlen,
+													  attributeForm->attalign) :
+									get_typavgwidth(attributeForm->atttypid,
+													attributeForm->atttypmod);
+		writeState->liveColumnCount++;
+	}
 	writeState->perTupleContext = AllocSetContextCreate(CurrentMemoryContext,
 														"Columnar per tuple context",
 														ALLOCSET_DEFAULT_SIZES);
@@ -147,51 +670,90 @@ ColumnarBeginWrite(RelFileNode relfilenode,
  * we create structures to hold stripe data and skip list. Then, we serialize and
  * append data to serialized value buffer for each of the columns and update
  * corresponding skip nodes. Then, whole chunk data is compressed at every
- * rowChunkCount insertion. Then, if row count exceeds stripeMaxRowCount, we flush
- * the stripe, and add its metadata to the table footer.
+ * rowChunkCount insertion. Then, if row count exceeds stripeMaxRowCount or the
+ * stripe buffers reach stripe_size_limit bytes, we flush the stripe, and add its
+ * metadata to the table footer.
+ *
+ * If the table has a sort key, the row is only collected and all rows of the
+ * stripe are serialized in sort key order when the stripe is flushed.
+ *
+ * If the write state uses the delta store and it still has room, the row is
+ * stored there instead.
  *
  * Returns the "row number" assigned to written row.
  */
 uint64
 ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *columnNulls)
 {
-	uint32 columnIndex = 0;
-	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
-	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
-	uint32 columnCount = writeState->tupleDescriptor->natts;
+	if (DeltaStoreTakesRows(writeState, 1))
+	{
+		Relation relation = OpenWriteStateRelation(writeState);
+		uint64 deltaRowNumber = ColumnarDeltaStoreInsert(relation,
+														 writeState->tupleDescriptor,
+														 columnValues, columnNulls);
+		relation_close(relation, NoLock);
+
+		writeState->deltaStoreRowCount++;
+		return deltaRowNumber;
+	}
+
 	ColumnarOptions *options = &writeState->options;
-	const uint32 chunkRowCount = options->chunkRowCount;
-	ChunkData *chunkData = writeState->chunkData;
 	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
 
-	if (stripeBuffers == NULL)
-	{
-		stripeBuffers = CreateEmptyStripeBuffers(options->stripeRowCount,
-												 chunkRowCount, columnCount);
-		stripeSkipList = CreateEmptyStripeSkipList(options->stripeRowCount,
-												   chunkRowCount, columnCount);
-		writeState->stripeBuffers = stripeBuffers;
-		writeState->stripeSkipList = stripeSkipList;
-		writeState->compressionBuffer = makeStringInfo();
-
-		Oid relationId = RelidByRelfilenode(writeState->relfilenode.spcNode,
-											writeState->relfilenode.relNode);
-		Relation relation = relation_open(relationId, NoLock);
-		writeState->emptyStripeReservation =
-			ReserveEmptyStripe(relation, columnCount, chunkRowCount,
-							   options->stripeRowCount);
-		relation_close(relation, NoLock);
+	if (writeState->stripeBuffers == NULL)
+	{
+		CreateStripeWriteBuffers(writeState);
+	}
 
+	uint64 writtenRowNumber = 0;
+	uint64 stripeRowCount = 0;
+	if (StripeRowsCollected(writeState))
+	{
 		/*
-		 * serializedValueBuffer lives in stripe write memory context so it needs to be
-		 * initialized when the stripe is created.
+		 * The row number only reflects the insertion order, rows are moved
+		 * when the stripe is sorted.
 		 */
-		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-		{
-			chunkData->valueBufferArray[columnIndex] = makeStringInfo();
-		}
+		writtenRowNumber = writeState->emptyStripeReservation->stripeFirstRowNumber +
+						   writeState->sortBuffer->rowCount;
+		AddRowToSortBuffer(writeState, columnValues, columnNulls);
+		stripeRowCount = writeState->sortBuffer->rowCount;
+	}
+	else
+	{
+		writtenRowNumber = AppendRowToStripe(writeState, columnValues, columnNulls);
+		stripeRowCount = writeState->stripeBuffers->rowCount;
+	}
+
+	if (stripeRowCount >= options->stripeRowCount ||
+		StripeSizeLimitReached(writeState))
+	{
+		ColumnarFlushPendingWrites(writeState);
 	}
 
+	MemoryContextSwitchTo(oldContext);
+
+	return writtenRowNumber;
+}
+
+
+/*
+ * AppendRowToStripe serializes a row into the chunk buffers of the current
+ * stripe and updates the skip nodes of its chunk. It must be called in
+ * stripeWriteContext, and the caller flushes the stripe when it's full.
+ *
+ * Returns the "row number" assigned to the row.
+ */
+static uint64
+AppendRowToStripe(ColumnarWriteState *writeState, Datum *columnValues,
+				  bool *columnNulls)
+{
+	uint32 columnIndex = 0;
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	const uint32 chunkRowCount = writeState->options.chunkRowCount;
+	ChunkData *chunkData = writeState->chunkData;
+
 	uint32 chunkIndex = stripeBuffers->rowCount / chunkRowCount;
 	uint32 chunkRowIndex = stripeBuffers->rowCount % chunkRowCount;
 
@@ -207,24 +769,41 @@ ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *colu
 		}
 		else
 		{
-			FmgrInfo *comparisonFunction =
-				writeState->comparisonFunctionArray[columnIndex];
 			Form_pg_attribute attributeForm =
 				TupleDescAttr(writeState->tupleDescriptor, columnIndex);
-			bool columnTypeByValue = attributeForm->attbyval;
-			int columnTypeLength = attributeForm->attlen;
-			Oid columnCollation = attributeForm->attcollation;
-			char columnTypeAlign = attributeForm->attalign;
 
-			chunkData->existsArray[columnIndex][chunkRowIndex] = true;
+			Datum columnValue = FlattenColumnValue(attributeForm,
+												   columnValues[columnIndex]);
 
-			SerializeSingleDatum(chunkData->valueBufferArray[columnIndex],
-								 columnValues[columnIndex], columnTypeByValue,
-								 columnTypeLength, columnTypeAlign);
+			chunkData->existsArray[columnIndex][chunkRowIndex] = true;
 
-			UpdateChunkSkipNodeMinMax(chunkSkipNode, columnValues[columnIndex],
-									  columnTypeByValue, columnTypeLength,
-									  columnCollation, comparisonFunction);
+			SerializeColumnValue(writeState, columnIndex, chunkSkipNode, columnValue);
+
+			UpdateChunkStatistics(writeState, columnIndex, chunkSkipNode, columnValue);
+
+			if (writeState->bloomHashFunctionArray[columnIndex] != NULL)
+			{
+				AddBloomFilterHash(writeState, columnIndex, columnValue);
+			}
+
+			if (writeState->hllRegisterArray[columnIndex] != NULL)
+			{
+				ColumnarHllAddHash(writeState->hllRegisterArray[columnIndex],
+								   ColumnarHllHash(columnValue,
+												   attributeForm->attlen == -1));
+			}
+
+			if (writeState->shreddedKeyStatisticsArray[columnIndex] != NIL)
+			{
+				ColumnarShreddedKeysAdd(writeState->shreddedKeyStatisticsArray[columnIndex],
+										columnValue, writeState->stripeWriteContext);
+			}
+
+			/* flat copies would otherwise stay until the stripe is flushed */
+			if (columnValue != columnValues[columnIndex])
+			{
+				pfree(DatumGetPointer(columnValue));
+			}
 		}
 
 		chunkSkipNode->rowCount++;
@@ -232,6 +811,11 @@ ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *colu
 
 	stripeSkipList->chunkCount = chunkIndex + 1;
 
+	if (writeState->projectionBuilder != NULL)
+	{
+		StripeProjectionAddRow(writeState->projectionBuilder, columnValues, columnNulls);
+	}
+
 	/* last row of the chunk is inserted serialize the chunk */
 	if (chunkRowIndex == chunkRowCount - 1)
 	{
@@ -241,401 +825,2322 @@ ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *colu
 	uint64 writtenRowNumber = writeState->emptyStripeReservation->stripeFirstRowNumber +
 							  stripeBuffers->rowCount;
 	stripeBuffers->rowCount++;
-	if (stripeBuffers->rowCount >= options->stripeRowCount)
-	{
-		ColumnarFlushPendingWrites(writeState);
-	}
-
-	MemoryContextSwitchTo(oldContext);
 
 	return writtenRowNumber;
 }
 
 
 /*
- * ColumnarEndWrite finishes a columnar data load operation. If we have an unflushed
- * stripe, we flush it.
+ * AddRowToSortBuffer copies a row into the sort buffer of the current stripe,
+ * growing the buffer if needed. It must be called in stripeWriteContext.
  */
-void
-ColumnarEndWrite(ColumnarWriteState *writeState)
+static void
+AddRowToSortBuffer(ColumnarWriteState *writeState, Datum *columnValues,
+				   bool *columnNulls)
 {
-	ColumnarFlushPendingWrites(writeState);
-
-	MemoryContextDelete(writeState->stripeWriteContext);
-	pfree(writeState->comparisonFunctionArray);
-	FreeChunkData(writeState->chunkData);
-	pfree(writeState);
-}
-
+	StripeSortBuffer *sortBuffer = writeState->sortBuffer;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
 
-void
-ColumnarFlushPendingWrites(ColumnarWriteState *writeState)
-{
-	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
-	if (stripeBuffers != NULL)
+	if (sortBuffer->rowCount == sortBuffer->rowCapacity)
 	{
-		MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
+		sortBuffer->rowCapacity *= 2;
+		sortBuffer->values = repalloc_huge(sortBuffer->values,
+										   (Size) sortBuffer->rowCapacity *
+										   columnCount * sizeof(Datum));
+		sortBuffer->nulls = repalloc_huge(sortBuffer->nulls,
+										  (Size) sortBuffer->rowCapacity *
+										  columnCount * sizeof(bool));
+	}
 
-		FlushStripe(writeState);
-		MemoryContextReset(writeState->stripeWriteContext);
+	Datum *rowValues = &sortBuffer->values[(Size) sortBuffer->rowCount * columnCount];
+	bool *rowNulls = &sortBuffer->nulls[(Size) sortBuffer->rowCount * columnCount];
 
-		/* set stripe data and skip list to NULL so they are recreated next time */
-		writeState->stripeBuffers = NULL;
-		writeState->stripeSkipList = NULL;
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(writeState->tupleDescriptor, columnIndex);
 
-		MemoryContextSwitchTo(oldContext);
+		rowNulls[columnIndex] = columnNulls[columnIndex];
+		rowValues[columnIndex] = 0;
+		if (!columnNulls[columnIndex])
+		{
+			rowValues[columnIndex] = DatumCopy(columnValues[columnIndex],
+											   attributeForm->attbyval,
+											   attributeForm->attlen);
+		}
 	}
-}
-
 
-/*
- * ColumnarWritePerTupleContext
- *
- * Return per-tuple context for columnar write operation.
- */
-MemoryContext
-ColumnarWritePerTupleContext(ColumnarWriteState *state)
-{
-	return state->perTupleContext;
+	sortBuffer->rowCount++;
 }
 
 
 /*
- * CreateEmptyStripeBuffers allocates an empty StripeBuffers structure with the given
- * column count.
+ * WriteSortBufferRows sorts the rows of the sort buffer by the sort key, or
+ * in Z-order, and appends them to the chunk buffers of the stripe. Rows with
+ * equal keys keep their insertion order. A table with bucket_by gets a
+ * stripe per bucket instead, see WriteBucketStripes. It must be called in
+ * stripeWriteContext.
  */
-static StripeBuffers *
-CreateEmptyStripeBuffers(uint32 stripeMaxRowCount, uint32 chunkRowCount,
-						 uint32 columnCount)
+static void
+WriteSortBufferRows(ColumnarWriteState *writeState)
 {
-	uint32 columnIndex = 0;
-	uint32 maxChunkCount = (stripeMaxRowCount / chunkRowCount) + 1;
-	ColumnBuffers **columnBuffersArray = palloc0(columnCount * sizeof(ColumnBuffers *));
+	StripeSortBuffer *sortBuffer = writeState->sortBuffer;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
 
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	uint32 *rowOrder = palloc_extended(sortBuffer->rowCount * sizeof(uint32),
+									   MCXT_ALLOC_HUGE);
+	for (uint32 rowIndex = 0; rowIndex < sortBuffer->rowCount; rowIndex++)
+	{
+		rowOrder[rowIndex] = rowIndex;
+	}
+
+	if (writeState->zorderColumnCount > 0)
+	{
+		SortBufferRowsInZOrder(writeState, rowOrder);
+	}
+	else if (writeState->sortKeyIndex >= 0)
+	{
+		qsort_arg(rowOrder, sortBuffer->rowCount, sizeof(uint32),
+				  CompareSortBufferRows, writeState);
+	}
+
+	if (writeState->bucketKeyIndex >= 0)
+	{
+		WriteBucketStripes(writeState, rowOrder);
+	}
+	else
+	{
+		for (uint32 rowIndex = 0; rowIndex < sortBuffer->rowCount; rowIndex++)
+		{
+			Size rowOffset = (Size) rowOrder[rowIndex] * columnCount;
+			AppendRowToStripe(writeState, &sortBuffer->values[rowOffset],
+							  &sortBuffer->nulls[rowOffset]);
+		}
+	}
+
+	sortBuffer->rowCount = 0;
+	pfree(rowOrder);
+}
+
+
+/*
+ * WriteBucketStripes appends the rows of the sort buffer, in the given
+ * order, to one stripe per bucket of the bucket_by column. Buckets are
+ * written in increasing order. All but the last stripe are flushed here,
+ * the last one is flushed by the caller. Their buffers are created in a
+ * child of stripeWriteContext, which is reset after each flush, so the
+ * write state holds at most the buffers of two stripes.
+ */
+static void
+WriteBucketStripes(ColumnarWriteState *writeState, uint32 *rowOrder)
+{
+	StripeSortBuffer *sortBuffer = writeState->sortBuffer;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	uint32 bucketCount = writeState->options.bucketCount;
+	uint32 rowCount = sortBuffer->rowCount;
+
+	/* a stable counting sort by bucket keeps the order of the rows of a bucket */
+	uint32 *rowBuckets = palloc_extended(rowCount * sizeof(uint32), MCXT_ALLOC_HUGE);
+	uint32 *bucketStarts = palloc0((bucketCount + 1) * sizeof(uint32));
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		Size valueIndex = (Size) rowIndex * columnCount + writeState->bucketKeyIndex;
+		rowBuckets[rowIndex] = ColumnarBucketOfValue(writeState->bucketHashFunction,
+													 writeState->bucketCollation,
+													 sortBuffer->values[valueIndex],
+													 sortBuffer->nulls[valueIndex],
+													 bucketCount);
+		bucketStarts[rowBuckets[rowIndex] + 1]++;
+	}
+
+	for (uint32 bucket = 0; bucket < bucketCount; bucket++)
+	{
+		bucketStarts[bucket + 1] += bucketStarts[bucket];
+	}
+
+	uint32 *bucketOrder = palloc_extended(rowCount * sizeof(uint32), MCXT_ALLOC_HUGE);
+	uint32 *bucketPositions = palloc(bucketCount * sizeof(uint32));
+	memcpy(bucketPositions, bucketStarts, bucketCount * sizeof(uint32));
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		uint32 row = rowOrder[rowIndex];
+		bucketOrder[bucketPositions[rowBuckets[row]]++] = row;
+	}
+
+	MemoryContext bucketContext = NULL;
+	bool firstStripe = true;
+	for (uint32 bucket = 0; bucket < bucketCount; bucket++)
+	{
+		if (bucketStarts[bucket] == bucketStarts[bucket + 1])
+		{
+			continue;
+		}
+
+		if (!firstStripe)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(bucketContext != NULL ?
+															 bucketContext :
+															 CurrentMemoryContext);
+			FlushStripe(writeState);
+			UpdateWritePeakMemory(writeState);
+			MemoryContextSwitchTo(oldContext);
+
+			if (bucketContext == NULL)
+			{
+				bucketContext = AllocSetContextCreate(writeState->stripeWriteContext,
+													  "Columnar Bucket Stripe Context",
+													  ALLOCSET_DEFAULT_SIZES);
+			}
+			else
+			{
+				MemoryContextReset(bucketContext);
+			}
+
+			writeState->stripeBuffers = NULL;
+			writeState->stripeSkipList = NULL;
+			writeState->largeValueBuffer = NULL;
+		}
+
+		firstStripe = false;
+
+		MemoryContext oldContext = MemoryContextSwitchTo(bucketContext != NULL ?
+														 bucketContext :
+														 CurrentMemoryContext);
+		if (writeState->stripeBuffers == NULL)
+		{
+			ReserveStripeWriteBuffers(writeState);
+		}
+
+		writeState->stripeBucket = writeState->recordBuckets ? (int32) bucket : -1;
+
+		for (uint32 rowIndex = bucketStarts[bucket]; rowIndex < bucketStarts[bucket + 1];
+			 rowIndex++)
+		{
+			Size rowOffset = (Size) bucketOrder[rowIndex] * columnCount;
+			AppendRowToStripe(writeState, &sortBuffer->values[rowOffset],
+							  &sortBuffer->nulls[rowOffset]);
+		}
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	pfree(rowBuckets);
+	pfree(bucketStarts);
+	pfree(bucketOrder);
+	pfree(bucketPositions);
+}
+
+
+/*
+ * CompareSortBufferRows is the qsort_arg comparator for the row indexes of
+ * the sort buffer of the write state given as arg.
+ */
+static int
+CompareSortBufferRows(const void *left, const void *right, void *arg)
+{
+	ColumnarWriteState *writeState = (ColumnarWriteState *) arg;
+	StripeSortBuffer *sortBuffer = writeState->sortBuffer;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	uint32 leftRow = *((const uint32 *) left);
+	uint32 rightRow = *((const uint32 *) right);
+	Size leftOffset = (Size) leftRow * columnCount + writeState->sortKeyIndex;
+	Size rightOffset = (Size) rightRow * columnCount + writeState->sortKeyIndex;
+
+	int compare = ApplySortComparator(sortBuffer->values[leftOffset],
+									  sortBuffer->nulls[leftOffset],
+									  sortBuffer->values[rightOffset],
+									  sortBuffer->nulls[rightOffset],
+									  &writeState->sortSupport);
+	if (compare != 0)
+	{
+		return compare;
+	}
+
+	return (leftRow < rightRow) ? -1 : (leftRow > rightRow) ? 1 : 0;
+}
+
+
+/*
+ * SortableColumnOperator returns the "<" operator of the column with the
+ * given attribute number, or InvalidOid if there is no such column, it was
+ * dropped or its type can't be sorted.
+ */
+static Oid
+SortableColumnOperator(TupleDesc tupleDescriptor, AttrNumber attnum)
+{
+	if (attnum <= 0 || attnum > tupleDescriptor->natts)
+	{
+		return InvalidOid;
+	}
+
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(tupleDescriptor, AttrNumberGetAttrOffset(attnum));
+	if (attributeForm->attisdropped)
+	{
+		return InvalidOid;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(attributeForm->atttypid,
+												  TYPECACHE_LT_OPR);
+	return typeEntry->lt_opr;
+}
+
+
+/*
+ * PrepareColumnSortSupport prepares sortSupport for sorting by the given
+ * column with the given operator, nulls last.
+ */
+static void
+PrepareColumnSortSupport(SortSupport sortSupport, TupleDesc tupleDescriptor,
+						 AttrNumber attnum, Oid sortOperator)
+{
+	sortSupport->ssup_cxt = CurrentMemoryContext;
+	sortSupport->ssup_collation =
+		TupleDescAttr(tupleDescriptor, AttrNumberGetAttrOffset(attnum))->attcollation;
+	sortSupport->ssup_nulls_first = false;
+	sortSupport->ssup_attno = attnum;
+	PrepareSortSupportFromOrderingOp(sortOperator, sortSupport);
+}
+
+
+/*
+ * SortBufferRowsInZOrder orders the row indexes of the sort buffer in the
+ * Z-order of the Z-order columns. Values are replaced by their rank among the
+ * values of the stripe first, so that columns of any type and range weigh
+ * the same.
+ */
+static void
+SortBufferRowsInZOrder(ColumnarWriteState *writeState, uint32 *rowOrder)
+{
+	StripeSortBuffer *sortBuffer = writeState->sortBuffer;
+	uint32 rowCount = sortBuffer->rowCount;
+	int zorderColumnCount = writeState->zorderColumnCount;
+
+	ZOrderSortState sortState = { 0 };
+	sortState.sortBuffer = sortBuffer;
+	sortState.columnCount = writeState->tupleDescriptor->natts;
+	sortState.zorderColumnCount = zorderColumnCount;
+	sortState.ranks = palloc_extended((Size) rowCount * zorderColumnCount *
+									  sizeof(uint32), MCXT_ALLOC_HUGE);
+
+	for (int zorderIndex = 0; zorderIndex < zorderColumnCount; zorderIndex++)
+	{
+		sortState.columnIndex = writeState->zorderColumnIndexes[zorderIndex];
+		sortState.sortSupport = &writeState->zorderSortSupport[zorderIndex];
+
+		qsort_arg(rowOrder, rowCount, sizeof(uint32),
+				  CompareSortBufferColumn, &sortState);
+
+		/* equal values share a rank */
+		uint32 rank = 0;
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			if (rowIndex > 0 &&
+				CompareSortBufferColumn(&rowOrder[rowIndex - 1], &rowOrder[rowIndex],
+										&sortState) != 0)
+			{
+				rank++;
+			}
+
+			sortState.ranks[(Size) rowOrder[rowIndex] * zorderColumnCount +
+							zorderIndex] = rank;
+		}
+	}
+
+	qsort_arg(rowOrder, rowCount, sizeof(uint32), CompareZOrderRanks, &sortState);
+
+	pfree(sortState.ranks);
+}
+
+
+/*
+ * CompareSortBufferColumn is the qsort_arg comparator for the row indexes of
+ * a sort buffer by the value of the column of the ZOrderSortState given as
+ * arg. Ties are broken by the value of the column only, so that equal values
+ * can be found next to each other.
+ */
+static int
+CompareSortBufferColumn(const void *left, const void *right, void *arg)
+{
+	ZOrderSortState *sortState = (ZOrderSortState *) arg;
+	StripeSortBuffer *sortBuffer = sortState->sortBuffer;
+	Size leftOffset = (Size) *((const uint32 *) left) * sortState->columnCount +
+					  sortState->columnIndex;
+	Size rightOffset = (Size) *((const uint32 *) right) * sortState->columnCount +
+					   sortState->columnIndex;
+
+	return ApplySortComparator(sortBuffer->values[leftOffset],
+							   sortBuffer->nulls[leftOffset],
+							   sortBuffer->values[rightOffset],
+							   sortBuffer->nulls[rightOffset],
+							   sortState->sortSupport);
+}
+
+
+/*
+ * CompareZOrderRanks is the qsort_arg comparator for the row indexes of a
+ * sort buffer in Z-order of their ranks. Rather than interleaving the bits of
+ * the ranks, it compares the ranks of the column whose ranks differ in the
+ * most significant bit, which orders rows the same way.
+ */
+static int
+CompareZOrderRanks(const void *left, const void *right, void *arg)
+{
+	ZOrderSortState *sortState = (ZOrderSortState *) arg;
+	int zorderColumnCount = sortState->zorderColumnCount;
+	uint32 leftRow = *((const uint32 *) left);
+	uint32 rightRow = *((const uint32 *) right);
+	uint32 *leftRanks = &sortState->ranks[(Size) leftRow * zorderColumnCount];
+	uint32 *rightRanks = &sortState->ranks[(Size) rightRow * zorderColumnCount];
+
+	int deciding = 0;
+	uint32 decidingDifference = 0;
+	for (int zorderIndex = 0; zorderIndex < zorderColumnCount; zorderIndex++)
+	{
+		uint32 difference = leftRanks[zorderIndex] ^ rightRanks[zorderIndex];
+
+		/* difference has a higher most significant bit */
+		if (decidingDifference < difference &&
+			decidingDifference < (decidingDifference ^ difference))
+		{
+			deciding = zorderIndex;
+			decidingDifference = difference;
+		}
+	}
+
+	if (leftRanks[deciding] != rightRanks[deciding])
+	{
+		return (leftRanks[deciding] < rightRanks[deciding]) ? -1 : 1;
+	}
+
+	return (leftRow < rightRow) ? -1 : (leftRow > rightRow) ? 1 : 0;
+}
+
+
+/*
+ * ColumnarDisableStripeSort makes the write state keep rows in insertion
+ * order, and in the same stripe, from now on, so that row numbers it hands
+ * out stay valid. Rows that are already collected for sorting or for
+ * bucketing are flushed first.
+ */
+void
+ColumnarDisableStripeSort(ColumnarWriteState *writeState)
+{
+	if (!StripeRowsCollected(writeState))
+	{
+		return;
+	}
+
+	ColumnarFlushPendingWrites(writeState);
+	writeState->sortKeyIndex = -1;
+	writeState->zorderColumnCount = 0;
+	writeState->bucketKeyIndex = -1;
+}
+
+
+/*
+ * ColumnarDisableStripeBuckets stops recording the bucket of the stripes the
+ * write state flushes from now on, after bucket_by of its table was changed.
+ * Rows that are already collected are still split by the old column, their
+ * stripes just aren't pruned or planned by bucket.
+ */
+void
+ColumnarDisableStripeBuckets(ColumnarWriteState *writeState)
+{
+	writeState->recordBuckets = false;
+}
+
+
+/*
+ * StripeRowsCollected returns whether the rows of a stripe are collected in
+ * the sort buffer and only appended to its chunks when it is flushed.
+ */
+static inline bool
+StripeRowsCollected(ColumnarWriteState *writeState)
+{
+	return writeState->sortKeyIndex >= 0 || writeState->bucketKeyIndex >= 0;
+}
+
+
+/*
+ * ColumnarEnableDeltaStore makes the write state store its first
+ * columnar.delta_store_row_limit rows in the delta store, if the extension
+ * has one.
+ */
+void
+ColumnarEnableDeltaStore(ColumnarWriteState *writeState)
+{
+	writeState->deltaStoreEnabled = ColumnarDeltaStoreSupported();
+}
+
+
+/*
+ * ColumnarDisableDeltaStore makes the write state write all rows to stripes
+ * from now on.
+ */
+void
+ColumnarDisableDeltaStore(ColumnarWriteState *writeState)
+{
+	writeState->deltaStoreEnabled = false;
+}
+
+
+/*
+ * DeltaStoreTakesRows returns true if the next rowCount rows of the write
+ * state go to the delta store.
+ */
+static bool
+DeltaStoreTakesRows(ColumnarWriteState *writeState, uint32 rowCount)
+{
+	return writeState->deltaStoreEnabled &&
+		   writeState->deltaStoreRowCount + rowCount <=
+		   (uint64) columnar_delta_store_row_limit;
+}
+
+
+/*
+ * StripeSizeLimitReached returns true if the buffers of the current stripe
+ * use at least stripe_size_limit bytes. The buffers, including the sort
+ * buffer and the serialized chunks, all live in stripeWriteContext.
+ *
+ * The large value area of the stripe is kept in a single buffer, so the
+ * stripe is also flushed once that holds LARGE_VALUE_AREA_LIMIT bytes.
+ */
+static bool
+StripeSizeLimitReached(ColumnarWriteState *writeState)
+{
+	int stripeSizeLimit = writeState->options.stripeSizeLimit;
+
+	if (writeState->largeValueBuffer != NULL &&
+		writeState->largeValueBuffer->len >= LARGE_VALUE_AREA_LIMIT)
+	{
+		return true;
+	}
+
+	return stripeSizeLimit > 0 &&
+		   MemoryContextMemAllocated(writeState->stripeWriteContext, true) >=
+		   (Size) stripeSizeLimit;
+}
+
+
+/*
+ * ColumnarWriteBatch adds rowCount rows to the columnar table, given as one
+ * array of values and one array of nulls per column. The rows are appended
+ * to the chunk buffers in slices that end at chunk and stripe boundaries,
+ * so each slice is serialized one column at a time and min/max of fixed
+ * width integer columns is computed over the whole slice at once.
+ *
+ * stripe_size_limit is checked after each slice, so a stripe may exceed it
+ * by up to a chunk.
+ *
+ * Sets rowNumbers[i] to the "row number" assigned to the i-th row. Rows of
+ * a batch get consecutive row numbers only within a stripe.
+ */
+void
+ColumnarWriteBatch(ColumnarWriteState *writeState, Datum **columnValues,
+				   bool **columnNulls, uint32 rowCount, uint64 *rowNumbers)
+{
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	ColumnarOptions *options = &writeState->options;
+
+	/*
+	 * Rows of sorted or bucketed stripes are collected one by one anyway, and
+	 * batches that fit into the delta store are stored there row by row.
+	 */
+	if (StripeRowsCollected(writeState) || DeltaStoreTakesRows(writeState, rowCount))
+	{
+		Datum *rowValues = palloc(columnCount * sizeof(Datum));
+		bool *rowNulls = palloc(columnCount * sizeof(bool));
+
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				rowValues[columnIndex] = columnValues[columnIndex][rowIndex];
+				rowNulls[columnIndex] = columnNulls[columnIndex][rowIndex];
+			}
+
+			rowNumbers[rowIndex] = ColumnarWriteRow(writeState, rowValues, rowNulls);
+		}
+
+		pfree(rowValues);
+		pfree(rowNulls);
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
+
+	uint32 batchRowIndex = 0;
+	while (batchRowIndex < rowCount)
+	{
+		if (writeState->stripeBuffers == NULL)
+		{
+			CreateStripeWriteBuffers(writeState);
+		}
+
+		/* auto_row_limits may size each stripe differently */
+		const uint32 chunkRowCount = options->chunkRowCount;
+		ChunkData *chunkData = writeState->chunkData;
+		StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+		StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+		uint32 chunkIndex = stripeBuffers->rowCount / chunkRowCount;
+		uint32 chunkRowIndex = stripeBuffers->rowCount % chunkRowCount;
+
+		/* the slice ends at the end of the batch, the chunk or the stripe */
+		uint32 sliceRowCount = Min(rowCount - batchRowIndex,
+								   chunkRowCount - chunkRowIndex);
+		sliceRowCount = Min(sliceRowCount,
+							options->stripeRowCount - stripeBuffers->rowCount);
+
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+			Form_pg_attribute attributeForm =
+				TupleDescAttr(writeState->tupleDescriptor, columnIndex);
+			Datum *sliceValues = columnValues[columnIndex] + batchRowIndex;
+			bool *sliceNulls = columnNulls[columnIndex] + batchRowIndex;
+			bool *existsArray = chunkData->existsArray[columnIndex] + chunkRowIndex;
+
+			for (uint32 rowIndex = 0; rowIndex < sliceRowCount; rowIndex++)
+			{
+				existsArray[rowIndex] = !sliceNulls[rowIndex];
+				if (sliceNulls[rowIndex])
+				{
+					continue;
+				}
+
+				Datum columnValue = FlattenColumnValue(attributeForm,
+													   sliceValues[rowIndex]);
+
+				SerializeColumnValue(writeState, columnIndex, chunkSkipNode,
+									 columnValue);
+
+				UpdateChunkStatistics(writeState, columnIndex, chunkSkipNode,
+									  columnValue);
+
+				if (writeState->bloomHashFunctionArray[columnIndex] != NULL)
+				{
+					AddBloomFilterHash(writeState, columnIndex, columnValue);
+				}
+
+				if (writeState->hllRegisterArray[columnIndex] != NULL)
+				{
+					ColumnarHllAddHash(writeState->hllRegisterArray[columnIndex],
+									   ColumnarHllHash(columnValue,
+													   attributeForm->attlen == -1));
+				}
+
+				if (writeState->shreddedKeyStatisticsArray[columnIndex] != NIL)
+				{
+					ColumnarShreddedKeysAdd(
+						writeState->shreddedKeyStatisticsArray[columnIndex],
+						columnValue, writeState->stripeWriteContext);
+				}
+
+				if (columnValue != sliceValues[rowIndex])
+				{
+					pfree(DatumGetPointer(columnValue));
+				}
+			}
+
+			chunkSkipNode->rowCount += sliceRowCount;
+		}
+
+		stripeSkipList->chunkCount = chunkIndex + 1;
+
+		if (writeState->projectionBuilder != NULL)
+		{
+			Datum *rowValues = palloc(columnCount * sizeof(Datum));
+			bool *rowNulls = palloc(columnCount * sizeof(bool));
+
+			for (uint32 rowIndex = 0; rowIndex < sliceRowCount; rowIndex++)
+			{
+				for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+				{
+					rowValues[columnIndex] = columnValues[columnIndex][batchRowIndex +
+																	  rowIndex];
+					rowNulls[columnIndex] = columnNulls[columnIndex][batchRowIndex +
+																	 rowIndex];
+				}
+
+				StripeProjectionAddRow(writeState->projectionBuilder, rowValues,
+									   rowNulls);
+			}
+
+			pfree(rowValues);
+			pfree(rowNulls);
+		}
+
+		uint64 sliceFirstRowNumber =
+			writeState->emptyStripeReservation->stripeFirstRowNumber +
+			stripeBuffers->rowCount;
+		for (uint32 rowIndex = 0; rowIndex < sliceRowCount; rowIndex++)
+		{
+			rowNumbers[batchRowIndex + rowIndex] = sliceFirstRowNumber + rowIndex;
+		}
+
+		/* last row of the chunk is inserted serialize the chunk */
+		if (chunkRowIndex + sliceRowCount == chunkRowCount)
+		{
+			SerializeChunkData(writeState, chunkIndex, chunkRowCount);
+		}
+
+		stripeBuffers->rowCount += sliceRowCount;
+		batchRowIndex += sliceRowCount;
+
+		if (stripeBuffers->rowCount >= options->stripeRowCount ||
+			StripeSizeLimitReached(writeState))
+		{
+			ColumnarFlushPendingWrites(writeState);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarWriteChunkGroup appends the given full chunk group of a stripe of
+ * the same table to the current stripe. Its encoded buffers are copied as
+ * they are, without decoding its rows, and its skip nodes are kept. skipList
+ * is the skip list of the stripe, see ReadStripeSkipList.
+ *
+ * Copying is only possible while the current stripe ends at a chunk boundary
+ * and has room for the chunk group, the rows aren't sorted, stored in the
+ * delta store or added to a stripe projection, both stripes have the same
+ * chunk group row count and columns, and the chunk group has no large values.
+ * Returns false otherwise, so the caller writes the rows instead.
+ *
+ * Sets rowNumber, if given, to the "row number" assigned to the first row of
+ * the chunk group, and the others follow it.
+ */
+bool
+ColumnarWriteChunkGroup(ColumnarWriteState *writeState, StripeMetadata *stripeMetadata,
+						StripeSkipList *skipList, uint32 chunkIndex, uint64 *rowNumber)
+{
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	ColumnarOptions *options = &writeState->options;
+	const uint32 chunkRowCount = options->chunkRowCount;
+
+	/* the chunk group row count of an automatically sized stripe isn't known yet */
+	if (StripeRowsCollected(writeState) ||
+		writeState->projectionBuilder != NULL ||
+		options->autoRowLimits ||
+		DeltaStoreTakesRows(writeState, chunkRowCount) ||
+		stripeMetadata->columnCount != columnCount ||
+		stripeMetadata->chunkGroupRowCount != chunkRowCount ||
+		chunkIndex >= skipList->chunkCount ||
+		skipList->chunkGroupRowCounts[chunkIndex] != chunkRowCount)
+	{
+		return false;
+	}
+
+	/* references to large values point into the large value area of their stripe */
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (skipList->chunkSkipNodeArray[columnIndex][chunkIndex].largeValueCount > 0)
+		{
+			return false;
+		}
+	}
+
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	if (stripeBuffers != NULL &&
+		(stripeBuffers->rowCount % chunkRowCount != 0 ||
+		 stripeBuffers->rowCount + chunkRowCount > options->stripeRowCount))
+	{
+		return false;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
+
+	if (writeState->stripeBuffers == NULL)
+	{
+		CreateStripeWriteBuffers(writeState);
+		stripeBuffers = writeState->stripeBuffers;
+	}
+
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	uint32 stripeChunkIndex = stripeBuffers->rowCount / chunkRowCount;
+	Relation relation = OpenWriteStateRelation(writeState);
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(writeState->tupleDescriptor, columnIndex);
+		ColumnChunkSkipNode *sourceSkipNode =
+			&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[columnIndex][stripeChunkIndex];
+		ColumnChunkBuffers *chunkBuffers =
+			stripeBuffers->columnBuffersArray[columnIndex]->chunkBuffersArray[stripeChunkIndex];
+
+		chunkBuffers->existsBuffer =
+			ReadChunkStream(relation, stripeMetadata->fileOffset +
+							sourceSkipNode->existsChunkOffset,
+							sourceSkipNode->existsLength);
+		chunkBuffers->valueBuffer =
+			ReadChunkStream(relation, stripeMetadata->fileOffset +
+							sourceSkipNode->valueChunkOffset,
+							sourceSkipNode->valueLength);
+		chunkBuffers->valueCompressionType = sourceSkipNode->valueCompressionType;
+		chunkBuffers->valueCompressionLevel = sourceSkipNode->valueCompressionLevel;
+		chunkBuffers->valueEncodingType = sourceSkipNode->valueEncodingType;
+		chunkBuffers->nullState = sourceSkipNode->nullState;
+		chunkBuffers->compressionDictionaryId = sourceSkipNode->compressionDictionaryId;
+		chunkBuffers->decompressedValueSize = sourceSkipNode->decompressedValueSize;
+		chunkBuffers->largeValueCount = 0;
+
+		/* offsets and lengths are set again when the stripe is flushed */
+		*chunkSkipNode = *sourceSkipNode;
+		if (sourceSkipNode->hasMinMax)
+		{
+			chunkSkipNode->minimumValue = DatumCopy(sourceSkipNode->minimumValue,
+													attributeForm->attbyval,
+													attributeForm->attlen);
+			chunkSkipNode->maximumValue = DatumCopy(sourceSkipNode->maximumValue,
+													attributeForm->attbyval,
+													attributeForm->attlen);
+		}
+
+		if (sourceSkipNode->bloomFilter != NULL)
+		{
+			chunkSkipNode->bloomFilter = palloc(VARSIZE(sourceSkipNode->bloomFilter));
+			memcpy(chunkSkipNode->bloomFilter, sourceSkipNode->bloomFilter,
+				   VARSIZE(sourceSkipNode->bloomFilter));
+		}
+
+		if (sourceSkipNode->hllSketch != NULL)
+		{
+			chunkSkipNode->hllSketch = palloc(VARSIZE(sourceSkipNode->hllSketch));
+			memcpy(chunkSkipNode->hllSketch, sourceSkipNode->hllSketch,
+				   VARSIZE(sourceSkipNode->hllSketch));
+		}
+
+		if (sourceSkipNode->shreddedKeyStats != NULL)
+		{
+			chunkSkipNode->shreddedKeyStats =
+				palloc(VARSIZE(sourceSkipNode->shreddedKeyStats));
+			memcpy(chunkSkipNode->shreddedKeyStats, sourceSkipNode->shreddedKeyStats,
+				   VARSIZE(sourceSkipNode->shreddedKeyStats));
+		}
+	}
+
+	relation_close(relation, NoLock);
+
+	if (rowNumber)
+	{
+		*rowNumber = writeState->emptyStripeReservation->stripeFirstRowNumber +
+					 stripeBuffers->rowCount;
+	}
+
+	writeState->chunkGroupRowCounts =
+		lappend_int(writeState->chunkGroupRowCounts, chunkRowCount);
+	stripeSkipList->chunkCount = stripeChunkIndex + 1;
+	stripeBuffers->rowCount += chunkRowCount;
+
+	if (stripeBuffers->rowCount >= options->stripeRowCount ||
+		StripeSizeLimitReached(writeState))
+	{
+		ColumnarFlushPendingWrites(writeState);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * ReadChunkStream reads the exists or value stream of a chunk that starts at
+ * the given logical offset into a new buffer.
+ */
+static StringInfo
+ReadChunkStream(Relation relation, uint64 logicalOffset, uint64 length)
+{
+	StringInfo buffer = makeStringInfo();
+
+	if (length > 0)
+	{
+		enlargeStringInfo(buffer, length);
+		ColumnarStorageRead(relation, logicalOffset, buffer->data, length);
+		buffer->len = length;
+	}
+
+	return buffer;
+}
+
+
+/*
+ * ColumnarEndWrite finishes a columnar data load operation. If we have an unflushed
+ * stripe, we flush it.
+ */
+void
+ColumnarEndWrite(ColumnarWriteState *writeState)
+{
+	ColumnarFlushPendingWrites(writeState);
+
+	if (writeState->stripeReservationBatch.remainingStripeCount > 0)
+	{
+		Relation relation = OpenWriteStateRelation(writeState);
+		ReleaseStripeReservationBatch(relation, &writeState->stripeReservationBatch,
+									  writeState->options.stripeRowCount);
+		relation_close(relation, NoLock);
+	}
+
+	UpdateWritePeakMemory(writeState);
+
+	MemoryContextDelete(writeState->stripeWriteContext);
+	pfree(writeState->comparisonFunctionArray);
+	FreeChunkData(writeState->chunkData);
+	pfree(writeState);
+}
+
+
+void
+ColumnarFlushPendingWrites(ColumnarWriteState *writeState)
+{
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	if (stripeBuffers != NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
+
+		if (writeState->sortBuffer != NULL)
+		{
+			WriteSortBufferRows(writeState);
+		}
+
+		FlushStripe(writeState);
+		UpdateWritePeakMemory(writeState);
+		MemoryContextReset(writeState->stripeWriteContext);
+
+		/* set stripe data and skip list to NULL so they are recreated next time */
+		writeState->stripeBuffers = NULL;
+		writeState->stripeSkipList = NULL;
+		writeState->sortBuffer = NULL;
+		writeState->largeValueBuffer = NULL;
+		writeState->compressionThread = NULL;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+}
+
+
+/*
+ * UpdateWritePeakMemory records the memory held by the stripe being written
+ * in the peak of all write states of the backend. Called before
+ * stripeWriteContext is reset, after the stripe was compressed and flushed,
+ * which is when it holds the most.
+ */
+static void
+UpdateWritePeakMemory(ColumnarWriteState *writeState)
+{
+	uint64 allocated = MemoryContextMemAllocated(writeState->stripeWriteContext, true);
+
+	WriteStatePeakMemory = Max(WriteStatePeakMemory, allocated);
+}
+
+
+/*
+ * ColumnarWriteStatePeakMemory returns the most memory a write state of this
+ * backend held for a stripe since the last ColumnarResetWriteStatePeakMemory.
+ */
+uint64
+ColumnarWriteStatePeakMemory(void)
+{
+	return WriteStatePeakMemory;
+}
+
+
+/*
+ * ColumnarResetWriteStatePeakMemory resets what ColumnarWriteStatePeakMemory
+ * returns.
+ */
+void
+ColumnarResetWriteStatePeakMemory(void)
+{
+	WriteStatePeakMemory = 0;
+}
+
+
+/*
+ * ColumnarWritePerTupleContext
+ *
+ * Return per-tuple context for columnar write operation.
+ */
+MemoryContext
+ColumnarWritePerTupleContext(ColumnarWriteState *state)
+{
+	return state->perTupleContext;
+}
+
+
+/*
+ * ColumnarWriteStateMemory returns the memory held by the stripe the write
+ * state is buffering, which ColumnarFlushPendingWrites gives back.
+ */
+uint64
+ColumnarWriteStateMemory(ColumnarWriteState *state)
+{
+	return MemoryContextMemAllocated(state->stripeWriteContext, true);
+}
+
+
+/*
+ * CreateEmptyStripeBuffers allocates an empty StripeBuffers structure with the given
+ * column count.
+ */
+static StripeBuffers *
+CreateEmptyStripeBuffers(uint32 stripeMaxRowCount, uint32 chunkRowCount,
+						 uint32 columnCount)
+{
+	uint32 columnIndex = 0;
+	uint32 maxChunkCount = (stripeMaxRowCount / chunkRowCount) + 1;
+	ColumnBuffers **columnBuffersArray = palloc0(columnCount * sizeof(ColumnBuffers *));
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
 		uint32 chunkIndex = 0;
 		ColumnChunkBuffers **chunkBuffersArray =
 			palloc0(maxChunkCount * sizeof(ColumnChunkBuffers *));
 
-		for (chunkIndex = 0; chunkIndex < maxChunkCount; chunkIndex++)
+		for (chunkIndex = 0; chunkIndex < maxChunkCount; chunkIndex++)
+		{
+			chunkBuffersArray[chunkIndex] = palloc0(sizeof(ColumnChunkBuffers));
+			chunkBuffersArray[chunkIndex]->existsBuffer = NULL;
+			chunkBuffersArray[chunkIndex]->valueBuffer = NULL;
+			chunkBuffersArray[chunkIndex]->valueCompressionType = COMPRESSION_NONE;
+			chunkBuffersArray[chunkIndex]->valueEncodingType = VALUE_ENCODING_NONE;
+			chunkBuffersArray[chunkIndex]->nullState = CHUNK_NULLS_SOME;
+		}
+
+		columnBuffersArray[columnIndex] = palloc0(sizeof(ColumnBuffers));
+		columnBuffersArray[columnIndex]->chunkBuffersArray = chunkBuffersArray;
+	}
+
+	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
+	stripeBuffers->columnBuffersArray = columnBuffersArray;
+	stripeBuffers->columnCount = columnCount;
+	stripeBuffers->rowCount = 0;
+
+	return stripeBuffers;
+}
+
+
+/*
+ * CreateEmptyStripeSkipList allocates an empty StripeSkipList structure with
+ * the given column count. This structure has enough chunks to hold statistics
+ * for stripeMaxRowCount rows.
+ */
+static StripeSkipList *
+CreateEmptyStripeSkipList(uint32 stripeMaxRowCount, uint32 chunkRowCount,
+						  uint32 columnCount)
+{
+	uint32 columnIndex = 0;
+	uint32 maxChunkCount = (stripeMaxRowCount / chunkRowCount) + 1;
+
+	ColumnChunkSkipNode **chunkSkipNodeArray =
+		palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		chunkSkipNodeArray[columnIndex] =
+			palloc0(maxChunkCount * sizeof(ColumnChunkSkipNode));
+	}
+
+	StripeSkipList *stripeSkipList = palloc0(sizeof(StripeSkipList));
+	stripeSkipList->columnCount = columnCount;
+	stripeSkipList->chunkCount = 0;
+	stripeSkipList->chunkSkipNodeArray = chunkSkipNodeArray;
+
+	return stripeSkipList;
+}
+
+
+/*
+ * OpenWriteStateRelation opens the relation the write state writes to. The
+ * relation id is looked up only once per write state. The relation is not
+ * kept open across calls, since write states outlive the resource owners of
+ * the statements that use them.
+ */
+static Relation
+OpenWriteStateRelation(ColumnarWriteState *writeState)
+{
+	if (!OidIsValid(writeState->relationId))
+	{
+		writeState->relationId = RelidByRelfilenode(writeState->relfilenode.spcNode,
+													writeState->relfilenode.relNode);
+	}
+
+	return relation_open(writeState->relationId, NoLock);
+}
+
+
+/*
+ * CreateStripeWriteBuffers creates the structures that hold the data and the
+ * skip list of a new stripe, and reserves the stripe. It must be called in
+ * stripeWriteContext.
+ */
+static void
+CreateStripeWriteBuffers(ColumnarWriteState *writeState)
+{
+	if (writeState->options.autoRowLimits)
+	{
+		AutoSizeStripe(writeState);
+	}
+
+	ReserveStripeWriteBuffers(writeState);
+
+	if (StripeRowsCollected(writeState))
+	{
+		uint32 columnCount = writeState->tupleDescriptor->natts;
+		ColumnarOptions *options = &writeState->options;
+
+		StripeSortBuffer *sortBuffer = palloc0(sizeof(StripeSortBuffer));
+		sortBuffer->rowCapacity = Min(options->stripeRowCount, 1024);
+		sortBuffer->values = palloc_extended((Size) sortBuffer->rowCapacity *
+											 columnCount * sizeof(Datum),
+											 MCXT_ALLOC_HUGE);
+		sortBuffer->nulls = palloc_extended((Size) sortBuffer->rowCapacity *
+											columnCount * sizeof(bool),
+											MCXT_ALLOC_HUGE);
+		writeState->sortBuffer = sortBuffer;
+	}
+}
+
+
+/*
+ * ReserveStripeWriteBuffers creates the chunk buffers and the skip list of a
+ * new stripe in the current memory context, and reserves the stripe. The
+ * stripes of the buckets of a bucket_by table after the first one get their
+ * buffers from here, with the same row limits.
+ */
+static void
+ReserveStripeWriteBuffers(ColumnarWriteState *writeState)
+{
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	ColumnarOptions *options = &writeState->options;
+	const uint32 chunkRowCount = options->chunkRowCount;
+	ChunkData *chunkData = writeState->chunkData;
+
+	writeState->stripeBuffers = CreateEmptyStripeBuffers(options->stripeRowCount,
+														 chunkRowCount, columnCount);
+	writeState->stripeSkipList = CreateEmptyStripeSkipList(options->stripeRowCount,
+														   chunkRowCount, columnCount);
+	writeState->compressionBuffer = makeStringInfo();
+	writeState->encodingBuffer = makeStringInfo();
+
+	/* the thread is joined when stripeWriteContext is reset */
+	if (columnar_enable_compression_thread && writeState->compressionThread == NULL)
+	{
+		writeState->compressionThread = CreateCompressionThread();
+		writeState->pendingJobCount = 0;
+	}
+
+	Relation relation = OpenWriteStateRelation(writeState);
+	writeState->emptyStripeReservation =
+		ReserveEmptyStripe(relation, columnCount, chunkRowCount,
+						   options->stripeRowCount,
+						   &writeState->stripeReservationBatch);
+	relation_close(relation, NoLock);
+
+	/*
+	 * serializedValueBuffer lives in stripe write memory context so it needs to be
+	 * initialized when the stripe is created.
+	 */
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		chunkData->valueBufferArray[columnIndex] = makeStringInfo();
+	}
+
+	writeState->stripeBucket = -1;
+}
+
+
+/*
+ * AutoSizeStripe picks the chunk group and stripe row counts of the next
+ * stripe of a table with auto_row_limits. Chunk groups get about
+ * columnar.auto_chunk_size bytes of an average column, halved if scans of
+ * the table skip most chunk groups and doubled if they skip almost none, and
+ * stripes about columnar.auto_stripe_size bytes. The chunk buffers of the
+ * write state are reallocated if the chunk group row count changes.
+ */
+static void
+AutoSizeStripe(ColumnarWriteState *writeState)
+{
+	ColumnarOptions *options = &writeState->options;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	double rowWidth = Max(writeState->autoRowWidth, 1.0);
+	double columnWidth = rowWidth / Max(writeState->liveColumnCount, 1);
+
+	Relation relation = OpenWriteStateRelation(writeState);
+
+	double chunkRows = columnar_auto_chunk_size *
+					   AutoChunkPruningFactor(writeState) / columnWidth;
+	uint32 chunkRowCount = AutoRowLimit(chunkRows, CHUNK_ROW_COUNT_MINIMUM,
+										AUTO_CHUNK_ROW_COUNT_MAXIMUM,
+										CHUNK_ROW_COUNT_MINIMUM);
+
+	double stripeRows = Max(columnar_auto_stripe_size / rowWidth, chunkRowCount);
+	uint32 stripeRowCount = AutoRowLimit(stripeRows, STRIPE_ROW_COUNT_MINIMUM,
+										 STRIPE_ROW_COUNT_MAXIMUM, chunkRowCount);
+
+	if (chunkRowCount != options->chunkRowCount)
+	{
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(GetMemoryChunkContext(writeState));
+
+		bool *columnMaskArray = palloc(columnCount * sizeof(bool));
+		memset(columnMaskArray, true, columnCount * sizeof(bool));
+
+		FreeChunkData(writeState->chunkData);
+		writeState->chunkData = CreateEmptyChunkData(columnCount, columnMaskArray,
+													 chunkRowCount);
+		pfree(columnMaskArray);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	/* reserved row numbers of the batch are spaced by the old stripe row count */
+	if (stripeRowCount != options->stripeRowCount &&
+		writeState->stripeReservationBatch.remainingStripeCount > 0)
+	{
+		ReleaseStripeReservationBatch(relation, &writeState->stripeReservationBatch,
+									  options->stripeRowCount);
+	}
+
+	relation_close(relation, NoLock);
+
+	elog(DEBUG1, "auto row limits: chunk group row limit %u, stripe row limit %u "
+				 "for a row width of %.1f bytes", chunkRowCount, stripeRowCount,
+		 rowWidth);
+
+	options->chunkRowCount = chunkRowCount;
+	options->stripeRowCount = stripeRowCount;
+}
+
+
+/*
+ * AutoChunkPruningFactor returns how much larger the chunk groups of a table
+ * with auto_row_limits should be than the target size, by the fraction of
+ * chunk groups its scans skipped so far. Smaller chunk groups let scans that
+ * already skip chunk groups skip more rows, larger ones compress better when
+ * scans skip almost none.
+ */
+static double
+AutoChunkPruningFactor(ColumnarWriteState *writeState)
+{
+	uint64 counters[COLUMNAR_STAT_COUNTER_COUNT] = { 0 };
+	if (!ColumnarStatRelationCounters(writeState->relationId, counters))
+	{
+		return 1.0;
+	}
+
+	uint64 scannedCount = counters[COLUMNAR_STAT_CHUNK_GROUPS_SCANNED];
+	uint64 skippedCount = counters[COLUMNAR_STAT_CHUNK_GROUPS_SKIPPED];
+	uint64 chunkGroupCount = scannedCount + skippedCount;
+	if (chunkGroupCount < AUTO_ROW_LIMITS_MIN_CHUNK_GROUPS)
+	{
+		return 1.0;
+	}
+	else if (skippedCount * 2 >= chunkGroupCount)
+	{
+		return 0.5;
+	}
+	else if (skippedCount * 20 < chunkGroupCount)
+	{
+		return 2.0;
+	}
+
+	return 1.0;
+}
+
+
+/*
+ * AutoRowLimit clamps the given row count to the given bounds and rounds it
+ * down to a multiple of the given number of rows, which is at most the
+ * maximum.
+ */
+static uint32
+AutoRowLimit(double rowCount, uint32 minimum, uint32 maximum, uint32 multiple)
+{
+	uint32 rowLimit = (uint32) Min(Max(rowCount, minimum), maximum);
+
+	return Max(rowLimit / multiple * multiple, multiple);
+}
+
+
+/*
+ * FlushStripe flushes current stripe data into the file. The function first ensures
+ * the last data chunk for each column is properly serialized and compressed. Then,
+ * the function creates the skip list and footer buffers. Finally, the function
+ * flushes the skip list, data, and footer buffers to the file.
+ */
+static void
+FlushStripe(ColumnarWriteState *writeState)
+{
+	uint32 columnIndex = 0;
+	uint32 chunkIndex = 0;
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	ColumnChunkSkipNode **columnSkipNodeArray = stripeSkipList->chunkSkipNodeArray;
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
+	uint32 columnCount = tupleDescriptor->natts;
+	uint32 chunkCount = stripeSkipList->chunkCount;
+	uint32 chunkRowCount = writeState->options.chunkRowCount;
+	uint32 lastChunkIndex = stripeBuffers->rowCount / chunkRowCount;
+	uint32 lastChunkRowCount = stripeBuffers->rowCount % chunkRowCount;
+	StringInfo largeValueBuffer = writeState->largeValueBuffer;
+	uint64 stripeSize = largeValueBuffer != NULL ? largeValueBuffer->len : 0;
+	uint64 stripeRowCount = stripeBuffers->rowCount;
+	uint64 stripeValueSize = 0;
+
+	elog(DEBUG1, "Flushing Stripe of size %d", stripeBuffers->rowCount);
+
+	Relation relation = OpenWriteStateRelation(writeState);
+
+	ColumnarStatCount(writeState->relationId, COLUMNAR_STAT_STRIPES_FLUSHED, 1);
+
+	COLUMNAR_TRACE_STRIPE_FLUSH_START(writeState->relationId, stripeRowCount);
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_STRIPE_FLUSH);
+
+	/*
+	 * check if the last chunk needs serialization , the last chunk was not serialized
+	 * if it was not full yet, e.g.  (rowCount > 0)
+	 */
+	if (lastChunkRowCount > 0)
+	{
+		SerializeChunkData(writeState, lastChunkIndex, lastChunkRowCount);
+	}
+
+	FinishPendingCompression(writeState);
+
+	/* update buffer sizes in stripe skip list */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNodeArray = columnSkipNodeArray[columnIndex];
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+
+		for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkBuffers *chunkBuffers =
+				columnBuffers->chunkBuffersArray[chunkIndex];
+			uint64 existsBufferSize = chunkBuffers->existsBuffer->len;
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+
+			chunkSkipNode->existsChunkOffset = stripeSize;
+			chunkSkipNode->existsLength = existsBufferSize;
+			chunkSkipNode->nullState = chunkBuffers->nullState;
+			stripeSize += existsBufferSize;
+		}
+
+		for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkBuffers *chunkBuffers =
+				columnBuffers->chunkBuffersArray[chunkIndex];
+			uint64 valueBufferSize = chunkBuffers->valueBuffer->len;
+			CompressionType valueCompressionType = chunkBuffers->valueCompressionType;
+			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+
+			chunkSkipNode->valueChunkOffset = stripeSize;
+			chunkSkipNode->valueLength = valueBufferSize;
+			chunkSkipNode->valueCompressionType = valueCompressionType;
+			chunkSkipNode->valueCompressionLevel = chunkBuffers->valueCompressionLevel;
+			chunkSkipNode->valueEncodingType = chunkBuffers->valueEncodingType;
+			chunkSkipNode->compressionDictionaryId =
+				chunkBuffers->compressionDictionaryId;
+			chunkSkipNode->decompressedValueSize = chunkBuffers->decompressedValueSize;
+
+			stripeSize += valueBufferSize;
+			stripeValueSize += chunkBuffers->decompressedValueSize;
+		}
+	}
+
+	if (writeState->options.autoRowLimits)
+	{
+		writeState->autoRowWidth = (double) stripeValueSize / stripeRowCount;
+	}
+
+	StripeMetadata *stripeMetadata =
+		CompleteStripeReservation(relation, writeState->emptyStripeReservation->stripeId,
+								  stripeSize, stripeRowCount, chunkCount,
+								  writeState->stripeBucket);
+
+	/*
+	 * Each stripe has two sections:
+	 * Large value section, which holds the values of at least
+	 * columnar.large_value_threshold bytes, and is empty if there are none.
+	 * Data section, in which we store data for each column continuously.
+	 * We store data for each for each column in chunks. For each chunk, we
+	 * store two buffers: "exists" buffer, and "value" buffer. "exists" buffer
+	 * tells which values are not NULL. "value" buffer contains values for
+	 * present values. For each column, we first store all "exists" buffers,
+	 * and then all "value" buffers.
+	 */
+
+	/*
+	 * The large values go first, their offsets are relative to the stripe.
+	 * All buffers are written at once, so their pages are logged in batches.
+	 */
+	uint32 bufferCount = 0;
+	StringInfo *buffers = palloc((1 + 2 * (Size) columnCount * chunkCount) *
+								 sizeof(StringInfo));
+	if (largeValueBuffer != NULL)
+	{
+		buffers[bufferCount++] = largeValueBuffer;
+	}
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+
+		for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			buffers[bufferCount++] =
+				columnBuffers->chunkBuffersArray[chunkIndex]->existsBuffer;
+		}
+
+		for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			buffers[bufferCount++] =
+				columnBuffers->chunkBuffersArray[chunkIndex]->valueBuffer;
+		}
+	}
+
+	ColumnarStorageWriteBuffers(relation, stripeMetadata->fileOffset, buffers,
+								bufferCount);
+	pfree(buffers);
+
+	/* the storage writes reported their own wait event */
+	pgstat_report_wait_start(WAIT_EVENT_COLUMNAR_STRIPE_FLUSH);
+
+	SaveChunkGroups(writeState->relfilenode,
+					stripeMetadata->id,
+					writeState->chunkGroupRowCounts);
+	SaveStripeSkipList(writeState->relfilenode,
+					   stripeMetadata->id,
+					   stripeSkipList, tupleDescriptor);
+	SaveStripeColumnSummaries(writeState->relfilenode,
+							  stripeMetadata->id,
+							  BuildStripeColumnSummaries(writeState),
+							  tupleDescriptor);
+	SaveEmptyRowMask(LookupStorageId(writeState->relfilenode),
+					 stripeMetadata->id,
+					 stripeMetadata->firstRowNumber,
+					 writeState->chunkGroupRowCounts);
+
+	if (writeState->projectionBuilder != NULL)
+	{
+		bytea *projection = StripeProjectionFinish(writeState->projectionBuilder);
+		if (projection != NULL)
+		{
+			SaveStripeProjection(writeState->relfilenode, stripeMetadata->id,
+								 projection);
+		}
+
+		ResetStripeProjectionBuilder(writeState->projectionBuilder);
+	}
+
+	writeState->chunkGroupRowCounts = NIL;
+
+	pgstat_report_wait_end();
+	COLUMNAR_TRACE_STRIPE_FLUSH_DONE(writeState->relationId, stripeMetadata->id,
+									 stripeSize);
+
+	relation_close(relation, NoLock);
+}
+
+
+/*
+ * SerializeBoolArray serializes the given boolean array and returns the result
+ * as a StringInfo. This function packs every 8 boolean values into one byte.
+ */
+static StringInfo
+SerializeBoolArray(bool *boolArray, uint32 boolArrayLength)
+{
+	uint32 boolArrayIndex = 0;
+	uint32 byteCount = ((boolArrayLength * sizeof(bool)) + (8 - sizeof(bool))) / 8;
+
+	StringInfo boolArrayBuffer = makeStringInfo();
+	enlargeStringInfo(boolArrayBuffer, byteCount);
+	boolArrayBuffer->len = byteCount;
+	memset(boolArrayBuffer->data, 0, byteCount);
+
+	for (boolArrayIndex = 0; boolArrayIndex < boolArrayLength; boolArrayIndex++)
+	{
+		if (boolArray[boolArrayIndex])
+		{
+			uint32 byteIndex = boolArrayIndex / 8;
+			uint32 bitIndex = boolArrayIndex % 8;
+			boolArrayBuffer->data[byteIndex] |= (1 << bitIndex);
+		}
+	}
+
+	return boolArrayBuffer;
+}
+
+
+/*
+ * SerializeSingleDatum serializes the given datum value and appends it to the
+ * provided string info buffer.
+ */
+static void
+SerializeSingleDatum(StringInfo datumBuffer, Datum datum, bool datumTypeByValue,
+					 int datumTypeLength, char datumTypeAlign)
+{
+	uint32 datumLength = att_addlength_datum(0, datumTypeLength, datum);
+	uint32 datumLengthAligned = att_align_nominal(datumLength, datumTypeAlign);
+
+	enlargeStringInfo(datumBuffer, datumLengthAligned);
+
+	char *currentDatumDataPointer = datumBuffer->data + datumBuffer->len;
+	memset(currentDatumDataPointer, 0, datumLengthAligned);
+
+	if (datumTypeLength > 0)
+	{
+		if (datumTypeByValue)
+		{
+			store_att_byval(currentDatumDataPointer, datum, datumTypeLength);
+		}
+		else
+		{
+			memcpy_s(currentDatumDataPointer, datumBuffer->maxlen - datumBuffer->len,
+					 DatumGetPointer(datum), datumTypeLength);
+		}
+	}
+	else
+	{
+		Assert(!datumTypeByValue);
+		memcpy_s(currentDatumDataPointer, datumBuffer->maxlen - datumBuffer->len,
+				 DatumGetPointer(datum), datumLength);
+	}
+
+	datumBuffer->len += datumLengthAligned;
+}
+
+
+/*
+ * SerializeColumnValue serializes a value of the given column into the value
+ * buffer of the current chunk. Variable length values of at least
+ * largeValueThreshold bytes are moved to the large value area of the stripe,
+ * compressed with the compression of the column, and only a reference to
+ * them is serialized.
+ */
+static void
+SerializeColumnValue(ColumnarWriteState *writeState, uint32 columnIndex,
+					 ColumnChunkSkipNode *chunkSkipNode, Datum value)
+{
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(writeState->tupleDescriptor, columnIndex);
+	StringInfo valueBuffer = writeState->chunkData->valueBufferArray[columnIndex];
+
+	if (attributeForm->attlen != -1)
+	{
+		SerializeSingleDatum(valueBuffer, value, attributeForm->attbyval,
+							 attributeForm->attlen, attributeForm->attalign);
+		return;
+	}
+
+	struct varlena *varlenaValue = (struct varlena *) DatumGetPointer(value);
+	int threshold = writeState->largeValueThreshold;
+	if (threshold > 0 && VARSIZE_ANY(varlenaValue) >= threshold)
+	{
+		/* values kept compressed are stored raw, to be compressed again */
+		struct varlena *rawValue = varlenaValue;
+		if (VARATT_IS_EXTENDED(rawValue))
 		{
-			chunkBuffersArray[chunkIndex] = palloc0(sizeof(ColumnChunkBuffers));
-			chunkBuffersArray[chunkIndex]->existsBuffer = NULL;
-			chunkBuffersArray[chunkIndex]->valueBuffer = NULL;
-			chunkBuffersArray[chunkIndex]->valueCompressionType = COMPRESSION_NONE;
+			rawValue = detoast_attr(rawValue);
 		}
 
-		columnBuffersArray[columnIndex] = palloc0(sizeof(ColumnBuffers));
-		columnBuffersArray[columnIndex]->chunkBuffersArray = chunkBuffersArray;
+		if (writeState->largeValueBuffer == NULL)
+		{
+			writeState->largeValueBuffer = makeStringInfo();
+		}
+
+		Datum reference =
+			ColumnarStoreLargeValue(writeState->largeValueBuffer,
+									PointerGetDatum(rawValue),
+									writeState->compressionTypeArray[columnIndex],
+									writeState->compressionLevelArray[columnIndex],
+									writeState->compressionBuffer);
+		chunkSkipNode->largeValueCount++;
+
+		SerializeSingleDatum(valueBuffer, reference, false, -1, attributeForm->attalign);
+		pfree(DatumGetPointer(reference));
+
+		if (rawValue != varlenaValue)
+		{
+			pfree(rawValue);
+		}
+	}
+	else
+	{
+		SerializeSingleDatum(valueBuffer, value, false, -1, attributeForm->attalign);
 	}
+}
 
-	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
-	stripeBuffers->columnBuffersArray = columnBuffersArray;
-	stripeBuffers->columnCount = columnCount;
-	stripeBuffers->rowCount = 0;
 
-	return stripeBuffers;
+/*
+ * FlattenColumnValue returns a flat copy of the given value if it's an
+ * expanded object, like the lazily read large values of rows read from
+ * columnar tables, and the value itself otherwise.
+ */
+static Datum
+FlattenColumnValue(Form_pg_attribute attributeForm, Datum value)
+{
+	if (attributeForm->attlen == -1 &&
+		VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(value)))
+	{
+		return PointerGetDatum(detoast_external_attr(
+								   (struct varlena *) DatumGetPointer(value)));
+	}
+
+	return value;
 }
 
 
 /*
- * CreateEmptyStripeSkipList allocates an empty StripeSkipList structure with
- * the given column count. This structure has enough chunks to hold statistics
- * for stripeMaxRowCount rows.
+ * SerializeChunkData serializes and compresses chunk data at given chunk index with the
+ * compression type of each column.
  */
-static StripeSkipList *
-CreateEmptyStripeSkipList(uint32 stripeMaxRowCount, uint32 chunkRowCount,
-						  uint32 columnCount)
+static void
+SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 rowCount)
 {
 	uint32 columnIndex = 0;
-	uint32 maxChunkCount = (stripeMaxRowCount / chunkRowCount) + 1;
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	ChunkData *chunkData = writeState->chunkData;
+	const uint32 columnCount = stripeBuffers->columnCount;
+	StringInfo compressionBuffer = writeState->compressionBuffer;
 
-	ColumnChunkSkipNode **chunkSkipNodeArray =
-		palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+	/*
+	 * Columns compressed with lz4 or zstd without a dictionary are collected
+	 * as jobs and compressed concurrently once all columns are encoded. The
+	 * job buffers only live until the chunk is stored. Jobs of the helper
+	 * thread instead stay in stripeWriteContext until they are finished, and
+	 * take over the value buffers of their columns.
+	 */
+	CompressionThread *compressionThread = writeState->compressionThread;
+	MemoryContext jobContext = NULL;
+	CompressionJob *jobs = NULL;
+	uint32 *jobColumnIndexes = NULL;
+	uint32 jobCount = 0;
+	if (compressionThread != NULL)
+	{
+		jobs = MemoryContextAllocZero(writeState->stripeWriteContext,
+									  columnCount * sizeof(CompressionJob));
+		jobColumnIndexes = MemoryContextAlloc(writeState->stripeWriteContext,
+											  columnCount * sizeof(uint32));
+	}
+	else if (columnar_column_compression_threads > 0 && columnCount > 1)
+	{
+		jobContext = AllocSetContextCreate(CurrentMemoryContext,
+										   "Columnar Compression Jobs",
+										   ALLOCSET_DEFAULT_SIZES);
+		jobs = MemoryContextAllocZero(jobContext, columnCount * sizeof(CompressionJob));
+		jobColumnIndexes = MemoryContextAlloc(jobContext, columnCount * sizeof(uint32));
+	}
+
+	writeState->chunkGroupRowCounts =
+		lappend_int(writeState->chunkGroupRowCounts, rowCount);
+
+	/*
+	 * Serialize exist values, data values are already serialized. Chunks
+	 * without nulls or without values only record that in their null state.
+	 */
 	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
-		chunkSkipNodeArray[columnIndex] =
-			palloc0(maxChunkCount * sizeof(ColumnChunkSkipNode));
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
+		bool *existsArray = chunkData->existsArray[columnIndex];
+
+		uint32 existsCount = 0;
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			existsCount += existsArray[rowIndex] ? 1 : 0;
+		}
+
+		FinishChunkStatistics(writeState, columnIndex,
+							  &writeState->stripeSkipList->chunkSkipNodeArray[columnIndex]
+							  [chunkIndex], existsCount);
+
+		chunkBuffers->nullState = CHUNK_NULLS_SOME;
+		if (writeState->nullStateEnabled && existsCount == rowCount)
+		{
+			chunkBuffers->nullState = CHUNK_NULLS_NONE;
+		}
+		else if (writeState->nullStateEnabled && existsCount == 0)
+		{
+			chunkBuffers->nullState = CHUNK_NULLS_ALL;
+		}
+
+		if (chunkBuffers->nullState == CHUNK_NULLS_SOME)
+		{
+			chunkBuffers->existsBuffer = SerializeBoolArray(existsArray, rowCount);
+		}
+		else
+		{
+			chunkBuffers->existsBuffer = makeStringInfo();
+		}
 	}
 
-	StripeSkipList *stripeSkipList = palloc0(sizeof(StripeSkipList));
-	stripeSkipList->columnCount = columnCount;
-	stripeSkipList->chunkCount = 0;
-	stripeSkipList->chunkSkipNodeArray = chunkSkipNodeArray;
+	/* build bloom filters, even chunks without values get an empty one */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (writeState->bloomHashFunctionArray[columnIndex] == NULL)
+		{
+			continue;
+		}
 
-	return stripeSkipList;
+		ColumnChunkSkipNode *chunkSkipNode =
+			&writeState->stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		chunkSkipNode->bloomFilter =
+			ColumnarBloomFilterBuild(writeState->bloomHashArray[columnIndex],
+									 writeState->bloomHashCount[columnIndex]);
+
+		writeState->bloomHashCount[columnIndex] = 0;
+	}
+
+	/* build the distinct value sketches of hll_columns */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		uint8 *registers = writeState->hllRegisterArray[columnIndex];
+		if (registers == NULL)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&writeState->stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		chunkSkipNode->hllSketch = ColumnarHllSketchBuild(registers);
+
+		memset(registers, 0, COLUMNAR_HLL_REGISTERS);
+	}
+
+	/* build the statistics of the shredded keys of jsonb columns */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		List *keyStatisticsList = writeState->shreddedKeyStatisticsArray[columnIndex];
+		if (keyStatisticsList == NIL)
+		{
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&writeState->stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		chunkSkipNode->shreddedKeyStats = ColumnarShreddedKeysBuild(keyStatisticsList);
+	}
+
+	/*
+	 * check and compress value buffers, if a value buffer is not compressable
+	 * then keep it as uncompressed, store compression information.
+	 */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
+		Form_pg_attribute attributeForm =
+			TupleDescAttr(writeState->tupleDescriptor, columnIndex);
+		CompressionType actualCompressionType = COMPRESSION_NONE;
+		CompressionType requestedCompressionType =
+			writeState->compressionTypeArray[columnIndex];
+		int compressionLevel = writeState->compressionLevelArray[columnIndex];
+
+		StringInfo serializedValueBuffer = chunkData->valueBufferArray[columnIndex];
+		chunkBuffers->valueCompressionLevel = compressionLevel;
+
+		Assert(requestedCompressionType >= 0 &&
+			   requestedCompressionType < COMPRESSION_COUNT);
+
+		/*
+		 * Dictionary encode variable length values if the chunk has few
+		 * distinct values, and run length encode fixed length values if they
+		 * have long runs. Otherwise integer like values are bit packed if
+		 * their range is small, and other variable length values get the
+		 * offsets layout if it is enabled. The general purpose codec is
+		 * applied after that.
+		 */
+		chunkBuffers->valueEncodingType = VALUE_ENCODING_NONE;
+
+		/*
+		 * References to large values are all distinct, and late materialization
+		 * would evaluate quals on them instead of the values if the chunk was
+		 * dictionary encoded.
+		 */
+		chunkBuffers->largeValueCount =
+			writeState->stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex].
+			largeValueCount;
+		bool tryDictionary = writeState->dictionaryEncodingEnabled &&
+							 attributeForm->attlen == -1 &&
+							 chunkBuffers->largeValueCount == 0;
+		bool tryRunLength = writeState->runLengthEncodingEnabled &&
+							attributeForm->attlen > 0;
+		bool tryBitPacking = writeState->bitPackingEnabled &&
+							 attributeForm->attbyval &&
+							 (attributeForm->attlen == 2 ||
+							  attributeForm->attlen == 4 ||
+							  attributeForm->attlen == 8) &&
+							 att_align_nominal(attributeForm->attlen,
+											   attributeForm->attalign) ==
+							 attributeForm->attlen;
+		bool tryOffsets = writeState->valueOffsetsEnabled &&
+						  attributeForm->attlen == -1;
+		if (tryDictionary || tryRunLength || tryBitPacking || tryOffsets)
+		{
+			uint32 valueCount = 0;
+			for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				valueCount += chunkData->existsArray[columnIndex][rowIndex] ? 1 : 0;
+			}
+
+			if (tryDictionary &&
+				DictionaryEncodeBuffer(serializedValueBuffer, valueCount,
+									   attributeForm->attlen, attributeForm->attalign,
+									   writeState->encodingBuffer))
+			{
+				serializedValueBuffer = writeState->encodingBuffer;
+				chunkBuffers->valueEncodingType = VALUE_ENCODING_DICTIONARY;
+			}
+			else if (tryRunLength &&
+					 RunLengthEncodeBuffer(serializedValueBuffer, valueCount,
+										   attributeForm->attlen,
+										   attributeForm->attalign,
+										   writeState->encodingBuffer))
+			{
+				serializedValueBuffer = writeState->encodingBuffer;
+				chunkBuffers->valueEncodingType = VALUE_ENCODING_RUN_LENGTH;
+			}
+			else if (tryBitPacking &&
+					 BitPackEncodeBuffer(serializedValueBuffer, valueCount,
+										 attributeForm->attlen,
+										 writeState->encodingBuffer))
+			{
+				serializedValueBuffer = writeState->encodingBuffer;
+				chunkBuffers->valueEncodingType = VALUE_ENCODING_BIT_PACKED;
+			}
+			else if (tryOffsets && valueCount > 0)
+			{
+				OffsetsEncodeBuffer(serializedValueBuffer, valueCount,
+									attributeForm->attlen, attributeForm->attalign,
+									writeState->encodingBuffer);
+				serializedValueBuffer = writeState->encodingBuffer;
+				chunkBuffers->valueEncodingType = VALUE_ENCODING_OFFSETS;
+			}
+		}
+
+		chunkBuffers->decompressedValueSize = serializedValueBuffer->len;
+
+		/*
+		 * if serializedValueBuffer is be compressed, update serializedValueBuffer
+		 * with compressed data and store compression type. zstd uses the trained
+		 * dictionary of the column if it has one, and the auto compression type
+		 * picks the compression of each chunk separately.
+		 */
+		uint64 dictionaryId = writeState->compressionDictionaryIdArray[columnIndex];
+		chunkBuffers->compressionDictionaryId = 0;
+		if (jobs != NULL && dictionaryId == 0 && serializedValueBuffer->len > 0 &&
+			ConcurrentCompressionSupported(requestedCompressionType))
+		{
+			MemoryContext oldContext =
+				MemoryContextSwitchTo(jobContext != NULL ? jobContext :
+									  writeState->stripeWriteContext);
+			CompressionJob *job = &jobs[jobCount];
+
+			/* the encoding buffer is reused by the next column */
+			job->inputBuffer = serializedValueBuffer;
+			if (serializedValueBuffer == writeState->encodingBuffer)
+			{
+				job->inputBuffer = CopyStringInfo(serializedValueBuffer);
+			}
+			else if (compressionThread != NULL)
+			{
+				/* the next chunk of the column gets a new value buffer */
+				chunkData->valueBufferArray[columnIndex] = makeStringInfo();
+			}
+
+			job->outputBuffer = makeStringInfo();
+			job->compressionType = requestedCompressionType;
+			job->compressionLevel = compressionLevel;
+			jobColumnIndexes[jobCount] = columnIndex;
+			jobCount++;
+
+			MemoryContextSwitchTo(oldContext);
+			continue;
+		}
+
+		if (dictionaryId != 0 &&
+			CompressBufferWithDictionary(serializedValueBuffer, compressionBuffer,
+										 compressionLevel, dictionaryId))
+		{
+			serializedValueBuffer = compressionBuffer;
+			actualCompressionType = COMPRESSION_ZSTD;
+			chunkBuffers->compressionDictionaryId = dictionaryId;
+		}
+		else if (requestedCompressionType == COMPRESSION_AUTO)
+		{
+			actualCompressionType =
+				CompressBufferAuto(serializedValueBuffer, compressionBuffer,
+								   compressionLevel,
+								   columnar_auto_compression_min_gain);
+			if (actualCompressionType != COMPRESSION_NONE)
+			{
+				serializedValueBuffer = compressionBuffer;
+			}
+		}
+		else if (CompressBuffer(serializedValueBuffer, compressionBuffer,
+								requestedCompressionType, compressionLevel))
+		{
+			serializedValueBuffer = compressionBuffer;
+
+			/* lz4hc output is decompressed like any other lz4 output */
+			actualCompressionType = requestedCompressionType == COMPRESSION_LZ4HC ?
+									COMPRESSION_LZ4 : requestedCompressionType;
+		}
+
+		/* store (compressed) value buffer */
+		chunkBuffers->valueCompressionType = actualCompressionType;
+		chunkBuffers->valueBuffer = CopyStringInfo(serializedValueBuffer);
+
+		/* valueBuffer needs to be reset for next chunk's data */
+		resetStringInfo(chunkData->valueBufferArray[columnIndex]);
+	}
+
+	if (compressionThread != NULL)
+	{
+		/* the helper thread runs one chunk at a time */
+		FinishPendingCompression(writeState);
+
+		if (jobCount > 0)
+		{
+			StartCompressionJobs(compressionThread, jobs, jobCount);
+			writeState->pendingJobs = jobs;
+			writeState->pendingJobColumnIndexes = jobColumnIndexes;
+			writeState->pendingJobCount = jobCount;
+			writeState->pendingChunkIndex = chunkIndex;
+		}
+		else
+		{
+			pfree(jobs);
+			pfree(jobColumnIndexes);
+		}
+
+		return;
+	}
+
+	if (jobCount > 0)
+	{
+		CompressBuffersConcurrently(jobs, jobCount, columnar_column_compression_threads);
+	}
+
+	StoreCompressionJobs(writeState, chunkIndex, jobs, jobColumnIndexes, jobCount);
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		resetStringInfo(chunkData->valueBufferArray[jobColumnIndexes[jobIndex]]);
+	}
+
+	if (jobContext != NULL)
+	{
+		MemoryContextDelete(jobContext);
+	}
 }
 
 
 /*
- * FlushStripe flushes current stripe data into the file. The function first ensures
- * the last data chunk for each column is properly serialized and compressed. Then,
- * the function creates the skip list and footer buffers. Finally, the function
- * flushes the skip list, data, and footer buffers to the file.
+ * StoreCompressionJobs stores copies of the compressed output of the given
+ * jobs of a chunk as the value buffers of their columns, or of the input of
+ * the jobs that didn't compress.
  */
 static void
-FlushStripe(ColumnarWriteState *writeState)
+StoreCompressionJobs(ColumnarWriteState *writeState, uint32 chunkIndex,
+					 CompressionJob *jobs, uint32 *jobColumnIndexes, uint32 jobCount)
 {
-	uint32 columnIndex = 0;
-	uint32 chunkIndex = 0;
 	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
-	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
-	ColumnChunkSkipNode **columnSkipNodeArray = stripeSkipList->chunkSkipNodeArray;
-	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
-	uint32 columnCount = tupleDescriptor->natts;
-	uint32 chunkCount = stripeSkipList->chunkCount;
-	uint32 chunkRowCount = writeState->options.chunkRowCount;
-	uint32 lastChunkIndex = stripeBuffers->rowCount / chunkRowCount;
-	uint32 lastChunkRowCount = stripeBuffers->rowCount % chunkRowCount;
-	uint64 stripeSize = 0;
-	uint64 stripeRowCount = stripeBuffers->rowCount;
 
-	elog(DEBUG1, "Flushing Stripe of size %d", stripeBuffers->rowCount);
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		CompressionJob *job = &jobs[jobIndex];
+		uint32 columnIndex = jobColumnIndexes[jobIndex];
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
+
+		if (job->compressed)
+		{
+			/* lz4hc output is decompressed like any other lz4 output */
+			chunkBuffers->valueCompressionType =
+				job->compressionType == COMPRESSION_LZ4HC ?
+				COMPRESSION_LZ4 : job->compressionType;
+			chunkBuffers->valueBuffer = CopyStringInfo(job->outputBuffer);
+		}
+		else
+		{
+			chunkBuffers->valueCompressionType = COMPRESSION_NONE;
+			chunkBuffers->valueBuffer = CopyStringInfo(job->inputBuffer);
+		}
+	}
+}
 
-	Oid relationId = RelidByRelfilenode(writeState->relfilenode.spcNode,
-										writeState->relfilenode.relNode);
-	Relation relation = relation_open(relationId, NoLock);
 
-	/*
-	 * check if the last chunk needs serialization , the last chunk was not serialized
-	 * if it was not full yet, e.g.  (rowCount > 0)
-	 */
-	if (lastChunkRowCount > 0)
+/*
+ * FinishPendingCompression waits for the jobs the helper thread compresses,
+ * if any, stores their output in their chunk and frees them.
+ */
+static void
+FinishPendingCompression(ColumnarWriteState *writeState)
+{
+	if (writeState->compressionThread == NULL || writeState->pendingJobCount == 0)
 	{
-		SerializeChunkData(writeState, lastChunkIndex, lastChunkRowCount);
+		return;
 	}
 
-	/* update buffer sizes in stripe skip list */
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	CompressionJob *jobs = writeState->pendingJobs;
+	uint32 jobCount = writeState->pendingJobCount;
+
+	FinishCompressionJobs(writeState->compressionThread);
+	StoreCompressionJobs(writeState, writeState->pendingChunkIndex, jobs,
+						 writeState->pendingJobColumnIndexes, jobCount);
+
+	for (uint32 jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		pfree(jobs[jobIndex].inputBuffer->data);
+		pfree(jobs[jobIndex].inputBuffer);
+		pfree(jobs[jobIndex].outputBuffer->data);
+		pfree(jobs[jobIndex].outputBuffer);
+	}
+
+	pfree(jobs);
+	pfree(writeState->pendingJobColumnIndexes);
+
+	writeState->pendingJobs = NULL;
+	writeState->pendingJobColumnIndexes = NULL;
+	writeState->pendingJobCount = 0;
+}
+
+
+/*
+ * BuildStripeColumnSummaries combines the min/max values of the chunk skip
+ * nodes of the current stripe into stripe level min/max values per column.
+ */
+static ColumnStripeSummary *
+BuildStripeColumnSummaries(ColumnarWriteState *writeState)
+{
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
+	uint32 columnCount = tupleDescriptor->natts;
+
+	ColumnStripeSummary *columnSummaries =
+		palloc0(columnCount * sizeof(ColumnStripeSummary));
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
-		ColumnChunkSkipNode *chunkSkipNodeArray = columnSkipNodeArray[columnIndex];
-		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		FmgrInfo *comparisonFunction = writeState->comparisonFunctionArray[columnIndex];
+		Oid columnCollation = TupleDescAttr(tupleDescriptor, columnIndex)->attcollation;
+		ColumnStripeSummary *columnSummary = &columnSummaries[columnIndex];
 
-		for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		if (comparisonFunction == NULL)
 		{
-			ColumnChunkBuffers *chunkBuffers =
-				columnBuffers->chunkBuffersArray[chunkIndex];
-			uint64 existsBufferSize = chunkBuffers->existsBuffer->len;
-			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
-
-			chunkSkipNode->existsChunkOffset = stripeSize;
-			chunkSkipNode->existsLength = existsBufferSize;
-			stripeSize += existsBufferSize;
+			continue;
 		}
 
-		for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
 		{
-			ColumnChunkBuffers *chunkBuffers =
-				columnBuffers->chunkBuffersArray[chunkIndex];
-			uint64 valueBufferSize = chunkBuffers->valueBuffer->len;
-			CompressionType valueCompressionType = chunkBuffers->valueCompressionType;
-			ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+			ColumnChunkSkipNode *chunkSkipNode =
+				&stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			if (!chunkSkipNode->hasMinMax)
+			{
+				continue;
+			}
+
+			if (!columnSummary->hasMinMax)
+			{
+				columnSummary->minimumValue = chunkSkipNode->minimumValue;
+				columnSummary->maximumValue = chunkSkipNode->maximumValue;
+				columnSummary->hasMinMax = true;
+				continue;
+			}
+
+			Datum minimumComparisonDatum =
+				FunctionCall2Coll(comparisonFunction, columnCollation,
+								  chunkSkipNode->minimumValue,
+								  columnSummary->minimumValue);
+			if (DatumGetInt32(minimumComparisonDatum) < 0)
+			{
+				columnSummary->minimumValue = chunkSkipNode->minimumValue;
+			}
+
+			Datum maximumComparisonDatum =
+				FunctionCall2Coll(comparisonFunction, columnCollation,
+								  chunkSkipNode->maximumValue,
+								  columnSummary->maximumValue);
+			if (DatumGetInt32(maximumComparisonDatum) > 0)
+			{
+				columnSummary->maximumValue = chunkSkipNode->maximumValue;
+			}
+		}
+	}
 
-			chunkSkipNode->valueChunkOffset = stripeSize;
-			chunkSkipNode->valueLength = valueBufferSize;
-			chunkSkipNode->valueCompressionType = valueCompressionType;
-			chunkSkipNode->valueCompressionLevel = writeState->options.compressionLevel;
-			chunkSkipNode->decompressedValueSize = chunkBuffers->decompressedValueSize;
+	return columnSummaries;
+}
 
-			stripeSize += valueBufferSize;
-		}
+
+/*
+ * AddBloomFilterHash remembers the hash of a value of the current chunk, to
+ * be added to its bloom filter when the chunk is serialized.
+ */
+static void
+AddBloomFilterHash(ColumnarWriteState *writeState, uint32 columnIndex,
+				   Datum columnValue)
+{
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(writeState->tupleDescriptor, columnIndex);
+	uint32 hashCount = writeState->bloomHashCount[columnIndex];
+
+	if (hashCount == writeState->bloomHashCapacity[columnIndex])
+	{
+		uint32 newCapacity = hashCount * 2;
+		writeState->bloomHashArray[columnIndex] =
+			repalloc(writeState->bloomHashArray[columnIndex],
+					 newCapacity * sizeof(uint64));
+		writeState->bloomHashCapacity[columnIndex] = newCapacity;
 	}
 
-	StripeMetadata *stripeMetadata =
-		CompleteStripeReservation(relation, writeState->emptyStripeReservation->stripeId,
-								  stripeSize, stripeRowCount, chunkCount);
+	writeState->bloomHashArray[columnIndex][hashCount] =
+		ColumnarBloomHash(writeState->bloomHashFunctionArray[columnIndex],
+						  attributeForm->attcollation, columnValue);
+	writeState->bloomHashCount[columnIndex] = hashCount + 1;
+}
 
-	uint64 currentFileOffset = stripeMetadata->fileOffset;
 
-	/*
-	 * Each stripe has only one section:
-	 * Data section, in which we store data for each column continuously.
-	 * We store data for each for each column in chunks. For each chunk, we
-	 * store two buffers: "exists" buffer, and "value" buffer. "exists" buffer
-	 * tells which values are not NULL. "value" buffer contains values for
-	 * present values. For each column, we first store all "exists" buffers,
-	 * and then all "value" buffers.
-	 */
+/*
+ * GetInlineComparisonKind returns how the chunk statistics of a column with
+ * the given attribute compare its values.
+ */
+static InlineComparisonKind
+GetInlineComparisonKind(Form_pg_attribute attributeForm)
+{
+	/* int64 and float8 are passed by reference on 32-bit builds */
+	if (!attributeForm->attbyval)
+	{
+		return INLINE_COMPARISON_NONE;
+	}
 
-	/* flush the data buffers */
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	switch (attributeForm->atttypid)
 	{
-		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		case INT2OID:
+		{
+			return INLINE_COMPARISON_INT16;
+		}
 
-		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		case INT4OID:
+		case DATEOID:
 		{
-			ColumnChunkBuffers *chunkBuffers =
-				columnBuffers->chunkBuffersArray[chunkIndex];
-			StringInfo existsBuffer = chunkBuffers->existsBuffer;
+			return INLINE_COMPARISON_INT32;
+		}
 
-			ColumnarStorageWrite(relation, currentFileOffset,
-								 existsBuffer->data, existsBuffer->len);
-			currentFileOffset += existsBuffer->len;
+		case INT8OID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		{
+			return INLINE_COMPARISON_INT64;
 		}
 
-		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		case FLOAT4OID:
 		{
-			ColumnChunkBuffers *chunkBuffers =
-				columnBuffers->chunkBuffersArray[chunkIndex];
-			StringInfo valueBuffer = chunkBuffers->valueBuffer;
+			return INLINE_COMPARISON_FLOAT4;
+		}
 
-			ColumnarStorageWrite(relation, currentFileOffset,
-								 valueBuffer->data, valueBuffer->len);
-			currentFileOffset += valueBuffer->len;
+		case FLOAT8OID:
+		{
+			return INLINE_COMPARISON_FLOAT8;
 		}
-	}
 
-	SaveChunkGroups(writeState->relfilenode,
-					stripeMetadata->id,
-					writeState->chunkGroupRowCounts);
-	SaveStripeSkipList(writeState->relfilenode,
-					   stripeMetadata->id,
-					   stripeSkipList, tupleDescriptor);
-	SaveEmptyRowMask(LookupStorageId(writeState->relfilenode),
-					 stripeMetadata->id,
-					 stripeMetadata->firstRowNumber,
-					 writeState->chunkGroupRowCounts);
+		default:
+		{
+			return INLINE_COMPARISON_NONE;
+		}
+	}
+}
 
-	writeState->chunkGroupRowCounts = NIL;
 
-	relation_close(relation, NoLock);
+/*
+ * ColumnarSortednessTracked returns whether the chunk skip nodes of a column
+ * tell whether the values of its chunks are sorted.
+ */
+bool
+ColumnarSortednessTracked(Form_pg_attribute attributeForm)
+{
+	return GetInlineComparisonKind(attributeForm) != INLINE_COMPARISON_NONE;
 }
 
 
 /*
- * SerializeBoolArray serializes the given boolean array and returns the result
- * as a StringInfo. This function packs every 8 boolean values into one byte.
+ * InlineCompare compares two values of a column that is compared inline and
+ * returns a negative, zero or positive number like a btree comparison
+ * function. Floats use the btree order, in which NaN is above all numbers.
  */
-static StringInfo
-SerializeBoolArray(bool *boolArray, uint32 boolArrayLength)
+static inline int
+InlineCompare(InlineComparisonKind comparisonKind, Datum left, Datum right)
 {
-	uint32 boolArrayIndex = 0;
-	uint32 byteCount = ((boolArrayLength * sizeof(bool)) + (8 - sizeof(bool))) / 8;
+	switch (comparisonKind)
+	{
+		case INLINE_COMPARISON_INT16:
+		{
+			int16 leftValue = DatumGetInt16(left);
+			int16 rightValue = DatumGetInt16(right);
+			return (leftValue > rightValue) - (leftValue < rightValue);
+		}
 
-	StringInfo boolArrayBuffer = makeStringInfo();
-	enlargeStringInfo(boolArrayBuffer, byteCount);
-	boolArrayBuffer->len = byteCount;
-	memset(boolArrayBuffer->data, 0, byteCount);
+		case INLINE_COMPARISON_INT32:
+		{
+			int32 leftValue = DatumGetInt32(left);
+			int32 rightValue = DatumGetInt32(right);
+			return (leftValue > rightValue) - (leftValue < rightValue);
+		}
 
-	for (boolArrayIndex = 0; boolArrayIndex < boolArrayLength; boolArrayIndex++)
-	{
-		if (boolArray[boolArrayIndex])
+		case INLINE_COMPARISON_INT64:
 		{
-			uint32 byteIndex = boolArrayIndex / 8;
-			uint32 bitIndex = boolArrayIndex % 8;
-			boolArrayBuffer->data[byteIndex] |= (1 << bitIndex);
+			int64 leftValue = DatumGetInt64(left);
+			int64 rightValue = DatumGetInt64(right);
+			return (leftValue > rightValue) - (leftValue < rightValue);
 		}
-	}
 
-	return boolArrayBuffer;
+		case INLINE_COMPARISON_FLOAT4:
+		{
+			float4 leftValue = DatumGetFloat4(left);
+			float4 rightValue = DatumGetFloat4(right);
+			return float4_gt(leftValue, rightValue) - float4_lt(leftValue, rightValue);
+		}
+
+		case INLINE_COMPARISON_FLOAT8:
+		{
+			float8 leftValue = DatumGetFloat8(left);
+			float8 rightValue = DatumGetFloat8(right);
+			return float8_gt(leftValue, rightValue) - float8_lt(leftValue, rightValue);
+		}
+
+		default:
+		{
+			elog(ERROR, "unexpected inline comparison kind: %d", comparisonKind);
+			return 0;
+		}
+	}
 }
 
 
 /*
- * SerializeSingleDatum serializes the given datum value and appends it to the
- * provided string info buffer.
+ * UpdateChunkStatistics updates the statistics of the given column chunk skip
+ * node with a non-null value of the column. Columns compared inline update
+ * their minimum/maximum without function calls or copies and also track
+ * whether the values of the chunk are sorted. All values are added to the
+ * distinct value sketch of the chunk.
  */
 static void
-SerializeSingleDatum(StringInfo datumBuffer, Datum datum, bool datumTypeByValue,
-					 int datumTypeLength, char datumTypeAlign)
+UpdateChunkStatistics(ColumnarWriteState *writeState, uint32 columnIndex,
+					  ColumnChunkSkipNode *chunkSkipNode, Datum columnValue)
 {
-	uint32 datumLength = att_addlength_datum(0, datumTypeLength, datum);
-	uint32 datumLengthAligned = att_align_nominal(datumLength, datumTypeAlign);
-
-	enlargeStringInfo(datumBuffer, datumLengthAligned);
-
-	char *currentDatumDataPointer = datumBuffer->data + datumBuffer->len;
-	memset(currentDatumDataPointer, 0, datumLengthAligned);
+	InlineComparisonKind comparisonKind = writeState->comparisonKindArray[columnIndex];
+	ChunkValueTracker *tracker = &writeState->chunkValueTrackers[columnIndex];
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(writeState->tupleDescriptor, columnIndex);
 
-	if (datumTypeLength > 0)
+	if (comparisonKind != INLINE_COMPARISON_NONE)
 	{
-		if (datumTypeByValue)
+		if (!chunkSkipNode->hasMinMax)
 		{
-			store_att_byval(currentDatumDataPointer, datum, datumTypeLength);
+			chunkSkipNode->minimumValue = columnValue;
+			chunkSkipNode->maximumValue = columnValue;
+			chunkSkipNode->hasMinMax = true;
 		}
-		else
+		else if (InlineCompare(comparisonKind, columnValue,
+							   chunkSkipNode->minimumValue) < 0)
 		{
-			memcpy_s(currentDatumDataPointer, datumBuffer->maxlen - datumBuffer->len,
-					 DatumGetPointer(datum), datumTypeLength);
+			chunkSkipNode->minimumValue = columnValue;
+		}
+		else if (InlineCompare(comparisonKind, columnValue,
+							   chunkSkipNode->maximumValue) > 0)
+		{
+			chunkSkipNode->maximumValue = columnValue;
+		}
+
+		if (tracker->hasLastValue &&
+			InlineCompare(comparisonKind, columnValue, tracker->lastValue) < 0)
+		{
+			tracker->valuesSorted = false;
 		}
+
+		tracker->lastValue = columnValue;
+		tracker->hasLastValue = true;
 	}
 	else
 	{
-		Assert(!datumTypeByValue);
-		memcpy_s(currentDatumDataPointer, datumBuffer->maxlen - datumBuffer->len,
-				 DatumGetPointer(datum), datumLength);
+		UpdateChunkSkipNodeMinMax(chunkSkipNode, columnValue, attributeForm->attbyval,
+								  attributeForm->attlen, attributeForm->attcollation,
+								  writeState->comparisonFunctionArray[columnIndex]);
 	}
 
-	datumBuffer->len += datumLengthAligned;
+	addHyperLogLog(&tracker->distinctSketch,
+				   DistinctSketchHash(columnValue, attributeForm));
 }
 
 
 /*
- * SerializeChunkData serializes and compresses chunk data at given chunk index with given
- * compression type for every column.
+ * FinishChunkStatistics stores the null count, distinct value estimate and
+ * sortedness of a column in the skip node of the chunk being serialized and
+ * resets the tracker of the column for the next chunk.
  */
 static void
-SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 rowCount)
+FinishChunkStatistics(ColumnarWriteState *writeState, uint32 columnIndex,
+					  ColumnChunkSkipNode *chunkSkipNode, uint32 existsCount)
 {
-	uint32 columnIndex = 0;
-	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
-	ChunkData *chunkData = writeState->chunkData;
-	CompressionType requestedCompressionType = writeState->options.compressionType;
-	int compressionLevel = writeState->options.compressionLevel;
-	const uint32 columnCount = stripeBuffers->columnCount;
-	StringInfo compressionBuffer = writeState->compressionBuffer;
+	ChunkValueTracker *tracker = &writeState->chunkValueTrackers[columnIndex];
+	hyperLogLogState *distinctSketch = &tracker->distinctSketch;
 
-	writeState->chunkGroupRowCounts =
-		lappend_int(writeState->chunkGroupRowCounts, rowCount);
-
-	/* serialize exist values, data values are already serialized */
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	chunkSkipNode->hasStatistics = true;
+	chunkSkipNode->nullCount = chunkSkipNode->rowCount - existsCount;
+	chunkSkipNode->distinctCount = 0;
+	if (existsCount > 0)
 	{
-		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
-		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
-
-		chunkBuffers->existsBuffer =
-			SerializeBoolArray(chunkData->existsArray[columnIndex], rowCount);
+		uint64 distinctEstimate = (uint64) rint(estimateHyperLogLog(distinctSketch));
+		chunkSkipNode->distinctCount = Max(Min(distinctEstimate, existsCount), 1);
 	}
 
-	/*
-	 * check and compress value buffers, if a value buffer is not compressable
-	 * then keep it as uncompressed, store compression information.
-	 */
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-	{
-		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
-		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
-		CompressionType actualCompressionType = COMPRESSION_NONE;
-
-		StringInfo serializedValueBuffer = chunkData->valueBufferArray[columnIndex];
-
-		Assert(requestedCompressionType >= 0 &&
-			   requestedCompressionType < COMPRESSION_COUNT);
+	chunkSkipNode->sortednessKnown =
+		writeState->comparisonKindArray[columnIndex] != INLINE_COMPARISON_NONE;
+	chunkSkipNode->valuesSorted = tracker->valuesSorted;
 
-		chunkBuffers->decompressedValueSize =
-			chunkData->valueBufferArray[columnIndex]->len;
-
-		/*
-		 * if serializedValueBuffer is be compressed, update serializedValueBuffer
-		 * with compressed data and store compression type.
-		 */
-		bool compressed = CompressBuffer(serializedValueBuffer, compressionBuffer,
-										 requestedCompressionType,
-										 compressionLevel);
-		if (compressed)
-		{
-			serializedValueBuffer = compressionBuffer;
-			actualCompressionType = requestedCompressionType;
-		}
+	tracker->valuesSorted = true;
+	tracker->hasLastValue = false;
+	memset(distinctSketch->hashesArr, 0, distinctSketch->arrSize);
+}
 
-		/* store (compressed) value buffer */
-		chunkBuffers->valueCompressionType = actualCompressionType;
-		chunkBuffers->valueBuffer = CopyStringInfo(serializedValueBuffer);
 
-		/* valueBuffer needs to be reset for next chunk's data */
-		resetStringInfo(chunkData->valueBufferArray[columnIndex]);
+/*
+ * DistinctSketchHash hashes a column value for the distinct value sketch.
+ * By-value types hash their datum, other types the bytes of their value.
+ */
+static uint32
+DistinctSketchHash(Datum columnValue, Form_pg_attribute attributeForm)
+{
+	if (attributeForm->attbyval)
+	{
+		uint64 datumBits = (uint64) columnValue;
+		return hash_bytes_uint32((uint32) datumBits ^ (uint32) (datumBits >> 32));
+	}
+	else if (attributeForm->attlen > 0)
+	{
+		return hash_bytes((const unsigned char *) DatumGetPointer(columnValue),
+						  attributeForm->attlen);
+	}
+	else if (attributeForm->attlen == -1)
+	{
+		struct varlena *value = (struct varlena *) DatumGetPointer(columnValue);
+		return hash_bytes((const unsigned char *) VARDATA_ANY(value),
+						  VARSIZE_ANY_EXHDR(value));
+	}
+	else
+	{
+		const char *value = DatumGetCString(columnValue);
+		return hash_bytes((const unsigned char *) value, strlen(value));
 	}
 }
 
@@ -714,6 +3219,12 @@ DatumCopy(Datum datum, bool datumTypeByValue, int datumTypeLength)
 	{
 		datumCopy = datum;
 	}
+	else if (datumTypeLength == -1 && VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(datum)))
+	{
+		/* lazily read large values are copied flat */
+		datumCopy = PointerGetDatum(detoast_external_attr(
+										(struct varlena *) DatumGetPointer(datum)));
+	}
 	else
 	{
 		uint32 datumLength = att_addlength_datum(0, datumTypeLength, datum);
@@ -752,5 +3263,134 @@ CopyStringInfo(StringInfo sourceString)
 bool
 ContainsPendingWrites(ColumnarWriteState *state)
 {
+	if (state->sortBuffer != NULL && state->sortBuffer->rowCount != 0)
+	{
+		return true;
+	}
+
 	return state->stripeBuffers != NULL && state->stripeBuffers->rowCount != 0;
 }
+
+
+/*
+ * ColumnarWriteStateReadRow fills columnValues and columnNulls with the row of
+ * the given row number if it is in the stripe being written, and returns
+ * false otherwise. Constraint checks use this to see the rows the current
+ * backend inserted without flushing them as a stripe of their own. Values of
+ * by reference types are allocated in the current memory context.
+ */
+bool
+ColumnarWriteStateReadRow(ColumnarWriteState *writeState, uint64 rowNumber,
+						  Datum *columnValues, bool *columnNulls)
+{
+	if (writeState->stripeBuffers == NULL || writeState->emptyStripeReservation == NULL)
+	{
+		return false;
+	}
+
+	uint64 stripeFirstRowNumber = writeState->emptyStripeReservation->stripeFirstRowNumber;
+	if (rowNumber < stripeFirstRowNumber)
+	{
+		return false;
+	}
+
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
+	uint32 columnCount = tupleDescriptor->natts;
+	uint64 stripeRowIndex = rowNumber - stripeFirstRowNumber;
+
+	/* rows of sorted stripes are only written when the stripe is flushed */
+	if (StripeRowsCollected(writeState))
+	{
+		StripeSortBuffer *sortBuffer = writeState->sortBuffer;
+		if (stripeRowIndex >= sortBuffer->rowCount)
+		{
+			return false;
+		}
+
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+			uint64 valueIndex = stripeRowIndex * columnCount + columnIndex;
+
+			columnNulls[columnIndex] = sortBuffer->nulls[valueIndex];
+			columnValues[columnIndex] = 0;
+			if (!columnNulls[columnIndex])
+			{
+				columnValues[columnIndex] = DatumCopy(sortBuffer->values[valueIndex],
+													  attributeForm->attbyval,
+													  attributeForm->attlen);
+			}
+		}
+
+		return true;
+	}
+
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	if (stripeRowIndex >= stripeBuffers->rowCount)
+	{
+		return false;
+	}
+
+	uint32 chunkRowCount = writeState->options.chunkRowCount;
+	uint32 chunkIndex = stripeRowIndex / chunkRowCount;
+	uint32 chunkRowIndex = stripeRowIndex % chunkRowCount;
+
+	/* full chunks are serialized and compressed as soon as they fill up */
+	uint32 serializedChunkCount = list_length(writeState->chunkGroupRowCounts);
+	uint32 chunkRowsWritten = chunkRowCount;
+	if (chunkIndex >= serializedChunkCount)
+	{
+		chunkRowsWritten = stripeBuffers->rowCount - chunkIndex * chunkRowCount;
+	}
+
+	bool *existsArray = palloc(chunkRowsWritten * sizeof(bool));
+	Datum *datumArray = palloc0(chunkRowsWritten * sizeof(Datum));
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (chunkIndex < serializedChunkCount)
+		{
+			ColumnChunkBuffers *chunkBuffers =
+				stripeBuffers->columnBuffersArray[columnIndex]->chunkBuffersArray[chunkIndex];
+			ColumnarDeserializeChunkBuffers(chunkBuffers, chunkRowsWritten,
+											attributeForm, existsArray, datumArray);
+		}
+		else
+		{
+			/* values of the current chunk are serialized without any encoding */
+			ChunkData *chunkData = writeState->chunkData;
+			memcpy(existsArray, chunkData->existsArray[columnIndex],
+				   chunkRowsWritten * sizeof(bool));
+			ColumnarDeserializeDatumArray(chunkData->valueBufferArray[columnIndex],
+										  existsArray, chunkRowsWritten, attributeForm,
+										  datumArray);
+		}
+
+		columnNulls[columnIndex] = !existsArray[chunkRowIndex];
+		columnValues[columnIndex] = 0;
+		if (columnNulls[columnIndex])
+		{
+			continue;
+		}
+
+		/* large values of the stripe are still in the large value buffer */
+		Datum value = datumArray[chunkRowIndex];
+		if (attributeForm->attlen == -1 && ColumnarIsLargeValueReference(value))
+		{
+			columnValues[columnIndex] =
+				ColumnarLargeValueFromBuffer(writeState->largeValueBuffer, value);
+		}
+		else
+		{
+			columnValues[columnIndex] = DatumCopy(value, attributeForm->attbyval,
+												  attributeForm->attlen);
+		}
+	}
+
+	pfree(existsArray);
+	pfree(datumArray);
+
+	return true;
+}
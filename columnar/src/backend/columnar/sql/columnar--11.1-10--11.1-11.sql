@@ -0,0 +1,16 @@
+-- columnar--11.1-10--11.1-11.sql
+
+CREATE TABLE columnar.stripe_attr (
+	storage_id BIGINT NOT NULL,
+	stripe_num BIGINT NOT NULL,
+	attr_num INT NOT NULL,
+	minimum_value BYTEA,
+	maximum_value BYTEA,
+	PRIMARY KEY (storage_id, stripe_num, attr_num)
+) WITH (user_catalog_table = true);
+
+-- revoke read access for columnar.stripe_attr from unprivileged
+-- user as it contains stripe min/max values
+REVOKE SELECT ON columnar.stripe_attr FROM PUBLIC;
+
+COMMENT ON TABLE columnar.stripe_attr IS 'Columnar per stripe column metadata';
@@ -0,0 +1,337 @@
+-- columnar--11.1-11--11.1-12.sql
+
+ALTER TABLE columnar.options ADD COLUMN cache_quota int NOT NULL DEFAULT 0;
+
+CREATE TABLE columnar.column_options (
+    regclass regclass NOT NULL,
+    attnum int2 NOT NULL,
+    bloom_filter bool NOT NULL DEFAULT false,
+    compression name,
+    compression_level int,
+    sort_key bool NOT NULL DEFAULT false,
+    projection_group_by bool NOT NULL DEFAULT false,
+    projection_sum bool NOT NULL DEFAULT false,
+    hll bool NOT NULL DEFAULT false,
+    shredded_keys text[],
+    bucket_count int,
+    PRIMARY KEY (regclass, attnum)
+) WITH (user_catalog_table = true);
+
+COMMENT ON TABLE columnar.column_options IS 'columnar column specific options, maintained by alter_columnar_table_set';
+
+ALTER TABLE columnar.chunk ADD COLUMN bloom_filter bytea;
+ALTER TABLE columnar.chunk ADD COLUMN value_encoding_type int NOT NULL DEFAULT 0;
+ALTER TABLE columnar.chunk ADD COLUMN null_state int NOT NULL DEFAULT 0;
+ALTER TABLE columnar.chunk ADD COLUMN compression_dictionary_id bigint NOT NULL DEFAULT 0;
+ALTER TABLE columnar.chunk ADD COLUMN null_count bigint;
+ALTER TABLE columnar.chunk ADD COLUMN distinct_count bigint;
+ALTER TABLE columnar.chunk ADD COLUMN values_sorted bool;
+ALTER TABLE columnar.chunk ADD COLUMN hll_sketch bytea;
+ALTER TABLE columnar.chunk ADD COLUMN large_value_count bigint NOT NULL DEFAULT 0;
+ALTER TABLE columnar.chunk ADD COLUMN shredded_key_stats bytea;
+
+CREATE SEQUENCE columnar.compression_dictionary_id_seq NO CYCLE;
+
+CREATE TABLE columnar.compression_dictionary (
+    storage_id bigint NOT NULL,
+    attr_num int NOT NULL,
+    dictionary_id bigint NOT NULL,
+    dictionary bytea NOT NULL,
+    PRIMARY KEY (storage_id, attr_num, dictionary_id),
+    UNIQUE (dictionary_id)
+) WITH (user_catalog_table = true);
+
+REVOKE SELECT ON columnar.compression_dictionary FROM PUBLIC;
+
+COMMENT ON TABLE columnar.compression_dictionary IS 'zstd dictionaries of columnar columns, maintained by train_compression_dictionary';
+
+ALTER TABLE columnar.options ADD COLUMN delta_store bool NOT NULL DEFAULT false;
+
+CREATE TABLE columnar.delta_store (
+    storage_id bigint NOT NULL,
+    row_number bigint NOT NULL,
+    row_data bytea NOT NULL,
+    PRIMARY KEY (storage_id, row_number)
+) WITH (user_catalog_table = true);
+
+REVOKE SELECT ON columnar.delta_store FROM PUBLIC;
+
+COMMENT ON TABLE columnar.delta_store IS 'rows of columnar tables that are not yet written to a stripe';
+
+ALTER TABLE columnar.options ADD COLUMN stripe_size_limit int NOT NULL DEFAULT 0;
+ALTER TABLE columnar.options ADD COLUMN auto_row_limits bool NOT NULL DEFAULT false;
+
+CREATE TABLE columnar.stripe_skip_list (
+    storage_id bigint NOT NULL,
+    stripe_num bigint NOT NULL,
+    skip_list bytea NOT NULL,
+    PRIMARY KEY (storage_id, stripe_num)
+) WITH (user_catalog_table = true);
+
+REVOKE SELECT ON columnar.stripe_skip_list FROM PUBLIC;
+
+COMMENT ON TABLE columnar.stripe_skip_list IS 'chunk metadata of columnar stripes written with columnar.compact_chunk_metadata, one row per stripe';
+
+CREATE TABLE columnar.stripe_projection (
+    storage_id bigint NOT NULL,
+    stripe_num bigint NOT NULL,
+    projection bytea NOT NULL,
+    PRIMARY KEY (storage_id, stripe_num)
+) WITH (user_catalog_table = true);
+
+REVOKE SELECT ON columnar.stripe_projection FROM PUBLIC;
+
+COMMENT ON TABLE columnar.stripe_projection IS 'per group counts and sums of columnar stripes for the projection_group_by and projection_sum columns, one row per stripe';
+
+CREATE TABLE columnar.matview_refresh (
+    matview regclass NOT NULL PRIMARY KEY,
+    source regclass NOT NULL,
+    next_stripe_id bigint NOT NULL,
+    live_rows bigint NOT NULL,
+    delta_rows bigint NOT NULL
+) WITH (user_catalog_table = true);
+
+COMMENT ON TABLE columnar.matview_refresh IS 'stripes of the source tables columnar materialized views were last refreshed from, maintained by refresh_materialized_view';
+
+ALTER TABLE columnar.stripe ADD COLUMN bucket int NOT NULL DEFAULT -1;
+
+-- stripe rows are updated in place once their data is written, which needs
+-- the new column to be stored in every row
+UPDATE columnar.stripe SET bucket = -1;
+
+#include "udfs/train_compression_dictionary/11.1-12.sql"
+#include "udfs/decompression_stats/11.1-12.sql"
+#include "udfs/flush_delta_store/11.1-12.sql"
+#include "udfs/recompress/11.1-12.sql"
+#include "udfs/reclaim_dropped_columns/11.1-12.sql"
+#include "udfs/metadata_statistics/11.1-12.sql"
+#include "udfs/offload_stripes/11.1-12.sql"
+#include "udfs/drop_stripes/11.1-12.sql"
+#include "udfs/pg_stat_columnar/11.1-12.sql"
+#include "udfs/wait_events/11.1-12.sql"
+#include "udfs/memory_peaks/11.1-12.sql"
+#include "udfs/advise/11.1-12.sql"
+#include "udfs/prewarm/11.1-12.sql"
+#include "udfs/export_arrow/11.1-12.sql"
+#include "udfs/import_arrow/11.1-12.sql"
+#include "udfs/load_csv/11.1-12.sql"
+#include "udfs/copy_heap_rows/11.1-12.sql"
+#include "udfs/alter_table_set_access_method/11.1-12.sql"
+#include "udfs/stripe_transfer/11.1-12.sql"
+#include "udfs/refresh_materialized_view/11.1-12.sql"
+#include "udfs/bucket_of/11.1-12.sql"
+
+DROP FUNCTION columnar.vacuum(regclass, int);
+#include "udfs/vacuum/11.1-12.sql"
+
+DROP FUNCTION columnar.alter_columnar_table_set(regclass, int, int, name, int);
+DROP FUNCTION columnar.alter_columnar_table_reset(regclass, bool, bool, bool, bool);
+
+#include "udfs/alter_columnar_table_set/11.1-12.sql"
+#include "udfs/alter_columnar_table_reset/11.1-12.sql"
+
+-- text
+
+CREATE FUNCTION vtexteq(text, text) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtextne(text, text) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtextlike(text, text) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtextnlike(text, text) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vstarts_with(text, text) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vlower(text) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vupper(text) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vlength(text) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vsubstring(text, int4, int4) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vsubstring(text, int4) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vsubstr(text, int4, int4) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vsubstr(text, int4) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION vtextlarger(text, text) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmax(text) (SFUNC = vtextlarger, STYPE = text);
+CREATE FUNCTION vtextsmaller(text, text) RETURNS text AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmin(text) (SFUNC = vtextsmaller, STYPE = text);
+
+-- float4 / float8
+
+CREATE FUNCTION vfloat4eq(float4, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat4ne(float4, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat4gt(float4, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat4lt(float4, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat4le(float4, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat4ge(float4, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat48eq(float4, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat48ne(float4, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat48gt(float4, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat48lt(float4, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat48le(float4, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat48ge(float4, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat8eq(float8, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat8ne(float8, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat8gt(float8, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat8lt(float8, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat8le(float8, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat8ge(float8, float8) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat84eq(float8, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat84ne(float8, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat84gt(float8, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat84lt(float8, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat84le(float8, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vfloat84ge(float8, float4) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION vfloat4sum(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vsum(float4) (SFUNC = vfloat4sum, STYPE = float4);
+CREATE FUNCTION vfloat4acc(float8[], float4) RETURNS float8[] AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vavg(float4) (SFUNC = vfloat4acc, STYPE = float8[], FINALFUNC = float8_avg, INITCOND = '{0,0,0}');
+CREATE FUNCTION vfloat4larger(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmax(float4) (SFUNC = vfloat4larger, STYPE = float4);
+CREATE FUNCTION vfloat4smaller(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmin(float4) (SFUNC = vfloat4smaller, STYPE = float4);
+
+CREATE FUNCTION vfloat8sum(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vsum(float8) (SFUNC = vfloat8sum, STYPE = float8);
+CREATE FUNCTION vfloat8acc(float8[], float8) RETURNS float8[] AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vavg(float8) (SFUNC = vfloat8acc, STYPE = float8[], FINALFUNC = float8_avg, INITCOND = '{0,0,0}');
+CREATE FUNCTION vfloat8larger(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmax(float8) (SFUNC = vfloat8larger, STYPE = float8);
+CREATE FUNCTION vfloat8smaller(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmin(float8) (SFUNC = vfloat8smaller, STYPE = float8);
+
+-- timestamp, timestamptz
+
+CREATE FUNCTION vtimestamp_eq(timestamp, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_ne(timestamp, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_gt(timestamp, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_lt(timestamp, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_le(timestamp, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_ge(timestamp, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_eq(timestamptz, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_ne(timestamptz, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_gt(timestamptz, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_lt(timestamptz, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_le(timestamptz, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_ge(timestamptz, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION vtimestamp_eq_date(timestamp, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_ne_date(timestamp, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_gt_date(timestamp, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_lt_date(timestamp, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_le_date(timestamp, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamp_ge_date(timestamp, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_eq_timestamp(date, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_ne_timestamp(date, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_gt_timestamp(date, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_lt_timestamp(date, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_le_timestamp(date, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_ge_timestamp(date, timestamp) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vtimestamptz_eq_date(timestamptz, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vtimestamptz_ne_date(timestamptz, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vtimestamptz_gt_date(timestamptz, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vtimestamptz_lt_date(timestamptz, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vtimestamptz_le_date(timestamptz, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vtimestamptz_ge_date(timestamptz, date) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_eq_timestamptz(date, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_ne_timestamptz(date, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_gt_timestamptz(date, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_lt_timestamptz(date, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_le_timestamptz(date, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_ge_timestamptz(date, timestamptz) RETURNS bool AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+
+CREATE FUNCTION vtimestamplarger(timestamp, timestamp) RETURNS timestamp AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmax(timestamp) (SFUNC = vtimestamplarger, STYPE = timestamp);
+CREATE FUNCTION vtimestampsmaller(timestamp, timestamp) RETURNS timestamp AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmin(timestamp) (SFUNC = vtimestampsmaller, STYPE = timestamp);
+
+CREATE FUNCTION vtimestamptzlarger(timestamptz, timestamptz) RETURNS timestamptz AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmax(timestamptz) (SFUNC = vtimestamptzlarger, STYPE = timestamptz);
+CREATE FUNCTION vtimestamptzsmaller(timestamptz, timestamptz) RETURNS timestamptz AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vmin(timestamptz) (SFUNC = vtimestamptzsmaller, STYPE = timestamptz);
+
+CREATE FUNCTION vdate_trunc(text, timestamp) RETURNS timestamp AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_trunc(text, timestamptz) RETURNS timestamptz AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+CREATE FUNCTION vdate_part(text, timestamp) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT;
+CREATE FUNCTION vdate_part(text, timestamptz) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C STABLE STRICT;
+
+-- numeric
+
+CREATE FUNCTION vnumericacc(internal, numeric) RETURNS internal AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vsum(numeric) (SFUNC = vnumericacc, STYPE = internal, FINALFUNC = numeric_sum,
+                                SERIALFUNC = numeric_avg_serialize, DESERIALFUNC = numeric_avg_deserialize);
+CREATE AGGREGATE vavg(numeric) (SFUNC = vnumericacc, STYPE = internal, FINALFUNC = numeric_avg,
+                                SERIALFUNC = numeric_avg_serialize, DESERIALFUNC = numeric_avg_deserialize);
+
+-- arithmetic
+
+CREATE FUNCTION vint2pl(int2, int2) RETURNS int2 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint2mi(int2, int2) RETURNS int2 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint2mul(int2, int2) RETURNS int2 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint2div(int2, int2) RETURNS int2 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint24pl(int2, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint24mi(int2, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint24mul(int2, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint24div(int2, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint42pl(int4, int2) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint42mi(int4, int2) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint42mul(int4, int2) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint42div(int4, int2) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint4pl(int4, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint4mi(int4, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint4mul(int4, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint4div(int4, int4) RETURNS int4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint48pl(int4, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint48mi(int4, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint48mul(int4, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint48div(int4, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint84pl(int8, int4) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint84mi(int8, int4) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint84mul(int8, int4) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint84div(int8, int4) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint8pl(int8, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint8mi(int8, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint8mul(int8, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vint8div(int8, int8) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat4pl(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat4mi(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat4mul(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat4div(float4, float4) RETURNS float4 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat48pl(float4, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat48mi(float4, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat48mul(float4, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat48div(float4, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat8pl(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat8mi(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat8mul(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat8div(float8, float8) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat84pl(float8, float4) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat84mi(float8, float4) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat84mul(float8, float4) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vfloat84div(float8, float4) RETURNS float8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+
+-- count(DISTINCT)
+
+CREATE FUNCTION vcountdistinctacc(internal, "any") RETURNS internal AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vcountdistinctfinal(internal) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vcount_distinct("any") (SFUNC = vcountdistinctacc, STYPE = internal,
+                                         FINALFUNC = vcountdistinctfinal);
+CREATE FUNCTION vapproxcountdistinctacc(internal, "any") RETURNS internal AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vapproxcountdistinctfinal(internal) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE vapprox_count_distinct("any") (SFUNC = vapproxcountdistinctacc, STYPE = internal,
+                                                FINALFUNC = vapproxcountdistinctfinal);
+
+-- approx_count_distinct, vectorized as vapprox_count_distinct
+
+CREATE FUNCTION approxcountdistinctacc(internal, "any") RETURNS internal AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION approxcountdistinctfinal(internal) RETURNS int8 AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE AGGREGATE approx_count_distinct("any") (SFUNC = approxcountdistinctacc, STYPE = internal,
+                                               FINALFUNC = approxcountdistinctfinal);
+COMMENT ON AGGREGATE approx_count_distinct("any")
+    IS 'estimated number of distinct values, from the chunk sketches of hll_columns where possible';
+
+-- CASE, COALESCE and NULLIF in aggregate arguments
+
+CREATE FUNCTION vcase(VARIADIC "any") RETURNS "any" AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vcoalesce(VARIADIC "any") RETURNS "any" AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+CREATE FUNCTION vnullif("any", "any") RETURNS "any" AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE;
+
+-- storage version 3, which keeps new stripe data in extents
+
+SELECT columnar.upgrade_columnar_storage(c.oid) FROM pg_class c, pg_am a
+  WHERE c.relam = a.oid AND amname = 'columnar';
@@ -0,0 +1,3 @@
+-- columnar--11.1-11--11.1-10.sql
+
+DROP TABLE columnar.stripe_attr;
@@ -0,0 +1,250 @@
+-- columnar--11.1-12--11.1-11.sql
+
+DROP FUNCTION public.vtexteq(text, text);
+DROP FUNCTION public.vtextne(text, text);
+DROP FUNCTION public.vtextlike(text, text);
+DROP FUNCTION public.vtextnlike(text, text);
+DROP FUNCTION public.vstarts_with(text, text);
+DROP FUNCTION public.vlower(text);
+DROP FUNCTION public.vupper(text);
+DROP FUNCTION public.vlength(text);
+DROP FUNCTION public.vsubstring(text, int4, int4);
+DROP FUNCTION public.vsubstring(text, int4);
+DROP FUNCTION public.vsubstr(text, int4, int4);
+DROP FUNCTION public.vsubstr(text, int4);
+DROP AGGREGATE public.vmax(text);
+DROP AGGREGATE public.vmin(text);
+DROP FUNCTION public.vtextlarger(text, text);
+DROP FUNCTION public.vtextsmaller(text, text);
+
+DROP AGGREGATE public.vsum(float4);
+DROP AGGREGATE public.vavg(float4);
+DROP AGGREGATE public.vmax(float4);
+DROP AGGREGATE public.vmin(float4);
+DROP FUNCTION public.vfloat4sum(float4, float4);
+DROP FUNCTION public.vfloat4acc(float8[], float4);
+DROP FUNCTION public.vfloat4larger(float4, float4);
+DROP FUNCTION public.vfloat4smaller(float4, float4);
+DROP AGGREGATE public.vsum(float8);
+DROP AGGREGATE public.vavg(float8);
+DROP AGGREGATE public.vmax(float8);
+DROP AGGREGATE public.vmin(float8);
+DROP FUNCTION public.vfloat8sum(float8, float8);
+DROP FUNCTION public.vfloat8acc(float8[], float8);
+DROP FUNCTION public.vfloat8larger(float8, float8);
+DROP FUNCTION public.vfloat8smaller(float8, float8);
+
+DROP FUNCTION public.vfloat4eq(float4, float4);
+DROP FUNCTION public.vfloat4ne(float4, float4);
+DROP FUNCTION public.vfloat4gt(float4, float4);
+DROP FUNCTION public.vfloat4lt(float4, float4);
+DROP FUNCTION public.vfloat4le(float4, float4);
+DROP FUNCTION public.vfloat4ge(float4, float4);
+DROP FUNCTION public.vfloat48eq(float4, float8);
+DROP FUNCTION public.vfloat48ne(float4, float8);
+DROP FUNCTION public.vfloat48gt(float4, float8);
+DROP FUNCTION public.vfloat48lt(float4, float8);
+DROP FUNCTION public.vfloat48le(float4, float8);
+DROP FUNCTION public.vfloat48ge(float4, float8);
+DROP FUNCTION public.vfloat8eq(float8, float8);
+DROP FUNCTION public.vfloat8ne(float8, float8);
+DROP FUNCTION public.vfloat8gt(float8, float8);
+DROP FUNCTION public.vfloat8lt(float8, float8);
+DROP FUNCTION public.vfloat8le(float8, float8);
+DROP FUNCTION public.vfloat8ge(float8, float8);
+DROP FUNCTION public.vfloat84eq(float8, float4);
+DROP FUNCTION public.vfloat84ne(float8, float4);
+DROP FUNCTION public.vfloat84gt(float8, float4);
+DROP FUNCTION public.vfloat84lt(float8, float4);
+DROP FUNCTION public.vfloat84le(float8, float4);
+DROP FUNCTION public.vfloat84ge(float8, float4);
+
+DROP AGGREGATE public.vmax(timestamp);
+DROP AGGREGATE public.vmin(timestamp);
+DROP FUNCTION public.vtimestamplarger(timestamp, timestamp);
+DROP FUNCTION public.vtimestampsmaller(timestamp, timestamp);
+DROP AGGREGATE public.vmax(timestamptz);
+DROP AGGREGATE public.vmin(timestamptz);
+DROP FUNCTION public.vtimestamptzlarger(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamptzsmaller(timestamptz, timestamptz);
+DROP FUNCTION public.vdate_trunc(text, timestamp);
+DROP FUNCTION public.vdate_trunc(text, timestamptz);
+DROP FUNCTION public.vdate_part(text, timestamp);
+DROP FUNCTION public.vdate_part(text, timestamptz);
+
+DROP AGGREGATE public.vsum(numeric);
+DROP AGGREGATE public.vavg(numeric);
+DROP FUNCTION public.vnumericacc(internal, numeric);
+
+DROP FUNCTION public.vint2pl(int2, int2);
+DROP FUNCTION public.vint2mi(int2, int2);
+DROP FUNCTION public.vint2mul(int2, int2);
+DROP FUNCTION public.vint2div(int2, int2);
+DROP FUNCTION public.vint24pl(int2, int4);
+DROP FUNCTION public.vint24mi(int2, int4);
+DROP FUNCTION public.vint24mul(int2, int4);
+DROP FUNCTION public.vint24div(int2, int4);
+DROP FUNCTION public.vint42pl(int4, int2);
+DROP FUNCTION public.vint42mi(int4, int2);
+DROP FUNCTION public.vint42mul(int4, int2);
+DROP FUNCTION public.vint42div(int4, int2);
+DROP FUNCTION public.vint4pl(int4, int4);
+DROP FUNCTION public.vint4mi(int4, int4);
+DROP FUNCTION public.vint4mul(int4, int4);
+DROP FUNCTION public.vint4div(int4, int4);
+DROP FUNCTION public.vint48pl(int4, int8);
+DROP FUNCTION public.vint48mi(int4, int8);
+DROP FUNCTION public.vint48mul(int4, int8);
+DROP FUNCTION public.vint48div(int4, int8);
+DROP FUNCTION public.vint84pl(int8, int4);
+DROP FUNCTION public.vint84mi(int8, int4);
+DROP FUNCTION public.vint84mul(int8, int4);
+DROP FUNCTION public.vint84div(int8, int4);
+DROP FUNCTION public.vint8pl(int8, int8);
+DROP FUNCTION public.vint8mi(int8, int8);
+DROP FUNCTION public.vint8mul(int8, int8);
+DROP FUNCTION public.vint8div(int8, int8);
+DROP FUNCTION public.vfloat4pl(float4, float4);
+DROP FUNCTION public.vfloat4mi(float4, float4);
+DROP FUNCTION public.vfloat4mul(float4, float4);
+DROP FUNCTION public.vfloat4div(float4, float4);
+DROP FUNCTION public.vfloat48pl(float4, float8);
+DROP FUNCTION public.vfloat48mi(float4, float8);
+DROP FUNCTION public.vfloat48mul(float4, float8);
+DROP FUNCTION public.vfloat48div(float4, float8);
+DROP FUNCTION public.vfloat8pl(float8, float8);
+DROP FUNCTION public.vfloat8mi(float8, float8);
+DROP FUNCTION public.vfloat8mul(float8, float8);
+DROP FUNCTION public.vfloat8div(float8, float8);
+DROP FUNCTION public.vfloat84pl(float8, float4);
+DROP FUNCTION public.vfloat84mi(float8, float4);
+DROP FUNCTION public.vfloat84mul(float8, float4);
+DROP FUNCTION public.vfloat84div(float8, float4);
+
+DROP AGGREGATE public.vcount_distinct("any");
+DROP AGGREGATE public.vapprox_count_distinct("any");
+DROP FUNCTION public.vcountdistinctacc(internal, "any");
+DROP FUNCTION public.vcountdistinctfinal(internal);
+DROP FUNCTION public.vapproxcountdistinctacc(internal, "any");
+DROP FUNCTION public.vapproxcountdistinctfinal(internal);
+DROP AGGREGATE public.approx_count_distinct("any");
+DROP FUNCTION public.approxcountdistinctacc(internal, "any");
+DROP FUNCTION public.approxcountdistinctfinal(internal);
+
+DROP FUNCTION public.vcase(VARIADIC "any");
+DROP FUNCTION public.vcoalesce(VARIADIC "any");
+DROP FUNCTION public.vnullif("any", "any");
+
+DROP FUNCTION public.vtimestamp_eq(timestamp, timestamp);
+DROP FUNCTION public.vtimestamp_ne(timestamp, timestamp);
+DROP FUNCTION public.vtimestamp_gt(timestamp, timestamp);
+DROP FUNCTION public.vtimestamp_lt(timestamp, timestamp);
+DROP FUNCTION public.vtimestamp_le(timestamp, timestamp);
+DROP FUNCTION public.vtimestamp_ge(timestamp, timestamp);
+DROP FUNCTION public.vtimestamptz_eq(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamptz_ne(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamptz_gt(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamptz_lt(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamptz_le(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamptz_ge(timestamptz, timestamptz);
+DROP FUNCTION public.vtimestamp_eq_date(timestamp, date);
+DROP FUNCTION public.vtimestamp_ne_date(timestamp, date);
+DROP FUNCTION public.vtimestamp_gt_date(timestamp, date);
+DROP FUNCTION public.vtimestamp_lt_date(timestamp, date);
+DROP FUNCTION public.vtimestamp_le_date(timestamp, date);
+DROP FUNCTION public.vtimestamp_ge_date(timestamp, date);
+DROP FUNCTION public.vdate_eq_timestamp(date, timestamp);
+DROP FUNCTION public.vdate_ne_timestamp(date, timestamp);
+DROP FUNCTION public.vdate_gt_timestamp(date, timestamp);
+DROP FUNCTION public.vdate_lt_timestamp(date, timestamp);
+DROP FUNCTION public.vdate_le_timestamp(date, timestamp);
+DROP FUNCTION public.vdate_ge_timestamp(date, timestamp);
+DROP FUNCTION public.vtimestamptz_eq_date(timestamptz, date);
+DROP FUNCTION public.vtimestamptz_ne_date(timestamptz, date);
+DROP FUNCTION public.vtimestamptz_gt_date(timestamptz, date);
+DROP FUNCTION public.vtimestamptz_lt_date(timestamptz, date);
+DROP FUNCTION public.vtimestamptz_le_date(timestamptz, date);
+DROP FUNCTION public.vtimestamptz_ge_date(timestamptz, date);
+DROP FUNCTION public.vdate_eq_timestamptz(date, timestamptz);
+DROP FUNCTION public.vdate_ne_timestamptz(date, timestamptz);
+DROP FUNCTION public.vdate_gt_timestamptz(date, timestamptz);
+DROP FUNCTION public.vdate_lt_timestamptz(date, timestamptz);
+DROP FUNCTION public.vdate_le_timestamptz(date, timestamptz);
+DROP FUNCTION public.vdate_ge_timestamptz(date, timestamptz);
+
+DROP FUNCTION columnar.alter_columnar_table_set(regclass, int, int, name, int, int, name[], text[], name, bool, int, name[], name[], name[], name[], text[], bool, name, int);
+DROP FUNCTION columnar.alter_columnar_table_reset(regclass, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool, bool);
+
+#include "../udfs/alter_columnar_table_set/11.1-3.sql"
+#include "../udfs/alter_columnar_table_reset/11.1-3.sql"
+
+DROP FUNCTION columnar.memory_peaks(bool);
+DROP FUNCTION columnar.advise(regclass, int);
+DROP FUNCTION columnar.prewarm(regclass, name[], bigint[]);
+DROP FUNCTION columnar.autoprewarm_dump();
+DROP FUNCTION columnar.export_arrow(regclass, name[]);
+DROP FUNCTION columnar.import_arrow(regclass, bytea);
+DROP FUNCTION columnar.import_arrow_file(regclass, text);
+DROP FUNCTION columnar.load_csv(regclass, text, "char", "char", text, bool);
+DROP FUNCTION columnar.refresh_materialized_view(regclass);
+DROP TABLE columnar.matview_refresh;
+DROP FUNCTION columnar.bucket_of(anyelement, int);
+ALTER TABLE columnar.stripe DROP COLUMN bucket;
+DROP FUNCTION columnar.copy_heap_rows(regclass, regclass);
+#include "../udfs/alter_table_set_access_method/11.1-8.sql"
+DROP FUNCTION columnar.export_stripes(regclass);
+DROP FUNCTION columnar.import_stripe(regclass, bytea);
+DROP FUNCTION columnar.column_profile(regclass, int);
+DROP FUNCTION columnar.wait_events();
+DROP VIEW columnar.pg_stat_columnar;
+DROP FUNCTION columnar.stat_reset(regclass);
+DROP FUNCTION columnar.stat_relations();
+DO $$
+BEGIN
+  IF EXISTS (SELECT 1 FROM columnar.stripe WHERE (file_offset & 4611686018427387904) <> 0) THEN
+    RAISE EXCEPTION 'cannot downgrade columnar while stripes are offloaded'
+      USING HINT = 'Bring those tables back with VACUUM FULL.';
+  END IF;
+END;
+$$;
+DROP FUNCTION columnar.drop_stripes(regclass, text);
+DROP FUNCTION columnar.offload_stripes(regclass, interval);
+DROP FUNCTION columnar.vacuum(regclass, int, real, int);
+DROP FUNCTION columnar._vacuum_internal(regclass, int, real, int);
+
+#include "../udfs/vacuum/11.1-10.sql"
+
+DROP FUNCTION columnar.metadata_statistics(regclass);
+DO $$
+BEGIN
+  IF EXISTS (SELECT 1 FROM columnar.stripe_skip_list) THEN
+    RAISE EXCEPTION 'cannot downgrade columnar while stripes have compact chunk metadata'
+      USING HINT = 'Rewrite those tables with VACUUM FULL while columnar.compact_chunk_metadata is off.';
+  END IF;
+END;
+$$;
+DROP TABLE columnar.stripe_skip_list;
+DROP TABLE columnar.stripe_projection;
+ALTER TABLE columnar.options DROP COLUMN auto_row_limits;
+ALTER TABLE columnar.options DROP COLUMN stripe_size_limit;
+DROP FUNCTION columnar.reclaim_dropped_columns(regclass);
+DROP FUNCTION columnar.recompress(regclass, name, int, interval);
+DROP FUNCTION columnar.flush_delta_store(regclass);
+DROP TABLE columnar.delta_store;
+ALTER TABLE columnar.options DROP COLUMN delta_store;
+DROP FUNCTION columnar.decompression_stats();
+DROP FUNCTION columnar.train_compression_dictionary(regclass, name, int);
+DROP TABLE columnar.compression_dictionary;
+DROP SEQUENCE columnar.compression_dictionary_id_seq;
+ALTER TABLE columnar.chunk DROP COLUMN shredded_key_stats;
+ALTER TABLE columnar.chunk DROP COLUMN large_value_count;
+ALTER TABLE columnar.chunk DROP COLUMN hll_sketch;
+ALTER TABLE columnar.chunk DROP COLUMN values_sorted;
+ALTER TABLE columnar.chunk DROP COLUMN distinct_count;
+ALTER TABLE columnar.chunk DROP COLUMN null_count;
+ALTER TABLE columnar.chunk DROP COLUMN compression_dictionary_id;
+ALTER TABLE columnar.chunk DROP COLUMN null_state;
+ALTER TABLE columnar.chunk DROP COLUMN value_encoding_type;
+ALTER TABLE columnar.chunk DROP COLUMN bloom_filter;
+DROP TABLE columnar.column_options;
+ALTER TABLE columnar.options DROP COLUMN cache_quota;
@@ -0,0 +1,39 @@
+CREATE OR REPLACE FUNCTION columnar.column_profile(
+  relation regclass,
+  sample_stripes int DEFAULT 8,
+  OUT attname name,
+  OUT null_frac real,
+  OUT distinct_frac real,
+  OUT sorted_frac real,
+  OUT clustered_frac real,
+  OUT compression text,
+  OUT stored_bytes bigint,
+  OUT none_bytes bigint,
+  OUT pglz_bytes bigint,
+  OUT lz4_bytes bigint,
+  OUT zstd_bytes bigint
+) RETURNS SETOF record
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_column_profile$$;
+
+COMMENT ON FUNCTION columnar.column_profile(regclass, int)
+  IS 'values and compressed sizes of the columns of a columnar table, measured on a sample of its stripes';
+
+CREATE OR REPLACE FUNCTION columnar.advise(
+  relation regclass,
+  sample_stripes int DEFAULT 8,
+  OUT attname name,
+  OUT option text,
+  OUT current_value text,
+  OUT recommended_value text,
+  OUT current_bytes bigint,
+  OUT estimated_bytes bigint,
+  OUT current_decompress_ms double precision,
+  OUT estimated_decompress_ms double precision,
+  OUT reason text
+) RETURNS SETOF record
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_advise$$;
+
+COMMENT ON FUNCTION columnar.advise(regclass, int)
+  IS 'options of a columnar table worth changing, from a sample of its stripes and its scan statistics';
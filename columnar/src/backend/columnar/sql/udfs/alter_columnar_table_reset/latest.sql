@@ -3,7 +3,20 @@ CREATE OR REPLACE FUNCTION columnar.alter_columnar_table_reset(
     chunk_group_row_limit bool DEFAULT false,
     stripe_row_limit bool DEFAULT false,
     compression bool DEFAULT false,
-    compression_level bool DEFAULT false)
+    compression_level bool DEFAULT false,
+    cache_quota bool DEFAULT false,
+    bloom_filter_columns bool DEFAULT false,
+    column_compression bool DEFAULT false,
+    sort_key bool DEFAULT false,
+    delta_store bool DEFAULT false,
+    stripe_size_limit bool DEFAULT false,
+    zorder_columns bool DEFAULT false,
+    projection_group_by bool DEFAULT false,
+    projection_sum bool DEFAULT false,
+    hll_columns bool DEFAULT false,
+    shredded_keys bool DEFAULT false,
+    auto_row_limits bool DEFAULT false,
+    bucket_by bool DEFAULT false)
     RETURNS void
     LANGUAGE C
 AS 'MODULE_PATHNAME', 'alter_columnar_table_reset';
@@ -13,5 +26,18 @@ COMMENT ON FUNCTION columnar.alter_columnar_table_reset(
     chunk_group_row_limit bool,
     stripe_row_limit bool,
     compression bool,
-    compression_level bool)
+    compression_level bool,
+    cache_quota bool,
+    bloom_filter_columns bool,
+    column_compression bool,
+    sort_key bool,
+    delta_store bool,
+    stripe_size_limit bool,
+    zorder_columns bool,
+    projection_group_by bool,
+    projection_sum bool,
+    hll_columns bool,
+    shredded_keys bool,
+    auto_row_limits bool,
+    bucket_by bool)
 IS 'reset on or more options on a columnar table to the system defaults';
@@ -3,7 +3,21 @@ CREATE OR REPLACE FUNCTION columnar.alter_columnar_table_set(
     chunk_group_row_limit int DEFAULT NULL,
     stripe_row_limit int DEFAULT NULL,
     compression name DEFAULT null,
-    compression_level int DEFAULT NULL)
+    compression_level int DEFAULT NULL,
+    cache_quota int DEFAULT NULL,
+    bloom_filter_columns name[] DEFAULT NULL,
+    column_compression text[] DEFAULT NULL,
+    sort_key name DEFAULT NULL,
+    delta_store bool DEFAULT NULL,
+    stripe_size_limit int DEFAULT NULL,
+    zorder_columns name[] DEFAULT NULL,
+    projection_group_by name[] DEFAULT NULL,
+    projection_sum name[] DEFAULT NULL,
+    hll_columns name[] DEFAULT NULL,
+    shredded_keys text[] DEFAULT NULL,
+    auto_row_limits bool DEFAULT NULL,
+    bucket_by name DEFAULT NULL,
+    bucket_count int DEFAULT NULL)
     RETURNS void
     LANGUAGE C
 AS 'MODULE_PATHNAME', 'alter_columnar_table_set';
@@ -13,5 +27,19 @@ COMMENT ON FUNCTION columnar.alter_columnar_table_set(
     chunk_group_row_limit int,
     stripe_row_limit int,
     compression name,
-    compression_level int)
+    compression_level int,
+    cache_quota int,
+    bloom_filter_columns name[],
+    column_compression text[],
+    sort_key name,
+    delta_store bool,
+    stripe_size_limit int,
+    zorder_columns name[],
+    projection_group_by name[],
+    projection_sum name[],
+    hll_columns name[],
+    shredded_keys text[],
+    auto_row_limits bool,
+    bucket_by name,
+    bucket_count int)
 IS 'set one or more options on a columnar table, when set to NULL no change is made';
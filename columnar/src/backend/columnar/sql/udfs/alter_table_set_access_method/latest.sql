@@ -158,9 +158,19 @@ BEGIN
                          INCLUDING DEFAULTS
         ) USING %s'::text, temp_tbl_name, tbl_schema, tbl_name, method);
 
-    -- Insert all data from original table
-
-    EXECUTE FORMAT('INSERT INTO %I SELECT * FROM %I.%I'::text, temp_tbl_name, tbl_schema, tbl_name);
+    -- Insert all data from original table. Heap tables are copied straight
+    -- into stripes, unless copy_heap_rows cannot copy them.
+
+    IF method = 'columnar' THEN
+        BEGIN
+            PERFORM columnar.copy_heap_rows(tbl_oid::oid::regclass,
+                                            quote_ident(temp_tbl_name)::regclass);
+        EXCEPTION WHEN feature_not_supported THEN
+            EXECUTE FORMAT('INSERT INTO %I SELECT * FROM %I.%I'::text, temp_tbl_name, tbl_schema, tbl_name);
+        END;
+    ELSE
+        EXECUTE FORMAT('INSERT INTO %I SELECT * FROM %I.%I'::text, temp_tbl_name, tbl_schema, tbl_name);
+    END IF;
 
     -- Drop original table
 
@@ -0,0 +1,11 @@
+CREATE OR REPLACE FUNCTION columnar.bucket_of(
+    value anyelement,
+    bucket_count int)
+    RETURNS int
+    LANGUAGE C IMMUTABLE PARALLEL SAFE
+AS 'MODULE_PATHNAME', 'bucket_of';
+
+COMMENT ON FUNCTION columnar.bucket_of(
+    value anyelement,
+    bucket_count int)
+IS 'bucket a value is written to by columnar tables with bucket_by set to bucket_count buckets';
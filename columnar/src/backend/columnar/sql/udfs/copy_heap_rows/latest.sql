@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION columnar.copy_heap_rows(
+  source regclass,
+  target regclass
+) RETURNS bigint
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_copy_heap_rows$$;
+
+COMMENT ON FUNCTION columnar.copy_heap_rows(regclass, regclass)
+  IS 'copy the rows of a heap table into new stripes of a columnar table with the same columns';
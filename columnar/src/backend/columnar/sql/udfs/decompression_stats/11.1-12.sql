@@ -0,0 +1,13 @@
+CREATE OR REPLACE FUNCTION columnar.decompression_stats(
+  OUT compression text,
+  OUT chunks bigint,
+  OUT compressed_bytes bigint,
+  OUT decompressed_bytes bigint,
+  OUT decompression_time_ms double precision,
+  OUT decompression_mb_per_sec double precision
+) RETURNS SETOF record
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_decompression_stats$$;
+
+COMMENT ON FUNCTION columnar.decompression_stats()
+  IS 'columnar decompressions of this backend per compression type';
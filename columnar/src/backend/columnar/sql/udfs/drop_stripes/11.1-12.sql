@@ -0,0 +1,11 @@
+CREATE OR REPLACE FUNCTION columnar.drop_stripes(
+    table_name regclass,
+    predicate text)
+    RETURNS bigint
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', 'columnar_drop_stripes';
+
+COMMENT ON FUNCTION columnar.drop_stripes(
+    table_name regclass,
+    predicate text)
+IS 'remove the rows of a columnar table that match predicate, detaching the stripes whose rows all match';
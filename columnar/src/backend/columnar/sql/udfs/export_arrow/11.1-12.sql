@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION columnar.export_arrow(
+  relation regclass,
+  columns name[] DEFAULT NULL
+) RETURNS SETOF bytea
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_export_arrow$$;
+
+COMMENT ON FUNCTION columnar.export_arrow(regclass, name[])
+  IS 'export the given columns of a columnar table as the messages of an Arrow IPC stream';
@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION columnar.flush_delta_store(
+    table_name regclass)
+    RETURNS bigint
+    LANGUAGE C
+AS 'MODULE_PATHNAME', 'flush_delta_store';
+
+COMMENT ON FUNCTION columnar.flush_delta_store(
+    table_name regclass)
+IS 'move the rows of a columnar table from its delta store into stripes';
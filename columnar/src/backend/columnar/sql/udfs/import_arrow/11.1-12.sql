@@ -0,0 +1,19 @@
+CREATE OR REPLACE FUNCTION columnar.import_arrow(
+  relation regclass,
+  stream bytea
+) RETURNS bigint
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_import_arrow$$;
+
+COMMENT ON FUNCTION columnar.import_arrow(regclass, bytea)
+  IS 'write the rows of an Arrow IPC stream into new stripes of a columnar table';
+
+CREATE OR REPLACE FUNCTION columnar.import_arrow_file(
+  relation regclass,
+  path text
+) RETURNS bigint
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_import_arrow_file$$;
+
+COMMENT ON FUNCTION columnar.import_arrow_file(regclass, text)
+  IS 'write the rows of an Arrow IPC stream file on the server into new stripes of a columnar table';
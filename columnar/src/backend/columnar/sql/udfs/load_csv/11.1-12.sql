@@ -0,0 +1,13 @@
+CREATE OR REPLACE FUNCTION columnar.load_csv(
+  relation regclass,
+  path text,
+  delimiter "char" DEFAULT ',',
+  quote "char" DEFAULT '"',
+  null_string text DEFAULT '',
+  header bool DEFAULT false
+) RETURNS bigint
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_load_csv$$;
+
+COMMENT ON FUNCTION columnar.load_csv(regclass, text, "char", "char", text, bool)
+  IS 'write the rows of a CSV file on the server into new stripes of a columnar table, parsed by parallel workers';
@@ -0,0 +1,11 @@
+CREATE OR REPLACE FUNCTION columnar.memory_peaks(
+  reset bool DEFAULT false,
+  OUT read_state_peak bigint,
+  OUT write_state_peak bigint
+) RETURNS record
+STRICT
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_memory_peaks$$;
+
+COMMENT ON FUNCTION columnar.memory_peaks(bool)
+  IS 'most memory a stripe read and a stripe write of this backend used, in bytes';
@@ -0,0 +1,14 @@
+CREATE OR REPLACE FUNCTION columnar.metadata_statistics(
+  relation regclass,
+  OUT attname name,
+  OUT null_frac real,
+  OUT avg_width int,
+  OUT n_distinct real,
+  OUT histogram_bounds text,
+  OUT correlation real
+) RETURNS SETOF record
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_metadata_statistics$$;
+
+COMMENT ON FUNCTION columnar.metadata_statistics(regclass)
+  IS 'column statistics of a columnar table derived from its chunk metadata';
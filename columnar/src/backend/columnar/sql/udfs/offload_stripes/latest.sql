@@ -0,0 +1,11 @@
+CREATE OR REPLACE FUNCTION columnar.offload_stripes(
+    table_name regclass,
+    older_than interval DEFAULT NULL)
+    RETURNS int
+    LANGUAGE C
+AS 'MODULE_PATHNAME', 'columnar_offload_stripes';
+
+COMMENT ON FUNCTION columnar.offload_stripes(
+    table_name regclass,
+    older_than interval)
+IS 'move the stripes of a columnar table to columnar.offload_directory, optionally only those written at least older_than ago';
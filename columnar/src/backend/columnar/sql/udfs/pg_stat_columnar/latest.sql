@@ -0,0 +1,57 @@
+CREATE OR REPLACE FUNCTION columnar.stat_relations(
+  OUT relid oid,
+  OUT stripes_scanned bigint,
+  OUT stripes_skipped bigint,
+  OUT chunk_groups_scanned bigint,
+  OUT chunk_groups_skipped bigint,
+  OUT bytes_read bigint,
+  OUT bytes_decompressed bigint,
+  OUT vectorized_rows bigint,
+  OUT row_path_rows bigint,
+  OUT cache_hits bigint,
+  OUT cache_misses bigint,
+  OUT cache_evictions bigint,
+  OUT rows_written bigint,
+  OUT stripes_flushed bigint
+) RETURNS SETOF record
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_stat_relations$$;
+
+COMMENT ON FUNCTION columnar.stat_relations()
+  IS 'cumulative read and write statistics of the columnar tables of the current database';
+
+CREATE OR REPLACE FUNCTION columnar.stat_reset(relation regclass DEFAULT NULL)
+RETURNS void
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_stat_reset$$;
+
+COMMENT ON FUNCTION columnar.stat_reset(regclass)
+  IS 'reset the statistics of a columnar table, or of all of them if relation is NULL';
+
+REVOKE EXECUTE ON FUNCTION columnar.stat_reset(regclass) FROM PUBLIC;
+
+CREATE OR REPLACE VIEW columnar.pg_stat_columnar AS
+  SELECT s.relid,
+         n.nspname AS schemaname,
+         c.relname,
+         s.stripes_scanned,
+         s.stripes_skipped,
+         s.chunk_groups_scanned,
+         s.chunk_groups_skipped,
+         s.bytes_read,
+         s.bytes_decompressed,
+         s.vectorized_rows,
+         s.row_path_rows,
+         s.cache_hits,
+         s.cache_misses,
+         s.cache_evictions,
+         s.rows_written,
+         s.stripes_flushed
+  FROM columnar.stat_relations() s
+  JOIN pg_catalog.pg_class c ON c.oid = s.relid
+  JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace;
+
+COMMENT ON VIEW columnar.pg_stat_columnar
+  IS 'cumulative read and write statistics of columnar tables, like pg_stat_user_tables';
+
+GRANT SELECT ON columnar.pg_stat_columnar TO PUBLIC;
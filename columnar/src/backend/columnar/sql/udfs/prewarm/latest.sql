@@ -0,0 +1,18 @@
+CREATE OR REPLACE FUNCTION columnar.prewarm(
+  relation regclass,
+  columns name[] DEFAULT NULL,
+  stripes bigint[] DEFAULT NULL
+) RETURNS bigint
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_prewarm$$;
+
+COMMENT ON FUNCTION columnar.prewarm(regclass, name[], bigint[])
+  IS 'load the chunks of the given columns and stripes of a columnar table into the shared column cache';
+
+CREATE OR REPLACE FUNCTION columnar.autoprewarm_dump()
+RETURNS bigint
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_autoprewarm_dump$$;
+
+COMMENT ON FUNCTION columnar.autoprewarm_dump()
+  IS 'save the keys of the chunks in the shared column cache for columnar.autoprewarm';
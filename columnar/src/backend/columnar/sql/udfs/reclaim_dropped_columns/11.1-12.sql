@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION columnar.reclaim_dropped_columns(
+    table_name regclass)
+    RETURNS int
+    LANGUAGE C
+AS 'MODULE_PATHNAME', 'columnar_reclaim_dropped_columns';
+
+COMMENT ON FUNCTION columnar.reclaim_dropped_columns(
+    table_name regclass)
+IS 'rewrite the stripes of a columnar table that still hold data of dropped columns without it';
@@ -0,0 +1,15 @@
+CREATE OR REPLACE FUNCTION columnar.recompress(
+    table_name regclass,
+    compression name,
+    compression_level int DEFAULT NULL,
+    older_than interval DEFAULT NULL)
+    RETURNS int
+    LANGUAGE C
+AS 'MODULE_PATHNAME', 'columnar_recompress';
+
+COMMENT ON FUNCTION columnar.recompress(
+    table_name regclass,
+    compression name,
+    compression_level int,
+    older_than interval)
+IS 'compress the stripes of a columnar table again with another compression, optionally only those written at least older_than ago';
@@ -0,0 +1,8 @@
+CREATE OR REPLACE FUNCTION columnar.refresh_materialized_view(
+  matview regclass
+) RETURNS text
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_refresh_materialized_view$$;
+
+COMMENT ON FUNCTION columnar.refresh_materialized_view(regclass)
+  IS 'refresh a columnar materialized view, aggregating only the stripes added to its source table since the last refresh when possible';
@@ -0,0 +1,18 @@
+CREATE OR REPLACE FUNCTION columnar.export_stripes(
+  relation regclass
+) RETURNS SETOF bytea
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_export_stripes$$;
+
+COMMENT ON FUNCTION columnar.export_stripes(regclass)
+  IS 'return the stripes of a columnar table in their compressed form, for columnar.import_stripe';
+
+CREATE OR REPLACE FUNCTION columnar.import_stripe(
+  relation regclass,
+  stripe bytea
+) RETURNS bigint
+LANGUAGE c STRICT
+AS 'MODULE_PATHNAME', $$columnar_import_stripe$$;
+
+COMMENT ON FUNCTION columnar.import_stripe(regclass, bytea)
+  IS 'write a stripe returned by columnar.export_stripes into a new stripe of a columnar table';
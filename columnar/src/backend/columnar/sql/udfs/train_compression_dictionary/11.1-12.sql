@@ -0,0 +1,13 @@
+CREATE OR REPLACE FUNCTION columnar.train_compression_dictionary(
+    table_name regclass,
+    column_name name,
+    dictionary_size int DEFAULT 65536)
+    RETURNS bigint
+    LANGUAGE C
+AS 'MODULE_PATHNAME', 'train_compression_dictionary';
+
+COMMENT ON FUNCTION columnar.train_compression_dictionary(
+    table_name regclass,
+    column_name name,
+    dictionary_size int)
+IS 'train a zstd dictionary for a column of a columnar table from its existing data';
@@ -5,7 +5,14 @@ CREATE OR REPLACE FUNCTION columnar._vacuum_internal(rel REGCLASS, stripe_count
 COMMENT ON FUNCTION columnar._vacuum_internal(REGCLASS, INT)
   IS 'vacuum columnar table internal function';
 
-CREATE OR REPLACE FUNCTION columnar.vacuum(tablename REGCLASS, stripe_count INT DEFAULT 0)
+CREATE OR REPLACE FUNCTION columnar._vacuum_internal(rel REGCLASS, stripe_count INT, cost_delay REAL, cost_limit INT)
+  RETURNS INT
+  LANGUAGE c AS 'MODULE_PATHNAME', $$vacuum_columnar_table$$;
+
+COMMENT ON FUNCTION columnar._vacuum_internal(REGCLASS, INT, REAL, INT)
+  IS 'vacuum columnar table internal function with cost based delay';
+
+CREATE OR REPLACE FUNCTION columnar.vacuum(tablename REGCLASS, stripe_count INT DEFAULT 0, cost_delay REAL DEFAULT NULL, cost_limit INT DEFAULT NULL)
 RETURNS INT AS $$
 DECLARE
   count INT;
@@ -15,7 +22,7 @@ BEGIN
   stripes := 0;
 
   WHILE count > 0 AND (stripe_count = 0 OR stripes < stripe_count) LOOP
-    SELECT columnar._vacuum_internal(tablename, stripe_count) INTO count;
+    SELECT columnar._vacuum_internal(tablename, stripe_count, cost_delay, cost_limit) INTO count;
     stripes := stripes + count;
   END LOOP;
 
@@ -23,7 +30,7 @@ BEGIN
 END;
 $$ LANGUAGE plpgsql;
 
-COMMENT ON FUNCTION columnar.vacuum(REGCLASS, INT)
+COMMENT ON FUNCTION columnar.vacuum(REGCLASS, INT, REAL, INT)
   IS 'vacuum columnar table function';
 
 CREATE OR REPLACE FUNCTION columnar.stats(
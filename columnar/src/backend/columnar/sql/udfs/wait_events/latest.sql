@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION columnar.wait_events(
+  OUT pid int,
+  OUT wait_event text
+) RETURNS SETOF record
+LANGUAGE c
+AS 'MODULE_PATHNAME', $$columnar_wait_events$$;
+
+COMMENT ON FUNCTION columnar.wait_events()
+  IS 'backends in a columnar wait event, which pg_stat_activity shows as Extension';
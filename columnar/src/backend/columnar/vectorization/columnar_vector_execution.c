@@ -16,21 +16,58 @@
 
 #include "catalog/pg_operator.h"
 #include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
 #include "nodes/pg_list.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/optimizer.h"
 #include "parser/parse_oper.h"
 #include "parser/parse_func.h"
-
+#include "port/pg_bitutils.h"
+#include "portability/instr_time.h"
+
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/float.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
 
 #include "pg_version_constants.h"
+#include "columnar/columnar.h"
 #include "columnar/vectorization/columnar_vector_execution.h"
 #include "columnar/vectorization/columnar_vector_types.h"
+#include "columnar/vectorization/types/types.h"
+
+/*
+ * IsVectorQualConstant returns true for constants, and for the params of
+ * prepared statements and of the plan above, which the scan evaluates before
+ * it builds the vectorized quals and passes as constants.
+ */
+static bool
+IsVectorQualConstant(Expr *arg)
+{
+	if (IsA(arg, Const))
+		return true;
+
+	if (IsA(arg, Param))
+	{
+		ParamKind paramKind = ((Param *) arg)->paramkind;
+
+		return paramKind == PARAM_EXTERN || paramKind == PARAM_EXEC;
+	}
+
+	return false;
+}
 
 /*
  * Check OpExpr argument so they can be vectorized.
  * For now, vectorization only support "normal" clauses where
- * we compare tuple column against constant value.
+ * we compare tuple column, a CASE, COALESCE or NULLIF of columns,
+ * or a function of a column, against constant value or a param.
  */
 bool
 CheckOpExprArgumentRules(List *args)
@@ -49,7 +86,7 @@ CheckOpExprArgumentRules(List *args)
 			break;
 	
 		Expr *arg = (Expr *) lfirst(lcOpExprArgs);
-		if (IsA(arg, Const))
+		if (IsVectorQualConstant(arg))
 		{
 			if (singleConstArgument)
 			{
@@ -58,7 +95,8 @@ CheckOpExprArgumentRules(List *args)
 			}
 			singleConstArgument = true;
 		}
-		else if (IsA(arg, Var))
+		else if (IsA(arg, Var) || IsVectorizableValueExpr((Node *) arg) ||
+				 IsA(arg, FuncExpr))
 		{
 			if (singleVarArgument)
 			{
@@ -78,10 +116,111 @@ CheckOpExprArgumentRules(List *args)
 }
 
 /*
- * Get vectorized procedure OID.
+ * VectorizedProcedureEntry maps a procedure to its vectorized version, which
+ * is InvalidOid if there is none.
+ */
+typedef struct VectorizedProcedureEntry
+{
+	Oid procedureOid;
+	Oid vectorizedProcedureOid;
+} VectorizedProcedureEntry;
+
+/*
+ * Backend local map of procedures to their vectorized versions, filled as
+ * they are looked up at plan time and reset when pg_proc changes.
+ */
+static HTAB *VectorizedProcedureMap = NULL;
+
+static void InitVectorizedProcedureMap(void);
+static void InvalidateVectorizedProcedureMap(Datum argument, int cacheId,
+											 uint32 hashValue);
+static Oid ResolveVectorizedProcedureOid(Oid procedureOid);
+
+
+/*
+ * InitVectorizedProcedureMap creates the map of vectorized procedures if it
+ * doesn't exist, and registers its invalidation callback the first time.
+ */
+static void
+InitVectorizedProcedureMap(void)
+{
+	static bool invalidationCallbackRegistered = false;
+
+	if (VectorizedProcedureMap != NULL)
+	{
+		return;
+	}
+
+	if (!invalidationCallbackRegistered)
+	{
+		CacheRegisterSyscacheCallback(PROCOID, InvalidateVectorizedProcedureMap,
+									  (Datum) 0);
+		invalidationCallbackRegistered = true;
+	}
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(VectorizedProcedureEntry);
+	info.hcxt = CacheMemoryContext;
+
+	VectorizedProcedureMap = hash_create("columnar vectorized procedure map", 64,
+										 &info, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+
+/*
+ * InvalidateVectorizedProcedureMap drops all entries of the map when any
+ * procedure changes, since creating or dropping a vectorized procedure
+ * changes the mapping of another one.
+ */
+static void
+InvalidateVectorizedProcedureMap(Datum argument, int cacheId, uint32 hashValue)
+{
+	if (VectorizedProcedureMap != NULL)
+	{
+		hash_destroy(VectorizedProcedureMap);
+		VectorizedProcedureMap = NULL;
+	}
+}
+
+
+/*
+ * GetVectorizedProcedureOid sets vectorizedProcedureOid to the vectorized
+ * version of the procedure and returns true, or returns false if it has
+ * none. Results are cached for the rest of the backend.
  */
 bool
 GetVectorizedProcedureOid(Oid procedureOid, Oid *vectorizedProcedureOid)
+{
+	InitVectorizedProcedureMap();
+
+	VectorizedProcedureEntry *entry = hash_search(VectorizedProcedureMap, &procedureOid,
+												  HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		Oid resolvedOid = ResolveVectorizedProcedureOid(procedureOid);
+
+		/* the catalog lookups may have reset the map */
+		InitVectorizedProcedureMap();
+
+		entry = hash_search(VectorizedProcedureMap, &procedureOid, HASH_ENTER, NULL);
+		entry->vectorizedProcedureOid = resolvedOid;
+	}
+
+	*vectorizedProcedureOid = entry->vectorizedProcedureOid;
+
+	return OidIsValid(entry->vectorizedProcedureOid);
+}
+
+
+/*
+ * ResolveVectorizedProcedureOid returns the OID of the procedure named like
+ * the given one with a "v" prefix that takes the same argument types, or
+ * InvalidOid if there is no such procedure.
+ */
+static Oid
+ResolveVectorizedProcedureOid(Oid procedureOid)
 {
 	Form_pg_proc procedureForm;
 	HeapTuple procedureTuple;
@@ -96,8 +235,14 @@ GetVectorizedProcedureOid(Oid procedureOid, Oid *vectorizedProcedureOid)
 	int nvargs;
 	Oid vatype;
 	Oid *true_oid_array;
+	Oid vectorizedProcedureOid = InvalidOid;
 
 	procedureTuple = SearchSysCache1(PROCOID, ObjectIdGetDatum(procedureOid));
+	if (!HeapTupleIsValid(procedureTuple))
+	{
+		elog(ERROR, "cache lookup failed for function %u", procedureOid);
+	}
+
 	procedureForm = (Form_pg_proc) GETSTRUCT(procedureTuple);
 
 	int originalProcedureNameLen = strlen(NameStr(procedureForm->proname));
@@ -110,46 +255,397 @@ GetVectorizedProcedureOid(Oid procedureOid, Oid *vectorizedProcedureOid)
 	memcpy(vectorizedProcedureName + 1,
 		NameStr(procedureForm->proname),
 		originalProcedureNameLen);
-	
-	ReleaseSysCache(procedureTuple);
 
-	funcNames = lappend(funcNames, makeString(vectorizedProcedureName));
+	int nargs = procedureForm->pronargs;
 
-	argtypes = palloc(sizeof(Oid) * procedureForm->pronargs);
+	argtypes = palloc(sizeof(Oid) * nargs);
 
-	for (i = 0; i < procedureForm->pronargs; i++)
+	for (i = 0; i < nargs; i++)
 		argtypes[i] = procedureForm->proargtypes.values[i];
+
+	ReleaseSysCache(procedureTuple);
+
+	funcNames = lappend(funcNames, makeString(vectorizedProcedureName));
 	
 #if PG_VERSION_NUM >= PG_VERSION_14
 	fdResult = func_get_detail(funcNames, NIL, NIL,
-								procedureForm->pronargs, argtypes,
+								nargs, argtypes,
 								false, true, false,
-								vectorizedProcedureOid,
+								&vectorizedProcedureOid,
 								&retype, &retset,
 								&nvargs, &vatype,
 								&true_oid_array, NULL);
 #else
 	fdResult = func_get_detail(funcNames,
 								NIL, NIL,
-								procedureForm->pronargs, argtypes,
+								nargs, argtypes,
 								false, false,
-								vectorizedProcedureOid, &retype,
+								&vectorizedProcedureOid, &retype,
 								&retset, &nvargs, &vatype,
 								&true_oid_array, NULL);
 #endif
 
 	if ((fdResult == FUNCDETAIL_NOTFOUND || fdResult == FUNCDETAIL_MULTIPLE) || 
-		!OidIsValid(*vectorizedProcedureOid) ||
-		(procedureForm->pronargs != 0 && 
-		 memcmp(argtypes, true_oid_array, procedureForm->pronargs * sizeof(Oid)) != 0))
+		!OidIsValid(vectorizedProcedureOid) ||
+		(nargs != 0 && 
+		 memcmp(argtypes, true_oid_array, nargs * sizeof(Oid)) != 0))
+	{
+		return InvalidOid;
+	}
+
+	return vectorizedProcedureOid;
+}
+
+/*
+ * IN lists with more values than this are searched with a binary search,
+ * shorter ones are compared with all values.
+ */
+#define VECTOR_IN_LIST_LINEAR_LIMIT 16
+
+/*
+ * Children of AND and OR are reordered after this many vectors. A child that
+ * decides few rows counts as deciding this share of them, which bounds its
+ * rank.
+ */
+#define VECTOR_QUAL_REORDER_INTERVAL 16
+#define VECTOR_QUAL_MIN_DECIDED_SHARE 0.001
+
+/*
+ * IN lists are only matched for the rows AND or OR left undecided when they
+ * are at most this fraction of the vector.
+ */
+#define VECTOR_QUAL_UNDECIDED_FRACTION 4
+
+/*
+ * IsBinaryEqualityType returns true for the fixed width types whose values
+ * are equal by the equality of the type when their binary values are.
+ */
+bool
+IsBinaryEqualityType(Oid typeOid)
+{
+	switch (typeOid)
 	{
+		case BOOLOID:
+		case CHAROID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+
+/*
+ * IsVectorizableInList returns true if the IN (...) or NOT IN (...) list
+ * compares a column with constants by the equality of its type, and the
+ * type is one whose values are equal when their binary values are.
+ */
+static bool
+IsVectorizableInList(ScalarArrayOpExpr *arrayOpExpr)
+{
+	if (list_length(arrayOpExpr->args) != 2)
+		return false;
+
+	Node *left = linitial(arrayOpExpr->args);
+	Node *right = lsecond(arrayOpExpr->args);
+
+	if (!IsA(left, Var) || ((Var *) left)->varattno <= 0 ||
+		!IsA(right, Const) || ((Const *) right)->constisnull)
+		return false;
+
+	Oid columnType = ((Var *) left)->vartype;
+
+	if (!IsBinaryEqualityType(columnType))
 		return false;
+
+	if (get_element_type(((Const *) right)->consttype) != columnType)
+		return false;
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(columnType, TYPECACHE_EQ_OPR);
+
+	if (arrayOpExpr->useOr)
+		return arrayOpExpr->opno == typeEntry->eq_opr;
+
+	return arrayOpExpr->opno == get_negator(typeEntry->eq_opr);
+}
+
+
+/*
+ * IsVectorizableTestArgument returns true if NullTest and BooleanTest
+ * argument is a user column, which vector slots have.
+ */
+static bool
+IsVectorizableTestArgument(Expr *arg)
+{
+	return arg != NULL && IsA(arg, Var) && ((Var *) arg)->varattno > 0;
+}
+
+
+/*
+ * IsVectorizableValueType returns true if values of the type are passed by
+ * value and stored in vectors of a fixed width, so CASE, COALESCE and NULLIF
+ * can move them between vectors without knowing the type.
+ */
+bool
+IsVectorizableValueType(Oid typeOid)
+{
+	int16 typeLen;
+	bool typeByVal;
+	get_typlenbyval(typeOid, &typeLen, &typeByVal);
+
+	return typeByVal &&
+		   (typeLen == 1 || typeLen == 2 || typeLen == 4 || typeLen == 8);
+}
+
+
+/*
+ * IsVectorizableValueExpr returns true for CASE, COALESCE and NULLIF, whose
+ * operands CreateVectorizedValueExpr checks.
+ */
+bool
+IsVectorizableValueExpr(Node *node)
+{
+	return node != NULL &&
+		   (IsA(node, CaseExpr) || IsA(node, CoalesceExpr) || IsA(node, NullIfExpr));
+}
+
+
+/*
+ * CreateVectorizedValueOperand returns an operand of a vectorized CASE,
+ * COALESCE or NULLIF, which is a column or constant of the type of the
+ * expression or another such expression, or NULL for anything else. Other
+ * operands, like arithmetic, could fail for rows CASE doesn't need them for.
+ */
+static Node *
+CreateVectorizedValueOperand(Node *node, Oid valueType)
+{
+	if (node == NULL || exprType(node) != valueType)
+		return NULL;
+
+	if (IsA(node, Const))
+		return node;
+
+	if (IsA(node, Var))
+		return IsVectorizableTestArgument((Expr *) node) ? node : NULL;
+
+	return CreateVectorizedValueExpr(node);
+}
+
+
+/*
+ * CreateVectorizedValueExpr returns a copy of a CASE, COALESCE or NULLIF
+ * whose conditions use vectorized operators, or NULL if it can't be
+ * vectorized. The expression needs a type IsVectorizableValueType accepts,
+ * CASE needs its WHEN clauses to be vectorizable quals rather than values
+ * of CASE x, and NULLIF needs a type with binary equality.
+ */
+Node *
+CreateVectorizedValueExpr(Node *node)
+{
+	check_stack_depth();
+
+	if (!IsVectorizableValueExpr(node))
+		return NULL;
+
+	Oid valueType = exprType(node);
+
+	if (!IsVectorizableValueType(valueType))
+		return NULL;
+
+	switch (nodeTag(node))
+	{
+		case T_CaseExpr:
+		{
+			CaseExpr *caseExpr = (CaseExpr *) node;
+
+			if (caseExpr->arg != NULL)
+				return NULL;
+
+			CaseExpr *newCaseExpr = copyObject(caseExpr);
+
+			ListCell *lc;
+			foreach(lc, newCaseExpr->args)
+			{
+				CaseWhen *caseWhen = lfirst_node(CaseWhen, lc);
+
+				/* conditions that can't be vectorized are returned as they are */
+				List *conditionList = CreateVectorizedExprList(list_make1(caseWhen->expr));
+				if (linitial(conditionList) == (void *) caseWhen->expr)
+					return NULL;
+
+				caseWhen->expr = linitial(conditionList);
+				caseWhen->result = (Expr *)
+					CreateVectorizedValueOperand((Node *) caseWhen->result, valueType);
+				if (caseWhen->result == NULL)
+					return NULL;
+			}
+
+			if (newCaseExpr->defresult == NULL)
+				newCaseExpr->defresult = (Expr *)
+					makeNullConst(valueType, -1, caseExpr->casecollid);
+
+			newCaseExpr->defresult = (Expr *)
+				CreateVectorizedValueOperand((Node *) newCaseExpr->defresult, valueType);
+			if (newCaseExpr->defresult == NULL)
+				return NULL;
+
+			return (Node *) newCaseExpr;
+		}
+
+		case T_CoalesceExpr:
+		{
+			CoalesceExpr *newCoalesceExpr = copyObject((CoalesceExpr *) node);
+
+			ListCell *lc;
+			foreach(lc, newCoalesceExpr->args)
+			{
+				lfirst(lc) = CreateVectorizedValueOperand(lfirst(lc), valueType);
+				if (lfirst(lc) == NULL)
+					return NULL;
+			}
+
+			return (Node *) newCoalesceExpr;
+		}
+
+		case T_NullIfExpr:
+		{
+			NullIfExpr *newNullIfExpr = copyObject((NullIfExpr *) node);
+
+			/* the rows are compared by their binary values */
+			if (list_length(newNullIfExpr->args) != 2 ||
+				!IsBinaryEqualityType(valueType) ||
+				newNullIfExpr->opno !=
+				lookup_type_cache(valueType, TYPECACHE_EQ_OPR)->eq_opr ||
+				IsA(linitial(newNullIfExpr->args), Const))
+				return NULL;
+
+			ListCell *lc;
+			foreach(lc, newNullIfExpr->args)
+			{
+				lfirst(lc) = CreateVectorizedValueOperand(lfirst(lc), valueType);
+				if (lfirst(lc) == NULL)
+					return NULL;
+			}
+
+			return (Node *) newNullIfExpr;
+		}
+
+		default:
+			return NULL;
 	}
+}
 
-	return true;
 
+/*
+ * VectorizedFunctionCall is a vectorized function that vectorized quals and
+ * projections can call on a column, which is its argument at columnArgument
+ * while the others are constants. It returns a vector the vectorized
+ * operators can compare, or the aggregates above the scan group by.
+ */
+typedef struct VectorizedFunctionCall
+{
+	const char *name;
+	int columnArgument;
+} VectorizedFunctionCall;
+
+static const VectorizedFunctionCall VectorizedFunctionCalls[] = {
+	{ "vlower", 0 },
+	{ "vupper", 0 },
+	{ "vlength", 0 },
+	{ "vsubstring", 0 },
+	{ "vsubstr", 0 },
+	{ "vdate_trunc", 1 },
+	{ "vdate_part", 1 }
+};
+
+
+/*
+ * GetVectorizedFunctionCallOid sets vectorizedProcedureOid to the vectorized
+ * version of the function and returns the position of its column argument,
+ * or returns -1 if it isn't one of the functions vectorized quals can call.
+ * Other vectorized procedures, like arithmetic, take their arguments in
+ * another way.
+ */
+static int
+GetVectorizedFunctionCallOid(Oid procedureOid, Oid *vectorizedProcedureOid)
+{
+	if (!GetVectorizedProcedureOid(procedureOid, vectorizedProcedureOid))
+		return -1;
+
+	char *vectorizedProcedureName = get_func_name(*vectorizedProcedureOid);
+
+	for (int i = 0; i < lengthof(VectorizedFunctionCalls); i++)
+	{
+		if (vectorizedProcedureName != NULL &&
+			strcmp(vectorizedProcedureName, VectorizedFunctionCalls[i].name) == 0)
+			return VectorizedFunctionCalls[i].columnArgument;
+	}
+
+	return -1;
+}
+
+
+/*
+ * CreateVectorizedFuncExpr returns a copy of a function call that calls its
+ * vectorized version instead, or NULL if it can't be vectorized. The column
+ * argument needs to be a column, or another such function call of one, and
+ * the others constants.
+ */
+Node *
+CreateVectorizedFuncExpr(Node *node)
+{
+	check_stack_depth();
+
+	if (node == NULL || !IsA(node, FuncExpr))
+		return NULL;
+
+	FuncExpr *funcExpr = (FuncExpr *) node;
+	Oid vectorizedOid = InvalidOid;
+
+	if (funcExpr->funcretset || funcExpr->funcvariadic)
+		return NULL;
+
+	int columnArgument = GetVectorizedFunctionCallOid(funcExpr->funcid, &vectorizedOid);
+	if (columnArgument < 0 || columnArgument >= list_length(funcExpr->args))
+		return NULL;
+
+	FuncExpr *newFuncExpr = copyObject(funcExpr);
+	newFuncExpr->funcid = vectorizedOid;
+
+	ListCell *lc;
+	foreach(lc, newFuncExpr->args)
+	{
+		Node *arg = lfirst(lc);
+
+		if (lc != list_nth_cell(newFuncExpr->args, columnArgument))
+		{
+			if (!IsA(arg, Const))
+				return NULL;
+		}
+		else if (IsA(arg, FuncExpr))
+		{
+			lfirst(lc) = CreateVectorizedFuncExpr(arg);
+			if (lfirst(lc) == NULL)
+				return NULL;
+		}
+		else if (!IsVectorizableTestArgument((Expr *) arg))
+		{
+			return NULL;
+		}
+	}
+
+	return (Node *) newFuncExpr;
 }
 
+
 List *
 CreateVectorizedExprList(List *exprList)
 {
@@ -172,7 +668,6 @@ CreateVectorizedExprList(List *exprList)
 		{
 			case T_OpExpr:
 			case T_DistinctExpr:	/* struct-equivalent to OpExpr */
-			case T_NullIfExpr:		/* struct-equivalent to OpExpr */
 			{
 				OpExpr *opExprNode = (OpExpr *) node;
 
@@ -209,243 +704,2212 @@ CreateVectorizedExprList(List *exprList)
 
 				OpExpr *opExprNodeVector = copyObject(opExprNode);
 				opExprNodeVector->opfuncid = vectorizedOid;
+
+				ListCell *lcOpExprArgs;
+				foreach(lcOpExprArgs, opExprNodeVector->args)
+				{
+					if (IsVectorizableValueExpr(lfirst(lcOpExprArgs)))
+						lfirst(lcOpExprArgs) =
+							CreateVectorizedValueExpr(lfirst(lcOpExprArgs));
+					else if (IsA(lfirst(lcOpExprArgs), FuncExpr))
+						lfirst(lcOpExprArgs) =
+							CreateVectorizedFuncExpr(lfirst(lcOpExprArgs));
+				}
+
+				if (list_member_ptr(opExprNodeVector->args, NULL))
+				{
+					newQualList = lappend(newQualList, opExprNode);
+					break;
+				}
+
 				newQualList = lappend(newQualList, opExprNodeVector);
 				
 				break;
 			}
 
-			case T_BoolExpr:
+			case T_CaseExpr:
+			case T_CoalesceExpr:
+			case T_NullIfExpr:
 			{
-				BoolExpr *boolExpr = castNode(BoolExpr, node);
-
-				List *newBoolExprArgList = NIL;
+				/* boolean ones, like COALESCE(flag, false) */
+				Node *valueExpr = NULL;
 
-				newBoolExprArgList = 
-					CreateVectorizedExprList(boolExpr->args);
-
-				if (list_length(list_intersection(newBoolExprArgList, boolExpr->args)) == 0)
-				{
-					Expr *booleanClause = NULL;
+				if (exprType(node) == BOOLOID)
+					valueExpr = CreateVectorizedValueExpr(node);
 
-					if (boolExpr->boolop == AND_EXPR)
-					{
-						booleanClause = make_andclause(newBoolExprArgList);
-					}
-					else if (boolExpr->boolop == OR_EXPR)
-					{
-						booleanClause = make_orclause(newBoolExprArgList);
-					}
+				newQualList = lappend(newQualList, valueExpr != NULL ? valueExpr : node);
+				break;
+			}
 
-					newQualList = lappend(newQualList, booleanClause);
-				}
+			case T_ScalarArrayOpExpr:
+			{
+				if (IsVectorizableInList((ScalarArrayOpExpr *) node))
+					newQualList = lappend(newQualList, copyObject(node));
 				else
-				{
-					newQualList = lappend(newQualList, boolExpr);
-				}
-
+					newQualList = lappend(newQualList, node);
 				break;
 			}
-			default:
+
+			case T_NullTest:
 			{
-				newQualList = lappend(newQualList, node);
+				NullTest *nullTest = (NullTest *) node;
+
+				if (IsVectorizableTestArgument(nullTest->arg) && !nullTest->argisrow)
+					newQualList = lappend(newQualList, copyObject(node));
+				else
+					newQualList = lappend(newQualList, node);
 				break;
 			}
-		}
+
+			case T_BooleanTest:
+			{
+				BooleanTest *booleanTest = (BooleanTest *) node;
+
+				if (IsVectorizableTestArgument(booleanTest->arg))
+					newQualList = lappend(newQualList, copyObject(node));
+				else
+					newQualList = lappend(newQualList, node);
+				break;
+			}
+
+			case T_Var:
+			{
+				/* a boolean column on its own */
+				if (((Var *) node)->vartype == BOOLOID &&
+					IsVectorizableTestArgument((Expr *) node))
+					newQualList = lappend(newQualList, copyObject(node));
+				else
+					newQualList = lappend(newQualList, node);
+				break;
+			}
+
+			case T_BoolExpr:
+			{
+				BoolExpr *boolExpr = castNode(BoolExpr, node);
+
+				List *newBoolExprArgList = NIL;
+
+				/*
+				 * NOT needs to know which rows of its argument are NULL, which
+				 * only single quals keep track of.
+				 */
+				if (boolExpr->boolop == NOT_EXPR)
+				{
+					Node *notArg = linitial(boolExpr->args);
+
+					newBoolExprArgList = CreateVectorizedExprList(boolExpr->args);
+
+					if (linitial(newBoolExprArgList) != notArg && !IsA(notArg, BoolExpr))
+						newQualList = lappend(newQualList,
+											  make_notclause(linitial(newBoolExprArgList)));
+					else
+						newQualList = lappend(newQualList, boolExpr);
+
+					break;
+				}
+
+				newBoolExprArgList = 
+					CreateVectorizedExprList(boolExpr->args);
+
+				if (list_length(list_intersection_ptr(newBoolExprArgList, boolExpr->args)) == 0)
+				{
+					Expr *booleanClause = NULL;
+
+					if (boolExpr->boolop == AND_EXPR)
+					{
+						booleanClause = make_andclause(newBoolExprArgList);
+					}
+					else if (boolExpr->boolop == OR_EXPR)
+					{
+						booleanClause = make_orclause(newBoolExprArgList);
+					}
+
+					newQualList = lappend(newQualList, booleanClause);
+				}
+				else
+				{
+					newQualList = lappend(newQualList, boolExpr);
+				}
+
+				break;
+			}
+			default:
+			{
+				newQualList = lappend(newQualList, node);
+				break;
+			}
+		}
+	}
+
+	return newQualList;
+}
+
+
+/*
+ * VectorizedQualFallbackReason returns why CreateVectorizedExprList leaves
+ * the given qual to be evaluated row by row, or NULL if it vectorizes it.
+ * EXPLAIN (VERBOSE) shows these reasons, so they are meant for users.
+ */
+const char *
+VectorizedQualFallbackReason(Node *node)
+{
+	check_stack_depth();
+
+	List *qualList = list_make1(node);
+	if (linitial(CreateVectorizedExprList(qualList)) != node)
+		return NULL;
+
+	switch (nodeTag(node))
+	{
+		case T_OpExpr:
+		case T_DistinctExpr:
+		{
+			OpExpr *opExprNode = (OpExpr *) node;
+
+			if (list_length(opExprNode->args) != 2 ||
+				CheckOpExprArgumentRules(opExprNode->args))
+				return "operator does not compare a column with a constant";
+
+			Oid vectorizedOid = InvalidOid;
+			if (!GetVectorizedProcedureOid(get_opcode(opExprNode->opno), &vectorizedOid))
+				return psprintf("no vectorized function for operator %s of type %s",
+								get_opname(opExprNode->opno),
+								format_type_be(exprType(linitial(opExprNode->args))));
+
+			ListCell *lc;
+			foreach(lc, opExprNode->args)
+			{
+				if (IsA(lfirst(lc), FuncExpr))
+					return psprintf("function %s can't be vectorized with these arguments",
+									get_func_name(((FuncExpr *) lfirst(lc))->funcid));
+			}
+
+			return "CASE, COALESCE or NULLIF operand is not supported";
+		}
+
+		case T_CaseExpr:
+		case T_CoalesceExpr:
+		case T_NullIfExpr:
+			return "CASE, COALESCE or NULLIF is not supported";
+
+		case T_ScalarArrayOpExpr:
+			return "IN list does not compare a column of a binary equality type "
+				   "with constants";
+
+		case T_NullTest:
+		case T_BooleanTest:
+			return "test of an expression instead of a column";
+
+		case T_Var:
+			return "not a boolean column";
+
+		case T_BoolExpr:
+		{
+			BoolExpr *boolExpr = (BoolExpr *) node;
+
+			if (boolExpr->boolop == NOT_EXPR && IsA(linitial(boolExpr->args), BoolExpr))
+				return "NOT of AND or OR is not supported";
+
+			ListCell *lc;
+			foreach(lc, boolExpr->args)
+			{
+				const char *reason = VectorizedQualFallbackReason(lfirst(lc));
+				if (reason != NULL)
+					return reason;
+			}
+
+			return "boolean expression is not supported";
+		}
+
+		case T_FuncExpr:
+			return "function calls are only supported as operands of operators";
+
+		case T_SubPlan:
+		case T_AlternativeSubPlan:
+			return "subqueries are not supported";
+
+		default:
+			return "expression type is not supported";
+	}
+}
+
+
+/*
+ * BuildColumnQual allocates a qual of the given type that computes its
+ * result from a column of the vector slot.
+ */
+static VectorQual *
+BuildColumnQual(VectorTupleTableSlot *vectorSlot, VectorQualTypeEnum vectorQualType,
+				Var *variable, VectorColumn **column)
+{
+	VectorQual *newVectorQual = palloc0(sizeof(VectorQual));
+	newVectorQual->vectorQualType = vectorQualType;
+	newVectorQual->result = BuildVectorColumn(vectorSlot->capacity, 1, true, NULL);
+
+	*column = (VectorColumn *) vectorSlot->tts.tts_values[variable->varattno - 1];
+
+	return newVectorQual;
+}
+
+
+static VectorQual *
+BuildBooleanTestQual(VectorTupleTableSlot *vectorSlot, Var *variable,
+					 BoolTestType booleanTestType)
+{
+	VectorColumn *column = NULL;
+	VectorQual *newVectorQual = BuildColumnQual(vectorSlot, VECTOR_QUAL_BOOLEAN_TEST,
+												variable, &column);
+	newVectorQual->u.booleanTest.column = column;
+	newVectorQual->u.booleanTest.booleanTestType = booleanTestType;
+
+	return newVectorQual;
+}
+
+
+static int
+CompareInt64(const void *left, const void *right)
+{
+	int64 leftValue = *(const int64 *) left;
+	int64 rightValue = *(const int64 *) right;
+
+	return (leftValue > rightValue) - (leftValue < rightValue);
+}
+
+
+/*
+ * InListValue converts an array element to the value a vector of the same
+ * type stores for it, widened to int64.
+ */
+static int64
+InListValue(Datum datum, int16 typeLen)
+{
+	switch (typeLen)
+	{
+		case sizeof(int8):
+			return (int8) DatumGetChar(datum);
+		case sizeof(int16):
+			return DatumGetInt16(datum);
+		case sizeof(int32):
+			return DatumGetInt32(datum);
+		default:
+			return DatumGetInt64(datum);
+	}
+}
+
+
+static VectorQual *
+BuildInListQual(VectorTupleTableSlot *vectorSlot, ScalarArrayOpExpr *arrayOpExpr)
+{
+	Var *variable = (Var *) linitial(arrayOpExpr->args);
+	Const *arrayConst = (Const *) lsecond(arrayOpExpr->args);
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+
+	int16 typeLen;
+	bool typeByVal;
+	char typeAlign;
+	get_typlenbyvalalign(variable->vartype, &typeLen, &typeByVal, &typeAlign);
+
+	Datum *elements = NULL;
+	bool *elementNulls = NULL;
+	int elementCount = 0;
+	deconstruct_array(array, variable->vartype, typeLen, typeByVal, typeAlign,
+					  &elements, &elementNulls, &elementCount);
+
+	VectorColumn *column = NULL;
+	VectorQual *newVectorQual = BuildColumnQual(vectorSlot, VECTOR_QUAL_IN_LIST,
+												variable, &column);
+	newVectorQual->u.inList.column = column;
+	newVectorQual->u.inList.useOr = arrayOpExpr->useOr;
+	newVectorQual->u.inList.values = palloc(sizeof(int64) * Max(elementCount, 1));
+
+	int valueCount = 0;
+	for (int i = 0; i < elementCount; i++)
+	{
+		if (elementNulls[i])
+		{
+			newVectorQual->u.inList.hasNull = true;
+			continue;
+		}
+
+		newVectorQual->u.inList.values[valueCount++] = InListValue(elements[i], typeLen);
+	}
+
+	qsort(newVectorQual->u.inList.values, valueCount, sizeof(int64), CompareInt64);
+
+	/* duplicates would only slow down the search */
+	int distinctCount = 0;
+	for (int i = 0; i < valueCount; i++)
+	{
+		if (distinctCount == 0 ||
+			newVectorQual->u.inList.values[distinctCount - 1] !=
+			newVectorQual->u.inList.values[i])
+		{
+			newVectorQual->u.inList.values[distinctCount++] =
+				newVectorQual->u.inList.values[i];
+		}
+	}
+
+	newVectorQual->u.inList.valueCount = distinctCount;
+
+	return newVectorQual;
+}
+
+
+/*
+ * Kernels of the steps of fused expressions, which use the steps of the
+ * vectorized arithmetic operators, so that they compute the same values and
+ * report the same errors.
+ */
+#define FUSED_VECTOR_KERNEL(NAME, TYPE, STEP)								\
+static COLUMNAR_VECTOR_KERNEL bool											\
+NAME(const void *left, const void *right, const bool *isnull,				\
+	 void *result, int count)												\
+{																			\
+	const TYPE *leftValue = (const TYPE *) left;							\
+	const TYPE *rightValue = (const TYPE *) right;							\
+	const uint8 *nullBytes = (const uint8 *) isnull;						\
+	TYPE *resultValue = (TYPE *) result;									\
+	uint8 overflow = 0;														\
+																			\
+	for (int i = 0; i < count; i++)											\
+	{																		\
+		uint8 rowOverflow = STEP(leftValue[i], rightValue[i], isnull[i],	\
+								 &resultValue[i]);							\
+		overflow |= rowOverflow & (nullBytes[i] ^ 1);						\
+	}																		\
+																			\
+	return overflow != 0;													\
+}
+
+FUSED_VECTOR_KERNEL(FusedInt8Add, int64, _int64_add)
+FUSED_VECTOR_KERNEL(FusedInt8Sub, int64, _int64_sub)
+FUSED_VECTOR_KERNEL(FusedInt8Mul, int64, _int64_mul)
+FUSED_VECTOR_KERNEL(FusedInt8Div, int64, _int64_div)
+FUSED_VECTOR_KERNEL(FusedFloat8Add, float8, _float8_add)
+FUSED_VECTOR_KERNEL(FusedFloat8Sub, float8, _float8_sub)
+FUSED_VECTOR_KERNEL(FusedFloat8Mul, float8, _float8_mul)
+FUSED_VECTOR_KERNEL(FusedFloat8Div, float8, _float8_div)
+
+
+/* vectorized operators that fused expressions compute, by their type */
+static const struct
+{
+	PGFunction function;
+	Oid typeOid;
+	FusedVectorKernel kernel;
+} FusedVectorOperators[] =
+{
+	{ vint8pl, INT8OID, FusedInt8Add },
+	{ vint8mi, INT8OID, FusedInt8Sub },
+	{ vint8mul, INT8OID, FusedInt8Mul },
+	{ vint8div, INT8OID, FusedInt8Div },
+	{ vfloat8pl, FLOAT8OID, FusedFloat8Add },
+	{ vfloat8mi, FLOAT8OID, FusedFloat8Sub },
+	{ vfloat8mul, FLOAT8OID, FusedFloat8Mul },
+	{ vfloat8div, FLOAT8OID, FusedFloat8Div },
+};
+
+
+/*
+ * FusedVectorBuild collects the steps, columns and constants of a fused
+ * expression while its tree is walked.
+ */
+typedef struct FusedVectorBuild
+{
+	VectorTupleTableSlot *vectorSlot;
+	Oid typeOid;
+	List *steps;
+	List *columns;
+	List *constants;
+	List *constantIndexes;
+	int scratchCount;
+} FusedVectorBuild;
+
+
+/*
+ * FusedVectorKernelOf returns the kernel of the vectorized procedure of a
+ * function call, or NULL if it isn't an operator fused expressions compute.
+ */
+static FusedVectorKernel
+FusedVectorKernelOf(FmgrInfo *fmgrInfo, Oid *typeOid)
+{
+	for (int i = 0; i < lengthof(FusedVectorOperators); i++)
+	{
+		if (FusedVectorOperators[i].function == fmgrInfo->fn_addr)
+		{
+			*typeOid = FusedVectorOperators[i].typeOid;
+			return FusedVectorOperators[i].kernel;
+		}
+	}
+
+	return NULL;
+}
+
+
+static bool BuildFusedVectorStep(FusedVectorBuild *build, FusedVectorKernel kernel,
+								 List *args, FusedVectorOperand *operand);
+
+
+/*
+ * BuildFusedVectorOperand sets operand to the column, constant or step an
+ * argument of a fused operator is, and returns false if the argument can't
+ * be part of a fused expression.
+ */
+static bool
+BuildFusedVectorOperand(FusedVectorBuild *build, Expr *arg,
+						FusedVectorOperand *operand)
+{
+	if (IsA(arg, Var))
+	{
+		Var *variable = (Var *) arg;
+
+		operand->column = (VectorColumn *)
+			build->vectorSlot->tts.tts_values[variable->varattno - 1];
+		build->columns = list_append_unique_ptr(build->columns, operand->column);
+		return true;
+	}
+	else if (IsA(arg, Const))
+	{
+		Const *con = (Const *) arg;
+
+		/* strict calls with a NULL constant have a result that is all NULL */
+		if (con->constisnull || build->scratchCount >= FUSED_VECTOR_MAX_OPERANDS)
+			return false;
+
+		operand->column = NULL;
+		operand->scratchIndex = build->scratchCount++;
+		build->constants = lappend(build->constants, con);
+		build->constantIndexes = lappend_int(build->constantIndexes,
+											 operand->scratchIndex);
+		return true;
+	}
+	else if (IsA(arg, FuncExpr))
+	{
+		FuncExpr *funcExpr = (FuncExpr *) arg;
+		FmgrInfo fmgrInfo;
+		Oid typeOid = InvalidOid;
+
+		fmgr_info(funcExpr->funcid, &fmgrInfo);
+
+		FusedVectorKernel kernel = FusedVectorKernelOf(&fmgrInfo, &typeOid);
+		if (kernel == NULL || typeOid != build->typeOid)
+			return false;
+
+		return BuildFusedVectorStep(build, kernel, funcExpr->args, operand);
+	}
+
+	return false;
+}
+
+
+/*
+ * BuildFusedVectorStep adds the step of a fused operator after the steps of
+ * its arguments, and sets operand to its result.
+ */
+static bool
+BuildFusedVectorStep(FusedVectorBuild *build, FusedVectorKernel kernel,
+					 List *args, FusedVectorOperand *operand)
+{
+	if (list_length(args) != 2)
+		return false;
+
+	FusedVectorStep *step = palloc0(sizeof(FusedVectorStep));
+	step->kernel = kernel;
+
+	if (!BuildFusedVectorOperand(build, linitial(args), &step->left) ||
+		!BuildFusedVectorOperand(build, lsecond(args), &step->right) ||
+		build->scratchCount >= FUSED_VECTOR_MAX_OPERANDS)
+	{
+		return false;
+	}
+
+	step->scratchIndex = build->scratchCount++;
+	build->steps = lappend(build->steps, step);
+
+	operand->column = NULL;
+	operand->scratchIndex = step->scratchIndex;
+	return true;
+}
+
+
+/*
+ * BuildFusedVectorExpr returns the fused expression of a call of a bigint
+ * or float8 arithmetic operator whose arguments are columns, constants and
+ * calls of operators of the same type, or NULL if the call isn't such a tree
+ * of at least two operators, which the vectorized operators compute as well.
+ */
+static FusedVectorExpr *
+BuildFusedVectorExpr(VectorTupleTableSlot *vectorSlot, FmgrInfo *fmgrInfo, List *args)
+{
+	FusedVectorBuild build = { 0 };
+	FusedVectorOperand operand;
+
+	build.vectorSlot = vectorSlot;
+
+	FusedVectorKernel kernel = FusedVectorKernelOf(fmgrInfo, &build.typeOid);
+	if (kernel == NULL ||
+		!BuildFusedVectorStep(&build, kernel, args, &operand) ||
+		list_length(build.steps) < 2 || build.columns == NIL)
+	{
+		return NULL;
+	}
+
+	FusedVectorExpr *fusedExpr = palloc0(sizeof(FusedVectorExpr));
+	fusedExpr->typeName = build.typeOid == INT8OID ? "bigint" : "float8";
+
+	fusedExpr->stepCount = list_length(build.steps);
+	fusedExpr->steps = palloc(sizeof(FusedVectorStep) * fusedExpr->stepCount);
+	for (int i = 0; i < fusedExpr->stepCount; i++)
+		fusedExpr->steps[i] = *(FusedVectorStep *) list_nth(build.steps, i);
+
+	fusedExpr->columnCount = list_length(build.columns);
+	fusedExpr->columns = palloc(sizeof(VectorColumn *) * fusedExpr->columnCount);
+	for (int i = 0; i < fusedExpr->columnCount; i++)
+		fusedExpr->columns[i] = list_nth(build.columns, i);
+
+	/* bigint and float8 values are both 8 bytes long */
+	fusedExpr->scratch = palloc(build.scratchCount * FUSED_VECTOR_TILE_ROWS *
+								sizeof(int64));
+
+	for (int i = 0; i < list_length(build.constants); i++)
+	{
+		Const *con = list_nth(build.constants, i);
+		int scratchIndex = list_nth_int(build.constantIndexes, i);
+		char *tile = fusedExpr->scratch +
+			scratchIndex * FUSED_VECTOR_TILE_ROWS * sizeof(int64);
+
+		for (int row = 0; row < FUSED_VECTOR_TILE_ROWS; row++)
+		{
+			if (build.typeOid == INT8OID)
+				((int64 *) tile)[row] = DatumGetInt64(con->constvalue);
+			else
+				((float8 *) tile)[row] = DatumGetFloat8(con->constvalue);
+		}
+	}
+
+	list_free_deep(build.steps);
+	list_free(build.columns);
+	list_free(build.constants);
+	list_free(build.constantIndexes);
+
+	return fusedExpr;
+}
+
+
+static VectorQual * BuildValueExprQual(VectorTupleTableSlot *vectorSlot, Node *node,
+									   bool isQual);
+
+
+/*
+ * BuildVectorValue sets up an operand of a vectorized CASE, COALESCE or
+ * NULLIF, which CreateVectorizedValueOperand accepted.
+ */
+static void
+BuildVectorValue(VectorTupleTableSlot *vectorSlot, Node *node, VectorValue *value)
+{
+	if (IsA(node, Const))
+	{
+		value->constValue = ((Const *) node)->constvalue;
+		value->constIsNull = ((Const *) node)->constisnull;
+	}
+	else if (IsA(node, Var))
+	{
+		value->column =
+			(VectorColumn *) vectorSlot->tts.tts_values[((Var *) node)->varattno - 1];
+	}
+	else
+	{
+		value->valueQual = BuildValueExprQual(vectorSlot, node, false);
+		value->column = value->valueQual->result;
+	}
+}
+
+
+/*
+ * BuildValueExprQual constructs a vectorized CASE, COALESCE or NULLIF, which
+ * computes its values into its result. isQual is set for boolean ones that
+ * are quals themselves rather than operands.
+ */
+static VectorQual *
+BuildValueExprQual(VectorTupleTableSlot *vectorSlot, Node *node, bool isQual)
+{
+	VectorQual *newVectorQual = palloc0(sizeof(VectorQual));
+	newVectorQual->vectorQualType = VECTOR_QUAL_VALUE_EXPR;
+	newVectorQual->result = BuildVectorColumn(vectorSlot->capacity,
+											  get_typlen(exprType(node)), true, NULL);
+	newVectorQual->u.valueExpr.valueExprType = nodeTag(node);
+	newVectorQual->u.valueExpr.slot = (TupleTableSlot *) vectorSlot;
+	newVectorQual->u.valueExpr.isQual = isQual;
+
+	List *operandList = NIL;
+
+	switch (nodeTag(node))
+	{
+		case T_CaseExpr:
+		{
+			CaseExpr *caseExpr = (CaseExpr *) node;
+
+			ListCell *lc;
+			foreach(lc, caseExpr->args)
+			{
+				CaseWhen *caseWhen = lfirst_node(CaseWhen, lc);
+
+				newVectorQual->u.valueExpr.conditionList =
+					lappend(newVectorQual->u.valueExpr.conditionList,
+							ConstructVectorizedQualList((TupleTableSlot *) vectorSlot,
+														list_make1(caseWhen->expr)));
+				operandList = lappend(operandList, caseWhen->result);
+			}
+
+			operandList = lappend(operandList, caseExpr->defresult);
+			break;
+		}
+
+		case T_CoalesceExpr:
+			operandList = ((CoalesceExpr *) node)->args;
+			break;
+
+		case T_NullIfExpr:
+			operandList = ((NullIfExpr *) node)->args;
+			break;
+
+		default:
+			elog(ERROR, "unrecognized vectorized value expression type: %d",
+				 (int) nodeTag(node));
+	}
+
+	newVectorQual->u.valueExpr.valueCount = list_length(operandList);
+	newVectorQual->u.valueExpr.values =
+		palloc0(sizeof(VectorValue) * list_length(operandList));
+
+	int operandIndex = 0;
+	ListCell *lc;
+	foreach(lc, operandList)
+	{
+		BuildVectorValue(vectorSlot, lfirst(lc),
+						 newVectorQual->u.valueExpr.values + operandIndex);
+		operandIndex++;
+	}
+
+	return newVectorQual;
+}
+
+
+/*
+ * BuildFunctionCallQual constructs the call of a vectorized procedure, for
+ * an operator or a function, with the given arguments. Constants are passed
+ * as they are, and the other arguments as vectors, which CASE, COALESCE,
+ * NULLIF and function call arguments compute before the call.
+ */
+static VectorQual *
+BuildFunctionCallQual(VectorTupleTableSlot *vectorSlot, Node *node, Oid functionOid,
+					  List *args, Oid inputCollationId)
+{
+	int argno = 0;
+	int nargs = list_length(args);
+
+	VectorQual *newVectorQual = palloc0(sizeof(VectorQual));
+	newVectorQual->vectorQualType = VECTOR_QUAL_EXPR;
+
+	newVectorQual->u.expr.fmgrInfo = palloc0(sizeof(FmgrInfo));
+	newVectorQual->u.expr.fcInfo  = palloc0(SizeForFunctionCallInfo(nargs));
+	newVectorQual->u.expr.vectorFnArguments = 
+		(VectorFnArgument *) palloc0(sizeof(VectorFnArgument) * nargs);
+
+
+	fmgr_info(functionOid, newVectorQual->u.expr.fmgrInfo);
+	fmgr_info_set_expr(node, newVectorQual->u.expr.fmgrInfo);
+
+	/* Initialize function call parameter structure too */
+	InitFunctionCallInfoData(*(newVectorQual->u.expr.fcInfo), 
+							 newVectorQual->u.expr.fmgrInfo,
+							 nargs, inputCollationId, NULL, NULL);
+
+	/* nested arithmetic is computed without calling its operators */
+	if (columnar_enable_fused_vector_expressions)
+	{
+		newVectorQual->u.expr.fusedExpr =
+			BuildFusedVectorExpr(vectorSlot, newVectorQual->u.expr.fmgrInfo, args);
+
+		if (newVectorQual->u.expr.fusedExpr != NULL)
+			return newVectorQual;
+	}
+
+	ListCell *lcArgs;
+	foreach(lcArgs, args)
+	{
+		Expr *arg = (Expr *) lfirst(lcArgs);
+
+		VectorFnArgument *vectorFnArgument = 
+			newVectorQual->u.expr.vectorFnArguments + argno;
+
+		newVectorQual->u.expr.fcInfo->args[argno].value = (Datum) vectorFnArgument;
+		newVectorQual->u.expr.fcInfo->args[argno].isnull = false;
+
+		if (IsA(arg, Const))
+		{
+			Const *con = (Const *) arg;
+
+			vectorFnArgument->type = VECTOR_FN_ARG_CONSTANT;
+			vectorFnArgument->arg = con->constvalue;
+
+			newVectorQual->u.expr.fcInfo->args[argno].isnull = con->constisnull;
+
+			/* a param may be NULL, which the vectorized procedures don't check */
+			if (con->constisnull && newVectorQual->u.expr.fmgrInfo->fn_strict)
+			{
+				int16 resultTypeLen = get_typlen(exprType(node));
+
+				newVectorQual->u.expr.nullResult = true;
+				newVectorQual->u.expr.resultTypeLen =
+					resultTypeLen > 0 ? resultTypeLen : sizeof(Datum);
+			}
+		}
+		else if (IsA(arg, Var))
+		{
+			Var *variable = (Var *) arg;
+			int columnIdx = variable->varattno - 1;
+
+			vectorFnArgument->type = VECTOR_FN_ARG_VAR;
+			vectorFnArgument->arg = vectorSlot->tts.tts_values[columnIdx];
+		}
+		else if (IsA(arg, FuncExpr))
+		{
+			/* the vector the call returns is passed on each evaluation */
+			FuncExpr *funcExpr = (FuncExpr *) arg;
+			VectorQual *argumentQual =
+				BuildFunctionCallQual(vectorSlot, (Node *) arg, funcExpr->funcid,
+									  funcExpr->args, funcExpr->inputcollid);
+			argumentQual->u.expr.outputArgument = vectorFnArgument;
+
+			newVectorQual->u.expr.argumentQualList =
+				lappend(newVectorQual->u.expr.argumentQualList, argumentQual);
+
+			vectorFnArgument->type = VECTOR_FN_ARG_VAR;
+		}
+		else
+		{
+			/* CASE, COALESCE or NULLIF, computed into a vector */
+			VectorQual *argumentQual =
+				BuildValueExprQual(vectorSlot, (Node *) arg, false);
+
+			newVectorQual->u.expr.argumentQualList =
+				lappend(newVectorQual->u.expr.argumentQualList, argumentQual);
+
+			vectorFnArgument->type = VECTOR_FN_ARG_VAR;
+			vectorFnArgument->arg = PointerGetDatum(argumentQual->result);
+		}
+		
+		argno++;
+	}
+
+	return newVectorQual;
+}
+
+
+List *
+ConstructVectorizedQualList(TupleTableSlot *slot, List *vectorizedQual)
+{
+	VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) slot;
+
+	List *vectorQualList = NIL;
+	ListCell *lc;
+
+	foreach(lc, vectorizedQual)
+	{
+		Node *node = lfirst(lc);
+
+		switch(nodeTag(node))
+		{
+			case T_OpExpr:
+			case T_DistinctExpr:	/* struct-equivalent to OpExpr */
+			{
+				OpExpr *opExprNode = (OpExpr *) node;
+
+				vectorQualList = lappend(vectorQualList,
+										 BuildFunctionCallQual(vectorSlot, node,
+															   opExprNode->opfuncid,
+															   opExprNode->args,
+															   opExprNode->inputcollid));
+				break;
+			}
+
+			case T_CaseExpr:
+			case T_CoalesceExpr:
+			case T_NullIfExpr:
+			{
+				vectorQualList = lappend(vectorQualList,
+										 BuildValueExprQual(vectorSlot, node, true));
+				break;
+			}
+
+			case T_ScalarArrayOpExpr:
+			{
+				vectorQualList = lappend(vectorQualList,
+										 BuildInListQual(vectorSlot,
+														 (ScalarArrayOpExpr *) node));
+				break;
+			}
+
+			case T_NullTest:
+			{
+				NullTest *nullTest = (NullTest *) node;
+
+				VectorColumn *column = NULL;
+				VectorQual *newVectorQual = BuildColumnQual(vectorSlot,
+															VECTOR_QUAL_NULL_TEST,
+															(Var *) nullTest->arg,
+															&column);
+				newVectorQual->u.nullTest.column = column;
+				newVectorQual->u.nullTest.nullTestType = nullTest->nulltesttype;
+
+				vectorQualList = lappend(vectorQualList, newVectorQual);
+				break;
+			}
+
+			case T_BooleanTest:
+			{
+				BooleanTest *booleanTest = (BooleanTest *) node;
+
+				vectorQualList = lappend(vectorQualList,
+										 BuildBooleanTestQual(vectorSlot,
+															  (Var *) booleanTest->arg,
+															  booleanTest->booltesttype));
+				break;
+			}
+
+			case T_Var:
+			{
+				vectorQualList = lappend(vectorQualList,
+										 BuildBooleanTestQual(vectorSlot, (Var *) node,
+															  IS_TRUE));
+				break;
+			}
+
+			case T_BoolExpr:
+			{
+				BoolExpr *boolExpr = castNode(BoolExpr, node);
+
+				/* NOT of a boolean column is the same as IS FALSE */
+				if (boolExpr->boolop == NOT_EXPR && IsA(linitial(boolExpr->args), Var))
+				{
+					vectorQualList = lappend(vectorQualList,
+											 BuildBooleanTestQual(vectorSlot,
+																  linitial(boolExpr->args),
+																  IS_FALSE));
+					break;
+				}
+
+				VectorQual *newVectorQual = palloc0(sizeof(VectorQual));
+				newVectorQual->vectorQualType = VECTOR_QUAL_BOOL_EXPR;
+
+				if (boolExpr->boolop == NOT_EXPR)
+				{
+					newVectorQual->result =
+						BuildVectorColumn(vectorSlot->capacity, 1, true, NULL);
+				}
+				else
+				{
+					newVectorQual->u.boolExpr.undecidedRows =
+						palloc(sizeof(uint32) * vectorSlot->capacity);
+				}
+				
+				List *newQualExprArgList = 
+					ConstructVectorizedQualList(slot, boolExpr->args);
+
+				newVectorQual->u.boolExpr.boolExprType = boolExpr->boolop;
+
+				ListCell *lcExprArgList;
+				foreach(lcExprArgList, newQualExprArgList)
+				{
+					newVectorQual->u.boolExpr.vectorQualExprList = 
+						lappend(newVectorQual->u.boolExpr.vectorQualExprList, 
+								(VectorQual*)lfirst(lcExprArgList));
+				}
+
+				vectorQualList = lappend(vectorQualList, newVectorQual);
+
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+
+	return vectorQualList;
+}
+
+/*
+ * vectorizedOr / vectorizedAnd
+ *
+ * Qual results are bools, which are 0 or 1, so they are combined eight at a
+ * time as 64-bit words.
+ */
+
+static void
+vectorizedAnd(bool *left, bool *right, int dimension)
+{
+	int n = 0;
+
+	for (; n + (int) sizeof(uint64) <= dimension; n += sizeof(uint64))
+	{
+		uint64 leftWord;
+		uint64 rightWord;
+
+		memcpy(&leftWord, left + n, sizeof(uint64));
+		memcpy(&rightWord, right + n, sizeof(uint64));
+		leftWord &= rightWord;
+		memcpy(left + n, &leftWord, sizeof(uint64));
+	}
+
+	for (; n < dimension; n++)
+	{
+		left[n] &= right[n];
+	}
+}
+
+static void
+vectorizedOr(bool *left, bool *right, int dimension)
+{
+	int n = 0;
+
+	for (; n + (int) sizeof(uint64) <= dimension; n += sizeof(uint64))
+	{
+		uint64 leftWord;
+		uint64 rightWord;
+
+		memcpy(&leftWord, left + n, sizeof(uint64));
+		memcpy(&rightWord, right + n, sizeof(uint64));
+		leftWord |= rightWord;
+		memcpy(left + n, &leftWord, sizeof(uint64));
+	}
+
+	for (; n < dimension; n++)
+	{
+		left[n] |= right[n];
+	}
+}
+
+/*
+ * The kernels of CASE, COALESCE and NULLIF combine the values of their
+ * operands with masks rather than branches on each row, so that the compiler
+ * vectorizes them. Values are moved as integers of their width, which works
+ * for all types IsVectorizableValueType accepts.
+ *
+ * SelectValues<type> sets the rows of mask to the vector or constant value,
+ * CoalesceValues<type> sets the NULL rows to the vector, and
+ * NullIfValues<type> sets the rows equal to the vector or constant to NULL.
+ */
+#define _BUILD_VALUE_KERNELS(TYPE)											\
+static void																	\
+SelectValues##TYPE(TYPE *result, bool *resultNull, const bool *mask,		\
+				   const TYPE *value, const bool *valueNull,				\
+				   TYPE constValue, bool constIsNull, uint32 dimension)		\
+{																			\
+	if (value != NULL)														\
+	{																		\
+		for (uint32 n = 0; n < dimension; n++)								\
+		{																	\
+			result[n] = mask[n] ? value[n] : result[n];						\
+			resultNull[n] = mask[n] ? valueNull[n] : resultNull[n];			\
+		}																	\
+	}																		\
+	else																	\
+	{																		\
+		for (uint32 n = 0; n < dimension; n++)								\
+		{																	\
+			result[n] = mask[n] ? constValue : result[n];					\
+			resultNull[n] = mask[n] ? constIsNull : resultNull[n];			\
+		}																	\
+	}																		\
+}																			\
+																			\
+static void																	\
+FillValues##TYPE(TYPE *result, TYPE constValue, uint32 dimension)			\
+{																			\
+	for (uint32 n = 0; n < dimension; n++)									\
+		result[n] = constValue;												\
+}																			\
+																			\
+static void																	\
+CoalesceValues##TYPE(TYPE *result, bool *resultNull, const TYPE *value,	\
+					 const bool *valueNull, uint32 dimension)				\
+{																			\
+	for (uint32 n = 0; n < dimension; n++)									\
+	{																		\
+		result[n] = valueNull[n] ? result[n] : value[n];					\
+		resultNull[n] &= valueNull[n];										\
+	}																		\
+}																			\
+																			\
+static void																	\
+NullIfValues##TYPE(const TYPE *result, bool *resultNull, const TYPE *value,	\
+				   const bool *valueNull, TYPE constValue, uint32 dimension)	\
+{																			\
+	if (value != NULL)														\
+	{																		\
+		for (uint32 n = 0; n < dimension; n++)								\
+			resultNull[n] |= !valueNull[n] & (result[n] == value[n]);		\
+	}																		\
+	else																	\
+	{																		\
+		for (uint32 n = 0; n < dimension; n++)								\
+			resultNull[n] |= (result[n] == constValue);						\
+	}																		\
+}
+
+_BUILD_VALUE_KERNELS(int8)
+_BUILD_VALUE_KERNELS(int16)
+_BUILD_VALUE_KERNELS(int32)
+_BUILD_VALUE_KERNELS(int64)
+
+/* calls CALL(TYPE) with the integer type of the width of the values */
+#define _VALUE_KERNEL_DISPATCH(typeLen, CALL)								\
+	switch (typeLen)														\
+	{																		\
+		case sizeof(int8):													\
+			CALL(int8);														\
+			break;															\
+		case sizeof(int16):													\
+			CALL(int16);													\
+			break;															\
+		case sizeof(int32):													\
+			CALL(int32);													\
+			break;															\
+		default:															\
+			CALL(int64);													\
+			break;															\
+	}
+
+
+/*
+ * SelectVectorValue sets the rows of result for which mask is set, or all of
+ * them if mask is NULL, to the value.
+ */
+static void
+SelectVectorValue(VectorColumn *result, const bool *mask, VectorValue *value,
+				  uint32 dimension)
+{
+	VectorColumn *column = value->column;
+
+	if (mask == NULL && column != NULL)
+	{
+		memcpy(result->value, column->value, result->columnTypeLen * dimension);
+		memcpy(result->isnull, column->isnull, dimension);
+	}
+	else if (mask == NULL)
+	{
+#define _FILL(TYPE) FillValues##TYPE((TYPE *) result->value, (TYPE) value->constValue, \
+									 dimension)
+		_VALUE_KERNEL_DISPATCH(result->columnTypeLen, _FILL);
+#undef _FILL
+		memset(result->isnull, value->constIsNull, dimension);
+	}
+	else
+	{
+#define _SELECT(TYPE) SelectValues##TYPE((TYPE *) result->value, result->isnull, mask, \
+										 column ? (TYPE *) column->value : NULL,	\
+										 column ? column->isnull : NULL,			\
+										 (TYPE) value->constValue,				\
+										 value->constIsNull, dimension)
+		_VALUE_KERNEL_DISPATCH(result->columnTypeLen, _SELECT);
+#undef _SELECT
+	}
+}
+
+
+/*
+ * CoalesceVectorValues computes COALESCE of the values into result. They are
+ * applied from the last one, so each row ends up with its first value that
+ * isn't NULL.
+ */
+static void
+CoalesceVectorValues(VectorColumn *result, VectorValue *values, int valueCount,
+					 uint32 dimension)
+{
+	SelectVectorValue(result, NULL, &values[valueCount - 1], dimension);
+
+	for (int i = valueCount - 2; i >= 0; i--)
+	{
+		VectorColumn *column = values[i].column;
+
+		if (column != NULL)
+		{
+#define _COALESCE(TYPE) CoalesceValues##TYPE((TYPE *) result->value, result->isnull, \
+											 (TYPE *) column->value, column->isnull, \
+											 dimension)
+			_VALUE_KERNEL_DISPATCH(result->columnTypeLen, _COALESCE);
+#undef _COALESCE
+		}
+		else if (!values[i].constIsNull)
+		{
+			SelectVectorValue(result, NULL, &values[i], dimension);
+		}
+	}
+}
+
+
+/*
+ * NullIfVectorValues computes NULLIF of the two values into result.
+ */
+static void
+NullIfVectorValues(VectorColumn *result, VectorValue *values, uint32 dimension)
+{
+	SelectVectorValue(result, NULL, &values[0], dimension);
+
+	VectorColumn *column = values[1].column;
+
+	/* NULLIF(x, NULL) is x */
+	if (column == NULL && values[1].constIsNull)
+		return;
+
+#define _NULLIF(TYPE) NullIfValues##TYPE((TYPE *) result->value, result->isnull,	\
+										 column ? (TYPE *) column->value : NULL,	\
+										 column ? column->isnull : NULL,			\
+										 (TYPE) values[1].constValue, dimension)
+	_VALUE_KERNEL_DISPATCH(result->columnTypeLen, _NULLIF);
+#undef _NULLIF
+}
+
+
+/*
+ * executeVectorizedValueExpr computes a CASE, COALESCE or NULLIF over the
+ * rows of the vector slot, after the ones among its operands.
+ */
+static VectorColumn *
+executeVectorizedValueExpr(VectorQual *vectorQual)
+{
+	VectorTupleTableSlot *vectorSlot =
+		(VectorTupleTableSlot *) vectorQual->u.valueExpr.slot;
+	VectorColumn *result = vectorQual->result;
+	VectorValue *values = vectorQual->u.valueExpr.values;
+	int valueCount = vectorQual->u.valueExpr.valueCount;
+	uint32 dimension = vectorSlot->dimension;
+
+	for (int i = 0; i < valueCount; i++)
+	{
+		if (values[i].valueQual != NULL)
+			executeVectorizedValueExpr(values[i].valueQual);
+	}
+
+	switch (vectorQual->u.valueExpr.valueExprType)
+	{
+		case T_CaseExpr:
+		{
+			List *conditionList = vectorQual->u.valueExpr.conditionList;
+
+			SelectVectorValue(result, NULL, &values[valueCount - 1], dimension);
+
+			/* the first WHEN clause that is true for a row is applied last */
+			for (int i = list_length(conditionList) - 1; i >= 0; i--)
+			{
+				bool *mask = ExecuteVectorizedQual(vectorQual->u.valueExpr.slot,
+												   list_nth(conditionList, i),
+												   AND_EXPR);
+
+				SelectVectorValue(result, mask, &values[i], dimension);
+			}
+			break;
+		}
+
+		case T_CoalesceExpr:
+			CoalesceVectorValues(result, values, valueCount, dimension);
+			break;
+
+		case T_NullIfExpr:
+			NullIfVectorValues(result, values, dimension);
+			break;
+
+		default:
+			elog(ERROR, "unrecognized vectorized value expression type: %d",
+				 (int) vectorQual->u.valueExpr.valueExprType);
+	}
+
+	/* quals keep the rows that are true, so NULL rows need to be false */
+	if (vectorQual->u.valueExpr.isQual)
+	{
+		bool *resultValue = (bool *) result->value;
+
+		for (uint32 n = 0; n < dimension; n++)
+			resultValue[n] &= !result->isnull[n];
+	}
+
+	result->dimension = dimension;
+
+	return result;
+}
+
+
+/*
+ * executeNullResultExpr returns the result of a strict call with a NULL
+ * constant argument, whose rows are all NULL, with the rows of its vector
+ * argument. Quals take NULL rows as false.
+ */
+static VectorColumn *
+executeNullResultExpr(VectorQual *vectorQual)
+{
+	FunctionCallInfo fcinfo = vectorQual->u.expr.fcInfo;
+	uint32 dimension = 0;
+
+	for (int argno = 0; argno < fcinfo->nargs; argno++)
+	{
+		VectorFnArgument *argument = vectorQual->u.expr.vectorFnArguments + argno;
+
+		if (argument->type == VECTOR_FN_ARG_VAR)
+		{
+			dimension = ((VectorColumn *) DatumGetPointer(argument->arg))->dimension;
+			break;
+		}
+	}
+
+	VectorColumn *result = VectorFnResultColumn(fcinfo, dimension,
+												vectorQual->u.expr.resultTypeLen);
+
+	memset(result->value, 0, result->columnTypeLen * dimension);
+	memset(result->isnull, true, dimension);
+	result->dimension = dimension;
+
+	return result;
+}
+
+
+/*
+ * executeFusedVectorExpr computes a fused expression over the rows of its
+ * columns, a tile of rows at a time. Rows are NULL where a column is.
+ */
+static VectorColumn *
+executeFusedVectorExpr(VectorQual *vectorQual)
+{
+	FusedVectorExpr *fusedExpr = vectorQual->u.expr.fusedExpr;
+	uint32 dimension = fusedExpr->columns[0]->dimension;
+	bool overflow = false;
+
+	VectorColumn *result = VectorFnResultColumn(vectorQual->u.expr.fcInfo,
+												dimension, sizeof(int64));
+
+	memcpy(result->isnull, fusedExpr->columns[0]->isnull, dimension);
+	result->noNulls = fusedExpr->columns[0]->noNulls;
+
+	for (int i = 1; i < fusedExpr->columnCount; i++)
+	{
+		VectorColumn *column = fusedExpr->columns[i];
+
+		for (uint32 row = 0; row < dimension; row++)
+			result->isnull[row] |= column->isnull[row];
+
+		result->noNulls &= column->noNulls;
+	}
+
+	for (uint32 start = 0; start < dimension; start += FUSED_VECTOR_TILE_ROWS)
+	{
+		int count = Min(FUSED_VECTOR_TILE_ROWS, dimension - start);
+		const bool *isnull = result->isnull + start;
+
+		for (int i = 0; i < fusedExpr->stepCount; i++)
+		{
+			FusedVectorStep *step = &fusedExpr->steps[i];
+			const char *left = step->left.column != NULL ?
+				(const char *) step->left.column->value + start * sizeof(int64) :
+				fusedExpr->scratch +
+				step->left.scratchIndex * FUSED_VECTOR_TILE_ROWS * sizeof(int64);
+			const char *right = step->right.column != NULL ?
+				(const char *) step->right.column->value + start * sizeof(int64) :
+				fusedExpr->scratch +
+				step->right.scratchIndex * FUSED_VECTOR_TILE_ROWS * sizeof(int64);
+
+			/* the last step computes the rows of the result */
+			char *stepResult = i == fusedExpr->stepCount - 1 ?
+				(char *) result->value + start * sizeof(int64) :
+				fusedExpr->scratch +
+				step->scratchIndex * FUSED_VECTOR_TILE_ROWS * sizeof(int64);
+
+			overflow |= step->kernel(left, right, isnull, stepResult, count);
+		}
+	}
+
+	if (overflow)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("%s out of range", fusedExpr->typeName)));
+
+	result->dimension = dimension;
+
+	return result;
+}
+
+
+static VectorColumn *
+executeVectorizedExpr(VectorQual *vectorQual)
+{
+	if (vectorQual->u.expr.fusedExpr != NULL)
+		return executeFusedVectorExpr(vectorQual);
+
+	ListCell *lc;
+	foreach(lc, vectorQual->u.expr.argumentQualList)
+	{
+		VectorQual *argumentQual = (VectorQual *) lfirst(lc);
+
+		if (argumentQual->vectorQualType == VECTOR_QUAL_EXPR)
+			argumentQual->u.expr.outputArgument->arg =
+				PointerGetDatum(executeVectorizedExpr(argumentQual));
+		else
+			executeVectorizedValueExpr(argumentQual);
+	}
+
+	if (vectorQual->u.expr.nullResult)
+		return executeNullResultExpr(vectorQual);
+
+	return (VectorColumn *) vectorQual->u.expr.fmgrInfo->fn_addr(vectorQual->u.expr.fcInfo);
+}
+
+
+
+/*
+ * ConstructVectorizedFuncExpr constructs a function call CreateVectorizedFuncExpr
+ * returned against the columns of the vector slot, for projections.
+ */
+VectorQual *
+ConstructVectorizedFuncExpr(TupleTableSlot *slot, Node *node)
+{
+	FuncExpr *funcExpr = castNode(FuncExpr, node);
+
+	return BuildFunctionCallQual((VectorTupleTableSlot *) slot, node, funcExpr->funcid,
+								 funcExpr->args, funcExpr->inputcollid);
+}
+
+
+/*
+ * ExecuteVectorizedFuncExpr computes a function call ConstructVectorizedFuncExpr
+ * constructed over the rows of its vector slot. The result is valid until the
+ * call is executed again.
+ */
+VectorColumn *
+ExecuteVectorizedFuncExpr(VectorQual *vectorQual)
+{
+	return executeVectorizedExpr(vectorQual);
+}
+
+
+static VectorColumn *
+executeVectorizedNullTest(VectorQual *vectorQual)
+{
+	VectorColumn *column = vectorQual->u.nullTest.column;
+	VectorColumn *result = vectorQual->result;
+	bool *resultValue = (bool *) result->value;
+	bool isNull = vectorQual->u.nullTest.nullTestType == IS_NULL;
+
+	for (int n = 0; n < column->dimension; n++)
+	{
+		resultValue[n] = column->isnull[n] == isNull;
+	}
+
+	memset(result->isnull, 0, column->dimension);
+	result->dimension = column->dimension;
+
+	return result;
+}
+
+
+static VectorColumn *
+executeVectorizedBooleanTest(VectorQual *vectorQual)
+{
+	VectorColumn *column = vectorQual->u.booleanTest.column;
+	VectorColumn *result = vectorQual->result;
+	bool *columnValue = (bool *) column->value;
+	bool *resultValue = (bool *) result->value;
+
+	/* stale values of NULL rows are masked, boolean tests are never NULL */
+	switch (vectorQual->u.booleanTest.booleanTestType)
+	{
+		case IS_TRUE:
+			for (int n = 0; n < column->dimension; n++)
+				resultValue[n] = columnValue[n] & !column->isnull[n];
+			break;
+
+		case IS_NOT_TRUE:
+			for (int n = 0; n < column->dimension; n++)
+				resultValue[n] = !columnValue[n] | column->isnull[n];
+			break;
+
+		case IS_FALSE:
+			for (int n = 0; n < column->dimension; n++)
+				resultValue[n] = !columnValue[n] & !column->isnull[n];
+			break;
+
+		case IS_NOT_FALSE:
+			for (int n = 0; n < column->dimension; n++)
+				resultValue[n] = columnValue[n] | column->isnull[n];
+			break;
+
+		case IS_UNKNOWN:
+			for (int n = 0; n < column->dimension; n++)
+				resultValue[n] = column->isnull[n];
+			break;
+
+		case IS_NOT_UNKNOWN:
+			for (int n = 0; n < column->dimension; n++)
+				resultValue[n] = !column->isnull[n];
+			break;
+	}
+
+	memset(result->isnull, 0, column->dimension);
+	result->dimension = column->dimension;
+
+	return result;
+}
+
+
+/*
+ * InListMatch<type> sets match for the rows whose value is in the sorted
+ * list. Short lists are compared with every value, longer ones searched
+ * with a binary search whose steps don't branch on the data.
+ * InListMatchRows<type> only searches for the given rows.
+ */
+#define _BUILD_IN_LIST_MATCH(TYPE)											\
+static void																	\
+InListMatch##TYPE(const TYPE *columnValue, int dimension,					\
+				  const int64 *values, int valueCount, bool *match)			\
+{																			\
+	if (valueCount <= VECTOR_IN_LIST_LINEAR_LIMIT)							\
+	{																		\
+		for (int n = 0; n < dimension; n++)									\
+		{																	\
+			int64 value = columnValue[n];									\
+			bool found = false;												\
+			for (int i = 0; i < valueCount; i++)							\
+				found |= (value == values[i]);								\
+			match[n] = found;												\
+		}																	\
+		return;																\
+	}																		\
+																			\
+	for (int n = 0; n < dimension; n++)										\
+	{																		\
+		int64 value = columnValue[n];										\
+		const int64 *base = values;											\
+		int length = valueCount;											\
+		while (length > 1)													\
+		{																	\
+			int half = length / 2;											\
+			base = (base[half] <= value) ? base + half : base;				\
+			length -= half;													\
+		}																	\
+		match[n] = (*base == value);										\
+	}																		\
+}
+																			\
+static void																	\
+InListMatchRows##TYPE(const TYPE *columnValue, const uint32 *rows,			\
+					  int rowCount, const int64 *values, int valueCount,	\
+					  bool *match)											\
+{																			\
+	for (int i = 0; i < rowCount; i++)										\
+	{																		\
+		int64 value = columnValue[rows[i]];									\
+		const int64 *base = values;											\
+		int length = valueCount;											\
+		while (length > 1)													\
+		{																	\
+			int half = length / 2;											\
+			base = (base[half] <= value) ? base + half : base;				\
+			length -= half;													\
+		}																	\
+		match[rows[i]] = (length == 1 && *base == value);					\
+	}																		\
+}
+
+_BUILD_IN_LIST_MATCH(int8)
+_BUILD_IN_LIST_MATCH(int16)
+_BUILD_IN_LIST_MATCH(int32)
+_BUILD_IN_LIST_MATCH(int64)
+
+
+/*
+ * executeVectorizedInList evaluates x IN (...) or x NOT IN (...). If rows
+ * are given, only those are matched, and the other rows of the result are
+ * still true or false but don't mean anything.
+ */
+static VectorColumn *
+executeVectorizedInList(VectorQual *vectorQual, const uint32 *rows, int rowCount)
+{
+	VectorColumn *column = vectorQual->u.inList.column;
+	VectorColumn *result = vectorQual->result;
+	bool *resultValue = (bool *) result->value;
+	const int64 *values = vectorQual->u.inList.values;
+	int valueCount = vectorQual->u.inList.valueCount;
+	bool hasNull = vectorQual->u.inList.hasNull;
+	int dimension = column->dimension;
+
+	/* matches are computed into the result, then combined with the NULLs */
+	if (rows != NULL)
+	{
+		memset(resultValue, false, dimension);
+
+		switch (column->columnTypeLen)
+		{
+			case sizeof(int8):
+				InListMatchRowsint8((int8 *) column->value, rows, rowCount, values,
+									valueCount, resultValue);
+				break;
+			case sizeof(int16):
+				InListMatchRowsint16((int16 *) column->value, rows, rowCount, values,
+									 valueCount, resultValue);
+				break;
+			case sizeof(int32):
+				InListMatchRowsint32((int32 *) column->value, rows, rowCount, values,
+									 valueCount, resultValue);
+				break;
+			default:
+				InListMatchRowsint64((int64 *) column->value, rows, rowCount, values,
+									 valueCount, resultValue);
+				break;
+		}
+	}
+	else
+	{
+		switch (column->columnTypeLen)
+		{
+			case sizeof(int8):
+				InListMatchint8((int8 *) column->value, dimension, values, valueCount,
+								resultValue);
+				break;
+			case sizeof(int16):
+				InListMatchint16((int16 *) column->value, dimension, values, valueCount,
+								 resultValue);
+				break;
+			case sizeof(int32):
+				InListMatchint32((int32 *) column->value, dimension, values, valueCount,
+								 resultValue);
+				break;
+			default:
+				InListMatchint64((int64 *) column->value, dimension, values, valueCount,
+								 resultValue);
+				break;
+		}
+	}
+
+	if (vectorQual->u.inList.useOr)
+	{
+		/* x IN (...) is NULL if x is NULL, or x matches nothing and a value is */
+		for (int n = 0; n < dimension; n++)
+		{
+			bool columnIsNull = column->isnull[n];
+			result->isnull[n] = columnIsNull | (!resultValue[n] & hasNull);
+			resultValue[n] = resultValue[n] & !columnIsNull;
+		}
+	}
+	else if (valueCount == 0 && !hasNull)
+	{
+		/* x <> ALL ('{}') is true even for NULL x */
+		memset(resultValue, true, dimension);
+		memset(result->isnull, 0, dimension);
+	}
+	else
+	{
+		/* x NOT IN (...) is NULL if x is NULL, or x matches nothing and a value is */
+		for (int n = 0; n < dimension; n++)
+		{
+			bool columnIsNull = column->isnull[n];
+			result->isnull[n] = columnIsNull | (!resultValue[n] & hasNull);
+			resultValue[n] = !resultValue[n] & !hasNull & !columnIsNull;
+		}
+	}
+
+	result->dimension = dimension;
+
+	return result;
+}
+
+
+static VectorColumn *executeVectorizedQualColumn(VectorQual *vectorQual);
+
+
+static VectorColumn *
+executeVectorizedNot(VectorQual *vectorQual)
+{
+	VectorColumn *argument =
+		executeVectorizedQualColumn(linitial(vectorQual->u.boolExpr.vectorQualExprList));
+	VectorColumn *result = vectorQual->result;
+	bool *argumentValue = (bool *) argument->value;
+	bool *resultValue = (bool *) result->value;
+
+	/* NOT NULL is NULL, so those rows are not kept either */
+	for (int n = 0; n < argument->dimension; n++)
+	{
+		resultValue[n] = !argumentValue[n] & !argument->isnull[n];
+		result->isnull[n] = argument->isnull[n];
+	}
+
+	result->dimension = argument->dimension;
+
+	return result;
+}
+
+
+/*
+ * executeVectorizedQualColumn evaluates a single qual, keeping track of
+ * which rows it is NULL for.
+ */
+static VectorColumn *
+executeVectorizedQualColumn(VectorQual *vectorQual)
+{
+	switch (vectorQual->vectorQualType)
+	{
+		case VECTOR_QUAL_EXPR:
+			return executeVectorizedExpr(vectorQual);
+		case VECTOR_QUAL_NULL_TEST:
+			return executeVectorizedNullTest(vectorQual);
+		case VECTOR_QUAL_BOOLEAN_TEST:
+			return executeVectorizedBooleanTest(vectorQual);
+		case VECTOR_QUAL_IN_LIST:
+			return executeVectorizedInList(vectorQual, NULL, 0);
+		case VECTOR_QUAL_VALUE_EXPR:
+			return executeVectorizedValueExpr(vectorQual);
+		case VECTOR_QUAL_BOOL_EXPR:
+			Assert(vectorQual->u.boolExpr.boolExprType == NOT_EXPR);
+			return executeVectorizedNot(vectorQual);
 	}
 
-	return newQualList;
+	pg_unreachable();
 }
 
 
-List *
-ConstructVectorizedQualList(TupleTableSlot *slot, List *vectorizedQual)
+/*
+ * VectorQualRank ranks a child of AND or OR by the time it took for each row
+ * it was evaluated on, over the share of those rows it decided, which are
+ * the rows it was false for under AND and true for under OR. Children that
+ * decide most rows for their cost are evaluated first. Children that weren't
+ * evaluated since they were last ranked are tried first, to learn about them.
+ */
+static double
+VectorQualRank(VectorQual *vectorQual, BoolExprType boolType)
 {
-	VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) slot;
+	if (vectorQual->evaluatedRows == 0)
+	{
+		return 0;
+	}
 
-	List *vectorQualList = NIL;
-	ListCell *lc;
+	double rowTime = vectorQual->evaluationTime / vectorQual->evaluatedRows;
+	double trueShare = (double) vectorQual->trueRows / vectorQual->evaluatedRows;
+	double decidedShare = (boolType == AND_EXPR) ? 1.0 - trueShare : trueShare;
 
-	foreach(lc, vectorizedQual)
+	return rowTime / Max(decidedShare, VECTOR_QUAL_MIN_DECIDED_SHARE);
+}
+
+
+/*
+ * ReorderVectorQualChildren sorts the children of AND or OR by their rank,
+ * then halves what was observed of them, so that the order follows the
+ * data as it changes over the scan.
+ */
+static void
+ReorderVectorQualChildren(VectorQual *vectorQual)
+{
+	List *childList = vectorQual->u.boolExpr.vectorQualExprList;
+	BoolExprType boolType = vectorQual->u.boolExpr.boolExprType;
+	int childCount = list_length(childList);
+
+	/* insertion sort, which keeps the order of children that rank the same */
+	for (int i = 1; i < childCount; i++)
 	{
-		Node *node = lfirst(lc);
+		VectorQual *child = list_nth(childList, i);
+		double childRank = VectorQualRank(child, boolType);
 
-		switch(nodeTag(node))
+		int j = i;
+		for (; j > 0; j--)
 		{
-			case T_OpExpr:
-			case T_DistinctExpr:	/* struct-equivalent to OpExpr */
-			case T_NullIfExpr:		/* struct-equivalent to OpExpr */
+			VectorQual *previous = list_nth(childList, j - 1);
+			if (VectorQualRank(previous, boolType) <= childRank)
 			{
-				OpExpr *opExprNode = (OpExpr *) node;
-
-				int argno = 0;
-				int nargs = list_length(opExprNode->args);
+				break;
+			}
 
-				VectorQual *newVectorQual = palloc(sizeof(VectorQual));
-				newVectorQual->vectorQualType = VECTOR_QUAL_EXPR;
+			lfirst(list_nth_cell(childList, j)) = previous;
+		}
 
-				newVectorQual->u.expr.fmgrInfo = palloc0(sizeof(FmgrInfo));
-				newVectorQual->u.expr.fcInfo  = palloc0(SizeForFunctionCallInfo(nargs));
-				newVectorQual->u.expr.vectorFnArguments = 
-					(VectorFnArgument *) palloc0(sizeof(VectorFnArgument) * nargs);
+		lfirst(list_nth_cell(childList, j)) = child;
+	}
 
+	ListCell *lc;
+	foreach(lc, childList)
+	{
+		VectorQual *child = (VectorQual *) lfirst(lc);
 
-				fmgr_info(opExprNode->opfuncid, newVectorQual->u.expr.fmgrInfo);
-				fmgr_info_set_expr((Node *) node, newVectorQual->u.expr.fmgrInfo);
+		child->evaluatedRows /= 2;
+		child->trueRows /= 2;
+		child->evaluationTime /= 2;
+	}
 
-				/* Initialize function call parameter structure too */
-				InitFunctionCallInfoData(*(newVectorQual->u.expr.fcInfo), 
-										 newVectorQual->u.expr.fmgrInfo,
-										 nargs, opExprNode->inputcollid, NULL, NULL);
+	vectorQual->u.boolExpr.vectorCount = 0;
+}
 
-				ListCell *lcOpExprArgs;
-				foreach(lcOpExprArgs, opExprNode->args)
-				{
-					Expr *arg = (Expr *) lfirst(lcOpExprArgs);
 
-					VectorFnArgument *vectorFnArgument = 
-						newVectorQual->u.expr.vectorFnArguments + argno;
+static bool *executeVectorizedQualList(TupleTableSlot *slot, List *vectorizedQualList,
+									   BoolExprType boolType, uint32 *undecidedRows);
 
-					if (IsA(arg, Const))
-					{
-						Const *con = (Const *) arg;
 
-						vectorFnArgument->type = VECTOR_FN_ARG_CONSTANT;
-						vectorFnArgument->arg = con->constvalue;
-						
-						newVectorQual->u.expr.fcInfo->args[argno].value = (Datum) vectorFnArgument;
-						newVectorQual->u.expr.fcInfo->args[argno].isnull = con->constisnull;
-					}
-					else if (IsA(arg, Var))
-					{
-						Var *variable = (Var *) arg;
-						int columnIdx = variable->varattno - 1;
+/*
+ * executeVectorizedQualValues evaluates a qual of a list, whose rows that
+ * are NULL are false in the result. IN lists are only matched for the given
+ * rows if there are any.
+ */
+static bool *
+executeVectorizedQualValues(TupleTableSlot *slot, VectorQual *vectorQual,
+							const uint32 *rows, int rowCount)
+{
+	switch (vectorQual->vectorQualType)
+	{
+		case VECTOR_QUAL_IN_LIST:
+			return (bool *) executeVectorizedInList(vectorQual, rows, rowCount)->value;
 
-						vectorFnArgument->type = VECTOR_FN_ARG_VAR;
-						vectorFnArgument->arg = vectorSlot->tts.tts_values[columnIdx];
+		case VECTOR_QUAL_BOOL_EXPR:
+		{
+			BoolExprType boolExprType = vectorQual->u.boolExpr.boolExprType;
 
-						newVectorQual->u.expr.fcInfo->args[argno].value = (Datum) vectorFnArgument;
-						newVectorQual->u.expr.fcInfo->args[argno].isnull = false;
-					}
-					
-					argno++;
-				}
+			if (boolExprType == NOT_EXPR)
+			{
+				return (bool *) executeVectorizedNot(vectorQual)->value;
+			}
 
-				vectorQualList = lappend(vectorQualList, newVectorQual);
-				break;
+			if (++vectorQual->u.boolExpr.vectorCount >= VECTOR_QUAL_REORDER_INTERVAL)
+			{
+				ReorderVectorQualChildren(vectorQual);
 			}
 
-			case T_BoolExpr:
+			return executeVectorizedQualList(slot, vectorQual->u.boolExpr.vectorQualExprList,
+											 boolExprType,
+											 vectorQual->u.boolExpr.undecidedRows);
+		}
+
+		default:
+			return (bool *) executeVectorizedQualColumn(vectorQual)->value;
+	}
+}
+
+
+/*
+ * executeVectorizedQualList ANDs or ORs the results of the quals of a list.
+ * Once no row is left undecided, which is when all rows are false for AND
+ * or true for OR, the remaining quals aren't evaluated. When few rows are
+ * left, IN lists are only matched for those rows, which undecidedRows holds
+ * if it is given. What is observed of each qual is kept for reordering the
+ * children of AND and OR.
+ */
+static bool *
+executeVectorizedQualList(TupleTableSlot *slot, List *vectorizedQualList,
+						  BoolExprType boolType, uint32 *undecidedRows)
+{
+	VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) slot;
+	int dimension = vectorSlot->dimension;
+	bool observe = list_length(vectorizedQualList) > 1;
+
+	bool *result = NULL;
+	int undecidedCount = dimension;
+
+	ListCell *lc;
+	foreach(lc, vectorizedQualList)
+	{
+		VectorQual *vectorQual = (VectorQual *) lfirst(lc);
+		const uint32 *rows = NULL;
+		int rowCount = 0;
+		instr_time startTime;
+		instr_time endTime;
+
+		INSTR_TIME_SET_ZERO(startTime);
+
+		if (result != NULL && undecidedRows != NULL &&
+			vectorQual->vectorQualType == VECTOR_QUAL_IN_LIST &&
+			undecidedCount <= dimension / VECTOR_QUAL_UNDECIDED_FRACTION)
+		{
+			for (int n = 0; n < dimension; n++)
 			{
-				BoolExpr *boolExpr = castNode(BoolExpr, node);
+				undecidedRows[rowCount] = n;
+				rowCount += (result[n] == (boolType == AND_EXPR));
+			}
 
-				VectorQual *newVectorQual = palloc0(sizeof(VectorQual));
-				newVectorQual->vectorQualType = VECTOR_QUAL_BOOL_EXPR;
-				
-				List *newQualExprArgList = 
-					ConstructVectorizedQualList(slot, boolExpr->args);
+			rows = undecidedRows;
+		}
 
-				newVectorQual->u.boolExpr.boolExprType = boolExpr->boolop;
+		if (observe)
+		{
+			INSTR_TIME_SET_CURRENT(startTime);
+		}
 
-				ListCell *lcExprArgList;
-				foreach(lcExprArgList, newQualExprArgList)
-				{
-					newVectorQual->u.boolExpr.vectorQualExprList = 
-						lappend(newVectorQual->u.boolExpr.vectorQualExprList, 
-								(VectorQual*)lfirst(lcExprArgList));
-				}
+		bool *qualResult = executeVectorizedQualValues(slot, vectorQual, rows, rowCount);
 
-				vectorQualList = lappend(vectorQualList, newVectorQual);
+		if (result == NULL)
+		{
+			result = qualResult;
+		}
+		else if (boolType == AND_EXPR)
+		{
+			vectorizedAnd(result, qualResult, dimension);
+		}
+		else
+		{
+			vectorizedOr(result, qualResult, dimension);
+		}
 
-				break;
+		int previousUndecidedCount = undecidedCount;
+		int trueCount = (int) pg_popcount((const char *) result, dimension);
+		undecidedCount = (boolType == AND_EXPR) ? trueCount : dimension - trueCount;
+
+		if (observe)
+		{
+			INSTR_TIME_SET_CURRENT(endTime);
+			INSTR_TIME_SUBTRACT(endTime, startTime);
+			vectorQual->evaluationTime += INSTR_TIME_GET_DOUBLE(endTime);
+
+			if (rows == NULL)
+			{
+				vectorQual->evaluatedRows += dimension;
+				vectorQual->trueRows += pg_popcount((const char *) qualResult, dimension);
+			}
+			else
+			{
+				/* only the undecided rows were matched, the others don't count */
+				vectorQual->evaluatedRows += previousUndecidedCount;
+				vectorQual->trueRows += (boolType == AND_EXPR) ?
+										undecidedCount :
+										previousUndecidedCount - undecidedCount;
 			}
+		}
 
-			default:
-				break;
+		if (undecidedCount == 0)
+		{
+			break;
 		}
 	}
 
-	return vectorQualList;
+	return result;
+}
+
+
+bool *
+ExecuteVectorizedQual(TupleTableSlot *slot, List *vectorizedQualList, BoolExprType boolType)
+{
+	return executeVectorizedQualList(slot, vectorizedQualList, boolType, NULL);
 }
 
+
 /*
- * vectorizedOr / vectorizedAnd
+ * BuildVectorQualPipeline constructs each of the vectorized quals, which are
+ * ANDed, against the columns of the vector slot, as a stage of a pipeline.
  */
-
-static void
-vectorizedAnd(bool *left, bool *right, int dimension)
+VectorQualPipeline *
+BuildVectorQualPipeline(TupleTableSlot *slot, List *vectorizedQual)
 {
-	for (int n = 0; n < dimension; n++)
+	VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) slot;
+
+	VectorQualPipeline *pipeline = palloc0(sizeof(VectorQualPipeline));
+	pipeline->slot = slot;
+	pipeline->selected = palloc(sizeof(bool) * vectorSlot->capacity);
+
+	ListCell *lc;
+	foreach(lc, vectorizedQual)
 	{
-		left[n] &= right[n];
+		Node *qual = lfirst(lc);
+
+		List *stageQualList = ConstructVectorizedQualList(slot, list_make1(qual));
+		if (stageQualList == NIL)
+		{
+			continue;
+		}
+
+		List *stageColumnList = NIL;
+
+		ListCell *varCell;
+		foreach(varCell, pull_var_clause(qual, 0))
+		{
+			Var *variable = (Var *) lfirst(varCell);
+			stageColumnList = list_append_unique_int(stageColumnList,
+													 variable->varattno);
+		}
+
+		pipeline->stageQualLists = lappend(pipeline->stageQualLists, stageQualList);
+		pipeline->stageColumnLists = lappend(pipeline->stageColumnLists,
+											 stageColumnList);
 	}
+
+	return pipeline;
 }
 
-static void
-vectorizedOr(bool *left, bool *right, int dimension)
+
+/*
+ * ExecuteVectorQualStage evaluates a stage of the pipeline on the vectorSize
+ * rows of the vector slot, once the reader filled the columns of the stage.
+ * The selection of the slot is set to the rows that passed all stages so
+ * far, and their number is returned.
+ */
+uint32
+ExecuteVectorQualStage(void *pipelineState, int stage, uint32 vectorSize)
 {
-	for (int n = 0; n < dimension; n++)
+	VectorQualPipeline *pipeline = (VectorQualPipeline *) pipelineState;
+	VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) pipeline->slot;
+
+	vectorSlot->dimension = vectorSize;
+
+	bool *qualResult = ExecuteVectorizedQual(pipeline->slot,
+											 list_nth(pipeline->stageQualLists, stage),
+											 AND_EXPR);
+
+	if (stage == 0)
 	{
-		left[n] |= right[n];
-	} 
+		memcpy(pipeline->selected, qualResult, sizeof(bool) * vectorSize);
+	}
+	else
+	{
+		vectorizedAnd(pipeline->selected, qualResult, vectorSize);
+	}
+
+	SetVectorSlotSelection(vectorSlot, pipeline->selected);
+
+	return vectorSlot->selectionCount;
 }
 
-static bool *
-executeVectorizedExpr(VectorQual *vectorQual)
+
+/*
+ * VectorValueFunctionState is kept in fn_extra by vcase, vcoalesce and
+ * vnullif, which compute CASE, COALESCE and NULLIF in aggregate arguments.
+ */
+typedef struct VectorValueFunctionState
 {
-	VectorColumn *res = 
-		(VectorColumn *) vectorQual->u.expr.fmgrInfo->fn_addr(vectorQual->u.expr.fcInfo);
+	VectorColumn *result;
+	int16 typeLen;
 
-	return (bool *) res->value;
-}
+	/* operands, set from the arguments of each call */
+	VectorValue *values;
 
-bool * 
-ExecuteVectorizedQual(TupleTableSlot *slot, List *vectorizedQualList, BoolExprType boolType)
+	/* vectorized comparisons of the WHEN clauses of vcase */
+	FunctionCallInfo *conditionFcInfo;
+} VectorValueFunctionState;
+
+
+/*
+ * IsVectorizedComparison returns true if the procedure is the vectorized
+ * version of another, so vcase can call it with vectors.
+ */
+static bool
+IsVectorizedComparison(Oid vectorizedProcedureOid)
 {
-	VectorTupleTableSlot *vectorSlot = (VectorTupleTableSlot *) slot;
-	ListCell *lc;
+	HeapTuple procedureTuple = SearchSysCache1(PROCOID,
+											   ObjectIdGetDatum(vectorizedProcedureOid));
+	if (!HeapTupleIsValid(procedureTuple))
+		return false;
 
-	bool *result = NULL;
+	Form_pg_proc procedureForm = (Form_pg_proc) GETSTRUCT(procedureTuple);
+	char *procedureName = pstrdup(NameStr(procedureForm->proname));
+	int nargs = procedureForm->pronargs;
+	Oid *argtypes = palloc(sizeof(Oid) * Max(nargs, 1));
+	memcpy(argtypes, procedureForm->proargtypes.values, sizeof(Oid) * nargs);
+	bool returnsBool = procedureForm->prorettype == BOOLOID;
 
-	foreach(lc, vectorizedQualList)
+	ReleaseSysCache(procedureTuple);
+
+	if (procedureName[0] != 'v' || nargs != 2 || !returnsBool)
+		return false;
+
+	Oid procedureOid = LookupFuncName(list_make1(makeString(procedureName + 1)),
+									  nargs, argtypes, true);
+
+	Oid resolvedOid;
+	return OidIsValid(procedureOid) &&
+		   GetVectorizedProcedureOid(procedureOid, &resolvedOid) &&
+		   resolvedOid == vectorizedProcedureOid;
+}
+
+
+/*
+ * VectorValueFunctionBegin returns the state of a call of vcase, vcoalesce
+ * or vnullif, with its result emptied for the rows of the vector arguments
+ * and the operands set from the arguments given as valueArgnos. The
+ * comparisons of the conditionCount WHEN clauses of vcase are looked up on
+ * the first call.
+ */
+static VectorValueFunctionState *
+VectorValueFunctionBegin(FunctionCallInfo fcinfo, int *valueArgnos, int valueCount,
+						 int conditionCount)
+{
+	FmgrInfo *flinfo = fcinfo->flinfo;
+	VectorValueFunctionState *state = (VectorValueFunctionState *) flinfo->fn_extra;
+
+	if (state == NULL)
 	{
-		VectorQual *vectorQual = (VectorQual *) lfirst(lc);
+		MemoryContext oldContext = MemoryContextSwitchTo(flinfo->fn_mcxt);
 
-		bool *qualResult = NULL;
+		state = palloc0(sizeof(VectorValueFunctionState));
+		state->typeLen = get_typlen(get_fn_expr_rettype(flinfo));
+		state->values = palloc0(sizeof(VectorValue) * Max(valueCount, 1));
+		state->conditionFcInfo = palloc0(sizeof(FunctionCallInfo) *
+										 Max(conditionCount, 1));
 
-		switch(vectorQual->vectorQualType)
+		for (int i = 0; i < conditionCount; i++)
 		{
-			case VECTOR_QUAL_EXPR:
-			{
-				qualResult = executeVectorizedExpr(vectorQual);
-				break;
-			}
-			case VECTOR_QUAL_BOOL_EXPR:
+			int argno = i * 4;
+
+			if (!get_fn_expr_arg_stable(flinfo, argno) || PG_ARGISNULL(argno) ||
+				!IsVectorizedComparison(DatumGetObjectId(PG_GETARG_DATUM(argno))))
 			{
-				if (vectorQual->u.boolExpr.boolExprType == AND_EXPR)
-				{
-					qualResult = ExecuteVectorizedQual(slot, vectorQual->u.boolExpr.vectorQualExprList, AND_EXPR);
-				}
-				else if (vectorQual->u.boolExpr.boolExprType == OR_EXPR)
-				{
-					qualResult = ExecuteVectorizedQual(slot, vectorQual->u.boolExpr.vectorQualExprList, OR_EXPR);
-				}
-				break;
+				elog(ERROR, "vcase needs vectorized comparisons");
 			}
+
+			FmgrInfo *conditionFmgrInfo = palloc0(sizeof(FmgrInfo));
+			fmgr_info_cxt(DatumGetObjectId(PG_GETARG_DATUM(argno)), conditionFmgrInfo,
+						  flinfo->fn_mcxt);
+
+			FunctionCallInfo conditionFcInfo = palloc0(SizeForFunctionCallInfo(2));
+			InitFunctionCallInfoData(*conditionFcInfo, conditionFmgrInfo, 2,
+									 PG_GET_COLLATION(), NULL, NULL);
+			conditionFcInfo->args[0].value = PointerGetDatum(palloc0(sizeof(VectorFnArgument)));
+			conditionFcInfo->args[1].value = PointerGetDatum(palloc0(sizeof(VectorFnArgument)));
+
+			state->conditionFcInfo[i] = conditionFcInfo;
 		}
 
-		if (result == NULL)
+		MemoryContextSwitchTo(oldContext);
+
+		flinfo->fn_extra = state;
+	}
+
+	VectorColumn *vectorColumn = NULL;
+	for (int argno = 0; argno < PG_NARGS() && vectorColumn == NULL; argno++)
+	{
+		if (!get_fn_expr_arg_stable(flinfo, argno))
+			vectorColumn = (VectorColumn *) PG_GETARG_POINTER(argno);
+	}
+
+	if (vectorColumn == NULL)
+	{
+		elog(ERROR, "vectorized expression needs a vector argument");
+	}
+
+	state->result = ReserveVectorColumn(state->result, vectorColumn->dimension,
+										state->typeLen, flinfo->fn_mcxt);
+	state->result->dimension = vectorColumn->dimension;
+
+	for (int i = 0; i < valueCount; i++)
+	{
+		int argno = valueArgnos[i];
+		VectorValue *value = &state->values[i];
+
+		if (get_fn_expr_arg_stable(flinfo, argno))
 		{
-			result = qualResult;
+			value->column = NULL;
+			value->constValue = PG_GETARG_DATUM(argno);
+			value->constIsNull = PG_ARGISNULL(argno);
 		}
 		else
 		{
-		
-			if (boolType == AND_EXPR)
-				vectorizedAnd(result, qualResult, vectorSlot->dimension);
-			else if (boolType == OR_EXPR)
-				vectorizedOr(result, qualResult, vectorSlot->dimension);
+			value->column = (VectorColumn *) PG_GETARG_POINTER(argno);
 		}
 	}
 
-	return result;
-}
\ No newline at end of file
+	return state;
+}
+
+
+/*
+ * vcase computes CASE in aggregate arguments. The arguments are, for each
+ * WHEN clause, the vectorized comparison of its condition, the two operands
+ * of the comparison and the result, then the ELSE result.
+ */
+PG_FUNCTION_INFO_V1(vcase);
+Datum
+vcase(PG_FUNCTION_ARGS)
+{
+	if (PG_NARGS() % 4 != 1)
+	{
+		elog(ERROR, "vcase needs four arguments for each WHEN clause and one for ELSE");
+	}
+
+	int conditionCount = (PG_NARGS() - 1) / 4;
+	int valueCount = conditionCount + 1;
+	int *valueArgnos = palloc(sizeof(int) * valueCount);
+
+	for (int i = 0; i < conditionCount; i++)
+		valueArgnos[i] = i * 4 + 3;
+	valueArgnos[conditionCount] = PG_NARGS() - 1;
+
+	VectorValueFunctionState *state =
+		VectorValueFunctionBegin(fcinfo, valueArgnos, valueCount, conditionCount);
+	VectorColumn *result = state->result;
+	uint32 dimension = result->dimension;
+
+	SelectVectorValue(result, NULL, &state->values[conditionCount], dimension);
+
+	/* the first WHEN clause that is true for a row is applied last */
+	for (int i = conditionCount - 1; i >= 0; i--)
+	{
+		FunctionCallInfo conditionFcInfo = state->conditionFcInfo[i];
+		bool comparesNull = false;
+
+		for (int operand = 0; operand < 2; operand++)
+		{
+			int argno = i * 4 + 1 + operand;
+			VectorFnArgument *argument = (VectorFnArgument *)
+				DatumGetPointer(conditionFcInfo->args[operand].value);
+
+			argument->type = get_fn_expr_arg_stable(fcinfo->flinfo, argno) ?
+							 VECTOR_FN_ARG_CONSTANT : VECTOR_FN_ARG_VAR;
+			argument->arg = PG_GETARG_DATUM(argno);
+			comparesNull |= PG_ARGISNULL(argno);
+		}
+
+		/* the comparisons are strict, so no row is true */
+		if (comparesNull)
+			continue;
+
+		VectorColumn *mask = (VectorColumn *)
+			DatumGetPointer(FunctionCallInvoke(conditionFcInfo));
+
+		SelectVectorValue(result, (bool *) mask->value, &state->values[i], dimension);
+	}
+
+	pfree(valueArgnos);
+
+	PG_RETURN_POINTER(result);
+}
+
+
+/*
+ * vcoalesce computes COALESCE in aggregate arguments.
+ */
+PG_FUNCTION_INFO_V1(vcoalesce);
+Datum
+vcoalesce(PG_FUNCTION_ARGS)
+{
+	int valueCount = PG_NARGS();
+	int *valueArgnos = palloc(sizeof(int) * valueCount);
+
+	for (int i = 0; i < valueCount; i++)
+		valueArgnos[i] = i;
+
+	VectorValueFunctionState *state =
+		VectorValueFunctionBegin(fcinfo, valueArgnos, valueCount, 0);
+
+	CoalesceVectorValues(state->result, state->values, valueCount,
+						 state->result->dimension);
+
+	pfree(valueArgnos);
+
+	PG_RETURN_POINTER(state->result);
+}
+
+
+/*
+ * vnullif computes NULLIF in aggregate arguments.
+ */
+PG_FUNCTION_INFO_V1(vnullif);
+Datum
+vnullif(PG_FUNCTION_ARGS)
+{
+	int valueArgnos[2] = { 0, 1 };
+
+	VectorValueFunctionState *state =
+		VectorValueFunctionBegin(fcinfo, valueArgnos, 2, 0);
+
+	NullIfVectorValues(state->result, state->values, state->result->dimension);
+
+	PG_RETURN_POINTER(state->result);
+}
@@ -11,7 +11,10 @@
 
 #include "postgres.h"
 
+#include <sys/mman.h>
+
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "nodes/bitmapset.h"
 
 #include "columnar/columnar.h"
@@ -19,16 +22,70 @@
 
 #include "columnar/utils/listutils.h"
 
+/* size of the transparent huge pages that large vector arenas are put in */
+#define VECTOR_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static char * AllocVectorArena(Size size, char **allocation);
+
+
+/*
+ * AllocVectorArena returns size zeroed bytes aligned to
+ * COLUMNAR_VECTOR_ALIGNMENT, for the values and null flags of vectors, and
+ * sets allocation to the chunk to pfree them with. With
+ * columnar.vector_huge_pages on, arenas of at least a huge page are aligned
+ * to huge pages and the kernel is asked to back them with those, which
+ * saves TLB misses when scans of wide tables walk many vectors.
+ */
+static char *
+AllocVectorArena(Size size, char **allocation)
+{
+	Size alignment = COLUMNAR_VECTOR_ALIGNMENT;
+	bool useHugePages = false;
+
+#ifdef MADV_HUGEPAGE
+	if (columnar_vector_huge_pages && size >= VECTOR_HUGE_PAGE_SIZE)
+	{
+		alignment = VECTOR_HUGE_PAGE_SIZE;
+		useHugePages = true;
+	}
+#endif
+
+	*allocation = palloc_extended(size + alignment - 1, MCXT_ALLOC_HUGE);
+	char *arena = (char *) TYPEALIGN(alignment, *allocation);
+
+#ifdef MADV_HUGEPAGE
+
+	/* before the pages are first touched, so they are faulted in as huge pages */
+	if (useHugePages)
+	{
+		(void) madvise(arena, TYPEALIGN_DOWN(VECTOR_HUGE_PAGE_SIZE, size),
+					   MADV_HUGEPAGE);
+	}
+#endif
+
+	memset(arena, 0, size);
+
+	return arena;
+}
+
+
 VectorColumn *
-BuildVectorColumn(int16 columnDimension, int16 columnTypeLen, 
+BuildVectorColumn(uint32 columnCapacity, int16 columnTypeLen, 
 				  bool columnIsVal, uint64 *rowNumber)
 {
 	VectorColumn *vectorColumn;
 
 	vectorColumn = palloc0(sizeof(VectorColumn));
 
+	Size valueSize = VECTOR_BUFFER_SIZE((Size) columnTypeLen * columnCapacity);
+	Size isnullSize = VECTOR_BUFFER_SIZE(sizeof(bool) * columnCapacity);
+	char *arena = AllocVectorArena(Max(valueSize + isnullSize, 1),
+								   &vectorColumn->buffer);
+
 	vectorColumn->dimension = 0;
-	vectorColumn->value = palloc0(columnTypeLen * COLUMNAR_VECTOR_COLUMN_SIZE);
+	vectorColumn->capacity = columnCapacity;
+	vectorColumn->value = (Datum *) arena;
+	vectorColumn->isnull = (bool *) (arena + valueSize);
 	vectorColumn->columnTypeLen = columnTypeLen;
 	vectorColumn->columnIsVal = columnIsVal;
 	vectorColumn->rowNumber = rowNumber;
@@ -36,13 +93,134 @@ BuildVectorColumn(int16 columnDimension, int16 columnTypeLen,
 	return vectorColumn;
 }
 
-TupleTableSlot * 
+/*
+ * ReserveVectorColumn returns an empty vector of the given type length with
+ * room for dimension rows. The given vector is reused if it is large enough,
+ * otherwise it is freed and a new one is allocated in memoryContext.
+ */
+VectorColumn *
+ReserveVectorColumn(VectorColumn *column, uint32 dimension, int16 typeLen,
+					MemoryContext memoryContext)
+{
+	if (column == NULL || column->capacity < dimension)
+	{
+		if (column != NULL)
+		{
+			pfree(column->buffer);
+			if (column->runLength != NULL)
+				pfree(column->runLength);
+			pfree(column);
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(memoryContext);
+		column = BuildVectorColumn(dimension, typeLen, true, NULL);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	ResetVectorColumnRuns(column);
+	column->dimension = 0;
+	column->noNulls = false;
+
+	return column;
+}
+
+/*
+ * VectorFnResultColumn returns the result vector of a call of a vectorized
+ * operator, with room for dimension rows. The vector is kept in fn_extra and
+ * reused by the next calls through the same FmgrInfo, which each read the
+ * result before the next vector is evaluated, so evaluating quals and
+ * aggregate arguments doesn't allocate a new vector for each batch.
+ */
+VectorColumn *
+VectorFnResultColumn(FunctionCallInfo fcinfo, uint32 dimension, int16 resultTypeLen)
+{
+	FmgrInfo *flinfo = fcinfo->flinfo;
+
+	flinfo->fn_extra = ReserveVectorColumn((VectorColumn *) flinfo->fn_extra,
+										   dimension, resultTypeLen,
+										   flinfo->fn_mcxt);
+
+	return (VectorColumn *) flinfo->fn_extra;
+}
+
+/*
+ * BuildArithmeticResultColumn returns the result vector of a call of a
+ * vectorized arithmetic operator, with the rows that are NULL already set.
+ * left and right are set to the vectors of the arguments, or to NULL for
+ * arguments that are constants, whose values are passed as they are.
+ */
+VectorColumn *
+BuildArithmeticResultColumn(FunctionCallInfo fcinfo, int16 resultTypeLen,
+							VectorColumn **left, VectorColumn **right)
+{
+	bool leftIsConst = get_fn_expr_arg_stable(fcinfo->flinfo, 0);
+	bool rightIsConst = get_fn_expr_arg_stable(fcinfo->flinfo, 1);
+
+	if (leftIsConst && rightIsConst)
+	{
+		elog(ERROR, "vectorized operator needs a vector argument");
+	}
+
+	*left = leftIsConst ? NULL : (VectorColumn *) PG_GETARG_POINTER(0);
+	*right = rightIsConst ? NULL : (VectorColumn *) PG_GETARG_POINTER(1);
+
+	VectorColumn *vectorColumn = *left != NULL ? *left : *right;
+
+	VectorColumn *res = VectorFnResultColumn(fcinfo, vectorColumn->dimension,
+											 resultTypeLen);
+	res->dimension = vectorColumn->dimension;
+
+	if ((leftIsConst && PG_ARGISNULL(0)) || (rightIsConst && PG_ARGISNULL(1)))
+	{
+		memset(res->isnull, true, res->dimension);
+	}
+	else if (*left != NULL && *right != NULL)
+	{
+		for (uint32 i = 0; i < res->dimension; i++)
+			res->isnull[i] = (*left)->isnull[i] | (*right)->isnull[i];
+
+		res->noNulls = (*left)->noNulls && (*right)->noNulls;
+	}
+	else
+	{
+		memcpy(res->isnull, vectorColumn->isnull, res->dimension);
+		res->noNulls = vectorColumn->noNulls;
+	}
+
+	return res;
+}
+
+/*
+ * CreateVectorTupleTableSlot creates a vector slot with a vector for every
+ * attribute of the given tuple descriptor.
+ */
+TupleTableSlot *
 CreateVectorTupleTableSlot(TupleDesc tupleDesc)
 {
-	int						i;
+	Bitmapset *columns = NULL;
+	if (tupleDesc->natts > 0)
+	{
+		columns = bms_add_range(NULL, 0, tupleDesc->natts - 1);
+	}
+
+	return CreateProjectedVectorTupleTableSlot(tupleDesc, columns);
+}
+
+
+/*
+ * CreateProjectedVectorTupleTableSlot creates a vector slot with vectors only
+ * for the attributes whose 0-based indexes are in columns, so that scans of
+ * wide tables don't allocate vectors for the columns they don't read. The
+ * other attributes, and dropped ones, are NULL in the slot. The values and
+ * null flags of the vectors are carved out of one arena, each array aligned
+ * and padded to COLUMNAR_VECTOR_ALIGNMENT and sized by the length of the
+ * type of its column.
+ */
+TupleTableSlot *
+CreateProjectedVectorTupleTableSlot(TupleDesc tupleDesc, Bitmapset *columns)
+{
 	TupleTableSlot			*slot;
 	VectorTupleTableSlot	*vectorTTS;
-	VectorColumn			*vectorColumn;
 
 	static TupleTableSlotOps tts_ops;
 	tts_ops = TTSOpsVirtual;
@@ -54,41 +232,103 @@ CreateVectorTupleTableSlot(TupleDesc tupleDesc)
 
 	/* Vectorized TTS */
 	vectorTTS = (VectorTupleTableSlot*) slot;
-	
-	/* All tuples should be skipped in initialization */
-	memset(vectorTTS->keep, false, COLUMNAR_VECTOR_COLUMN_SIZE);
 
-	for (i = 0; i < slotTupleDesc->natts; i++)
-	{		
-		Oid columnTypeOid = TupleDescAttr(slotTupleDesc, i)->atttypid;
-		
-		int16 columnTypeLen = get_typlen(columnTypeOid);
+	/* the size is fixed for the slot, changes take effect with the next query */
+	vectorTTS->capacity = columnar_vector_size;
+	vectorTTS->hasSelection = false;
+	vectorTTS->selectionCount = 0;
+	vectorTTS->selection = palloc(sizeof(uint32) * vectorTTS->capacity);
+	vectorTTS->rowNumber = palloc0(sizeof(uint64) * vectorTTS->capacity);
+
+	int16 *vectorColumnTypeLens = palloc0(sizeof(int16) * Max(slotTupleDesc->natts, 1));
+	Size arenaSize = 0;
+
+	for (int i = 0; i < slotTupleDesc->natts; i++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(slotTupleDesc, i);
+
+		if (attributeForm->attisdropped || !bms_is_member(i, columns))
+		{
+			continue;
+		}
+
+		/* vectors of variable length types hold pointers to the values */
+		int16 columnTypeLen = get_typlen(attributeForm->atttypid);
+		vectorColumnTypeLens[i] = columnTypeLen < 0 ? sizeof(Datum) : columnTypeLen;
+
+		arenaSize += VECTOR_BUFFER_SIZE((Size) vectorColumnTypeLens[i] * vectorTTS->capacity) +
+					 VECTOR_BUFFER_SIZE(sizeof(bool) * vectorTTS->capacity);
+	}
+
+	char *arenaAllocation = NULL;
+	char *arena = AllocVectorArena(Max(arenaSize, 1), &arenaAllocation);
+
+	for (int i = 0; i < slotTupleDesc->natts; i++)
+	{
+		int16 vectorColumnTypeLen = vectorColumnTypeLens[i];
+
+		if (vectorColumnTypeLen == 0)
+		{
+			vectorTTS->tts.tts_values[i] = (Datum) 0;
+			vectorTTS->tts.tts_isnull[i] = true;
+			continue;
+		}
+
+		/*
+		 * The columns are allocated one by one, so that ExtendVectorColumnRuns
+		 * finds their memory context.
+		 */
+		VectorColumn *vectorColumn = palloc0(sizeof(VectorColumn));
 
-		int16 vectorColumnTypeLen = 
-			columnTypeLen == -1 ?  sizeof(Datum) : get_typlen(columnTypeOid);
+		vectorColumn->capacity = vectorTTS->capacity;
+		vectorColumn->value = (Datum *) arena;
+		arena += VECTOR_BUFFER_SIZE((Size) vectorColumnTypeLen * vectorTTS->capacity);
+		vectorColumn->isnull = (bool *) arena;
+		arena += VECTOR_BUFFER_SIZE(sizeof(bool) * vectorTTS->capacity);
+		vectorColumn->columnTypeLen = vectorColumnTypeLen;
 
 		/* 
 		 * We consider that type is passed by val also for cases where we have 
 		 * typlen == -1. This is because we use pointer to VARLEN type and don't
 		 * construct our own object.
 		*/
-		bool vectorColumnIsVal = vectorColumnTypeLen <= sizeof(Datum);
-
-		vectorColumn = BuildVectorColumn(COLUMNAR_VECTOR_COLUMN_SIZE,
-										 vectorColumnTypeLen,
-										 vectorColumnIsVal,
-										 vectorTTS->rowNumber);
+		vectorColumn->columnIsVal = vectorColumnTypeLen <= sizeof(Datum);
+		vectorColumn->rowNumber = vectorTTS->rowNumber;
 
 		vectorTTS->tts.tts_values[i] = PointerGetDatum(vectorColumn);
 		vectorTTS->tts.tts_isnull[i] = false;
 	}
 
+	pfree(vectorColumnTypeLens);
+
 	vectorTTS->tts.tts_nvalid = tupleDesc->natts;
 
 	return slot;
 }
 
 
+/*
+ * SetVectorSlotSelection sets the selection of the slot to the tuples for
+ * which qualResult is true. The loop has no branches, so its speed doesn't
+ * depend on how predictable the qual results are.
+ */
+void
+SetVectorSlotSelection(VectorTupleTableSlot *vectorSlot, bool *qualResult)
+{
+	uint32 *selection = vectorSlot->selection;
+	uint32 selectionCount = 0;
+
+	for (uint32 i = 0; i < vectorSlot->dimension; i++)
+	{
+		selection[selectionCount] = i;
+		selectionCount += qualResult[i];
+	}
+
+	vectorSlot->selectionCount = selectionCount;
+	vectorSlot->hasSelection = true;
+}
+
+
 void
 ExtractTupleFromVectorSlot(TupleTableSlot *out, VectorTupleTableSlot *vectorSlot, 
 						   int32 index, List *attrNeededList)
@@ -122,6 +362,11 @@ WriteTupleToVectorSlot(TupleTableSlot *in, VectorTupleTableSlot *vectorSlot,
 	{
 		VectorColumn *column = (VectorColumn *) vectorSlot->tts.tts_values[i];
 
+		if (column == NULL)
+		{
+			continue;
+		}
+
 		if (!in->tts_isnull[i])
 		{
 			column->isnull[column->dimension] = false;
@@ -162,10 +407,88 @@ CleanupVectorSlot(VectorTupleTableSlot *vectorSlot)
 	for (i = 0; i < tupDesc->natts; i++)
 	{
 		VectorColumn *column = (VectorColumn *) vectorSlot->tts.tts_values[i];
-		memset(column->isnull, true, COLUMNAR_VECTOR_COLUMN_SIZE);
+
+		/* columns the slot was created without */
+		if (column == NULL)
+		{
+			continue;
+		}
+
+		memset(column->isnull, true, column->capacity);
 		column->dimension = 0;
+		column->noNulls = false;
+		ResetVectorColumnRuns(column);
 	}
 	
-	memset(vectorSlot->keep, true, COLUMNAR_VECTOR_COLUMN_SIZE);
+	vectorSlot->hasSelection = false;
 	vectorSlot->dimension = 0;
-}
\ No newline at end of file
+}
+
+/*
+ * ExtendVectorColumnRuns adds the row at position dimension, which must have
+ * been written already, to the runs of the column.
+ */
+void
+ExtendVectorColumnRuns(VectorColumn *vectorColumn)
+{
+	uint32 position = vectorColumn->dimension;
+
+	if (vectorColumn->runLength == NULL)
+	{
+		vectorColumn->runLength =
+			MemoryContextAlloc(GetMemoryChunkContext(vectorColumn),
+							   sizeof(uint32) * vectorColumn->capacity);
+	}
+
+	if (position > 0 &&
+		vectorColumn->isnull[position] == vectorColumn->isnull[position - 1] &&
+		(vectorColumn->isnull[position] ||
+		 memcmp((int8 *) vectorColumn->value + vectorColumn->columnTypeLen * position,
+				(int8 *) vectorColumn->value + vectorColumn->columnTypeLen * (position - 1),
+				vectorColumn->columnTypeLen) == 0))
+	{
+		vectorColumn->runLength[vectorColumn->runCount - 1]++;
+	}
+	else
+	{
+		vectorColumn->runLength[vectorColumn->runCount++] = 1;
+	}
+}
+
+void
+ResetVectorColumnRuns(VectorColumn *vectorColumn)
+{
+	vectorColumn->hasRuns = false;
+	vectorColumn->runCount = 0;
+}
+
+/*
+ * CopyVectorColumnRuns gives target, which has the same rows as source, the
+ * runs of source.
+ */
+void
+CopyVectorColumnRuns(VectorColumn *target, VectorColumn *source)
+{
+	if (target->runLength == NULL)
+	{
+		target->runLength = MemoryContextAlloc(GetMemoryChunkContext(target),
+											   sizeof(uint32) * target->capacity);
+	}
+
+	memcpy(target->runLength, source->runLength, sizeof(uint32) * source->runCount);
+	target->runCount = source->runCount;
+	target->hasRuns = true;
+}
+
+/*
+ * ClearVectorColumn empties a column written since the vector slot was last
+ * cleaned up, leaving it as CleanupVectorSlot does.
+ */
+void
+ClearVectorColumn(VectorColumn *vectorColumn)
+{
+	memset(vectorColumn->isnull, true, vectorColumn->dimension);
+	vectorColumn->dimension = 0;
+	vectorColumn->noNulls = false;
+	ResetVectorColumnRuns(vectorColumn);
+}
@@ -287,9 +287,12 @@
 #include "utils/syscache.h"
 #include "utils/tuplesort.h"
 
+#include "columnar/columnar.h"
+#include "columnar/columnar_customscan.h"
 #include "columnar/vectorization/columnar_vector_types.h"
 #include "columnar/vectorization/columnar_vector_execution.h"
 #include "columnar/vectorization/nodes/columnar_aggregator_node.h"
+#include "columnar/vectorization/types/types.h"
 
 /*
  * Control how many partitions are created when spilling HashAgg to
@@ -415,6 +418,81 @@ typedef struct FindColsContext
 	Bitmapset  *unaggregated;	/* other column references */
 } FindColsContext;
 
+/*
+ * Hashed aggregation of vectors. The groups of the rows of a vector are looked
+ * up first, through a small open addressing cache in front of the hash table,
+ * and the rows are then sorted by group. The aggregated columns of each group
+ * are gathered into groupslot, whose vectors are passed to the transition
+ * functions once per group.
+ *
+ * Rows often come in runs of equal keys, as stripes of tables with a sort key
+ * are sorted and encoded chunks are read as runs. A row with the keys of the
+ * row before it joins its group without a lookup, and if no group of the
+ * vector is split (contiguous), the groups are ranges of rows that need no
+ * sorting and are copied as they are.
+ *
+ * The keys of all rows of a vector are hashed first, a grouping column at a
+ * time and once per run of a column read as runs, before the rows are looked
+ * up. Aggregates without aggregates, like hashed DISTINCT, only add groups.
+ *
+ * A cache entry remembers the group in the hash table, and the batch group it
+ * was given in the vector with number batchno. Keys are compared by their
+ * binary values, which the planner only allows for fixed width types.
+ *
+ * Once the hash table is over hash_mem, the rows of groups that are not in it
+ * are spilled. They are partitioned by the high bits of their key hashes, and
+ * written a column at a time for each partition of a vector, into the tapes
+ * of the partitions. The partitions are read back as vectors into spillslot
+ * and aggregated like the vectors of the scan, see agg_refill_hash_table().
+ */
+#define VECTOR_AGG_KEY_CACHE_SIZE 1024	/* must be a power of 2 */
+#define VECTOR_AGG_KEY_CACHE_PROBES 4
+
+typedef struct VectorAggKeyCacheEntry
+{
+	bool		used;
+	uint32		hash;
+	uint32		batchno;
+	uint32		batchgroup;
+	AggStatePerGroup pergroup;
+} VectorAggKeyCacheEntry;
+
+typedef struct VectorAggHashState
+{
+	int			numkeys;		/* number of grouping columns */
+	VectorAggKeyCacheEntry *cache;
+	Datum	   *cachekeys;		/* numkeys keys of each cache entry */
+	bool	   *cachenulls;
+	Datum	   *rowkeys;		/* keys of the current row */
+	bool	   *rownulls;
+	Datum	   *prevkeys;		/* keys of the row before it */
+	bool	   *prevnulls;
+
+	uint32		batchno;		/* number of the current vector */
+	uint32		ngroups;		/* groups of the current vector */
+	bool		contiguous;		/* each group is a range of rows */
+	AggStatePerGroup grouppergroup[COLUMNAR_VECTOR_COLUMN_SIZE];
+	uint32		groupsize[COLUMNAR_VECTOR_COLUMN_SIZE];
+	uint32		groupstart[COLUMNAR_VECTOR_COLUMN_SIZE + 1];
+	uint32		rowgroup[COLUMNAR_VECTOR_COLUMN_SIZE];
+	uint32		sortedrows[COLUMNAR_VECTOR_COLUMN_SIZE];
+	uint32		rowhash[COLUMNAR_VECTOR_COLUMN_SIZE];	/* hash of the keys of each row */
+
+	Bitmapset  *aggregated;		/* input columns under an aggref */
+	TupleTableSlot *groupslot;	/* vector slot holding the rows of a group */
+
+	uint32		nspilled;		/* rows of the current vector that are spilled */
+	uint32		spilledrows[COLUMNAR_VECTOR_COLUMN_SIZE];
+	uint32		spilledorder[COLUMNAR_VECTOR_COLUMN_SIZE];	/* by partition */
+	char	   *spillbuffer;	/* values of a fixed width column being spilled */
+	Size		spillbuffersize;
+	TupleTableSlot *spillslot;	/* vector slot that spilled rows are read into */
+	MemoryContext spillcontext; /* variable length values read from a tape */
+} VectorAggHashState;
+
+/* group of the spilled rows of a vector */
+#define VECTOR_AGG_SPILLED_GROUP PG_UINT32_MAX
+
 static void select_current_set(AggState *aggstate, int setno, bool is_hash);
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
@@ -425,6 +503,15 @@ static void advance_transition_function(AggState *aggstate,
 										AggStatePerTrans pertrans,
 										AggStatePerGroup pergroupstate);
 static void advance_aggregates(AggState *aggstate);
+static void advance_chunk_group_summary(AggState *aggstate,
+										AggStatePerGroup pergroup);
+static void advance_stripe_projection_group(AggState *aggstate,
+											AggStatePerGroup pergroup,
+											StripeProjectionSummary *summary,
+											StripeProjectionGroup *group);
+static void advance_stripe_projection(AggState *aggstate,
+									  AggStatePerGroup pergroup);
+static void hash_fill_stripe_projection(AggState *aggstate);
 static void process_ordered_aggregate_single(AggState *aggstate,
 											 AggStatePerTrans pertrans,
 											 AggStatePerGroup pergroupstate);
@@ -469,6 +556,27 @@ static void initialize_hash_entry(AggState *aggstate,
 static void lookup_hash_entries(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(VectorAggState *vectoraggstate);
 static void agg_fill_hash_table(AggState *aggstate);
+static VectorAggHashState *vector_agg_hash_state_create(AggState *aggstate);
+static void vector_agg_hash_keys(VectorAggHashState *hashstate,
+								 AggStatePerHash perhash,
+								 VectorTupleTableSlot *vectorslot);
+static void vector_agg_lookup_groups(AggState *aggstate,
+									 VectorAggHashState *hashstate,
+									 VectorTupleTableSlot *vectorslot);
+static void vector_agg_advance_group(AggState *aggstate,
+									 VectorAggHashState *hashstate,
+									 VectorTupleTableSlot *vectorslot,
+									 uint32 group);
+static void vector_agg_spill_rows(AggState *aggstate,
+								  VectorAggHashState *hashstate,
+								  VectorTupleTableSlot *vectorslot,
+								  HashAggSpill *spill);
+static void vector_agg_spill_write(HashAggSpill *spill, int partition,
+								   void *data, Size size);
+static VectorTupleTableSlot *vector_agg_spill_read(AggState *aggstate,
+												   VectorAggHashState *hashstate,
+												   HashAggBatch *batch);
+static void vector_agg_batch_read(HashAggBatch *batch, void *data, Size size);
 static bool agg_refill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table_in_memory(AggState *aggstate);
@@ -486,7 +594,6 @@ static HashAggBatch *hashagg_batch_new(LogicalTape *input_tape, int setno,
 #endif
 									   int64 input_tuples, double input_card,
 									   int used_bits);
-static MinimalTuple hashagg_batch_read(HashAggBatch *batch, uint32 *hashp);
 #if PG_VERSION_NUM < PG_VERSION_15
 static void hashagg_spill_init(HashAggSpill *spill, HashTapeInfo *tapeinfo,
 #else
@@ -520,6 +627,7 @@ static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
 									  int numArguments);
 #endif
 static AggState * VExecInitAgg(Agg *node, EState *estate, int eflags);
+static void VExecReScanAgg(AggState *node);
 
 /*
  * Select the current grouping set; affects current_set and
@@ -910,6 +1018,279 @@ advance_aggregates(AggState *aggstate)
 							  &dummynull);
 }
 
+/*
+ * Advance the aggregates of a plain aggregation with the chunk groups that
+ * the columnar scan below answered from their statistics, once the scan
+ * returned its other rows. The planner only asks the scan for them when the
+ * aggregates are count(*), or count, min, max or vapprox_count_distinct of a
+ * column, see ChunkGroupSummarySupported. Counts add the row or value counts
+ * of the chunk groups, min and max are advanced with a vector of the minimum
+ * and maximum values of each chunk group, and vapprox_count_distinct merges
+ * the distinct value sketches of the chunk groups.
+ */
+static void
+advance_chunk_group_summary(AggState *aggstate, AggStatePerGroup pergroup)
+{
+	ChunkGroupSummary *summary =
+		ColumnarScanChunkGroupSummary(outerPlanState(aggstate));
+	List	   *scanTargetList = outerPlan(aggstate->ss.ps.plan)->targetlist;
+	MemoryContext oldContext;
+
+	if (summary == NULL || summary->chunkGroupCount == 0)
+		return;
+
+	select_current_set(aggstate, 0, false);
+
+	for (int transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		AggStatePerGroup pergroupstate = &pergroup[transno];
+		Aggref	   *aggref = pertrans->aggref;
+
+		if (aggref->aggstar)
+		{
+			pergroupstate->transValue =
+				Int64GetDatum(DatumGetInt64(pergroupstate->transValue) +
+							  summary->rowCount);
+			continue;
+		}
+
+		Var		   *argument = (Var *) ((TargetEntry *) linitial(aggref->args))->expr;
+		Var		   *column = (Var *) ((TargetEntry *) list_nth(scanTargetList,
+															   argument->varattno - 1))->expr;
+		uint32		columnIndex = column->varattno - 1;
+
+		if (strcmp(get_func_name(aggref->aggfnoid), "vcount") == 0)
+		{
+			pergroupstate->transValue =
+				Int64GetDatum(DatumGetInt64(pergroupstate->transValue) +
+							  summary->valueCount[columnIndex]);
+			continue;
+		}
+
+		if (strcmp(get_func_name(aggref->aggfnoid), "vapprox_count_distinct") == 0)
+		{
+			pergroupstate->transValue =
+				VectorApproxCountDistinctAddSketch(pergroupstate->transValue,
+												   pergroupstate->transValueIsNull,
+												   aggstate->curaggcontext->ecxt_per_tuple_memory,
+												   get_typlen(column->vartype) == -1,
+												   summary->sketchRegisters[columnIndex]);
+			pergroupstate->transValueIsNull = false;
+			pergroupstate->noTransValue = false;
+			continue;
+		}
+
+		uint32		valueCount = summary->minMaxValueCount[columnIndex];
+		int16		typeLen = get_typlen(column->vartype);
+
+		if (valueCount == 0)
+			continue;
+
+		oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+		VectorColumn *minMaxColumn = BuildVectorColumn(valueCount, typeLen, true, NULL);
+
+		for (uint32 i = 0; i < valueCount; i++)
+			store_att_byval((int8 *) minMaxColumn->value + typeLen * i,
+							summary->minMaxValues[columnIndex][i], typeLen);
+		minMaxColumn->dimension = valueCount;
+
+		MemoryContextSwitchTo(oldContext);
+
+		pertrans->transfn_fcinfo->args[1].value = PointerGetDatum(minMaxColumn);
+		pertrans->transfn_fcinfo->args[1].isnull = false;
+
+		advance_transition_function(aggstate, pertrans, pergroupstate);
+	}
+
+	ResetExprContext(aggstate->tmpcontext);
+}
+
+/*
+ * Advance the aggregates of a group with a group of the stripe projections
+ * that the columnar scan below answered stripes with. The planner only asks
+ * the scan for them when the aggregates are count(*), or count or sum of a
+ * column, see StripeProjectionColumns. Counts add the row or value counts of
+ * the group, and sums add its sum, so that the stripes don't have to return
+ * rows.
+ */
+static void
+advance_stripe_projection_group(AggState *aggstate, AggStatePerGroup pergroup,
+								StripeProjectionSummary *summary,
+								StripeProjectionGroup *group)
+{
+	List	   *scanTargetList = outerPlan(aggstate->ss.ps.plan)->targetlist;
+
+	for (int transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		AggStatePerGroup pergroupstate = &pergroup[transno];
+		Aggref	   *aggref = pertrans->aggref;
+		StripeProjectionMeasure *measure = NULL;
+
+		if (aggref->aggstar)
+		{
+			pergroupstate->transValue =
+				Int64GetDatum(DatumGetInt64(pergroupstate->transValue) +
+							  group->rowCount);
+			continue;
+		}
+
+		Var		   *argument = (Var *) ((TargetEntry *) linitial(aggref->args))->expr;
+		Var		   *column = (Var *) ((TargetEntry *) list_nth(scanTargetList,
+															   argument->varattno - 1))->expr;
+
+		for (int i = 0; i < summary->measureCount; i++)
+		{
+			if (summary->measureAttnums[i] == column->varattno)
+				measure = &group->measures[i];
+		}
+
+		if (measure == NULL)
+			elog(ERROR, "column %d is missing from the stripe projections",
+				 column->varattno);
+
+		if (strcmp(get_func_name(aggref->aggfnoid), "vcount") == 0)
+		{
+			pergroupstate->transValue =
+				Int64GetDatum(DatumGetInt64(pergroupstate->transValue) +
+							  measure->valueCount);
+			continue;
+		}
+
+		/* sums of integers are kept in an int8 state, see vsum */
+		if (pertrans->aggtranstype == INT8OID)
+		{
+			pergroupstate->transValue =
+				Int64GetDatum(DatumGetInt64(pergroupstate->transValue) +
+							  measure->intSum);
+			continue;
+		}
+
+		/* the sum of a float column is NULL until it sees a value */
+		if (measure->valueCount == 0)
+			continue;
+
+		if (pertrans->aggtranstype == FLOAT4OID)
+		{
+			float4		sum = (float4) measure->floatSum;
+
+			if (!pergroupstate->transValueIsNull)
+				sum += DatumGetFloat4(pergroupstate->transValue);
+
+			pergroupstate->transValue = Float4GetDatum(sum);
+		}
+		else
+		{
+			float8		sum = measure->floatSum;
+			MemoryContext oldContext;
+
+			if (!pergroupstate->transValueIsNull)
+				sum += DatumGetFloat8(pergroupstate->transValue);
+
+			oldContext = MemoryContextSwitchTo(aggstate->curaggcontext->ecxt_per_tuple_memory);
+			pergroupstate->transValue = datumCopy(Float8GetDatum(sum),
+												  pertrans->transtypeByVal,
+												  pertrans->transtypeLen);
+			MemoryContextSwitchTo(oldContext);
+		}
+
+		pergroupstate->transValueIsNull = false;
+		pergroupstate->noTransValue = false;
+	}
+}
+
+/*
+ * Advance the aggregates of a plain aggregation with the stripes that the
+ * columnar scan below answered from their projections, once the scan
+ * returned its other rows.
+ */
+static void
+advance_stripe_projection(AggState *aggstate, AggStatePerGroup pergroup)
+{
+	StripeProjectionSummary *summary =
+		ColumnarScanStripeProjectionSummary(outerPlanState(aggstate));
+	HASH_SEQ_STATUS status;
+	StripeProjectionGroup *group;
+
+	if (summary == NULL || summary->stripeCount == 0)
+		return;
+
+	select_current_set(aggstate, 0, false);
+
+	hash_seq_init(&status, summary->groups);
+	while ((group = hash_seq_search(&status)) != NULL)
+		advance_stripe_projection_group(aggstate, pergroup, summary, group);
+}
+
+/*
+ * Add the groups of the stripes that the columnar scan below answered from
+ * their projections to the hash table of a hashed aggregation, once the scan
+ * returned its other rows. The columns of the hash table are all group by
+ * columns of the projections, see StripeProjectionColumns.
+ */
+static void
+hash_fill_stripe_projection(AggState *aggstate)
+{
+	StripeProjectionSummary *summary =
+		ColumnarScanStripeProjectionSummary(outerPlanState(aggstate));
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	TupleTableSlot *hashslot = perhash->hashslot;
+	List	   *scanTargetList = outerPlan(aggstate->ss.ps.plan)->targetlist;
+	int			keyIndexes[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+	HASH_SEQ_STATUS status;
+	StripeProjectionGroup *group;
+
+	if (summary == NULL || summary->stripeCount == 0)
+		return;
+
+	Assert(perhash->numhashGrpCols <= PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM);
+
+	for (int i = 0; i < perhash->numhashGrpCols; i++)
+	{
+		Var		   *column = (Var *) ((TargetEntry *) list_nth(scanTargetList,
+															   perhash->hashGrpColIdxInput[i] - 1))->expr;
+
+		keyIndexes[i] = -1;
+		for (int keyIndex = 0; keyIndex < summary->groupCount; keyIndex++)
+		{
+			if (summary->groupAttnums[keyIndex] == column->varattno)
+				keyIndexes[i] = keyIndex;
+		}
+
+		if (keyIndexes[i] < 0)
+			elog(ERROR, "column %d is missing from the stripe projections",
+				 column->varattno);
+	}
+
+	select_current_set(aggstate, 0, true);
+
+	hash_seq_init(&status, summary->groups);
+	while ((group = hash_seq_search(&status)) != NULL)
+	{
+		TupleHashEntry hashentry;
+		uint32		hashvalue;
+		bool		isnew = false;
+
+		ExecClearTuple(hashslot);
+		for (int i = 0; i < perhash->numhashGrpCols; i++)
+		{
+			hashslot->tts_isnull[i] = group->keyNulls[keyIndexes[i]];
+			hashslot->tts_values[i] = group->keyValues[keyIndexes[i]];
+		}
+		ExecStoreVirtualTuple(hashslot);
+
+		hashentry = LookupTupleHashEntry(perhash->hashtable, hashslot,
+										 &isnew, &hashvalue);
+		if (isnew)
+			initialize_hash_entry(aggstate, perhash->hashtable, hashentry);
+
+		advance_stripe_projection_group(aggstate, hashentry->additional,
+										summary, group);
+	}
+}
+
 /*
  * Run the transition function for a DISTINCT or ORDER BY aggregate
  * with only one input.  This is called after we have completed
@@ -1948,7 +2329,9 @@ static void
 hash_agg_enter_spill_mode(AggState *aggstate)
 {
 	aggstate->hash_spill_mode = true;
-	hashagg_recompile_expressions(aggstate, aggstate->table_filled, true);
+
+	/* spilled rows are read back as vectors, see agg_refill_hash_table() */
+	hashagg_recompile_expressions(aggstate, false, true);
 
 	if (!aggstate->hash_ever_spilled)
 	{
@@ -2616,6 +2999,13 @@ agg_retrieve_direct(VectorAggState *vectoraggstate)
 				}
 			}
 
+			/* the chunk groups and stripes that the scan didn't return rows of */
+			if (node->aggstrategy == AGG_PLAIN && !hasGroupingSets)
+			{
+				advance_chunk_group_summary(aggstate, pergroups[0]);
+				advance_stripe_projection(aggstate, pergroups[0]);
+			}
+
 			/*
 			 * Use the representative input tuple for any references to
 			 * non-aggregated input columns in aggregate direct args, the node
@@ -2654,39 +3044,83 @@ agg_retrieve_direct(VectorAggState *vectoraggstate)
 
 /*
  * ExecAgg for hashed case: read input and build hash table
+ *
+ * The input is read a vector at a time, see VectorAggHashState. New groups
+ * are added for a whole vector before its rows are aggregated, which the
+ * spilling of single tuples doesn't fit, so the hash table is kept in memory
+ * whatever its size. The planner only uses this node for hashed aggregates
+ * whose groups are expected to fit in hash_mem.
  */
 static void
 agg_fill_hash_table(AggState *aggstate)
 {
 	TupleTableSlot *outerslot;
-	ExprContext *tmpcontext = aggstate->tmpcontext;
+	VectorAggHashState *hashstate;
+	MemoryContext hashstatecxt;
+	MemoryContext oldcontext;
+
+	Assert(aggstate->num_hashes == 1);
+
+	/*
+	 * The groups that the stripe projections of the scan add once it is done
+	 * can't be spilled, so such aggregations keep all groups in memory, see
+	 * StripeProjectionColumns() of the planner hook.
+	 */
+	if (ColumnarScanStripeProjectionSummary(outerPlanState(aggstate)) != NULL)
+	{
+		aggstate->hash_mem_limit = SIZE_MAX;
+		aggstate->hash_ngroups_limit = PG_UINT64_MAX;
+	}
+
+	hashstatecxt = AllocSetContextCreate(CurrentMemoryContext,
+										 "VectorAgg hash fill",
+										 ALLOCSET_DEFAULT_SIZES);
+	oldcontext = MemoryContextSwitchTo(hashstatecxt);
+	hashstate = vector_agg_hash_state_create(aggstate);
+	MemoryContextSwitchTo(oldcontext);
 
 	/*
-	 * Process each outer-plan tuple, and then fetch the next one, until we
+	 * Process each outer-plan vector, and then fetch the next one, until we
 	 * exhaust the outer plan.
 	 */
 	for (;;)
 	{
+		VectorTupleTableSlot *vectorslot;
+
 		outerslot = fetch_input_tuple(aggstate);
 		if (TupIsNull(outerslot))
 			break;
 
-		/* set up for lookup_hash_entries and advance_aggregates */
-		tmpcontext->ecxt_outertuple = outerslot;
+		vectorslot = (VectorTupleTableSlot *) outerslot;
+		if (vectorslot->dimension == 0)
+			continue;
+
+		if (hashstate->groupslot == NULL)
+		{
+			oldcontext = MemoryContextSwitchTo(hashstatecxt);
+			hashstate->groupslot =
+				CreateVectorTupleTableSlot(outerslot->tts_tupleDescriptor);
+			MemoryContextSwitchTo(oldcontext);
+		}
 
-		/* Find or build hashtable entries */
-		lookup_hash_entries(aggstate);
+		/* Find or build hashtable entries of all rows */
+		vector_agg_lookup_groups(aggstate, hashstate, vectorslot);
 
-		/* Advance the aggregates (or combine functions) */
-		advance_aggregates(aggstate);
+		/* Advance the aggregates (or combine functions) of each group */
+		for (uint32 group = 0; group < hashstate->ngroups; group++)
+			vector_agg_advance_group(aggstate, hashstate, vectorslot, group);
 
-		/*
-		 * Reset per-input-tuple context after each tuple, but note that the
-		 * hash lookups do this too
-		 */
-		ResetExprContext(aggstate->tmpcontext);
+		/* the rows of groups that didn't fit in hash_mem */
+		if (hashstate->nspilled > 0)
+			vector_agg_spill_rows(aggstate, hashstate, vectorslot,
+								  &aggstate->hash_spills[0]);
 	}
 
+	MemoryContextDelete(hashstatecxt);
+
+	/* the stripes that the scan didn't return rows of */
+	hash_fill_stripe_projection(aggstate);
+
 	/* finalize spills, if any */
 	hashagg_finish_initial_spills(aggstate);
 
@@ -2697,12 +3131,622 @@ agg_fill_hash_table(AggState *aggstate)
 						   &aggstate->perhash[0].hashiter);
 }
 
+/*
+ * Create the state of a hashed aggregation of vectors, in the current memory
+ * context.
+ */
+static VectorAggHashState *
+vector_agg_hash_state_create(AggState *aggstate)
+{
+	VectorAggHashState *hashstate = palloc0(sizeof(VectorAggHashState));
+	Bitmapset  *unaggregated = NULL;
+
+	hashstate->numkeys = aggstate->perhash[0].aggnode->numCols;
+	hashstate->cache = palloc0(sizeof(VectorAggKeyCacheEntry) *
+							   VECTOR_AGG_KEY_CACHE_SIZE);
+	hashstate->cachekeys = palloc(sizeof(Datum) * hashstate->numkeys *
+								  VECTOR_AGG_KEY_CACHE_SIZE);
+	hashstate->cachenulls = palloc(sizeof(bool) * hashstate->numkeys *
+								   VECTOR_AGG_KEY_CACHE_SIZE);
+	hashstate->rowkeys = palloc(sizeof(Datum) * hashstate->numkeys);
+	hashstate->rownulls = palloc(sizeof(bool) * hashstate->numkeys);
+	hashstate->prevkeys = palloc(sizeof(Datum) * hashstate->numkeys);
+	hashstate->prevnulls = palloc(sizeof(bool) * hashstate->numkeys);
+	find_cols(aggstate, &hashstate->aggregated, &unaggregated);
+
+	return hashstate;
+}
+
+/*
+ * Hash the keys of each row of the vector into hashstate->rowhash. Each key
+ * is hashed with its binary value and null flag, and the rows of a run of a
+ * column read as runs share the hash of the run's key.
+ */
+static void
+vector_agg_hash_keys(VectorAggHashState *hashstate, AggStatePerHash perhash,
+					 VectorTupleTableSlot *vectorslot)
+{
+	uint32		dimension = vectorslot->dimension;
+	uint32	   *rowhash = hashstate->rowhash;
+
+	memset(rowhash, 0, sizeof(uint32) * dimension);
+
+	for (int i = 0; i < hashstate->numkeys; i++)
+	{
+		int			varNumber = perhash->hashGrpColIdxInput[i] - 1;
+		VectorColumn *column = (VectorColumn *) vectorslot->tts.tts_values[varNumber];
+		uint16		typeLen = column->columnTypeLen;
+
+		if (column->hasRuns)
+		{
+			uint32		position;
+			uint32		length;
+
+			foreach_vector_run(column, position, length)
+			{
+				bool		isnull = column->isnull[position];
+				Datum		key = isnull ? (Datum) 0 :
+					fetch_att((int8 *) column->value + typeLen * position, true, typeLen);
+				uint32		keyhash = murmurhash32((uint32) key ^
+												   (uint32) ((uint64) key >> 32) ^
+												   isnull);
+
+				for (uint32 row = position; row < position + length; row++)
+					rowhash[row] = hash_combine(rowhash[row], keyhash);
+			}
+
+			continue;
+		}
+
+		for (uint32 row = 0; row < dimension; row++)
+		{
+			bool		isnull = column->isnull[row];
+			Datum		key = isnull ? (Datum) 0 :
+				fetch_att((int8 *) column->value + typeLen * row, true, typeLen);
+
+			rowhash[row] = hash_combine(rowhash[row],
+										murmurhash32((uint32) key ^
+													 (uint32) ((uint64) key >> 32) ^
+													 isnull));
+		}
+	}
+}
+
+/*
+ * Find the group of each row of the vector, and sort the rows by group into
+ * hashstate->sortedrows unless the groups are contiguous. Groups missing from
+ * the key cache are looked up in the hash table, and added to it if they are
+ * new. In spill mode, the rows of new groups are added to
+ * hashstate->spilledrows instead.
+ */
+static void
+vector_agg_lookup_groups(AggState *aggstate, VectorAggHashState *hashstate,
+						 VectorTupleTableSlot *vectorslot)
+{
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	TupleTableSlot *hashslot = perhash->hashslot;
+	int			numkeys = hashstate->numkeys;
+	uint32		dimension = vectorslot->dimension;
+	uint32	   *groupsize = hashstate->groupsize;
+
+	select_current_set(aggstate, 0, true);
+
+	hashstate->batchno++;
+	hashstate->ngroups = 0;
+	hashstate->nspilled = 0;
+	hashstate->contiguous = true;
+
+	vector_agg_hash_keys(hashstate, perhash, vectorslot);
+
+	for (uint32 row = 0; row < dimension; row++)
+	{
+		VectorAggKeyCacheEntry *entry = NULL;
+		VectorAggKeyCacheEntry *victim = NULL;
+		uint32		hash = hashstate->rowhash[row];
+		uint32		slotno;
+
+		for (int i = 0; i < numkeys; i++)
+		{
+			int			varNumber = perhash->hashGrpColIdxInput[i] - 1;
+			VectorColumn *column = (VectorColumn *) vectorslot->tts.tts_values[varNumber];
+
+			hashstate->rownulls[i] = column->isnull[row];
+			hashstate->rowkeys[i] = hashstate->rownulls[i] ? (Datum) 0 :
+				fetch_att((int8 *) column->value + column->columnTypeLen * row,
+						  true, column->columnTypeLen);
+		}
+
+		/* the row continues the run of the row before it */
+		if (row > 0 &&
+			memcmp(hashstate->rowkeys, hashstate->prevkeys,
+				   sizeof(Datum) * numkeys) == 0 &&
+			memcmp(hashstate->rownulls, hashstate->prevnulls,
+				   sizeof(bool) * numkeys) == 0)
+		{
+			hashstate->rowgroup[row] = hashstate->rowgroup[row - 1];
+			if (hashstate->rowgroup[row] == VECTOR_AGG_SPILLED_GROUP)
+				hashstate->spilledrows[hashstate->nspilled++] = row;
+			else
+				groupsize[hashstate->rowgroup[row]]++;
+			continue;
+		}
+
+		for (int probe = 0; probe < VECTOR_AGG_KEY_CACHE_PROBES; probe++)
+		{
+			VectorAggKeyCacheEntry *candidate;
+
+			slotno = (hash + probe) & (VECTOR_AGG_KEY_CACHE_SIZE - 1);
+			candidate = &hashstate->cache[slotno];
+
+			if (!candidate->used)
+			{
+				victim = candidate;
+				break;
+			}
+
+			if (candidate->hash == hash &&
+				memcmp(&hashstate->cachekeys[slotno * numkeys], hashstate->rowkeys,
+					   sizeof(Datum) * numkeys) == 0 &&
+				memcmp(&hashstate->cachenulls[slotno * numkeys], hashstate->rownulls,
+					   sizeof(bool) * numkeys) == 0)
+			{
+				entry = candidate;
+				break;
+			}
+		}
+
+		if (entry == NULL)
+		{
+			TupleHashEntry hashentry;
+			uint32		hashvalue;
+			bool		isnew = false;
+
+			/* replace the first probed entry if all of them were taken */
+			if (victim == NULL)
+			{
+				slotno = hash & (VECTOR_AGG_KEY_CACHE_SIZE - 1);
+				victim = &hashstate->cache[slotno];
+			}
+			else
+				slotno = victim - hashstate->cache;
+
+			/* the hash table stores the other needed columns too */
+			ExecClearTuple(hashslot);
+			for (int i = 0; i < perhash->numhashGrpCols; i++)
+			{
+				int			varNumber = perhash->hashGrpColIdxInput[i] - 1;
+				VectorColumn *column = (VectorColumn *) vectorslot->tts.tts_values[varNumber];
+
+				hashslot->tts_isnull[i] = column->isnull[row];
+				hashslot->tts_values[i] = column->isnull[row] ? (Datum) 0 :
+					fetch_att((int8 *) column->value + column->columnTypeLen * row,
+							  column->columnIsVal, column->columnTypeLen);
+			}
+			ExecStoreVirtualTuple(hashslot);
+
+			/* in spill mode, only groups already in the table are found */
+			hashentry = LookupTupleHashEntry(perhash->hashtable, hashslot,
+											 aggstate->hash_spill_mode ? NULL : &isnew,
+											 &hashvalue);
+			if (hashentry != NULL)
+			{
+				if (isnew)
+					initialize_hash_entry(aggstate, perhash->hashtable, hashentry);
+
+				entry = victim;
+				entry->used = true;
+				entry->hash = hash;
+				entry->batchno = 0;
+				entry->pergroup = hashentry->additional;
+				memcpy(&hashstate->cachekeys[slotno * numkeys], hashstate->rowkeys,
+					   sizeof(Datum) * numkeys);
+				memcpy(&hashstate->cachenulls[slotno * numkeys], hashstate->rownulls,
+					   sizeof(bool) * numkeys);
+			}
+		}
+
+		if (entry == NULL)
+		{
+			hashstate->rowgroup[row] = VECTOR_AGG_SPILLED_GROUP;
+			hashstate->spilledrows[hashstate->nspilled++] = row;
+		}
+		else
+		{
+			if (entry->batchno != hashstate->batchno)
+			{
+				entry->batchno = hashstate->batchno;
+				entry->batchgroup = hashstate->ngroups;
+				hashstate->grouppergroup[hashstate->ngroups] = entry->pergroup;
+				groupsize[hashstate->ngroups] = 0;
+				hashstate->ngroups++;
+			}
+			else
+			{
+				/* a run of a group that already had rows before another run */
+				hashstate->contiguous = false;
+			}
+
+			hashstate->rowgroup[row] = entry->batchgroup;
+			groupsize[entry->batchgroup]++;
+		}
+
+		/* the keys of this row are compared with those of the next one */
+		Datum	   *swapkeys = hashstate->prevkeys;
+		bool	   *swapnulls = hashstate->prevnulls;
+
+		hashstate->prevkeys = hashstate->rowkeys;
+		hashstate->prevnulls = hashstate->rownulls;
+		hashstate->rowkeys = swapkeys;
+		hashstate->rownulls = swapnulls;
+	}
+
+	/* counting sort of the rows by group */
+	uint32		position = 0;
+
+	for (uint32 group = 0; group < hashstate->ngroups; group++)
+	{
+		hashstate->groupstart[group] = position;
+		position += groupsize[group];
+		groupsize[group] = hashstate->groupstart[group];
+	}
+	hashstate->groupstart[hashstate->ngroups] = position;
+
+	/*
+	 * Groups are in the order of their first rows, so they are sorted, unless
+	 * spilled rows are between them.
+	 */
+	if (hashstate->contiguous && hashstate->nspilled == 0)
+		return;
+
+	hashstate->contiguous = false;
+
+	for (uint32 row = 0; row < dimension; row++)
+	{
+		uint32		group = hashstate->rowgroup[row];
+
+		if (group != VECTOR_AGG_SPILLED_GROUP)
+			hashstate->sortedrows[groupsize[group]++] = row;
+	}
+}
+
+/*
+ * Advance the transition states of a group of the vector with its rows. A
+ * vector of a single group without spilled rows is passed as it is;
+ * otherwise the rows of the group are gathered into the group slot first, or
+ * copied as a range if the groups are contiguous.
+ */
+static void
+vector_agg_advance_group(AggState *aggstate, VectorAggHashState *hashstate,
+						 VectorTupleTableSlot *vectorslot, uint32 group)
+{
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+	AggStatePerGroup pergroup = hashstate->grouppergroup[group];
+	uint32		start = hashstate->groupstart[group];
+	uint32		nrows = hashstate->groupstart[group + 1] - start;
+	TupleTableSlot *inputslot = (TupleTableSlot *) vectorslot;
+	int			attno;
+
+	/* no aggregates, the group only had to be added */
+	if (aggstate->numtrans == 0)
+		return;
+
+	if (hashstate->ngroups > 1 || hashstate->nspilled > 0)
+	{
+		VectorTupleTableSlot *groupslot =
+			(VectorTupleTableSlot *) hashstate->groupslot;
+
+		attno = -1;
+		while ((attno = bms_next_member(hashstate->aggregated, attno)) >= 0)
+		{
+			VectorColumn *source = (VectorColumn *) vectorslot->tts.tts_values[attno - 1];
+			VectorColumn *target = (VectorColumn *) groupslot->tts.tts_values[attno - 1];
+			uint16		typeLen = source->columnTypeLen;
+
+			if (hashstate->contiguous)
+			{
+				memcpy(target->value, (int8 *) source->value + typeLen * start,
+					   typeLen * nrows);
+				memcpy(target->isnull, &source->isnull[start], sizeof(bool) * nrows);
+			}
+			else
+			{
+				const uint32 *rows = &hashstate->sortedrows[start];
+
+				switch (typeLen)
+				{
+					case sizeof(int64):
+						for (uint32 i = 0; i < nrows; i++)
+							((int64 *) target->value)[i] = ((int64 *) source->value)[rows[i]];
+						break;
+					case sizeof(int32):
+						for (uint32 i = 0; i < nrows; i++)
+							((int32 *) target->value)[i] = ((int32 *) source->value)[rows[i]];
+						break;
+					case sizeof(int16):
+						for (uint32 i = 0; i < nrows; i++)
+							((int16 *) target->value)[i] = ((int16 *) source->value)[rows[i]];
+						break;
+					default:
+						for (uint32 i = 0; i < nrows; i++)
+							memcpy((int8 *) target->value + typeLen * i,
+								   (int8 *) source->value + typeLen * rows[i],
+								   typeLen);
+						break;
+				}
+
+				for (uint32 i = 0; i < nrows; i++)
+					target->isnull[i] = source->isnull[rows[i]];
+			}
+
+			target->dimension = nrows;
+			target->hasRuns = false;
+			target->runCount = 0;
+			target->noNulls = source->noNulls;
+		}
+
+		ExecClearTuple(hashstate->groupslot);
+		groupslot->dimension = nrows;
+		ExecStoreVirtualTuple(hashstate->groupslot);
+
+		inputslot = hashstate->groupslot;
+	}
+
+	select_current_set(aggstate, 0, true);
+	aggstate->hash_pergroup[0] = pergroup;
+	tmpcontext->ecxt_outertuple = inputslot;
+
+	advance_aggregates(aggstate);
+
+	/* COUNT(*) is counted here, its transition function gets no rows */
+	for (int transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+
+		if (pertrans->aggref->aggstar)
+			pergroup[transno].transValue += nrows;
+	}
+
+	/* Reset per-input-tuple context after each group */
+	ResetExprContext(tmpcontext);
+}
+
+/*
+ * Write the spilled rows of the vector to the partitions of the given spill.
+ * The rows are sorted by partition, and for each partition with rows, their
+ * number is written, followed by the null flags and the values of each
+ * needed column. Only the columns the aggregation needs are spilled, the
+ * others are read back as NULL.
+ */
+static void
+vector_agg_spill_rows(AggState *aggstate, VectorAggHashState *hashstate,
+					  VectorTupleTableSlot *vectorslot, HashAggSpill *spill)
+{
+	TupleDesc	tupleDesc = vectorslot->tts.tts_tupleDescriptor;
+	uint32		nspilled = hashstate->nspilled;
+	uint32		partitionstart[HASHAGG_MAX_PARTITIONS + 1];
+	bool		nulls[COLUMNAR_VECTOR_COLUMN_SIZE];
+
+	Assert(spill->partitions != NULL);
+
+	/* counting sort of the spilled rows by partition */
+	memset(partitionstart, 0, sizeof(uint32) * (spill->npartitions + 1));
+
+	for (uint32 i = 0; i < nspilled; i++)
+	{
+		uint32		hash = hashstate->rowhash[hashstate->spilledrows[i]];
+
+		partitionstart[((hash & spill->mask) >> spill->shift) + 1]++;
+	}
+
+	for (int partition = 0; partition < spill->npartitions; partition++)
+		partitionstart[partition + 1] += partitionstart[partition];
+
+	for (uint32 i = 0; i < nspilled; i++)
+	{
+		uint32		row = hashstate->spilledrows[i];
+		uint32		hash = hashstate->rowhash[row];
+		int			partition = (hash & spill->mask) >> spill->shift;
+
+		hashstate->spilledorder[partitionstart[partition]++] = row;
+
+		/*
+		 * All hash values destined for a given partition have some bits in
+		 * common, which causes bad HLL cardinality estimates. Hash the hash
+		 * to get a more uniform distribution.
+		 */
+		addHyperLogLog(&spill->hll_card[partition], hash_bytes_uint32(hash));
+	}
+
+	/* the counting moved each start to the start of the next partition */
+	for (int partition = spill->npartitions; partition > 0; partition--)
+		partitionstart[partition] = partitionstart[partition - 1];
+	partitionstart[0] = 0;
+
+	for (int partition = 0; partition < spill->npartitions; partition++)
+	{
+		uint32		start = partitionstart[partition];
+		uint32		nrows = partitionstart[partition + 1] - start;
+		const uint32 *rows = &hashstate->spilledorder[start];
+
+		if (nrows == 0)
+			continue;
+
+		spill->ntuples[partition] += nrows;
+		vector_agg_spill_write(spill, partition, &nrows, sizeof(uint32));
+
+		for (int attno = 1; attno <= tupleDesc->natts; attno++)
+		{
+			VectorColumn *column = (VectorColumn *) vectorslot->tts.tts_values[attno - 1];
+			int16		attlen = TupleDescAttr(tupleDesc, attno - 1)->attlen;
+			uint16		typeLen = column->columnTypeLen;
+
+			if (!aggstate->all_cols_needed &&
+				!bms_is_member(attno, aggstate->colnos_needed))
+				continue;
+
+			for (uint32 i = 0; i < nrows; i++)
+				nulls[i] = column->isnull[rows[i]];
+			vector_agg_spill_write(spill, partition, nulls, sizeof(bool) * nrows);
+
+			if (attlen > 0)
+			{
+				Size		size = (Size) typeLen * nrows;
+
+				if (size > hashstate->spillbuffersize)
+				{
+					if (hashstate->spillbuffer != NULL)
+						pfree(hashstate->spillbuffer);
+					hashstate->spillbuffer =
+						MemoryContextAlloc(GetMemoryChunkContext(hashstate), size);
+					hashstate->spillbuffersize = size;
+				}
+
+				for (uint32 i = 0; i < nrows; i++)
+					memcpy(hashstate->spillbuffer + typeLen * i,
+						   (int8 *) column->value + typeLen * rows[i], typeLen);
+				vector_agg_spill_write(spill, partition, hashstate->spillbuffer, size);
+				continue;
+			}
+
+			/* vectors of variable length types hold pointers to the values */
+			for (uint32 i = 0; i < nrows; i++)
+			{
+				Datum		value = column->value[rows[i]];
+				uint32		size;
+
+				if (nulls[i])
+					continue;
+
+				size = datumGetSize(value, false, attlen);
+				vector_agg_spill_write(spill, partition, &size, sizeof(uint32));
+				vector_agg_spill_write(spill, partition, DatumGetPointer(value), size);
+			}
+		}
+	}
+}
+
+/*
+ * Write data to the tape of the given partition of a spill.
+ */
+static void
+vector_agg_spill_write(HashAggSpill *spill, int partition, void *data, Size size)
+{
+#if PG_VERSION_NUM < PG_VERSION_15
+	LogicalTapeWrite(spill->tapeset, spill->partitions[partition], data, size);
+#else
+	LogicalTapeWrite(spill->partitions[partition], data, size);
+#endif
+}
+
+/*
+ * Read the next vector of spilled rows of the batch into the spill slot, as
+ * written by vector_agg_spill_rows(), and return it. Returns NULL once the
+ * batch is exhausted.
+ */
+static VectorTupleTableSlot *
+vector_agg_spill_read(AggState *aggstate, VectorAggHashState *hashstate,
+					  HashAggBatch *batch)
+{
+	VectorTupleTableSlot *vectorslot = (VectorTupleTableSlot *) hashstate->spillslot;
+	TupleDesc	tupleDesc = vectorslot->tts.tts_tupleDescriptor;
+	uint32		nrows;
+	size_t		nread;
+
+#if PG_VERSION_NUM < PG_VERSION_15
+	nread = LogicalTapeRead(batch->tapeset, batch->input_tapenum, &nrows,
+							sizeof(uint32));
+#else
+	nread = LogicalTapeRead(batch->input_tape, &nrows, sizeof(uint32));
+#endif
+	if (nread == 0)
+		return NULL;
+	if (nread != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg_internal("unexpected EOF for hash aggregate spill: requested %zu bytes, read %zu bytes",
+								 sizeof(uint32), nread)));
+
+	MemoryContextReset(hashstate->spillcontext);
+	ExecClearTuple(hashstate->spillslot);
+
+	for (int attno = 1; attno <= tupleDesc->natts; attno++)
+	{
+		VectorColumn *column = (VectorColumn *) vectorslot->tts.tts_values[attno - 1];
+		int16		attlen = TupleDescAttr(tupleDesc, attno - 1)->attlen;
+
+		column->dimension = nrows;
+		column->hasRuns = false;
+		column->runCount = 0;
+		column->noNulls = false;
+
+		if (!aggstate->all_cols_needed &&
+			!bms_is_member(attno, aggstate->colnos_needed))
+		{
+			memset(column->isnull, true, sizeof(bool) * nrows);
+			continue;
+		}
+
+		vector_agg_batch_read(batch, column->isnull, sizeof(bool) * nrows);
+
+		if (attlen > 0)
+		{
+			vector_agg_batch_read(batch, column->value,
+								  (Size) column->columnTypeLen * nrows);
+			continue;
+		}
+
+		for (uint32 row = 0; row < nrows; row++)
+		{
+			uint32		size;
+			char	   *value;
+
+			if (column->isnull[row])
+				continue;
+
+			vector_agg_batch_read(batch, &size, sizeof(uint32));
+			value = MemoryContextAlloc(hashstate->spillcontext, size);
+			vector_agg_batch_read(batch, value, size);
+			column->value[row] = PointerGetDatum(value);
+		}
+	}
+
+	vectorslot->dimension = nrows;
+	vectorslot->hasSelection = false;
+	ExecStoreVirtualTuple(hashstate->spillslot);
+
+	return vectorslot;
+}
+
+/*
+ * Read size bytes of the spilled rows of the batch, which must be there.
+ */
+static void
+vector_agg_batch_read(HashAggBatch *batch, void *data, Size size)
+{
+	size_t		nread;
+
+#if PG_VERSION_NUM < PG_VERSION_15
+	nread = LogicalTapeRead(batch->tapeset, batch->input_tapenum, data, size);
+#else
+	nread = LogicalTapeRead(batch->input_tape, data, size);
+#endif
+	if (nread != size)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg_internal("unexpected EOF for hash aggregate spill: requested %zu bytes, read %zu bytes",
+								 size, nread)));
+}
+
 /*
  * If any data was spilled during hash aggregation, reset the hash table and
  * reprocess one batch of spilled data. After reprocessing a batch, the hash
  * table will again contain data, ready to be consumed by
  * agg_retrieve_hash_table_in_memory().
  *
+ * The spilled rows are read back as vectors and aggregated like the vectors
+ * of the scan, spilling the rows of the groups that don't fit again into the
+ * partitions of the batch.
+ *
  * Should only be called after all in memory hash table entries have been
  * finalized and emitted.
  *
@@ -2713,7 +3757,6 @@ static bool
 agg_refill_hash_table(AggState *aggstate)
 {
 	HashAggBatch *batch;
-	AggStatePerHash perhash;
 	HashAggSpill spill;
 #if PG_VERSION_NUM < PG_VERSION_15
 	HashTapeInfo *tapeinfo = aggstate->hash_tapeinfo;
@@ -2721,10 +3764,15 @@ agg_refill_hash_table(AggState *aggstate)
 	LogicalTapeSet *tapeset = aggstate->hash_tapeset;
 #endif
 	bool		spill_initialized = false;
+	VectorAggHashState *hashstate;
+	MemoryContext hashstatecxt;
+	MemoryContext oldcontext;
 
 	if (aggstate->hash_batches == NIL)
 		return false;
 
+	Assert(aggstate->num_hashes == 1);
+
 	/* hash_batches is a stack, with the top item at the end of the list */
 	batch = llast(aggstate->hash_batches);
 	aggstate->hash_batches = list_delete_last(aggstate->hash_batches);
@@ -2733,124 +3781,75 @@ agg_refill_hash_table(AggState *aggstate)
 						batch->used_bits, &aggstate->hash_mem_limit,
 						&aggstate->hash_ngroups_limit, NULL);
 
-	/*
-	 * Each batch only processes one grouping set; set the rest to NULL so
-	 * that advance_aggregates() knows to ignore them. We don't touch
-	 * pergroups for sorted grouping sets here, because they will be needed if
-	 * we rescan later. The expressions for sorted grouping sets will not be
-	 * evaluated after we recompile anyway.
-	 */
 	MemSet(aggstate->hash_pergroup, 0,
 		   sizeof(AggStatePerGroup) * aggstate->num_hashes);
 
 	/* free memory and reset hash tables */
 	ReScanExprContext(aggstate->hashcontext);
-	for (int setno = 0; setno < aggstate->num_hashes; setno++)
-		ResetTupleHashTable(aggstate->perhash[setno].hashtable);
+	ResetTupleHashTable(aggstate->perhash[0].hashtable);
 
 	aggstate->hash_ngroups_current = 0;
 
-	/*
-	 * In AGG_MIXED mode, hash aggregation happens in phase 1 and the output
-	 * happens in phase 0. So, we switch to phase 1 when processing a batch,
-	 * and back to phase 0 after the batch is done.
-	 */
-	Assert(aggstate->current_phase == 0);
-	if (aggstate->phase->aggstrategy == AGG_MIXED)
-	{
-		aggstate->current_phase = 1;
-		aggstate->phase = &aggstate->phases[aggstate->current_phase];
-	}
-
 	select_current_set(aggstate, batch->setno, true);
 
-	perhash = &aggstate->perhash[aggstate->current_set];
-
-	/*
-	 * Spilled tuples are always read back as MinimalTuples, which may be
-	 * different from the outer plan, so recompile the aggregate expressions.
-	 *
-	 * We still need the NULL check, because we are only processing one
-	 * grouping set at a time and the rest will be NULL.
-	 */
-	hashagg_recompile_expressions(aggstate, true, true);
+	hashstatecxt = AllocSetContextCreate(CurrentMemoryContext,
+										 "VectorAgg hash refill",
+										 ALLOCSET_DEFAULT_SIZES);
+	oldcontext = MemoryContextSwitchTo(hashstatecxt);
+	hashstate = vector_agg_hash_state_create(aggstate);
+	hashstate->spillslot =
+		CreateVectorTupleTableSlot(ExecGetResultType(outerPlanState(aggstate)));
+	hashstate->groupslot =
+		CreateVectorTupleTableSlot(ExecGetResultType(outerPlanState(aggstate)));
+	hashstate->spillcontext = AllocSetContextCreate(hashstatecxt,
+													"VectorAgg spilled values",
+													ALLOCSET_DEFAULT_SIZES);
+	MemoryContextSwitchTo(oldcontext);
 
 	for (;;)
 	{
-		TupleTableSlot *spillslot = aggstate->hash_spill_rslot;
-		TupleTableSlot *hashslot = perhash->hashslot;
-		TupleHashEntry entry;
-		MinimalTuple tuple;
-		uint32		hash;
-		bool		isnew = false;
-		bool	   *p_isnew = aggstate->hash_spill_mode ? NULL : &isnew;
+		VectorTupleTableSlot *vectorslot;
 
 		CHECK_FOR_INTERRUPTS();
 
-		tuple = hashagg_batch_read(batch, &hash);
-		if (tuple == NULL)
+		vectorslot = vector_agg_spill_read(aggstate, hashstate, batch);
+		if (vectorslot == NULL)
 			break;
 
-		ExecStoreMinimalTuple(tuple, spillslot, true);
-		aggstate->tmpcontext->ecxt_outertuple = spillslot;
+		vector_agg_lookup_groups(aggstate, hashstate, vectorslot);
 
-		prepare_hash_slot(perhash,
-						  aggstate->tmpcontext->ecxt_outertuple,
-						  hashslot);
-#if PG_VERSION_NUM < PG_VERSION_15
-		entry = LookupTupleHashEntryHash(
-										 perhash->hashtable, hashslot, p_isnew, hash);
-#else
-		entry = LookupTupleHashEntryHash(perhash->hashtable, hashslot,
-										 p_isnew, hash);
-#endif
+		for (uint32 group = 0; group < hashstate->ngroups; group++)
+			vector_agg_advance_group(aggstate, hashstate, vectorslot, group);
 
-		if (entry != NULL)
-		{
-			if (isnew)
-				initialize_hash_entry(aggstate, perhash->hashtable, entry);
-			aggstate->hash_pergroup[batch->setno] = entry->additional;
-			advance_aggregates(aggstate);
-		}
-		else
+		if (hashstate->nspilled == 0)
+			continue;
+
+		if (!spill_initialized)
 		{
-			if (!spill_initialized)
-			{
-				/*
-				 * Avoid initializing the spill until we actually need it so
-				 * that we don't assign tapes that will never be used.
-				 */
-				spill_initialized = true;
+			/*
+			 * Avoid initializing the spill until we actually need it so that
+			 * we don't assign tapes that will never be used.
+			 */
+			spill_initialized = true;
 #if PG_VERSION_NUM < PG_VERSION_15
-				hashagg_spill_init(&spill, tapeinfo, batch->used_bits,
+			hashagg_spill_init(&spill, tapeinfo, batch->used_bits,
 #else
-				hashagg_spill_init(&spill, tapeset, batch->used_bits,
+			hashagg_spill_init(&spill, tapeset, batch->used_bits,
 #endif
-								   batch->input_card, aggstate->hashentrysize);
-			}
-			/* no memory for a new group, spill */
-			hashagg_spill_tuple(aggstate, &spill, spillslot, hash);
-
-			aggstate->hash_pergroup[batch->setno] = NULL;
+							   batch->input_card, aggstate->hashentrysize);
 		}
 
-		/*
-		 * Reset per-input-tuple context after each tuple, but note that the
-		 * hash lookups do this too
-		 */
-		ResetExprContext(aggstate->tmpcontext);
+		vector_agg_spill_rows(aggstate, hashstate, vectorslot, &spill);
 	}
 
+	MemoryContextDelete(hashstatecxt);
+
 #if PG_VERSION_NUM < PG_VERSION_15
 	hashagg_tapeinfo_release(tapeinfo, batch->input_tapenum);
 #else
 	LogicalTapeClose(batch->input_tape);
 #endif
 
-	/* change back to phase 0 */
-	aggstate->current_phase = 0;
-	aggstate->phase = &aggstate->phases[aggstate->current_phase];
-
 	if (spill_initialized)
 	{
 		hashagg_spill_finish(aggstate, &spill, batch->setno);
@@ -3244,84 +4243,6 @@ hashagg_batch_new(LogicalTape *input_tape, int setno,
 	return batch;
 }
 
-/*
- * read_spilled_tuple
- * 		read the next tuple from a batch's tape.  Return NULL if no more.
- */
-static MinimalTuple
-hashagg_batch_read(HashAggBatch *batch, uint32 *hashp)
-{
-#if PG_VERSION_NUM < PG_VERSION_15
-	LogicalTapeSet *tapeset = batch->tapeset;
-	int			tapenum = batch->input_tapenum;
-#else
-	LogicalTape *tape = batch->input_tape;
-#endif
-	MinimalTuple tuple;
-	uint32		t_len;
-	size_t		nread;
-	uint32		hash;
-
-#if PG_VERSION_NUM < PG_VERSION_15
-	nread = LogicalTapeRead(tapeset, tapenum, &hash, sizeof(uint32));
-#else
-	nread = LogicalTapeRead(tape, &hash, sizeof(uint32));
-#endif
-	if (nread == 0)
-		return NULL;
-	if (nread != sizeof(uint32))
-		ereport(ERROR,
-				(errcode_for_file_access(),
-#if PG_VERSION_NUM < PG_VERSION_15
-				 errmsg("unexpected EOF for tape %d: requested %zu bytes, read %zu bytes",
-						tapenum, sizeof(uint32), nread)));
-#else
-				 errmsg_internal("unexpected EOF for tape %p: requested %zu bytes, read %zu bytes",
-								 tape, sizeof(uint32), nread)));
-#endif
-	if (hashp != NULL)
-		*hashp = hash;
-
-#if PG_VERSION_NUM < PG_VERSION_15
-	nread = LogicalTapeRead(tapeset, tapenum, &t_len, sizeof(t_len));
-#else
-	nread = LogicalTapeRead(tape, &t_len, sizeof(t_len));
-#endif
-	if (nread != sizeof(uint32))
-		ereport(ERROR,
-				(errcode_for_file_access(),
-#if PG_VERSION_NUM < PG_VERSION_15
-				 errmsg("unexpected EOF for tape %d: requested %zu bytes, read %zu bytes",
-						tapenum, sizeof(uint32), nread)));
-#else
-				 errmsg_internal("unexpected EOF for tape %p: requested %zu bytes, read %zu bytes",
-								 tape, sizeof(uint32), nread)));
-#endif
-
-	tuple = (MinimalTuple) palloc(t_len);
-	tuple->t_len = t_len;
-
-#if PG_VERSION_NUM < PG_VERSION_15
-	nread = LogicalTapeRead(tapeset, tapenum,
-#else
-	nread = LogicalTapeRead(tape,
-#endif
-							(void *) ((char *) tuple + sizeof(uint32)),
-							t_len - sizeof(uint32));
-	if (nread != t_len - sizeof(uint32))
-		ereport(ERROR,
-				(errcode_for_file_access(),
-#if PG_VERSION_NUM < PG_VERSION_15
-				 errmsg("unexpected EOF for tape %d: requested %zu bytes, read %zu bytes",
-						tapenum, t_len - sizeof(uint32), nread)));
-#else
-				 errmsg_internal("unexpected EOF for tape %p: requested %zu bytes, read %zu bytes",
-								 tape, t_len - sizeof(uint32), nread)));
-#endif
-
-	return tuple;
-}
-
 /*
  * hashagg_finish_initial_spills
  *
@@ -4822,8 +5743,13 @@ ExecEndAgg(AggState *node)
 	ExecEndNode(outerPlan);
 }
 
-void
-ExecReScanAgg(AggState *node)
+/*
+ * VExecReScanAgg is ExecReScanAgg, named apart so that it isn't resolved to
+ * the executor function of the same name, which would rebuild the
+ * expressions of the hash table for row-by-row aggregation.
+ */
+static void
+VExecReScanAgg(AggState *node)
 {
 	ExprContext *econtext = node->ss.ps.ps_ExprContext;
 	PlanState  *outerPlan = outerPlanState(node);
@@ -5139,7 +6065,13 @@ AggRegisterCallback(FunctionCallInfo fcinfo,
  * ----------------------------------------------------------------
  */
 
-/* Parallel Execution */
+/*
+ * The vector aggregate node keeps no state shared between processes. Below a
+ * Gather, each process aggregates the rows its columnar scan returns into
+ * partial states, which reach the leader as tuples, and the parallel state of
+ * the scan is set up by the callbacks of the scan itself. The callbacks below
+ * are only there because the node is parallel aware like its scan.
+ */
 
 static Size 
 ColumnarAggNode_EstimateDSM(CustomScanState *node,
@@ -5184,6 +6116,7 @@ static Node *CreateVectorAggState(CustomScan *custom_plan);
 static void BeginVectorAgg(CustomScanState *node, EState *estate, int eflags);
 static TupleTableSlot *ExecVectorAgg(CustomScanState *node);
 static void EndVectorAgg(CustomScanState *node);
+static void ReScanVectorAgg(CustomScanState *node);
 static void ExplainAggNode(CustomScanState *node, List *ancestors, ExplainState *es);
 
 static CustomScanMethods VectorAggNodeMethods = {
@@ -5197,6 +6130,7 @@ static CustomExecMethods VectorAggNodeExecMethods = {
 	.BeginCustomScan = BeginVectorAgg,
 	.ExecCustomScan = ExecVectorAgg,
 	.EndCustomScan = EndVectorAgg,
+	.ReScanCustomScan = ReScanVectorAgg,
 
 	.ExplainCustomScan = ExplainAggNode,
 
@@ -5261,6 +6195,28 @@ EndVectorAgg(CustomScanState *node)
 }
 
 
+/*
+ * ReScanVectorAgg rescans the aggregate state of the node, as a nested loop
+ * or a rescanned Gather above it needs. ExecReScan only resets the custom
+ * scan node, so the changed parameters are passed on to the aggregate state
+ * and its expression context, which VExecReScanAgg expects to be reset
+ * already, is reset here.
+ */
+static void
+ReScanVectorAgg(CustomScanState *node)
+{
+	AggState *aggstate = ((VectorAggState *) node)->aggstate;
+
+	ReScanExprContext(aggstate->ss.ps.ps_ExprContext);
+
+	aggstate->ss.ps.chgParam = node->ss.ps.chgParam;
+	VExecReScanAgg(aggstate);
+
+	/* the set belongs to the custom scan node, which frees it */
+	aggstate->ss.ps.chgParam = NULL;
+}
+
+
 static void
 ExplainAggNode(CustomScanState *node, List *ancestors, ExplainState *es)
 {
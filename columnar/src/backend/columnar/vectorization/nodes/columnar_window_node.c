@@ -0,0 +1,902 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_window_node.c
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ * Custom scan node that replaces a WindowAgg over a columnar scan, or over
+ * a sort of one, whose window functions are all row_number(), lag and lead
+ * of a column by a constant offset, and count or sum of an integer or float
+ * column over a ROWS frame that starts UNBOUNDED PRECEDING or a constant
+ * number of rows PRECEDING and ends at the CURRENT ROW.
+ *
+ * The rows of the input are buffered, and each window function is computed
+ * for a vector of up to columnar.vector_size of them in one loop over the
+ * values of its argument, instead of once for each row through the window
+ * object API. The rows before the vector that lag and the frames reach are
+ * kept with it, and the rows after it that lead reaches are read with it.
+ * Scans in the order of a sort key merge the stripes of the table row by
+ * row, so the vectors are built here from the rows of the input.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "nodes/extensible.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/float.h"
+#include "utils/fmgroids.h"
+#include "utils/memutils.h"
+
+#include "columnar/columnar.h"
+#include "columnar/vectorization/nodes/columnar_window_node.h"
+
+typedef enum VectorWindowFunctionType
+{
+	VECTOR_WINDOW_ROW_NUMBER,
+	VECTOR_WINDOW_COUNT_ROWS,
+	VECTOR_WINDOW_COUNT,
+	VECTOR_WINDOW_SUM_INT2,
+	VECTOR_WINDOW_SUM_INT4,
+	VECTOR_WINDOW_SUM_FLOAT4,
+	VECTOR_WINDOW_SUM_FLOAT8,
+	VECTOR_WINDOW_SHIFT
+} VectorWindowFunctionType;
+
+typedef struct VectorWindowFunction
+{
+	VectorWindowFunctionType type;
+
+	/* buffered column of the argument, or -1 if the function has none */
+	int argumentIndex;
+
+	/* lag and lead return the row this many rows after the current one */
+	int64 shift;
+	Datum defaultValue;
+	bool defaultIsNull;
+
+	/* aggregate of the frame of the last row computed */
+	int64 valueCount;
+	int64 intSum;
+	float4 float4Sum;
+	float8 float8Sum;
+
+	/* results for the rows of the vector */
+	Datum *values;
+	bool *isnull;
+} VectorWindowFunction;
+
+typedef struct VectorWindowState
+{
+	CustomScanState css;
+
+	int functionCount;
+	VectorWindowFunction *functions;
+
+	/* frames start this many rows before the current row, -1 if unbounded */
+	int64 frameOffset;
+
+	/* rows before and after a vector that its window functions read */
+	int64 preceding;
+	int64 following;
+	int vectorSize;
+
+	/* compares the partitioning columns of two input rows, or NULL */
+	ExprState *partitionEqual;
+	TupleTableSlot *previousSlot;
+	int64 lastPartitionStart;
+
+	/*
+	 * Input rows from position bufferStart on, the position of the first row
+	 * of the partition of each of them, and the values of the input columns
+	 * that window functions read, which point into the rows.
+	 */
+	MemoryContext bufferContext;
+	int bufferCapacity;
+	int bufferCount;
+	int64 bufferStart;
+	MinimalTuple *bufferRows;
+	int64 *partitionStart;
+	int argumentCount;
+	AttrNumber *argumentAttno;
+	Datum **argumentValues;
+	bool **argumentIsNull;
+	bool inputDone;
+
+	/* rows of the vector whose results are computed, and the next one */
+	int64 vectorStart;
+	int64 vectorEnd;
+	int64 nextPosition;
+
+	int inputColumnCount;
+	TupleTableSlot *rowSlot;
+} VectorWindowState;
+
+/* CustomScanMethods */
+static Node * CreateVectorWindowState(CustomScan *custom_plan);
+
+/* CustomScanExecMethods */
+static void BeginVectorWindow(CustomScanState *node, EState *estate, int eflags);
+static TupleTableSlot * ExecVectorWindow(CustomScanState *node);
+static void EndVectorWindow(CustomScanState *node);
+static void ReScanVectorWindow(CustomScanState *node);
+
+static void InitVectorWindowFunction(VectorWindowState *state,
+									 VectorWindowFunction *function,
+									 WindowFunc *windowFunc);
+static int VectorWindowArgumentIndex(VectorWindowState *state, AttrNumber attno);
+static void ReadVectorWindowRows(VectorWindowState *state);
+static void ComputeVectorWindow(VectorWindowState *state);
+static void ComputeVectorWindowFunction(VectorWindowState *state,
+										VectorWindowFunction *function);
+static void ComputeFrameAggregate(VectorWindowState *state,
+								  VectorWindowFunction *function);
+static void ComputeFloatFrameSums(VectorWindowState *state,
+								  VectorWindowFunction *function);
+static void AddFrameValue(VectorWindowFunction *function, Datum value);
+static void RemoveFrameValue(VectorWindowFunction *function, Datum value);
+static void ResetVectorWindowBuffer(VectorWindowState *state);
+
+static CustomScanMethods VectorWindowNodeMethods = {
+	"VectorWindowAggNode",		/* CustomName */
+	CreateVectorWindowState,	/* CreateCustomScanState */
+};
+
+static CustomExecMethods VectorWindowNodeExecMethods = {
+	.CustomName = "VectorWindowAggNode",
+
+	.BeginCustomScan = BeginVectorWindow,
+	.ExecCustomScan = ExecVectorWindow,
+	.EndCustomScan = EndVectorWindow,
+	.ReScanCustomScan = ReScanVectorWindow,
+};
+
+
+static Node *
+CreateVectorWindowState(CustomScan *custom_plan)
+{
+	VectorWindowState *state = (VectorWindowState *) newNode(
+		sizeof(VectorWindowState), T_CustomScanState);
+
+	CustomScanState *cscanstate = &state->css;
+	cscanstate->methods = &VectorWindowNodeExecMethods;
+
+	return (Node *) cscanstate;
+}
+
+
+/*
+ * BeginVectorWindow initializes the input of the node and its window
+ * functions. The scan tuple of the node has the columns of the input rows,
+ * followed by the results of the window functions, see VectorizeWindowAgg.
+ */
+static void
+BeginVectorWindow(CustomScanState *node, EState *estate, int eflags)
+{
+	VectorWindowState *state = (VectorWindowState *) node;
+	CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+	WindowAgg *windowAgg = (WindowAgg *) linitial(cscan->custom_private);
+
+	outerPlanState(state) = ExecInitNode(outerPlan(cscan), estate, eflags);
+
+	TupleDesc inputDesc = ExecGetResultType(outerPlanState(state));
+	state->inputColumnCount = inputDesc->natts;
+	state->rowSlot = ExecInitExtraTupleSlot(estate, inputDesc, &TTSOpsMinimalTuple);
+	state->previousSlot = ExecInitExtraTupleSlot(estate, inputDesc,
+												 &TTSOpsMinimalTuple);
+
+	if (windowAgg->partNumCols > 0)
+	{
+		state->partitionEqual = execTuplesMatchPrepare(inputDesc,
+													   windowAgg->partNumCols,
+													   windowAgg->partColIdx,
+													   windowAgg->partOperators,
+													   windowAgg->partCollations,
+													   &node->ss.ps);
+	}
+
+	if (windowAgg->frameOptions & FRAMEOPTION_START_UNBOUNDED_PRECEDING)
+	{
+		state->frameOffset = -1;
+	}
+	else if (windowAgg->frameOptions & FRAMEOPTION_START_OFFSET_PRECEDING)
+	{
+		state->frameOffset = DatumGetInt64(((Const *) windowAgg->startOffset)->constvalue);
+	}
+	else
+	{
+		state->frameOffset = 0;
+	}
+
+	state->vectorSize = columnar_vector_size;
+
+	List *windowFuncEntries = list_copy_tail(cscan->custom_scan_tlist,
+											 state->inputColumnCount);
+	state->functionCount = list_length(windowFuncEntries);
+	state->functions = palloc0(sizeof(VectorWindowFunction) * state->functionCount);
+	state->argumentAttno = palloc0(sizeof(AttrNumber) * Max(state->functionCount, 1));
+
+	for (int i = 0; i < state->functionCount; i++)
+	{
+		TargetEntry *targetEntry = list_nth(windowFuncEntries, i);
+
+		InitVectorWindowFunction(state, &state->functions[i],
+								 (WindowFunc *) targetEntry->expr);
+	}
+
+	state->bufferCapacity = state->preceding + state->vectorSize + state->following + 1;
+	state->bufferContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "Vector Window Rows",
+												 ALLOCSET_DEFAULT_SIZES);
+	state->bufferRows = palloc0(sizeof(MinimalTuple) * state->bufferCapacity);
+	state->partitionStart = palloc0(sizeof(int64) * state->bufferCapacity);
+	state->argumentValues = palloc0(sizeof(Datum *) * Max(state->argumentCount, 1));
+	state->argumentIsNull = palloc0(sizeof(bool *) * Max(state->argumentCount, 1));
+
+	for (int i = 0; i < state->argumentCount; i++)
+	{
+		state->argumentValues[i] = palloc0(sizeof(Datum) * state->bufferCapacity);
+		state->argumentIsNull[i] = palloc0(sizeof(bool) * state->bufferCapacity);
+	}
+
+	ResetVectorWindowBuffer(state);
+}
+
+
+/*
+ * InitVectorWindowFunction sets up the computation of one of the window
+ * functions that VectorizedWindowAggSupported accepted, and widens the rows
+ * kept around vectors to the rows it reads.
+ */
+static void
+InitVectorWindowFunction(VectorWindowState *state, VectorWindowFunction *function,
+						 WindowFunc *windowFunc)
+{
+	function->argumentIndex = -1;
+	function->values = palloc0(sizeof(Datum) * state->vectorSize);
+	function->isnull = palloc0(sizeof(bool) * state->vectorSize);
+
+	if (windowFunc->args != NIL)
+	{
+		Var *argument = (Var *) linitial(windowFunc->args);
+		function->argumentIndex = VectorWindowArgumentIndex(state, argument->varattno);
+	}
+
+	switch (windowFunc->winfnoid)
+	{
+		case F_ROW_NUMBER:
+		{
+			function->type = VECTOR_WINDOW_ROW_NUMBER;
+			return;
+		}
+
+		case F_LAG_ANYELEMENT:
+		case F_LAG_ANYELEMENT_INT4:
+		case F_LAG_ANYCOMPATIBLE_INT4_ANYCOMPATIBLE:
+		case F_LEAD_ANYELEMENT:
+		case F_LEAD_ANYELEMENT_INT4:
+		case F_LEAD_ANYCOMPATIBLE_INT4_ANYCOMPATIBLE:
+		{
+			bool isLead = windowFunc->winfnoid == F_LEAD_ANYELEMENT ||
+						  windowFunc->winfnoid == F_LEAD_ANYELEMENT_INT4 ||
+						  windowFunc->winfnoid == F_LEAD_ANYCOMPATIBLE_INT4_ANYCOMPATIBLE;
+			int64 offset = 1;
+
+			if (list_length(windowFunc->args) > 1)
+			{
+				offset = DatumGetInt32(((Const *) lsecond(windowFunc->args))->constvalue);
+			}
+
+			function->defaultIsNull = true;
+			if (list_length(windowFunc->args) > 2)
+			{
+				Const *defaultConst = (Const *) lthird(windowFunc->args);
+
+				function->defaultValue = defaultConst->constvalue;
+				function->defaultIsNull = defaultConst->constisnull;
+			}
+
+			function->type = VECTOR_WINDOW_SHIFT;
+			function->shift = isLead ? offset : -offset;
+
+			if (function->shift > 0)
+			{
+				state->following = Max(state->following, function->shift);
+			}
+			else
+			{
+				state->preceding = Max(state->preceding, -function->shift);
+			}
+
+			return;
+		}
+
+		case F_COUNT_:
+		{
+			function->type = VECTOR_WINDOW_COUNT_ROWS;
+			return;
+		}
+
+		case F_COUNT_ANY:
+		{
+			function->type = VECTOR_WINDOW_COUNT;
+			break;
+		}
+
+		case F_SUM_INT2:
+		{
+			function->type = VECTOR_WINDOW_SUM_INT2;
+			break;
+		}
+
+		case F_SUM_INT4:
+		{
+			function->type = VECTOR_WINDOW_SUM_INT4;
+			break;
+		}
+
+		case F_SUM_FLOAT4:
+		{
+			function->type = VECTOR_WINDOW_SUM_FLOAT4;
+			break;
+		}
+
+		case F_SUM_FLOAT8:
+		{
+			function->type = VECTOR_WINDOW_SUM_FLOAT8;
+			break;
+		}
+
+		default:
+		{
+			elog(ERROR, "window function %u is not supported by vector window nodes",
+				 windowFunc->winfnoid);
+		}
+	}
+
+	/* sliding frames remove the row before the frame, see ComputeFrameAggregate */
+	if (state->frameOffset >= 0)
+	{
+		state->preceding = Max(state->preceding, state->frameOffset + 1);
+	}
+}
+
+
+/*
+ * VectorWindowArgumentIndex returns the index of the buffered values of the
+ * input column with the given attribute number, which are buffered from now
+ * on if they weren't already.
+ */
+static int
+VectorWindowArgumentIndex(VectorWindowState *state, AttrNumber attno)
+{
+	for (int i = 0; i < state->argumentCount; i++)
+	{
+		if (state->argumentAttno[i] == attno)
+		{
+			return i;
+		}
+	}
+
+	state->argumentAttno[state->argumentCount] = attno;
+	return state->argumentCount++;
+}
+
+
+/*
+ * ExecVectorWindow returns the next row of the window with the results of
+ * its window functions, computing them for the next vector of rows once the
+ * rows of the last one are returned.
+ */
+static TupleTableSlot *
+ExecVectorWindow(CustomScanState *node)
+{
+	VectorWindowState *state = (VectorWindowState *) node;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+
+	ResetExprContext(econtext);
+
+	if (state->nextPosition >= state->vectorEnd)
+	{
+		ReadVectorWindowRows(state);
+		ComputeVectorWindow(state);
+
+		if (state->nextPosition >= state->vectorEnd)
+		{
+			return NULL;
+		}
+	}
+
+	int bufferIndex = state->nextPosition - state->bufferStart;
+	int vectorIndex = state->nextPosition - state->vectorStart;
+
+	TupleTableSlot *rowSlot = ExecStoreMinimalTuple(state->bufferRows[bufferIndex],
+													state->rowSlot, false);
+	slot_getallattrs(rowSlot);
+
+	TupleTableSlot *scanSlot = node->ss.ss_ScanTupleSlot;
+	ExecClearTuple(scanSlot);
+
+	memcpy(scanSlot->tts_values, rowSlot->tts_values,
+		   sizeof(Datum) * state->inputColumnCount);
+	memcpy(scanSlot->tts_isnull, rowSlot->tts_isnull,
+		   sizeof(bool) * state->inputColumnCount);
+
+	for (int i = 0; i < state->functionCount; i++)
+	{
+		VectorWindowFunction *function = &state->functions[i];
+
+		scanSlot->tts_values[state->inputColumnCount + i] = function->values[vectorIndex];
+		scanSlot->tts_isnull[state->inputColumnCount + i] = function->isnull[vectorIndex];
+	}
+
+	ExecStoreVirtualTuple(scanSlot);
+	state->nextPosition++;
+
+	if (node->ss.ps.ps_ProjInfo == NULL)
+	{
+		return scanSlot;
+	}
+
+	econtext->ecxt_scantuple = scanSlot;
+	return ExecProject(node->ss.ps.ps_ProjInfo);
+}
+
+
+/*
+ * ReadVectorWindowRows drops the rows no later row reads from the buffer,
+ * and reads the rows of the next vector and the rows after it that lead
+ * reads. The last row read is kept, to compare the next one with.
+ */
+static void
+ReadVectorWindowRows(VectorWindowState *state)
+{
+	int64 readEnd = state->bufferStart + state->bufferCount;
+	int64 keepStart = Min(state->nextPosition - state->preceding, readEnd - 1);
+
+	if (keepStart > state->bufferStart)
+	{
+		int dropCount = keepStart - state->bufferStart;
+		int keepCount = state->bufferCount - dropCount;
+
+		for (int i = 0; i < dropCount; i++)
+		{
+			pfree(state->bufferRows[i]);
+		}
+
+		memmove(state->bufferRows, state->bufferRows + dropCount,
+				sizeof(MinimalTuple) * keepCount);
+		memmove(state->partitionStart, state->partitionStart + dropCount,
+				sizeof(int64) * keepCount);
+
+		for (int i = 0; i < state->argumentCount; i++)
+		{
+			memmove(state->argumentValues[i], state->argumentValues[i] + dropCount,
+					sizeof(Datum) * keepCount);
+			memmove(state->argumentIsNull[i], state->argumentIsNull[i] + dropCount,
+					sizeof(bool) * keepCount);
+		}
+
+		state->bufferStart = keepStart;
+		state->bufferCount = keepCount;
+	}
+
+	int64 wantedEnd = state->nextPosition + state->vectorSize + state->following;
+	ExprContext *econtext = state->css.ss.ps.ps_ExprContext;
+
+	while (!state->inputDone && state->bufferStart + state->bufferCount < wantedEnd)
+	{
+		TupleTableSlot *slot = ExecProcNode(outerPlanState(state));
+		if (TupIsNull(slot))
+		{
+			state->inputDone = true;
+			break;
+		}
+
+		int64 position = state->bufferStart + state->bufferCount;
+
+		if (position > 0 && state->partitionEqual != NULL)
+		{
+			econtext->ecxt_outertuple = slot;
+			econtext->ecxt_innertuple = state->previousSlot;
+
+			if (!ExecQualAndReset(state->partitionEqual, econtext))
+			{
+				state->lastPartitionStart = position;
+			}
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(state->bufferContext);
+		MinimalTuple row = ExecCopySlotMinimalTuple(slot);
+		MemoryContextSwitchTo(oldContext);
+
+		int bufferIndex = state->bufferCount++;
+		state->bufferRows[bufferIndex] = row;
+		state->partitionStart[bufferIndex] = state->lastPartitionStart;
+
+		ExecStoreMinimalTuple(row, state->previousSlot, false);
+
+		for (int i = 0; i < state->argumentCount; i++)
+		{
+			state->argumentValues[i][bufferIndex] =
+				slot_getattr(state->previousSlot, state->argumentAttno[i],
+							 &state->argumentIsNull[i][bufferIndex]);
+		}
+	}
+}
+
+
+/*
+ * ComputeVectorWindow computes the window functions for the next vector of
+ * rows, which ends before the rows lead still needs to read after it.
+ */
+static void
+ComputeVectorWindow(VectorWindowState *state)
+{
+	int64 readEnd = state->bufferStart + state->bufferCount;
+	int64 vectorEnd = Min(state->nextPosition + state->vectorSize, readEnd);
+
+	if (!state->inputDone)
+	{
+		vectorEnd = Min(vectorEnd, readEnd - state->following);
+	}
+
+	state->vectorStart = state->nextPosition;
+	state->vectorEnd = Max(vectorEnd, state->nextPosition);
+
+	for (int i = 0; i < state->functionCount; i++)
+	{
+		ComputeVectorWindowFunction(state, &state->functions[i]);
+	}
+}
+
+
+static void
+ComputeVectorWindowFunction(VectorWindowState *state, VectorWindowFunction *function)
+{
+	int rowCount = state->vectorEnd - state->vectorStart;
+	int firstIndex = state->vectorStart - state->bufferStart;
+	int64 *partitionStart = state->partitionStart + firstIndex;
+	Datum *values = function->values;
+	bool *isnull = function->isnull;
+
+	switch (function->type)
+	{
+		case VECTOR_WINDOW_ROW_NUMBER:
+		{
+			for (int i = 0; i < rowCount; i++)
+			{
+				values[i] = Int64GetDatum(state->vectorStart + i - partitionStart[i] + 1);
+				isnull[i] = false;
+			}
+
+			break;
+		}
+
+		case VECTOR_WINDOW_COUNT_ROWS:
+		{
+			for (int i = 0; i < rowCount; i++)
+			{
+				int64 position = state->vectorStart + i;
+				int64 frameStart = partitionStart[i];
+
+				if (state->frameOffset >= 0)
+				{
+					frameStart = Max(frameStart, position - state->frameOffset);
+				}
+
+				values[i] = Int64GetDatum(position - frameStart + 1);
+				isnull[i] = false;
+			}
+
+			break;
+		}
+
+		case VECTOR_WINDOW_SHIFT:
+		{
+			int64 readEnd = state->bufferStart + state->bufferCount;
+			Datum *argumentValues = state->argumentValues[function->argumentIndex];
+			bool *argumentIsNull = state->argumentIsNull[function->argumentIndex];
+
+			for (int i = 0; i < rowCount; i++)
+			{
+				int64 target = state->vectorStart + i + function->shift;
+				int targetIndex = target - state->bufferStart;
+
+				if (target >= partitionStart[i] && target < readEnd &&
+					state->partitionStart[targetIndex] == partitionStart[i])
+				{
+					values[i] = argumentValues[targetIndex];
+					isnull[i] = argumentIsNull[targetIndex];
+				}
+				else
+				{
+					values[i] = function->defaultValue;
+					isnull[i] = function->defaultIsNull;
+				}
+			}
+
+			break;
+		}
+
+		case VECTOR_WINDOW_SUM_FLOAT4:
+		case VECTOR_WINDOW_SUM_FLOAT8:
+		{
+			/* removing values from float sums would round them differently */
+			if (state->frameOffset >= 0)
+			{
+				ComputeFloatFrameSums(state, function);
+				break;
+			}
+
+			ComputeFrameAggregate(state, function);
+			break;
+		}
+
+		default:
+		{
+			ComputeFrameAggregate(state, function);
+			break;
+		}
+	}
+}
+
+
+/*
+ * ComputeFrameAggregate computes count or sum of the frames of the rows of
+ * the vector by adding the value of each row to the aggregate of the frame
+ * of the row before it and, for frames that start a number of rows before
+ * the current row, removing the value of the row before the frame. The
+ * aggregate starts over at the first row of each partition.
+ */
+static void
+ComputeFrameAggregate(VectorWindowState *state, VectorWindowFunction *function)
+{
+	int rowCount = state->vectorEnd - state->vectorStart;
+	int firstIndex = state->vectorStart - state->bufferStart;
+	Datum *argumentValues = state->argumentValues[function->argumentIndex];
+	bool *argumentIsNull = state->argumentIsNull[function->argumentIndex];
+
+	for (int i = 0; i < rowCount; i++)
+	{
+		int64 position = state->vectorStart + i;
+		int bufferIndex = firstIndex + i;
+		int64 partitionStart = state->partitionStart[bufferIndex];
+
+		if (position == partitionStart)
+		{
+			function->valueCount = 0;
+			function->intSum = 0;
+		}
+
+		if (!argumentIsNull[bufferIndex])
+		{
+			AddFrameValue(function, argumentValues[bufferIndex]);
+		}
+
+		int64 removedPosition = position - state->frameOffset - 1;
+		if (state->frameOffset >= 0 && removedPosition >= partitionStart)
+		{
+			int removedIndex = removedPosition - state->bufferStart;
+
+			if (!argumentIsNull[removedIndex])
+			{
+				RemoveFrameValue(function, argumentValues[removedIndex]);
+			}
+		}
+
+		function->isnull[i] = false;
+
+		switch (function->type)
+		{
+			case VECTOR_WINDOW_COUNT:
+			{
+				function->values[i] = Int64GetDatum(function->valueCount);
+				break;
+			}
+
+			case VECTOR_WINDOW_SUM_FLOAT4:
+			{
+				function->values[i] = Float4GetDatum(function->float4Sum);
+				function->isnull[i] = function->valueCount == 0;
+				break;
+			}
+
+			case VECTOR_WINDOW_SUM_FLOAT8:
+			{
+				function->values[i] = Float8GetDatum(function->float8Sum);
+				function->isnull[i] = function->valueCount == 0;
+				break;
+			}
+
+			default:
+			{
+				function->values[i] = Int64GetDatum(function->intSum);
+				function->isnull[i] = function->valueCount == 0;
+				break;
+			}
+		}
+	}
+}
+
+
+/*
+ * ComputeFloatFrameSums sums the values of the frame of each row of the
+ * vector from its first row on, like a WindowAgg restarts float sums, which
+ * have no inverse transition, when the start of the frame moves.
+ */
+static void
+ComputeFloatFrameSums(VectorWindowState *state, VectorWindowFunction *function)
+{
+	int rowCount = state->vectorEnd - state->vectorStart;
+	int firstIndex = state->vectorStart - state->bufferStart;
+	Datum *argumentValues = state->argumentValues[function->argumentIndex];
+	bool *argumentIsNull = state->argumentIsNull[function->argumentIndex];
+
+	for (int i = 0; i < rowCount; i++)
+	{
+		int64 position = state->vectorStart + i;
+		int64 frameStart = Max(state->partitionStart[firstIndex + i],
+							   position - state->frameOffset);
+
+		function->valueCount = 0;
+
+		for (int bufferIndex = frameStart - state->bufferStart;
+			 bufferIndex <= firstIndex + i; bufferIndex++)
+		{
+			if (!argumentIsNull[bufferIndex])
+			{
+				AddFrameValue(function, argumentValues[bufferIndex]);
+			}
+		}
+
+		if (function->type == VECTOR_WINDOW_SUM_FLOAT4)
+		{
+			function->values[i] = Float4GetDatum(function->float4Sum);
+		}
+		else
+		{
+			function->values[i] = Float8GetDatum(function->float8Sum);
+		}
+
+		function->isnull[i] = function->valueCount == 0;
+	}
+}
+
+
+/*
+ * AddFrameValue adds a value that isn't NULL to the aggregate of the frame.
+ * The first value of a float sum becomes the sum, as it does for the strict
+ * transition functions of sum.
+ */
+static inline void
+AddFrameValue(VectorWindowFunction *function, Datum value)
+{
+	switch (function->type)
+	{
+		case VECTOR_WINDOW_SUM_INT2:
+		{
+			function->intSum += DatumGetInt16(value);
+			break;
+		}
+
+		case VECTOR_WINDOW_SUM_INT4:
+		{
+			function->intSum += DatumGetInt32(value);
+			break;
+		}
+
+		case VECTOR_WINDOW_SUM_FLOAT4:
+		{
+			function->float4Sum = function->valueCount == 0 ?
+								  DatumGetFloat4(value) :
+								  float4_pl(function->float4Sum, DatumGetFloat4(value));
+			break;
+		}
+
+		case VECTOR_WINDOW_SUM_FLOAT8:
+		{
+			function->float8Sum = function->valueCount == 0 ?
+								  DatumGetFloat8(value) :
+								  float8_pl(function->float8Sum, DatumGetFloat8(value));
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+
+	function->valueCount++;
+}
+
+
+/*
+ * RemoveFrameValue removes a value that isn't NULL from the count or integer
+ * sum of the frame.
+ */
+static inline void
+RemoveFrameValue(VectorWindowFunction *function, Datum value)
+{
+	if (function->type == VECTOR_WINDOW_SUM_INT2)
+	{
+		function->intSum -= DatumGetInt16(value);
+	}
+	else if (function->type == VECTOR_WINDOW_SUM_INT4)
+	{
+		function->intSum -= DatumGetInt32(value);
+	}
+
+	function->valueCount--;
+}
+
+
+/*
+ * ResetVectorWindowBuffer frees the buffered rows, so that the window is
+ * computed from the first row of the input again.
+ */
+static void
+ResetVectorWindowBuffer(VectorWindowState *state)
+{
+	ExecClearTuple(state->rowSlot);
+	ExecClearTuple(state->previousSlot);
+	MemoryContextReset(state->bufferContext);
+
+	state->bufferCount = 0;
+	state->bufferStart = 0;
+	state->lastPartitionStart = 0;
+	state->inputDone = false;
+	state->vectorStart = 0;
+	state->vectorEnd = 0;
+	state->nextPosition = 0;
+}
+
+
+static void
+EndVectorWindow(CustomScanState *node)
+{
+	VectorWindowState *state = (VectorWindowState *) node;
+
+	ExecEndNode(outerPlanState(state));
+	MemoryContextDelete(state->bufferContext);
+}
+
+
+static void
+ReScanVectorWindow(CustomScanState *node)
+{
+	VectorWindowState *state = (VectorWindowState *) node;
+	PlanState *outerPlan = outerPlanState(state);
+
+	ResetVectorWindowBuffer(state);
+
+	if (outerPlan->chgParam == NULL)
+	{
+		ExecReScan(outerPlan);
+	}
+}
+
+
+CustomScan *
+columnar_create_window_node(void)
+{
+	CustomScan *cscan = (CustomScan *) makeNode(CustomScan);
+	cscan->methods = &VectorWindowNodeMethods;
+	return cscan;
+}
+
+
+void
+columnar_register_window_node(void)
+{
+	RegisterCustomScanMethods(&VectorWindowNodeMethods);
+}
+
+#endif
@@ -1,17 +1,101 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
+#include "catalog/pg_type.h"
+#include "common/hashfn.h"
 #include "fmgr.h"
 #include "nodes/execnodes.h"
+#include "port/pg_bitutils.h"
 #include "utils/date.h"
+#include "utils/float.h"
 #include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/numeric.h"
+#include "utils/timestamp.h"
 #include "utils/fmgrprotos.h"
 
 #include "pg_version_constants.h"
+#include "columnar/columnar.h"
 #include "columnar/vectorization/types/types.h"
 #include "columnar/vectorization/types/numeric.h"
 
+/*
+ * The null flags of a vector are bytes that are 0 or 1, so the popcount of
+ * the flags is the number of NULL rows, and a NULL row is masked out of a sum
+ * by and'ing its value with the flag minus one, and out of a minimum or
+ * maximum by replacing its value with one that can't change the result. The
+ * loops have no branch, so the compiler vectorizes them. Vectors read from
+ * chunks without NULL rows take a plain loop that doesn't read the flags.
+ */
+
+static inline uint32
+VectorNonNullCount(const VectorColumn *column)
+{
+	if (column->noNulls)
+		return column->dimension;
+
+	return column->dimension -
+		   (uint32) pg_popcount((const char *) column->isnull, column->dimension);
+}
+
+#define _BUILD_SUM_KERNEL(NAME, CTYPE, SUMTYPE)								\
+static COLUMNAR_VECTOR_KERNEL SUMTYPE										\
+NAME(const CTYPE *vectorValue, const bool *vectorNull, uint32 dimension,	\
+	 bool noNulls)															\
+{																			\
+	const uint8 *nullBytes = (const uint8 *) vectorNull;					\
+	SUMTYPE sum = 0;														\
+																			\
+	if (noNulls)															\
+	{																		\
+		for (uint32 i = 0; i < dimension; i++)								\
+			sum += vectorValue[i];											\
+																			\
+		return sum;															\
+	}																		\
+																			\
+	for (uint32 i = 0; i < dimension; i++)									\
+		sum += (SUMTYPE) vectorValue[i] & ((SUMTYPE) nullBytes[i] - 1);		\
+																			\
+	return sum;																\
+}
+
+#define _BUILD_MINMAX_KERNEL(NAME, CTYPE, OP, IDENTITY)						\
+static COLUMNAR_VECTOR_KERNEL CTYPE											\
+NAME(const CTYPE *vectorValue, const bool *vectorNull, uint32 dimension,	\
+	 bool noNulls, CTYPE result)											\
+{																			\
+	if (noNulls)															\
+	{																		\
+		for (uint32 i = 0; i < dimension; i++)								\
+			result = OP(result, vectorValue[i]);							\
+																			\
+		return result;														\
+	}																		\
+																			\
+	for (uint32 i = 0; i < dimension; i++)									\
+	{																		\
+		CTYPE value = vectorNull[i] ? (IDENTITY) : vectorValue[i];			\
+		result = OP(result, value);											\
+	}																		\
+																			\
+	return result;															\
+}
+
+_BUILD_SUM_KERNEL(VectorSumInt16, int16, int64)
+_BUILD_SUM_KERNEL(VectorSumInt32, int32, int64)
+_BUILD_SUM_KERNEL(VectorSumInt64, int64, int128)
+
+_BUILD_MINMAX_KERNEL(VectorMaxInt16, int16, Max, PG_INT16_MIN)
+_BUILD_MINMAX_KERNEL(VectorMinInt16, int16, Min, PG_INT16_MAX)
+_BUILD_MINMAX_KERNEL(VectorMaxInt32, int32, Max, PG_INT32_MIN)
+_BUILD_MINMAX_KERNEL(VectorMinInt32, int32, Min, PG_INT32_MAX)
+_BUILD_MINMAX_KERNEL(VectorMaxInt64, int64, Max, PG_INT64_MIN)
+_BUILD_MINMAX_KERNEL(VectorMinInt64, int64, Min, PG_INT64_MAX)
+
 /* count */
 
 PG_FUNCTION_INFO_V1(vemptycount);
@@ -28,16 +112,21 @@ vanycount(PG_FUNCTION_ARGS)
 	int64 arg = PG_GETARG_INT64(0);
 	int64 result = arg;
 	VectorColumn *arg1 = (VectorColumn *) PG_GETARG_POINTER(1);
-	int i;
 
-	for (i = 0; i <  arg1->dimension; i++) 
+	/* each run of non null rows adds its length */
+	if (arg1->hasRuns)
 	{
-		if (arg1->isnull[i])
-			continue;
+		foreach_vector_run(arg1, position, length)
+		{
+			if (!arg1->isnull[position])
+				result += length;
+		}
 
-		result++;
+		PG_RETURN_INT64(result);
 	}
 
+	result += VectorNonNullCount(arg1);
+
 	PG_RETURN_INT64(result);
 }
 
@@ -49,16 +138,23 @@ vint2sum(PG_FUNCTION_ARGS)
 {
 	int64 sumX = PG_GETARG_INT64(0);
 	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
-	int i;
 
 	int16 *vectorValue = (int16*) arg1->value;
 
-	for (i = 0; i < arg1->dimension; i++)
+	if (arg1->hasRuns)
 	{
-		if (!arg1->isnull[i])
-			sumX += (int64) vectorValue[i];
+		foreach_vector_run(arg1, position, length)
+		{
+			if (!arg1->isnull[position])
+				sumX += (int64) vectorValue[position] * length;
+		}
+
+		PG_RETURN_INT64(sumX);
 	}
 
+	sumX += VectorSumInt16(vectorValue, arg1->isnull, arg1->dimension,
+						   arg1->noNulls);
+
 	PG_RETURN_INT64(sumX);
 }
 
@@ -69,7 +165,6 @@ vint2acc(PG_FUNCTION_ARGS)
 	ArrayType  *transarray;
 	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
 	Int64AggState *transdata;
-	int i;
 
 	/*
 	 * If we're invoked as an aggregate, we can cheat and modify our first
@@ -85,15 +180,24 @@ vint2acc(PG_FUNCTION_ARGS)
 
 	int16 *vectorValue = (int16*) arg1->value;
 
-	for (i = 0; i < arg1->dimension; i++)
+	if (arg1->hasRuns)
 	{
-		if (!arg1->isnull[i])
+		foreach_vector_run(arg1, position, length)
 		{
-			transdata->N++;
-			transdata->sumX += (int64) vectorValue[i];
+			if (!arg1->isnull[position])
+			{
+				transdata->N += length;
+				transdata->sumX += (int64) vectorValue[position] * length;
+			}
 		}
+
+		PG_RETURN_ARRAYTYPE_P(transarray);
 	}
 
+	transdata->N += VectorNonNullCount(arg1);
+	transdata->sumX += VectorSumInt16(vectorValue, arg1->isnull, arg1->dimension,
+									  arg1->noNulls);
+
 	PG_RETURN_ARRAYTYPE_P(transarray);
 }
 
@@ -103,18 +207,23 @@ Datum vint2larger(PG_FUNCTION_ARGS)
 	int16 maxValue = PG_GETARG_INT16(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int16 result = maxValue;
-	int i = 0;
 
 	int16 *vectorValue = (int16*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Max(result, vectorValue[position]);
+		}
 
-		result = Max(result, vectorValue[i]);
+		PG_RETURN_INT16(Max(maxValue, result));
 	}
 
+	result = VectorMaxInt16(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	maxValue = Max(maxValue, result);
 
 	PG_RETURN_INT16(maxValue);
@@ -126,18 +235,23 @@ Datum vint2smaller(PG_FUNCTION_ARGS)
 	int16 minValue = PG_GETARG_INT32(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int16 result = minValue;
-	int i = 0;
 
 	int16 *vectorValue = (int16*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Min(result, vectorValue[position]);
+		}
 
-		result = Min(result, vectorValue[i]);
+		PG_RETURN_INT16(Min(minValue, result));
 	}
 
+	result = VectorMinInt16(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	minValue = Min(minValue, result);
 
 	PG_RETURN_INT16(minValue);
@@ -151,16 +265,23 @@ vint4sum(PG_FUNCTION_ARGS)
 {
 	int64 sumX = PG_GETARG_INT64(0);
 	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
-	int i;
 
 	int32 *vectorValue = (int32*) arg1->value;
 
-	for (i = 0; i < arg1->dimension; i++)
+	if (arg1->hasRuns)
 	{
-		if (!arg1->isnull[i])
-			sumX += (int64) vectorValue[i];
+		foreach_vector_run(arg1, position, length)
+		{
+			if (!arg1->isnull[position])
+				sumX += (int64) vectorValue[position] * length;
+		}
+
+		PG_RETURN_INT64(sumX);
 	}
 
+	sumX += VectorSumInt32(vectorValue, arg1->isnull, arg1->dimension,
+						   arg1->noNulls);
+
 	PG_RETURN_INT64(sumX);
 }
 
@@ -171,7 +292,6 @@ vint4acc(PG_FUNCTION_ARGS)
 	ArrayType  *transarray;
 	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
 	Int64AggState *transdata;
-	int i;
 
 	/*
 	 * If we're invoked as an aggregate, we can cheat and modify our first
@@ -187,15 +307,24 @@ vint4acc(PG_FUNCTION_ARGS)
 
 	int32 *vectorValue = (int32*) arg1->value;
 
-	for (i = 0; i < arg1->dimension; i++)
+	if (arg1->hasRuns)
 	{
-		if (!arg1->isnull[i])
+		foreach_vector_run(arg1, position, length)
 		{
-			transdata->N++;
-			transdata->sumX += (int64) vectorValue[i];
+			if (!arg1->isnull[position])
+			{
+				transdata->N += length;
+				transdata->sumX += (int64) vectorValue[position] * length;
+			}
 		}
+
+		PG_RETURN_ARRAYTYPE_P(transarray);
 	}
 
+	transdata->N += VectorNonNullCount(arg1);
+	transdata->sumX += VectorSumInt32(vectorValue, arg1->isnull, arg1->dimension,
+									  arg1->noNulls);
+
 	PG_RETURN_ARRAYTYPE_P(transarray);
 }
 
@@ -205,18 +334,23 @@ Datum vint4larger(PG_FUNCTION_ARGS)
 	int32 maxValue = PG_GETARG_INT32(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int32 result = maxValue;
-	int i = 0;
 
 	int32 *vectorValue = (int32*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Max(result, vectorValue[position]);
+		}
 
-		result = Max(result, vectorValue[i]);
+		PG_RETURN_INT32(Max(maxValue, result));
 	}
 
+	result = VectorMaxInt32(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	maxValue = Max(maxValue, result);
 
 	PG_RETURN_INT32(maxValue);
@@ -228,18 +362,23 @@ Datum vint4smaller(PG_FUNCTION_ARGS)
 	int32 minValue = PG_GETARG_INT32(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int32 result = minValue;
-	int i = 0;
 
 	int32 *vectorValue = (int32*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Min(result, vectorValue[position]);
+		}
 
-		result = Min(result, vectorValue[i]);
+		PG_RETURN_INT32(Min(minValue, result));
 	}
 
+	result = VectorMinInt32(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	minValue = Min(minValue, result);
 
 	PG_RETURN_INT32(minValue);
@@ -289,7 +428,6 @@ Datum
 vint8acc(PG_FUNCTION_ARGS)
 {
 	Int128AggState *state;
-	int i;
 
 	state = PG_ARGISNULL(0) ? NULL : (Int128AggState *) PG_GETARG_POINTER(0);
 	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
@@ -311,15 +449,26 @@ vint8acc(PG_FUNCTION_ARGS)
 
 	int64 *vectorValue = (int64*) arg1->value;
 
-	for (i = 0; i < arg1->dimension; i++)
+	if (arg1->hasRuns)
 	{
-		if (!arg1->isnull[i])
+		foreach_vector_run(arg1, position, length)
 		{
-			state->N++;
-			state->sumX += (int128) vectorValue[i];
+			if (!arg1->isnull[position])
+			{
+				state->N += length;
+				state->sumX += (int128) vectorValue[position] * length;
+			}
 		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		PG_RETURN_NUMERIC(state);
 	}
 
+	state->N += VectorNonNullCount(arg1);
+	state->sumX += VectorSumInt64(vectorValue, arg1->isnull, arg1->dimension,
+								  arg1->noNulls);
+
 	MemoryContextSwitchTo(oldContext);
 
 	PG_RETURN_NUMERIC(state);
@@ -367,19 +516,24 @@ Datum vint8larger(PG_FUNCTION_ARGS)
 {
 	int64 maxValue = PG_GETARG_INT64(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
-	int64 result = 0;
-	int i = 0;
+	int64 result = maxValue;
 
 	int64 *vectorValue = (int64*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Max(result, vectorValue[position]);
+		}
 
-		result = Max(maxValue, vectorValue[i]);
+		PG_RETURN_INT64(Max(maxValue, result));
 	}
 
+	result = VectorMaxInt64(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	maxValue = Max(maxValue, result);
 
 	PG_RETURN_INT64(maxValue);
@@ -391,23 +545,149 @@ Datum vint8smaller(PG_FUNCTION_ARGS)
 	int64 minValue = PG_GETARG_INT64(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int64 result = minValue;
-	int i = 0;
 
 	int64 *vectorValue = (int64*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Min(result, vectorValue[position]);
+		}
 
-		result = Min(result, vectorValue[i]);
+		PG_RETURN_INT64(Min(minValue, result));
 	}
 
+	result = VectorMinInt64(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	minValue = Min(minValue, result);
 
 	PG_RETURN_INT64(minValue);
 }
 
+/* numeric */
+
+/*
+ * NumericAccum adds a numeric to the NumericAggState of sum(numeric) and
+ * avg(numeric) through numeric_avg_accum, which creates the state in the
+ * aggregate context on the first call.
+ */
+static Datum
+NumericAccum(FunctionCallInfo fcinfo, Datum state, bool *stateIsNull, Datum value)
+{
+	LOCAL_FCINFO(accumFcinfo, 2);
+
+	InitFunctionCallInfoData(*accumFcinfo, NULL, 2, InvalidOid, fcinfo->context, NULL);
+	accumFcinfo->args[0].value = state;
+	accumFcinfo->args[0].isnull = *stateIsNull;
+	accumFcinfo->args[1].value = value;
+	accumFcinfo->args[1].isnull = false;
+
+	state = numeric_avg_accum(accumFcinfo);
+	*stateIsNull = false;
+
+	return state;
+}
+
+/*
+ * NumericFlushSum adds the values summed up in the int128 sum to the state
+ * as one numeric, so that the state converts them to numeric only once.
+ */
+static Datum
+NumericFlushSum(FunctionCallInfo fcinfo, NumericInt128Sum *sum, Datum state,
+				bool *stateIsNull)
+{
+	if (sum->N == 0)
+		return state;
+
+	Numeric sumNumeric = numeric_int128_sum_result(sum);
+	state = NumericAccum(fcinfo, state, stateIsNull, NumericGetDatum(sumNumeric));
+
+	/* the sum counted as one value, but stands for N of them */
+	((NumericAggStateHead *) DatumGetPointer(state))->N += sum->N - 1;
+
+	memset(sum, 0, sizeof(NumericInt128Sum));
+
+	return state;
+}
+
+/*
+ * NumericAddValue adds count times the value to the int128 sum, flushing
+ * the sum first when it would overflow. Values it can not hold are added
+ * to the state one by one.
+ */
+static Datum
+NumericAddValue(FunctionCallInfo fcinfo, NumericInt128Sum *sum, Datum state,
+				bool *stateIsNull, Datum value, int64 count)
+{
+	if (numeric_int128_sum_add(sum, value, count))
+		return state;
+
+	if (sum->N > 0)
+	{
+		state = NumericFlushSum(fcinfo, sum, state, stateIsNull);
+
+		if (numeric_int128_sum_add(sum, value, count))
+			return state;
+	}
+
+	for (int64 i = 0; i < count; i++)
+		state = NumericAccum(fcinfo, state, stateIsNull, value);
+
+	return state;
+}
+
+/*
+ * vnumericacc is the transition function of vsum(numeric) and
+ * vavg(numeric). The values of the vector are summed up as a fixed scale
+ * int128 and added to the NumericAggState of sum(numeric) as one numeric,
+ * so that numeric_sum, numeric_avg and the parallel aggregation of the
+ * built-in aggregates work on the state.
+ */
+PG_FUNCTION_INFO_V1(vnumericacc);
+Datum
+vnumericacc(PG_FUNCTION_ARGS)
+{
+	bool stateIsNull = PG_ARGISNULL(0);
+	Datum state = stateIsNull ? (Datum) 0 : PG_GETARG_DATUM(0);
+	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
+	NumericInt128Sum sum = { 0 };
+	int i;
+
+	if (!AggCheckCallContext(fcinfo, NULL))
+		elog(ERROR, "aggregate function called in non-aggregate context");
+
+	Datum *vectorValue = (Datum*) arg1->value;
+
+	if (arg1->hasRuns)
+	{
+		foreach_vector_run(arg1, position, length)
+		{
+			if (!arg1->isnull[position])
+				state = NumericAddValue(fcinfo, &sum, state, &stateIsNull,
+										vectorValue[position], length);
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg1->dimension; i++)
+		{
+			if (!arg1->isnull[i])
+				state = NumericAddValue(fcinfo, &sum, state, &stateIsNull,
+										vectorValue[i], 1);
+		}
+	}
+
+	state = NumericFlushSum(fcinfo, &sum, state, &stateIsNull);
+
+	if (stateIsNull)
+		PG_RETURN_NULL();
+
+	PG_RETURN_DATUM(state);
+}
+
 // date
 
 PG_FUNCTION_INFO_V1(vdatelarger);
@@ -416,18 +696,23 @@ Datum vdatelarger(PG_FUNCTION_ARGS)
 	int32 maxValue = PG_GETARG_INT32(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int32 result = maxValue;
-	int i = 0;
 
 	DateADT *vectorValue = (DateADT*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Max(result, vectorValue[position]);
+		}
 
-		result = Max(result, vectorValue[i]);
+		PG_RETURN_INT32(Max(maxValue, result));
 	}
 
+	result = VectorMaxInt32(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	maxValue = Max(maxValue, result);
 
 	PG_RETURN_INT32(maxValue);
@@ -439,19 +724,835 @@ Datum vdatesmaller(PG_FUNCTION_ARGS)
 	int32 minValue = PG_GETARG_INT32(0);
 	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
 	int32 result = minValue;
-	int i = 0;
 
 	DateADT *vectorValue = (DateADT*) arg2->value;
 
-	for (i = 0; i < arg2->dimension; i++) 
+	if (arg2->hasRuns)
 	{
-		if (arg2->isnull[i])
-			continue;
+		foreach_vector_run(arg2, position, length)
+		{
+			if (!arg2->isnull[position])
+				result = Min(result, vectorValue[position]);
+		}
 
-		result = Min(result, vectorValue[i]);
+		PG_RETURN_INT32(Min(minValue, result));
 	}
 
+	result = VectorMinInt32(vectorValue, arg2->isnull, arg2->dimension,
+						   arg2->noNulls, result);
+
 	minValue = Min(minValue, result);
 
 	PG_RETURN_INT32(minValue);
-}
\ No newline at end of file
+}
+
+// timestamp, timestamptz
+
+/*
+ * VectorTimestampMinMax folds the non null values of the vector into the
+ * running maximum, or minimum, of a timestamp or timestamptz column. The
+ * state starts NULL, as for max(timestamp), so that no rows give NULL.
+ */
+static Datum
+VectorTimestampMinMax(FunctionCallInfo fcinfo, bool larger)
+{
+	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	Timestamp result = hasValue ? PG_GETARG_TIMESTAMP(0) : 0;
+
+	Timestamp *vectorValue = (Timestamp*) arg2->value;
+
+	if (arg2->hasRuns)
+	{
+		foreach_vector_run(arg2, position, length)
+		{
+			if (arg2->isnull[position])
+				continue;
+
+			if (!hasValue ||
+				(larger ? vectorValue[position] > result : vectorValue[position] < result))
+				result = vectorValue[position];
+
+			hasValue = true;
+		}
+	}
+	else if (VectorNonNullCount(arg2) > 0)
+	{
+		if (larger)
+			result = VectorMaxInt64(vectorValue, arg2->isnull, arg2->dimension,
+								   arg2->noNulls, hasValue ? result : PG_INT64_MIN);
+		else
+			result = VectorMinInt64(vectorValue, arg2->isnull, arg2->dimension,
+								   arg2->noNulls, hasValue ? result : PG_INT64_MAX);
+
+		hasValue = true;
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_TIMESTAMP(result);
+}
+
+PG_FUNCTION_INFO_V1(vtimestamplarger);
+Datum vtimestamplarger(PG_FUNCTION_ARGS)
+{
+	return VectorTimestampMinMax(fcinfo, true);
+}
+
+PG_FUNCTION_INFO_V1(vtimestampsmaller);
+Datum vtimestampsmaller(PG_FUNCTION_ARGS)
+{
+	return VectorTimestampMinMax(fcinfo, false);
+}
+
+PG_FUNCTION_INFO_V1(vtimestamptzlarger);
+Datum vtimestamptzlarger(PG_FUNCTION_ARGS)
+{
+	return VectorTimestampMinMax(fcinfo, true);
+}
+
+PG_FUNCTION_INFO_V1(vtimestamptzsmaller);
+Datum vtimestamptzsmaller(PG_FUNCTION_ARGS)
+{
+	return VectorTimestampMinMax(fcinfo, false);
+}
+
+/* float4 */
+
+/*
+ * vfloat4sum starts from a NULL state, like sum(float4), so that the sum of no
+ * rows is NULL. Runs are added row by row to round like the row path.
+ */
+PG_FUNCTION_INFO_V1(vfloat4sum);
+Datum
+vfloat4sum(PG_FUNCTION_ARGS)
+{
+	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	float4 sumX = hasValue ? PG_GETARG_FLOAT4(0) : 0;
+	int i;
+
+	float4 *vectorValue = (float4*) arg1->value;
+
+	if (arg1->hasRuns)
+	{
+		foreach_vector_run(arg1, position, length)
+		{
+			if (arg1->isnull[position])
+				continue;
+
+			for (i = 0; i < length; i++)
+				sumX = float4_pl(sumX, vectorValue[position]);
+
+			hasValue = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg1->dimension; i++)
+		{
+			if (arg1->isnull[i])
+				continue;
+
+			sumX = float4_pl(sumX, vectorValue[i]);
+			hasValue = true;
+		}
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT4(sumX);
+}
+
+/*
+ * vfloat4acc keeps the float8[] {N, Sx, Sxx} state of float4_accum, so that
+ * float8_avg and float8_combine work on it. Sxx is left alone, as avg
+ * does not read it.
+ */
+PG_FUNCTION_INFO_V1(vfloat4acc);
+Datum
+vfloat4acc(PG_FUNCTION_ARGS)
+{
+	ArrayType  *transarray;
+	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
+	float8	   *transvalues;
+	int i;
+
+	if (AggCheckCallContext(fcinfo, NULL))
+		transarray = PG_GETARG_ARRAYTYPE_P(0);
+	else
+		transarray = PG_GETARG_ARRAYTYPE_P_COPY(0);
+
+	if (ARR_NDIM(transarray) != 1 || ARR_DIMS(transarray)[0] != 3 ||
+		ARR_HASNULL(transarray) || ARR_ELEMTYPE(transarray) != FLOAT8OID)
+		elog(ERROR, "vfloat4acc: expected 3-element float8 array");
+
+	transvalues = (float8 *) ARR_DATA_PTR(transarray);
+
+	float4 *vectorValue = (float4*) arg1->value;
+
+	float8 N = transvalues[0];
+	float8 sumX = transvalues[1];
+
+	if (arg1->hasRuns)
+	{
+		foreach_vector_run(arg1, position, length)
+		{
+			if (arg1->isnull[position])
+				continue;
+
+			for (i = 0; i < length; i++)
+				sumX = float8_pl(sumX, vectorValue[position]);
+
+			N += length;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg1->dimension; i++)
+		{
+			if (arg1->isnull[i])
+				continue;
+
+			sumX = float8_pl(sumX, vectorValue[i]);
+			N += 1.0;
+		}
+	}
+
+	transvalues[0] = N;
+	transvalues[1] = sumX;
+
+	PG_RETURN_ARRAYTYPE_P(transarray);
+}
+
+/*
+ * vfloat4larger and vfloat4smaller compare with float4_gt and float4_lt, which sort
+ * NaN above every other value, and start from a NULL state so that no rows
+ * give NULL.
+ */
+PG_FUNCTION_INFO_V1(vfloat4larger);
+Datum vfloat4larger(PG_FUNCTION_ARGS)
+{
+	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	float4 result = hasValue ? PG_GETARG_FLOAT4(0) : 0;
+	int i = 0;
+
+	float4 *vectorValue = (float4*) arg2->value;
+
+	if (arg2->hasRuns)
+	{
+		foreach_vector_run(arg2, position, length)
+		{
+			if (arg2->isnull[position])
+				continue;
+
+			if (!hasValue || float4_gt(vectorValue[position], result))
+				result = vectorValue[position];
+
+			hasValue = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg2->dimension; i++)
+		{
+			if (arg2->isnull[i])
+				continue;
+
+			if (!hasValue || float4_gt(vectorValue[i], result))
+				result = vectorValue[i];
+
+			hasValue = true;
+		}
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT4(result);
+}
+
+PG_FUNCTION_INFO_V1(vfloat4smaller);
+Datum vfloat4smaller(PG_FUNCTION_ARGS)
+{
+	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	float4 result = hasValue ? PG_GETARG_FLOAT4(0) : 0;
+	int i = 0;
+
+	float4 *vectorValue = (float4*) arg2->value;
+
+	if (arg2->hasRuns)
+	{
+		foreach_vector_run(arg2, position, length)
+		{
+			if (arg2->isnull[position])
+				continue;
+
+			if (!hasValue || float4_lt(vectorValue[position], result))
+				result = vectorValue[position];
+
+			hasValue = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg2->dimension; i++)
+		{
+			if (arg2->isnull[i])
+				continue;
+
+			if (!hasValue || float4_lt(vectorValue[i], result))
+				result = vectorValue[i];
+
+			hasValue = true;
+		}
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT4(result);
+}
+
+/* float8 */
+
+/*
+ * vfloat8sum starts from a NULL state, like sum(float8), so that the sum of no
+ * rows is NULL. Runs are added row by row to round like the row path.
+ */
+PG_FUNCTION_INFO_V1(vfloat8sum);
+Datum
+vfloat8sum(PG_FUNCTION_ARGS)
+{
+	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	float8 sumX = hasValue ? PG_GETARG_FLOAT8(0) : 0;
+	int i;
+
+	float8 *vectorValue = (float8*) arg1->value;
+
+	if (arg1->hasRuns)
+	{
+		foreach_vector_run(arg1, position, length)
+		{
+			if (arg1->isnull[position])
+				continue;
+
+			for (i = 0; i < length; i++)
+				sumX = float8_pl(sumX, vectorValue[position]);
+
+			hasValue = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg1->dimension; i++)
+		{
+			if (arg1->isnull[i])
+				continue;
+
+			sumX = float8_pl(sumX, vectorValue[i]);
+			hasValue = true;
+		}
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(sumX);
+}
+
+/*
+ * vfloat8acc keeps the float8[] {N, Sx, Sxx} state of float8_accum, so that
+ * float8_avg and float8_combine work on it. Sxx is left alone, as avg
+ * does not read it.
+ */
+PG_FUNCTION_INFO_V1(vfloat8acc);
+Datum
+vfloat8acc(PG_FUNCTION_ARGS)
+{
+	ArrayType  *transarray;
+	VectorColumn *arg1 = (VectorColumn*) PG_GETARG_POINTER(1);
+	float8	   *transvalues;
+	int i;
+
+	if (AggCheckCallContext(fcinfo, NULL))
+		transarray = PG_GETARG_ARRAYTYPE_P(0);
+	else
+		transarray = PG_GETARG_ARRAYTYPE_P_COPY(0);
+
+	if (ARR_NDIM(transarray) != 1 || ARR_DIMS(transarray)[0] != 3 ||
+		ARR_HASNULL(transarray) || ARR_ELEMTYPE(transarray) != FLOAT8OID)
+		elog(ERROR, "vfloat8acc: expected 3-element float8 array");
+
+	transvalues = (float8 *) ARR_DATA_PTR(transarray);
+
+	float8 *vectorValue = (float8*) arg1->value;
+
+	float8 N = transvalues[0];
+	float8 sumX = transvalues[1];
+
+	if (arg1->hasRuns)
+	{
+		foreach_vector_run(arg1, position, length)
+		{
+			if (arg1->isnull[position])
+				continue;
+
+			for (i = 0; i < length; i++)
+				sumX = float8_pl(sumX, vectorValue[position]);
+
+			N += length;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg1->dimension; i++)
+		{
+			if (arg1->isnull[i])
+				continue;
+
+			sumX = float8_pl(sumX, vectorValue[i]);
+			N += 1.0;
+		}
+	}
+
+	transvalues[0] = N;
+	transvalues[1] = sumX;
+
+	PG_RETURN_ARRAYTYPE_P(transarray);
+}
+
+/*
+ * vfloat8larger and vfloat8smaller compare with float8_gt and float8_lt, which sort
+ * NaN above every other value, and start from a NULL state so that no rows
+ * give NULL.
+ */
+PG_FUNCTION_INFO_V1(vfloat8larger);
+Datum vfloat8larger(PG_FUNCTION_ARGS)
+{
+	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	float8 result = hasValue ? PG_GETARG_FLOAT8(0) : 0;
+	int i = 0;
+
+	float8 *vectorValue = (float8*) arg2->value;
+
+	if (arg2->hasRuns)
+	{
+		foreach_vector_run(arg2, position, length)
+		{
+			if (arg2->isnull[position])
+				continue;
+
+			if (!hasValue || float8_gt(vectorValue[position], result))
+				result = vectorValue[position];
+
+			hasValue = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg2->dimension; i++)
+		{
+			if (arg2->isnull[i])
+				continue;
+
+			if (!hasValue || float8_gt(vectorValue[i], result))
+				result = vectorValue[i];
+
+			hasValue = true;
+		}
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(result);
+}
+
+PG_FUNCTION_INFO_V1(vfloat8smaller);
+Datum vfloat8smaller(PG_FUNCTION_ARGS)
+{
+	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	float8 result = hasValue ? PG_GETARG_FLOAT8(0) : 0;
+	int i = 0;
+
+	float8 *vectorValue = (float8*) arg2->value;
+
+	if (arg2->hasRuns)
+	{
+		foreach_vector_run(arg2, position, length)
+		{
+			if (arg2->isnull[position])
+				continue;
+
+			if (!hasValue || float8_lt(vectorValue[position], result))
+				result = vectorValue[position];
+
+			hasValue = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < arg2->dimension; i++)
+		{
+			if (arg2->isnull[i])
+				continue;
+
+			if (!hasValue || float8_lt(vectorValue[i], result))
+				result = vectorValue[i];
+
+			hasValue = true;
+		}
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(result);
+}
+
+/* text */
+
+/*
+ * VectorTextMinMax compares with bttextcmp under the collation of the
+ * aggregate, like text_larger and text_smaller. Rows read from a dictionary
+ * encoded chunk share the datum of their value, so a row with the same
+ * datum as the row before it is skipped without comparing it again. The
+ * result may point into the vector, the aggregate copies it into its own
+ * memory.
+ */
+static Datum
+VectorTextMinMax(FunctionCallInfo fcinfo, bool larger)
+{
+	VectorColumn *arg2 = (VectorColumn*) PG_GETARG_POINTER(1);
+	bool hasValue = !PG_ARGISNULL(0);
+	Datum result = hasValue ? PG_GETARG_DATUM(0) : (Datum) 0;
+	Oid collation = PG_GET_COLLATION();
+	Datum lastValue = (Datum) 0;
+	int i = 0;
+
+	Datum *vectorValue = (Datum*) arg2->value;
+
+	for (i = 0; i < arg2->dimension; i++)
+	{
+		if (arg2->isnull[i] || vectorValue[i] == lastValue)
+			continue;
+
+		lastValue = vectorValue[i];
+
+		if (hasValue)
+		{
+			int32 cmp = DatumGetInt32(DirectFunctionCall2Coll(bttextcmp, collation,
+															  vectorValue[i], result));
+			/* like text_larger and text_smaller, ties take the new value */
+			if (larger ? cmp < 0 : cmp > 0)
+				continue;
+		}
+
+		result = vectorValue[i];
+		hasValue = true;
+	}
+
+	if (!hasValue)
+		PG_RETURN_NULL();
+
+	PG_RETURN_DATUM(result);
+}
+
+PG_FUNCTION_INFO_V1(vtextlarger);
+Datum vtextlarger(PG_FUNCTION_ARGS)
+{
+	return VectorTextMinMax(fcinfo, true);
+}
+
+PG_FUNCTION_INFO_V1(vtextsmaller);
+Datum vtextsmaller(PG_FUNCTION_ARGS)
+{
+	return VectorTextMinMax(fcinfo, false);
+}
+
+/* count(DISTINCT) */
+
+#define COUNT_DISTINCT_INITIAL_CAPACITY 1024
+
+/*
+ * VectorDistinctState is the transition state of vcount_distinct and
+ * vapprox_count_distinct. The exact count keeps the distinct values in an
+ * open addressing hash set, the approximate count keeps a HyperLogLog
+ * sketch of their hashes.
+ */
+typedef struct VectorDistinctState
+{
+	MemoryContext context;
+	bool isVarlena;
+
+	/* exact count */
+	uint64 count;
+	uint64 capacity;
+	uint64 *hashes;			/* 0 marks an empty slot */
+	Datum *values;
+
+	/* approximate count */
+	uint8 *registers;
+} VectorDistinctState;
+
+static VectorDistinctState *
+GetDistinctState(FunctionCallInfo fcinfo, bool approximate)
+{
+	MemoryContext aggContext;
+
+	if (!AggCheckCallContext(fcinfo, &aggContext))
+		elog(ERROR, "aggregate function called in non-aggregate context");
+
+	if (!PG_ARGISNULL(0))
+		return (VectorDistinctState *) PG_GETARG_POINTER(0);
+
+	VectorDistinctState *state =
+		MemoryContextAllocZero(aggContext, sizeof(VectorDistinctState));
+	Oid typeId = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+	state->context = aggContext;
+	state->isVarlena = get_typlen(typeId) == -1;
+
+	if (approximate)
+	{
+		/* approx_count_distinct is vectorized without the checks of count(DISTINCT) */
+		if (!ColumnarHllTypeSupported(typeId))
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("approx_count_distinct does not support type %s",
+								   format_type_be(typeId))));
+
+		if (state->isVarlena && OidIsValid(PG_GET_COLLATION()) &&
+			!get_collation_isdeterministic(PG_GET_COLLATION()))
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("approx_count_distinct does not support "
+								   "nondeterministic collations")));
+
+		state->registers = MemoryContextAllocZero(aggContext, COLUMNAR_HLL_REGISTERS);
+	}
+	else
+	{
+		state->capacity = COUNT_DISTINCT_INITIAL_CAPACITY;
+		state->hashes = MemoryContextAllocZero(aggContext,
+											   sizeof(uint64) * state->capacity);
+		state->values = MemoryContextAlloc(aggContext, sizeof(Datum) * state->capacity);
+	}
+
+	return state;
+}
+
+static void
+DistinctSetGrow(VectorDistinctState *state)
+{
+	uint64 oldCapacity = state->capacity;
+	uint64 *oldHashes = state->hashes;
+	Datum *oldValues = state->values;
+
+	state->capacity = oldCapacity * 2;
+	state->hashes = MemoryContextAllocExtended(state->context,
+											   sizeof(uint64) * state->capacity,
+											   MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+	state->values = MemoryContextAllocHuge(state->context,
+										   sizeof(Datum) * state->capacity);
+
+	uint64 mask = state->capacity - 1;
+	for (uint64 i = 0; i < oldCapacity; i++)
+	{
+		if (oldHashes[i] == 0)
+			continue;
+
+		uint64 position = oldHashes[i] & mask;
+		while (state->hashes[position] != 0)
+			position = (position + 1) & mask;
+
+		state->hashes[position] = oldHashes[i];
+		state->values[position] = oldValues[i];
+	}
+
+	pfree(oldHashes);
+	pfree(oldValues);
+}
+
+/*
+ * DistinctSetAdd adds a value to the hash set unless an equal value is in
+ * it already. Text values are compared by their bytes, which is only
+ * equality under deterministic collations, as the planner checks.
+ */
+static void
+DistinctSetAdd(VectorDistinctState *state, uint64 hash, Datum value)
+{
+	if (hash == 0)
+		hash = 1;
+
+	/* the set is kept at most half full */
+	if (state->count * 2 >= state->capacity)
+		DistinctSetGrow(state);
+
+	uint64 mask = state->capacity - 1;
+	uint64 position = hash & mask;
+
+	for (; state->hashes[position] != 0; position = (position + 1) & mask)
+	{
+		if (state->hashes[position] != hash)
+			continue;
+
+		if (!state->isVarlena)
+		{
+			if (state->values[position] == value)
+				return;
+			continue;
+		}
+
+		text *entry = DatumGetTextPP(state->values[position]);
+		text *valueText = DatumGetTextPP(value);
+
+		if (VARSIZE_ANY_EXHDR(entry) == VARSIZE_ANY_EXHDR(valueText) &&
+			memcmp(VARDATA_ANY(entry), VARDATA_ANY(valueText),
+				   VARSIZE_ANY_EXHDR(entry)) == 0)
+			return;
+	}
+
+	if (state->isVarlena)
+	{
+		text *valueText = DatumGetTextPP(value);
+		Size length = VARSIZE_ANY_EXHDR(valueText);
+		text *copy = MemoryContextAlloc(state->context, VARHDRSZ + length);
+
+		SET_VARSIZE(copy, VARHDRSZ + length);
+		memcpy(VARDATA(copy), VARDATA_ANY(valueText), length);
+		value = PointerGetDatum(copy);
+	}
+
+	state->hashes[position] = hash;
+	state->values[position] = value;
+	state->count++;
+}
+
+/*
+ * VectorDistinctAdd adds the non NULL values of a vector to the state. Runs,
+ * and rows equal to the row before them, are added once.
+ */
+static void
+VectorDistinctAdd(VectorDistinctState *state, VectorColumn *column)
+{
+	uint32 count = column->hasRuns ? column->runCount : column->dimension;
+	uint32 row = 0;
+	bool hasPrevious = false;
+	Datum previous = (Datum) 0;
+
+	for (uint32 i = 0; i < count; row += column->hasRuns ? column->runLength[i] : 1, i++)
+	{
+		if (column->isnull[row])
+			continue;
+
+		Datum value;
+		switch (column->columnTypeLen)
+		{
+			case sizeof(int8):
+				value = Int64GetDatum(((int8 *) column->value)[row]);
+				break;
+			case sizeof(int16):
+				value = Int64GetDatum(((int16 *) column->value)[row]);
+				break;
+			case sizeof(int32):
+				value = Int64GetDatum(((int32 *) column->value)[row]);
+				break;
+			default:
+				value = ((Datum *) column->value)[row];
+				break;
+		}
+
+		if (hasPrevious && value == previous)
+			continue;
+
+		hasPrevious = true;
+		previous = value;
+
+		uint64 hash = ColumnarHllHash(value, state->isVarlena);
+
+		if (state->registers != NULL)
+			ColumnarHllAddHash(state->registers, hash);
+		else
+			DistinctSetAdd(state, hash, value);
+	}
+}
+
+PG_FUNCTION_INFO_V1(vcountdistinctacc);
+Datum
+vcountdistinctacc(PG_FUNCTION_ARGS)
+{
+	VectorDistinctState *state = GetDistinctState(fcinfo, false);
+
+	VectorDistinctAdd(state, (VectorColumn *) PG_GETARG_POINTER(1));
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(vcountdistinctfinal);
+Datum
+vcountdistinctfinal(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT64(0);
+
+	VectorDistinctState *state = (VectorDistinctState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_INT64(state->count);
+}
+
+PG_FUNCTION_INFO_V1(vapproxcountdistinctacc);
+Datum
+vapproxcountdistinctacc(PG_FUNCTION_ARGS)
+{
+	VectorDistinctState *state = GetDistinctState(fcinfo, true);
+
+	VectorDistinctAdd(state, (VectorColumn *) PG_GETARG_POINTER(1));
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(vapproxcountdistinctfinal);
+Datum
+vapproxcountdistinctfinal(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT64(0);
+
+	VectorDistinctState *state = (VectorDistinctState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_INT64(ColumnarHllEstimate(state->registers));
+}
+
+/*
+ * VectorApproxCountDistinctAddSketch merges the registers of a sketch into
+ * the state of vapprox_count_distinct, creating the state in aggContext if
+ * it is NULL, and returns the state. The vector aggregate node adds the
+ * sketches of the chunk groups the scan below left out with it.
+ */
+Datum
+VectorApproxCountDistinctAddSketch(Datum stateDatum, bool stateIsNull,
+								   MemoryContext aggContext, bool isVarlena,
+								   const uint8 *registers)
+{
+	VectorDistinctState *state = (VectorDistinctState *) DatumGetPointer(stateDatum);
+
+	if (stateIsNull)
+	{
+		state = MemoryContextAllocZero(aggContext, sizeof(VectorDistinctState));
+		state->context = aggContext;
+		state->isVarlena = isVarlena;
+		state->registers = MemoryContextAllocZero(aggContext, COLUMNAR_HLL_REGISTERS);
+	}
+
+	for (int i = 0; i < COLUMNAR_HLL_REGISTERS; i++)
+		state->registers[i] = Max(state->registers[i], registers[i]);
+
+	return PointerGetDatum(state);
+}
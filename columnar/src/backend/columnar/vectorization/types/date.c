@@ -1,13 +1,319 @@
-
 #include "postgres.h"
 
+#include "catalog/pg_type.h"
 #include "nodes/execnodes.h"
+#include "parser/scansup.h"
+#include "pgtime.h"
+#include "utils/builtins.h"
 #include "utils/date.h"
+#include "utils/datetime.h"
+#include "utils/timestamp.h"
 
 #include "columnar/vectorization/types/types.h"
 
+static inline Timestamp DateToComparableTimestamp(DateADT date);
+static inline TimestampTz DateToComparableTimestampTz(DateADT date);
+static VectorColumn * VectorizedTimestampFunction(FunctionCallInfo fcinfo,
+												  PGFunction function,
+												  int64 truncUnitLength);
+static Datum CallTimestampFunction(PGFunction function, Datum units, Datum value,
+								   bool *isNull);
+static int64 TimestampTruncUnitLength(text *units);
+
 // date (int32)
 BUILD_CMP_OPERATOR_INT(date_, DateADT, DateADT)
 
 // time (int64)
-BUILD_CMP_OPERATOR_INT(time_, TimeADT, TimeADT)
\ No newline at end of file
+BUILD_CMP_OPERATOR_INT(time_, TimeADT, TimeADT)
+
+// timestamp, timestamptz (int64)
+BUILD_CMP_OPERATOR_INT(timestamp_, Timestamp, Timestamp)
+BUILD_CMP_OPERATOR_INT(timestamptz_, TimestampTz, TimestampTz)
+
+// timestamp / date
+BUILD_CMP_OPERATOR_CONVERTED(timestamp_, _date, Timestamp, _NO_CONVERSION,
+							 DateADT, DateToComparableTimestamp)
+BUILD_CMP_OPERATOR_CONVERTED(date_, _timestamp, DateADT, DateToComparableTimestamp,
+							 Timestamp, _NO_CONVERSION)
+
+// timestamptz / date
+BUILD_CMP_OPERATOR_CONVERTED(timestamptz_, _date, TimestampTz, _NO_CONVERSION,
+							 DateADT, DateToComparableTimestampTz)
+BUILD_CMP_OPERATOR_CONVERTED(date_, _timestamptz, DateADT, DateToComparableTimestampTz,
+							 TimestampTz, _NO_CONVERSION)
+
+
+/*
+ * DateToComparableTimestamp converts a date to the timestamp of its
+ * midnight, like date2timestamp_opt_overflow. Dates past the last timestamp
+ * become a value above all finite timestamps but below infinity, so they
+ * compare the way date_cmp_timestamp compares them.
+ */
+static inline Timestamp
+DateToComparableTimestamp(DateADT date)
+{
+	if (DATE_IS_NOBEGIN(date))
+		return DT_NOBEGIN;
+	else if (DATE_IS_NOEND(date))
+		return DT_NOEND;
+	else if (date >= (TIMESTAMP_END_JULIAN - POSTGRES_EPOCH_JDATE))
+		return DT_NOEND - 1;
+
+	return date * USECS_PER_DAY;
+}
+
+
+/*
+ * DateToComparableTimestampTz converts a date to the timestamptz of its
+ * midnight in the session time zone, handling out of range dates like
+ * DateToComparableTimestamp. The time zone offset takes a lookup, so the
+ * last conversion is remembered; a column, or the constant, mostly repeats
+ * the same date.
+ */
+static inline TimestampTz
+DateToComparableTimestampTz(DateADT date)
+{
+	static bool lastValid = false;
+	static DateADT lastDate = 0;
+	static pg_tz *lastTimeZone = NULL;
+	static TimestampTz lastResult = 0;
+
+	if (lastValid && lastDate == date && lastTimeZone == session_timezone)
+	{
+		return lastResult;
+	}
+
+	int overflow = 0;
+	TimestampTz result = date2timestamptz_opt_overflow(date, &overflow);
+	if (overflow > 0)
+	{
+		result = DT_NOEND - 1;
+	}
+	else if (overflow < 0)
+	{
+		result = DT_NOBEGIN + 1;
+	}
+
+	lastValid = true;
+	lastDate = date;
+	lastTimeZone = session_timezone;
+	lastResult = result;
+
+	return result;
+}
+
+
+// date_trunc and date_part of timestamp and timestamptz
+PG_FUNCTION_INFO_V1(vdate_trunc);
+Datum
+vdate_trunc(PG_FUNCTION_ARGS)
+{
+	bool hasTimeZone = get_fn_expr_argtype(fcinfo->flinfo, 1) == TIMESTAMPTZOID;
+	int64 truncUnitLength = 0;
+
+	/* without a time zone, the units up to a day have a fixed length */
+	if (!hasTimeZone && !PG_ARGISNULL(0))
+	{
+		VectorFnArgument *units = (VectorFnArgument *) PG_GETARG_POINTER(0);
+		truncUnitLength = TimestampTruncUnitLength(DatumGetTextPP(units->arg));
+	}
+
+	PG_RETURN_POINTER(VectorizedTimestampFunction(fcinfo,
+												  hasTimeZone ? timestamptz_trunc :
+												  timestamp_trunc,
+												  truncUnitLength));
+}
+
+
+PG_FUNCTION_INFO_V1(vdate_part);
+Datum
+vdate_part(PG_FUNCTION_ARGS)
+{
+	bool hasTimeZone = get_fn_expr_argtype(fcinfo->flinfo, 1) == TIMESTAMPTZOID;
+
+	PG_RETURN_POINTER(VectorizedTimestampFunction(fcinfo,
+												  hasTimeZone ? timestamptz_part :
+												  timestamp_part,
+												  0));
+}
+
+
+/*
+ * TruncateTimestamps truncates the timestamps to multiples of unitLength,
+ * which is how date_trunc truncates them to units up to a day. Infinite
+ * timestamps stay as they are.
+ */
+static COLUMNAR_VECTOR_KERNEL void
+TruncateTimestamps(const int64 *values, Datum *result, uint32 dimension,
+				   int64 unitLength)
+{
+	for (uint32 i = 0; i < dimension; i++)
+	{
+		int64 value = values[i];
+		bool finite = !TIMESTAMP_NOT_FINITE(value);
+		int64 finiteValue = finite ? value : 0;
+		int64 remainder = finiteValue % unitLength;
+
+		remainder += remainder < 0 ? unitLength : 0;
+		result[i] = finite ? finiteValue - remainder : value;
+	}
+}
+
+
+/*
+ * VectorizedTimestampFunction calls the given date_trunc or date_part
+ * function with the constant units for each row of the timestamp column,
+ * and returns the results, which are 8 byte values passed by value, as a
+ * vector. truncUnitLength is set for date_trunc to units of a fixed length,
+ * which are truncated without a call.
+ *
+ * A run of rows read from an encoded chunk gets one call, and the runs are
+ * kept in the result, so an aggregate grouping by it hashes each run once.
+ * Otherwise a row whose value repeats the row before it reuses its result,
+ * which is common for sorted timestamps.
+ */
+static VectorColumn *
+VectorizedTimestampFunction(FunctionCallInfo fcinfo, PGFunction function,
+							int64 truncUnitLength)
+{
+	VectorFnArgument *units = (VectorFnArgument *) PG_GETARG_POINTER(0);
+	VectorFnArgument *argument = (VectorFnArgument *) PG_GETARG_POINTER(1);
+
+	if (units->type != VECTOR_FN_ARG_CONSTANT || argument->type != VECTOR_FN_ARG_VAR)
+	{
+		elog(ERROR, "vectorized timestamp function needs constant units and "
+					"a vector argument");
+	}
+
+	VectorColumn *vectorColumn = (VectorColumn *) argument->arg;
+	VectorColumn *res = VectorFnResultColumn(fcinfo, vectorColumn->dimension,
+											 sizeof(int64));
+	res->dimension = vectorColumn->dimension;
+
+	if (PG_ARGISNULL(0))
+	{
+		memset(res->isnull, true, res->dimension);
+		return res;
+	}
+
+	int64 *vectorValue = (int64 *) vectorColumn->value;
+	bool *vectorNull = vectorColumn->isnull;
+	Datum *resultValue = (Datum *) res->value;
+
+	memcpy(res->isnull, vectorNull, res->dimension);
+
+	if (vectorColumn->hasRuns)
+	{
+		foreach_vector_run(vectorColumn, position, length)
+		{
+			Datum result = 0;
+			bool isNull = vectorNull[position];
+
+			if (!isNull && truncUnitLength > 0)
+				TruncateTimestamps(&vectorValue[position], &result, 1, truncUnitLength);
+			else if (!isNull)
+				result = CallTimestampFunction(function, units->arg,
+											   Int64GetDatum(vectorValue[position]),
+											   &isNull);
+
+			for (uint32 n = 0; n < length; n++)
+			{
+				resultValue[position + n] = result;
+			}
+			memset(res->isnull + position, isNull, length);
+		}
+
+		CopyVectorColumnRuns(res, vectorColumn);
+	}
+	else if (truncUnitLength > 0)
+	{
+		TruncateTimestamps(vectorValue, resultValue, res->dimension, truncUnitLength);
+	}
+	else
+	{
+		bool lastValid = false;
+		int64 lastValue = 0;
+		Datum lastResult = 0;
+		bool lastIsNull = false;
+
+		for (uint32 i = 0; i < res->dimension; i++)
+		{
+			if (vectorNull[i])
+			{
+				resultValue[i] = 0;
+				continue;
+			}
+
+			if (!lastValid || vectorValue[i] != lastValue)
+			{
+				lastResult = CallTimestampFunction(function, units->arg,
+												   Int64GetDatum(vectorValue[i]),
+												   &lastIsNull);
+				lastValue = vectorValue[i];
+				lastValid = true;
+			}
+
+			resultValue[i] = lastResult;
+			res->isnull[i] = lastIsNull;
+		}
+	}
+
+	return res;
+}
+
+
+/*
+ * CallTimestampFunction calls date_trunc or date_part with the units and a
+ * timestamp. date_part returns NULL for some units of infinite timestamps.
+ */
+static Datum
+CallTimestampFunction(PGFunction function, Datum units, Datum value, bool *isNull)
+{
+	LOCAL_FCINFO(callInfo, 2);
+
+	InitFunctionCallInfoData(*callInfo, NULL, 2, InvalidOid, NULL, NULL);
+	callInfo->args[0].value = units;
+	callInfo->args[0].isnull = false;
+	callInfo->args[1].value = value;
+	callInfo->args[1].isnull = false;
+
+	Datum result = function(callInfo);
+	*isNull = callInfo->isnull;
+
+	return result;
+}
+
+
+/*
+ * TimestampTruncUnitLength returns the length of the date_trunc units in
+ * microseconds if they are units up to a day, whose boundaries are multiples
+ * of their length for timestamps without a time zone, or 0 otherwise.
+ */
+static int64
+TimestampTruncUnitLength(text *units)
+{
+	int unitValue = 0;
+	char *lowUnits = downcase_truncate_identifier(VARDATA_ANY(units),
+												  VARSIZE_ANY_EXHDR(units), false);
+
+	if (DecodeUnits(0, lowUnits, &unitValue) != UNITS)
+		return 0;
+
+	switch (unitValue)
+	{
+		case DTK_DAY:
+			return USECS_PER_DAY;
+		case DTK_HOUR:
+			return USECS_PER_HOUR;
+		case DTK_MINUTE:
+			return USECS_PER_MINUTE;
+		case DTK_SECOND:
+			return USECS_PER_SEC;
+		case DTK_MILLISEC:
+			return 1000;
+		case DTK_MICROSEC:
+			return 1;
+		default:
+			return 0;
+	}
+}
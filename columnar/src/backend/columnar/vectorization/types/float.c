@@ -0,0 +1,22 @@
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "nodes/execnodes.h"
+#include "utils/float.h"
+
+#include "columnar/vectorization/types/types.h"
+
+// float4
+BUILD_CMP_OPERATOR_FLOAT( float4, float4, _DATUM_FLOAT4, float4, _DATUM_FLOAT4, float4)
+BUILD_CMP_OPERATOR_FLOAT(float48, float4, _DATUM_FLOAT4, float8, _DATUM_FLOAT8, float8)
+
+// float8
+BUILD_CMP_OPERATOR_FLOAT( float8, float8, _DATUM_FLOAT8, float8, _DATUM_FLOAT8, float8)
+BUILD_CMP_OPERATOR_FLOAT(float84, float8, _DATUM_FLOAT8, float4, _DATUM_FLOAT4, float8)
+
+// arithmetic
+BUILD_ARITHMETIC_OPERATOR_FLOAT( float4, float4, _DATUM_FLOAT4, float4, _DATUM_FLOAT4, float4)
+BUILD_ARITHMETIC_OPERATOR_FLOAT(float48, float4, _DATUM_FLOAT4, float8, _DATUM_FLOAT8, float8)
+BUILD_ARITHMETIC_OPERATOR_FLOAT( float8, float8, _DATUM_FLOAT8, float8, _DATUM_FLOAT8, float8)
+BUILD_ARITHMETIC_OPERATOR_FLOAT(float84, float8, _DATUM_FLOAT8, float4, _DATUM_FLOAT4, float8)
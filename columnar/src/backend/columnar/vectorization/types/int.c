@@ -24,3 +24,12 @@ BUILD_CMP_OPERATOR_INT(int48, int32, int64)
 BUILD_CMP_OPERATOR_INT( int8, int64, int64)
 BUILD_CMP_OPERATOR_INT(int82, int64, int16)
 BUILD_CMP_OPERATOR_INT(int84, int64, int32)
+
+// arithmetic
+BUILD_ARITHMETIC_OPERATOR_INT( int2, int16, int16, int16, 16, "smallint")
+BUILD_ARITHMETIC_OPERATOR_INT(int24, int16, int32, int32, 32, "integer")
+BUILD_ARITHMETIC_OPERATOR_INT(int42, int32, int16, int32, 32, "integer")
+BUILD_ARITHMETIC_OPERATOR_INT( int4, int32, int32, int32, 32, "integer")
+BUILD_ARITHMETIC_OPERATOR_INT(int48, int32, int64, int64, 64, "bigint")
+BUILD_ARITHMETIC_OPERATOR_INT(int84, int64, int32, int64, 64, "bigint")
+BUILD_ARITHMETIC_OPERATOR_INT( int8, int64, int64, int64, 64, "bigint")
@@ -449,3 +449,135 @@ Numeric int128_to_numeric(int128 val)
 
 	return res;
 }
+
+/*
+ * numeric_int128_sum_add adds count times the numeric datum to the sum.
+ *
+ * The sum is held as an integer of the value times NBASE to the power of
+ * its fraction digits, which grow to those of the added values. Numerics
+ * are read in place, as short varlenas too. Returns false, leaving the sum
+ * as it was, for NaN and infinity, for compressed or external values, and
+ * when the sum would overflow, so that the caller adds the value another
+ * way.
+ */
+bool
+numeric_int128_sum_add(NumericInt128Sum *sum, Datum value, int64 count)
+{
+	struct varlena *varlenaValue = (struct varlena *) DatumGetPointer(value);
+
+	if (VARATT_IS_EXTENDED(varlenaValue) && !VARATT_IS_SHORT(varlenaValue))
+		return false;
+
+	const char *data = VARDATA_ANY(varlenaValue);
+	int dataLength = VARSIZE_ANY_EXHDR(varlenaValue);
+
+	if (dataLength < (int) sizeof(uint16))
+		return false;
+
+	/* short varlenas are not aligned, so the fields are copied out */
+	uint16 header;
+	memcpy(&header, data, sizeof(uint16));
+
+	bool negative;
+	int dscale;
+	int16 weight;
+	const char *digits;
+	int ndigits;
+
+	if ((header & NUMERIC_SIGN_MASK) == NUMERIC_SPECIAL)
+	{
+		return false;
+	}
+	else if ((header & NUMERIC_SIGN_MASK) == NUMERIC_SHORT)
+	{
+		negative = (header & NUMERIC_SHORT_SIGN_MASK) != 0;
+		dscale = (header & NUMERIC_SHORT_DSCALE_MASK) >> NUMERIC_SHORT_DSCALE_SHIFT;
+		weight = ((header & NUMERIC_SHORT_WEIGHT_SIGN_MASK) ? ~NUMERIC_SHORT_WEIGHT_MASK : 0) |
+				 (header & NUMERIC_SHORT_WEIGHT_MASK);
+		digits = data + sizeof(uint16);
+	}
+	else
+	{
+		if (dataLength < (int) (sizeof(uint16) + sizeof(int16)))
+			return false;
+
+		negative = (header & NUMERIC_SIGN_MASK) == NUMERIC_NEG;
+		dscale = header & NUMERIC_DSCALE_MASK;
+		memcpy(&weight, data + sizeof(uint16), sizeof(int16));
+		digits = data + sizeof(uint16) + sizeof(int16);
+	}
+
+	ndigits = (dataLength - (digits - data)) / sizeof(NumericDigit);
+
+	/* digits past the last stored one are zero, before and after the point */
+	int fractionDigits = Max(ndigits - 1 - weight, 0);
+	int integerDigits = Max(weight + 1, 0);
+
+	/* at most 36 decimal digits, so that many values add up without overflow */
+	if (integerDigits + fractionDigits > 9)
+		return false;
+
+	int128 scaledValue = 0;
+	for (int i = 0; i < ndigits; i++)
+	{
+		NumericDigit digit;
+		memcpy(&digit, digits + i * sizeof(NumericDigit), sizeof(NumericDigit));
+		scaledValue = scaledValue * NBASE + digit;
+	}
+
+	for (int i = ndigits - 1 - weight; i < fractionDigits; i++)
+		scaledValue *= NBASE;
+
+	if (negative)
+		scaledValue = -scaledValue;
+
+	/* bring the sum and the value to the larger of their fraction digits */
+	int128 newSum = sum->sumX;
+	int sumFractionDigits = sum->fractionDigits;
+
+	for (; sumFractionDigits < fractionDigits; sumFractionDigits++)
+	{
+		if (__builtin_mul_overflow(newSum, (int128) NBASE, &newSum))
+			return false;
+	}
+
+	for (; fractionDigits < sumFractionDigits; fractionDigits++)
+	{
+		if (__builtin_mul_overflow(scaledValue, (int128) NBASE, &scaledValue))
+			return false;
+	}
+
+	if (__builtin_mul_overflow(scaledValue, (int128) count, &scaledValue) ||
+		__builtin_add_overflow(newSum, scaledValue, &newSum))
+		return false;
+
+	sum->sumX = newSum;
+	sum->fractionDigits = sumFractionDigits;
+	sum->dscale = Max(sum->dscale, dscale);
+	sum->N += count;
+
+	return true;
+}
+
+/*
+ * numeric_int128_sum_result returns the sum as a numeric, with the largest
+ * display scale of the values added to it.
+ */
+Numeric
+numeric_int128_sum_result(NumericInt128Sum *sum)
+{
+	Numeric		res;
+	NumericVar	result;
+
+	init_var(&result);
+
+	int128_to_numericvar(sum->sumX, &result);
+	result.weight -= sum->fractionDigits;
+	result.dscale = sum->dscale;
+
+	res = make_numeric(&result);
+
+	free_var(&result);
+
+	return res;
+}
@@ -0,0 +1,408 @@
+/*-------------------------------------------------------------------------
+ *
+ * text.c
+ *	Text PostgreSQL type
+ *
+ * Rows read from a dictionary encoded chunk share the datum of their
+ * dictionary entry, so the datum works as the dictionary code of the value.
+ * Comparison results are remembered per datum, which compares each distinct
+ * value of a chunk with the constant only once instead of once per row.
+ *
+ * Prefix predicates (starts_with, and LIKE 'literal%') instead compare the
+ * leading bytes of the values in place, without a function call per value.
+ *
+ * lower, upper, length and substring compute a vector of their results for
+ * a column, which the vectorized comparisons then take as their column
+ * argument. Their results are remembered per datum in the same way.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/tupmacs.h"
+#include "fmgr.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+#include "columnar/vectorization/types/types.h"
+
+/* number of remembered comparison results, must be a power of 2 */
+#define TEXT_RESULT_CACHE_SIZE 1024
+
+/*
+ * VectorTextFunctionState is kept in fn_extra by the vectorized text
+ * functions, with their result vector and the context of the values in it,
+ * which is reset by the next call.
+ */
+typedef struct VectorTextFunctionState
+{
+	VectorColumn *result;
+	MemoryContext valueContext;
+} VectorTextFunctionState;
+
+static VectorColumn * VectorizedTextPredicate(FunctionCallInfo fcinfo,
+											  PGFunction predicate, bool negate);
+static VectorColumn * VectorizedTextFunction(FunctionCallInfo fcinfo,
+											 PGFunction function, int16 resultTypeLen);
+static bool LikePatternPrefix(text *pattern, Oid collation, text **prefix);
+static inline bool TextHasPrefix(Datum value, text *prefix);
+
+
+PG_FUNCTION_INFO_V1(vtexteq);
+Datum
+vtexteq(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextPredicate(fcinfo, texteq, false));
+}
+
+
+PG_FUNCTION_INFO_V1(vtextne);
+Datum
+vtextne(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextPredicate(fcinfo, texteq, true));
+}
+
+
+PG_FUNCTION_INFO_V1(vtextlike);
+Datum
+vtextlike(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextPredicate(fcinfo, textlike, false));
+}
+
+
+PG_FUNCTION_INFO_V1(vtextnlike);
+Datum
+vtextnlike(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextPredicate(fcinfo, textlike, true));
+}
+
+
+PG_FUNCTION_INFO_V1(vstarts_with);
+Datum
+vstarts_with(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextPredicate(fcinfo, text_starts_with, false));
+}
+
+
+PG_FUNCTION_INFO_V1(vlower);
+Datum
+vlower(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextFunction(fcinfo, lower, sizeof(Datum)));
+}
+
+
+PG_FUNCTION_INFO_V1(vupper);
+Datum
+vupper(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextFunction(fcinfo, upper, sizeof(Datum)));
+}
+
+
+PG_FUNCTION_INFO_V1(vlength);
+Datum
+vlength(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(VectorizedTextFunction(fcinfo, textlen, sizeof(int32)));
+}
+
+
+/* substring(text, int, int) and substring(text, int) */
+PG_FUNCTION_INFO_V1(vsubstring);
+Datum
+vsubstring(PG_FUNCTION_ARGS)
+{
+	PGFunction function = PG_NARGS() == 3 ? text_substr : text_substr_no_len;
+
+	PG_RETURN_POINTER(VectorizedTextFunction(fcinfo, function, sizeof(Datum)));
+}
+
+
+/* substr is the same function as substring with another name */
+PG_FUNCTION_INFO_V1(vsubstr);
+Datum
+vsubstr(PG_FUNCTION_ARGS)
+{
+	return vsubstring(fcinfo);
+}
+
+
+/*
+ * VectorizedTextPredicate evaluates the given text predicate between each
+ * row of the column argument and the constant argument, and returns the
+ * results as a vector.
+ *
+ * starts_with, and LIKE patterns which are a literal followed by %, only
+ * compare the leading bytes of each value with the prefix. Other predicates
+ * are called once per distinct datum.
+ */
+static VectorColumn *
+VectorizedTextPredicate(FunctionCallInfo fcinfo, PGFunction predicate, bool negate)
+{
+	VectorFnArgument *left = (VectorFnArgument *) PG_GETARG_POINTER(0);
+	VectorFnArgument *right = (VectorFnArgument *) PG_GETARG_POINTER(1);
+	VectorColumn *vectorColumn = NULL;
+	Datum constValue = 0;
+	bool constOnLeft = false;
+
+	if (left->type == VECTOR_FN_ARG_VAR && right->type == VECTOR_FN_ARG_CONSTANT)
+	{
+		vectorColumn = (VectorColumn *) left->arg;
+		constValue = right->arg;
+	}
+	else if (left->type == VECTOR_FN_ARG_CONSTANT && right->type == VECTOR_FN_ARG_VAR)
+	{
+		vectorColumn = (VectorColumn *) right->arg;
+		constValue = left->arg;
+		constOnLeft = true;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	Oid collation = PG_GET_COLLATION();
+
+	/* the constant is the prefix or pattern only when it is the right argument */
+	text *prefix = NULL;
+	if (!constOnLeft)
+	{
+		if (predicate == text_starts_with &&
+			OidIsValid(collation) && get_collation_isdeterministic(collation))
+		{
+			prefix = DatumGetTextPP(constValue);
+		}
+		else if (predicate == textlike)
+		{
+			LikePatternPrefix(DatumGetTextPP(constValue), collation, &prefix);
+		}
+	}
+
+	VectorColumn *res = VectorFnResultColumn(fcinfo, vectorColumn->dimension, 1);
+
+	Datum *vectorValue = (Datum *) vectorColumn->value;
+	bool *vectorNull = (bool *) vectorColumn->isnull;
+	bool *resIdx = (bool *) res->value;
+	bool *resNull = (bool *) res->isnull;
+
+	/* a zero datum never points to a value, so it marks an unused slot */
+	Datum cachedValue[TEXT_RESULT_CACHE_SIZE];
+	bool cachedResult[TEXT_RESULT_CACHE_SIZE];
+	memset(cachedValue, 0, sizeof(cachedValue));
+
+	for (uint32 i = 0; i < vectorColumn->dimension; i++)
+	{
+		resNull[i] = vectorNull[i];
+		if (vectorNull[i])
+		{
+			resIdx[i] = false;
+			continue;
+		}
+
+		Datum value = vectorValue[i];
+
+		if (prefix != NULL)
+		{
+			resIdx[i] = TextHasPrefix(value, prefix) != negate;
+			continue;
+		}
+
+		uint32 slot = (uint32) (value / sizeof(Datum)) & (TEXT_RESULT_CACHE_SIZE - 1);
+
+		if (cachedValue[slot] != value)
+		{
+			Datum result = constOnLeft ?
+						   DirectFunctionCall2Coll(predicate, collation,
+												   constValue, value) :
+						   DirectFunctionCall2Coll(predicate, collation,
+												   value, constValue);
+			cachedValue[slot] = value;
+			cachedResult[slot] = DatumGetBool(result) != negate;
+		}
+
+		resIdx[i] = cachedResult[slot];
+	}
+
+	res->dimension = vectorColumn->dimension;
+
+	return res;
+}
+
+
+/*
+ * VectorizedTextFunction calls the given text function for each row of the
+ * column argument, with the constant arguments after it, and returns the
+ * results as a vector of values of resultTypeLen bytes, which are datums
+ * for text results. The function is called once per distinct datum, and the
+ * text it returns lives until the next call through the same FmgrInfo.
+ */
+static VectorColumn *
+VectorizedTextFunction(FunctionCallInfo fcinfo, PGFunction function, int16 resultTypeLen)
+{
+	VectorFnArgument *argument = (VectorFnArgument *) PG_GETARG_POINTER(0);
+	FmgrInfo *flinfo = fcinfo->flinfo;
+	int nargs = PG_NARGS();
+
+	if (argument->type != VECTOR_FN_ARG_VAR)
+	{
+		elog(ERROR, "vectorized text function needs a vector argument");
+	}
+
+	VectorColumn *vectorColumn = (VectorColumn *) argument->arg;
+
+	VectorTextFunctionState *state = (VectorTextFunctionState *) flinfo->fn_extra;
+	if (state == NULL)
+	{
+		state = MemoryContextAllocZero(flinfo->fn_mcxt, sizeof(VectorTextFunctionState));
+		state->valueContext = AllocSetContextCreate(flinfo->fn_mcxt,
+													"Columnar Vectorized Text Function",
+													ALLOCSET_DEFAULT_SIZES);
+		flinfo->fn_extra = state;
+	}
+	else
+	{
+		MemoryContextReset(state->valueContext);
+	}
+
+	state->result = ReserveVectorColumn(state->result, vectorColumn->dimension,
+										resultTypeLen, flinfo->fn_mcxt);
+
+	VectorColumn *res = state->result;
+	res->dimension = vectorColumn->dimension;
+
+	/* the functions are strict, so a NULL constant makes all results NULL */
+	Datum constValues[2] = { 0, 0 };
+	for (int i = 1; i < nargs; i++)
+	{
+		if (PG_ARGISNULL(i))
+		{
+			memset(res->isnull, true, res->dimension);
+			return res;
+		}
+
+		constValues[i - 1] = ((VectorFnArgument *) PG_GETARG_POINTER(i))->arg;
+	}
+
+	Oid collation = PG_GET_COLLATION();
+	Datum *vectorValue = (Datum *) vectorColumn->value;
+	bool *vectorNull = (bool *) vectorColumn->isnull;
+	int8 *resultValue = (int8 *) res->value;
+
+	/* a zero datum never points to a value, so it marks an unused slot */
+	Datum cachedValue[TEXT_RESULT_CACHE_SIZE];
+	Datum cachedResult[TEXT_RESULT_CACHE_SIZE];
+	memset(cachedValue, 0, sizeof(cachedValue));
+
+	MemoryContext oldContext = MemoryContextSwitchTo(state->valueContext);
+
+	for (uint32 i = 0; i < vectorColumn->dimension; i++)
+	{
+		res->isnull[i] = vectorNull[i];
+		if (vectorNull[i])
+		{
+			continue;
+		}
+
+		Datum value = vectorValue[i];
+		uint32 slot = (uint32) (value / sizeof(Datum)) & (TEXT_RESULT_CACHE_SIZE - 1);
+
+		if (cachedValue[slot] != value)
+		{
+			Datum result = 0;
+
+			if (nargs == 1)
+				result = DirectFunctionCall1Coll(function, collation, value);
+			else if (nargs == 2)
+				result = DirectFunctionCall2Coll(function, collation, value,
+												 constValues[0]);
+			else
+				result = DirectFunctionCall3Coll(function, collation, value,
+												 constValues[0], constValues[1]);
+
+			cachedValue[slot] = value;
+			cachedResult[slot] = result;
+		}
+
+		store_att_byval(resultValue + resultTypeLen * i, cachedResult[slot],
+						resultTypeLen);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return res;
+}
+
+
+/*
+ * LikePatternPrefix returns whether the LIKE pattern matches exactly the
+ * values starting with a literal prefix, which is then stored in *prefix.
+ * That is the case for a pattern of characters other than the wildcards
+ * and the escape character, followed by one or more %, and a deterministic
+ * collation, under which LIKE compares bytes.
+ */
+static bool
+LikePatternPrefix(text *pattern, Oid collation, text **prefix)
+{
+	char *patternData = VARDATA_ANY(pattern);
+	int patternLength = VARSIZE_ANY_EXHDR(pattern);
+
+	if (!OidIsValid(collation) || !get_collation_isdeterministic(collation))
+	{
+		return false;
+	}
+
+	int prefixLength = patternLength;
+	while (prefixLength > 0 && patternData[prefixLength - 1] == '%')
+	{
+		prefixLength--;
+	}
+
+	if (prefixLength == patternLength)
+	{
+		return false;
+	}
+
+	/* server encodings never use these ASCII bytes within a multibyte character */
+	for (int i = 0; i < prefixLength; i++)
+	{
+		char c = patternData[i];
+		if (c == '%' || c == '_' || c == '\\')
+		{
+			return false;
+		}
+	}
+
+	*prefix = cstring_to_text_with_len(patternData, prefixLength);
+
+	return true;
+}
+
+
+/*
+ * TextHasPrefix returns whether the text datum starts with the bytes of the
+ * given prefix.
+ */
+static inline bool
+TextHasPrefix(Datum value, text *prefix)
+{
+	int prefixLength = VARSIZE_ANY_EXHDR(prefix);
+	text *valueText = DatumGetTextPP(value);
+
+	bool hasPrefix = VARSIZE_ANY_EXHDR(valueText) >= prefixLength &&
+					 memcmp(VARDATA_ANY(valueText), VARDATA_ANY(prefix),
+							prefixLength) == 0;
+
+	if ((Pointer) valueText != DatumGetPointer(value))
+	{
+		pfree(valueText);
+	}
+
+	return hasPrefix;
+}
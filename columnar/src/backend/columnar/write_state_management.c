@@ -43,6 +43,7 @@
 #include "storage/smgr.h"
 #include "tcop/utility.h"
 #include "utils/builtins.h"
+#include "utils/memutils.h"
 #include "utils/pg_rusage.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
@@ -61,6 +62,9 @@ static HTAB *WriteStateMap = NULL;
 /* memory context for allocating WriteStateMap & all write states */
 static MemoryContext WriteStateContext = NULL;
 
+/* counts calls of columnar_init_write_state, to order write states by last use */
+static uint64 WriteStateUseCount = 0;
+
 /*
  * Each member of the writeStateStack in WriteStateMapEntry. This means that
  * we did some inserts in the subtransaction subXid, and the state of those
@@ -71,9 +75,23 @@ typedef struct SubXidWriteState
 	SubTransactionId subXid;
 	ColumnarWriteState *writeState;
 	struct SubXidWriteState *next;
+
+	/* value of WriteStateUseCount when writes were last forwarded here */
+	uint64 lastUse;
 } SubXidWriteState;
 
 
+/*
+ * A write state that ColumnarEnforceWriteStateMemoryLimit may flush, with
+ * the memory its pending stripe holds.
+ */
+typedef struct FlushCandidate
+{
+	SubXidWriteState *stackEntry;
+	uint64 memory;
+} FlushCandidate;
+
+
 /*
  * An entry in WriteStateMap.
  */
@@ -111,9 +129,13 @@ CleanupWriteStateMap(void *arg)
 {
 	WriteStateMap = NULL;
 	WriteStateContext = NULL;
+	WriteStateUseCount = 0;
 }
 
 
+static int CompareFlushCandidates(const void *a, const void *b);
+
+
 ColumnarWriteState *
 columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 						  Oid tupSlotRelationId, SubTransactionId currentSubXid)
@@ -168,6 +190,7 @@ columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 
 		if (stackHead->subXid == currentSubXid)
 		{
+			stackHead->lastUse = ++WriteStateUseCount;
 			return stackHead->writeState;
 		}
 	}
@@ -194,7 +217,12 @@ columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 	stackEntry->writeState = ColumnarBeginWrite(relation->rd_node,
 												columnarOptions,
 												tupdesc);
+	if (columnarOptions.deltaStore)
+	{
+		ColumnarEnableDeltaStore(stackEntry->writeState);
+	}
 	stackEntry->subXid = currentSubXid;
+	stackEntry->lastUse = ++WriteStateUseCount;
 	stackEntry->next = hashEntry->writeStateStack;
 	hashEntry->writeStateStack = stackEntry;
 
@@ -230,6 +258,121 @@ FlushWriteStateForRelfilenode(Oid relfilenode, SubTransactionId currentSubXid)
 }
 
 
+/*
+ * ColumnarDisableWriteStateBuckets makes the pending writes of all
+ * subtransactions for given relfilenode flush stripes without a bucket, for
+ * when the bucket_by option of the relation changes under them.
+ */
+void
+ColumnarDisableWriteStateBuckets(Oid relfilenode)
+{
+	if (WriteStateMap == NULL)
+	{
+		return;
+	}
+
+	WriteStateMapEntry *entry = hash_search(WriteStateMap, &relfilenode, HASH_FIND, NULL);
+	if (entry == NULL || entry->dropped)
+	{
+		return;
+	}
+
+	for (SubXidWriteState *stackEntry = entry->writeStateStack; stackEntry != NULL;
+		 stackEntry = stackEntry->next)
+	{
+		ColumnarDisableStripeBuckets(stackEntry->writeState);
+	}
+}
+
+/*
+ * ColumnarEnforceWriteStateMemoryLimit flushes pending writes of the given
+ * subtransaction once the write states of the transaction use more than
+ * columnar.write_state_memory_limit. The write states holding the most
+ * memory are flushed first, the least recently used among equal ones, until
+ * the write states use half of the limit, so that a load spread over many
+ * relations, such as the partitions of a table, keeps the stripes of the
+ * rest filling instead of flushing a small stripe for each of them. Pending
+ * writes of upper subtransactions are kept, since a stripe flushed now would
+ * be rolled back with the current subtransaction.
+ */
+void
+ColumnarEnforceWriteStateMemoryLimit(SubTransactionId currentSubXid)
+{
+	if (WriteStateMap == NULL || columnar_write_state_memory_limit == 0)
+	{
+		return;
+	}
+
+	Size memoryLimit = (Size) columnar_write_state_memory_limit * 1024;
+	Size allocated = MemoryContextMemAllocated(WriteStateContext, true);
+	if (allocated <= memoryLimit)
+	{
+		return;
+	}
+
+	long entryCount = hash_get_num_entries(WriteStateMap);
+	FlushCandidate *candidates = palloc(entryCount * sizeof(FlushCandidate));
+	int candidateCount = 0;
+
+	HASH_SEQ_STATUS status;
+	WriteStateMapEntry *entry;
+
+	hash_seq_init(&status, WriteStateMap);
+	while ((entry = hash_seq_search(&status)) != 0)
+	{
+		if (entry->dropped || entry->writeStateStack == NULL)
+		{
+			continue;
+		}
+
+		SubXidWriteState *stackHead = entry->writeStateStack;
+		if (stackHead->subXid == currentSubXid &&
+			ContainsPendingWrites(stackHead->writeState))
+		{
+			candidates[candidateCount].stackEntry = stackHead;
+			candidates[candidateCount].memory =
+				ColumnarWriteStateMemory(stackHead->writeState);
+			candidateCount++;
+		}
+	}
+
+	qsort(candidates, candidateCount, sizeof(FlushCandidate), CompareFlushCandidates);
+
+	Size memoryTarget = memoryLimit / 2;
+	for (int i = 0; i < candidateCount && allocated > memoryTarget; i++)
+	{
+		ColumnarFlushPendingWrites(candidates[i].stackEntry->writeState);
+		allocated = MemoryContextMemAllocated(WriteStateContext, true);
+	}
+
+	pfree(candidates);
+}
+
+
+/*
+ * CompareFlushCandidates orders write states by the memory they hold, the
+ * largest first, and then by their last use, the oldest first.
+ */
+static int
+CompareFlushCandidates(const void *a, const void *b)
+{
+	const FlushCandidate *first = a;
+	const FlushCandidate *second = b;
+
+	if (first->memory != second->memory)
+	{
+		return first->memory > second->memory ? -1 : 1;
+	}
+
+	if (first->stackEntry->lastUse != second->stackEntry->lastUse)
+	{
+		return first->stackEntry->lastUse < second->stackEntry->lastUse ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
 /*
  * Helper function for FlushWriteStateForAllRels and DiscardWriteStateForAllRels.
  * Pops all of write states for current subtransaction, and depending on "commit"
@@ -335,6 +478,40 @@ ColumnarNonTransactionDropWriteState(Oid relfilenode)
 }
 
 
+/*
+ * ColumnarReadPendingRow fills columnValues and columnNulls with the row of
+ * the given row number if the current backend wrote it to the given
+ * relfilenode but hasn't flushed it yet.
+ */
+bool
+ColumnarReadPendingRow(Oid relfilenode, uint64 rowNumber, Datum *columnValues,
+					   bool *columnNulls)
+{
+	if (WriteStateMap == NULL)
+	{
+		return false;
+	}
+
+	WriteStateMapEntry *entry = hash_search(WriteStateMap, &relfilenode, HASH_FIND, NULL);
+	if (entry == NULL || entry->dropped)
+	{
+		return false;
+	}
+
+	for (SubXidWriteState *stackEntry = entry->writeStateStack; stackEntry != NULL;
+		 stackEntry = stackEntry->next)
+	{
+		if (ColumnarWriteStateReadRow(stackEntry->writeState, rowNumber,
+									  columnValues, columnNulls))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * Returns true if there are any pending writes in upper transactions.
  */
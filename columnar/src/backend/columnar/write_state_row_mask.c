@@ -27,6 +27,7 @@
 static RowMaskWriteStateEntry *InitRowMaskEntry(uint64 storageId,
 												bytea *rowMask);
 static void RowMaskFlushPendingWriteState(List *rowMaskWriteStateList);
+static int RowMaskWriteStateEntryCompare(const void *a, const void *b);
 
 /*
  * Mapping from relfilenode to RowMaskCacheMapEntry. This keeps deleted rows for
@@ -47,9 +48,20 @@ typedef struct SubXidWriteState
 	SubTransactionId subXid;
 	List *rowMaskWriteStateEntryList;
 	RowMaskWriteStateEntry *lastRowMaskWriteStateEntry;
+
+	/*
+	 * Entries of rowMaskWriteStateEntryList ordered by their first row number,
+	 * so that deletes don't search the whole list for the entry of each row.
+	 * Sorted again when entries were added since, see RowMaskFindWriteState.
+	 */
+	RowMaskWriteStateEntry **sortedEntries;
+	int sortedEntryCount;
+
 	struct SubXidWriteState *next;
 } SubXidWriteState;
 
+static void SortRowMaskWriteStateEntries(SubXidWriteState *stackEntry);
+
 /*
  * An entry in RowMaskCacheMap.
  */
@@ -179,18 +191,101 @@ InitRowMaskEntry(uint64 storageId, bytea *mask)
 	return rowMask;
 }
 
+/*
+ * RowMaskFlushPendingWriteState writes the given row mask write state entries
+ * to the catalog in row number order, so that each row mask and chunk group
+ * is updated once, and frees their masks.
+ */
 static void
 RowMaskFlushPendingWriteState(List *rowMaskWriteStateList)
 {
+	int entryCount = list_length(rowMaskWriteStateList);
+	if (entryCount == 0)
+	{
+		return;
+	}
+
+	RowMaskWriteStateEntry **rowMaskEntries =
+		palloc(entryCount * sizeof(RowMaskWriteStateEntry *));
+
+	int entryIndex = 0;
 	ListCell *lc;
 	foreach (lc, rowMaskWriteStateList)
 	{
-		RowMaskWriteStateEntry *rowMaskCache = (RowMaskWriteStateEntry *)lfirst(lc);
-		FlushRowMaskCache(rowMaskCache);
-		UpdateChunkGroupDeletedRows(rowMaskCache->storageId, rowMaskCache->stripeId,
-									rowMaskCache->chunkId, rowMaskCache->deletedRows);
-		pfree(rowMaskCache->mask);
+		rowMaskEntries[entryIndex++] = (RowMaskWriteStateEntry *) lfirst(lc);
+	}
+
+	qsort(rowMaskEntries, entryCount, sizeof(RowMaskWriteStateEntry *),
+		  RowMaskWriteStateEntryCompare);
+
+	FlushRowMaskWriteStateEntries(rowMaskEntries, entryCount);
+
+	for (entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		pfree(rowMaskEntries[entryIndex]->mask);
+	}
+
+	pfree(rowMaskEntries);
+}
+
+
+/*
+ * SortRowMaskWriteStateEntries rebuilds the sortedEntries array of the given
+ * stack entry from its list of write state entries.
+ */
+static void
+SortRowMaskWriteStateEntries(SubXidWriteState *stackEntry)
+{
+	int entryCount = list_length(stackEntry->rowMaskWriteStateEntryList);
+
+	if (stackEntry->sortedEntries != NULL)
+	{
+		pfree(stackEntry->sortedEntries);
+		stackEntry->sortedEntries = NULL;
+	}
+
+	stackEntry->sortedEntryCount = entryCount;
+	if (entryCount == 0)
+	{
+		return;
+	}
+
+	stackEntry->sortedEntries =
+		MemoryContextAlloc(RowMaskWriteStateContext,
+						   entryCount * sizeof(RowMaskWriteStateEntry *));
+
+	int entryIndex = 0;
+	ListCell *lc;
+	foreach (lc, stackEntry->rowMaskWriteStateEntryList)
+	{
+		stackEntry->sortedEntries[entryIndex++] = (RowMaskWriteStateEntry *) lfirst(lc);
+	}
+
+	qsort(stackEntry->sortedEntries, entryCount, sizeof(RowMaskWriteStateEntry *),
+		  RowMaskWriteStateEntryCompare);
+}
+
+
+/*
+ * RowMaskWriteStateEntryCompare orders row mask write state entries by their
+ * first row number, which also orders them by stripe and chunk group.
+ */
+static int
+RowMaskWriteStateEntryCompare(const void *a, const void *b)
+{
+	const RowMaskWriteStateEntry *entryA = *((RowMaskWriteStateEntry * const *) a);
+	const RowMaskWriteStateEntry *entryB = *((RowMaskWriteStateEntry * const *) b);
+
+	if (entryA->startRowNumber < entryB->startRowNumber)
+	{
+		return -1;
+	}
+	else if (entryA->startRowNumber > entryB->startRowNumber)
+	{
+		return 1;
 	}
+
+	return 0;
 }
 
 
@@ -217,6 +312,8 @@ void RowMaskFlushWriteStateForRelfilenode(Oid relfilenode,
 			RowMaskFlushPendingWriteState(stackEntry->rowMaskWriteStateEntryList);
 			list_free(stackEntry->rowMaskWriteStateEntryList);
 			stackEntry->rowMaskWriteStateEntryList = NIL;
+			stackEntry->lastRowMaskWriteStateEntry = NULL;
+			SortRowMaskWriteStateEntries(stackEntry);
 		}
 	}
 }
@@ -257,10 +354,31 @@ RowMaskFindWriteState(Oid relfilenode, SubTransactionId currentSubXid,
 				return stackHead->lastRowMaskWriteStateEntry;;
 			}
 
-			ListCell *lc;
-			foreach (lc, stackHead->rowMaskWriteStateEntryList)
+			if (stackHead->sortedEntryCount !=
+				list_length(stackHead->rowMaskWriteStateEntryList))
+			{
+				SortRowMaskWriteStateEntries(stackHead);
+			}
+
+			/* find the last entry that starts at or before rowId */
+			int low = 0;
+			int high = stackHead->sortedEntryCount;
+			while (low < high)
+			{
+				int mid = low + (high - low) / 2;
+				if (stackHead->sortedEntries[mid]->startRowNumber <= (int64) rowId)
+				{
+					low = mid + 1;
+				}
+				else
+				{
+					high = mid;
+				}
+			}
+
+			if (low > 0)
 			{
-				RowMaskWriteStateEntry *rowMask = (RowMaskWriteStateEntry *)lfirst(lc);
+				RowMaskWriteStateEntry *rowMask = stackHead->sortedEntries[low - 1];
 
 				if (rowMask->startRowNumber <= rowId && rowMask->endRowNumber >= rowId)
 				{
@@ -17,16 +17,19 @@
 #include "fmgr.h"
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
+#include "nodes/plannodes.h"
 #include "nodes/extensible.h"
 #include "port/atomics.h"
 #include "storage/bufpage.h"
 #include "storage/lockdefs.h"
 #include "storage/relfilenode.h"
 #include "storage/s_lock.h"
+#include "utils/hsearch.h"
 #include "utils/relcache.h"
 #include "utils/snapmgr.h"
 
 #include "columnar/columnar_compression.h"
+#include "columnar/columnar_encoding.h"
 #include "columnar/columnar_metadata.h"
 #include "columnar/columnar_write_state_row_mask.h"
 
@@ -42,13 +45,24 @@
 /* Limits for option parameters */
 #define STRIPE_ROW_COUNT_MINIMUM 1000
 #define STRIPE_ROW_COUNT_MAXIMUM 100000000
+#define STRIPE_SIZE_LIMIT_MAXIMUM (1024 * 1024 * 1024)
 #define CHUNK_ROW_COUNT_MINIMUM 1000
 #define CHUNK_ROW_COUNT_MAXIMUM 100000000
-#define COMPRESSION_LEVEL_MIN 1
+#define ZORDER_COLUMN_COUNT_MAXIMUM 8
+#define PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM 4
+#define BUCKET_COUNT_MINIMUM 2
+#define BUCKET_COUNT_MAXIMUM 1024
+/* negative levels are zstd's fast levels, 0 is not a valid level */
+#define COMPRESSION_LEVEL_MIN -100
 #define COMPRESSION_LEVEL_MAX 19
+#define COMPRESSION_WORKERS_MAX 64
+#define CACHE_QUOTA_MAXIMUM 20000
+#define COMPRESSION_DICTIONARY_SIZE_MIN 1024
+#define COMPRESSION_DICTIONARY_SIZE_MAX (1024 * 1024)
+#define COMPRESSION_DICTIONARY_SAMPLE_SIZE 4096
 
 /* Columnar file signature */
-#define COLUMNAR_VERSION_MAJOR 2
+#define COLUMNAR_VERSION_MAJOR 3
 #define COLUMNAR_VERSION_MINOR 0
 
 /* miscellaneous defines */
@@ -60,6 +74,29 @@
 /* Columnar row mask byte array size */
 #define COLUMNAR_ROW_MASK_CHUNK_SIZE 10000
 
+/*
+ * ColumnCompressionOption overrides the table's compression settings for a
+ * single column.
+ */
+typedef struct ColumnCompressionOption
+{
+	AttrNumber attnum;
+	CompressionType compressionType;
+
+	/* 0 if the column uses the compression level of the table */
+	int compressionLevel;
+} ColumnCompressionOption;
+
+/*
+ * ColumnarShreddedKey is a top level key of a jsonb column whose values, as
+ * returned by the ->> operator, get per chunk statistics.
+ */
+typedef struct ColumnarShreddedKey
+{
+	AttrNumber attnum;
+	char *key;
+} ColumnarShreddedKey;
+
 /*
  * ColumnarOptions holds the option values to be used when reading or writing
  * a columnar table. To resolve these values, we first check foreign table's options,
@@ -71,9 +108,71 @@ typedef struct ColumnarOptions
 	uint32 chunkRowCount;
 	CompressionType compressionType;
 	int compressionLevel;
+
+	/* column cache quota in megabytes, 0 if only the global limit applies */
+	int cacheQuota;
+
+	/* attribute numbers of the columns that get per chunk bloom filters */
+	Bitmapset *bloomFilterColumns;
+
+	/* list of ColumnCompressionOption for columns with their own compression */
+	List *columnCompressionOptions;
+
+	/* column the rows of each stripe are sorted by, InvalidAttrNumber if none */
+	AttrNumber sortKeyColumn;
+
+	/*
+	 * attribute numbers of the columns the rows of each stripe are ordered
+	 * by in Z-order, NULL if none, never set together with sortKeyColumn
+	 */
+	Bitmapset *zorderColumns;
+
+	/*
+	 * attribute numbers of the columns each stripe keeps per group counts
+	 * for, and of the columns it keeps the sums of in each group, NULL if
+	 * none, see columnar_projection.c
+	 */
+	Bitmapset *projectionGroupByColumns;
+	Bitmapset *projectionSumColumns;
+
+	/* attribute numbers of the columns that get per chunk distinct value sketches */
+	Bitmapset *hllColumns;
+
+	/* list of ColumnarShreddedKey, the jsonb keys that get per chunk statistics */
+	List *shreddedKeys;
+
+	/* whether small writes go to the row oriented delta store first */
+	bool deltaStore;
+
+	/* bytes of stripe buffers that flush a stripe, 0 if only stripeRowCount does */
+	int stripeSizeLimit;
+
+	/*
+	 * whether the writer picks chunkRowCount and stripeRowCount for each
+	 * stripe from the row width it observes, see columnar_writer.c
+	 */
+	bool autoRowLimits;
+
+	/*
+	 * column whose hash puts each row in one of bucketCount buckets, with a
+	 * stripe of their own, InvalidAttrNumber if none, see columnar_bucket.c
+	 */
+	AttrNumber bucketColumn;
+	uint32 bucketCount;
 } ColumnarOptions;
 
 
+/*
+ * ChunkNullState tells whether a column chunk has both null and non-null
+ * values. Chunks with only one kind of values don't store an exists stream.
+ */
+typedef enum ChunkNullState
+{
+	CHUNK_NULLS_SOME = 0,
+	CHUNK_NULLS_NONE = 1,
+	CHUNK_NULLS_ALL = 2
+} ChunkNullState;
+
 /* ColumnChunkSkipNode contains statistics for a ColumnChunkData. */
 typedef struct ColumnChunkSkipNode
 {
@@ -101,13 +200,52 @@ typedef struct ColumnChunkSkipNode
 
 	CompressionType valueCompressionType;
 	int valueCompressionLevel;
+
+	/* encoding applied to the values before compression */
+	ValueEncodingType valueEncodingType;
+
+	ChunkNullState nullState;
+
+	/* zstd dictionary the values are compressed with, 0 if none */
+	uint64 compressionDictionaryId;
+
+	/* bloom filter of the values, NULL if not enabled for the column */
+	bytea *bloomFilter;
+
+	/* HyperLogLog sketch of the values, NULL if not enabled for the column */
+	bytea *hllSketch;
+
+	/*
+	 * Statistics of the values of the shredded keys of a jsonb column, NULL
+	 * if the column has none, see columnar_shredded_keys.c.
+	 */
+	bytea *shreddedKeyStats;
+
+	/*
+	 * Null count and estimated distinct value count of the chunk, valid if
+	 * hasStatistics. valuesSorted tells whether the non-null values are in
+	 * ascending order and is valid if sortednessKnown.
+	 */
+	bool hasStatistics;
+	uint64 nullCount;
+	uint64 distinctCount;
+	bool sortednessKnown;
+	bool valuesSorted;
+
+	/*
+	 * Values of the chunk stored in the large value area of the stripe, see
+	 * columnar.large_value_threshold. The value stream holds references to
+	 * them instead.
+	 */
+	uint64 largeValueCount;
 } ColumnChunkSkipNode;
 
 
 /*
  * StripeSkipList can be used for skipping row chunks. It contains a column chunk
  * skip node for each chunk of each column. chunkSkipNodeArray[column][chunk]
- * is the entry for the specified column chunk.
+ * is the entry for the specified column chunk. Skip lists read for some of the
+ * columns only, see ReadStripeSkipListColumns, have NULL for the others.
  */
 typedef struct StripeSkipList
 {
@@ -120,6 +258,19 @@ typedef struct StripeSkipList
 } StripeSkipList;
 
 
+/*
+ * ColumnStripeSummary contains the minimum and maximum values of a column
+ * over all chunk groups of a stripe. It lets readers skip a stripe without
+ * reading its chunk level metadata.
+ */
+typedef struct ColumnStripeSummary
+{
+	bool hasMinMax;
+	Datum minimumValue;
+	Datum maximumValue;
+} ColumnStripeSummary;
+
+
 /*
  * ChunkData represents a chunk of data for multiple columns. valueArray stores
  * the values of data, and existsArray stores whether a value is present.
@@ -141,6 +292,21 @@ typedef struct ChunkData
 
 	/* valueBuffer keeps actual data for type-by-reference datums from valueArray. */
 	StringInfo *valueBufferArray;
+
+	/* encoding of each column's values, set by the reader */
+	ValueEncodingType *valueEncodingArray;
+
+	/* null state of each column's chunk, from its skip node */
+	ChunkNullState *nullStateArray;
+
+	/*
+	 * Set for columns of fixed length values that were left as they are
+	 * stored, back to back and without NULL rows, instead of being
+	 * deserialized into valueArray. Vectorized reads leave such chunks
+	 * packed, and row reads those that have no NULL rows, so that the value
+	 * of each row is at its index.
+	 */
+	char **packedValueArray;
 } ChunkData;
 
 
@@ -156,7 +322,12 @@ typedef struct ColumnChunkBuffers
 	StringInfo existsBuffer;
 	StringInfo valueBuffer;
 	CompressionType valueCompressionType;
+	int valueCompressionLevel;
+	ValueEncodingType valueEncodingType;
+	ChunkNullState nullState;
+	uint64 compressionDictionaryId;
 	uint64 decompressedValueSize;
+	uint64 largeValueCount;
 } ColumnChunkBuffers;
 
 
@@ -180,6 +351,14 @@ typedef struct StripeBuffers
 	uint32 *selectedChunkGroupRowCounts;
 	uint32 *selectedChunkGroupRowOffset;
 	uint32 *selectedChunkGroupDeletedRows;
+	uint32 *selectedChunkGroupIndex;
+	uint32 selectedChunkGroupCount;
+
+	/*
+	 * Skip nodes of the selected chunk groups, by [column][chunk group], NULL
+	 * for the columns that aren't projected.
+	 */
+	ColumnChunkSkipNode **selectedChunkSkipNodeArray;
 } StripeBuffers;
 
 
@@ -205,24 +384,274 @@ typedef enum StripeWriteStateEnum
 
 
 /* Parallel Custom Scan shared data */
+/*
+ * ColumnarReadStatistics counts what a read did, for EXPLAIN ANALYZE. Stripes
+ * skipped are those whose column summaries refute the quals, and the rows
+ * removed by row masks are the deleted rows of the chunk groups read. Rows
+ * removed by sorted search are the rows of sorted chunks that the quals
+ * exclude, which the read left out without evaluating them.
+ */
+typedef struct ColumnarReadStatistics
+{
+	uint64 stripesRead;
+	uint64 stripesSkipped;
+	uint64 chunkGroupsRead;
+	uint64 chunkGroupsSkipped;
+	uint64 bytesRead;
+	uint64 rowsRemovedByRowMask;
+	uint64 rowsRemovedBySortedSearch;
+	uint64 cacheHits;
+	uint64 cacheMisses;
+
+	/* rows of stripes returned one by one and in vectors */
+	uint64 rowsRead;
+	uint64 vectorRowsRead;
+
+	/* most memory the read used for a stripe, parallel reads take the max */
+	uint64 peakMemoryBytes;
+
+	/* indexed by compression type */
+	DecompressionStatistics decompression[COMPRESSION_COUNT];
+} ColumnarReadStatistics;
+
+/* counters of columnar.pg_stat_columnar, in the order of its columns */
+typedef enum ColumnarStatCounter
+{
+	COLUMNAR_STAT_STRIPES_SCANNED,
+	COLUMNAR_STAT_STRIPES_SKIPPED,
+	COLUMNAR_STAT_CHUNK_GROUPS_SCANNED,
+	COLUMNAR_STAT_CHUNK_GROUPS_SKIPPED,
+	COLUMNAR_STAT_BYTES_READ,
+	COLUMNAR_STAT_BYTES_DECOMPRESSED,
+	COLUMNAR_STAT_VECTORIZED_ROWS,
+	COLUMNAR_STAT_ROW_PATH_ROWS,
+	COLUMNAR_STAT_CACHE_HITS,
+	COLUMNAR_STAT_CACHE_MISSES,
+	COLUMNAR_STAT_CACHE_EVICTIONS,
+	COLUMNAR_STAT_ROWS_WRITTEN,
+	COLUMNAR_STAT_STRIPES_FLUSHED,
+	COLUMNAR_STAT_COUNTER_COUNT
+} ColumnarStatCounter;
+
 typedef struct ParallelColumnarScanData
 {
 	slock_t mutex;
-	pg_atomic_uint64 nextStripeId;	/* Fetch next stripe id to be read and increment */
+	pg_atomic_uint32 deltaStoreClaimed;	/* Set by the participant reading the delta store */
+
+	/*
+	 * Stripes to read, looked up once by the leader and stored after the
+	 * snapshot at stripeListOffset, see ColumnarParallelScanStripeList. If
+	 * stripeListPruned is set, the stripes that the scan clauses refute are
+	 * left out, and chunkGroupsPruned counts their chunk groups.
+	 *
+	 * Parallel table scans, which size their shared memory before the
+	 * snapshot is known, don't have a stripe list and set stripeListOffset
+	 * to 0. Their participants claim whole stripes by id from nextStripeId.
+	 */
+	pg_atomic_uint64 nextStripeId;
+	Size stripeListOffset;
+	uint64 stripeCount;
+	bool stripeListPruned;
+	uint64 stripesPruned;
+	uint64 chunkGroupsPruned;
+
+	/*
+	 * Next stripe of the list to claim, the stripe whose chunk groups are
+	 * being handed out and the next of them to claim. All under mutex, see
+	 * ClaimParallelStripeRange.
+	 */
+	uint64 nextStripeIndex;
+	bool hasSplitStripe;
+	StripeMetadata splitStripe;
+	uint32 splitStripeNextChunkGroup;
+	uint32 participantCount;
+
+	ColumnarReadStatistics workerStatistics; /* Summed by the workers, under mutex */
 	char snapshotData[FLEXIBLE_ARRAY_MEMBER];
 } ParallelColumnarScanData;
 typedef struct ParallelColumnarScanData *ParallelColumnarScan;
 
+#define ParallelColumnarScanStripes(pscan) \
+	((StripeMetadata *) ((char *) (pscan) + (pscan)->stripeListOffset))
+
 
 typedef bool (*ColumnarSupportsIndexAM_type)(char *);
 typedef const char *(*CompressionTypeStr_type)(CompressionType);
 typedef bool (*IsColumnarTableAmTable_type)(Oid);
 typedef bool (*ReadColumnarOptions_type)(Oid, ColumnarOptions *);
 
+/* DeltaStoreScanDesc represents a scan over the delta store rows of a storage. */
+typedef struct DeltaStoreScanDescData *DeltaStoreScanDesc;
+
 /* ColumnarReadState represents state of a columnar scan. */
 struct ColumnarReadState;
 typedef struct ColumnarReadState ColumnarReadState;
 
+/*
+ * ColumnarVectorQualFunc evaluates a stage of the quals filtering the vectors
+ * of a sequential scan, once the columns of the stage are read into the
+ * vectors. It narrows the rows selected by the earlier stages and returns how
+ * many are left.
+ */
+typedef uint32 (*ColumnarVectorQualFunc)(void *qualState, int stage,
+										 uint32 vectorSize);
+
+/*
+ * ChunkGroupSummary collects the skip list statistics of the chunk groups of
+ * a sequential scan whose rows all pass qualList and none of which are
+ * deleted. Such chunk groups are left out of the read, for an aggregate that
+ * only needs their row and value counts and min/max values, see
+ * ColumnarSetChunkGroupSummary. The arrays are indexed by column index, and
+ * minMaxValues keeps the minimum and maximum of each chunk group that has
+ * values, only for columns of by-value types. sketchRegisters merges the
+ * distinct value sketches of the chunk groups for the columns of
+ * sketchColumns, whose chunk groups need a sketch to be summarized.
+ */
+typedef struct ChunkGroupSummary
+{
+	List *qualList;
+	List *qualVars;
+
+	uint32 columnCount;
+	uint64 chunkGroupCount;
+	uint64 rowCount;
+	uint64 *valueCount;
+	Datum **minMaxValues;
+	uint32 *minMaxValueCount;
+	uint32 *minMaxCapacity;
+	Bitmapset *sketchColumns;
+	uint8 **sketchRegisters;
+} ChunkGroupSummary;
+
+/*
+ * ColumnarChunkGroupDelete marks the rows of the chunk groups of the
+ * sequential scan of a DELETE whose rows all pass qualList deleted, with a
+ * row mask update per chunk group instead of a delete per row, see
+ * ColumnarSetChunkGroupDelete. chunkGroupCount and deletedRowCount count the
+ * chunk groups and the rows, that weren't deleted yet, marked so far.
+ */
+typedef struct ColumnarChunkGroupDelete
+{
+	List *qualList;
+	List *qualVars;
+
+	uint64 chunkGroupCount;
+	uint64 deletedRowCount;
+} ColumnarChunkGroupDelete;
+
+/*
+ * ColumnarTopNBound is the first sort key of the last of the rows a top-N
+ * sort above a sequential scan keeps so far, which the scan updates as it
+ * returns rows. Chunk groups whose rows all sort after it can't be in the
+ * result of the sort, and are left out of the read, see
+ * ColumnarSetTopNBound. rowCount is the number of rows the sort keeps, and
+ * the bound is valid once the scan returned that many.
+ */
+typedef struct ColumnarTopNBound
+{
+	AttrNumber attno;
+	uint64 rowCount;
+	struct SortSupportData *sortKey;
+
+	bool valid;
+	Datum value;
+	bool isNull;
+} ColumnarTopNBound;
+
+/*
+ * ColumnarJoinKeyFilter is a bloom filter of the join keys of the hash table
+ * of a hash join above a sequential scan, whose rows without a match the join
+ * discards. Chunk groups none of whose keys may be in it are left out of the
+ * read before their other columns are read, see ColumnarSetJoinKeyFilter.
+ * The scan sets bloomFilter once the join has built its hash table, and the
+ * read counts the chunk groups it left out in chunkGroupsFiltered.
+ */
+typedef struct ColumnarJoinKeyFilter
+{
+	AttrNumber attno;
+	Oid collation;
+	FmgrInfo *hashFunction;
+	bytea *bloomFilter;
+
+	uint64 chunkGroupsFiltered;
+} ColumnarJoinKeyFilter;
+
+/*
+ * StripeProjectionMeasure holds the number of values of a column in a group
+ * of a stripe projection, and their sum. Sums of integer columns are kept in
+ * intSum, sums of float columns in floatSum.
+ */
+typedef struct StripeProjectionMeasure
+{
+	int64 valueCount;
+	int64 intSum;
+	float8 floatSum;
+} StripeProjectionMeasure;
+
+/*
+ * StripeProjectionGroup is a group of a stripe projection: the values of its
+ * group by columns, the number of its rows, and a measure per measured
+ * column. The key values come first, so they can be the key of a hash table
+ * entry of STRIPE_PROJECTION_GROUP_KEY_SIZE bytes.
+ */
+typedef struct StripeProjectionGroup
+{
+	Datum keyValues[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+	bool keyNulls[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+	int64 rowCount;
+	StripeProjectionMeasure measures[FLEXIBLE_ARRAY_MEMBER];
+} StripeProjectionGroup;
+
+#define STRIPE_PROJECTION_GROUP_KEY_SIZE \
+	(offsetof(StripeProjectionGroup, keyNulls) + \
+	 PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM * sizeof(bool))
+#define STRIPE_PROJECTION_GROUP_SIZE(measureCount) \
+	(offsetof(StripeProjectionGroup, measures) + \
+	 (measureCount) * sizeof(StripeProjectionMeasure))
+
+/*
+ * StripeProjection is the projection of a stripe, with the attribute numbers
+ * of its group by columns and of the columns it has the sums of, whose
+ * measures come in that order.
+ */
+typedef struct StripeProjection
+{
+	int keyCount;
+	AttrNumber keyAttnums[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+	int sumCount;
+	AttrNumber *sumAttnums;
+
+	uint32 groupCount;
+	StripeProjectionGroup **groups;
+} StripeProjection;
+
+/*
+ * StripeProjectionSummary collects the groups of the stripes of a sequential
+ * scan whose projection answers an aggregate above the scan, see
+ * ColumnarSetStripeProjectionSummary. Such stripes have no deleted rows, and
+ * the quals only reference group by columns of their projection, so which
+ * of its groups pass them is known. Groups are merged by the values of
+ * groupAttnums, and measures[i] of a group is the count and sum of
+ * measureAttnums[i].
+ */
+typedef struct StripeProjectionSummary
+{
+	List *qualList;
+	List *qualVars;
+
+	int groupCount;
+	AttrNumber groupAttnums[PROJECTION_GROUP_BY_COLUMN_COUNT_MAXIMUM];
+	int measureCount;
+	AttrNumber *measureAttnums;
+
+	/* measured columns whose sums the aggregate needs */
+	Bitmapset *sumColumns;
+
+	uint64 stripeCount;
+	HTAB *groups;
+	MemoryContext context;
+} StripeProjectionSummary;
+
 
 /* ColumnarWriteState represents state of a columnar write operation. */
 struct ColumnarWriteState;
@@ -232,6 +661,25 @@ typedef struct ColumnarWriteState ColumnarWriteState;
 struct RowMaskWriteStateEntry;
 typedef struct RowMaskWriteStateEntry RowMaskWriteStateEntry;
 
+/*
+ * StripeRowMasks holds the columnar.row_mask rows of a stripe, ordered by
+ * their first row number, see ReadStripeRowMasks.
+ */
+typedef struct StripeRowMasks
+{
+	int count;
+	uint64 *startRowNumbers;
+	uint64 *endRowNumbers;
+	bytea **masks;
+} StripeRowMasks;
+
+/* Admission policies of the column cache, see ColumnarCacheAdmit. */
+typedef enum ColumnarCacheAdmission
+{
+	COLUMN_CACHE_ADMIT_ALL,
+	COLUMN_CACHE_ADMIT_SECOND_ACCESS
+} ColumnarCacheAdmission;
+
 /* Cache statistics for when caching is enabled and used. */
 typedef struct ColumnarCacheStatistics
 {
@@ -242,19 +690,91 @@ typedef struct ColumnarCacheStatistics
 	uint64 maximumCacheSize;
 	uint64 endingCacheSize;
 	uint64 entries;
+
+	/* skip list cache, see columnar_skiplist_cache.c */
+	uint64 skipListHits;
+	uint64 skipListMisses;
+	uint64 skipListEntries;
+	uint64 skipListSize;
 } ColumnarCacheStatistics;
 
+/* a chunk in the shared column cache, see ColumnarSharedCacheChunks */
+typedef struct ColumnarCachedChunk
+{
+	Oid databaseId;
+	uint64 storageId;
+	uint64 stripeId;
+	uint64 chunkId;
+	uint32 columnId;
+} ColumnarCachedChunk;
+
 /* GUCs */
 extern int columnar_compression;
 extern int columnar_stripe_row_limit;
+extern int columnar_stripe_size_limit;
+extern bool columnar_auto_row_limits;
+extern int columnar_auto_chunk_size;
+extern int columnar_auto_stripe_size;
+extern int columnar_large_value_threshold;
+extern int columnar_write_state_memory_limit;
+extern int columnar_read_state_memory_limit;
+extern bool columnar_enable_streaming_reads;
 extern int columnar_chunk_group_row_limit;
 extern int columnar_compression_level;
+extern int columnar_auto_compression_min_gain;
+extern int columnar_compression_workers;
+extern int columnar_column_compression_threads;
+extern bool columnar_enable_decompression_thread;
+extern bool columnar_enable_compression_thread;
+extern int columnar_column_decompression_threads;
 extern bool columnar_enable_parallel_execution;
 extern int columnar_min_parallel_processes;
 extern bool columnar_enable_vectorization;
+extern bool columnar_enable_vectorized_window;
+extern bool columnar_enable_fused_vector_expressions;
+extern bool columnar_enable_bucketwise_execution;
+extern bool columnar_enable_synchronized_scans;
 extern bool columnar_enable_dml;
 extern bool columnar_enable_page_cache;
 extern int columnar_page_cache_size;
+extern int columnar_prefetch_depth;
+extern bool columnar_enable_late_materialization;
+extern bool columnar_enable_sorted_chunk_search;
+extern bool columnar_enable_chunk_group_delete;
+extern bool columnar_enable_rescan_cache;
+extern bool columnar_enable_transaction_read_cache;
+extern bool columnar_enable_approximate_count_distinct;
+extern bool columnar_enable_metadata_statistics;
+extern int columnar_vector_size;
+extern bool columnar_vector_huge_pages;
+extern int columnar_skiplist_cache_size;
+extern int columnar_shared_cache_size;
+extern bool columnar_autoprewarm;
+extern int columnar_autoprewarm_interval;
+extern int columnar_column_cache_admission;
+extern bool columnar_column_cache_bypass_large_scans;
+extern bool columnar_enable_dictionary_encoding;
+extern bool columnar_enable_run_length_encoding;
+extern bool columnar_enable_bit_packing;
+extern bool columnar_enable_value_offsets;
+extern bool columnar_enable_auto_compaction;
+extern bool columnar_enable_autovacuum_compaction;
+extern bool columnar_enable_vacuum_compaction;
+extern int columnar_auto_compaction_naptime;
+extern int columnar_auto_compaction_min_stripes;
+extern int columnar_auto_compaction_stripe_count;
+extern int columnar_auto_compaction_delta_rows;
+extern double columnar_vacuum_deleted_rows_threshold;
+extern bool columnar_online_vacuum;
+extern double columnar_vacuum_cost_delay;
+extern int columnar_vacuum_cost_limit;
+extern int columnar_delta_store_row_limit;
+extern bool columnar_preserve_compressed_values;
+extern bool columnar_compact_chunk_metadata;
+extern char *columnar_offload_directory;
+extern bool columnar_enable_extent_storage;
+extern int columnar_io_uring_queue_depth;
+extern int columnar_stat_max_relations;
 
 
 /* called when the user changes options on the given relation */
@@ -270,10 +790,27 @@ extern ColumnarWriteState * ColumnarBeginWrite(RelFileNode relfilenode,
 											   TupleDesc tupleDescriptor);
 extern uint64 ColumnarWriteRow(ColumnarWriteState *state, Datum *columnValues,
 							   bool *columnNulls);
+extern void ColumnarWriteBatch(ColumnarWriteState *state, Datum **columnValues,
+							   bool **columnNulls, uint32 rowCount,
+							   uint64 *rowNumbers);
+extern bool ColumnarWriteChunkGroup(ColumnarWriteState *writeState,
+									StripeMetadata *stripeMetadata,
+									StripeSkipList *skipList, uint32 chunkIndex,
+									uint64 *rowNumber);
 extern void ColumnarFlushPendingWrites(ColumnarWriteState *state);
+extern void ColumnarDisableStripeSort(ColumnarWriteState *state);
+extern void ColumnarDisableStripeBuckets(ColumnarWriteState *state);
+extern void ColumnarEnableDeltaStore(ColumnarWriteState *state);
+extern void ColumnarDisableDeltaStore(ColumnarWriteState *state);
 extern void ColumnarEndWrite(ColumnarWriteState *state);
 extern bool ContainsPendingWrites(ColumnarWriteState *state);
+extern bool ColumnarWriteStateReadRow(ColumnarWriteState *writeState, uint64 rowNumber,
+									  Datum *columnValues, bool *columnNulls);
 extern MemoryContext ColumnarWritePerTupleContext(ColumnarWriteState *state);
+extern uint64 ColumnarWriteStateMemory(ColumnarWriteState *state);
+extern uint64 ColumnarWriteStatePeakMemory(void);
+extern void ColumnarResetWriteStatePeakMemory(void);
+extern bool ColumnarSortednessTracked(Form_pg_attribute attributeForm);
 
 /* Function declarations for reading from columnar table */
 
@@ -293,11 +830,64 @@ extern void ColumnarResetRead(ColumnarReadState *readState);
 /* functions only applicable for sequential access */
 extern bool ColumnarReadNextRow(ColumnarReadState *state, Datum *columnValues,
 								bool *columnNulls, uint64 *rowNumber);
+extern bool ColumnarReadNextBatchedRow(ColumnarReadState *readState,
+									   Datum *columnValues, bool *columnNulls,
+									   uint64 *rowNumber);
 extern bool ColumnarReadNextVector(ColumnarReadState *readState, Datum *columnValues,
-								   bool *columnNulls, uint64 *rowNumber,
+								   uint64 *rowNumber, int maxVectorSize,
 								   int *newVectorSize);
+extern void ColumnarSetVectorQual(ColumnarReadState *readState, List *stageColumnLists,
+								  ColumnarVectorQualFunc qualFunc, void *qualState);
+extern void ColumnarSetRowBound(ColumnarReadState *readState, uint64 rowBound);
+extern void ColumnarSetTopNBound(ColumnarReadState *readState, ColumnarTopNBound *bound);
+extern void ColumnarSetJoinKeyFilter(ColumnarReadState *readState,
+									 ColumnarJoinKeyFilter *filter);
+extern void ColumnarSetStripeList(ColumnarReadState *readState, List *stripeList,
+								  bool readDeltaStore);
+extern void ColumnarSetSyncScan(ColumnarReadState *readState);
+extern ChunkGroupSummary * CreateChunkGroupSummary(TupleDesc tupleDescriptor,
+												   List *qualList,
+												   List *sketchColumns);
+extern void ResetChunkGroupSummary(ChunkGroupSummary *summary);
+extern void ColumnarSetChunkGroupSummary(ColumnarReadState *readState,
+										 ChunkGroupSummary *summary);
+extern ColumnarChunkGroupDelete * CreateChunkGroupDelete(TupleDesc tupleDescriptor,
+														 List *qualList);
+extern void ColumnarSetChunkGroupDelete(ColumnarReadState *readState,
+										ColumnarChunkGroupDelete *chunkGroupDelete);
+extern StripeProjectionSummary * CreateStripeProjectionSummary(List *groupColumns,
+															   List *sumColumns,
+															   List *countColumns,
+															   List *qualList,
+															   int natts);
+extern void ResetStripeProjectionSummary(StripeProjectionSummary *summary);
+extern void ColumnarSetStripeProjectionSummary(ColumnarReadState *readState,
+											   StripeProjectionSummary *summary);
+extern void ColumnarAddScanQual(ColumnarReadState *readState, List *clauseList);
+extern double ColumnarChunkGroupReadFraction(Relation relation, List *whereClauseList);
+extern List * ColumnarParallelScanStripeList(Relation relation, Snapshot snapshot,
+											 List *whereClauseList,
+											 uint64 *stripesPruned,
+											 uint64 *chunkGroupsPruned);
 extern int64 ColumnarReadChunkGroupsFiltered(ColumnarReadState *state);
+extern const ColumnarReadStatistics * ColumnarReadGetStatistics(ColumnarReadState *state);
+extern void AddColumnarReadStatistics(ColumnarReadStatistics *total,
+									  const ColumnarReadStatistics *statistics);
+extern uint64 ColumnarReadStatePeakMemory(void);
+extern void ColumnarResetReadStatePeakMemory(void);
+extern void ColumnarSetStripeFloor(Oid relationId, uint64 stripeId);
+extern bool StripeChunksImplyClauses(Relation relation, StripeMetadata *stripeMetadata,
+									 List *clauseList, Snapshot snapshot);
 extern void ColumnarRescan(ColumnarReadState *readState, List *scanQual);
+extern void ColumnarReadSetChunkGroup(ColumnarReadState *readState,
+									  StripeMetadata *stripeMetadata,
+									  uint32 chunkGroupIndex);
+extern bool ColumnarReadChunkGroupNextRow(ColumnarReadState *readState,
+										  Datum *columnValues, bool *columnNulls,
+										  uint64 *rowNumber);
+extern bool ColumnarReadDeltaStoreNextRow(ColumnarReadState *readState,
+										  Datum *columnValues, bool *columnNulls,
+										  uint64 *rowNumber);
 
 /* functions only applicable for random access */
 extern void ColumnarReadRowByRowNumberOrError(ColumnarReadState *readState,
@@ -306,9 +896,24 @@ extern void ColumnarReadRowByRowNumberOrError(ColumnarReadState *readState,
 extern bool ColumnarReadRowByRowNumber(ColumnarReadState *readState,
 									   uint64 rowNumber, Datum *columnValues,
 									   bool *columnNulls);
+extern void ColumnarReadSetRowNumbers(ColumnarReadState *readState,
+									  const uint64 *rowNumbers, uint32 rowNumberCount);
+extern bool ColumnarReadNextRowNumber(ColumnarReadState *readState,
+									  Datum *columnValues, bool *columnNulls,
+									  uint64 *rowNumber);
 extern bool ColumnarSetStripeReadState(ColumnarReadState *readState,
 									   StripeMetadata *startStripeMetadata);
 
+/* functions for chunks that are in memory */
+extern void ColumnarDeserializeChunkBuffers(ColumnChunkBuffers *chunkBuffers,
+											uint32 rowCount,
+											Form_pg_attribute attributeForm,
+											bool *existsArray, Datum *datumArray);
+extern void ColumnarDeserializeDatumArray(StringInfo datumBuffer, bool *existsArray,
+										  uint32 datumCount,
+										  Form_pg_attribute attributeForm,
+										  Datum *datumArray);
+
 /* Function declarations for common functions */
 extern FmgrInfo * GetFunctionInfoOrNull(Oid typeId, Oid accessMethodId,
 										int16 procedureId);
@@ -330,26 +935,85 @@ extern bool IsColumnarTableAmTable(Oid relationId);
 
 /* columnar_metadata_tables.c */
 extern void DeleteMetadataRows(RelFileNode relfilenode);
+extern void DeleteStorageMetadataRows(uint64 storageId);
 extern void DeleteMetadataRowsForStripeId(RelFileNode relfilenode, uint64 stripeId);
+extern StripeMetadata * ReplaceStripeMetadata(Relation rel,
+											 StripeMetadata *stripeMetadata,
+											 uint64 newStripeId, uint64 fileOffset,
+											 uint64 dataLength,
+											 StripeSkipList *skipList,
+											 TupleDesc tupleDescriptor);
 extern uint64 ColumnarMetadataNewStorageId(void);
 extern uint64 GetHighestUsedAddress(RelFileNode relfilenode);
 extern EmptyStripeReservation * ReserveEmptyStripe(Relation rel, uint64 columnCount,
 												   uint64 chunkGroupRowCount,
-												   uint64 stripeRowCount);
+												   uint64 stripeRowCount,
+												   StripeReservationBatch *batch);
+extern void ReleaseStripeReservationBatch(Relation rel, StripeReservationBatch *batch,
+										  uint64 stripeRowCount);
 extern StripeMetadata * CompleteStripeReservation(Relation rel, uint64 stripeId,
 												  uint64 sizeBytes, uint64 rowCount,
-												  uint64 chunkCount);
+												  uint64 chunkCount, int32 bucket);
 extern void SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe,
 							   StripeSkipList *stripeSkipList,
 							   TupleDesc tupleDescriptor);
+extern bool ColumnarChunkValueEncodingSupported(void);
+extern bool ColumnarChunkNullStateSupported(void);
+extern bool ColumnarChunkLargeValueCountSupported(void);
+extern bool ColumnarCompressionDictionarySupported(void);
+extern uint64 SaveCompressionDictionary(uint64 storageId, AttrNumber attnum,
+										bytea *dictionary);
+extern uint64 ReadLatestCompressionDictionaryId(uint64 storageId, AttrNumber attnum);
+extern bytea * ReadCompressionDictionary(uint64 dictionaryId);
+extern bool ColumnarDeltaStoreSupported(void);
+extern void InsertDeltaStoreRow(uint64 storageId, uint64 rowNumber, bytea *rowData);
+extern DeltaStoreScanDesc BeginDeltaStoreScan(uint64 storageId, Snapshot snapshot);
+extern bytea * DeltaStoreScanNext(DeltaStoreScanDesc scan, uint64 *rowNumber);
+extern void EndDeltaStoreScan(DeltaStoreScanDesc scan);
+extern bytea * ReadDeltaStoreRow(uint64 storageId, uint64 rowNumber, Snapshot snapshot);
+extern bool DeleteDeltaStoreRow(uint64 storageId, uint64 rowNumber,
+								bool *alreadyDeleted);
+extern void DeleteDeltaStoreRows(uint64 storageId, Snapshot snapshot);
+extern uint64 DeltaStoreRowCount(uint64 storageId, Snapshot snapshot);
 extern void SaveChunkGroups(RelFileNode relfilenode, uint64 stripe,
 							List *chunkGroupRowCounts);
+extern void SaveStripeProjection(RelFileNode relfilenode, uint64 stripe,
+								 bytea *projection);
+extern bytea * ReadStripeProjection(RelFileNode relfilenode, uint64 stripe,
+									Snapshot snapshot);
+extern bool StripeHasDeletedRows(RelFileNode relfilenode, StripeMetadata *stripeMetadata,
+								 Snapshot snapshot);
+extern uint64 StripeDeletedRowCount(RelFileNode relfilenode,
+								   StripeMetadata *stripeMetadata, Snapshot snapshot);
+extern void SaveStripeColumnSummaries(RelFileNode relfilenode, uint64 stripe,
+									  ColumnStripeSummary *columnSummaries,
+									  TupleDesc tupleDescriptor);
+extern ColumnStripeSummary * ReadStripeColumnSummaries(RelFileNode relfilenode,
+													   uint64 stripe,
+													   TupleDesc tupleDescriptor,
+													   Snapshot snapshot);
 extern void UpdateChunkGroupDeletedRows(uint64 storageId, uint64 stripe,
 										uint32 chunkGroupId, uint32 deletedRowNumber);
 extern StripeSkipList * ReadStripeSkipList(RelFileNode relfilenode, uint64 stripe,
 										   TupleDesc tupleDescriptor,
 										   uint32 chunkCount,
 										   Snapshot snapshot);
+extern StripeSkipList * ReadStripeSkipListColumns(RelFileNode relfilenode, uint64 stripe,
+												  TupleDesc tupleDescriptor,
+												  uint32 chunkCount, Snapshot snapshot,
+												  const bool *columnMask);
+extern void SendStripeSkipListNodes(StringInfo buffer, StripeSkipList *chunkList,
+									uint32 columnCount, TupleDesc tupleDescriptor);
+extern StripeSkipList * ReceiveStripeSkipList(StringInfo buffer,
+											  TupleDesc tupleDescriptor,
+											  uint32 columnCount, uint32 chunkCount,
+											  const bool *columnMask);
+extern void SendStripeColumnSummaries(StringInfo buffer,
+									  ColumnStripeSummary *columnSummaries,
+									  uint32 columnCount, TupleDesc tupleDescriptor);
+extern ColumnStripeSummary * ReceiveStripeColumnSummaries(StringInfo buffer,
+														  TupleDesc tupleDescriptor,
+														  uint32 columnCount);
 extern StripeMetadata * FindNextStripeByRowNumber(Relation relation, uint64 rowNumber,
 												  Snapshot snapshot);
 extern StripeMetadata * FindStripeByRowNumber(Relation relation, uint64 rowNumber,
@@ -357,12 +1021,11 @@ extern StripeMetadata * FindStripeByRowNumber(Relation relation, uint64 rowNumbe
 extern StripeMetadata * FindStripeWithMatchingFirstRowNumber(Relation relation,
 															 uint64 rowNumber,
 															 Snapshot snapshot);
-extern StripeMetadata *  FindNextStripeForParallelWorker(Relation relation,
-														 Snapshot snapshot,
-														 uint64 nextStripeId,
-														 uint64 * nextHigherStripeId);
+extern StripeMetadata * FindNextStripeById(Relation relation, uint64 stripeId,
+										   Snapshot snapshot);
 extern StripeWriteStateEnum StripeWriteState(StripeMetadata *stripeMetadata);
 extern uint64 StripeGetHighestRowNumber(StripeMetadata *stripeMetadata);
+extern bool StripeVisibleToAll(StripeMetadata *stripeMetadata, TransactionId oldestXmin);
 extern StripeMetadata * FindStripeWithHighestRowNumber(Relation relation,
 													   Snapshot snapshot);
 extern Datum columnar_relation_storageid(PG_FUNCTION_ARGS);
@@ -370,10 +1033,16 @@ extern bool SaveEmptyRowMask(uint64 storageId, uint64 stripeId,
 							 uint64 stripeStartRowNumber, List *chunkGroupRowCounts);
 extern bool UpdateRowMask(RelFileNode relfilenode, uint64 storageId,
 						  Snapshot snapshot, uint64 rowNumber);
-extern void FlushRowMaskCache(RowMaskWriteStateEntry *rowMaskEntry);
-extern bytea * ReadChunkRowMask(RelFileNode relfilenode, Snapshot snapshot,
-								MemoryContext ctx,
-								uint64 stripeFirstRowNumber, int rowCount);
+extern uint64 UpdateRowMaskRange(RelFileNode relfilenode, uint64 storageId,
+								 uint64 firstRowNumber, uint64 endRowNumber);
+extern void FlushRowMaskWriteStateEntries(RowMaskWriteStateEntry **rowMaskEntries,
+										  int entryCount);
+extern StripeRowMasks * ReadStripeRowMasks(RelFileNode relfilenode, MemoryContext ctx,
+										   uint64 stripeFirstRowNumber,
+										   uint64 rowCount);
+extern bytea * StripeChunkRowMask(StripeRowMasks *stripeRowMasks, MemoryContext ctx,
+								  uint64 chunkFirstRowNumber, int rowCount);
+extern bool StripeRowMasksRowDeleted(StripeRowMasks *stripeRowMasks, uint64 rowNumber);
 extern Datum create_table_row_mask(PG_FUNCTION_ARGS);
 extern EState * create_estate_for_relation(Relation rel);
 
@@ -408,6 +1077,10 @@ extern bool ColumnarPendingWritesInUpperTransactions(Oid relfilenode,
 													 SubTransactionId currentSubXid);
 extern void FlushWriteStateForRelfilenode(Oid relfilenode, SubTransactionId
 										  currentSubXid);
+extern void ColumnarDisableWriteStateBuckets(Oid relfilenode);
+extern void ColumnarEnforceWriteStateMemoryLimit(SubTransactionId currentSubXid);
+extern bool ColumnarReadPendingRow(Oid relfilenode, uint64 rowNumber,
+								   Datum *columnValues, bool *columnNulls);
 extern MemoryContext GetColumnarWriteContextForDebug(void);
 
 /* write_state_row_mask.c */
@@ -435,16 +1108,219 @@ extern ColumnarReadState ** InitColumnarReadStateCache(Relation relation,
 													  SubTransactionId currentSubXid);
 extern ColumnarReadState ** FindReadStateCache(Relation relation,
 											   SubTransactionId currentSubXid);
+extern ColumnarReadState ** LockReadStateCache(Relation relation,
+											   SubTransactionId currentSubXid);
+extern ColumnarReadState ** UpdateReadStateCache(Relation relation,
+												 SubTransactionId currentSubXid,
+												 Bitmapset *attrNeeded);
 extern void CleanupReadStateCache(SubTransactionId currentSubXid);
 extern MemoryContext GetColumnarReadStateCache(void);
+extern StripeRowMasks * TransactionReadCacheLookupRowMasks(uint64 storageId,
+															uint64 stripeFirstRowNumber,
+															Snapshot snapshot,
+															MemoryContext cxt);
+extern void TransactionReadCacheStoreRowMasks(uint64 storageId,
+											  uint64 stripeFirstRowNumber,
+											  Snapshot snapshot,
+											  StripeRowMasks *stripeRowMasks);
+extern bool TransactionReadCacheLookupRowCounts(uint64 storageId, uint64 stripe,
+												uint32 chunkGroupCount, Snapshot snapshot,
+												uint32 **chunkGroupRowCounts,
+												uint32 **chunkGroupDeletedRows);
+extern void TransactionReadCacheStoreRowCounts(uint64 storageId, uint64 stripe,
+											   uint32 chunkGroupCount, Snapshot snapshot,
+											   const uint32 *chunkGroupRowCounts,
+											   const uint32 *chunkGroupDeletedRows);
+extern void TransactionReadCacheInvalidate(uint64 storageId);
+extern void TransactionReadCacheReset(void);
 
 /* columnar_cache.c */
 extern void ColumnarMarkChunkGroupInUse(uint64 relId, uint64 stripeId, uint32 chunkId);
 extern void ColumnarAddCacheEntry(uint64, uint64, uint64, uint32, void *);
 extern void *ColumnarRetrieveCache(uint64, uint64, uint64, uint32);
+extern bool ColumnarCacheAdmit(uint64 relId, uint64 stripeId, uint64 chunkId,
+							   uint32 columnId, uint64 size, int quota);
 extern void ColumnarResetCache(void);
 extern ColumnarCacheStatistics *ColumnarGetCacheStatistics(void);
 extern MemoryContext ColumnarCacheMemoryContext(void);
 
+/* columnar_shared_cache.c */
+extern void ColumnarSharedCacheInit(void);
+extern bool ColumnarSharedCacheEnabled(void);
+extern StringInfo ColumnarSharedCacheLookup(uint64 storageId, uint64 stripeId,
+											uint64 chunkId, uint32 columnId);
+extern void ColumnarSharedCacheInsert(uint64 storageId, uint64 stripeId,
+									  uint64 chunkId, uint32 columnId,
+									  StringInfo data);
+extern bool ColumnarSharedCacheClaimMissing(uint64 storageId, uint64 stripeId,
+											uint64 chunkId, uint32 columnId);
+extern ColumnarCachedChunk * ColumnarSharedCacheChunks(int32 *chunkCount);
+extern void ColumnarSharedCacheReleaseClaim(void);
+extern void ColumnarSharedCacheStatistics(ColumnarCacheStatistics *statistics);
+
+/* columnar_prewarm.c */
+extern void ColumnarPrewarmInit(void);
+
+/* columnar_compaction.c */
+extern void ColumnarCompactionInit(void);
+extern List * CompactionRelationList(void);
+extern void ColumnarVacuumCompact(Relation rel, int elevel);
+
+/* columnar_sync_scan.c */
+extern void ColumnarSyncScanInit(void);
+extern bool ColumnarSyncScanEnabled(void);
+extern uint64 ColumnarSyncScanGetLocation(Relation relation, uint32 columnsHash);
+extern void ColumnarSyncScanReportLocation(Relation relation, uint32 columnsHash,
+										   uint64 rowNumber);
+
+/* columnar_stat.c */
+extern void ColumnarStatInit(void);
+extern void ColumnarStatCount(Oid relationId, ColumnarStatCounter counter,
+							  uint64 amount);
+extern void ColumnarStatCountRead(Oid relationId,
+								  const ColumnarReadStatistics *statistics);
+extern bool ColumnarStatRelationCounters(Oid relationId, uint64 *counters);
+extern void ColumnarStatDropRelation(Oid relationId);
+
+/* columnar_recompress.c */
+extern bool StripeWrittenBefore(StripeMetadata *stripeMetadata, TimestampTz cutoff);
+
+/* columnar_parallel_vacuum.c */
+extern int ColumnarParallelVacuumWorkers(int candidateCount);
+extern struct Tuplestorestate ** ColumnarParallelReadStripeRows(Relation relation,
+																StripeMetadata **stripes,
+																uint32 *rowLimits,
+																uint32 stripeCount,
+																int nworkers);
+
+/* columnar_arrow.c */
+extern void CheckColumnarImportRelation(Relation rel);
+extern void CheckColumnarImportNotNull(Relation rel, bool **columnNulls, uint32 rowCount);
+
+/* columnar_delta_store.c */
+extern uint64 ColumnarDeltaStoreInsert(Relation relation, TupleDesc tupleDescriptor,
+									   Datum *columnValues, bool *columnNulls);
+extern void DeformDeltaStoreRow(bytea *rowData, TupleDesc tupleDescriptor,
+								Datum *columnValues, bool *columnNulls);
+extern uint64 ColumnarFlushDeltaStore(Relation relation);
+
+/* columnar_visibility_map.c */
+extern void ColumnarVisibilityMapUpdate(Relation relation, TransactionId oldestXmin,
+										int elevel);
+extern void ColumnarVisibilityMapClearRow(Relation relation, uint64 rowNumber);
+extern void ColumnarVisibilityMapClearRows(Relation relation, uint64 firstRowNumber,
+										   uint64 endRowNumber);
+extern void ColumnarVisibilityMapClearStripe(Relation relation,
+											 StripeMetadata *stripeMetadata);
+
+/* columnar_bloom.c */
+extern FmgrInfo * ColumnarBloomHashFunction(Oid typeId);
+extern uint64 ColumnarBloomHash(FmgrInfo *hashFunction, Oid collation, Datum value);
+extern bytea * ColumnarBloomFilterBuild(uint64 *hashes, uint32 hashCount);
+extern bool ColumnarBloomFilterMayContain(bytea *bloomFilter, uint64 hash);
+
+/* columnar_bucket.c */
+extern uint32 ColumnarBucketOfValue(FmgrInfo *hashFunction, Oid collation, Datum value,
+									bool isNull, uint32 bucketCount);
+extern bool ColumnarAllowedBuckets(Relation relation, List *clauseList,
+								   Bitmapset **allowedBuckets);
+extern void ColumnarSplitPlanByBucket(PlannedStmt *stmt);
+
+/* columnar_hll.c */
+
+/* number of registers of distinct value sketches is 2 ^ COLUMNAR_HLL_PRECISION */
+#define COLUMNAR_HLL_PRECISION 14
+#define COLUMNAR_HLL_REGISTERS (1 << COLUMNAR_HLL_PRECISION)
+
+extern bool ColumnarHllTypeSupported(Oid typeId);
+extern uint64 ColumnarHllHash(Datum value, bool isVarlena);
+extern void ColumnarHllAddHash(uint8 *registers, uint64 hash);
+extern int64 ColumnarHllEstimate(const uint8 *registers);
+extern bytea * ColumnarHllSketchBuild(const uint8 *registers);
+extern void ColumnarHllSketchMerge(uint8 *registers, bytea *serializedSketch);
+
+/* columnar_shredded_keys.c */
+
+/*
+ * ShreddedKeyStatistics tracks the values of a shredded key in the rows of
+ * the chunk being written: rows whose ->> value for the key isn't NULL and,
+ * unless boundsKnown was cleared by a long value, the smallest and largest
+ * of those values in byte order.
+ */
+typedef struct ShreddedKeyStatistics
+{
+	char *key;
+	uint64 presentCount;
+	bool boundsKnown;
+	text *minimumValue;
+	text *maximumValue;
+} ShreddedKeyStatistics;
+
+extern List * ColumnarShreddedKeyStatisticsList(List *shreddedKeys, AttrNumber attnum);
+extern void ColumnarShreddedKeysAdd(List *keyStatisticsList, Datum jsonbValue,
+									MemoryContext statisticsContext);
+extern bytea * ColumnarShreddedKeysBuild(List *keyStatisticsList);
+extern bool ColumnarShreddedKeyLookup(bytea *shreddedKeyStats, const char *key,
+									  uint64 *presentCount, text **minimumValue,
+									  text **maximumValue);
+extern bool ColumnarShreddedKeyExpression(Node *node, Var **column, char **key);
+extern int ColumnarShreddedKeyValueCompare(text *left, text *right);
+
+/* columnar_large_value.c */
+extern bool ColumnarIsLargeValueReference(Datum value);
+extern Datum ColumnarStoreLargeValue(StringInfo largeValueBuffer, Datum value,
+									 CompressionType compressionType,
+									 int compressionLevel,
+									 StringInfo compressionBuffer);
+extern Datum ColumnarLargeValueFromBuffer(StringInfo largeValueBuffer, Datum reference);
+extern Datum ColumnarFetchLargeValue(Relation relation, uint64 stripeFileOffset,
+									 Datum reference);
+extern Datum ColumnarLazyLargeValue(Relation relation, uint64 stripeFileOffset,
+									Datum reference, MemoryContext parentContext);
+
+/* columnar_projection.c */
+typedef struct StripeProjectionBuilder StripeProjectionBuilder;
+extern StripeProjectionBuilder * CreateStripeProjectionBuilder(TupleDesc tupleDescriptor,
+															   ColumnarOptions *options);
+extern void StripeProjectionAddRow(StripeProjectionBuilder *builder, Datum *columnValues,
+								   bool *columnNulls);
+extern bytea * StripeProjectionFinish(StripeProjectionBuilder *builder);
+extern void ResetStripeProjectionBuilder(StripeProjectionBuilder *builder);
+extern bool StripeProjectionSumTypeSupported(Oid typeId);
+extern StripeProjection * DeserializeStripeProjection(bytea *serialized);
+
+/* columnar_skiplist_cache.c */
+extern StripeSkipList * ColumnarSkipListCacheLookup(uint64 storageId, uint64 stripeId,
+													 TupleDesc tupleDescriptor,
+													 uint32 chunkCount,
+													 const bool *columnMask);
+extern void ColumnarSkipListCacheInsert(uint64 storageId, uint64 stripeId,
+										StripeSkipList *skipList,
+										TupleDesc tupleDescriptor);
+extern void ColumnarSkipListCacheInvalidateStripe(uint64 storageId, uint64 stripeId);
+extern void ColumnarSkipListCacheInvalidateStorage(uint64 storageId);
+extern void ColumnarSkipListCacheStatistics(uint64 *hits, uint64 *misses,
+											uint64 *entries, uint64 *size);
+
+/* columnar_matview.c */
+extern void DeleteMatviewRefreshState(Oid matviewId);
+
+/* columnar_merge_read.c */
+typedef struct ColumnarMergeReadState ColumnarMergeReadState;
+
+extern ColumnarMergeReadState * ColumnarBeginMergeRead(Relation relation,
+													   TupleDesc tupleDescriptor,
+													   List *projectedColumnList,
+													   List *whereClauseList,
+													   MemoryContext scanContext,
+													   Snapshot snapshot,
+													   AttrNumber sortKeyColumn);
+extern bool ColumnarMergeReadNextRow(ColumnarMergeReadState *mergeRead,
+									 Datum *columnValues, bool *columnNulls,
+									 uint64 *rowNumber);
+extern void ColumnarMergeRescan(ColumnarMergeReadState *mergeRead,
+								List *whereClauseList);
+extern void ColumnarEndMergeRead(ColumnarMergeReadState *mergeRead);
+
 
 #endif /* COLUMNAR_H */
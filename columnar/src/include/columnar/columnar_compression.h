@@ -21,14 +21,87 @@ typedef enum
 	COMPRESSION_LZ4 = 2,
 	COMPRESSION_ZSTD = 3,
 
+	/* picks one of the above for each chunk, never stored in a chunk */
+	COMPRESSION_AUTO = 4,
+
+	/* lz4's high compression mode, stored as COMPRESSION_LZ4 in chunks */
+	COMPRESSION_LZ4HC = 5,
+
 	COMPRESSION_COUNT
 } CompressionType;
 
+/* decompressions of one compression type done by a backend */
+typedef struct DecompressionStatistics
+{
+	uint64 chunkCount;
+	uint64 compressedBytes;
+	uint64 decompressedBytes;
+	uint64 elapsedMicroseconds;
+} DecompressionStatistics;
+
+/* a buffer to compress with CompressBuffersConcurrently or a CompressionThread */
+typedef struct CompressionJob
+{
+	StringInfo inputBuffer;
+	StringInfo outputBuffer;
+	CompressionType compressionType;
+	int compressionLevel;
+
+	/* set if outputBuffer holds the compressed data */
+	bool compressed;
+} CompressionJob;
+
+/* a value stream to decompress with a DecompressionThread */
+typedef struct DecompressionJob
+{
+	StringInfo inputBuffer;
+	StringInfo outputBuffer;
+	CompressionType compressionType;
+	uint64 decompressedSize;
+
+	/* set if outputBuffer holds the decompressed data */
+	bool decompressed;
+	uint64 elapsedMicroseconds;
+} DecompressionJob;
+
+/* a helper thread that decompresses jobs while the backend does other work */
+typedef struct DecompressionThread DecompressionThread;
+
+/* a helper thread that compresses jobs while the backend does other work */
+typedef struct CompressionThread CompressionThread;
+
 extern bool CompressBuffer(StringInfo inputBuffer,
 						   StringInfo outputBuffer,
 						   CompressionType compressionType,
 						   int compressionLevel);
+extern CompressionType CompressBufferAuto(StringInfo inputBuffer,
+										  StringInfo outputBuffer,
+										  int compressionLevel,
+										  int minimumGain);
+extern bool ConcurrentCompressionSupported(CompressionType compressionType);
+extern void CompressBuffersConcurrently(CompressionJob *jobs, uint32 jobCount,
+										int threadCount);
+extern CompressionThread * CreateCompressionThread(void);
+extern bool StartCompressionJobs(CompressionThread *thread, CompressionJob *jobs,
+								 uint32 jobCount);
+extern void FinishCompressionJobs(CompressionThread *thread);
+extern DecompressionThread * CreateDecompressionThread(void);
+extern bool StartDecompressionJobs(DecompressionThread *thread, DecompressionJob *jobs,
+								   uint32 jobCount);
+extern void FinishDecompressionJobs(DecompressionThread *thread);
+extern void DecompressBuffersConcurrently(DecompressionJob *jobs, uint32 jobCount,
+										  int threadCount);
+extern bool CompressBufferWithDictionary(StringInfo inputBuffer,
+										 StringInfo outputBuffer,
+										 int compressionLevel,
+										 uint64 dictionaryId);
+extern bytea * TrainCompressionDictionary(StringInfo samples, size_t *sampleSizes,
+										  uint32 sampleCount, uint32 dictionarySize);
 extern StringInfo DecompressBuffer(StringInfo buffer, CompressionType compressionType,
 								   uint64 decompressedSize);
+extern void DecompressBufferInto(StringInfo buffer, CompressionType compressionType,
+								 uint64 decompressedSize, uint64 dictionaryId,
+								 StringInfo outputBuffer);
+extern const DecompressionStatistics * ColumnarDecompressionStatistics(void);
 
 #endif /* COLUMNAR_COMPRESSION_H */
@@ -18,7 +18,32 @@
 /* Flag to indicate is vectorized aggregate used in execution */
 #define CUSTOM_SCAN_VECTORIZED_AGGREGATE 1
 
+/* Number of rows a LIMIT above the scan needs at most */
+#define CUSTOM_SCAN_ROW_BOUND 2
+
+/* Flag to indicate the aggregate above can use chunk group statistics */
+#define CUSTOM_SCAN_CHUNK_GROUP_SUMMARY 3
+
+/* Text of why the aggregate above isn't vectorized, shown by EXPLAIN VERBOSE */
+#define CUSTOM_SCAN_AGGREGATE_FALLBACK 4
+
+/* Text of the columns the aggregate above needs from stripe projections */
+#define CUSTOM_SCAN_STRIPE_PROJECTION 5
+
+/* Text of the columns whose chunk group sketches the aggregate above merges */
+#define CUSTOM_SCAN_CHUNK_GROUP_SKETCHES 6
+
+/* Text of the first sort key of a top-N sort above the scan */
+#define CUSTOM_SCAN_TOP_N 7
+
+/* Sort key column the scan returns the rows in the order of */
+#define CUSTOM_SCAN_SORTED_READ 8
+
 extern void columnar_customscan_init(void);
 extern const CustomScanMethods * columnar_customscan_methods(void);
+extern bool IsColumnarScanPath(Path *path);
+extern struct ChunkGroupSummary * ColumnarScanChunkGroupSummary(PlanState *planState);
+extern struct StripeProjectionSummary * ColumnarScanStripeProjectionSummary(
+	PlanState *planState);
 
 #endif /* COLUMNAR_CUSTOMSCAN_H */
@@ -0,0 +1,66 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_encoding.h
+ *
+ * Type and function declarations for value encodings, which are applied
+ * to the serialized values of a chunk before compression.
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_ENCODING_H
+#define COLUMNAR_ENCODING_H
+
+#include "lib/stringinfo.h"
+
+/* Enumeration for the encoding of a column chunk's value stream */
+typedef enum
+{
+	VALUE_ENCODING_NONE = 0,
+	VALUE_ENCODING_DICTIONARY = 1,
+	VALUE_ENCODING_RUN_LENGTH = 2,
+	VALUE_ENCODING_BIT_PACKED = 3,
+	VALUE_ENCODING_OFFSETS = 4,
+
+	VALUE_ENCODING_COUNT
+} ValueEncodingType;
+
+/* dictionaries with more entries are not worth it for low cardinality columns */
+#define DICTIONARY_MAX_ENTRIES 4096
+
+extern bool DictionaryEncodeBuffer(StringInfo inputBuffer, uint32 valueCount,
+								   int datumTypeLength, char datumTypeAlign,
+								   StringInfo outputBuffer);
+extern void DictionaryDecodeDatumArray(StringInfo datumBuffer, bool *existsArray,
+									   uint32 datumCount, int datumTypeLength,
+									   char datumTypeAlign, Datum *datumArray);
+extern uint32 DictionaryEntryArray(StringInfo datumBuffer, int datumTypeLength,
+								   char datumTypeAlign, Datum **entryArray,
+								   const uint16 **codeArray, uint32 *codeCount);
+extern bool RunLengthEncodeBuffer(StringInfo inputBuffer, uint32 valueCount,
+								  int datumTypeLength, char datumTypeAlign,
+								  StringInfo outputBuffer);
+extern void RunLengthDecodeDatumArray(StringInfo datumBuffer, bool *existsArray,
+									  uint32 datumCount, bool datumTypeByValue,
+									  int datumTypeLength, char datumTypeAlign,
+									  Datum *datumArray);
+extern uint32 RunLengthRunArray(StringInfo datumBuffer, int datumTypeLength,
+								char datumTypeAlign, const char **runValues,
+								const uint32 **runLengthArray);
+extern bool BitPackEncodeBuffer(StringInfo inputBuffer, uint32 valueCount,
+								int datumTypeLength, StringInfo outputBuffer);
+extern void BitPackDecodeDatumArray(StringInfo datumBuffer, bool *existsArray,
+									uint32 datumCount, int datumTypeLength,
+									Datum *datumArray);
+extern void OffsetsEncodeBuffer(StringInfo inputBuffer, uint32 valueCount,
+								int datumTypeLength, char datumTypeAlign,
+								StringInfo outputBuffer);
+extern Datum OffsetsValueAt(StringInfo datumBuffer, uint32 valueIndex,
+							int datumTypeLength);
+extern void OffsetsDecodeDatumArray(StringInfo datumBuffer, bool *existsArray,
+									uint32 datumCount, int datumTypeLength,
+									Datum *datumArray);
+
+#endif /* COLUMNAR_ENCODING_H */
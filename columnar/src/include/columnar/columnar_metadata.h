@@ -29,6 +29,9 @@ typedef struct StripeMetadata
 	uint64 id;
 	uint64 firstRowNumber;
 
+	/* bucket_by bucket of all rows of the stripe, or -1 */
+	int32 bucket;
+
 	/* see StripeWriteState */
 	bool aborted;
 
@@ -39,6 +42,9 @@ typedef struct StripeMetadata
 	 * not.
 	 */
 	bool insertedByCurrentXact;
+
+	/* transaction that inserted the stripe, see ColumnarVisibilityMapUpdate */
+	TransactionId insertXid;
 } StripeMetadata;
 
 /*
@@ -51,12 +57,63 @@ typedef struct EmptyStripeReservation
 	uint64 stripeFirstRowNumber;
 } EmptyStripeReservation;
 
+/*
+ * StripeReservationBatch holds stripe ids and row numbers that a writer
+ * reserved in bulk but hasn't used yet. Stripe i of the batch gets stripe
+ * id nextStripeId + i and the row numbers from nextRowNumber + i *
+ * stripeRowCount on.
+ */
+typedef struct StripeReservationBatch
+{
+	uint64 nextStripeId;
+	uint64 nextRowNumber;
+	uint32 remainingStripeCount;
+
+	/* number of stripes the next bulk reservation asks for */
+	uint32 nextBatchSize;
+} StripeReservationBatch;
+
+/* largest number of stripes reserved at once */
+#define STRIPE_RESERVATION_BATCH_MAX 16
+
+/*
+ * StripeListSummary sums up the stripes of a table for the planner, see
+ * columnar_stripe_list_cache.c.
+ */
+typedef struct StripeListSummary
+{
+	uint64 stripeCount;
+	uint64 totalDataLength;
+	uint64 rowCount;
+	uint32 maxColumnCount;
+
+	/* rows of the stripes that have a bucket_by bucket */
+	uint64 bucketedRowCount;
+} StripeListSummary;
+
 extern List * StripesForRelfilenode(RelFileNode relfilenode, ScanDirection scanDirection);
+extern List * StripesForSnapshot(Relation relation, Snapshot snapshot);
+extern List * StripeVersionsForRelfilenode(RelFileNode relfilenode);
 extern uint32 DeletedRowsForStripe(RelFileNode relfilenode,
 								   uint32 chunkCount,
 								   uint64 stripeId);
+extern void ChunkGroupRowCountsForStripe(RelFileNode relfilenode, uint32 chunkCount,
+										 uint64 stripeId, uint32 **chunkGroupRowCounts,
+										 uint32 **chunkGroupDeletedRows);
 extern void ColumnarStorageUpdateIfNeeded(Relation rel, bool isUpgrade);
 extern StripeMetadata * RewriteStripeMetadataRowWithNewValues(Relation rel, uint64 stripeId,
               uint64 sizeBytes, uint64 fileOffset, uint64 rowCount, uint64 chunkCount);
+extern void ResetStripeBuckets(Relation rel);
+
+/* columnar_stripe_list_cache.c */
+extern StripeListSummary StripeListSummaryForRelation(Relation relation);
+extern void ColumnarInvalidateStripeListSummary(Relation relation);
+extern StripeMetadata * CachedStripeContainingRowNumber(Relation relation,
+														uint64 rowNumber);
+extern StripeMetadata * CachedStripeFollowingRowNumber(Relation relation,
+													   uint64 rowNumber);
+
+/* columnar_metadata_statistics.c */
+extern void ColumnarMetadataStatisticsInit(void);
 
 #endif /* COLUMNAR_METADATA_H */
@@ -14,6 +14,9 @@
 
 #include "postgres.h"
 
+#include "access/rmgr.h"
+#include "lib/stringinfo.h"
+#include "storage/bufmgr.h"
 #include "storage/smgr.h"
 #include "utils/rel.h"
 
@@ -36,8 +39,43 @@
 #define ColumnarFirstLogicalOffset ((BLCKSZ - SizeOfPageHeaderData) * 2)
 #define ColumnarLogicalOffsetIsValid(X) ((X) >= ColumnarFirstLogicalOffset)
 
+/*
+ * Stripes moved out by columnar.offload_stripes keep their data in the
+ * table's file in columnar.offload_directory. Their logical offsets have
+ * this bit set, and the rest is the offset in that file.
+ */
+#define COLUMNAR_OFFLOADED_OFFSET_FLAG (UINT64CONST(1) << 62)
+#define ColumnarLogicalOffsetIsOffloaded(X) \
+	(((X) & COLUMNAR_OFFLOADED_OFFSET_FLAG) != 0)
+
+/*
+ * Blocks of the extents are read and written this many at a time, and
+ * reservations of at least this many pages start on a multiple of it.
+ */
+#define COLUMNAR_EXTENT_BLOCKS 128
+
+/* number of free ranges the metapage can keep */
+#define COLUMNAR_MAX_FREE_RANGES 64
 
-extern void ColumnarStorageInit(SMgrRelation srel, uint64 storageId);
+/* an unused range of logical offsets below the reserved offset */
+typedef struct ColumnarFreeRange
+{
+	uint64 logicalOffset;
+	uint64 length;
+} ColumnarFreeRange;
+
+
+/* a range read by ColumnarStorageReadRanges into data */
+typedef struct ColumnarStorageRange
+{
+	uint64 logicalOffset;
+	char *data;
+	uint32 amount;
+} ColumnarStorageRange;
+
+
+extern void ColumnarStorageInit(SMgrRelation srel, uint64 storageId,
+								char persistence);
 extern bool ColumnarStorageIsCurrent(Relation rel);
 extern void ColumnarStorageUpdateCurrent(Relation rel, bool upgrade,
 										 uint64 reservedStripeId,
@@ -52,13 +90,42 @@ extern uint64 ColumnarStorageGetReservedRowNumber(Relation rel, bool force);
 extern uint64 ColumnarStorageGetReservedOffset(Relation rel, bool force);
 
 extern uint64 ColumnarStorageReserveData(Relation rel, uint64 amount);
+extern void ColumnarStorageSetFreeRanges(Relation rel, ColumnarFreeRange *freeRanges,
+										 uint32 freeRangeCount);
 extern uint64 ColumnarStorageReserveRowNumber(Relation rel, uint64 nrows);
 extern uint64 ColumnarStorageReserveStripeId(Relation rel);
+extern uint64 ColumnarStorageReserveStripes(Relation rel, uint64 stripeCount,
+											uint64 stripeRowCount,
+											uint64 *firstRowNumber);
+extern void ColumnarStorageReleaseStripes(Relation rel, uint64 firstStripeId,
+										  uint64 endStripeId, uint64 firstRowNumber,
+										  uint64 endRowNumber);
 
 extern void ColumnarStorageRead(Relation rel, uint64 logicalOffset,
 								char *data, uint32 amount);
+extern void ColumnarStorageReadExtended(Relation rel, uint64 logicalOffset,
+										char *data, uint32 amount,
+										BufferAccessStrategy strategy);
+extern bool ColumnarStorageReadsAsync(Relation rel);
+extern void ColumnarStorageReadRanges(Relation rel, ColumnarStorageRange *ranges,
+									  uint32 rangeCount, BufferAccessStrategy strategy);
+extern uint32 ColumnarStoragePrefetch(Relation rel, uint64 logicalOffset,
+									  uint64 amount);
 extern void ColumnarStorageWrite(Relation rel, uint64 logicalOffset,
 								 char *data, uint32 amount);
+extern void ColumnarStorageWriteBuffers(Relation rel, uint64 logicalOffset,
+										StringInfo *buffers, uint32 bufferCount);
+extern void ColumnarStorageLogChange(Relation rel, RmgrId rmid, uint8 info,
+									 char *mainData, uint32 mainLength,
+									 char *blockData, uint32 blockLength);
 extern bool ColumnarStorageTruncate(Relation rel, uint64 newDataReservation);
+extern uint64 ColumnarStorageOffload(Relation rel, uint64 logicalOffset,
+									 uint64 amount);
+
+extern void ColumnarStorageSyncExtents(void);
+extern void ColumnarStorageForgetExtents(void);
+
+extern void ColumnarStorageBeginCostDelay(double costDelay, int costLimit);
+extern void ColumnarStorageEndCostDelay(void);
 
 #endif /* COLUMNAR_STORAGE_H */
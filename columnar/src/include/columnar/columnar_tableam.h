@@ -7,6 +7,8 @@
 #include "access/tableam.h"
 #include "access/skey.h"
 #include "nodes/bitmapset.h"
+#include "nodes/execnodes.h"
+#include "nodes/nodes.h"
 #include "access/heapam.h"
 #include "catalog/indexing.h"
 #include "utils/acl.h"
@@ -59,9 +61,51 @@ extern TableScanDesc columnar_beginscan_extended(Relation relation, Snapshot sna
 												 List *scanQual,
 												 ParallelColumnarScan parallelColumnarScan,
 												 bool returnVectorResult);
+extern void ColumnarScanSetVectorQual(ColumnarScanDesc columnarScanDesc,
+									  List *stageColumnLists,
+									  ColumnarVectorQualFunc qualFunc,
+									  void *qualState);
+extern void ColumnarScanSetRowBound(ColumnarScanDesc columnarScanDesc,
+									uint64 rowBound);
+extern void ColumnarScanSetChunkGroupSummary(ColumnarScanDesc columnarScanDesc,
+											 ChunkGroupSummary *summary);
+extern void ColumnarScanSetChunkGroupDelete(ColumnarScanDesc columnarScanDesc,
+											ColumnarChunkGroupDelete *chunkGroupDelete);
+extern void ColumnarScanSetMergeRead(ColumnarScanDesc columnarScanDesc,
+									 AttrNumber sortKeyColumn);
+extern void ColumnarScanSetStripeProjectionSummary(ColumnarScanDesc columnarScanDesc,
+												   StripeProjectionSummary *summary);
+extern void ColumnarScanSetTopNBound(ColumnarScanDesc columnarScanDesc,
+									 ColumnarTopNBound *bound);
+extern void ColumnarScanSetJoinKeyFilter(ColumnarScanDesc columnarScanDesc,
+										 ColumnarJoinKeyFilter *filter);
+extern void ColumnarScanAddQual(ColumnarScanDesc columnarScanDesc, List *clauseList);
 extern int64 ColumnarScanChunkGroupsFiltered(ColumnarScanDesc columnarScanDesc);
+extern const ColumnarReadStatistics * ColumnarScanGetStatistics(
+	ColumnarScanDesc columnarScanDesc);
+extern void ColumnarSetIndexFetchProjection(TupleTableSlot *slot, Bitmapset *attrNeeded,
+											MemoryContext queryContext);
+extern void ColumnarSetUpdateFetchProjection(ResultRelInfo *resultRelInfo,
+											 Bitmapset *attrNeeded,
+											 MemoryContext queryContext);
 extern bool ColumnarSupportsIndexAM(char *indexAMName);
 extern bool IsColumnarTableAmTable(Oid relationId);
+extern void ColumnarLockStorageForRowChange(uint64 storageId);
+
+/* columnar_replication.c */
+extern bool ColumnarLogicalChangesLogged(Relation rel, CmdType operation);
+extern void ColumnarCheckLogicalReplication(Relation rel);
+extern void ColumnarLogLogicalInsert(Relation rel, ItemPointer tid, Datum *values,
+									 bool *nulls);
+extern void ColumnarLogLogicalMultiInsert(Relation rel, Datum **columnValues,
+										  bool **columnNulls, uint64 *rowNumbers,
+										  int rowCount);
+extern void ColumnarLogLogicalDelete(Relation rel, ItemPointer tid, Datum *oldValues,
+									 bool *oldNulls);
+extern void ColumnarLogLogicalUpdate(Relation rel, ItemPointer oldTid,
+									 Datum *oldValues, bool *oldNulls,
+									 ItemPointer newTid, Datum *newValues,
+									 bool *newNulls);
 
 
 #endif /* COLUMNAR_TABLEAM_H */
@@ -0,0 +1,91 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_trace.h
+ *
+ * Wait events and static trace probes of the hot paths of columnar.
+ *
+ * Extensions can't register wait events of their own before PostgreSQL 17,
+ * so the events below are reported in the Extension class and show up as
+ * wait_event Extension in pg_stat_activity. columnar.wait_events() names them
+ * per backend. A wait the code waits on meanwhile, like DataFileRead while
+ * a block is read, replaces the event until it is done.
+ *
+ * The COLUMNAR_TRACE_* probes compile to USDT probes of provider columnar
+ * when PostgreSQL is built with --enable-dtrace, and to nothing otherwise, so
+ * they can be attached to with bpftrace, like
+ *
+ *	bpftrace -e 'usdt:columnar.so:columnar:decompress__start { ... }'
+ *
+ * Copyright (c) Hydra, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_TRACE_H
+#define COLUMNAR_TRACE_H
+
+#include "postgres.h"
+
+#include "pgstat.h"
+
+#ifdef ENABLE_DTRACE
+#include <sys/sdt.h>
+#endif
+
+/* the event ids of columnar in the Extension wait event class */
+#define COLUMNAR_WAIT_EVENT_BASE (PG_WAIT_EXTENSION | 0x0C00)
+
+typedef enum ColumnarWaitEvent
+{
+	WAIT_EVENT_COLUMNAR_STORAGE_READ = COLUMNAR_WAIT_EVENT_BASE + 1,
+	WAIT_EVENT_COLUMNAR_STORAGE_WRITE,
+	WAIT_EVENT_COLUMNAR_DECOMPRESS,
+	WAIT_EVENT_COLUMNAR_SKIP_LIST_READ,
+	WAIT_EVENT_COLUMNAR_ROW_MASK_READ,
+	WAIT_EVENT_COLUMNAR_STRIPE_FLUSH,
+	WAIT_EVENT_COLUMNAR_LAST = WAIT_EVENT_COLUMNAR_STRIPE_FLUSH
+} ColumnarWaitEvent;
+
+#ifdef ENABLE_DTRACE
+#define COLUMNAR_TRACE_STORAGE_READ_START(relid, offset, amount) \
+	DTRACE_PROBE3(columnar, storage__read__start, relid, offset, amount)
+#define COLUMNAR_TRACE_STORAGE_READ_DONE(relid, offset, amount) \
+	DTRACE_PROBE3(columnar, storage__read__done, relid, offset, amount)
+#define COLUMNAR_TRACE_STORAGE_WRITE_START(relid, offset, amount) \
+	DTRACE_PROBE3(columnar, storage__write__start, relid, offset, amount)
+#define COLUMNAR_TRACE_STORAGE_WRITE_DONE(relid, offset, amount) \
+	DTRACE_PROBE3(columnar, storage__write__done, relid, offset, amount)
+#define COLUMNAR_TRACE_DECOMPRESS_START(type, compressed, decompressed) \
+	DTRACE_PROBE3(columnar, decompress__start, type, compressed, decompressed)
+#define COLUMNAR_TRACE_DECOMPRESS_DONE(type, compressed, decompressed) \
+	DTRACE_PROBE3(columnar, decompress__done, type, compressed, decompressed)
+#define COLUMNAR_TRACE_SKIP_LIST_READ_START(relfilenode, stripe) \
+	DTRACE_PROBE2(columnar, skip__list__read__start, relfilenode, stripe)
+#define COLUMNAR_TRACE_SKIP_LIST_READ_DONE(relfilenode, stripe) \
+	DTRACE_PROBE2(columnar, skip__list__read__done, relfilenode, stripe)
+#define COLUMNAR_TRACE_ROW_MASK_READ_START(relfilenode, firstRowNumber) \
+	DTRACE_PROBE2(columnar, row__mask__read__start, relfilenode, firstRowNumber)
+#define COLUMNAR_TRACE_ROW_MASK_READ_DONE(relfilenode, firstRowNumber, count) \
+	DTRACE_PROBE3(columnar, row__mask__read__done, relfilenode, firstRowNumber, count)
+#define COLUMNAR_TRACE_STRIPE_FLUSH_START(relid, rows) \
+	DTRACE_PROBE2(columnar, stripe__flush__start, relid, rows)
+#define COLUMNAR_TRACE_STRIPE_FLUSH_DONE(relid, stripe, bytes) \
+	DTRACE_PROBE3(columnar, stripe__flush__done, relid, stripe, bytes)
+#else
+#define COLUMNAR_TRACE_STORAGE_READ_START(relid, offset, amount)
+#define COLUMNAR_TRACE_STORAGE_READ_DONE(relid, offset, amount)
+#define COLUMNAR_TRACE_STORAGE_WRITE_START(relid, offset, amount)
+#define COLUMNAR_TRACE_STORAGE_WRITE_DONE(relid, offset, amount)
+#define COLUMNAR_TRACE_DECOMPRESS_START(type, compressed, decompressed)
+#define COLUMNAR_TRACE_DECOMPRESS_DONE(type, compressed, decompressed)
+#define COLUMNAR_TRACE_SKIP_LIST_READ_START(relfilenode, stripe)
+#define COLUMNAR_TRACE_SKIP_LIST_READ_DONE(relfilenode, stripe)
+#define COLUMNAR_TRACE_ROW_MASK_READ_START(relfilenode, firstRowNumber)
+#define COLUMNAR_TRACE_ROW_MASK_READ_DONE(relfilenode, firstRowNumber, count)
+#define COLUMNAR_TRACE_STRIPE_FLUSH_START(relid, rows)
+#define COLUMNAR_TRACE_STRIPE_FLUSH_DONE(relid, stripe, bytes)
+#endif
+
+extern const char * ColumnarWaitEventName(uint32 waitEventInfo);
+
+#endif /* COLUMNAR_TRACE_H */
@@ -37,6 +37,16 @@
 	index_insert(a, b, c, d, e, f, h)
 #endif
 
+#if PG_VERSION_NUM >= PG_VERSION_15
+#define shm_mq_send_compat(a, b, c, d, e) shm_mq_send(a, b, c, d, e)
+#define parse_analyze_fixedparams_compat(a, b, c, d, e) \
+	parse_analyze_fixedparams(a, b, c, d, e)
+#else
+#define shm_mq_send_compat(a, b, c, d, e) shm_mq_send(a, b, c, d)
+#define parse_analyze_fixedparams_compat(a, b, c, d, e) \
+	parse_analyze(a, b, c, d, e)
+#endif
+
 #define ACLCHECK_OBJECT_TABLE OBJECT_TABLE
 
 #define ExplainPropertyLong(qlabel, value, es) \
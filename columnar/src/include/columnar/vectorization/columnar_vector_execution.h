@@ -16,12 +16,45 @@
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
 
+#include "columnar/vectorization/columnar_vector_types.h"
+
 extern bool CheckOpExprArgumentRules(List *args);
+extern bool IsVectorizableValueType(Oid typeOid);
+extern bool IsBinaryEqualityType(Oid typeOid);
+extern bool IsVectorizableValueExpr(Node *node);
+extern Node * CreateVectorizedValueExpr(Node *node);
+extern Node * CreateVectorizedFuncExpr(Node *node);
 extern bool GetVectorizedProcedureOid(Oid procedureOid, Oid *vectorizedProcedureOid);
 extern List * CreateVectorizedExprList(List *exprList);
+extern const char * VectorizedQualFallbackReason(Node *node);
 extern List * ConstructVectorizedQualList(TupleTableSlot *slot, List *vectorizedQual);
+extern VectorQual * ConstructVectorizedFuncExpr(TupleTableSlot *slot, Node *node);
+extern VectorColumn * ExecuteVectorizedFuncExpr(VectorQual *vectorQual);
 extern bool * ExecuteVectorizedQual(TupleTableSlot *slot,
 									List *vectorizedQualList,
 									BoolExprType boolType);
 
+/*
+ * VectorQualPipeline evaluates the vectorized quals of a scan one at a time,
+ * so the reader only fills the columns of the next qual for vectors that
+ * still have rows passing the quals before it.
+ */
+typedef struct VectorQualPipeline
+{
+	TupleTableSlot *slot;
+
+	/* lists with the constructed qual of each stage */
+	List *stageQualLists;
+
+	/* integer lists of the attribute numbers each stage reads */
+	List *stageColumnLists;
+
+	/* rows that passed the stages evaluated so far */
+	bool *selected;
+} VectorQualPipeline;
+
+extern VectorQualPipeline * BuildVectorQualPipeline(TupleTableSlot *slot,
+													List *vectorizedQual);
+extern uint32 ExecuteVectorQualStage(void *pipelineState, int stage, uint32 vectorSize);
+
 #endif
\ No newline at end of file
@@ -19,8 +19,20 @@
 #include "nodes/bitmapset.h"
 #include "nodes/primnodes.h"
 
-/* DEFAULT_CHUNK_ROW_COUNT */
+/*
+ * Limits of columnar.vector_size, the number of rows of vectors. The maximum
+ * is DEFAULT_CHUNK_ROW_COUNT.
+ */
 #define COLUMNAR_VECTOR_COLUMN_SIZE 10000
+#define COLUMNAR_MIN_VECTOR_COLUMN_SIZE 64
+
+/*
+ * The values and null flags of vectors start on a cache line, and their
+ * sizes are rounded up to whole cache lines, so SIMD kernels can load the
+ * last rows with full width loads.
+ */
+#define COLUMNAR_VECTOR_ALIGNMENT 64
+#define VECTOR_BUFFER_SIZE(size) TYPEALIGN(COLUMNAR_VECTOR_ALIGNMENT, (size))
 
 typedef struct VectorTupleTableSlot
 {
@@ -28,28 +40,84 @@ typedef struct VectorTupleTableSlot
 	TupleTableSlot tts;
 	/* How many tuples does this slot contain */ 
 	uint32 dimension;
-	/* Keep array to represent filtered tuples */
-	bool keep[COLUMNAR_VECTOR_COLUMN_SIZE];
+	/* How many tuples can this slot contain */
+	uint32 capacity;
+	/*
+	 * Set if a qual filtered the tuples. Then only the selectionCount tuples
+	 * whose indexes are in selection, in ascending order, passed it.
+	 */
+	bool hasSelection;
+	uint32 selectionCount;
+	uint32 *selection;
 	/* Row Number */
-	uint64 rowNumber[COLUMNAR_VECTOR_COLUMN_SIZE];
+	uint64 *rowNumber;
 } VectorTupleTableSlot;
 
+/* index of the nth tuple of the slot that passed the quals */
+#define VectorSlotSelectedRow(slot, n) \
+	((slot)->hasSelection ? (slot)->selection[(n)] : (n))
+
+/* number of tuples of the slot that passed the quals */
+#define VectorSlotSelectedCount(slot) \
+	((slot)->hasSelection ? (slot)->selectionCount : (slot)->dimension)
+
 extern TupleTableSlot * CreateVectorTupleTableSlot(TupleDesc tupleDesc);
+extern TupleTableSlot * CreateProjectedVectorTupleTableSlot(TupleDesc tupleDesc,
+																   Bitmapset *columns);
+extern void SetVectorSlotSelection(VectorTupleTableSlot *vectorSlot, bool *qualResult);
 
 typedef struct VectorColumn
 {
 	uint32	dimension;
+	/* number of rows value and isnull have room for */
+	uint32	capacity;
 	uint16	columnTypeLen;
 	bool 	columnIsVal;
 	Datum	*value;
-	bool	isnull[COLUMNAR_VECTOR_COLUMN_SIZE];
+	bool	*isnull;
+	/*
+	 * Allocation that value and isnull are in, which is freed with the
+	 * column, or NULL when they are part of the arena of a vector slot.
+	 */
+	char	*buffer;
 	uint64	*rowNumber;
+	/*
+	 * Set if the rows were read from an encoded chunk. Then rows are grouped
+	 * in runCount runs of rows with equal values and null flags, and
+	 * runLength has the number of rows of each run.
+	 */
+	bool	hasRuns;
+	uint32	runCount;
+	uint32	*runLength;
+	/*
+	 * Set if no row is NULL, for vectors read from chunks whose skip nodes
+	 * say so, so that aggregates don't have to look at isnull.
+	 */
+	bool	noNulls;
 } VectorColumn;
 
-extern VectorColumn * BuildVectorColumn(int16 columnDimension,
+/*
+ * foreach_vector_run iterates over the runs of a vector column which has
+ * runs. position is the first row of the run and length its number of rows.
+ */
+#define foreach_vector_run(column, position, length) \
+	for (uint32 _runIndex = 0, position = 0, length = 0; \
+		 _runIndex < (column)->runCount && \
+		 ((length) = (column)->runLength[_runIndex], true); \
+		 (position) += (length), _runIndex++)
+
+extern VectorColumn * BuildVectorColumn(uint32 columnCapacity,
 										int16 columnTypeLen,
 										bool columnIsVal,
 										uint64 *rowNumber);
+extern VectorColumn * ReserveVectorColumn(VectorColumn *column, uint32 dimension,
+										  int16 typeLen, MemoryContext memoryContext);
+extern VectorColumn * VectorFnResultColumn(FunctionCallInfo fcinfo, uint32 dimension,
+										   int16 resultTypeLen);
+extern VectorColumn * BuildArithmeticResultColumn(FunctionCallInfo fcinfo,
+												  int16 resultTypeLen,
+												  VectorColumn **left,
+												  VectorColumn **right);
 extern void ExtractTupleFromVectorSlot(TupleTableSlot *out, 
 									   VectorTupleTableSlot *vectorSlot, 
 									   int32 index,
@@ -58,11 +126,19 @@ extern void WriteTupleToVectorSlot(TupleTableSlot *in,
 								   VectorTupleTableSlot *vectorSlot,
 								   int32 index);
 extern void CleanupVectorSlot(VectorTupleTableSlot *vectorSlot);
+extern void ExtendVectorColumnRuns(VectorColumn *vectorColumn);
+extern void ResetVectorColumnRuns(VectorColumn *vectorColumn);
+extern void CopyVectorColumnRuns(VectorColumn *target, VectorColumn *source);
+extern void ClearVectorColumn(VectorColumn *vectorColumn);
 
 typedef enum VectorQualType
 {
 	VECTOR_QUAL_BOOL_EXPR,
-	VECTOR_QUAL_EXPR
+	VECTOR_QUAL_EXPR,
+	VECTOR_QUAL_NULL_TEST,
+	VECTOR_QUAL_BOOLEAN_TEST,
+	VECTOR_QUAL_IN_LIST,
+	VECTOR_QUAL_VALUE_EXPR
 } VectorQualTypeEnum;
 
 
@@ -80,6 +156,75 @@ typedef struct VectorFnArgument
 } VectorFnArgument;
 
 
+/*
+ * VectorValue is an operand of a vectorized CASE, COALESCE or NULLIF, which
+ * is a vector or a constant of the type of the expression.
+ */
+typedef struct VectorValue
+{
+	/* NULL for constants */
+	VectorColumn *column;
+	Datum constValue;
+	bool constIsNull;
+	/* CASE, COALESCE or NULLIF that computes column, evaluated first */
+	struct VectorQual *valueQual;
+} VectorValue;
+
+
+/*
+ * Rows of each tile of a fused expression, which its steps compute one
+ * after the other, so the values they pass on stay in the cache.
+ */
+#define FUSED_VECTOR_TILE_ROWS 256
+
+/* operands a fused expression may have, constants and steps together */
+#define FUSED_VECTOR_MAX_OPERANDS 32
+
+/*
+ * Computes count rows of a step of a fused expression into result, and
+ * returns whether a row that isn't null overflowed.
+ */
+typedef bool (*FusedVectorKernel) (const void *left, const void *right,
+								   const bool *isnull, void *result, int count);
+
+/*
+ * FusedVectorOperand is a column of the vector slot, or NULL for constants
+ * and the results of steps, whose tile is at scratchIndex in the scratch
+ * buffer of the expression.
+ */
+typedef struct FusedVectorOperand
+{
+	VectorColumn *column;
+	int scratchIndex;
+} FusedVectorOperand;
+
+typedef struct FusedVectorStep
+{
+	FusedVectorKernel kernel;
+	FusedVectorOperand left;
+	FusedVectorOperand right;
+	int scratchIndex;
+} FusedVectorStep;
+
+/*
+ * FusedVectorExpr is a tree of bigint or float8 arithmetic operators over
+ * columns and constants, flattened into steps that are computed a tile of
+ * rows at a time, the last one into the result of the expression.
+ */
+typedef struct FusedVectorExpr
+{
+	int stepCount;
+	FusedVectorStep *steps;
+	/* columns the rows of the result are NULL for when they are */
+	int columnCount;
+	VectorColumn **columns;
+	/* a tile for each constant and step, constants filled in once */
+	char *scratch;
+	/* type name of the overflow errors of the steps */
+	const char *typeName;
+} FusedVectorExpr;
+
+
 typedef struct VectorQual
 {
 	VectorQualTypeEnum vectorQualType;
@@ -90,13 +235,72 @@ typedef struct VectorQual
 			FmgrInfo *fmgrInfo;
 			FunctionCallInfo fcInfo;
 			VectorFnArgument *vectorFnArguments;
+			/* CASE, COALESCE, NULLIF or function call arguments, evaluated first */
+			List *argumentQualList;
+			/* argument of the enclosing call that a function call argument sets */
+			VectorFnArgument *outputArgument;
+			/*
+			 * Set if the procedure is strict and a constant argument is NULL,
+			 * then every row of the result is NULL and it isn't called.
+			 * resultTypeLen is the length of the values of the result.
+			 */
+			bool nullResult;
+			int16 resultTypeLen;
+			/* set if the call is computed as a fused expression instead */
+			FusedVectorExpr *fusedExpr;
 		} expr;
 		struct
 		{
 			BoolExprType boolExprType;
 			List *vectorQualExprList;
+			/* vectors evaluated since the children were last reordered */
+			uint32 vectorCount;
+			/* rows AND or OR left undecided, that IN lists are matched for */
+			uint32 *undecidedRows;
 		} boolExpr;
+		struct
+		{
+			VectorColumn *column;
+			NullTestType nullTestType;
+		} nullTest;
+		struct
+		{
+			VectorColumn *column;
+			BoolTestType booleanTestType;
+		} booleanTest;
+		struct
+		{
+			VectorColumn *column;
+			/* IN (...) if set, otherwise NOT IN (...) */
+			bool useOr;
+			bool hasNull;
+			/* sorted distinct values, as read from vectors of their length */
+			int valueCount;
+			int64 *values;
+		} inList;
+		struct
+		{
+			/* T_CaseExpr, T_CoalesceExpr or T_NullIfExpr */
+			NodeTag valueExprType;
+			TupleTableSlot *slot;
+			/* quals of the WHEN clauses of CASE, a list for each */
+			List *conditionList;
+			/* results of the WHEN clauses then ELSE, or the arguments */
+			int valueCount;
+			VectorValue *values;
+			/* evaluated as a qual, so NULL rows are false in the result */
+			bool isQual;
+		} valueExpr;
 	} u;
+	/* result of quals other than expressions, reused for each vector */
+	VectorColumn *result;
+	/*
+	 * Rows the qual was evaluated on as a child of AND or OR, the rows it was
+	 * true for, and the seconds it took, which AND and OR order them by.
+	 */
+	uint64 evaluatedRows;
+	uint64 trueRows;
+	double evaluationTime;
 } VectorQual;
 
 #endif
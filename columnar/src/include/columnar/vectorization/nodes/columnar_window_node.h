@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_window_node.h
+ *	Custom scan method for window functions
+ *
+ * IDENTIFICATION
+ *	src/backend/columnar/vectorization/nodes/columnar_window_node.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+
+#ifndef COLUMNAR_WINDOW_NODE_H
+#define COLUMNAR_WINDOW_NODE_H
+
+#include "postgres.h"
+
+#include "nodes/plannodes.h"
+
+/* largest lag, lead or frame offset the vector window node keeps rows for */
+#define VECTOR_WINDOW_MAX_OFFSET 10000
+
+extern CustomScan *columnar_create_window_node(void);
+extern void columnar_register_window_node(void);
+
+#endif
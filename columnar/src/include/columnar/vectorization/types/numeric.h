@@ -14,6 +14,32 @@
 #include "postgres.h"
 
 #include "utils/numeric.h"
+
+/*
+ * NumericInt128Sum adds up numerics as an integer of NBASE digits, with
+ * fractionDigits of them after the decimal point.
+ */
+typedef struct NumericInt128Sum
+{
+	int64		N;				/* count of added values */
+	int128		sumX;			/* sum times NBASE ^ fractionDigits */
+	int			fractionDigits;	/* NBASE digits after the decimal point */
+	int			dscale;			/* largest display scale of the values */
+} NumericInt128Sum;
+
+/*
+ * The leading fields of the NumericAggState of numeric.c, which is the
+ * transition state of sum(numeric) and avg(numeric).
+ */
+typedef struct NumericAggStateHead
+{
+	bool		calcSumX2;		/* if true, calculate sumX2 */
+	MemoryContext agg_context;	/* context we're calculating in */
+	int64		N;				/* count of processed numbers */
+} NumericAggStateHead;
+
 extern Numeric int128_to_numeric(int128 val);
+extern bool numeric_int128_sum_add(NumericInt128Sum *sum, Datum value, int64 count);
+extern Numeric numeric_int128_sum_result(NumericInt128Sum *sum);
 
 #endif
\ No newline at end of file
@@ -14,36 +14,86 @@
 
 #include "postgres.h"
 
+#include "common/int.h"
+
 #include "columnar/vectorization/columnar_vector_types.h"
 
-#define _BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE, OPSYM, OPSTR)				\
-PG_FUNCTION_INFO_V1(v##FNAME##OPSTR);										\
-Datum v##FNAME##OPSTR(PG_FUNCTION_ARGS) 									\
+/*
+ * The comparison loops have no branches, so that the compiler vectorizes
+ * them; the files that use them are compiled with CFLAGS_VECTORIZE. Where
+ * the compiler supports function multiversioning, the loops are also built
+ * for AVX2 and the variant the CPU supports is picked when they are loaded.
+ */
+#if defined(__x86_64__) && defined(__linux__) && \
+	((defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6) || \
+	 (defined(__clang__) && __clang_major__ >= 14))
+#define COLUMNAR_VECTOR_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define COLUMNAR_VECTOR_KERNEL
+#endif
+
+#define _BUILD_CMP_KERNEL(NAME, VTYPE, CTYPE, EXPR)							\
+static COLUMNAR_VECTOR_KERNEL void											\
+NAME(const VTYPE *vectorValue, const bool *vectorNull, CTYPE constValue,	\
+	 bool *resIdx, int dimension)											\
+{																			\
+	/* bools are 0 or 1, as bytes the compiler can vectorize their logic */	\
+	const uint8 *nullBytes = (const uint8 *) vectorNull;					\
+	uint8 *resultBytes = (uint8 *) resIdx;									\
+																			\
+	for (int i = 0; i < dimension; i++)										\
+	{																		\
+		resultBytes[i] = (uint8) ((nullBytes[i] ^ 1) & (EXPR));				\
+	}																		\
+}
+
+#define _BUILD_CMP_OP(FNAME, OPSTR, SUFFIX, LTYPE, LGET, LCONV,				\
+					  RTYPE, RGET, RCONV, CMP)								\
+_BUILD_CMP_KERNEL(v##FNAME##OPSTR##SUFFIX##VarConst, LTYPE, RTYPE,			\
+				  CMP(LCONV(vectorValue[i]), RCONV(constValue)))			\
+_BUILD_CMP_KERNEL(v##FNAME##OPSTR##SUFFIX##ConstVar, RTYPE, LTYPE,			\
+				  CMP(LCONV(constValue), RCONV(vectorValue[i])))			\
+PG_FUNCTION_INFO_V1(v##FNAME##OPSTR##SUFFIX);								\
+Datum v##FNAME##OPSTR##SUFFIX(PG_FUNCTION_ARGS)								\
 {																			\
 	VectorFnArgument *left = (VectorFnArgument *) PG_GETARG_POINTER(0);		\
 	VectorFnArgument *right = (VectorFnArgument *) PG_GETARG_POINTER(1);	\
 																			\
 	VectorColumn *vectorColumn = NULL;										\
 	VectorColumn *res = NULL;												\
-	int i = 0;																\
 																			\
 	if (left->type == VECTOR_FN_ARG_VAR &&									\
 		right->type == VECTOR_FN_ARG_CONSTANT)								\
 	{																		\
 		vectorColumn = (VectorColumn*) left->arg;							\
-		RTYPE constValue = right->arg;										\
+		RTYPE constValue = RGET(RTYPE, right->arg);							\
 																			\
-		res = BuildVectorColumn(vectorColumn->dimension, 1, true, NULL);	\
+		res = VectorFnResultColumn(fcinfo, vectorColumn->dimension,			\
+										   1);								\
 																			\
 		LTYPE *vectorValue = (LTYPE *) vectorColumn->value;					\
 		bool *vectorNull = (bool *) vectorColumn->isnull;					\
 		bool *resIdx = (bool *) res->value;									\
 		bool *resNull = (bool *) res->isnull;								\
 																			\
-		for (i = 0; i < vectorColumn->dimension; i++)						\
+		/* compare once per run of equal values */							\
+		if (vectorColumn->hasRuns)											\
 		{																	\
-			resNull[i] = vectorNull[i];										\
-			resIdx[i] = !vectorNull[i] && vectorValue[i] OPSYM constValue;	\
+			foreach_vector_run(vectorColumn, position, length)				\
+			{																\
+				bool result = !vectorNull[position] &&						\
+							  CMP(LCONV(vectorValue[position]),				\
+								  RCONV(constValue));						\
+				memset(resNull + position, vectorNull[position], length);	\
+				memset(resIdx + position, result, length);					\
+			}																\
+		}																	\
+		else																\
+		{																	\
+			memcpy(resNull, vectorNull, vectorColumn->dimension);			\
+			v##FNAME##OPSTR##SUFFIX##VarConst(vectorValue, vectorNull,		\
+											  constValue, resIdx,			\
+											  vectorColumn->dimension);		\
 		}																	\
 																			\
 		res->dimension = vectorColumn->dimension;							\
@@ -52,19 +102,34 @@ Datum v##FNAME##OPSTR(PG_FUNCTION_ARGS) 									\
 			 right->type == VECTOR_FN_ARG_VAR)								\
 	{																		\
 		vectorColumn = (VectorColumn*) right->arg;							\
-		LTYPE constValue = left->arg;										\
+		LTYPE constValue = LGET(LTYPE, left->arg);							\
 																			\
-		res = BuildVectorColumn(vectorColumn->dimension, 1, true, NULL);	\
+		res = VectorFnResultColumn(fcinfo, vectorColumn->dimension,			\
+										   1);								\
 																			\
 		RTYPE *vectorValue = (RTYPE *) vectorColumn->value;					\
 		bool *vectorNull = (bool *) vectorColumn->isnull;					\
 		bool *resIdx = (bool *) res->value;									\
 		bool *resNull = (bool *) res->isnull;								\
 																			\
-		for (i = 0; i < vectorColumn->dimension; i++)						\
+		/* compare once per run of equal values */							\
+		if (vectorColumn->hasRuns)											\
+		{																	\
+			foreach_vector_run(vectorColumn, position, length)				\
+			{																\
+				bool result = !vectorNull[position] &&						\
+							  CMP(LCONV(constValue),						\
+								  RCONV(vectorValue[position]));			\
+				memset(resNull + position, vectorNull[position], length);	\
+				memset(resIdx + position, result, length);					\
+			}																\
+		}																	\
+		else																\
 		{																	\
-			resNull[i] = vectorNull[i];										\
-			resIdx[i] = !vectorNull[i] && vectorValue[i] OPSYM constValue;	\
+			memcpy(resNull, vectorNull, vectorColumn->dimension);			\
+			v##FNAME##OPSTR##SUFFIX##ConstVar(vectorValue, vectorNull,		\
+											  constValue, resIdx,			\
+											  vectorColumn->dimension);		\
 		}																	\
 																			\
 		res->dimension = vectorColumn->dimension;							\
@@ -77,14 +142,217 @@ Datum v##FNAME##OPSTR(PG_FUNCTION_ARGS) 									\
 	PG_RETURN_POINTER(res);													\
 }																			\
 
-#define BUILD_CMP_OPERATOR_INT(FNAME, LTYPE, RTYPE)		\
-	_BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE, ==, eq)		\
-	_BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE, !=, ne)		\
-	_BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE,  >, gt)		\
-	_BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE,  <, lt)		\
-	_BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE, <=, le)		\
-	_BUILD_CMP_OP_INT(FNAME, LTYPE, RTYPE, >=, ge)		\
+/* how constants are read from their datum, and how values are compared */
+#define _DATUM_CAST(TYPE, datum) ((TYPE) (datum))
+#define _DATUM_FLOAT4(TYPE, datum) DatumGetFloat4(datum)
+#define _DATUM_FLOAT8(TYPE, datum) DatumGetFloat8(datum)
+
+#define _NO_CONVERSION(value) (value)
+
+#define _CMP_eq(left, right) ((left) == (right))
+#define _CMP_ne(left, right) ((left) != (right))
+#define _CMP_gt(left, right) ((left) > (right))
+#define _CMP_lt(left, right) ((left) < (right))
+#define _CMP_le(left, right) ((left) <= (right))
+#define _CMP_ge(left, right) ((left) >= (right))
+
+#define _BUILD_CMP_OPERATORS(FNAME, SUFFIX, LTYPE, LGET, LCONV,				\
+							 RTYPE, RGET, RCONV, CMP)						\
+	_BUILD_CMP_OP(FNAME, eq, SUFFIX, LTYPE, LGET, LCONV,					\
+				  RTYPE, RGET, RCONV, CMP##eq)								\
+	_BUILD_CMP_OP(FNAME, ne, SUFFIX, LTYPE, LGET, LCONV,					\
+				  RTYPE, RGET, RCONV, CMP##ne)								\
+	_BUILD_CMP_OP(FNAME, gt, SUFFIX, LTYPE, LGET, LCONV,					\
+				  RTYPE, RGET, RCONV, CMP##gt)								\
+	_BUILD_CMP_OP(FNAME, lt, SUFFIX, LTYPE, LGET, LCONV,					\
+				  RTYPE, RGET, RCONV, CMP##lt)								\
+	_BUILD_CMP_OP(FNAME, le, SUFFIX, LTYPE, LGET, LCONV,					\
+				  RTYPE, RGET, RCONV, CMP##le)								\
+	_BUILD_CMP_OP(FNAME, ge, SUFFIX, LTYPE, LGET, LCONV,					\
+				  RTYPE, RGET, RCONV, CMP##ge)								\
+
+#define BUILD_CMP_OPERATOR_INT(FNAME, LTYPE, RTYPE)							\
+	_BUILD_CMP_OPERATORS(FNAME, , LTYPE, _DATUM_CAST, _NO_CONVERSION,		\
+						 RTYPE, _DATUM_CAST, _NO_CONVERSION, _CMP_)			\
+
+/*
+ * Floats compare with the float4_/float8_ functions of utils/float.h, which
+ * order NaN above all other values and equal to itself, like the btree
+ * operators do. CMPTYPE is the type both sides are compared as.
+ */
+#define BUILD_CMP_OPERATOR_FLOAT(FNAME, LTYPE, LGET, RTYPE, RGET, CMPTYPE)	\
+	_BUILD_CMP_OPERATORS(FNAME, , LTYPE, LGET, _NO_CONVERSION,				\
+						 RTYPE, RGET, _NO_CONVERSION, CMPTYPE##_)			\
+
+/*
+ * Cross-type operators named v<FNAME><op><SUFFIX>, such as
+ * vtimestamp_lt_date, whose values are converted to a common type by LCONV
+ * and RCONV before they are compared.
+ */
+#define BUILD_CMP_OPERATOR_CONVERTED(FNAME, SUFFIX, LTYPE, LCONV, RTYPE, RCONV) \
+	_BUILD_CMP_OPERATORS(FNAME, SUFFIX, LTYPE, _DATUM_CAST, LCONV,			\
+						 RTYPE, _DATUM_CAST, RCONV, _CMP_)					\
+
+/*
+ * Arithmetic operators are called from aggregate arguments, whose
+ * expressions are evaluated like any others. Arguments that aren't constants
+ * (or parameters) are the vectors of columns or of other operators, and the
+ * result is a vector too, NULL where an argument is NULL. The loops compute
+ * null rows too, so that they have no branches, and only count an overflow
+ * of a row that isn't null.
+ */
+#define _BUILD_ARITHMETIC_KERNEL(NAME, LTYPE, RTYPE, RESTYPE, LEXPR, REXPR, STEP) \
+static COLUMNAR_VECTOR_KERNEL bool											\
+NAME(const LTYPE *leftValue, LTYPE leftConst,								\
+	 const RTYPE *rightValue, RTYPE rightConst,								\
+	 const bool *vectorNull, RESTYPE *result, int dimension)				\
+{																			\
+	const uint8 *nullBytes = (const uint8 *) vectorNull;					\
+	uint8 overflow = 0;														\
+																			\
+	for (int i = 0; i < dimension; i++)										\
+	{																		\
+		uint8 rowOverflow = STEP((RESTYPE) (LEXPR), (RESTYPE) (REXPR),		\
+								 vectorNull[i], &result[i]);				\
+		overflow |= rowOverflow & (nullBytes[i] ^ 1);						\
+	}																		\
+																			\
+	return overflow != 0;													\
+}
+
+#define _BUILD_ARITHMETIC_OP(FNAME, OPSTR, LTYPE, LGET, RTYPE, RGET,		\
+							 RESTYPE, STEP, TYPENAME)						\
+_BUILD_ARITHMETIC_KERNEL(v##FNAME##OPSTR##VarVar, LTYPE, RTYPE, RESTYPE,	\
+						 leftValue[i], rightValue[i], STEP)					\
+_BUILD_ARITHMETIC_KERNEL(v##FNAME##OPSTR##VarConst, LTYPE, RTYPE, RESTYPE,	\
+						 leftValue[i], rightConst, STEP)					\
+_BUILD_ARITHMETIC_KERNEL(v##FNAME##OPSTR##ConstVar, LTYPE, RTYPE, RESTYPE,	\
+						 leftConst, rightValue[i], STEP)					\
+PG_FUNCTION_INFO_V1(v##FNAME##OPSTR);										\
+Datum v##FNAME##OPSTR(PG_FUNCTION_ARGS)										\
+{																			\
+	VectorColumn *left = NULL;												\
+	VectorColumn *right = NULL;												\
+	VectorColumn *res = BuildArithmeticResultColumn(fcinfo, sizeof(RESTYPE),	\
+													&left, &right);			\
+																			\
+	LTYPE leftConst = (left != NULL || PG_ARGISNULL(0)) ? 0 :				\
+		LGET(LTYPE, PG_GETARG_DATUM(0));									\
+	RTYPE rightConst = (right != NULL || PG_ARGISNULL(1)) ? 0 :			\
+		RGET(RTYPE, PG_GETARG_DATUM(1));									\
+	const LTYPE *leftValue = left ? (const LTYPE *) left->value : NULL;		\
+	const RTYPE *rightValue = right ? (const RTYPE *) right->value : NULL;	\
+	bool overflow;															\
+																			\
+	if (left != NULL && right != NULL)										\
+		overflow = v##FNAME##OPSTR##VarVar(leftValue, leftConst,			\
+										   rightValue, rightConst,			\
+										   res->isnull, (RESTYPE *) res->value, \
+										   res->dimension);					\
+	else if (left != NULL)													\
+		overflow = v##FNAME##OPSTR##VarConst(leftValue, leftConst,			\
+											 rightValue, rightConst,		\
+											 res->isnull,					\
+											 (RESTYPE *) res->value,		\
+											 res->dimension);				\
+	else																	\
+		overflow = v##FNAME##OPSTR##ConstVar(leftValue, leftConst,			\
+											 rightValue, rightConst,		\
+											 res->isnull,					\
+											 (RESTYPE *) res->value,		\
+											 res->dimension);				\
+																			\
+	if (overflow)															\
+		ereport(ERROR,														\
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),				\
+				 errmsg(TYPENAME " out of range")));						\
+																			\
+	PG_RETURN_POINTER(res);													\
+}
 
+/*
+ * Integer steps return whether the row overflowed, like the overflow checks
+ * of common/int.h. Division reports a division by zero itself, so it skips
+ * null rows, whose values may be anything.
+ */
+#define _BUILD_INT_DIV(BITS)												\
+static inline bool															\
+_int##BITS##_div(int##BITS left, int##BITS right, bool isnull,				\
+				 int##BITS *result)											\
+{																			\
+	*result = 0;															\
+	if (isnull)																\
+		return false;														\
+																			\
+	if (right == 0)															\
+		ereport(ERROR,														\
+				(errcode(ERRCODE_DIVISION_BY_ZERO),							\
+				 errmsg("division by zero")));								\
+																			\
+	/* the minimum value divided by -1 doesn't fit, like its negation */	\
+	if (right == -1)														\
+		return pg_sub_s##BITS##_overflow(0, left, result);					\
+																			\
+	*result = left / right;													\
+	return false;															\
+}
+
+_BUILD_INT_DIV(16)
+_BUILD_INT_DIV(32)
+_BUILD_INT_DIV(64)
+
+#define _int16_add(left, right, isnull, result) pg_add_s16_overflow(left, right, result)
+#define _int16_sub(left, right, isnull, result) pg_sub_s16_overflow(left, right, result)
+#define _int16_mul(left, right, isnull, result) pg_mul_s16_overflow(left, right, result)
+#define _int32_add(left, right, isnull, result) pg_add_s32_overflow(left, right, result)
+#define _int32_sub(left, right, isnull, result) pg_sub_s32_overflow(left, right, result)
+#define _int32_mul(left, right, isnull, result) pg_mul_s32_overflow(left, right, result)
+#define _int64_add(left, right, isnull, result) pg_add_s64_overflow(left, right, result)
+#define _int64_sub(left, right, isnull, result) pg_sub_s64_overflow(left, right, result)
+#define _int64_mul(left, right, isnull, result) pg_mul_s64_overflow(left, right, result)
+
+/*
+ * Integer operators v<FNAME>pl, mi, mul and div, computed in RESTYPE of BITS
+ * bits.
+ */
+#define BUILD_ARITHMETIC_OPERATOR_INT(FNAME, LTYPE, RTYPE, RESTYPE, BITS, TYPENAME) \
+	_BUILD_ARITHMETIC_OP(FNAME, pl, LTYPE, _DATUM_CAST, RTYPE, _DATUM_CAST,	\
+						 RESTYPE, _int##BITS##_add, TYPENAME)				\
+	_BUILD_ARITHMETIC_OP(FNAME, mi, LTYPE, _DATUM_CAST, RTYPE, _DATUM_CAST,	\
+						 RESTYPE, _int##BITS##_sub, TYPENAME)				\
+	_BUILD_ARITHMETIC_OP(FNAME, mul, LTYPE, _DATUM_CAST, RTYPE, _DATUM_CAST, \
+						 RESTYPE, _int##BITS##_mul, TYPENAME)				\
+	_BUILD_ARITHMETIC_OP(FNAME, div, LTYPE, _DATUM_CAST, RTYPE, _DATUM_CAST, \
+						 RESTYPE, _int##BITS##_div, TYPENAME)				\
+
+/*
+ * Float steps use the functions of utils/float.h, which report overflows,
+ * underflows and divisions by zero themselves, so null rows are skipped.
+ */
+#define _FLOAT_STEP(left, right, isnull, result, FUNC)						\
+	((*(result) = (isnull) ? 0 : FUNC(left, right)), false)
+
+#define _float4_add(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float4_pl)
+#define _float4_sub(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float4_mi)
+#define _float4_mul(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float4_mul)
+#define _float4_div(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float4_div)
+#define _float8_add(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float8_pl)
+#define _float8_sub(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float8_mi)
+#define _float8_mul(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float8_mul)
+#define _float8_div(left, right, isnull, result) _FLOAT_STEP(left, right, isnull, result, float8_div)
+
+/*
+ * Float operators v<FNAME>pl, mi, mul and div, computed in RESTYPE.
+ */
+#define BUILD_ARITHMETIC_OPERATOR_FLOAT(FNAME, LTYPE, LGET, RTYPE, RGET, RESTYPE) \
+	_BUILD_ARITHMETIC_OP(FNAME, pl, LTYPE, LGET, RTYPE, RGET,				\
+						 RESTYPE, _##RESTYPE##_add, #RESTYPE)				\
+	_BUILD_ARITHMETIC_OP(FNAME, mi, LTYPE, LGET, RTYPE, RGET,				\
+						 RESTYPE, _##RESTYPE##_sub, #RESTYPE)				\
+	_BUILD_ARITHMETIC_OP(FNAME, mul, LTYPE, LGET, RTYPE, RGET,				\
+						 RESTYPE, _##RESTYPE##_mul, #RESTYPE)				\
+	_BUILD_ARITHMETIC_OP(FNAME, div, LTYPE, LGET, RTYPE, RGET,				\
+						 RESTYPE, _##RESTYPE##_div, #RESTYPE)				\
 
 typedef struct Int128AggState
 {
@@ -100,5 +368,19 @@ typedef struct Int64AggState
 	int64		sumX;			/* sum of processed numbers */
 } Int64AggState;
 
+/* operators that nested arithmetic is fused for */
+extern Datum vint8pl(PG_FUNCTION_ARGS);
+extern Datum vint8mi(PG_FUNCTION_ARGS);
+extern Datum vint8mul(PG_FUNCTION_ARGS);
+extern Datum vint8div(PG_FUNCTION_ARGS);
+extern Datum vfloat8pl(PG_FUNCTION_ARGS);
+extern Datum vfloat8mi(PG_FUNCTION_ARGS);
+extern Datum vfloat8mul(PG_FUNCTION_ARGS);
+extern Datum vfloat8div(PG_FUNCTION_ARGS);
+
+extern Datum VectorApproxCountDistinctAddSketch(Datum stateDatum, bool stateIsNull,
+												MemoryContext aggContext, bool isVarlena,
+												const uint8 *registers);
+
 #endif
 
@@ -39,6 +39,8 @@
 #define AlterTableStmtObjType_compat(a) ((a)->relkind)
 #define F_NEXTVAL F_NEXTVAL_OID
 #define ROLE_PG_MONITOR DEFAULT_ROLE_MONITOR
+#define ROLE_PG_READ_ALL_STATS DEFAULT_ROLE_READ_ALL_STATS
+#define ROLE_PG_READ_SERVER_FILES DEFAULT_ROLE_READ_SERVER_FILES
 #define PROC_WAIT_STATUS_WAITING STATUS_WAITING
 #define getObjectTypeDescription_compat(a, b) getObjectTypeDescription(a)
 #define getObjectIdentity_compat(a, b) getObjectIdentity(a)
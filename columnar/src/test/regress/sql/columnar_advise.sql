@@ -0,0 +1,44 @@
+--
+-- Test columnar.column_profile and columnar.advise
+--
+SET columnar.compression TO 'none';
+SET columnar.chunk_group_row_limit TO 1000;
+SET columnar.stripe_row_limit TO 10000;
+CREATE TABLE t_advise(a int, b int, c text) USING columnar;
+RESET columnar.stripe_row_limit;
+RESET columnar.chunk_group_row_limit;
+RESET columnar.compression;
+
+INSERT INTO t_advise
+SELECT i, 7, CASE WHEN i % 4 <> 0 THEN md5(i::text) END
+FROM generate_series(1, 30000) i;
+
+SELECT attname, null_frac, sorted_frac, clustered_frac, compression,
+       distinct_frac > 0.9 AS unique_chunks, distinct_frac < 0.01 AS constant_chunks,
+       stored_bytes = none_bytes AS stored_uncompressed,
+       least(lz4_bytes, zstd_bytes) < stored_bytes AS compressible
+FROM columnar.column_profile('t_advise') ORDER BY attname;
+
+-- a single stripe is scaled up to the whole table
+SELECT attname, stored_bytes > 0 AS has_bytes
+FROM columnar.column_profile('t_advise', sample_stripes => 1) ORDER BY attname;
+
+-- uncompressed columns that compress well get a compression
+SELECT attname, current_value, recommended_value <> 'none' AS compressed,
+       estimated_bytes < current_bytes AS smaller, reason IS NOT NULL AS has_reason
+FROM columnar.advise('t_advise') WHERE option = 'compression' ORDER BY attname;
+
+-- once compressed, leaving the columns uncompressed isn't advised
+SELECT columnar.alter_columnar_table_set('t_advise', compression => 'zstd');
+SELECT columnar.recompress('t_advise', 'zstd');
+SELECT count(*) FROM columnar.advise('t_advise')
+WHERE option = 'compression' AND recommended_value = 'none';
+
+SELECT columnar.advise('t_advise', sample_stripes => 0);
+
+CREATE TABLE t_advise_heap(a int);
+SELECT columnar.advise('t_advise_heap');
+SELECT columnar.column_profile('t_advise_heap');
+DROP TABLE t_advise_heap;
+
+DROP TABLE t_advise;
@@ -102,7 +102,7 @@ EXPLAIN (verbose, costs off, timing off, summary off) SELECT COUNT(1) FROM t_mix
 
 -- Vectorized aggregate with DISTINCT not supported.
 
-EXPLAIN (verbose, costs off, timing off, summary off) SELECT COUNT(DISTINCT a) FROM t_mixed;
+EXPLAIN (verbose, costs off, timing off, summary off) SELECT SUM(DISTINCT a) FROM t_mixed;
 
 -- github#145
 -- Vectorized aggregate doesn't accept function as argument
@@ -112,7 +112,7 @@ EXPLAIN (verbose, costs off, timing off, summary off) SELECT SUM(length(b::text)
 DROP TABLE t_mixed;
 
 -- github#180
--- Vectorized aggregate does't accept filter on columns
+-- Vectorized aggregates apply FILTER as a mask of their argument
 
 CREATE TABLE t_filter(a INT) USING columnar;
 
@@ -122,6 +122,357 @@ EXPLAIN (verbose, costs off, timing off, summary off) SELECT COUNT(a) FILTER (WH
 
 SELECT COUNT(a) FILTER (WHERE a > 90) FROM t_filter;
 
+SELECT COUNT(*) FILTER (WHERE a > 10 AND a <= 20), SUM(a) FILTER (WHERE a < 5 OR a = 100), MAX(a) FILTER (WHERE a < 50) FROM t_filter;
+
+-- filters other than comparisons aren't vectorized
+EXPLAIN (verbose, costs off, timing off, summary off) SELECT COUNT(a) FILTER (WHERE a IS NULL) FROM t_filter;
+
+DROP TABLE t_filter;
+
+SET client_min_messages TO default;
+
+-- EXPLAIN (VERBOSE) shows why quals are not vectorized
+CREATE TABLE t_fallback(a int, b text) USING columnar;
+INSERT INTO t_fallback VALUES (1, 'one'), (2, 'two');
+EXPLAIN (verbose, costs off, timing off, summary off) SELECT a FROM t_fallback WHERE btrim(b) = 'one';
+DROP TABLE t_fallback;
+
+-- float4 and float8 comparisons and aggregates
+CREATE TABLE t_float(a float4, b float8) USING columnar;
+INSERT INTO t_float SELECT g, g / 2.0 FROM GENERATE_SERIES(1, 1000) g;
+INSERT INTO t_float VALUES (NULL, NULL);
+SELECT sum(a), avg(a), min(a), max(a), sum(b), avg(b), min(b), max(b) FROM t_float;
+-- NaN sorts above all other values and equals itself
+INSERT INTO t_float VALUES ('NaN', 'NaN');
+SELECT min(a), max(a), min(b), max(b) FROM t_float;
+SELECT count(*) FROM t_float WHERE b = 'NaN';
+SELECT count(*) FROM t_float WHERE b > 499;
+SELECT count(*) FROM t_float WHERE a < 'NaN'::float8;
+-- no rows give NULL
+SELECT sum(a), avg(a), min(a), max(b) FROM t_float WHERE b < 0;
+DROP TABLE t_float;
+
+-- timestamp and timestamptz comparisons, also with dates, and min/max
+CREATE TABLE t_timestamp(a timestamp, b timestamptz) USING columnar;
+INSERT INTO t_timestamp SELECT '2023-01-01'::timestamp + g * interval '1 hour',
+  '2023-01-01'::timestamptz + g * interval '1 hour' FROM GENERATE_SERIES(0, 999) g;
+SELECT count(*) FROM t_timestamp WHERE a >= '2023-01-10';
+SELECT count(*) FROM t_timestamp WHERE a < '2023-01-10'::date;
+SELECT count(*) FROM t_timestamp WHERE '2023-01-10'::date <= a;
+SELECT count(*) FROM t_timestamp WHERE b < '2023-01-10';
+SELECT count(*) FROM t_timestamp WHERE b >= '2023-01-10'::date;
+SELECT count(*) FROM t_timestamp WHERE a > 'infinity'::date;
+SELECT min(a), max(a) FROM t_timestamp;
+SELECT min(b) = '2023-01-01'::timestamptz, max(b) = '2023-02-11 15:00'::timestamptz FROM t_timestamp;
+SELECT max(a), min(b) FROM t_timestamp WHERE a < '2000-01-01';
+-- date_trunc and date_part are vectorized in quals and group keys
+SELECT count(*) FROM t_timestamp WHERE date_trunc('day', a) = '2023-01-05';
+SELECT count(*) FROM t_timestamp WHERE date_part('hour', a) = 12;
+SELECT count(*) FROM t_timestamp WHERE date_trunc('day', b) >= '2023-02-01';
+SELECT date_trunc('week', a) AS week, count(*) FROM t_timestamp GROUP BY week ORDER BY week;
+DROP TABLE t_timestamp;
+
+-- numeric sums are added up as int128 within a vector
+CREATE TABLE t_numeric(a numeric) USING columnar;
+INSERT INTO t_numeric SELECT g * 0.01 FROM GENERATE_SERIES(1, 10000) g;
+INSERT INTO t_numeric VALUES (NULL);
+SELECT sum(a), round(avg(a), 6), count(a) FROM t_numeric;
+INSERT INTO t_numeric SELECT 1.5 FROM GENERATE_SERIES(1, 5000) g;
+INSERT INTO t_numeric SELECT g * -0.5 FROM GENERATE_SERIES(1, 100) g;
+SELECT sum(a), round(avg(a), 6), count(a) FROM t_numeric;
+-- values too large for the int128 sum, and NaN, are added one by one
+INSERT INTO t_numeric VALUES (123456789012345678901234567890123456789.5);
+SELECT sum(a) FROM t_numeric;
+INSERT INTO t_numeric VALUES ('NaN');
+SELECT sum(a), avg(a) FROM t_numeric;
+SELECT sum(a), avg(a) FROM t_numeric WHERE a < -1000;
+DROP TABLE t_numeric;
+
+-- hashed GROUP BY aggregates each group of rows of a vector together
+CREATE TABLE t_group(a int, b bigint, d bool) USING columnar;
+INSERT INTO t_group SELECT g % 5, g, g % 2 = 0 FROM GENERATE_SERIES(1, 25000) g;
+INSERT INTO t_group VALUES (NULL, 1, NULL), (NULL, 2, true);
+SELECT a, count(*), count(b), sum(b), min(b), max(b) FROM t_group GROUP BY a ORDER BY a;
+SELECT a, d, count(*), sum(b) FROM t_group GROUP BY a, d HAVING sum(b) > 30000000 ORDER BY a, d;
+SELECT a, count(*), max(b) FROM t_group WHERE b > 24990 GROUP BY a ORDER BY a;
+DROP TABLE t_group;
+
+-- rows in runs of equal group keys
+CREATE TABLE t_group_runs(a int, b int) USING columnar;
+INSERT INTO t_group_runs SELECT g / 3000, g FROM GENERATE_SERIES(0, 20999) g;
+INSERT INTO t_group_runs SELECT g % 7, g FROM GENERATE_SERIES(0, 699) g;
+SELECT a, count(*), sum(b), min(b), max(b) FROM t_group_runs GROUP BY a ORDER BY a;
+-- DISTINCT and GROUP BY without aggregates only add groups
+SELECT DISTINCT a FROM t_group_runs ORDER BY a;
+SELECT a FROM t_group_runs WHERE b % 2 = 0 GROUP BY a ORDER BY a;
+DROP TABLE t_group_runs;
+
+-- arithmetic in aggregate arguments is computed on vectors
+CREATE TABLE t_arith(a int, b bigint, c float8) USING columnar;
+INSERT INTO t_arith SELECT g, g * 2, g / 4.0 FROM GENERATE_SERIES(1, 20000) g;
+INSERT INTO t_arith VALUES (NULL, 1, 1), (1, NULL, NULL);
+SELECT sum(a + b), sum(a * 2), sum(b - a), max(b / a), min(c * 2), sum(a * b) FROM t_arith;
+SELECT sum((a + 1) * (b - 1)), count(a - b), avg(c / 4) FROM t_arith WHERE a > 19990;
+-- nested bigint and float8 arithmetic is fused
+SELECT sum(b * 3 - b / 2 + 7), sum(c * 2 + c * c - 1), sum(b * b * b) FROM t_arith;
+SET columnar.enable_fused_vector_expressions TO false;
+SELECT sum(b * 3 - b / 2 + 7), sum(c * 2 + c * c - 1), sum(b * b * b) FROM t_arith;
+RESET columnar.enable_fused_vector_expressions;
+SET max_parallel_workers_per_gather = 0;
+SELECT sum(a * 200000) FROM t_arith;
+SELECT sum(b / (a - a)) FROM t_arith;
+SELECT sum(b * b * b * b * b) FROM t_arith;
+RESET max_parallel_workers_per_gather;
+DROP TABLE t_arith;
+
+-- IN lists, NULL tests, boolean tests and NOT in quals are vectorized
+CREATE TABLE t_filter(a int, b bigint, d bool) USING columnar;
+INSERT INTO t_filter SELECT g % 100, g, CASE WHEN g % 3 = 0 THEN NULL ELSE g % 3 = 1 END FROM GENERATE_SERIES(1, 20000) g;
+INSERT INTO t_filter VALUES (NULL, NULL, NULL);
+SELECT count(*) FROM t_filter WHERE a IN (1, 5, 7);
+SELECT count(*) FROM t_filter WHERE a NOT IN (1, 5, 7);
+SELECT count(*) FROM t_filter WHERE a IN (1, NULL);
+SELECT count(*) FROM t_filter WHERE a NOT IN (1, NULL);
+SELECT count(*) FROM t_filter WHERE a = ANY('{0,3,6,9,12,15,18,21,24,27,30,33,36,39,42,45,48,51,54,57,60,60,3}'::int[]);
+SELECT count(*) FROM t_filter WHERE a <> ALL('{0,3,6,9,12,15,18,21,24,27,30,33,36,39,42,45,48,51,54,57,60,60,3}'::int[]);
+SELECT count(*) FROM t_filter WHERE a IS NULL;
+SELECT count(*) FROM t_filter WHERE a IS NOT NULL;
+SELECT count(*) FROM t_filter WHERE d;
+SELECT count(*) FROM t_filter WHERE NOT d;
+SELECT count(*) FROM t_filter WHERE d IS NOT TRUE;
+SELECT count(*) FROM t_filter WHERE d IS UNKNOWN;
+SELECT count(*) FROM t_filter WHERE NOT (a > 50);
+SELECT count(*) FROM t_filter WHERE NOT (a IN (1, 5, 7));
+SELECT count(*) FROM t_filter WHERE a IN (1, 2) AND d IS NOT NULL;
+SELECT count(*) FROM t_filter WHERE a IS NULL OR b IN (5, 10);
 DROP TABLE t_filter;
 
-SET client_min_messages TO default;
\ No newline at end of file
+-- count(DISTINCT) keeps the values in a hash set, min and max of text compare each distinct datum once
+CREATE TABLE t_distinct(a int, b text, c bigint) USING columnar;
+INSERT INTO t_distinct SELECT g % 1000, 'user_' || (g % 300), g FROM GENERATE_SERIES(1, 100000) g;
+INSERT INTO t_distinct VALUES (NULL, NULL, NULL);
+SELECT count(DISTINCT a), count(DISTINCT b), count(DISTINCT c), min(b), max(b), count(*) FROM t_distinct;
+SELECT count(DISTINCT a), min(b), max(b) FROM t_distinct WHERE a < 10;
+SELECT count(DISTINCT b), min(b) FROM t_distinct WHERE a IS NULL;
+SET columnar.enable_approximate_count_distinct TO true;
+SELECT count(DISTINCT a), count(DISTINCT c) FROM t_distinct;
+RESET columnar.enable_approximate_count_distinct;
+DROP TABLE t_distinct;
+
+-- vectors smaller than chunk groups, with rows of the chunk groups deleted
+CREATE TABLE t_vector_size(a int, b bigint) USING columnar;
+INSERT INTO t_vector_size SELECT g % 100, g FROM GENERATE_SERIES(1, 25000) g;
+DELETE FROM t_vector_size WHERE b % 7 = 0;
+SET columnar.vector_size TO 1000;
+SELECT count(*), sum(b) FROM t_vector_size;
+SELECT count(*), sum(b) FROM t_vector_size WHERE a < 10;
+SELECT a, b FROM t_vector_size WHERE a = 1 AND b > 24700;
+RESET columnar.vector_size;
+DROP TABLE t_vector_size;
+
+-- fixed length values of plain encoded chunks are copied into vectors as they are stored
+SET columnar.enable_dictionary_encoding TO false;
+SET columnar.enable_run_length_encoding TO false;
+SET columnar.enable_bit_packing TO false;
+CREATE TABLE t_packed(a int, b bigint) USING columnar;
+INSERT INTO t_packed SELECT CASE WHEN g % 5 = 0 THEN NULL ELSE g % 1000 END, g FROM GENERATE_SERIES(1, 30000) g;
+DELETE FROM t_packed WHERE b % 11 = 0;
+RESET columnar.enable_dictionary_encoding;
+RESET columnar.enable_run_length_encoding;
+RESET columnar.enable_bit_packing;
+SELECT count(*), count(a), sum(a), sum(b) FROM t_packed;
+SELECT count(*), sum(b) FROM t_packed WHERE a < 100;
+SELECT a, b FROM t_packed WHERE b > 29990;
+SET columnar.vector_size TO 4096;
+SELECT count(*), count(a), sum(a), sum(b) FROM t_packed;
+RESET columnar.vector_size;
+DROP TABLE t_packed;
+
+-- vectors of chunks without NULL rows are aggregated without reading their null flags
+CREATE TABLE t_no_nulls(a int, b bigint, c smallint, d timestamp) USING columnar;
+INSERT INTO t_no_nulls SELECT g % 1000, g, g % 100, '2023-01-01'::timestamp + g * interval '1 minute' FROM GENERATE_SERIES(1, 20000) g;
+INSERT INTO t_no_nulls VALUES (NULL, NULL, NULL, NULL), (5000, -5, -3, NULL);
+SELECT count(a), sum(a), min(a), max(a), sum(b), min(b), max(b), sum(c), min(c), max(c), min(d), max(d) FROM t_no_nulls;
+DROP TABLE t_no_nulls;
+
+-- params of prepared statements and of subplans are vectorized quals
+CREATE TABLE t_param(a int, b text) USING columnar;
+INSERT INTO t_param SELECT g % 100, 'v' || (g % 7) FROM GENERATE_SERIES(1, 10000) g;
+SET plan_cache_mode TO force_generic_plan;
+PREPARE p_param(int, text) AS SELECT count(*) FROM t_param WHERE a < $1 AND b = $2;
+EXECUTE p_param(10, 'v3');
+EXECUTE p_param(NULL, 'v3');
+EXECUTE p_param(10, NULL);
+DEALLOCATE p_param;
+RESET plan_cache_mode;
+SELECT v.x, (SELECT count(*) FROM t_param WHERE a < v.x) FROM (VALUES (1), (50)) v(x);
+DROP TABLE t_param;
+
+-- AND and OR skip children once the rows are decided, in an adaptive order
+CREATE TABLE t_bool(a int, b int, c int) USING columnar;
+INSERT INTO t_bool SELECT g, g % 1000, CASE WHEN g % 3 = 0 THEN NULL ELSE g % 10 END FROM GENERATE_SERIES(1, 300000) g;
+SELECT count(*) FROM t_bool WHERE (b < 900 AND a > 250000 AND c IN (1, 2, 5, 8)) OR a = 1;
+SELECT count(*) FROM t_bool WHERE a < 1000 OR b = 7 OR c NOT IN (1, 2);
+SELECT count(*) FROM t_bool WHERE b >= 0 OR c IN (1, 2);
+SELECT count(*) FROM t_bool WHERE ((a > 290000 OR b = 999) AND c IN (4, 7)) OR a < 0;
+DROP TABLE t_bool;
+
+-- vectorized aggregates and quals on the columnar side of joins
+CREATE TABLE t_fact(k int, v bigint) USING columnar;
+INSERT INTO t_fact SELECT g % 10, g FROM GENERATE_SERIES(1, 50000) g;
+CREATE TABLE t_dim(k int, name text);
+INSERT INTO t_dim SELECT g, 'k' || g FROM GENERATE_SERIES(0, 9) g;
+SELECT d.name, f.total FROM t_dim d JOIN (SELECT k, sum(v) AS total FROM t_fact GROUP BY k) f ON f.k = d.k ORDER BY d.name;
+SELECT count(*) FROM t_dim d WHERE d.k < (SELECT max(k) FROM t_fact WHERE v > 100);
+SET enable_hashjoin TO false;
+SET enable_mergejoin TO false;
+SELECT count(*), sum(f.v) FROM t_dim d JOIN t_fact f ON f.k = d.k WHERE f.v > 49000;
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+DROP TABLE t_fact, t_dim;
+
+-- partial vector aggregates below a Gather, also when a nested loop rescans them
+CREATE TABLE t_parallel(k int, v bigint, n numeric, f float8) USING columnar;
+INSERT INTO t_parallel SELECT g % 10, g, g, g / 4.0 FROM GENERATE_SERIES(1, 300000) g;
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SELECT k, count(*), sum(v), round(avg(v), 2), sum(n), avg(f) FROM t_parallel GROUP BY k ORDER BY k;
+SET enable_hashjoin TO false;
+SET enable_mergejoin TO false;
+SET enable_material TO false;
+SELECT d.g, s.c, s.total FROM GENERATE_SERIES(1, 3) d(g), (SELECT count(*) AS c, sum(v) AS total FROM t_parallel WHERE k < 5) s ORDER BY d.g;
+SELECT d.g, s.c FROM GENERATE_SERIES(1, 2) d(g), (SELECT k, count(*) AS c FROM t_parallel GROUP BY k) s WHERE s.k = d.g ORDER BY d.g;
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET enable_material;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+DROP TABLE t_parallel;
+
+-- the chunk groups of the last stripes are split between the participants
+CREATE TABLE t_one_stripe(v bigint) USING columnar;
+INSERT INTO t_one_stripe SELECT g FROM GENERATE_SERIES(1, 150000) g;
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SELECT count(*), sum(v), min(v), max(v) FROM t_one_stripe;
+SELECT count(*) FROM t_one_stripe WHERE v > 140000;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+DROP TABLE t_one_stripe;
+
+-- vectorized quals are evaluated while reading, one column at a time
+CREATE TABLE t_stage(a int, b bigint, c text) USING columnar;
+INSERT INTO t_stage SELECT g / 10000, g, 'v' || g FROM GENERATE_SERIES(1, 50000) g;
+SELECT count(*), sum(b), min(c) FROM t_stage WHERE a = 2 AND b > 25000;
+DELETE FROM t_stage WHERE b % 4 = 0;
+SELECT count(*), sum(b), min(c) FROM t_stage WHERE a = 2 AND b > 25000;
+SELECT columnar.alter_columnar_table_set('t_stage', delta_store => true);
+INSERT INTO t_stage VALUES (2, 60000, 'v60000'), (3, 60001, 'v60001');
+SELECT count(*), sum(b), min(c) FROM t_stage WHERE a = 2 AND b > 25000;
+SELECT count(*), sum(b), min(c) FROM t_stage WHERE a = 3 AND b > 60000;
+SELECT count(*), sum(b), min(c) FROM t_stage WHERE a = 4 AND b > 45000;
+SET columnar.vector_size TO 1000;
+SELECT count(*), sum(b), min(c) FROM t_stage WHERE b > 25000 AND a = 2;
+RESET columnar.vector_size;
+DROP TABLE t_stage;
+
+-- CASE, COALESCE and NULLIF in vectorized quals and aggregate arguments
+CREATE TABLE t_case(a int, b bigint, s text, f bool) USING columnar;
+INSERT INTO t_case SELECT CASE WHEN g % 7 = 0 THEN NULL ELSE g % 10 END, g, CASE g % 3 WHEN 0 THEN 'x' WHEN 1 THEN 'y' END, CASE WHEN g % 4 = 0 THEN NULL ELSE g % 2 = 0 END FROM GENERATE_SERIES(1, 20000) g;
+SELECT sum(CASE WHEN s = 'x' THEN b ELSE 0 END), sum(CASE WHEN a > 5 THEN 1 WHEN a > 2 THEN 2 END) FROM t_case;
+SELECT sum(COALESCE(a, 100)), sum(NULLIF(a, 3)), sum(COALESCE(a, 0) * b) FROM t_case;
+SELECT count(*) FROM t_case WHERE COALESCE(a, 0) > 5;
+SELECT count(*), sum(b) FROM t_case WHERE CASE WHEN s = 'x' THEN a WHEN s = 'y' THEN 0 END >= 4;
+SELECT count(*) FROM t_case WHERE COALESCE(f, false);
+SELECT count(*) FROM t_case WHERE NULLIF(a, 3) < 3;
+DROP TABLE t_case;
+
+-- count, min and max of chunk groups that the quals cover come from their statistics
+CREATE FUNCTION summarized_chunk_groups(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Chunk Groups Summarized' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+SET columnar.enable_parallel_execution TO false;
+SET columnar.chunk_group_row_limit TO 1000;
+CREATE TABLE t_summary(a int, b int, c text) USING columnar;
+INSERT INTO t_summary SELECT g, CASE WHEN g % 10 = 0 THEN NULL ELSE g % 100 END, 'c' || g FROM GENERATE_SERIES(1, 10000) g;
+RESET columnar.chunk_group_row_limit;
+SELECT count(*), count(b), min(a), max(a), min(b), max(b) FROM t_summary WHERE a > 2500;
+SELECT summarized_chunk_groups('SELECT count(*), count(b), min(a), max(a), min(b), max(b) FROM t_summary WHERE a > 2500');
+-- chunk groups with deleted rows are read
+DELETE FROM t_summary WHERE a = 5001;
+SELECT count(*), count(b), min(a), max(a), min(b), max(b) FROM t_summary WHERE a > 2500;
+SELECT summarized_chunk_groups('SELECT count(*), count(b), min(a), max(a), min(b), max(b) FROM t_summary WHERE a > 2500');
+SELECT count(*) FROM t_summary;
+SELECT summarized_chunk_groups('SELECT count(*) FROM t_summary');
+-- other aggregates, and quals on columns with NULLs, need the rows
+SELECT summarized_chunk_groups('SELECT count(*), sum(a) FROM t_summary WHERE a > 2500');
+SELECT summarized_chunk_groups('SELECT min(c) FROM t_summary WHERE a > 2500');
+SELECT count(*), max(a) FROM t_summary WHERE b > 0;
+SELECT summarized_chunk_groups('SELECT count(*), max(a) FROM t_summary WHERE b > 0');
+RESET columnar.enable_parallel_execution;
+DROP TABLE t_summary;
+DROP FUNCTION summarized_chunk_groups(text);
+-- aggregates over partitioned tables are vectorized for each partition
+CREATE FUNCTION vector_aggregate_nodes(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (costs off) ' || query LOOP
+        IF rec ~ 'VectorAggNode' THEN
+            result := result + 1;
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+SET max_parallel_workers_per_gather TO 0;
+CREATE TABLE t_part(a int, b int) PARTITION BY RANGE (a);
+CREATE TABLE t_part_1 PARTITION OF t_part FOR VALUES FROM (0) TO (50000) USING columnar;
+CREATE TABLE t_part_2 PARTITION OF t_part FOR VALUES FROM (50000) TO (100000) USING columnar;
+INSERT INTO t_part SELECT g, g % 10 FROM GENERATE_SERIES(0, 99999) g;
+ANALYZE t_part;
+SELECT count(*), sum(a), min(b), max(b) FROM t_part;
+SELECT vector_aggregate_nodes('SELECT count(*), sum(a), min(b), max(b) FROM t_part');
+SET columnar.enable_vectorization TO false;
+SELECT count(*), sum(a), min(b), max(b) FROM t_part;
+SELECT vector_aggregate_nodes('SELECT count(*), sum(a), min(b), max(b) FROM t_part');
+SET columnar.enable_vectorization TO default;
+RESET max_parallel_workers_per_gather;
+DROP TABLE t_part;
+-- aggregates under UNION ALL, subqueries and CTEs are vectorized on their own
+CREATE TABLE t_subquery(a int, b int) USING columnar;
+INSERT INTO t_subquery SELECT g, g % 10 FROM GENERATE_SERIES(1, 1000) g;
+SELECT count(*) FROM t_subquery UNION ALL SELECT sum(a) FROM t_subquery;
+SELECT vector_aggregate_nodes('SELECT count(*) FROM t_subquery UNION ALL SELECT sum(a) FROM t_subquery');
+SELECT s * 2 FROM (SELECT sum(a) s FROM t_subquery) q;
+SELECT vector_aggregate_nodes('SELECT s * 2 FROM (SELECT sum(a) s FROM t_subquery) q');
+WITH c AS MATERIALIZED (SELECT max(a) m FROM t_subquery) SELECT m FROM c;
+SELECT vector_aggregate_nodes('WITH c AS MATERIALIZED (SELECT max(a) m FROM t_subquery) SELECT m FROM c');
+SELECT count(*) FROM t_subquery WHERE a IN (SELECT max(b) FROM t_subquery);
+SELECT vector_aggregate_nodes('SELECT count(*) FROM t_subquery WHERE a IN (SELECT max(b) FROM t_subquery)');
+DROP TABLE t_subquery;
+-- hashed GROUP BY over more groups than fit in work_mem spills vectors
+CREATE TABLE t_spill(a int, b int, c text) USING columnar;
+INSERT INTO t_spill SELECT g % 50000, g, 'v' || (g % 7) FROM GENERATE_SERIES(1, 200000) g;
+ANALYZE t_spill;
+SET work_mem TO '256kB';
+SET enable_sort TO false;
+SET max_parallel_workers_per_gather TO 0;
+SELECT vector_aggregate_nodes('SELECT a, count(*), sum(b), count(c), max(b) FROM t_spill GROUP BY a');
+SELECT count(*), sum(cnt), sum(total), sum(texts), min(maxb) FROM (SELECT a, count(*) cnt, sum(b) total, count(c) texts, max(b) maxb FROM t_spill GROUP BY a) s;
+RESET max_parallel_workers_per_gather;
+RESET enable_sort;
+RESET work_mem;
+DROP TABLE t_spill;
+DROP FUNCTION vector_aggregate_nodes(text);
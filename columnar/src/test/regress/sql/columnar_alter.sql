@@ -223,6 +223,11 @@ INSERT INTO products VALUES (2, 'shampoo', 1);
 INSERT INTO products VALUES (2, 'shampoo', 20);
 ALTER TABLE products DROP CONSTRAINT dummy_constraint;
 INSERT INTO products VALUES (3, 'pen', 2);
+-- rows copied in are checked as well
+COPY products FROM STDIN WITH (FORMAT 'csv');
+4,pencil,3
+5,eraser,0
+\.
 SELECT * FROM products ORDER BY 1;
 
 -- Add a UNIQUE constraint
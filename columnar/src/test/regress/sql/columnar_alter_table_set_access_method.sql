@@ -230,4 +230,24 @@ SELECT COUNT(1) FROM pg_class WHERE relname = 't' AND relam = (SELECT oid FROM p
 SELECT columnar.alter_table_set_access_method('t', 'heap');
 SELECT COUNT(1) FROM pg_class WHERE relname = 't' AND relam = (SELECT oid FROM pg_am WHERE amname = 'heap');
 
-DROP TABLE t;
\ No newline at end of file
+DROP TABLE t;
+
+-- 10. Heap rows are copied straight into stripes
+
+CREATE TABLE heap_copy (a INT, dropped INT, b TEXT, c NUMERIC);
+ALTER TABLE heap_copy DROP COLUMN dropped;
+INSERT INTO heap_copy SELECT g, CASE WHEN g % 5 = 0 THEN NULL ELSE repeat('x', g % 3000) END, g * 1.5
+  FROM generate_series(1, 25000) g;
+CREATE INDEX heap_copy_a ON heap_copy (a);
+
+CREATE TABLE heap_copy_mismatch (a INT) USING columnar;
+SELECT columnar.copy_heap_rows('heap_copy', 'heap_copy_mismatch');
+DROP TABLE heap_copy_mismatch;
+
+SELECT columnar.alter_table_set_access_method('heap_copy', 'columnar');
+SELECT COUNT(*), SUM(a), SUM(length(b)), COUNT(b), SUM(c) FROM heap_copy;
+SELECT indexname FROM pg_indexes WHERE tablename = 'heap_copy';
+SET enable_seqscan TO off;
+SELECT a, length(b), c FROM heap_copy WHERE a = 12345;
+RESET enable_seqscan;
+DROP TABLE heap_copy;
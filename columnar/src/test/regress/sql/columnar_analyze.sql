@@ -16,4 +16,49 @@ INSERT INTO test_analyze SELECT floor(i / 1000), floor(i / 10)::text, 4 FROM gen
 INSERT INTO test_analyze SELECT floor(i / 2), floor(i / 10)::text, 5 FROM generate_series(1000, 110000) i;
 
 ANALYZE test_analyze;
+
+-- small tables have all of their chunk groups decoded, deleted ones are counted
+SELECT reltuples FROM pg_class WHERE relname = 'test_analyze';
+DELETE FROM test_analyze WHERE c = '4';
+ANALYZE test_analyze;
+SELECT reltuples FROM pg_class WHERE relname = 'test_analyze';
+SELECT n_distinct FROM pg_stats WHERE tablename = 'test_analyze' AND attname = 'c';
 DROP TABLE test_analyze;
+
+-- statistics derived from chunk metadata for columns that were never analyzed
+SET columnar.chunk_group_row_limit TO 1000;
+CREATE TABLE test_metadata_stats(a int, b int, c text) USING columnar;
+INSERT INTO test_metadata_stats
+  SELECT i, i % 10, CASE WHEN i % 2 = 0 THEN 'x' END FROM generate_series(1, 3000) i;
+RESET columnar.chunk_group_row_limit;
+
+SELECT attname, null_frac, round(n_distinct::numeric, 1) AS n_distinct,
+       histogram_bounds, correlation
+FROM columnar.metadata_statistics('test_metadata_stats') WHERE attname <> 'b';
+SELECT n_distinct BETWEEN 9 AND 11 FROM columnar.metadata_statistics('test_metadata_stats')
+WHERE attname = 'b';
+
+CREATE FUNCTION pg_temp.estimated_rows(query text) RETURNS int AS $$
+DECLARE
+  plan json;
+BEGIN
+  EXECUTE 'EXPLAIN (FORMAT JSON) ' || query INTO plan;
+  RETURN (plan->0->'Plan'->>'Plan Rows')::int;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT pg_temp.estimated_rows('SELECT * FROM test_metadata_stats WHERE a <= 1000');
+SET columnar.enable_metadata_statistics TO on;
+SELECT pg_temp.estimated_rows('SELECT * FROM test_metadata_stats WHERE a <= 1000') BETWEEN 500 AND 700;
+SELECT pg_temp.estimated_rows('SELECT * FROM test_metadata_stats WHERE c IS NULL');
+
+-- stripes written later are added to the cached statistics
+INSERT INTO test_metadata_stats SELECT i, 0, NULL FROM generate_series(3001, 6000) i;
+SELECT pg_temp.estimated_rows('SELECT * FROM test_metadata_stats WHERE c IS NULL');
+
+-- ANALYZE statistics are used again once they are recent
+ANALYZE test_metadata_stats;
+INSERT INTO test_metadata_stats SELECT i, 0, 'y' FROM generate_series(6001, 7000) i;
+SELECT pg_temp.estimated_rows('SELECT * FROM test_metadata_stats WHERE c IS NULL');
+RESET columnar.enable_metadata_statistics;
+DROP TABLE test_metadata_stats;
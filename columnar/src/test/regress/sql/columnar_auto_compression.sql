@@ -0,0 +1,49 @@
+SELECT columnar_test_helpers.compression_type_supported('lz4') AND
+       columnar_test_helpers.compression_type_supported('zstd') AS auto_supported \gset
+\if :auto_supported
+\else
+\q
+\endif
+
+CREATE SCHEMA am_auto_compression;
+SET search_path TO am_auto_compression;
+
+CREATE TABLE test_auto (a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('test_auto', compression => 'auto');
+SELECT compression FROM columnar.options WHERE regclass = 'test_auto'::regclass;
+
+INSERT INTO test_auto SELECT i, 'value ' || i FROM generate_series(1, 20000) i;
+
+-- compressible chunks get compressed with lz4 or zstd
+SELECT attr_num, value_compression_type IN (2, 3) AS compressed, count(*)
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_auto'::regclass)
+      AND attr_num = 2
+GROUP BY 1, 2 ORDER BY 1, 2;
+
+-- chunks that don't shrink enough are stored uncompressed
+SET columnar.auto_compression_min_gain TO 100;
+TRUNCATE test_auto;
+INSERT INTO test_auto SELECT i, 'value ' || i FROM generate_series(1, 20000) i;
+SELECT value_compression_type, count(*)
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_auto'::regclass)
+GROUP BY 1 ORDER BY 1;
+RESET columnar.auto_compression_min_gain;
+
+SELECT count(*), sum(a), count(DISTINCT b) FROM test_auto;
+
+-- auto can be set for single columns too
+SELECT columnar.alter_columnar_table_set('test_auto', compression => 'none',
+                                         column_compression => '{b=auto}');
+TRUNCATE test_auto;
+INSERT INTO test_auto SELECT i, 'value ' || i FROM generate_series(1, 20000) i;
+SELECT attr_num, value_compression_type IN (2, 3) AS compressed, count(*)
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_auto'::regclass)
+GROUP BY 1, 2 ORDER BY 1, 2;
+
+SELECT count(*), sum(a), count(DISTINCT b) FROM test_auto;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA am_auto_compression CASCADE;
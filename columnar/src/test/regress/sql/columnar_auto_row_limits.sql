@@ -0,0 +1,54 @@
+--
+-- Test auto_row_limits, which sizes stripes and chunk groups by row width
+--
+CREATE SCHEMA columnar_auto_row_limits;
+SET search_path TO columnar_auto_row_limits;
+
+-- keep the serialized widths of the values predictable
+SET columnar.enable_dictionary_encoding TO false;
+SET columnar.enable_bit_packing TO false;
+SET columnar.enable_run_length_encoding TO false;
+SET columnar.auto_chunk_size TO '16kB';
+SET columnar.auto_stripe_size TO '1MB';
+
+CREATE TABLE narrow (a int8) USING columnar;
+SELECT columnar.alter_columnar_table_set('narrow', auto_row_limits => true);
+SELECT regclass, chunk_group_row_limit, stripe_row_limit, auto_row_limits
+FROM columnar.options WHERE regclass = 'narrow'::regclass;
+
+-- 16kB of a bigint column is 2048 rows, rounded down to 2000
+INSERT INTO narrow SELECT g FROM generate_series(1, 10000) g;
+SELECT columnar_test_helpers.columnar_relation_storageid('narrow'::regclass) AS storage_id \gset
+SELECT chunk_row_count, row_count FROM columnar.stripe
+WHERE storage_id = :storage_id ORDER BY stripe_num;
+SELECT count(*), sum(a) FROM narrow;
+
+-- the first stripe is sized from the estimated width of text, the next ones
+-- from the 212 bytes a row took in the first stripe
+CREATE TABLE wide (id int8, payload text) USING columnar;
+SELECT columnar.alter_columnar_table_set('wide', auto_row_limits => true);
+INSERT INTO wide SELECT g, repeat('x', 200) FROM generate_series(1, 40000) g;
+SELECT columnar_test_helpers.columnar_relation_storageid('wide'::regclass) AS storage_id \gset
+SELECT chunk_row_count, row_count FROM columnar.stripe
+WHERE storage_id = :storage_id ORDER BY stripe_num;
+SELECT count(*), sum(id), sum(length(payload)) FROM wide;
+SELECT id, length(payload) FROM wide WHERE id IN (25999, 26000, 26001, 40000) ORDER BY id;
+
+-- resetting goes back to the fixed limits
+SELECT columnar.alter_columnar_table_reset('narrow', auto_row_limits => true);
+SELECT columnar.alter_columnar_table_set('narrow', chunk_group_row_limit => 1000,
+                                         stripe_row_limit => 5000);
+INSERT INTO narrow SELECT g FROM generate_series(1, 10000) g;
+SELECT columnar_test_helpers.columnar_relation_storageid('narrow'::regclass) AS storage_id \gset
+SELECT chunk_row_count, row_count FROM columnar.stripe
+WHERE storage_id = :storage_id ORDER BY stripe_num;
+SELECT regclass, auto_row_limits FROM columnar.options WHERE regclass = 'narrow'::regclass;
+
+-- the GUC sets the option of new tables
+SET columnar.auto_row_limits TO true;
+CREATE TABLE defaulted (a int) USING columnar;
+SELECT regclass, auto_row_limits FROM columnar.options WHERE regclass = 'defaulted'::regclass;
+RESET columnar.auto_row_limits;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_auto_row_limits CASCADE;
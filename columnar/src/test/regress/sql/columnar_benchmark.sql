@@ -0,0 +1,34 @@
+--
+-- Test the microbenchmark functions of columnar_test_helpers
+--
+
+SET search_path TO columnar_test_helpers, public;
+
+CREATE TABLE t_bench(a int, b bigint, c float8, d text) USING columnar;
+
+SELECT benchmark, runs, rows FROM benchmark_write('t_bench', 20000, 'random');
+SELECT count(*), count(DISTINCT a) <= 32767 AS in_range FROM t_bench;
+
+SELECT benchmark, runs, rows, bytes > 0 AS read, elapsed_ms >= 0 AS timed
+FROM benchmark_read('t_bench', false, 2);
+SELECT benchmark, runs, rows, bytes > 0 AS read
+FROM benchmark_read('t_bench', true, 2);
+
+SELECT benchmark, runs, rows, bytes
+FROM benchmark_codec('pglz', 'low_cardinality', 65536, 2);
+SELECT benchmark, runs, rows, bytes
+FROM benchmark_codec('none', 'random', 1000, 3);
+
+SELECT benchmark, runs, rows, bytes, rows_per_sec IS NULL OR rows_per_sec > 0 AS rate
+FROM benchmark_kernel('vint4gt(int4,int4)', 'sequential', 1000, 3);
+SELECT benchmark, runs, rows, bytes
+FROM benchmark_kernel('vfloat8le(float8,float8)', 'constant', 100, 2);
+
+-- invalid arguments
+SELECT * FROM benchmark_codec('pglz', 'zigzag');
+SELECT * FROM benchmark_codec('auto');
+SELECT * FROM benchmark_kernel('vtexteq(text,text)');
+SELECT * FROM benchmark_read('pg_class', false, 1);
+
+DROP TABLE t_bench;
+RESET search_path;
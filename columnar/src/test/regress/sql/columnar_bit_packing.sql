@@ -0,0 +1,45 @@
+CREATE SCHEMA columnar_bit_packing;
+SET search_path TO columnar_bit_packing;
+
+CREATE TABLE test_bit_packing (id int8, ts timestamptz, small int2, n int8) USING columnar;
+INSERT INTO test_bit_packing
+SELECT i, '2024-01-01 00:00:00+00'::timestamptz + i * interval '1 second',
+       (i % 100) - 50, CASE WHEN i % 10 = 0 THEN NULL ELSE i * 1000 END
+FROM generate_series(1, 20000) i;
+
+SELECT columnar_test_helpers.columnar_relation_storageid(oid) AS test_bit_packing_storage_id
+FROM pg_class WHERE relname = 'test_bit_packing' \gset
+
+SELECT DISTINCT attr_num, value_encoding_type FROM columnar.chunk
+WHERE storage_id = :test_bit_packing_storage_id ORDER BY attr_num;
+
+SELECT count(*), sum(id), min(id), max(id) FROM test_bit_packing;
+SELECT sum(small), min(small), max(small) FROM test_bit_packing;
+SELECT count(n), sum(n) FROM test_bit_packing;
+SELECT count(*) FROM test_bit_packing
+WHERE ts <> '2024-01-01 00:00:00+00'::timestamptz + id * interval '1 second';
+SELECT id, small, n FROM test_bit_packing WHERE id IN (1, 10, 9999, 10001) ORDER BY id;
+
+-- values whose range doesn't fit in int8 are delta packed
+CREATE TABLE test_bit_packing_wide (a int8) USING columnar;
+INSERT INTO test_bit_packing_wide
+SELECT (i - 500) * 10000000000000000 FROM generate_series(1, 1000) i;
+
+SELECT DISTINCT value_encoding_type FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_bit_packing_wide'::regclass);
+
+SELECT sum(a), min(a), max(a) FROM test_bit_packing_wide;
+
+-- verify packing can be disabled
+SET columnar.enable_bit_packing TO off;
+INSERT INTO test_bit_packing (id) SELECT i FROM generate_series(1, 10000) i;
+RESET columnar.enable_bit_packing;
+
+SELECT value_encoding_type, count(*) FROM columnar.chunk
+WHERE storage_id = :test_bit_packing_storage_id AND attr_num = 1
+GROUP BY value_encoding_type ORDER BY value_encoding_type;
+
+SELECT count(id), sum(id) FROM test_bit_packing;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_bit_packing CASCADE;
@@ -114,3 +114,73 @@ CREATE TABLE t1 (i int) USING columnar;
 INSERT INTO t1 SELECT generate_series(1, 1000000, 1);
 EXPLAIN SELECT COUNT(*) FROM t1;
 DROP TABLE t1;
+
+-- returns a counter of the column and skip list caches after the query ran
+CREATE FUNCTION cache_statistic(query text, statistic text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := -1;
+BEGIN
+    PERFORM set_config('columnar.enable_column_cache', 'on', false);
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ ('^\s*' || statistic || ':') THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+-- scans of an empty table read no skip lists, so they show what is cached
+CREATE TABLE skip_list_probe (a int) USING columnar;
+CREATE FUNCTION skip_list_cache_entries() RETURNS bigint AS $$
+    SELECT cache_statistic('SELECT * FROM skip_list_probe', 'Skip List Cache Entries');
+$$ LANGUAGE sql;
+
+CREATE TABLE skip_list_cached (a int) USING columnar;
+INSERT INTO skip_list_cached SELECT generate_series(1, 1000);
+INSERT INTO skip_list_cached SELECT generate_series(1001, 2000);
+SELECT skip_list_cache_entries() AS entries \gset
+
+-- the skip lists of both stripes are cached, and found by the next scan
+SELECT cache_statistic('SELECT sum(a) FROM skip_list_cached', 'Skip List Cache Misses') AS misses \gset
+SELECT skip_list_cache_entries() - :entries AS cached_stripes;
+SELECT cache_statistic('SELECT sum(a) FROM skip_list_cached', 'Skip List Cache Misses') - :misses AS new_misses;
+
+-- columnar.vacuum drops the entry of the stripe it removes
+DELETE FROM skip_list_cached WHERE a <= 1000;
+SELECT columnar.vacuum('skip_list_cached');
+SELECT skip_list_cache_entries() - :entries AS cached_stripes;
+SELECT count(*), sum(a) FROM skip_list_cached WHERE a > 1500;
+
+-- TRUNCATE drops the entries of the table
+TRUNCATE skip_list_cached;
+SELECT skip_list_cache_entries() - :entries AS cached_stripes;
+SELECT count(*) FROM skip_list_cached;
+
+DROP TABLE skip_list_cached;
+DROP FUNCTION skip_list_cache_entries();
+DROP TABLE skip_list_probe;
+
+-- a scan of more than columnar.column_cache_size evicts the chunks it read
+-- before, and the cache stays below its size
+CREATE TABLE cache_evictions (a int, b text) USING columnar;
+INSERT INTO cache_evictions SELECT i, md5(i::text) FROM generate_series(1, 1000000) i;
+
+SET columnar.column_cache_size TO '20MB';
+SELECT cache_statistic('SELECT sum(a), sum(length(b)) FROM cache_evictions',
+                       'Cache Evictions') > 0 AS evicted;
+SELECT cache_statistic('SELECT sum(a), sum(length(b)) FROM cache_evictions',
+                       'Cache Ending Size') < 20 * 1024 * 1024 AS below_size;
+SET columnar.enable_column_cache TO true;
+SELECT sum(a), sum(length(b)) FROM cache_evictions;
+
+RESET columnar.column_cache_size;
+SELECT cache_statistic('SELECT sum(a), sum(length(b)) FROM cache_evictions',
+                       'Cache Evictions') AS evictions;
+
+RESET columnar.enable_parallel_execution;
+DROP TABLE cache_evictions;
+DROP FUNCTION cache_statistic(text, text);
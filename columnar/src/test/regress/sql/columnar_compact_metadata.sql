@@ -0,0 +1,53 @@
+CREATE SCHEMA columnar_compact_metadata;
+SET search_path TO columnar_compact_metadata;
+
+SET columnar.compact_chunk_metadata TO on;
+CREATE TABLE events (id int, tag text, note text) USING columnar;
+SELECT columnar.alter_columnar_table_set('events', bloom_filter_columns => '{tag}');
+INSERT INTO events SELECT i, 'tag' || (i % 50), CASE WHEN i % 7 = 0 THEN NULL ELSE 'note ' || i END
+FROM generate_series(1, 25000) i;
+SELECT columnar_test_helpers.columnar_relation_storageid('events'::regclass) AS storage_id \gset
+
+-- the chunk metadata of the stripe is a single row
+SELECT count(*) FROM columnar.chunk WHERE storage_id = :storage_id;
+SELECT count(*) FROM columnar.stripe_skip_list WHERE storage_id = :storage_id;
+
+SELECT count(*), sum(id), count(note) FROM events;
+SELECT count(*) FROM events WHERE id BETWEEN 12000 AND 12999;
+SELECT count(*) FROM events WHERE tag = 'tag7';
+SELECT min(note), max(id) FROM events WHERE id > 24990;
+
+-- stripes written with it off still use columnar.chunk
+RESET columnar.compact_chunk_metadata;
+INSERT INTO events SELECT i, 'tag' || (i % 50), 'note ' || i FROM generate_series(25001, 26000) i;
+SELECT count(*) > 0 FROM columnar.chunk WHERE storage_id = :storage_id;
+SELECT count(*), sum(id) FROM events;
+
+VACUUM FULL events;
+SELECT columnar_test_helpers.columnar_relation_storageid('events'::regclass) AS new_storage_id \gset
+SELECT count(*) FROM columnar.stripe_skip_list WHERE storage_id = :new_storage_id;
+SELECT count(*), sum(id), count(note) FROM events;
+
+-- scans read the chunk metadata of the columns they project or filter on
+SET columnar.compact_chunk_metadata TO on;
+CREATE TABLE wide (a int, b int, c text, d int) USING columnar;
+INSERT INTO wide SELECT i, i % 100, 'c' || i, i * 2 FROM generate_series(1, 30000) i;
+SELECT count(*) FROM wide WHERE d < 1000;
+SELECT sum(b) FROM wide WHERE a > 29000;
+SELECT count(c), max(d) FROM wide;
+RESET columnar.compact_chunk_metadata;
+INSERT INTO wide SELECT i, i % 100, 'c' || i, i * 2 FROM generate_series(30001, 31000) i;
+SELECT count(*), sum(b) FROM wide WHERE d > 61000;
+SELECT count(c), max(d) FROM wide;
+
+-- dropping a table removes its rows
+SET columnar.compact_chunk_metadata TO on;
+CREATE TABLE dropped (a int) USING columnar;
+INSERT INTO dropped SELECT generate_series(1, 100);
+SELECT columnar_test_helpers.columnar_relation_storageid('dropped'::regclass) AS dropped_storage_id \gset
+DROP TABLE dropped;
+SELECT count(*) FROM columnar.stripe_skip_list WHERE storage_id = :dropped_storage_id;
+RESET columnar.compact_chunk_metadata;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_compact_metadata CASCADE;
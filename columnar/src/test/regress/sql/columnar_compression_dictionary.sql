@@ -0,0 +1,47 @@
+SELECT columnar_test_helpers.compression_type_supported('zstd') AS zstd_supported \gset
+\if :zstd_supported
+\else
+\q
+\endif
+
+CREATE SCHEMA am_compression_dictionary;
+SET search_path TO am_compression_dictionary;
+
+CREATE TABLE test_dictionary (a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('test_dictionary', compression => 'zstd',
+                                         chunk_group_row_limit => 1000);
+
+INSERT INTO test_dictionary SELECT i, 'customer ' || i || ' ordered item ' || (i % 97)
+FROM generate_series(1, 20000) i;
+
+SELECT columnar.train_compression_dictionary('test_dictionary', 'b',
+                                             dictionary_size => 4096) > 0 AS trained;
+
+-- only chunks written after training use the dictionary
+INSERT INTO test_dictionary SELECT i, 'customer ' || i || ' ordered item ' || (i % 97)
+FROM generate_series(20001, 40000) i;
+
+SELECT attr_num, compression_dictionary_id > 0 AS uses_dictionary, count(*)
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_dictionary'::regclass)
+GROUP BY 1, 2 ORDER BY 1, 2;
+
+SELECT count(*), sum(a), count(DISTINCT b) FROM test_dictionary;
+SELECT b FROM test_dictionary WHERE a IN (1, 20001, 40000) ORDER BY a;
+
+-- dictionaries can be retrained from chunks compressed with a dictionary
+SELECT columnar.train_compression_dictionary('test_dictionary', 'b',
+                                             dictionary_size => 4096) > 0 AS trained;
+SELECT count(*) FROM columnar.compression_dictionary
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_dictionary'::regclass);
+
+SELECT columnar.train_compression_dictionary('test_dictionary', 'c');
+SELECT columnar.train_compression_dictionary('test_dictionary', 'b', dictionary_size => 10);
+
+-- dictionaries are removed with the table
+SELECT columnar_test_helpers.columnar_relation_storageid('test_dictionary'::regclass) AS storage_id \gset
+DROP TABLE test_dictionary;
+SELECT count(*) FROM columnar.compression_dictionary WHERE storage_id = :storage_id;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA am_compression_dictionary CASCADE;
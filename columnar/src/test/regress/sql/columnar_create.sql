@@ -19,8 +19,23 @@ CREATE TABLE contestant_compressed (handle TEXT, birthdate DATE, rating INT,
 ANALYZE contestant;
 SELECT count(*) FROM contestant;
 
--- Should fail: unlogged tables not supported
+-- Should work: unlogged tables are supported
 CREATE UNLOGGED TABLE columnar_unlogged(i int) USING columnar;
+INSERT INTO columnar_unlogged SELECT i FROM generate_series(1,5) i;
+SELECT count(*), sum(i) FROM columnar_unlogged;
+
+-- the init fork has the metapage the table is reset to after a crash
+SELECT pg_relation_size('columnar_unlogged', 'init') > 0;
+
+BEGIN;
+CREATE UNLOGGED TABLE columnar_unlogged_truncated(i int) USING columnar;
+INSERT INTO columnar_unlogged_truncated SELECT i FROM generate_series(1,5) i;
+TRUNCATE columnar_unlogged_truncated;
+INSERT INTO columnar_unlogged_truncated SELECT i FROM generate_series(1,3) i;
+COMMIT;
+SELECT count(*) FROM columnar_unlogged_truncated;
+
+DROP TABLE columnar_unlogged, columnar_unlogged_truncated;
 
 CREATE TABLE columnar_table_1 (a int) USING columnar;
 INSERT INTO columnar_table_1 VALUES (1);
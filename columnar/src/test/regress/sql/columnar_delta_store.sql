@@ -0,0 +1,79 @@
+CREATE SCHEMA am_delta_store;
+SET search_path TO am_delta_store;
+
+CREATE TABLE test_delta (a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('test_delta', delta_store => true);
+SELECT columnar_test_helpers.columnar_relation_storageid('test_delta'::regclass) AS storage_id \gset
+
+-- small writes are kept in the delta store instead of stripes
+INSERT INTO test_delta VALUES (1, 'one');
+INSERT INTO test_delta VALUES (2, 'two'), (3, 'three');
+SELECT count(*) FROM columnar.stripe WHERE storage_id = :storage_id;
+SELECT count(*) FROM columnar.delta_store WHERE storage_id = :storage_id;
+SELECT * FROM test_delta ORDER BY a;
+
+-- rows past the limit of a write go to stripes
+SET columnar.delta_store_row_limit TO 5;
+INSERT INTO test_delta SELECT i, 'row ' || i FROM generate_series(4, 10) i;
+RESET columnar.delta_store_row_limit;
+SELECT count(*) FROM columnar.stripe WHERE storage_id = :storage_id;
+SELECT count(*) FROM columnar.delta_store WHERE storage_id = :storage_id;
+SELECT count(*), sum(a) FROM test_delta;
+
+-- delta store rows can be updated and deleted
+UPDATE test_delta SET b = 'TWO' WHERE a = 2;
+DELETE FROM test_delta WHERE a = 3;
+SELECT * FROM test_delta WHERE a <= 4 ORDER BY a;
+
+-- flushing moves the rows into stripes
+SELECT columnar.flush_delta_store('test_delta');
+SELECT count(*) FROM columnar.stripe WHERE storage_id = :storage_id;
+SELECT count(*) FROM columnar.delta_store WHERE storage_id = :storage_id;
+SELECT * FROM test_delta WHERE a <= 4 ORDER BY a;
+SELECT count(*), sum(a) FROM test_delta;
+
+-- rewrites move the rows into the stripes of the new storage
+INSERT INTO test_delta VALUES (11, 'eleven');
+VACUUM FULL test_delta;
+SELECT count(*) FROM columnar.delta_store WHERE storage_id = :storage_id;
+SELECT count(*), sum(a) FROM test_delta;
+
+-- indexed tables don't use the delta store
+CREATE INDEX test_delta_idx ON test_delta (a);
+SELECT columnar_test_helpers.columnar_relation_storageid('test_delta'::regclass) AS storage_id \gset
+INSERT INTO test_delta VALUES (12, 'twelve');
+SELECT count(*) FROM columnar.delta_store WHERE storage_id = :storage_id;
+SELECT b FROM test_delta WHERE a = 12;
+SELECT columnar.flush_delta_store('test_delta');
+
+-- row numbers are reserved in batches that double in size
+CREATE TABLE test_batches (a int) USING columnar;
+SELECT columnar.alter_columnar_table_set('test_batches', delta_store => true);
+SELECT reserved_row_number AS first_row_number
+FROM columnar_test_helpers.columnar_storage_info('test_batches') \gset
+INSERT INTO test_batches VALUES (1);
+SELECT reserved_row_number - :first_row_number AS reserved
+FROM columnar_test_helpers.columnar_storage_info('test_batches');
+INSERT INTO test_batches VALUES (2);
+SELECT reserved_row_number - :first_row_number AS reserved
+FROM columnar_test_helpers.columnar_storage_info('test_batches');
+INSERT INTO test_batches VALUES (3);
+SELECT reserved_row_number - :first_row_number AS reserved
+FROM columnar_test_helpers.columnar_storage_info('test_batches');
+INSERT INTO test_batches VALUES (4), (5), (6), (7);
+SELECT reserved_row_number - :first_row_number AS reserved
+FROM columnar_test_helpers.columnar_storage_info('test_batches');
+INSERT INTO test_batches VALUES (8);
+SELECT reserved_row_number - :first_row_number AS reserved
+FROM columnar_test_helpers.columnar_storage_info('test_batches');
+
+-- each row got its own row number, and the rows stay readable once flushed
+SELECT count(*), count(DISTINCT ctid) FROM test_batches;
+SELECT columnar.flush_delta_store('test_batches');
+SELECT count(*) FROM columnar.delta_store
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_batches'::regclass);
+SELECT count(*), count(DISTINCT ctid), sum(a) FROM test_batches;
+SELECT a FROM test_batches ORDER BY a;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA am_delta_store CASCADE;
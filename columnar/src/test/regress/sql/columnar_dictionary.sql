@@ -0,0 +1,94 @@
+CREATE SCHEMA columnar_dictionary;
+SET search_path TO columnar_dictionary;
+
+CREATE TABLE test_dictionary (a int, b text) USING columnar;
+INSERT INTO test_dictionary SELECT i, 'status_' || (i % 3) FROM generate_series(1, 20000) i;
+
+SELECT columnar_test_helpers.columnar_relation_storageid(oid) AS test_dictionary_storage_id
+FROM pg_class WHERE relname = 'test_dictionary' \gset
+
+-- only the low cardinality text column is dictionary encoded, the integer
+-- column is bit packed
+SELECT DISTINCT attr_num, value_encoding_type FROM columnar.chunk
+WHERE storage_id = :test_dictionary_storage_id ORDER BY attr_num;
+
+SELECT b, count(*) FROM test_dictionary GROUP BY b ORDER BY b;
+SELECT count(*) FROM test_dictionary WHERE b = 'status_1';
+SELECT count(*) FROM test_dictionary WHERE b <> 'status_1';
+SELECT count(*) FROM test_dictionary WHERE 'status_2' = b;
+
+-- prefix patterns compare the leading bytes, other patterns call textlike
+SELECT count(*) FROM test_dictionary WHERE b LIKE 'status%';
+SELECT count(*) FROM test_dictionary WHERE b LIKE 'status_%';
+SELECT count(*) FROM test_dictionary WHERE b LIKE 'stat%1';
+SELECT count(*) FROM test_dictionary WHERE b NOT LIKE 'status%';
+SELECT count(*) FROM test_dictionary WHERE b ^@ 'status_1';
+SELECT count(*) FROM test_dictionary WHERE 'status_2' LIKE b;
+
+-- text functions of a column compute a vector that comparisons read
+SELECT count(*) FROM test_dictionary WHERE upper(b) = 'STATUS_1';
+SELECT count(*) FROM test_dictionary WHERE lower(upper(b)) = 'status_2';
+SELECT count(*) FROM test_dictionary WHERE length(b) = 8;
+SELECT count(*) FROM test_dictionary WHERE substring(b, 8, 1) = '0';
+SELECT count(*) FROM test_dictionary WHERE substr(b, 8) <> '0';
+SELECT count(*) FROM test_dictionary WHERE substring(b, 0, 3) = 'st';
+
+-- high cardinality columns are not encoded
+CREATE TABLE test_no_dictionary (b text) USING columnar;
+INSERT INTO test_no_dictionary SELECT md5(i::text) FROM generate_series(1, 10000) i;
+
+SELECT DISTINCT value_encoding_type FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_no_dictionary'::regclass);
+
+-- verify encoding can be disabled
+SET columnar.enable_dictionary_encoding TO off;
+INSERT INTO test_dictionary SELECT i, 'status_' || (i % 3) FROM generate_series(1, 10000) i;
+RESET columnar.enable_dictionary_encoding;
+
+SELECT value_encoding_type, count(*) FROM columnar.chunk
+WHERE storage_id = :test_dictionary_storage_id AND attr_num = 2
+GROUP BY value_encoding_type ORDER BY value_encoding_type;
+
+SELECT b, count(*) FROM test_dictionary GROUP BY b ORDER BY b;
+
+-- clauses on dictionary encoded chunks are evaluated once per distinct value
+CREATE TABLE test_dictionary_filter (a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('test_dictionary_filter', chunk_group_row_limit => 1000);
+INSERT INTO test_dictionary_filter
+SELECT i, CASE WHEN i = 2500 THEN 'b' WHEN i % 7 = 0 THEN NULL
+               WHEN i % 2 = 0 THEN 'a' ELSE 'c' END
+FROM generate_series(1, 5000) i;
+
+SELECT DISTINCT value_encoding_type FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_dictionary_filter'::regclass)
+      AND attr_num = 2;
+
+CREATE FUNCTION chunk_groups_removed(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := -1;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Chunk Groups Removed by Filter' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+-- the min/max values of every chunk group include 'b', only one has it
+SELECT a FROM test_dictionary_filter WHERE b = 'b';
+SELECT chunk_groups_removed('SELECT a FROM test_dictionary_filter WHERE b = ''b''');
+SELECT a FROM test_dictionary_filter WHERE b = 'b' AND a > 2000;
+SELECT a FROM test_dictionary_filter WHERE b = 'b' AND a + length(b) > 2000;
+SELECT count(a) FROM test_dictionary_filter WHERE b <> 'a';
+SELECT count(a) FROM test_dictionary_filter WHERE b IS NULL;
+SELECT count(a) FROM test_dictionary_filter WHERE b IN ('b', 'd');
+
+RESET columnar.enable_parallel_execution;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_dictionary CASCADE;
@@ -0,0 +1,30 @@
+--
+-- Test dropping the rows that match a predicate with their stripes
+--
+
+CREATE TABLE t_drop(a int) USING columnar;
+INSERT INTO t_drop SELECT generate_series(1, 1000);
+INSERT INTO t_drop SELECT generate_series(1001, 2000);
+INSERT INTO t_drop SELECT generate_series(2001, 3000);
+
+-- the first stripe is detached, the second one only partly matches
+SELECT columnar.drop_stripes('t_drop', 'a <= 1500');
+
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('t_drop'::regclass);
+
+SELECT count(*), min(a), sum(a) FROM t_drop;
+
+-- stripes with NULLs aren't detached, as NULLs don't match
+INSERT INTO t_drop SELECT CASE WHEN i % 2 = 0 THEN i END FROM generate_series(3001, 4000) i;
+SELECT columnar.drop_stripes('t_drop', 'a > 3000');
+
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('t_drop'::regclass);
+
+SELECT count(*), count(a), max(a) FROM t_drop;
+
+SELECT columnar.drop_stripes('t_drop', 'random() > 0.5');
+SELECT columnar.drop_stripes('t_drop', 'true; DROP TABLE t_drop');
+
+DROP TABLE t_drop;
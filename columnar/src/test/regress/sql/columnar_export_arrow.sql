@@ -0,0 +1,42 @@
+--
+-- Test columnar.export_arrow, which returns the messages of an Arrow stream
+--
+CREATE TABLE t_arrow(i int, t text, f float8, b bool, d date, ts timestamptz, n numeric)
+  USING columnar;
+INSERT INTO t_arrow
+SELECT g, CASE WHEN g % 7 = 0 THEN NULL ELSE 'row ' || g END, g / 4.0, g % 2 = 0,
+       '2024-01-01'::date + g % 365, '2024-01-01 00:00:00+00'::timestamptz + g * interval '1 minute',
+       g * 1.5
+FROM generate_series(1, 25000) g;
+
+SELECT count(*) FROM columnar.export_arrow(NULL);
+
+-- a schema, a record batch for each chunk group and the end of stream
+SELECT count(*) FROM columnar.export_arrow('t_arrow');
+
+-- every message starts with the continuation marker and aligned metadata
+SELECT bool_and(substring(message FROM 1 FOR 4) = '\xffffffff'::bytea),
+       bool_and(get_byte(message, 4) % 8 = 0)
+FROM columnar.export_arrow('t_arrow') message;
+
+SELECT message FROM columnar.export_arrow('t_arrow') WITH ORDINALITY AS e(message, n)
+ORDER BY n DESC LIMIT 1;
+
+-- the record batches hold all rows, their length follows the message header
+SELECT sum(get_byte(message, 72) + get_byte(message, 73) * 256 + get_byte(message, 74) * 65536)
+FROM columnar.export_arrow('t_arrow') WITH ORDINALITY AS e(message, n)
+WHERE n > 1 AND length(message) > 8;
+
+-- a batch of 10000 int values needs no validity bitmap
+SELECT length(message) FROM columnar.export_arrow('t_arrow', columns => '{i}')
+  WITH ORDINALITY AS e(message, n)
+WHERE n = 2;
+
+SELECT count(*) FROM columnar.export_arrow('t_arrow', columns => '{i,x}');
+SELECT count(*) FROM columnar.export_arrow('t_arrow', columns => '{i,NULL}');
+
+CREATE TABLE t_arrow_heap(a int);
+SELECT count(*) FROM columnar.export_arrow('t_arrow_heap');
+DROP TABLE t_arrow_heap;
+
+DROP TABLE t_arrow;
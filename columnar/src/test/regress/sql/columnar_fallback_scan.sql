@@ -34,6 +34,32 @@ set parallel_tuple_cost to default;
 set max_parallel_workers to default;
 set max_parallel_workers_per_gather to default;
 
+-- rows of plain scans, index builds and rewrites are read a vector at a time
+create table fallback_batch(i int, t text, u uuid, n numeric) using columnar;
+insert into fallback_batch
+  select g, case when g % 7 = 0 then null else 'row ' || g end,
+         md5(g::text)::uuid, g * 1.5
+  from generate_series(1, 25000) g;
+
+select count(*), count(t), count(distinct u), sum(n), sum(length(t)) from fallback_batch;
+
+create index fallback_batch_u on fallback_batch (u);
+set enable_seqscan = false;
+select i, t from fallback_batch where u = md5('24997')::uuid;
+set enable_seqscan to default;
+
+vacuum full fallback_batch;
+select count(*), count(t), count(distinct u), sum(n), sum(length(t)) from fallback_batch;
+
+-- vectors can't hold macaddr values, so these are read row by row
+create table fallback_macaddr(m macaddr) using columnar;
+insert into fallback_macaddr
+  select ('08:00:2b:01:02:' || lpad(to_hex(g % 256), 2, '0'))::macaddr
+  from generate_series(1, 2000) g;
+select count(*), count(distinct m) from fallback_macaddr;
+
+drop table fallback_batch, fallback_macaddr;
+
 set columnar.enable_custom_scan to default;
 
 drop table fallback_scan;
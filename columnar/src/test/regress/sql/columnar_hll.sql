@@ -0,0 +1,72 @@
+--
+-- Test hll_columns, which keep a distinct value sketch of each chunk, and approx_count_distinct
+--
+CREATE SCHEMA columnar_hll;
+SET search_path TO columnar_hll;
+
+CREATE FUNCTION summarized_chunk_groups(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Chunk Groups Summarized' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE events (id int, user_id int, kind text, amount float8) USING columnar;
+SELECT columnar.alter_columnar_table_set('events', chunk_group_row_limit => 1000,
+                                         hll_columns => '{user_id,kind}');
+SELECT attnum, hll FROM columnar.column_options
+WHERE regclass = 'events'::regclass ORDER BY attnum;
+
+INSERT INTO events SELECT g, g % 2000, 'kind ' || (g % 50), g FROM generate_series(1, 10000) g;
+SELECT attr_num, count(*) FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('events'::regclass)
+      AND hll_sketch IS NOT NULL
+GROUP BY 1 ORDER BY 1;
+
+-- estimates are close to the number of distinct values
+SELECT approx_count_distinct(user_id) BETWEEN 1900 AND 2100,
+       approx_count_distinct(kind) BETWEEN 48 AND 52,
+       approx_count_distinct(id) BETWEEN 9500 AND 10500
+FROM events;
+
+-- fully covered chunk groups merge their sketches, the others are read
+SELECT summarized_chunk_groups('SELECT approx_count_distinct(user_id) FROM events');
+SELECT summarized_chunk_groups('SELECT count(*), approx_count_distinct(kind) FROM events WHERE id > 2500');
+SELECT summarized_chunk_groups('SELECT approx_count_distinct(id) FROM events');
+
+-- merged sketches give the same estimates as reading the rows
+SELECT approx_count_distinct(user_id) AS user_estimate,
+       approx_count_distinct(kind) AS kind_estimate
+FROM events WHERE id > 2500 \gset
+SET columnar.enable_vectorization TO false;
+SELECT approx_count_distinct(user_id) = :user_estimate,
+       approx_count_distinct(kind) = :kind_estimate
+FROM events WHERE id > 2500;
+RESET columnar.enable_vectorization;
+
+SELECT approx_count_distinct(user_id) FROM events WHERE false;
+
+-- sketches need types whose equal values have equal bytes
+SELECT columnar.alter_columnar_table_set('events', hll_columns => '{amount}');
+SELECT columnar.alter_columnar_table_set('events', hll_columns => '{missing}');
+SELECT approx_count_distinct(amount) FROM events;
+
+-- chunks written without the option have no sketches
+SELECT columnar.alter_columnar_table_reset('events', hll_columns => true);
+SELECT count(*) FROM columnar.column_options
+WHERE regclass = 'events'::regclass AND hll;
+INSERT INTO events SELECT g, g % 2000, 'kind ' || (g % 50), g FROM generate_series(10001, 12000) g;
+SELECT summarized_chunk_groups('SELECT approx_count_distinct(user_id) FROM events WHERE id > 10000');
+
+RESET columnar.enable_parallel_execution;
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_hll CASCADE;
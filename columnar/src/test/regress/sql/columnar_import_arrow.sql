@@ -0,0 +1,74 @@
+--
+-- Test columnar.import_arrow, which writes the rows of an Arrow stream into stripes
+--
+CREATE TABLE t_arrow(i int, t text, f float8, b bool, d date, ts timestamptz, n numeric)
+  USING columnar;
+INSERT INTO t_arrow
+SELECT g, CASE WHEN g % 7 = 0 THEN NULL ELSE 'row ' || g END, g / 4.0, g % 2 = 0,
+       '2024-01-01'::date + g % 365, '2024-01-01 00:00:00+00'::timestamptz + g * interval '1 minute',
+       g * 1.5
+FROM generate_series(1, 25000) g;
+
+CREATE TEMP TABLE arrow_stream AS
+SELECT string_agg(message, ''::bytea ORDER BY n) AS stream
+FROM columnar.export_arrow('t_arrow') WITH ORDINALITY AS e(message, n);
+
+-- a round trip keeps all rows and values
+CREATE TABLE t_arrow_copy(i int, t text, f float8, b bool, d date, ts timestamptz, n numeric)
+  USING columnar;
+SELECT columnar.import_arrow('t_arrow_copy', stream) FROM arrow_stream;
+
+SELECT count(*) FROM t_arrow_copy;
+SELECT count(*) FROM (TABLE t_arrow EXCEPT TABLE t_arrow_copy) diff;
+SELECT count(*) FROM t_arrow_copy WHERE t IS NULL;
+
+-- importing a stream again appends its rows
+SELECT columnar.import_arrow('t_arrow_copy', stream) FROM arrow_stream;
+SELECT count(*), sum(i) FROM t_arrow_copy;
+
+-- fields are matched by name, missing columns are NULL and types are converted
+CREATE TABLE t_arrow_cast(n text, extra int, i bigint, f numeric) USING columnar;
+SELECT columnar.import_arrow('t_arrow_cast', string_agg(message, ''::bytea ORDER BY n))
+FROM columnar.export_arrow('t_arrow', columns => '{i,f,n}') WITH ORDINALITY AS e(message, n);
+SELECT * FROM t_arrow_cast ORDER BY i LIMIT 3;
+SELECT count(*) FROM t_arrow_cast WHERE extra IS NOT NULL;
+
+-- a stream without record batches has no rows
+SELECT columnar.import_arrow('t_arrow_cast', message)
+FROM columnar.export_arrow('t_arrow', columns => '{i}') WITH ORDINALITY AS e(message, n)
+WHERE n = 1;
+
+SELECT columnar.import_arrow('t_arrow_cast', NULL);
+SELECT columnar.import_arrow('t_arrow_cast', ''::bytea);
+SELECT columnar.import_arrow('t_arrow_cast', '\x00'::bytea);
+
+SELECT columnar.import_arrow('t_arrow_cast', string_agg(message, ''::bytea ORDER BY n))
+FROM columnar.export_arrow('t_arrow', columns => '{i,t}') WITH ORDINALITY AS e(message, n);
+
+CREATE TABLE t_arrow_int(t int, ts int) USING columnar;
+SELECT columnar.import_arrow('t_arrow_int', string_agg(message, ''::bytea ORDER BY n))
+FROM columnar.export_arrow('t_arrow', columns => '{t}') WITH ORDINALITY AS e(message, n);
+SELECT columnar.import_arrow('t_arrow_int', string_agg(message, ''::bytea ORDER BY n))
+FROM columnar.export_arrow('t_arrow', columns => '{ts}') WITH ORDINALITY AS e(message, n);
+DROP TABLE t_arrow_int;
+
+CREATE TABLE t_arrow_not_null(i int, t text NOT NULL) USING columnar;
+SELECT columnar.import_arrow('t_arrow_not_null', string_agg(message, ''::bytea ORDER BY n))
+FROM columnar.export_arrow('t_arrow', columns => '{i}') WITH ORDINALITY AS e(message, n);
+DROP TABLE t_arrow_not_null;
+
+CREATE TABLE t_arrow_indexed(i int PRIMARY KEY) USING columnar;
+SELECT columnar.import_arrow('t_arrow_indexed', string_agg(message, ''::bytea ORDER BY n))
+FROM columnar.export_arrow('t_arrow', columns => '{i}') WITH ORDINALITY AS e(message, n);
+DROP TABLE t_arrow_indexed;
+
+CREATE TABLE t_arrow_heap(i int);
+SELECT columnar.import_arrow('t_arrow_heap', stream) FROM arrow_stream;
+DROP TABLE t_arrow_heap;
+
+SELECT columnar.import_arrow_file('t_arrow_cast', '/nonexistent/stream.arrow');
+
+DROP TABLE arrow_stream;
+DROP TABLE t_arrow_cast;
+DROP TABLE t_arrow_copy;
+DROP TABLE t_arrow;
@@ -222,6 +222,14 @@ REINDEX TABLE exclusion_test;
 -- should still work after reindex
 INSERT INTO exclusion_test SELECT x, 2, 3*x, BOX('4,4,4,4') FROM generate_series(10,15) AS x;
 
+-- exclusion checks read our own rows without flushing them as stripes
+CREATE TABLE exclusion_stripes (a INT, EXCLUDE USING btree (a WITH =)) USING columnar;
+INSERT INTO exclusion_stripes SELECT generate_series(1, 1000);
+SELECT COUNT(*) FROM columnar.stripe cs
+WHERE cs.storage_id = columnar_test_helpers.columnar_relation_storageid('columnar_indexes.exclusion_stripes'::regclass);
+INSERT INTO exclusion_stripes VALUES (1001), (1001);
+DROP TABLE exclusion_stripes;
+
 -- make sure that we respect INCLUDE syntax --
 
 CREATE TABLE include_test (a INT, b BIGINT, c BIGINT, d BIGINT) USING columnar;
@@ -644,5 +652,83 @@ BEGIN;
 ROLLBACK;
 
 
+-- parallel index builds
+CREATE TABLE parallel_build(a int, b text) USING columnar;
+INSERT INTO parallel_build SELECT i, i::text FROM generate_series(1, 400000) i;
+SET min_parallel_table_scan_size TO 0;
+SET max_parallel_maintenance_workers TO 2;
+-- rows the transaction didn't flush yet are indexed too
+BEGIN;
+  INSERT INTO parallel_build VALUES (1, 'duplicate');
+  CREATE UNIQUE INDEX parallel_build_dup_idx ON parallel_build (a);
+ROLLBACK;
+CREATE UNIQUE INDEX parallel_build_a_idx ON parallel_build (a);
+BEGIN;
+  SET LOCAL columnar.enable_custom_scan TO 'OFF';
+  SET LOCAL enable_seqscan TO 'OFF';
+  SELECT count(*), sum(a) FROM parallel_build WHERE a BETWEEN 1000 AND 390000;
+ROLLBACK;
+-- bitmap heap scans
+BEGIN;
+  SET LOCAL columnar.enable_custom_scan TO 'OFF';
+  SET LOCAL enable_seqscan TO 'OFF';
+  SET LOCAL enable_indexscan TO 'OFF';
+  SELECT count(*), sum(a) FROM parallel_build WHERE a BETWEEN 1000 AND 390000 OR a < 10;
+  -- lossy blocks
+  SET LOCAL work_mem TO '64kB';
+  SELECT count(*), sum(a) FROM parallel_build WHERE a BETWEEN 1000 AND 390000 OR a < 10;
+ROLLBACK;
+-- parallel index and bitmap heap scans see the rows the transaction didn't flush yet
+BEGIN;
+  SET LOCAL columnar.enable_custom_scan TO 'OFF';
+  SET LOCAL enable_seqscan TO 'OFF';
+  SET LOCAL parallel_setup_cost TO 0;
+  SET LOCAL parallel_tuple_cost TO 0;
+  SET LOCAL min_parallel_index_scan_size TO 0;
+  INSERT INTO parallel_build VALUES (400001, 'pending');
+  SELECT count(*), sum(a) FROM parallel_build WHERE a > 390000;
+  SET LOCAL enable_indexscan TO 'OFF';
+  SELECT count(*), sum(a) FROM parallel_build WHERE a > 390000;
+ROLLBACK;
+-- index fetches decode only the columns the scan uses
+BEGIN;
+  SET LOCAL columnar.enable_custom_scan TO 'OFF';
+  SET LOCAL enable_seqscan TO 'OFF';
+  SET LOCAL enable_bitmapscan TO 'OFF';
+  SELECT b FROM parallel_build WHERE a = 12345;
+  SELECT a FROM parallel_build WHERE a BETWEEN 10 AND 20 AND b LIKE '%1';
+  SELECT count(*) FROM parallel_build WHERE a < 100;
+  SET LOCAL enable_indexscan TO 'OFF';
+  SET LOCAL enable_bitmapscan TO 'ON';
+  SELECT b FROM parallel_build WHERE a = 54321 OR a = 7 ORDER BY a;
+ROLLBACK;
+-- index only scans skip the rows of blocks vacuum marked all visible
+CREATE TABLE ios_test(a int, b int) USING columnar;
+INSERT INTO ios_test SELECT i, i FROM generate_series(1, 20000) i;
+CREATE INDEX ios_test_a_idx ON ios_test (a);
+VACUUM ios_test;
+BEGIN;
+  SET LOCAL columnar.enable_custom_scan TO 'OFF';
+  SET LOCAL enable_seqscan TO 'OFF';
+  SET LOCAL enable_bitmapscan TO 'OFF';
+  EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+  SELECT a FROM ios_test WHERE a BETWEEN 100 AND 199;
+ROLLBACK;
+-- deleting a row makes its block fetched again, and vacuum leaves it alone
+DELETE FROM ios_test WHERE a = 150;
+VACUUM ios_test;
+BEGIN;
+  SET LOCAL columnar.enable_custom_scan TO 'OFF';
+  SET LOCAL enable_seqscan TO 'OFF';
+  SET LOCAL enable_bitmapscan TO 'OFF';
+  EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+  SELECT a FROM ios_test WHERE a BETWEEN 100 AND 199;
+  EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+  SELECT a FROM ios_test WHERE a BETWEEN 15000 AND 15099;
+ROLLBACK;
+DROP TABLE ios_test;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_maintenance_workers;
+
 SET client_min_messages TO WARNING;
 DROP SCHEMA columnar_indexes CASCADE;
@@ -71,7 +71,7 @@ CREATE TABLE test_logical_replication(i int) USING columnar;
 INSERT INTO test_logical_replication VALUES (1);
 CREATE PUBLICATION test_columnar_publication
   FOR TABLE test_logical_replication;
--- should fail; columnar does not support logical replication
+-- should succeed; with wal_level=logical, the row is logged for decoding
 INSERT INTO test_logical_replication VALUES (2);
 DROP PUBLICATION test_columnar_publication;
 -- should succeed
@@ -31,5 +31,167 @@ JOIN users u2 ON (u1.id::text = u2.name)
 WHERE u2.id > 299990
 GROUP BY u1.id, u2.id;
 
+-- hash joins filter the rows of the columnar scan on their outer side with
+-- the keys of the hash table
+RESET enable_hashjoin;
+SET enable_nestloop TO off;
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE join_keys (id int);
+INSERT INTO join_keys VALUES (5), (7), (7), (NULL);
+ANALYZE things, join_keys;
+
+CREATE FUNCTION runtime_filter_used(query text) RETURNS bool AS $$
+DECLARE
+    rec text;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Runtime Filter' THEN
+            RETURN true;
+        END IF;
+    END LOOP;
+    RETURN false;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT count(*), sum(things.id) FROM things JOIN join_keys ON (things.user_id = join_keys.id);
+SELECT runtime_filter_used('SELECT count(*) FROM things JOIN join_keys ON (things.user_id = join_keys.id)');
+SELECT count(*) FROM things WHERE user_id IN (SELECT id FROM join_keys);
+
+-- outer rows without a match are kept by left joins
+SELECT count(*) FROM things LEFT JOIN join_keys ON (things.user_id = join_keys.id);
+
+SET columnar.enable_runtime_filter TO false;
+SELECT count(*), sum(things.id) FROM things JOIN join_keys ON (things.user_id = join_keys.id);
+SELECT runtime_filter_used('SELECT count(*) FROM things JOIN join_keys ON (things.user_id = join_keys.id)');
+RESET columnar.enable_runtime_filter;
+
+-- chunk groups without a key of the hash table aren't read past the key column
+CREATE TABLE facts (k int, payload bigint) USING columnar;
+SELECT columnar.alter_columnar_table_set('facts', stripe_row_limit => 1000,
+                                         chunk_group_row_limit => 1000);
+INSERT INTO facts SELECT g / 1000, g FROM generate_series(0, 19999) g;
+CREATE TABLE fact_keys (k int);
+INSERT INTO fact_keys VALUES (0), (19);
+ANALYZE facts, fact_keys;
+
+CREATE FUNCTION runtime_filter_chunk_groups(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := -1;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Chunk Groups Removed by Runtime Filter' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT count(*), sum(payload) FROM facts JOIN fact_keys USING (k);
+SELECT runtime_filter_chunk_groups('SELECT sum(payload) FROM facts JOIN fact_keys USING (k)') BETWEEN 15 AND 18;
+SET columnar.enable_late_materialization TO false;
+SELECT count(*), sum(payload) FROM facts JOIN fact_keys USING (k);
+SELECT runtime_filter_chunk_groups('SELECT sum(payload) FROM facts JOIN fact_keys USING (k)');
+RESET columnar.enable_late_materialization;
+
+RESET columnar.enable_parallel_execution;
+RESET enable_nestloop;
+
+-- rescans of the nested loop keep the stripes of facts they loaded before
+SET enable_hashjoin TO off;
+SELECT count(*), sum(payload) FROM fact_keys JOIN facts USING (k);
+SET columnar.enable_rescan_cache TO false;
+SELECT count(*), sum(payload) FROM fact_keys JOIN facts USING (k);
+RESET columnar.enable_rescan_cache;
+DELETE FROM facts WHERE payload = 0;
+SELECT count(*), sum(payload) FROM fact_keys JOIN facts USING (k);
+RESET enable_hashjoin;
+
+-- bucket_by writes a stripe per bucket, and joins and aggregates on the
+-- bucket_by column run bucket by bucket
+CREATE TABLE bucketed_orders (customer_id int, amount int) USING columnar;
+CREATE TABLE bucketed_customers (id int, region int) USING columnar;
+SELECT columnar.alter_columnar_table_set('bucketed_orders', bucket_count => 4);
+SELECT columnar.alter_columnar_table_set('bucketed_orders', bucket_by => 'customer_id',
+                                         bucket_count => 4);
+SELECT columnar.alter_columnar_table_set('bucketed_customers', bucket_by => 'id',
+                                         bucket_count => 4);
+INSERT INTO bucketed_orders SELECT g % 100, g FROM generate_series(1, 10000) g;
+INSERT INTO bucketed_customers SELECT g, g % 5 FROM generate_series(0, 99) g;
+ANALYZE bucketed_orders, bucketed_customers;
+
+SELECT count(*), count(DISTINCT bucket) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('bucketed_orders'::regclass);
+
+CREATE FUNCTION bucket_filters(query text) RETURNS int AS $$
+DECLARE
+    rec text;
+    result int := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (costs off) ' || query LOOP
+        IF rec ~ 'Filter: .*bucket_of' THEN
+            result := result + 1;
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION bucket_stripes_read(query text) RETURNS int AS $$
+DECLARE
+    rec text;
+    result int := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, verbose on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Stripes Read' THEN
+            result := result + regexp_replace(rec, '[^0-9]*', '', 'g')::int;
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+SET enable_sort TO off;
+SET enable_mergejoin TO off;
+SET enable_nestloop TO off;
+
+SELECT count(*), sum(total) FROM
+  (SELECT customer_id, sum(amount) AS total FROM bucketed_orders GROUP BY customer_id) s;
+SELECT bucket_filters('SELECT customer_id, sum(amount) FROM bucketed_orders GROUP BY customer_id');
+SELECT count(*), sum(o.amount) FROM bucketed_orders o JOIN bucketed_customers c
+  ON (o.customer_id = c.id);
+SELECT bucket_filters('SELECT count(*) FROM bucketed_orders o JOIN bucketed_customers c ON (o.customer_id = c.id)');
+SELECT count(*), sum(n) FROM
+  (SELECT c.id, count(*) AS n FROM bucketed_orders o JOIN bucketed_customers c
+   ON (o.customer_id = c.id) GROUP BY c.id) s;
+
+-- equality on the bucket_by column only reads the stripe of its bucket
+SELECT count(*), sum(amount) FROM bucketed_orders WHERE customer_id = 7;
+SELECT bucket_stripes_read('SELECT count(*) FROM bucketed_orders WHERE customer_id = 7');
+
+SET columnar.enable_bucketwise_execution TO false;
+SELECT count(*), sum(total) FROM
+  (SELECT customer_id, sum(amount) AS total FROM bucketed_orders GROUP BY customer_id) s;
+SELECT bucket_filters('SELECT customer_id, sum(amount) FROM bucketed_orders GROUP BY customer_id');
+SELECT count(*), sum(o.amount) FROM bucketed_orders o JOIN bucketed_customers c
+  ON (o.customer_id = c.id);
+RESET columnar.enable_bucketwise_execution;
+
+-- resetting bucket_by forgets the buckets of the stripes
+SELECT columnar.alter_columnar_table_reset('bucketed_orders', bucket_by => true);
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('bucketed_orders'::regclass)
+      AND bucket >= 0;
+SELECT bucket_filters('SELECT customer_id, sum(amount) FROM bucketed_orders GROUP BY customer_id');
+SELECT count(*), sum(amount) FROM bucketed_orders WHERE customer_id = 7;
+
+RESET enable_nestloop;
+RESET enable_mergejoin;
+RESET enable_sort;
+RESET columnar.enable_parallel_execution;
+
 SET client_min_messages TO warning;
 DROP SCHEMA am_columnar_join CASCADE;
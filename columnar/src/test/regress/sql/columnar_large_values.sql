@@ -0,0 +1,35 @@
+CREATE SCHEMA columnar_large_values;
+SET search_path TO columnar_large_values;
+
+SET columnar.large_value_threshold TO '1kB';
+CREATE TABLE docs (id int, doc text, attrs jsonb) USING columnar;
+INSERT INTO docs SELECT i, repeat('value ' || i || ' ', 500), jsonb_build_object('k', repeat('x', 2000))
+FROM generate_series(1, 5) i;
+INSERT INTO docs SELECT i, 'small', '{"k": "x"}' FROM generate_series(6, 10) i;
+RESET columnar.large_value_threshold;
+
+-- only the large values are stored out of line
+SELECT attr_num, sum(large_value_count) FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('docs'::regclass)
+GROUP BY attr_num ORDER BY attr_num;
+
+SELECT id, octet_length(doc), doc = repeat('value ' || id || ' ', 500) AS same,
+       length(attrs->>'k')
+FROM docs ORDER BY id;
+
+SELECT count(*), sum(length(doc)) FROM docs WHERE doc IS NOT NULL;
+
+SET columnar.enable_vectorization TO false;
+SELECT count(*) FROM docs WHERE doc LIKE 'value 3 %';
+SET columnar.enable_vectorization TO default;
+SELECT count(*) FROM docs WHERE doc LIKE 'value 3 %';
+
+-- the large value area is copied as is
+SELECT columnar.recompress('docs', 'pglz');
+SELECT count(*), sum(length(doc)), sum(length(attrs->>'k')) FROM docs;
+
+VACUUM FULL docs;
+SELECT count(*), sum(length(doc)), sum(length(attrs->>'k')) FROM docs;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_large_values CASCADE;
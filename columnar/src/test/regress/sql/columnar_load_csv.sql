@@ -0,0 +1,61 @@
+--
+-- Test columnar.load_csv, which writes the rows of a CSV file into stripes
+--
+CREATE TABLE load_csv_source(i int, t text, n numeric);
+INSERT INTO load_csv_source
+SELECT g, CASE WHEN g % 7 = 0 THEN NULL
+               WHEN g % 11 = 0 THEN ''
+               WHEN g % 5 = 0 THEN 'row ' || g || ', "quoted"'
+               ELSE 'row ' || g END,
+       g * 1.5
+FROM generate_series(1, 100000) g;
+
+SELECT current_setting('data_directory') || '/columnar_load_csv.csv' AS csv_path \gset
+COPY load_csv_source TO :'csv_path' WITH (FORMAT csv, HEADER);
+
+-- large enough to be parsed by parallel workers
+CREATE TABLE t_load_csv(i int, t text, n numeric) USING columnar;
+SELECT columnar.load_csv('t_load_csv', :'csv_path', header => true);
+SELECT count(*), count(t), count(*) FILTER (WHERE t = '') AS empty, sum(n) FROM t_load_csv;
+SELECT count(*) FROM (SELECT * FROM t_load_csv EXCEPT ALL SELECT * FROM load_csv_source) e;
+
+-- rows keep the order of the file
+SELECT count(*) FROM (SELECT i, row_number() OVER () AS r FROM t_load_csv) o WHERE i <> r;
+
+-- parsed by the leader
+SET columnar.enable_parallel_execution TO off;
+TRUNCATE t_load_csv;
+SELECT columnar.load_csv('t_load_csv', :'csv_path', header => true);
+SELECT count(*) FROM (SELECT * FROM t_load_csv EXCEPT ALL SELECT * FROM load_csv_source) e;
+RESET columnar.enable_parallel_execution;
+
+-- other delimiters, NULL strings and quoted newlines
+SELECT current_setting('data_directory') || '/columnar_load_csv_small.csv' AS small_path \gset
+COPY (SELECT 1, E'two\nlines', NULL UNION ALL SELECT 2, 'a|b', 3.5)
+  TO :'small_path' WITH (FORMAT csv, DELIMITER '|', NULL 'none');
+CREATE TABLE t_load_csv_small(i int, t text, n numeric) USING columnar;
+SELECT columnar.load_csv('t_load_csv_small', :'small_path', delimiter => '|',
+                         null_string => 'none');
+SELECT * FROM t_load_csv_small ORDER BY i;
+
+-- records must match the columns
+\set VERBOSITY terse
+CREATE TABLE t_load_csv_wide(i int, t text, n numeric, extra int) USING columnar;
+SELECT columnar.load_csv('t_load_csv_wide', :'small_path', delimiter => '|',
+                         null_string => 'none');
+CREATE TABLE t_load_csv_narrow(i int, t text) USING columnar;
+SELECT columnar.load_csv('t_load_csv_narrow', :'small_path', delimiter => '|',
+                         null_string => 'none');
+CREATE TABLE t_load_csv_not_null(i int, t text, n numeric NOT NULL) USING columnar;
+SELECT columnar.load_csv('t_load_csv_not_null', :'small_path', delimiter => '|',
+                         null_string => 'none');
+SELECT columnar.load_csv('t_load_csv_small', :'small_path', delimiter => '"');
+SELECT columnar.load_csv('t_load_csv_small', '/nonexistent/file.csv');
+\set VERBOSITY default
+
+DROP TABLE t_load_csv_wide;
+DROP TABLE t_load_csv_narrow;
+DROP TABLE t_load_csv_not_null;
+DROP TABLE t_load_csv_small;
+DROP TABLE t_load_csv;
+DROP TABLE load_csv_source;
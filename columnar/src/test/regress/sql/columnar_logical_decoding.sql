@@ -0,0 +1,51 @@
+--
+-- Test logical decoding of changes to published columnar tables, which
+-- needs wal_level = logical
+--
+CREATE SCHEMA columnar_logical_decoding;
+SET search_path TO columnar_logical_decoding;
+
+CREATE TABLE events (id int, note text) USING columnar;
+ALTER TABLE events REPLICA IDENTITY FULL;
+CREATE PUBLICATION columnar_decoding_publication FOR TABLE events;
+
+-- leaves out the changes to the metadata tables of columnar
+CREATE FUNCTION decoded_changes() RETURNS SETOF text AS $$
+    SELECT data FROM pg_logical_slot_get_changes('columnar_decoding_slot', NULL, NULL,
+                                                 'include-xids', '0',
+                                                 'skip-empty-xacts', '1')
+    WHERE data LIKE 'table columnar_logical_decoding.events:%';
+$$ LANGUAGE sql;
+
+SELECT 'init' FROM pg_create_logical_replication_slot('columnar_decoding_slot', 'test_decoding');
+
+INSERT INTO events VALUES (1, 'one'), (2, 'two');
+SELECT * FROM decoded_changes();
+
+-- COPY logs multi insert records
+COPY events FROM STDIN WITH (FORMAT 'csv');
+3,three
+4,four
+\.
+SELECT * FROM decoded_changes();
+
+UPDATE events SET note = 'uno' WHERE id = 1;
+DELETE FROM events WHERE id = 2;
+SELECT * FROM decoded_changes();
+
+-- rolled back changes aren't decoded
+BEGIN;
+INSERT INTO events VALUES (5, 'five');
+ROLLBACK;
+SELECT * FROM decoded_changes();
+
+-- changes are only logged while the table is published
+DROP PUBLICATION columnar_decoding_publication;
+INSERT INTO events VALUES (6, 'six');
+SELECT * FROM decoded_changes();
+
+SELECT pg_drop_replication_slot('columnar_decoding_slot');
+SELECT * FROM events ORDER BY id;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_logical_decoding CASCADE;
@@ -30,6 +30,18 @@ SELECT pg_relation_size('test_pglz') AS size_pglz \gset
 -- verify that pglz & lz4 resulted in different compression ratios
 SELECT :size_pglz <> :size_lz4;
 
+-- lz4hc compresses harder, its chunks are stored as lz4
+SET columnar.compression TO 'lz4hc';
+CREATE TABLE test_lz4hc (LIKE test_lz4) USING columnar;
+INSERT INTO test_lz4hc SELECT * FROM test_lz4;
+
+SELECT bool_or(value_compression_type = 2) AS has_lz4,
+       bool_and(value_compression_type IN (0, 2)) AS only_lz4
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_lz4hc'::regclass);
+
+SELECT count(*) FROM (SELECT * FROM test_lz4 EXCEPT ALL SELECT * FROM test_lz4hc) t;
+
 -- Other operations
 VACUUM FULL test_lz4;
 ANALYZE test_lz4;
@@ -46,3 +46,29 @@ DROP TABLE t CASCADE;
 -- dropping must remove metadata
 SELECT count(*) FROM columnar.stripe WHERE storage_id=:storageid;
 SELECT count(*) FROM columnar.chunk WHERE storage_id=:storageid;
+
+-- columnar.refresh_materialized_view only aggregates the new stripes
+CREATE TABLE mv_source(a int, b int) USING columnar;
+INSERT INTO mv_source SELECT i % 3, i FROM generate_series(1, 30) i;
+CREATE MATERIALIZED VIEW mv_agg USING columnar AS
+   SELECT a, count(*) AS cnt, sum(b) AS bsum, min(b) AS bmin, max(b) AS bmax
+   FROM mv_source GROUP BY a;
+SELECT columnar.refresh_materialized_view('mv_agg');
+INSERT INTO mv_source SELECT i % 4, i FROM generate_series(31, 40) i;
+SELECT columnar.refresh_materialized_view('mv_agg');
+SELECT * FROM mv_agg ORDER BY a;
+
+-- deleted rows make it refresh in full
+DELETE FROM mv_source WHERE b = 1;
+SELECT columnar.refresh_materialized_view('mv_agg');
+SELECT * FROM mv_agg ORDER BY a;
+SELECT count(*) FROM columnar.matview_refresh WHERE matview = 'mv_agg'::regclass;
+
+-- views whose aggregates can't be merged are refreshed in full
+CREATE MATERIALIZED VIEW mv_avg USING columnar AS
+   SELECT a, avg(b) FROM mv_source GROUP BY a;
+SELECT columnar.refresh_materialized_view('mv_avg');
+SELECT count(*) FROM columnar.matview_refresh WHERE matview = 'mv_avg'::regclass;
+
+DROP TABLE mv_source CASCADE;
+SELECT count(*) FROM columnar.matview_refresh;
@@ -0,0 +1,57 @@
+CREATE SCHEMA columnar_null_state;
+SET search_path TO columnar_null_state;
+
+CREATE TABLE test_null_state (a int, b int, c text) USING columnar;
+INSERT INTO test_null_state
+SELECT i, NULL, CASE WHEN i % 3 = 0 THEN NULL ELSE i::text END
+FROM generate_series(1, 15000) i;
+
+-- chunks without a mix of nulls don't store an exists stream
+SELECT attr_num, null_state, exists_stream_length > 0 AS has_exists_stream, count(*)
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_null_state'::regclass)
+GROUP BY 1, 2, 3 ORDER BY 1, 2, 3;
+
+-- chunks record their null count, a distinct value estimate and, for types
+-- compared inline, whether their values are sorted
+SELECT attr_num, chunk_group_num, null_count, values_sorted,
+       abs(distinct_count - (value_count - null_count)) <= (value_count - null_count) / 10
+       AS distinct_count_close
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_null_state'::regclass)
+ORDER BY 1, 2;
+
+SELECT count(*), count(a), count(b), count(c), sum(a) FROM test_null_state;
+SELECT count(*) FROM test_null_state WHERE b IS NULL AND c IS NULL;
+-- chunks with only nulls are skipped by strict clauses on the column
+SELECT count(*) FROM test_null_state WHERE b > 0;
+SELECT a, b, c FROM test_null_state WHERE a IN (1, 3, 14999) ORDER BY a;
+
+CREATE FUNCTION chunk_groups_removed(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := -1;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Chunk Groups Removed by Filter' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+-- chunks without nulls are skipped by IS NULL, chunks with only nulls by
+-- IS NOT NULL
+SELECT a FROM test_null_state WHERE a IS NULL;
+SELECT chunk_groups_removed('SELECT a FROM test_null_state WHERE a IS NULL');
+SELECT chunk_groups_removed('SELECT a FROM test_null_state WHERE b IS NOT NULL');
+SELECT chunk_groups_removed('SELECT a FROM test_null_state WHERE c IS NULL');
+SELECT count(*) FROM test_null_state WHERE a > 14000 OR a IS NULL;
+
+RESET columnar.enable_parallel_execution;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_null_state CASCADE;
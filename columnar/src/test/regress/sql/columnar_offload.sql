@@ -0,0 +1,47 @@
+--
+-- Test offloading stripes to columnar.offload_directory
+--
+
+CREATE TABLE t_offload(a int) USING columnar;
+INSERT INTO t_offload SELECT generate_series(1, 1000);
+INSERT INTO t_offload SELECT generate_series(1001, 2000);
+INSERT INTO t_offload SELECT generate_series(2001, 3000);
+
+SELECT columnar.offload_stripes('t_offload');
+
+SELECT set_config('columnar.offload_directory',
+                  current_setting('data_directory') || '/columnar_offload',
+                  false) IS NOT NULL AS set;
+
+SELECT columnar.offload_stripes('t_offload');
+
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('t_offload'::regclass)
+      AND (file_offset & 4611686018427387904) <> 0;
+
+SELECT count(*), sum(a) FROM t_offload;
+SELECT a FROM t_offload WHERE a BETWEEN 1500 AND 1502 ORDER BY a;
+
+-- stripes that are offloaded already are skipped
+SELECT columnar.offload_stripes('t_offload');
+
+-- deletes, inserts and VACUUM keep working
+DELETE FROM t_offload WHERE a <= 1000;
+INSERT INTO t_offload SELECT generate_series(3001, 4000);
+VACUUM t_offload;
+
+SELECT count(*), sum(a) FROM t_offload;
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('t_offload'::regclass)
+      AND (file_offset & 4611686018427387904) <> 0;
+
+-- VACUUM FULL brings the stripes back
+VACUUM FULL t_offload;
+
+SELECT count(*), sum(a) FROM t_offload;
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('t_offload'::regclass)
+      AND (file_offset & 4611686018427387904) <> 0;
+
+RESET columnar.offload_directory;
+DROP TABLE t_offload;
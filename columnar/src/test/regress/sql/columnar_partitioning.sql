@@ -189,3 +189,29 @@ set default_table_access_method to default;
 SET enable_partitionwise_join to default;
 DROP TABLE prt1;
 DROP TABLE prt2;
+
+-- the memory limit of pending writes flushes the largest ones first, and
+-- only until half of the limit is in use
+CREATE TABLE write_limit (id int, part int, payload text) PARTITION BY LIST (part);
+CREATE TABLE write_limit_1 PARTITION OF write_limit FOR VALUES IN (1) USING columnar;
+CREATE TABLE write_limit_2 PARTITION OF write_limit FOR VALUES IN (2) USING columnar;
+CREATE TABLE write_limit_3 PARTITION OF write_limit FOR VALUES IN (3) USING columnar;
+BEGIN;
+INSERT INTO write_limit SELECT i, 1, repeat(md5(i::text), 2) FROM generate_series(1, 60000) i;
+INSERT INTO write_limit SELECT i, 2, repeat(md5(i::text), 2) FROM generate_series(1, 1000) i;
+SELECT relname, (SELECT count(*) FROM columnar.stripe
+                 WHERE storage_id = columnar_test_helpers.columnar_relation_storageid(c.oid)) AS stripes
+FROM pg_class c WHERE relname LIKE 'write_limit\_%' ORDER BY relname;
+SELECT WriteStateContext * 4 / 3 / 1024 AS memory_limit
+FROM columnar_test_helpers.columnar_store_memory_stats() \gset
+SET LOCAL columnar.write_state_memory_limit TO :memory_limit;
+INSERT INTO write_limit SELECT i, 3, repeat(md5(i::text), 2) FROM generate_series(1, 36000) i;
+SELECT relname, (SELECT count(*) FROM columnar.stripe
+                 WHERE storage_id = columnar_test_helpers.columnar_relation_storageid(c.oid)) AS stripes
+FROM pg_class c WHERE relname LIKE 'write_limit\_%' ORDER BY relname;
+COMMIT;
+SELECT relname, (SELECT count(*) FROM columnar.stripe
+                 WHERE storage_id = columnar_test_helpers.columnar_relation_storageid(c.oid)) AS stripes
+FROM pg_class c WHERE relname LIKE 'write_limit\_%' ORDER BY relname;
+SELECT part, count(*), sum(id) FROM write_limit GROUP BY part ORDER BY part;
+DROP TABLE write_limit;
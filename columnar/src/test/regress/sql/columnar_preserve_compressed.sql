@@ -0,0 +1,26 @@
+CREATE SCHEMA columnar_preserve_compressed;
+SET search_path TO columnar_preserve_compressed;
+
+-- heap values this large are stored compressed inline
+CREATE TABLE heap_docs (id int, doc text);
+INSERT INTO heap_docs SELECT i, repeat('document ' || i || ' ', 4000) FROM generate_series(1, 3) i;
+
+SET columnar.preserve_compressed_values TO on;
+CREATE TABLE docs_preserved (id int, doc text) USING columnar;
+INSERT INTO docs_preserved SELECT * FROM heap_docs;
+RESET columnar.preserve_compressed_values;
+
+CREATE TABLE docs_detoasted (id int, doc text) USING columnar;
+INSERT INTO docs_detoasted SELECT * FROM heap_docs;
+
+-- preserved values keep their compressed size, but read the same
+SELECT h.id, pg_column_size(p.doc) < 2000 AS compressed,
+       pg_column_size(d.doc) > 40000 AS decompressed,
+       p.doc = h.doc AS same, length(p.doc)
+FROM heap_docs h JOIN docs_preserved p USING (id) JOIN docs_detoasted d USING (id)
+ORDER BY 1;
+
+SELECT count(*) FROM docs_preserved WHERE doc LIKE 'document 2 %';
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_preserve_compressed CASCADE;
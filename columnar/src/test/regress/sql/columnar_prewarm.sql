@@ -0,0 +1,20 @@
+--
+-- Test columnar.prewarm, which needs the shared column cache
+--
+CREATE TABLE t_prewarm(a int, b text) USING columnar;
+INSERT INTO t_prewarm SELECT i, md5(i::text) FROM generate_series(1, 1000) i;
+
+SELECT columnar.prewarm(NULL);
+
+SELECT columnar.prewarm('t_prewarm', columns => '{a,c}');
+
+-- the regression server runs without a shared column cache
+SELECT columnar.prewarm('t_prewarm');
+SELECT columnar.prewarm('t_prewarm', columns => '{b}', stripes => '{1}');
+SELECT columnar.autoprewarm_dump();
+
+CREATE TABLE t_prewarm_heap(a int);
+SELECT columnar.prewarm('t_prewarm_heap');
+DROP TABLE t_prewarm_heap;
+
+DROP TABLE t_prewarm;
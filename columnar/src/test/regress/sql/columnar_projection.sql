@@ -0,0 +1,69 @@
+--
+-- Test projection_group_by and projection_sum, which keep grouped counts and sums of each stripe
+--
+CREATE SCHEMA columnar_projection;
+SET search_path TO columnar_projection;
+
+CREATE FUNCTION projected_stripes(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Stripes Answered by Projection' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE sales (day int, region int, amount int, price float8, note text) USING columnar;
+SELECT columnar.alter_columnar_table_set('sales', projection_group_by => '{day,region}',
+                                         projection_sum => '{amount,price}');
+SELECT attnum, projection_group_by, projection_sum FROM columnar.column_options
+WHERE regclass = 'sales'::regclass ORDER BY attnum;
+
+INSERT INTO sales SELECT g % 10, g % 3, g, g, 'sale ' || g FROM generate_series(1, 3000) g;
+INSERT INTO sales SELECT g % 10, g % 3, g, g, 'sale ' || g FROM generate_series(3001, 6000) g;
+SELECT count(*) FROM columnar.stripe_projection
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('sales'::regclass);
+
+-- whole stripes are answered from their projections
+SELECT count(*), count(region), sum(amount), sum(price) FROM sales;
+SELECT projected_stripes('SELECT count(*), count(region), sum(amount), sum(price) FROM sales');
+SELECT count(*), sum(amount) FROM sales WHERE region = 1;
+SELECT projected_stripes('SELECT count(*), sum(amount) FROM sales WHERE region = 1');
+SET enable_sort TO false;
+SELECT day, count(*), sum(amount) FROM sales GROUP BY day ORDER BY day;
+SELECT projected_stripes('SELECT day, count(*), sum(amount) FROM sales GROUP BY day');
+RESET enable_sort;
+
+-- other columns and aggregates need the rows
+SELECT projected_stripes('SELECT count(note) FROM sales');
+SELECT projected_stripes('SELECT sum(amount) FROM sales WHERE amount > 10');
+SELECT projected_stripes('SELECT max(amount) FROM sales');
+SELECT projected_stripes('SELECT sum(day) FROM sales');
+
+-- stripes with deleted rows are read
+DELETE FROM sales WHERE amount = 1;
+SELECT count(*), count(region), sum(amount), sum(price) FROM sales;
+SELECT projected_stripes('SELECT count(*), count(region), sum(amount), sum(price) FROM sales');
+
+-- projection columns must have supported types
+SELECT columnar.alter_columnar_table_set('sales', projection_group_by => '{note}');
+SELECT columnar.alter_columnar_table_set('sales', projection_sum => '{note}');
+SELECT columnar.alter_columnar_table_set('sales', projection_sum => '{missing}');
+
+-- tables without projections read all their stripes
+SELECT columnar.alter_columnar_table_reset('sales', projection_group_by => true,
+                                           projection_sum => true);
+SELECT count(*) FROM columnar.column_options
+WHERE regclass = 'sales'::regclass AND (projection_group_by OR projection_sum);
+SELECT projected_stripes('SELECT count(*) FROM sales');
+
+RESET columnar.enable_parallel_execution;
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_projection CASCADE;
@@ -23,8 +23,30 @@ SELECT xmin FROM contestant;
 SELECT xmax FROM contestant;
 SELECT tableid FROM contestant;
 
--- sample scans should fail
-SELECT * FROM contestant TABLESAMPLE SYSTEM(0.1);
+-- sample scans
+SELECT count(*) FROM contestant TABLESAMPLE SYSTEM(100);
+SELECT count(*) FROM contestant TABLESAMPLE BERNOULLI(100);
+SELECT count(*) FROM contestant TABLESAMPLE SYSTEM(0);
+
+-- SYSTEM samples whole chunk groups
+SET columnar.chunk_group_row_limit = 1000;
+CREATE TABLE sample_test (a int) USING columnar;
+INSERT INTO sample_test SELECT generate_series(1, 100000);
+SELECT count(*) % 1000 = 0 AS whole_chunk_groups, count(*) BETWEEN 20000 AND 80000 AS about_half
+  FROM sample_test TABLESAMPLE SYSTEM (50) REPEATABLE (0);
+SELECT count(*) BETWEEN 40000 AND 60000 AS about_half
+  FROM sample_test TABLESAMPLE BERNOULLI (50) REPEATABLE (0);
+
+-- the same seed samples the same rows
+SELECT (SELECT sum(a) FROM sample_test TABLESAMPLE BERNOULLI (10) REPEATABLE (1)) =
+       (SELECT sum(a) FROM sample_test TABLESAMPLE BERNOULLI (10) REPEATABLE (1)) AS repeatable;
+
+-- deleted rows are not sampled
+DELETE FROM sample_test WHERE a <= 50000;
+SELECT count(*) FROM sample_test TABLESAMPLE SYSTEM (100);
+SELECT count(*) FROM sample_test TABLESAMPLE BERNOULLI (100);
+RESET columnar.chunk_group_row_limit;
+DROP TABLE sample_test;
 
 -- Query compressed data
 SELECT count(*) FROM contestant_compressed;
@@ -159,4 +181,44 @@ SELECT * FROM t WHERE a >= 90;
 
 SELECT * FROM t WHERE a >= 90;
 
-DROP TABLE t;
\ No newline at end of file
+DROP TABLE t;
+
+--
+-- [columnar] Vectorized comparisons with the constant on the left
+--
+
+CREATE TABLE t(a INT, b BIGINT) USING columnar;
+
+INSERT INTO t SELECT g, g FROM generate_series(1, 20000) AS g;
+
+SELECT count(*) FROM t WHERE 100 > a;
+
+SELECT count(*) FROM t WHERE a <= 100 AND 50 < b;
+
+SELECT count(*) FROM t WHERE a < 10 OR 19990 < b;
+
+DROP TABLE t;
+
+--
+-- [columnar] LIMIT loads stripes a few chunk groups at a time
+--
+
+set columnar.chunk_group_row_limit = 1000;
+
+CREATE TABLE t(a INT, b BIGINT) USING columnar;
+
+INSERT INTO t SELECT g, g FROM generate_series(1, 20000) AS g;
+
+set columnar.chunk_group_row_limit to default;
+
+DELETE FROM t WHERE a % 3 = 0;
+
+SELECT count(*), sum(a) FROM (SELECT a FROM t LIMIT 10) s;
+
+SELECT count(*), sum(a) FROM (SELECT a FROM t WHERE a % 1000 = 999 LIMIT 3) s;
+
+SELECT count(*) FROM (SELECT a FROM t LIMIT 20000) s;
+
+SELECT a FROM t OFFSET 5 LIMIT 3;
+
+DROP TABLE t;
@@ -0,0 +1,41 @@
+--
+-- Test columnar.read_state_memory_limit and columnar.memory_peaks
+--
+SET columnar.compression TO 'none';
+SET columnar.chunk_group_row_limit TO 1000;
+CREATE TABLE t_read_memory(a int, b text) USING columnar;
+RESET columnar.chunk_group_row_limit;
+RESET columnar.compression;
+
+SELECT write_state_peak IS NOT NULL FROM columnar.memory_peaks(reset => true);
+INSERT INTO t_read_memory SELECT i, md5(i::text) FROM generate_series(1, 100000) i;
+SELECT write_state_peak > 0 AS write_tracked FROM columnar.memory_peaks(reset => true);
+
+-- the whole stripe is loaded at once
+SELECT count(*), sum(length(b)), count(DISTINCT b) FROM t_read_memory;
+SELECT read_state_peak AS unlimited_peak FROM columnar.memory_peaks(reset => true) \gset
+
+-- the stripe is loaded a few chunk groups at a time, same results
+SET columnar.read_state_memory_limit TO '128kB';
+SELECT count(*), sum(length(b)), count(DISTINCT b) FROM t_read_memory;
+SELECT read_state_peak < :unlimited_peak AS lower_peak
+FROM columnar.memory_peaks(reset => true);
+
+SELECT sum(a) FROM t_read_memory WHERE a > 50000 AND b LIKE 'a%';
+SELECT a, b FROM t_read_memory WHERE a BETWEEN 98999 AND 99002 ORDER BY a;
+
+-- with a row bound
+SELECT a FROM t_read_memory LIMIT 3;
+
+RESET columnar.read_state_memory_limit;
+
+-- the chunks are loaded one chunk group at a time, same results
+SET columnar.enable_streaming_reads TO on;
+SELECT count(*), sum(length(b)), count(DISTINCT b) FROM t_read_memory;
+SELECT read_state_peak < :unlimited_peak AS lower_peak
+FROM columnar.memory_peaks(reset => true);
+SELECT sum(a) FROM t_read_memory WHERE a > 50000 AND b LIKE 'a%';
+SELECT a FROM t_read_memory LIMIT 3;
+RESET columnar.enable_streaming_reads;
+
+DROP TABLE t_read_memory;
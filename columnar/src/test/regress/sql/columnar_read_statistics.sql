@@ -0,0 +1,33 @@
+--
+-- Test the read statistics of columnar scans in EXPLAIN (ANALYZE, VERBOSE)
+--
+CREATE OR REPLACE FUNCTION columnar_read_statistics (query text) RETURNS SETOF text AS
+$$
+    DECLARE
+        rec text;
+    BEGIN
+        FOR rec IN EXECUTE 'EXPLAIN (analyze on, verbose on, costs off, timing off, summary off) ' || query LOOP
+            IF rec ~ '^\s+(Columnar Stripes|Columnar Chunk Groups Read|Rows Removed by Row Mask)' then
+                RETURN NEXT trim(rec);
+            END IF;
+        END LOOP;
+    END;
+$$ LANGUAGE PLPGSQL;
+
+set columnar.stripe_row_limit = 1000;
+set columnar.chunk_group_row_limit = 1000;
+set columnar.enable_parallel_execution to false;
+
+CREATE TABLE read_statistics (a int) USING columnar;
+INSERT INTO read_statistics SELECT generate_series(1, 10000);
+
+SELECT columnar_read_statistics('SELECT sum(a) FROM read_statistics WHERE a > 8500');
+
+DELETE FROM read_statistics WHERE a = 9000;
+SELECT columnar_read_statistics('SELECT sum(a) FROM read_statistics WHERE a > 8500');
+
+set columnar.stripe_row_limit to default;
+set columnar.chunk_group_row_limit to default;
+set columnar.enable_parallel_execution to default;
+DROP TABLE read_statistics;
+DROP FUNCTION columnar_read_statistics(text);
@@ -0,0 +1,62 @@
+CREATE SCHEMA columnar_recompress;
+SET search_path TO columnar_recompress;
+
+SET columnar.compression TO 'none';
+CREATE TABLE events (id int, payload text) USING columnar;
+INSERT INTO events SELECT i, repeat('event ' || (i % 10) || ' ', 20) FROM generate_series(1, 20000) i;
+INSERT INTO events SELECT i, repeat('event ' || (i % 10) || ' ', 20) FROM generate_series(20001, 30000) i;
+RESET columnar.compression;
+CREATE INDEX events_id ON events (id);
+DELETE FROM events WHERE id % 100 = 0;
+
+CREATE TEMP TABLE stripes_before AS
+SELECT stripe_num, first_row_number, row_count FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('events'::regclass);
+
+SELECT columnar.recompress('events', 'pglz');
+
+SELECT DISTINCT value_compression_type FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('events'::regclass)
+  AND attr_num = 2;
+
+-- rewritten stripes keep their row numbers under a new stripe id
+SELECT count(*) FROM columnar.stripe s JOIN stripes_before b USING (first_row_number, row_count)
+WHERE s.storage_id = columnar_test_helpers.columnar_relation_storageid('events'::regclass)
+  AND s.stripe_num > b.stripe_num;
+
+SELECT sum(id), count(*), count(DISTINCT payload) FROM events;
+
+SET enable_seqscan TO off;
+SELECT count(*) FROM events WHERE id IN (12300, 12345);
+RESET enable_seqscan;
+
+-- deletes still find the moved row masks
+DELETE FROM events WHERE id = 12345;
+SELECT sum(id), count(*) FROM events;
+
+SELECT columnar.recompress('events', 'pglz', older_than => '30 days');
+
+-- dropped columns are reclaimed, the other columns are copied as they are
+CREATE TABLE wide(a int, b text, c int) USING columnar;
+INSERT INTO wide SELECT i, md5(i::text), i * 2 FROM generate_series(1, 1000) i;
+INSERT INTO wide SELECT i, md5(i::text), i * 2 FROM generate_series(1001, 2000) i;
+ALTER TABLE wide DROP COLUMN b;
+
+SELECT columnar_test_helpers.columnar_relation_storageid('wide'::regclass) AS wide_storage_id \gset
+SELECT sum(data_length) AS wide_length FROM columnar.stripe
+WHERE storage_id = :wide_storage_id \gset
+
+SELECT columnar.reclaim_dropped_columns('wide');
+SELECT columnar.reclaim_dropped_columns('wide');
+
+SELECT sum(data_length) < :wide_length AS smaller FROM columnar.stripe
+WHERE storage_id = :wide_storage_id;
+SELECT count(*) FROM columnar.chunk
+WHERE storage_id = :wide_storage_id AND attr_num = 2
+  AND value_stream_length + exists_stream_length > 0;
+
+SELECT sum(a), sum(c), count(*) FROM wide;
+SELECT * FROM wide WHERE a = 1500;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_recompress CASCADE;
@@ -0,0 +1,43 @@
+CREATE SCHEMA columnar_run_length;
+SET search_path TO columnar_run_length;
+
+CREATE TABLE test_run_length (a int, b int) USING columnar;
+INSERT INTO test_run_length SELECT i / 1000, i FROM generate_series(1, 20000) i;
+
+SELECT columnar_test_helpers.columnar_relation_storageid(oid) AS test_run_length_storage_id
+FROM pg_class WHERE relname = 'test_run_length' \gset
+
+-- only the column with repeated values is run length encoded, the other one
+-- is bit packed
+SELECT DISTINCT attr_num, value_encoding_type FROM columnar.chunk
+WHERE storage_id = :test_run_length_storage_id ORDER BY attr_num;
+
+SELECT count(a), sum(a), min(a), max(a) FROM test_run_length;
+SELECT count(*) FROM test_run_length WHERE a = 5;
+SELECT count(*) FROM test_run_length WHERE a > 18;
+SELECT a, count(*) FROM test_run_length WHERE b % 1000 = 0 GROUP BY a ORDER BY a LIMIT 3;
+
+-- runs of nulls
+CREATE TABLE test_run_length_nulls (a int) USING columnar;
+INSERT INTO test_run_length_nulls
+SELECT CASE WHEN i % 4000 < 2000 THEN NULL ELSE i / 2000 END FROM generate_series(1, 10000) i;
+
+SELECT DISTINCT value_encoding_type FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_run_length_nulls'::regclass);
+
+SELECT count(*), count(a), sum(a), min(a), max(a) FROM test_run_length_nulls;
+SELECT count(*) FROM test_run_length_nulls WHERE a = 3;
+
+-- verify encoding can be disabled
+SET columnar.enable_run_length_encoding TO off;
+INSERT INTO test_run_length SELECT i / 1000, i FROM generate_series(1, 10000) i;
+RESET columnar.enable_run_length_encoding;
+
+SELECT value_encoding_type, count(*) FROM columnar.chunk
+WHERE storage_id = :test_run_length_storage_id AND attr_num = 1
+GROUP BY value_encoding_type ORDER BY value_encoding_type;
+
+SELECT count(a), sum(a) FROM test_run_length;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_run_length CASCADE;
@@ -0,0 +1,44 @@
+--
+-- Test the shared column cache, which the server running this schedule
+-- enables with columnar.shared_column_cache_size
+--
+CREATE SCHEMA columnar_shared_cache;
+SET search_path TO columnar_shared_cache;
+
+SET columnar.enable_parallel_execution TO false;
+SET columnar.enable_column_cache TO true;
+
+-- a single stripe of ten chunk groups
+CREATE TABLE t_cache(a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('t_cache', chunk_group_row_limit => 1000);
+INSERT INTO t_cache SELECT i, 'value ' || i FROM generate_series(1, 10000) i;
+SELECT columnar_test_helpers.columnar_relation_storageid('t_cache'::regclass) AS storage_id \gset
+SELECT count(*) FROM columnar.stripe WHERE storage_id = :storage_id;
+
+-- queries with different quals read different chunk groups of the same
+-- stripe, each one the only chunk group they select
+SELECT a, b FROM t_cache WHERE a BETWEEN 5001 AND 5003 ORDER BY a;
+SELECT a, b FROM t_cache WHERE a BETWEEN 1 AND 3 ORDER BY a;
+SELECT a, b FROM t_cache WHERE a BETWEEN 9998 AND 10000 ORDER BY a;
+SELECT a, b FROM t_cache WHERE a BETWEEN 5001 AND 5003 ORDER BY a;
+
+-- two chunk groups at once, then one of them alone
+SELECT count(*), sum(a), min(b), max(b) FROM t_cache WHERE a BETWEEN 2500 AND 3500;
+SELECT count(*), sum(a), min(b), max(b) FROM t_cache WHERE a BETWEEN 3001 AND 3500;
+SELECT count(*), sum(a + 0), sum(length(b)) FROM t_cache;
+
+-- the scans above cached every chunk already
+SELECT columnar.prewarm('t_cache');
+SELECT columnar.autoprewarm_dump() > 0;
+
+-- chunks of a new table are loaded by prewarm and read from the cache
+CREATE TABLE t_prewarm(a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('t_prewarm', chunk_group_row_limit => 1000);
+INSERT INTO t_prewarm SELECT i, 'value ' || i FROM generate_series(1, 5000) i;
+SELECT columnar.prewarm('t_prewarm', columns => '{a}') > 0;
+SELECT columnar.prewarm('t_prewarm', columns => '{a}');
+SELECT a, b FROM t_prewarm WHERE a BETWEEN 4001 AND 4002 ORDER BY a;
+SELECT a, b FROM t_prewarm WHERE a BETWEEN 1 AND 2 ORDER BY a;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_shared_cache CASCADE;
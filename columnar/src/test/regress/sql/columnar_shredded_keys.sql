@@ -0,0 +1,68 @@
+--
+-- Test shredded_keys, which keep statistics of keys of jsonb columns per chunk
+--
+CREATE SCHEMA columnar_shredded_keys;
+SET search_path TO columnar_shredded_keys;
+
+CREATE FUNCTION filtered_chunk_groups(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Columnar Chunk Groups Removed by Filter' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+-- only the statistics should skip chunk groups
+SET columnar.enable_parallel_execution TO false;
+SET columnar.enable_late_materialization TO false;
+
+CREATE TABLE events (id int, payload jsonb) USING columnar;
+SELECT columnar.alter_columnar_table_set('events', chunk_group_row_limit => 1000,
+                                         shredded_keys => '{payload=country,payload=referrer}');
+SELECT attnum, shredded_keys FROM columnar.column_options
+WHERE regclass = 'events'::regclass ORDER BY attnum;
+
+INSERT INTO events
+SELECT g, jsonb_build_object('country', 'c' || ((g - 1) / 1000), 'amount', g) ||
+          CASE WHEN g <= 1000 THEN '{"referrer": "ads"}'::jsonb ELSE '{}' END
+FROM generate_series(1, 10000) g;
+SELECT attr_num, count(*) FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('events'::regclass)
+      AND shredded_key_stats IS NOT NULL
+GROUP BY 1 ORDER BY 1;
+
+SELECT filtered_chunk_groups($$SELECT count(*) FROM events WHERE payload->>'country' = 'c3'$$);
+SELECT count(*) FROM events WHERE payload->>'country' = 'c3';
+SELECT filtered_chunk_groups($$SELECT count(*) FROM events WHERE 'c3' = payload->>'country'$$);
+SELECT filtered_chunk_groups($$SELECT count(*) FROM events WHERE payload->>'referrer' IS NOT NULL$$);
+SELECT count(*) FROM events WHERE payload->>'referrer' IS NOT NULL;
+
+-- ranges need the order of the bounds
+SELECT filtered_chunk_groups($$SELECT count(*) FROM events WHERE (payload->>'country') COLLATE "C" > 'c7'$$);
+SELECT count(*) FROM events WHERE (payload->>'country') COLLATE "C" > 'c7';
+
+-- keys without statistics are read
+SELECT filtered_chunk_groups($$SELECT count(*) FROM events WHERE payload->>'amount' = '5'$$);
+SELECT count(*) FROM events WHERE payload->>'amount' = '5';
+
+SELECT columnar.alter_columnar_table_set('events', shredded_keys => '{id=country}');
+SELECT columnar.alter_columnar_table_set('events', shredded_keys => '{payload}');
+SELECT columnar.alter_columnar_table_set('events', shredded_keys => '{missing=country}');
+
+-- chunks written without the option have no statistics
+SELECT columnar.alter_columnar_table_reset('events', shredded_keys => true);
+SELECT count(*) FROM columnar.column_options
+WHERE regclass = 'events'::regclass AND shredded_keys IS NOT NULL;
+INSERT INTO events SELECT g, jsonb_build_object('country', 'c10') FROM generate_series(10001, 11000) g;
+SELECT filtered_chunk_groups($$SELECT count(*) FROM events WHERE payload->>'country' = 'c3'$$);
+
+RESET columnar.enable_late_materialization;
+RESET columnar.enable_parallel_execution;
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_shredded_keys CASCADE;
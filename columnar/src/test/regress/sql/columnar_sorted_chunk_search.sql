@@ -0,0 +1,55 @@
+--
+-- Test binary searching sorted chunks for the rows range quals select
+--
+CREATE SCHEMA columnar_sorted_chunk_search;
+SET search_path TO columnar_sorted_chunk_search;
+
+CREATE FUNCTION rows_removed_by_sorted_search(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := 0;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, verbose on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Rows Removed by Sorted Search' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+-- chunks are searched by row by row reads
+SET columnar.enable_vectorization TO false;
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE events (id int, v int) USING columnar;
+SELECT columnar.alter_columnar_table_set('events', chunk_group_row_limit => 1000);
+INSERT INTO events SELECT g, (g * 7919) % 10000 FROM generate_series(1, 10000) g;
+
+SELECT rows_removed_by_sorted_search($$SELECT sum(v) FROM events WHERE id BETWEEN 4101 AND 4110$$);
+SELECT count(*), sum(id) FROM events WHERE id BETWEEN 4101 AND 4110;
+SELECT rows_removed_by_sorted_search($$SELECT sum(v) FROM events WHERE id = 7777$$);
+SELECT id, v FROM events WHERE id = 7777;
+
+-- the range spans two chunk groups, with the constant on the left side
+SELECT rows_removed_by_sorted_search($$SELECT sum(v) FROM events WHERE 4995 < id AND id <= 5005$$);
+SELECT count(*), min(id), max(id) FROM events WHERE 4995 < id AND id <= 5005;
+
+-- values that aren't sorted are all read
+SELECT rows_removed_by_sorted_search($$SELECT sum(id) FROM events WHERE v < 10$$);
+SELECT count(*) FROM events WHERE v < 10;
+
+-- deleted rows in the range are still left out
+DELETE FROM events WHERE id = 4105;
+SELECT rows_removed_by_sorted_search($$SELECT sum(v) FROM events WHERE id BETWEEN 4101 AND 4110$$);
+SELECT count(*), sum(id) FROM events WHERE id BETWEEN 4101 AND 4110;
+
+SET columnar.enable_sorted_chunk_search TO false;
+SELECT rows_removed_by_sorted_search($$SELECT sum(v) FROM events WHERE id BETWEEN 4101 AND 4110$$);
+SELECT count(*), sum(id) FROM events WHERE id BETWEEN 4101 AND 4110;
+RESET columnar.enable_sorted_chunk_search;
+
+RESET columnar.enable_parallel_execution;
+RESET columnar.enable_vectorization;
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_sorted_chunk_search CASCADE;
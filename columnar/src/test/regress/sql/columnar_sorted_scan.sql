@@ -0,0 +1,86 @@
+--
+-- Test columnar scans that return the rows in the order of the sort key
+--
+CREATE SCHEMA columnar_sorted_scan;
+SET search_path TO columnar_sorted_scan;
+
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE readings (ts int, v int) USING columnar;
+SELECT columnar.alter_columnar_table_set('readings', chunk_group_row_limit => 1000);
+
+-- written before the sort key, so sorted when the scan starts
+INSERT INTO readings SELECT (g * 7) % 500, g FROM generate_series(1, 500) g;
+
+SELECT columnar.alter_columnar_table_set('readings', sort_key => 'ts');
+
+-- the second stripe overlaps the first one, the third one follows it
+INSERT INTO readings SELECT 3000 - g, g FROM generate_series(1, 2000) g;
+INSERT INTO readings SELECT g, g FROM generate_series(500, 1500) g;
+INSERT INTO readings SELECT g, g FROM generate_series(3000, 3500) g;
+INSERT INTO readings VALUES (NULL, 0);
+
+EXPLAIN (costs off) SELECT ts FROM readings ORDER BY ts;
+EXPLAIN (costs off) SELECT ts FROM readings ORDER BY ts LIMIT 5;
+
+SELECT ts FROM readings ORDER BY ts LIMIT 5;
+SELECT ts FROM readings ORDER BY ts OFFSET 4000;
+SELECT ts FROM readings WHERE ts BETWEEN 1498 AND 1502 ORDER BY ts;
+
+-- every row comes after the one before it
+SELECT count(*) FROM (
+    SELECT ts, lag(ts) OVER (ORDER BY ts) AS prev,
+           row_number() OVER (ORDER BY ts) AS rn
+    FROM readings) rows
+WHERE ts < prev OR (ts IS NOT NULL AND prev IS NULL AND rn > 1);
+
+SET columnar.enable_sorted_scan TO false;
+EXPLAIN (costs off) SELECT ts FROM readings ORDER BY ts;
+RESET columnar.enable_sorted_scan;
+
+-- running totals, lag and lead run in a vector window node
+CREATE TABLE ticks (ts int, region int, price int, volume float8) USING columnar;
+SELECT columnar.alter_columnar_table_set('ticks', sort_key => 'ts');
+INSERT INTO ticks SELECT g, g % 3, CASE WHEN g % 7 = 0 THEN NULL ELSE g % 100 END, g * 0.5
+FROM generate_series(1, 25000) g;
+
+EXPLAIN (costs off)
+SELECT ts, row_number() OVER w, sum(price) OVER w, lag(price, 2) OVER w, lead(price) OVER w
+FROM ticks WINDOW w AS (ORDER BY ts ROWS UNBOUNDED PRECEDING);
+
+SELECT count(*), sum(total), sum(cnt * rn), sum(prev * rn), sum(next * rn) FROM (
+    SELECT row_number() OVER w AS rn, sum(price) OVER w AS total, count(price) OVER w AS cnt,
+           lag(price, 2) OVER w AS prev, lead(price) OVER w AS next
+    FROM ticks WINDOW w AS (ORDER BY ts ROWS UNBOUNDED PRECEDING)) s;
+
+EXPLAIN (costs off)
+SELECT region, ts, row_number() OVER w, sum(volume) OVER w, count(*) OVER w,
+       sum(price) OVER w, lag(price, 3, -1) OVER w
+FROM ticks WINDOW w AS (PARTITION BY region ORDER BY ts ROWS 5 PRECEDING);
+
+SELECT count(*), sum(rn * ts), sum(vol), sum(n), sum(total), sum(prev * rn) FROM (
+    SELECT ts, row_number() OVER w AS rn, sum(volume) OVER w AS vol, count(*) OVER w AS n,
+           sum(price) OVER w AS total, lag(price, 3, -1) OVER w AS prev
+    FROM ticks WINDOW w AS (PARTITION BY region ORDER BY ts ROWS 5 PRECEDING)) s;
+
+SET columnar.enable_vectorized_window TO false;
+
+SELECT count(*), sum(total), sum(cnt * rn), sum(prev * rn), sum(next * rn) FROM (
+    SELECT row_number() OVER w AS rn, sum(price) OVER w AS total, count(price) OVER w AS cnt,
+           lag(price, 2) OVER w AS prev, lead(price) OVER w AS next
+    FROM ticks WINDOW w AS (ORDER BY ts ROWS UNBOUNDED PRECEDING)) s;
+
+SELECT count(*), sum(rn * ts), sum(vol), sum(n), sum(total), sum(prev * rn) FROM (
+    SELECT ts, row_number() OVER w AS rn, sum(volume) OVER w AS vol, count(*) OVER w AS n,
+           sum(price) OVER w AS total, lag(price, 3, -1) OVER w AS prev
+    FROM ticks WINDOW w AS (PARTITION BY region ORDER BY ts ROWS 5 PRECEDING)) s;
+
+RESET columnar.enable_vectorized_window;
+
+-- the default frame includes the peers of the current row
+EXPLAIN (costs off) SELECT ts, sum(price) OVER (ORDER BY ts) FROM ticks;
+
+RESET columnar.enable_parallel_execution;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_sorted_scan CASCADE;
@@ -0,0 +1,42 @@
+--
+-- Test the cumulative statistics in columnar.pg_stat_columnar
+--
+
+CREATE TABLE t_stat(a int, b text) USING columnar;
+SELECT 't_stat'::regclass::oid AS t_stat_oid \gset
+
+INSERT INTO t_stat SELECT i, i::text FROM generate_series(1, 1000) i;
+
+SELECT relname, rows_written, stripes_flushed, stripes_scanned
+FROM columnar.pg_stat_columnar WHERE relid = 't_stat'::regclass;
+
+SELECT sum(length(b)) FROM t_stat WHERE a > 0;
+
+SELECT stripes_scanned, chunk_groups_scanned, bytes_read > 0 AS read,
+       vectorized_rows + row_path_rows AS rows
+FROM columnar.pg_stat_columnar WHERE relid = 't_stat'::regclass;
+
+-- chunk groups refuted by the where clause are skipped
+SELECT sum(a) FROM t_stat WHERE a > 5000;
+
+SELECT stripes_skipped + chunk_groups_skipped > 0 AS skipped
+FROM columnar.pg_stat_columnar WHERE relid = 't_stat'::regclass;
+
+-- counters of the current transaction show up before it commits
+BEGIN;
+INSERT INTO t_stat SELECT i, i::text FROM generate_series(1001, 1100) i;
+SELECT rows_written FROM columnar.pg_stat_columnar WHERE relid = 't_stat'::regclass;
+ROLLBACK;
+
+SELECT columnar.stat_reset('t_stat');
+SELECT count(*) FROM columnar.pg_stat_columnar WHERE relid = 't_stat'::regclass;
+
+SELECT sum(a) FROM t_stat;
+SELECT count(*) FROM columnar.pg_stat_columnar WHERE relid = 't_stat'::regclass;
+
+-- dropping the table removes its statistics
+DROP TABLE t_stat;
+SELECT count(*) FROM columnar.stat_relations() WHERE relid = :t_stat_oid;
+
+-- columnar wait events of backends, none of this one is waiting
+SELECT count(*) FROM columnar.wait_events() WHERE pid = pg_backend_pid();
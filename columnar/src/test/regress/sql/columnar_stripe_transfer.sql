@@ -0,0 +1,42 @@
+--
+-- Test columnar.export_stripes and columnar.import_stripe, which copy stripes in their compressed form
+--
+CREATE SCHEMA columnar_stripe_transfer;
+SET search_path TO columnar_stripe_transfer;
+
+CREATE TABLE events (id int, payload text, price float8) USING columnar;
+INSERT INTO events SELECT i, 'event ' || (i % 10), i / 4.0 FROM generate_series(1, 20000) i;
+INSERT INTO events
+SELECT i, CASE WHEN i % 7 = 0 THEN NULL ELSE 'event ' || (i % 10) END, i / 4.0
+FROM generate_series(20001, 30000) i;
+
+-- the stripes keep all rows, values and chunk metadata
+CREATE TABLE events_copy (id int, payload text, price float8) USING columnar;
+SELECT sum(columnar.import_stripe('events_copy', s)) FROM columnar.export_stripes('events') s;
+
+SELECT count(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('events_copy'::regclass);
+SELECT count(*), sum(id), count(payload) FROM events_copy;
+SELECT count(*) FROM (TABLE events EXCEPT TABLE events_copy) diff;
+SELECT count(*) FROM events_copy WHERE id BETWEEN 100 AND 200;
+
+-- columns are matched by position and must have the same types
+CREATE TABLE events_int (id int, payload int, price float8) USING columnar;
+SELECT columnar.import_stripe('events_int', s) FROM columnar.export_stripes('events') s;
+
+CREATE TABLE events_not_null (id int, payload text NOT NULL, price float8) USING columnar;
+SELECT sum(columnar.import_stripe('events_not_null', s)) FROM columnar.export_stripes('events') s;
+
+CREATE TABLE events_indexed (id int PRIMARY KEY, payload text, price float8) USING columnar;
+SELECT columnar.import_stripe('events_indexed', s) FROM columnar.export_stripes('events') s;
+
+SELECT columnar.import_stripe('events_copy', '\x00'::bytea);
+
+-- deleted rows would be lost with their stripe
+BEGIN;
+DELETE FROM events WHERE id = 1;
+SELECT count(*) FROM columnar.export_stripes('events');
+ROLLBACK;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_stripe_transfer CASCADE;
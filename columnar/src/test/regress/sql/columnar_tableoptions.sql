@@ -129,6 +129,65 @@ SELECT columnar.alter_columnar_table_reset(
 SELECT * FROM columnar.options
 WHERE regclass = 'table_options'::regclass;
 
+-- set and reset the cache quota
+SELECT columnar.alter_columnar_table_set('table_options', cache_quota => 64);
+SELECT cache_quota FROM columnar.options WHERE regclass = 'table_options'::regclass;
+SELECT columnar.alter_columnar_table_reset('table_options', cache_quota => true);
+SELECT cache_quota FROM columnar.options WHERE regclass = 'table_options'::regclass;
+
+-- set and reset bloom filter columns
+SELECT columnar.alter_columnar_table_set('table_options', bloom_filter_columns => '{a}');
+SELECT attnum, bloom_filter FROM columnar.column_options WHERE regclass = 'table_options'::regclass;
+SELECT columnar.alter_columnar_table_reset('table_options', bloom_filter_columns => true);
+SELECT count(*) FROM columnar.column_options WHERE regclass = 'table_options'::regclass;
+
+-- set and reset per column compression
+SELECT columnar.alter_columnar_table_set('table_options', column_compression => '{a=none}');
+SELECT attnum, compression, compression_level FROM columnar.column_options WHERE regclass = 'table_options'::regclass;
+SELECT columnar.alter_columnar_table_set('table_options', column_compression => '{a=pglz:5}');
+SELECT attnum, compression, compression_level FROM columnar.column_options WHERE regclass = 'table_options'::regclass;
+SELECT columnar.alter_columnar_table_reset('table_options', column_compression => true);
+SELECT count(*) FROM columnar.column_options WHERE regclass = 'table_options'::regclass;
+
+-- chunks of a column are compressed with the compression of the column
+CREATE TABLE column_compression (a text, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('column_compression', compression => 'pglz',
+                                         column_compression => '{b=none}');
+INSERT INTO column_compression SELECT repeat('x', 100), repeat('x', 100) FROM generate_series(1, 1000);
+SELECT attr_num, value_compression_type FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('column_compression'::regclass)
+ORDER BY attr_num;
+DROP TABLE column_compression;
+
+-- rows of each stripe are sorted by the sort key before they are written
+CREATE TABLE sort_key_test (a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('sort_key_test', sort_key => 'a');
+SELECT attnum, sort_key FROM columnar.column_options WHERE regclass = 'sort_key_test'::regclass;
+INSERT INTO sort_key_test SELECT i % 3, 'row ' || i FROM generate_series(1, 6) i;
+SELECT * FROM sort_key_test;
+SELECT columnar.alter_columnar_table_set('sort_key_test', sort_key => 'c');
+-- tables with indexes keep the insertion order
+CREATE INDEX sort_key_test_b_idx ON sort_key_test (b);
+INSERT INTO sort_key_test VALUES (1, 'row 7'), (0, 'row 8');
+SELECT b FROM sort_key_test OFFSET 6;
+SELECT columnar.alter_columnar_table_reset('sort_key_test', sort_key => true);
+SELECT count(*) FROM columnar.column_options WHERE regclass = 'sort_key_test'::regclass;
+DROP TABLE sort_key_test;
+
+-- zorder_columns interleave the order of several columns
+CREATE TABLE zorder_test (x int, y int) USING columnar;
+SELECT columnar.alter_columnar_table_set('zorder_test', zorder_columns => '{x,y}');
+SELECT attnum, sort_key FROM columnar.column_options WHERE regclass = 'zorder_test'::regclass ORDER BY attnum;
+INSERT INTO zorder_test SELECT x, y FROM generate_series(3, 0, -1) x, generate_series(0, 3) y;
+SELECT * FROM zorder_test;
+SELECT columnar.alter_columnar_table_set('zorder_test', zorder_columns => '{x}');
+SELECT columnar.alter_columnar_table_set('zorder_test', sort_key => 'y');
+SELECT attnum, sort_key FROM columnar.column_options WHERE regclass = 'zorder_test'::regclass ORDER BY attnum;
+SELECT columnar.alter_columnar_table_set('zorder_test', zorder_columns => '{y,x}');
+SELECT columnar.alter_columnar_table_reset('zorder_test', zorder_columns => true);
+SELECT count(*) FROM columnar.column_options WHERE regclass = 'zorder_test'::regclass;
+DROP TABLE zorder_test;
+
 -- verify edge cases
 -- first start with a table that is not a columnar table
 CREATE TABLE not_a_columnar_table (a int);
@@ -142,6 +201,23 @@ SELECT columnar.alter_columnar_table_set('table_options', compression => 'foobar
 SELECT columnar.alter_columnar_table_set('table_options', compression_level => 0);
 SELECT columnar.alter_columnar_table_set('table_options', compression_level => 20);
 
+-- verify cannot set out of range cache quotas
+SELECT columnar.alter_columnar_table_set('table_options', cache_quota => -1);
+SELECT columnar.alter_columnar_table_set('table_options', cache_quota => 20001);
+
+-- verify cannot add bloom filters to unknown columns
+SELECT columnar.alter_columnar_table_set('table_options', bloom_filter_columns => '{b}');
+
+-- verify per column compression is validated
+SELECT columnar.alter_columnar_table_set('table_options', column_compression => '{b=pglz}');
+SELECT columnar.alter_columnar_table_set('table_options', column_compression => '{a=foobar}');
+SELECT columnar.alter_columnar_table_set('table_options', column_compression => '{a=pglz:20}');
+SELECT columnar.alter_columnar_table_set('table_options', column_compression => '{a}');
+
+-- verify cannot set out of range stripe_size_limit
+SELECT columnar.alter_columnar_table_set('table_options', stripe_size_limit => -1);
+SELECT columnar.alter_columnar_table_set('table_options', stripe_size_limit => 1073741825);
+
 -- verify cannot set out of range stripe_row_limit & chunk_group_row_limit options
 SELECT columnar.alter_columnar_table_set('table_options', stripe_row_limit => 999);
 SELECT columnar.alter_columnar_table_set('table_options', stripe_row_limit => 100000001);
@@ -150,6 +226,14 @@ SELECT columnar.alter_columnar_table_set('table_options', chunk_group_row_limit
 SELECT columnar.alter_columnar_table_set('table_options', chunk_group_row_limit => 0);
 INSERT INTO table_options VALUES (1);
 
+-- verify stripes are flushed once their buffers reach stripe_size_limit
+CREATE TABLE table_options_wide (a int, b text) USING columnar;
+SELECT columnar.alter_columnar_table_set('table_options_wide', stripe_size_limit => 1048576);
+INSERT INTO table_options_wide SELECT i, repeat(md5(i::text), 10) FROM generate_series(1, 20000) i;
+SELECT count(*) > 1 AS flushed_by_size, sum(row_count) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('table_options_wide'::regclass);
+DROP TABLE table_options_wide;
+
 -- verify options are removed when table is dropped
 DROP TABLE table_options;
 -- we expect no entries in çstore.options for anything not found int pg_class
@@ -89,6 +89,11 @@ CREATE FUNCTION top_memory_context_usage()
 		SELECT TopMemoryContext FROM columnar_test_helpers.columnar_store_memory_stats();
 	$$ LANGUAGE SQL VOLATILE;
 
+CREATE FUNCTION columnar_compact_relation(rel regclass)
+    RETURNS BOOLEAN
+    LANGUAGE C STRICT VOLATILE
+    AS 'columnar', $$columnar_compact_relation$$;
+
 CREATE OR REPLACE FUNCTION uses_index_scan(command text)
 RETURNS BOOLEAN AS $$
 DECLARE
@@ -140,3 +145,66 @@ BEGIN
     PERFORM pg_sleep(0.001);
   END LOOP;
 END; $$ language plpgsql;
+
+-- microbenchmarks, see columnar_benchmark.c
+CREATE FUNCTION benchmark_write(
+    rel regclass,
+    row_count int,
+    data_shape text DEFAULT 'sequential',
+    benchmark OUT text,
+    runs OUT int,
+    rows OUT bigint,
+    bytes OUT bigint,
+    elapsed_ms OUT float8,
+    rows_per_sec OUT float8,
+    mb_per_sec OUT float8)
+  RETURNS SETOF record
+  STRICT
+  LANGUAGE c AS 'columnar', $$columnar_benchmark_write$$;
+
+CREATE FUNCTION benchmark_read(
+    rel regclass,
+    vectorized bool DEFAULT false,
+    iterations int DEFAULT 1,
+    benchmark OUT text,
+    runs OUT int,
+    rows OUT bigint,
+    bytes OUT bigint,
+    elapsed_ms OUT float8,
+    rows_per_sec OUT float8,
+    mb_per_sec OUT float8)
+  RETURNS SETOF record
+  STRICT
+  LANGUAGE c AS 'columnar', $$columnar_benchmark_read$$;
+
+CREATE FUNCTION benchmark_codec(
+    compression name,
+    data_shape text DEFAULT 'sequential',
+    size int DEFAULT 1048576,
+    iterations int DEFAULT 10,
+    benchmark OUT text,
+    runs OUT int,
+    rows OUT bigint,
+    bytes OUT bigint,
+    elapsed_ms OUT float8,
+    rows_per_sec OUT float8,
+    mb_per_sec OUT float8)
+  RETURNS SETOF record
+  STRICT
+  LANGUAGE c AS 'columnar', $$columnar_benchmark_codec$$;
+
+CREATE FUNCTION benchmark_kernel(
+    kernel regprocedure,
+    data_shape text DEFAULT 'sequential',
+    row_count int DEFAULT 10000,
+    iterations int DEFAULT 1000,
+    benchmark OUT text,
+    runs OUT int,
+    rows OUT bigint,
+    bytes OUT bigint,
+    elapsed_ms OUT float8,
+    rows_per_sec OUT float8,
+    mb_per_sec OUT float8)
+  RETURNS SETOF record
+  STRICT
+  LANGUAGE c AS 'columnar', $$columnar_benchmark_kernel$$;
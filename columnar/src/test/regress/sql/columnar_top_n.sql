@@ -0,0 +1,48 @@
+--
+-- Test the top-N filter of columnar scans below a sort with a limit
+--
+CREATE SCHEMA columnar_top_n;
+SET search_path TO columnar_top_n;
+
+CREATE FUNCTION top_n_rows_removed(query text) RETURNS bigint AS $$
+DECLARE
+    rec text;
+    result bigint := -1;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (analyze on, costs off, timing off, summary off) ' || query LOOP
+        IF rec ~ 'Rows Removed by Top-N Filter' THEN
+            result := regexp_replace(rec, '[^0-9]*', '', 'g');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE events (id int, kind text) USING columnar;
+SELECT columnar.alter_columnar_table_set('events', chunk_group_row_limit => 1000);
+INSERT INTO events SELECT g, 'kind ' || (g % 7) FROM generate_series(1, 10000) g;
+INSERT INTO events VALUES (NULL, NULL), (5, 'tie');
+
+EXPLAIN (costs off) SELECT * FROM events ORDER BY id LIMIT 3;
+
+SELECT * FROM events ORDER BY id, kind LIMIT 3;
+SELECT * FROM events ORDER BY id DESC LIMIT 3;
+SELECT * FROM events ORDER BY id NULLS FIRST LIMIT 3;
+SELECT * FROM events ORDER BY id, kind FETCH FIRST 5 ROWS WITH TIES;
+SELECT * FROM events WHERE kind = 'kind 3' ORDER BY id LIMIT 2;
+SELECT id FROM events ORDER BY kind DESC, id LIMIT 2;
+
+-- rows after the bound are left out once the scan returned enough rows
+SELECT top_n_rows_removed('SELECT * FROM events ORDER BY id LIMIT 3') > 0;
+
+SET columnar.enable_top_n_filter TO false;
+SELECT top_n_rows_removed('SELECT * FROM events ORDER BY id LIMIT 3');
+SELECT * FROM events ORDER BY id, kind LIMIT 3;
+RESET columnar.enable_top_n_filter;
+
+RESET columnar.enable_parallel_execution;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_top_n CASCADE;
@@ -103,3 +103,93 @@ SELECT COUNT(*) from columnar_transaction_update;
 SELECT COUNT(*) from columnar_transaction_update WHERE j = -1;
 
 DROP TABLE columnar_transaction_update;
+
+-- deleted rows in whole and partial words of the row mask
+CREATE TABLE columnar_mask_words (a int) USING columnar;
+INSERT INTO columnar_mask_words SELECT g FROM generate_series(1, 20000) g;
+DELETE FROM columnar_mask_words WHERE a BETWEEN 129 AND 320 OR a % 7 = 0 OR a BETWEEN 1001 AND 1064;
+SELECT count(*), sum(a) FROM columnar_mask_words;
+SELECT count(*), sum(a) FROM columnar_mask_words WHERE a % 2 = 0;
+SET columnar.enable_vectorization TO false;
+SELECT count(*), sum(a) FROM columnar_mask_words;
+SELECT count(*), sum(a) FROM columnar_mask_words WHERE a % 2 = 0;
+RESET columnar.enable_vectorization;
+DROP TABLE columnar_mask_words;
+
+-- row masks kept across the statements of a transaction
+CREATE TABLE columnar_xact_masks (a int) USING columnar;
+INSERT INTO columnar_xact_masks SELECT g FROM generate_series(1, 10000) g;
+DELETE FROM columnar_xact_masks WHERE a % 10 = 0;
+BEGIN ISOLATION LEVEL REPEATABLE READ;
+SELECT count(*), sum(a) FROM columnar_xact_masks;
+SELECT count(*), sum(a) FROM columnar_xact_masks;
+DELETE FROM columnar_xact_masks WHERE a % 3 = 0;
+SELECT count(*), sum(a) FROM columnar_xact_masks;
+SAVEPOINT s1;
+DELETE FROM columnar_xact_masks WHERE a <= 1000;
+SELECT count(*) FROM columnar_xact_masks;
+ROLLBACK TO SAVEPOINT s1;
+SELECT count(*) FROM columnar_xact_masks;
+COMMIT;
+DROP TABLE columnar_xact_masks;
+
+-- chunk groups whose rows all pass the WHERE clause of a DELETE
+SET columnar.chunk_group_row_limit = 1000;
+CREATE TABLE columnar_chunk_group_delete (a int, b text) USING columnar;
+INSERT INTO columnar_chunk_group_delete SELECT g, g::text FROM generate_series(1, 10000) g;
+RESET columnar.chunk_group_row_limit;
+DELETE FROM columnar_chunk_group_delete WHERE a % 1000 = 0;
+DO $$
+DECLARE
+  deleted bigint;
+BEGIN
+  DELETE FROM columnar_chunk_group_delete WHERE a > 500 AND a <= 4500;
+  GET DIAGNOSTICS deleted = ROW_COUNT;
+  RAISE NOTICE 'deleted % rows', deleted;
+END $$;
+SELECT count(*), sum(a) FROM columnar_chunk_group_delete;
+SELECT count(*) FROM columnar_chunk_group_delete WHERE a <= 5000;
+SET columnar.enable_chunk_group_delete TO false;
+DO $$
+DECLARE
+  deleted bigint;
+BEGIN
+  DELETE FROM columnar_chunk_group_delete WHERE a > 6000 AND a <= 8000;
+  GET DIAGNOSTICS deleted = ROW_COUNT;
+  RAISE NOTICE 'deleted % rows', deleted;
+END $$;
+RESET columnar.enable_chunk_group_delete;
+SELECT count(*), sum(a) FROM columnar_chunk_group_delete;
+
+-- rows of deleted chunk groups count as deleted rows of the table, also
+-- when the subtransaction deleting them is rolled back
+TRUNCATE columnar_chunk_group_delete;
+INSERT INTO columnar_chunk_group_delete SELECT g, g::text FROM generate_series(1, 10000) g;
+BEGIN;
+DELETE FROM columnar_chunk_group_delete WHERE a <= 2000;
+SELECT n_tup_del FROM pg_stat_xact_user_tables
+WHERE relid = 'columnar_chunk_group_delete'::regclass;
+SAVEPOINT s1;
+DELETE FROM columnar_chunk_group_delete WHERE a > 2000 AND a <= 5000;
+SELECT n_tup_del FROM pg_stat_xact_user_tables
+WHERE relid = 'columnar_chunk_group_delete'::regclass;
+ROLLBACK TO SAVEPOINT s1;
+SELECT n_tup_del FROM pg_stat_xact_user_tables
+WHERE relid = 'columnar_chunk_group_delete'::regclass;
+DELETE FROM columnar_chunk_group_delete WHERE a > 5500 AND a <= 7000;
+SELECT n_tup_del FROM pg_stat_xact_user_tables
+WHERE relid = 'columnar_chunk_group_delete'::regclass;
+COMMIT;
+SELECT count(*), sum(a) FROM columnar_chunk_group_delete;
+DROP TABLE columnar_chunk_group_delete;
+
+-- updates only fetch the old values of the columns they don't assign
+CREATE TABLE columnar_update_fetch (a int, b text, c int) USING columnar;
+INSERT INTO columnar_update_fetch SELECT g, 'row ' || g, g * 10 FROM generate_series(1, 5) g;
+BEGIN;
+UPDATE columnar_update_fetch SET b = 'updated' WHERE a = 2;
+UPDATE columnar_update_fetch SET c = c + 1 WHERE a >= 4 RETURNING *;
+UPDATE columnar_update_fetch SET a = a * 100, b = b || '!' WHERE c = 30;
+COMMIT;
+SELECT * FROM columnar_update_fetch ORDER BY a;
+DROP TABLE columnar_update_fetch;
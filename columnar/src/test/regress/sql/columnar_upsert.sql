@@ -36,3 +36,15 @@ COMMIT;
 SELECT * FROM upsert_test;
 
 DROP TABLE upsert_test;
+
+-- upserting many conflicting rows writes their new versions to one stripe
+CREATE TABLE upsert_batch (k INT PRIMARY KEY, v INT) USING columnar;
+INSERT INTO upsert_batch SELECT i, 0 FROM generate_series(1, 10000) i;
+INSERT INTO upsert_batch SELECT i, 1 FROM generate_series(5001, 15000) i
+  ON CONFLICT (k) DO UPDATE SET v = upsert_batch.v + EXCLUDED.v + 1;
+
+SELECT v, COUNT(*) FROM upsert_batch GROUP BY v ORDER BY v;
+SELECT COUNT(*) FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('upsert_batch'::regclass);
+
+DROP TABLE upsert_batch;
@@ -242,4 +242,36 @@ VACUUM t;
 SELECT COUNT(*) = (:columnar_chunk_group_rows / 2) FROM columnar.chunk_group WHERE storage_id = :t_oid;
 SELECT COUNT(*) = (:columnar_row_mask_rows / 2) FROM columnar.row_mask WHERE storage_id = :t_oid;
 
-DROP TABLE t;
\ No newline at end of file
+DROP TABLE t;
+
+  -- Heavily deleted stripes before the last ones are only rewritten by
+  -- VACUUM with columnar.enable_vacuum_compaction on
+
+CREATE TABLE t(a INT) USING columnar;
+ALTER TABLE t SET (autovacuum_enabled = false);
+SELECT columnar.alter_columnar_table_set('t', stripe_row_limit => 1000);
+
+SELECT columnar_test_helpers.columnar_relation_storageid(pg_class.oid) AS t_oid FROM pg_class WHERE relname='t' \gset
+
+INSERT INTO t SELECT g FROM generate_series(1, 1000) g;
+INSERT INTO t SELECT g FROM generate_series(1001, 2000) g;
+INSERT INTO t SELECT g FROM generate_series(2001, 3000) g;
+
+DELETE FROM t WHERE a <= 1000 AND a % 2 = 0;
+
+SET columnar.enable_vacuum_compaction TO off;
+VACUUM t;
+SELECT count(*), sum(row_count) FROM columnar.stripe WHERE storage_id = :t_oid;
+SELECT sum(deleted_rows) FROM columnar.chunk_group WHERE storage_id = :t_oid;
+
+SET columnar.enable_vacuum_compaction TO on;
+VACUUM t;
+SELECT count(*), sum(row_count) FROM columnar.stripe WHERE storage_id = :t_oid;
+SELECT sum(deleted_rows) FROM columnar.chunk_group WHERE storage_id = :t_oid;
+
+RESET columnar.enable_vacuum_compaction;
+
+SELECT COUNT(*), SUM(a), MIN(a), MAX(a) FROM t;
+SELECT COUNT(*) FROM t WHERE a <= 1000 AND a % 2 = 0;
+
+DROP TABLE t;
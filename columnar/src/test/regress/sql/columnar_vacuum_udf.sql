@@ -89,3 +89,123 @@ SELECT columnar.vacuum('t1');
 SELECT count(i1), count(i2), count(i3), count(i4) FROM t1;
 
 DROP TABLE t1;
+
+-- stripes are rewritten once their deleted rows are above the threshold
+CREATE TABLE t1(a int) USING columnar;
+INSERT INTO t1 SELECT generate_series(1, 300000);
+INSERT INTO t1 VALUES (300001);
+DELETE FROM t1 WHERE a <= 150000 AND a % 2 = 0;
+
+SET columnar.vacuum_deleted_rows_threshold TO 0.6;
+SELECT columnar.vacuum('t1');
+SELECT count(*) FROM columnar.stats('t1'::regclass);
+
+RESET columnar.vacuum_deleted_rows_threshold;
+SELECT columnar.vacuum('t1') > 0 AS rewritten;
+SELECT count(*), sum(a) FROM t1;
+
+DROP TABLE t1;
+
+-- full chunk groups without deleted rows are copied, the rest is rewritten
+CREATE TABLE t1(a int, b text) USING columnar;
+INSERT INTO t1 SELECT i, 'v' || (i % 50) FROM generate_series(1, 100000) i;
+INSERT INTO t1 VALUES (100001, 'last');
+DELETE FROM t1 WHERE a BETWEEN 20001 AND 45000;
+
+SELECT columnar.vacuum('t1') > 0 AS rewritten;
+SELECT count(*), sum(a), count(DISTINCT b) FROM t1;
+SELECT row_count, chunk_group_count FROM columnar.stripe
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('t1'::regclass)
+ORDER BY stripe_num;
+
+DROP TABLE t1;
+
+-- online vacuums give the same rows
+CREATE TABLE t1(a int) USING columnar;
+INSERT INTO t1 SELECT generate_series(1, 1000);
+INSERT INTO t1 SELECT generate_series(1001, 2000);
+INSERT INTO t1 SELECT generate_series(2001, 3000);
+DELETE FROM t1 WHERE a % 3 = 0;
+
+SET columnar.online_vacuum TO on;
+SELECT columnar.vacuum('t1') > 0 AS rewritten;
+RESET columnar.online_vacuum;
+SELECT count(*), sum(a) FROM t1;
+
+DROP TABLE t1;
+
+-- throttled vacuums give the same rows
+CREATE TABLE t1(a int) USING columnar;
+INSERT INTO t1 SELECT generate_series(1, 1000);
+INSERT INTO t1 SELECT generate_series(1001, 2000);
+INSERT INTO t1 SELECT generate_series(2001, 3000);
+DELETE FROM t1 WHERE a % 3 = 0;
+
+SELECT columnar.vacuum('t1', cost_delay => 1, cost_limit => 10000) > 0 AS rewritten;
+SELECT count(*), sum(a) FROM t1;
+SELECT columnar.vacuum('t1', cost_delay => 500);
+
+DROP TABLE t1;
+
+-- space of removed stripes is reused once no snapshot can see them
+CREATE TABLE t1(a int) USING columnar;
+SELECT columnar.alter_columnar_table_set('t1', stripe_row_limit => 1000);
+INSERT INTO t1 SELECT generate_series(1, 1000);
+INSERT INTO t1 SELECT generate_series(1001, 2000);
+INSERT INTO t1 SELECT generate_series(2001, 3000);
+
+BEGIN;
+DECLARE old_rows CURSOR FOR SELECT count(*), sum(a) FROM t1 WHERE a <= 1000;
+DELETE FROM t1 WHERE a <= 1000;
+SELECT columnar.vacuum('t1');
+SELECT reserved_offset AS reserved_offset
+FROM columnar_test_helpers.columnar_storage_info('t1') \gset
+
+-- the cursor still sees the removed stripe, so its space isn't reused yet
+INSERT INTO t1 SELECT generate_series(3001, 3100);
+SELECT reserved_offset > :reserved_offset AS extended
+FROM columnar_test_helpers.columnar_storage_info('t1');
+FETCH old_rows;
+COMMIT;
+
+-- once its metadata rows are pruned, a later vacuum records it as free
+VACUUM columnar.stripe;
+SELECT columnar.vacuum('t1');
+SELECT reserved_offset AS reserved_offset
+FROM columnar_test_helpers.columnar_storage_info('t1') \gset
+
+INSERT INTO t1 SELECT generate_series(3101, 3200);
+SELECT reserved_offset = :reserved_offset AS reused
+FROM columnar_test_helpers.columnar_storage_info('t1');
+
+SELECT count(*), sum(a), min(a), max(a) FROM t1;
+SELECT count(*), sum(a) FROM t1 WHERE a > 3100;
+
+DROP TABLE t1;
+
+-- the compaction workers combine undersized stripes the same way
+CREATE TABLE t1(a int) USING columnar;
+INSERT INTO t1 SELECT generate_series(1, 100);
+INSERT INTO t1 SELECT generate_series(101, 200);
+INSERT INTO t1 SELECT generate_series(201, 300);
+INSERT INTO t1 SELECT generate_series(301, 400);
+INSERT INTO t1 SELECT generate_series(401, 500);
+INSERT INTO t1 SELECT generate_series(501, 600);
+INSERT INTO t1 SELECT generate_series(601, 700);
+INSERT INTO t1 SELECT generate_series(701, 800);
+INSERT INTO t1 SELECT generate_series(801, 900);
+INSERT INTO t1 SELECT generate_series(901, 1000);
+INSERT INTO t1 SELECT generate_series(1001, 1100);
+INSERT INTO t1 SELECT generate_series(1101, 1200);
+
+SELECT columnar_test_helpers.columnar_relation_storageid('t1'::regclass) AS storage_id \gset
+SELECT count(*) FROM columnar.stripe WHERE storage_id = :storage_id;
+
+SELECT columnar_test_helpers.columnar_compact_relation('t1');
+SELECT count(*) FROM columnar.stripe WHERE storage_id = :storage_id;
+SELECT count(*), sum(a), min(a), max(a) FROM t1;
+
+-- nothing is left to combine
+SELECT columnar_test_helpers.columnar_compact_relation('t1');
+
+DROP TABLE t1;
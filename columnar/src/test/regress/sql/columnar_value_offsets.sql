@@ -0,0 +1,30 @@
+CREATE SCHEMA columnar_value_offsets;
+SET search_path TO columnar_value_offsets;
+
+CREATE TABLE test_offsets (a int, b text) USING columnar;
+
+SET columnar.enable_value_offsets TO on;
+INSERT INTO test_offsets
+SELECT i, CASE WHEN i % 7 <> 0 THEN repeat('x', i % 37) || i END
+FROM generate_series(1, 20000) i;
+RESET columnar.enable_value_offsets;
+
+SELECT columnar_test_helpers.columnar_relation_storageid(oid) AS test_offsets_storage_id
+FROM pg_class WHERE relname = 'test_offsets' \gset
+
+-- the high cardinality text column stores the offsets of its values
+SELECT DISTINCT attr_num, value_encoding_type FROM columnar.chunk
+WHERE storage_id = :test_offsets_storage_id ORDER BY attr_num;
+
+SELECT count(*), count(b), sum(length(b)) FROM test_offsets;
+SELECT a, b FROM test_offsets WHERE a IN (1, 7, 9999, 20000) ORDER BY a;
+
+-- single rows are fetched through their offsets
+CREATE INDEX test_offsets_a_idx ON test_offsets (a);
+SET enable_seqscan TO off;
+SELECT b FROM test_offsets WHERE a = 12345;
+SELECT b FROM test_offsets WHERE a = 14;
+RESET enable_seqscan;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_value_offsets CASCADE;
@@ -0,0 +1,58 @@
+--
+-- Test vectorized quals in the scans of UPDATE and DELETE
+--
+CREATE SCHEMA columnar_vectorized_dml;
+SET search_path TO columnar_vectorized_dml;
+
+CREATE FUNCTION vectorized_filter(query text) RETURNS text AS $$
+DECLARE
+    rec text;
+    result text := NULL;
+BEGIN
+    FOR rec IN EXECUTE 'EXPLAIN (costs off) ' || query LOOP
+        IF rec ~ 'Columnar Vectorized Filter' THEN
+            result := regexp_replace(rec, '^ *Columnar Vectorized Filter: ', '');
+        END IF;
+    END LOOP;
+    RETURN result;
+END;
+$$ LANGUAGE plpgsql;
+
+SET columnar.enable_parallel_execution TO false;
+
+CREATE TABLE events (id int, ts timestamp, note text, amount int) USING columnar;
+SELECT columnar.alter_columnar_table_set('events', chunk_group_row_limit => 1000);
+INSERT INTO events
+SELECT g, '2024-01-01'::timestamp + g * interval '1 minute',
+       CASE WHEN g % 3 = 0 THEN NULL ELSE 'note ' || g END, g % 100
+FROM generate_series(1, 10000) g;
+
+SELECT vectorized_filter($$DELETE FROM events WHERE id > 9500$$);
+SELECT vectorized_filter($$UPDATE events SET amount = amount + 1
+                           WHERE id BETWEEN 2001 AND 3000$$);
+
+-- rows keep the columns the update doesn't read
+BEGIN;
+UPDATE events SET amount = amount + 1000
+WHERE ts BETWEEN '2024-01-02' AND '2024-01-03';
+SELECT count(*), sum(amount), count(note), min(id), max(id)
+FROM events WHERE amount >= 1000;
+SELECT id, note, amount FROM events WHERE id IN (1439, 1440, 2880, 2881) ORDER BY id;
+ROLLBACK;
+
+UPDATE events SET note = upper(note) WHERE id % 1000 = 7 AND amount = 7;
+SELECT id, note, amount FROM events WHERE note LIKE 'NOTE%' ORDER BY id;
+
+DELETE FROM events WHERE id > 9500;
+DELETE FROM events WHERE amount < 50 AND note IS NULL;
+SELECT count(*), sum(id), count(note), sum(amount) FROM events;
+
+-- the same without vectorization
+SET columnar.enable_vectorization TO false;
+SELECT vectorized_filter($$DELETE FROM events WHERE id > 9000$$);
+DELETE FROM events WHERE id > 9000;
+SELECT count(*), sum(id), count(note), sum(amount) FROM events;
+RESET columnar.enable_vectorization;
+
+SET client_min_messages TO warning;
+DROP SCHEMA columnar_vectorized_dml CASCADE;
@@ -39,6 +39,16 @@ SELECT data_length AS size_comp_level_19 FROM columnar.stripe WHERE storage_id =
 -- verify that higher compression level compressed better
 SELECT :size_comp_level_default > :size_comp_level_19 AS size_changed;
 
+-- negative levels are zstd's fast levels
+SELECT columnar.alter_columnar_table_set('test_zstd', compression_level => -5);
+VACUUM FULL test_zstd;
+
+SELECT data_length AS size_comp_level_fast FROM columnar.stripe WHERE storage_id = (
+    SELECT storage_id from columnar_test_helpers.columnar_storage_info('test_zstd')) \gset
+
+SELECT :size_comp_level_fast > :size_comp_level_default AS size_changed;
+SELECT count(DISTINCT test_zstd.*) FROM test_zstd;
+
 -- compare compression rate to pglz
 SET columnar.compression TO 'pglz';
 CREATE TABLE test_pglz (LIKE test_zstd) USING columnar;
@@ -54,6 +64,107 @@ SELECT :size_pglz > :size_comp_level_default;
 ANALYZE test_zstd;
 SELECT count(DISTINCT test_zstd.*) FROM test_zstd;
 
+-- decompressions are counted per compression type
+SELECT chunks > 0 AS decompressed, decompressed_bytes > compressed_bytes AS expanded,
+       decompression_time_ms >= 0 AS timed
+FROM columnar.decompression_stats() WHERE compression = 'zstd';
+
+-- the next chunk group can be decompressed by a helper thread
+SET columnar.enable_decompression_thread TO on;
+SELECT count(*) FROM test_zstd;
+SELECT count(*) AS differences FROM (
+    (SELECT * FROM test_zstd EXCEPT ALL SELECT * FROM test_none)
+    UNION ALL
+    (SELECT * FROM test_none EXCEPT ALL SELECT * FROM test_zstd)) AS d;
+RESET columnar.enable_decompression_thread;
+
+-- the columns of a chunk group can be decompressed by a pool of threads
+SET columnar.enable_column_cache TO off;
+SET columnar.column_decompression_threads TO 4;
+SELECT count(*) AS differences FROM (
+    (SELECT * FROM test_zstd EXCEPT ALL SELECT * FROM test_none)
+    UNION ALL
+    (SELECT * FROM test_none EXCEPT ALL SELECT * FROM test_zstd)) AS d;
+RESET columnar.column_decompression_threads;
+RESET columnar.enable_column_cache;
+
+-- chunk groups being written can be compressed by a helper thread
+SET columnar.compression TO 'zstd';
+SET columnar.enable_compression_thread TO on;
+CREATE TABLE test_zstd_thread (LIKE test_zstd) USING columnar;
+INSERT INTO test_zstd_thread SELECT * FROM test_none;
+RESET columnar.enable_compression_thread;
+SELECT count(*) AS differences FROM (
+    (SELECT * FROM test_zstd_thread EXCEPT ALL SELECT * FROM test_none)
+    UNION ALL
+    (SELECT * FROM test_none EXCEPT ALL SELECT * FROM test_zstd_thread)) AS d;
+SELECT bool_or(value_compression_type = 3) AS has_zstd
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_zstd_thread'::regclass);
+
+-- chunks above zstd's minimum job size can be compressed by zstd's threads
+CREATE TABLE test_zstd_serial (a int, b text) USING columnar;
+INSERT INTO test_zstd_serial SELECT i, repeat(md5(i::text), 8) FROM generate_series(1, 20000) i;
+SET columnar.compression_workers TO 2;
+CREATE TABLE test_zstd_workers (LIKE test_zstd_serial) USING columnar;
+INSERT INTO test_zstd_workers SELECT * FROM test_zstd_serial;
+RESET columnar.compression_workers;
+SELECT count(*) AS differences FROM (
+    (SELECT * FROM test_zstd_workers EXCEPT ALL SELECT * FROM test_zstd_serial)
+    UNION ALL
+    (SELECT * FROM test_zstd_serial EXCEPT ALL SELECT * FROM test_zstd_workers)) AS d;
+SELECT bool_and(value_compression_type = 3) AS all_zstd,
+       min(value_decompressed_length) > 1024 * 1024 AS above_job_size
+FROM columnar.chunk
+WHERE storage_id = columnar_test_helpers.columnar_relation_storageid('test_zstd_workers'::regclass)
+      AND attr_num = 2;
+
+-- lz4 and zstd columns of a chunk group can be compressed by a pool of
+-- threads, while pglz and dictionary compressed columns stay in the backend
+CREATE TABLE test_column_threads (batch int, a int, b text, c text, d text, e text) USING columnar;
+SELECT columnar.alter_columnar_table_set('test_column_threads', compression => 'zstd',
+                                         chunk_group_row_limit => 1000,
+                                         column_compression => '{b=lz4,c=pglz,d=zstd}');
+SELECT columnar_test_helpers.columnar_relation_storageid('test_column_threads'::regclass) AS storage_id \gset
+INSERT INTO test_column_threads
+SELECT 0, i, repeat('b', 40) || md5(i::text), repeat('c', 40) || md5(i::text),
+       repeat('d', 40) || md5(i::text), 'customer ' || i || ' ordered item ' || (i % 97)
+FROM generate_series(1, 20000) i;
+SELECT columnar.train_compression_dictionary('test_column_threads', 'e',
+                                             dictionary_size => 4096) > 0 AS trained;
+
+INSERT INTO test_column_threads
+SELECT 1, i, repeat('b', 40) || md5(i::text), repeat('c', 40) || md5(i::text),
+       repeat('d', 40) || md5(i::text), 'customer ' || i || ' ordered item ' || (i % 97)
+FROM generate_series(1, 10000) i;
+SELECT max(stripe_num) AS serial_stripe FROM columnar.stripe WHERE storage_id = :storage_id \gset
+SET columnar.column_compression_threads TO 4;
+INSERT INTO test_column_threads
+SELECT 2, i, repeat('b', 40) || md5(i::text), repeat('c', 40) || md5(i::text),
+       repeat('d', 40) || md5(i::text), 'customer ' || i || ' ordered item ' || (i % 97)
+FROM generate_series(1, 10000) i;
+RESET columnar.column_compression_threads;
+SELECT max(stripe_num) AS threaded_stripe FROM columnar.stripe WHERE storage_id = :storage_id \gset
+
+SELECT count(*) AS differences FROM (
+    (SELECT a, b, c, d, e FROM test_column_threads WHERE batch = 2
+     EXCEPT ALL SELECT a, b, c, d, e FROM test_column_threads WHERE batch = 1)
+    UNION ALL
+    (SELECT a, b, c, d, e FROM test_column_threads WHERE batch = 1
+     EXCEPT ALL SELECT a, b, c, d, e FROM test_column_threads WHERE batch = 2)) AS d;
+SELECT attr_num, value_compression_type, compression_dictionary_id > 0 AS uses_dictionary,
+       count(*)
+FROM columnar.chunk
+WHERE storage_id = :storage_id AND stripe_num = :threaded_stripe AND attr_num > 2
+GROUP BY 1, 2, 3 ORDER BY 1, 2, 3;
+-- the threads compress every chunk the way the backend does
+SELECT count(*) AS different_chunks
+FROM columnar.chunk threaded JOIN columnar.chunk serial USING (storage_id, attr_num, chunk_group_num)
+WHERE storage_id = :storage_id AND threaded.stripe_num = :threaded_stripe AND
+      serial.stripe_num = :serial_stripe AND
+      (threaded.value_compression_type <> serial.value_compression_type OR
+       threaded.compression_dictionary_id <> serial.compression_dictionary_id);
+
 TRUNCATE test_zstd;
 
 SELECT count(DISTINCT test_zstd.*) FROM test_zstd;